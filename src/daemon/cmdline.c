@@ -53,6 +53,7 @@ enum {
     ARG_LOG_TARGET,
     ARG_LOG_META,
     ARG_LOG_TIME,
+    ARG_LOG_ASYNC,
     ARG_LOG_BACKTRACE,
     ARG_LOAD,
     ARG_FILE,
@@ -63,6 +64,7 @@ enum {
     ARG_CHECK,
     ARG_NO_CPU_LIMIT,
     ARG_DISABLE_SHM,
+    ARG_PERF_COUNTERS,
     ARG_DUMP_RESAMPLE_METHODS,
     ARG_SYSTEM,
     ARG_CLEANUP_SHM,
@@ -88,6 +90,7 @@ static const struct option long_options[] = {
     {"log-target",                  1, 0, ARG_LOG_TARGET},
     {"log-meta",                    2, 0, ARG_LOG_META},
     {"log-time",                    2, 0, ARG_LOG_TIME},
+    {"log-async",                   2, 0, ARG_LOG_ASYNC},
     {"log-backtrace",               1, 0, ARG_LOG_BACKTRACE},
     {"load",                        1, 0, ARG_LOAD},
     {"file",                        1, 0, ARG_FILE},
@@ -100,6 +103,7 @@ static const struct option long_options[] = {
     {"system",                      2, 0, ARG_SYSTEM},
     {"no-cpu-limit",                2, 0, ARG_NO_CPU_LIMIT},
     {"disable-shm",                 2, 0, ARG_DISABLE_SHM},
+    {"enable-perf-counters",        2, 0, ARG_PERF_COUNTERS},
     {"dump-resample-methods",       2, 0, ARG_DUMP_RESAMPLE_METHODS},
     {"cleanup-shm",                 2, 0, ARG_CLEANUP_SHM},
     {NULL, 0, 0, 0}
@@ -143,6 +147,8 @@ void pa_cmdline_help(const char *argv0) {
            "                                        Specify the log target\n"
            "      --log-meta[=BOOL]                 Include code location in log messages\n"
            "      --log-time[=BOOL]                 Include timestamps in log messages\n"
+           "      --log-async[=BOOL]                Write log messages of IO threads from\n"
+           "                                        a separate thread\n"
            "      --log-backtrace=FRAMES            Include a backtrace in log messages\n"
            "  -p, --dl-search-path=PATH             Set the search path for dynamic shared\n"
            "                                        objects (plugins)\n"
@@ -152,7 +158,9 @@ void pa_cmdline_help(const char *argv0) {
            "      --use-pid-file[=BOOL]             Create a PID file\n"
            "      --no-cpu-limit[=BOOL]             Do not install CPU load limiter on\n"
            "                                        platforms that support it.\n"
-           "      --disable-shm[=BOOL]              Disable shared memory support.\n\n"
+           "      --disable-shm[=BOOL]              Disable shared memory support.\n"
+           "      --enable-perf-counters[=BOOL]     Count CPU events of the IO threads\n"
+           "                                        for the stat command.\n\n"
 
            "STARTUP SCRIPT:\n"
            "  -L, --load=\"MODULE ARGUMENTS\"         Load the specified plugin module with\n"
@@ -338,6 +346,14 @@ int pa_cmdline_parse(pa_daemon_conf *conf, int argc, char *const argv [], int *d
                 conf->log_time = !!b;
                 break;
 
+            case ARG_LOG_ASYNC:
+                if ((b = optarg ? pa_parse_boolean(optarg) : 1) < 0) {
+                    pa_log(_("--log-async expects boolean argument"));
+                    goto fail;
+                }
+                conf->log_async = !!b;
+                break;
+
             case ARG_LOG_META:
                 if ((b = optarg ? pa_parse_boolean(optarg) : 1) < 0) {
                     pa_log(_("--log-meta expects boolean argument"));
@@ -389,6 +405,14 @@ int pa_cmdline_parse(pa_daemon_conf *conf, int argc, char *const argv [], int *d
                 conf->disable_shm = !!b;
                 break;
 
+            case ARG_PERF_COUNTERS:
+                if ((b = optarg ? pa_parse_boolean(optarg) : 1) < 0) {
+                    pa_log(_("--enable-perf-counters expects boolean argument"));
+                    goto fail;
+                }
+                conf->perf_counters = !!b;
+                break;
+
             default:
                 goto fail;
         }
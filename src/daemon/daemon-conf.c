@@ -66,6 +66,8 @@ static const pa_daemon_conf default_conf = {
     .nice_level = -11,
     .realtime_scheduling = true,
     .realtime_priority = 5,  /* Half of JACK's default rtprio */
+    .deadline_scheduling = false,
+    .timer_slack_usec = 500,
     .disallow_module_loading = false,
     .disallow_exit = false,
     .flat_volumes = true,
@@ -80,10 +82,13 @@ static const pa_daemon_conf default_conf = {
     .log_backtrace = 0,
     .log_meta = false,
     .log_time = false,
+    .log_async = false,
     .resample_method = PA_RESAMPLER_AUTO,
     .disable_remixing = false,
     .disable_lfe_remixing = false,
+    .avoid_resampling = false,
     .lfe_crossover_freq = 120,
+    .resampler_timing = false,
     .config_file = NULL,
     .use_pid_file = true,
     .system_instance = false,
@@ -92,7 +97,18 @@ static const pa_daemon_conf default_conf = {
 #endif
     .no_cpu_limit = true,
     .disable_shm = false,
+    .perf_counters = false,
     .lock_memory = false,
+    .lock_memory_pools = false,
+    .memblock_thread_cache = false,
+    .cpu_autotune = false,
+    .shm_huge_pages = false,
+    .shm_numa_node = -1,
+    .shm_max_segments = 4,
+    .dsp_worker_threads = -1,
+    .shared_io_threads = 0,
+    .client_command_rate = 1000,
+    .client_command_burst = 200,
     .deferred_volume = true,
     .default_n_fragments = 4,
     .default_fragment_size_msec = 25,
@@ -168,6 +184,8 @@ void pa_daemon_conf_free(pa_daemon_conf *c) {
     pa_xfree(c->script_commands);
     pa_xfree(c->dl_search_path);
     pa_xfree(c->default_script_file);
+    pa_xfree(c->startup_trace_file);
+    pa_xfree(c->io_thread_cpus);
 
     if (c->log_target)
         pa_log_target_free(c->log_target);
@@ -487,6 +505,95 @@ static int parse_rtprio(pa_config_parser_state *state) {
     return 0;
 }
 
+static int parse_io_thread_cpus(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    pa_xfree(c->io_thread_cpus);
+    c->io_thread_cpus = pa_streq(state->rvalue, "none") ? NULL : pa_xstrdup(state->rvalue);
+
+    return 0;
+}
+
+static int parse_dsp_worker_threads(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+    uint32_t n;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if (pa_streq(state->rvalue, "auto"))
+        c->dsp_worker_threads = -1;
+    else if (pa_atou(state->rvalue, &n) < 0 || n > 256) {
+        pa_log("[%s:%u] Invalid number of DSP worker threads '%s'.", state->filename, state->lineno, state->rvalue);
+        return -1;
+    } else
+        c->dsp_worker_threads = (int) n;
+
+    return 0;
+}
+
+static int parse_shared_io_threads(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+    uint32_t n;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if (pa_atou(state->rvalue, &n) < 0 || n > 64) {
+        pa_log("[%s:%u] Invalid number of shared IO threads '%s'.", state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    c->shared_io_threads = n;
+
+    return 0;
+}
+
+static int parse_client_command_rate(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+    uint32_t n;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if (pa_atou(state->rvalue, &n) < 0 || n > 1000000) {
+        pa_log("[%s:%u] Invalid client command rate '%s'.", state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    c->client_command_rate = n;
+
+    return 0;
+}
+
+static int parse_numa_node(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+    int32_t node;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if (pa_streq(state->rvalue, "auto"))
+        c->shm_numa_node = -2;
+    else if (pa_streq(state->rvalue, "none"))
+        c->shm_numa_node = -1;
+    else if (pa_atoi(state->rvalue, &node) < 0 || node < 0) {
+        pa_log("[%s:%u] Invalid NUMA node '%s'.", state->filename, state->lineno, state->rvalue);
+        return -1;
+    } else
+        c->shm_numa_node = (int) node;
+
+    return 0;
+}
+
 #ifdef HAVE_DBUS
 static int parse_server_type(pa_config_parser_state *state) {
     pa_daemon_conf *c;
@@ -513,6 +620,13 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "fail",                       pa_config_parse_bool,     &c->fail, NULL },
         { "high-priority",              pa_config_parse_bool,     &c->high_priority, NULL },
         { "realtime-scheduling",        pa_config_parse_bool,     &c->realtime_scheduling, NULL },
+        { "deadline-scheduling",        pa_config_parse_bool,     &c->deadline_scheduling, NULL },
+        { "timer-slack-usec",           pa_config_parse_unsigned, &c->timer_slack_usec, NULL },
+        { "io-thread-cpus",             parse_io_thread_cpus,     c, NULL },
+        { "dsp-worker-threads",         parse_dsp_worker_threads, c, NULL },
+        { "shared-io-threads",          parse_shared_io_threads,  c, NULL },
+        { "client-command-rate",        parse_client_command_rate, c, NULL },
+        { "client-command-burst",       pa_config_parse_unsigned, &c->client_command_burst, NULL },
         { "disallow-module-loading",    pa_config_parse_bool,     &c->disallow_module_loading, NULL },
         { "allow-module-loading",       pa_config_parse_not_bool, &c->disallow_module_loading, NULL },
         { "disallow-exit",              pa_config_parse_bool,     &c->disallow_exit, NULL },
@@ -524,16 +638,23 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
 #endif
         { "no-cpu-limit",               pa_config_parse_bool,     &c->no_cpu_limit, NULL },
         { "cpu-limit",                  pa_config_parse_not_bool, &c->no_cpu_limit, NULL },
+        { "cpu-autotune",               pa_config_parse_bool,     &c->cpu_autotune, NULL },
         { "disable-shm",                pa_config_parse_bool,     &c->disable_shm, NULL },
         { "enable-shm",                 pa_config_parse_not_bool, &c->disable_shm, NULL },
+        { "enable-perf-counters",       pa_config_parse_bool,     &c->perf_counters, NULL },
         { "flat-volumes",               pa_config_parse_bool,     &c->flat_volumes, NULL },
         { "lock-memory",                pa_config_parse_bool,     &c->lock_memory, NULL },
+        { "lock-memory-pools",          pa_config_parse_bool,     &c->lock_memory_pools, NULL },
+        { "enable-memblock-thread-cache",
+                                        pa_config_parse_bool,     &c->memblock_thread_cache, NULL },
         { "enable-deferred-volume",     pa_config_parse_bool,     &c->deferred_volume, NULL },
         { "exit-idle-time",             pa_config_parse_int,      &c->exit_idle_time, NULL },
         { "scache-idle-time",           pa_config_parse_int,      &c->scache_idle_time, NULL },
+        { "scache-max-size-bytes",      pa_config_parse_size,     &c->scache_max_size, NULL },
         { "realtime-priority",          parse_rtprio,             c, NULL },
         { "dl-search-path",             pa_config_parse_string,   &c->dl_search_path, NULL },
         { "default-script-file",        pa_config_parse_string,   &c->default_script_file, NULL },
+        { "startup-trace-file",         pa_config_parse_string,   &c->startup_trace_file, NULL },
         { "log-target",                 parse_log_target,         c, NULL },
         { "log-level",                  parse_log_level,          c, NULL },
         { "verbose",                    parse_log_level,          c, NULL },
@@ -541,6 +662,7 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "default-sample-format",      parse_sample_format,      c, NULL },
         { "default-sample-rate",        parse_sample_rate,        c, NULL },
         { "alternate-sample-rate",      parse_alternate_sample_rate, c, NULL },
+        { "avoid-resampling",           pa_config_parse_bool,     &c->avoid_resampling, NULL },
         { "default-sample-channels",    parse_sample_channels,    &ci,  NULL },
         { "default-channel-map",        parse_channel_map,        &ci,  NULL },
         { "default-fragments",          parse_fragments,          c, NULL },
@@ -555,10 +677,15 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "disable-lfe-remixing",       pa_config_parse_bool,     &c->disable_lfe_remixing, NULL },
         { "enable-lfe-remixing",        pa_config_parse_not_bool, &c->disable_lfe_remixing, NULL },
         { "lfe-crossover-freq",         pa_config_parse_unsigned, &c->lfe_crossover_freq, NULL },
+        { "enable-resampler-timing",    pa_config_parse_bool,     &c->resampler_timing, NULL },
         { "load-default-script-file",   pa_config_parse_bool,     &c->load_default_script_file, NULL },
         { "shm-size-bytes",             pa_config_parse_size,     &c->shm_size, NULL },
+        { "shm-huge-pages",             pa_config_parse_bool,     &c->shm_huge_pages, NULL },
+        { "shm-max-segments",           pa_config_parse_unsigned, &c->shm_max_segments, NULL },
+        { "shm-numa-node",              parse_numa_node,          c, NULL },
         { "log-meta",                   pa_config_parse_bool,     &c->log_meta, NULL },
         { "log-time",                   pa_config_parse_bool,     &c->log_time, NULL },
+        { "log-async",                  pa_config_parse_bool,     &c->log_async, NULL },
         { "log-backtrace",              pa_config_parse_unsigned, &c->log_backtrace, NULL },
 #ifdef HAVE_SYS_RESOURCE_H
         { "rlimit-fsize",               parse_rlimit,             &c->rlimit_fsize, NULL },
@@ -726,6 +853,16 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "nice-level = %i\n", c->nice_level);
     pa_strbuf_printf(s, "realtime-scheduling = %s\n", pa_yes_no(c->realtime_scheduling));
     pa_strbuf_printf(s, "realtime-priority = %i\n", c->realtime_priority);
+    pa_strbuf_printf(s, "deadline-scheduling = %s\n", pa_yes_no(c->deadline_scheduling));
+    pa_strbuf_printf(s, "timer-slack-usec = %u\n", c->timer_slack_usec);
+    pa_strbuf_printf(s, "io-thread-cpus = %s\n", c->io_thread_cpus ? c->io_thread_cpus : "none");
+    if (c->dsp_worker_threads < 0)
+        pa_strbuf_puts(s, "dsp-worker-threads = auto\n");
+    else
+        pa_strbuf_printf(s, "dsp-worker-threads = %i\n", c->dsp_worker_threads);
+    pa_strbuf_printf(s, "shared-io-threads = %u\n", c->shared_io_threads);
+    pa_strbuf_printf(s, "client-command-rate = %u\n", c->client_command_rate);
+    pa_strbuf_printf(s, "client-command-burst = %u\n", c->client_command_burst);
     pa_strbuf_printf(s, "allow-module-loading = %s\n", pa_yes_no(!c->disallow_module_loading));
     pa_strbuf_printf(s, "allow-exit = %s\n", pa_yes_no(!c->disallow_exit));
     pa_strbuf_printf(s, "use-pid-file = %s\n", pa_yes_no(c->use_pid_file));
@@ -734,23 +871,31 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "local-server-type = %s\n", server_type_to_string[c->local_server_type]);
 #endif
     pa_strbuf_printf(s, "cpu-limit = %s\n", pa_yes_no(!c->no_cpu_limit));
+    pa_strbuf_printf(s, "cpu-autotune = %s\n", pa_yes_no(c->cpu_autotune));
     pa_strbuf_printf(s, "enable-shm = %s\n", pa_yes_no(!c->disable_shm));
+    pa_strbuf_printf(s, "enable-perf-counters = %s\n", pa_yes_no(c->perf_counters));
     pa_strbuf_printf(s, "flat-volumes = %s\n", pa_yes_no(c->flat_volumes));
     pa_strbuf_printf(s, "lock-memory = %s\n", pa_yes_no(c->lock_memory));
+    pa_strbuf_printf(s, "lock-memory-pools = %s\n", pa_yes_no(c->lock_memory_pools));
+    pa_strbuf_printf(s, "enable-memblock-thread-cache = %s\n", pa_yes_no(c->memblock_thread_cache));
     pa_strbuf_printf(s, "exit-idle-time = %i\n", c->exit_idle_time);
     pa_strbuf_printf(s, "scache-idle-time = %i\n", c->scache_idle_time);
+    pa_strbuf_printf(s, "scache-max-size-bytes = %lu\n", (unsigned long) c->scache_max_size);
     pa_strbuf_printf(s, "dl-search-path = %s\n", pa_strempty(c->dl_search_path));
     pa_strbuf_printf(s, "default-script-file = %s\n", pa_strempty(pa_daemon_conf_get_default_script_file(c)));
     pa_strbuf_printf(s, "load-default-script-file = %s\n", pa_yes_no(c->load_default_script_file));
+    pa_strbuf_printf(s, "startup-trace-file = %s\n", pa_strempty(c->startup_trace_file));
     pa_strbuf_printf(s, "log-target = %s\n", pa_strempty(log_target));
     pa_strbuf_printf(s, "log-level = %s\n", log_level_to_string[c->log_level]);
     pa_strbuf_printf(s, "resample-method = %s\n", pa_resample_method_to_string(c->resample_method));
     pa_strbuf_printf(s, "enable-remixing = %s\n", pa_yes_no(!c->disable_remixing));
     pa_strbuf_printf(s, "enable-lfe-remixing = %s\n", pa_yes_no(!c->disable_lfe_remixing));
     pa_strbuf_printf(s, "lfe-crossover-freq = %u\n", c->lfe_crossover_freq);
+    pa_strbuf_printf(s, "enable-resampler-timing = %s\n", pa_yes_no(c->resampler_timing));
     pa_strbuf_printf(s, "default-sample-format = %s\n", pa_sample_format_to_string(c->default_sample_spec.format));
     pa_strbuf_printf(s, "default-sample-rate = %u\n", c->default_sample_spec.rate);
     pa_strbuf_printf(s, "alternate-sample-rate = %u\n", c->alternate_sample_rate);
+    pa_strbuf_printf(s, "avoid-resampling = %s\n", pa_yes_no(c->avoid_resampling));
     pa_strbuf_printf(s, "default-sample-channels = %u\n", c->default_sample_spec.channels);
     pa_strbuf_printf(s, "default-channel-map = %s\n", pa_channel_map_snprint(cm, sizeof(cm), &c->default_channel_map));
     pa_strbuf_printf(s, "default-fragments = %u\n", c->default_n_fragments);
@@ -759,8 +904,17 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "deferred-volume-safety-margin-usec = %u\n", c->deferred_volume_safety_margin_usec);
     pa_strbuf_printf(s, "deferred-volume-extra-delay-usec = %d\n", c->deferred_volume_extra_delay_usec);
     pa_strbuf_printf(s, "shm-size-bytes = %lu\n", (unsigned long) c->shm_size);
+    pa_strbuf_printf(s, "shm-huge-pages = %s\n", pa_yes_no(c->shm_huge_pages));
+    pa_strbuf_printf(s, "shm-max-segments = %u\n", c->shm_max_segments);
+    if (c->shm_numa_node == -2)
+        pa_strbuf_puts(s, "shm-numa-node = auto\n");
+    else if (c->shm_numa_node < 0)
+        pa_strbuf_puts(s, "shm-numa-node = none\n");
+    else
+        pa_strbuf_printf(s, "shm-numa-node = %i\n", c->shm_numa_node);
     pa_strbuf_printf(s, "log-meta = %s\n", pa_yes_no(c->log_meta));
     pa_strbuf_printf(s, "log-time = %s\n", pa_yes_no(c->log_time));
+    pa_strbuf_printf(s, "log-async = %s\n", pa_yes_no(c->log_async));
     pa_strbuf_printf(s, "log-backtrace = %u\n", c->log_backtrace);
 #ifdef HAVE_SYS_RESOURCE_H
     pa_strbuf_printf(s, "rlimit-fsize = %li\n", c->rlimit_fsize.is_set ? (long int) c->rlimit_fsize.value : -1);
@@ -61,27 +61,39 @@ typedef struct pa_daemon_conf {
         fail,
         high_priority,
         realtime_scheduling,
+        deadline_scheduling,
         disallow_module_loading,
         use_pid_file,
         system_instance,
         no_cpu_limit,
         disable_shm,
+        perf_counters,
         disable_remixing,
         disable_lfe_remixing,
+        avoid_resampling,
+        resampler_timing,
         load_default_script_file,
         disallow_exit,
         log_meta,
         log_time,
+        log_async,
         flat_volumes,
         lock_memory,
-        deferred_volume;
+        lock_memory_pools,
+        deferred_volume,
+        memblock_thread_cache,
+        cpu_autotune,
+        shm_huge_pages;
     pa_server_type_t local_server_type;
+    unsigned timer_slack_usec;
     int exit_idle_time,
         scache_idle_time,
         realtime_priority,
         nice_level,
         resample_method;
     char *script_commands, *dl_search_path, *default_script_file;
+    char *startup_trace_file;
+    char *io_thread_cpus;
     pa_log_target *log_target;
     pa_log_level_t log_level;
     unsigned log_backtrace;
@@ -132,6 +144,12 @@ typedef struct pa_daemon_conf {
     uint32_t alternate_sample_rate;
     pa_channel_map default_channel_map;
     size_t shm_size;
+    size_t scache_max_size;
+    int shm_numa_node; /* -1 for none, -2 for auto */
+    int dsp_worker_threads; /* -1 for auto */
+    unsigned shared_io_threads;
+    unsigned shm_max_segments;
+    unsigned client_command_rate, client_command_burst;
 } pa_daemon_conf;
 
 /* Allocate a new structure and fill it with sane defaults */
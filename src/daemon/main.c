@@ -63,6 +63,7 @@
 #include <pulse/client-conf.h>
 #include <pulse/mainloop.h>
 #include <pulse/mainloop-signal.h>
+#include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
@@ -73,6 +74,7 @@
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-scache.h>
 #include <pulsecore/core.h>
+#include <pulsecore/startup-trace.h>
 #include <pulsecore/module.h>
 #include <pulsecore/cli-command.h>
 #include <pulsecore/log.h>
@@ -85,10 +87,12 @@
 #include <pulsecore/shm.h>
 #include <pulsecore/memtrap.h>
 #include <pulsecore/strlist.h>
+#include <pulsecore/thread.h>
 #ifdef HAVE_DBUS
 #include <pulsecore/dbus-shared.h>
 #endif
 #include <pulsecore/cpu.h>
+#include <pulsecore/cpu-autotune.h>
 
 #include "cmdline.h"
 #include "cpulimit.h"
@@ -384,6 +388,7 @@ int main(int argc, char *argv[]) {
 #endif
     int autospawn_fd = -1;
     bool autospawn_locked = false;
+    pa_usec_t startup_time = pa_rtclock_now(), trace_begin;
 #ifdef HAVE_DBUS
     pa_dbusobj_server_lookup *server_lookup = NULL; /* /org/pulseaudio/server_lookup */
     pa_dbus_connection *lookup_service_bus = NULL; /* Always the user bus. */
@@ -472,6 +477,11 @@ int main(int argc, char *argv[]) {
     setlocale(LC_ALL, "");
     pa_init_i18n();
 
+    /* Whether the trace is written is only known after parsing the
+     * configuration, which is part of what is traced */
+    pa_startup_trace_start();
+    trace_begin = pa_startup_trace_begin();
+
     conf = pa_daemon_conf_new();
 
     if (pa_daemon_conf_load(conf, NULL) < 0)
@@ -485,6 +495,8 @@ int main(int argc, char *argv[]) {
         goto finish;
     }
 
+    pa_startup_trace_end(trace_begin, "daemon", "configuration");
+
     if (conf->log_target)
         pa_log_set_target(conf->log_target);
     else {
@@ -893,7 +905,7 @@ int main(int argc, char *argv[]) {
 #ifdef HAVE_SYS_RESOURCE_H
     set_all_rlimits(conf);
 #endif
-    pa_rtclock_hrtimer_enable();
+    pa_rtclock_hrtimer_enable(conf->timer_slack_usec);
 
     if (conf->high_priority)
         pa_raise_priority(conf->nice_level);
@@ -1015,13 +1027,25 @@ int main(int argc, char *argv[]) {
 
     pa_memtrap_install();
 
+    /* After daemonizing, threads don't survive a fork */
+    if (conf->log_async && pa_log_start_async() < 0)
+        pa_log_warn("Failed to start the logging thread, logging synchronously.");
+
     pa_assert_se(mainloop = pa_mainloop_new());
 
-    if (!(c = pa_core_new(pa_mainloop_get_api(mainloop), !conf->disable_shm, conf->shm_size))) {
+    trace_begin = pa_startup_trace_begin();
+
+    /* Before any IO thread is started, they open their counters themselves */
+    pa_thread_enable_perf_counters(conf->perf_counters);
+
+    if (!(c = pa_core_new(pa_mainloop_get_api(mainloop), !conf->disable_shm, conf->shm_size,
+                          conf->shm_huge_pages, conf->shm_numa_node >= 0 ? conf->shm_numa_node : -1))) {
         pa_log(_("pa_core_new() failed."));
         goto finish;
     }
 
+    pa_startup_trace_end(trace_begin, "daemon", "core");
+
     c->default_sample_spec = conf->default_sample_spec;
     c->alternate_sample_rate = conf->alternate_sample_rate;
     c->default_channel_map = conf->default_channel_map;
@@ -1032,12 +1056,24 @@ int main(int argc, char *argv[]) {
     c->lfe_crossover_freq = conf->lfe_crossover_freq;
     c->exit_idle_time = conf->exit_idle_time;
     c->scache_idle_time = conf->scache_idle_time;
+    c->scache_max_size = conf->scache_max_size;
     c->resample_method = conf->resample_method;
     c->realtime_priority = conf->realtime_priority;
     c->realtime_scheduling = conf->realtime_scheduling;
+    c->deadline_scheduling = conf->deadline_scheduling;
+    c->io_thread_cpus = pa_xstrdup(conf->io_thread_cpus);
+    c->dsp_worker_threads = conf->dsp_worker_threads;
+    c->shared_io_threads = conf->shared_io_threads;
+    c->client_command_rate = conf->client_command_rate;
+    c->client_command_burst = conf->client_command_burst;
     c->disable_remixing = conf->disable_remixing;
     c->disable_lfe_remixing = conf->disable_lfe_remixing;
+    c->avoid_resampling = conf->avoid_resampling;
+    c->resampler_timing = conf->resampler_timing;
     c->deferred_volume = conf->deferred_volume;
+    c->memblock_thread_cache = conf->memblock_thread_cache;
+    c->mempool_numa_node_auto = conf->shm_numa_node == -2;
+
     c->running_as_daemon = conf->daemonize;
     c->disallow_exit = conf->disallow_exit;
     c->flat_volumes = conf->flat_volumes;
@@ -1045,8 +1081,22 @@ int main(int argc, char *argv[]) {
     c->server_type = conf->local_server_type;
 #endif
 
+    pa_mempool_set_max_segments(c->mempool, PA_MAX(conf->shm_max_segments, 1U));
+    if (c->rw_mempool)
+        pa_mempool_set_max_segments(c->rw_mempool, PA_MAX(conf->shm_max_segments, 1U));
+
+    if (conf->lock_memory_pools)
+        pa_core_lock_mempools(c);
+
     pa_cpu_init(&c->cpu_info);
 
+    if (conf->cpu_autotune) {
+        char *cache = pa_state_path("cpu-autotune", false);
+
+        pa_cpu_autotune(&c->cpu_info, &c->default_sample_spec, cache);
+        pa_xfree(cache);
+    }
+
     pa_assert_se(pa_signal_init(pa_mainloop_get_api(mainloop)) == 0);
     pa_signal_new(SIGINT, signal_callback, c);
     pa_signal_new(SIGTERM, signal_callback, c);
@@ -1070,6 +1120,8 @@ int main(int argc, char *argv[]) {
 
     if (start_server) {
 #endif
+        trace_begin = pa_startup_trace_begin();
+
         if (conf->load_default_script_file) {
             FILE *f;
 
@@ -1082,6 +1134,8 @@ int main(int argc, char *argv[]) {
         if (r >= 0)
             r = pa_cli_command_execute(c, conf->script_commands, buf, &conf->fail);
 
+        pa_startup_trace_end(trace_begin, "daemon", "startup script");
+
         pa_log_error("%s", s = pa_strbuf_tostring_free(buf));
         pa_xfree(s);
 
@@ -1129,7 +1183,13 @@ int main(int argc, char *argv[]) {
     }
 #endif
 
-    pa_log_info("Daemon startup complete.");
+    /* Deferred modules are loaded from here on */
+    pa_log_info("Daemon startup complete after %0.1f ms.", (double) (pa_rtclock_now() - startup_time) / PA_USEC_PER_MSEC);
+
+    pa_startup_trace_stop();
+
+    if (conf->startup_trace_file)
+        pa_startup_trace_write(conf->startup_trace_file);
 
     retval = 0;
     if (pa_mainloop_run(mainloop, &retval) < 0)
@@ -1164,6 +1224,8 @@ finish:
         pa_log_info("Daemon terminated.");
     }
 
+    pa_log_stop_async();
+
     if (!conf->no_cpu_limit)
         pa_cpu_limit_done();
 
@@ -1187,6 +1249,8 @@ finish:
     if (conf)
         pa_daemon_conf_free(conf);
 
+    pa_startup_trace_free();
+
     if (valid_pid_file)
         pa_pid_file_remove();
 
@@ -23,6 +23,8 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
 #include <asoundlib.h>
 #include <math.h>
 
@@ -43,7 +45,11 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/conf-parser.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/database.h>
+#include <pulsecore/startup-trace.h>
 #include <pulsecore/strbuf.h>
+#include <pulsecore/tagstruct.h>
 
 #include "alsa-mixer.h"
 #include "alsa-util.h"
@@ -3393,6 +3399,7 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *ps) {
     if (ps->decibel_fixes)
         pa_hashmap_free(ps->decibel_fixes);
 
+    pa_xfree(ps->conf_path);
     pa_xfree(ps);
 }
 
@@ -3551,6 +3558,48 @@ static int mapping_parse_exact_channels(pa_config_parser_state *state) {
     return 0;
 }
 
+static int mapping_parse_intended_roles(pa_config_parser_state *state) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_mapping *m;
+
+    pa_assert(state);
+
+    ps = state->userdata;
+
+    if (!(m = pa_alsa_mapping_get(ps, state->section))) {
+        pa_log("[%s:%u] %s invalid in section %s", state->filename, state->lineno, state->lvalue, state->section);
+        return -1;
+    }
+
+    pa_proplist_sets(m->proplist, PA_PROP_DEVICE_INTENDED_ROLES, state->rvalue);
+
+    return 0;
+}
+
+static int mapping_parse_max_streams(pa_config_parser_state *state) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_mapping *m;
+    uint32_t n;
+
+    pa_assert(state);
+
+    ps = state->userdata;
+
+    if (!(m = pa_alsa_mapping_get(ps, state->section))) {
+        pa_log("[%s:%u] %s invalid in section %s", state->filename, state->lineno, state->lvalue, state->section);
+        return -1;
+    }
+
+    if (pa_atou(state->rvalue, &n) < 0 || n == 0) {
+        pa_log("[%s:%u] %s has invalid value '%s'", state->filename, state->lineno, state->lvalue, state->rvalue);
+        return -1;
+    }
+
+    pa_proplist_setf(m->proplist, "module-intended-roles.max-streams", "%u", n);
+
+    return 0;
+}
+
 static int mapping_parse_element(pa_config_parser_state *state) {
     pa_alsa_profile_set *ps;
     pa_alsa_mapping *m;
@@ -3842,14 +3891,17 @@ fail:
     return -1;
 }
 
+/* If mixer is NULL, the mixer of the mapping's open PCM is used */
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
-                                pa_alsa_direction_t direction, pa_hashmap *used_paths) {
+                                pa_alsa_direction_t direction, pa_hashmap *used_paths,
+                                snd_mixer_t *mixer) {
 
     pa_alsa_path *p;
     void *state;
     snd_pcm_t *pcm_handle;
     pa_alsa_path_set *ps;
     snd_mixer_t *mixer_handle;
+    pa_usec_t begin;
 
     if (direction == PA_ALSA_DIRECTION_OUTPUT) {
         if (m->output_path_set)
@@ -3866,12 +3918,19 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
+    begin = pa_startup_trace_begin();
+
+    if (mixer)
+        mixer_handle = mixer;
+    else {
+        pa_assert(pcm_handle);
+        mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL);
+    }
 
-    mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL);
     if (!mixer_handle) {
         /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths);
+        pa_startup_trace_end(begin, "mixer", m->name);
         return;
     }
 
@@ -3884,7 +3943,7 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     path_set_condense(ps, mixer_handle);
     path_set_make_path_descriptions_unique(ps);
 
-    if (mixer_handle)
+    if (mixer_handle != mixer)
         snd_mixer_close(mixer_handle);
 
     PA_HASHMAP_FOREACH(p, ps->paths, state)
@@ -3892,6 +3951,8 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
 
     pa_log_debug("Available mixer paths (after tidying):");
     pa_alsa_path_set_dump(ps);
+
+    pa_startup_trace_end(begin, "mixer", m->name);
 }
 
 static int mapping_verify(pa_alsa_mapping *m, const pa_channel_map *bonus) {
@@ -4256,6 +4317,8 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
         { "element-output",         mapping_parse_element,        NULL, NULL },
         { "direction",              mapping_parse_direction,      NULL, NULL },
         { "exact-channels",         mapping_parse_exact_channels, NULL, NULL },
+        { "intended-roles",         mapping_parse_intended_roles, NULL, NULL },
+        { "max-streams",            mapping_parse_max_streams,    NULL, NULL },
 
         /* Shared by [Mapping ...] and [Profile ...] */
         { "description",            mapping_parse_description,    NULL, NULL },
@@ -4289,7 +4352,7 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
                               PA_ALSA_PROFILE_SETS_DIR);
 
     r = pa_config_parse(fn, NULL, items, NULL, ps);
-    pa_xfree(fn);
+    ps->conf_path = fn;
 
     if (r < 0)
         goto fail;
@@ -4430,19 +4493,233 @@ static int add_profiles_to_probe(
     return i;
 }
 
+#define PROBE_CACHE_VERSION 1
+
+static pa_database *probe_cache_open(void) {
+    pa_database *db;
+    char *fn;
+
+    if (!(fn = pa_state_path("alsa-probe-cache", true)))
+        return NULL;
+
+    if (!(db = pa_database_open(fn, true)))
+        pa_log_debug("Failed to open probe cache '%s': %s", fn, pa_cstrerror(errno));
+
+    pa_xfree(fn);
+
+    return db;
+}
+
+/* Everything that decides whether the PCMs of the card open the way the
+ * profile set asks for. The mixer elements change when the driver or the
+ * firmware of the card does. */
+static char *probe_cache_fingerprint(pa_alsa_profile_set *ps, int card, snd_mixer_t *mixer, const pa_sample_spec *ss,
+                                     unsigned default_n_fragments, unsigned default_fragment_size_msec) {
+    char sst[PA_SAMPLE_SPEC_SNPRINT_MAX];
+    char *driver, *longname = NULL;
+    snd_mixer_elem_t *e;
+    struct stat st;
+    pa_strbuf *buf;
+
+    buf = pa_strbuf_new();
+
+    driver = pa_alsa_get_driver_name(card);
+    snd_card_get_longname(card, &longname);
+    pa_strbuf_printf(buf, "%s\n%s\n", pa_strnull(driver), pa_strnull(longname));
+    pa_xfree(driver);
+    free(longname);
+
+    if (ps->conf_path && stat(ps->conf_path, &st) >= 0)
+        pa_strbuf_printf(buf, "%s %llu %llu\n", ps->conf_path,
+                         (unsigned long long) st.st_mtime, (unsigned long long) st.st_size);
+
+    pa_strbuf_printf(buf, "%s %u %u\n", pa_sample_spec_snprint(sst, sizeof(sst), ss),
+                     default_n_fragments, default_fragment_size_msec);
+
+    for (e = snd_mixer_first_elem(mixer); e; e = snd_mixer_elem_next(e))
+        if (snd_mixer_elem_get_type(e) == SND_MIXER_ELEM_SIMPLE)
+            pa_strbuf_printf(buf, "%s,%u;", snd_mixer_selem_get_name(e), snd_mixer_selem_get_index(e));
+
+    return pa_strbuf_to_string_free(buf);
+}
+
+static char *probe_cache_key(pa_alsa_profile_set *ps, int card) {
+    char *longname = NULL, *key;
+
+    if (snd_card_get_longname(card, &longname) < 0 || !longname)
+        return NULL;
+
+    key = pa_sprintf_malloc("%s:%s", longname, pa_strnull(ps->conf_path));
+    free(longname);
+
+    return key;
+}
+
+struct cached_mapping {
+    pa_alsa_mapping *mapping;
+    uint32_t supported;
+    pa_channel_map channel_map;
+    bool output_probed, input_probed;
+};
+
+struct cached_profile {
+    pa_alsa_profile *profile;
+    bool supported;
+};
+
+/* Applies the entry to ps if it was made for the same fingerprint and
+ * exactly the mappings and profiles of ps. The mappings whose paths were
+ * probed are put into probed_outputs and probed_inputs. */
+static bool probe_cache_load(pa_database *db, const char *key, const char *fingerprint, pa_alsa_profile_set *ps,
+                             pa_hashmap *probed_outputs, pa_hashmap *probed_inputs) {
+    struct cached_mapping *mappings = NULL;
+    struct cached_profile *profiles = NULL;
+    uint32_t n_mappings = 0, n_profiles = 0, i;
+    pa_tagstruct *t = NULL;
+    pa_datum k, data;
+    const char *fp;
+    uint8_t version;
+    bool r = false;
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+
+    pa_zero(data);
+
+    if (!pa_database_get(db, &k, &data))
+        return false;
+
+    t = pa_tagstruct_new_fixed(data.data, data.size);
+
+    if (pa_tagstruct_getu8(t, &version) < 0 ||
+        version != PROBE_CACHE_VERSION ||
+        pa_tagstruct_gets(t, &fp) < 0 ||
+        !fp ||
+        !pa_streq(fp, fingerprint) ||
+        pa_tagstruct_getu32(t, &n_mappings) < 0 ||
+        n_mappings != pa_hashmap_size(ps->mappings))
+        goto finish;
+
+    mappings = pa_xnew0(struct cached_mapping, n_mappings);
+
+    for (i = 0; i < n_mappings; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 ||
+            !name ||
+            !(mappings[i].mapping = pa_hashmap_get(ps->mappings, name)) ||
+            pa_tagstruct_getu32(t, &mappings[i].supported) < 0 ||
+            pa_tagstruct_get_channel_map(t, &mappings[i].channel_map) < 0 ||
+            pa_tagstruct_get_boolean(t, &mappings[i].output_probed) < 0 ||
+            pa_tagstruct_get_boolean(t, &mappings[i].input_probed) < 0)
+            goto finish;
+    }
+
+    if (pa_tagstruct_getu32(t, &n_profiles) < 0 ||
+        n_profiles != pa_hashmap_size(ps->profiles))
+        goto finish;
+
+    profiles = pa_xnew0(struct cached_profile, n_profiles);
+
+    for (i = 0; i < n_profiles; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 ||
+            !name ||
+            !(profiles[i].profile = pa_hashmap_get(ps->profiles, name)) ||
+            pa_tagstruct_get_boolean(t, &profiles[i].supported) < 0)
+            goto finish;
+    }
+
+    if (!pa_tagstruct_eof(t))
+        goto finish;
+
+    for (i = 0; i < n_mappings; i++) {
+        pa_alsa_mapping *m = mappings[i].mapping;
+
+        m->supported = (int) mappings[i].supported;
+        m->channel_map = mappings[i].channel_map;
+
+        if (mappings[i].output_probed)
+            pa_hashmap_put(probed_outputs, m, m);
+        if (mappings[i].input_probed)
+            pa_hashmap_put(probed_inputs, m, m);
+    }
+
+    for (i = 0; i < n_profiles; i++)
+        profiles[i].profile->supported = profiles[i].supported;
+
+    r = true;
+
+finish:
+    pa_xfree(mappings);
+    pa_xfree(profiles);
+    pa_tagstruct_free(t);
+    pa_datum_free(&data);
+
+    return r;
+}
+
+static void probe_cache_save(pa_database *db, const char *key, const char *fingerprint, pa_alsa_profile_set *ps,
+                             pa_hashmap *probed_outputs, pa_hashmap *probed_inputs) {
+    pa_alsa_mapping *m;
+    pa_alsa_profile *p;
+    pa_tagstruct *t;
+    pa_datum k, data;
+    void *state;
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, PROBE_CACHE_VERSION);
+    pa_tagstruct_puts(t, fingerprint);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->mappings));
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        pa_tagstruct_puts(t, m->name);
+        pa_tagstruct_putu32(t, (uint32_t) PA_MAX(m->supported, 0));
+        pa_tagstruct_put_channel_map(t, &m->channel_map);
+        pa_tagstruct_put_boolean(t, !!pa_hashmap_get(probed_outputs, m));
+        pa_tagstruct_put_boolean(t, !!pa_hashmap_get(probed_inputs, m));
+    }
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->profiles));
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        pa_tagstruct_puts(t, p->name);
+        pa_tagstruct_put_boolean(t, p->supported);
+    }
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+
+    data.data = (void *) pa_tagstruct_data(t, &data.size);
+
+    if (pa_database_set(db, &k, &data, true) < 0)
+        pa_log_debug("Failed to store probing results for %s.", key);
+    else
+        pa_database_sync(db);
+
+    pa_tagstruct_free(t);
+}
+
 void pa_alsa_profile_set_probe(
         pa_alsa_profile_set *ps,
         const char *dev_id,
         const pa_sample_spec *ss,
         unsigned default_n_fragments,
-        unsigned default_fragment_size_msec) {
+        unsigned default_fragment_size_msec,
+        bool use_cache) {
 
     bool found_output = false, found_input = false;
 
     pa_alsa_profile *p, *last = NULL;
     pa_alsa_profile **pp, **probe_order;
     pa_alsa_mapping *m;
-    pa_hashmap *broken_inputs, *broken_outputs, *used_paths;
+    pa_hashmap *broken_inputs, *broken_outputs, *used_paths, *probed_outputs, *probed_inputs;
+    pa_database *cache = NULL;
+    snd_mixer_t *mixer = NULL;
+    char *cache_key = NULL, *fingerprint = NULL;
+    void *state;
+    int card;
+    pa_usec_t begin;
 
     pa_assert(ps);
     pa_assert(dev_id);
@@ -4451,11 +4728,39 @@ void pa_alsa_profile_set_probe(
     if (ps->probed)
         return;
 
+    begin = pa_startup_trace_begin();
+
     broken_inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     broken_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    probed_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    probed_inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     pp = probe_order = pa_xnew0(pa_alsa_profile *, pa_hashmap_size(ps->profiles) + 1);
 
+    /* Opening the PCMs is what takes long, so if we did that before for
+     * what still looks like the same card, only probe the mixer paths of
+     * the mappings that were found working, all with the card mixer. */
+    if (use_cache &&
+        (card = snd_card_get_index(dev_id)) >= 0 &&
+        (cache_key = probe_cache_key(ps, card)) &&
+        (mixer = pa_alsa_open_mixer(card, NULL)) &&
+        (cache = probe_cache_open())) {
+
+        fingerprint = probe_cache_fingerprint(ps, card, mixer, ss, default_n_fragments, default_fragment_size_msec);
+
+        if (probe_cache_load(cache, cache_key, fingerprint, ps, probed_outputs, probed_inputs)) {
+            pa_log_info("Using cached probing results for %s.", cache_key);
+
+            PA_HASHMAP_FOREACH(m, probed_outputs, state)
+                mapping_paths_probe(m, NULL, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixer);
+
+            PA_HASHMAP_FOREACH(m, probed_inputs, state)
+                mapping_paths_probe(m, NULL, PA_ALSA_DIRECTION_INPUT, used_paths, mixer);
+
+            goto finish;
+        }
+    }
+
     pp += add_profiles_to_probe(pp, ps->profiles, false, false);
     pp += add_profiles_to_probe(pp, ps->profiles, false, true);
     pp += add_profiles_to_probe(pp, ps->profiles, true, false);
@@ -4555,20 +4860,26 @@ void pa_alsa_profile_set_probe(
             PA_IDXSET_FOREACH(m, p->output_mappings, idx)
                 if (m->output_pcm) {
                     found_output |= !p->fallback_output;
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, NULL);
+                    pa_hashmap_put(probed_outputs, m, m);
                 }
 
         if (p->input_mappings)
             PA_IDXSET_FOREACH(m, p->input_mappings, idx)
                 if (m->input_pcm) {
                     found_input |= !p->fallback_input;
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, NULL);
+                    pa_hashmap_put(probed_inputs, m, m);
                 }
     }
 
     /* Clean up */
     profile_finalize_probing(last, NULL);
 
+    if (cache)
+        probe_cache_save(cache, cache_key, fingerprint, ps, probed_outputs, probed_inputs);
+
+finish:
     pa_alsa_profile_set_drop_unsupported(ps);
 
     paths_drop_unused(ps->input_paths, used_paths);
@@ -4576,9 +4887,22 @@ void pa_alsa_profile_set_probe(
     pa_hashmap_free(broken_inputs);
     pa_hashmap_free(broken_outputs);
     pa_hashmap_free(used_paths);
+    pa_hashmap_free(probed_outputs);
+    pa_hashmap_free(probed_inputs);
     pa_xfree(probe_order);
 
+    if (mixer)
+        snd_mixer_close(mixer);
+
+    if (cache)
+        pa_database_close(cache);
+
+    pa_xfree(cache_key);
+    pa_xfree(fingerprint);
+
     ps->probed = true;
+
+    pa_startup_trace_end(begin, "card", dev_id);
 }
 
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *ps) {
@@ -320,6 +320,8 @@ struct pa_alsa_profile_set {
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
+
+    char *conf_path; /* the file the set was read from, if any */
 };
 
 void pa_alsa_mapping_dump(pa_alsa_mapping *m);
@@ -328,7 +330,11 @@ void pa_alsa_decibel_fix_dump(pa_alsa_decibel_fix *db_fix);
 pa_alsa_mapping *pa_alsa_mapping_get(pa_alsa_profile_set *ps, const char *name);
 
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus);
-void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+/* With use_cache, which profiles an earlier probe of the same card found
+ * working is reused, as long as the card, its mixer and the profile set
+ * file look the same as back then. Only the mixer paths are probed
+ * again. */
+void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec, bool use_cache);
 void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
@@ -24,6 +24,7 @@
 
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <asoundlib.h>
 
@@ -45,6 +46,8 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/io-trace.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -52,10 +55,12 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/tracepoint.h>
 
 #include <modules/reserve-wrap.h>
 
 #include "alsa-util.h"
+#include "alsa-tsched.h"
 #include "alsa-sink.h"
 
 /* #define DEBUG_TIMING */
@@ -64,6 +69,7 @@
 
 #define DEFAULT_TSCHED_BUFFER_USEC (2*PA_USEC_PER_SEC)             /* 2s    -- Overall buffer size */
 #define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms  -- Fill up when only this much is left in the buffer */
+#define NO_REWIND_TSCHED_BUFFER_USEC (40*PA_USEC_PER_MSEC)         /* 40ms  -- Overall buffer size, and the fixed latency, without rewinds */
 
 #define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  -- On underrun, increase watermark by this */
 #define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms   -- When everything's great, decrease watermark by this */
@@ -88,6 +94,8 @@
 #define DEFAULT_REWIND_SAFEGUARD_BYTES (256U) /* 1.33ms @48kHz, we'll never rewind less than this */
 #define DEFAULT_REWIND_SAFEGUARD_USEC (1330) /* 1.33ms, depending on channels/rate/sample we may rewind more than 256 above */
 
+#define IO_TRACE_ENTRIES 256 /* IO cycles kept for pacmd dump-sink-io-trace */
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -97,6 +105,12 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Set instead of thread when the IO thread of the card serves us */
+    pa_alsa_io_group *io_group;
+    pa_io_scheduler_client *io_client;
+    pa_usec_t io_deadline;
+    bool io_running, io_failed;
+
     snd_pcm_t *pcm_handle;
 
     char *paths_dir;
@@ -110,6 +124,10 @@ struct userdata {
 
     unsigned int *rates;
 
+    /* The hardware parameters that worked for each sample rate, so that
+     * resuming at a rate we had before skips the negotiation */
+    pa_hashmap *hw_params_cache;
+
     size_t
         frame_size,
         fragment_size,
@@ -123,7 +141,9 @@ struct userdata {
         watermark_dec_step,
         watermark_inc_threshold,
         watermark_dec_threshold,
-        rewind_safeguard;
+        rewind_safeguard,
+        render_ahead,
+        render_ahead_cur;
 
     snd_pcm_uframes_t frames_per_block;
 
@@ -131,17 +151,42 @@ struct userdata {
     pa_usec_t min_latency_ref;
     pa_usec_t tsched_watermark_usec;
 
+    /* In UNIX write mode what is left of the last rendered chunk, in
+     * mmap mode the data rendered ahead for the next wakeup */
     pa_memchunk memchunk;
 
     char *device_name;  /* name of the PCM device */
     char *control_device; /* name of the control device */
 
-    bool use_mmap:1, use_tsched:1, deferred_volume:1, fixed_latency_range:1;
+    bool use_mmap:1, use_tsched:1, use_rewinds:1, deferred_volume:1, fixed_latency_range:1, single_hw_query:1;
+
+    /* With standby an idle suspend keeps the PCM open and configured,
+     * only stopped. standby_next is decided in the main thread before
+     * each suspend, in_standby is the IO thread's view. pcm_passthrough
+     * tells whether pcm_handle was opened in NONAUDIO mode. */
+    bool standby, standby_next, in_standby;
+    bool pcm_passthrough, standby_passthrough;
+    pa_sample_spec standby_spec;
 
     bool first, after_rewind;
 
     pa_rtpoll_item *alsa_rtpoll_item;
 
+    /* Carried from one iteration of the IO loop to the next */
+    unsigned short revents;
+    bool timer_elapsed;
+    pa_usec_t rtpoll_sleep, sleep_start;
+
+    pa_io_trace *io_trace;
+    pa_io_trace_entry trace_entry; /* the cycle being traced */
+
+    /* With single_hw_query what the one snd_pcm_status() of the current
+     * wakeup returned, and write_count at that time */
+    bool hw_query_valid;
+    snd_pcm_sframes_t hw_query_avail, hw_query_delay;
+    pa_usec_t hw_query_time;
+    uint64_t hw_query_write_count;
+
     pa_smoother *smoother;
     uint64_t write_count;
     uint64_t since_start;
@@ -159,6 +204,12 @@ struct userdata {
     pa_alsa_ucm_mapping_context *ucm_context;
 };
 
+enum {
+    SINK_MESSAGE_GET_WATERMARK = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_IO_DETACH,
+    SINK_MESSAGE_LEAVE_STANDBY
+};
+
 static void userdata_free(struct userdata *u);
 
 /* FIXME: Is there a better way to do this than device names? */
@@ -292,34 +343,20 @@ static int reserve_monitor_init(struct userdata *u, const char *dname) {
 }
 
 static void fix_min_sleep_wakeup(struct userdata *u) {
-    size_t max_use, max_use_2;
-
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    max_use = u->hwbuf_size - u->hwbuf_unused;
-    max_use_2 = pa_frame_align(max_use/2, &u->sink->sample_spec);
-
-    u->min_sleep = pa_usec_to_bytes(TSCHED_MIN_SLEEP_USEC, &u->sink->sample_spec);
-    u->min_sleep = PA_CLAMP(u->min_sleep, u->frame_size, max_use_2);
-
-    u->min_wakeup = pa_usec_to_bytes(TSCHED_MIN_WAKEUP_USEC, &u->sink->sample_spec);
-    u->min_wakeup = PA_CLAMP(u->min_wakeup, u->frame_size, max_use_2);
+    pa_alsa_tsched_fix_min_sleep_wakeup(&u->sink->sample_spec, u->hwbuf_size - u->hwbuf_unused,
+                                        TSCHED_MIN_SLEEP_USEC, TSCHED_MIN_WAKEUP_USEC,
+                                        &u->min_sleep, &u->min_wakeup);
 }
 
 static void fix_tsched_watermark(struct userdata *u) {
-    size_t max_use;
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    max_use = u->hwbuf_size - u->hwbuf_unused;
-
-    if (u->tsched_watermark > max_use - u->min_sleep)
-        u->tsched_watermark = max_use - u->min_sleep;
-
-    if (u->tsched_watermark < u->min_wakeup)
-        u->tsched_watermark = u->min_wakeup;
-
+    u->tsched_watermark = pa_alsa_tsched_fix_watermark(u->tsched_watermark, u->hwbuf_size - u->hwbuf_unused,
+                                                       u->min_sleep, u->min_wakeup);
     u->tsched_watermark_usec = pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec);
 }
 
@@ -330,9 +367,11 @@ static void increase_watermark(struct userdata *u) {
     pa_assert(u);
     pa_assert(u->use_tsched);
 
+    pa_metric_inc(u->sink->metrics.watermark_increases);
+
     /* First, just try to increase the watermark */
     old_watermark = u->tsched_watermark;
-    u->tsched_watermark = PA_MIN(u->tsched_watermark * 2, u->tsched_watermark + u->watermark_inc_step);
+    u->tsched_watermark = pa_alsa_tsched_increase_watermark(u->tsched_watermark, u->watermark_inc_step);
     fix_tsched_watermark(u);
 
     if (old_watermark != u->tsched_watermark) {
@@ -343,13 +382,13 @@ static void increase_watermark(struct userdata *u) {
 
     /* Hmm, we cannot increase the watermark any further, hence let's
        raise the latency, unless doing so was disabled in
-       configuration */
-    if (u->fixed_latency_range)
+       configuration or the latency is fixed */
+    if (u->fixed_latency_range || !u->use_rewinds)
         return;
 
     old_min_latency = u->sink->thread_info.min_latency;
-    new_min_latency = PA_MIN(old_min_latency * 2, old_min_latency + TSCHED_WATERMARK_INC_STEP_USEC);
-    new_min_latency = PA_MIN(new_min_latency, u->sink->thread_info.max_latency);
+    new_min_latency = pa_alsa_tsched_increase_min_latency(old_min_latency, u->sink->thread_info.max_latency,
+                                                          TSCHED_WATERMARK_INC_STEP_USEC);
 
     if (old_min_latency != new_min_latency) {
         pa_log_info("Increasing minimal latency to %0.2f ms",
@@ -378,11 +417,7 @@ static void decrease_watermark(struct userdata *u) {
 
     old_watermark = u->tsched_watermark;
 
-    if (u->tsched_watermark < u->watermark_dec_step)
-        u->tsched_watermark = u->tsched_watermark / 2;
-    else
-        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
-
+    u->tsched_watermark = pa_alsa_tsched_decrease_watermark(u->tsched_watermark, u->watermark_dec_step);
     fix_tsched_watermark(u);
 
     if (old_watermark != u->tsched_watermark)
@@ -396,7 +431,7 @@ restart:
 }
 
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
-    pa_usec_t usec, wm;
+    pa_usec_t usec;
 
     pa_assert(sleep_usec);
     pa_assert(process_usec);
@@ -409,13 +444,7 @@ static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*p
     if (usec == (pa_usec_t) -1)
         usec = pa_bytes_to_usec(u->hwbuf_size, &u->sink->sample_spec);
 
-    wm = u->tsched_watermark_usec;
-
-    if (wm > usec)
-        wm = usec/2;
-
-    *sleep_usec = usec - wm;
-    *process_usec = wm;
+    pa_alsa_tsched_sleep_time(usec, u->tsched_watermark_usec, sleep_usec, process_usec);
 
 #ifdef DEBUG_TIMING
     pa_log_debug("Buffer time: %lu ms; Sleep time: %lu ms; Process time: %lu ms",
@@ -434,12 +463,17 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     pa_assert(err != -EAGAIN);
 
-    if (err == -EPIPE)
+    if (err == -EPIPE) {
         pa_log_debug("%s: Buffer underrun!", call);
+        u->trace_entry.flags |= PA_IO_TRACE_XRUN;
+        pa_metric_inc(u->sink->metrics.xruns);
+    }
 
     if (err == -ESTRPIPE)
         pa_log_debug("%s: System suspended!", call);
 
+    u->hw_query_valid = false;
+
     if ((err = snd_pcm_recover(u->pcm_handle, err, 1)) < 0) {
         pa_log("%s: %s", call, pa_alsa_strerror(err));
         return -1;
@@ -450,6 +484,64 @@ static int try_recover(struct userdata *u, const char *call, int err) {
     return 0;
 }
 
+/* Asks the device for its avail, delay and the time of both at once */
+static int query_hw(struct userdata *u) {
+    snd_pcm_status_t *status;
+    snd_htimestamp_t htstamp = { 0, 0 };
+    snd_pcm_state_t state;
+    int err;
+
+    snd_pcm_status_alloca(&status);
+
+    pa_io_trace_count_queries(u->io_trace, 1);
+
+    if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, status, &u->hw_query_delay, u->hwbuf_size, &u->sink->sample_spec, false)) < 0))
+        return err;
+
+    /* Unlike snd_pcm_avail() the status call succeeds on xruns */
+    state = snd_pcm_status_get_state(status);
+    if (state == SND_PCM_STATE_XRUN)
+        return -EPIPE;
+    if (state == SND_PCM_STATE_SUSPENDED)
+        return -ESTRPIPE;
+
+    u->hw_query_avail = (snd_pcm_sframes_t) snd_pcm_status_get_avail(status);
+
+    snd_pcm_status_get_htstamp(status, &htstamp);
+    u->hw_query_time = pa_timespec_load(&htstamp);
+
+    /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
+    if (u->hw_query_time <= 0)
+        u->hw_query_time = pa_rtclock_now();
+
+    u->hw_query_write_count = u->write_count;
+    u->hw_query_valid = true;
+
+    return 0;
+}
+
+/* With single_hw_query the device is asked only once per wakeup, later
+ * calls take off what we wrote since. Over the few microseconds that
+ * takes the device plays next to nothing, so that only errs on the side
+ * of writing a little less. */
+static snd_pcm_sframes_t get_avail(struct userdata *u) {
+    snd_pcm_sframes_t n;
+    int err;
+
+    if (!u->single_hw_query) {
+        pa_io_trace_count_queries(u->io_trace, 1);
+        return pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec);
+    }
+
+    if (!u->hw_query_valid)
+        if ((err = query_hw(u)) < 0)
+            return err;
+
+    n = u->hw_query_avail - (snd_pcm_sframes_t) ((u->write_count - u->hw_query_write_count) / u->frame_size);
+
+    return PA_MAX(n, 0);
+}
+
 static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_timeout) {
     size_t left_to_play;
     bool underrun = false;
@@ -471,9 +563,12 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_tim
         PA_DEBUG_TRAP;
 #endif
 
-        if (!u->first && !u->after_rewind)
+        if (!u->first && !u->after_rewind) {
+            u->trace_entry.flags |= PA_IO_TRACE_XRUN;
+
             if (pa_log_ratelimit(PA_LOG_INFO))
                 pa_log_info("Underrun!");
+        }
     }
 
 #ifdef DEBUG_TIMING
@@ -529,7 +624,10 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
         /* First we determine how many samples are missing to fill the
          * buffer up to 100% */
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
+        if (PA_UNLIKELY((n = get_avail(u)) < 0)) {
+
+            if (j == 0)
+                u->trace_entry.avail = n;
 
             if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
                 continue;
@@ -539,6 +637,9 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
 
         n_bytes = (size_t) n * u->frame_size;
 
+        if (j == 0 && u->trace_entry.avail >= 0)
+            u->trace_entry.avail = (int64_t) n_bytes;
+
 #ifdef DEBUG_TIMING
         pa_log_debug("avail: %lu", (unsigned long) n_bytes);
 #endif
@@ -603,6 +704,7 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
             snd_pcm_uframes_t offset, frames;
             snd_pcm_sframes_t sframes;
             size_t written;
+            pa_usec_t render_start;
 
             frames = (snd_pcm_uframes_t) (n_bytes / u->frame_size);
 /*             pa_log_debug("%lu frames to write", (unsigned long) frames); */
@@ -638,12 +740,35 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
             p = (uint8_t*) areas[0].addr + (offset * u->frame_size);
 
             written = frames * u->frame_size;
-            chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, written, true);
-            chunk.length = pa_memblock_get_length(chunk.memblock);
-            chunk.index = 0;
 
-            pa_sink_render_into_full(u->sink, &chunk);
-            pa_memblock_unref_fixed(chunk.memblock);
+            if (u->memchunk.length > 0) {
+                void *q;
+
+                /* What we rendered ahead goes first, this is just a copy */
+                written = PA_MIN(written, u->memchunk.length);
+                frames = written / u->frame_size;
+
+                q = pa_memblock_acquire(u->memchunk.memblock);
+                memcpy(p, (uint8_t *) q + u->memchunk.index, written);
+                pa_memblock_release(u->memchunk.memblock);
+
+                u->memchunk.index += written;
+                u->memchunk.length -= written;
+
+                if (u->memchunk.length <= 0) {
+                    pa_memblock_unref(u->memchunk.memblock);
+                    pa_memchunk_reset(&u->memchunk);
+                }
+            } else {
+                chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, written, true);
+                chunk.length = pa_memblock_get_length(chunk.memblock);
+                chunk.index = 0;
+
+                render_start = pa_rtclock_now();
+                pa_sink_render_into_full(u->sink, &chunk);
+                u->trace_entry.process_usec += pa_rtclock_now() - render_start;
+                pa_memblock_unref_fixed(chunk.memblock);
+            }
 
             if (PA_UNLIKELY((sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames)) < 0)) {
 
@@ -672,6 +797,15 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
         }
     }
 
+    /* With the device buffer filled up, prepare what the next wakeup
+     * will write, so that it only has to copy it. */
+    if (u->render_ahead_cur > 0 && !u->memchunk.memblock) {
+        pa_usec_t render_start = pa_rtclock_now();
+
+        pa_sink_render_full(u->sink, u->render_ahead_cur, &u->memchunk);
+        u->trace_entry.process_usec += pa_rtclock_now() - render_start;
+    }
+
     input_underrun = pa_sink_process_input_underruns(u->sink, left_to_play);
 
     if (u->use_tsched) {
@@ -710,7 +844,10 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
         int r;
         bool after_avail = true;
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
+        if (PA_UNLIKELY((n = get_avail(u)) < 0)) {
+
+            if (j == 0)
+                u->trace_entry.avail = n;
 
             if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
                 continue;
@@ -720,6 +857,9 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
 
         n_bytes = (size_t) n * u->frame_size;
 
+        if (j == 0 && u->trace_entry.avail >= 0)
+            u->trace_entry.avail = (int64_t) n_bytes;
+
 #ifdef DEBUG_TIMING
         pa_log_debug("avail: %lu", (unsigned long) n_bytes);
 #endif
@@ -772,8 +912,12 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
 
 /*         pa_log_debug("%lu frames to write", (unsigned long) frames); */
 
-            if (u->memchunk.length <= 0)
+            if (u->memchunk.length <= 0) {
+                pa_usec_t render_start = pa_rtclock_now();
+
                 pa_sink_render(u->sink, n_bytes, &u->memchunk);
+                u->trace_entry.process_usec += pa_rtclock_now() - render_start;
+            }
 
             pa_assert(u->memchunk.length > 0);
 
@@ -851,34 +995,60 @@ static void update_smoother(struct userdata *u) {
     int64_t position;
     int err;
     pa_usec_t now1 = 0, now2;
-    snd_pcm_status_t *status;
-    snd_htimestamp_t htstamp = { 0, 0 };
-
-    snd_pcm_status_alloca(&status);
+    uint64_t write_count;
 
     pa_assert(u);
     pa_assert(u->pcm_handle);
 
     /* Let's update the time smoother */
 
-    if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, status, &delay, u->hwbuf_size, &u->sink->sample_spec, false)) < 0)) {
-        pa_log_warn("Failed to query DSP status data: %s", pa_alsa_strerror(err));
-        return;
-    }
+    if (u->single_hw_query) {
 
-    snd_pcm_status_get_htstamp(status, &htstamp);
-    now1 = pa_timespec_load(&htstamp);
+        /* Between the queries the smoother is all we need, so don't
+         * even ask the device if it's too early for an update */
+        if (!u->hw_query_valid) {
+            if (u->last_smoother_update > 0 && u->last_smoother_update + u->smoother_interval > pa_rtclock_now())
+                return;
 
-    /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
-    if (now1 <= 0)
-        now1 = pa_rtclock_now();
+            if (PA_UNLIKELY((err = query_hw(u)) < 0)) {
+                pa_log_warn("Failed to query DSP status data: %s", pa_alsa_strerror(err));
+                return;
+            }
+        }
+
+        delay = u->hw_query_delay;
+        now1 = u->hw_query_time;
+        write_count = u->hw_query_write_count;
+
+    } else {
+        snd_pcm_status_t *status;
+        snd_htimestamp_t htstamp = { 0, 0 };
+
+        snd_pcm_status_alloca(&status);
+
+        pa_io_trace_count_queries(u->io_trace, 1);
+
+        if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, status, &delay, u->hwbuf_size, &u->sink->sample_spec, false)) < 0)) {
+            pa_log_warn("Failed to query DSP status data: %s", pa_alsa_strerror(err));
+            return;
+        }
+
+        snd_pcm_status_get_htstamp(status, &htstamp);
+        now1 = pa_timespec_load(&htstamp);
+
+        /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
+        if (now1 <= 0)
+            now1 = pa_rtclock_now();
+
+        write_count = u->write_count;
+    }
 
     /* check if the time since the last update is bigger than the interval */
     if (u->last_smoother_update > 0)
         if (u->last_smoother_update + u->smoother_interval > now1)
             return;
 
-    position = (int64_t) u->write_count - ((int64_t) delay * (int64_t) u->frame_size);
+    position = (int64_t) write_count - ((int64_t) delay * (int64_t) u->frame_size);
 
     if (PA_UNLIKELY(position < 0))
         position = 0;
@@ -932,10 +1102,29 @@ static int suspend(struct userdata *u) {
 
     pa_smoother_pause(u->smoother, pa_rtclock_now());
 
+    /* What we rendered ahead would come too late after resuming */
+    if (u->use_mmap && u->memchunk.memblock) {
+        pa_memblock_unref(u->memchunk.memblock);
+        pa_memchunk_reset(&u->memchunk);
+    }
+
+    /* Resume with the watermark we learned so far instead of learning it
+     * all over again from the configured one */
+    if (u->use_tsched)
+        u->tsched_watermark_ref = u->tsched_watermark;
+
     /* Let's suspend -- we don't call snd_pcm_drain() here since that might
      * take awfully long with our long buffer sizes today. */
-    snd_pcm_close(u->pcm_handle);
-    u->pcm_handle = NULL;
+    if (u->standby_next) {
+        /* Stopped, the device stays configured for resuming */
+        snd_pcm_drop(u->pcm_handle);
+        u->standby_spec = u->sink->sample_spec;
+        u->standby_passthrough = u->pcm_passthrough;
+        u->in_standby = true;
+    } else {
+        snd_pcm_close(u->pcm_handle);
+        u->pcm_handle = NULL;
+    }
 
     if (u->alsa_rtpoll_item) {
         pa_rtpoll_item_free(u->alsa_rtpoll_item);
@@ -950,11 +1139,28 @@ static int suspend(struct userdata *u) {
     pa_sink_set_max_rewind_within_thread(u->sink, 0);
     pa_sink_set_max_request_within_thread(u->sink, 0);
 
-    pa_log_info("Device suspended...");
+    if (u->in_standby)
+        pa_log_info("Device in standby...");
+    else
+        pa_log_info("Device suspended...");
 
     return 0;
 }
 
+/* Called from IO context */
+static void leave_standby(struct userdata *u) {
+    pa_assert(u);
+
+    if (!u->in_standby)
+        return;
+
+    snd_pcm_close(u->pcm_handle);
+    u->pcm_handle = NULL;
+    u->in_standby = false;
+
+    pa_log_info("Device closed, suspended...");
+}
+
 /* Called from IO context */
 static int update_sw_params(struct userdata *u) {
     snd_pcm_uframes_t avail_min;
@@ -964,6 +1170,7 @@ static int update_sw_params(struct userdata *u) {
 
     /* Use the full buffer if no one asked us for anything specific */
     u->hwbuf_unused = 0;
+    u->render_ahead_cur = 0;
 
     if (u->use_tsched) {
         pa_usec_t latency;
@@ -983,6 +1190,16 @@ static int update_sw_params(struct userdata *u) {
             u->hwbuf_unused = PA_LIKELY(b < u->hwbuf_size) ? (u->hwbuf_size - b) : 0;
         }
 
+        /* The data rendered ahead is part of the latency, so leave as
+         * much of the device buffer unused. Keep at least half of the
+         * latency in the device. */
+        if (u->render_ahead > 0) {
+            u->render_ahead_cur = pa_frame_align(PA_MIN(u->render_ahead, (u->hwbuf_size - u->hwbuf_unused) / 2), &u->sink->sample_spec);
+            u->hwbuf_unused += u->render_ahead_cur;
+
+            pa_log_debug("Rendering %lu bytes ahead", (unsigned long) u->render_ahead_cur);
+        }
+
         fix_min_sleep_wakeup(u);
         fix_tsched_watermark(u);
     }
@@ -1006,9 +1223,11 @@ static int update_sw_params(struct userdata *u) {
         return err;
     }
 
-    pa_sink_set_max_request_within_thread(u->sink, u->hwbuf_size - u->hwbuf_unused);
-     if (pa_alsa_pcm_is_hw(u->pcm_handle))
-         pa_sink_set_max_rewind_within_thread(u->sink, u->hwbuf_size);
+    pa_sink_set_max_request_within_thread(u->sink, u->hwbuf_size - u->hwbuf_unused + u->render_ahead_cur);
+    if (!u->use_rewinds)
+        pa_sink_set_max_rewind_within_thread(u->sink, 0);
+    else if (pa_alsa_pcm_is_hw(u->pcm_handle))
+        pa_sink_set_max_rewind_within_thread(u->sink, u->hwbuf_size + u->render_ahead_cur);
     else {
         pa_log_info("Disabling rewind_within_thread for device %s", u->device_name);
         pa_sink_set_max_rewind_within_thread(u->sink, 0);
@@ -1032,25 +1251,62 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
     fix_min_sleep_wakeup(u);
     fix_tsched_watermark(u);
 
-    if (in_thread)
-        pa_sink_set_latency_range_within_thread(u->sink,
-                                                u->min_latency_ref,
-                                                pa_bytes_to_usec(u->hwbuf_size, ss));
-    else {
-        pa_sink_set_latency_range(u->sink,
-                                  0,
-                                  pa_bytes_to_usec(u->hwbuf_size, ss));
-
-        /* work-around assert in pa_sink_set_latency_within_thead,
-           keep track of min_latency and reuse it when
-           this routine is called from IO context */
-        u->min_latency_ref = u->sink->thread_info.min_latency;
+    /* Without rewinds the latency is fixed to the whole buffer */
+    if (u->use_rewinds) {
+        if (in_thread)
+            pa_sink_set_latency_range_within_thread(u->sink,
+                                                    u->min_latency_ref,
+                                                    pa_bytes_to_usec(u->hwbuf_size, ss));
+        else {
+            pa_sink_set_latency_range(u->sink,
+                                      0,
+                                      pa_bytes_to_usec(u->hwbuf_size, ss));
+
+            /* work-around assert in pa_sink_set_latency_within_thead,
+               keep track of min_latency and reuse it when
+               this routine is called from IO context */
+            u->min_latency_ref = u->sink->thread_info.min_latency;
+        }
     }
 
     pa_log_info("Time scheduling watermark is %0.2fms",
                 (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
 }
 
+/* Called from IO context, or from the main thread before the IO thread
+ * starts */
+static void save_hw_params(struct userdata *u) {
+    snd_pcm_hw_params_t *hwparams;
+
+    pa_assert(u);
+    pa_assert(u->pcm_handle);
+
+    if (!(hwparams = pa_alsa_save_hw_params(u->pcm_handle)))
+        return;
+
+    pa_hashmap_remove_and_free(u->hw_params_cache, PA_UINT32_TO_PTR(u->sink->sample_spec.rate));
+    pa_hashmap_put(u->hw_params_cache, PA_UINT32_TO_PTR(u->sink->sample_spec.rate), hwparams);
+}
+
+/* Called from IO context */
+static int restore_hw_params(struct userdata *u) {
+    snd_pcm_hw_params_t *hwparams;
+
+    pa_assert(u);
+    pa_assert(u->pcm_handle);
+
+    if (!(hwparams = pa_hashmap_get(u->hw_params_cache, PA_UINT32_TO_PTR(u->sink->sample_spec.rate))))
+        return -1;
+
+    if (pa_alsa_restore_hw_params(u->pcm_handle, hwparams) < 0) {
+        /* Don't try again, negotiate from scratch from now on */
+        pa_hashmap_remove_and_free(u->hw_params_cache, PA_UINT32_TO_PTR(u->sink->sample_spec.rate));
+        return -1;
+    }
+
+    return 0;
+}
+
 /* Called from IO context */
 static int unsuspend(struct userdata *u) {
     pa_sample_spec ss;
@@ -1060,7 +1316,7 @@ static int unsuspend(struct userdata *u) {
     char *device_name = NULL;
 
     pa_assert(u);
-    pa_assert(!u->pcm_handle);
+    pa_assert(!u->pcm_handle || u->in_standby);
 
     pa_log_info("Trying resume...");
 
@@ -1072,6 +1328,25 @@ static int unsuspend(struct userdata *u) {
         pa_snprintf(device_name, len, "%s,AES0=6", u->device_name);
     }
 
+    if (u->in_standby) {
+        u->in_standby = false;
+
+        /* Nothing to negotiate, unless the configuration changed while
+         * we were suspended */
+        if (!!device_name == u->standby_passthrough &&
+            pa_sample_spec_equal(&u->standby_spec, &u->sink->sample_spec)) {
+            if ((err = snd_pcm_prepare(u->pcm_handle)) >= 0) {
+                pa_log_debug("Leaving standby.");
+                goto configured;
+            }
+
+            pa_log_info("Failed to prepare the device in standby: %s", pa_alsa_strerror(err));
+        }
+
+        snd_pcm_close(u->pcm_handle);
+        u->pcm_handle = NULL;
+    }
+
     if ((err = snd_pcm_open(&u->pcm_handle, device_name ? device_name : u->device_name, SND_PCM_STREAM_PLAYBACK,
                             SND_PCM_NONBLOCK|
                             SND_PCM_NO_AUTO_RESAMPLE|
@@ -1081,35 +1356,46 @@ static int unsuspend(struct userdata *u) {
         goto fail;
     }
 
-    ss = u->sink->sample_spec;
-    period_size = u->fragment_size / u->frame_size;
-    buffer_size = u->hwbuf_size / u->frame_size;
-    b = u->use_mmap;
-    d = u->use_tsched;
+    u->pcm_passthrough = !!device_name;
 
-    if ((err = pa_alsa_set_hw_params(u->pcm_handle, &ss, &period_size, &buffer_size, 0, &b, &d, true)) < 0) {
-        pa_log("Failed to set hardware parameters: %s", pa_alsa_strerror(err));
-        goto fail;
-    }
+    /* The passthrough device is a different one, nothing saved applies */
+    if (!device_name && restore_hw_params(u) >= 0)
+        pa_log_debug("Reused the hardware parameters saved for %u Hz.", u->sink->sample_spec.rate);
+    else {
+        ss = u->sink->sample_spec;
+        period_size = u->fragment_size / u->frame_size;
+        buffer_size = u->hwbuf_size / u->frame_size;
+        b = u->use_mmap;
+        d = u->use_tsched;
+
+        if ((err = pa_alsa_set_hw_params(u->pcm_handle, &ss, &period_size, &buffer_size, 0, &b, &d, true)) < 0) {
+            pa_log("Failed to set hardware parameters: %s", pa_alsa_strerror(err));
+            goto fail;
+        }
 
-    if (b != u->use_mmap || d != u->use_tsched) {
-        pa_log_warn("Resume failed, couldn't get original access mode.");
-        goto fail;
-    }
+        if (b != u->use_mmap || d != u->use_tsched) {
+            pa_log_warn("Resume failed, couldn't get original access mode.");
+            goto fail;
+        }
 
-    if (!pa_sample_spec_equal(&ss, &u->sink->sample_spec)) {
-        pa_log_warn("Resume failed, couldn't restore original sample settings.");
-        goto fail;
-    }
+        if (!pa_sample_spec_equal(&ss, &u->sink->sample_spec)) {
+            pa_log_warn("Resume failed, couldn't restore original sample settings.");
+            goto fail;
+        }
 
-    if (period_size*u->frame_size != u->fragment_size ||
-        buffer_size*u->frame_size != u->hwbuf_size) {
-        pa_log_warn("Resume failed, couldn't restore original fragment settings. (Old: %lu/%lu, New %lu/%lu)",
-                    (unsigned long) u->hwbuf_size, (unsigned long) u->fragment_size,
-                    (unsigned long) (buffer_size*u->frame_size), (unsigned long) (period_size*u->frame_size));
-        goto fail;
+        if (period_size*u->frame_size != u->fragment_size ||
+            buffer_size*u->frame_size != u->hwbuf_size) {
+            pa_log_warn("Resume failed, couldn't restore original fragment settings. (Old: %lu/%lu, New %lu/%lu)",
+                        (unsigned long) u->hwbuf_size, (unsigned long) u->fragment_size,
+                        (unsigned long) (buffer_size*u->frame_size), (unsigned long) (period_size*u->frame_size));
+            goto fail;
+        }
+
+        if (!device_name)
+            save_hw_params(u);
     }
 
+configured:
     if (update_sw_params(u) < 0)
         goto fail;
 
@@ -1124,7 +1410,7 @@ static int unsuspend(struct userdata *u) {
     u->first = true;
     u->since_start = 0;
 
-    /* reset the watermark to the value defined when sink was created */
+    /* reset the watermark to the value we had when we were suspended */
     if (u->use_tsched)
         reset_watermark(u, u->tsched_watermark_ref, &u->sink->sample_spec, true);
 
@@ -1153,7 +1439,7 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
         case PA_SINK_MESSAGE_GET_LATENCY: {
             pa_usec_t r = 0;
 
-            if (u->pcm_handle)
+            if (u->pcm_handle && !u->in_standby)
                 r = sink_get_latency(u);
 
             *((pa_usec_t*) data) = r;
@@ -1161,6 +1447,28 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             return 0;
         }
 
+        case SINK_MESSAGE_GET_WATERMARK:
+            *((pa_usec_t*) data) = u->tsched_watermark_usec;
+            return 0;
+
+        case SINK_MESSAGE_LEAVE_STANDBY:
+            leave_standby(u);
+            return 0;
+
+        case SINK_MESSAGE_IO_DETACH:
+            /* The rtpoll of the card is only touched from its thread */
+            if (u->alsa_rtpoll_item) {
+                pa_rtpoll_item_free(u->alsa_rtpoll_item);
+                u->alsa_rtpoll_item = NULL;
+            }
+
+            if (u->mixer_pd) {
+                pa_alsa_mixer_pdata_free(u->mixer_pd);
+                u->mixer_pd = NULL;
+            }
+
+            return 0;
+
         case PA_SINK_MESSAGE_SET_STATE:
 
             switch ((pa_sink_state_t) PA_PTR_TO_UINT(data)) {
@@ -1183,6 +1491,10 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                     if (u->sink->thread_info.state == PA_SINK_INIT) {
                         if (build_pollfd(u) < 0)
                             return -PA_ERR_IO;
+
+                        if (u->io_group && u->mixer_pd &&
+                            pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0)
+                            return -PA_ERR_IO;
                     }
 
                     if (u->sink->thread_info.state == PA_SINK_SUSPENDED) {
@@ -1205,6 +1517,30 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
     return pa_sink_process_msg(o, code, data, offset, chunk);
 }
 
+/* Called from main context. Publishes the watermark the IO thread
+ * learned, so that module-device-restore can start the next instance of
+ * this sink with it. */
+static void publish_watermark(struct userdata *u) {
+    pa_usec_t watermark;
+    const char *old;
+    pa_proplist *pl;
+
+    if (!u->use_tsched)
+        return;
+
+    if (pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_GET_WATERMARK, &watermark, 0, NULL) < 0)
+        return;
+
+    pl = pa_proplist_new();
+    pa_proplist_setf(pl, PA_PROP_DEVICE_BUFFERING_WATERMARK, "%llu", (unsigned long long) watermark);
+
+    if (!(old = pa_proplist_gets(u->sink->proplist, PA_PROP_DEVICE_BUFFERING_WATERMARK)) ||
+        !pa_streq(old, pa_proplist_gets(pl, PA_PROP_DEVICE_BUFFERING_WATERMARK)))
+        pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+
+    pa_proplist_free(pl);
+}
+
 /* Called from main context */
 static int sink_set_state_cb(pa_sink *s, pa_sink_state_t new_state) {
     pa_sink_state_t old_state;
@@ -1215,15 +1551,38 @@ static int sink_set_state_cb(pa_sink *s, pa_sink_state_t new_state) {
 
     old_state = pa_sink_get_state(u->sink);
 
-    if (PA_SINK_IS_OPENED(old_state) && new_state == PA_SINK_SUSPENDED)
-        reserve_done(u);
-    else if (old_state == PA_SINK_SUSPENDED && PA_SINK_IS_OPENED(new_state))
+    if (PA_SINK_IS_OPENED(old_state) && new_state == PA_SINK_SUSPENDED) {
+        publish_watermark(u);
+
+        /* Whoever else suspends us wants the device to be released */
+        u->standby_next = u->standby && u->sink->suspend_cause == PA_SUSPEND_IDLE;
+
+        /* We keep the device open in standby */
+        if (!u->standby_next)
+            reserve_done(u);
+    } else if (old_state == PA_SINK_SUSPENDED && PA_SINK_IS_OPENED(new_state))
         if (reserve_init(u, u->device_name) < 0)
             return -PA_ERR_BUSY;
 
     return 0;
 }
 
+/* Called from main context */
+static void sink_suspend_cause_changed_cb(pa_sink *s, pa_suspend_cause_t old_cause) {
+    struct userdata *u;
+
+    pa_sink_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!u->standby_next || s->suspend_cause == PA_SUSPEND_IDLE)
+        return;
+
+    /* Suspended for some other reason too now, close the device */
+    u->standby_next = false;
+    pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), SINK_MESSAGE_LEAVE_STANDBY, NULL, 0, NULL);
+    reserve_done(u);
+}
+
 static int ctl_mixer_callback(snd_mixer_elem_t *elem, unsigned int mask) {
     struct userdata *u = snd_mixer_elem_get_callback_private(elem);
 
@@ -1512,7 +1871,7 @@ static void sink_update_requested_latency_cb(pa_sink *s) {
                                * we can dynamically adjust the
                                * latency */
 
-    if (!u->pcm_handle)
+    if (!u->pcm_handle || u->in_standby)
         return;
 
     before = u->hwbuf_unused;
@@ -1614,7 +1973,7 @@ static int sink_update_rate_cb(pa_sink *s, uint32_t rate) {
 
 static int process_rewind(struct userdata *u) {
     snd_pcm_sframes_t unused;
-    size_t rewind_nbytes, unused_nbytes, limit_nbytes;
+    size_t rewind_nbytes, unused_nbytes, limit_nbytes, ahead_nbytes = 0;
     pa_assert(u);
 
     if (!PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
@@ -1627,6 +1986,22 @@ static int process_rewind(struct userdata *u) {
 
     pa_log_debug("Requested to rewind %lu bytes.", (unsigned long) rewind_nbytes);
 
+    /* The newest data is what we rendered ahead, drop that first */
+    if (u->use_mmap && u->memchunk.memblock) {
+        ahead_nbytes = PA_MIN(rewind_nbytes, u->memchunk.length);
+        rewind_nbytes -= ahead_nbytes;
+        u->memchunk.length -= ahead_nbytes;
+
+        if (u->memchunk.length <= 0) {
+            pa_memblock_unref(u->memchunk.memblock);
+            pa_memchunk_reset(&u->memchunk);
+        }
+
+        pa_log_debug("Dropped %lu bytes rendered ahead.", (unsigned long) ahead_nbytes);
+    }
+
+    pa_io_trace_count_queries(u->io_trace, 1);
+
     if (PA_UNLIKELY((unused = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
         pa_log("snd_pcm_avail() failed: %s", pa_alsa_strerror((int) unused));
         return -1;
@@ -1667,130 +2042,245 @@ static int process_rewind(struct userdata *u) {
             pa_log_info("Tried rewind, but was apparently not possible.");
         else {
             u->write_count -= rewind_nbytes;
+            u->hw_query_valid = false;
             pa_log_debug("Rewound %lu bytes.", (unsigned long) rewind_nbytes);
-            pa_sink_process_rewind(u->sink, rewind_nbytes);
+            pa_sink_process_rewind(u->sink, ahead_nbytes + rewind_nbytes);
 
             u->after_rewind = true;
             return 0;
         }
-    } else
+    } else if (ahead_nbytes <= 0)
         pa_log_debug("Mhmm, actually there is nothing to rewind.");
 
-    pa_sink_process_rewind(u->sink, 0);
+    if (ahead_nbytes > 0)
+        u->after_rewind = true;
+
+    pa_sink_process_rewind(u->sink, ahead_nbytes);
     return 0;
 }
 
-static void thread_func(void *userdata) {
-    struct userdata *u = userdata;
-    unsigned short revents = 0;
+/* With timer scheduling the thread has to be done within a watermark
+ * after it woke up, so it asks for a share of every watermark period */
+#define DEADLINE_RUNTIME_DIVISOR 4
 
-    pa_assert(u);
+static void make_realtime(struct userdata *u) {
+    if (u->core->deadline_scheduling && u->use_tsched) {
+        pa_usec_t period = pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec);
 
-    pa_log_debug("Thread starting up");
+        if (pa_make_deadline(period / DEADLINE_RUNTIME_DIVISOR, period) >= 0)
+            return;
+    }
 
     if (u->core->realtime_scheduling)
         pa_make_realtime(u->core->realtime_priority);
+}
 
-    pa_thread_mq_install(&u->thread_mq);
-
-    for (;;) {
-        int ret;
-        pa_usec_t rtpoll_sleep = 0, real_sleep;
+/* Called from IO context. Does what an iteration of the IO loop does
+ * before it goes to sleep, and tells how long to sleep, 0 meaning until
+ * a message or the device wakes us up. */
+static int io_iterate(struct userdata *u, pa_usec_t *ret_sleep) {
+    pa_usec_t rtpoll_sleep = 0;
+    bool traced = false;
 
 #ifdef DEBUG_TIMING
-        pa_log_debug("Loop");
+    pa_log_debug("Loop");
 #endif
 
-        if (PA_UNLIKELY(u->sink->thread_info.rewind_requested)) {
-            if (process_rewind(u) < 0)
-                goto fail;
-        }
+    if (PA_UNLIKELY(u->sink->thread_info.rewind_requested)) {
+        if (process_rewind(u) < 0)
+            return -1;
+    }
 
-        /* Render some data and write it to the dsp */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            int work_done;
-            pa_usec_t sleep_usec = 0;
-            bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
+    /* Render some data and write it to the dsp */
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        int work_done;
+        pa_usec_t sleep_usec = 0;
+        bool on_timeout = u->timer_elapsed;
+        uint64_t write_count;
 
-            if (u->use_mmap)
-                work_done = mmap_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
-            else
-                work_done = unix_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
+        u->trace_entry.time = pa_rtclock_now();
+        u->hw_query_valid = false;
+        if (on_timeout)
+            u->trace_entry.flags |= PA_IO_TRACE_TIMEOUT;
+        if (u->revents & POLLOUT)
+            u->trace_entry.flags |= PA_IO_TRACE_POLLED;
+        traced = true;
 
-            if (work_done < 0)
-                goto fail;
+        write_count = u->write_count;
+        PA_TRACE_BEGIN(PA_TRACEPOINT_ALSA_SINK_WRITE, u->sink->index, on_timeout);
 
-/*             pa_log_debug("work_done = %i", work_done); */
+        if (u->use_mmap)
+            work_done = mmap_write(u, &sleep_usec, u->revents & POLLOUT, on_timeout);
+        else
+            work_done = unix_write(u, &sleep_usec, u->revents & POLLOUT, on_timeout);
 
-            if (work_done) {
+        PA_TRACE_END(PA_TRACEPOINT_ALSA_SINK_WRITE, u->sink->index, (int64_t) (u->write_count - write_count));
 
-                if (u->first) {
-                    pa_log_info("Starting playback.");
-                    snd_pcm_start(u->pcm_handle);
+        if (work_done < 0)
+            return -1;
 
-                    pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+/*         pa_log_debug("work_done = %i", work_done); */
 
-                    u->first = false;
-                }
+        if (work_done) {
+
+            if (u->first) {
+                pa_log_info("Starting playback.");
 
-                update_smoother(u);
+                if (u->io_group)
+                    pa_alsa_io_group_start_pcm(u->io_group, u->pcm_handle);
+                else
+                    snd_pcm_start(u->pcm_handle);
+
+                pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+
+                u->first = false;
             }
 
-            if (u->use_tsched) {
-                pa_usec_t cusec;
+            update_smoother(u);
+        }
 
-                if (u->since_start <= u->hwbuf_size) {
+        if (u->use_tsched) {
+            pa_usec_t cusec;
 
-                    /* USB devices on ALSA seem to hit a buffer
-                     * underrun during the first iterations much
-                     * quicker then we calculate here, probably due to
-                     * the transport latency. To accommodate for that
-                     * we artificially decrease the sleep time until
-                     * we have filled the buffer at least once
-                     * completely.*/
+            if (u->since_start <= u->hwbuf_size) {
 
-                    if (pa_log_ratelimit(PA_LOG_DEBUG))
-                        pa_log_debug("Cutting sleep time for the initial iterations by half.");
-                    sleep_usec /= 2;
-                }
+                /* USB devices on ALSA seem to hit a buffer
+                 * underrun during the first iterations much
+                 * quicker then we calculate here, probably due to
+                 * the transport latency. To accommodate for that
+                 * we artificially decrease the sleep time until
+                 * we have filled the buffer at least once
+                 * completely.*/
 
-                /* OK, the playback buffer is now full, let's
-                 * calculate when to wake up next */
+                if (pa_log_ratelimit(PA_LOG_DEBUG))
+                    pa_log_debug("Cutting sleep time for the initial iterations by half.");
+                sleep_usec /= 2;
+            }
+
+            /* OK, the playback buffer is now full, let's
+             * calculate when to wake up next */
 #ifdef DEBUG_TIMING
-                pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC);
+            pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC);
 #endif
 
-                /* Convert from the sound card time domain to the
-                 * system time domain */
-                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+            /* Convert from the sound card time domain to the
+             * system time domain */
+            cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
 
 #ifdef DEBUG_TIMING
-                pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC);
+            pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC);
 #endif
 
-                /* We don't trust the conversion, so we wake up whatever comes first */
-                rtpoll_sleep = PA_MIN(sleep_usec, cusec);
-            }
+            /* We don't trust the conversion, so we wake up whatever comes first */
+            rtpoll_sleep = PA_MIN(sleep_usec, cusec);
+        }
+
+        u->after_rewind = false;
 
-            u->after_rewind = false;
+    }
 
+    if (u->sink->flags & PA_SINK_DEFERRED_VOLUME) {
+        pa_usec_t volume_sleep;
+        pa_sink_volume_change_apply(u->sink, &volume_sleep);
+        if (volume_sleep > 0) {
+            if (rtpoll_sleep > 0)
+                rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
+            else
+                rtpoll_sleep = volume_sleep;
         }
+    }
 
-        if (u->sink->flags & PA_SINK_DEFERRED_VOLUME) {
-            pa_usec_t volume_sleep;
-            pa_sink_volume_change_apply(u->sink, &volume_sleep);
-            if (volume_sleep > 0) {
-                if (rtpoll_sleep > 0)
-                    rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
-                else
-                    rtpoll_sleep = volume_sleep;
-            }
+    if (traced) {
+        u->trace_entry.sleep_usec = rtpoll_sleep;
+        pa_io_trace_push(u->io_trace, &u->trace_entry);
+    }
+
+    pa_zero(u->trace_entry);
+
+    u->rtpoll_sleep = rtpoll_sleep;
+    if (rtpoll_sleep > 0)
+        u->sleep_start = pa_rtclock_now();
+
+    *ret_sleep = rtpoll_sleep;
+    return 0;
+}
+
+/* Called from IO context after sleeping, with u->timer_elapsed telling
+ * whether we woke up because our time was up */
+static int io_woken_up(struct userdata *u) {
+    if (u->rtpoll_sleep > 0) {
+        pa_usec_t real_sleep = pa_rtclock_now() - u->sleep_start;
+#ifdef DEBUG_TIMING
+        pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
+            (double) u->rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
+            (double) ((int64_t) real_sleep - (int64_t) u->rtpoll_sleep) / PA_USEC_PER_MSEC);
+#endif
+        if (u->timer_elapsed)
+            u->trace_entry.lateness = (int64_t) real_sleep - (int64_t) u->rtpoll_sleep;
+
+        if (u->use_tsched && real_sleep > u->rtpoll_sleep + u->tsched_watermark_usec)
+            pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
+                (double) (real_sleep - u->rtpoll_sleep) / PA_USEC_PER_MSEC,
+                (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
+    }
+
+    if (u->sink->flags & PA_SINK_DEFERRED_VOLUME)
+        pa_sink_volume_change_apply(u->sink, NULL);
+
+    /* Tell ALSA about this and process its response */
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        struct pollfd *pollfd;
+        int err;
+        unsigned n;
+
+        pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
+
+        if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &u->revents)) < 0) {
+            pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
+            return -1;
         }
 
-        if (rtpoll_sleep > 0) {
+        if (u->revents & ~POLLOUT) {
+            if (pa_alsa_recover_from_poll(u->pcm_handle, u->revents) < 0)
+                return -1;
+
+            u->trace_entry.flags |= PA_IO_TRACE_XRUN;
+
+            u->first = true;
+            u->since_start = 0;
+            u->revents = 0;
+        } else if (u->revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Wakeup from ALSA!");
+
+    } else
+        u->revents = 0;
+
+    return 0;
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Thread starting up");
+
+    make_realtime(u);
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    if (u->core->memblock_thread_cache)
+        pa_mempool_thread_cache_enable(u->core->mempool);
+
+    for (;;) {
+        pa_usec_t rtpoll_sleep;
+        int ret;
+
+        if (io_iterate(u, &rtpoll_sleep) < 0)
+            goto fail;
+
+        if (rtpoll_sleep > 0)
             pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
-            real_sleep = pa_rtclock_now();
-        }
         else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
@@ -1798,50 +2288,15 @@ static void thread_func(void *userdata) {
         if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
             goto fail;
 
-        if (rtpoll_sleep > 0) {
-            real_sleep = pa_rtclock_now() - real_sleep;
-#ifdef DEBUG_TIMING
-            pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
-                (double) rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
-                (double) ((int64_t) real_sleep - (int64_t) rtpoll_sleep) / PA_USEC_PER_MSEC);
-#endif
-            if (u->use_tsched && real_sleep > rtpoll_sleep + u->tsched_watermark_usec)
-                pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
-                    (double) (real_sleep - rtpoll_sleep) / PA_USEC_PER_MSEC,
-                    (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
-        }
-
-        if (u->sink->flags & PA_SINK_DEFERRED_VOLUME)
-            pa_sink_volume_change_apply(u->sink, NULL);
-
         if (ret == 0)
             goto finish;
 
-        /* Tell ALSA about this and process its response */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            struct pollfd *pollfd;
-            int err;
-            unsigned n;
-
-            pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
-
-            if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &revents)) < 0) {
-                pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
-                goto fail;
-            }
-
-            if (revents & ~POLLOUT) {
-                if (pa_alsa_recover_from_poll(u->pcm_handle, revents) < 0)
-                    goto fail;
+        u->timer_elapsed = pa_rtpoll_timer_elapsed(u->rtpoll);
 
-                u->first = true;
-                u->since_start = 0;
-                revents = 0;
-            } else if (revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Wakeup from ALSA!");
+        PA_TRACE_INSTANT(PA_TRACEPOINT_ALSA_WAKEUP, u->sink->index, u->timer_elapsed);
 
-        } else
-            revents = 0;
+        if (io_woken_up(u) < 0)
+            goto fail;
     }
 
 fail:
@@ -1851,9 +2306,50 @@ fail:
     pa_asyncmsgq_wait_for(u->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
 
 finish:
+    pa_mempool_thread_cache_disable(u->core->mempool);
+
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from IO context, when the sink is served by the IO thread of its
+ * card. Every call continues where the previous one went to sleep. */
+static pa_usec_t io_process(struct userdata *u) {
+    pa_usec_t rtpoll_sleep;
+
+    pa_assert(u);
+
+    if (PA_UNLIKELY(u->io_failed))
+        return PA_USEC_INVALID;
+
+    if (u->io_running) {
+        u->timer_elapsed = u->io_deadline != PA_USEC_INVALID && pa_rtclock_now() >= u->io_deadline;
+
+        if (io_woken_up(u) < 0)
+            goto fail;
+    }
+
+    u->io_running = true;
+
+    if (io_iterate(u, &rtpoll_sleep) < 0)
+        goto fail;
+
+    u->io_deadline = rtpoll_sleep > 0 ? pa_rtclock_now() + rtpoll_sleep : PA_USEC_INVALID;
+    return u->io_deadline;
+
+fail:
+    /* The other devices of the card go on until the card is unloaded,
+     * stop polling ours in the meantime */
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+
+    if (u->alsa_rtpoll_item) {
+        pa_rtpoll_item_free(u->alsa_rtpoll_item);
+        u->alsa_rtpoll_item = NULL;
+    }
+
+    u->io_failed = true;
+    return PA_USEC_INVALID;
+}
+
 static void set_sink_name(pa_sink_new_data *data, pa_modargs *ma, const char *device_id, const char *device_name, pa_alsa_mapping *mapping) {
     const char *n;
     char *t;
@@ -1975,7 +2471,8 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
             u->mixer_pd = pa_alsa_mixer_pdata_new();
             mixer_callback = io_mixer_callback;
 
-            if (pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
+            /* A shared rtpoll is hooked up once the IO thread runs us */
+            if (!u->io_group && pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
                 pa_log("Failed to initialize file descriptor monitoring");
                 return -1;
             }
@@ -1998,7 +2495,7 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
     return 0;
 }
 
-pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping) {
+pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping, pa_alsa_io_group *io_group) {
 
     struct userdata *u = NULL;
     const char *dev_id = NULL, *key, *mod_name;
@@ -2006,10 +2503,11 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     char *thread_name = NULL;
     uint32_t alternate_sample_rate;
     pa_channel_map map;
-    uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark, rewind_safeguard;
+    uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark, rewind_safeguard, render_ahead = 0;
     snd_pcm_uframes_t period_frames, buffer_frames, tsched_frames;
     size_t frame_size;
     bool use_mmap = true, b, use_tsched = true, d, ignore_dB = false, namereg_fail = false, deferred_volume = false, set_formats = false, fixed_latency_range = false;
+    bool single_hw_query = false, use_rewinds = true, standby = false;
     pa_sink_new_data data;
     bool volume_is_set;
     bool mute_is_set;
@@ -2053,7 +2551,15 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     frag_size = (uint32_t) pa_usec_to_bytes(m->core->default_fragment_size_msec*PA_USEC_PER_MSEC, &ss);
     if (frag_size <= 0)
         frag_size = (uint32_t) frame_size;
-    tsched_size = (uint32_t) pa_usec_to_bytes(DEFAULT_TSCHED_BUFFER_USEC, &ss);
+
+    if (pa_modargs_get_value_boolean(ma, "rewinds", &use_rewinds) < 0) {
+        pa_log("Failed to parse rewinds argument.");
+        goto fail;
+    }
+
+    /* Without rewinds nothing that was written can be taken back, hence
+     * keep the buffer small and fill it up early */
+    tsched_size = (uint32_t) pa_usec_to_bytes(use_rewinds ? DEFAULT_TSCHED_BUFFER_USEC : NO_REWIND_TSCHED_BUFFER_USEC, &ss);
     tsched_watermark = (uint32_t) pa_usec_to_bytes(DEFAULT_TSCHED_WATERMARK_USEC, &ss);
 
     if (pa_modargs_get_value_u32(ma, "fragments", &nfrags) < 0 ||
@@ -2091,6 +2597,21 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "render_ahead", &render_ahead) < 0) {
+        pa_log("Failed to parse render_ahead argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "single_hw_query", &single_hw_query) < 0) {
+        pa_log("Failed to parse single_hw_query argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "standby", &standby) < 0) {
+        pa_log("Failed to parse standby argument.");
+        goto fail;
+    }
+
     deferred_volume = m->core->deferred_volume;
     if (pa_modargs_get_value_boolean(ma, "deferred_volume", &deferred_volume) < 0) {
         pa_log("Failed to parse deferred_volume argument.");
@@ -2109,12 +2630,18 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     u->module = m;
     u->use_mmap = use_mmap;
     u->use_tsched = use_tsched;
+    u->use_rewinds = use_rewinds;
     u->deferred_volume = deferred_volume;
     u->fixed_latency_range = fixed_latency_range;
     u->first = true;
     u->rewind_safeguard = rewind_safeguard;
-    u->rtpoll = pa_rtpoll_new();
-    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    u->io_group = io_group;
+
+    /* With an IO group the rtpoll is the one of its thread */
+    if (!u->io_group) {
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    }
 
     u->smoother = pa_smoother_new(
             SMOOTHER_ADJUST_USEC,
@@ -2215,6 +2742,28 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         u->use_tsched = use_tsched = false;
     }
 
+    if (render_ahead > 0 && !(use_mmap && use_tsched)) {
+        pa_log_info("Rendering ahead needs mmap() and timer-based scheduling, disabling it.");
+        render_ahead = 0;
+    }
+
+    /* What was rendered ahead is dropped on rewinds, which needs the
+     * inputs to keep it as history */
+    if (render_ahead > 0 && !use_rewinds) {
+        pa_log_info("Rendering ahead needs rewinds, disabling it.");
+        render_ahead = 0;
+    }
+
+    /* Without the timer every wakeup comes from the device and the
+     * smoother is only fed every few of them anyway */
+    if (single_hw_query && !use_tsched) {
+        pa_log_info("Querying the device once per wakeup needs timer-based scheduling, disabling it.");
+        single_hw_query = false;
+    }
+
+    u->single_hw_query = single_hw_query;
+    u->standby = standby;
+
     if (u->use_mmap)
         pa_log_info("Successfully enabled mmap() mode.");
 
@@ -2234,6 +2783,8 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    u->hw_params_cache = pa_hashmap_new_full(NULL, NULL, NULL, (pa_free_cb_t) snd_pcm_hw_params_free);
+
     /* ALSA might tweak the sample spec, so recalculate the frame size */
     frame_size = pa_frame_size(&ss);
 
@@ -2292,7 +2843,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     else if (u->mixer_path_set)
         pa_alsa_add_ports(&data, u->mixer_path_set, card);
 
-    u->sink = pa_sink_new(m->core, &data, PA_SINK_HARDWARE | PA_SINK_LATENCY | (u->use_tsched ? PA_SINK_DYNAMIC_LATENCY : 0) |
+    u->sink = pa_sink_new(m->core, &data, PA_SINK_HARDWARE | PA_SINK_LATENCY | (u->use_tsched && u->use_rewinds ? PA_SINK_DYNAMIC_LATENCY : 0) |
                           (set_formats ? PA_SINK_SET_FORMATS : 0));
     volume_is_set = data.volume_is_set;
     mute_is_set = data.muted_is_set;
@@ -2319,6 +2870,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     if (u->use_tsched)
         u->sink->update_requested_latency = sink_update_requested_latency_cb;
     u->sink->set_state = sink_set_state_cb;
+    u->sink->suspend_cause_changed = sink_suspend_cause_changed_cb;
     if (u->ucm_context)
         u->sink->set_port = sink_set_port_ucm_cb;
     else
@@ -2327,14 +2879,21 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         u->sink->update_rate = sink_update_rate_cb;
     u->sink->userdata = u;
 
-    pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
-    pa_sink_set_rtpoll(u->sink, u->rtpoll);
+    u->io_trace = pa_io_trace_new(IO_TRACE_ENTRIES);
+    u->sink->io_trace = u->io_trace;
+
+    if (!u->io_group) {
+        pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
+        pa_sink_set_rtpoll(u->sink, u->rtpoll);
+    }
 
     u->frame_size = frame_size;
     u->frames_per_block = pa_mempool_block_size_max(m->core->mempool) / frame_size;
+    u->render_ahead = pa_frame_align(PA_MIN((size_t) render_ahead, u->frames_per_block * frame_size), &ss);
     u->fragment_size = frag_size = (size_t) (period_frames * frame_size);
     u->hwbuf_size = buffer_size = (size_t) (buffer_frames * frame_size);
     pa_cvolume_mute(&u->hardware_volume, u->sink->sample_spec.channels);
+    save_hw_params(u);
 
     pa_log_info("Using %0.1f fragments of size %lu bytes (%0.2fms), buffer size is %lu bytes (%0.2fms)",
                 (double) u->hwbuf_size / (double) u->fragment_size,
@@ -2344,7 +2903,11 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
                 (double) pa_bytes_to_usec(u->hwbuf_size, &ss) / PA_USEC_PER_MSEC);
 
     pa_sink_set_max_request(u->sink, u->hwbuf_size);
-    if (pa_alsa_pcm_is_hw(u->pcm_handle))
+    if (!u->use_rewinds) {
+        pa_log_info("Rewinds disabled, using a fixed latency of %0.2fms",
+                    (double) pa_bytes_to_usec(u->hwbuf_size, &ss) / PA_USEC_PER_MSEC);
+        pa_sink_set_max_rewind(u->sink, 0);
+    } else if (pa_alsa_pcm_is_hw(u->pcm_handle))
         pa_sink_set_max_rewind(u->sink, u->hwbuf_size);
     else {
         pa_log_info("Disabling rewind for device %s", u->device_name);
@@ -2352,9 +2915,22 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     }
 
     if (u->use_tsched) {
+        const char *learned;
+        uint32_t usec;
+
+        /* Start from what an earlier instance learned, if
+         * module-device-restore told us and nobody asked for something
+         * specific */
+        if (!pa_modargs_get_value(ma, "tsched_buffer_watermark", NULL) &&
+            (learned = pa_proplist_gets(u->sink->proplist, PA_PROP_DEVICE_BUFFERING_WATERMARK)) &&
+            pa_atou(learned, &usec) >= 0 && usec > 0)
+            tsched_watermark = (uint32_t) pa_usec_to_bytes(usec, &ss);
+
         u->tsched_watermark_ref = tsched_watermark;
         reset_watermark(u, u->tsched_watermark_ref, &ss, false);
-    } else
+    }
+
+    if (!u->use_tsched || !u->use_rewinds)
         pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->hwbuf_size, &ss));
 
     reserve_update(u);
@@ -2370,13 +2946,25 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
 
     pa_alsa_dump(PA_LOG_DEBUG, u->pcm_handle);
 
-    thread_name = pa_sprintf_malloc("alsa-sink-%s", pa_strnull(pa_proplist_gets(u->sink->proplist, "alsa.id")));
-    if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (u->io_group) {
+        u->io_client = pa_io_scheduler_client_new(pa_alsa_io_group_get_scheduler(u->io_group), m,
+                                                  (pa_io_scheduler_process_cb_t) io_process, u);
+        u->rtpoll = pa_io_scheduler_client_get_rtpoll(u->io_client);
+
+        pa_sink_set_asyncmsgq(u->sink, pa_io_scheduler_client_get_asyncmsgq(u->io_client));
+        pa_sink_set_rtpoll(u->sink, u->rtpoll);
+    } else {
+        thread_name = pa_sprintf_malloc("alsa-sink-%s", pa_strnull(pa_proplist_gets(u->sink->proplist, "alsa.id")));
+        if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+        pa_xfree(thread_name);
+        thread_name = NULL;
+
+        pa_alsa_set_thread_affinity(u->thread, u->pcm_handle,
+                                    pa_modargs_get_value(ma, "thread_cpus", m->core->io_thread_cpus), u->sink->proplist);
     }
-    pa_xfree(thread_name);
-    thread_name = NULL;
 
     /* Get initial mixer settings */
     if (volume_is_set) {
@@ -2439,6 +3027,9 @@ fail:
 static void userdata_free(struct userdata *u) {
     pa_assert(u);
 
+    if (u->sink && (u->thread || u->io_client) && PA_SINK_IS_LINKED(u->sink->state))
+        publish_watermark(u);
+
     if (u->sink)
         pa_sink_unlink(u->sink);
 
@@ -2447,6 +3038,14 @@ static void userdata_free(struct userdata *u) {
         pa_thread_free(u->thread);
     }
 
+    if (u->io_client) {
+        pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_IO_DETACH, NULL, 0, NULL);
+        pa_io_scheduler_client_free(u->io_client);
+
+        /* Owned by the IO thread of the card */
+        u->rtpoll = NULL;
+    }
+
     pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink)
@@ -2481,12 +3080,18 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->io_trace)
+        pa_io_trace_free(u->io_trace);
+
     if (u->formats)
         pa_idxset_free(u->formats, (pa_free_cb_t) pa_format_info_free);
 
     if (u->rates)
         pa_xfree(u->rates);
 
+    if (u->hw_params_cache)
+        pa_hashmap_free(u->hw_params_cache);
+
     reserve_done(u);
     monitor_done(u);
 
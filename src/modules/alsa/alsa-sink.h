@@ -27,7 +27,8 @@
 
 #include "alsa-util.h"
 
-pa_sink* pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping);
+/* io_group may be NULL for a thread of the sink's own */
+pa_sink* pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping, pa_alsa_io_group *io_group);
 
 void pa_alsa_sink_free(pa_sink *s);
 
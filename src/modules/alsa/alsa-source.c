@@ -40,6 +40,7 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/io-trace.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -47,10 +48,12 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/tracepoint.h>
 
 #include <modules/reserve-wrap.h>
 
 #include "alsa-util.h"
+#include "alsa-tsched.h"
 #include "alsa-source.h"
 
 /* #define DEBUG_TIMING */
@@ -78,6 +81,8 @@
 
 #define VOLUME_ACCURACY (PA_VOLUME_NORM/100)
 
+#define IO_TRACE_ENTRIES 256 /* IO cycles kept for pacmd dump-source-io-trace */
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -87,6 +92,12 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Set instead of thread when the IO thread of the card serves us */
+    pa_alsa_io_group *io_group;
+    pa_io_scheduler_client *io_client;
+    pa_usec_t io_deadline;
+    bool io_running, io_failed;
+
     snd_pcm_t *pcm_handle;
 
     char *paths_dir;
@@ -129,6 +140,14 @@ struct userdata {
 
     pa_rtpoll_item *alsa_rtpoll_item;
 
+    /* Carried from one iteration of the IO loop to the next */
+    unsigned short revents;
+    bool timer_elapsed;
+    pa_usec_t rtpoll_sleep, sleep_start;
+
+    pa_io_trace *io_trace;
+    pa_io_trace_entry trace_entry; /* the cycle being traced */
+
     pa_smoother *smoother;
     uint64_t read_count;
     pa_usec_t smoother_interval;
@@ -143,6 +162,11 @@ struct userdata {
     pa_alsa_ucm_mapping_context *ucm_context;
 };
 
+enum {
+    SOURCE_MESSAGE_GET_WATERMARK = PA_SOURCE_MESSAGE_MAX,
+    SOURCE_MESSAGE_IO_DETACH
+};
+
 static void userdata_free(struct userdata *u);
 
 static pa_hook_result_t reserve_cb(pa_reserve_wrapper *r, void *forced, struct userdata *u) {
@@ -267,35 +291,21 @@ static int reserve_monitor_init(struct userdata *u, const char *dname) {
 }
 
 static void fix_min_sleep_wakeup(struct userdata *u) {
-    size_t max_use, max_use_2;
-
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    max_use = u->hwbuf_size - u->hwbuf_unused;
-    max_use_2 = pa_frame_align(max_use/2, &u->source->sample_spec);
-
-    u->min_sleep = pa_usec_to_bytes(TSCHED_MIN_SLEEP_USEC, &u->source->sample_spec);
-    u->min_sleep = PA_CLAMP(u->min_sleep, u->frame_size, max_use_2);
-
-    u->min_wakeup = pa_usec_to_bytes(TSCHED_MIN_WAKEUP_USEC, &u->source->sample_spec);
-    u->min_wakeup = PA_CLAMP(u->min_wakeup, u->frame_size, max_use_2);
+    pa_alsa_tsched_fix_min_sleep_wakeup(&u->source->sample_spec, u->hwbuf_size - u->hwbuf_unused,
+                                        TSCHED_MIN_SLEEP_USEC, TSCHED_MIN_WAKEUP_USEC,
+                                        &u->min_sleep, &u->min_wakeup);
 }
 
 static void fix_tsched_watermark(struct userdata *u) {
-    size_t max_use;
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    max_use = u->hwbuf_size - u->hwbuf_unused;
-
-    if (u->tsched_watermark > max_use - u->min_sleep)
-        u->tsched_watermark = max_use - u->min_sleep;
-
-    if (u->tsched_watermark < u->min_wakeup)
-        u->tsched_watermark = u->min_wakeup;
-
-   u->tsched_watermark_usec = pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec);
+    u->tsched_watermark = pa_alsa_tsched_fix_watermark(u->tsched_watermark, u->hwbuf_size - u->hwbuf_unused,
+                                                       u->min_sleep, u->min_wakeup);
+    u->tsched_watermark_usec = pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec);
 }
 
 static void increase_watermark(struct userdata *u) {
@@ -307,7 +317,7 @@ static void increase_watermark(struct userdata *u) {
 
     /* First, just try to increase the watermark */
     old_watermark = u->tsched_watermark;
-    u->tsched_watermark = PA_MIN(u->tsched_watermark * 2, u->tsched_watermark + u->watermark_inc_step);
+    u->tsched_watermark = pa_alsa_tsched_increase_watermark(u->tsched_watermark, u->watermark_inc_step);
     fix_tsched_watermark(u);
 
     if (old_watermark != u->tsched_watermark) {
@@ -323,8 +333,8 @@ static void increase_watermark(struct userdata *u) {
         return;
 
     old_min_latency = u->source->thread_info.min_latency;
-    new_min_latency = PA_MIN(old_min_latency * 2, old_min_latency + TSCHED_WATERMARK_INC_STEP_USEC);
-    new_min_latency = PA_MIN(new_min_latency, u->source->thread_info.max_latency);
+    new_min_latency = pa_alsa_tsched_increase_min_latency(old_min_latency, u->source->thread_info.max_latency,
+                                                          TSCHED_WATERMARK_INC_STEP_USEC);
 
     if (old_min_latency != new_min_latency) {
         pa_log_info("Increasing minimal latency to %0.2f ms",
@@ -353,11 +363,7 @@ static void decrease_watermark(struct userdata *u) {
 
     old_watermark = u->tsched_watermark;
 
-    if (u->tsched_watermark < u->watermark_dec_step)
-        u->tsched_watermark = u->tsched_watermark / 2;
-    else
-        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
-
+    u->tsched_watermark = pa_alsa_tsched_decrease_watermark(u->tsched_watermark, u->watermark_dec_step);
     fix_tsched_watermark(u);
 
     if (old_watermark != u->tsched_watermark)
@@ -371,7 +377,7 @@ restart:
 }
 
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
-    pa_usec_t wm, usec;
+    pa_usec_t usec;
 
     pa_assert(sleep_usec);
     pa_assert(process_usec);
@@ -384,13 +390,7 @@ static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*p
     if (usec == (pa_usec_t) -1)
         usec = pa_bytes_to_usec(u->hwbuf_size, &u->source->sample_spec);
 
-    wm = u->tsched_watermark_usec;
-
-    if (wm > usec)
-        wm = usec/2;
-
-    *sleep_usec = usec - wm;
-    *process_usec = wm;
+    pa_alsa_tsched_sleep_time(usec, u->tsched_watermark_usec, sleep_usec, process_usec);
 
 #ifdef DEBUG_TIMING
     pa_log_debug("Buffer time: %lu ms; Sleep time: %lu ms; Process time: %lu ms",
@@ -409,8 +409,11 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     pa_assert(err != -EAGAIN);
 
-    if (err == -EPIPE)
+    if (err == -EPIPE) {
         pa_log_debug("%s: Buffer overrun!", call);
+        u->trace_entry.flags |= PA_IO_TRACE_XRUN;
+        pa_metric_inc(u->source->metrics.xruns);
+    }
 
     if (err == -ESTRPIPE)
         pa_log_debug("%s: System suspended!", call);
@@ -446,6 +449,8 @@ static size_t check_left_to_record(struct userdata *u, size_t n_bytes, bool on_t
         PA_DEBUG_TRAP;
 #endif
 
+        u->trace_entry.flags |= PA_IO_TRACE_XRUN;
+
         if (pa_log_ratelimit(PA_LOG_INFO))
             pa_log_info("Overrun!");
     }
@@ -495,8 +500,13 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
         int r;
         bool after_avail = true;
 
+        pa_io_trace_count_queries(u->io_trace, 1);
+
         if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->source->sample_spec)) < 0)) {
 
+            if (j == 0)
+                u->trace_entry.avail = n;
+
             if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
                 continue;
 
@@ -505,6 +515,9 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
 
         n_bytes = (size_t) n * u->frame_size;
 
+        if (j == 0 && u->trace_entry.avail >= 0)
+            u->trace_entry.avail = (int64_t) n_bytes;
+
 #ifdef DEBUG_TIMING
         pa_log_debug("avail: %lu", (unsigned long) n_bytes);
 #endif
@@ -560,6 +573,7 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
             const snd_pcm_channel_area_t *areas;
             snd_pcm_uframes_t offset, frames;
             snd_pcm_sframes_t sframes;
+            pa_usec_t post_start;
 
             frames = (snd_pcm_uframes_t) (n_bytes / u->frame_size);
 /*             pa_log_debug("%lu frames to read", (unsigned long) frames); */
@@ -598,7 +612,9 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
             chunk.length = pa_memblock_get_length(chunk.memblock);
             chunk.index = 0;
 
+            post_start = pa_rtclock_now();
             pa_source_post(u->source, &chunk);
+            u->trace_entry.process_usec += pa_rtclock_now() - post_start;
             pa_memblock_unref_fixed(chunk.memblock);
 
             if (PA_UNLIKELY((sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames)) < 0)) {
@@ -655,8 +671,13 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
         int r;
         bool after_avail = true;
 
+        pa_io_trace_count_queries(u->io_trace, 1);
+
         if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->source->sample_spec)) < 0)) {
 
+            if (j == 0)
+                u->trace_entry.avail = n;
+
             if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
                 continue;
 
@@ -664,6 +685,9 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
         }
 
         n_bytes = (size_t) n * u->frame_size;
+
+        if (j == 0 && u->trace_entry.avail >= 0)
+            u->trace_entry.avail = (int64_t) n_bytes;
         left_to_record = check_left_to_record(u, n_bytes, on_timeout);
         on_timeout = false;
 
@@ -701,6 +725,7 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
             void *p;
             snd_pcm_sframes_t frames;
             pa_memchunk chunk;
+            pa_usec_t post_start;
 
             chunk.memblock = pa_memblock_new(u->core->mempool, (size_t) -1);
 
@@ -738,7 +763,9 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
             chunk.index = 0;
             chunk.length = (size_t) frames * u->frame_size;
 
+            post_start = pa_rtclock_now();
             pa_source_post(u->source, &chunk);
+            u->trace_entry.process_usec += pa_rtclock_now() - post_start;
             pa_memblock_unref(chunk.memblock);
 
             work_done = true;
@@ -782,6 +809,8 @@ static void update_smoother(struct userdata *u) {
 
     /* Let's update the time smoother */
 
+    pa_io_trace_count_queries(u->io_trace, 1);
+
     if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, status, &delay, u->hwbuf_size, &u->source->sample_spec, true)) < 0)) {
         pa_log_warn("Failed to get delay: %s", pa_alsa_strerror(err));
         return;
@@ -843,6 +872,11 @@ static int suspend(struct userdata *u) {
 
     pa_smoother_pause(u->smoother, pa_rtclock_now());
 
+    /* Resume with the watermark we learned so far instead of learning it
+     * all over again from the configured one */
+    if (u->use_tsched)
+        u->tsched_watermark_ref = u->tsched_watermark;
+
     /* Let's suspend */
     snd_pcm_close(u->pcm_handle);
     u->pcm_handle = NULL;
@@ -1009,7 +1043,7 @@ static int unsuspend(struct userdata *u) {
 
     u->first = true;
 
-    /* reset the watermark to the value defined when source was created */
+    /* reset the watermark to the value we had when we were suspended */
     if (u->use_tsched)
         reset_watermark(u, u->tsched_watermark_ref, &u->source->sample_spec, true);
 
@@ -1043,6 +1077,24 @@ static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t off
             return 0;
         }
 
+        case SOURCE_MESSAGE_GET_WATERMARK:
+            *((pa_usec_t*) data) = u->tsched_watermark_usec;
+            return 0;
+
+        case SOURCE_MESSAGE_IO_DETACH:
+            /* The rtpoll of the card is only touched from its thread */
+            if (u->alsa_rtpoll_item) {
+                pa_rtpoll_item_free(u->alsa_rtpoll_item);
+                u->alsa_rtpoll_item = NULL;
+            }
+
+            if (u->mixer_pd) {
+                pa_alsa_mixer_pdata_free(u->mixer_pd);
+                u->mixer_pd = NULL;
+            }
+
+            return 0;
+
         case PA_SOURCE_MESSAGE_SET_STATE:
 
             switch ((pa_source_state_t) PA_PTR_TO_UINT(data)) {
@@ -1065,6 +1117,10 @@ static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t off
                     if (u->source->thread_info.state == PA_SOURCE_INIT) {
                         if (build_pollfd(u) < 0)
                             return -PA_ERR_IO;
+
+                        if (u->io_group && u->mixer_pd &&
+                            pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0)
+                            return -PA_ERR_IO;
                     }
 
                     if (u->source->thread_info.state == PA_SOURCE_SUSPENDED) {
@@ -1087,6 +1143,30 @@ static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t off
     return pa_source_process_msg(o, code, data, offset, chunk);
 }
 
+/* Called from main context. Publishes the watermark the IO thread
+ * learned, so that module-device-restore can start the next instance of
+ * this source with it. */
+static void publish_watermark(struct userdata *u) {
+    pa_usec_t watermark;
+    const char *old;
+    pa_proplist *pl;
+
+    if (!u->use_tsched)
+        return;
+
+    if (pa_asyncmsgq_send(u->source->asyncmsgq, PA_MSGOBJECT(u->source), SOURCE_MESSAGE_GET_WATERMARK, &watermark, 0, NULL) < 0)
+        return;
+
+    pl = pa_proplist_new();
+    pa_proplist_setf(pl, PA_PROP_DEVICE_BUFFERING_WATERMARK, "%llu", (unsigned long long) watermark);
+
+    if (!(old = pa_proplist_gets(u->source->proplist, PA_PROP_DEVICE_BUFFERING_WATERMARK)) ||
+        !pa_streq(old, pa_proplist_gets(pl, PA_PROP_DEVICE_BUFFERING_WATERMARK)))
+        pa_source_update_proplist(u->source, PA_UPDATE_REPLACE, pl);
+
+    pa_proplist_free(pl);
+}
+
 /* Called from main context */
 static int source_set_state_cb(pa_source *s, pa_source_state_t new_state) {
     pa_source_state_t old_state;
@@ -1097,9 +1177,10 @@ static int source_set_state_cb(pa_source *s, pa_source_state_t new_state) {
 
     old_state = pa_source_get_state(u->source);
 
-    if (PA_SOURCE_IS_OPENED(old_state) && new_state == PA_SOURCE_SUSPENDED)
+    if (PA_SOURCE_IS_OPENED(old_state) && new_state == PA_SOURCE_SUSPENDED) {
+        publish_watermark(u);
         reserve_done(u);
-    else if (old_state == PA_SOURCE_SUSPENDED && PA_SOURCE_IS_OPENED(new_state))
+    } else if (old_state == PA_SOURCE_SUSPENDED && PA_SOURCE_IS_OPENED(new_state))
         if (reserve_init(u, u->device_name) < 0)
             return -PA_ERR_BUSY;
 
@@ -1427,139 +1508,214 @@ static int source_update_rate_cb(pa_source *s, uint32_t rate) {
     return -1;
 }
 
-static void thread_func(void *userdata) {
-    struct userdata *u = userdata;
-    unsigned short revents = 0;
+/* With timer scheduling the thread has to be done within a watermark
+ * after it woke up, so it asks for a share of every watermark period */
+#define DEADLINE_RUNTIME_DIVISOR 4
 
-    pa_assert(u);
+static void make_realtime(struct userdata *u) {
+    if (u->core->deadline_scheduling && u->use_tsched) {
+        pa_usec_t period = pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec);
 
-    pa_log_debug("Thread starting up");
+        if (pa_make_deadline(period / DEADLINE_RUNTIME_DIVISOR, period) >= 0)
+            return;
+    }
 
     if (u->core->realtime_scheduling)
         pa_make_realtime(u->core->realtime_priority);
+}
 
-    pa_thread_mq_install(&u->thread_mq);
-
-    for (;;) {
-        int ret;
-        pa_usec_t rtpoll_sleep = 0, real_sleep;
+/* Called from IO context. Does what an iteration of the IO loop does
+ * before it goes to sleep, and tells how long to sleep, 0 meaning until
+ * a message or the device wakes us up. */
+static int io_iterate(struct userdata *u, pa_usec_t *ret_sleep) {
+    pa_usec_t rtpoll_sleep = 0;
+    bool traced = false;
 
 #ifdef DEBUG_TIMING
-        pa_log_debug("Loop");
+    pa_log_debug("Loop");
 #endif
 
-        /* Read some data and pass it to the sources */
-        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
-            int work_done;
-            pa_usec_t sleep_usec = 0;
-            bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
-
-            if (u->first) {
-                pa_log_info("Starting capture.");
+    /* Read some data and pass it to the sources */
+    if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+        int work_done;
+        pa_usec_t sleep_usec = 0;
+        bool on_timeout = u->timer_elapsed;
+        uint64_t read_count;
+
+        u->trace_entry.time = pa_rtclock_now();
+        if (on_timeout)
+            u->trace_entry.flags |= PA_IO_TRACE_TIMEOUT;
+        if (u->revents & POLLIN)
+            u->trace_entry.flags |= PA_IO_TRACE_POLLED;
+        traced = true;
+
+        if (u->first) {
+            pa_log_info("Starting capture.");
+
+            if (u->io_group)
+                pa_alsa_io_group_start_pcm(u->io_group, u->pcm_handle);
+            else
                 snd_pcm_start(u->pcm_handle);
 
-                pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+            pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
 
-                u->first = false;
-            }
+            u->first = false;
+        }
 
-            if (u->use_mmap)
-                work_done = mmap_read(u, &sleep_usec, revents & POLLIN, on_timeout);
-            else
-                work_done = unix_read(u, &sleep_usec, revents & POLLIN, on_timeout);
+        read_count = u->read_count;
+        PA_TRACE_BEGIN(PA_TRACEPOINT_ALSA_SOURCE_READ, u->source->index, on_timeout);
 
-            if (work_done < 0)
-                goto fail;
+        if (u->use_mmap)
+            work_done = mmap_read(u, &sleep_usec, u->revents & POLLIN, on_timeout);
+        else
+            work_done = unix_read(u, &sleep_usec, u->revents & POLLIN, on_timeout);
 
-/*             pa_log_debug("work_done = %i", work_done); */
+        PA_TRACE_END(PA_TRACEPOINT_ALSA_SOURCE_READ, u->source->index, (int64_t) (u->read_count - read_count));
 
-            if (work_done)
-                update_smoother(u);
+        if (work_done < 0)
+            return -1;
 
-            if (u->use_tsched) {
-                pa_usec_t cusec;
+/*         pa_log_debug("work_done = %i", work_done); */
 
-                /* OK, the capture buffer is now empty, let's
-                 * calculate when to wake up next */
+        if (work_done)
+            update_smoother(u);
 
-/*                 pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC); */
+        if (u->use_tsched) {
+            pa_usec_t cusec;
 
-                /* Convert from the sound card time domain to the
-                 * system time domain */
-                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+            /* OK, the capture buffer is now empty, let's
+             * calculate when to wake up next */
 
-/*                 pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC); */
+/*             pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC); */
 
-                /* We don't trust the conversion, so we wake up whatever comes first */
-                rtpoll_sleep = PA_MIN(sleep_usec, cusec);
-            }
-        }
+            /* Convert from the sound card time domain to the
+             * system time domain */
+            cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
 
-        if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME) {
-            pa_usec_t volume_sleep;
-            pa_source_volume_change_apply(u->source, &volume_sleep);
-            if (volume_sleep > 0) {
-                if (rtpoll_sleep > 0)
-                    rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
-                else
-                    rtpoll_sleep = volume_sleep;
-            }
+/*             pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC); */
+
+            /* We don't trust the conversion, so we wake up whatever comes first */
+            rtpoll_sleep = PA_MIN(sleep_usec, cusec);
         }
+    }
 
-        if (rtpoll_sleep > 0) {
-            pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
-            real_sleep = pa_rtclock_now();
+    if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME) {
+        pa_usec_t volume_sleep;
+        pa_source_volume_change_apply(u->source, &volume_sleep);
+        if (volume_sleep > 0) {
+            if (rtpoll_sleep > 0)
+                rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
+            else
+                rtpoll_sleep = volume_sleep;
         }
-        else
-            pa_rtpoll_set_timer_disabled(u->rtpoll);
+    }
 
-        /* Hmm, nothing to do. Let's sleep */
-        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
-            goto fail;
+    if (traced) {
+        u->trace_entry.sleep_usec = rtpoll_sleep;
+        pa_io_trace_push(u->io_trace, &u->trace_entry);
+    }
+
+    pa_zero(u->trace_entry);
+
+    u->rtpoll_sleep = rtpoll_sleep;
+    if (rtpoll_sleep > 0)
+        u->sleep_start = pa_rtclock_now();
+
+    *ret_sleep = rtpoll_sleep;
+    return 0;
+}
 
-        if (rtpoll_sleep > 0) {
-            real_sleep = pa_rtclock_now() - real_sleep;
+/* Called from IO context after sleeping, with u->timer_elapsed telling
+ * whether we woke up because our time was up */
+static int io_woken_up(struct userdata *u) {
+    if (u->rtpoll_sleep > 0) {
+        pa_usec_t real_sleep = pa_rtclock_now() - u->sleep_start;
 #ifdef DEBUG_TIMING
-            pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
-                (double) rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
-                (double) ((int64_t) real_sleep - (int64_t) rtpoll_sleep) / PA_USEC_PER_MSEC);
+        pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
+            (double) u->rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
+            (double) ((int64_t) real_sleep - (int64_t) u->rtpoll_sleep) / PA_USEC_PER_MSEC);
 #endif
-            if (u->use_tsched && real_sleep > rtpoll_sleep + u->tsched_watermark_usec)
-                pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
-                    (double) (real_sleep - rtpoll_sleep) / PA_USEC_PER_MSEC,
-                    (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
+        if (u->timer_elapsed)
+            u->trace_entry.lateness = (int64_t) real_sleep - (int64_t) u->rtpoll_sleep;
+
+        if (u->use_tsched && real_sleep > u->rtpoll_sleep + u->tsched_watermark_usec)
+            pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
+                (double) (real_sleep - u->rtpoll_sleep) / PA_USEC_PER_MSEC,
+                (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
+    }
+
+    if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME)
+        pa_source_volume_change_apply(u->source, NULL);
+
+    /* Tell ALSA about this and process its response */
+    if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+        struct pollfd *pollfd;
+        int err;
+        unsigned n;
+
+        pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
+
+        if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &u->revents)) < 0) {
+            pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
+            return -1;
         }
 
-        if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME)
-            pa_source_volume_change_apply(u->source, NULL);
+        if (u->revents & ~POLLIN) {
+            if (pa_alsa_recover_from_poll(u->pcm_handle, u->revents) < 0)
+                return -1;
 
-        if (ret == 0)
-            goto finish;
+            u->trace_entry.flags |= PA_IO_TRACE_XRUN;
 
-        /* Tell ALSA about this and process its response */
-        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
-            struct pollfd *pollfd;
-            int err;
-            unsigned n;
+            u->first = true;
+            u->revents = 0;
+        } else if (u->revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Wakeup from ALSA!");
 
-            pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
+    } else
+        u->revents = 0;
 
-            if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &revents)) < 0) {
-                pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
-                goto fail;
-            }
+    return 0;
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
 
-            if (revents & ~POLLIN) {
-                if (pa_alsa_recover_from_poll(u->pcm_handle, revents) < 0)
-                    goto fail;
+    pa_assert(u);
 
-                u->first = true;
-                revents = 0;
-            } else if (revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Wakeup from ALSA!");
+    pa_log_debug("Thread starting up");
 
-        } else
-            revents = 0;
+    make_realtime(u);
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    if (u->core->memblock_thread_cache)
+        pa_mempool_thread_cache_enable(u->core->mempool);
+
+    for (;;) {
+        pa_usec_t rtpoll_sleep;
+        int ret;
+
+        if (io_iterate(u, &rtpoll_sleep) < 0)
+            goto fail;
+
+        if (rtpoll_sleep > 0)
+            pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
+        else
+            pa_rtpoll_set_timer_disabled(u->rtpoll);
+
+        /* Hmm, nothing to do. Let's sleep */
+        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+
+        u->timer_elapsed = pa_rtpoll_timer_elapsed(u->rtpoll);
+
+        PA_TRACE_INSTANT(PA_TRACEPOINT_ALSA_WAKEUP, u->source->index, u->timer_elapsed);
+
+        if (io_woken_up(u) < 0)
+            goto fail;
     }
 
 fail:
@@ -1569,9 +1725,50 @@ fail:
     pa_asyncmsgq_wait_for(u->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
 
 finish:
+    pa_mempool_thread_cache_disable(u->core->mempool);
+
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from IO context, when the source is served by the IO thread of
+ * its card. Every call continues where the previous one went to sleep. */
+static pa_usec_t io_process(struct userdata *u) {
+    pa_usec_t rtpoll_sleep;
+
+    pa_assert(u);
+
+    if (PA_UNLIKELY(u->io_failed))
+        return PA_USEC_INVALID;
+
+    if (u->io_running) {
+        u->timer_elapsed = u->io_deadline != PA_USEC_INVALID && pa_rtclock_now() >= u->io_deadline;
+
+        if (io_woken_up(u) < 0)
+            goto fail;
+    }
+
+    u->io_running = true;
+
+    if (io_iterate(u, &rtpoll_sleep) < 0)
+        goto fail;
+
+    u->io_deadline = rtpoll_sleep > 0 ? pa_rtclock_now() + rtpoll_sleep : PA_USEC_INVALID;
+    return u->io_deadline;
+
+fail:
+    /* The other devices of the card go on until the card is unloaded,
+     * stop polling ours in the meantime */
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+
+    if (u->alsa_rtpoll_item) {
+        pa_rtpoll_item_free(u->alsa_rtpoll_item);
+        u->alsa_rtpoll_item = NULL;
+    }
+
+    u->io_failed = true;
+    return PA_USEC_INVALID;
+}
+
 static void set_source_name(pa_source_new_data *data, pa_modargs *ma, const char *device_id, const char *device_name, pa_alsa_mapping *mapping) {
     const char *n;
     char *t;
@@ -1692,7 +1889,8 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
             u->mixer_pd = pa_alsa_mixer_pdata_new();
             mixer_callback = io_mixer_callback;
 
-            if (pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
+            /* A shared rtpoll is hooked up once the IO thread runs us */
+            if (!u->io_group && pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
                 pa_log("Failed to initialize file descriptor monitoring");
                 return -1;
             }
@@ -1715,7 +1913,7 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
     return 0;
 }
 
-pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping) {
+pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping, pa_alsa_io_group *io_group) {
 
     struct userdata *u = NULL;
     const char *dev_id = NULL, *key, *mod_name;
@@ -1823,8 +2021,13 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     u->deferred_volume = deferred_volume;
     u->fixed_latency_range = fixed_latency_range;
     u->first = true;
-    u->rtpoll = pa_rtpoll_new();
-    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    u->io_group = io_group;
+
+    /* With an IO group the rtpoll is the one of its thread */
+    if (!u->io_group) {
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    }
 
     u->smoother = pa_smoother_new(
             SMOOTHER_ADJUST_USEC,
@@ -2032,8 +2235,13 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
         u->source->update_rate = source_update_rate_cb;
     u->source->userdata = u;
 
-    pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
-    pa_source_set_rtpoll(u->source, u->rtpoll);
+    u->io_trace = pa_io_trace_new(IO_TRACE_ENTRIES);
+    u->source->io_trace = u->io_trace;
+
+    if (!u->io_group) {
+        pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
+        pa_source_set_rtpoll(u->source, u->rtpoll);
+    }
 
     u->frame_size = frame_size;
     u->frames_per_block = pa_mempool_block_size_max(m->core->mempool) / frame_size;
@@ -2049,6 +2257,17 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
                 (double) pa_bytes_to_usec(u->hwbuf_size, &ss) / PA_USEC_PER_MSEC);
 
     if (u->use_tsched) {
+        const char *learned;
+        uint32_t usec;
+
+        /* Start from what an earlier instance learned, if
+         * module-device-restore told us and nobody asked for something
+         * specific */
+        if (!pa_modargs_get_value(ma, "tsched_buffer_watermark", NULL) &&
+            (learned = pa_proplist_gets(u->source->proplist, PA_PROP_DEVICE_BUFFERING_WATERMARK)) &&
+            pa_atou(learned, &usec) >= 0 && usec > 0)
+            tsched_watermark = (uint32_t) pa_usec_to_bytes(usec, &ss);
+
         u->tsched_watermark_ref = tsched_watermark;
         reset_watermark(u, u->tsched_watermark_ref, &ss, false);
     }
@@ -2068,13 +2287,25 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
 
     pa_alsa_dump(PA_LOG_DEBUG, u->pcm_handle);
 
-    thread_name = pa_sprintf_malloc("alsa-source-%s", pa_strnull(pa_proplist_gets(u->source->proplist, "alsa.id")));
-    if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (u->io_group) {
+        u->io_client = pa_io_scheduler_client_new(pa_alsa_io_group_get_scheduler(u->io_group), m,
+                                                  (pa_io_scheduler_process_cb_t) io_process, u);
+        u->rtpoll = pa_io_scheduler_client_get_rtpoll(u->io_client);
+
+        pa_source_set_asyncmsgq(u->source, pa_io_scheduler_client_get_asyncmsgq(u->io_client));
+        pa_source_set_rtpoll(u->source, u->rtpoll);
+    } else {
+        thread_name = pa_sprintf_malloc("alsa-source-%s", pa_strnull(pa_proplist_gets(u->source->proplist, "alsa.id")));
+        if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+        pa_xfree(thread_name);
+        thread_name = NULL;
+
+        pa_alsa_set_thread_affinity(u->thread, u->pcm_handle,
+                                    pa_modargs_get_value(ma, "thread_cpus", m->core->io_thread_cpus), u->source->proplist);
     }
-    pa_xfree(thread_name);
-    thread_name = NULL;
 
     /* Get initial mixer settings */
     if (volume_is_set) {
@@ -2122,6 +2353,9 @@ fail:
 static void userdata_free(struct userdata *u) {
     pa_assert(u);
 
+    if (u->source && (u->thread || u->io_client) && PA_SOURCE_IS_LINKED(u->source->state))
+        publish_watermark(u);
+
     if (u->source)
         pa_source_unlink(u->source);
 
@@ -2130,6 +2364,14 @@ static void userdata_free(struct userdata *u) {
         pa_thread_free(u->thread);
     }
 
+    if (u->io_client) {
+        pa_asyncmsgq_send(u->source->asyncmsgq, PA_MSGOBJECT(u->source), SOURCE_MESSAGE_IO_DETACH, NULL, 0, NULL);
+        pa_io_scheduler_client_free(u->io_client);
+
+        /* Owned by the IO thread of the card */
+        u->rtpoll = NULL;
+    }
+
     pa_thread_mq_done(&u->thread_mq);
 
     if (u->source)
@@ -2161,6 +2403,9 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->io_trace)
+        pa_io_trace_free(u->io_trace);
+
     if (u->rates)
         pa_xfree(u->rates);
 
@@ -0,0 +1,86 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "alsa-tsched.h"
+
+void pa_alsa_tsched_fix_min_sleep_wakeup(const pa_sample_spec *ss, size_t max_use,
+                                         pa_usec_t min_sleep_usec, pa_usec_t min_wakeup_usec,
+                                         size_t *min_sleep, size_t *min_wakeup) {
+    size_t frame_size, max_use_2;
+
+    pa_assert(ss);
+    pa_assert(min_sleep);
+    pa_assert(min_wakeup);
+
+    frame_size = pa_frame_size(ss);
+    max_use_2 = pa_frame_align(max_use/2, ss);
+
+    *min_sleep = pa_usec_to_bytes(min_sleep_usec, ss);
+    *min_sleep = PA_CLAMP(*min_sleep, frame_size, max_use_2);
+
+    *min_wakeup = pa_usec_to_bytes(min_wakeup_usec, ss);
+    *min_wakeup = PA_CLAMP(*min_wakeup, frame_size, max_use_2);
+}
+
+size_t pa_alsa_tsched_fix_watermark(size_t watermark, size_t max_use, size_t min_sleep, size_t min_wakeup) {
+
+    if (watermark > max_use - min_sleep)
+        watermark = max_use - min_sleep;
+
+    if (watermark < min_wakeup)
+        watermark = min_wakeup;
+
+    return watermark;
+}
+
+size_t pa_alsa_tsched_increase_watermark(size_t watermark, size_t inc_step) {
+    return PA_MIN(watermark * 2, watermark + inc_step);
+}
+
+size_t pa_alsa_tsched_decrease_watermark(size_t watermark, size_t dec_step) {
+
+    if (watermark < dec_step)
+        return watermark / 2;
+
+    return PA_MAX(watermark / 2, watermark - dec_step);
+}
+
+pa_usec_t pa_alsa_tsched_increase_min_latency(pa_usec_t min_latency, pa_usec_t max_latency, pa_usec_t inc_step) {
+    pa_usec_t l;
+
+    l = PA_MIN(min_latency * 2, min_latency + inc_step);
+    return PA_MIN(l, max_latency);
+}
+
+void pa_alsa_tsched_sleep_time(pa_usec_t latency, pa_usec_t watermark_usec, pa_usec_t *sleep_usec, pa_usec_t *process_usec) {
+
+    pa_assert(sleep_usec);
+    pa_assert(process_usec);
+
+    if (watermark_usec > latency)
+        watermark_usec = latency/2;
+
+    *sleep_usec = latency - watermark_usec;
+    *process_usec = watermark_usec;
+}
@@ -0,0 +1,55 @@
+#ifndef fooalsatschedhfoo
+#define fooalsatschedhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/types.h>
+
+#include <pulse/sample.h>
+
+/* The arithmetic of timer based scheduling: how the wakeup watermark
+ * moves and how long to sleep. Nothing in here talks to the PCM, so
+ * module-sim-sink and module-sim-source use it as well. Sizes are in
+ * bytes, max_use is the part of the hardware buffer in use. */
+
+/* Clamps the minimal sleep and wakeup times to between one frame and
+ * half of the buffer */
+void pa_alsa_tsched_fix_min_sleep_wakeup(const pa_sample_spec *ss, size_t max_use,
+                                         pa_usec_t min_sleep_usec, pa_usec_t min_wakeup_usec,
+                                         size_t *min_sleep, size_t *min_wakeup);
+
+/* Returns the watermark limited to what the buffer allows, with room
+ * for min_sleep above it and at least min_wakeup */
+size_t pa_alsa_tsched_fix_watermark(size_t watermark, size_t max_use, size_t min_sleep, size_t min_wakeup);
+
+/* The watermark after an underrun resp. after a verification period
+ * without one, before pa_alsa_tsched_fix_watermark(). At most doubles
+ * resp. halves it. */
+size_t pa_alsa_tsched_increase_watermark(size_t watermark, size_t inc_step);
+size_t pa_alsa_tsched_decrease_watermark(size_t watermark, size_t dec_step);
+
+/* The minimal latency to use once the watermark can't grow any
+ * further */
+pa_usec_t pa_alsa_tsched_increase_min_latency(pa_usec_t min_latency, pa_usec_t max_latency, pa_usec_t inc_step);
+
+/* Splits the latency into the time to sleep and the time left for
+ * processing. latency is the requested latency or, if there is none,
+ * the whole buffer. */
+void pa_alsa_tsched_sleep_time(pa_usec_t latency, pa_usec_t watermark_usec, pa_usec_t *sleep_usec, pa_usec_t *process_usec);
+
+#endif
@@ -990,10 +990,15 @@ int pa_alsa_ucm_set_profile(pa_alsa_ucm_config *ucm, const char *new_profile, co
         ret = -1;
     }
 
-    /* find active verb */
+    /* find active verb, setting the verb disables all devices */
     ucm->active_verb = NULL;
     PA_LLIST_FOREACH(verb, ucm->verbs) {
         const char *verb_name;
+        pa_alsa_ucm_device *dev;
+
+        PA_LLIST_FOREACH(dev, verb->devices)
+            dev->enabled = false;
+
         verb_name = pa_proplist_gets(verb->proplist, PA_ALSA_PROP_UCM_NAME);
         if (pa_streq(verb_name, profile)) {
             ucm->active_verb = verb;
@@ -1008,7 +1013,7 @@ int pa_alsa_ucm_set_port(pa_alsa_ucm_mapping_context *context, pa_device_port *p
     int i;
     int ret = 0;
     pa_alsa_ucm_config *ucm;
-    const char **enable_devs;
+    pa_alsa_ucm_device **enable_devs;
     int enable_num = 0;
     uint32_t idx;
     pa_alsa_ucm_device *dev;
@@ -1018,31 +1023,37 @@ int pa_alsa_ucm_set_port(pa_alsa_ucm_mapping_context *context, pa_device_port *p
     ucm = context->ucm;
     pa_assert(ucm->ucm_mgr);
 
-    enable_devs = pa_xnew(const char *, pa_idxset_size(context->ucm_devices));
+    enable_devs = pa_xnew(pa_alsa_ucm_device *, pa_idxset_size(context->ucm_devices));
 
-    /* first disable then enable */
+    /* first disable then enable, leaving alone the devices the old and
+     * the new port have in common */
     PA_IDXSET_FOREACH(dev, context->ucm_devices, idx) {
         const char *dev_name = pa_proplist_gets(dev->proplist, PA_ALSA_PROP_UCM_NAME);
 
-        if (ucm_port_contains(port->name, dev_name, is_sink))
-            enable_devs[enable_num++] = dev_name;
-        else {
+        if (ucm_port_contains(port->name, dev_name, is_sink)) {
+            if (!dev->enabled)
+                enable_devs[enable_num++] = dev;
+        } else if (dev->enabled) {
             pa_log_debug("Disable ucm device %s", dev_name);
-            if (snd_use_case_set(ucm->ucm_mgr, "_disdev", dev_name) > 0) {
+            if (snd_use_case_set(ucm->ucm_mgr, "_disdev", dev_name) < 0) {
                 pa_log("Failed to disable ucm device %s", dev_name);
                 ret = -1;
                 break;
             }
+            dev->enabled = false;
         }
     }
 
     for (i = 0; i < enable_num; i++) {
-        pa_log_debug("Enable ucm device %s", enable_devs[i]);
-        if (snd_use_case_set(ucm->ucm_mgr, "_enadev", enable_devs[i]) < 0) {
-            pa_log("Failed to enable ucm device %s", enable_devs[i]);
+        const char *dev_name = pa_proplist_gets(enable_devs[i]->proplist, PA_ALSA_PROP_UCM_NAME);
+
+        pa_log_debug("Enable ucm device %s", dev_name);
+        if (snd_use_case_set(ucm->ucm_mgr, "_enadev", dev_name) < 0) {
+            pa_log("Failed to enable ucm device %s", dev_name);
             ret = -1;
             break;
         }
+        enable_devs[i]->enabled = true;
     }
 
     pa_xfree(enable_devs);
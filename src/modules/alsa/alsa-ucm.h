@@ -144,6 +144,11 @@ struct pa_alsa_ucm_device {
 
     pa_alsa_jack *input_jack;
     pa_alsa_jack *output_jack;
+
+    /* Whether we ran the enable sequence of the device since the verb was
+     * last set, so that port switches only run the sequences that change
+     * something */
+    bool enabled;
 };
 
 struct pa_alsa_ucm_modifier {
@@ -447,6 +447,50 @@ finish:
     return ret;
 }
 
+snd_pcm_hw_params_t *pa_alsa_save_hw_params(snd_pcm_t *pcm_handle) {
+    snd_pcm_hw_params_t *hwparams;
+    int err;
+
+    pa_assert(pcm_handle);
+
+    if ((err = snd_pcm_hw_params_malloc(&hwparams)) < 0) {
+        pa_log_warn("snd_pcm_hw_params_malloc() failed: %s", pa_alsa_strerror(err));
+        return NULL;
+    }
+
+    if ((err = snd_pcm_hw_params_current(pcm_handle, hwparams)) < 0) {
+        pa_log_info("snd_pcm_hw_params_current() failed: %s", pa_alsa_strerror(err));
+        snd_pcm_hw_params_free(hwparams);
+        return NULL;
+    }
+
+    return hwparams;
+}
+
+int pa_alsa_restore_hw_params(snd_pcm_t *pcm_handle, const snd_pcm_hw_params_t *saved) {
+    snd_pcm_hw_params_t *hwparams;
+    int err;
+
+    pa_assert(pcm_handle);
+    pa_assert(saved);
+
+    /* snd_pcm_hw_params() refines what it is given */
+    snd_pcm_hw_params_alloca(&hwparams);
+    snd_pcm_hw_params_copy(hwparams, saved);
+
+    if ((err = snd_pcm_hw_params(pcm_handle, hwparams)) < 0) {
+        pa_log_debug("snd_pcm_hw_params() with saved parameters failed: %s", pa_alsa_strerror(err));
+        return err;
+    }
+
+    if ((err = snd_pcm_prepare(pcm_handle)) < 0) {
+        pa_log_info("snd_pcm_prepare() failed: %s", pa_alsa_strerror(err));
+        return err;
+    }
+
+    return 0;
+}
+
 int pa_alsa_set_sw_params(snd_pcm_t *pcm, snd_pcm_uframes_t avail_min, bool period_event) {
     snd_pcm_sw_params_t *swparams;
     snd_pcm_uframes_t boundary;
@@ -1310,6 +1354,175 @@ char *pa_alsa_get_driver_name(int card) {
     return n;
 }
 
+int pa_alsa_get_numa_node(int card) {
+    char *t, *s;
+    int32_t node = -1;
+
+    pa_assert(card >= 0);
+
+    t = pa_sprintf_malloc("/sys/class/sound/card%i/device/numa_node", card);
+    s = pa_read_line_from_file(t);
+    pa_xfree(t);
+
+    if (!s)
+        return -1;
+
+    if (pa_atoi(s, &node) < 0 || node < 0)
+        node = -1;
+
+    pa_xfree(s);
+
+    return (int) node;
+}
+
+/* The CPUs the card's interrupt is routed to, or failing that the ones
+ * local to the bus the card is on */
+static char *get_irq_cpus(int card) {
+    char *t, *s;
+    uint32_t irq;
+
+    pa_assert(card >= 0);
+
+    t = pa_sprintf_malloc("/sys/class/sound/card%i/device/irq", card);
+    s = pa_read_line_from_file(t);
+    pa_xfree(t);
+
+    if (s && pa_atou(s, &irq) >= 0 && irq > 0) {
+        pa_xfree(s);
+
+        t = pa_sprintf_malloc("/proc/irq/%u/smp_affinity_list", irq);
+        s = pa_read_line_from_file(t);
+        pa_xfree(t);
+
+        if (s && *s)
+            return s;
+    }
+
+    pa_xfree(s);
+
+    t = pa_sprintf_malloc("/sys/class/sound/card%i/device/local_cpulist", card);
+    s = pa_read_line_from_file(t);
+    pa_xfree(t);
+
+    if (s && !*s) {
+        pa_xfree(s);
+        s = NULL;
+    }
+
+    return s;
+}
+
+void pa_alsa_set_thread_affinity(pa_thread *t, snd_pcm_t *pcm, const char *cpus, pa_proplist *p) {
+    char *irq_cpus = NULL;
+
+    pa_assert(t);
+    pa_assert(pcm);
+    pa_assert(p);
+
+    if (!cpus || pa_streq(cpus, "none"))
+        return;
+
+    if (pa_streq(cpus, "irq")) {
+        snd_pcm_info_t* info;
+        int card;
+
+        snd_pcm_info_alloca(&info);
+
+        if (snd_pcm_info(pcm, info) < 0 || (card = snd_pcm_info_get_card(info)) < 0 ||
+            !(irq_cpus = get_irq_cpus(card))) {
+            pa_log_info("Could not find the CPUs handling the interrupt of the device, not binding the IO thread.");
+            return;
+        }
+
+        cpus = irq_cpus;
+    }
+
+    if (pa_thread_set_affinity(t, cpus) >= 0)
+        pa_proplist_sets(p, PA_PROP_DEVICE_THREAD_CPUS, cpus);
+
+    pa_xfree(irq_cpus);
+}
+
+struct pa_alsa_io_group {
+    pa_io_scheduler *scheduler;
+
+    /* Only accessed from the IO thread */
+    snd_pcm_t **pending;
+    unsigned n_pending, n_allocated;
+};
+
+/* Called from IO context, after all devices of the group ran */
+static void start_pending(void *userdata) {
+    pa_alsa_io_group *g = userdata;
+    unsigned i;
+    int err;
+
+    if (g->n_pending == 0)
+        return;
+
+    /* Linked PCMs start on the same sample. They are unlinked again right
+     * away so that stopping one of them doesn't stop the others too. */
+    for (i = 1; i < g->n_pending; i++)
+        if ((err = snd_pcm_link(g->pending[0], g->pending[i])) < 0) {
+            pa_log_debug("Failed to link PCMs, starting them separately: %s", pa_alsa_strerror(err));
+            snd_pcm_start(g->pending[i]);
+            g->pending[i] = NULL;
+        }
+
+    snd_pcm_start(g->pending[0]);
+
+    for (i = 1; i < g->n_pending; i++)
+        if (g->pending[i])
+            snd_pcm_unlink(g->pending[i]);
+
+    if (g->n_pending > 1)
+        pa_log_debug("Started %u PCMs together.", g->n_pending);
+
+    g->n_pending = 0;
+}
+
+pa_alsa_io_group *pa_alsa_io_group_new(pa_core *c, const char *name) {
+    pa_alsa_io_group *g;
+
+    pa_assert(c);
+    pa_assert(name);
+
+    g = pa_xnew0(pa_alsa_io_group, 1);
+
+    if (!(g->scheduler = pa_io_scheduler_new(c, name, start_pending, g))) {
+        pa_xfree(g);
+        return NULL;
+    }
+
+    return g;
+}
+
+void pa_alsa_io_group_free(pa_alsa_io_group *g) {
+    pa_assert(g);
+
+    pa_io_scheduler_unref(g->scheduler);
+    pa_xfree(g->pending);
+    pa_xfree(g);
+}
+
+pa_io_scheduler *pa_alsa_io_group_get_scheduler(pa_alsa_io_group *g) {
+    pa_assert(g);
+
+    return g->scheduler;
+}
+
+void pa_alsa_io_group_start_pcm(pa_alsa_io_group *g, snd_pcm_t *pcm) {
+    pa_assert(g);
+    pa_assert(pcm);
+
+    if (g->n_pending >= g->n_allocated) {
+        g->n_allocated = PA_MAX(2 * g->n_allocated, 4U);
+        g->pending = pa_xrenew(snd_pcm_t*, g->pending, g->n_allocated);
+    }
+
+    g->pending[g->n_pending++] = pcm;
+}
+
 char *pa_alsa_get_driver_name_by_pcm(snd_pcm_t *pcm) {
     int card;
     snd_pcm_info_t* info;
@@ -28,7 +28,9 @@
 #include <pulse/proplist.h>
 
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/core.h>
+#include <pulsecore/io-scheduler.h>
 #include <pulsecore/log.h>
 
 #include "alsa-mixer.h"
@@ -43,6 +45,15 @@ int pa_alsa_set_hw_params(
         bool *use_tsched,                  /* modified at return */
         bool require_exact_channel_number);
 
+/* Returns the hardware parameters currently installed on the device, to
+ * be handed to pa_alsa_restore_hw_params() later. Free with
+ * snd_pcm_hw_params_free(). */
+snd_pcm_hw_params_t *pa_alsa_save_hw_params(snd_pcm_t *pcm_handle);
+
+/* Installs parameters returned by pa_alsa_save_hw_params() for the same
+ * device again, without negotiating them */
+int pa_alsa_restore_hw_params(snd_pcm_t *pcm_handle, const snd_pcm_hw_params_t *saved);
+
 int pa_alsa_set_sw_params(
         snd_pcm_t *pcm,
         snd_pcm_uframes_t avail_min,
@@ -129,6 +140,26 @@ int pa_alsa_safe_mmap_begin(snd_pcm_t *pcm, const snd_pcm_channel_area_t **areas
 char *pa_alsa_get_driver_name(int card);
 char *pa_alsa_get_driver_name_by_pcm(snd_pcm_t *pcm);
 
+/* Returns the NUMA node the card is attached to, or -1 if unknown */
+int pa_alsa_get_numa_node(int card);
+
+/* Binds t to the CPUs in cpus, or for "irq" to the ones that handle the
+ * interrupt of the card pcm belongs to, and records the binding in p */
+void pa_alsa_set_thread_affinity(pa_thread *t, snd_pcm_t *pcm, const char *cpus, pa_proplist *p);
+
+/* A single IO thread driving all PCMs of a card, whose sinks and sources
+ * are clients of its scheduler */
+typedef struct pa_alsa_io_group pa_alsa_io_group;
+
+pa_alsa_io_group *pa_alsa_io_group_new(pa_core *c, const char *name);
+void pa_alsa_io_group_free(pa_alsa_io_group *g);
+pa_io_scheduler *pa_alsa_io_group_get_scheduler(pa_alsa_io_group *g);
+
+/* Called from the IO thread instead of snd_pcm_start(). The PCMs started
+ * within the same round are started together, so that they run sample
+ * aligned. */
+void pa_alsa_io_group_start_pcm(pa_alsa_io_group *g, snd_pcm_t *pcm);
+
 char *pa_alsa_get_reserve_name(const char *device);
 
 unsigned int *pa_alsa_get_supported_rates(snd_pcm_t *pcm, unsigned int fallback_rate);
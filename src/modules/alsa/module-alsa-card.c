@@ -26,7 +26,10 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/modargs.h>
+#include <pulsecore/msgobject.h>
 #include <pulsecore/queue.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -64,11 +67,19 @@ PA_MODULE_USAGE(
         "tsched_buffer_watermark=<lower fill watermark> "
         "profile=<profile name> "
         "fixed_latency_range=<disable latency range changes on underrun?> "
+        "rewinds=<allow rewinding the device buffer, or play at a small fixed latency?> "
         "ignore_dB=<ignore dB information from the device?> "
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
         "profile_set=<profile set configuration file> "
         "paths_dir=<directory containing the path configuration files> "
         "use_ucm=<load use case manager> "
+        "thread_cpus=<CPUs to bind the IO thread to, 'irq' or 'none'> "
+        "render_ahead=<number of bytes to render before they are needed> "
+        "single_hw_query=<ask the device for its position only once per wakeup?> "
+        "standby=<keep the device open but stopped while suspended for being idle?> "
+        "single_io_thread=<drive all PCMs of the card from one IO thread?> "
+        "probe_cache=<reuse what probing the card found on earlier starts?> "
+        "async_probe=<probe the card in a worker thread and create it afterwards?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -90,17 +101,36 @@ static const char* const valid_modargs[] = {
     "tsched_buffer_size",
     "tsched_buffer_watermark",
     "fixed_latency_range",
+    "rewinds",
     "profile",
     "ignore_dB",
     "deferred_volume",
     "profile_set",
     "paths_dir",
     "use_ucm",
+    "thread_cpus",
+    "render_ahead",
+    "single_hw_query",
+    "standby",
+    "single_io_thread",
+    "probe_cache",
+    "async_probe",
     NULL
 };
 
 #define DEFAULT_DEVICE_ID "0"
 
+struct card_msg {
+    pa_msgobject parent;
+};
+
+typedef struct card_msg card_msg;
+PA_DEFINE_PRIVATE_CLASS(card_msg, pa_msgobject);
+
+enum {
+    CARD_MESSAGE_PROBE_DONE
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -118,6 +148,20 @@ struct userdata {
 
     pa_alsa_profile_set *profile_set;
 
+    pa_reserve_wrapper *reserve;
+
+    /* Only set while the profile set is probed in a worker thread, which
+     * tells the main thread through probe_mq when it is done */
+    pa_thread *probe_thread;
+    pa_thread_mq probe_mq;
+    card_msg *msg;
+    pa_sample_spec probe_ss;
+    unsigned probe_n_fragments, probe_fragment_size_msec;
+    bool probe_cache;
+
+    /* If set, the sinks and sources share its IO thread */
+    pa_alsa_io_group *io_group;
+
     /* ucm stuffs */
     bool use_ucm;
     pa_alsa_ucm_config ucm;
@@ -247,7 +291,7 @@ static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
         PA_IDXSET_FOREACH(am, nd->profile->output_mappings, idx) {
 
             if (!am->sink)
-                am->sink = pa_alsa_sink_new(c->module, u->modargs, __FILE__, c, am);
+                am->sink = pa_alsa_sink_new(c->module, u->modargs, __FILE__, c, am, u->io_group);
 
             if (sink_inputs && am->sink) {
                 pa_sink_move_all_finish(am->sink, sink_inputs, false);
@@ -259,7 +303,7 @@ static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
         PA_IDXSET_FOREACH(am, nd->profile->input_mappings, idx) {
 
             if (!am->source)
-                am->source = pa_alsa_source_new(c->module, u->modargs, __FILE__, c, am);
+                am->source = pa_alsa_source_new(c->module, u->modargs, __FILE__, c, am, u->io_group);
 
             if (source_outputs && am->source) {
                 pa_source_move_all_finish(am->source, source_outputs, false);
@@ -297,11 +341,11 @@ static void init_profile(struct userdata *u) {
 
     if (d->profile && d->profile->output_mappings)
         PA_IDXSET_FOREACH(am, d->profile->output_mappings, idx)
-            am->sink = pa_alsa_sink_new(u->module, u->modargs, __FILE__, u->card, am);
+            am->sink = pa_alsa_sink_new(u->module, u->modargs, __FILE__, u->card, am, u->io_group);
 
     if (d->profile && d->profile->input_mappings)
         PA_IDXSET_FOREACH(am, d->profile->input_mappings, idx)
-            am->source = pa_alsa_source_new(u->module, u->modargs, __FILE__, u->card, am);
+            am->source = pa_alsa_source_new(u->module, u->modargs, __FILE__, u->card, am, u->io_group);
 }
 
 static void report_port_state(pa_device_port *p, struct userdata *u) {
@@ -378,6 +422,12 @@ static int report_jack_state(snd_mixer_elem_t *melem, unsigned int mask) {
 
     PA_HASHMAP_FOREACH(jack, u->jacks, state)
         if (jack->melem == melem) {
+            /* Drivers send value events for writes that change nothing,
+             * don't go through all ports for those. A zero mask is the
+             * initial report, which has to set up the ports in any case. */
+            if (mask != 0 && jack->plugged_in == plugged_in)
+                continue;
+
             jack->plugged_in = plugged_in;
             if (u->use_ucm) {
                 pa_assert(u->card->ports);
@@ -614,16 +664,134 @@ static pa_hook_result_t source_output_unlink_hook_callback(pa_core *c, pa_source
     return PA_HOOK_OK;
 }
 
-int pa__init(pa_module *m) {
+/* Creates the card from the probed profile set */
+static int card_new(struct userdata *u) {
     pa_card_new_data data;
-    bool ignore_dB = false;
-    struct userdata *u;
-    pa_reserve_wrapper *reserve = NULL;
     const char *description;
     const char *profile = NULL;
-    char *fn = NULL;
     bool namereg_fail = false;
 
+    pa_assert(u);
+    pa_assert(u->profile_set->probed);
+
+    pa_alsa_profile_set_dump(u->profile_set);
+
+    pa_card_new_data_init(&data);
+    data.driver = __FILE__;
+    data.module = u->module;
+
+    pa_alsa_init_proplist_card(u->core, data.proplist, u->alsa_card_index);
+
+    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_STRING, u->device_id);
+    pa_alsa_init_description(data.proplist, NULL);
+    set_card_name(&data, u->modargs, u->device_id);
+
+    /* We need to give pa_modargs_get_value_boolean() a pointer to a local
+     * variable instead of using &data.namereg_fail directly, because
+     * data.namereg_fail is a bitfield and taking the address of a bitfield
+     * variable is impossible. */
+    namereg_fail = data.namereg_fail;
+    if (pa_modargs_get_value_boolean(u->modargs, "namereg_fail", &namereg_fail) < 0) {
+        pa_log("Failed to parse namereg_fail argument.");
+        pa_card_new_data_done(&data);
+        return -1;
+    }
+    data.namereg_fail = namereg_fail;
+
+    if (u->reserve)
+        if ((description = pa_proplist_gets(data.proplist, PA_PROP_DEVICE_DESCRIPTION)))
+            pa_reserve_wrapper_set_application_device_name(u->reserve, description);
+
+    add_profiles(u, data.profiles, data.ports);
+
+    if (pa_hashmap_isempty(data.profiles)) {
+        pa_log("Failed to find a working profile.");
+        pa_card_new_data_done(&data);
+        return -1;
+    }
+
+    add_disabled_profile(data.profiles);
+
+    if (pa_modargs_get_proplist(u->modargs, "card_properties", data.proplist, PA_UPDATE_REPLACE) < 0) {
+        pa_log("Invalid properties");
+        pa_card_new_data_done(&data);
+        return -1;
+    }
+
+    if ((profile = pa_modargs_get_value(u->modargs, "profile", NULL)))
+        pa_card_new_data_set_profile(&data, profile);
+
+    u->card = pa_card_new(u->core, &data);
+    pa_card_new_data_done(&data);
+
+    if (!u->card)
+        return -1;
+
+    u->card->userdata = u;
+    u->card->set_profile = card_set_profile;
+
+    init_jacks(u);
+    init_profile(u);
+    init_eld_ctls(u);
+
+    /* The sinks and sources took their own reference, if any */
+    if (u->reserve) {
+        pa_reserve_wrapper_unref(u->reserve);
+        u->reserve = NULL;
+    }
+
+    if (!pa_hashmap_isempty(u->profile_set->decibel_fixes))
+        pa_log_warn("Card %s uses decibel fixes (i.e. overrides the decibel information for some alsa volume elements). "
+                    "Please note that this feature is meant just as a help for figuring out the correct decibel values. "
+                    "PulseAudio is not the correct place to maintain the decibel mappings! The fixed decibel values "
+                    "should be sent to ALSA developers so that they can fix the driver. If it turns out that this feature "
+                    "is abused (i.e. fixes are not pushed to ALSA), the decibel fix feature may be removed in some future "
+                    "PulseAudio version.", u->card->name);
+
+    return 0;
+}
+
+static void probe_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Probing card %s in a worker thread.", u->device_id);
+
+    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &u->probe_ss, u->probe_n_fragments,
+                              u->probe_fragment_size_msec, u->probe_cache);
+
+    pa_asyncmsgq_post(u->probe_mq.outq, PA_MSGOBJECT(u->msg), CARD_MESSAGE_PROBE_DONE, u, 0, NULL, NULL);
+}
+
+/* Runs in the main thread */
+static int card_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = data;
+
+    pa_assert(u);
+
+    switch (code) {
+        case CARD_MESSAGE_PROBE_DONE:
+            pa_thread_free(u->probe_thread);
+            u->probe_thread = NULL;
+
+            if (card_new(u) < 0)
+                pa_module_unload_request(u->module, true);
+
+            return 0;
+
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+int pa__init(pa_module *m) {
+    bool ignore_dB = false;
+    struct userdata *u;
+    char *fn = NULL;
+    bool single_io_thread = false;
+    bool async_probe = false;
+
     pa_alsa_refcnt_inc();
 
     pa_assert(m);
@@ -633,6 +801,7 @@ int pa__init(pa_module *m) {
     u->module = m;
     u->use_ucm = true;
     u->ucm.core = m->core;
+    u->probe_cache = true;
 
     if (!(u->modargs = pa_modargs_new(m->argument, valid_modargs))) {
         pa_log("Failed to parse module arguments.");
@@ -646,19 +815,49 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (m->core->mempool_numa_node_auto)
+        pa_core_set_mempool_numa_node(m->core, pa_alsa_get_numa_node(u->alsa_card_index));
+
     if (pa_modargs_get_value_boolean(u->modargs, "ignore_dB", &ignore_dB) < 0) {
         pa_log("Failed to parse ignore_dB argument.");
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(u->modargs, "single_io_thread", &single_io_thread) < 0) {
+        pa_log("Failed to parse single_io_thread argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(u->modargs, "probe_cache", &u->probe_cache) < 0) {
+        pa_log("Failed to parse probe_cache argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(u->modargs, "async_probe", &async_probe) < 0) {
+        pa_log("Failed to parse async_probe argument.");
+        goto fail;
+    }
+
+    /* All PCMs of a card run from the same clock, so one thread can serve
+     * them all and start them together */
+    if (single_io_thread) {
+        char *name = pa_sprintf_malloc("alsa-card-%i", u->alsa_card_index);
+
+        u->io_group = pa_alsa_io_group_new(m->core, name);
+        pa_xfree(name);
+
+        if (!u->io_group)
+            goto fail;
+    }
+
     if (!pa_in_system_mode()) {
         char *rname;
 
         if ((rname = pa_alsa_get_reserve_name(u->device_id))) {
-            reserve = pa_reserve_wrapper_get(m->core, rname);
+            u->reserve = pa_reserve_wrapper_get(m->core, rname);
             pa_xfree(rname);
 
-            if (!reserve)
+            if (!u->reserve)
                 goto fail;
         }
     }
@@ -703,84 +902,36 @@ int pa__init(pa_module *m) {
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
-    pa_alsa_profile_set_dump(u->profile_set);
-
-    pa_card_new_data_init(&data);
-    data.driver = __FILE__;
-    data.module = m;
-
-    pa_alsa_init_proplist_card(m->core, data.proplist, u->alsa_card_index);
-
-    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_STRING, u->device_id);
-    pa_alsa_init_description(data.proplist, NULL);
-    set_card_name(&data, u->modargs, u->device_id);
-
-    /* We need to give pa_modargs_get_value_boolean() a pointer to a local
-     * variable instead of using &data.namereg_fail directly, because
-     * data.namereg_fail is a bitfield and taking the address of a bitfield
-     * variable is impossible. */
-    namereg_fail = data.namereg_fail;
-    if (pa_modargs_get_value_boolean(u->modargs, "namereg_fail", &namereg_fail) < 0) {
-        pa_log("Failed to parse namereg_fail argument.");
-        pa_card_new_data_done(&data);
-        goto fail;
-    }
-    data.namereg_fail = namereg_fail;
-
-    if (reserve)
-        if ((description = pa_proplist_gets(data.proplist, PA_PROP_DEVICE_DESCRIPTION)))
-            pa_reserve_wrapper_set_application_device_name(reserve, description);
-
-    add_profiles(u, data.profiles, data.ports);
-
-    if (pa_hashmap_isempty(data.profiles)) {
-        pa_log("Failed to find a working profile.");
-        pa_card_new_data_done(&data);
-        goto fail;
-    }
-
-    add_disabled_profile(data.profiles);
+    u->probe_ss = m->core->default_sample_spec;
+    u->probe_n_fragments = m->core->default_n_fragments;
+    u->probe_fragment_size_msec = m->core->default_fragment_size_msec;
+
+    /* Probing opens every PCM of the card, which can take long enough to
+     * stall the main loop. Nothing but the worker touches the profile set
+     * until it is done, after which the card is created from
+     * card_process_msg(). */
+    if (async_probe && !u->profile_set->probed) {
+        pa_thread_mq_init(&u->probe_mq, m->core->mainloop, NULL);
+        u->msg = pa_msgobject_new(card_msg);
+        u->msg->parent.process_msg = card_process_msg;
+
+        if (!(u->probe_thread = pa_thread_new("alsa-probe", probe_thread_func, u))) {
+            pa_log("Failed to create probe thread.");
+            goto fail;
+        }
 
-    if (pa_modargs_get_proplist(u->modargs, "card_properties", data.proplist, PA_UPDATE_REPLACE) < 0) {
-        pa_log("Invalid properties");
-        pa_card_new_data_done(&data);
-        goto fail;
+        return 0;
     }
 
-    if ((profile = pa_modargs_get_value(u->modargs, "profile", NULL)))
-        pa_card_new_data_set_profile(&data, profile);
+    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &u->probe_ss, u->probe_n_fragments,
+                              u->probe_fragment_size_msec, u->probe_cache);
 
-    u->card = pa_card_new(m->core, &data);
-    pa_card_new_data_done(&data);
-
-    if (!u->card)
+    if (card_new(u) < 0)
         goto fail;
 
-    u->card->userdata = u;
-    u->card->set_profile = card_set_profile;
-
-    init_jacks(u);
-    init_profile(u);
-    init_eld_ctls(u);
-
-    if (reserve)
-        pa_reserve_wrapper_unref(reserve);
-
-    if (!pa_hashmap_isempty(u->profile_set->decibel_fixes))
-        pa_log_warn("Card %s uses decibel fixes (i.e. overrides the decibel information for some alsa volume elements). "
-                    "Please note that this feature is meant just as a help for figuring out the correct decibel values. "
-                    "PulseAudio is not the correct place to maintain the decibel mappings! The fixed decibel values "
-                    "should be sent to ALSA developers so that they can fix the driver. If it turns out that this feature "
-                    "is abused (i.e. fixes are not pushed to ALSA), the decibel fix feature may be removed in some future "
-                    "PulseAudio version.", u->card->name);
-
     return 0;
 
 fail:
-    if (reserve)
-        pa_reserve_wrapper_unref(reserve);
-
     pa__done(m);
 
     return -1;
@@ -795,7 +946,9 @@ int pa__get_n_used(pa_module *m) {
 
     pa_assert(m);
     pa_assert_se(u = m->userdata);
-    pa_assert(u->card);
+
+    if (!u->card)
+        return 0;
 
     PA_IDXSET_FOREACH(sink, u->card->sinks, idx)
         n += pa_sink_linked_by(sink);
@@ -814,6 +967,15 @@ void pa__done(pa_module*m) {
     if (!(u = m->userdata))
         goto finish;
 
+    /* The worker owns the profile set until it is done */
+    if (u->probe_thread)
+        pa_thread_free(u->probe_thread);
+
+    if (u->msg) {
+        pa_thread_mq_done(&u->probe_mq);
+        card_msg_unref(u->msg);
+    }
+
     if (u->mixer_fdl)
         pa_alsa_fdlist_free(u->mixer_fdl);
     if (u->mixer_handle)
@@ -830,12 +992,18 @@ void pa__done(pa_module*m) {
     if (u->card)
         pa_card_free(u->card);
 
+    if (u->io_group)
+        pa_alsa_io_group_free(u->io_group);
+
     if (u->modargs)
         pa_modargs_free(u->modargs);
 
     if (u->profile_set)
         pa_alsa_profile_set_free(u->profile_set);
 
+    if (u->reserve)
+        pa_reserve_wrapper_unref(u->reserve);
+
     pa_alsa_ucm_free(&u->ucm);
 
     pa_xfree(u->device_id);
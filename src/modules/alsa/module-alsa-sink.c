@@ -55,10 +55,15 @@ PA_MODULE_USAGE(
         "ignore_dB=<ignore dB information from the device?> "
         "control=<name of mixer control> "
         "rewind_safeguard=<number of bytes that cannot be rewound> "
+        "render_ahead=<number of bytes to render before they are needed> "
+        "single_hw_query=<ask the device for its position only once per wakeup?> "
+        "standby=<keep the device open but stopped while suspended for being idle?> "
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
         "deferred_volume_safety_margin=<usec adjustment depending on volume direction> "
         "deferred_volume_extra_delay=<usec adjustment to HW volume changes> "
-        "fixed_latency_range=<disable latency range changes on underrun?>");
+        "fixed_latency_range=<disable latency range changes on underrun?> "
+        "rewinds=<allow rewinding the device buffer, or play at a small fixed latency?> "
+        "thread_cpus=<CPUs to bind the IO thread to, 'irq' or 'none'>");
 
 static const char* const valid_modargs[] = {
     "name",
@@ -81,10 +86,15 @@ static const char* const valid_modargs[] = {
     "ignore_dB",
     "control",
     "rewind_safeguard",
+    "render_ahead",
+    "single_hw_query",
+    "standby",
     "deferred_volume",
     "deferred_volume_safety_margin",
     "deferred_volume_extra_delay",
     "fixed_latency_range",
+    "rewinds",
+    "thread_cpus",
     NULL
 };
 
@@ -100,7 +110,7 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
-    if (!(m->userdata = pa_alsa_sink_new(m, ma, __FILE__, NULL, NULL)))
+    if (!(m->userdata = pa_alsa_sink_new(m, ma, __FILE__, NULL, NULL, NULL)))
         goto fail;
 
     pa_modargs_free(ma);
@@ -66,7 +66,8 @@ PA_MODULE_USAGE(
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
         "deferred_volume_safety_margin=<usec adjustment depending on volume direction> "
         "deferred_volume_extra_delay=<usec adjustment to HW volume changes> "
-        "fixed_latency_range=<disable latency range changes on overrun?>");
+        "fixed_latency_range=<disable latency range changes on overrun?> "
+        "thread_cpus=<CPUs to bind the IO thread to, 'irq' or 'none'>");
 
 static const char* const valid_modargs[] = {
     "name",
@@ -92,6 +93,7 @@ static const char* const valid_modargs[] = {
     "deferred_volume_safety_margin",
     "deferred_volume_extra_delay",
     "fixed_latency_range",
+    "thread_cpus",
     NULL
 };
 
@@ -107,7 +109,7 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
-    if (!(m->userdata = pa_alsa_source_new(m, ma, __FILE__, NULL, NULL)))
+    if (!(m->userdata = pa_alsa_source_new(m, ma, __FILE__, NULL, NULL, NULL)))
         goto fail;
 
     pa_modargs_free(ma);
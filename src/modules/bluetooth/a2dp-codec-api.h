@@ -0,0 +1,81 @@
+#ifndef fooa2dpcodecapihfoo
+#define fooa2dpcodecapihfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/core.h>
+
+#define MAX_A2DP_CAPS_SIZE 254
+
+/* An A2DP codec. The first group of callbacks is used by the endpoints in
+ * bluez5-util.c to negotiate a configuration with the remote device, from
+ * the main thread. The second group runs a stream with a negotiated
+ * configuration, from the IO thread of module-bluez5-device, except for
+ * init() and deinit(). Encoded packets include the RTP headers. */
+typedef struct pa_a2dp_codec {
+    /* Unique name, used for the endpoint paths and in the proplist */
+    const char *name;
+    /* Human readable description */
+    const char *description;
+    /* Codec id, as in a2dp-codecs.h */
+    uint8_t id;
+
+    /* Fills the capabilities we announce to BlueZ, returns their size */
+    uint8_t (*fill_capabilities)(uint8_t capabilities_buffer[MAX_A2DP_CAPS_SIZE]);
+    /* Returns whether a configuration chosen by the remote device is one
+     * we can handle */
+    bool (*is_configuration_valid)(const uint8_t *config_buffer, uint8_t config_size);
+    /* Chooses a configuration out of the remote capabilities that fits
+     * default_sample_spec best, returns its size or 0 if there is none */
+    uint8_t (*fill_preferred_configuration)(const pa_sample_spec *default_sample_spec,
+                                            const uint8_t *capabilities_buffer, uint8_t capabilities_size,
+                                            uint8_t config_buffer[MAX_A2DP_CAPS_SIZE]);
+
+    /* Sets up an encoder or decoder for a valid configuration and fills
+     * in the sample spec it works with. Returns the codec state. */
+    void *(*init)(bool for_encoding, const uint8_t *config_buffer, uint8_t config_size, pa_sample_spec *sample_spec);
+    void (*deinit)(void *codec_info);
+    /* Prepares for a new stream, the encoder starts at its highest
+     * bitrate again */
+    void (*reset)(void *codec_info);
+
+    /* The amount of audio that goes into a packet of the link MTU */
+    size_t (*get_read_block_size)(void *codec_info, size_t read_link_mtu);
+    size_t (*get_write_block_size)(void *codec_info, size_t write_link_mtu);
+
+    /* Lower or raise the encoder bitrate by one step, return the new write
+     * block size, or 0 if the bitrate is at its limit already */
+    size_t (*reduce_encoder_bitrate)(void *codec_info, size_t write_link_mtu);
+    size_t (*increase_encoder_bitrate)(void *codec_info, size_t write_link_mtu);
+    /* The current encoder bitrate, in bits per second */
+    uint32_t (*get_encoder_bitrate)(void *codec_info);
+    /* How much the codec delays the audio, on top of the block size */
+    pa_usec_t (*get_latency)(void *codec_info);
+
+    /* Encodes input_size bytes of audio into one packet. timestamp is in
+     * samples. Returns the size of the packet, or 0 on failure, and how
+     * much of the input it took in processed. */
+    size_t (*encode_buffer)(void *codec_info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size,
+                            uint8_t *output_buffer, size_t output_size, size_t *processed);
+    /* Decodes one packet. Returns the amount of audio written, and how much
+     * of the packet was used in processed, which is 0 on failure. */
+    size_t (*decode_buffer)(void *codec_info, const uint8_t *input_buffer, size_t input_size,
+                            uint8_t *output_buffer, size_t output_size, size_t *processed);
+} pa_a2dp_codec;
+
+#endif
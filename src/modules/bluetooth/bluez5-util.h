@@ -22,6 +22,8 @@
 
 #include <pulsecore/core.h>
 
+#include "a2dp-codec-api.h"
+
 #define PA_BLUETOOTH_UUID_A2DP_SOURCE "0000110a-0000-1000-8000-00805f9b34fb"
 #define PA_BLUETOOTH_UUID_A2DP_SINK   "0000110b-0000-1000-8000-00805f9b34fb"
 #define PA_BLUETOOTH_UUID_HSP_HS      "00001108-0000-1000-8000-00805f9b34fb"
@@ -75,6 +77,9 @@ struct pa_bluetooth_transport {
     uint8_t *config;
     size_t config_size;
 
+    /* The codec of A2DP transports */
+    const pa_a2dp_codec *a2dp_codec;
+
     uint16_t microphone_gain;
     uint16_t speaker_gain;
 
@@ -24,8 +24,17 @@
 
 #include <errno.h>
 
-#include <arpa/inet.h>
-#include <sbc/sbc.h>
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+
+#ifdef HAVE_LINUX_SOCKIOS_H
+#include <linux/sockios.h>
+#endif
+
+#ifdef HAVE_SENDMMSG
+#include <sys/socket.h>
+#endif
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -44,9 +53,8 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/time-smoother.h>
 
-#include "a2dp-codecs.h"
+#include "a2dp-codec-api.h"
 #include "bluez5-util.h"
-#include "rtp.h"
 
 #include "module-bluez5-device-symdef.h"
 
@@ -62,10 +70,24 @@ PA_MODULE_USAGE("path=<device object path>");
 #define FIXED_LATENCY_RECORD_A2DP   (25 * PA_USEC_PER_MSEC)
 #define FIXED_LATENCY_RECORD_SCO    (25 * PA_USEC_PER_MSEC)
 
-#define BITPOOL_DEC_LIMIT 32
-#define BITPOOL_DEC_STEP 5
+/* The encoder bitrate goes down when more than BITRATE_QUEUE_HIGH packets
+ * wait in the socket, and up again once no more than BITRATE_QUEUE_LOW did
+ * for BITRATE_INC_USEC. No change follows another within BITRATE_HOLD_USEC. */
+#define BITRATE_QUEUE_HIGH 3
+#define BITRATE_QUEUE_LOW 1
+#define BITRATE_INC_USEC (5 * PA_USEC_PER_SEC)
+#define BITRATE_HOLD_USEC (1 * PA_USEC_PER_SEC)
 #define HSP_MAX_GAIN 15
 
+/* How many A2DP packets are encoded ahead and written in one go */
+#define A2DP_MAX_BATCH 8
+#define A2DP_ENCODER_REPORT_USEC (10 * PA_USEC_PER_SEC)
+
+/* SCO packets carry only a few ms of audio each. Instead of a wakeup per
+ * packet and direction, about this much is read and written per wakeup */
+#define SCO_BATCH_USEC (12 * PA_USEC_PER_MSEC)
+#define SCO_MAX_BATCH 8
+
 static const char* const valid_modargs[] = {
     "path",
     NULL
@@ -74,6 +96,7 @@ static const char* const valid_modargs[] = {
 enum {
     BLUETOOTH_MESSAGE_IO_THREAD_FAILED,
     BLUETOOTH_MESSAGE_STREAM_FD_HUP,
+    BLUETOOTH_MESSAGE_BITRATE_CHANGED,
     BLUETOOTH_MESSAGE_MAX
 };
 
@@ -84,17 +107,31 @@ typedef struct bluetooth_msg {
 PA_DEFINE_PRIVATE_CLASS(bluetooth_msg, pa_msgobject);
 #define BLUETOOTH_MSG(o) (bluetooth_msg_cast(o))
 
-typedef struct sbc_info {
-    sbc_t sbc;                           /* Codec data */
-    bool sbc_initialized;                /* Keep track if the encoder is initialized */
-    size_t codesize, frame_length;       /* SBC Codesize, frame_length. We simply cache those values here */
-    uint16_t seq_num;                    /* Cumulative packet sequence */
-    uint8_t min_bitpool;
-    uint8_t max_bitpool;
+/* One RTP packet, with its headers, ready to be written */
+struct a2dp_packet {
+    void *buffer;
+    size_t length;
+    size_t pcm_length;                   /* Bytes of audio encoded in it */
+};
+
+typedef struct a2dp_info {
+    const pa_a2dp_codec *codec;          /* Codec of the transport */
+    void *codec_info;                    /* Its encoder or decoder state */
+    pa_usec_t bitrate_changed_at;        /* When the encoder bitrate last changed */
+    pa_usec_t queue_low_since;           /* Since when the socket queue has been short, or 0 */
+    unsigned skips;                      /* How often we had to skip audio */
 
     void* buffer;                        /* Codec transfer buffer */
     size_t buffer_size;                  /* Size of the buffer */
-} sbc_info_t;
+
+    struct a2dp_packet packets[A2DP_MAX_BATCH]; /* Ring of encoded packets */
+    size_t packet_size;                  /* Size of each packet buffer */
+    unsigned first_packet, n_packets;    /* Packets waiting to be written */
+
+    pa_usec_t encode_time, encode_time_max; /* Time spent in the encoder since the last report */
+    unsigned encode_count;
+    pa_usec_t encode_reported_at;
+} a2dp_info_t;
 
 struct userdata {
     pa_module *module;
@@ -132,10 +169,11 @@ struct userdata {
     uint64_t read_index;
     uint64_t write_index;
     pa_usec_t started_at;
+    unsigned sco_batch; /* SCO packets per wakeup */
+    pa_usec_t sco_next_wakeup;
     pa_smoother *read_smoother;
-    pa_memchunk write_memchunk;
     pa_sample_spec sample_spec;
-    struct sbc_info sbc_info;
+    struct a2dp_info a2dp_info;
 };
 
 typedef enum pa_bluetooth_form_factor {
@@ -240,7 +278,7 @@ static void connect_ports(struct userdata *u, void *new_data, pa_direction_t dir
 }
 
 /* Run from IO thread */
-static int sco_process_render(struct userdata *u) {
+static int sco_write_packet(struct userdata *u) {
     ssize_t l;
     pa_memchunk memchunk;
 
@@ -272,11 +310,14 @@ static int sco_process_render(struct userdata *u) {
         if (errno == EINTR)
             /* Retry right away if we got interrupted */
             continue;
-        else if (errno == EAGAIN)
+        else if (errno == EAGAIN) {
             /* Hmm, apparently the socket was not writable, give up for now */
+            pa_memblock_unref(memchunk.memblock);
             return 0;
+        }
 
         pa_log_error("Failed to write data to SCO socket: %s", pa_cstrerror(errno));
+        pa_memblock_unref(memchunk.memblock);
         return -1;
     }
 
@@ -286,6 +327,7 @@ static int sco_process_render(struct userdata *u) {
         pa_log_error("Wrote memory block to socket only partially! %llu written, wanted to write %llu.",
                     (unsigned long long) l,
                     (unsigned long long) memchunk.length);
+        pa_memblock_unref(memchunk.memblock);
         return -1;
     }
 
@@ -295,8 +337,28 @@ static int sco_process_render(struct userdata *u) {
     return 1;
 }
 
+/* Run from IO thread. Writes up to n packets, returns how many the
+ * socket took. */
+static int sco_process_render(struct userdata *u, unsigned n) {
+    int n_written = 0;
+
+    while ((unsigned) n_written < n) {
+        int r;
+
+        if ((r = sco_write_packet(u)) < 0)
+            return -1;
+
+        if (r == 0)
+            break;
+
+        n_written++;
+    }
+
+    return n_written;
+}
+
 /* Run from IO thread */
-static int sco_process_push(struct userdata *u) {
+static int sco_read_packet(struct userdata *u) {
     ssize_t l;
     pa_memchunk memchunk;
     struct cmsghdr *cm;
@@ -390,111 +452,245 @@ static int sco_process_push(struct userdata *u) {
     return l;
 }
 
+/* Run from IO thread. Reads all packets that are waiting, returns the
+ * number of bytes read. */
+static int sco_process_push(struct userdata *u) {
+    int n_read = 0;
+    unsigned i;
+
+    /* Twice the batch, so that a late wakeup catches up */
+    for (i = 0; i < 2 * SCO_MAX_BATCH; i++) {
+        int r;
+
+        if ((r = sco_read_packet(u)) < 0)
+            return -1;
+
+        if (r == 0)
+            break;
+
+        n_read += r;
+    }
+
+    return n_read;
+}
+
 /* Run from IO thread */
 static void a2dp_prepare_buffer(struct userdata *u) {
     size_t min_buffer_size = PA_MAX(u->read_link_mtu, u->write_link_mtu);
 
     pa_assert(u);
 
-    if (u->sbc_info.buffer_size >= min_buffer_size)
+    if (u->a2dp_info.buffer_size >= min_buffer_size)
         return;
 
-    u->sbc_info.buffer_size = 2 * min_buffer_size;
-    pa_xfree(u->sbc_info.buffer);
-    u->sbc_info.buffer = pa_xmalloc(u->sbc_info.buffer_size);
+    u->a2dp_info.buffer_size = 2 * min_buffer_size;
+    pa_xfree(u->a2dp_info.buffer);
+    u->a2dp_info.buffer = pa_xmalloc(u->a2dp_info.buffer_size);
 }
 
 /* Run from IO thread */
-static int a2dp_process_render(struct userdata *u) {
-    struct sbc_info *sbc_info;
-    struct rtp_header *header;
-    struct rtp_payload *payload;
-    size_t nbytes;
-    void *d;
-    const void *p;
-    size_t to_write, to_encode;
-    unsigned frame_count;
-    int ret = 0;
+static void a2dp_prepare_packets(struct userdata *u) {
+    struct a2dp_info *a2dp_info = &u->a2dp_info;
+    unsigned i;
 
     pa_assert(u);
-    pa_assert(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK);
-    pa_assert(u->sink);
 
-    /* First, render some data */
-    if (!u->write_memchunk.memblock)
-        pa_sink_render_full(u->sink, u->write_block_size, &u->write_memchunk);
+    if (a2dp_info->packet_size >= u->write_link_mtu)
+        return;
 
-    pa_assert(u->write_memchunk.length == u->write_block_size);
+    /* The MTU only changes with a new stream, when nothing is queued */
+    pa_assert(a2dp_info->n_packets == 0);
 
-    a2dp_prepare_buffer(u);
+    a2dp_info->packet_size = u->write_link_mtu;
+    for (i = 0; i < A2DP_MAX_BATCH; i++) {
+        pa_xfree(a2dp_info->packets[i].buffer);
+        a2dp_info->packets[i].buffer = pa_xmalloc(a2dp_info->packet_size);
+    }
+}
 
-    sbc_info = &u->sbc_info;
-    header = sbc_info->buffer;
-    payload = (struct rtp_payload*) ((uint8_t*) sbc_info->buffer + sizeof(*header));
+/* Run from IO thread */
+static void a2dp_report_encoder_time(struct userdata *u, pa_usec_t now) {
+    struct a2dp_info *a2dp_info = &u->a2dp_info;
 
-    frame_count = 0;
+    if (a2dp_info->encode_reported_at == 0)
+        a2dp_info->encode_reported_at = now;
+
+    if (now < a2dp_info->encode_reported_at + A2DP_ENCODER_REPORT_USEC || a2dp_info->encode_count == 0)
+        return;
+
+    pa_log_debug("%s encoder took %llu us per packet on average over %u packets, %llu us at most",
+                 a2dp_info->codec->description,
+                 (unsigned long long) (a2dp_info->encode_time / a2dp_info->encode_count),
+                 a2dp_info->encode_count,
+                 (unsigned long long) a2dp_info->encode_time_max);
+
+    a2dp_info->encode_time = 0;
+    a2dp_info->encode_time_max = 0;
+    a2dp_info->encode_count = 0;
+    a2dp_info->encode_reported_at = now;
+}
+
+/* Run from IO thread. Renders one block and encodes it straight from the
+ * memblock into the next free packet of the ring. */
+static int a2dp_encode_packet(struct userdata *u) {
+    struct a2dp_info *a2dp_info;
+    struct a2dp_packet *packet;
+    pa_memchunk memchunk;
+    uint64_t index;
+    pa_usec_t start, stop;
+    const uint8_t *p;
+    size_t length, processed;
+    unsigned i;
+
+    pa_assert(u);
+
+    a2dp_info = &u->a2dp_info;
+    pa_assert(a2dp_info->n_packets < A2DP_MAX_BATCH);
+
+    /* The stream position of this packet is behind those still queued */
+    index = u->write_index;
+    for (i = 0; i < a2dp_info->n_packets; i++)
+        index += a2dp_info->packets[(a2dp_info->first_packet + i) % A2DP_MAX_BATCH].pcm_length;
+
+    packet = &a2dp_info->packets[(a2dp_info->first_packet + a2dp_info->n_packets) % A2DP_MAX_BATCH];
+
+    pa_sink_render_full(u->sink, u->write_block_size, &memchunk);
+    pa_assert(memchunk.length == u->write_block_size);
 
     /* Try to create a packet of the full MTU */
 
-    p = (const uint8_t *) pa_memblock_acquire_chunk(&u->write_memchunk);
-    to_encode = u->write_memchunk.length;
+    start = pa_rtclock_now();
+
+    p = (const uint8_t *) pa_memblock_acquire_chunk(&memchunk);
+
+    length = a2dp_info->codec->encode_buffer(a2dp_info->codec_info, index / pa_frame_size(&u->sample_spec),
+                                             p, memchunk.length, packet->buffer, a2dp_info->packet_size,
+                                             &processed);
+
+    pa_memblock_release(memchunk.memblock);
+    pa_memblock_unref(memchunk.memblock);
+
+    if (PA_UNLIKELY(length == 0))
+        return -1;
+
+    stop = pa_rtclock_now();
+    a2dp_info->encode_time += stop - start;
+    a2dp_info->encode_time_max = PA_MAX(a2dp_info->encode_time_max, stop - start);
+    a2dp_info->encode_count++;
+    a2dp_report_encoder_time(u, stop);
 
-    d = (uint8_t*) sbc_info->buffer + sizeof(*header) + sizeof(*payload);
-    to_write = sbc_info->buffer_size - sizeof(*header) - sizeof(*payload);
+    pa_assert(processed == memchunk.length);
 
-    while (PA_LIKELY(to_encode > 0 && to_write > 0)) {
-        ssize_t written;
-        ssize_t encoded;
+    packet->length = length;
+    packet->pcm_length = memchunk.length;
+    a2dp_info->n_packets++;
 
-        encoded = sbc_encode(&sbc_info->sbc,
-                             p, to_encode,
-                             d, to_write,
-                             &written);
+    return 0;
+}
+
+/* Run from IO thread */
+static void a2dp_packets_written(struct userdata *u, unsigned n) {
+    struct a2dp_info *a2dp_info = &u->a2dp_info;
+
+    pa_assert(n <= a2dp_info->n_packets);
+
+    for (; n > 0; n--) {
+        u->write_index += (uint64_t) a2dp_info->packets[a2dp_info->first_packet].pcm_length;
+        a2dp_info->first_packet = (a2dp_info->first_packet + 1) % A2DP_MAX_BATCH;
+        a2dp_info->n_packets--;
+    }
+}
+
+#ifdef HAVE_SENDMMSG
+/* Run from IO thread. Hands all queued packets to the socket in one call.
+ * Returns the number of packets written, or -1 with errno set (ENOTSOCK
+ * if the stream is no socket after all). */
+static int a2dp_send_batch(struct userdata *u) {
+    struct a2dp_info *a2dp_info = &u->a2dp_info;
+    struct mmsghdr msgs[A2DP_MAX_BATCH];
+    struct iovec iov[A2DP_MAX_BATCH];
+    unsigned i;
+    int n;
 
-        if (PA_UNLIKELY(encoded <= 0)) {
-            pa_log_error("SBC encoding error (%li)", (long) encoded);
-            pa_memblock_release(u->write_memchunk.memblock);
+    pa_zero(msgs);
+
+    for (i = 0; i < a2dp_info->n_packets; i++) {
+        struct a2dp_packet *packet = &a2dp_info->packets[(a2dp_info->first_packet + i) % A2DP_MAX_BATCH];
+
+        iov[i].iov_base = packet->buffer;
+        iov[i].iov_len = packet->length;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    do
+        n = sendmmsg(u->stream_fd, msgs, a2dp_info->n_packets, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+
+    if (n < 0)
+        return -1;
+
+    for (i = 0; i < (unsigned) n; i++)
+        if (msgs[i].msg_len != iov[i].iov_len) {
+            pa_log_warn("Wrote memory block to socket only partially! %llu written, wanted to write %llu.",
+                        (unsigned long long) msgs[i].msg_len,
+                        (unsigned long long) iov[i].iov_len);
+            errno = EIO;
             return -1;
         }
 
-        pa_assert_fp((size_t) encoded <= to_encode);
-        pa_assert_fp((size_t) encoded == sbc_info->codesize);
+    return n;
+}
+#endif
 
-        pa_assert_fp((size_t) written <= to_write);
-        pa_assert_fp((size_t) written == sbc_info->frame_length);
+/* Run from IO thread. Encodes packets until n are queued and writes as
+ * many of them as the socket takes. Returns the number written. */
+static int a2dp_process_render(struct userdata *u, unsigned n) {
+    struct a2dp_info *a2dp_info;
+    int ret = 0;
 
-        p = (const uint8_t*) p + encoded;
-        to_encode -= encoded;
+    pa_assert(u);
+    pa_assert(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK);
+    pa_assert(u->sink);
+    pa_assert(n > 0);
 
-        d = (uint8_t*) d + written;
-        to_write -= written;
+    a2dp_prepare_packets(u);
 
-        frame_count++;
-    }
+    a2dp_info = &u->a2dp_info;
 
-    pa_memblock_release(u->write_memchunk.memblock);
+    /* First, render and encode what is due but not queued yet */
+    while (a2dp_info->n_packets < PA_MIN(n, A2DP_MAX_BATCH))
+        if (a2dp_encode_packet(u) < 0)
+            return -1;
 
-    pa_assert(to_encode == 0);
+#ifdef HAVE_SENDMMSG
+    if (u->stream_write_type == 0 && a2dp_info->n_packets > 1) {
+        int l;
 
-    PA_ONCE_BEGIN {
-        pa_log_debug("Using SBC encoder implementation: %s", pa_strnull(sbc_get_implementation_info(&sbc_info->sbc)));
-    } PA_ONCE_END;
+        if ((l = a2dp_send_batch(u)) >= 0) {
+            a2dp_packets_written(u, l);
+            return l;
+        }
 
-    /* write it to the fifo */
-    memset(sbc_info->buffer, 0, sizeof(*header) + sizeof(*payload));
-    header->v = 2;
-    header->pt = 1;
-    header->sequence_number = htons(sbc_info->seq_num++);
-    header->timestamp = htonl(u->write_index / pa_frame_size(&u->sample_spec));
-    header->ssrc = htonl(1);
-    payload->frame_count = frame_count;
+        if (errno == EAGAIN)
+            /* Hmm, apparently the socket was not writable, give up for now */
+            return 0;
 
-    nbytes = (uint8_t*) d - (uint8_t*) sbc_info->buffer;
+        if (errno != ENOTSOCK) {
+            pa_log_error("Failed to write data to socket: %s", pa_cstrerror(errno));
+            return -1;
+        }
 
-    for (;;) {
+        /* pa_write() finds out about this on its own below */
+    }
+#endif
+
+    /* write them to the socket one by one */
+    while (a2dp_info->n_packets > 0) {
+        struct a2dp_packet *packet = &a2dp_info->packets[a2dp_info->first_packet];
         ssize_t l;
 
-        l = pa_write(u->stream_fd, sbc_info->buffer, nbytes, &u->stream_write_type);
+        l = pa_write(u->stream_fd, packet->buffer, packet->length, &u->stream_write_type);
 
         pa_assert(l != 0);
 
@@ -509,27 +705,20 @@ static int a2dp_process_render(struct userdata *u) {
                 break;
 
             pa_log_error("Failed to write data to socket: %s", pa_cstrerror(errno));
-            ret = -1;
-            break;
+            return -1;
         }
 
-        pa_assert((size_t) l <= nbytes);
+        pa_assert((size_t) l <= packet->length);
 
-        if ((size_t) l != nbytes) {
+        if ((size_t) l != packet->length) {
             pa_log_warn("Wrote memory block to socket only partially! %llu written, wanted to write %llu.",
                         (unsigned long long) l,
-                        (unsigned long long) nbytes);
-            ret = -1;
-            break;
+                        (unsigned long long) packet->length);
+            return -1;
         }
 
-        u->write_index += (uint64_t) u->write_memchunk.length;
-        pa_memblock_unref(u->write_memchunk.memblock);
-        pa_memchunk_reset(&u->write_memchunk);
-
-        ret = 1;
-
-        break;
+        a2dp_packets_written(u, 1);
+        ret++;
     }
 
     return ret;
@@ -551,22 +740,16 @@ static int a2dp_process_push(struct userdata *u) {
     for (;;) {
         bool found_tstamp = false;
         pa_usec_t tstamp;
-        struct sbc_info *sbc_info;
-        struct rtp_header *header;
-        struct rtp_payload *payload;
-        const void *p;
+        struct a2dp_info *a2dp_info;
         void *d;
         ssize_t l;
-        size_t to_write, to_decode;
-        size_t total_written = 0;
+        size_t written, processed;
 
         a2dp_prepare_buffer(u);
 
-        sbc_info = &u->sbc_info;
-        header = sbc_info->buffer;
-        payload = (struct rtp_payload*) ((uint8_t*) sbc_info->buffer + sizeof(*header));
+        a2dp_info = &u->a2dp_info;
 
-        l = pa_read(u->stream_fd, sbc_info->buffer, sbc_info->buffer_size, &u->stream_write_type);
+        l = pa_read(u->stream_fd, a2dp_info->buffer, a2dp_info->buffer_size, &u->stream_write_type);
 
         if (l <= 0) {
 
@@ -583,7 +766,7 @@ static int a2dp_process_push(struct userdata *u) {
             break;
         }
 
-        pa_assert((size_t) l <= sbc_info->buffer_size);
+        pa_assert((size_t) l <= a2dp_info->buffer_size);
 
         /* TODO: get timestamp from rtp */
         if (!found_tstamp) {
@@ -591,52 +774,24 @@ static int a2dp_process_push(struct userdata *u) {
             tstamp = pa_rtclock_now();
         }
 
-        p = (uint8_t*) sbc_info->buffer + sizeof(*header) + sizeof(*payload);
-        to_decode = l - sizeof(*header) - sizeof(*payload);
-
         d = pa_memblock_acquire(memchunk.memblock);
-        to_write = memchunk.length = pa_memblock_get_length(memchunk.memblock);
-
-        while (PA_LIKELY(to_decode > 0)) {
-            size_t written;
-            ssize_t decoded;
-
-            decoded = sbc_decode(&sbc_info->sbc,
-                                 p, to_decode,
-                                 d, to_write,
-                                 &written);
-
-            if (PA_UNLIKELY(decoded <= 0)) {
-                pa_log_error("SBC decoding error (%li)", (long) decoded);
-                pa_memblock_release(memchunk.memblock);
-                pa_memblock_unref(memchunk.memblock);
-                return 0;
-            }
+        memchunk.length = pa_memblock_get_length(memchunk.memblock);
 
-            total_written += written;
+        written = a2dp_info->codec->decode_buffer(a2dp_info->codec_info, a2dp_info->buffer, l,
+                                                  d, memchunk.length, &processed);
 
-            /* Reset frame length, it can be changed due to bitpool change */
-            sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
-
-            pa_assert_fp((size_t) decoded <= to_decode);
-            pa_assert_fp((size_t) decoded == sbc_info->frame_length);
-
-            pa_assert_fp((size_t) written == sbc_info->codesize);
-
-            p = (const uint8_t*) p + decoded;
-            to_decode -= decoded;
+        pa_memblock_release(memchunk.memblock);
 
-            d = (uint8_t*) d + written;
-            to_write -= written;
+        if (processed != (size_t) l) {
+            pa_memblock_unref(memchunk.memblock);
+            return 0;
         }
 
-        u->read_index += (uint64_t) total_written;
+        u->read_index += (uint64_t) written;
         pa_smoother_put(u->read_smoother, tstamp, pa_bytes_to_usec(u->read_index, &u->sample_spec));
         pa_smoother_resume(u->read_smoother, tstamp, true);
 
-        memchunk.length -= to_write;
-
-        pa_memblock_release(memchunk.memblock);
+        memchunk.length = written;
 
         pa_source_post(u->source, &memchunk);
 
@@ -649,61 +804,97 @@ static int a2dp_process_push(struct userdata *u) {
     return ret;
 }
 
+/* Run from I/O thread. Has the main thread show the current encoder
+ * bitrate and skip count in the sink proplist. */
+static void a2dp_post_bitrate(struct userdata *u) {
+    struct a2dp_info *a2dp_info = &u->a2dp_info;
+
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->msg), BLUETOOTH_MESSAGE_BITRATE_CHANGED,
+                      PA_UINT_TO_PTR(a2dp_info->codec->get_encoder_bitrate(a2dp_info->codec_info)),
+                      a2dp_info->skips, NULL, NULL);
+}
+
 /* Run from I/O thread */
-static void a2dp_set_bitpool(struct userdata *u, uint8_t bitpool) {
-    struct sbc_info *sbc_info;
+static void a2dp_set_write_block_size(struct userdata *u, size_t write_block_size) {
+    struct a2dp_info *a2dp_info = &u->a2dp_info;
 
-    pa_assert(u);
+    u->write_block_size = write_block_size;
+
+    pa_sink_set_max_request_within_thread(u->sink, u->write_block_size);
+    pa_sink_set_fixed_latency_within_thread(u->sink,
+            FIXED_LATENCY_PLAYBACK_A2DP + pa_bytes_to_usec(u->write_block_size, &u->sample_spec) +
+            a2dp_info->codec->get_latency(a2dp_info->codec_info));
+}
 
-    sbc_info = &u->sbc_info;
+/* Run from I/O thread. Steps the encoder bitrate down or up, returns false
+ * if it is at its limit already. */
+static bool a2dp_change_bitrate(struct userdata *u, bool increase) {
+    struct a2dp_info *a2dp_info;
+    size_t write_block_size;
 
-    if (sbc_info->sbc.bitpool == bitpool)
-        return;
+    pa_assert(u);
 
-    if (bitpool > sbc_info->max_bitpool)
-        bitpool = sbc_info->max_bitpool;
-    else if (bitpool < sbc_info->min_bitpool)
-        bitpool = sbc_info->min_bitpool;
+    a2dp_info = &u->a2dp_info;
 
-    sbc_info->sbc.bitpool = bitpool;
+    if (increase)
+        write_block_size = a2dp_info->codec->increase_encoder_bitrate(a2dp_info->codec_info, u->write_link_mtu);
+    else
+        write_block_size = a2dp_info->codec->reduce_encoder_bitrate(a2dp_info->codec_info, u->write_link_mtu);
 
-    sbc_info->codesize = sbc_get_codesize(&sbc_info->sbc);
-    sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
+    if (write_block_size == 0)
+        return false;
 
-    pa_log_debug("Bitpool has changed to %u", sbc_info->sbc.bitpool);
+    pa_log_debug("Encoder bitrate has changed to %u bit/s",
+                 a2dp_info->codec->get_encoder_bitrate(a2dp_info->codec_info));
 
-    u->read_block_size =
-        (u->read_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-        / sbc_info->frame_length * sbc_info->codesize;
+    a2dp_info->bitrate_changed_at = pa_rtclock_now();
+    a2dp_info->queue_low_since = 0;
+    a2dp_post_bitrate(u);
 
-    u->write_block_size =
-        (u->write_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-        / sbc_info->frame_length * sbc_info->codesize;
+    a2dp_set_write_block_size(u, write_block_size);
 
-    pa_sink_set_max_request_within_thread(u->sink, u->write_block_size);
-    pa_sink_set_fixed_latency_within_thread(u->sink,
-            FIXED_LATENCY_PLAYBACK_A2DP + pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
+    return true;
 }
 
-/* Run from I/O thread */
-static void a2dp_reduce_bitpool(struct userdata *u) {
-    struct sbc_info *sbc_info;
-    uint8_t bitpool;
+/* Run from I/O thread. Called after writing, steers the encoder bitrate by
+ * how many packets are still waiting in the socket to go out. */
+static void a2dp_update_bitrate(struct userdata *u) {
+#ifdef SIOCOUTQ
+    struct a2dp_info *a2dp_info;
+    pa_usec_t now;
+    int queued;
 
     pa_assert(u);
 
-    sbc_info = &u->sbc_info;
+    a2dp_info = &u->a2dp_info;
+
+    if (ioctl(u->stream_fd, SIOCOUTQ, &queued) < 0)
+        return;
+
+    now = pa_rtclock_now();
 
-    /* Check if bitpool is already at its limit */
-    if (sbc_info->sbc.bitpool <= BITPOOL_DEC_LIMIT)
+    if (now < a2dp_info->bitrate_changed_at + BITRATE_HOLD_USEC)
         return;
 
-    bitpool = sbc_info->sbc.bitpool - BITPOOL_DEC_STEP;
+    if ((size_t) queued > BITRATE_QUEUE_HIGH * u->write_link_mtu) {
+        if (a2dp_change_bitrate(u, false))
+            pa_log_debug("%i bytes waiting in the socket, reduced the encoder bitrate", queued);
+
+        a2dp_info->queue_low_since = 0;
+        return;
+    }
 
-    if (bitpool < BITPOOL_DEC_LIMIT)
-        bitpool = BITPOOL_DEC_LIMIT;
+    if ((size_t) queued > BITRATE_QUEUE_LOW * u->write_link_mtu) {
+        a2dp_info->queue_low_since = 0;
+        return;
+    }
 
-    a2dp_set_bitpool(u, bitpool);
+    if (a2dp_info->queue_low_since == 0)
+        a2dp_info->queue_low_since = now;
+    else if (now >= a2dp_info->queue_low_since + BITRATE_INC_USEC && !a2dp_change_bitrate(u, true))
+        /* Already at the top, start over */
+        a2dp_info->queue_low_since = 0;
+#endif
 }
 
 static void teardown_stream(struct userdata *u) {
@@ -722,10 +913,9 @@ static void teardown_stream(struct userdata *u) {
         u->read_smoother = NULL;
     }
 
-    if (u->write_memchunk.memblock) {
-        pa_memblock_unref(u->write_memchunk.memblock);
-        pa_memchunk_reset(&u->write_memchunk);
-    }
+    /* Whatever was not written yet belongs to the old stream */
+    u->a2dp_info.first_packet = 0;
+    u->a2dp_info.n_packets = 0;
 
     pa_log_debug("Audio stream torn down");
 }
@@ -766,17 +956,26 @@ static void transport_release(struct userdata *u) {
 
 /* Run from I/O thread */
 static void transport_config_mtu(struct userdata *u) {
+    pa_usec_t codec_latency = 0, packet_usec;
+
     if (u->profile == PA_BLUETOOTH_PROFILE_HEADSET_HEAD_UNIT || u->profile == PA_BLUETOOTH_PROFILE_HEADSET_AUDIO_GATEWAY) {
         u->read_block_size = u->read_link_mtu;
         u->write_block_size = u->write_link_mtu;
+
+        packet_usec = PA_MAX(pa_bytes_to_usec(u->write_block_size, &u->sample_spec), (pa_usec_t) 1);
+        u->sco_batch = (unsigned) PA_CLAMP(SCO_BATCH_USEC / packet_usec, (pa_usec_t) 1, (pa_usec_t) SCO_MAX_BATCH);
+
+        /* Playback is written up to a batch ahead, capture waits up to a
+         * batch in the socket */
+        codec_latency = (u->sco_batch - 1) * packet_usec;
+
+        pa_log_debug("Handling %u SCO packets per wakeup", u->sco_batch);
     } else {
-        u->read_block_size =
-            (u->read_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-            / u->sbc_info.frame_length * u->sbc_info.codesize;
+        const pa_a2dp_codec *codec = u->a2dp_info.codec;
 
-        u->write_block_size =
-            (u->write_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-            / u->sbc_info.frame_length * u->sbc_info.codesize;
+        u->read_block_size = codec->get_read_block_size(u->a2dp_info.codec_info, u->read_link_mtu);
+        u->write_block_size = codec->get_write_block_size(u->a2dp_info.codec_info, u->write_link_mtu);
+        codec_latency = codec->get_latency(u->a2dp_info.codec_info);
     }
 
     if (u->sink) {
@@ -784,14 +983,16 @@ static void transport_config_mtu(struct userdata *u) {
         pa_sink_set_fixed_latency_within_thread(u->sink,
                                                 (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK ?
                                                  FIXED_LATENCY_PLAYBACK_A2DP : FIXED_LATENCY_PLAYBACK_SCO) +
-                                                pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
+                                                pa_bytes_to_usec(u->write_block_size, &u->sample_spec) +
+                                                codec_latency);
     }
 
     if (u->source)
         pa_source_set_fixed_latency_within_thread(u->source,
                                                   (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SOURCE ?
                                                    FIXED_LATENCY_RECORD_A2DP : FIXED_LATENCY_RECORD_SCO) +
-                                                  pa_bytes_to_usec(u->read_block_size, &u->sample_spec));
+                                                  pa_bytes_to_usec(u->read_block_size, &u->sample_spec) +
+                                                  codec_latency);
 }
 
 /* Run from I/O thread */
@@ -801,6 +1002,10 @@ static void setup_stream(struct userdata *u) {
 
     pa_log_info("Transport %s resuming", u->transport->path);
 
+    /* A new stream starts at the highest bitrate again */
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK || u->profile == PA_BLUETOOTH_PROFILE_A2DP_SOURCE)
+        u->a2dp_info.codec->reset(u->a2dp_info.codec_info);
+
     transport_config_mtu(u);
 
     pa_make_fd_nonblock(u->stream_fd);
@@ -812,8 +1017,11 @@ static void setup_stream(struct userdata *u) {
 
     pa_log_debug("Stream properly set up, we're ready to roll!");
 
-    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
-        a2dp_set_bitpool(u, u->sbc_info.max_bitpool);
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
+        u->a2dp_info.bitrate_changed_at = pa_rtclock_now();
+        u->a2dp_info.queue_low_since = 0;
+        a2dp_post_bitrate(u);
+    }
 
     u->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_NEVER, 1);
     pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
@@ -822,6 +1030,7 @@ static void setup_stream(struct userdata *u) {
 
     u->read_index = u->write_index = 0;
     u->started_at = 0;
+    u->sco_next_wakeup = 0;
 
     if (u->source)
         u->read_smoother = pa_smoother_new(PA_USEC_PER_SEC, 2*PA_USEC_PER_SEC, true, true, 10, pa_rtclock_now(), true);
@@ -950,6 +1159,8 @@ static int add_source(struct userdata *u) {
     data.name = pa_sprintf_malloc("bluez_source.%s", u->device->address);
     data.namereg_fail = false;
     pa_proplist_sets(data.proplist, "bluetooth.protocol", pa_bluetooth_profile_to_string(u->profile));
+    if (u->a2dp_info.codec && (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK || u->profile == PA_BLUETOOTH_PROFILE_A2DP_SOURCE))
+        pa_proplist_sets(data.proplist, "bluetooth.codec", u->a2dp_info.codec->name);
     pa_source_new_data_set_sample_spec(&data, &u->sample_spec);
     if (u->profile == PA_BLUETOOTH_PROFILE_HEADSET_HEAD_UNIT)
         pa_proplist_sets(data.proplist, PA_PROP_DEVICE_INTENDED_ROLES, "phone");
@@ -1107,6 +1318,8 @@ static int add_sink(struct userdata *u) {
     data.name = pa_sprintf_malloc("bluez_sink.%s", u->device->address);
     data.namereg_fail = false;
     pa_proplist_sets(data.proplist, "bluetooth.protocol", pa_bluetooth_profile_to_string(u->profile));
+    if (u->a2dp_info.codec && (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK || u->profile == PA_BLUETOOTH_PROFILE_A2DP_SOURCE))
+        pa_proplist_sets(data.proplist, "bluetooth.codec", u->a2dp_info.codec->name);
     pa_sink_new_data_set_sample_spec(&data, &u->sample_spec);
     if (u->profile == PA_BLUETOOTH_PROFILE_HEADSET_HEAD_UNIT)
         pa_proplist_sets(data.proplist, PA_PROP_DEVICE_INTENDED_ROLES, "phone");
@@ -1151,111 +1364,18 @@ static void transport_config(struct userdata *u) {
         u->sample_spec.channels = 1;
         u->sample_spec.rate = 8000;
     } else {
-        sbc_info_t *sbc_info = &u->sbc_info;
-        a2dp_sbc_t *config;
+        a2dp_info_t *a2dp_info = &u->a2dp_info;
 
         pa_assert(u->transport);
+        pa_assert(u->transport->a2dp_codec);
 
-        u->sample_spec.format = PA_SAMPLE_S16LE;
-        config = (a2dp_sbc_t *) u->transport->config;
+        if (a2dp_info->codec_info)
+            a2dp_info->codec->deinit(a2dp_info->codec_info);
 
-        if (sbc_info->sbc_initialized)
-            sbc_reinit(&sbc_info->sbc, 0);
-        else
-            sbc_init(&sbc_info->sbc, 0);
-        sbc_info->sbc_initialized = true;
-
-        switch (config->frequency) {
-            case SBC_SAMPLING_FREQ_16000:
-                sbc_info->sbc.frequency = SBC_FREQ_16000;
-                u->sample_spec.rate = 16000U;
-                break;
-            case SBC_SAMPLING_FREQ_32000:
-                sbc_info->sbc.frequency = SBC_FREQ_32000;
-                u->sample_spec.rate = 32000U;
-                break;
-            case SBC_SAMPLING_FREQ_44100:
-                sbc_info->sbc.frequency = SBC_FREQ_44100;
-                u->sample_spec.rate = 44100U;
-                break;
-            case SBC_SAMPLING_FREQ_48000:
-                sbc_info->sbc.frequency = SBC_FREQ_48000;
-                u->sample_spec.rate = 48000U;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->channel_mode) {
-            case SBC_CHANNEL_MODE_MONO:
-                sbc_info->sbc.mode = SBC_MODE_MONO;
-                u->sample_spec.channels = 1;
-                break;
-            case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-                sbc_info->sbc.mode = SBC_MODE_DUAL_CHANNEL;
-                u->sample_spec.channels = 2;
-                break;
-            case SBC_CHANNEL_MODE_STEREO:
-                sbc_info->sbc.mode = SBC_MODE_STEREO;
-                u->sample_spec.channels = 2;
-                break;
-            case SBC_CHANNEL_MODE_JOINT_STEREO:
-                sbc_info->sbc.mode = SBC_MODE_JOINT_STEREO;
-                u->sample_spec.channels = 2;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->allocation_method) {
-            case SBC_ALLOCATION_SNR:
-                sbc_info->sbc.allocation = SBC_AM_SNR;
-                break;
-            case SBC_ALLOCATION_LOUDNESS:
-                sbc_info->sbc.allocation = SBC_AM_LOUDNESS;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->subbands) {
-            case SBC_SUBBANDS_4:
-                sbc_info->sbc.subbands = SBC_SB_4;
-                break;
-            case SBC_SUBBANDS_8:
-                sbc_info->sbc.subbands = SBC_SB_8;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->block_length) {
-            case SBC_BLOCK_LENGTH_4:
-                sbc_info->sbc.blocks = SBC_BLK_4;
-                break;
-            case SBC_BLOCK_LENGTH_8:
-                sbc_info->sbc.blocks = SBC_BLK_8;
-                break;
-            case SBC_BLOCK_LENGTH_12:
-                sbc_info->sbc.blocks = SBC_BLK_12;
-                break;
-            case SBC_BLOCK_LENGTH_16:
-                sbc_info->sbc.blocks = SBC_BLK_16;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        sbc_info->min_bitpool = config->min_bitpool;
-        sbc_info->max_bitpool = config->max_bitpool;
-
-        /* Set minimum bitpool for source to get the maximum possible block_size */
-        sbc_info->sbc.bitpool = u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK ? sbc_info->max_bitpool : sbc_info->min_bitpool;
-        sbc_info->codesize = sbc_get_codesize(&sbc_info->sbc);
-        sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
-
-        pa_log_info("SBC parameters: allocation=%u, subbands=%u, blocks=%u, bitpool=%u",
-                    sbc_info->sbc.allocation, sbc_info->sbc.subbands, sbc_info->sbc.blocks, sbc_info->sbc.bitpool);
+        a2dp_info->codec = u->transport->a2dp_codec;
+        a2dp_info->codec_info = a2dp_info->codec->init(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK,
+                                                       u->transport->config, u->transport->config_size,
+                                                       &u->sample_spec);
     }
 }
 
@@ -1346,6 +1466,7 @@ static void thread_func(void *userdata) {
         struct pollfd *pollfd;
         int ret;
         bool disable_timer = true;
+        bool sco_paced;
 
         pollfd = u->rtpoll_item ? pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL) : NULL;
 
@@ -1367,6 +1488,13 @@ static void thread_func(void *userdata) {
                 goto fail;
         }
 
+        /* With capture running, SCO is driven by the packets we get. To
+         * batch them, don't wake up for each of them but read what came
+         * in on a timer, and write as many packets in the same wakeup */
+        sco_paced = u->sco_batch > 1 &&
+                    (u->profile == PA_BLUETOOTH_PROFILE_HEADSET_HEAD_UNIT || u->profile == PA_BLUETOOTH_PROFILE_HEADSET_AUDIO_GATEWAY) &&
+                    u->source && PA_SOURCE_IS_LINKED(u->source->thread_info.state);
+
         if (u->source && PA_SOURCE_IS_LINKED(u->source->thread_info.state)) {
 
             /* We should send two blocks to the device before we expect
@@ -1375,7 +1503,7 @@ static void thread_func(void *userdata) {
             if (u->write_index == 0 && u->read_index <= 0)
                 do_write = 2;
 
-            if (pollfd && (pollfd->revents & POLLIN)) {
+            if (pollfd && ((pollfd->revents & POLLIN) || sco_paced)) {
                 int n_read;
 
                 if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SOURCE)
@@ -1436,12 +1564,24 @@ static void thread_func(void *userdata) {
                                 pa_memblock_unref(tmp.memblock);
                                 u->write_index += skip_bytes;
 
-                                if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
-                                    a2dp_reduce_bitpool(u);
+                                if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
+                                    u->a2dp_info.skips++;
+                                    if (!a2dp_change_bitrate(u, false))
+                                        /* The bitrate stayed the same, still show the skip */
+                                        a2dp_post_bitrate(u);
+                                }
                             }
                         }
 
-                        do_write = 1;
+                        /* Write all that is due in one go, A2DP can batch that.
+                         * SCO writes a batch ahead and sleeps until it's
+                         * played. */
+                        if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
+                            do_write = PA_MIN(pa_usec_to_bytes(audio_to_send, &u->sample_spec) / u->write_block_size + 1,
+                                              A2DP_MAX_BATCH);
+                        else
+                            do_write = PA_MIN(pa_usec_to_bytes(audio_to_send, &u->sample_spec) / u->write_block_size + u->sco_batch,
+                                              2 * SCO_MAX_BATCH);
                         pending_read_bytes = 0;
                     }
                 }
@@ -1453,18 +1593,24 @@ static void thread_func(void *userdata) {
                         u->started_at = pa_rtclock_now();
 
                     if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
-                        if ((n_written = a2dp_process_render(u)) < 0)
+                        if ((n_written = a2dp_process_render(u, do_write)) < 0)
                             goto fail;
+
+                        a2dp_update_bitrate(u);
+                        writable = false;
                     } else {
-                        if ((n_written = sco_process_render(u)) < 0)
+                        if ((n_written = sco_process_render(u, do_write)) < 0)
                             goto fail;
+
+                        /* A socket that took all of it will likely take
+                         * the next batch too, don't wait for POLLOUT */
+                        writable = (unsigned) n_written >= do_write;
                     }
 
-                    if (n_written == 0)
+                    if (n_written == 0 && (pollfd->revents & POLLOUT))
                         pa_log("Broken kernel: we got EAGAIN on write() after POLLOUT!");
 
                     do_write -= n_written;
-                    writable = false;
                 }
 
                 if ((!u->source || !PA_SOURCE_IS_LINKED(u->source->thread_info.state)) && do_write <= 0) {
@@ -1488,13 +1634,29 @@ static void thread_func(void *userdata) {
             }
         }
 
+        if (pollfd && sco_paced) {
+            pa_usec_t now = pa_rtclock_now();
+
+            /* An absolute schedule, so that messages don't delay it */
+            if (u->sco_next_wakeup <= now) {
+                pa_usec_t period = u->sco_batch * pa_bytes_to_usec(u->read_block_size, &u->sample_spec);
+
+                u->sco_next_wakeup += period;
+                if (u->sco_next_wakeup <= now)
+                    u->sco_next_wakeup = now + period;
+            }
+
+            pa_rtpoll_set_timer_absolute(u->rtpoll, u->sco_next_wakeup);
+            disable_timer = false;
+        }
+
         if (disable_timer)
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
         if (pollfd)
             pollfd->events = (short) (((u->sink && PA_SINK_IS_LINKED(u->sink->thread_info.state) && !writable) ? POLLOUT : 0) |
-                                      (u->source && PA_SOURCE_IS_LINKED(u->source->thread_info.state) ? POLLIN : 0));
+                                      (u->source && PA_SOURCE_IS_LINKED(u->source->thread_info.state) && !sco_paced ? POLLIN : 0));
 
         if ((ret = pa_rtpoll_run(u->rtpoll)) < 0) {
             pa_log_debug("pa_rtpoll_run failed with: %d", ret);
@@ -2118,6 +2280,19 @@ static int device_process_msg(pa_msgobject *obj, int code, void *data, int64_t o
         case BLUETOOTH_MESSAGE_STREAM_FD_HUP:
             pa_bluetooth_transport_set_state(u->transport, PA_BLUETOOTH_TRANSPORT_STATE_IDLE);
             break;
+        case BLUETOOTH_MESSAGE_BITRATE_CHANGED: {
+            pa_proplist *pl;
+
+            if (!u->sink)
+                break;
+
+            pl = pa_proplist_new();
+            pa_proplist_setf(pl, "bluetooth.a2dp.bitrate", "%u", PA_PTR_TO_UINT(data));
+            pa_proplist_setf(pl, "bluetooth.a2dp.skips", "%llu", (unsigned long long) offset);
+            pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+            pa_proplist_free(pl);
+            break;
+        }
     }
 
     return 0;
@@ -2211,6 +2386,7 @@ fail:
 
 void pa__done(pa_module *m) {
     struct userdata *u;
+    unsigned i;
 
     pa_assert(m);
 
@@ -2231,11 +2407,14 @@ void pa__done(pa_module *m) {
     if (u->transport_microphone_gain_changed_slot)
         pa_hook_slot_free(u->transport_microphone_gain_changed_slot);
 
-    if (u->sbc_info.buffer)
-        pa_xfree(u->sbc_info.buffer);
+    if (u->a2dp_info.buffer)
+        pa_xfree(u->a2dp_info.buffer);
+
+    for (i = 0; i < A2DP_MAX_BATCH; i++)
+        pa_xfree(u->a2dp_info.packets[i].buffer);
 
-    if (u->sbc_info.sbc_initialized)
-        sbc_finish(&u->sbc_info.sbc);
+    if (u->a2dp_info.codec_info)
+        u->a2dp_info.codec->deinit(u->a2dp_info.codec_info);
 
     if (u->msg)
         pa_xfree(u->msg);
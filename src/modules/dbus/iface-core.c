@@ -83,6 +83,7 @@ static void handle_get_card_by_name(DBusConnection *conn, DBusMessage *msg, void
 static void handle_get_sink_by_name(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_source_by_name(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_sample_by_name(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_all_streams(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_upload_sample(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_load_module(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_exit(DBusConnection *conn, DBusMessage *msg, void *userdata);
@@ -188,6 +189,7 @@ enum method_handler_index {
     METHOD_HANDLER_GET_SINK_BY_NAME,
     METHOD_HANDLER_GET_SOURCE_BY_NAME,
     METHOD_HANDLER_GET_SAMPLE_BY_NAME,
+    METHOD_HANDLER_GET_ALL_STREAMS,
     METHOD_HANDLER_UPLOAD_SAMPLE,
     METHOD_HANDLER_LOAD_MODULE,
     METHOD_HANDLER_EXIT,
@@ -200,6 +202,7 @@ static pa_dbus_arg_info get_card_by_name_args[] = { { "name", "s", "in" }, { "ca
 static pa_dbus_arg_info get_sink_by_name_args[] = { { "name", "s", "in" }, { "sink", "o", "out" } };
 static pa_dbus_arg_info get_source_by_name_args[] = { { "name", "s", "in" }, { "source", "o", "out" } };
 static pa_dbus_arg_info get_sample_by_name_args[] = { { "name", "s", "in" }, { "sample", "o", "out" } };
+static pa_dbus_arg_info get_all_streams_args[] = { { "streams", "a{oa{sv}}", "out" } };
 static pa_dbus_arg_info upload_sample_args[] = { { "name",           "s",      "in" },
                                                  { "sample_format",  "u",      "in" },
                                                  { "sample_rate",    "u",      "in" },
@@ -233,6 +236,11 @@ static pa_dbus_method_handler method_handlers[METHOD_HANDLER_MAX] = {
         .arguments = get_sample_by_name_args,
         .n_arguments = sizeof(get_sample_by_name_args) / sizeof(pa_dbus_arg_info),
         .receive_cb = handle_get_sample_by_name },
+    [METHOD_HANDLER_GET_ALL_STREAMS] = {
+        .method_name = "GetAllStreams",
+        .arguments = get_all_streams_args,
+        .n_arguments = sizeof(get_all_streams_args) / sizeof(pa_dbus_arg_info),
+        .receive_cb = handle_get_all_streams },
     [METHOD_HANDLER_UPLOAD_SAMPLE] = {
         .method_name = "UploadSample",
         .arguments = upload_sample_args,
@@ -1273,6 +1281,46 @@ static void handle_get_sample_by_name(DBusConnection *conn, DBusMessage *msg, vo
     pa_dbus_send_basic_value_reply(conn, msg, DBUS_TYPE_OBJECT_PATH, &object_path);
 }
 
+static void append_streams(DBusMessageIter *dict_iter, pa_hashmap *streams) {
+    pa_dbusiface_stream *stream;
+    void *state;
+
+    PA_HASHMAP_FOREACH(stream, streams, state) {
+        DBusMessageIter entry_iter;
+        const char *object_path = pa_dbusiface_stream_get_path(stream);
+
+        pa_assert_se(dbus_message_iter_open_container(dict_iter, DBUS_TYPE_DICT_ENTRY, NULL, &entry_iter));
+        pa_assert_se(dbus_message_iter_append_basic(&entry_iter, DBUS_TYPE_OBJECT_PATH, &object_path));
+        pa_dbusiface_stream_append_all(stream, &entry_iter);
+        pa_assert_se(dbus_message_iter_close_container(dict_iter, &entry_iter));
+    }
+}
+
+/* The properties of all playback and record streams at once, so that
+ * clients don't need a GetAll round trip per stream. */
+static void handle_get_all_streams(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    pa_dbusiface_core *c = userdata;
+    DBusMessage *reply = NULL;
+    DBusMessageIter msg_iter;
+    DBusMessageIter dict_iter;
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(c);
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+
+    dbus_message_iter_init_append(reply, &msg_iter);
+    pa_assert_se(dbus_message_iter_open_container(&msg_iter, DBUS_TYPE_ARRAY, "{oa{sv}}", &dict_iter));
+
+    append_streams(&dict_iter, c->playback_streams);
+    append_streams(&dict_iter, c->record_streams);
+
+    pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
 static void handle_upload_sample(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     pa_dbusiface_core *c = userdata;
     DBusMessageIter msg_iter;
@@ -100,6 +100,13 @@ struct pa_dbusiface_device {
     pa_hook_slot *port_changed_slot;
     pa_hook_slot *proplist_changed_slot;
 
+    /* Volume, mute and property list signals are only sent once per
+     * main loop iteration, with the latest values */
+    pa_defer_event *signal_event;
+    bool volume_signal_pending;
+    bool mute_signal_pending;
+    bool property_list_signal_pending;
+
     pa_dbus_protocol *dbus_protocol;
 };
 
@@ -1082,11 +1089,80 @@ static void handle_source_get_all(DBusConnection *conn, DBusMessage *msg, void *
     dbus_message_unref(reply);
 }
 
+static pa_mainloop_api *device_mainloop(pa_dbusiface_device *d) {
+    return (d->type == PA_DEVICE_TYPE_SINK) ? d->sink->core->mainloop : d->source->core->mainloop;
+}
+
+static void send_volume_signal(pa_dbusiface_device *d) {
+    DBusMessage *signal_msg = NULL;
+    dbus_uint32_t volume[PA_CHANNELS_MAX];
+    dbus_uint32_t *volume_ptr = volume;
+    unsigned i = 0;
+
+    for (i = 0; i < d->volume.channels; ++i)
+        volume[i] = d->volume.values[i];
+
+    pa_assert_se(signal_msg = dbus_message_new_signal(d->path,
+                                                      PA_DBUSIFACE_DEVICE_INTERFACE,
+                                                      signals[SIGNAL_VOLUME_UPDATED].name));
+    pa_assert_se(dbus_message_append_args(signal_msg,
+                                          DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &volume_ptr, d->volume.channels,
+                                          DBUS_TYPE_INVALID));
+
+    pa_dbus_protocol_send_signal(d->dbus_protocol, signal_msg);
+    dbus_message_unref(signal_msg);
+}
+
+static void send_mute_signal(pa_dbusiface_device *d) {
+    DBusMessage *signal_msg = NULL;
+
+    pa_assert_se(signal_msg = dbus_message_new_signal(d->path,
+                                                      PA_DBUSIFACE_DEVICE_INTERFACE,
+                                                      signals[SIGNAL_MUTE_UPDATED].name));
+    pa_assert_se(dbus_message_append_args(signal_msg, DBUS_TYPE_BOOLEAN, &d->mute, DBUS_TYPE_INVALID));
+
+    pa_dbus_protocol_send_signal(d->dbus_protocol, signal_msg);
+    dbus_message_unref(signal_msg);
+}
+
+static void send_property_list_signal(pa_dbusiface_device *d) {
+    DBusMessage *signal_msg = NULL;
+    DBusMessageIter msg_iter;
+
+    pa_assert_se(signal_msg = dbus_message_new_signal(d->path,
+                                                      PA_DBUSIFACE_DEVICE_INTERFACE,
+                                                      signals[SIGNAL_PROPERTY_LIST_UPDATED].name));
+    dbus_message_iter_init_append(signal_msg, &msg_iter);
+    pa_dbus_append_proplist(&msg_iter, d->proplist);
+
+    pa_dbus_protocol_send_signal(d->dbus_protocol, signal_msg);
+    dbus_message_unref(signal_msg);
+}
+
+static void signal_event_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    pa_dbusiface_device *d = userdata;
+
+    pa_assert(d);
+
+    a->defer_enable(e, 0);
+
+    if (d->volume_signal_pending)
+        send_volume_signal(d);
+
+    if (d->mute_signal_pending)
+        send_mute_signal(d);
+
+    if (d->property_list_signal_pending)
+        send_property_list_signal(d);
+
+    d->volume_signal_pending = false;
+    d->mute_signal_pending = false;
+    d->property_list_signal_pending = false;
+}
+
 static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void *slot_data) {
     pa_dbusiface_device *d = slot_data;
-    DBusMessage *signal_msg = NULL;
     const pa_cvolume *new_volume = NULL;
-    unsigned i = 0;
 
     if ((d->type == PA_DEVICE_TYPE_SINK && d->sink != call_data) ||
         (d->type == PA_DEVICE_TYPE_SOURCE && d->source != call_data))
@@ -1097,23 +1173,9 @@ static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void
                  : pa_source_get_volume(d->source, false);
 
     if (!pa_cvolume_equal(&d->volume, new_volume)) {
-        dbus_uint32_t volume[PA_CHANNELS_MAX];
-        dbus_uint32_t *volume_ptr = volume;
-
         d->volume = *new_volume;
-
-        for (i = 0; i < d->volume.channels; ++i)
-            volume[i] = d->volume.values[i];
-
-        pa_assert_se(signal_msg = dbus_message_new_signal(d->path,
-                                                          PA_DBUSIFACE_DEVICE_INTERFACE,
-                                                          signals[SIGNAL_VOLUME_UPDATED].name));
-        pa_assert_se(dbus_message_append_args(signal_msg,
-                                              DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &volume_ptr, d->volume.channels,
-                                              DBUS_TYPE_INVALID));
-
-        pa_dbus_protocol_send_signal(d->dbus_protocol, signal_msg);
-        dbus_message_unref(signal_msg);
+        d->volume_signal_pending = true;
+        device_mainloop(d)->defer_enable(d->signal_event, 1);
     }
 
     return PA_HOOK_OK;
@@ -1121,7 +1183,6 @@ static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void
 
 static pa_hook_result_t mute_changed_cb(void *hook_data, void *call_data, void *slot_data) {
     pa_dbusiface_device *d = slot_data;
-    DBusMessage *signal_msg = NULL;
     bool new_mute = false;
 
     if ((d->type == PA_DEVICE_TYPE_SINK && d->sink != call_data) ||
@@ -1134,14 +1195,8 @@ static pa_hook_result_t mute_changed_cb(void *hook_data, void *call_data, void *
 
     if (d->mute != new_mute) {
         d->mute = new_mute;
-
-        pa_assert_se(signal_msg = dbus_message_new_signal(d->path,
-                                                          PA_DBUSIFACE_DEVICE_INTERFACE,
-                                                          signals[SIGNAL_MUTE_UPDATED].name));
-        pa_assert_se(dbus_message_append_args(signal_msg, DBUS_TYPE_BOOLEAN, &d->mute, DBUS_TYPE_INVALID));
-
-        pa_dbus_protocol_send_signal(d->dbus_protocol, signal_msg);
-        dbus_message_unref(signal_msg);
+        d->mute_signal_pending = true;
+        device_mainloop(d)->defer_enable(d->signal_event, 1);
     }
 
     return PA_HOOK_OK;
@@ -1216,7 +1271,6 @@ static pa_hook_result_t port_changed_cb(void *hook_data, void *call_data, void *
 
 static pa_hook_result_t proplist_changed_cb(void *hook_data, void *call_data, void *slot_data) {
     pa_dbusiface_device *d = slot_data;
-    DBusMessage *signal_msg = NULL;
     pa_proplist *new_proplist = NULL;
 
     if ((d->type == PA_DEVICE_TYPE_SINK && d->sink != call_data) ||
@@ -1226,18 +1280,9 @@ static pa_hook_result_t proplist_changed_cb(void *hook_data, void *call_data, vo
     new_proplist = (d->type == PA_DEVICE_TYPE_SINK) ? d->sink->proplist : d->source->proplist;
 
     if (!pa_proplist_equal(d->proplist, new_proplist)) {
-        DBusMessageIter msg_iter;
-
         pa_proplist_update(d->proplist, PA_UPDATE_SET, new_proplist);
-
-        pa_assert_se(signal_msg = dbus_message_new_signal(d->path,
-                                                          PA_DBUSIFACE_DEVICE_INTERFACE,
-                                                          signals[SIGNAL_PROPERTY_LIST_UPDATED].name));
-        dbus_message_iter_init_append(signal_msg, &msg_iter);
-        pa_dbus_append_proplist(&msg_iter, d->proplist);
-
-        pa_dbus_protocol_send_signal(d->dbus_protocol, signal_msg);
-        dbus_message_unref(signal_msg);
+        d->property_list_signal_pending = true;
+        device_mainloop(d)->defer_enable(d->signal_event, 1);
     }
 
     return PA_HOOK_OK;
@@ -1263,6 +1308,8 @@ pa_dbusiface_device *pa_dbusiface_device_new_sink(pa_dbusiface_core *core, pa_si
     d->next_port_index = 0;
     d->active_port = sink->active_port;
     d->proplist = pa_proplist_copy(sink->proplist);
+    d->signal_event = sink->core->mainloop->defer_new(sink->core->mainloop, signal_event_cb, d);
+    sink->core->mainloop->defer_enable(d->signal_event, 0);
     d->dbus_protocol = pa_dbus_protocol_get(sink->core);
     d->volume_changed_slot = pa_hook_connect(&sink->core->hooks[PA_CORE_HOOK_SINK_VOLUME_CHANGED],
                                              PA_HOOK_NORMAL, volume_changed_cb, d);
@@ -1306,6 +1353,8 @@ pa_dbusiface_device *pa_dbusiface_device_new_source(pa_dbusiface_core *core, pa_
     d->next_port_index = 0;
     d->active_port = source->active_port;
     d->proplist = pa_proplist_copy(source->proplist);
+    d->signal_event = source->core->mainloop->defer_new(source->core->mainloop, signal_event_cb, d);
+    source->core->mainloop->defer_enable(d->signal_event, 0);
     d->dbus_protocol = pa_dbus_protocol_get(source->core);
     d->volume_changed_slot = pa_hook_connect(&source->core->hooks[PA_CORE_HOOK_SOURCE_VOLUME_CHANGED],
                                              PA_HOOK_NORMAL, volume_changed_cb, d);
@@ -1338,6 +1387,9 @@ void pa_dbusiface_device_free(pa_dbusiface_device *d) {
     pa_hook_slot_free(d->port_changed_slot);
     pa_hook_slot_free(d->proplist_changed_slot);
 
+    /* Pending signals die with the object */
+    device_mainloop(d)->defer_free(d->signal_event);
+
     pa_assert_se(pa_dbus_protocol_remove_interface(d->dbus_protocol, d->path, device_interface_info.name) >= 0);
 
     if (d->type == PA_DEVICE_TYPE_SINK) {
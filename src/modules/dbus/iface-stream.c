@@ -56,6 +56,13 @@ struct pa_dbusiface_stream {
 
     bool has_volume;
 
+    /* Volume, mute and property list signals are only sent once per
+     * main loop iteration, with the latest values */
+    pa_defer_event *signal_event;
+    bool volume_signal_pending;
+    bool mute_signal_pending;
+    bool property_list_signal_pending;
+
     pa_dbus_protocol *dbus_protocol;
     pa_hook_slot *send_event_slot;
     pa_hook_slot *move_finish_slot;
@@ -513,6 +520,21 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_dbusiface_stream *s = userdata;
     DBusMessage *reply = NULL;
     DBusMessageIter msg_iter;
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(s);
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+
+    dbus_message_iter_init_append(reply, &msg_iter);
+    pa_dbusiface_stream_append_all(s, &msg_iter);
+
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+void pa_dbusiface_stream_append_all(pa_dbusiface_stream *s, DBusMessageIter *iter) {
     DBusMessageIter dict_iter;
     dbus_uint32_t idx = 0;
     const char *driver = NULL;
@@ -530,9 +552,8 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     const char *resample_method = NULL;
     unsigned i = 0;
 
-    pa_assert(conn);
-    pa_assert(msg);
     pa_assert(s);
+    pa_assert(iter);
 
     if (s->has_volume) {
         for (i = 0; i < s->volume.channels; ++i)
@@ -569,10 +590,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     if (!resample_method)
         resample_method = "";
 
-    pa_assert_se((reply = dbus_message_new_method_return(msg)));
-
-    dbus_message_iter_init_append(reply, &msg_iter);
-    pa_assert_se(dbus_message_iter_open_container(&msg_iter, DBUS_TYPE_ARRAY, "{sv}", &dict_iter));
+    pa_assert_se(dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict_iter));
 
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_INDEX].property_name, DBUS_TYPE_UINT32, &idx);
 
@@ -600,9 +618,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_RESAMPLE_METHOD].property_name, DBUS_TYPE_STRING, &resample_method);
     pa_dbus_append_proplist_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_PROPERTY_LIST].property_name, s->proplist);
 
-    pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
-    pa_assert_se(dbus_connection_send(conn, reply, NULL));
-    dbus_message_unref(reply);
+    pa_assert_se(dbus_message_iter_close_container(iter, &dict_iter));
 }
 
 static void handle_move(DBusConnection *conn, DBusMessage *msg, void *userdata) {
@@ -734,11 +750,80 @@ static pa_hook_result_t move_finish_cb(void *hook_data, void *call_data, void *s
     return PA_HOOK_OK;
 }
 
-static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void *slot_data) {
-    pa_dbusiface_stream *s = slot_data;
+static pa_mainloop_api *stream_mainloop(pa_dbusiface_stream *s) {
+    return (s->type == STREAM_TYPE_PLAYBACK) ? s->sink_input->core->mainloop : s->source_output->core->mainloop;
+}
+
+static void send_volume_signal(pa_dbusiface_stream *s) {
     DBusMessage *signal_msg = NULL;
+    dbus_uint32_t volume[PA_CHANNELS_MAX];
+    dbus_uint32_t *volume_ptr = volume;
     unsigned i = 0;
 
+    for (i = 0; i < s->volume.channels; ++i)
+        volume[i] = s->volume.values[i];
+
+    pa_assert_se(signal_msg = dbus_message_new_signal(s->path,
+                                                      PA_DBUSIFACE_STREAM_INTERFACE,
+                                                      signals[SIGNAL_VOLUME_UPDATED].name));
+    pa_assert_se(dbus_message_append_args(signal_msg,
+                                          DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &volume_ptr, s->volume.channels,
+                                          DBUS_TYPE_INVALID));
+
+    pa_dbus_protocol_send_signal(s->dbus_protocol, signal_msg);
+    dbus_message_unref(signal_msg);
+}
+
+static void send_mute_signal(pa_dbusiface_stream *s) {
+    DBusMessage *signal_msg = NULL;
+
+    pa_assert_se(signal_msg = dbus_message_new_signal(s->path,
+                                                      PA_DBUSIFACE_STREAM_INTERFACE,
+                                                      signals[SIGNAL_MUTE_UPDATED].name));
+    pa_assert_se(dbus_message_append_args(signal_msg, DBUS_TYPE_BOOLEAN, &s->mute, DBUS_TYPE_INVALID));
+
+    pa_dbus_protocol_send_signal(s->dbus_protocol, signal_msg);
+    dbus_message_unref(signal_msg);
+}
+
+static void send_property_list_signal(pa_dbusiface_stream *s) {
+    DBusMessage *signal_msg = NULL;
+    DBusMessageIter msg_iter;
+
+    pa_assert_se(signal_msg = dbus_message_new_signal(s->path,
+                                                      PA_DBUSIFACE_STREAM_INTERFACE,
+                                                      signals[SIGNAL_PROPERTY_LIST_UPDATED].name));
+    dbus_message_iter_init_append(signal_msg, &msg_iter);
+    pa_dbus_append_proplist(&msg_iter, s->proplist);
+
+    pa_dbus_protocol_send_signal(s->dbus_protocol, signal_msg);
+    dbus_message_unref(signal_msg);
+}
+
+static void signal_event_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    pa_dbusiface_stream *s = userdata;
+
+    pa_assert(s);
+
+    a->defer_enable(e, 0);
+
+    if (s->volume_signal_pending)
+        send_volume_signal(s);
+
+    if (s->mute_signal_pending)
+        send_mute_signal(s);
+
+    if (s->property_list_signal_pending)
+        send_property_list_signal(s);
+
+    s->volume_signal_pending = false;
+    s->mute_signal_pending = false;
+    s->property_list_signal_pending = false;
+}
+
+static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void *slot_data) {
+    pa_dbusiface_stream *s = slot_data;
+
     if ((s->type == STREAM_TYPE_PLAYBACK && s->sink_input != call_data) ||
         (s->type == STREAM_TYPE_RECORD && s->source_output != call_data))
         return PA_HOOK_OK;
@@ -749,23 +834,9 @@ static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void
         pa_sink_input_get_volume(s->sink_input, &new_volume, true);
 
         if (!pa_cvolume_equal(&s->volume, &new_volume)) {
-            dbus_uint32_t volume[PA_CHANNELS_MAX];
-            dbus_uint32_t *volume_ptr = volume;
-
             s->volume = new_volume;
-
-            for (i = 0; i < s->volume.channels; ++i)
-                volume[i] = s->volume.values[i];
-
-            pa_assert_se(signal_msg = dbus_message_new_signal(s->path,
-                                                              PA_DBUSIFACE_STREAM_INTERFACE,
-                                                              signals[SIGNAL_VOLUME_UPDATED].name));
-            pa_assert_se(dbus_message_append_args(signal_msg,
-                                                  DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &volume_ptr, s->volume.channels,
-                                                  DBUS_TYPE_INVALID));
-
-            pa_dbus_protocol_send_signal(s->dbus_protocol, signal_msg);
-            dbus_message_unref(signal_msg);
+            s->volume_signal_pending = true;
+            stream_mainloop(s)->defer_enable(s->signal_event, 1);
         }
     }
 
@@ -774,7 +845,6 @@ static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void
 
 static pa_hook_result_t mute_changed_cb(void *hook_data, void *call_data, void *slot_data) {
     pa_dbusiface_stream *s = slot_data;
-    DBusMessage *signal_msg = NULL;
 
     if ((s->type == STREAM_TYPE_PLAYBACK && s->sink_input != call_data) ||
         (s->type == STREAM_TYPE_RECORD && s->source_output != call_data))
@@ -787,15 +857,8 @@ static pa_hook_result_t mute_changed_cb(void *hook_data, void *call_data, void *
 
         if (s->mute != new_mute) {
             s->mute = new_mute;
-
-            pa_assert_se(signal_msg = dbus_message_new_signal(s->path,
-                                                              PA_DBUSIFACE_STREAM_INTERFACE,
-                                                              signals[SIGNAL_MUTE_UPDATED].name));
-            pa_assert_se(dbus_message_append_args(signal_msg, DBUS_TYPE_BOOLEAN, &s->mute, DBUS_TYPE_INVALID));
-
-            pa_dbus_protocol_send_signal(s->dbus_protocol, signal_msg);
-            dbus_message_unref(signal_msg);
-            signal_msg = NULL;
+            s->mute_signal_pending = true;
+            stream_mainloop(s)->defer_enable(s->signal_event, 1);
         }
     }
 
@@ -804,7 +867,6 @@ static pa_hook_result_t mute_changed_cb(void *hook_data, void *call_data, void *
 
 static pa_hook_result_t proplist_changed_cb(void *hook_data, void *call_data, void *slot_data) {
     pa_dbusiface_stream *s = slot_data;
-    DBusMessage *signal_msg = NULL;
     pa_proplist *new_proplist = NULL;
 
     if ((s->type == STREAM_TYPE_PLAYBACK && s->sink_input != call_data) ||
@@ -814,18 +876,9 @@ static pa_hook_result_t proplist_changed_cb(void *hook_data, void *call_data, vo
     new_proplist = (s->type == STREAM_TYPE_PLAYBACK) ? s->sink_input->proplist : s->source_output->proplist;
 
     if (!pa_proplist_equal(s->proplist, new_proplist)) {
-        DBusMessageIter msg_iter;
-
         pa_proplist_update(s->proplist, PA_UPDATE_SET, new_proplist);
-
-        pa_assert_se(signal_msg = dbus_message_new_signal(s->path,
-                                                          PA_DBUSIFACE_STREAM_INTERFACE,
-                                                          signals[SIGNAL_PROPERTY_LIST_UPDATED].name));
-        dbus_message_iter_init_append(signal_msg, &msg_iter);
-        pa_dbus_append_proplist(&msg_iter, s->proplist);
-
-        pa_dbus_protocol_send_signal(s->dbus_protocol, signal_msg);
-        dbus_message_unref(signal_msg);
+        s->property_list_signal_pending = true;
+        stream_mainloop(s)->defer_enable(s->signal_event, 1);
     }
 
     return PA_HOOK_OK;
@@ -908,6 +961,11 @@ pa_dbusiface_stream *pa_dbusiface_stream_new_playback(pa_dbusiface_core *core, p
 
     s->mute = sink_input->muted;
     s->proplist = pa_proplist_copy(sink_input->proplist);
+    s->signal_event = sink_input->core->mainloop->defer_new(sink_input->core->mainloop, signal_event_cb, s);
+    sink_input->core->mainloop->defer_enable(s->signal_event, 0);
+    s->volume_signal_pending = false;
+    s->mute_signal_pending = false;
+    s->property_list_signal_pending = false;
     s->dbus_protocol = pa_dbus_protocol_get(sink_input->core);
     s->send_event_slot = pa_hook_connect(&sink_input->core->hooks[PA_CORE_HOOK_SINK_INPUT_SEND_EVENT],
                                          PA_HOOK_NORMAL,
@@ -946,6 +1004,11 @@ pa_dbusiface_stream *pa_dbusiface_stream_new_record(pa_dbusiface_core *core, pa_
     s->mute = false;
     s->proplist = pa_proplist_copy(source_output->proplist);
     s->has_volume = false;
+    s->signal_event = source_output->core->mainloop->defer_new(source_output->core->mainloop, signal_event_cb, s);
+    source_output->core->mainloop->defer_enable(s->signal_event, 0);
+    s->volume_signal_pending = false;
+    s->mute_signal_pending = false;
+    s->property_list_signal_pending = false;
     s->dbus_protocol = pa_dbus_protocol_get(source_output->core);
     s->send_event_slot = pa_hook_connect(&source_output->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_SEND_EVENT],
                                          PA_HOOK_NORMAL,
@@ -972,6 +1035,9 @@ void pa_dbusiface_stream_free(pa_dbusiface_stream *s) {
 
     pa_assert_se(pa_dbus_protocol_remove_interface(s->dbus_protocol, s->path, stream_interface_info.name) >= 0);
 
+    /* Whatever is still pending is moot, the object is gone */
+    stream_mainloop(s)->defer_free(s->signal_event);
+
     if (s->type == STREAM_TYPE_PLAYBACK) {
         pa_sink_input_unref(s->sink_input);
         pa_sink_unref(s->sink);
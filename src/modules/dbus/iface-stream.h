@@ -42,4 +42,8 @@ void pa_dbusiface_stream_free(pa_dbusiface_stream *s);
 
 const char *pa_dbusiface_stream_get_path(pa_dbusiface_stream *s);
 
+/* Appends all properties of the Stream interface as an a{sv} dictionary,
+ * as returned by GetAll. */
+void pa_dbusiface_stream_append_all(pa_dbusiface_stream *s, DBusMessageIter *iter);
+
 #endif
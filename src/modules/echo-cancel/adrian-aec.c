@@ -32,6 +32,9 @@
 
 #ifdef __SSE__
 #include <xmmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ADRIAN_NEON 1
 #endif
 
 /* Vector Dot Product */
@@ -48,9 +51,9 @@ static REAL dotp(REAL a[], REAL b[])
   return sum0 + sum1;
 }
 
+#ifdef __SSE__
 static REAL dotp_sse(REAL a[], REAL b[])
 {
-#ifdef __SSE__
   /* This is taken from speex's inner product implementation */
   int j;
   REAL sum;
@@ -66,11 +69,81 @@ static REAL dotp_sse(REAL a[], REAL b[])
   _mm_store_ss(&sum, acc);
 
   return sum;
-#else
-  return dotp(a, b);
+}
+
+/* Tap weight update w += mikro_ef * xf, and the dot product of the new w
+ * with the x of the next sample, but for tap 0, in the same pass. */
+static REAL update_dotp_sse(REAL w[], REAL xf[], REAL x[], REAL mikro_ef)
+{
+  int j;
+  REAL sum = 0.0f, vsum;
+  __m128 mu = _mm_set1_ps(mikro_ef);
+  __m128 acc = _mm_setzero_ps();
+
+  /* The next sample is not in x yet, so the first taps go one by one */
+  w[0] += mikro_ef * xf[0];
+  for (j = 1; j < 4; j++) {
+    w[j] += mikro_ef * xf[j];
+    sum += w[j] * x[j - 1];
+  }
+
+  for (j = 4; j < NLMS_LEN; j += 4) {
+    __m128 wv = _mm_add_ps(_mm_load_ps(w+j), _mm_mul_ps(mu, _mm_loadu_ps(xf+j)));
+
+    _mm_store_ps(w+j, wv);
+    acc = _mm_add_ps(acc, _mm_mul_ps(wv, _mm_loadu_ps(x+j-1)));
+  }
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+  _mm_store_ss(&vsum, acc);
+
+  return sum + vsum;
+}
 #endif
+
+#ifdef ADRIAN_NEON
+static REAL dotp_neon(REAL a[], REAL b[])
+{
+  int j;
+  float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+  float32x2_t acc;
+
+  for (j = 0; j < NLMS_LEN; j += 8) {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(a + j), vld1q_f32(b + j));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(a + j + 4), vld1q_f32(b + j + 4));
+  }
+  acc0 = vaddq_f32(acc0, acc1);
+  acc = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+
+  return vget_lane_f32(vpadd_f32(acc, acc), 0);
 }
 
+/* Same as update_dotp_sse() */
+static REAL update_dotp_neon(REAL w[], REAL xf[], REAL x[], REAL mikro_ef)
+{
+  int j;
+  REAL sum = 0.0f;
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x2_t acc;
+
+  w[0] += mikro_ef * xf[0];
+  for (j = 1; j < 4; j++) {
+    w[j] += mikro_ef * xf[j];
+    sum += w[j] * x[j - 1];
+  }
+
+  for (j = 4; j < NLMS_LEN; j += 4) {
+    float32x4_t wv = vmlaq_n_f32(vld1q_f32(w + j), vld1q_f32(xf + j), mikro_ef);
+
+    vst1q_f32(w + j, wv);
+    acc0 = vmlaq_f32(acc0, wv, vld1q_f32(x + j - 1));
+  }
+  acc = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+
+  return sum + vget_lane_f32(vpadd_f32(acc, acc), 0);
+}
+#endif
+
 
 AEC* AEC_init(int RATE, int have_vector)
 {
@@ -93,7 +166,15 @@ AEC* AEC_init(int RATE, int have_vector)
   if (have_vector) {
       /* Get a 16-byte aligned location */
       a->w = (REAL *) (((uintptr_t) a->w_arr) - (((uintptr_t) a->w_arr) % 16) + 16);
+#if defined(__SSE__)
       a->dotp = dotp_sse;
+      a->update_dotp = update_dotp_sse;
+#elif defined(ADRIAN_NEON)
+      a->dotp = dotp_neon;
+      a->update_dotp = update_dotp_neon;
+#else
+      a->dotp = dotp;
+#endif
   } else {
       /* We don't care about alignment, just use the array as-is */
       a->w = a->w_arr;
@@ -172,6 +253,7 @@ static void AEC_leaky(AEC *a)
       --(a->hangover);
       // My Leaky NLMS is to erase vector w when hangover expires
       memset(a->w_arr, 0, sizeof(a->w_arr));
+      a->have_next_dotp = 0;
     }
   }
 }
@@ -196,8 +278,13 @@ static REAL AEC_nlms_pw(AEC *a, REAL d, REAL x_, float stepsize)
   // (mic signal - estimated mic signal from spk signal)
   e = d;
   if (a->hangover > 0) {
-    e -= a->dotp(a->w, a->x + a->j);
+    if (a->have_next_dotp)
+      // tap 0 meets the new sample only now
+      e -= a->next_dotp + a->w[0] * a->x[a->j];
+    else
+      e -= a->dotp(a->w, a->x + a->j);
   }
+  a->have_next_dotp = 0;
   ef = IIR1_highpass(a->Fe, e);     // pre-whitening of e
 
   // optimize: iterative dotp(xf, xf)
@@ -207,17 +294,24 @@ static REAL AEC_nlms_pw(AEC *a, REAL d, REAL x_, float stepsize)
     // calculate variable step size
     REAL mikro_ef = stepsize * ef / a->dotp_xf_xf;
 
+    if (a->update_dotp) {
+      // update tap weights and filter the next sample in one go. The
+      // memmove below keeps the values the next sample sees in x.
+      a->next_dotp = a->update_dotp(a->w, &a->xf[a->j], &a->x[a->j], mikro_ef);
+      a->have_next_dotp = 1;
+    } else {
 #ifdef DISABLE_ORC
-    // update tap weights (filter learning)
-    int i;
-    for (i = 0; i < NLMS_LEN; i += 2) {
-      // optimize: partial loop unrolling
-      a->w[i] += mikro_ef * a->xf[i + a->j];
-      a->w[i + 1] += mikro_ef * a->xf[i + a->j + 1];
-    }
+      // update tap weights (filter learning)
+      int i;
+      for (i = 0; i < NLMS_LEN; i += 2) {
+        // optimize: partial loop unrolling
+        a->w[i] += mikro_ef * a->xf[i + a->j];
+        a->w[i + 1] += mikro_ef * a->xf[i + a->j + 1];
+      }
 #else
-    update_tap_weights(a->w, &a->xf[a->j], mikro_ef, NLMS_LEN);
+      update_tap_weights(a->w, &a->xf[a->j], mikro_ef, NLMS_LEN);
 #endif
+    }
   }
 
   if (--(a->j) < 0) {
@@ -328,6 +328,10 @@ struct AEC {
 
   // vfuncs that are picked based on processor features available
   REAL (*dotp) (REAL[], REAL[]);
+  // optional: updates w and does most of the next dotp in one pass
+  REAL (*update_dotp) (REAL w[], REAL xf[], REAL x[], REAL mikro_ef);
+  REAL next_dotp;               // that part of the next dotp
+  int have_next_dotp;
 };
 
 /* Double-Talk Detector
@@ -82,9 +82,11 @@ bool pa_adrian_ec_init(pa_core *c, pa_echo_canceller *ec,
 
     pa_log_debug ("Using nframes %d, blocksize %u, channels %d, rate %d", *nframes, ec->params.priv.adrian.blocksize, out_ss->channels, out_ss->rate);
 
-    /* For now we only support SSE */
+    /* For now we only support SSE and NEON */
     if (c->cpu_info.cpu_type == PA_CPU_X86 && (c->cpu_info.flags.x86 & PA_CPU_X86_SSE))
         have_vector = 1;
+    else if (c->cpu_info.cpu_type == PA_CPU_ARM && (c->cpu_info.flags.arm & PA_CPU_ARM_NEON))
+        have_vector = 1;
 
     ec->params.priv.adrian.aec = AEC_init(rate, have_vector);
     if (!ec->params.priv.adrian.aec)
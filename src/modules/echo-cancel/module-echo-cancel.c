@@ -48,6 +48,7 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/ltdl-helper.h>
 
@@ -73,6 +74,7 @@ PA_MODULE_USAGE(
           "aec_method=<implementation to use> "
           "aec_args=<parameters for the AEC engine> "
           "save_aec=<save AEC data in /tmp> "
+          "aec_thread=<run the canceller in a thread of its own> "
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
         ));
@@ -139,10 +141,14 @@ static const pa_echo_canceller ec_table[] = {
 #define DEFAULT_ADJUST_TIME_USEC (1*PA_USEC_PER_SEC)
 #define DEFAULT_ADJUST_TOLERANCE (5*PA_USEC_PER_MSEC)
 #define DEFAULT_SAVE_AEC false
+#define DEFAULT_AEC_THREAD false
 #define DEFAULT_AUTOLOADED false
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* The reference resampler corrects at most this much, in parts per million */
+#define MAX_REFERENCE_CORRECTION_PPM 10000
+
 /* Can only be used in main context */
 #define IS_ACTIVE(u) ((pa_source_get_state((u)->source) == PA_SOURCE_RUNNING) && \
                       (pa_sink_get_state((u)->sink) == PA_SINK_RUNNING))
@@ -172,8 +178,19 @@ static const pa_echo_canceller ec_table[] = {
  * 2) periodically check the difference between capture and playback. We use a
  *    low and high watermark for adjusting the alignment. Playback should always
  *    be before capture and the difference should not be bigger than one frame
- *    size. We would ideally like to resample the sink_input but most driver
- *    don't give enough accuracy to be able to do that right now.
+ *    size. Within the watermarks we resample the playback samples, the
+ *    reference for the canceller, so that the difference goes away over the
+ *    next period, instead of dropping samples. This also follows the drift
+ *    between the sink and source clocks. What is played is not touched.
+ *
+ * The I/O threads publish their timing after every block. The main thread
+ * and the resync in the source I/O thread read that without waiting for the
+ * other threads.
+ *
+ * With aec_thread=yes the canceller itself runs in a thread of its own.
+ * The source I/O thread then hands each block over to it and posts the
+ * result when it comes back, one block later, instead of waiting for the
+ * canceller.
  */
 
 struct userdata;
@@ -186,6 +203,11 @@ struct pa_echo_canceller_msg {
 PA_DEFINE_PRIVATE_CLASS(pa_echo_canceller_msg, pa_msgobject);
 #define PA_ECHO_CANCELLER_MSG(o) (pa_echo_canceller_msg_cast(o))
 
+/* A block on its way through the canceller thread */
+struct ec_job {
+    pa_memchunk rchunk, pchunk, cchunk;
+};
+
 struct snapshot {
     pa_usec_t sink_now;
     pa_usec_t sink_latency;
@@ -200,6 +222,14 @@ struct snapshot {
     size_t plen;
 };
 
+/* A snapshot one I/O thread publishes for the others to read without a round
+ * trip: seq is odd while the owner is writing, readers retry if it was odd
+ * or changed while they copied. */
+struct published_snapshot {
+    pa_atomic_t seq;
+    struct snapshot snapshot;
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -209,6 +239,9 @@ struct userdata {
     bool save_aec;
 
     pa_echo_canceller *ec;
+    bool ec_bypass;               /* null canceller, capture goes through as it is */
+    pa_thread *ec_thread;
+    pa_asyncmsgq *ec_thread_mq;   /* to hand blocks to the canceller thread */
     uint32_t source_output_blocksize;
     uint32_t source_blocksize;
     uint32_t sink_blocksize;
@@ -239,6 +272,12 @@ struct userdata {
 
     pa_atomic_t request_resync;
 
+    struct published_snapshot sink_snapshot;    /* sink half, from the sink I/O thread */
+    struct published_snapshot source_snapshot;  /* source half, from the source I/O thread */
+
+    pa_resampler *reference_resampler;  /* adjusts the rate of the playback samples */
+    uint32_t reference_rate;            /* its nominal rate, a multiple of the sink rate */
+
     pa_time_event *time_event;
     pa_usec_t adjust_time;
     int adjust_threshold;
@@ -256,6 +295,7 @@ struct userdata {
 };
 
 static void source_output_snapshot_within_thread(struct userdata *u, struct snapshot *snapshot);
+static bool get_sink_snapshot(struct userdata *u, struct snapshot *snapshot);
 
 static const char* const valid_modargs[] = {
     "source_name",
@@ -273,6 +313,7 @@ static const char* const valid_modargs[] = {
     "aec_method",
     "aec_args",
     "save_aec",
+    "aec_thread",
     "autoloaded",
     "use_volume_sharing",
     NULL
@@ -281,16 +322,18 @@ static const char* const valid_modargs[] = {
 enum {
     SOURCE_OUTPUT_MESSAGE_POST = PA_SOURCE_OUTPUT_MESSAGE_MAX,
     SOURCE_OUTPUT_MESSAGE_REWIND,
-    SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT,
-    SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME
+    SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME,
+    SOURCE_OUTPUT_MESSAGE_SET_REFERENCE_RATE,
+    SOURCE_OUTPUT_MESSAGE_EC_DONE
 };
 
 enum {
-    SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT
+    ECHO_CANCELLER_MESSAGE_SET_VOLUME,
 };
 
 enum {
-    ECHO_CANCELLER_MESSAGE_SET_VOLUME,
+    EC_THREAD_MESSAGE_RUN,
+    EC_THREAD_MESSAGE_SHUTDOWN
 };
 
 static int64_t calc_diff(struct userdata *u, struct snapshot *snapshot) {
@@ -331,12 +374,45 @@ static int64_t calc_diff(struct userdata *u, struct snapshot *snapshot) {
     return diff_time;
 }
 
+/* Called from the I/O thread owning p */
+static void snapshot_publish(struct published_snapshot *p, const struct snapshot *snapshot) {
+    pa_atomic_inc(&p->seq);
+    p->snapshot = *snapshot;
+    pa_atomic_inc(&p->seq);
+}
+
+/* Called from any context. Returns false if nothing was published yet. */
+static bool snapshot_fetch(struct published_snapshot *p, struct snapshot *snapshot) {
+    int seq;
+
+    do {
+        seq = pa_atomic_load(&p->seq);
+        *snapshot = p->snapshot;
+    } while ((seq & 1) || pa_atomic_load(&p->seq) != seq);
+
+    return seq > 0;
+}
+
+/* Called from any context. Fills in the sink half of snapshot. */
+static bool get_sink_snapshot(struct userdata *u, struct snapshot *snapshot) {
+    struct snapshot sink;
+
+    if (!snapshot_fetch(&u->sink_snapshot, &sink))
+        return false;
+
+    snapshot->sink_now = sink.sink_now;
+    snapshot->sink_latency = sink.sink_latency;
+    snapshot->sink_delay = sink.sink_delay;
+    snapshot->send_counter = sink.send_counter;
+
+    return true;
+}
+
 /* Called from main context */
 static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
     struct userdata *u = userdata;
-    uint32_t old_rate, base_rate, new_rate;
-    int64_t diff_time;
-    /*size_t fs*/
+    int64_t diff_time, correction;
+    uint32_t new_rate;
     struct snapshot latency_snapshot;
 
     pa_assert(u);
@@ -347,49 +423,39 @@ static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct tim
     if (!IS_ACTIVE(u))
         return;
 
-    /* update our snapshots */
-    pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
+    /* pick up what the I/O threads published last */
+    if (!snapshot_fetch(&u->source_snapshot, &latency_snapshot) ||
+        !get_sink_snapshot(u, &latency_snapshot))
+        goto finish;
 
     /* calculate drift between capture and playback */
     diff_time = calc_diff(u, &latency_snapshot);
 
-    /*fs = pa_frame_size(&u->source_output->sample_spec);*/
-    old_rate = u->sink_input->sample_spec.rate;
-    base_rate = u->source_output->sample_spec.rate;
-
-    if (diff_time < 0) {
-        /* recording before playback, we need to adjust quickly. The echo
-         * canceller does not work in this case. */
+    if (diff_time < 0 || diff_time > u->adjust_threshold) {
+        /* recording before playback, or too far behind it, we need to adjust
+         * quickly. The echo canceller does not work in the first case. */
         pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME,
             NULL, diff_time, NULL, NULL);
-        /*new_rate = base_rate - ((pa_usec_to_bytes(-diff_time, &u->source_output->sample_spec) / fs) * PA_USEC_PER_SEC) / u->adjust_time;*/
-        new_rate = base_rate;
-    }
-    else {
-        if (diff_time > u->adjust_threshold) {
-            /* diff too big, quickly adjust */
-            pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME,
-                NULL, diff_time, NULL, NULL);
-        }
-
-        /* recording behind playback, we need to slowly adjust the rate to match */
-        /*new_rate = base_rate + ((pa_usec_to_bytes(diff_time, &u->source_output->sample_spec) / fs) * PA_USEC_PER_SEC) / u->adjust_time;*/
+        correction = 0;
+    } else {
+        /* recording behind playback, stretch the playback samples so that
+         * the difference is gone by the next time we get here */
+        correction = diff_time * 1000000 / (int64_t) u->adjust_time;
 
-        /* assume equal samplerates for now */
-        new_rate = base_rate;
+        /* make sure we don't make too big adjustments because that sounds horrible */
+        correction = PA_CLAMP(correction, -MAX_REFERENCE_CORRECTION_PPM, MAX_REFERENCE_CORRECTION_PPM);
     }
 
-    /* make sure we don't make too big adjustments because that sounds horrible */
-    if (new_rate > base_rate * 1.1 || new_rate < base_rate * 0.9)
-        new_rate = base_rate;
+    if (u->reference_resampler) {
+        new_rate = (uint32_t) ((int64_t) u->reference_rate - (int64_t) u->reference_rate * correction / 1000000);
 
-    if (new_rate != old_rate) {
-        pa_log_info("Old rate %lu Hz, new rate %lu Hz", (unsigned long) old_rate, (unsigned long) new_rate);
+        pa_log_debug("Reference rate %lu (%lld ppm)", (unsigned long) new_rate, (long long) -correction);
 
-        pa_sink_input_set_rate(u->sink_input, new_rate);
+        pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_SET_REFERENCE_RATE,
+            NULL, new_rate, NULL, NULL);
     }
 
+finish:
     pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
 }
 
@@ -417,7 +483,9 @@ static int source_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t
                 /* Add the latency internal to our source output on top */
                 pa_bytes_to_usec(pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq), &u->source_output->source->sample_spec) +
                 /* and the buffering we do on the source */
-                pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec);
+                pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec) +
+                /* and the block the canceller thread holds back */
+                (u->ec_thread ? pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec) : 0);
 
             return 0;
 
@@ -678,11 +746,17 @@ static void do_resync(struct userdata *u) {
     int64_t diff_time;
     struct snapshot latency_snapshot;
 
+    /* update our snapshot, the sink half is whatever the sink I/O thread
+     * published last */
+    if (!get_sink_snapshot(u, &latency_snapshot)) {
+        /* nothing played yet, try again later */
+        pa_atomic_store(&u->request_resync, 1);
+        return;
+    }
+
     pa_log("Doing resync");
 
-    /* update our snapshot */
     source_output_snapshot_within_thread(u, &latency_snapshot);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
 
     /* calculate drift between capture and playback */
     diff_time = calc_diff(u, &latency_snapshot);
@@ -789,6 +863,48 @@ static void do_push_drift_comp(struct userdata *u) {
     }
 }
 
+/* Cancels the echo in one block, saving the data if requested.
+ *
+ * Called from source I/O thread context, or from the canceller thread. */
+static void run_block(struct userdata *u, pa_memchunk *rchunk, pa_memchunk *pchunk, pa_memchunk *cchunk) {
+    uint8_t *rdata, *pdata, *cdata;
+    int unused PA_GCC_UNUSED;
+
+    rdata = pa_memblock_acquire(rchunk->memblock);
+    rdata += rchunk->index;
+    pdata = pa_memblock_acquire(pchunk->memblock);
+    pdata += pchunk->index;
+    cdata = pa_memblock_acquire(cchunk->memblock);
+
+    if (u->save_aec) {
+        if (u->captured_file)
+            unused = fwrite(rdata, 1, u->source_output_blocksize, u->captured_file);
+        if (u->played_file)
+            unused = fwrite(pdata, 1, u->sink_blocksize, u->played_file);
+    }
+
+    /* perform echo cancellation */
+    u->ec->run(u->ec, rdata, pdata, cdata);
+
+    if (u->save_aec) {
+        if (u->canceled_file)
+            unused = fwrite(cdata, 1, u->source_blocksize, u->canceled_file);
+    }
+
+    pa_memblock_release(cchunk->memblock);
+    pa_memblock_release(pchunk->memblock);
+    pa_memblock_release(rchunk->memblock);
+}
+
+static void ec_job_free(void *p) {
+    struct ec_job *job = p;
+
+    pa_memblock_unref(job->rchunk.memblock);
+    pa_memblock_unref(job->pchunk.memblock);
+    pa_memblock_unref(job->cchunk.memblock);
+    pa_xfree(job);
+}
+
 /* This one's simpler than the drift compensation case -- we just iterate over
  * the capture buffer, and pass the canceller blocksize bytes of playback and
  * capture data.
@@ -797,8 +913,6 @@ static void do_push_drift_comp(struct userdata *u) {
 static void do_push(struct userdata *u) {
     size_t rlen, plen;
     pa_memchunk rchunk, pchunk, cchunk;
-    uint8_t *rdata, *pdata, *cdata;
-    int unused PA_GCC_UNUSED;
 
     rlen = pa_memblockq_get_length(u->source_memblockq);
     plen = pa_memblockq_get_length(u->sink_memblockq);
@@ -813,53 +927,113 @@ static void do_push(struct userdata *u) {
         if (plen < u->sink_blocksize)
             pa_memblockq_seek(u->sink_memblockq, u->sink_blocksize - plen, PA_SEEK_RELATIVE, true);
 
-        rdata = pa_memblock_acquire(rchunk.memblock);
-        rdata += rchunk.index;
-        pdata = pa_memblock_acquire(pchunk.memblock);
-        pdata += pchunk.index;
-
         cchunk.index = 0;
         cchunk.length = u->source_blocksize;
         cchunk.memblock = pa_memblock_new(u->source->core->mempool, cchunk.length);
-        cdata = pa_memblock_acquire(cchunk.memblock);
 
-        if (u->save_aec) {
-            if (u->captured_file)
-                unused = fwrite(rdata, 1, u->source_output_blocksize, u->captured_file);
-            if (u->played_file)
-                unused = fwrite(pdata, 1, u->sink_blocksize, u->played_file);
-        }
+        if (u->ec_thread) {
+            struct ec_job *job;
 
-        /* perform echo cancellation */
-        u->ec->run(u->ec, rdata, pdata, cdata);
+            /* the canceller thread takes over our references, the result
+             * comes back as SOURCE_OUTPUT_MESSAGE_EC_DONE */
+            job = pa_xnew(struct ec_job, 1);
+            job->rchunk = rchunk;
+            job->pchunk = pchunk;
+            job->cchunk = cchunk;
+            pa_asyncmsgq_post(u->ec_thread_mq, NULL, EC_THREAD_MESSAGE_RUN, job, 0, NULL, NULL);
+        } else {
+            run_block(u, &rchunk, &pchunk, &cchunk);
 
-        if (u->save_aec) {
-            if (u->canceled_file)
-                unused = fwrite(cdata, 1, u->source_blocksize, u->canceled_file);
-        }
+            pa_memblock_unref(rchunk.memblock);
+            pa_memblock_unref(pchunk.memblock);
 
-        pa_memblock_release(cchunk.memblock);
-        pa_memblock_release(pchunk.memblock);
-        pa_memblock_release(rchunk.memblock);
+            /* forward the (echo-canceled) data to the virtual source */
+            pa_source_post(u->source, &cchunk);
+            pa_memblock_unref(cchunk.memblock);
+        }
 
         /* drop consumed source samples */
         pa_memblockq_drop(u->source_memblockq, u->source_output_blocksize);
-        pa_memblock_unref(rchunk.memblock);
         rlen -= u->source_output_blocksize;
 
         /* drop consumed sink samples */
         pa_memblockq_drop(u->sink_memblockq, u->sink_blocksize);
-        pa_memblock_unref(pchunk.memblock);
 
         if (plen >= u->sink_blocksize)
             plen -= u->sink_blocksize;
         else
             plen = 0;
+    }
+}
 
-        /* forward the (echo-canceled) data to the virtual source */
-        pa_source_post(u->source, &cchunk);
-        pa_memblock_unref(cchunk.memblock);
+/* For the null canceller: forward whole blocks of capture data without
+ * copying them and throw away as much playback data.
+ *
+ * Called from source I/O thread context. */
+static void do_bypass(struct userdata *u) {
+    size_t rlen, plen, to_post, to_drop;
+    pa_memchunk rchunk;
+
+    rlen = pa_memblockq_get_length(u->source_memblockq);
+    plen = pa_memblockq_get_length(u->sink_memblockq);
+
+    to_post = rlen - rlen % u->source_output_blocksize;
+    to_drop = to_post / u->source_output_blocksize * u->sink_blocksize;
+
+    while (to_post > 0) {
+        pa_assert_se(pa_memblockq_peek(u->source_memblockq, &rchunk) >= 0);
+        pa_assert(rchunk.memblock);
+
+        rchunk.length = PA_MIN(rchunk.length, to_post);
+        pa_source_post(u->source, &rchunk);
+
+        pa_memblockq_drop(u->source_memblockq, rchunk.length);
+        pa_memblock_unref(rchunk.memblock);
+        to_post -= rchunk.length;
+    }
+
+    /* we ran out of played data, don't let the queue run behind */
+    if (plen < to_drop)
+        pa_memblockq_seek(u->sink_memblockq, to_drop - plen, PA_SEEK_RELATIVE, true);
+
+    pa_memblockq_drop(u->sink_memblockq, to_drop);
+}
+
+/* Called from the canceller thread. */
+static void ec_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Canceller thread starting up");
+
+    /* Below the I/O threads, which must not wait for us */
+    if (u->core->realtime_scheduling)
+        pa_make_realtime(PA_MAX(u->core->realtime_priority - 1, 1));
+
+    for (;;) {
+        struct ec_job *job;
+        int code;
+        void *data;
+
+        pa_assert_se(pa_asyncmsgq_get(u->ec_thread_mq, NULL, &code, &data, NULL, NULL, true) == 0);
+
+        if (code == EC_THREAD_MESSAGE_SHUTDOWN) {
+            pa_asyncmsgq_done(u->ec_thread_mq, 0);
+            break;
+        }
+
+        pa_assert(code == EC_THREAD_MESSAGE_RUN);
+
+        job = data;
+        run_block(u, &job->rchunk, &job->pchunk, &job->cchunk);
+        pa_asyncmsgq_done(u->ec_thread_mq, 0);
+
+        pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_EC_DONE,
+                          job, 0, NULL, ec_job_free);
     }
+
+    pa_log_debug("Canceller thread shutting down");
 }
 
 /* Called from source I/O thread context. */
@@ -867,6 +1041,7 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     struct userdata *u;
     size_t rlen, plen, to_skip;
     pa_memchunk rchunk;
+    struct snapshot snapshot;
 
     pa_source_output_assert_ref(o);
     pa_source_output_assert_io_context(o);
@@ -940,10 +1115,32 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     }
 
     /* process and push out samples */
-    if (u->ec->params.drift_compensation)
+    if (u->ec_bypass)
+        do_bypass(u);
+    else if (u->ec->params.drift_compensation)
         do_push_drift_comp(u);
     else
         do_push(u);
+
+    source_output_snapshot_within_thread(u, &snapshot);
+    snapshot_publish(&u->source_snapshot, &snapshot);
+}
+
+/* Called from sink I/O thread context. */
+static void sink_input_publish_snapshot(struct userdata *u) {
+    struct snapshot snapshot;
+    size_t delay;
+
+    pa_zero(snapshot);
+
+    delay = pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq);
+
+    snapshot.sink_now = pa_rtclock_now();
+    snapshot.sink_latency = pa_sink_get_latency_within_thread(u->sink_input->sink);
+    snapshot.sink_delay = (u->sink_input->thread_info.resampler ? pa_resampler_request(u->sink_input->thread_info.resampler, delay) : delay);
+    snapshot.send_counter = u->send_counter;
+
+    snapshot_publish(&u->sink_snapshot, &snapshot);
 }
 
 /* Called from sink I/O thread context. */
@@ -970,6 +1167,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
         NULL, 0, chunk, NULL);
     u->send_counter += chunk->length;
 
+    sink_input_publish_snapshot(u);
+
     return 0;
 }
 
@@ -1006,6 +1205,8 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
     pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_REWIND, NULL, (int64_t) nbytes, NULL, NULL);
     u->send_counter -= nbytes;
+
+    sink_input_publish_snapshot(u);
 }
 
 /* Called from source I/O thread context. */
@@ -1039,10 +1240,23 @@ static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data,
 
             pa_source_output_assert_io_context(u->source_output);
 
-            if (u->source_output->source->thread_info.state == PA_SOURCE_RUNNING)
-                pa_memblockq_push_align(u->sink_memblockq, chunk);
-            else
+            if (u->source_output->source->thread_info.state == PA_SOURCE_RUNNING) {
+                if (u->reference_resampler) {
+                    pa_memchunk rchunk;
+
+                    pa_resampler_run(u->reference_resampler, chunk, &rchunk);
+
+                    if (rchunk.memblock) {
+                        pa_memblockq_push_align(u->sink_memblockq, &rchunk);
+                        pa_memblock_unref(rchunk.memblock);
+                    }
+                } else
+                    pa_memblockq_push_align(u->sink_memblockq, chunk);
+            } else {
                 pa_memblockq_flush_write(u->sink_memblockq, true);
+                if (u->reference_resampler)
+                    pa_resampler_reset(u->reference_resampler);
+            }
 
             u->recv_counter += (int64_t) chunk->length;
 
@@ -1057,56 +1271,40 @@ static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data,
             else
                 pa_memblockq_flush_write(u->sink_memblockq, true);
 
+            /* the rate stays within a percent, close enough for a rewind */
+            if (u->reference_resampler)
+                pa_resampler_reset(u->reference_resampler);
+
             pa_log_debug("Sink rewind (%lld)", (long long) offset);
 
             u->recv_counter -= offset;
 
             return 0;
 
-        case SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            struct snapshot *snapshot = (struct snapshot *) data;
-
-            source_output_snapshot_within_thread(u, snapshot);
-            return 0;
-        }
-
         case SOURCE_OUTPUT_MESSAGE_APPLY_DIFF_TIME:
             apply_diff_time(u, offset);
             return 0;
 
-    }
-
-    return pa_source_output_process_msg(obj, code, data, offset, chunk);
-}
-
-/* Called from sink I/O thread context. */
-static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    struct userdata *u = PA_SINK_INPUT(obj)->userdata;
-
-    switch (code) {
-
-        case SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            size_t delay;
-            pa_usec_t now, latency;
-            struct snapshot *snapshot = (struct snapshot *) data;
+        case SOURCE_OUTPUT_MESSAGE_SET_REFERENCE_RATE:
+            if (u->reference_resampler)
+                pa_resampler_set_input_rate(u->reference_resampler, (uint32_t) offset);
+            return 0;
 
-            pa_sink_input_assert_io_context(u->sink_input);
+        case SOURCE_OUTPUT_MESSAGE_EC_DONE: {
+            struct ec_job *job = (struct ec_job *) data;
 
-            now = pa_rtclock_now();
-            latency = pa_sink_get_latency_within_thread(u->sink_input->sink);
-            delay = pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq);
+            pa_source_output_assert_io_context(u->source_output);
 
-            delay = (u->sink_input->thread_info.resampler ? pa_resampler_request(u->sink_input->thread_info.resampler, delay) : delay);
+            /* forward the (echo-canceled) data to the virtual source */
+            if (u->source->thread_info.state == PA_SOURCE_RUNNING)
+                pa_source_post(u->source, &job->cchunk);
 
-            snapshot->sink_now = now;
-            snapshot->sink_latency = latency;
-            snapshot->sink_delay = delay;
-            snapshot->send_counter = u->send_counter;
             return 0;
         }
+
     }
 
-    return pa_sink_input_process_msg(obj, code, data, offset, chunk);
+    return pa_source_output_process_msg(obj, code, data, offset, chunk);
 }
 
 /* Called from sink I/O thread context. */
@@ -1631,6 +1829,9 @@ static int init_common(pa_modargs *ma, struct userdata *u, pa_sample_spec *sourc
 
     pa_log_info("Using AEC engine: %s", ec_string);
 
+    /* Nothing to cancel, unless we are asked to save the data */
+    u->ec_bypass = ec_method == PA_ECHO_CANCELLER_NULL && !u->save_aec;
+
     u->ec->init = ec_table[ec_method].init;
     u->ec->play = ec_table[ec_method].play;
     u->ec->record = ec_table[ec_method].record;
@@ -1658,6 +1859,7 @@ int pa__init(pa_module*m) {
     pa_sink_new_data sink_data;
     pa_memchunk silence;
     uint32_t temp;
+    bool aec_thread;
     uint32_t nframes = 0;
 
     pa_assert(m);
@@ -1736,6 +1938,12 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    aec_thread = DEFAULT_AEC_THREAD;
+    if (pa_modargs_get_value_boolean(ma, "aec_thread", &aec_thread) < 0) {
+        pa_log("Failed to parse aec_thread value");
+        goto fail;
+    }
+
     u->autoloaded = DEFAULT_AUTOLOADED;
     if (pa_modargs_get_value_boolean(ma, "autoloaded", &u->autoloaded) < 0) {
         pa_log("Failed to parse autoloaded value");
@@ -1772,6 +1980,12 @@ int pa__init(pa_module*m) {
     if (u->ec->params.drift_compensation)
         pa_assert(u->ec->set_drift);
 
+    if (aec_thread && u->ec->params.drift_compensation) {
+        /* play() and record() run at different times, keep them in order */
+        pa_log_warn("Canceller does drift compensation, not running it in its own thread");
+        aec_thread = false;
+    }
+
     /* Create source */
     pa_source_new_data_init(&source_data);
     source_data.driver = __FILE__;
@@ -1925,7 +2139,6 @@ int pa__init(pa_module*m) {
     if (!u->sink_input)
         goto fail;
 
-    u->sink_input->parent.process_msg = sink_input_process_msg_cb;
     u->sink_input->pop = sink_input_pop_cb;
     u->sink_input->process_rewind = sink_input_process_rewind_cb;
     u->sink_input->update_max_rewind = sink_input_update_max_rewind_cb;
@@ -1960,9 +2173,22 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
-    if (u->adjust_time > 0 && !u->ec->params.drift_compensation)
+    if (u->adjust_time > 0 && !u->ec->params.drift_compensation) {
+        pa_sample_spec reference_ss = sink_ss;
+
+        /* Run the resampler at a multiple of the actual rate, so that it
+         * can be adjusted in steps of a few ppm */
+        u->reference_rate = sink_ss.rate * (PA_RATE_MAX / sink_ss.rate);
+        reference_ss.rate = u->reference_rate;
+
+        if (!(u->reference_resampler = pa_resampler_new(u->core->mempool, &reference_ss, &sink_map, &reference_ss, &sink_map,
+                                                        0, u->core->resample_method, PA_RESAMPLER_VARIABLE_RATE))) {
+            pa_log("Failed to create reference resampler.");
+            goto fail;
+        }
+
         u->time_event = pa_core_rttime_new(m->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
-    else if (u->ec->params.drift_compensation) {
+    } else if (u->ec->params.drift_compensation) {
         pa_log_info("Canceller does drift compensation -- built-in compensation will be disabled");
         u->adjust_time = 0;
         /* Perform resync just once to give the canceller a leg up */
@@ -1987,6 +2213,19 @@ int pa__init(pa_module*m) {
         }
     }
 
+    if (aec_thread && u->ec_bypass)
+        /* there is no work to hand off */
+        aec_thread = false;
+
+    if (aec_thread) {
+        u->ec_thread_mq = pa_asyncmsgq_new(0);
+
+        if (!(u->ec_thread = pa_thread_new("echo-cancel", ec_thread_func, u))) {
+            pa_log("Failed to create canceller thread.");
+            goto fail;
+        }
+    }
+
     u->ec->msg = pa_msgobject_new(pa_echo_canceller_msg);
     u->ec->msg->parent.process_msg = canceller_process_msg_cb;
     u->ec->msg->userdata = u;
@@ -2048,6 +2287,16 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unlink(u->sink);
 
+    /* Nothing new can be queued now, let the canceller thread finish what
+     * it has got. Its results are dropped with u->asyncmsgq. */
+    if (u->ec_thread) {
+        pa_asyncmsgq_send(u->ec_thread_mq, NULL, EC_THREAD_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(u->ec_thread);
+    }
+
+    if (u->ec_thread_mq)
+        pa_asyncmsgq_unref(u->ec_thread_mq);
+
     if (u->source_output)
         pa_source_output_unref(u->source_output);
     if (u->sink_input)
@@ -2058,6 +2307,9 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
+    if (u->reference_resampler)
+        pa_resampler_free(u->reference_resampler);
+
     if (u->source_memblockq)
         pa_memblockq_free(u->source_memblockq);
     if (u->sink_memblockq)
@@ -31,6 +31,8 @@
 
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/atomic.h>
+
 #include <pulsecore/sink.h>
 #include <pulsecore/module.h>
 #include <pulsecore/core-util.h>
@@ -54,6 +56,12 @@
  * should hopefully not be that expensive if RT scheduling is
  * enabled. A better fix would only be possible with additional event
  * source support in JACK.
+ *
+ * With prerender= set we avoid the context switch: the PA thread
+ * renders that many JACK periods ahead into a ring, from which the
+ * JACK thread takes what it needs without waiting. It then just posts
+ * a message so that we refill the ring. This costs the additional
+ * latency of the ring.
  */
 
 PA_MODULE_AUTHOR("Lennart Poettering");
@@ -67,9 +75,11 @@ PA_MODULE_USAGE(
         "client_name=<jack client name> "
         "channels=<number of channels> "
         "channel_map=<channel map> "
-        "connect=<connect ports?>");
+        "connect=<connect ports?> "
+        "prerender=<JACK periods to render ahead, 0 to render when JACK asks>");
 
 #define DEFAULT_SINK_NAME "jack_out"
+#define MAX_PRERENDER 32
 
 struct userdata {
     pa_core *core;
@@ -93,6 +103,15 @@ struct userdata {
     jack_nframes_t frames_in_buffer;
     jack_nframes_t saved_frame_time;
     bool saved_frame_time_valid;
+
+    /* The interleaved prerender ring. The PA thread owns ring_write,
+     * the JACK thread ring_read, and ring_fill hands frames over. */
+    float *ring;
+    jack_nframes_t ring_frames;
+    jack_nframes_t ring_read, ring_write;
+    pa_atomic_t ring_fill;
+    pa_atomic_t ring_underrun;
+    bool ring_primed;
 };
 
 static const char* const valid_modargs[] = {
@@ -103,15 +122,41 @@ static const char* const valid_modargs[] = {
     "channels",
     "channel_map",
     "connect",
+    "prerender",
     NULL
 };
 
 enum {
     SINK_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_CONSUMED,
     SINK_MESSAGE_BUFFER_SIZE,
     SINK_MESSAGE_ON_SHUTDOWN
 };
 
+/* Called from the PA thread, tops the ring up again */
+static void ring_refill(struct userdata *u) {
+    size_t frame_size;
+    jack_nframes_t n;
+
+    frame_size = pa_frame_size(&u->sink->sample_spec);
+
+    while ((n = u->ring_frames - (jack_nframes_t) pa_atomic_load(&u->ring_fill)) > 0) {
+        pa_memchunk chunk;
+
+        /* Only up to the end of the ring, and then from its start */
+        n = PA_MIN(n, u->ring_frames - u->ring_write);
+
+        chunk.memblock = pa_memblock_new_fixed(u->core->mempool, u->ring + u->ring_write * u->channels, n * frame_size, false);
+        chunk.index = 0;
+        chunk.length = n * frame_size;
+        pa_sink_render_into_full(u->sink, &chunk);
+        pa_memblock_unref_fixed(chunk.memblock);
+
+        u->ring_write = (u->ring_write + n) % u->ring_frames;
+        pa_atomic_add(&u->ring_fill, (int) n);
+    }
+}
+
 static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *memchunk) {
     struct userdata *u = PA_SINK(o)->userdata;
 
@@ -156,7 +201,40 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
             return 0;
 
+        case SINK_MESSAGE_CONSUMED:
+
+            /* The JACK thread took data from the ring */
+
+            if (u->sink->thread_info.state == PA_SINK_RUNNING) {
+
+                if (pa_atomic_cmpxchg(&u->ring_underrun, 1, 0) && u->ring_primed) {
+                    pa_log_debug("Prerender ring underrun!");
+                    pa_metric_inc(u->sink->metrics.xruns);
+                }
+
+                ring_refill(u);
+                u->ring_primed = true;
+            } else {
+                /* What is left in the ring still gets played, but the
+                 * JACK thread will run out of data without us caring */
+                pa_atomic_store(&u->ring_underrun, 0);
+                u->ring_primed = false;
+            }
+
+            u->frames_in_buffer = (jack_nframes_t) PA_PTR_TO_UINT(data);
+            u->saved_frame_time = (jack_nframes_t) offset;
+            u->saved_frame_time_valid = true;
+
+            return 0;
+
         case SINK_MESSAGE_BUFFER_SIZE:
+            if (u->ring) {
+                if ((jack_nframes_t) offset > u->ring_frames)
+                    pa_log_warn("JACK buffer size of %u frames exceeds the prerender ring of %u frames, playback will drop out.",
+                                (unsigned) offset, (unsigned) u->ring_frames);
+                return 0;
+            }
+
             pa_sink_set_max_request_within_thread(u->sink, (size_t) offset * pa_frame_size(&u->sink->sample_spec));
             return 0;
 
@@ -173,6 +251,9 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             jack_port_get_latency_range(u->port[0], JackPlaybackLatency, &r);
             l = r.max + u->frames_in_buffer;
 
+            if (u->ring)
+                l += (jack_nframes_t) pa_atomic_load(&u->ring_fill);
+
             if (u->saved_frame_time_valid) {
                 /* Adjust the worst case latency by the time that
                  * passed since we last handed data to JACK */
@@ -212,6 +293,47 @@ static int jack_process(jack_nframes_t nframes, void *arg) {
     return 0;
 }
 
+/* JACK Callback: Like jack_process(), but taking the data from the
+ * prerender ring. This must not wait for the PA thread. */
+static int jack_process_prerendered(jack_nframes_t nframes, void *arg) {
+    struct userdata *u = arg;
+    void *buffer[PA_CHANNELS_MAX];
+    jack_nframes_t done = 0, fill, n;
+    unsigned c;
+    pa_assert(u);
+
+    for (c = 0; c < u->channels; c++)
+        pa_assert_se(buffer[c] = jack_port_get_buffer(u->port[c], nframes));
+
+    fill = (jack_nframes_t) pa_atomic_load(&u->ring_fill);
+
+    while (done < nframes && fill > 0) {
+        void *dst[PA_CHANNELS_MAX];
+
+        n = PA_MIN(PA_MIN(nframes - done, fill), u->ring_frames - u->ring_read);
+
+        for (c = 0; c < u->channels; c++)
+            dst[c] = (float*) buffer[c] + done;
+
+        pa_deinterleave(u->ring + u->ring_read * u->channels, dst, u->channels, sizeof(float), n);
+
+        u->ring_read = (u->ring_read + n) % u->ring_frames;
+        pa_atomic_sub(&u->ring_fill, (int) n);
+        fill -= n;
+        done += n;
+    }
+
+    if (done < nframes) {
+        for (c = 0; c < u->channels; c++)
+            memset((float*) buffer[c] + done, 0, (nframes - done) * sizeof(float));
+
+        pa_atomic_store(&u->ring_underrun, 1);
+    }
+
+    pa_asyncmsgq_post(u->jack_msgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_CONSUMED, PA_UINT_TO_PTR(nframes), jack_frame_time(u->client), NULL, NULL);
+    return 0;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -290,7 +412,7 @@ int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     jack_status_t status;
     const char *server_name, *client_name;
-    uint32_t channels = 0;
+    uint32_t channels = 0, prerender = 0;
     bool do_connect = true;
     unsigned i;
     const char **ports = NULL, **p;
@@ -312,6 +434,11 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "prerender", &prerender) < 0 || prerender > MAX_PRERENDER) {
+        pa_log("Failed to parse prerender= argument.");
+        goto fail;
+    }
+
     server_name = pa_modargs_get_value(ma, "server_name", NULL);
     client_name = pa_modargs_get_value(ma, "client_name", "PulseAudio JACK Sink");
 
@@ -409,9 +536,19 @@ int pa__init(pa_module*m) {
 
     pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
     pa_sink_set_rtpoll(u->sink, u->rtpoll);
-    pa_sink_set_max_request(u->sink, jack_get_buffer_size(u->client) * pa_frame_size(&u->sink->sample_spec));
 
-    jack_set_process_callback(u->client, jack_process, u);
+    if (prerender > 0) {
+        /* The ring is never resized, the JACK thread might be using it */
+        u->ring_frames = prerender * jack_get_buffer_size(u->client);
+        u->ring = pa_xnew0(float, u->ring_frames * u->channels);
+
+        pa_sink_set_max_request(u->sink, u->ring_frames * pa_frame_size(&u->sink->sample_spec));
+        jack_set_process_callback(u->client, jack_process_prerendered, u);
+    } else {
+        pa_sink_set_max_request(u->sink, jack_get_buffer_size(u->client) * pa_frame_size(&u->sink->sample_spec));
+        jack_set_process_callback(u->client, jack_process, u);
+    }
+
     jack_on_shutdown(u->client, jack_shutdown, u);
     jack_set_thread_init_callback(u->client, jack_init, u);
     jack_set_buffer_size_callback(u->client, jack_buffer_size, u);
@@ -444,7 +581,7 @@ int pa__init(pa_module*m) {
     }
 
     jack_port_get_latency_range(u->port[0], JackPlaybackLatency, &r);
-    n = r.max * pa_frame_size(&u->sink->sample_spec);
+    n = (r.max + u->ring_frames) * pa_frame_size(&u->sink->sample_spec);
     pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(n, &u->sink->sample_spec));
     pa_sink_put(u->sink);
 
@@ -508,5 +645,6 @@ void pa__done(pa_module*m) {
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
+    pa_xfree(u->ring);
     pa_xfree(u);
 }
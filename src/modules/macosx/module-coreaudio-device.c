@@ -43,6 +43,9 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/i18n.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/ringbuffer.h>
 
 #include <CoreAudio/CoreAudio.h>
 #include <CoreAudio/CoreAudioTypes.h>
@@ -52,6 +55,10 @@
 
 #define DEFAULT_FRAMES_PER_IOPROC 512
 
+/* How many IOProc buffers the IO thread renders ahead of the IOProc, or
+ * the IOProc records before the IO thread collects them */
+#define IOPROC_BUFFERS_PER_RING 2
+
 PA_MODULE_AUTHOR("Daniel Mack");
 PA_MODULE_DESCRIPTION("CoreAudio device");
 PA_MODULE_VERSION(PACKAGE_VERSION);
@@ -65,10 +72,6 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
-enum {
-    CA_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
-};
-
 typedef struct coreaudio_sink coreaudio_sink;
 typedef struct coreaudio_source coreaudio_source;
 
@@ -77,7 +80,10 @@ struct userdata {
     AudioDeviceIOProcID proc_id;
 
     pa_thread_mq thread_mq;
-    pa_asyncmsgq *async_msgq;
+
+    /* Posted by the IOProc after it took from or added to the rings */
+    pa_fdsem *ioproc_fdsem;
+    UInt32 frames_per_ioproc;
 
     pa_rtpoll *rtpoll;
     pa_thread *thread;
@@ -88,9 +94,6 @@ struct userdata {
 
     char *device_name, *vendor_name;
 
-    const AudioBufferList *render_input_data;
-    AudioBufferList       *render_output_data;
-
     AudioStreamBasicDescription stream_description;
 
     PA_LLIST_HEAD(coreaudio_sink, sinks);
@@ -108,6 +111,12 @@ struct coreaudio_sink {
     pa_channel_map map;
     pa_sample_spec ss;
 
+    /* Between the IO thread and the IOProc, which must not wait for the
+     * IO thread nor take locks */
+    pa_ringbuffer ring;
+    pa_atomic_t ring_count;
+    pa_atomic_t xruns;
+
     PA_LLIST_FIELDS(coreaudio_sink);
 };
 
@@ -122,6 +131,12 @@ struct coreaudio_source {
     pa_channel_map map;
     pa_sample_spec ss;
 
+    /* Between the IO thread and the IOProc, which must not wait for the
+     * IO thread nor take locks */
+    pa_ringbuffer ring;
+    pa_atomic_t ring_count;
+    pa_atomic_t xruns;
+
     PA_LLIST_FIELDS(coreaudio_source);
 };
 
@@ -137,20 +152,72 @@ static OSStatus io_render_proc (AudioDeviceID          device,
                                 const AudioTimeStamp  *outputTime,
                                 void                  *clientData) {
     struct userdata *u = clientData;
+    coreaudio_sink *ca_sink;
+    coreaudio_source *ca_source;
+    UInt32 i;
 
     pa_assert(u);
     pa_assert(device == u->object_id);
 
-    u->render_input_data = inputData;
-    u->render_output_data = outputData;
+    /* Only copies between the device buffers and the rings here, the
+     * IO thread renders and posts in its own time */
+
+    /* audio out */
+    for (i = 0, ca_sink = u->sinks; outputData && i < outputData->mNumberBuffers && ca_sink; i++, ca_sink = ca_sink->next) {
+        AudioBuffer *buf = outputData->mBuffers + i;
+        uint8_t *d = buf->mData;
+        int left = (int) buf->mDataByteSize;
+
+        while (left > 0) {
+            int n;
+            void *p;
 
-    if (u->sinks)
-        pa_assert_se(pa_asyncmsgq_send(u->async_msgq, PA_MSGOBJECT(u->sinks->pa_sink),
-                                        CA_MESSAGE_RENDER, NULL, 0, NULL) == 0);
+            p = pa_ringbuffer_peek(&ca_sink->ring, &n);
+            if (n <= 0)
+                break;
 
-    if (u->sources)
-        pa_assert_se(pa_asyncmsgq_send(u->async_msgq, PA_MSGOBJECT(u->sources->pa_source),
-                                        CA_MESSAGE_RENDER, NULL, 0, NULL) == 0);
+            n = PA_MIN(n, left);
+            memcpy(d, p, n);
+            pa_ringbuffer_drop(&ca_sink->ring, n);
+
+            d += n;
+            left -= n;
+        }
+
+        if (left > 0) {
+            /* Silence is all zeros in float */
+            memset(d, 0, left);
+            pa_atomic_inc(&ca_sink->xruns);
+        }
+    }
+
+    /* audio in */
+    for (i = 0, ca_source = u->sources; inputData && i < inputData->mNumberBuffers && ca_source; i++, ca_source = ca_source->next) {
+        const AudioBuffer *buf = inputData->mBuffers + i;
+        const uint8_t *d = buf->mData;
+        int left = (int) buf->mDataByteSize;
+
+        while (left > 0) {
+            int n;
+            void *p;
+
+            p = pa_ringbuffer_begin_write(&ca_source->ring, &n);
+            if (n <= 0)
+                break;
+
+            n = PA_MIN(n, left);
+            memcpy(p, d, n);
+            pa_ringbuffer_end_write(&ca_source->ring, n);
+
+            d += n;
+            left -= n;
+        }
+
+        if (left > 0)
+            pa_atomic_inc(&ca_source->xruns);
+    }
+
+    pa_fdsem_post(u->ioproc_fdsem);
 
     return 0;
 }
@@ -180,6 +247,7 @@ static pa_usec_t get_latency_us(pa_object *o) {
     pa_sample_spec *ss;
     bool is_source;
     UInt32 v = 0, total = 0;
+    size_t queued;
     OSStatus err;
     UInt32 size = sizeof(v);
     AudioObjectPropertyAddress property_address;
@@ -190,12 +258,14 @@ static pa_usec_t get_latency_us(pa_object *o) {
 
         u = sink->userdata;
         ss = &sink->ss;
+        queued = (size_t) pa_atomic_load(&sink->ring_count);
         is_source = false;
     } else if (pa_source_isinstance(o)) {
         coreaudio_source *source = PA_SOURCE(o)->userdata;
 
         u = source->userdata;
         ss = &source->ss;
+        queued = (size_t) pa_atomic_load(&source->ring_count);
         is_source = true;
     } else
         pa_assert_not_reached();
@@ -249,7 +319,8 @@ static pa_usec_t get_latency_us(pa_object *o) {
     } else
         pa_log_warn("Failed to get streams: %d", err);
 
-    return pa_bytes_to_usec(total * pa_frame_size(ss), ss);
+    /* what waits in the ring on top of that */
+    return pa_bytes_to_usec(total * pa_frame_size(ss) + queued, ss);
 }
 
 static void ca_device_check_device_state(struct userdata *u) {
@@ -275,73 +346,95 @@ static void ca_device_check_device_state(struct userdata *u) {
     u->running = active;
 }
 
-static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    coreaudio_sink *sink = PA_SINK(o)->userdata;
-    struct userdata *u = sink->userdata;
-    unsigned int i;
-    pa_memchunk audio_chunk;
+/* Called from IO context */
+static void ca_sink_fill_ring(coreaudio_sink *ca_sink) {
+    struct userdata *u = ca_sink->userdata;
+    int xruns;
 
-    switch (code) {
-        case CA_MESSAGE_RENDER: {
-            /* audio out */
-            for (i = 0; i < u->render_output_data->mNumberBuffers; i++) {
-                AudioBuffer *buf = u->render_output_data->mBuffers + i;
+    /* While suspended the ring runs empty on purpose */
+    if ((xruns = pa_atomic_load(&ca_sink->xruns)) > 0) {
+        pa_atomic_sub(&ca_sink->xruns, xruns);
 
-                pa_assert(sink);
+        if (PA_SINK_IS_OPENED(ca_sink->pa_sink->thread_info.state))
+            pa_log_debug("%s: IOProc found the ring empty %d times", ca_sink->name, xruns);
+    }
 
-                if (PA_SINK_IS_OPENED(sink->pa_sink->thread_info.state)) {
-                    audio_chunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, buf->mData, buf->mDataByteSize, false);
-                    audio_chunk.length = buf->mDataByteSize;
-                    audio_chunk.index = 0;
+    if (!PA_SINK_IS_OPENED(ca_sink->pa_sink->thread_info.state))
+        return;
 
-                    pa_sink_render_into_full(sink->pa_sink, &audio_chunk);
-                    pa_memblock_unref_fixed(audio_chunk.memblock);
-                }
+    /* Twice, to go on at the start after the end of the memory */
+    for (;;) {
+        pa_memchunk audio_chunk;
+        void *p;
+        int n;
 
-                sink = sink->next;
-            }
+        p = pa_ringbuffer_begin_write(&ca_sink->ring, &n);
+        n = (int) pa_frame_align((size_t) n, &ca_sink->ss);
 
-            return 0;
-        }
+        if (n <= 0)
+            break;
 
-        case PA_SINK_MESSAGE_GET_LATENCY: {
-            *((pa_usec_t *) data) = get_latency_us(PA_OBJECT(o));
-            return 0;
-        }
-    }
+        /* Render straight into the ring, the IOProc only copies out */
+        audio_chunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, p, (size_t) n, false);
+        audio_chunk.length = (size_t) n;
+        audio_chunk.index = 0;
 
-    return pa_sink_process_msg(o, code, data, offset, chunk);
+        pa_sink_render_into_full(ca_sink->pa_sink, &audio_chunk);
+        pa_memblock_unref_fixed(audio_chunk.memblock);
+
+        pa_ringbuffer_end_write(&ca_sink->ring, n);
+    }
 }
 
-static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    coreaudio_source *source = PA_SOURCE(o)->userdata;
-    struct userdata *u = source->userdata;
-    unsigned int i;
-    pa_memchunk audio_chunk;
+/* Called from IO context */
+static void ca_source_drain_ring(coreaudio_source *ca_source) {
+    struct userdata *u = ca_source->userdata;
+    int xruns;
 
-    switch (code) {
-        case CA_MESSAGE_RENDER: {
-            /* audio in */
-            for (i = 0; i < u->render_input_data->mNumberBuffers; i++) {
-                const AudioBuffer *buf = u->render_input_data->mBuffers + i;
+    if ((xruns = pa_atomic_load(&ca_source->xruns)) > 0) {
+        pa_atomic_sub(&ca_source->xruns, xruns);
+        pa_log_debug("%s: IOProc found the ring full %d times", ca_source->name, xruns);
+    }
 
-                pa_assert(source);
+    for (;;) {
+        pa_memchunk audio_chunk;
+        void *p;
+        int n;
 
-                if (PA_SOURCE_IS_OPENED(source->pa_source->thread_info.state)) {
-                    audio_chunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, buf->mData, buf->mDataByteSize, true);
-                    audio_chunk.length = buf->mDataByteSize;
-                    audio_chunk.index = 0;
+        p = pa_ringbuffer_peek(&ca_source->ring, &n);
+        n = (int) pa_frame_align((size_t) n, &ca_source->ss);
 
-                    pa_source_post(source->pa_source, &audio_chunk);
-                    pa_memblock_unref_fixed(audio_chunk.memblock);
-                }
+        if (n <= 0)
+            break;
+
+        /* pa_memblock_unref_fixed() copies the data if the block is still
+         * referenced, before the drop gives the memory back to the IOProc */
+        if (PA_SOURCE_IS_OPENED(ca_source->pa_source->thread_info.state)) {
+            audio_chunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, p, (size_t) n, true);
+            audio_chunk.length = (size_t) n;
+            audio_chunk.index = 0;
+
+            pa_source_post(ca_source->pa_source, &audio_chunk);
+            pa_memblock_unref_fixed(audio_chunk.memblock);
+        }
 
-                source = source->next;
-            }
+        pa_ringbuffer_drop(&ca_source->ring, n);
+    }
+}
 
+static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    switch (code) {
+        case PA_SINK_MESSAGE_GET_LATENCY: {
+            *((pa_usec_t *) data) = get_latency_us(PA_OBJECT(o));
             return 0;
         }
+    }
 
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    switch (code) {
         case PA_SOURCE_MESSAGE_GET_LATENCY: {
             *((pa_usec_t *) data) = get_latency_us(PA_OBJECT(o));
             return 0;
@@ -427,6 +520,10 @@ static int ca_device_create_sink(pa_module *m, AudioBuffer *buf, int channel_idx
     ca_sink->ss.rate = u->stream_description.mSampleRate;
     ca_sink->ss.format = PA_SAMPLE_FLOAT32LE;
 
+    ca_sink->ring.count = &ca_sink->ring_count;
+    ca_sink->ring.capacity = (int) (u->frames_per_ioproc * pa_frame_size(&ca_sink->ss) * IOPROC_BUFFERS_PER_RING);
+    ca_sink->ring.memory = pa_xmalloc(ca_sink->ring.capacity);
+
     pa_sink_new_data_init(&new_data);
     new_data.card = u->card;
     new_data.driver = __FILE__;
@@ -545,6 +642,10 @@ static int ca_device_create_source(pa_module *m, AudioBuffer *buf, int channel_i
     ca_source->ss.rate = u->stream_description.mSampleRate;
     ca_source->ss.format = PA_SAMPLE_FLOAT32LE;
 
+    ca_source->ring.count = &ca_source->ring_count;
+    ca_source->ring.capacity = (int) (u->frames_per_ioproc * pa_frame_size(&ca_source->ss) * IOPROC_BUFFERS_PER_RING);
+    ca_source->ring.memory = pa_xmalloc(ca_source->ring.capacity);
+
     pa_source_new_data_init(&new_data);
     new_data.card = u->card;
     new_data.driver = __FILE__;
@@ -670,13 +771,19 @@ static void thread_func(void *userdata) {
 
     for (;;) {
         coreaudio_sink *ca_sink;
+        coreaudio_source *ca_source;
         int ret;
 
         PA_LLIST_FOREACH(ca_sink, u->sinks) {
             if (PA_UNLIKELY(ca_sink->pa_sink->thread_info.rewind_requested))
                 pa_sink_process_rewind(ca_sink->pa_sink, 0);
+
+            ca_sink_fill_ring(ca_sink);
         }
 
+        PA_LLIST_FOREACH(ca_source, u->sources)
+            ca_source_drain_ring(ca_source);
+
         ret = pa_rtpoll_run(u->rtpoll);
 
         if (ret < 0)
@@ -768,8 +875,23 @@ int pa__init(pa_module *m) {
 
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
-    u->async_msgq = pa_asyncmsgq_new(0);
-    pa_rtpoll_item_new_asyncmsgq_read(u->rtpoll, PA_RTPOLL_EARLY-1, u->async_msgq);
+    u->ioproc_fdsem = pa_fdsem_new();
+    pa_rtpoll_item_new_fdsem(u->rtpoll, PA_RTPOLL_EARLY-1, u->ioproc_fdsem);
+
+    /* set number of frames in IOProc, the rings are sized by what the
+     * device really took */
+    frames = DEFAULT_FRAMES_PER_IOPROC;
+    pa_modargs_get_value_u32(ma, "ioproc_frames", (unsigned int *) &frames);
+
+    property_address.mSelector = kAudioDevicePropertyBufferFrameSize;
+    AudioObjectSetPropertyData(u->object_id, &property_address, 0, NULL, sizeof(frames), &frames);
+
+    size = sizeof(frames);
+    if (AudioObjectGetPropertyData(u->object_id, &property_address, 0, NULL, &size, &frames) != 0 || frames <= 0)
+        frames = DEFAULT_FRAMES_PER_IOPROC;
+
+    u->frames_per_ioproc = frames;
+    pa_log_debug("%u frames per IOProc\n", (unsigned int) frames);
 
     PA_LLIST_HEAD_INIT(coreaudio_sink, u->sinks);
 
@@ -792,14 +914,6 @@ int pa__init(pa_module *m) {
 
     AudioObjectAddPropertyListener(u->object_id, &property_address, ca_stream_format_changed, u);
 
-    /* set number of frames in IOProc */
-    frames = DEFAULT_FRAMES_PER_IOPROC;
-    pa_modargs_get_value_u32(ma, "ioproc_frames", (unsigned int *) &frames);
-
-    property_address.mSelector = kAudioDevicePropertyBufferFrameSize;
-    AudioObjectSetPropertyData(u->object_id, &property_address, 0, NULL, sizeof(frames), &frames);
-    pa_log_debug("%u frames per IOProc\n", (unsigned int) frames);
-
     /* create one ioproc for both directions */
     err = AudioDeviceCreateIOProcID(u->object_id, io_render_proc, u, &u->proc_id);
     if (err) {
@@ -838,6 +952,12 @@ void pa__done(pa_module *m) {
     u = m->userdata;
     pa_assert(u);
 
+    /* the IOProc uses the rings of the sinks and sources */
+    if (u->proc_id) {
+        AudioDeviceStop(u->object_id, u->proc_id);
+        AudioDeviceDestroyIOProcID(u->object_id, u->proc_id);
+    }
+
     /* unlink sinks */
     for (ca_sink = u->sinks; ca_sink; ca_sink = ca_sink->next)
         if (ca_sink->pa_sink)
@@ -852,7 +972,6 @@ void pa__done(pa_module *m) {
         pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
         pa_thread_free(u->thread);
         pa_thread_mq_done(&u->thread_mq);
-        pa_asyncmsgq_unref(u->async_msgq);
     }
 
     /* free sinks */
@@ -862,6 +981,7 @@ void pa__done(pa_module *m) {
         if (ca_sink->pa_sink)
             pa_sink_unref(ca_sink->pa_sink);
 
+        pa_xfree(ca_sink->ring.memory);
         pa_xfree(ca_sink->name);
         pa_xfree(ca_sink);
         ca_sink = next;
@@ -874,15 +994,12 @@ void pa__done(pa_module *m) {
         if (ca_source->pa_source)
             pa_source_unref(ca_source->pa_source);
 
+        pa_xfree(ca_source->ring.memory);
         pa_xfree(ca_source->name);
         pa_xfree(ca_source);
         ca_source = next;
     }
 
-    if (u->proc_id) {
-        AudioDeviceStop(u->object_id, u->proc_id);
-        AudioDeviceDestroyIOProcID(u->object_id, u->proc_id);
-    }
 
     property_address.mSelector = kAudioDevicePropertyStreamFormat;
     property_address.mScope = kAudioObjectPropertyScopeGlobal;
@@ -895,5 +1012,8 @@ void pa__done(pa_module *m) {
     pa_rtpoll_free(u->rtpoll);
     pa_card_free(u->card);
 
+    if (u->ioproc_fdsem)
+        pa_fdsem_free(u->ioproc_fdsem);
+
     pa_xfree(u);
 }
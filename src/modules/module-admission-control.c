@@ -0,0 +1,442 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/hook-list.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/resampler.h>
+
+#include "module-admission-control-symdef.h"
+
+PA_MODULE_AUTHOR("PulseAudio developers");
+PA_MODULE_DESCRIPTION("Protect sinks whose IO thread runs out of time from more load");
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(true);
+PA_MODULE_USAGE(
+        "policy=<Comma separated list of what to do with an overloaded sink: reject, downgrade, cork> "
+        "threshold=<Percentage of headroom below which a sink is overloaded> "
+        "restore_threshold=<Percentage of headroom above which a sink recovers> "
+        "interval=<Seconds between two load checks> "
+        "count=<Number of checks in a row the headroom has to stay below or above the threshold> "
+        "roles=<Comma separated list of roles which may be downgraded or corked> "
+        "resample_method=<The resampler to downgrade to>");
+
+#define DEFAULT_POLICY "reject"
+#define DEFAULT_THRESHOLD 20
+#define DEFAULT_RESTORE_THRESHOLD 40
+#define DEFAULT_INTERVAL 1
+#define DEFAULT_COUNT 3
+#define DEFAULT_ROLES "music,video,game,event,animation,test"
+#define DEFAULT_RESAMPLE_METHOD "speex-float-1"
+
+static const char* const valid_modargs[] = {
+    "policy",
+    "threshold",
+    "restore_threshold",
+    "interval",
+    "count",
+    "roles",
+    "resample_method",
+    NULL
+};
+
+enum {
+    POLICY_REJECT = 1 << 0,
+    POLICY_DOWNGRADE = 1 << 1,
+    POLICY_CORK = 1 << 2
+};
+
+/* A stream this module changed */
+struct stream {
+    pa_sink_input *sink_input;
+    pa_sink *sink;
+
+    bool downgraded;
+    pa_resample_method_t original_method;
+    bool corked;
+};
+
+struct sink_state {
+    unsigned n_low, n_high;
+    bool overloaded;
+};
+
+struct userdata {
+    pa_core *core;
+    unsigned policy;
+    uint32_t threshold, restore_threshold, count;
+    pa_usec_t interval;
+    pa_idxset *roles;
+    pa_resample_method_t method;
+
+    pa_hashmap *streams;
+    pa_hashmap *sinks;
+
+    pa_time_event *time_event;
+    pa_hook_slot
+        *sink_input_put_slot,
+        *sink_input_unlink_slot,
+        *sink_unlink_slot;
+};
+
+static bool is_low_priority(struct userdata *u, pa_sink_input *i) {
+    const char *role;
+
+    if (!(role = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE)))
+        return false;
+
+    return !!pa_idxset_get_by_data(u->roles, role, NULL);
+}
+
+static void relieve_stream(struct userdata *u, pa_sink *sink, pa_sink_input *i) {
+    struct stream *s;
+    pa_resample_method_t method;
+
+    if (!PA_SINK_INPUT_IS_LINKED(i->state) || !is_low_priority(u, i))
+        return;
+
+    if (!(s = pa_hashmap_get(u->streams, i))) {
+        s = pa_xnew0(struct stream, 1);
+        s->sink_input = i;
+        pa_hashmap_put(u->streams, i, s);
+    }
+
+    s->sink = sink;
+
+    method = pa_sink_input_get_resample_method(i);
+
+    if ((u->policy & POLICY_DOWNGRADE) && !s->downgraded &&
+        method != PA_RESAMPLER_INVALID &&
+        method != PA_RESAMPLER_COPY &&
+        method != PA_RESAMPLER_TRIVIAL &&
+        method != PA_RESAMPLER_PEAKS &&
+        method != u->method) {
+
+        s->original_method = i->requested_resample_method;
+
+        if (pa_sink_input_set_resample_method(i, u->method) >= 0) {
+            pa_log_info("Sink %s overloaded, downgrading sink input %u to %s.",
+                        sink->name, i->index, pa_resample_method_to_string(u->method));
+            s->downgraded = true;
+        }
+    }
+
+    if ((u->policy & POLICY_CORK) && !s->corked &&
+        pa_sink_input_get_state(i) != PA_SINK_INPUT_CORKED && !i->muted) {
+
+        pa_log_info("Sink %s overloaded, corking sink input %u.", sink->name, i->index);
+        pa_sink_input_set_mute(i, true, false);
+        pa_sink_input_send_event(i, PA_STREAM_EVENT_REQUEST_CORK, NULL);
+        s->corked = true;
+    }
+}
+
+static void restore_stream(struct stream *s) {
+    pa_sink_input *i = s->sink_input;
+
+    if (!PA_SINK_INPUT_IS_LINKED(i->state))
+        return;
+
+    if (s->downgraded) {
+        pa_log_info("Restoring %s for sink input %u.", pa_resample_method_to_string(s->original_method), i->index);
+        pa_sink_input_set_resample_method(i, s->original_method);
+    }
+
+    if (s->corked) {
+        pa_log_info("Uncorking sink input %u.", i->index);
+
+        if (i->muted)
+            pa_sink_input_set_mute(i, false, false);
+        if (pa_sink_input_get_state(i) == PA_SINK_INPUT_CORKED)
+            pa_sink_input_send_event(i, PA_STREAM_EVENT_REQUEST_UNCORK, NULL);
+    }
+}
+
+static void enter_overload(struct userdata *u, pa_sink *sink, struct sink_state *st) {
+    pa_sink_input *i;
+    uint32_t idx;
+
+    pa_log_info("Sink %s has only %u%% headroom left.", sink->name, 100 - PA_MIN(pa_sink_get_render_load(sink) / 10, 100U));
+
+    st->overloaded = true;
+    pa_sink_set_overloaded(sink, true, u->policy & POLICY_REJECT);
+
+    PA_IDXSET_FOREACH(i, sink->inputs, idx)
+        relieve_stream(u, sink, i);
+}
+
+static void leave_overload(struct userdata *u, pa_sink *sink, struct sink_state *st) {
+    struct stream *s;
+    void *state;
+
+    st->overloaded = false;
+    pa_sink_set_overloaded(sink, false, false);
+
+    PA_HASHMAP_FOREACH(s, u->streams, state) {
+        if (s->sink != sink)
+            continue;
+
+        restore_stream(s);
+        s->downgraded = s->corked = false;
+        s->sink = NULL;
+    }
+}
+
+static void check_sink(struct userdata *u, pa_sink *sink) {
+    struct sink_state *st;
+    unsigned headroom;
+
+    if (!(st = pa_hashmap_get(u->sinks, sink))) {
+        st = pa_xnew0(struct sink_state, 1);
+        pa_hashmap_put(u->sinks, sink, st);
+    }
+
+    /* A sink that doesn't play doesn't render, and its last load is
+     * stale */
+    if (PA_SINK_IS_RUNNING(sink->state))
+        headroom = 100 - PA_MIN(pa_sink_get_render_load(sink) / 10, 100U);
+    else
+        headroom = 100;
+
+    if (headroom < u->threshold) {
+        st->n_high = 0;
+        st->n_low++;
+    } else if (headroom >= u->restore_threshold) {
+        st->n_low = 0;
+        st->n_high++;
+    } else
+        st->n_low = st->n_high = 0;
+
+    if (!st->overloaded && st->n_low >= u->count)
+        enter_overload(u, sink, st);
+    else if (st->overloaded && st->n_high >= u->count)
+        leave_overload(u, sink, st);
+}
+
+static void time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+    pa_sink *sink;
+    uint32_t idx;
+
+    pa_assert(u);
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx)
+        if (PA_SINK_IS_LINKED(sink->state))
+            check_sink(u, sink);
+
+    pa_core_rttime_restart(u->core, e, pa_rtclock_now() + u->interval);
+}
+
+static pa_hook_result_t sink_input_put_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
+    struct sink_state *st;
+
+    pa_core_assert_ref(core);
+    pa_sink_input_assert_ref(i);
+
+    /* Streams that are allowed in while the sink is overloaded get the
+     * same treatment as those that were there before */
+    if (i->sink && (st = pa_hashmap_get(u->sinks, i->sink)) && st->overloaded)
+        relieve_stream(u, i->sink, i);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_unlink_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
+    pa_sink_input_assert_ref(i);
+
+    pa_hashmap_remove_and_free(u->streams, i);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_unlink_cb(pa_core *core, pa_sink *sink, struct userdata *u) {
+    struct stream *s;
+    void *state;
+
+    pa_sink_assert_ref(sink);
+
+    PA_HASHMAP_FOREACH(s, u->streams, state)
+        if (s->sink == sink)
+            s->sink = NULL;
+
+    pa_hashmap_remove_and_free(u->sinks, sink);
+
+    return PA_HOOK_OK;
+}
+
+static int parse_policy(const char *policy, unsigned *ret) {
+    const char *state = NULL;
+    char *n;
+
+    *ret = 0;
+
+    while ((n = pa_split(policy, ",", &state))) {
+        if (pa_streq(n, "reject"))
+            *ret |= POLICY_REJECT;
+        else if (pa_streq(n, "downgrade"))
+            *ret |= POLICY_DOWNGRADE;
+        else if (pa_streq(n, "cork"))
+            *ret |= POLICY_CORK;
+        else if (n[0] != '\0') {
+            pa_xfree(n);
+            return -1;
+        }
+
+        pa_xfree(n);
+    }
+
+    return 0;
+}
+
+int pa__init(pa_module *m) {
+    pa_modargs *ma = NULL;
+    struct userdata *u;
+    const char *roles, *split_state = NULL;
+    char *n;
+    uint32_t interval = DEFAULT_INTERVAL;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments");
+        goto fail;
+    }
+
+    m->userdata = u = pa_xnew0(struct userdata, 1);
+
+    u->core = m->core;
+    u->streams = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                     NULL, pa_xfree);
+    u->sinks = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                   NULL, pa_xfree);
+
+    if (parse_policy(pa_modargs_get_value(ma, "policy", DEFAULT_POLICY), &u->policy) < 0) {
+        pa_log("Invalid policy, must be a list of reject, downgrade and cork");
+        goto fail;
+    }
+
+    u->threshold = DEFAULT_THRESHOLD;
+    u->restore_threshold = DEFAULT_RESTORE_THRESHOLD;
+
+    if (pa_modargs_get_value_u32(ma, "threshold", &u->threshold) < 0 ||
+        pa_modargs_get_value_u32(ma, "restore_threshold", &u->restore_threshold) < 0 ||
+        u->restore_threshold > 100 || u->threshold > u->restore_threshold) {
+        pa_log("Invalid thresholds, must be percentages with threshold <= restore_threshold");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "interval", &interval) < 0 || interval < 1) {
+        pa_log("Invalid interval");
+        goto fail;
+    }
+    u->interval = interval * PA_USEC_PER_SEC;
+
+    u->count = DEFAULT_COUNT;
+    if (pa_modargs_get_value_u32(ma, "count", &u->count) < 0 || u->count < 1) {
+        pa_log("Invalid count");
+        goto fail;
+    }
+
+    u->roles = pa_idxset_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    roles = pa_modargs_get_value(ma, "roles", DEFAULT_ROLES);
+    while ((n = pa_split(roles, ",", &split_state))) {
+        if (n[0] == '\0' || pa_idxset_put(u->roles, n, NULL) < 0)
+            pa_xfree(n);
+    }
+
+    if ((u->method = pa_parse_resample_method(pa_modargs_get_value(ma, "resample_method", DEFAULT_RESAMPLE_METHOD))) == PA_RESAMPLER_INVALID) {
+        pa_log("Invalid resample method");
+        goto fail;
+    }
+
+    u->sink_input_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_put_cb, u);
+    u->sink_input_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_unlink_cb, u);
+    u->sink_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_unlink_cb, u);
+
+    u->time_event = pa_core_rttime_new(m->core, pa_rtclock_now() + u->interval, time_cb, u);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    pa__done(m);
+
+    if (ma)
+        pa_modargs_free(ma);
+
+    return -1;
+}
+
+void pa__done(pa_module *m) {
+    struct userdata* u;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    if (u->time_event)
+        u->core->mainloop->time_free(u->time_event);
+
+    if (u->sink_input_put_slot)
+        pa_hook_slot_free(u->sink_input_put_slot);
+    if (u->sink_input_unlink_slot)
+        pa_hook_slot_free(u->sink_input_unlink_slot);
+    if (u->sink_unlink_slot)
+        pa_hook_slot_free(u->sink_unlink_slot);
+
+    if (u->streams) {
+        struct stream *s;
+        void *state;
+
+        PA_HASHMAP_FOREACH(s, u->streams, state)
+            restore_stream(s);
+
+        pa_hashmap_free(u->streams);
+    }
+
+    if (u->sinks) {
+        struct sink_state *st;
+        pa_sink *sink;
+        void *state;
+
+        PA_HASHMAP_FOREACH_KV(sink, st, u->sinks, state)
+            if (st->overloaded)
+                pa_sink_set_overloaded(sink, false, false);
+
+        pa_hashmap_free(u->sinks);
+    }
+
+    if (u->roles)
+        pa_idxset_free(u->roles, pa_xfree);
+
+    pa_xfree(u);
+}
@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <math.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -55,18 +56,28 @@ PA_MODULE_USAGE(
         "sink_name=<name for the sink> "
         "sink_properties=<properties for the sink> "
         "slaves=<slave sinks> "
-        "adjust_time=<how often to readjust rates in s> "
+        "adjust_time=<time constant of the rate control in s, 0 to disable it> "
+        "share_resampling=<convert once for the outputs on sinks of the same format, which must share a clock> "
         "resample_method=<method> "
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "thread_cpus=<CPUs to bind the IO thread to or 'none'>");
 
 #define DEFAULT_SINK_NAME "combined"
 
 #define MEMBLOCKQ_MAXLENGTH (1024*1024*16)
 
-#define DEFAULT_ADJUST_TIME_USEC (10*PA_USEC_PER_SEC)
+#define DEFAULT_ADJUST_TIME_USEC (2*PA_USEC_PER_SEC)
+
+/* How often the outputs measure their latency and update their rate */
+#define CONTROL_INTERVAL_USEC (PA_USEC_PER_MSEC * 250)
+
+/* The rate of an output stays within 1% of the sink's, and changes by
+ * at most 0.1% at a time */
+#define MAX_RATE_DEVIATION 0.01
+#define MAX_RATE_STEP 0.001
 
 #define BLOCK_USEC (PA_USEC_PER_MSEC * 200)
 
@@ -75,14 +86,37 @@ static const char* const valid_modargs[] = {
     "sink_properties",
     "slaves",
     "adjust_time",
+    "share_resampling",
     "resample_method",
     "format",
     "rate",
     "channels",
     "channel_map",
+    "thread_cpus",
     NULL
 };
 
+/* The state of a PI controller of a rate, see rate_control_update() */
+struct rate_control {
+    double error;      /* of the latency, low pass filtered, in s */
+    double integral;   /* of the error, in s² */
+};
+
+/* With share_resampling the outputs on sinks that take the same sample
+ * spec and channel map get their audio converted once, by the sink
+ * thread. The members of a group follow one rate, so their sinks have
+ * to run from the same clock. */
+struct group {
+    pa_sample_spec sample_spec;
+    pa_channel_map channel_map;
+
+    pa_resampler *resampler; /* NULL if there is nothing to do */
+    struct rate_control control;
+    unsigned n_outputs;
+
+    PA_LLIST_FIELDS(struct group);
+};
+
 struct output {
     struct userdata *userdata;
 
@@ -113,10 +147,24 @@ struct output {
     pa_rtpoll_item *control_inq_rtpoll_item_read, *control_inq_rtpoll_item_write;
     pa_rtpoll_item *outq_rtpoll_item_read, *outq_rtpoll_item_write;
 
+    /* What the sink input takes, and so what is in memblockq */
+    pa_sample_spec sample_spec;
+    pa_channel_map channel_map;
+
     pa_memblockq *memblockq;
 
-    /* For communication of the stream latencies to the main thread */
-    pa_usec_t total_latency;
+    /* For communication of the stream latencies to the sink thread, in
+     * usec, -1 while not known */
+    pa_atomic_t total_latency;
+    pa_atomic_t sink_latency;
+
+    /* In the output thread */
+    pa_usec_t next_control;
+    struct rate_control control;
+    bool latency_warned;
+
+    /* In the sink thread, with share_resampling */
+    struct group *group;
 
     /* For communication of the stream parameters to the sink thread */
     pa_atomic_t max_request;
@@ -135,8 +183,8 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
-    pa_time_event *time_event;
     pa_usec_t adjust_time;
+    bool share_resampling;
 
     bool automatic;
     bool auto_desc;
@@ -160,6 +208,9 @@ struct userdata {
         bool in_null_mode;
         pa_smoother *smoother;
         uint64_t counter;
+        pa_usec_t next_target_update;
+        PA_LLIST_HEAD(struct group, groups);
+        pa_atomic_t target_latency; /* for the outputs, in usec, -1 while not known */
     } thread_info;
 };
 
@@ -167,7 +218,6 @@ enum {
     SINK_MESSAGE_ADD_OUTPUT = PA_SINK_MESSAGE_MAX,
     SINK_MESSAGE_REMOVE_OUTPUT,
     SINK_MESSAGE_NEED,
-    SINK_MESSAGE_UPDATE_LATENCY,
     SINK_MESSAGE_UPDATE_MAX_REQUEST,
     SINK_MESSAGE_UPDATE_LATENCY_RANGE
 };
@@ -182,105 +232,6 @@ static void output_enable(struct output *o);
 static void output_free(struct output *o);
 static int output_create_sink_input(struct output *o);
 
-static void adjust_rates(struct userdata *u) {
-    struct output *o;
-    pa_usec_t max_sink_latency = 0, min_total_latency = (pa_usec_t) -1, target_latency, avg_total_latency = 0;
-    uint32_t base_rate;
-    uint32_t idx;
-    unsigned n = 0;
-
-    pa_assert(u);
-    pa_sink_assert_ref(u->sink);
-
-    if (pa_idxset_size(u->outputs) <= 0)
-        return;
-
-    if (!PA_SINK_IS_OPENED(pa_sink_get_state(u->sink)))
-        return;
-
-    PA_IDXSET_FOREACH(o, u->outputs, idx) {
-        pa_usec_t sink_latency;
-
-        if (!o->sink_input || !PA_SINK_IS_OPENED(pa_sink_get_state(o->sink)))
-            continue;
-
-        o->total_latency = pa_sink_input_get_latency(o->sink_input, &sink_latency);
-        o->total_latency += sink_latency;
-
-        if (sink_latency > max_sink_latency)
-            max_sink_latency = sink_latency;
-
-        if (min_total_latency == (pa_usec_t) -1 || o->total_latency < min_total_latency)
-            min_total_latency = o->total_latency;
-
-        avg_total_latency += o->total_latency;
-        n++;
-
-        pa_log_debug("[%s] total=%0.2fms sink=%0.2fms ", o->sink->name, (double) o->total_latency / PA_USEC_PER_MSEC, (double) sink_latency / PA_USEC_PER_MSEC);
-
-        if (o->total_latency > 10*PA_USEC_PER_SEC)
-            pa_log_warn("[%s] Total latency of output is very high (%0.2fms), most likely the audio timing in one of your drivers is broken.", o->sink->name, (double) o->total_latency / PA_USEC_PER_MSEC);
-    }
-
-    if (min_total_latency == (pa_usec_t) -1)
-        return;
-
-    avg_total_latency /= n;
-
-    target_latency = max_sink_latency > min_total_latency ? max_sink_latency : min_total_latency;
-
-    pa_log_info("[%s] avg total latency is %0.2f msec.", u->sink->name, (double) avg_total_latency / PA_USEC_PER_MSEC);
-    pa_log_info("[%s] target latency is %0.2f msec.", u->sink->name, (double) target_latency / PA_USEC_PER_MSEC);
-
-    base_rate = u->sink->sample_spec.rate;
-
-    PA_IDXSET_FOREACH(o, u->outputs, idx) {
-        uint32_t new_rate = base_rate;
-        uint32_t current_rate;
-
-        if (!o->sink_input || !PA_SINK_IS_OPENED(pa_sink_get_state(o->sink)))
-            continue;
-
-        current_rate = o->sink_input->sample_spec.rate;
-
-        if (o->total_latency != target_latency)
-            new_rate += (uint32_t) (((double) o->total_latency - (double) target_latency) / (double) u->adjust_time * (double) new_rate);
-
-        if (new_rate < (uint32_t) (base_rate*0.8) || new_rate > (uint32_t) (base_rate*1.25)) {
-            pa_log_warn("[%s] sample rates too different, not adjusting (%u vs. %u).", o->sink_input->sink->name, base_rate, new_rate);
-            new_rate = base_rate;
-        } else {
-            if (base_rate < new_rate + 20 && new_rate < base_rate + 20)
-              new_rate = base_rate;
-            /* Do the adjustment in small steps; 2‰ can be considered inaudible */
-            if (new_rate < (uint32_t) (current_rate*0.998) || new_rate > (uint32_t) (current_rate*1.002)) {
-                pa_log_info("[%s] new rate of %u Hz not within 2‰ of %u Hz, forcing smaller adjustment", o->sink_input->sink->name, new_rate, current_rate);
-                new_rate = PA_CLAMP(new_rate, (uint32_t) (current_rate*0.998), (uint32_t) (current_rate*1.002));
-            }
-            pa_log_info("[%s] new rate is %u Hz; ratio is %0.3f; latency is %0.2f msec.", o->sink_input->sink->name, new_rate, (double) new_rate / base_rate, (double) o->total_latency / PA_USEC_PER_MSEC);
-        }
-        pa_sink_input_set_rate(o->sink_input, new_rate);
-    }
-
-    pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_UPDATE_LATENCY, NULL, (int64_t) avg_total_latency, NULL);
-}
-
-static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
-    struct userdata *u = userdata;
-
-    pa_assert(u);
-    pa_assert(a);
-    pa_assert(u->time_event == e);
-
-    adjust_rates(u);
-
-    if (pa_sink_get_state(u->sink) == PA_SINK_SUSPENDED) {
-        u->core->mainloop->time_free(e);
-        u->time_event = NULL;
-    } else
-        pa_core_rttime_restart(u->core, e, pa_rtclock_now() + u->adjust_time);
-}
-
 static void process_render_null(struct userdata *u, pa_usec_t now) {
     size_t ate = 0;
 
@@ -370,8 +321,167 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* One step of a critically damped PI controller with the time constant
+ * adjust_time. error is the latency minus the target, in s. Returns the
+ * new rate, which stays within MAX_RATE_DEVIATION of base_rate and
+ * MAX_RATE_STEP of current_rate. */
+static uint32_t rate_control_update(struct rate_control *c, struct userdata *u, double error, uint32_t base_rate, uint32_t current_rate) {
+    double tau, kp, ki, correction, step;
+
+    tau = (double) u->adjust_time / PA_USEC_PER_SEC;
+    kp = 1.0 / tau;
+    ki = kp * kp / 4;
+
+    /* A sink reports its latency in steps, so the error is smoothed a bit */
+    c->error += (error - c->error) * 0.3;
+
+    correction = kp * c->error + ki * c->integral;
+
+    /* Don't wind up while the rate is at its limit */
+    if (fabs(correction) < MAX_RATE_DEVIATION)
+        c->integral += c->error * CONTROL_INTERVAL_USEC / PA_USEC_PER_SEC;
+
+    /* A higher input rate takes more of the queue for each second played */
+    correction = PA_CLAMP(correction, -MAX_RATE_DEVIATION, MAX_RATE_DEVIATION);
+    step = PA_CLAMP(base_rate * (1 + correction) - current_rate, -base_rate * MAX_RATE_STEP, base_rate * MAX_RATE_STEP);
+
+    return (uint32_t) (current_rate + step + 0.5);
+}
+
+/* The groups follow the average latency of their outputs.
+ *
+ * Called from combine sink I/O thread context */
+static void adjust_group_rates(struct userdata *u, pa_usec_t target_latency) {
+    struct group *g;
+
+    PA_LLIST_FOREACH(g, u->thread_info.groups) {
+        struct output *o;
+        double error = 0;
+        unsigned n = 0;
+        uint32_t current_rate, new_rate;
+
+        if (!g->resampler)
+            continue;
+
+        PA_LLIST_FOREACH(o, u->thread_info.active_outputs) {
+            int total_latency;
+
+            if (o->group != g || (total_latency = pa_atomic_load(&o->total_latency)) < 0)
+                continue;
+
+            error += ((double) total_latency - (double) target_latency) / PA_USEC_PER_SEC;
+            n++;
+        }
+
+        if (n == 0)
+            continue;
+
+        current_rate = pa_resampler_input_sample_spec(g->resampler)->rate;
+        new_rate = rate_control_update(&g->control, u, error / n, u->sink->sample_spec.rate, current_rate);
+
+        if (new_rate != current_rate) {
+            pa_log_debug("Group of %u outputs at %u Hz: new rate is %u Hz.", g->n_outputs, g->sample_spec.rate, new_rate);
+            pa_resampler_set_input_rate(g->resampler, new_rate);
+        }
+    }
+}
+
+/* All outputs aim for the same total latency: the highest latency of
+ * their sinks, or the lowest total latency if that is higher. The
+ * average total latency is what the combined sink reports.
+ *
+ * Called from combine sink I/O thread context */
+static void update_target_latency(struct userdata *u) {
+    struct output *o;
+    pa_usec_t max_sink_latency = 0, min_total_latency = (pa_usec_t) -1, avg_total_latency = 0, target_latency, x, y;
+    unsigned n = 0;
+
+    PA_LLIST_FOREACH(o, u->thread_info.active_outputs) {
+        int total_latency, sink_latency;
+
+        if ((total_latency = pa_atomic_load(&o->total_latency)) < 0 ||
+            (sink_latency = pa_atomic_load(&o->sink_latency)) < 0)
+            continue;
+
+        max_sink_latency = PA_MAX(max_sink_latency, (pa_usec_t) sink_latency);
+        min_total_latency = PA_MIN(min_total_latency, (pa_usec_t) total_latency);
+        avg_total_latency += (pa_usec_t) total_latency;
+        n++;
+    }
+
+    if (n == 0)
+        return;
+
+    avg_total_latency /= n;
+    target_latency = PA_MAX(max_sink_latency, min_total_latency);
+
+    pa_atomic_store(&u->thread_info.target_latency, (int) target_latency);
+
+    if (u->share_resampling && u->adjust_time > 0)
+        adjust_group_rates(u, target_latency);
+
+    x = pa_rtclock_now();
+    y = pa_bytes_to_usec(u->thread_info.counter, &u->sink->sample_spec);
+
+    if (y > avg_total_latency)
+        y -= avg_total_latency;
+    else
+        y = 0;
+
+    pa_smoother_put(u->thread_info.smoother, x, y);
+}
+
+/* Renders once, converts once per group and hands the same memblocks to
+ * all outputs of a group. o wants length bytes in its own format.
+ *
+ * Called from combine sink I/O thread context */
+static void render_shared(struct userdata *u, struct output *o, size_t length) {
+    struct group *g;
+    pa_memchunk chunk;
+
+    pa_assert(o->group);
+
+    if (o->group->resampler)
+        length = pa_resampler_request(o->group->resampler, length);
+
+    pa_sink_render(u->sink, PA_MAX(length, pa_frame_size(&u->sink->sample_spec)), &chunk);
+
+    u->thread_info.counter += chunk.length;
+
+    PA_LLIST_FOREACH(g, u->thread_info.groups) {
+        struct output *j;
+        pa_memchunk rchunk;
+
+        if (g->resampler)
+            pa_resampler_run(g->resampler, &chunk, &rchunk);
+        else {
+            rchunk = chunk;
+            pa_memblock_ref(rchunk.memblock);
+        }
+
+        if (!rchunk.memblock)
+            continue;
+
+        PA_LLIST_FOREACH(j, u->thread_info.active_outputs) {
+            if (j->group != g)
+                continue;
+
+            if (j == o)
+                pa_memblockq_push_align(o->memblockq, &rchunk);
+            else
+                pa_asyncmsgq_post(j->audio_inq, PA_MSGOBJECT(j->sink_input), SINK_INPUT_MESSAGE_POST, NULL, 0, &rchunk, NULL);
+        }
+
+        pa_memblock_unref(rchunk.memblock);
+    }
+
+    pa_memblock_unref(chunk.memblock);
+}
+
 /* Called from combine sink I/O thread context */
 static void render_memblock(struct userdata *u, struct output *o, size_t length) {
+    pa_usec_t now;
+
     pa_assert(u);
     pa_assert(o);
 
@@ -383,6 +493,12 @@ static void render_memblock(struct userdata *u, struct output *o, size_t length)
     if (!pa_atomic_load(&u->thread_info.running))
         return;
 
+    now = pa_rtclock_now();
+    if (now >= u->thread_info.next_target_update) {
+        update_target_latency(u);
+        u->thread_info.next_target_update = now + CONTROL_INTERVAL_USEC;
+    }
+
     /* Maybe there's some data in the requesting output's queue
      * now? */
     while (pa_asyncmsgq_process_one(o->audio_inq) > 0)
@@ -393,6 +509,11 @@ static void render_memblock(struct userdata *u, struct output *o, size_t length)
         struct output *j;
         pa_memchunk chunk;
 
+        if (u->share_resampling) {
+            render_shared(u, o, length);
+            continue;
+        }
+
         /* Render data! */
         pa_sink_render(u->sink, length, &chunk);
 
@@ -433,13 +554,62 @@ static void request_memblock(struct output *o, size_t length) {
         pa_asyncmsgq_send(o->outq, PA_MSGOBJECT(o->userdata->sink), SINK_MESSAGE_NEED, o, (int64_t) length, NULL);
 }
 
+/* Measures the latency of the output and moves it towards the target with
+ * the rate of the resampler. With share_resampling the sink thread does
+ * that for the group.
+ *
+ * Called from I/O thread context */
+static void adjust_rate(struct output *o) {
+    struct userdata *u = o->userdata;
+    pa_sink_input *i = o->sink_input;
+    pa_usec_t sink_latency, total_latency;
+    uint32_t current_rate, new_rate;
+    int target_latency;
+
+    sink_latency = pa_sink_get_latency_within_thread(i->sink);
+    total_latency = sink_latency +
+        pa_bytes_to_usec(pa_memblockq_get_length(o->memblockq), &o->sample_spec) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+
+    pa_atomic_store(&o->sink_latency, (int) sink_latency);
+    pa_atomic_store(&o->total_latency, (int) total_latency);
+
+    if (total_latency > 10*PA_USEC_PER_SEC && !o->latency_warned) {
+        pa_log_warn("[%s] Total latency of output is very high (%0.2fms), most likely the audio timing in one of your drivers is broken.", i->sink->name, (double) total_latency / PA_USEC_PER_MSEC);
+        o->latency_warned = true;
+    }
+
+    if (u->adjust_time == 0 || u->share_resampling || (target_latency = pa_atomic_load(&u->thread_info.target_latency)) < 0)
+        return;
+
+    current_rate = i->thread_info.sample_spec.rate;
+    new_rate = rate_control_update(&o->control, u, ((double) total_latency - (double) target_latency) / PA_USEC_PER_SEC,
+                                   u->sink->sample_spec.rate, current_rate);
+
+    if (new_rate == current_rate)
+        return;
+
+    pa_log_debug("[%s] new rate is %u Hz; ratio is %0.4f; latency is %0.2f msec, target %0.2f msec.", i->sink->name, new_rate,
+                 (double) new_rate / u->sink->sample_spec.rate, (double) total_latency / PA_USEC_PER_MSEC, (double) target_latency / PA_USEC_PER_MSEC);
+
+    i->thread_info.sample_spec.rate = new_rate;
+    pa_resampler_set_input_rate(i->thread_info.resampler, new_rate);
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct output *o;
+    pa_usec_t now;
 
     pa_sink_input_assert_ref(i);
     pa_assert_se(o = i->userdata);
 
+    now = pa_rtclock_now();
+    if (now >= o->next_control) {
+        adjust_rate(o);
+        o->next_control = now + CONTROL_INTERVAL_USEC;
+    }
+
     /* If necessary, get some new data */
     request_memblock(o, nbytes);
 
@@ -553,6 +723,9 @@ static void sink_input_attach_cb(pa_sink_input *i) {
 
     pa_sink_input_request_rewind(i, 0, false, true, true);
 
+    o->next_control = 0;
+    pa_zero(o->control);
+
     nbytes = pa_sink_input_get_max_request(i);
     pa_atomic_store(&o->max_request, (int) nbytes);
     pa_log_debug("attach max request %lu", (unsigned long) nbytes);
@@ -584,6 +757,9 @@ static void sink_input_detach_cb(pa_sink_input *i) {
      * pass any further data to this output */
     pa_asyncmsgq_send(o->userdata->sink->asyncmsgq, PA_MSGOBJECT(o->userdata->sink), SINK_MESSAGE_REMOVE_OUTPUT, o, 0, NULL);
 
+    pa_atomic_store(&o->total_latency, -1);
+    pa_atomic_store(&o->sink_latency, -1);
+
     if (o->audio_inq_rtpoll_item_read) {
         pa_rtpoll_item_free(o->audio_inq_rtpoll_item_read);
         o->audio_inq_rtpoll_item_read = NULL;
@@ -675,9 +851,6 @@ static void unsuspend(struct userdata *u) {
     PA_IDXSET_FOREACH(o, u->outputs, idx)
         output_enable(o);
 
-    if (!u->time_event && u->adjust_time > 0)
-        u->time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
-
     pa_log_info("Resumed successfully...");
 }
 
@@ -779,6 +952,54 @@ static void update_latency_range(struct userdata *u) {
     pa_sink_set_latency_range_within_thread(u->sink, min_latency, max_latency);
 }
 
+/* Called from thread context of the io thread */
+static void group_add_output(struct userdata *u, struct output *o) {
+    struct group *g;
+
+    PA_LLIST_FOREACH(g, u->thread_info.groups)
+        if (pa_sample_spec_equal(&g->sample_spec, &o->sample_spec) && pa_channel_map_equal(&g->channel_map, &o->channel_map))
+            break;
+
+    if (!g) {
+        g = pa_xnew0(struct group, 1);
+        g->sample_spec = o->sample_spec;
+        g->channel_map = o->channel_map;
+
+        /* Without rate control the group may need no conversion at all */
+        if (u->adjust_time > 0 ||
+            !pa_sample_spec_equal(&g->sample_spec, &u->sink->sample_spec) ||
+            !pa_channel_map_equal(&g->channel_map, &u->sink->channel_map))
+            g->resampler = pa_resampler_new(u->core->mempool,
+                                            &u->sink->sample_spec, &u->sink->channel_map,
+                                            &g->sample_spec, &g->channel_map,
+                                            u->core->lfe_crossover_freq,
+                                            u->resample_method,
+                                            u->adjust_time > 0 ? PA_RESAMPLER_VARIABLE_RATE : 0);
+
+        PA_LLIST_PREPEND(struct group, u->thread_info.groups, g);
+    }
+
+    g->n_outputs++;
+    o->group = g;
+}
+
+/* Called from thread context of the io thread */
+static void group_remove_output(struct userdata *u, struct output *o) {
+    struct group *g = o->group;
+
+    o->group = NULL;
+
+    if (--g->n_outputs > 0)
+        return;
+
+    PA_LLIST_REMOVE(struct group, u->thread_info.groups, g);
+
+    if (g->resampler)
+        pa_resampler_free(g->resampler);
+
+    pa_xfree(g);
+}
+
 /* Called from thread context of the io thread */
 static void output_add_within_thread(struct output *o) {
     pa_assert(o);
@@ -786,6 +1007,9 @@ static void output_add_within_thread(struct output *o) {
 
     PA_LLIST_PREPEND(struct output, o->userdata->thread_info.active_outputs, o);
 
+    if (o->userdata->share_resampling)
+        group_add_output(o->userdata, o);
+
     pa_assert(!o->outq_rtpoll_item_read);
     pa_assert(!o->audio_inq_rtpoll_item_write);
     pa_assert(!o->control_inq_rtpoll_item_write);
@@ -811,6 +1035,9 @@ static void output_remove_within_thread(struct output *o) {
 
     PA_LLIST_REMOVE(struct output, o->userdata->thread_info.active_outputs, o);
 
+    if (o->group)
+        group_remove_output(o->userdata, o);
+
     if (o->outq_rtpoll_item_read) {
         pa_rtpoll_item_free(o->outq_rtpoll_item_read);
         o->outq_rtpoll_item_read = NULL;
@@ -901,21 +1128,6 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             render_memblock(u, (struct output*) data, (size_t) offset);
             return 0;
 
-        case SINK_MESSAGE_UPDATE_LATENCY: {
-            pa_usec_t x, y, latency = (pa_usec_t) offset;
-
-            x = pa_rtclock_now();
-            y = pa_bytes_to_usec(u->thread_info.counter, &u->sink->sample_spec);
-
-            if (y > latency)
-                y -= latency;
-            else
-                y = 0;
-
-            pa_smoother_put(u->thread_info.smoother, x, y);
-            return 0;
-        }
-
         case SINK_MESSAGE_UPDATE_MAX_REQUEST:
             update_max_request(u);
             break;
@@ -980,11 +1192,15 @@ static int output_create_sink_input(struct output *o) {
     data.driver = __FILE__;
     pa_proplist_setf(data.proplist, PA_PROP_MEDIA_NAME, "Simultaneous output on %s", pa_strnull(pa_proplist_gets(o->sink->proplist, PA_PROP_DEVICE_DESCRIPTION)));
     pa_proplist_sets(data.proplist, PA_PROP_MEDIA_ROLE, "filter");
-    pa_sink_input_new_data_set_sample_spec(&data, &u->sink->sample_spec);
-    pa_sink_input_new_data_set_channel_map(&data, &u->sink->channel_map);
+    pa_sink_input_new_data_set_sample_spec(&data, &o->sample_spec);
+    pa_sink_input_new_data_set_channel_map(&data, &o->channel_map);
     data.module = u->module;
     data.resample_method = u->resample_method;
-    data.flags = PA_SINK_INPUT_VARIABLE_RATE|PA_SINK_INPUT_DONT_MOVE|PA_SINK_INPUT_NO_CREATE_ON_SUSPEND;
+    data.flags = PA_SINK_INPUT_DONT_MOVE|PA_SINK_INPUT_NO_CREATE_ON_SUSPEND;
+
+    /* The group has the resampler that follows the drift */
+    if (!u->share_resampling)
+        data.flags |= PA_SINK_INPUT_VARIABLE_RATE;
 
     pa_sink_input_new(&o->sink_input, u->core, &data);
 
@@ -1012,6 +1228,7 @@ static int output_create_sink_input(struct output *o) {
 /* Called from main context */
 static struct output *output_new(struct userdata *u, pa_sink *sink) {
     struct output *o;
+    pa_memchunk silence;
 
     pa_assert(u);
     pa_assert(sink);
@@ -1023,16 +1240,30 @@ static struct output *output_new(struct userdata *u, pa_sink *sink) {
     o->control_inq = pa_asyncmsgq_new(0);
     o->outq = pa_asyncmsgq_new(0);
     o->sink = sink;
+    pa_atomic_store(&o->total_latency, -1);
+    pa_atomic_store(&o->sink_latency, -1);
+
+    /* With shared resampling the sink input gets what its sink takes */
+    if (u->share_resampling) {
+        o->sample_spec = sink->sample_spec;
+        o->channel_map = sink->channel_map;
+    } else {
+        o->sample_spec = u->sink->sample_spec;
+        o->channel_map = u->sink->channel_map;
+    }
+
+    pa_silence_memchunk_get(&u->core->silence_cache, u->core->mempool, &silence, &o->sample_spec, 0);
     o->memblockq = pa_memblockq_new(
             "module-combine-sink output memblockq",
             0,
             MEMBLOCKQ_MAXLENGTH,
             MEMBLOCKQ_MAXLENGTH,
-            &u->sink->sample_spec,
+            &o->sample_spec,
             1,
             0,
             0,
-            &u->sink->silence);
+            &silence);
+    pa_memblock_unref(silence.memblock);
 
     pa_assert_se(pa_idxset_put(u->outputs, o, NULL) == 0);
     update_description(u);
@@ -1252,7 +1483,7 @@ static pa_hook_result_t sink_state_changed_hook_cb(pa_core *c, pa_sink *s, struc
 int pa__init(pa_module*m) {
     struct userdata *u;
     pa_modargs *ma = NULL;
-    const char *slaves, *rm;
+    const char *slaves, *rm, *cpus;
     int resample_method = PA_RESAMPLER_TRIVIAL;
     pa_sample_spec ss;
     pa_channel_map map;
@@ -1283,6 +1514,7 @@ int pa__init(pa_module*m) {
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
     u->resample_method = resample_method;
     u->outputs = pa_idxset_new(NULL, NULL);
+    pa_atomic_store(&u->thread_info.target_latency, -1);
     u->thread_info.smoother = pa_smoother_new(
             PA_USEC_PER_SEC,
             PA_USEC_PER_SEC*2,
@@ -1303,6 +1535,11 @@ int pa__init(pa_module*m) {
     else
         u->adjust_time = DEFAULT_ADJUST_TIME_USEC;
 
+    if (pa_modargs_get_value_boolean(ma, "share_resampling", &u->share_resampling) < 0) {
+        pa_log("Failed to parse share_resampling value");
+        goto fail;
+    }
+
     slaves = pa_modargs_get_value(ma, "slaves", NULL);
     u->automatic = !slaves;
 
@@ -1470,15 +1707,19 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    /* There is no sound card behind this sink, so "irq" has nothing to
+     * follow */
+    cpus = pa_modargs_get_value(ma, "thread_cpus", m->core->io_thread_cpus);
+    if (cpus && !pa_streq(cpus, "none") && !pa_streq(cpus, "irq"))
+        if (pa_thread_set_affinity(u->thread, cpus) >= 0)
+            pa_proplist_sets(u->sink->proplist, PA_PROP_DEVICE_THREAD_CPUS, cpus);
+
     /* Activate the sink and the sink inputs */
     pa_sink_put(u->sink);
 
     PA_IDXSET_FOREACH(o, u->outputs, idx)
         output_verify(o);
 
-    if (u->adjust_time > 0)
-        u->time_event = pa_core_rttime_new(m->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
-
     pa_modargs_free(ma);
 
     return 0;
@@ -1531,8 +1772,6 @@ void pa__done(pa_module*m) {
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
-    if (u->time_event)
-        u->core->mainloop->time_free(u->time_event);
 
     if (u->thread_info.smoother)
         pa_smoother_free(u->thread_info.smoother);
@@ -590,47 +590,36 @@ static void update_highest_priority_device_indexes(struct userdata *u, const cha
             pa_assert_se(device_name = get_name(name, prefix));
 
             if ((e = entry_read(u, name))) {
-                for (uint32_t i = 0; i < NUM_ROLES; ++i) {
-                    if (!highest_priority_available[i] || e->priority[i] < highest_priority_available[i]) {
-                        /* We've found a device with a higher priority than that we've currently got,
-                           so see if it is currently available or not and update our list */
-                        uint32_t idx;
-                        bool found = false;
-
-                        if (sink_mode) {
-                            pa_sink *sink;
-
-                            PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
-                                if ((pa_sink*) ignore_device == sink)
-                                    continue;
-                                if (!PA_SINK_IS_LINKED(sink->state))
-                                    continue;
-                                if (pa_streq(sink->name, device_name)) {
-                                    found = true;
-                                    idx = sink->index; /* Is this needed? */
-                                    break;
-                                }
-                            }
-                        } else {
-                            pa_source *source;
-
-                            PA_IDXSET_FOREACH(source, u->core->sources, idx) {
-                                if ((pa_source*) ignore_device == source)
-                                    continue;
-                                if (!PA_SOURCE_IS_LINKED(source->state))
-                                    continue;
-                                if (pa_streq(source->name, device_name)) {
-                                    found = true;
-                                    idx = source->index; /* Is this needed? */
-                                    break;
-                                }
-                            }
-                        }
-                        if (found) {
+                uint32_t idx = PA_INVALID_INDEX;
+
+                /* Look the device up once by name, rather than scanning
+                 * all devices for every role */
+                if (sink_mode) {
+                    pa_sink *sink;
+
+                    if ((sink = pa_namereg_get(u->core, device_name, PA_NAMEREG_SINK)) &&
+                        (pa_sink*) ignore_device != sink &&
+                        PA_SINK_IS_LINKED(sink->state) &&
+                        pa_streq(sink->name, device_name))
+                        idx = sink->index;
+                } else {
+                    pa_source *source;
+
+                    if ((source = pa_namereg_get(u->core, device_name, PA_NAMEREG_SOURCE)) &&
+                        (pa_source*) ignore_device != source &&
+                        PA_SOURCE_IS_LINKED(source->state) &&
+                        pa_streq(source->name, device_name))
+                        idx = source->index;
+                }
+
+                if (idx != PA_INVALID_INDEX) {
+                    for (uint32_t i = 0; i < NUM_ROLES; ++i) {
+                        /* We've found an available device with a higher
+                         * priority than the one we've currently got */
+                        if (!highest_priority_available[i] || e->priority[i] < highest_priority_available[i]) {
                             highest_priority_available[i] = e->priority[i];
                             (*indexes)[i] = idx;
                         }
-
                     }
                 }
 
@@ -646,7 +635,9 @@ static void update_highest_priority_device_indexes(struct userdata *u, const cha
     }
 }
 
-static void route_sink_input(struct userdata *u, pa_sink_input *si) {
+/* Returns the sink the input should be moved to, or NULL if it should stay
+ * where it is */
+static pa_sink *get_route_sink(struct userdata *u, pa_sink_input *si) {
     const char *role;
     uint32_t role_index, device_index;
     pa_sink *sink;
@@ -655,17 +646,17 @@ static void route_sink_input(struct userdata *u, pa_sink_input *si) {
     pa_assert(u->do_routing);
 
     if (si->save_sink)
-        return;
+        return NULL;
 
     /* Skip this if it is already in the process of being moved anyway */
     if (!si->sink)
-        return;
+        return NULL;
 
     /* It might happen that a stream and a sink are set up at the
     same time, in which case we want to make sure we don't
     interfere with that */
     if (!PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(si)))
-        return;
+        return NULL;
 
     if (!(role = pa_proplist_gets(si->proplist, PA_PROP_MEDIA_ROLE)))
         role_index = get_role_index("none");
@@ -673,22 +664,39 @@ static void route_sink_input(struct userdata *u, pa_sink_input *si) {
         role_index = get_role_index(role);
 
     if (PA_INVALID_INDEX == role_index)
-        return;
+        return NULL;
 
     device_index = u->preferred_sinks[role_index];
     if (PA_INVALID_INDEX == device_index)
-        return;
+        return NULL;
 
     if (!(sink = pa_idxset_get_by_index(u->core->sinks, device_index)))
-        return;
+        return NULL;
 
-    if (si->sink != sink)
+    if (si->sink == sink)
+        return NULL;
+
+    return sink;
+}
+
+static void route_sink_input(struct userdata *u, pa_sink_input *si) {
+    pa_sink *sink;
+
+    if ((sink = get_route_sink(u, si)))
         pa_sink_input_move_to(si, sink, false);
 }
 
+static void free_route(pa_idxset *inputs) {
+    pa_idxset_free(inputs, (pa_free_cb_t) pa_sink_input_unref);
+}
+
 static pa_hook_result_t route_sink_inputs(struct userdata *u, pa_sink *ignore_sink) {
     pa_sink_input *si;
+    pa_sink *sink;
+    pa_hashmap *routes;
+    pa_idxset *inputs;
     uint32_t idx;
+    void *state;
 
     pa_assert(u);
 
@@ -697,10 +705,27 @@ static pa_hook_result_t route_sink_inputs(struct userdata *u, pa_sink *ignore_si
 
     update_highest_priority_device_indexes(u, "sink:", ignore_sink);
 
+    /* Collect the inputs per destination first, so that they can be moved
+     * in batches */
+    routes = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, (pa_free_cb_t) free_route);
+
     PA_IDXSET_FOREACH(si, u->core->sink_inputs, idx) {
-        route_sink_input(u, si);
+        if (!(sink = get_route_sink(u, si)))
+            continue;
+
+        if (!(inputs = pa_hashmap_get(routes, sink))) {
+            inputs = pa_idxset_new(NULL, NULL);
+            pa_hashmap_put(routes, sink, inputs);
+        }
+
+        pa_idxset_put(inputs, pa_sink_input_ref(si), NULL);
     }
 
+    PA_HASHMAP_FOREACH_KV(sink, inputs, routes, state)
+        pa_sink_input_move_all_to(inputs, sink, false);
+
+    pa_hashmap_free(routes);
+
     return PA_HOOK_OK;
 }
 
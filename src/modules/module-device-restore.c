@@ -62,7 +62,8 @@ PA_MODULE_USAGE(
         "restore_port=<Save/restore port?> "
         "restore_volume=<Save/restore volumes?> "
         "restore_muted=<Save/restore muted states?> "
-        "restore_formats=<Save/restore saved formats?>");
+        "restore_formats=<Save/restore saved formats?> "
+        "restore_watermark=<Save/restore learned timer scheduling watermarks?>");
 
 #define SAVE_INTERVAL (10 * PA_USEC_PER_SEC)
 
@@ -71,6 +72,7 @@ static const char* const valid_modargs[] = {
     "restore_muted",
     "restore_port",
     "restore_formats",
+    "restore_watermark",
     NULL
 };
 
@@ -88,6 +90,7 @@ struct userdata {
     bool restore_muted:1;
     bool restore_port:1;
     bool restore_formats:1;
+    bool restore_watermark:1;
 };
 
 /* Protocol extension commands */
@@ -100,12 +103,13 @@ enum {
     SUBCOMMAND_SAVE_FORMATS
 };
 
-#define ENTRY_VERSION 1
+#define ENTRY_VERSION 2
 
 struct entry {
     uint8_t version;
     bool port_valid;
     char *port;
+    pa_usec_t watermark; /* 0 if not known, since version 2 */
 };
 
 #define PERPORTENTRY_VERSION 1
@@ -195,6 +199,7 @@ static bool entry_write(struct userdata *u, const char *name, const struct entry
     pa_tagstruct_putu8(t, e->version);
     pa_tagstruct_put_boolean(t, e->port_valid);
     pa_tagstruct_puts(t, e->port);
+    pa_tagstruct_putu64(t, e->watermark);
 
     key.data = (char *) name;
     key.size = strlen(name);
@@ -238,6 +243,9 @@ static struct entry* entry_read(struct userdata *u, const char *name) {
         goto fail;
     }
 
+    if (e->version >= 2 && pa_tagstruct_getu64(t, &e->watermark) < 0)
+        goto fail;
+
     if (!pa_tagstruct_eof(t))
         goto fail;
 
@@ -310,6 +318,7 @@ static struct entry* entry_copy(const struct entry *e) {
     r->version = e->version;
     r->port_valid = e->port_valid;
     r->port = pa_xstrdup(e->port);
+    r->watermark = e->watermark;
 
     return r;
 }
@@ -322,6 +331,9 @@ static bool entries_equal(const struct entry *a, const struct entry *b) {
         (a->port_valid && !pa_streq(a->port, b->port)))
         return false;
 
+    if (a->watermark != b->watermark)
+        return false;
+
     return true;
 }
 
@@ -749,6 +761,80 @@ static pa_hook_result_t sink_new_hook_callback(pa_core *c, pa_sink_new_data *new
     return PA_HOOK_OK;
 }
 
+/* The devices publish the watermark their timer scheduling learned in
+ * their proplist, and pick it up from there when they are created */
+static void restore_watermark(struct userdata *u, const char *name, pa_proplist *p) {
+    struct entry *e;
+
+    if (pa_proplist_contains(p, PA_PROP_DEVICE_BUFFERING_WATERMARK))
+        return;
+
+    if (!(e = entry_read(u, name)))
+        return;
+
+    if (e->watermark > 0) {
+        pa_log_info("Restoring watermark of %0.2f ms for %s.", (double) e->watermark / PA_USEC_PER_MSEC, name);
+        pa_proplist_setf(p, PA_PROP_DEVICE_BUFFERING_WATERMARK, "%llu", (unsigned long long) e->watermark);
+    }
+
+    entry_free(e);
+}
+
+static void store_watermark(struct userdata *u, const char *name, pa_proplist *p, pa_device_type_t type, uint32_t idx) {
+    struct entry *e;
+    const char *v;
+    uint32_t watermark;
+
+    if (!(v = pa_proplist_gets(p, PA_PROP_DEVICE_BUFFERING_WATERMARK)) ||
+        pa_atou(v, &watermark) < 0 || watermark <= 0)
+        return;
+
+    if (!(e = entry_read(u, name)))
+        e = entry_new();
+
+    if (e->watermark != watermark) {
+        pa_log_info("Storing watermark for device %s.", name);
+
+        e->version = ENTRY_VERSION;
+        e->watermark = watermark;
+
+        if (entry_write(u, name, e))
+            trigger_save(u, type, idx);
+    }
+
+    entry_free(e);
+}
+
+static pa_hook_result_t sink_new_watermark_hook_callback(pa_core *c, pa_sink_new_data *new_data, struct userdata *u) {
+    char *name;
+
+    pa_assert(c);
+    pa_assert(new_data);
+    pa_assert(u);
+    pa_assert(u->restore_watermark);
+
+    name = pa_sprintf_malloc("sink:%s", new_data->name);
+    restore_watermark(u, name, new_data->proplist);
+    pa_xfree(name);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_proplist_hook_callback(pa_core *c, pa_sink *sink, struct userdata *u) {
+    char *name;
+
+    pa_assert(c);
+    pa_assert(sink);
+    pa_assert(u);
+    pa_assert(u->restore_watermark);
+
+    name = pa_sprintf_malloc("sink:%s", sink->name);
+    store_watermark(u, name, sink->proplist, PA_DEVICE_TYPE_SINK, sink->index);
+    pa_xfree(name);
+
+    return PA_HOOK_OK;
+}
+
 static pa_hook_result_t sink_fixate_hook_callback(pa_core *c, pa_sink_new_data *new_data, struct userdata *u) {
     char *name;
     struct perportentry *e;
@@ -891,6 +977,36 @@ static pa_hook_result_t source_new_hook_callback(pa_core *c, pa_source_new_data
     return PA_HOOK_OK;
 }
 
+static pa_hook_result_t source_new_watermark_hook_callback(pa_core *c, pa_source_new_data *new_data, struct userdata *u) {
+    char *name;
+
+    pa_assert(c);
+    pa_assert(new_data);
+    pa_assert(u);
+    pa_assert(u->restore_watermark);
+
+    name = pa_sprintf_malloc("source:%s", new_data->name);
+    restore_watermark(u, name, new_data->proplist);
+    pa_xfree(name);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_proplist_hook_callback(pa_core *c, pa_source *source, struct userdata *u) {
+    char *name;
+
+    pa_assert(c);
+    pa_assert(source);
+    pa_assert(u);
+    pa_assert(u->restore_watermark);
+
+    name = pa_sprintf_malloc("source:%s", source->name);
+    store_watermark(u, name, source->proplist, PA_DEVICE_TYPE_SOURCE, source->index);
+    pa_xfree(name);
+
+    return PA_HOOK_OK;
+}
+
 static pa_hook_result_t source_fixate_hook_callback(pa_core *c, pa_source_new_data *new_data, struct userdata *u) {
     char *name;
     struct perportentry *e;
@@ -1201,7 +1317,7 @@ int pa__init(pa_module*m) {
     pa_sink *sink;
     pa_source *source;
     uint32_t idx;
-    bool restore_volume = true, restore_muted = true, restore_port = true, restore_formats = true;
+    bool restore_volume = true, restore_muted = true, restore_port = true, restore_formats = true, restore_watermark = true;
 
     pa_assert(m);
 
@@ -1213,8 +1329,9 @@ int pa__init(pa_module*m) {
     if (pa_modargs_get_value_boolean(ma, "restore_volume", &restore_volume) < 0 ||
         pa_modargs_get_value_boolean(ma, "restore_muted", &restore_muted) < 0 ||
         pa_modargs_get_value_boolean(ma, "restore_port", &restore_port) < 0 ||
-        pa_modargs_get_value_boolean(ma, "restore_formats", &restore_formats) < 0) {
-        pa_log("restore_port, restore_volume, restore_muted and restore_formats expect boolean arguments");
+        pa_modargs_get_value_boolean(ma, "restore_formats", &restore_formats) < 0 ||
+        pa_modargs_get_value_boolean(ma, "restore_watermark", &restore_watermark) < 0) {
+        pa_log("restore_port, restore_volume, restore_muted, restore_formats and restore_watermark expect boolean arguments");
         goto fail;
     }
 
@@ -1228,6 +1345,7 @@ int pa__init(pa_module*m) {
     u->restore_muted = restore_muted;
     u->restore_port = restore_port;
     u->restore_formats = restore_formats;
+    u->restore_watermark = restore_watermark;
 
     u->subscribed = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
@@ -1254,6 +1372,14 @@ int pa__init(pa_module*m) {
     if (restore_formats)
         pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) sink_put_hook_callback, u);
 
+    if (restore_watermark) {
+        pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_NEW], PA_HOOK_EARLY, (pa_hook_cb_t) sink_new_watermark_hook_callback, u);
+        pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SOURCE_NEW], PA_HOOK_EARLY, (pa_hook_cb_t) source_new_watermark_hook_callback, u);
+
+        pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_PROPLIST_CHANGED], PA_HOOK_NORMAL, (pa_hook_cb_t) sink_proplist_hook_callback, u);
+        pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SOURCE_PROPLIST_CHANGED], PA_HOOK_NORMAL, (pa_hook_cb_t) source_proplist_hook_callback, u);
+    }
+
     if (!(fname = pa_state_path("device-volumes", true)))
         goto fail;
 
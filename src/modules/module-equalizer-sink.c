@@ -48,6 +48,7 @@
 
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/i18n.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/aupdate.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sink.h>
@@ -63,6 +64,7 @@
 #include <pulsecore/database.h>
 #include <pulsecore/protocol-dbus.h>
 #include <pulsecore/dbus-util.h>
+#include <pulsecore/filter/convolver.h>
 
 #include "module-equalizer-sink-symdef.h"
 
@@ -80,11 +82,16 @@ PA_MODULE_USAGE(
           "channel_map=<channel map> "
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
+          "low_latency=<yes or no> "
          ));
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 #define DEFAULT_AUTOLOADED false
 
+/* In low latency mode, the first taps of the filter are applied directly,
+ * the rest in partitions that grow from this size on */
+#define CONVOLVER_BLOCK 64
+
 struct userdata {
     pa_module *module;
     pa_sink *sink;
@@ -127,6 +134,23 @@ struct userdata {
 
     pa_database *database;
     char **base_profiles;
+
+    /* Low latency mode convolves with a minimum phase filter of each
+     * channel's response instead of going through the STFT. The main
+     * thread works out the filter whenever the response changes, and
+     * bumps ir_version so that the IO thread loads it. */
+    bool low_latency;
+    size_t ir_length;
+    pa_convolver **convolvers;
+    float ***irs;
+    pa_aupdate **a_ir;
+    pa_atomic_t *ir_version;
+    int *ir_loaded;
+    float *mp_buffer;
+    fftwf_complex *mp_spectrum;
+    fftwf_plan mp_forward_plan, mp_inverse_plan;
+    float *scratch_in, *scratch_out;
+    size_t scratch_frames;
 };
 
 static const char* const valid_modargs[] = {
@@ -139,6 +163,7 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "autoloaded",
     "use_volume_sharing",
+    "low_latency",
     NULL
 };
 
@@ -237,6 +262,70 @@ static void alloc_input_buffers(struct userdata *u, size_t min_buffer_length) {
     u->input_buffer_max = min_buffer_length;
 }
 
+/* Works out the minimum phase filter with the magnitude response of the
+ * given channel, from its real cepstrum. Called from main context. */
+static void update_response(struct userdata *u, size_t channel) {
+    const size_t N = u->fft_size;
+    unsigned a_i;
+    float *ir;
+    float X;
+    size_t k;
+
+    a_i = pa_aupdate_read_begin(u->a_H[channel]);
+    X = u->Xs[channel][a_i];
+    /* The stored response has the FFT gain divided out */
+    for (k = 0; k < FILTER_SIZE(u); ++k) {
+        u->mp_spectrum[k][0] = logf(PA_MAX(X * u->Hs[channel][a_i][k] * N, 1e-6f));
+        u->mp_spectrum[k][1] = 0;
+    }
+    pa_aupdate_read_end(u->a_H[channel]);
+
+    fftwf_execute_dft_c2r(u->mp_inverse_plan, u->mp_spectrum, u->mp_buffer);
+
+    /* Fold the anti-causal part of the cepstrum over */
+    for (k = 1; k < N / 2; ++k)
+        u->mp_buffer[k] *= 2;
+    for (k = N / 2 + 1; k < N; ++k)
+        u->mp_buffer[k] = 0;
+    for (k = 0; k <= N / 2; ++k)
+        u->mp_buffer[k] /= N;
+
+    fftwf_execute_dft_r2c(u->mp_forward_plan, u->mp_buffer, u->mp_spectrum);
+
+    for (k = 0; k < FILTER_SIZE(u); ++k) {
+        float m = expf(u->mp_spectrum[k][0]), p = u->mp_spectrum[k][1];
+
+        u->mp_spectrum[k][0] = m * cosf(p);
+        u->mp_spectrum[k][1] = m * sinf(p);
+    }
+
+    fftwf_execute_dft_c2r(u->mp_inverse_plan, u->mp_spectrum, u->mp_buffer);
+
+    a_i = pa_aupdate_write_begin(u->a_ir[channel]);
+    ir = u->irs[channel][a_i];
+
+    /* Truncate, fading out over the last quarter */
+    for (k = 0; k < u->ir_length; ++k) {
+        float w = 1.0f;
+
+        if (k >= u->ir_length * 3 / 4)
+            w = 0.5f * (1 + cosf(M_PI * (k - u->ir_length * 3 / 4) / (u->ir_length / 4)));
+
+        ir[k] = u->mp_buffer[k] / N * w;
+    }
+
+    pa_aupdate_write_end(u->a_ir[channel]);
+    pa_atomic_inc(&u->ir_version[channel]);
+}
+
+/* Ends a write of a channel's response. Called from main context. */
+static void filter_write_end(struct userdata *u, size_t channel) {
+    pa_aupdate_write_end(u->a_H[channel]);
+
+    if (u->low_latency)
+        update_response(u, channel);
+}
+
 /* Called from I/O thread context */
 static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SINK(o)->userdata;
@@ -586,6 +675,68 @@ static void input_buffer(struct userdata *u, pa_memchunk *in) {
     pa_memblock_release(in->memblock);
 }
 
+/* Called from I/O thread context */
+static int low_latency_pop(struct userdata *u, size_t nbytes, pa_memchunk *chunk) {
+    size_t fs, n;
+    float *src, *dst;
+    pa_memchunk tchunk;
+
+    fs = pa_frame_size(&u->sink->sample_spec);
+
+    /* Hmm, process any rewind request that might be queued up */
+    pa_sink_process_rewind(u->sink, 0);
+
+    while (pa_memblockq_peek(u->input_q, &tchunk) < 0) {
+        pa_memchunk nchunk;
+
+        pa_sink_render(u->sink, nbytes, &nchunk);
+        pa_memblockq_push(u->input_q, &nchunk);
+        pa_memblock_unref(nchunk.memblock);
+    }
+
+    tchunk.length = PA_MIN(nbytes, tchunk.length);
+    n = tchunk.length / fs;
+    pa_assert(n > 0);
+
+    pa_memblockq_drop(u->input_q, n * fs);
+
+    if (n > u->scratch_frames) {
+        pa_xfree(u->scratch_in);
+        pa_xfree(u->scratch_out);
+        u->scratch_in = pa_xnew(float, n);
+        u->scratch_out = pa_xnew(float, n);
+        u->scratch_frames = n;
+    }
+
+    chunk->index = 0;
+    chunk->length = n * fs;
+    chunk->memblock = pa_memblock_new(u->sink->core->mempool, chunk->length);
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+
+    for (size_t c = 0; c < u->channels; c++) {
+        int v = pa_atomic_load(&u->ir_version[c]);
+
+        if (v != u->ir_loaded[c]) {
+            unsigned a_i = pa_aupdate_read_begin(u->a_ir[c]);
+            pa_convolver_set_response(u->convolvers[c], 0, 0, u->irs[c][a_i], 1);
+            pa_aupdate_read_end(u->a_ir[c]);
+            u->ir_loaded[c] = v;
+        }
+
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->scratch_in, sizeof(float), src + c, fs, n);
+        pa_convolver_process(u->convolvers[c], u->scratch_in, u->scratch_out, n);
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + c, fs, u->scratch_out, sizeof(float), n);
+    }
+
+    pa_memblock_release(chunk->memblock);
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_unref(tchunk.memblock);
+
+    return 0;
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
@@ -599,6 +750,9 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     pa_assert(chunk);
     pa_assert(u->sink);
 
+    if (u->low_latency)
+        return low_latency_pop(u, nbytes, chunk);
+
     /* FIXME: Please clean this up. I see more commented code lines
      * than uncommented code lines. I am sorry, but I am too dumb to
      * understand this. */
@@ -738,6 +892,10 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
             pa_memblockq_seek(u->input_q, - (int64_t) amount, PA_SEEK_RELATIVE, true);
             pa_log("Resetting filter");
             //reset_filter(u); //this is the "proper" thing to do...
+
+            if (u->low_latency)
+                for (size_t c = 0; c < u->channels; c++)
+                    pa_convolver_reset(u->convolvers[c]);
         }
     }
 
@@ -767,7 +925,7 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
     pa_assert_se(u = i->userdata);
 
     fs = pa_frame_size(&u->sink_input->sample_spec);
-    pa_sink_set_max_request_within_thread(u->sink, PA_ROUND_UP(nbytes / fs, u->R) * fs);
+    pa_sink_set_max_request_within_thread(u->sink, u->low_latency ? nbytes : PA_ROUND_UP(nbytes / fs, u->R) * fs);
 }
 
 /* Called from I/O thread context */
@@ -816,8 +974,11 @@ static void sink_input_attach_cb(pa_sink_input *i) {
 
     fs = pa_frame_size(&u->sink_input->sample_spec);
     /* set buffer size to max request, no overlap copy */
-    max_request = PA_ROUND_UP(pa_sink_input_get_max_request(u->sink_input) / fs, u->R);
-    max_request = PA_MAX(max_request, u->window_size);
+    max_request = pa_sink_input_get_max_request(u->sink_input) / fs;
+    if (!u->low_latency) {
+        max_request = PA_ROUND_UP(max_request, u->R);
+        max_request = PA_MAX(max_request, u->window_size);
+    }
 
     pa_sink_set_max_request_within_thread(u->sink, max_request * fs);
 
@@ -991,7 +1152,7 @@ static const char* load_profile(struct userdata *u, size_t channel, char *name)
             u->Xs[channel][a_i] = profile[0];
             memcpy(u->Hs[channel][a_i], profile + 1, FILTER_SIZE(u) * sizeof(float));
             fix_filter(u->Hs[channel][a_i], u->fft_size);
-            pa_aupdate_write_end(u->a_H[channel]);
+            filter_write_end(u, channel);
             pa_xfree(u->base_profiles[channel]);
             u->base_profiles[channel] = pa_xstrdup(name);
         }else{
@@ -1031,7 +1192,7 @@ static void load_state(struct userdata *u) {
                 H = state + c * CHANNEL_PROFILE_SIZE(u) + 1;
                 u->Xs[c][a_i] = state[c * CHANNEL_PROFILE_SIZE(u)];
                 memcpy(u->Hs[c][a_i], H, FILTER_SIZE(u) * sizeof(float));
-                pa_aupdate_write_end(u->a_H[c]);
+                filter_write_end(u, c);
             }
             unpack(((char *)value.data) + FILTER_STATE_SIZE(u) * sizeof(float), value.size - FILTER_STATE_SIZE(u) * sizeof(float), &names, &n_profs);
             n_profs = PA_MIN(n_profs, u->channels);
@@ -1092,6 +1253,7 @@ int pa__init(pa_module*m) {
     float *H;
     unsigned a_i;
     bool use_volume_sharing = true;
+    bool low_latency = false;
 
     pa_assert(m);
 
@@ -1124,9 +1286,15 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "low_latency", &low_latency) < 0) {
+        pa_log("low_latency= expects a boolean argument");
+        goto fail;
+    }
+
     u = pa_xnew0(struct userdata, 1);
     u->module = m;
     m->userdata = u;
+    u->low_latency = low_latency;
 
     u->channels = ss.channels;
     u->fft_size = pow(2, ceil(log(ss.rate) / log(2)));//probably unstable near corner cases of powers of 2
@@ -1166,6 +1334,29 @@ int pa__init(pa_module*m) {
     hanning_window(u->W, u->window_size);
     u->first_iteration = true;
 
+    if (u->low_latency) {
+        u->ir_length = u->fft_size / 2;
+        u->convolvers = pa_xnew0(pa_convolver *, u->channels);
+        u->irs = pa_xnew0(float **, u->channels);
+        u->a_ir = pa_xnew0(pa_aupdate *, u->channels);
+        u->ir_version = pa_xnew0(pa_atomic_t, u->channels);
+        u->ir_loaded = pa_xnew0(int, u->channels);
+
+        for (c = 0; c < u->channels; ++c) {
+            u->convolvers[c] = pa_convolver_new(1, 1, u->ir_length, CONVOLVER_BLOCK);
+            u->irs[c] = pa_xnew0(float *, 2);
+            for (i = 0; i < 2; ++i)
+                u->irs[c][i] = pa_xnew0(float, u->ir_length);
+            u->a_ir[c] = pa_aupdate_new();
+            pa_atomic_store(&u->ir_version[c], 0);
+        }
+
+        u->mp_buffer = alloc(u->fft_size, sizeof(float));
+        u->mp_spectrum = alloc(FILTER_SIZE(u), sizeof(fftwf_complex));
+        u->mp_forward_plan = fftwf_plan_dft_r2c_1d(u->fft_size, u->mp_buffer, u->mp_spectrum, FFTW_ESTIMATE);
+        u->mp_inverse_plan = fftwf_plan_dft_c2r_1d(u->fft_size, u->mp_spectrum, u->mp_buffer, FFTW_ESTIMATE);
+    }
+
     u->base_profiles = pa_xnew0(char *, u->channels);
     for (c = 0; c < u->channels; ++c)
         u->base_profiles[c] = pa_xstrdup("default");
@@ -1274,7 +1465,7 @@ int pa__init(pa_module*m) {
             H[i] = 1.0 / sqrtf(2.0f);
 
         fix_filter(H, u->fft_size);
-        pa_aupdate_write_end(u->a_H[c]);
+        filter_write_end(u, c);
     }
 
     /* load old parameters */
@@ -1363,6 +1554,30 @@ void pa__done(pa_module*m) {
     pa_xfree(u->Xs);
     pa_xfree(u->Hs);
 
+    if (u->convolvers) {
+        for (c = 0; c < u->channels; ++c) {
+            pa_convolver_free(u->convolvers[c]);
+            pa_xfree(u->irs[c][0]);
+            pa_xfree(u->irs[c][1]);
+            pa_xfree(u->irs[c]);
+            pa_aupdate_free(u->a_ir[c]);
+        }
+
+        fftwf_destroy_plan(u->mp_inverse_plan);
+        fftwf_destroy_plan(u->mp_forward_plan);
+        fftwf_free(u->mp_spectrum);
+        fftwf_free(u->mp_buffer);
+
+        pa_xfree(u->convolvers);
+        pa_xfree(u->irs);
+        pa_xfree(u->a_ir);
+        pa_xfree(u->ir_version);
+        pa_xfree(u->ir_loaded);
+    }
+
+    pa_xfree(u->scratch_in);
+    pa_xfree(u->scratch_out);
+
     pa_xfree(u);
 }
 
@@ -1852,10 +2067,10 @@ void equalizer_handle_seed_filter(DBusConnection *conn, DBusMessage *msg, void *
             float *H_p = u->Hs[c][b_i];
             u->Xs[c][b_i] = preamp;
             memcpy(H_p, H, FILTER_SIZE(u) * sizeof(float));
-            pa_aupdate_write_end(u->a_H[c]);
+            filter_write_end(u, c);
         }
     }
-    pa_aupdate_write_end(u->a_H[r_channel]);
+    filter_write_end(u, r_channel);
     pa_xfree(ys);
 
     pa_dbus_send_empty_reply(conn, msg);
@@ -2002,10 +2217,10 @@ static void set_filter(struct userdata *u, size_t channel, double *H_, double pr
             unsigned b_i = pa_aupdate_write_begin(u->a_H[c]);
             u->Xs[c][b_i] = u->Xs[r_channel][a_i];
             memcpy(u->Hs[c][b_i], u->Hs[r_channel][a_i], FILTER_SIZE(u) * sizeof(float));
-            pa_aupdate_write_end(u->a_H[c]);
+            filter_write_end(u, c);
         }
     }
-    pa_aupdate_write_end(u->a_H[r_channel]);
+    filter_write_end(u, r_channel);
 }
 
 void equalizer_handle_set_filter(DBusConnection *conn, DBusMessage *msg, void *_u) {
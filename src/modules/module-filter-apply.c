@@ -65,6 +65,9 @@ struct filter {
 struct userdata {
     pa_core *core;
     pa_hashmap *filters;
+    /* stream object -> what the stream asked for when it was last
+     * processed, see get_stream_state() */
+    pa_hashmap *streams;
     bool autoclean;
     pa_time_event *housekeeping_time_event;
 };
@@ -152,6 +155,23 @@ static char* get_group(pa_object *o, bool is_sink_input) {
     return pa_proplist_get_stream_group(pl, pa_proplist_gets(pl, PA_PROP_FILTER_APPLY), NULL);
 }
 
+/* The properties that decide what process() does with a stream: the
+ * filter it wants and, for grouped filters, its group. NULL if it wants
+ * none. */
+static char *get_stream_state(pa_object *o, bool is_sink_input) {
+    const char *want;
+    char *group, *state;
+
+    if (!(want = should_filter(o, is_sink_input)))
+        return NULL;
+
+    group = get_group(o, is_sink_input);
+    state = pa_sprintf_malloc("%s\n%s", want, pa_strempty(group));
+    pa_xfree(group);
+
+    return state;
+}
+
 /* For filters that apply on a source-output/sink-input pair, this finds the
  * master sink if we know the master source, or vice versa. It does this by
  * looking up streams that belong to the same stream group as the original
@@ -399,6 +419,15 @@ static bool can_unload_module(struct userdata *u, uint32_t idx) {
     return true;
 }
 
+static void remember_stream(struct userdata *u, pa_object *o, bool is_sink_input) {
+    char *state;
+
+    pa_hashmap_remove_and_free(u->streams, o);
+
+    if ((state = get_stream_state(o, is_sink_input)))
+        pa_hashmap_put(u->streams, o, state);
+}
+
 static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_input) {
     const char *want;
     bool done_something = false;
@@ -422,6 +451,10 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
     if ((is_sink_input && !sink) || (!is_sink_input && !source))
         return PA_HOOK_OK;
 
+    /* Only remembered once the stream got where it wants to be, so that a
+     * property change retries whatever failed */
+    pa_hashmap_remove_and_free(u->streams, o);
+
     /* If the stream doesn't what any filter, then let it be. */
     if ((want = should_filter(o, is_sink_input))) {
         char *module_name;
@@ -437,6 +470,7 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
         if (pa_streq(module->name, module_name)) {
             pa_log_debug("Stream appears to be playing on an appropriate sink already. Ignoring.");
             pa_xfree(module_name);
+            remember_stream(u, o, is_sink_input);
             return PA_HOOK_OK;
         }
 
@@ -444,6 +478,8 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
 
         if (should_group_filter(fltr) && !find_paired_master(u, fltr, o, is_sink_input)) {
             pa_log_debug("Want group filtering but don't have enough streams.");
+            filter_free(fltr);
+            pa_xfree(module_name);
             return PA_HOOK_OK;
         }
 
@@ -497,12 +533,30 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
         }
     }
 
+    remember_stream(u, o, is_sink_input);
+
     if (done_something)
         trigger_housekeeping(u);
 
     return PA_HOOK_OK;
 }
 
+/* Streams change their properties all the time, mostly ones that don't
+ * concern us */
+static pa_hook_result_t process_changed(struct userdata *u, pa_object *o, bool is_sink_input) {
+    char *state;
+    bool changed;
+
+    state = get_stream_state(o, is_sink_input);
+    changed = !pa_safe_streq(state, pa_hashmap_get(u->streams, o));
+    pa_xfree(state);
+
+    if (!changed)
+        return PA_HOOK_OK;
+
+    return process(u, o, is_sink_input);
+}
+
 static pa_hook_result_t sink_input_put_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
     pa_core_assert_ref(core);
     pa_sink_input_assert_ref(i);
@@ -524,7 +578,7 @@ static pa_hook_result_t sink_input_proplist_cb(pa_core *core, pa_sink_input *i,
     pa_core_assert_ref(core);
     pa_sink_input_assert_ref(i);
 
-    return process(u, PA_OBJECT(i), true);
+    return process_changed(u, PA_OBJECT(i), true);
 }
 
 static pa_hook_result_t sink_input_unlink_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
@@ -533,6 +587,8 @@ static pa_hook_result_t sink_input_unlink_cb(pa_core *core, pa_sink_input *i, st
 
     pa_assert(u);
 
+    pa_hashmap_remove_and_free(u->streams, i);
+
     if (pa_hashmap_size(u->filters) > 0)
         trigger_housekeeping(u);
 
@@ -596,7 +652,7 @@ static pa_hook_result_t source_output_proplist_cb(pa_core *core, pa_source_outpu
     pa_core_assert_ref(core);
     pa_source_output_assert_ref(o);
 
-    return process(u, PA_OBJECT(o), false);
+    return process_changed(u, PA_OBJECT(o), false);
 }
 
 static pa_hook_result_t source_output_unlink_cb(pa_core *core, pa_source_output *o, struct userdata *u) {
@@ -605,6 +661,8 @@ static pa_hook_result_t source_output_unlink_cb(pa_core *core, pa_source_output
 
     pa_assert(u);
 
+    pa_hashmap_remove_and_free(u->streams, o);
+
     if (pa_hashmap_size(u->filters) > 0)
         trigger_housekeeping(u);
 
@@ -669,6 +727,7 @@ int pa__init(pa_module *m) {
     }
 
     u->filters = pa_hashmap_new(filter_hash, filter_compare);
+    u->streams = pa_hashmap_new_full(NULL, NULL, NULL, pa_xfree);
 
     pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_put_cb, u);
     pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_finish_cb, u);
@@ -716,5 +775,8 @@ void pa__done(pa_module *m) {
         pa_hashmap_free(u->filters);
     }
 
+    if (u->streams)
+        pa_hashmap_free(u->streams);
+
     pa_xfree(u);
 }
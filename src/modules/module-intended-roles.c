@@ -67,6 +67,22 @@ static bool role_match(pa_proplist *proplist, const char *role) {
     return pa_str_in_list_spaces(pa_proplist_gets(proplist, PA_PROP_DEVICE_INTENDED_ROLES), role);
 }
 
+/* Devices may take only so many streams, e.g. a hardware PCM backed by a
+ * few DSP slots. If they are all in use, further streams are left to the
+ * default device, where they are mixed in software. */
+static bool has_room(pa_proplist *proplist, unsigned n_streams) {
+    const char *t;
+    uint32_t max;
+
+    if (!(t = pa_proplist_gets(proplist, "module-intended-roles.max-streams")))
+        return true;
+
+    if (pa_atou(t, &max) < 0)
+        return true;
+
+    return n_streams < max;
+}
+
 static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_new_data *new_data, struct userdata *u) {
     const char *role;
     pa_sink *s, *def;
@@ -93,7 +109,7 @@ static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_n
 
     /* Prefer the default sink over any other sink, just in case... */
     if ((def = pa_namereg_get_default_sink(c)))
-        if (role_match(def->proplist, role) && pa_sink_input_new_data_set_sink(new_data, def, false))
+        if (role_match(def->proplist, role) && has_room(def->proplist, pa_idxset_size(def->inputs)) && pa_sink_input_new_data_set_sink(new_data, def, false))
             return PA_HOOK_OK;
 
     /* @todo: favour the highest priority device, not the first one we find? */
@@ -104,7 +120,7 @@ static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_n
         if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)))
             continue;
 
-        if (role_match(s->proplist, role) && pa_sink_input_new_data_set_sink(new_data, s, false))
+        if (role_match(s->proplist, role) && has_room(s->proplist, pa_idxset_size(s->inputs)) && pa_sink_input_new_data_set_sink(new_data, s, false))
             return PA_HOOK_OK;
     }
 
@@ -137,7 +153,7 @@ static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_ou
 
     /* Prefer the default source over any other source, just in case... */
     if ((def = pa_namereg_get_default_source(c)))
-        if (role_match(def->proplist, role)) {
+        if (role_match(def->proplist, role) && has_room(def->proplist, pa_idxset_size(def->outputs))) {
             pa_source_output_new_data_set_source(new_data, def, false);
             return PA_HOOK_OK;
         }
@@ -153,7 +169,7 @@ static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_ou
             continue;
 
         /* @todo: favour the highest priority device, not the first one we find? */
-        if (role_match(s->proplist, role)) {
+        if (role_match(s->proplist, role) && has_room(s->proplist, pa_idxset_size(s->outputs))) {
             pa_source_output_new_data_set_source(new_data, s, false);
             return PA_HOOK_OK;
         }
@@ -200,6 +216,9 @@ static pa_hook_result_t sink_put_hook_callback(pa_core *c, pa_sink *sink, struct
         if (!role_match(sink->proplist, role))
             continue;
 
+        if (!has_room(sink->proplist, pa_idxset_size(sink->inputs)))
+            break;
+
         pa_sink_input_move_to(si, sink, false);
     }
 
@@ -250,6 +269,9 @@ static pa_hook_result_t source_put_hook_callback(pa_core *c, pa_source *source,
         if (!role_match(source->proplist, role))
             continue;
 
+        if (!has_room(source->proplist, pa_idxset_size(source->outputs)))
+            break;
+
         pa_source_output_move_to(so, source, false);
     }
 
@@ -286,7 +308,7 @@ static pa_hook_result_t sink_unlink_hook_callback(pa_core *c, pa_sink *sink, str
             continue;
 
         /* Would the default sink fit? If so, let's use it */
-        if (def != sink && role_match(def->proplist, role))
+        if (def != sink && role_match(def->proplist, role) && has_room(def->proplist, pa_idxset_size(def->inputs)))
             if (pa_sink_input_move_to(si, def, false) >= 0)
                 continue;
 
@@ -299,7 +321,7 @@ static pa_hook_result_t sink_unlink_hook_callback(pa_core *c, pa_sink *sink, str
             if (!PA_SINK_IS_LINKED(pa_sink_get_state(d)))
                 continue;
 
-            if (role_match(d->proplist, role))
+            if (role_match(d->proplist, role) && has_room(d->proplist, pa_idxset_size(d->inputs)))
                 if (pa_sink_input_move_to(si, d, false) >= 0)
                     break;
         }
@@ -341,7 +363,7 @@ static pa_hook_result_t source_unlink_hook_callback(pa_core *c, pa_source *sourc
             continue;
 
         /* Would the default source fit? If so, let's use it */
-        if (def != source && role_match(def->proplist, role) && !source->monitor_of == !def->monitor_of) {
+        if (def != source && role_match(def->proplist, role) && !source->monitor_of == !def->monitor_of && has_room(def->proplist, pa_idxset_size(def->outputs))) {
             pa_source_output_move_to(so, def, false);
             continue;
         }
@@ -356,7 +378,7 @@ static pa_hook_result_t source_unlink_hook_callback(pa_core *c, pa_source *sourc
                 continue;
 
             /* If moving from a monitor, move to another monitor */
-            if (!source->monitor_of == !d->monitor_of && role_match(d->proplist, role)) {
+            if (!source->monitor_of == !d->monitor_of && role_match(d->proplist, role) && has_room(d->proplist, pa_idxset_size(d->outputs))) {
                 pa_source_output_move_to(so, d, false);
                 break;
             }
@@ -393,6 +415,8 @@ int pa__init(pa_module*m) {
     /* A little bit later than module-stream-restore */
     u->sink_input_new_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_NEW], PA_HOOK_EARLY+10, (pa_hook_cb_t) sink_input_new_hook_callback, u);
     u->source_output_new_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_NEW], PA_HOOK_EARLY+10, (pa_hook_cb_t) source_output_new_hook_callback, u);
+    pa_hook_slot_set_property_filter(u->sink_input_new_hook_slot, PA_PROP_MEDIA_ROLE);
+    pa_hook_slot_set_property_filter(u->source_output_new_hook_slot, PA_PROP_MEDIA_ROLE);
 
     if (on_hotplug) {
         /* A little bit later than module-stream-restore */
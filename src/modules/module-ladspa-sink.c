@@ -20,6 +20,11 @@
 /* TODO: Some plugins cause latency, and some even report it by using a control
    out port. We don't currently use the latency information. */
 
+/* Several plugins can be chained within one sink by separating the values of
+   the plugin, label, control and port map arguments with '|'. The instances
+   of one channel group run all stages in a row on the same port buffers, so
+   the audio is deinterleaved only once for the whole chain. */
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -38,6 +43,7 @@
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/ltdl-helper.h>
+#include <pulsecore/workpool.h>
 
 #ifdef HAVE_DBUS
 #include <pulsecore/protocol-dbus.h>
@@ -59,27 +65,44 @@ PA_MODULE_USAGE(
       "rate=<sample rate> "
       "channels=<number of channels> "
       "channel_map=<input channel map> "
-      "plugin=<ladspa plugin name> "
-      "label=<ladspa plugin label> "
-      "control=<comma separated list of input control values> "
-      "input_ladspaport_map=<comma separated list of input LADSPA port names> "
-      "output_ladspaport_map=<comma separated list of output LADSPA port names> "));
+      "plugin=<ladspa plugin name, '|' separated for a chain> "
+      "label=<ladspa plugin label, '|' separated for a chain> "
+      "control=<comma separated list of input control values, '|' separated for a chain> "
+      "input_ladspaport_map=<comma separated list of input LADSPA port names, '|' separated for a chain> "
+      "output_ladspaport_map=<comma separated list of output LADSPA port names, '|' separated for a chain> "));
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+#define STAGE_SEPARATOR "|"
+
 /* PLEASE NOTICE: The PortAudio ports and the LADSPA ports are two different concepts.
 They are not related and where possible the names of the LADSPA port variables contains "ladspa" to avoid confusion */
 
+/* One plugin of the chain */
+struct stage {
+    lt_dlhandle dl;
+    const LADSPA_Descriptor *descriptor;
+    LADSPA_Handle handle[PA_CHANNELS_MAX];
+    unsigned long max_ladspaport_count, input_count, output_count;
+    unsigned long input_ladspaport[PA_CHANNELS_MAX], output_ladspaport[PA_CHANNELS_MAX];
+    /* Every plugin instance has its own buffers, so that the instances
+     * can run in parallel. The inputs of a stage are the outputs of the
+     * stage before it, the outputs are the inputs again for plugins that
+     * can work in place. */
+    LADSPA_Data **input[PA_CHANNELS_MAX], **output[PA_CHANNELS_MAX];
+    /* The control ports of the stage, within the ones of the userdata */
+    long unsigned n_control;
+};
+
 struct userdata {
     pa_module *module;
 
     pa_sink *sink;
     pa_sink_input *sink_input;
 
-    const LADSPA_Descriptor *descriptor;
-    LADSPA_Handle handle[PA_CHANNELS_MAX];
-    unsigned long max_ladspaport_count, input_count, output_count, channels;
-    LADSPA_Data **input, **output;
+    struct stage *stages;
+    unsigned n_stages;
+    unsigned long max_ladspaport_count, channels, n_instances;
     size_t block_size;
     LADSPA_Data *control;
     long unsigned n_control;
@@ -90,6 +113,12 @@ struct userdata {
 
     pa_memblockq *memblockq;
 
+    /* The instances are run as jobs of the DSP worker pool; these
+     * describe the block being processed */
+    pa_workpool *workpool;
+    float *run_src, *run_dst;
+    unsigned run_frames;
+
     bool *use_default;
     pa_sample_spec ss;
 
@@ -435,12 +464,28 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
+/* Called from I/O thread or DSP worker context */
+static void run_instance(void *userdata, unsigned h) {
+    struct userdata *u = userdata;
+    struct stage *first = &u->stages[0], *last = &u->stages[u->n_stages - 1];
+    unsigned c, k;
+
+    for (c = 0; c < first->input_count; c++)
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, first->input[h][c], sizeof(float), u->run_src + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->run_frames);
+
+    /* Every stage finds its input in the port buffers of the one before */
+    for (k = 0; k < u->n_stages; k++)
+        u->stages[k].descriptor->run(u->stages[k].handle[h], u->run_frames);
+
+    for (c = 0; c < last->output_count; c++)
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->run_dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), last->output[h][c], sizeof(float), u->run_frames);
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
-    float *src, *dst;
     size_t fs;
-    unsigned n, h, c;
+    unsigned n;
     pa_memchunk tchunk;
 
     pa_sink_input_assert_ref(i);
@@ -472,16 +517,11 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     pa_memblockq_drop(u->memblockq, chunk->length);
 
-    src = pa_memblock_acquire_chunk(&tchunk);
-    dst = pa_memblock_acquire(chunk->memblock);
+    u->run_src = pa_memblock_acquire_chunk(&tchunk);
+    u->run_dst = pa_memblock_acquire(chunk->memblock);
+    u->run_frames = n;
 
-    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
-        for (c = 0; c < u->input_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c], sizeof(float), src+ h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
-        u->descriptor->run(u->handle[h], n);
-        for (c = 0; c < u->output_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
-    }
+    pa_workpool_run(u->workpool, (unsigned) u->n_instances, run_instance, u);
 
     pa_memblock_release(tchunk.memblock);
     pa_memblock_release(chunk->memblock);
@@ -507,19 +547,23 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
         u->sink->thread_info.rewind_nbytes = 0;
 
         if (amount > 0) {
-            unsigned c;
+            unsigned c, k;
 
             pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, true);
 
             pa_log_debug("Resetting plugin");
 
-            /* Reset the plugin */
-            if (u->descriptor->deactivate)
-                for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                    u->descriptor->deactivate(u->handle[c]);
-            if (u->descriptor->activate)
-                for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                    u->descriptor->activate(u->handle[c]);
+            /* Reset the plugins */
+            for (k = 0; k < u->n_stages; k++) {
+                const LADSPA_Descriptor *d = u->stages[k].descriptor;
+
+                if (d->deactivate)
+                    for (c = 0; c < u->n_instances; c++)
+                        d->deactivate(u->stages[k].handle[c]);
+                if (d->activate)
+                    for (c = 0; c < u->n_instances; c++)
+                        d->activate(u->stages[k].handle[c]);
+            }
         }
     }
 
@@ -676,23 +720,22 @@ static void sink_input_mute_changed_cb(pa_sink_input *i) {
     pa_sink_mute_changed(u->sink, i->muted);
 }
 
-static int parse_control_parameters(struct userdata *u, const char *cdata, double *read_values, bool *use_default) {
+static int parse_control_parameters(unsigned long n_control, const char *cdata, double *read_values, bool *use_default) {
     unsigned long p = 0;
     const char *state = NULL;
     char *k;
 
     pa_assert(read_values);
     pa_assert(use_default);
-    pa_assert(u);
 
-    pa_log_debug("Trying to read %lu control values", u->n_control);
+    pa_log_debug("Trying to read %lu control values", n_control);
 
-    if (!cdata && u->n_control > 0)
+    if (!cdata && n_control > 0)
         return -1;
 
     pa_log_debug("cdata: '%s'", cdata);
 
-    while ((k = pa_split(cdata, ",", &state)) && p < u->n_control) {
+    while ((k = pa_split(cdata, ",", &state)) && p < n_control) {
         double f;
 
         if (*k == 0) {
@@ -719,19 +762,19 @@ static int parse_control_parameters(struct userdata *u, const char *cdata, doubl
     /* The previous loop doesn't take the last control value into account
        if it is left empty, so we do it here. */
     if (*cdata == 0 || cdata[strlen(cdata) - 1] == ',') {
-        if (p < u->n_control)
+        if (p < n_control)
             use_default[p] = true;
         p++;
     }
 
-    if (p > u->n_control || k) {
-        pa_log("Too many control values passed, %lu expected.", u->n_control);
+    if (p > n_control || k) {
+        pa_log("Too many control values passed, %lu expected.", n_control);
         pa_xfree(k);
         goto fail;
     }
 
-    if (p < u->n_control) {
-        pa_log("Not enough control values passed, %lu expected, %lu passed.", u->n_control, p);
+    if (p < n_control) {
+        pa_log("Not enough control values passed, %lu expected, %lu passed.", n_control, p);
         goto fail;
     }
 
@@ -743,90 +786,103 @@ fail:
 
 static void connect_control_ports(struct userdata *u) {
     unsigned long p = 0, h = 0, c;
-    const LADSPA_Descriptor *d;
+    unsigned k;
 
     pa_assert(u);
-    pa_assert_se(d = u->descriptor);
 
-    for (p = 0; p < d->PortCount; p++) {
-        if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
-            continue;
+    /* h runs over the control ports of all stages */
+    for (k = 0; k < u->n_stages; k++) {
+        struct stage *st = &u->stages[k];
+        const LADSPA_Descriptor *d;
 
-        if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
-            for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                d->connect_port(u->handle[c], p, &u->control_out);
-            continue;
-        }
+        pa_assert_se(d = st->descriptor);
+
+        for (p = 0; p < d->PortCount; p++) {
+            if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
+                continue;
+
+            if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
+                for (c = 0; c < u->n_instances; c++)
+                    d->connect_port(st->handle[c], p, &u->control_out);
+                continue;
+            }
 
-        /* input control port */
+            /* input control port */
 
-        pa_log_debug("Binding %f to port %s", u->control[h], d->PortNames[p]);
+            pa_log_debug("Binding %f to port %s", u->control[h], d->PortNames[p]);
 
-        for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-            d->connect_port(u->handle[c], p, &u->control[h]);
+            for (c = 0; c < u->n_instances; c++)
+                d->connect_port(st->handle[c], p, &u->control[h]);
 
-        h++;
+            h++;
+        }
     }
 }
 
 static int validate_control_parameters(struct userdata *u, double *control_values, bool *use_default) {
     unsigned long p = 0, h = 0;
-    const LADSPA_Descriptor *d;
+    unsigned k;
     pa_sample_spec ss;
 
     pa_assert(control_values);
     pa_assert(use_default);
     pa_assert(u);
-    pa_assert_se(d = u->descriptor);
 
     ss = u->ss;
 
-    /* Iterate over all ports. Check for every control port that 1) it
-     * supports default values if a default value is provided and 2) the
-     * provided value is within the limits specified in the plugin. */
+    /* Iterate over all ports of all stages. Check for every control port
+     * that 1) it supports default values if a default value is provided
+     * and 2) the provided value is within the limits specified in the
+     * plugin. */
 
-    for (p = 0; p < d->PortCount; p++) {
-        LADSPA_PortRangeHintDescriptor hint = d->PortRangeHints[p].HintDescriptor;
+    for (k = 0; k < u->n_stages; k++) {
+        const LADSPA_Descriptor *d;
 
-        if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
-            continue;
+        pa_assert_se(d = u->stages[k].descriptor);
 
-        if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p]))
-            continue;
+        for (p = 0; p < d->PortCount; p++) {
+            LADSPA_PortRangeHintDescriptor hint = d->PortRangeHints[p].HintDescriptor;
 
-        if (use_default[h]) {
-            /* User wants to use default value. Check if the plugin
-             * provides it. */
-            if (!LADSPA_IS_HINT_HAS_DEFAULT(hint)) {
-                pa_log_warn("Control port value left empty but plugin defines no default.");
-                return -1;
-            }
-        }
-        else {
-            /* Check if the user-provided value is within the bounds. */
-            LADSPA_Data lower = d->PortRangeHints[p].LowerBound;
-            LADSPA_Data upper = d->PortRangeHints[p].UpperBound;
-
-            if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
-                upper *= (LADSPA_Data) ss.rate;
-                lower *= (LADSPA_Data) ss.rate;
-            }
+            if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
+                continue;
 
-            if (LADSPA_IS_HINT_BOUNDED_ABOVE(hint)) {
-                if (control_values[h] > upper) {
-                    pa_log_warn("Control value %lu over upper bound: %f (upper bound: %f)", h, control_values[h], upper);
+            if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p]))
+                continue;
+
+            if (use_default[h]) {
+                /* User wants to use default value. Check if the plugin
+                 * provides it. */
+                if (!LADSPA_IS_HINT_HAS_DEFAULT(hint)) {
+                    pa_log_warn("Control port value left empty but plugin defines no default.");
                     return -1;
                 }
             }
-            if (LADSPA_IS_HINT_BOUNDED_BELOW(hint)) {
-                if (control_values[h] < lower) {
-                    pa_log_warn("Control value %lu below lower bound: %f (lower bound: %f)", h, control_values[h], lower);
-                    return -1;
+            else {
+                /* Check if the user-provided value is within the bounds. */
+                LADSPA_Data lower = d->PortRangeHints[p].LowerBound;
+                LADSPA_Data upper = d->PortRangeHints[p].UpperBound;
+
+                if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
+                    upper *= (LADSPA_Data) ss.rate;
+                    lower *= (LADSPA_Data) ss.rate;
+                }
+
+                if (LADSPA_IS_HINT_BOUNDED_ABOVE(hint)) {
+                    if (control_values[h] > upper) {
+                        pa_log_warn("Control value %lu over upper bound: %f (upper bound: %f)", h, control_values[h], upper);
+                        return -1;
+                    }
+                }
+                if (LADSPA_IS_HINT_BOUNDED_BELOW(hint)) {
+                    if (control_values[h] < lower) {
+                        pa_log_warn("Control value %lu below lower bound: %f (lower bound: %f)", h, control_values[h], lower);
+                        return -1;
+                    }
                 }
             }
-        }
 
-        h++;
+            h++;
+        }
     }
 
     return 0;
@@ -834,106 +890,112 @@ static int validate_control_parameters(struct userdata *u, double *control_value
 
 static int write_control_parameters(struct userdata *u, double *control_values, bool *use_default) {
     unsigned long p = 0, h = 0, c;
-    const LADSPA_Descriptor *d;
+    unsigned k;
     pa_sample_spec ss;
 
     pa_assert(control_values);
     pa_assert(use_default);
     pa_assert(u);
-    pa_assert_se(d = u->descriptor);
 
     ss = u->ss;
 
     if (validate_control_parameters(u, control_values, use_default) < 0)
         return -1;
 
-    /* p iterates over all ports, h is the control port iterator */
-
-    for (p = 0; p < d->PortCount; p++) {
-        LADSPA_PortRangeHintDescriptor hint = d->PortRangeHints[p].HintDescriptor;
-
-        if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
-            continue;
+    /* p iterates over all ports of a stage, h is the control port iterator
+     * over all stages */
 
-        if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
-            for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-                d->connect_port(u->handle[c], p, &u->control_out);
-            continue;
-        }
+    for (k = 0; k < u->n_stages; k++) {
+        const LADSPA_Descriptor *d;
 
-        if (use_default[h]) {
+        pa_assert_se(d = u->stages[k].descriptor);
 
-            LADSPA_Data lower, upper;
+        for (p = 0; p < d->PortCount; p++) {
+            LADSPA_PortRangeHintDescriptor hint = d->PortRangeHints[p].HintDescriptor;
 
-            lower = d->PortRangeHints[p].LowerBound;
-            upper = d->PortRangeHints[p].UpperBound;
+            if (!LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]))
+                continue;
 
-            if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
-                lower *= (LADSPA_Data) ss.rate;
-                upper *= (LADSPA_Data) ss.rate;
+            if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
+                for (c = 0; c < u->n_instances; c++)
+                    d->connect_port(u->stages[k].handle[c], p, &u->control_out);
+                continue;
             }
 
-            switch (hint & LADSPA_HINT_DEFAULT_MASK) {
-
-            case LADSPA_HINT_DEFAULT_MINIMUM:
-                u->control[h] = lower;
-                break;
-
-            case LADSPA_HINT_DEFAULT_MAXIMUM:
-                u->control[h] = upper;
-                break;
-
-            case LADSPA_HINT_DEFAULT_LOW:
-                if (LADSPA_IS_HINT_LOGARITHMIC(hint))
-                    u->control[h] = (LADSPA_Data) exp(log(lower) * 0.75 + log(upper) * 0.25);
-                else
-                    u->control[h] = (LADSPA_Data) (lower * 0.75 + upper * 0.25);
-                break;
-
-            case LADSPA_HINT_DEFAULT_MIDDLE:
-                if (LADSPA_IS_HINT_LOGARITHMIC(hint))
-                    u->control[h] = (LADSPA_Data) exp(log(lower) * 0.5 + log(upper) * 0.5);
-                else
-                    u->control[h] = (LADSPA_Data) (lower * 0.5 + upper * 0.5);
-                break;
-
-            case LADSPA_HINT_DEFAULT_HIGH:
-                if (LADSPA_IS_HINT_LOGARITHMIC(hint))
-                    u->control[h] = (LADSPA_Data) exp(log(lower) * 0.25 + log(upper) * 0.75);
-                else
-                    u->control[h] = (LADSPA_Data) (lower * 0.25 + upper * 0.75);
-                break;
-
-            case LADSPA_HINT_DEFAULT_0:
-                u->control[h] = 0;
-                break;
+            if (use_default[h]) {
 
-            case LADSPA_HINT_DEFAULT_1:
-                u->control[h] = 1;
-                break;
+                LADSPA_Data lower, upper;
 
-            case LADSPA_HINT_DEFAULT_100:
-                u->control[h] = 100;
-                break;
+                lower = d->PortRangeHints[p].LowerBound;
+                upper = d->PortRangeHints[p].UpperBound;
 
-            case LADSPA_HINT_DEFAULT_440:
-                u->control[h] = 440;
-                break;
+                if (LADSPA_IS_HINT_SAMPLE_RATE(hint)) {
+                    lower *= (LADSPA_Data) ss.rate;
+                    upper *= (LADSPA_Data) ss.rate;
+                }
 
-            default:
-                pa_assert_not_reached();
-            }
-        }
-        else {
-            if (LADSPA_IS_HINT_INTEGER(hint)) {
-                u->control[h] = roundf(control_values[h]);
+                switch (hint & LADSPA_HINT_DEFAULT_MASK) {
+
+                case LADSPA_HINT_DEFAULT_MINIMUM:
+                    u->control[h] = lower;
+                    break;
+
+                case LADSPA_HINT_DEFAULT_MAXIMUM:
+                    u->control[h] = upper;
+                    break;
+
+                case LADSPA_HINT_DEFAULT_LOW:
+                    if (LADSPA_IS_HINT_LOGARITHMIC(hint))
+                        u->control[h] = (LADSPA_Data) exp(log(lower) * 0.75 + log(upper) * 0.25);
+                    else
+                        u->control[h] = (LADSPA_Data) (lower * 0.75 + upper * 0.25);
+                    break;
+
+                case LADSPA_HINT_DEFAULT_MIDDLE:
+                    if (LADSPA_IS_HINT_LOGARITHMIC(hint))
+                        u->control[h] = (LADSPA_Data) exp(log(lower) * 0.5 + log(upper) * 0.5);
+                    else
+                        u->control[h] = (LADSPA_Data) (lower * 0.5 + upper * 0.5);
+                    break;
+
+                case LADSPA_HINT_DEFAULT_HIGH:
+                    if (LADSPA_IS_HINT_LOGARITHMIC(hint))
+                        u->control[h] = (LADSPA_Data) exp(log(lower) * 0.25 + log(upper) * 0.75);
+                    else
+                        u->control[h] = (LADSPA_Data) (lower * 0.25 + upper * 0.75);
+                    break;
+
+                case LADSPA_HINT_DEFAULT_0:
+                    u->control[h] = 0;
+                    break;
+
+                case LADSPA_HINT_DEFAULT_1:
+                    u->control[h] = 1;
+                    break;
+
+                case LADSPA_HINT_DEFAULT_100:
+                    u->control[h] = 100;
+                    break;
+
+                case LADSPA_HINT_DEFAULT_440:
+                    u->control[h] = 440;
+                    break;
+
+                default:
+                    pa_assert_not_reached();
+                }
             }
             else {
-                u->control[h] = control_values[h];
+                if (LADSPA_IS_HINT_INTEGER(hint)) {
+                    u->control[h] = roundf(control_values[h]);
+                }
+                else {
+                    u->control[h] = control_values[h];
+                }
             }
-        }
 
-        h++;
+            h++;
+        }
     }
 
     /* set the use_default array to the user data */
@@ -942,71 +1004,39 @@ static int write_control_parameters(struct userdata *u, double *control_values,
     return 0;
 }
 
-int pa__init(pa_module*m) {
-    struct userdata *u;
-    pa_sample_spec ss;
-    pa_channel_map map;
-    pa_modargs *ma;
-    char *t;
-    pa_sink *master;
-    pa_sink_input_new_data sink_input_data;
-    pa_sink_new_data sink_data;
-    const char *plugin, *label, *input_ladspaport_map, *output_ladspaport_map;
-    LADSPA_Descriptor_Function descriptor_func;
-    unsigned long input_ladspaport[PA_CHANNELS_MAX], output_ladspaport[PA_CHANNELS_MAX];
-    const char *e, *cdata;
-    const LADSPA_Descriptor *d;
-    unsigned long p, h, j, n_control, c;
-    pa_memchunk silence;
-
-    pa_assert(m);
+/* Splits a module argument into one value per stage of the chain */
+static int split_stage_values(const char *v, char **values, unsigned n_stages) {
+    unsigned k;
 
-    pa_assert_cc(sizeof(LADSPA_Data) == sizeof(float));
+    pa_assert(values);
+    pa_assert(n_stages > 0);
 
-    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
-        pa_log("Failed to parse module arguments.");
-        goto fail;
-    }
+    if (!v)
+        return 0;
 
-    if (!(master = pa_namereg_get(m->core, pa_modargs_get_value(ma, "master", NULL), PA_NAMEREG_SINK))) {
-        pa_log("Master sink not found");
-        goto fail;
-    }
+    for (k = 0; k < n_stages; k++) {
+        size_t l = strcspn(v, STAGE_SEPARATOR);
 
-    ss = master->sample_spec;
-    ss.format = PA_SAMPLE_FLOAT32;
-    map = master->channel_map;
-    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
-        pa_log("Invalid sample format specification or channel map");
-        goto fail;
-    }
+        values[k] = pa_xstrndup(v, l);
+        v += l;
 
-    if (!(plugin = pa_modargs_get_value(ma, "plugin", NULL))) {
-        pa_log("Missing LADSPA plugin name");
-        goto fail;
-    }
+        if (!*v)
+            break;
 
-    if (!(label = pa_modargs_get_value(ma, "label", NULL))) {
-        pa_log("Missing LADSPA plugin label");
-        goto fail;
+        v++;
     }
 
-    if (!(input_ladspaport_map = pa_modargs_get_value(ma, "input_ladspaport_map", NULL)))
-        pa_log_debug("Using default input ladspa port mapping");
-
-    if (!(output_ladspaport_map = pa_modargs_get_value(ma, "output_ladspaport_map", NULL)))
-        pa_log_debug("Using default output ladspa port mapping");
-
-    cdata = pa_modargs_get_value(ma, "control", NULL);
+    return k == n_stages - 1 && !*v ? 0 : -1;
+}
 
-    u = pa_xnew0(struct userdata, 1);
-    u->module = m;
-    m->userdata = u;
-    u->max_ladspaport_count = 1; /*to avoid division by zero etc. in pa__done when failing before this value has been set*/
-    u->channels = 0;
-    u->input = NULL;
-    u->output = NULL;
-    u->ss = ss;
+/* Loads the plugin of a stage and finds its audio ports */
+static int load_stage(struct userdata *u, struct stage *st, const char *plugin, const char *label,
+                      const char *input_ladspaport_map, const char *output_ladspaport_map, unsigned long *n_control) {
+    LADSPA_Descriptor_Function descriptor_func;
+    const LADSPA_Descriptor *d;
+    const char *e;
+    unsigned long p, j, c;
+    char *t;
 
     if (!(e = getenv("LADSPA_PATH")))
         e = LADSPA_PATH;
@@ -1014,32 +1044,32 @@ int pa__init(pa_module*m) {
     /* FIXME: This is not exactly thread safe */
     t = pa_xstrdup(lt_dlgetsearchpath());
     lt_dlsetsearchpath(e);
-    m->dl = lt_dlopenext(plugin);
+    st->dl = lt_dlopenext(plugin);
     lt_dlsetsearchpath(t);
     pa_xfree(t);
 
-    if (!m->dl) {
+    if (!st->dl) {
         pa_log("Failed to load LADSPA plugin: %s", lt_dlerror());
-        goto fail;
+        return -1;
     }
 
-    if (!(descriptor_func = (LADSPA_Descriptor_Function) pa_load_sym(m->dl, NULL, "ladspa_descriptor"))) {
+    if (!(descriptor_func = (LADSPA_Descriptor_Function) pa_load_sym(st->dl, NULL, "ladspa_descriptor"))) {
         pa_log("LADSPA module lacks ladspa_descriptor() symbol.");
-        goto fail;
+        return -1;
     }
 
     for (j = 0;; j++) {
 
         if (!(d = descriptor_func(j))) {
             pa_log("Failed to find plugin label '%s' in plugin '%s'.", label, plugin);
-            goto fail;
+            return -1;
         }
 
         if (pa_streq(d->Label, label))
             break;
     }
 
-    u->descriptor = d;
+    st->descriptor = d;
 
     pa_log_debug("Module: %s", plugin);
     pa_log_debug("Label: %s", d->Label);
@@ -1048,8 +1078,8 @@ int pa__init(pa_module*m) {
     pa_log_debug("Maker: %s", d->Maker);
     pa_log_debug("Copyright: %s", d->Copyright);
 
-    n_control = 0;
-    u->channels = ss.channels;
+    *n_control = 0;
+    st->max_ladspaport_count = 1;
 
     /*
     * Enumerate ladspa ports
@@ -1059,123 +1089,278 @@ int pa__init(pa_module*m) {
         if (LADSPA_IS_PORT_AUDIO(d->PortDescriptors[p])) {
             if (LADSPA_IS_PORT_INPUT(d->PortDescriptors[p])) {
                 pa_log_debug("Port %lu is input: %s", p, d->PortNames[p]);
-                input_ladspaport[u->input_count] = p;
-                u->input_count++;
+                st->input_ladspaport[st->input_count] = p;
+                st->input_count++;
             } else if (LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
                 pa_log_debug("Port %lu is output: %s", p, d->PortNames[p]);
-                output_ladspaport[u->output_count] = p;
-                u->output_count++;
+                st->output_ladspaport[st->output_count] = p;
+                st->output_count++;
             }
         } else if (LADSPA_IS_PORT_CONTROL(d->PortDescriptors[p]) && LADSPA_IS_PORT_INPUT(d->PortDescriptors[p])) {
             pa_log_debug("Port %lu is control: %s", p, d->PortNames[p]);
-            n_control++;
+            (*n_control)++;
         } else
             pa_log_debug("Ignored port %s", d->PortNames[p]);
         /* XXX: Has anyone ever seen an in-place plugin with non-equal number of input and output ports? */
         /* Could be if the plugin is for up-mixing stereo to 5.1 channels */
         /* Or if the plugin is down-mixing 5.1 to two channel stereo or binaural encoded signal */
-        if (u->input_count > u->max_ladspaport_count)
-            u->max_ladspaport_count = u->input_count;
+        if (st->input_count > st->max_ladspaport_count)
+            st->max_ladspaport_count = st->input_count;
         else
-            u->max_ladspaport_count = u->output_count;
+            st->max_ladspaport_count = st->output_count;
     }
 
-    if (u->channels % u->max_ladspaport_count) {
+    if (u->channels % st->max_ladspaport_count) {
         pa_log("Cannot handle non-integral number of plugins required for given number of channels");
-        goto fail;
+        return -1;
     }
 
-    pa_log_debug("Will run %lu plugin instances", u->channels / u->max_ladspaport_count);
-
     /* Parse data for input ladspa port map */
-    if (input_ladspaport_map) {
+    if (input_ladspaport_map && *input_ladspaport_map) {
         const char *state = NULL;
         char *pname;
         c = 0;
         while ((pname = pa_split(input_ladspaport_map, ",", &state))) {
-            if (c == u->input_count) {
+            if (c == st->input_count) {
                 pa_log("Too many ports in input ladspa port map");
                 pa_xfree(pname);
-                goto fail;
+                return -1;
             }
 
             for (p = 0; p < d->PortCount; p++) {
                 if (pa_streq(d->PortNames[p], pname)) {
                     if (LADSPA_IS_PORT_AUDIO(d->PortDescriptors[p]) && LADSPA_IS_PORT_INPUT(d->PortDescriptors[p])) {
-                        input_ladspaport[c] = p;
+                        st->input_ladspaport[c] = p;
                     } else {
                         pa_log("Port %s is not an audio input ladspa port", pname);
                         pa_xfree(pname);
-                        goto fail;
+                        return -1;
                     }
                 }
             }
             c++;
             pa_xfree(pname);
         }
-    }
+    } else
+        pa_log_debug("Using default input ladspa port mapping");
 
     /* Parse data for output port map */
-    if (output_ladspaport_map) {
+    if (output_ladspaport_map && *output_ladspaport_map) {
         const char *state = NULL;
         char *pname;
         c = 0;
         while ((pname = pa_split(output_ladspaport_map, ",", &state))) {
-            if (c == u->output_count) {
+            if (c == st->output_count) {
                 pa_log("Too many ports in output ladspa port map");
                 pa_xfree(pname);
-                goto fail;
+                return -1;
             }
             for (p = 0; p < d->PortCount; p++) {
                 if (pa_streq(d->PortNames[p], pname)) {
                     if (LADSPA_IS_PORT_AUDIO(d->PortDescriptors[p]) && LADSPA_IS_PORT_OUTPUT(d->PortDescriptors[p])) {
-                        output_ladspaport[c] = p;
+                        st->output_ladspaport[c] = p;
                     } else {
                         pa_log("Port %s is not an output ladspa port", pname);
                         pa_xfree(pname);
-                        goto fail;
+                        return -1;
                     }
                 }
             }
             c++;
             pa_xfree(pname);
         }
+    } else
+        pa_log_debug("Using default output ladspa port mapping");
+
+    return 0;
+}
+
+static LADSPA_Data **new_port_buffers(struct userdata *u, unsigned long n) {
+    LADSPA_Data **b;
+    unsigned long c;
+
+    b = pa_xnew(LADSPA_Data*, (unsigned) PA_MAX(n, 1u));
+    for (c = 0; c < n; c++)
+        b[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
+
+    return b;
+}
+
+static void free_port_buffers(LADSPA_Data **b, unsigned long n) {
+    unsigned long c;
+
+    for (c = 0; c < n; c++)
+        pa_xfree(b[c]);
+    pa_xfree(b);
+}
+
+/* Instantiates the plugin of a stage for every channel group and connects
+ * it to its port buffers. All buffers are allocated here, nothing is
+ * allocated while the sink runs. */
+static int instantiate_stage(struct userdata *u, struct stage *st, struct stage *prev) {
+    const LADSPA_Descriptor *d = st->descriptor;
+    unsigned long h, c;
+
+    for (h = 0; h < u->n_instances; h++) {
+        /* The first stage is filled from the sink input, the others
+         * read what the stage before them wrote */
+        if (prev)
+            st->input[h] = prev->output[h];
+        else
+            st->input[h] = new_port_buffers(u, st->input_count);
+
+        if (!LADSPA_IS_INPLACE_BROKEN(d->Properties) && st->output_count <= st->input_count)
+            st->output[h] = st->input[h];
+        else
+            st->output[h] = new_port_buffers(u, st->output_count);
+
+        if (!(st->handle[h] = d->instantiate(d, u->ss.rate))) {
+            pa_log("Failed to instantiate plugin with label %s", d->Label);
+            return -1;
+        }
+
+        for (c = 0; c < st->input_count; c++)
+            d->connect_port(st->handle[h], st->input_ladspaport[c], st->input[h][c]);
+        for (c = 0; c < st->output_count; c++)
+            d->connect_port(st->handle[h], st->output_ladspaport[c], st->output[h][c]);
     }
 
-    u->block_size = pa_frame_align(pa_mempool_block_size_max(m->core->mempool), &ss);
+    return 0;
+}
+
+static void free_stage_values(char **values, unsigned n_stages) {
+    unsigned k;
+
+    if (!values)
+        return;
+
+    for (k = 0; k < n_stages; k++)
+        pa_xfree(values[k]);
+    pa_xfree(values);
+}
+
+static void append_stage_property(pa_proplist *p, const char *key, const char *value) {
+    const char *old;
+
+    if ((old = pa_proplist_gets(p, key)))
+        pa_proplist_setf(p, key, "%s" STAGE_SEPARATOR "%s", old, value);
+    else
+        pa_proplist_sets(p, key, value);
+}
+
+int pa__init(pa_module*m) {
+    struct userdata *u;
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_modargs *ma;
+    pa_sink *master;
+    pa_sink_input_new_data sink_input_data;
+    pa_sink_new_data sink_data;
+    const char *plugin_arg, *label_arg, *z;
+    char **plugin = NULL, **label = NULL, **cdata = NULL, **input_ladspaport_map = NULL, **output_ladspaport_map = NULL;
+    unsigned long c;
+    unsigned k, n_stages = 0;
+    pa_memchunk silence;
+
+    pa_assert(m);
+
+    pa_assert_cc(sizeof(LADSPA_Data) == sizeof(float));
 
-    /* Create buffers */
-    if (LADSPA_IS_INPLACE_BROKEN(d->Properties)) {
-        u->input = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->input_count);
-        for (c = 0; c < u->input_count; c++)
-            u->input[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-        u->output = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->output_count);
-        for (c = 0; c < u->output_count; c++)
-            u->output[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-    } else {
-        u->input = (LADSPA_Data**) pa_xnew(LADSPA_Data*, (unsigned) u->max_ladspaport_count);
-        for (c = 0; c < u->max_ladspaport_count; c++)
-            u->input[c] = (LADSPA_Data*) pa_xnew(uint8_t, (unsigned) u->block_size);
-        u->output = u->input;
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    if (!(master = pa_namereg_get(m->core, pa_modargs_get_value(ma, "master", NULL), PA_NAMEREG_SINK))) {
+        pa_log("Master sink not found");
+        goto fail;
+    }
+
+    ss = master->sample_spec;
+    ss.format = PA_SAMPLE_FLOAT32;
+    map = master->channel_map;
+    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
+        pa_log("Invalid sample format specification or channel map");
+        goto fail;
     }
-    /* Initialize plugin instances */
-    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
-        if (!(u->handle[h] = d->instantiate(d, ss.rate))) {
-            pa_log("Failed to instantiate plugin %s with label %s", plugin, d->Label);
+
+    if (!(plugin_arg = pa_modargs_get_value(ma, "plugin", NULL))) {
+        pa_log("Missing LADSPA plugin name");
+        goto fail;
+    }
+
+    if (!(label_arg = pa_modargs_get_value(ma, "label", NULL))) {
+        pa_log("Missing LADSPA plugin label");
+        goto fail;
+    }
+
+    for (n_stages = 1, z = plugin_arg; (z = strchr(z, STAGE_SEPARATOR[0])); z++)
+        n_stages++;
+
+    plugin = pa_xnew0(char*, n_stages);
+    label = pa_xnew0(char*, n_stages);
+    cdata = pa_xnew0(char*, n_stages);
+    input_ladspaport_map = pa_xnew0(char*, n_stages);
+    output_ladspaport_map = pa_xnew0(char*, n_stages);
+
+    if (split_stage_values(plugin_arg, plugin, n_stages) < 0 ||
+        split_stage_values(label_arg, label, n_stages) < 0 ||
+        split_stage_values(pa_modargs_get_value(ma, "control", NULL), cdata, n_stages) < 0 ||
+        split_stage_values(pa_modargs_get_value(ma, "input_ladspaport_map", NULL), input_ladspaport_map, n_stages) < 0 ||
+        split_stage_values(pa_modargs_get_value(ma, "output_ladspaport_map", NULL), output_ladspaport_map, n_stages) < 0) {
+        pa_log("The plugin, label, control and port map arguments need a value for each of the %u plugins", n_stages);
+        goto fail;
+    }
+
+    u = pa_xnew0(struct userdata, 1);
+    u->module = m;
+    m->userdata = u;
+    u->channels = ss.channels;
+    u->ss = ss;
+    u->stages = pa_xnew0(struct stage, n_stages);
+    u->n_stages = n_stages;
+
+    u->n_control = 0;
+    for (k = 0; k < n_stages; k++) {
+        struct stage *st = &u->stages[k];
+
+        if (load_stage(u, st, plugin[k], label[k], input_ladspaport_map[k], output_ladspaport_map[k], &st->n_control) < 0)
+            goto fail;
+
+        /* Each channel group runs through the whole chain on its own */
+        if (k > 0 && st->max_ladspaport_count != u->stages[0].max_ladspaport_count) {
+            pa_log("Plugin %s handles %lu channels per instance, but the chain started with %lu",
+                   label[k], st->max_ladspaport_count, u->stages[0].max_ladspaport_count);
+            goto fail;
+        }
+
+        if (k > 0 && st->input_count != u->stages[k - 1].output_count) {
+            pa_log("Plugin %s has %lu audio inputs, but the plugin before it has %lu outputs",
+                   label[k], st->input_count, u->stages[k - 1].output_count);
             goto fail;
         }
 
-        for (c = 0; c < u->input_count; c++)
-            d->connect_port(u->handle[h], input_ladspaport[c], u->input[c]);
-        for (c = 0; c < u->output_count; c++)
-            d->connect_port(u->handle[h], output_ladspaport[c], u->output[c]);
+        u->n_control += st->n_control;
     }
 
-    u->n_control = n_control;
+    u->max_ladspaport_count = u->stages[0].max_ladspaport_count;
+    u->n_instances = u->channels / u->max_ladspaport_count;
+
+    pa_log_debug("Will run %lu plugin instances of %u plugins", u->n_instances, n_stages);
+
+    u->block_size = pa_frame_align(pa_mempool_block_size_max(m->core->mempool), &ss);
+
+    /* Initialize plugin instances and create their buffers */
+    for (k = 0; k < n_stages; k++)
+        if (instantiate_stage(u, &u->stages[k], k > 0 ? &u->stages[k - 1] : NULL) < 0)
+            goto fail;
+
+    u->workpool = pa_core_get_workpool(m->core);
 
     if (u->n_control > 0) {
         double *control_values;
         bool *use_default;
+        unsigned long h = 0;
 
         /* temporary storage for parser */
         control_values = pa_xnew(double, (unsigned) u->n_control);
@@ -1185,8 +1370,15 @@ int pa__init(pa_module*m) {
         u->control = pa_xnew(LADSPA_Data, (unsigned) u->n_control);
         u->use_default = pa_xnew(bool, (unsigned) u->n_control);
 
-        if ((parse_control_parameters(u, cdata, control_values, use_default) < 0) ||
-            (write_control_parameters(u, control_values, use_default) < 0)) {
+        for (k = 0; k < n_stages; k++) {
+            if (u->stages[k].n_control > 0 &&
+                parse_control_parameters(u->stages[k].n_control, cdata[k], control_values + h, use_default + h) < 0)
+                break;
+
+            h += u->stages[k].n_control;
+        }
+
+        if (k < n_stages || write_control_parameters(u, control_values, use_default) < 0) {
             pa_xfree(control_values);
             pa_xfree(use_default);
 
@@ -1199,9 +1391,10 @@ int pa__init(pa_module*m) {
         pa_xfree(use_default);
     }
 
-    if (d->activate)
-        for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
-            d->activate(u->handle[c]);
+    for (k = 0; k < n_stages; k++)
+        if (u->stages[k].descriptor->activate)
+            for (c = 0; c < u->n_instances; c++)
+                u->stages[k].descriptor->activate(u->stages[k].handle[c]);
 
     /* Create sink */
     pa_sink_new_data_init(&sink_data);
@@ -1213,12 +1406,20 @@ int pa__init(pa_module*m) {
     pa_sink_new_data_set_channel_map(&sink_data, &map);
     pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_MASTER_DEVICE, master->name);
     pa_proplist_sets(sink_data.proplist, PA_PROP_DEVICE_CLASS, "filter");
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.module", plugin);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.label", d->Label);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.name", d->Name);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.maker", d->Maker);
-    pa_proplist_sets(sink_data.proplist, "device.ladspa.copyright", d->Copyright);
-    pa_proplist_setf(sink_data.proplist, "device.ladspa.unique_id", "%lu", (unsigned long) d->UniqueID);
+    for (k = 0; k < n_stages; k++) {
+        const LADSPA_Descriptor *d = u->stages[k].descriptor;
+        char id[32];
+
+        pa_snprintf(id, sizeof(id), "%lu", (unsigned long) d->UniqueID);
+
+        /* A chain lists its plugins in the same properties */
+        append_stage_property(sink_data.proplist, "device.ladspa.module", plugin[k]);
+        append_stage_property(sink_data.proplist, "device.ladspa.label", d->Label);
+        append_stage_property(sink_data.proplist, "device.ladspa.name", d->Name);
+        append_stage_property(sink_data.proplist, "device.ladspa.maker", d->Maker);
+        append_stage_property(sink_data.proplist, "device.ladspa.copyright", d->Copyright);
+        append_stage_property(sink_data.proplist, "device.ladspa.unique_id", id);
+    }
 
     if (pa_modargs_get_proplist(ma, "sink_properties", sink_data.proplist, PA_UPDATE_REPLACE) < 0) {
         pa_log("Invalid properties");
@@ -1227,10 +1428,9 @@ int pa__init(pa_module*m) {
     }
 
     if ((u->auto_desc = !pa_proplist_contains(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION))) {
-        const char *z;
-
         z = pa_proplist_gets(master->proplist, PA_PROP_DEVICE_DESCRIPTION);
-        pa_proplist_setf(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION, "LADSPA Plugin %s on %s", d->Name, z ? z : master->name);
+        pa_proplist_setf(sink_data.proplist, PA_PROP_DEVICE_DESCRIPTION, "LADSPA Plugin %s on %s",
+                         pa_proplist_gets(sink_data.proplist, "device.ladspa.name"), z ? z : master->name);
     }
 
     u->sink = pa_sink_new(m->core, &sink_data,
@@ -1295,11 +1495,23 @@ int pa__init(pa_module*m) {
     dbus_init(u);
 #endif
 
+    free_stage_values(plugin, n_stages);
+    free_stage_values(label, n_stages);
+    free_stage_values(cdata, n_stages);
+    free_stage_values(input_ladspaport_map, n_stages);
+    free_stage_values(output_ladspaport_map, n_stages);
+
     pa_modargs_free(ma);
 
     return 0;
 
 fail:
+    free_stage_values(plugin, n_stages);
+    free_stage_values(label, n_stages);
+    free_stage_values(cdata, n_stages);
+    free_stage_values(input_ladspaport_map, n_stages);
+    free_stage_values(output_ladspaport_map, n_stages);
+
     if (ma)
         pa_modargs_free(ma);
 
@@ -1319,7 +1531,7 @@ int pa__get_n_used(pa_module *m) {
 
 void pa__done(pa_module*m) {
     struct userdata *u;
-    unsigned c;
+    unsigned h, k;
 
     pa_assert(m);
 
@@ -1345,36 +1557,31 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
-    for (c = 0; c < (u->channels / u->max_ladspaport_count); c++) {
-        if (u->handle[c]) {
-            if (u->descriptor->deactivate)
-                u->descriptor->deactivate(u->handle[c]);
-            u->descriptor->cleanup(u->handle[c]);
-        }
-    }
+    for (k = 0; k < u->n_stages; k++) {
+        struct stage *st = &u->stages[k];
 
-    if (u->output == u->input) {
-        if (u->input != NULL) {
-            for (c = 0; c < u->max_ladspaport_count; c++)
-                pa_xfree(u->input[c]);
-            pa_xfree(u->input);
-        }
-    } else {
-        if (u->input != NULL) {
-            for (c = 0; c < u->input_count; c++)
-                pa_xfree(u->input[c]);
-            pa_xfree(u->input);
-        }
-        if (u->output != NULL) {
-            for (c = 0; c < u->output_count; c++)
-                pa_xfree(u->output[c]);
-            pa_xfree(u->output);
+        for (h = 0; h < u->n_instances; h++) {
+            if (st->handle[h]) {
+                if (st->descriptor->deactivate)
+                    st->descriptor->deactivate(st->handle[h]);
+                st->descriptor->cleanup(st->handle[h]);
+            }
+
+            /* The inputs of the later stages belong to the stage before */
+            if (k == 0 && st->input[h])
+                free_port_buffers(st->input[h], st->input_count);
+            if (st->output[h] && st->output[h] != st->input[h])
+                free_port_buffers(st->output[h], st->output_count);
         }
+
+        if (st->dl)
+            lt_dlclose(st->dl);
     }
 
     if (u->memblockq)
         pa_memblockq_free(u->memblockq);
 
+    pa_xfree(u->stages);
     pa_xfree(u->control);
     pa_xfree(u->use_default);
     pa_xfree(u);
@@ -23,6 +23,7 @@
 #endif
 
 #include <stdio.h>
+#include <math.h>
 
 #include <pulse/xmalloc.h>
 
@@ -45,8 +46,9 @@ PA_MODULE_LOAD_ONCE(false);
 PA_MODULE_USAGE(
         "source=<source to connect to> "
         "sink=<sink to connect to> "
-        "adjust_time=<how often to readjust rates in s> "
+        "adjust_time=<time constant of the latency control in s, 0 disables it> "
         "latency_msec=<latency in ms> "
+        "fast_start=<drop the excess latency at the start?> "
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
@@ -61,7 +63,19 @@ PA_MODULE_USAGE(
 
 #define MEMBLOCKQ_MAXLENGTH (1024*1024*16)
 
-#define DEFAULT_ADJUST_TIME_USEC (10*PA_USEC_PER_SEC)
+#define DEFAULT_ADJUST_TIME_USEC (2*PA_USEC_PER_SEC)
+
+/* How often the sink thread measures the latency and updates the rate */
+#define CONTROL_INTERVAL_USEC (PA_USEC_PER_MSEC * 250)
+
+/* The sink input rate stays within 1% of the source output rate and
+ * moves by at most 2‰ per update, which can be considered inaudible */
+#define MAX_RATE_DEVIATION 0.01
+#define MAX_RATE_STEP 0.002
+
+/* With fast_start, latency beyond the target plus this is dropped until
+ * the latency has come within it for the first time */
+#define FAST_START_MARGIN_USEC (PA_USEC_PER_MSEC * 5)
 
 struct userdata {
     pa_core *core;
@@ -75,30 +89,25 @@ struct userdata {
 
     pa_rtpoll_item *rtpoll_item_read, *rtpoll_item_write;
 
-    pa_time_event *time_event;
     pa_usec_t adjust_time;
-
-    int64_t recv_counter;
-    int64_t send_counter;
+    bool fast_start;
 
     size_t skip;
     pa_usec_t latency;
 
     bool in_pop;
-    size_t min_memblockq_length;
 
+    /* Only accessed from the sink thread */
     struct {
-        int64_t send_counter;
-        size_t source_output_buffer;
-        pa_usec_t source_latency;
-
-        int64_t recv_counter;
-        size_t sink_input_buffer;
-        pa_usec_t sink_latency;
-
-        size_t min_memblockq_length;
-        size_t max_request;
-    } latency_snapshot;
+        /* When the last sample in the memblockq was captured */
+        pa_usec_t capture_time;
+        bool capture_time_valid;
+
+        pa_usec_t next_control;
+        double error;
+        double integral;
+        bool settled;
+    } control;
 };
 
 static const char* const valid_modargs[] = {
@@ -106,6 +115,7 @@ static const char* const valid_modargs[] = {
     "sink",
     "adjust_time",
     "latency_msec",
+    "fast_start",
     "format",
     "rate",
     "channels",
@@ -120,25 +130,14 @@ static const char* const valid_modargs[] = {
 
 enum {
     SINK_INPUT_MESSAGE_POST = PA_SINK_INPUT_MESSAGE_MAX,
-    SINK_INPUT_MESSAGE_REWIND,
-    SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT,
-    SINK_INPUT_MESSAGE_MAX_REQUEST_CHANGED
+    SINK_INPUT_MESSAGE_REWIND
 };
 
-enum {
-    SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT = PA_SOURCE_OUTPUT_MESSAGE_MAX,
-};
-
-static void enable_adjust_timer(struct userdata *u, bool enable);
-
 /* Called from main context */
 static void teardown(struct userdata *u) {
     pa_assert(u);
     pa_assert_ctl_context();
 
-    u->adjust_time = 0;
-    enable_adjust_timer(u, false);
-
     /* Handling the asyncmsgq between the source output and the sink input
      * requires some care. When the source output is unlinked, nothing needs
      * to be done for the asyncmsgq, because the source output is the sending
@@ -167,111 +166,20 @@ static void teardown(struct userdata *u) {
     }
 }
 
-/* Called from main context */
-static void adjust_rates(struct userdata *u) {
-    size_t buffer, fs;
-    uint32_t old_rate, base_rate, new_rate;
-    pa_usec_t buffer_latency;
-
-    pa_assert(u);
-    pa_assert_ctl_context();
-
-    pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
-
-    buffer =
-        u->latency_snapshot.sink_input_buffer +
-        u->latency_snapshot.source_output_buffer;
-
-    if (u->latency_snapshot.recv_counter <= u->latency_snapshot.send_counter)
-        buffer += (size_t) (u->latency_snapshot.send_counter - u->latency_snapshot.recv_counter);
-    else
-        buffer += PA_CLIP_SUB(buffer, (size_t) (u->latency_snapshot.recv_counter - u->latency_snapshot.send_counter));
-
-    buffer_latency = pa_bytes_to_usec(buffer, &u->sink_input->sample_spec);
-
-    pa_log_debug("Loopback overall latency is %0.2f ms + %0.2f ms + %0.2f ms = %0.2f ms",
-                (double) u->latency_snapshot.sink_latency / PA_USEC_PER_MSEC,
-                (double) buffer_latency / PA_USEC_PER_MSEC,
-                (double) u->latency_snapshot.source_latency / PA_USEC_PER_MSEC,
-                ((double) u->latency_snapshot.sink_latency + buffer_latency + u->latency_snapshot.source_latency) / PA_USEC_PER_MSEC);
-
-    pa_log_debug("Should buffer %zu bytes, buffered at minimum %zu bytes",
-                u->latency_snapshot.max_request*2,
-                u->latency_snapshot.min_memblockq_length);
-
-    fs = pa_frame_size(&u->sink_input->sample_spec);
-    old_rate = u->sink_input->sample_spec.rate;
-    base_rate = u->source_output->sample_spec.rate;
-
-    if (u->latency_snapshot.min_memblockq_length < u->latency_snapshot.max_request*2)
-        new_rate = base_rate - (((u->latency_snapshot.max_request*2 - u->latency_snapshot.min_memblockq_length) / fs) *PA_USEC_PER_SEC)/u->adjust_time;
-    else
-        new_rate = base_rate + (((u->latency_snapshot.min_memblockq_length - u->latency_snapshot.max_request*2) / fs) *PA_USEC_PER_SEC)/u->adjust_time;
-
-    if (new_rate < (uint32_t) (base_rate*0.8) || new_rate > (uint32_t) (base_rate*1.25)) {
-        pa_log_warn("Sample rates too different, not adjusting (%u vs. %u).", base_rate, new_rate);
-        new_rate = base_rate;
-    } else {
-        if (base_rate < new_rate + 20 && new_rate < base_rate + 20)
-          new_rate = base_rate;
-        /* Do the adjustment in small steps; 2‰ can be considered inaudible */
-        if (new_rate < (uint32_t) (old_rate*0.998) || new_rate > (uint32_t) (old_rate*1.002)) {
-            pa_log_info("New rate of %u Hz not within 2‰ of %u Hz, forcing smaller adjustment", new_rate, old_rate);
-            new_rate = PA_CLAMP(new_rate, (uint32_t) (old_rate*0.998), (uint32_t) (old_rate*1.002));
-        }
-    }
-
-    pa_sink_input_set_rate(u->sink_input, new_rate);
-    pa_log_debug("[%s] Updated sampling rate to %lu Hz.", u->sink_input->sink->name, (unsigned long) new_rate);
-
-    pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
-}
-
-/* Called from main context */
-static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
-    struct userdata *u = userdata;
-
-    pa_assert(u);
-    pa_assert(a);
-    pa_assert(u->time_event == e);
-
-    adjust_rates(u);
-}
-
-/* Called from main context */
-static void enable_adjust_timer(struct userdata *u, bool enable) {
-    if (enable) {
-        if (u->time_event || u->adjust_time <= 0)
-            return;
-
-        u->time_event = pa_core_rttime_new(u->module->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
-    } else {
-        if (!u->time_event)
-            return;
-
-        u->core->mainloop->time_free(u->time_event);
-        u->time_event = NULL;
-    }
-}
-
-/* Called from main context */
-static void update_adjust_timer(struct userdata *u) {
-    if (u->sink_input->state == PA_SINK_INPUT_CORKED || u->source_output->state == PA_SOURCE_OUTPUT_CORKED)
-        enable_adjust_timer(u, false);
-    else
-        enable_adjust_timer(u, true);
-}
-
 /* Called from input thread context */
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
     struct userdata *u;
     pa_memchunk copy;
+    pa_usec_t capture_time;
 
     pa_source_output_assert_ref(o);
     pa_source_output_assert_io_context(o);
     pa_assert_se(u = o->userdata);
 
+    /* The last sample of the chunk was captured when the source had
+     * just as much left to deliver as its latency */
+    capture_time = PA_CLIP_SUB(pa_rtclock_now(), pa_source_get_latency_within_thread(o->source));
+
     if (u->skip >= chunk->length) {
         u->skip -= chunk->length;
         return;
@@ -286,8 +194,7 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
         chunk = &copy;
     }
 
-    pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_POST, NULL, 0, chunk, NULL);
-    u->send_counter += (int64_t) chunk->length;
+    pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_POST, NULL, (int64_t) capture_time, chunk, NULL);
 }
 
 /* Called from input thread context */
@@ -299,29 +206,6 @@ static void source_output_process_rewind_cb(pa_source_output *o, size_t nbytes)
     pa_assert_se(u = o->userdata);
 
     pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_REWIND, NULL, (int64_t) nbytes, NULL, NULL);
-    u->send_counter -= (int64_t) nbytes;
-}
-
-/* Called from output thread context */
-static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    struct userdata *u = PA_SOURCE_OUTPUT(obj)->userdata;
-
-    switch (code) {
-
-        case SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            size_t length;
-
-            length = pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq);
-
-            u->latency_snapshot.send_counter = u->send_counter;
-            u->latency_snapshot.source_output_buffer = u->source_output->thread_info.resampler ? pa_resampler_result(u->source_output->thread_info.resampler, length) : length;
-            u->latency_snapshot.source_latency = pa_source_get_latency_within_thread(u->source_output->source);
-
-            return 0;
-        }
-    }
-
-    return pa_source_output_process_msg(obj, code, data, offset, chunk);
 }
 
 /* Called from output thread context */
@@ -422,8 +306,6 @@ static void source_output_moving_cb(pa_source_output *o, pa_source *dest) {
         pa_sink_input_cork(u->sink_input, true);
     else
         pa_sink_input_cork(u->sink_input, false);
-
-    update_adjust_timer(u);
 }
 
 /* Called from main thread */
@@ -435,27 +317,116 @@ static void source_output_suspend_cb(pa_source_output *o, bool suspended) {
     pa_assert_se(u = o->userdata);
 
     pa_sink_input_cork(u->sink_input, suspended);
+}
 
-    update_adjust_timer(u);
+/* The latency of the newest sample in the memblockq: how long ago it
+ * was captured plus how long it takes until it is heard. All samples
+ * share it as long as the rate stays the same, so it doesn't depend on
+ * the block sizes of the source and the sink.
+ *
+ * Called from output thread context */
+static pa_usec_t get_latency(struct userdata *u, pa_usec_t now) {
+    pa_sink_input *i = u->sink_input;
+
+    return PA_CLIP_SUB(now, u->control.capture_time) +
+        pa_bytes_to_usec(pa_memblockq_get_length(u->memblockq), &i->thread_info.sample_spec) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec) +
+        pa_sink_get_latency_within_thread(i->sink);
 }
 
-/* Called from output thread context */
-static void update_min_memblockq_length(struct userdata *u) {
-    size_t length;
+/* Drops what lies beyond the target at the start, but leaves the
+ * memblockq at least as long as its prebuf. Returns whether it dropped
+ * anything.
+ *
+ * Called from output thread context */
+static bool trim_latency(struct userdata *u, pa_usec_t latency) {
+    size_t excess, length, keep;
 
-    pa_assert(u);
-    pa_sink_input_assert_io_context(u->sink_input);
+    if (latency <= u->latency + FAST_START_MARGIN_USEC)
+        return false;
 
+    excess = pa_usec_to_bytes(latency - u->latency, &u->sink_input->thread_info.sample_spec);
     length = pa_memblockq_get_length(u->memblockq);
+    keep = pa_memblockq_get_prebuf(u->memblockq);
 
-    if (u->min_memblockq_length == (size_t) -1 ||
-        length < u->min_memblockq_length)
-        u->min_memblockq_length = length;
+    if (length <= keep)
+        return false;
+
+    excess = pa_frame_align(PA_MIN(excess, length - keep), &u->sink_input->thread_info.sample_spec);
+    if (excess == 0)
+        return false;
+
+    pa_log_debug("Dropping %0.2f ms of excess latency.", (double) pa_bytes_to_usec(excess, &u->sink_input->thread_info.sample_spec) / PA_USEC_PER_MSEC);
+    pa_memblockq_drop(u->memblockq, excess);
+
+    return true;
+}
+
+/* Measures the latency and moves it towards the target with the rate of
+ * the resampler. That is one step of a critically damped PI controller
+ * with the time constant adjust_time.
+ *
+ * Called from output thread context */
+static void adjust_rate(struct userdata *u, pa_usec_t now) {
+    pa_sink_input *i = u->sink_input;
+    pa_usec_t latency;
+    uint32_t base_rate, current_rate, new_rate;
+    double error, tau, kp, ki, correction, step;
+
+    if (!u->control.capture_time_valid || !pa_memblockq_is_readable(u->memblockq))
+        return;
+
+    latency = get_latency(u, now);
+
+    if (!u->control.settled) {
+        if (u->fast_start && trim_latency(u, latency))
+            latency = get_latency(u, now);
+
+        if (latency <= u->latency + FAST_START_MARGIN_USEC) {
+            pa_log_info("Loopback latency settled at %0.2f ms.", (double) latency / PA_USEC_PER_MSEC);
+            u->control.settled = true;
+        }
+    }
+
+    if (u->adjust_time == 0 || !i->thread_info.resampler)
+        return;
+
+    error = ((double) latency - (double) u->latency) / PA_USEC_PER_SEC;
+
+    tau = (double) u->adjust_time / PA_USEC_PER_SEC;
+    kp = 1.0 / tau;
+    ki = kp * kp / 4;
+
+    /* The sink reports its latency in steps, so the error is smoothed a bit */
+    u->control.error += (error - u->control.error) * 0.3;
+
+    correction = kp * u->control.error + ki * u->control.integral;
+
+    /* Don't wind up while the rate is at its limit */
+    if (fabs(correction) < MAX_RATE_DEVIATION)
+        u->control.integral += u->control.error * CONTROL_INTERVAL_USEC / PA_USEC_PER_SEC;
+
+    /* A higher input rate takes more of the queue for each second played */
+    base_rate = i->sample_spec.rate;
+    current_rate = i->thread_info.sample_spec.rate;
+    correction = PA_CLAMP(correction, -MAX_RATE_DEVIATION, MAX_RATE_DEVIATION);
+    step = PA_CLAMP(base_rate * (1 + correction) - current_rate, -base_rate * MAX_RATE_STEP, base_rate * MAX_RATE_STEP);
+    new_rate = (uint32_t) (current_rate + step + 0.5);
+
+    if (new_rate == current_rate)
+        return;
+
+    pa_log_debug("[%s] Loopback latency is %0.2f ms, target %0.2f ms; new rate is %u Hz.", i->sink->name,
+                 (double) latency / PA_USEC_PER_MSEC, (double) u->latency / PA_USEC_PER_MSEC, new_rate);
+
+    i->thread_info.sample_spec.rate = new_rate;
+    pa_resampler_set_input_rate(i->thread_info.resampler, new_rate);
 }
 
 /* Called from output thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
+    pa_usec_t now;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -467,6 +438,12 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
         ;
     u->in_pop = false;
 
+    now = pa_rtclock_now();
+    if (now >= u->control.next_control) {
+        adjust_rate(u, now);
+        u->control.next_control = now + CONTROL_INTERVAL_USEC;
+    }
+
     if (pa_memblockq_peek(u->memblockq, chunk) < 0) {
         pa_log_info("Could not peek into queue");
         return -1;
@@ -475,8 +452,6 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     chunk->length = PA_MIN(chunk->length, nbytes);
     pa_memblockq_drop(u->memblockq, chunk->length);
 
-    update_min_memblockq_length(u);
-
     return 0;
 }
 
@@ -518,7 +493,8 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
             else
                 pa_memblockq_flush_write(u->memblockq, true);
 
-            update_min_memblockq_length(u);
+            u->control.capture_time = (pa_usec_t) offset;
+            u->control.capture_time_valid = true;
 
             /* Is this the end of an underrun? Then let's start things
              * right-away */
@@ -532,8 +508,6 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
                                              false, true, false);
             }
 
-            u->recv_counter += (int64_t) chunk->length;
-
             return 0;
 
         case SINK_INPUT_MESSAGE_REWIND:
@@ -545,44 +519,7 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
             else
                 pa_memblockq_flush_write(u->memblockq, true);
 
-            u->recv_counter -= offset;
-
-            update_min_memblockq_length(u);
-
             return 0;
-
-        case SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT: {
-            size_t length;
-
-            update_min_memblockq_length(u);
-
-            length = pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq);
-
-            u->latency_snapshot.recv_counter = u->recv_counter;
-            u->latency_snapshot.sink_input_buffer =
-                pa_memblockq_get_length(u->memblockq) +
-                (u->sink_input->thread_info.resampler ? pa_resampler_request(u->sink_input->thread_info.resampler, length) : length);
-            u->latency_snapshot.sink_latency = pa_sink_get_latency_within_thread(u->sink_input->sink);
-
-            u->latency_snapshot.max_request = pa_sink_input_get_max_request(u->sink_input);
-
-            u->latency_snapshot.min_memblockq_length = u->min_memblockq_length;
-            u->min_memblockq_length = (size_t) -1;
-
-            return 0;
-        }
-
-        case SINK_INPUT_MESSAGE_MAX_REQUEST_CHANGED: {
-            /* This message is sent from the IO thread to the main
-             * thread! So don't be confused. All the user cases above
-             * are executed in thread context, but this one is not! */
-
-            pa_assert_ctl_context();
-
-            if (u->time_event)
-                adjust_rates(u);
-            return 0;
-        }
     }
 
     return pa_sink_input_process_msg(obj, code, data, offset, chunk);
@@ -604,7 +541,11 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_memblockq_set_prebuf(u->memblockq, pa_sink_input_get_max_request(i)*2);
     pa_memblockq_set_maxrewind(u->memblockq, pa_sink_input_get_max_rewind(i));
 
-    u->min_memblockq_length = (size_t) -1;
+    /* A new sink has a latency of its own, start over */
+    u->control.next_control = 0;
+    u->control.error = 0;
+    u->control.integral = 0;
+    u->control.settled = false;
 }
 
 /* Called from output thread context */
@@ -642,7 +583,6 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
 
     pa_memblockq_set_prebuf(u->memblockq, nbytes*2);
     pa_log_info("Max request changed");
-    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_MAX_REQUEST_CHANGED, NULL, 0, NULL, NULL);
 }
 
 /* Called from main thread */
@@ -694,8 +634,6 @@ static void sink_input_moving_cb(pa_sink_input *i, pa_sink *dest) {
         pa_source_output_cork(u->source_output, true);
     else
         pa_source_output_cork(u->source_output, false);
-
-    update_adjust_timer(u);
 }
 
 /* Called from main thread */
@@ -721,8 +659,6 @@ static void sink_input_suspend_cb(pa_sink_input *i, bool suspended) {
     pa_assert_se(u = i->userdata);
 
     pa_source_output_cork(u->source_output, suspended);
-
-    update_adjust_timer(u);
 }
 
 int pa__init(pa_module *m) {
@@ -830,6 +766,12 @@ int pa__init(pa_module *m) {
     else
         u->adjust_time = DEFAULT_ADJUST_TIME_USEC;
 
+    u->fast_start = true;
+    if (pa_modargs_get_value_boolean(ma, "fast_start", &u->fast_start) < 0) {
+        pa_log("fast_start= expects a boolean argument.");
+        goto fail;
+    }
+
     pa_sink_input_new_data_init(&sink_input_data);
     sink_input_data.driver = __FILE__;
     sink_input_data.module = m;
@@ -935,7 +877,6 @@ int pa__init(pa_module *m) {
     if (!u->source_output)
         goto fail;
 
-    u->source_output->parent.process_msg = source_output_process_msg_cb;
     u->source_output->push = source_output_push_cb;
     u->source_output->process_rewind = source_output_process_rewind_cb;
     u->source_output->kill = source_output_kill_cb;
@@ -989,8 +930,6 @@ int pa__init(pa_module *m) {
     if (pa_sink_get_state(u->sink_input->sink) != PA_SINK_SUSPENDED)
         pa_source_output_cork(u->source_output, false);
 
-    update_adjust_timer(u);
-
     pa_modargs_free(ma);
     return 0;
 
@@ -43,6 +43,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/sink-input.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 
 #include "module-match-symdef.h"
 
@@ -61,6 +62,12 @@ PA_MODULE_USAGE("table=<filename> "
 #define UPDATE_REPLACE "replace"
 #define UPDATE_MERGE "merge"
 
+/* Property values we remember the matching rules for */
+#define MATCH_CACHE_MAX 64
+
+/* Characters that make an expression more than a plain string */
+#define REGEX_SPECIAL ".[]()*+?{}|\\^$"
+
 static const char* const valid_modargs[] = {
     "table",
     "key",
@@ -69,6 +76,12 @@ static const char* const valid_modargs[] = {
 
 struct rule {
     regex_t regex;
+
+    /* Set if the expression is a plain string, which is then matched
+     * without the regex engine, possibly anchored at either end */
+    char *literal;
+    bool anchor_start, anchor_end;
+
     pa_volume_t volume;
     pa_proplist *proplist;
     pa_update_mode_t mode;
@@ -79,8 +92,72 @@ struct userdata {
     struct rule *rules;
     char *property_key;
     pa_hook_slot *sink_input_fixate_hook_slot;
+
+    /* property value -> NULL terminated array of the matching rules.
+     * Most streams of an application share a name, and the table never
+     * changes. */
+    pa_hashmap *cache;
 };
 
+static char *literal_from_regex(const char *re, bool *anchor_start, bool *anchor_end) {
+    size_t len;
+
+    *anchor_start = re[0] == '^';
+    if (*anchor_start)
+        re++;
+
+    len = strlen(re);
+    *anchor_end = len > 0 && re[len - 1] == '$';
+    if (*anchor_end)
+        len--;
+
+    if (strcspn(re, REGEX_SPECIAL) < len)
+        return NULL;
+
+    return pa_xstrndup(re, len);
+}
+
+static bool rule_matches(struct rule *r, const char *s) {
+    if (!r->literal)
+        return !regexec(&r->regex, s, 0, NULL, 0);
+
+    if (r->anchor_start && r->anchor_end)
+        return pa_streq(s, r->literal);
+    if (r->anchor_start)
+        return pa_startswith(s, r->literal);
+    if (r->anchor_end)
+        return pa_endswith(s, r->literal);
+
+    return !!strstr(s, r->literal);
+}
+
+static struct rule **get_matching_rules(struct userdata *u, const char *s) {
+    struct rule **matches, *r;
+    unsigned n = 0;
+
+    if ((matches = pa_hashmap_get(u->cache, s)))
+        return matches;
+
+    for (r = u->rules; r; r = r->next)
+        n++;
+
+    matches = pa_xnew(struct rule*, n + 1);
+    n = 0;
+
+    for (r = u->rules; r; r = r->next)
+        if (rule_matches(r, s))
+            matches[n++] = r;
+
+    matches[n] = NULL;
+
+    if (pa_hashmap_size(u->cache) >= MATCH_CACHE_MAX)
+        pa_hashmap_remove_all(u->cache);
+
+    pa_hashmap_put(u->cache, pa_xstrdup(s), matches);
+
+    return matches;
+}
+
 static int load_rules(struct userdata *u, const char *filename) {
     FILE *f;
     int n = 0;
@@ -186,6 +263,7 @@ static int load_rules(struct userdata *u, const char *filename) {
 
         rule = pa_xnew(struct rule, 1);
         rule->regex = regex;
+        rule->literal = literal_from_regex(ln, &rule->anchor_start, &rule->anchor_end);
         rule->proplist = proplist;
         rule->mode = mode;
         rule->volume = volume;
@@ -212,32 +290,38 @@ finish:
 }
 
 static pa_hook_result_t sink_input_fixate_hook_callback(pa_core *c, pa_sink_input_new_data *si, struct userdata *u) {
-    struct rule *r;
-    const char *n;
+    struct rule **matches, *r;
+    const char *v;
+    char *n;
 
     pa_assert(c);
     pa_assert(u);
 
-    if (!(n = pa_proplist_gets(si->proplist, u->property_key)))
+    if (!(v = pa_proplist_gets(si->proplist, u->property_key)))
         return PA_HOOK_OK;
 
+    /* The proplist updates below may replace the value */
+    n = pa_xstrdup(v);
+
     pa_log_debug("Matching with %s", n);
 
-    for (r = u->rules; r; r = r->next) {
-        if (!regexec(&r->regex, n, 0, NULL, 0)) {
-            if (r->proplist) {
-                pa_log_debug("updating proplist of sink input '%s'", n);
-                pa_proplist_update(si->proplist, r->mode, r->proplist);
-            } else if (si->volume_writable) {
-                pa_cvolume cv;
-                pa_log_debug("changing volume of sink input '%s' to 0x%03x", n, r->volume);
-                pa_cvolume_set(&cv, si->sample_spec.channels, r->volume);
-                pa_sink_input_new_data_set_volume(si, &cv);
-            } else
-                pa_log_debug("the volume of sink input '%s' is not writable, can't change it", n);
-        }
+    matches = get_matching_rules(u, n);
+
+    for (; (r = *matches); matches++) {
+        if (r->proplist) {
+            pa_log_debug("updating proplist of sink input '%s'", n);
+            pa_proplist_update(si->proplist, r->mode, r->proplist);
+        } else if (si->volume_writable) {
+            pa_cvolume cv;
+            pa_log_debug("changing volume of sink input '%s' to 0x%03x", n, r->volume);
+            pa_cvolume_set(&cv, si->sample_spec.channels, r->volume);
+            pa_sink_input_new_data_set_volume(si, &cv);
+        } else
+            pa_log_debug("the volume of sink input '%s' is not writable, can't change it", n);
     }
 
+    pa_xfree(n);
+
     return PA_HOOK_OK;
 }
 
@@ -257,6 +341,7 @@ int pa__init(pa_module*m) {
     m->userdata = u;
 
     u->property_key = pa_xstrdup(pa_modargs_get_value(ma, "key", PA_PROP_MEDIA_NAME));
+    u->cache = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, pa_xfree);
 
     if (load_rules(u, pa_modargs_get_value(ma, "table", NULL)) < 0)
         goto fail;
@@ -290,10 +375,14 @@ void pa__done(pa_module*m) {
     if (u->property_key)
         pa_xfree(u->property_key);
 
+    if (u->cache)
+        pa_hashmap_free(u->cache);
+
     for (r = u->rules; r; r = n) {
         n = r->next;
 
         regfree(&r->regex);
+        pa_xfree(r->literal);
         if (r->proplist)
             pa_proplist_free(r->proplist);
         pa_xfree(r);
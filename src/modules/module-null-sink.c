@@ -40,6 +40,7 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/io-scheduler.h>
 
 #include "module-null-sink-symdef.h"
 
@@ -67,6 +68,10 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Instead of the above when shared IO threads are enabled */
+    pa_io_scheduler *io_scheduler;
+    pa_io_scheduler_client *io_client;
+
     pa_usec_t block_usec;
     pa_usec_t timestamp;
 };
@@ -193,6 +198,32 @@ static void process_render(struct userdata *u, pa_usec_t now) {
 /*     pa_log_debug("Ate in sum %lu bytes (of %lu)", (unsigned long) ate, (unsigned long) nbytes); */
 }
 
+/* Called from IO context, either our own thread or a shared one. Returns
+ * when we want to be woken up next. */
+static pa_usec_t process(struct userdata *u) {
+    pa_usec_t now = 0;
+
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
+        now = pa_rtpoll_now(u->sink->thread_info.rtpoll);
+
+    if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
+        process_rewind(u, now);
+
+    /* Render some data and drop it immediately. Nobody hears us, so
+     * rendering a bit early is fine: if another device of a shared
+     * thread woke it and less than a quarter of our buffer is left, top
+     * it up now instead of waking up again shortly. Devices with the
+     * same latency end up being served in the same wakeups. */
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        if (u->timestamp <= now + u->block_usec / 4)
+            process_render(u, now);
+
+        return u->timestamp;
+    }
+
+    return PA_USEC_INVALID;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -205,22 +236,12 @@ static void thread_func(void *userdata) {
     u->timestamp = pa_rtclock_now();
 
     for (;;) {
-        pa_usec_t now = 0;
+        pa_usec_t deadline;
         int ret;
 
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
-            now = pa_rtclock_now();
-
-        if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
-            process_rewind(u, now);
-
-        /* Render some data and drop it immediately */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            if (u->timestamp <= now)
-                process_render(u, now);
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
-        } else
+        if ((deadline = process(u)) != PA_USEC_INVALID)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, deadline);
+        else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
@@ -266,8 +287,6 @@ int pa__init(pa_module*m) {
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
-    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
 
     pa_sink_new_data_init(&data);
     data.driver = __FILE__;
@@ -296,17 +315,28 @@ int pa__init(pa_module*m) {
     u->sink->update_requested_latency = sink_update_requested_latency_cb;
     u->sink->userdata = u;
 
-    pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
-    pa_sink_set_rtpoll(u->sink, u->rtpoll);
-
     u->block_usec = BLOCK_USEC;
     nbytes = pa_usec_to_bytes(u->block_usec, &u->sink->sample_spec);
     pa_sink_set_max_rewind(u->sink, nbytes);
     pa_sink_set_max_request(u->sink, nbytes);
 
-    if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if ((u->io_scheduler = pa_io_scheduler_get(m->core))) {
+        u->timestamp = pa_rtclock_now();
+        u->io_client = pa_io_scheduler_client_new(u->io_scheduler, m, (pa_io_scheduler_process_cb_t) process, u);
+
+        pa_sink_set_asyncmsgq(u->sink, pa_io_scheduler_client_get_asyncmsgq(u->io_client));
+        pa_sink_set_rtpoll(u->sink, pa_io_scheduler_client_get_rtpoll(u->io_client));
+    } else {
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+
+        pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
+        pa_sink_set_rtpoll(u->sink, u->rtpoll);
+
+        if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
     }
 
     pa_sink_set_latency_range(u->sink, 0, BLOCK_USEC);
@@ -351,7 +381,14 @@ void pa__done(pa_module*m) {
         pa_thread_free(u->thread);
     }
 
-    pa_thread_mq_done(&u->thread_mq);
+    if (u->io_client)
+        pa_io_scheduler_client_free(u->io_client);
+
+    if (u->io_scheduler)
+        pa_io_scheduler_unref(u->io_scheduler);
+
+    if (u->rtpoll)
+        pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink)
         pa_sink_unref(u->sink);
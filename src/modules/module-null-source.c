@@ -33,6 +33,7 @@
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
+#include <pulsecore/io-scheduler.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/module.h>
@@ -69,6 +70,10 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Instead of the above when shared IO threads are enabled */
+    pa_io_scheduler *io_scheduler;
+    pa_io_scheduler_client *io_client;
+
     size_t block_size;
 
     pa_usec_t block_usec;
@@ -98,6 +103,15 @@ static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t off
 
             break;
 
+        case PA_SOURCE_MESSAGE_ADD_OUTPUT:
+
+            /* While nobody listened, process() didn't keep the timestamp
+             * going. Don't post all of that time to the first output. */
+            if (pa_hashmap_isempty(u->source->thread_info.outputs))
+                u->timestamp = pa_rtclock_now();
+
+            break;
+
         case PA_SOURCE_MESSAGE_GET_LATENCY: {
             pa_usec_t now;
 
@@ -121,6 +135,45 @@ static void source_update_requested_latency_cb(pa_source *s) {
     u->block_usec = pa_source_get_requested_latency_within_thread(s);
 }
 
+/* Called from IO context, either our own thread or a shared one. Returns
+ * when we want to be woken up next. */
+static pa_usec_t process(struct userdata *u) {
+    pa_usec_t now;
+    pa_memchunk chunk;
+
+    if (!PA_SOURCE_IS_OPENED(u->source->thread_info.state))
+        return PA_USEC_INVALID;
+
+    /* Generate some null data */
+    now = pa_rtpoll_now(u->source->thread_info.rtpoll);
+
+    /* If nobody listens, don't wake up just to throw silence away. A new
+     * output comes with a message, which wakes us up again. */
+    if (pa_hashmap_isempty(u->source->thread_info.outputs)) {
+        u->timestamp = now;
+        return PA_USEC_INVALID;
+    }
+
+    chunk.length = now > u->timestamp ? pa_usec_to_bytes(now - u->timestamp, &u->source->sample_spec) : 0;
+
+    /* Never more than one block, or than latency_time: if we're behind
+     * further, the rest follows right away */
+    chunk.length = PA_MIN(chunk.length, pa_usec_to_bytes(u->latency_time * PA_USEC_PER_MSEC, &u->source->sample_spec));
+    chunk.length = PA_MIN(chunk.length, pa_frame_align(pa_mempool_block_size_max(u->core->mempool), &u->source->sample_spec));
+
+    if (chunk.length > 0) {
+
+        chunk.memblock = pa_memblock_new(u->core->mempool, (size_t) -1); /* or chunk.length? */
+        chunk.index = 0;
+        pa_source_post(u->source, &chunk);
+        pa_memblock_unref(chunk.memblock);
+
+        u->timestamp += pa_bytes_to_usec(chunk.length, &u->source->sample_spec);
+    }
+
+    return u->timestamp + u->latency_time * PA_USEC_PER_MSEC;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -133,27 +186,12 @@ static void thread_func(void *userdata) {
     u->timestamp = pa_rtclock_now();
 
     for (;;) {
+        pa_usec_t deadline;
         int ret;
 
-        /* Generate some null data */
-        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
-            pa_usec_t now;
-            pa_memchunk chunk;
-
-            now = pa_rtclock_now();
-
-            if ((chunk.length = pa_usec_to_bytes(now - u->timestamp, &u->source->sample_spec)) > 0) {
-
-                chunk.memblock = pa_memblock_new(u->core->mempool, (size_t) -1); /* or chunk.length? */
-                chunk.index = 0;
-                pa_source_post(u->source, &chunk);
-                pa_memblock_unref(chunk.memblock);
-
-                u->timestamp = now;
-            }
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp + u->latency_time * PA_USEC_PER_MSEC);
-        } else
+        if ((deadline = process(u)) != PA_USEC_INVALID)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, deadline);
+        else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
@@ -199,8 +237,6 @@ int pa__init(pa_module*m) {
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
-    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
 
     pa_source_new_data_init(&data);
     data.driver = __FILE__;
@@ -230,18 +266,29 @@ int pa__init(pa_module*m) {
     u->source->update_requested_latency = source_update_requested_latency_cb;
     u->source->userdata = u;
 
-    pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
-    pa_source_set_rtpoll(u->source, u->rtpoll);
-
     pa_source_set_latency_range(u->source, 0, MAX_LATENCY_USEC);
     u->block_usec = u->source->thread_info.max_latency;
 
     u->source->thread_info.max_rewind =
         pa_usec_to_bytes(u->block_usec, &u->source->sample_spec);
 
-    if (!(u->thread = pa_thread_new("null-source", thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if ((u->io_scheduler = pa_io_scheduler_get(m->core))) {
+        u->timestamp = pa_rtclock_now();
+        u->io_client = pa_io_scheduler_client_new(u->io_scheduler, m, (pa_io_scheduler_process_cb_t) process, u);
+
+        pa_source_set_asyncmsgq(u->source, pa_io_scheduler_client_get_asyncmsgq(u->io_client));
+        pa_source_set_rtpoll(u->source, pa_io_scheduler_client_get_rtpoll(u->io_client));
+    } else {
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+
+        pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
+        pa_source_set_rtpoll(u->source, u->rtpoll);
+
+        if (!(u->thread = pa_thread_new("null-source", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
     }
 
     pa_source_put(u->source);
@@ -275,7 +322,14 @@ void pa__done(pa_module*m) {
         pa_thread_free(u->thread);
     }
 
-    pa_thread_mq_done(&u->thread_mq);
+    if (u->io_client)
+        pa_io_scheduler_client_free(u->io_client);
+
+    if (u->io_scheduler)
+        pa_io_scheduler_unref(u->io_scheduler);
+
+    if (u->rtpoll)
+        pa_thread_mq_done(&u->thread_mq);
 
     if (u->source)
         pa_source_unref(u->source);
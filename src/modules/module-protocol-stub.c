@@ -46,10 +46,10 @@
 
 #ifdef USE_TCP_SOCKETS
 #define SOCKET_DESCRIPTION "(TCP sockets)"
-#define SOCKET_USAGE "port=<TCP port number> listen=<address to listen on>"
+#define SOCKET_USAGE "port=<TCP port number> listen=<address to listen on> backlog=<connections queued up before refusing more>"
 #else
 #define SOCKET_DESCRIPTION "(UNIX sockets)"
-#define SOCKET_USAGE "socket=<path to UNIX socket>"
+#define SOCKET_USAGE "socket=<path to UNIX socket> backlog=<connections queued up before refusing more>"
 #endif
 
 #if defined(USE_PROTOCOL_SIMPLE)
@@ -109,7 +109,7 @@
 #  define TCPWRAP_SERVICE "pulseaudio-native"
 #  define IPV4_PORT PA_NATIVE_DEFAULT_PORT
 #  define UNIX_SOCKET PA_NATIVE_DEFAULT_UNIX_SOCKET
-#  define MODULE_ARGUMENTS_COMMON "cookie", "auth-cookie", "auth-cookie-enabled", "auth-anonymous",
+#  define MODULE_ARGUMENTS_COMMON "cookie", "auth-cookie", "auth-cookie-enabled", "auth-anonymous", "max-connections",
 
 #  ifdef USE_TCP_SOCKETS
 #    include "module-native-protocol-tcp-symdef.h"
@@ -118,9 +118,10 @@
 #  endif
 
 #  if defined(HAVE_CREDS) && !defined(USE_TCP_SOCKETS)
-#    define MODULE_ARGUMENTS MODULE_ARGUMENTS_COMMON "auth-group", "auth-group-enable", "srbchannel",
+#    define MODULE_ARGUMENTS MODULE_ARGUMENTS_COMMON "auth-group", "auth-group-enable", "srbchannel", "memfd",
 #    define AUTH_USAGE "auth-group=<system group to allow access> auth-group-enable=<enable auth by UNIX group?> "
-#    define SRB_USAGE "srbchannel=<enable shared ringbuffer communication channel?> "
+#    define SRB_USAGE "srbchannel=<enable shared ringbuffer communication channel?> " \
+                      "memfd=<give clients their own memfd memory pools?> "
 #  elif defined(USE_TCP_SOCKETS)
 #    define MODULE_ARGUMENTS MODULE_ARGUMENTS_COMMON "auth-ip-acl",
 #    define AUTH_USAGE "auth-ip-acl=<IP address ACL to allow access> "
@@ -135,6 +136,7 @@
   PA_MODULE_USAGE("auth-anonymous=<don't check for cookies?> "
                   "auth-cookie=<path to cookie file> "
                   "auth-cookie-enabled=<enable cookie authentication?> "
+                  "max-connections=<maximum number of concurrent clients> "
                   AUTH_USAGE
                   SRB_USAGE
                   SOCKET_USAGE);
@@ -183,6 +185,7 @@ static const char* const valid_modargs[] = {
 #else
     "socket",
 #endif
+    "backlog",
     NULL
 };
 
@@ -238,6 +241,7 @@ static void socket_server_on_connection_cb(pa_socket_server*s, pa_iochannel *io,
 int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     struct userdata *u = NULL;
+    uint32_t backlog = 0;
 
 #if defined(USE_TCP_SOCKETS)
     uint32_t port = IPV4_PORT;
@@ -258,6 +262,11 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "backlog", &backlog) < 0 || backlog > INT_MAX) {
+        pa_log("backlog= expects a positive integer.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->module = m;
 
@@ -319,11 +328,19 @@ int pa__init(pa_module*m) {
 #  endif
         goto fail;
 
-    if (u->socket_server_ipv4)
+    if (u->socket_server_ipv4) {
         pa_socket_server_set_callback(u->socket_server_ipv4, socket_server_on_connection_cb, u);
+
+        if (backlog > 0 && pa_socket_server_set_backlog(u->socket_server_ipv4, (int) backlog) < 0)
+            goto fail;
+    }
 #  ifdef HAVE_IPV6
-    if (u->socket_server_ipv6)
+    if (u->socket_server_ipv6) {
         pa_socket_server_set_callback(u->socket_server_ipv6, socket_server_on_connection_cb, u);
+
+        if (backlog > 0 && pa_socket_server_set_backlog(u->socket_server_ipv6, (int) backlog) < 0)
+            goto fail;
+    }
 #  endif
 
 #else
@@ -362,6 +379,9 @@ int pa__init(pa_module*m) {
 
     pa_socket_server_set_callback(u->socket_server_unix, socket_server_on_connection_cb, u);
 
+    if (backlog > 0 && pa_socket_server_set_backlog(u->socket_server_unix, (int) backlog) < 0)
+        goto fail;
+
 #endif
 
 #if defined(USE_PROTOCOL_NATIVE)
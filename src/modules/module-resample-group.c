@@ -0,0 +1,406 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/hook-list.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/sink-input.h>
+
+#include "module-resample-group-symdef.h"
+
+PA_MODULE_AUTHOR("PulseAudio developers");
+PA_MODULE_DESCRIPTION("Mix streams of the same rate before resampling them together");
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(true);
+PA_MODULE_USAGE(
+        "min_streams=<Number of streams with the same rate on a sink from which they are grouped> "
+        "resample_method=<The resampler for the mix of a group>");
+
+#define DEFAULT_MIN_STREAMS 2
+#define HOUSEKEEPING_INTERVAL (10 * PA_USEC_PER_SEC)
+
+#define PA_PROP_RESAMPLE_GROUP_MOVING "resample.group.moving"
+
+static const char* const valid_modargs[] = {
+    "min_streams",
+    "resample_method",
+    NULL
+};
+
+/* The streams of a group are mixed by a remap sink at their rate, whose
+ * stream on master is then the only one to resample. Only streams that
+ * request the same latency share a group, so that none of them gets a
+ * latency it did not ask for. */
+struct group {
+    pa_sink *master;
+    uint32_t rate;
+    pa_usec_t latency;
+
+    uint32_t module_index;
+    pa_sink *sink;
+};
+
+struct userdata {
+    pa_core *core;
+    pa_hashmap *groups;
+    uint32_t min_streams;
+    char *resample_method;
+    pa_time_event *housekeeping_time_event;
+};
+
+static unsigned group_hash(const void *p) {
+    const struct group *g = p;
+
+    return g->master->index + g->rate + (unsigned) g->latency;
+}
+
+static int group_compare(const void *a, const void *b) {
+    const struct group *ga = a, *gb = b;
+
+    if (ga->master != gb->master || ga->rate != gb->rate || ga->latency != gb->latency)
+        return 1;
+
+    return 0;
+}
+
+static void group_free(struct group *g) {
+    pa_xfree(g);
+}
+
+static struct group *find_group_by_sink(struct userdata *u, pa_sink *s) {
+    struct group *g;
+    void *state;
+
+    PA_HASHMAP_FOREACH(g, u->groups, state)
+        if (g->sink == s)
+            return g;
+
+    return NULL;
+}
+
+/* Fills in the group key of i if it would gain from mixing with others
+ * on its sink before resampling */
+static bool get_key(struct userdata *u, pa_sink_input *i, struct group *key) {
+    pa_assert(u);
+    pa_assert(i);
+    pa_assert(key);
+
+    /* Neither streams already in a group nor the streams of the groups
+     * themselves */
+    if (!i->sink ||
+        find_group_by_sink(u, i->sink) ||
+        (i->origin_sink && find_group_by_sink(u, i->origin_sink)))
+        return false;
+
+    if (i->sample_spec.rate == i->sink->sample_spec.rate ||
+        (i->flags & (PA_SINK_INPUT_VARIABLE_RATE|PA_SINK_INPUT_FIX_RATE)) ||
+        pa_sink_input_is_passthrough(i) ||
+        !pa_sink_input_may_move(i))
+        return false;
+
+    key->master = i->sink;
+    key->rate = i->sample_spec.rate;
+    key->latency = pa_sink_input_get_requested_latency(i);
+
+    return true;
+}
+
+static unsigned count_streams(struct userdata *u, const struct group *key) {
+    struct group k;
+    pa_sink_input *i;
+    unsigned n = 0;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(i, key->master->inputs, idx)
+        if (get_key(u, i, &k) && group_compare(&k, key) == 0)
+            n++;
+
+    return n;
+}
+
+static void move_stream(pa_sink_input *i, pa_sink *dest) {
+    pa_proplist_sets(i->proplist, PA_PROP_RESAMPLE_GROUP_MOVING, "1");
+
+    if (pa_sink_input_move_to(i, dest, false) < 0)
+        pa_log_info("Failed to move sink input %u to <%s>.", i->index, dest->name);
+    else
+        pa_log_debug("Moved sink input %u to <%s>.", i->index, dest->name);
+
+    pa_proplist_unset(i->proplist, PA_PROP_RESAMPLE_GROUP_MOVING);
+}
+
+static struct group *group_new(struct userdata *u, const struct group *key) {
+    char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
+    struct group *g;
+    const char *d;
+    char *args;
+    pa_module *m;
+    pa_sink *s;
+    uint32_t idx;
+
+    /* Everything but the rate is taken from the master, so that the
+     * stream of the remap sink only resamples */
+    d = pa_proplist_gets(key->master->proplist, PA_PROP_DEVICE_DESCRIPTION);
+    args = pa_sprintf_malloc("sink_name=%s.rate_%u "
+                             "sink_properties='device.description=\"%s at %u Hz\" resample.group=1' "
+                             "master=%s format=%s rate=%u channels=%u channel_map=%s remix=no%s%s",
+                             key->master->name, key->rate,
+                             d ? d : key->master->name, key->rate,
+                             key->master->name,
+                             pa_sample_format_to_string(key->master->sample_spec.format),
+                             key->rate,
+                             key->master->sample_spec.channels,
+                             pa_channel_map_snprint(cm, sizeof(cm), &key->master->channel_map),
+                             u->resample_method ? " resample_method=" : "",
+                             u->resample_method ? u->resample_method : "");
+
+    pa_log_debug("Loading module-remap-sink with arguments '%s'", args);
+    m = pa_module_load(u->core, "module-remap-sink", args);
+    pa_xfree(args);
+
+    if (!m)
+        return NULL;
+
+    g = pa_xnew0(struct group, 1);
+    *g = *key;
+    g->module_index = m->index;
+
+    PA_IDXSET_FOREACH(s, u->core->sinks, idx)
+        if (s->module == m) {
+            g->sink = s;
+            break;
+        }
+
+    pa_assert(g->sink);
+    pa_hashmap_put(u->groups, g, g);
+
+    return g;
+}
+
+static void housekeeping_time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+    struct group *g;
+    void *state;
+
+    pa_assert(a);
+    pa_assert(e);
+    pa_assert(u);
+
+    pa_assert(e == u->housekeeping_time_event);
+    u->core->mainloop->time_free(u->housekeeping_time_event);
+    u->housekeeping_time_event = NULL;
+
+    PA_HASHMAP_FOREACH(g, u->groups, state) {
+        if (pa_idxset_isempty(g->sink->inputs)) {
+            pa_log_debug("Group for %u Hz on <%s> is no longer used. Unloading.", g->rate, g->master->name);
+            pa_module_unload_request_by_index(u->core, g->module_index, true);
+            pa_hashmap_remove(u->groups, g);
+            group_free(g);
+        }
+    }
+}
+
+static void trigger_housekeeping(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->housekeeping_time_event)
+        return;
+
+    u->housekeeping_time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + HOUSEKEEPING_INTERVAL, housekeeping_time_callback, u);
+}
+
+static pa_hook_result_t process(struct userdata *u, pa_sink_input *i) {
+    struct group key, *g;
+    pa_sink_input *j;
+    uint32_t idx;
+
+    if (!get_key(u, i, &key))
+        return PA_HOOK_OK;
+
+    if (!(g = pa_hashmap_get(u->groups, &key))) {
+        if (count_streams(u, &key) < u->min_streams)
+            return PA_HOOK_OK;
+
+        if (!(g = group_new(u, &key))) {
+            pa_log("Unable to set up the group for %u Hz on <%s>.", key.rate, key.master->name);
+            return PA_HOOK_OK;
+        }
+
+        /* Bring in the streams that were there before the group */
+        PA_IDXSET_FOREACH(j, key.master->inputs, idx) {
+            struct group k;
+
+            if (j != i && get_key(u, j, &k) && group_compare(&k, &key) == 0)
+                move_stream(j, g->sink);
+        }
+    }
+
+    move_stream(i, g->sink);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_put_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
+    pa_core_assert_ref(core);
+    pa_sink_input_assert_ref(i);
+
+    return process(u, i);
+}
+
+static pa_hook_result_t sink_input_move_finish_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
+    pa_core_assert_ref(core);
+    pa_sink_input_assert_ref(i);
+
+    if (pa_proplist_gets(i->proplist, PA_PROP_RESAMPLE_GROUP_MOVING))
+        return PA_HOOK_OK;
+
+    trigger_housekeeping(u);
+
+    return process(u, i);
+}
+
+static pa_hook_result_t sink_input_unlink_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
+    pa_core_assert_ref(core);
+    pa_sink_input_assert_ref(i);
+    pa_assert(u);
+
+    if (i->sink && find_group_by_sink(u, i->sink))
+        trigger_housekeeping(u);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_unlink_cb(pa_core *core, pa_sink *sink, struct userdata *u) {
+    struct group *g;
+    void *state;
+
+    pa_core_assert_ref(core);
+    pa_sink_assert_ref(sink);
+    pa_assert(u);
+
+    PA_HASHMAP_FOREACH(g, u->groups, state) {
+        if (g->master == sink || g->sink == sink) {
+            /* Hand the streams back to the master rather than leaving
+             * them to a generic rescue */
+            if (g->sink == sink && PA_SINK_IS_LINKED(g->master->state)) {
+                pa_sink_input *i;
+                uint32_t idx;
+
+                PA_IDXSET_FOREACH(i, sink->inputs, idx)
+                    move_stream(i, g->master);
+            }
+
+            pa_module_unload_request_by_index(u->core, g->module_index, true);
+            pa_hashmap_remove(u->groups, g);
+            group_free(g);
+        }
+    }
+
+    return PA_HOOK_OK;
+}
+
+int pa__init(pa_module *m) {
+    pa_modargs *ma = NULL;
+    struct userdata *u;
+    const char *method;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments");
+        goto fail;
+    }
+
+    m->userdata = u = pa_xnew0(struct userdata, 1);
+    u->core = m->core;
+    u->groups = pa_hashmap_new_full(group_hash, group_compare, NULL, (pa_free_cb_t) group_free);
+
+    u->min_streams = DEFAULT_MIN_STREAMS;
+    if (pa_modargs_get_value_u32(ma, "min_streams", &u->min_streams) < 0 || u->min_streams < 1) {
+        pa_log("Failed to parse min_streams value");
+        goto fail;
+    }
+
+    if ((method = pa_modargs_get_value(ma, "resample_method", NULL))) {
+        if (pa_parse_resample_method(method) == PA_RESAMPLER_INVALID) {
+            pa_log("Invalid resample_method value");
+            goto fail;
+        }
+
+        u->resample_method = pa_xstrdup(method);
+    }
+
+    pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_put_cb, u);
+    pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_finish_cb, u);
+    pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_unlink_cb, u);
+    pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_UNLINK], PA_HOOK_LATE-1, (pa_hook_cb_t) sink_unlink_cb, u);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    pa__done(m);
+
+    if (ma)
+        pa_modargs_free(ma);
+
+    return -1;
+}
+
+void pa__done(pa_module *m) {
+    struct userdata *u;
+    struct group *g;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    if (u->housekeeping_time_event)
+        u->core->mainloop->time_free(u->housekeeping_time_event);
+
+    if (u->groups) {
+        while ((g = pa_hashmap_steal_first(u->groups))) {
+            pa_sink_input *i;
+            uint32_t idx;
+
+            PA_IDXSET_FOREACH(i, g->sink->inputs, idx)
+                move_stream(i, g->master);
+
+            pa_module_unload_request_by_index(u->core, g->module_index, true);
+            group_free(g);
+        }
+
+        pa_hashmap_free(u->groups);
+    }
+
+    pa_xfree(u->resample_method);
+    pa_xfree(u);
+}
@@ -0,0 +1,373 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/hook-list.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/resampler.h>
+
+#include "module-resampler-downgrade-symdef.h"
+
+PA_MODULE_AUTHOR("PulseAudio developers");
+PA_MODULE_DESCRIPTION("Use a cheaper resampler for low priority streams while resampling takes too much CPU time");
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(true);
+PA_MODULE_USAGE(
+        "roles=<Comma separated list of roles which may be downgraded> "
+        "resample_method=<The resampler to downgrade to> "
+        "load_threshold=<Percentage of a sink's time spent resampling above which streams are downgraded> "
+        "restore_threshold=<Percentage below which the original resampler is restored> "
+        "interval=<Seconds between two load checks>");
+
+#define DEFAULT_ROLES "music,video,game,event,animation,test"
+#define DEFAULT_RESAMPLE_METHOD "speex-float-1"
+#define DEFAULT_LOAD_THRESHOLD 30
+#define DEFAULT_RESTORE_THRESHOLD 20
+#define DEFAULT_INTERVAL 2
+
+#define PA_PROP_RESAMPLE_METHOD "resample.method"
+
+static const char* const valid_modargs[] = {
+    "roles",
+    "resample_method",
+    "load_threshold",
+    "restore_threshold",
+    "interval",
+    NULL
+};
+
+struct stream {
+    pa_sink_input *sink_input;
+
+    /* Resampler usec counter at the last check, and the time spent
+     * resampling since the check before that */
+    uint32_t last_usec;
+    pa_usec_t cost;
+
+    /* The method to go back to, and the cost measured with it */
+    bool downgraded;
+    pa_resample_method_t original_method;
+    pa_usec_t original_cost;
+};
+
+struct userdata {
+    pa_core *core;
+    pa_hashmap *streams;
+    pa_idxset *roles;
+    pa_resample_method_t method;
+    uint32_t load_threshold, restore_threshold;
+    pa_usec_t interval, last_check;
+    pa_time_event *time_event;
+    pa_hook_slot
+        *sink_input_put_slot,
+        *sink_input_unlink_slot;
+    bool observing;
+};
+
+static void publish_method(pa_sink_input *i) {
+    pa_proplist *pl;
+
+    pl = pa_proplist_new();
+    pa_proplist_sets(pl, PA_PROP_RESAMPLE_METHOD, pa_resample_method_to_string(pa_sink_input_get_resample_method(i)));
+    pa_sink_input_update_proplist(i, PA_UPDATE_REPLACE, pl);
+    pa_proplist_free(pl);
+}
+
+static void stream_free(struct stream *s) {
+    pa_xfree(s);
+}
+
+static void add_stream(struct userdata *u, pa_sink_input *i) {
+    struct stream *s;
+
+    s = pa_xnew0(struct stream, 1);
+    s->sink_input = i;
+    s->last_usec = pa_sink_input_get_resampler_usec(i);
+
+    pa_hashmap_put(u->streams, i, s);
+
+    if (pa_sink_input_get_resample_method(i) != PA_RESAMPLER_INVALID)
+        publish_method(i);
+}
+
+static bool may_downgrade(struct userdata *u, pa_sink_input *i) {
+    const char *role;
+    pa_resample_method_t method;
+
+    if (!(role = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE)))
+        return false;
+
+    if (!pa_idxset_get_by_data(u->roles, role, NULL))
+        return false;
+
+    method = pa_sink_input_get_resample_method(i);
+
+    return method != PA_RESAMPLER_INVALID &&
+        method != PA_RESAMPLER_COPY &&
+        method != PA_RESAMPLER_TRIVIAL &&
+        method != PA_RESAMPLER_PEAKS &&
+        method != u->method;
+}
+
+/* Takes the most expensive low priority stream of the sink down to the
+ * cheap resampler. One stream per check, so that the effect can be
+ * measured before the next one is touched. */
+static void downgrade(struct userdata *u, pa_sink *sink) {
+    struct stream *best = NULL;
+    pa_sink_input *i;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(i, sink->inputs, idx) {
+        struct stream *s;
+
+        if (!(s = pa_hashmap_get(u->streams, i)) || s->downgraded || !may_downgrade(u, i))
+            continue;
+
+        if (!best || s->cost > best->cost)
+            best = s;
+    }
+
+    if (!best)
+        return;
+
+    i = best->sink_input;
+    best->original_method = i->requested_resample_method;
+    best->original_cost = best->cost;
+
+    if (pa_sink_input_set_resample_method(i, u->method) < 0)
+        return;
+
+    pa_log_info("Resampling load on sink %s too high, downgrading sink input %u to %s.",
+                sink->name, i->index, pa_resample_method_to_string(u->method));
+
+    best->downgraded = true;
+    publish_method(i);
+}
+
+/* Restores a downgraded stream if the load with its original cost put
+ * back would still stay below the restore threshold. */
+static void restore(struct userdata *u, pa_sink *sink, pa_usec_t load, pa_usec_t elapsed) {
+    pa_sink_input *i;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(i, sink->inputs, idx) {
+        struct stream *s;
+
+        if (!(s = pa_hashmap_get(u->streams, i)) || !s->downgraded)
+            continue;
+
+        if ((load - s->cost + s->original_cost) * 100 >= u->restore_threshold * elapsed)
+            continue;
+
+        if (pa_sink_input_set_resample_method(i, s->original_method) < 0)
+            continue;
+
+        pa_log_info("Resampling load on sink %s low again, restoring %s for sink input %u.",
+                    sink->name, pa_resample_method_to_string(s->original_method), i->index);
+
+        s->downgraded = false;
+        publish_method(i);
+        return;
+    }
+}
+
+static void check_sink(struct userdata *u, pa_sink *sink, pa_usec_t elapsed) {
+    pa_sink_input *i;
+    pa_usec_t load = 0;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(i, sink->inputs, idx) {
+        struct stream *s;
+        uint32_t usec;
+
+        if (!(s = pa_hashmap_get(u->streams, i)))
+            continue;
+
+        usec = pa_sink_input_get_resampler_usec(i);
+        s->cost = usec - s->last_usec;
+        s->last_usec = usec;
+
+        load += s->cost;
+    }
+
+    if (load * 100 >= u->load_threshold * elapsed)
+        downgrade(u, sink);
+    else if (load * 100 < u->restore_threshold * elapsed)
+        restore(u, sink, load, elapsed);
+}
+
+static void time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+    pa_usec_t now, elapsed;
+    pa_sink *sink;
+    uint32_t idx;
+
+    pa_assert(u);
+
+    now = pa_rtclock_now();
+    elapsed = now - u->last_check;
+    u->last_check = now;
+
+    if (elapsed > 0)
+        PA_IDXSET_FOREACH(sink, u->core->sinks, idx)
+            check_sink(u, sink, elapsed);
+
+    pa_core_rttime_restart(u->core, e, now + u->interval);
+}
+
+static pa_hook_result_t sink_input_put_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
+    pa_core_assert_ref(core);
+    pa_sink_input_assert_ref(i);
+
+    add_stream(u, i);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_unlink_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
+    pa_sink_input_assert_ref(i);
+
+    pa_hashmap_remove_and_free(u->streams, i);
+
+    return PA_HOOK_OK;
+}
+
+int pa__init(pa_module *m) {
+    pa_modargs *ma = NULL;
+    struct userdata *u;
+    const char *roles, *split_state = NULL;
+    char *n;
+    uint32_t interval = DEFAULT_INTERVAL;
+    pa_sink_input *i;
+    uint32_t idx;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments");
+        goto fail;
+    }
+
+    m->userdata = u = pa_xnew0(struct userdata, 1);
+
+    u->core = m->core;
+    u->streams = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                     NULL, (pa_free_cb_t) stream_free);
+
+    u->roles = pa_idxset_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    roles = pa_modargs_get_value(ma, "roles", DEFAULT_ROLES);
+    while ((n = pa_split(roles, ",", &split_state))) {
+        if (n[0] == '\0' || pa_idxset_put(u->roles, n, NULL) < 0)
+            pa_xfree(n);
+    }
+
+    if ((u->method = pa_parse_resample_method(pa_modargs_get_value(ma, "resample_method", DEFAULT_RESAMPLE_METHOD))) == PA_RESAMPLER_INVALID) {
+        pa_log("Invalid resample method");
+        goto fail;
+    }
+
+    u->load_threshold = DEFAULT_LOAD_THRESHOLD;
+    u->restore_threshold = DEFAULT_RESTORE_THRESHOLD;
+
+    if (pa_modargs_get_value_u32(ma, "load_threshold", &u->load_threshold) < 0 ||
+        pa_modargs_get_value_u32(ma, "restore_threshold", &u->restore_threshold) < 0 ||
+        u->load_threshold > 100 || u->restore_threshold > u->load_threshold) {
+        pa_log("Invalid thresholds, must be percentages with restore_threshold <= load_threshold");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "interval", &interval) < 0 || interval < 1) {
+        pa_log("Invalid interval");
+        goto fail;
+    }
+    u->interval = interval * PA_USEC_PER_SEC;
+
+    /* Make the IO threads time the resamplers */
+    pa_sink_input_observe_resampler_usec(m->core, true);
+    u->observing = true;
+
+    PA_IDXSET_FOREACH(i, m->core->sink_inputs, idx)
+        if (PA_SINK_INPUT_IS_LINKED(i->state))
+            add_stream(u, i);
+
+    u->sink_input_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_put_cb, u);
+    u->sink_input_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_unlink_cb, u);
+
+    u->last_check = pa_rtclock_now();
+    u->time_event = pa_core_rttime_new(m->core, u->last_check + u->interval, time_cb, u);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    pa__done(m);
+
+    if (ma)
+        pa_modargs_free(ma);
+
+    return -1;
+}
+
+void pa__done(pa_module *m) {
+    struct userdata* u;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    if (u->time_event)
+        u->core->mainloop->time_free(u->time_event);
+
+    if (u->observing)
+        pa_sink_input_observe_resampler_usec(u->core, false);
+
+    if (u->sink_input_put_slot)
+        pa_hook_slot_free(u->sink_input_put_slot);
+    if (u->sink_input_unlink_slot)
+        pa_hook_slot_free(u->sink_input_unlink_slot);
+
+    if (u->streams) {
+        struct stream *s;
+        void *state;
+
+        /* Give the downgraded streams their resampler back */
+        PA_HASHMAP_FOREACH(s, u->streams, state)
+            if (s->downgraded && PA_SINK_INPUT_IS_LINKED(s->sink_input->state))
+                pa_sink_input_set_resample_method(s->sink_input, s->original_method);
+
+        pa_hashmap_free(u->streams);
+    }
+
+    if (u->roles)
+        pa_idxset_free(u->roles, pa_xfree);
+
+    pa_xfree(u);
+}
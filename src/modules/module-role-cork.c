@@ -263,6 +263,11 @@ int pa__init(pa_module *m) {
     u->sink_input_move_start_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_START], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_start_cb, u);
     u->sink_input_move_finish_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_finish_cb, u);
 
+    /* Streams without a role are of no interest when they appear, but
+     * leaving ones still need to be forgotten */
+    pa_hook_slot_set_property_filter(u->sink_input_put_slot, PA_PROP_MEDIA_ROLE);
+    pa_hook_slot_set_property_filter(u->sink_input_move_finish_slot, PA_PROP_MEDIA_ROLE);
+
     pa_modargs_free(ma);
 
     return 0;
@@ -22,6 +22,7 @@
 #endif
 
 #include <pulse/volume.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/macro.h>
@@ -42,14 +43,18 @@ PA_MODULE_USAGE(
         "trigger_roles=<Comma separated list of roles which will trigger a ducking> "
         "ducking_roles=<Comma separated list of roles which will be ducked> "
         "global=<Should we operate globally or only inside the same device?>"
-        "volume=<Volume for the attenuated streams. Default: -20dB"
+        "volume=<Volume for the attenuated streams. Default: -20dB> "
+        "fade_msec=<Time over which the volume glides when ducking starts and ends. Default: 100>"
 );
 
+#define DEFAULT_FADE_MSEC 100
+
 static const char* const valid_modargs[] = {
     "trigger_roles",
     "ducking_roles",
     "global",
     "volume",
+    "fade_msec",
     NULL
 };
 
@@ -61,6 +66,14 @@ struct userdata {
     pa_idxset *ducked_inputs;
     bool global;
     pa_volume_t volume;
+    pa_usec_t fade;
+
+    /* The trigger streams, each with the sink it was counted on, and how
+     * many of them each sink has */
+    pa_hashmap *trigger_inputs;
+    pa_hashmap *n_triggers;
+    unsigned n_triggers_total;
+
     pa_hook_slot
         *sink_input_put_slot,
         *sink_input_unlink_slot,
@@ -68,103 +81,132 @@ struct userdata {
         *sink_input_move_finish_slot;
 };
 
-static bool sink_has_trigger_streams(struct userdata *u, pa_sink *s, pa_sink_input *ignore) {
-    pa_sink_input *j;
-    uint32_t idx, role_idx;
-    const char *trigger_role;
+static bool has_role(pa_idxset *roles, pa_sink_input *i) {
+    const char *role, *r;
+    uint32_t idx;
 
-    pa_assert(u);
-    pa_sink_assert_ref(s);
+    if (!(role = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE)))
+        return false;
+
+    PA_IDXSET_FOREACH(r, roles, idx)
+        if (pa_streq(role, r))
+            return true;
+
+    return false;
+}
 
-    PA_IDXSET_FOREACH(j, s->inputs, idx) {
-        const char *role;
+static bool sink_is_ducked(struct userdata *u, pa_sink *s) {
+    if (u->global)
+        return u->n_triggers_total > 0;
 
-        if (j == ignore)
-            continue;
+    return pa_hashmap_get(u->n_triggers, s) != NULL;
+}
 
-        if (!(role = pa_proplist_gets(j->proplist, PA_PROP_MEDIA_ROLE)))
-            continue;
+static void duck_input(struct userdata *u, pa_sink_input *i) {
+    pa_cvolume vol;
 
-        PA_IDXSET_FOREACH(trigger_role, u->trigger_roles, role_idx) {
-            if (pa_streq(role, trigger_role)) {
-                pa_log_debug("Found a '%s' stream that will trigger the ducking.", trigger_role);
-                return true;
-            }
-        }
-    }
+    if (pa_idxset_get_by_data(u->ducked_inputs, i, NULL))
+        return;
 
-    return false;
+    vol.channels = 1;
+    vol.values[0] = u->volume;
+
+    pa_log_debug("Ducking sink input %u.", i->index);
+    pa_sink_input_add_volume_factor(i, u->name, &vol, u->fade);
+    pa_idxset_put(u->ducked_inputs, i, NULL);
 }
 
-static void apply_ducking_to_sink(struct userdata *u, pa_sink *s, pa_sink_input *ignore, bool duck) {
-    pa_sink_input *j;
-    uint32_t idx, role_idx;
-    const char *ducking_role;
-    bool trigger = false;
+static void unduck_input(struct userdata *u, pa_sink_input *i) {
+    if (!pa_idxset_remove_by_data(u->ducked_inputs, i, NULL))
+        return;
 
-    pa_assert(u);
-    pa_sink_assert_ref(s);
+    pa_log_debug("Unducking sink input %u.", i->index);
+    pa_sink_input_remove_volume_factor(i, u->name, u->fade);
+}
 
-    PA_IDXSET_FOREACH(j, s->inputs, idx) {
-        const char *role;
-        pa_sink_input *i;
+/* Called when s, or any sink if global, got its first trigger stream */
+static void duck_sink(struct userdata *u, pa_sink *s) {
+    pa_sink_input *i;
+    uint32_t idx;
 
-        if (j == ignore)
-            continue;
+    PA_IDXSET_FOREACH(i, u->global ? u->core->sink_inputs : s->inputs, idx)
+        if (i->sink && has_role(u->ducking_roles, i))
+            duck_input(u, i);
+}
 
-        if (!(role = pa_proplist_gets(j->proplist, PA_PROP_MEDIA_ROLE)))
-            continue;
+/* Called when s, or all sinks if global, lost their last trigger stream.
+ * Only the ducked streams need a look. */
+static void unduck_sink(struct userdata *u, pa_sink *s) {
+    pa_sink_input *i;
+    uint32_t idx;
 
-        PA_IDXSET_FOREACH(ducking_role, u->ducking_roles, role_idx) {
-            if ((trigger = pa_streq(role, ducking_role)))
-                break;
-        }
-        if (!trigger)
-            continue;
-
-        i = pa_idxset_get_by_data(u->ducked_inputs, j, NULL);
-        if (duck && !i) {
-            pa_cvolume vol;
-            vol.channels = 1;
-            vol.values[0] = u->volume;
-
-            pa_log_debug("Found a '%s' stream that should be ducked.", ducking_role);
-            pa_sink_input_add_volume_factor(j, u->name, &vol);
-            pa_idxset_put(u->ducked_inputs, j, NULL);
-        } else if (!duck && i) { /* This stream should not longer be ducked */
-            pa_log_debug("Found a '%s' stream that should be unducked", ducking_role);
-            pa_idxset_remove_by_data(u->ducked_inputs, j, NULL);
-            pa_sink_input_remove_volume_factor(j, u->name);
-        }
-    }
+    PA_IDXSET_FOREACH(i, u->ducked_inputs, idx)
+        if (u->global || i->sink == s)
+            unduck_input(u, i);
 }
 
-static void apply_ducking(struct userdata *u, pa_sink *s, pa_sink_input *ignore, bool duck) {
-    pa_assert(u);
+static void add_trigger(struct userdata *u, pa_sink_input *i) {
+    unsigned *n;
+
+    pa_assert(i->sink);
+
+    if (pa_hashmap_put(u->trigger_inputs, i, i->sink) < 0)
+        return;
 
-    if (u->global) {
-        uint32_t idx;
-        PA_IDXSET_FOREACH(s, u->core->sinks, idx)
-            apply_ducking_to_sink(u, s, ignore, duck);
-    } else
-        apply_ducking_to_sink(u, s, ignore, duck);
+    if (!(n = pa_hashmap_get(u->n_triggers, i->sink))) {
+        n = pa_xnew0(unsigned, 1);
+        pa_hashmap_put(u->n_triggers, i->sink, n);
+    }
+
+    (*n)++;
+    u->n_triggers_total++;
+
+    if (u->global ? u->n_triggers_total == 1 : *n == 1) {
+        pa_log_debug("Sink input %u triggers the ducking.", i->index);
+        duck_sink(u, i->sink);
+    }
 }
 
-static pa_hook_result_t process(struct userdata *u, pa_sink_input *i, bool duck) {
-    bool should_duck = false;
-    const char *role;
+static void remove_trigger(struct userdata *u, pa_sink_input *i) {
+    pa_sink *s;
+    unsigned *n;
+
+    if (!(s = pa_hashmap_remove(u->trigger_inputs, i)))
+        return;
+
+    pa_assert_se(n = pa_hashmap_get(u->n_triggers, s));
+    pa_assert(*n > 0);
+    pa_assert(u->n_triggers_total > 0);
 
+    (*n)--;
+    u->n_triggers_total--;
+
+    if (*n <= 0)
+        pa_hashmap_remove_and_free(u->n_triggers, s);
+
+    if (u->global ? u->n_triggers_total == 0 : *n == 0) {
+        pa_log_debug("The ducking ends with sink input %u.", i->index);
+        unduck_sink(u, s);
+    }
+}
+
+/* Called when i appeared on its sink */
+static pa_hook_result_t process_attach(struct userdata *u, pa_sink_input *i) {
     pa_assert(u);
     pa_sink_input_assert_ref(i);
 
-    if (!(role = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE)))
-        return PA_HOOK_OK;
-
     if (!i->sink)
         return PA_HOOK_OK;
 
-    should_duck = sink_has_trigger_streams(u, i->sink, duck ? NULL : i);
-    apply_ducking(u, i->sink, duck ? NULL : i, should_duck);
+    if (has_role(u->trigger_roles, i))
+        add_trigger(u, i);
+
+    if (has_role(u->ducking_roles, i)) {
+        if (sink_is_ducked(u, i->sink))
+            duck_input(u, i);
+        else
+            unduck_input(u, i);
+    }
 
     return PA_HOOK_OK;
 }
@@ -173,34 +215,41 @@ static pa_hook_result_t sink_input_put_cb(pa_core *core, pa_sink_input *i, struc
     pa_core_assert_ref(core);
     pa_sink_input_assert_ref(i);
 
-    return process(u, i, true);
+    return process_attach(u, i);
 }
 
 static pa_hook_result_t sink_input_unlink_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
     pa_sink_input_assert_ref(i);
 
     pa_idxset_remove_by_data(u->ducked_inputs, i, NULL);
-    return process(u, i, false);
+    remove_trigger(u, i);
+
+    return PA_HOOK_OK;
 }
 
 static pa_hook_result_t sink_input_move_start_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
     pa_core_assert_ref(core);
     pa_sink_input_assert_ref(i);
 
-    return process(u, i, false);
+    /* A ducked stream stays ducked until it arrived, so that it doesn't
+     * get loud for a moment if the new sink is ducked as well */
+    remove_trigger(u, i);
+
+    return PA_HOOK_OK;
 }
 
 static pa_hook_result_t sink_input_move_finish_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
     pa_core_assert_ref(core);
     pa_sink_input_assert_ref(i);
 
-    return process(u, i, true);
+    return process_attach(u, i);
 }
 
 int pa__init(pa_module *m) {
     pa_modargs *ma = NULL;
     struct userdata *u;
     const char *roles;
+    uint32_t fade_msec;
 
     pa_assert(m);
 
@@ -215,6 +264,8 @@ int pa__init(pa_module *m) {
     u->name = m->name;
 
     u->ducked_inputs = pa_idxset_new(NULL, NULL);
+    u->trigger_inputs = pa_hashmap_new(NULL, NULL);
+    u->n_triggers = pa_hashmap_new_full(NULL, NULL, NULL, pa_xfree);
 
     u->trigger_roles = pa_idxset_new(NULL, NULL);
     roles = pa_modargs_get_value(ma, "trigger_roles", NULL);
@@ -263,11 +314,23 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    fade_msec = DEFAULT_FADE_MSEC;
+    if (pa_modargs_get_value_u32(ma, "fade_msec", &fade_msec) < 0) {
+        pa_log("Failed to parse fade_msec parameter");
+        goto fail;
+    }
+    u->fade = (pa_usec_t) fade_msec * PA_USEC_PER_MSEC;
+
     u->sink_input_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_put_cb, u);
     u->sink_input_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_unlink_cb, u);
     u->sink_input_move_start_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_START], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_start_cb, u);
     u->sink_input_move_finish_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_finish_cb, u);
 
+    /* Streams without a role are of no interest when they appear, but
+     * leaving ones still need to be forgotten */
+    pa_hook_slot_set_property_filter(u->sink_input_put_slot, PA_PROP_MEDIA_ROLE);
+    pa_hook_slot_set_property_filter(u->sink_input_move_finish_slot, PA_PROP_MEDIA_ROLE);
+
     pa_modargs_free(ma);
 
     return 0;
@@ -298,11 +361,17 @@ void pa__done(pa_module *m) {
 
     if (u->ducked_inputs) {
         while ((i = pa_idxset_steal_first(u->ducked_inputs, NULL)))
-            pa_sink_input_remove_volume_factor(i, u->name);
+            pa_sink_input_remove_volume_factor(i, u->name, u->fade);
 
         pa_idxset_free(u->ducked_inputs, NULL);
     }
 
+    if (u->trigger_inputs)
+        pa_hashmap_free(u->trigger_inputs);
+
+    if (u->n_triggers)
+        pa_hashmap_free(u->n_triggers);
+
     if (u->sink_input_put_slot)
         pa_hook_slot_free(u->sink_input_put_slot);
     if (u->sink_input_unlink_slot)
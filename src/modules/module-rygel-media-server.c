@@ -50,7 +50,9 @@ PA_MODULE_AUTHOR("Lennart Poettering");
 PA_MODULE_DESCRIPTION("UPnP MediaServer Plugin for Rygel");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 PA_MODULE_LOAD_ONCE(true);
-PA_MODULE_USAGE("display_name=<UPnP Media Server name>");
+PA_MODULE_USAGE(
+        "display_name=<UPnP Media Server name> "
+        "encoding=<pcm or ulaw>");
 
 /* This implements http://live.gnome.org/Rygel/MediaServer2Spec */
 
@@ -160,6 +162,7 @@ PA_MODULE_USAGE("display_name=<UPnP Media Server name>");
 
 static const char* const valid_modargs[] = {
     "display_name",
+    "encoding",
     NULL
 };
 
@@ -172,6 +175,10 @@ struct userdata {
 
     char *display_name;
 
+    /* Offer the 64 kbit/s mu-law streams instead of the raw PCM ones, so
+     * that many renderers fit on a slow network */
+    bool ulaw;
+
     pa_hook_slot *source_new_slot, *source_unlink_slot;
 
     pa_http_protocol *http;
@@ -355,12 +362,15 @@ static void append_variant_urls(DBusMessage *m, DBusMessageIter *iter, const str
     pa_xfree(url);
 }
 
-static void append_variant_mime_type(DBusMessage *m, DBusMessageIter *iter, pa_sink *sink, pa_source *source) {
+static void append_variant_mime_type(DBusMessage *m, DBusMessageIter *iter, const struct userdata *u, pa_sink *sink, pa_source *source) {
     char *mime_type;
 
+    pa_assert(u);
     pa_assert(sink || source);
 
-    if (sink)
+    if (u->ulaw)
+        mime_type = pa_xstrdup("audio/basic");
+    else if (sink)
         mime_type = pa_sample_spec_to_mime_type_mimefy(&sink->sample_spec, &sink->channel_map);
     else
         mime_type = pa_sample_spec_to_mime_type_mimefy(&source->sample_spec, &source->channel_map);
@@ -370,6 +380,11 @@ static void append_variant_mime_type(DBusMessage *m, DBusMessageIter *iter, pa_s
     pa_xfree(mime_type);
 }
 
+/* DLNA has no profile for mu-law */
+static const char *dlna_profile(const struct userdata *u) {
+    return u->ulaw ? "" : "LPCM";
+}
+
 static void append_variant_item_display_name(DBusMessage *m, DBusMessageIter *iter, pa_sink *sink, pa_source *source) {
     const char *display_name;
 
@@ -447,7 +462,7 @@ static void append_property_dict_entry_urls(DBusMessage *m, DBusMessageIter *ite
     pa_assert_se(dbus_message_iter_close_container(iter, &sub));
 }
 
-static void append_property_dict_entry_mime_type(DBusMessage *m, DBusMessageIter *iter, pa_sink *sink, pa_source *source) {
+static void append_property_dict_entry_mime_type(DBusMessage *m, DBusMessageIter *iter, const struct userdata *u, pa_sink *sink, pa_source *source) {
     DBusMessageIter sub;
     const char *property_name = "MIMEType";
 
@@ -455,7 +470,7 @@ static void append_property_dict_entry_mime_type(DBusMessage *m, DBusMessageIter
 
     pa_assert_se(dbus_message_iter_open_container(iter, DBUS_TYPE_DICT_ENTRY, NULL, &sub));
     pa_assert_se(dbus_message_iter_append_basic(&sub, DBUS_TYPE_STRING, &property_name));
-    append_variant_mime_type(m, &sub, sink, source);
+    append_variant_mime_type(m, &sub, u, sink, source);
     pa_assert_se(dbus_message_iter_close_container(iter, &sub));
 }
 
@@ -584,8 +599,8 @@ static void append_sink_or_source_item_properties(
     if (filter_len == 1 && (*filter)[0] == '*' && (*filter)[1] == '\0') {
         append_sink_or_source_item_mediaobject2_properties(r, &sub, path, sink, source);
         append_property_dict_entry_urls(r, &sub, user_data, sink, source);
-        append_property_dict_entry_mime_type(r, &sub, sink, source);
-        append_property_dict_entry_string(r, &sub, "DLNAProfile", "LPCM");
+        append_property_dict_entry_mime_type(r, &sub, user_data, sink, source);
+        append_property_dict_entry_string(r, &sub, "DLNAProfile", dlna_profile(user_data));
     }
     else {
         for (int i = 0; i < filter_len; ++i) {
@@ -606,10 +621,10 @@ static void append_sink_or_source_item_properties(
                 append_property_dict_entry_urls(r, &sub, user_data, sink, source);
             }
             else if (pa_streq(property_name, "MIMEType")) {
-                append_property_dict_entry_mime_type(r, &sub, sink, source);
+                append_property_dict_entry_mime_type(r, &sub, user_data, sink, source);
             }
             else if (pa_streq(property_name, "DLNAProfile")) {
-                append_property_dict_entry_string(r, &sub, "DLNAProfile", "LPCM");
+                append_property_dict_entry_string(r, &sub, "DLNAProfile", dlna_profile(user_data));
             }
         }
     }
@@ -765,7 +780,8 @@ static char *compute_url(const struct userdata *u, const char *name) {
             if (a.port <= 0)
                 a.port = 4714;
 
-            s = pa_sprintf_malloc("http://%s:%u/listen/source/%s", address, a.port, name);
+            s = pa_sprintf_malloc("http://%s:%u/listen/source/%s%s", address, a.port, name,
+                                  u->ulaw ? "?" PA_HTTP_QUERY_ULAW : "");
 
             pa_xfree(a.path_or_host);
             return s;
@@ -774,7 +790,8 @@ static char *compute_url(const struct userdata *u, const char *name) {
         pa_xfree(a.path_or_host);
     }
 
-    return pa_sprintf_malloc("http://@ADDRESS@:4714/listen/source/%s", name);
+    return pa_sprintf_malloc("http://@ADDRESS@:4714/listen/source/%s%s", name,
+                             u->ulaw ? "?" PA_HTTP_QUERY_ULAW : "");
 }
 
 static DBusHandlerResult sinks_and_sources_handler(DBusConnection *c, DBusMessage *m, void *userdata) {
@@ -988,11 +1005,11 @@ static DBusHandlerResult sinks_and_sources_handler(DBusConnection *c, DBusMessag
 
         } else if (message_is_property_get(m, "org.gnome.UPnP.MediaItem2", "MIMEType")) {
             pa_assert_se(r = dbus_message_new_method_return(m));
-            append_variant_mime_type(r, NULL, sink, source);
+            append_variant_mime_type(r, NULL, u, sink, source);
 
         } else if (message_is_property_get(m, "org.gnome.UPnP.MediaItem2", "DLNAProfile")) {
             pa_assert_se(r = dbus_message_new_method_return(m));
-            append_variant_string(r, NULL, "LPCM");
+            append_variant_string(r, NULL, dlna_profile(u));
 
         } else if (message_is_property_get(m, "org.gnome.UPnP.MediaItem2", "URLs")) {
             pa_assert_se(r = dbus_message_new_method_return(m));
@@ -1006,8 +1023,8 @@ static DBusHandlerResult sinks_and_sources_handler(DBusConnection *c, DBusMessag
 
             pa_assert_se(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}", &sub));
 
-            append_property_dict_entry_mime_type(r, &sub, sink, source);
-            append_property_dict_entry_string(r, &sub, "DLNAProfile", "LPCM");
+            append_property_dict_entry_mime_type(r, &sub, u, sink, source);
+            append_property_dict_entry_string(r, &sub, "DLNAProfile", dlna_profile(u));
             append_property_dict_entry_urls(r, &sub, u, sink, source);
 
             pa_assert_se(dbus_message_iter_close_container(&iter, &sub));
@@ -1062,6 +1079,15 @@ int pa__init(pa_module *m) {
     else
         u->display_name = pa_xstrdup(_("Audio on @HOSTNAME@"));
 
+    if ((t = pa_modargs_get_value(ma, "encoding", NULL))) {
+        if (pa_streq(t, "ulaw"))
+            u->ulaw = true;
+        else if (!pa_streq(t, "pcm")) {
+            pa_log("Invalid encoding '%s'.", t);
+            goto fail;
+        }
+    }
+
     u->source_new_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_PUT], PA_HOOK_LATE, (pa_hook_cb_t) source_new_or_unlink_cb, u);
     u->source_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) source_new_or_unlink_cb, u);
 
@@ -0,0 +1,920 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/i18n.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/source.h>
+#include <pulsecore/module.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/io-trace.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/log.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/time-smoother.h>
+
+#include <modules/alsa/alsa-tsched.h>
+
+#include "sim-device.h"
+#include "module-sim-source-symdef.h"
+
+PA_MODULE_DESCRIPTION(_("Source recording from a simulated sound card"));
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(false);
+PA_MODULE_USAGE(
+        "source_name=<name of source> "
+        "source_properties=<properties for the source> "
+        "format=<sample format> "
+        "rate=<sample rate> "
+        "channels=<number of channels> "
+        "channel_map=<channel map> "
+        "fragments=<number of fragments> "
+        "fragment_size=<fragment size> "
+        "tsched=<enable system timer based scheduling mode?> "
+        "tsched_buffer_size=<buffer size when using timer based scheduling> "
+        "tsched_buffer_watermark=<upper fill watermark> "
+        "granularity=<frames the capture position moves at once> "
+        "drift_ppm=<how much faster the card's clock runs, in parts per million> "
+        "jitter_usec=<mean of the random delay added to every wakeup> "
+        "seed=<seed of the random delays>");
+
+/* The policy of alsa-source, so that what is measured here holds for it */
+
+#define DEFAULT_SOURCE_NAME "sim"
+
+#define DEFAULT_TSCHED_BUFFER_USEC (2*PA_USEC_PER_SEC)             /* 2s */
+#define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms */
+
+#define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  */
+#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms */
+#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s */
+#define TSCHED_WATERMARK_INC_THRESHOLD_USEC (0*PA_USEC_PER_MSEC)   /* 0ms */
+#define TSCHED_WATERMARK_DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC) /* 100ms */
+
+#define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms */
+#define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms */
+
+#define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s */
+#define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s */
+
+#define SMOOTHER_MIN_INTERVAL (2*PA_USEC_PER_MSEC)                 /* 2ms */
+#define SMOOTHER_MAX_INTERVAL (200*PA_USEC_PER_MSEC)               /* 200ms */
+
+#define MAX_DRIFT_PPM 100000 /* 10%, more than any card is off */
+
+#define IO_TRACE_ENTRIES 256 /* IO cycles kept for pacmd dump-source-io-trace */
+
+struct userdata {
+    pa_core *core;
+    pa_module *module;
+    pa_source *source;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    pa_sim_device *device;
+
+    size_t
+        frame_size,
+        fragment_size,
+        hwbuf_size,
+        tsched_watermark,
+        tsched_watermark_ref,
+        hwbuf_unused,
+        min_sleep,
+        min_wakeup,
+        watermark_inc_step,
+        watermark_dec_step,
+        watermark_inc_threshold,
+        watermark_dec_threshold,
+        avail_min;
+
+    size_t frames_per_block;
+
+    pa_usec_t watermark_dec_not_before;
+    pa_usec_t min_latency_ref;
+    pa_usec_t tsched_watermark_usec;
+
+    bool use_tsched:1, opened:1;
+
+    bool first;
+
+    /* When the timer or the card wake us up next, PA_USEC_INVALID if
+     * they don't, and whether they did */
+    pa_usec_t timer_deadline, poll_deadline;
+    bool timer_elapsed, polled;
+
+    pa_io_trace *io_trace;
+    pa_io_trace_entry trace_entry; /* the cycle being traced */
+
+    pa_smoother *smoother;
+    uint64_t read_count;
+    pa_usec_t smoother_interval;
+    pa_usec_t last_smoother_update;
+};
+
+static const char* const valid_modargs[] = {
+    "source_name",
+    "source_properties",
+    "format",
+    "rate",
+    "channels",
+    "channel_map",
+    "fragments",
+    "fragment_size",
+    "tsched",
+    "tsched_buffer_size",
+    "tsched_buffer_watermark",
+    "granularity",
+    "drift_ppm",
+    "jitter_usec",
+    "seed",
+    NULL
+};
+
+static void fix_min_sleep_wakeup(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    pa_alsa_tsched_fix_min_sleep_wakeup(&u->source->sample_spec, u->hwbuf_size - u->hwbuf_unused,
+                                        TSCHED_MIN_SLEEP_USEC, TSCHED_MIN_WAKEUP_USEC,
+                                        &u->min_sleep, &u->min_wakeup);
+}
+
+static void fix_tsched_watermark(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    u->tsched_watermark = pa_alsa_tsched_fix_watermark(u->tsched_watermark, u->hwbuf_size - u->hwbuf_unused,
+                                                       u->min_sleep, u->min_wakeup);
+    u->tsched_watermark_usec = pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec);
+}
+
+static void increase_watermark(struct userdata *u) {
+    size_t old_watermark;
+    pa_usec_t old_min_latency, new_min_latency;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    /* First, just try to increase the watermark */
+    old_watermark = u->tsched_watermark;
+    u->tsched_watermark = pa_alsa_tsched_increase_watermark(u->tsched_watermark, u->watermark_inc_step);
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark) {
+        pa_log_info("Increasing wakeup watermark to %0.2f ms",
+                    (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+        return;
+    }
+
+    /* Hmm, we cannot increase the watermark any further, hence let's
+     raise the latency */
+    old_min_latency = u->source->thread_info.min_latency;
+    new_min_latency = pa_alsa_tsched_increase_min_latency(old_min_latency, u->source->thread_info.max_latency,
+                                                          TSCHED_WATERMARK_INC_STEP_USEC);
+
+    if (old_min_latency != new_min_latency) {
+        pa_log_info("Increasing minimal latency to %0.2f ms",
+                    (double) new_min_latency / PA_USEC_PER_MSEC);
+
+        pa_source_set_latency_range_within_thread(u->source, new_min_latency, u->source->thread_info.max_latency);
+    }
+}
+
+static void decrease_watermark(struct userdata *u) {
+    size_t old_watermark;
+    pa_usec_t now;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    now = pa_rtclock_now();
+
+    if (u->watermark_dec_not_before <= 0)
+        goto restart;
+
+    if (u->watermark_dec_not_before > now)
+        return;
+
+    old_watermark = u->tsched_watermark;
+
+    u->tsched_watermark = pa_alsa_tsched_decrease_watermark(u->tsched_watermark, u->watermark_dec_step);
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark)
+        pa_log_info("Decreasing wakeup watermark to %0.2f ms",
+                    (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+
+    /* We don't change the latency range*/
+
+restart:
+    u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+}
+
+static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
+    pa_usec_t usec;
+
+    pa_assert(sleep_usec);
+    pa_assert(process_usec);
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    usec = pa_source_get_requested_latency_within_thread(u->source);
+
+    if (usec == (pa_usec_t) -1)
+        usec = pa_bytes_to_usec(u->hwbuf_size, &u->source->sample_spec);
+
+    pa_alsa_tsched_sleep_time(usec, u->tsched_watermark_usec, sleep_usec, process_usec);
+}
+
+static size_t check_left_to_record(struct userdata *u, size_t n_bytes, bool on_timeout) {
+    size_t left_to_record;
+    size_t rec_space = u->hwbuf_size - u->hwbuf_unused;
+    bool overrun = false;
+
+    /* We use <= instead of < for this check here because an overrun
+     * only happens after the last sample was processed, not already when
+     * it is removed from the buffer. */
+
+    if (n_bytes <= rec_space)
+        left_to_record = rec_space - n_bytes;
+    else {
+
+        /* We got a dropout. What a mess! */
+        left_to_record = 0;
+        overrun = true;
+
+        u->trace_entry.flags |= PA_IO_TRACE_XRUN;
+        pa_metric_inc(u->source->metrics.xruns);
+
+        if (pa_log_ratelimit(PA_LOG_INFO))
+            pa_log_info("Overrun!");
+    }
+
+    if (u->use_tsched) {
+        bool reset_not_before = true;
+
+        if (overrun || left_to_record < u->watermark_inc_threshold)
+            increase_watermark(u);
+        else if (left_to_record > u->watermark_dec_threshold) {
+            reset_not_before = false;
+
+            /* We decrease the watermark only if have actually
+             * been woken up by a timeout. If something else woke
+             * us up it's too easy to fulfill the deadlines... */
+
+            if (on_timeout)
+                decrease_watermark(u);
+        }
+
+        if (reset_not_before)
+            u->watermark_dec_not_before = 0;
+    }
+
+    return left_to_record;
+}
+
+/* Like mmap_read() of alsa-source, posting straight from the ring */
+static int sim_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bool on_timeout) {
+    bool work_done = false;
+    pa_usec_t max_sleep_usec = 0, process_usec = 0;
+    size_t left_to_record = 0;
+    unsigned j = 0;
+
+    pa_assert(u);
+    pa_source_assert_ref(u->source);
+
+    if (u->use_tsched)
+        hw_sleep_time(u, &max_sleep_usec, &process_usec);
+
+    for (;;) {
+        size_t n_bytes;
+
+        pa_io_trace_count_queries(u->io_trace, 1);
+
+        n_bytes = pa_sim_device_avail(u->device, pa_rtclock_now());
+
+        if (j == 0)
+            u->trace_entry.avail = (int64_t) n_bytes;
+
+        left_to_record = check_left_to_record(u, n_bytes, on_timeout);
+        on_timeout = false;
+
+        if (u->use_tsched)
+            if (!polled &&
+                pa_bytes_to_usec(left_to_record, &u->source->sample_spec) > process_usec+max_sleep_usec/2)
+                break;
+
+        if (PA_UNLIKELY(n_bytes <= 0))
+            break;
+
+        if (++j > 10)
+            break;
+
+        polled = false;
+
+        while (n_bytes > 0) {
+            pa_memchunk chunk;
+            size_t length;
+            void *p;
+            pa_usec_t post_start;
+
+            length = PA_MIN(n_bytes, u->frames_per_block * u->frame_size);
+            p = pa_sim_device_begin(u->device, &length);
+
+            chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, length, true);
+            chunk.length = pa_memblock_get_length(chunk.memblock);
+            chunk.index = 0;
+
+            post_start = pa_rtclock_now();
+            pa_source_post(u->source, &chunk);
+            u->trace_entry.process_usec += pa_rtclock_now() - post_start;
+            pa_memblock_unref_fixed(chunk.memblock);
+
+            pa_sim_device_commit(u->device, length);
+
+            work_done = true;
+
+            u->read_count += length;
+
+            n_bytes -= length;
+        }
+    }
+
+    if (u->use_tsched) {
+        *sleep_usec = pa_bytes_to_usec(left_to_record, &u->source->sample_spec);
+        process_usec = u->tsched_watermark_usec;
+
+        if (*sleep_usec > process_usec)
+            *sleep_usec -= process_usec;
+        else
+            *sleep_usec = 0;
+    } else
+        *sleep_usec = 0;
+
+    return work_done ? 1 : 0;
+}
+
+static void update_smoother(struct userdata *u) {
+    int64_t delay;
+    uint64_t position;
+    pa_usec_t now1, now2;
+
+    pa_assert(u);
+
+    now1 = pa_rtclock_now();
+
+    /* check if the time since the last update is bigger than the interval */
+    if (u->last_smoother_update > 0)
+        if (u->last_smoother_update + u->smoother_interval > now1)
+            return;
+
+    pa_io_trace_count_queries(u->io_trace, 1);
+    delay = pa_sim_device_delay(u->device, now1);
+
+    position = u->read_count + (uint64_t) PA_MAX(delay, 0);
+    now2 = pa_bytes_to_usec(position, &u->source->sample_spec);
+
+    pa_smoother_put(u->smoother, now1, now2);
+
+    u->last_smoother_update = now1;
+    /* exponentially increase the update interval up to the MAX limit */
+    u->smoother_interval = PA_MIN (u->smoother_interval * 2, SMOOTHER_MAX_INTERVAL);
+}
+
+static pa_usec_t source_get_latency(struct userdata *u) {
+    int64_t delay;
+    pa_usec_t now1, now2;
+
+    pa_assert(u);
+
+    now1 = pa_rtclock_now();
+    now2 = pa_smoother_get(u->smoother, now1);
+
+    delay = (int64_t) now2 - (int64_t) pa_bytes_to_usec(u->read_count, &u->source->sample_spec);
+
+    return delay >= 0 ? (pa_usec_t) delay : 0;
+}
+
+static void suspend(struct userdata *u) {
+    pa_assert(u);
+
+    pa_smoother_pause(u->smoother, pa_rtclock_now());
+
+    /* Resume with the watermark we learned so far instead of learning it
+     * all over again from the configured one */
+    if (u->use_tsched)
+        u->tsched_watermark_ref = u->tsched_watermark;
+
+    pa_sim_device_drop(u->device);
+    u->opened = false;
+
+    pa_log_info("Device suspended...");
+}
+
+/* Called from IO context */
+static void update_sw_params(struct userdata *u) {
+    pa_assert(u);
+
+    /* Use the full buffer if no one asked us for anything specific */
+    u->hwbuf_unused = 0;
+
+    if (u->use_tsched) {
+        pa_usec_t latency;
+
+        if ((latency = pa_source_get_requested_latency_within_thread(u->source)) != (pa_usec_t) -1) {
+            size_t b;
+
+            pa_log_debug("latency set to %0.2fms", (double) latency / PA_USEC_PER_MSEC);
+
+            b = pa_usec_to_bytes(latency, &u->source->sample_spec);
+
+            /* We need at least one sample in our buffer */
+
+            if (PA_UNLIKELY(b < u->frame_size))
+                b = u->frame_size;
+
+            u->hwbuf_unused = PA_LIKELY(b < u->hwbuf_size) ? (u->hwbuf_size - b) : 0;
+        }
+
+        fix_min_sleep_wakeup(u);
+        fix_tsched_watermark(u);
+    }
+
+    pa_log_debug("hwbuf_unused=%lu", (unsigned long) u->hwbuf_unused);
+
+    u->avail_min = u->frame_size;
+
+    if (u->use_tsched) {
+        pa_usec_t sleep_usec, process_usec;
+
+        hw_sleep_time(u, &sleep_usec, &process_usec);
+        u->avail_min += pa_frame_align(pa_usec_to_bytes(sleep_usec, &u->source->sample_spec), &u->source->sample_spec);
+    }
+
+    pa_log_debug("setting avail_min=%lu", (unsigned long) (u->avail_min / u->frame_size));
+}
+
+/* Called from IO Context on unsuspend or from main thread when creating source */
+static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_sample_spec *ss,
+                            bool in_thread) {
+    u->tsched_watermark = pa_usec_to_bytes_round_up(pa_bytes_to_usec_round_up(tsched_watermark, ss),
+                                                    &u->source->sample_spec);
+
+    u->watermark_inc_step = pa_usec_to_bytes(TSCHED_WATERMARK_INC_STEP_USEC, &u->source->sample_spec);
+    u->watermark_dec_step = pa_usec_to_bytes(TSCHED_WATERMARK_DEC_STEP_USEC, &u->source->sample_spec);
+
+    u->watermark_inc_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_INC_THRESHOLD_USEC, &u->source->sample_spec);
+    u->watermark_dec_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_DEC_THRESHOLD_USEC, &u->source->sample_spec);
+
+    fix_min_sleep_wakeup(u);
+    fix_tsched_watermark(u);
+
+    if (in_thread)
+        pa_source_set_latency_range_within_thread(u->source,
+                                                  u->min_latency_ref,
+                                                  pa_bytes_to_usec(u->hwbuf_size, ss));
+    else {
+        pa_source_set_latency_range(u->source,
+                                    0,
+                                    pa_bytes_to_usec(u->hwbuf_size, ss));
+
+        /* As in alsa-source, min_latency can't be set to 0 from the IO
+         * thread, so keep what it became */
+        u->min_latency_ref = u->source->thread_info.min_latency;
+    }
+
+    pa_log_info("Time scheduling watermark is %0.2fms",
+                (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+}
+
+/* Called from IO context */
+static void unsuspend(struct userdata *u) {
+    pa_assert(u);
+
+    update_sw_params(u);
+
+    u->opened = true;
+
+    u->read_count = 0;
+    pa_smoother_reset(u->smoother, pa_rtclock_now(), true);
+    u->smoother_interval = SMOOTHER_MIN_INTERVAL;
+    u->last_smoother_update = 0;
+
+    u->first = true;
+
+    /* reset the watermark to the value we had when we were suspended */
+    if (u->use_tsched)
+        reset_watermark(u, u->tsched_watermark_ref, &u->source->sample_spec, true);
+
+    pa_log_info("Resumed successfully...");
+}
+
+static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = PA_SOURCE(o)->userdata;
+
+    switch (code) {
+
+        case PA_SOURCE_MESSAGE_GET_LATENCY: {
+            pa_usec_t r = 0;
+
+            if (u->opened)
+                r = source_get_latency(u);
+
+            *((pa_usec_t*) data) = r;
+
+            return 0;
+        }
+
+        case PA_SOURCE_MESSAGE_SET_STATE:
+
+            switch ((pa_source_state_t) PA_PTR_TO_UINT(data)) {
+
+                case PA_SOURCE_SUSPENDED:
+                    pa_assert(PA_SOURCE_IS_OPENED(u->source->thread_info.state));
+
+                    suspend(u);
+                    break;
+
+                case PA_SOURCE_IDLE:
+                case PA_SOURCE_RUNNING:
+
+                    if (u->source->thread_info.state == PA_SOURCE_SUSPENDED)
+                        unsuspend(u);
+
+                    break;
+
+                case PA_SOURCE_UNLINKED:
+                case PA_SOURCE_INIT:
+                case PA_SOURCE_INVALID_STATE:
+                    ;
+            }
+
+            break;
+    }
+
+    return pa_source_process_msg(o, code, data, offset, chunk);
+}
+
+static void source_update_requested_latency_cb(pa_source *s) {
+    struct userdata *u = s->userdata;
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    if (!u->opened)
+        return;
+
+    update_sw_params(u);
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Thread starting up");
+
+    if (u->core->realtime_scheduling)
+        pa_make_realtime(u->core->realtime_priority);
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    for (;;) {
+        pa_usec_t rtpoll_sleep = 0, wakeup;
+        int ret;
+
+        u->timer_deadline = u->poll_deadline = PA_USEC_INVALID;
+
+        /* Read some data and pass it to the source outputs */
+        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+            pa_usec_t sleep_usec = 0;
+            bool on_timeout = u->timer_elapsed;
+
+            u->trace_entry.time = pa_rtclock_now();
+            if (on_timeout)
+                u->trace_entry.flags |= PA_IO_TRACE_TIMEOUT;
+            if (u->polled)
+                u->trace_entry.flags |= PA_IO_TRACE_POLLED;
+
+            if (u->first) {
+                pa_log_info("Starting capture.");
+                pa_sim_device_start(u->device, pa_rtclock_now());
+                pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+
+                u->first = false;
+            }
+
+            if (sim_read(u, &sleep_usec, u->polled, on_timeout) > 0)
+                update_smoother(u);
+
+            if (u->use_tsched) {
+                pa_usec_t cusec;
+
+                /* Convert from the sound card time domain to the
+                 * system time domain */
+                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+
+                /* We don't trust the conversion, so we wake up whatever comes first */
+                rtpoll_sleep = PA_MIN(sleep_usec, cusec);
+
+                if (rtpoll_sleep > 0)
+                    u->timer_deadline = pa_rtclock_now() + rtpoll_sleep;
+            }
+
+            /* Where a poll() on the card would return, with period
+             * events only at the end of a fragment */
+            u->poll_deadline = pa_sim_device_when_avail(u->device, u->avail_min, u->use_tsched ? 0 : u->fragment_size);
+
+            u->trace_entry.sleep_usec = rtpoll_sleep;
+            pa_io_trace_push(u->io_trace, &u->trace_entry);
+            pa_zero(u->trace_entry);
+        }
+
+        wakeup = PA_MIN(u->timer_deadline, u->poll_deadline);
+
+        if (wakeup != PA_USEC_INVALID)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, wakeup + pa_sim_device_next_jitter(u->device));
+        else
+            pa_rtpoll_set_timer_disabled(u->rtpoll);
+
+        /* Hmm, nothing to do. Let's sleep */
+        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+
+        if (wakeup != PA_USEC_INVALID) {
+            pa_usec_t now = pa_rtclock_now();
+
+            u->timer_elapsed = u->timer_deadline != PA_USEC_INVALID && now >= u->timer_deadline;
+            u->polled = u->poll_deadline != PA_USEC_INVALID && now >= u->poll_deadline;
+
+            if (u->timer_elapsed)
+                u->trace_entry.lateness = (int64_t) now - (int64_t) u->timer_deadline;
+        } else
+            u->timer_elapsed = u->polled = false;
+    }
+
+fail:
+    /* If this was no regular exit from the loop we have to continue
+     * processing messages until we received PA_MESSAGE_SHUTDOWN */
+    pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+    pa_asyncmsgq_wait_for(u->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("Thread shutting down");
+}
+
+int pa__init(pa_module*m) {
+    struct userdata *u = NULL;
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_modargs *ma = NULL;
+    pa_source_new_data data;
+    uint32_t nfrags, frag_size, tsched_size, tsched_watermark;
+    uint32_t granularity = 1, jitter_usec = 0, seed = 1;
+    int32_t drift_ppm = 0;
+    size_t frame_size;
+    bool use_tsched = true;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    ss = m->core->default_sample_spec;
+    map = m->core->default_channel_map;
+    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
+        pa_log("Invalid sample format specification or channel map");
+        goto fail;
+    }
+
+    frame_size = pa_frame_size(&ss);
+
+    nfrags = m->core->default_n_fragments;
+    frag_size = (uint32_t) pa_usec_to_bytes(m->core->default_fragment_size_msec*PA_USEC_PER_MSEC, &ss);
+    if (frag_size <= 0)
+        frag_size = (uint32_t) frame_size;
+    tsched_size = (uint32_t) pa_usec_to_bytes(DEFAULT_TSCHED_BUFFER_USEC, &ss);
+    tsched_watermark = (uint32_t) pa_usec_to_bytes(DEFAULT_TSCHED_WATERMARK_USEC, &ss);
+
+    if (pa_modargs_get_value_u32(ma, "fragments", &nfrags) < 0 ||
+        pa_modargs_get_value_u32(ma, "fragment_size", &frag_size) < 0 ||
+        pa_modargs_get_value_u32(ma, "tsched_buffer_size", &tsched_size) < 0 ||
+        pa_modargs_get_value_u32(ma, "tsched_buffer_watermark", &tsched_watermark) < 0) {
+        pa_log("Failed to parse buffer metrics");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "tsched", &use_tsched) < 0) {
+        pa_log("Failed to parse tsched argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "granularity", &granularity) < 0 || granularity <= 0) {
+        pa_log("Failed to parse granularity argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_s32(ma, "drift_ppm", &drift_ppm) < 0 || drift_ppm < -MAX_DRIFT_PPM || drift_ppm > MAX_DRIFT_PPM) {
+        pa_log("Failed to parse drift_ppm argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "jitter_usec", &jitter_usec) < 0 ||
+        pa_modargs_get_value_u32(ma, "seed", &seed) < 0) {
+        pa_log("Failed to parse jitter_usec or seed argument.");
+        goto fail;
+    }
+
+    m->userdata = u = pa_xnew0(struct userdata, 1);
+    u->core = m->core;
+    u->module = m;
+    u->use_tsched = use_tsched;
+    u->first = true;
+    u->timer_deadline = u->poll_deadline = PA_USEC_INVALID;
+
+    u->rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+
+    u->smoother = pa_smoother_new(
+            SMOOTHER_ADJUST_USEC,
+            SMOOTHER_WINDOW_USEC,
+            true,
+            true,
+            5,
+            pa_rtclock_now(),
+            true);
+    u->smoother_interval = SMOOTHER_MIN_INTERVAL;
+
+    /* With timer scheduling the whole buffer is a single period, like
+     * pa_alsa_set_hw_params() tries to get it */
+    u->frame_size = frame_size;
+    if (use_tsched)
+        u->hwbuf_size = u->fragment_size = pa_frame_align(tsched_size, &ss);
+    else {
+        u->fragment_size = pa_frame_align(frag_size, &ss);
+        u->hwbuf_size = u->fragment_size * PA_MAX(nfrags, 2U);
+    }
+
+    if (u->hwbuf_size <= 0) {
+        pa_log("Buffer too small.");
+        goto fail;
+    }
+
+    u->device = pa_sim_device_new(&ss, false, u->hwbuf_size, granularity, drift_ppm, jitter_usec, seed);
+
+    pa_source_new_data_init(&data);
+    data.driver = __FILE__;
+    data.module = m;
+    pa_source_new_data_set_name(&data, pa_modargs_get_value(ma, "source_name", DEFAULT_SOURCE_NAME));
+    pa_source_new_data_set_sample_spec(&data, &ss);
+    pa_source_new_data_set_channel_map(&data, &map);
+    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_DESCRIPTION, _("Simulated Input"));
+    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_CLASS, "sound");
+    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_ACCESS_MODE, "mmap");
+    pa_proplist_setf(data.proplist, PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE, "%lu", (unsigned long) u->hwbuf_size);
+    pa_proplist_setf(data.proplist, PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE, "%lu", (unsigned long) u->fragment_size);
+    pa_proplist_setf(data.proplist, "sim.granularity", "%lu", (unsigned long) granularity);
+    pa_proplist_setf(data.proplist, "sim.drift_ppm", "%li", (long) drift_ppm);
+    pa_proplist_setf(data.proplist, "sim.jitter_usec", "%lu", (unsigned long) jitter_usec);
+
+    if (pa_modargs_get_proplist(ma, "source_properties", data.proplist, PA_UPDATE_REPLACE) < 0) {
+        pa_log("Invalid properties");
+        pa_source_new_data_done(&data);
+        goto fail;
+    }
+
+    u->source = pa_source_new(m->core, &data, PA_SOURCE_HARDWARE|PA_SOURCE_LATENCY|(u->use_tsched ? PA_SOURCE_DYNAMIC_LATENCY : 0));
+    pa_source_new_data_done(&data);
+
+    if (!u->source) {
+        pa_log("Failed to create source object.");
+        goto fail;
+    }
+
+    u->source->parent.process_msg = source_process_msg;
+    if (u->use_tsched)
+        u->source->update_requested_latency = source_update_requested_latency_cb;
+    u->source->userdata = u;
+
+    u->io_trace = pa_io_trace_new(IO_TRACE_ENTRIES);
+    u->source->io_trace = u->io_trace;
+
+    pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
+    pa_source_set_rtpoll(u->source, u->rtpoll);
+
+    u->frames_per_block = pa_mempool_block_size_max(m->core->mempool) / frame_size;
+
+    pa_log_info("Using %0.1f fragments of size %lu bytes (%0.2fms), buffer size is %lu bytes (%0.2fms)",
+                (double) u->hwbuf_size / (double) u->fragment_size,
+                (long unsigned) u->fragment_size,
+                (double) pa_bytes_to_usec(u->fragment_size, &ss) / PA_USEC_PER_MSEC,
+                (long unsigned) u->hwbuf_size,
+                (double) pa_bytes_to_usec(u->hwbuf_size, &ss) / PA_USEC_PER_MSEC);
+
+
+    if (u->use_tsched) {
+        u->tsched_watermark_ref = tsched_watermark;
+        reset_watermark(u, u->tsched_watermark_ref, &ss, false);
+    } else
+        pa_source_set_fixed_latency(u->source, pa_bytes_to_usec(u->hwbuf_size, &ss));
+
+    update_sw_params(u);
+    u->opened = true;
+
+    if (!(u->thread = pa_thread_new("sim-source", thread_func, u))) {
+        pa_log("Failed to create thread.");
+        goto fail;
+    }
+
+    pa_source_put(u->source);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+
+    pa__done(m);
+
+    return -1;
+}
+
+int pa__get_n_used(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+    pa_assert_se(u = m->userdata);
+
+    return pa_source_linked_by(u->source);
+}
+
+void pa__done(pa_module*m) {
+    struct userdata *u;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    if (u->source)
+        pa_source_unlink(u->source);
+
+    if (u->thread) {
+        pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(u->thread);
+    }
+
+    pa_thread_mq_done(&u->thread_mq);
+
+    if (u->source)
+        pa_source_unref(u->source);
+
+    if (u->io_trace)
+        pa_io_trace_free(u->io_trace);
+
+    if (u->device)
+        pa_sim_device_free(u->device);
+
+    if (u->smoother)
+        pa_smoother_free(u->smoother);
+
+    if (u->rtpoll)
+        pa_rtpoll_free(u->rtpoll);
+
+    pa_xfree(u);
+}
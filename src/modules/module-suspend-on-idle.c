@@ -49,6 +49,9 @@ struct userdata {
     pa_core *core;
     pa_usec_t timeout;
     pa_hashmap *device_infos;
+
+    /* Suspends the devices that timed out in one go */
+    pa_defer_event *suspend_event;
 };
 
 struct device_info {
@@ -58,8 +61,51 @@ struct device_info {
     pa_usec_t last_use;
     pa_time_event *time_event;
     pa_usec_t timeout;
+    bool suspend_pending;
 };
 
+static void suspend_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+    struct device_info *d;
+    pa_idxset *sinks, *sources;
+    void *state;
+
+    pa_assert(u);
+
+    u->core->mainloop->defer_enable(u->suspend_event, 0);
+
+    sinks = pa_idxset_new(NULL, NULL);
+    sources = pa_idxset_new(NULL, NULL);
+
+    PA_HASHMAP_FOREACH(d, u->device_infos, state) {
+        if (!d->suspend_pending)
+            continue;
+
+        d->suspend_pending = false;
+
+        if (d->sink && pa_sink_check_suspend(d->sink) <= 0 && !(d->sink->suspend_cause & PA_SUSPEND_IDLE)) {
+            pa_log_info("Sink %s idle for too long, suspending ...", d->sink->name);
+            pa_idxset_put(sinks, d->sink, NULL);
+        }
+
+        if (d->source && pa_source_check_suspend(d->source) <= 0 && !(d->source->suspend_cause & PA_SUSPEND_IDLE)) {
+            pa_log_info("Source %s idle for too long, suspending ...", d->source->name);
+            pa_idxset_put(sources, d->source, NULL);
+        }
+    }
+
+    /* Devices sharing an IO thread, like filters and their masters,
+     * get only one state message for all of them */
+    if (!pa_idxset_isempty(sinks) || !pa_idxset_isempty(sources)) {
+        pa_sink_suspend_many(sinks, true, PA_SUSPEND_IDLE);
+        pa_source_suspend_many(sources, true, PA_SUSPEND_IDLE);
+        pa_core_maybe_vacuum(u->core);
+    }
+
+    pa_idxset_free(sinks, NULL);
+    pa_idxset_free(sources, NULL);
+}
+
 static void timeout_cb(pa_mainloop_api*a, pa_time_event* e, const struct timeval *t, void *userdata) {
     struct device_info *d = userdata;
 
@@ -67,17 +113,10 @@ static void timeout_cb(pa_mainloop_api*a, pa_time_event* e, const struct timeval
 
     d->userdata->core->mainloop->time_restart(d->time_event, NULL);
 
-    if (d->sink && pa_sink_check_suspend(d->sink) <= 0 && !(d->sink->suspend_cause & PA_SUSPEND_IDLE)) {
-        pa_log_info("Sink %s idle for too long, suspending ...", d->sink->name);
-        pa_sink_suspend(d->sink, true, PA_SUSPEND_IDLE);
-        pa_core_maybe_vacuum(d->userdata->core);
-    }
-
-    if (d->source && pa_source_check_suspend(d->source) <= 0 && !(d->source->suspend_cause & PA_SUSPEND_IDLE)) {
-        pa_log_info("Source %s idle for too long, suspending ...", d->source->name);
-        pa_source_suspend(d->source, true, PA_SUSPEND_IDLE);
-        pa_core_maybe_vacuum(d->userdata->core);
-    }
+    /* Devices that went idle together usually time out in the same
+     * iteration, collect them */
+    d->suspend_pending = true;
+    d->userdata->core->mainloop->defer_enable(d->userdata->suspend_event, 1);
 }
 
 static void restart(struct device_info *d) {
@@ -99,6 +138,7 @@ static void resume(struct device_info *d) {
     pa_assert(d);
 
     d->userdata->core->mainloop->time_restart(d->time_event, NULL);
+    d->suspend_pending = false;
 
     if (d->sink) {
         pa_log_debug("Sink %s becomes busy, resuming.", d->sink->name);
@@ -346,6 +386,7 @@ static pa_hook_result_t device_new_hook_cb(pa_core *c, pa_object *o, struct user
     d->source = source ? pa_source_ref(source) : NULL;
     d->sink = sink ? pa_sink_ref(sink) : NULL;
     d->time_event = pa_core_rttime_new(c, PA_USEC_INVALID, timeout_cb, d);
+    d->suspend_pending = false;
 
     if (timeout_valid)
         d->timeout = timeout * PA_USEC_PER_SEC;
@@ -438,6 +479,8 @@ int pa__init(pa_module*m) {
     u->core = m->core;
     u->timeout = timeout * PA_USEC_PER_SEC;
     u->device_infos = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, (pa_free_cb_t) device_info_free);
+    u->suspend_event = m->core->mainloop->defer_new(m->core->mainloop, suspend_cb, u);
+    m->core->mainloop->defer_enable(u->suspend_event, 0);
 
     PA_IDXSET_FOREACH(sink, m->core->sinks, idx)
         device_new_hook_cb(m->core, PA_OBJECT(sink), u);
@@ -486,5 +529,8 @@ void pa__done(pa_module*m) {
 
     pa_hashmap_free(u->device_infos);
 
+    if (u->suspend_event)
+        m->core->mainloop->defer_free(u->suspend_event);
+
     pa_xfree(u);
 }
@@ -54,6 +54,7 @@ struct userdata {
 
 static pa_hook_result_t sink_put_hook_callback(pa_core *c, pa_sink *sink, void* userdata) {
     pa_sink_input *i;
+    pa_idxset *inputs;
     uint32_t idx;
     pa_sink *def;
     const char *s;
@@ -92,18 +93,32 @@ static pa_hook_result_t sink_put_hook_callback(pa_core *c, pa_sink *sink, void*
         return PA_HOOK_OK;
     }
 
+    inputs = pa_idxset_new(NULL, NULL);
+
     PA_IDXSET_FOREACH(i, def->inputs, idx) {
         if (i->save_sink || !PA_SINK_INPUT_IS_LINKED(i->state))
             continue;
 
-        if (pa_sink_input_move_to(i, sink, false) < 0)
+        pa_idxset_put(inputs, pa_sink_input_ref(i), NULL);
+    }
+
+    /* Move them all at once, so that both IO threads are only bothered
+     * once */
+    pa_sink_input_move_all_to(inputs, sink, false);
+
+    while ((i = pa_idxset_steal_first(inputs, NULL))) {
+        if (i->sink != sink)
             pa_log_info("Failed to move sink input %u \"%s\" to %s.", i->index,
                         pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), sink->name);
         else
             pa_log_info("Successfully moved sink input %u \"%s\" to %s.", i->index,
                         pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), sink->name);
+
+        pa_sink_input_unref(i);
     }
 
+    pa_idxset_free(inputs, NULL);
+
     return PA_HOOK_OK;
 }
 
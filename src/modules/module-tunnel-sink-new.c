@@ -28,9 +28,11 @@
 #include <pulse/mainloop.h>
 #include <pulse/introspect.h>
 #include <pulse/error.h>
+#include <pulse/rtclock.h>
 
 #include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/modargs.h>
@@ -55,15 +57,26 @@ PA_MODULE_USAGE(
         "channels=<number of channels> "
         "rate=<sample rate> "
         "channel_map=<channel map> "
-        "cookie=<cookie file path>"
+        "cookie=<cookie file path> "
+        "compress=<compress the audio data on the network?> "
+        "adjust_latency=<let the remote server keep the total latency at the requested one?> "
+        "reconnect=<keep the sink and reconnect when the connection to the server is lost?>"
         );
 
 #define MAX_LATENCY_USEC (200 * PA_USEC_PER_MSEC)
 #define TUNNEL_THREAD_FAILED_MAINLOOP 1
 
+/* The delay before a reconnection attempt doubles after each failure */
+#define RECONNECT_MIN_USEC (1 * PA_USEC_PER_SEC)
+#define RECONNECT_MAX_USEC (60 * PA_USEC_PER_SEC)
+
+/* How often the sink keeps up with real time while disconnected */
+#define OFFLINE_INTERVAL_USEC (20 * PA_USEC_PER_MSEC)
+
 static void stream_state_cb(pa_stream *stream, void *userdata);
 static void stream_changed_buffer_attr_cb(pa_stream *stream, void *userdata);
 static void stream_set_buffer_attr_cb(pa_stream *stream, int success, void *userdata);
+static void stream_write_cb(pa_stream *stream, size_t nbytes, void *userdata);
 static void context_state_cb(pa_context *c, void *userdata);
 static void sink_update_requested_latency_cb(pa_sink *s);
 
@@ -82,6 +95,18 @@ struct userdata {
 
     bool connected;
 
+    bool compress;
+
+    bool reconnect;
+    pa_usec_t reconnect_delay;
+    pa_time_event *reconnect_event;
+    pa_time_event *offline_event;
+    pa_usec_t offline_timestamp;
+    bool adjust_latency;
+
+    /* The server asked for data before we could render any */
+    bool write_pending;
+
     char *cookie_file;
     char *remote_server;
     char *remote_sink_name;
@@ -97,7 +122,9 @@ static const char* const valid_modargs[] = {
     "rate",
     "channel_map",
     "cookie",
-   /* "reconnect", reconnect if server comes back again - unimplemented */
+    "compress",
+    "adjust_latency",
+    "reconnect",
     NULL,
 };
 
@@ -140,13 +167,106 @@ static pa_proplist* tunnel_new_proplist(struct userdata *u) {
     return proplist;
 }
 
-static void thread_func(void *userdata) {
+/* Renders straight into the memory libpulse sends from, as much as the
+ * server asked for. Returns -1 if the stream failed.
+ *
+ * Called from the IO thread */
+static int write_stream(struct userdata *u) {
+    size_t writable;
+
+    u->write_pending = false;
+
+    if (!u->connected ||
+            pa_stream_get_state(u->stream) != PA_STREAM_READY ||
+            !PA_SINK_IS_LINKED(u->sink->thread_info.state)) {
+        u->write_pending = true;
+        return 0;
+    }
+
+    writable = pa_stream_writable_size(u->stream);
+    while (writable > 0) {
+        pa_memchunk memchunk;
+        void *p;
+        size_t nbytes = writable;
+
+        if (pa_stream_begin_write(u->stream, &p, &nbytes) < 0) {
+            pa_log_error("Could not get a buffer from the stream: %s", pa_strerror(pa_context_errno(u->context)));
+            return -1;
+        }
+
+        nbytes = pa_frame_align(PA_MIN(nbytes, writable), &u->sink->sample_spec);
+        if (nbytes == 0) {
+            pa_stream_cancel_write(u->stream);
+            break;
+        }
+
+        memchunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, p, nbytes, false);
+        memchunk.index = 0;
+        memchunk.length = nbytes;
+        pa_sink_render_into_full(u->sink, &memchunk);
+        pa_memblock_unref_fixed(memchunk.memblock);
+
+        /* The data lies in the buffer of pa_stream_begin_write(), so
+         * libpulse sends it without a copy */
+        if (pa_stream_write(u->stream, p, nbytes, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+            pa_log_error("Could not write data into the stream: %s", pa_strerror(pa_context_errno(u->context)));
+            return -1;
+        }
+
+        writable -= nbytes;
+    }
+
+    return 0;
+}
+
+static void offline_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *t, void *userdata) {
     struct userdata *u = userdata;
-    pa_proplist *proplist;
+    struct timeval tv;
+    pa_usec_t now;
+
     pa_assert(u);
 
-    pa_log_debug("Thread starting up");
-    pa_thread_mq_install(u->thread_mq);
+    now = pa_rtclock_now();
+
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        size_t nbytes = pa_usec_to_bytes(now - u->offline_timestamp, &u->sink->sample_spec);
+
+        /* Nobody listens, but the streams keep playing */
+        while (nbytes > 0) {
+            pa_memchunk memchunk;
+
+            pa_sink_render(u->sink, nbytes, &memchunk);
+            nbytes -= PA_MIN(nbytes, memchunk.length);
+            pa_memblock_unref(memchunk.memblock);
+        }
+    }
+
+    u->offline_timestamp = now;
+    api->time_restart(e, pa_timeval_rtstore(&tv, now + OFFLINE_INTERVAL_USEC, true));
+}
+
+static void enable_offline_timer(struct userdata *u, bool enable) {
+    struct timeval tv;
+
+    if (enable) {
+        if (u->offline_event)
+            return;
+
+        u->offline_timestamp = pa_rtclock_now();
+        u->offline_event = u->thread_mainloop_api->time_new(u->thread_mainloop_api,
+                                                            pa_timeval_rtstore(&tv, u->offline_timestamp + OFFLINE_INTERVAL_USEC, true),
+                                                            offline_cb, u);
+    } else {
+        if (!u->offline_event)
+            return;
+
+        u->thread_mainloop_api->time_free(u->offline_event);
+        u->offline_event = NULL;
+    }
+}
+
+static int connect_context(struct userdata *u) {
+    pa_proplist *proplist;
 
     proplist = tunnel_new_proplist(u);
     u->context = pa_context_new_with_proplist(u->thread_mainloop_api,
@@ -156,12 +276,12 @@ static void thread_func(void *userdata) {
 
     if (!u->context) {
         pa_log("Failed to create libpulse context");
-        goto fail;
+        return -1;
     }
 
     if (u->cookie_file && pa_context_load_cookie_from_file(u->context, u->cookie_file) != 0) {
         pa_log_error("Can not load cookie file!");
-        goto fail;
+        return -1;
     }
 
     pa_context_set_state_callback(u->context, context_state_cb, u);
@@ -169,8 +289,91 @@ static void thread_func(void *userdata) {
                            u->remote_server,
                            PA_CONTEXT_NOAUTOSPAWN,
                            NULL) < 0) {
-        pa_log("Failed to connect libpulse context");
-        goto fail;
+        pa_log("Failed to connect libpulse context: %s", pa_strerror(pa_context_errno(u->context)));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void disconnect_context(struct userdata *u) {
+    u->connected = false;
+
+    /* Tearing down must not look like another lost connection */
+    if (u->stream) {
+        pa_stream_set_state_callback(u->stream, NULL, NULL);
+        pa_stream_disconnect(u->stream);
+        pa_stream_unref(u->stream);
+        u->stream = NULL;
+    }
+
+    if (u->context) {
+        pa_context_set_state_callback(u->context, NULL, NULL);
+        pa_context_disconnect(u->context);
+        pa_context_unref(u->context);
+        u->context = NULL;
+    }
+}
+
+static void connection_lost(struct userdata *u);
+
+static void reconnect_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    api->time_free(e);
+    u->reconnect_event = NULL;
+
+    pa_log_info("Reconnecting to %s.", u->remote_server);
+
+    disconnect_context(u);
+    if (connect_context(u) < 0)
+        connection_lost(u);
+}
+
+/* Without reconnect the module goes away with the connection. Otherwise
+ * the sink stays and keeps up with real time on its own until the stream is
+ * up again. The old context is only dropped on the next attempt, as we
+ * may be called from within its callbacks. */
+static void connection_lost(struct userdata *u) {
+    struct timeval tv;
+
+    pa_assert(u);
+
+    u->connected = false;
+
+    if (!u->reconnect) {
+        u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+        return;
+    }
+
+    /* The stream and the context often fail together */
+    if (u->reconnect_event)
+        return;
+
+    pa_log_info("Connection to %s lost, trying again in %0.1f s.", u->remote_server, (double) u->reconnect_delay / PA_USEC_PER_SEC);
+
+    u->reconnect_event = u->thread_mainloop_api->time_new(u->thread_mainloop_api,
+                                                          pa_timeval_rtstore(&tv, pa_rtclock_now() + u->reconnect_delay, true),
+                                                          reconnect_cb, u);
+    u->reconnect_delay = PA_MIN(u->reconnect_delay * 2, RECONNECT_MAX_USEC);
+
+    enable_offline_timer(u, true);
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
+    pa_assert(u);
+
+    pa_log_debug("Thread starting up");
+    pa_thread_mq_install(u->thread_mq);
+
+    if (connect_context(u) < 0) {
+        if (!u->reconnect)
+            goto fail;
+
+        connection_lost(u);
     }
 
     for (;;) {
@@ -186,57 +389,26 @@ static void thread_func(void *userdata) {
         if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
             pa_sink_process_rewind(u->sink, 0);
 
-        if (u->connected &&
-                pa_stream_get_state(u->stream) == PA_STREAM_READY &&
-                PA_SINK_IS_LINKED(u->sink->thread_info.state)) {
-            size_t writable;
-
-            writable = pa_stream_writable_size(u->stream);
-            if (writable > 0) {
-                pa_memchunk memchunk;
-                const void *p;
-
-                pa_sink_render_full(u->sink, writable, &memchunk);
-
-                pa_assert(memchunk.length > 0);
-
-                /* we have new data to write */
-                p = pa_memblock_acquire(memchunk.memblock);
-                /* TODO: Use pa_stream_begin_write() to reduce copying. */
-                ret = pa_stream_write(u->stream,
-                                      (uint8_t*) p + memchunk.index,
-                                      memchunk.length,
-                                      NULL,     /**< A cleanup routine for the data or NULL to request an internal copy */
-                                      0,        /** offset */
-                                      PA_SEEK_RELATIVE);
-                pa_memblock_release(memchunk.memblock);
-                pa_memblock_unref(memchunk.memblock);
-
-                if (ret != 0) {
-                    pa_log_error("Could not write data into the stream ... ret = %i", ret);
-                    u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
-                }
-
-            }
-        }
+        /* Data is written when the server asks for it, in
+         * stream_write_cb(). This only catches up on a request that came
+         * in before the stream or the sink was ready. */
+        if (u->write_pending && write_stream(u) < 0)
+            u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
     }
 fail:
     pa_asyncmsgq_post(u->thread_mq->outq, PA_MSGOBJECT(u->module->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
     pa_asyncmsgq_wait_for(u->thread_mq->inq, PA_MESSAGE_SHUTDOWN);
 
 finish:
-    if (u->stream) {
-        pa_stream_disconnect(u->stream);
-        pa_stream_unref(u->stream);
-        u->stream = NULL;
-    }
+    enable_offline_timer(u, false);
 
-    if (u->context) {
-        pa_context_disconnect(u->context);
-        pa_context_unref(u->context);
-        u->context = NULL;
+    if (u->reconnect_event) {
+        u->thread_mainloop_api->time_free(u->reconnect_event);
+        u->reconnect_event = NULL;
     }
 
+    disconnect_context(u);
+
     pa_log_debug("Thread shutting down");
 }
 
@@ -248,13 +420,16 @@ static void stream_state_cb(pa_stream *stream, void *userdata) {
     switch (pa_stream_get_state(stream)) {
         case PA_STREAM_FAILED:
             pa_log_error("Stream failed.");
-            u->connected = false;
-            u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+            connection_lost(u);
             break;
         case PA_STREAM_TERMINATED:
             pa_log_debug("Stream terminated.");
             break;
         case PA_STREAM_READY:
+            /* Back from a lost connection, the next one gets the shortest delay again */
+            u->reconnect_delay = RECONNECT_MIN_USEC;
+            enable_offline_timer(u, false);
+
             if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
                 cork_stream(u, false);
 
@@ -272,6 +447,16 @@ static void stream_state_cb(pa_stream *stream, void *userdata) {
     }
 }
 
+/* called when the remote server requests more data */
+static void stream_write_cb(pa_stream *stream, size_t nbytes, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    if (write_stream(u) < 0)
+        u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+}
+
 /* called when remote server changes the stream buffer_attr */
 static void stream_changed_buffer_attr_cb(pa_stream *stream, void *userdata) {
     struct userdata *u = userdata;
@@ -335,10 +520,13 @@ static void context_state_cb(pa_context *c, void *userdata) {
 
             pa_stream_set_state_callback(u->stream, stream_state_cb, userdata);
             pa_stream_set_buffer_attr_callback(u->stream, stream_changed_buffer_attr_cb, userdata);
+            pa_stream_set_write_callback(u->stream, stream_write_cb, userdata);
             if (pa_stream_connect_playback(u->stream,
                                            u->remote_sink_name,
                                            &bufferattr,
-                                           PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_DONT_MOVE | PA_STREAM_START_CORKED | PA_STREAM_AUTO_TIMING_UPDATE,
+                                           PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_DONT_MOVE | PA_STREAM_START_CORKED | PA_STREAM_AUTO_TIMING_UPDATE |
+                                           (u->compress ? PA_STREAM_COMPRESS : 0) |
+                                           (u->adjust_latency ? PA_STREAM_ADJUST_LATENCY : 0),
                                            NULL,
                                            NULL) < 0) {
                 pa_log_error("Could not connect stream.");
@@ -349,13 +537,11 @@ static void context_state_cb(pa_context *c, void *userdata) {
         }
         case PA_CONTEXT_FAILED:
             pa_log_debug("Context failed: %s.", pa_strerror(pa_context_errno(u->context)));
-            u->connected = false;
-            u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+            connection_lost(u);
             break;
         case PA_CONTEXT_TERMINATED:
             pa_log_debug("Context terminated.");
-            u->connected = false;
-            u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+            connection_lost(u);
             break;
     }
 }
@@ -496,6 +682,23 @@ int pa__init(pa_module *m) {
     u->cookie_file = pa_xstrdup(pa_modargs_get_value(ma, "cookie", NULL));
     u->remote_sink_name = pa_xstrdup(pa_modargs_get_value(ma, "sink", NULL));
 
+    if (pa_modargs_get_value_boolean(ma, "compress", &u->compress) < 0) {
+        pa_log("Failed to parse compress argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "reconnect", &u->reconnect) < 0) {
+        pa_log("Failed to parse reconnect argument.");
+        goto fail;
+    }
+
+    u->reconnect_delay = RECONNECT_MIN_USEC;
+
+    if (pa_modargs_get_value_boolean(ma, "adjust_latency", &u->adjust_latency) < 0) {
+        pa_log("Failed to parse adjust_latency argument.");
+        goto fail;
+    }
+
     u->thread_mq = pa_xnew0(pa_thread_mq, 1);
     pa_thread_mq_init_thread_mainloop(u->thread_mq, m->core->mainloop, u->thread_mainloop_api);
 
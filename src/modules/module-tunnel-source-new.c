@@ -28,9 +28,11 @@
 #include <pulse/mainloop.h>
 #include <pulse/introspect.h>
 #include <pulse/error.h>
+#include <pulse/rtclock.h>
 
 #include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/source.h>
 #include <pulsecore/modargs.h>
@@ -55,11 +57,20 @@ PA_MODULE_USAGE(
         "channels=<number of channels> "
         "rate=<sample rate> "
         "channel_map=<channel map> "
-        "cookie=<cookie file path>"
+        "cookie=<cookie file path> "
+        "compress=<compress the audio data on the network?> "
+        "reconnect=<keep the source and reconnect when the connection to the server is lost?>"
         );
 
 #define TUNNEL_THREAD_FAILED_MAINLOOP 1
 
+/* The delay before a reconnection attempt doubles after each failure */
+#define RECONNECT_MIN_USEC (1 * PA_USEC_PER_SEC)
+#define RECONNECT_MAX_USEC (60 * PA_USEC_PER_SEC)
+
+/* How often the source keeps up with real time while disconnected */
+#define OFFLINE_INTERVAL_USEC (20 * PA_USEC_PER_MSEC)
+
 static void stream_state_cb(pa_stream *stream, void *userdata);
 static void stream_read_cb(pa_stream *s, size_t length, void *userdata);
 static void context_state_cb(pa_context *c, void *userdata);
@@ -80,6 +91,14 @@ struct userdata {
     bool connected;
     bool new_data;
 
+    bool compress;
+
+    bool reconnect;
+    pa_usec_t reconnect_delay;
+    pa_time_event *reconnect_event;
+    pa_time_event *offline_event;
+    pa_usec_t offline_timestamp;
+
     char *cookie_file;
     char *remote_server;
     char *remote_source_name;
@@ -95,7 +114,8 @@ static const char* const valid_modargs[] = {
     "rate",
     "channel_map",
     "cookie",
-   /* "reconnect", reconnect if server comes back again - unimplemented */
+    "compress",
+    "reconnect",
     NULL,
 };
 
@@ -188,14 +208,60 @@ static void read_new_samples(struct userdata *u) {
     }
 }
 
-static void thread_func(void *userdata) {
+static void offline_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *t, void *userdata) {
     struct userdata *u = userdata;
-    pa_proplist *proplist;
+    struct timeval tv;
+    pa_usec_t now;
 
     pa_assert(u);
 
-    pa_log_debug("Thread starting up");
-    pa_thread_mq_install(u->thread_mq);
+    now = pa_rtclock_now();
+
+    if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+        size_t nbytes = pa_usec_to_bytes(now - u->offline_timestamp, &u->source->sample_spec);
+        pa_memchunk memchunk;
+
+        /* The recording streams get silence instead of stalling */
+        memchunk = u->source->silence;
+        pa_memblock_ref(memchunk.memblock);
+
+        while (nbytes > 0) {
+            if (nbytes < memchunk.length)
+                memchunk.length = nbytes;
+
+            pa_source_post(u->source, &memchunk);
+            nbytes -= memchunk.length;
+        }
+
+        pa_memblock_unref(memchunk.memblock);
+    }
+
+    u->offline_timestamp = now;
+    api->time_restart(e, pa_timeval_rtstore(&tv, now + OFFLINE_INTERVAL_USEC, true));
+}
+
+static void enable_offline_timer(struct userdata *u, bool enable) {
+    struct timeval tv;
+
+    if (enable) {
+        if (u->offline_event)
+            return;
+
+        u->offline_timestamp = pa_rtclock_now();
+        u->offline_event = u->thread_mainloop_api->time_new(u->thread_mainloop_api,
+                                                            pa_timeval_rtstore(&tv, u->offline_timestamp + OFFLINE_INTERVAL_USEC, true),
+                                                            offline_cb, u);
+    } else {
+        if (!u->offline_event)
+            return;
+
+        u->thread_mainloop_api->time_free(u->offline_event);
+        u->offline_event = NULL;
+    }
+}
+
+static int connect_context(struct userdata *u) {
+    pa_proplist *proplist;
 
     proplist = tunnel_new_proplist(u);
     u->context = pa_context_new_with_proplist(u->thread_mainloop_api,
@@ -205,12 +271,12 @@ static void thread_func(void *userdata) {
 
     if (!u->context) {
         pa_log("Failed to create libpulse context");
-        goto fail;
+        return -1;
     }
 
     if (u->cookie_file && pa_context_load_cookie_from_file(u->context, u->cookie_file) != 0) {
         pa_log_error("Can not load cookie file!");
-        goto fail;
+        return -1;
     }
 
     pa_context_set_state_callback(u->context, context_state_cb, u);
@@ -219,7 +285,91 @@ static void thread_func(void *userdata) {
                            PA_CONTEXT_NOAUTOSPAWN,
                            NULL) < 0) {
         pa_log("Failed to connect libpulse context: %s", pa_strerror(pa_context_errno(u->context)));
-        goto fail;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void disconnect_context(struct userdata *u) {
+    u->connected = false;
+
+    /* Tearing down must not look like another lost connection */
+    if (u->stream) {
+        pa_stream_set_state_callback(u->stream, NULL, NULL);
+        pa_stream_disconnect(u->stream);
+        pa_stream_unref(u->stream);
+        u->stream = NULL;
+    }
+
+    if (u->context) {
+        pa_context_set_state_callback(u->context, NULL, NULL);
+        pa_context_disconnect(u->context);
+        pa_context_unref(u->context);
+        u->context = NULL;
+    }
+}
+
+static void connection_lost(struct userdata *u);
+
+static void reconnect_cb(pa_mainloop_api *api, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    api->time_free(e);
+    u->reconnect_event = NULL;
+
+    pa_log_info("Reconnecting to %s.", u->remote_server);
+
+    disconnect_context(u);
+    if (connect_context(u) < 0)
+        connection_lost(u);
+}
+
+/* Without reconnect the module goes away with the connection. Otherwise
+ * the source stays and keeps up with real time on its own until the stream is
+ * up again. The old context is only dropped on the next attempt, as we
+ * may be called from within its callbacks. */
+static void connection_lost(struct userdata *u) {
+    struct timeval tv;
+
+    pa_assert(u);
+
+    u->connected = false;
+
+    if (!u->reconnect) {
+        u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+        return;
+    }
+
+    /* The stream and the context often fail together */
+    if (u->reconnect_event)
+        return;
+
+    pa_log_info("Connection to %s lost, trying again in %0.1f s.", u->remote_server, (double) u->reconnect_delay / PA_USEC_PER_SEC);
+
+    u->reconnect_event = u->thread_mainloop_api->time_new(u->thread_mainloop_api,
+                                                          pa_timeval_rtstore(&tv, pa_rtclock_now() + u->reconnect_delay, true),
+                                                          reconnect_cb, u);
+    u->reconnect_delay = PA_MIN(u->reconnect_delay * 2, RECONNECT_MAX_USEC);
+
+    enable_offline_timer(u, true);
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Thread starting up");
+    pa_thread_mq_install(u->thread_mq);
+
+    if (connect_context(u) < 0) {
+        if (!u->reconnect)
+            goto fail;
+
+        connection_lost(u);
     }
 
     for (;;) {
@@ -240,18 +390,15 @@ fail:
     pa_asyncmsgq_wait_for(u->thread_mq->inq, PA_MESSAGE_SHUTDOWN);
 
 finish:
-    if (u->stream) {
-        pa_stream_disconnect(u->stream);
-        pa_stream_unref(u->stream);
-        u->stream = NULL;
-    }
+    enable_offline_timer(u, false);
 
-    if (u->context) {
-        pa_context_disconnect(u->context);
-        pa_context_unref(u->context);
-        u->context = NULL;
+    if (u->reconnect_event) {
+        u->thread_mainloop_api->time_free(u->reconnect_event);
+        u->reconnect_event = NULL;
     }
 
+    disconnect_context(u);
+
     pa_log_debug("Thread shutting down");
 }
 
@@ -263,13 +410,16 @@ static void stream_state_cb(pa_stream *stream, void *userdata) {
     switch (pa_stream_get_state(stream)) {
         case PA_STREAM_FAILED:
             pa_log_error("Stream failed: %s", pa_strerror(pa_context_errno(u->context)));
-            u->connected = false;
-            u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+            connection_lost(u);
             break;
         case PA_STREAM_TERMINATED:
             pa_log_debug("Stream terminated.");
             break;
         case PA_STREAM_READY:
+            /* Back from a lost connection, the next one gets the shortest delay again */
+            u->reconnect_delay = RECONNECT_MIN_USEC;
+            enable_offline_timer(u, false);
+
             if (PA_SOURCE_IS_OPENED(u->source->thread_info.state))
                 cork_stream(u, false);
 
@@ -336,7 +486,8 @@ static void context_state_cb(pa_context *c, void *userdata) {
             if (pa_stream_connect_record(u->stream,
                                          u->remote_source_name,
                                          &bufferattr,
-                                         PA_STREAM_INTERPOLATE_TIMING|PA_STREAM_DONT_MOVE|PA_STREAM_AUTO_TIMING_UPDATE|PA_STREAM_START_CORKED) < 0) {
+                                         PA_STREAM_INTERPOLATE_TIMING|PA_STREAM_DONT_MOVE|PA_STREAM_AUTO_TIMING_UPDATE|PA_STREAM_START_CORKED|
+                                         (u->compress ? PA_STREAM_COMPRESS : 0)) < 0) {
                 pa_log_debug("Could not create stream: %s", pa_strerror(pa_context_errno(u->context)));
                 u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
             }
@@ -345,13 +496,11 @@ static void context_state_cb(pa_context *c, void *userdata) {
         }
         case PA_CONTEXT_FAILED:
             pa_log_debug("Context failed with err %s.", pa_strerror(pa_context_errno(u->context)));
-            u->connected = false;
-            u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+            connection_lost(u);
             break;
         case PA_CONTEXT_TERMINATED:
             pa_log_debug("Context terminated.");
-            u->connected = false;
-            u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+            connection_lost(u);
             break;
     }
 }
@@ -495,6 +644,18 @@ int pa__init(pa_module *m) {
     u->cookie_file = pa_xstrdup(pa_modargs_get_value(ma, "cookie", NULL));
     u->remote_source_name = pa_xstrdup(pa_modargs_get_value(ma, "source", NULL));
 
+    if (pa_modargs_get_value_boolean(ma, "compress", &u->compress) < 0) {
+        pa_log("Failed to parse compress argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "reconnect", &u->reconnect) < 0) {
+        pa_log("Failed to parse reconnect argument.");
+        goto fail;
+    }
+
+    u->reconnect_delay = RECONNECT_MIN_USEC;
+
     u->thread_mq = pa_xnew0(pa_thread_mq, 1);
     pa_thread_mq_init_thread_mainloop(u->thread_mq, m->core->mainloop, u->thread_mainloop_api);
 
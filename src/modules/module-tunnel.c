@@ -961,7 +961,7 @@ static void server_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag, pa
     struct userdata *u = userdata;
     pa_sample_spec ss;
     pa_channel_map cm;
-    const char *server_name, *server_version, *user_name, *host_name, *default_sink_name, *default_source_name;
+    const char *server_name, *server_version, *user_name, *host_name, *default_sink_name, *default_source_name, *cpu_kernels;
     uint32_t cookie;
 
     pa_assert(pd);
@@ -983,7 +983,8 @@ static void server_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag, pa
         pa_tagstruct_gets(t, &default_sink_name) < 0 ||
         pa_tagstruct_gets(t, &default_source_name) < 0 ||
         pa_tagstruct_getu32(t, &cookie) < 0 ||
-        (u->version >= 15 && pa_tagstruct_get_channel_map(t, &cm) < 0)) {
+        (u->version >= 15 && pa_tagstruct_get_channel_map(t, &cm) < 0) ||
+        (u->version >= 31 && pa_tagstruct_gets(t, &cpu_kernels) < 0)) {
 
         pa_log("Parse failure");
         goto fail;
@@ -1136,6 +1137,18 @@ static void sink_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag, pa_t
     if (u->version >= 21 && read_formats(u, t) < 0)
         goto fail;
 
+    if (u->version >= 40) {
+        uint32_t render_load;
+        bool overloaded;
+
+        if (pa_tagstruct_getu32(t, &render_load) < 0 ||
+            pa_tagstruct_get_boolean(t, &overloaded) < 0) {
+
+            pa_log("Parse failure");
+            goto fail;
+        }
+    }
+
     if (!pa_tagstruct_eof(t)) {
         pa_log("Packet too long");
         goto fail;
@@ -1239,6 +1252,50 @@ static void sink_input_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag
         pa_format_info_free(format);
     }
 
+    if (u->version >= 32) {
+        uint64_t runs;
+        uint32_t n_phases, n_buckets, count;
+        const char *phase;
+        pa_usec_t usec;
+
+        if (pa_tagstruct_getu64(t, &runs) < 0 ||
+            pa_tagstruct_getu32(t, &n_phases) < 0) {
+
+            pa_log("Parse failure");
+            goto fail;
+        }
+
+        for (; n_phases > 0; n_phases--) {
+            if (pa_tagstruct_gets(t, &phase) < 0 ||
+                pa_tagstruct_get_usec(t, &usec) < 0 ||
+                pa_tagstruct_getu32(t, &n_buckets) < 0) {
+
+                pa_log("Parse failure");
+                goto fail;
+            }
+
+            for (; n_buckets > 0; n_buckets--)
+                if (pa_tagstruct_getu32(t, &count) < 0) {
+
+                    pa_log("Parse failure");
+                    goto fail;
+                }
+        }
+    }
+
+    if (u->version >= 39) {
+        uint32_t underruns, silence_frames, rewinds, render_usec;
+
+        if (pa_tagstruct_getu32(t, &underruns) < 0 ||
+            pa_tagstruct_getu32(t, &silence_frames) < 0 ||
+            pa_tagstruct_getu32(t, &rewinds) < 0 ||
+            pa_tagstruct_getu32(t, &render_usec) < 0) {
+
+            pa_log("Parse failure");
+            goto fail;
+        }
+    }
+
     if (!pa_tagstruct_eof(t)) {
         pa_log("Packet too long");
         goto fail;
@@ -1445,6 +1502,9 @@ static void start_subscribe(struct userdata *u) {
 #endif
                         );
 
+    if (u->version >= 35)
+        pa_tagstruct_put_boolean(t, false); /* deltas */
+
     pa_pstream_send_tagstruct(u->pstream, t);
 }
 
@@ -1536,6 +1596,14 @@ static void create_stream_callback(pa_pdispatch *pd, uint32_t command,  uint32_t
         pa_format_info_free(format);
     }
 
+    if (u->version >= 36) {
+        bool compressed;
+
+        /* We never ask for it */
+        if (pa_tagstruct_get_boolean(t, &compressed) < 0 || compressed)
+            goto parse_error;
+    }
+
     if (!pa_tagstruct_eof(t))
         goto parse_error;
 
@@ -1755,6 +1823,9 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
     }
 #endif
 
+    if (u->version >= 36)
+        pa_tagstruct_put_boolean(reply, false); /* compress */
+
     pa_pstream_send_tagstruct(u->pstream, reply);
     pa_pdispatch_register_reply(u->pdispatch, tag, DEFAULT_TIMEOUT, create_stream_callback, u, NULL);
 
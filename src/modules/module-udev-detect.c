@@ -48,7 +48,8 @@ PA_MODULE_USAGE(
         "fixed_latency_range=<disable latency range changes on underrun?> "
         "ignore_dB=<ignore dB information from the device?> "
         "deferred_volume=<syncronize sw and hw volume changes in IO-thread?> "
-        "use_ucm=<use ALSA UCM for card configuration?>");
+        "use_ucm=<use ALSA UCM for card configuration?> "
+        "async_probe=<probe cards in worker threads while the main loop keeps running?>");
 
 struct device {
     char *path;
@@ -69,6 +70,7 @@ struct userdata {
     bool ignore_dB:1;
     bool deferred_volume:1;
     bool use_ucm:1;
+    bool async_probe:1;
 
     uint32_t tsched_buffer_size;
 
@@ -87,6 +89,7 @@ static const char* const valid_modargs[] = {
     "ignore_dB",
     "deferred_volume",
     "use_ucm",
+    "async_probe",
     NULL
 };
 
@@ -407,6 +410,7 @@ static void card_changed(struct userdata *u, struct udev_device *dev) {
                      "ignore_dB=%s "
                      "deferred_volume=%s "
                      "use_ucm=%s "
+                     "async_probe=%s "
                      "card_properties=\"module-udev-detect.discovered=1\"",
                      path_get_card_id(path),
                      n,
@@ -415,7 +419,8 @@ static void card_changed(struct userdata *u, struct udev_device *dev) {
                      pa_yes_no(u->fixed_latency_range),
                      pa_yes_no(u->ignore_dB),
                      pa_yes_no(u->deferred_volume),
-                     pa_yes_no(u->use_ucm));
+                     pa_yes_no(u->use_ucm),
+                     pa_yes_no(u->async_probe));
     pa_xfree(n);
 
     if (u->tsched_buffer_size_valid)
@@ -445,6 +450,30 @@ static void remove_card(struct userdata *u, struct udev_device *dev) {
     device_free(d);
 }
 
+/* With async_probe module-alsa-card unloads itself when probing fails,
+ * which has to count as a failed load so that we try again later. A
+ * module that did create its card is not loaded again. */
+static pa_hook_result_t module_unlink_cb(pa_core *c, pa_module *m, struct userdata *u) {
+    struct device *d;
+    void *state;
+
+    pa_assert(c);
+    pa_assert(m);
+    pa_assert(u);
+
+    PA_HASHMAP_FOREACH(d, u->devices, state)
+        if (d->module == m->index) {
+            if (!pa_namereg_get(c, d->card_name, PA_NAMEREG_CARD)) {
+                pa_log_info("Card %s (%s) failed to probe.", d->path, d->card_name);
+                d->module = PA_INVALID_INDEX;
+            }
+
+            break;
+        }
+
+    return PA_HOOK_OK;
+}
+
 static void process_device(struct userdata *u, struct udev_device *dev) {
     const char *action, *ff;
 
@@ -687,7 +716,7 @@ int pa__init(pa_module *m) {
     struct udev_list_entry *item = NULL, *first = NULL;
     int fd;
     bool use_tsched = true, fixed_latency_range = false, ignore_dB = false, deferred_volume = m->core->deferred_volume;
-    bool use_ucm = true;
+    bool use_ucm = true, async_probe = true;
 
     pa_assert(m);
 
@@ -740,6 +769,15 @@ int pa__init(pa_module *m) {
     }
     u->use_ucm = use_ucm;
 
+    if (pa_modargs_get_value_boolean(ma, "async_probe", &async_probe) < 0) {
+        pa_log("Failed to parse async_probe= argument.");
+        goto fail;
+    }
+    u->async_probe = async_probe;
+
+    pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_MODULE_UNLINK], PA_HOOK_NORMAL,
+                           (pa_hook_cb_t) module_unlink_cb, u);
+
     if (!(u->udev = udev_new())) {
         pa_log("Failed to initialize udev library.");
         goto fail;
@@ -38,6 +38,8 @@
 #include <pulsecore/ltdl-helper.h>
 #include <pulsecore/sound-file.h>
 #include <pulsecore/resampler.h>
+#include <pulsecore/workpool.h>
+#include <pulsecore/filter/convolver.h>
 
 #include <math.h>
 
@@ -62,6 +64,16 @@ PA_MODULE_USAGE(
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* Blocks are split into jobs of at least this many frames for the DSP
+ * worker pool */
+#define FRAMES_PER_JOB 256
+
+/* Longer impulse responses than this are convolved in the frequency
+ * domain, in partitions of this many frames */
+#define CONVOLVER_BLOCK 64
+
+#define MAX_HRIR_SAMPLES 4096
+
 struct userdata {
     pa_module *module;
 
@@ -85,8 +97,22 @@ struct userdata {
     unsigned hrir_samples;
     float *hrir_data;
 
+    /* For short responses: the left and right coefficient of each tap
+     * and input channel, oldest tap first, so that a window of the input
+     * buffer lines up with them */
+    float *taps;
+
+    /* For long ones, instead of the input buffer and the taps */
+    pa_convolver *convolver;
+
+    /* The last hrir_samples - 1 input frames, oldest first, followed by
+     * the frames of the block being processed */
     float *input_buffer;
-    int input_buffer_offset;
+    unsigned input_buffer_frames;
+
+    pa_workpool *workpool;
+    float *output;
+    unsigned n_frames, n_jobs;
 };
 
 static const char* const valid_modargs[] = {
@@ -211,17 +237,41 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
+/* Folds one range of the block with the impulse response. Called from
+ * I/O thread or DSP worker context */
+static void fold_frames(void *userdata, unsigned job) {
+    struct userdata *u = userdata;
+    unsigned j, l, first, last, n_taps;
+    float sum_right, sum_left;
+
+    first = u->n_frames * job / u->n_jobs;
+    last = u->n_frames * (job + 1) / u->n_jobs;
+    n_taps = u->hrir_samples * u->channels;
+
+    for (l = first; l < last; l++) {
+        /* The hrir_samples input frames that go with l, oldest first */
+        const float *in = u->input_buffer + l * u->channels;
+
+        sum_right = 0;
+        sum_left = 0;
+
+        for (j = 0; j < n_taps; j++) {
+            sum_left += in[j] * u->taps[2 * j];
+            sum_right += in[j] * u->taps[2 * j + 1];
+        }
+
+        u->output[2 * l] = PA_CLAMP_UNLIKELY(sum_left, -1.0f, 1.0f);
+        u->output[2 * l + 1] = PA_CLAMP_UNLIKELY(sum_right, -1.0f, 1.0f);
+    }
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
-    float *src, *dst;
+    float *src;
     unsigned n;
     pa_memchunk tchunk;
 
-    unsigned j, k, l;
-    float sum_right, sum_left;
-    float current_sample;
-
     pa_sink_input_assert_ref(i);
     pa_assert(chunk);
     pa_assert_se(u = i->userdata);
@@ -250,34 +300,43 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     pa_memblockq_drop(u->memblockq, n * u->sink_fs);
 
-    src = pa_memblock_acquire_chunk(&tchunk);
-    dst = pa_memblock_acquire(chunk->memblock);
+    if (u->convolver) {
+        float *dst;
+        unsigned l;
 
-    for (l = 0; l < n; l++) {
-        memcpy(((char*) u->input_buffer) + u->input_buffer_offset * u->sink_fs, ((char *) src) + l * u->sink_fs, u->sink_fs);
+        src = pa_memblock_acquire_chunk(&tchunk);
+        dst = pa_memblock_acquire(chunk->memblock);
 
-        sum_right = 0;
-        sum_left = 0;
+        pa_convolver_process(u->convolver, src, dst, n);
 
-        /* fold the input buffer with the impulse response */
-        for (j = 0; j < u->hrir_samples; j++) {
-            for (k = 0; k < u->channels; k++) {
-                current_sample = u->input_buffer[((u->input_buffer_offset + j) % u->hrir_samples) * u->channels + k];
+        for (l = 0; l < 2 * n; l++)
+            dst[l] = PA_CLAMP_UNLIKELY(dst[l], -1.0f, 1.0f);
 
-                sum_left += current_sample * u->hrir_data[j * u->hrir_channels + u->mapping_left[k]];
-                sum_right += current_sample * u->hrir_data[j * u->hrir_channels + u->mapping_right[k]];
-            }
-        }
+        pa_memblock_release(chunk->memblock);
+        pa_memblock_release(tchunk.memblock);
+        pa_memblock_unref(tchunk.memblock);
 
-        dst[2 * l] = PA_CLAMP_UNLIKELY(sum_left, -1.0f, 1.0f);
-        dst[2 * l + 1] = PA_CLAMP_UNLIKELY(sum_right, -1.0f, 1.0f);
+        return 0;
+    }
 
-        u->input_buffer_offset--;
-        if (u->input_buffer_offset < 0)
-            u->input_buffer_offset += u->hrir_samples;
+    if (n > u->input_buffer_frames) {
+        u->input_buffer = pa_xrealloc(u->input_buffer, (u->hrir_samples - 1 + n) * u->sink_fs);
+        u->input_buffer_frames = n;
     }
 
+    src = pa_memblock_acquire_chunk(&tchunk);
+    memcpy(u->input_buffer + (u->hrir_samples - 1) * u->channels, src, n * u->sink_fs);
     pa_memblock_release(tchunk.memblock);
+
+    u->output = pa_memblock_acquire(chunk->memblock);
+    u->n_frames = n;
+    u->n_jobs = PA_CLAMP(n / FRAMES_PER_JOB, 1U, pa_workpool_get_n_threads(u->workpool) + 1);
+
+    pa_workpool_run(u->workpool, u->n_jobs, fold_frames, u);
+
+    /* Keep the history for the next block */
+    memmove(u->input_buffer, u->input_buffer + n * u->channels, (u->hrir_samples - 1) * u->sink_fs);
+
     pa_memblock_release(chunk->memblock);
 
     pa_memblock_unref(tchunk.memblock);
@@ -304,8 +363,10 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
             pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, true);
 
             /* Reset the input buffer */
-            memset(u->input_buffer, 0, u->hrir_samples * u->sink_fs);
-            u->input_buffer_offset = 0;
+            if (u->convolver)
+                pa_convolver_reset(u->convolver);
+            else
+                memset(u->input_buffer, 0, (u->hrir_samples - 1) * u->sink_fs);
         }
     }
 
@@ -747,9 +808,10 @@ int pa__init(pa_module*m) {
                                  PA_RESAMPLER_SRC_SINC_BEST_QUALITY, PA_RESAMPLER_NO_REMAP);
 
     u->hrir_samples = hrir_temp_chunk.length / pa_frame_size(&hrir_temp_ss) * hrir_ss.rate / hrir_temp_ss.rate;
-    if (u->hrir_samples > 64) {
-        u->hrir_samples = 64;
-        pa_log("The (resampled) hrir contains more than 64 samples. Only the first 64 samples will be used to limit processor usage.");
+    if (u->hrir_samples > MAX_HRIR_SAMPLES) {
+        u->hrir_samples = MAX_HRIR_SAMPLES;
+        pa_log("The (resampled) hrir contains more than %u samples. Only the first %u samples will be used to limit processor usage.",
+               MAX_HRIR_SAMPLES, MAX_HRIR_SAMPLES);
     }
 
     hrir_total_length = u->hrir_samples * pa_frame_size(&hrir_ss);
@@ -825,8 +887,30 @@ int pa__init(pa_module*m) {
         }
     }
 
-    u->input_buffer = pa_xmalloc0(u->hrir_samples * u->sink_fs);
-    u->input_buffer_offset = 0;
+    if (u->hrir_samples > CONVOLVER_BLOCK) {
+        u->convolver = pa_convolver_new(u->channels, 2, u->hrir_samples, CONVOLVER_BLOCK);
+
+        for (i = 0; i < u->channels; i++) {
+            pa_convolver_set_response(u->convolver, i, 0, u->hrir_data + u->mapping_left[i], u->hrir_channels);
+            pa_convolver_set_response(u->convolver, i, 1, u->hrir_data + u->mapping_right[i], u->hrir_channels);
+        }
+    } else {
+        u->taps = pa_xnew(float, 2 * u->hrir_samples * u->channels);
+
+        for (j = 0; j < u->hrir_samples; j++) {
+            float *t = u->taps + 2 * (u->hrir_samples - 1 - j) * u->channels;
+
+            for (i = 0; i < u->channels; i++) {
+                t[2 * i] = u->hrir_data[j * u->hrir_channels + u->mapping_left[i]];
+                t[2 * i + 1] = u->hrir_data[j * u->hrir_channels + u->mapping_right[i]];
+            }
+        }
+
+        u->input_buffer_frames = FRAMES_PER_JOB;
+        u->input_buffer = pa_xmalloc0((u->hrir_samples - 1 + u->input_buffer_frames) * u->sink_fs);
+    }
+
+    u->workpool = pa_core_get_workpool(m->core);
 
     pa_sink_put(u->sink);
     pa_sink_input_put(u->sink_input);
@@ -890,6 +974,12 @@ void pa__done(pa_module*m) {
     if (u->input_buffer)
         pa_xfree(u->input_buffer);
 
+    if (u->taps)
+        pa_xfree(u->taps);
+
+    if (u->convolver)
+        pa_convolver_free(u->convolver);
+
     if (u->mapping_left)
         pa_xfree(u->mapping_left);
     if (u->mapping_right)
@@ -33,8 +33,11 @@
 #include <avahi-common/domain.h>
 #include <avahi-common/malloc.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/hashmap.h>
@@ -48,19 +51,29 @@ PA_MODULE_AUTHOR("Lennart Poettering");
 PA_MODULE_DESCRIPTION("mDNS/DNS-SD Service Discovery");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 PA_MODULE_LOAD_ONCE(true);
+PA_MODULE_USAGE("remove_timeout=<seconds to keep a tunnel after its service disappeared>");
 
 #define SERVICE_TYPE_SINK "_pulse-sink._tcp"
 #define SERVICE_TYPE_SOURCE "_non-monitor._sub._pulse-source._tcp"
 
+#define DEFAULT_REMOVE_TIMEOUT 10
+
 static const char* const valid_modargs[] = {
+    "remove_timeout",
     NULL
 };
 
+struct userdata;
+
 struct tunnel {
+    struct userdata *userdata;
     AvahiIfIndex interface;
     AvahiProtocol protocol;
     char *name, *type, *domain;
     uint32_t module_index;
+
+    /* Set while the service is gone and the tunnel waits to be removed */
+    pa_time_event *remove_event;
 };
 
 struct userdata {
@@ -71,6 +84,7 @@ struct userdata {
     AvahiServiceBrowser *source_browser, *sink_browser;
 
     pa_hashmap *tunnels;
+    pa_usec_t remove_timeout;
 };
 
 static unsigned tunnel_hash(const void *p) {
@@ -107,7 +121,7 @@ static struct tunnel *tunnel_new(
         const char *name, const char *type, const char *domain) {
 
     struct tunnel *t;
-    t = pa_xnew(struct tunnel, 1);
+    t = pa_xnew0(struct tunnel, 1);
     t->interface = interface;
     t->protocol = protocol;
     t->name = pa_xstrdup(name);
@@ -119,6 +133,10 @@ static struct tunnel *tunnel_new(
 
 static void tunnel_free(struct tunnel *t) {
     pa_assert(t);
+
+    if (t->remove_event)
+        t->userdata->core->mainloop->time_free(t->remove_event);
+
     pa_xfree(t->name);
     pa_xfree(t->type);
     pa_xfree(t->domain);
@@ -234,6 +252,7 @@ static void resolver_cb(
         pa_log_debug("Loading %s with arguments '%s'", module_name, args);
 
         if ((m = pa_module_load(u->core, module_name, args))) {
+            tnl->userdata = u;
             tnl->module_index = m->index;
             pa_hashmap_put(u->tunnels, tnl, tnl);
             tnl = NULL;
@@ -254,6 +273,24 @@ finish:
         tunnel_free(tnl);
 }
 
+static void tunnel_remove(struct tunnel *t) {
+    struct userdata *u = t->userdata;
+
+    pa_module_unload_request_by_index(u->core, t->module_index, true);
+    pa_hashmap_remove(u->tunnels, t);
+    tunnel_free(t);
+}
+
+static void remove_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    struct tunnel *t = userdata;
+
+    pa_assert(t);
+    pa_assert(t->remove_event == e);
+
+    pa_log_debug("Service '%s' didn't come back, removing its tunnel.", t->name);
+    tunnel_remove(t);
+}
+
 static void browser_cb(
         AvahiServiceBrowser *b,
         AvahiIfIndex interface, AvahiProtocol protocol,
@@ -273,6 +310,19 @@ static void browser_cb(
     t = tunnel_new(interface, protocol, name, type, domain);
 
     if (event == AVAHI_BROWSER_NEW) {
+        struct tunnel *t2;
+
+        /* A service that flapped finds its tunnel still loaded and
+         * connected, unless the tunnel gave up in the meantime */
+        if ((t2 = pa_hashmap_get(u->tunnels, t))) {
+            if (!pa_idxset_get_by_index(u->core->modules, t2->module_index))
+                tunnel_remove(t2);
+            else if (t2->remove_event) {
+                pa_log_debug("Service '%s' is back, keeping its tunnel.", t2->name);
+                u->core->mainloop->time_free(t2->remove_event);
+                t2->remove_event = NULL;
+            }
+        }
 
         if (!pa_hashmap_get(u->tunnels, t))
             if (!(avahi_service_resolver_new(u->client, interface, protocol, name, type, domain, AVAHI_PROTO_UNSPEC, 0, resolver_cb, u)))
@@ -286,9 +336,10 @@ static void browser_cb(
         struct tunnel *t2;
 
         if ((t2 = pa_hashmap_get(u->tunnels, t))) {
-            pa_module_unload_request_by_index(u->core, t2->module_index, true);
-            pa_hashmap_remove(u->tunnels, t2);
-            tunnel_free(t2);
+            if (u->remove_timeout <= 0)
+                tunnel_remove(t2);
+            else if (!t2->remove_event)
+                t2->remove_event = pa_core_rttime_new(u->core, pa_rtclock_now() + u->remove_timeout, remove_cb, t2);
         }
     }
 
@@ -376,6 +427,7 @@ int pa__init(pa_module*m) {
 
     struct userdata *u;
     pa_modargs *ma = NULL;
+    uint32_t remove_timeout = DEFAULT_REMOVE_TIMEOUT;
     int error;
 
     if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
@@ -383,12 +435,18 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "remove_timeout", &remove_timeout) < 0) {
+        pa_log("Failed to parse remove_timeout argument.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew(struct userdata, 1);
     u->core = m->core;
     u->module = m;
     u->sink_browser = u->source_browser = NULL;
 
     u->tunnels = pa_hashmap_new(tunnel_hash, tunnel_compare);
+    u->remove_timeout = (pa_usec_t) remove_timeout * PA_USEC_PER_SEC;
 
     u->avahi_poll = pa_avahi_poll_new(m->core->mainloop);
 
@@ -50,6 +50,8 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-error.h>
 #include <pulsecore/thread.h>
@@ -91,13 +93,27 @@ PA_MODULE_USAGE(
         "channel_map=<channel map> "
         "fragments=<number of fragments> "
         "fragment_size=<fragment size> "
-        "mmap=<enable memory mapping?>");
+        "mmap=<enable memory mapping?> "
+        "tsched=<enable system timer based scheduling mode?> "
+        "tsched_buffer_watermark=<lower fill watermark>");
 #ifdef __linux__
 PA_MODULE_DEPRECATED("Please use module-alsa-card instead of module-oss!");
 #endif
 
 #define DEFAULT_DEVICE "/dev/dsp"
 
+/* Without rewinds whatever is queued will be heard, so the buffer is kept
+ * modest. With the timer the fragments only decide how exact the pointer is. */
+#define DEFAULT_TSCHED_BUFFER_USEC (200*PA_USEC_PER_MSEC)          /* 200ms -- Overall buffer size */
+#define DEFAULT_TSCHED_FRAGMENT_USEC (10*PA_USEC_PER_MSEC)         /* 10ms  -- Fragment size, rounded down to a power of two */
+#define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms  -- Fill up when only this much is left in the buffer */
+
+#define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  -- On underrun, increase watermark by this */
+#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms   -- When everything's great, decrease watermark by this */
+#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s   -- How long after a drop out recheck if things are good now */
+
+#define TSCHED_MIN_SLEEP_USEC (3*PA_USEC_PER_MSEC)                 /* 3ms   -- Sleep at least this long on each iteration */
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -134,6 +150,14 @@ struct userdata {
 
     int in_mmap_saved_nfrags, out_mmap_saved_nfrags;
 
+    /* With timer-based scheduling: the fragments written after the one the
+     * device plays, how many to keep there and how many recorded ones to
+     * collect before waking up, as the latencies that were requested ask */
+    bool use_tsched;
+    unsigned out_ahead, out_target, in_target;
+    pa_usec_t out_watermark, in_watermark;
+    pa_usec_t out_watermark_dec_not_before, in_watermark_dec_not_before;
+
     pa_rtpoll_item *rtpoll_item;
 };
 
@@ -152,6 +176,8 @@ static const char* const valid_modargs[] = {
     "channels",
     "channel_map",
     "mmap",
+    "tsched",
+    "tsched_buffer_watermark",
     NULL
 };
 
@@ -356,6 +382,164 @@ static int mmap_read(struct userdata *u) {
     return info.blocks;
 }
 
+static void increase_watermark(pa_usec_t *watermark, pa_usec_t *dec_not_before, pa_usec_t max_watermark) {
+    pa_usec_t old_watermark;
+
+    old_watermark = *watermark;
+    *watermark = PA_MIN(*watermark * 2, *watermark + TSCHED_WATERMARK_INC_STEP_USEC);
+    *watermark = PA_MIN(*watermark, max_watermark);
+
+    *dec_not_before = pa_rtclock_now() + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+
+    if (old_watermark != *watermark)
+        pa_log_info("Increasing wakeup watermark to %0.2f ms", (double) *watermark / PA_USEC_PER_MSEC);
+}
+
+static void decrease_watermark(pa_usec_t *watermark, pa_usec_t *dec_not_before, pa_usec_t min_watermark) {
+    pa_usec_t old_watermark, now;
+
+    now = pa_rtclock_now();
+
+    if (*dec_not_before <= 0)
+        goto restart;
+
+    if (*dec_not_before > now)
+        return;
+
+    old_watermark = *watermark;
+
+    if (*watermark < TSCHED_WATERMARK_DEC_STEP_USEC)
+        *watermark = *watermark / 2;
+    else
+        *watermark = PA_MAX(*watermark / 2, *watermark - TSCHED_WATERMARK_DEC_STEP_USEC);
+
+    *watermark = PA_MAX(*watermark, min_watermark);
+
+    if (old_watermark != *watermark)
+        pa_log_info("Decreasing wakeup watermark to %0.2f ms", (double) *watermark / PA_USEC_PER_MSEC);
+
+restart:
+    *dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+}
+
+static void mmap_reset_playback(struct userdata *u) {
+    pa_assert(u);
+
+    u->out_mmap_saved_nfrags = 0;
+
+    /* Without the timer everything up to the pointer is written again
+     * right away. With it only the fragment the device starts on is
+     * silent and we go on with the one after it. */
+    if (u->use_tsched) {
+        u->out_mmap_current = 1;
+        u->out_ahead = 0;
+    } else {
+        u->out_mmap_current = 0;
+        u->out_ahead = u->out_nfrags - 1;
+    }
+}
+
+/* Called from IO context */
+static int mmap_tsched_write(struct userdata *u, pa_usec_t *sleep_usec) {
+    struct count_info info;
+    unsigned hw, ahead, target;
+    size_t left, watermark;
+    pa_usec_t min_watermark;
+
+    pa_assert(u);
+    pa_assert(u->sink);
+    pa_assert(sleep_usec);
+
+    if (ioctl(u->fd, SNDCTL_DSP_GETOPTR, &info) < 0) {
+        pa_log("SNDCTL_DSP_GETOPTR: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    info.blocks += u->out_mmap_saved_nfrags;
+    u->out_mmap_saved_nfrags = 0;
+
+    /* The fragment the device plays right now */
+    hw = ((unsigned) info.ptr / u->out_fragment_size) % u->out_nfrags;
+    min_watermark = pa_bytes_to_usec(u->out_fragment_size, &u->sink->sample_spec);
+
+    if ((unsigned) info.blocks > u->out_ahead) {
+        /* It played everything we had written and went on with what was
+         * left in the buffer from before */
+        pa_log_info("Underrun!");
+        increase_watermark(&u->out_watermark, &u->out_watermark_dec_not_before,
+                           pa_bytes_to_usec(u->out_hwbuf_size / 2, &u->sink->sample_spec));
+
+        u->out_mmap_current = (hw + 1) % u->out_nfrags;
+        ahead = 0;
+    } else {
+        ahead = (u->out_mmap_current + u->out_nfrags - hw - 1) % u->out_nfrags;
+        decrease_watermark(&u->out_watermark, &u->out_watermark_dec_not_before, min_watermark);
+    }
+
+    /* Keep at least the watermark queued, whatever latency was asked for */
+    watermark = pa_usec_to_bytes(u->out_watermark, &u->sink->sample_spec);
+    target = PA_MAX(u->out_target, (unsigned) (watermark / u->out_fragment_size) + 1);
+    target = PA_MIN(target, u->out_nfrags - 1);
+
+    if (ahead < target) {
+        mmap_fill_memblocks(u, target - ahead);
+        ahead = target;
+    }
+
+    u->out_ahead = ahead;
+
+    /* Wake up when only the watermark is left */
+    left = ahead * u->out_fragment_size + (u->out_fragment_size - (size_t) info.ptr % u->out_fragment_size);
+    *sleep_usec = left > watermark ? pa_bytes_to_usec(left - watermark, &u->sink->sample_spec) : 0;
+    *sleep_usec = PA_MAX(*sleep_usec, TSCHED_MIN_SLEEP_USEC);
+
+    return 0;
+}
+
+/* Called from IO context */
+static int mmap_tsched_read(struct userdata *u, pa_usec_t *sleep_usec) {
+    struct count_info info;
+    size_t filled, target, watermark;
+
+    pa_assert(u);
+    pa_assert(u->source);
+    pa_assert(sleep_usec);
+
+    if (ioctl(u->fd, SNDCTL_DSP_GETIPTR, &info) < 0) {
+        pa_log("SNDCTL_DSP_GETIPTR: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    info.blocks += u->in_mmap_saved_nfrags;
+    u->in_mmap_saved_nfrags = 0;
+
+    if ((unsigned) info.blocks >= u->in_nfrags) {
+        /* The device went round the whole buffer since we looked last */
+        pa_log_info("Overrun!");
+        increase_watermark(&u->in_watermark, &u->in_watermark_dec_not_before,
+                           pa_bytes_to_usec(u->in_hwbuf_size / 2, &u->source->sample_spec));
+    } else
+        decrease_watermark(&u->in_watermark, &u->in_watermark_dec_not_before,
+                           pa_bytes_to_usec(u->in_fragment_size, &u->source->sample_spec));
+
+    if (info.blocks > 0) {
+        mmap_post_memblocks(u, PA_MIN((unsigned) info.blocks, u->in_nfrags));
+        mmap_clear_memblocks(u, u->in_nfrags/2);
+    }
+
+    /* Wake up when the fragments for the requested latency are recorded,
+     * but at the latest when only the watermark is left free */
+    watermark = pa_usec_to_bytes(u->in_watermark, &u->source->sample_spec);
+    target = PA_MIN(u->in_target * u->in_fragment_size, u->in_hwbuf_size - PA_MIN(watermark, u->in_hwbuf_size - u->in_fragment_size));
+    target = PA_MAX(target, u->in_fragment_size);
+
+    filled = (size_t) info.ptr % u->in_fragment_size;
+    *sleep_usec = target > filled ? pa_bytes_to_usec(target - filled, &u->source->sample_spec) : 0;
+    *sleep_usec = PA_MAX(*sleep_usec, TSCHED_MIN_SLEEP_USEC);
+
+    return 0;
+}
+
 static pa_usec_t mmap_sink_get_latency(struct userdata *u) {
     struct count_info info;
     size_t bpos, n;
@@ -369,7 +553,12 @@ static pa_usec_t mmap_sink_get_latency(struct userdata *u) {
 
     u->out_mmap_saved_nfrags += info.blocks;
 
-    bpos = ((u->out_mmap_current + (unsigned) u->out_mmap_saved_nfrags) * u->out_fragment_size) % u->out_hwbuf_size;
+    /* Without timer-based scheduling every played fragment is written again
+     * right away, so the buffer is full up to the pointer */
+    if (u->use_tsched)
+        bpos = (u->out_mmap_current * u->out_fragment_size) % u->out_hwbuf_size;
+    else
+        bpos = ((u->out_mmap_current + (unsigned) u->out_mmap_saved_nfrags) * u->out_fragment_size) % u->out_hwbuf_size;
 
     if (bpos <= (size_t) info.ptr)
         n = u->out_hwbuf_size - ((size_t) info.ptr - bpos);
@@ -619,8 +808,9 @@ static int unsuspend(struct userdata *u) {
         }
     }
 
-    u->out_mmap_current = u->in_mmap_current = 0;
-    u->out_mmap_saved_nfrags = u->in_mmap_saved_nfrags = 0;
+    mmap_reset_playback(u);
+    u->in_mmap_current = 0;
+    u->in_mmap_saved_nfrags = 0;
 
     pa_assert(!u->rtpoll_item);
 
@@ -699,8 +889,7 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
                         do_trigger = true;
 
-                        u->out_mmap_current = 0;
-                        u->out_mmap_saved_nfrags = 0;
+                        mmap_reset_playback(u);
 
                         u->sink_suspended = false;
                     }
@@ -881,6 +1070,42 @@ static void source_set_volume(pa_source *s) {
     pa_log_info("Device doesn't support writing mixer settings: %s", pa_cstrerror(errno));
 }
 
+/* Called from IO context */
+static void sink_update_requested_latency_cb(pa_sink *s) {
+    struct userdata *u = s->userdata;
+    pa_usec_t latency;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    /* Without a request fill the whole buffer, apart from the fragment
+     * that is played */
+    if ((latency = pa_sink_get_requested_latency_within_thread(s)) == (pa_usec_t) -1)
+        u->out_target = u->out_nfrags - 1;
+    else
+        u->out_target = PA_CLAMP((unsigned) (pa_usec_to_bytes(latency, &s->sample_spec) / u->out_fragment_size),
+                                 1U, u->out_nfrags - 1);
+
+    pa_log_debug("Keeping %u fragments queued", u->out_target);
+}
+
+/* Called from IO context */
+static void source_update_requested_latency_cb(pa_source *s) {
+    struct userdata *u = s->userdata;
+    pa_usec_t latency;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    if ((latency = pa_source_get_requested_latency_within_thread(s)) == (pa_usec_t) -1)
+        u->in_target = u->in_nfrags - 1;
+    else
+        u->in_target = PA_CLAMP((unsigned) (pa_usec_to_bytes(latency, &s->sample_spec) / u->in_fragment_size),
+                                1U, u->in_nfrags - 1);
+
+    pa_log_debug("Collecting %u fragments per wakeup", u->in_target);
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
     int write_type = 0, read_type = 0;
@@ -903,6 +1128,33 @@ static void thread_func(void *userdata) {
         if (PA_UNLIKELY(u->sink && u->sink->thread_info.rewind_requested))
             pa_sink_process_rewind(u->sink, 0);
 
+        if (u->use_tsched) {
+            pa_usec_t sleep_usec = (pa_usec_t) -1, s;
+
+            /* Look at the pointers when the timer says so instead of
+             * waking up for each fragment */
+            if (u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+                if (mmap_tsched_write(u, &s) < 0)
+                    goto fail;
+
+                sleep_usec = s;
+            }
+
+            if (u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+                if (mmap_tsched_read(u, &s) < 0)
+                    goto fail;
+
+                sleep_usec = PA_MIN(sleep_usec, s);
+            }
+
+            if (sleep_usec != (pa_usec_t) -1)
+                pa_rtpoll_set_timer_relative(u->rtpoll, sleep_usec);
+            else
+                pa_rtpoll_set_timer_disabled(u->rtpoll);
+
+            goto sleep;
+        }
+
         /* Render some data and write it to the dsp */
 
         if (u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state) && ((revents & POLLOUT) || u->use_mmap || u->use_getospace)) {
@@ -1117,13 +1369,14 @@ static void thread_func(void *userdata) {
 
 /*         pa_log("loop2 revents=%i", revents); */
 
+sleep:
         if (u->rtpoll_item) {
             struct pollfd *pollfd;
 
             pa_assert(u->fd >= 0);
 
             pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
-            pollfd->events = (short)
+            pollfd->events = u->use_tsched ? 0 : (short)
                 (((u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state)) ? POLLIN : 0) |
                  ((u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state)) ? POLLOUT : 0));
         }
@@ -1168,7 +1421,8 @@ int pa__init(pa_module*m) {
     int fd = -1;
     int nfrags, orig_frag_size, frag_size;
     int mode, caps;
-    bool record = true, playback = true, use_mmap = true;
+    bool record = true, playback = true, use_mmap = true, use_tsched = true;
+    uint32_t tsched_watermark;
     pa_sample_spec ss;
     pa_channel_map map;
     pa_modargs *ma = NULL;
@@ -1219,6 +1473,17 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "tsched", &use_tsched) < 0) {
+        pa_log("Failed to parse tsched argument.");
+        goto fail;
+    }
+
+    tsched_watermark = (uint32_t) pa_usec_to_bytes(DEFAULT_TSCHED_WATERMARK_USEC, &ss);
+    if (pa_modargs_get_value_u32(ma, "tsched_buffer_watermark", &tsched_watermark) < 0 || tsched_watermark <= 0) {
+        pa_log("Failed to parse tsched_buffer_watermark argument.");
+        goto fail;
+    }
+
     if ((fd = pa_oss_open(dev = pa_modargs_get_value(ma, "device", DEFAULT_DEVICE), &mode, &caps)) < 0)
         goto fail;
 
@@ -1232,6 +1497,20 @@ int pa__init(pa_module*m) {
         use_mmap = false;
     }
 
+    if (use_tsched && !use_mmap) {
+        pa_log_info("Cannot enable timer-based scheduling without memory mapping, falling back to sound IRQ scheduling.");
+        use_tsched = false;
+    }
+
+    /* With the timer deciding when to wake up, small fragments only make
+     * the pointer more exact, so unless told otherwise use many of them */
+    if (use_tsched && !pa_modargs_get_value(ma, "fragments", NULL) && !pa_modargs_get_value(ma, "fragment_size", NULL)) {
+        frag_size = 1 << pa_ulog2((unsigned) pa_usec_to_bytes(DEFAULT_TSCHED_FRAGMENT_USEC, &ss));
+        frag_size = PA_MAX(frag_size, (int) pa_frame_size(&ss));
+        nfrags = (int) (pa_usec_to_bytes(DEFAULT_TSCHED_BUFFER_USEC, &ss) / (size_t) frag_size);
+        nfrags = PA_MAX(nfrags, 2);
+    }
+
     if (pa_oss_get_hw_description(dev, hwdesc, sizeof(hwdesc)) >= 0)
         pa_log_info("Hardware name is '%s'.", hwdesc);
     else
@@ -1269,6 +1548,7 @@ int pa__init(pa_module*m) {
     u->out_fragment_size = u->in_fragment_size = (uint32_t) (u->frag_size = frag_size);
     u->orig_frag_size = orig_frag_size;
     u->use_mmap = use_mmap;
+    u->use_tsched = use_tsched;
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
     u->rtpoll_item = NULL;
@@ -1291,6 +1571,11 @@ int pa__init(pa_module*m) {
     u->in_hwbuf_size = u->in_nfrags * u->in_fragment_size;
     u->out_hwbuf_size = u->out_nfrags * u->out_fragment_size;
 
+    mmap_reset_playback(u);
+    u->out_target = u->out_nfrags - 1;
+    u->in_target = u->in_nfrags - 1;
+    u->out_watermark = u->in_watermark = pa_bytes_to_usec(tsched_watermark, &ss);
+
     if (mode != O_WRONLY) {
         char *name_buf = NULL;
 
@@ -1298,6 +1583,7 @@ int pa__init(pa_module*m) {
             if ((u->in_mmap = mmap(NULL, u->in_hwbuf_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
                 pa_log_warn("mmap(PROT_READ) failed, reverting to non-mmap mode: %s", pa_cstrerror(errno));
                 use_mmap = u->use_mmap = false;
+                use_tsched = u->use_tsched = false;
                 u->in_mmap = NULL;
             } else
                 pa_log_debug("Successfully mmap()ed input buffer.");
@@ -1331,7 +1617,7 @@ int pa__init(pa_module*m) {
             goto fail;
         }
 
-        u->source = pa_source_new(m->core, &source_new_data, PA_SOURCE_HARDWARE|PA_SOURCE_LATENCY);
+        u->source = pa_source_new(m->core, &source_new_data, PA_SOURCE_HARDWARE|PA_SOURCE_LATENCY|(use_tsched ? PA_SOURCE_DYNAMIC_LATENCY : 0));
         pa_source_new_data_done(&source_new_data);
         pa_xfree(name_buf);
 
@@ -1345,7 +1631,15 @@ int pa__init(pa_module*m) {
 
         pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
         pa_source_set_rtpoll(u->source, u->rtpoll);
-        pa_source_set_fixed_latency(u->source, pa_bytes_to_usec(u->in_hwbuf_size, &u->source->sample_spec));
+
+        if (use_tsched) {
+            u->source->update_requested_latency = source_update_requested_latency_cb;
+            pa_source_set_latency_range(u->source,
+                                        pa_bytes_to_usec(u->in_fragment_size, &u->source->sample_spec),
+                                        pa_bytes_to_usec(u->in_hwbuf_size, &u->source->sample_spec));
+        } else
+            pa_source_set_fixed_latency(u->source, pa_bytes_to_usec(u->in_hwbuf_size, &u->source->sample_spec));
+
         u->source->refresh_volume = true;
 
         if (use_mmap)
@@ -1364,6 +1658,7 @@ int pa__init(pa_module*m) {
                 } else {
                     pa_log_warn("mmap(PROT_WRITE) failed, reverting to non-mmap mode: %s", pa_cstrerror(errno));
                     u->use_mmap = use_mmap = false;
+                    u->use_tsched = use_tsched = false;
                     u->out_mmap = NULL;
                 }
             } else {
@@ -1400,7 +1695,7 @@ int pa__init(pa_module*m) {
             goto fail;
         }
 
-        u->sink = pa_sink_new(m->core, &sink_new_data, PA_SINK_HARDWARE|PA_SINK_LATENCY);
+        u->sink = pa_sink_new(m->core, &sink_new_data, PA_SINK_HARDWARE|PA_SINK_LATENCY|(use_tsched ? PA_SINK_DYNAMIC_LATENCY : 0));
         pa_sink_new_data_done(&sink_new_data);
         pa_xfree(name_buf);
 
@@ -1414,7 +1709,15 @@ int pa__init(pa_module*m) {
 
         pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
         pa_sink_set_rtpoll(u->sink, u->rtpoll);
-        pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->out_hwbuf_size, &u->sink->sample_spec));
+
+        if (use_tsched) {
+            u->sink->update_requested_latency = sink_update_requested_latency_cb;
+            pa_sink_set_latency_range(u->sink,
+                                      pa_bytes_to_usec(2 * u->out_fragment_size, &u->sink->sample_spec),
+                                      pa_bytes_to_usec(u->out_hwbuf_size, &u->sink->sample_spec));
+        } else
+            pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->out_hwbuf_size, &u->sink->sample_spec));
+
         u->sink->refresh_volume = true;
 
         pa_sink_set_max_request(u->sink, u->out_hwbuf_size);
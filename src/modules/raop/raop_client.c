@@ -34,7 +34,7 @@
 /* TODO: Replace OpenSSL with NSS */
 #include <openssl/err.h>
 #include <openssl/rand.h>
-#include <openssl/aes.h>
+#include <openssl/evp.h>
 #include <openssl/rsa.h>
 #include <openssl/engine.h>
 
@@ -79,9 +79,8 @@ struct pa_raop_client {
     uint8_t jack_status;
 
     /* Encryption Related bits */
-    AES_KEY aes;
+    EVP_CIPHER_CTX *aes;
     uint8_t aes_iv[AES_CHUNKSIZE]; /* initialization vector for aes-cbc */
-    uint8_t aes_nv[AES_CHUNKSIZE]; /* next vector for aes-cbc */
     uint8_t aes_key[AES_CHUNKSIZE]; /* key for aes-cbc */
 
     pa_socket_client *sc;
@@ -148,6 +147,33 @@ static inline void bit_writer(uint8_t **buffer, uint8_t *bit_pos, int *size, uin
     }
 }
 
+/**
+ * Function to append whole bytes behind a bit writer position that is not
+ * byte aligned, the way bit_writer() would write them 8 bits at a time.
+ * @param buffer Handle to the buffer. It is incremented past the data.
+ * @param bit_pos The current write location, which must not be 0
+ * @param size A pointer to the byte size currently written
+ * @param data The bytes to write
+ * @param len The number of bytes
+ */
+static inline void byte_writer(uint8_t **buffer, uint8_t bit_pos, int *size, const uint8_t *data, size_t len) {
+    uint8_t *bp = *buffer;
+    uint8_t acc = *bp;
+    const unsigned shift = bit_pos, back = 8 - bit_pos;
+
+    pa_assert(bit_pos > 0 && bit_pos < 8);
+
+    /* Each byte spills its low bits into the next byte of the buffer */
+    for (; len > 0; len--, data++) {
+        *bp++ = acc | (*data >> shift);
+        acc = (uint8_t) (*data << back);
+    }
+
+    *bp = acc;
+    *size += (int) (bp - *buffer);
+    *buffer = bp;
+}
+
 static int rsa_encrypt(uint8_t *text, int len, uint8_t *res) {
     const char n[] =
         "59dE8qLieItsH1WgjrcFRKj6eUWqi+bGLOX1HL3U3GhC/j0Qg90u3sG/1CUtwC"
@@ -173,23 +199,27 @@ static int rsa_encrypt(uint8_t *text, int len, uint8_t *res) {
     return size;
 }
 
+/* Every packet is encrypted in CBC mode from the same IV, and a trailing
+ * partial block is left in the clear. The whole packet goes through EVP in
+ * one call, which uses the AES instructions of the CPU where it has them. */
 static int aes_encrypt(pa_raop_client* c, uint8_t *data, int size) {
-    uint8_t *buf;
-    int i=0, j;
+    int len, out;
 
     pa_assert(c);
+    pa_assert(c->aes);
 
-    memcpy(c->aes_nv, c->aes_iv, AES_CHUNKSIZE);
-    while (i+AES_CHUNKSIZE <= size) {
-        buf = data + i;
-        for (j=0; j<AES_CHUNKSIZE; ++j)
-            buf[j] ^= c->aes_nv[j];
+    len = size - size % AES_CHUNKSIZE;
+    if (len <= 0)
+        return 0;
 
-        AES_encrypt(buf, buf, &c->aes);
-        memcpy(c->aes_nv, buf, AES_CHUNKSIZE);
-        i += AES_CHUNKSIZE;
+    if (!EVP_EncryptInit_ex(c->aes, NULL, NULL, NULL, c->aes_iv) ||
+        !EVP_EncryptUpdate(c->aes, data, &out, data, len)) {
+        pa_log("AES encryption failed");
+        return -1;
     }
-    return i;
+
+    pa_assert(out == len);
+    return len;
 }
 
 static inline void rtrimchar(char *str, char rc) {
@@ -402,6 +432,8 @@ void pa_raop_client_free(pa_raop_client* c) {
         pa_rtsp_client_free(c->rtsp);
     if (c->sid)
         pa_xfree(c->sid);
+    if (c->aes)
+        EVP_CIPHER_CTX_free(c->aes);
     pa_xfree(c->host);
     pa_xfree(c);
 }
@@ -421,13 +453,21 @@ int pa_raop_connect(pa_raop_client* c) {
         return 0;
     }
 
-    c->rtsp = pa_rtsp_client_new(c->core->mainloop, c->host, c->port, "iTunes/4.6 (Macintosh; U; PPC Mac OS X 10.3)");
-
     /* Initialise the AES encryption system */
+    if (!c->aes && !(c->aes = EVP_CIPHER_CTX_new())) {
+        pa_log("Failed to create an AES context");
+        return -1;
+    }
+
     pa_random(c->aes_iv, sizeof(c->aes_iv));
     pa_random(c->aes_key, sizeof(c->aes_key));
-    memcpy(c->aes_nv, c->aes_iv, sizeof(c->aes_nv));
-    AES_set_encrypt_key(c->aes_key, 128, &c->aes);
+    if (!EVP_EncryptInit_ex(c->aes, EVP_aes_128_cbc(), NULL, c->aes_key, c->aes_iv)) {
+        pa_log("Failed to set up AES encryption");
+        return -1;
+    }
+    EVP_CIPHER_CTX_set_padding(c->aes, 0);
+
+    c->rtsp = pa_rtsp_client_new(c->core->mainloop, c->host, c->port, "iTunes/4.6 (Macintosh; U; PPC Mac OS X 10.3)");
 
     /* Generate random instance id */
     pa_random(&rand_data, sizeof(rand_data));
@@ -519,19 +559,26 @@ int pa_raop_client_encode_sample(pa_raop_client* c, pa_memchunk* raw, pa_memchun
     bit_writer(&bp,&bpos,&size,(bsize>>8)&0xff,8);
     bit_writer(&bp,&bpos,&size,(bsize)&0xff,8);
 
-    ibp = p = pa_memblock_acquire(raw->memblock);
-    maxibp = p + raw->length - 4;
-    while (ibp <= maxibp) {
-        /* Byte swap stereo data */
-        bit_writer(&bp,&bpos,&size,*(ibp+1),8);
-        bit_writer(&bp,&bpos,&size,*(ibp+0),8);
-        bit_writer(&bp,&bpos,&size,*(ibp+3),8);
-        bit_writer(&bp,&bpos,&size,*(ibp+2),8);
-        ibp += 4;
-        raw->index += 4;
-        raw->length -= 4;
+    /* Byte swap stereo data, a frame at a time, and append the frames
+     * behind the 55 bits of the header */
+    p = pa_memblock_acquire(raw->memblock);
+    ibp = p + raw->index;
+    maxibp = ibp + length;
+    while (ibp < maxibp) {
+        uint8_t swapped[256];
+        size_t i, n = PA_MIN(sizeof(swapped), (size_t) (maxibp - ibp));
+
+        for (i = 0; i < n; i += 2) {
+            swapped[i] = ibp[i+1];
+            swapped[i+1] = ibp[i];
+        }
+
+        byte_writer(&bp, bpos, &size, swapped, n);
+        ibp += n;
     }
     pa_memblock_release(raw->memblock);
+    raw->index += length;
+    raw->length -= length;
     encoded->length = header_size + size;
 
     /* store the length (endian swapped: make this better) */
@@ -540,7 +587,12 @@ int pa_raop_client_encode_sample(pa_raop_client* c, pa_memchunk* raw, pa_memchun
     *(b + 3) = len & 0xff;
 
     /* encrypt our data */
-    aes_encrypt(c, (b + header_size), size);
+    if (aes_encrypt(c, (b + header_size), size) < 0) {
+        pa_memblock_release(encoded->memblock);
+        pa_memblock_unref(encoded->memblock);
+        pa_memchunk_reset(encoded);
+        return -1;
+    }
 
     /* We're done with the chunk */
     pa_memblock_release(encoded->memblock);
@@ -46,12 +46,18 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/mix.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/socket-util.h>
 #include <pulsecore/atomic.h>
 #include <pulsecore/once.h>
 #include <pulsecore/poll.h>
 #include <pulsecore/arpa-inet.h>
+#include <pulsecore/asyncq.h>
+#include <pulsecore/flist.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+#include <pulsecore/rtpoll.h>
 
 #include "module-rtp-recv-symdef.h"
 
@@ -67,6 +73,8 @@ PA_MODULE_USAGE(
         "sink=<name of the sink> "
         "sap_address=<multicast address to listen on> "
         "latency_msec=<latency in ms> "
+        "adaptive_latency=<follow the jitter of the network, with latency_msec at most> "
+        "shared_receiver=<receive all sessions in a thread of the module> "
 );
 
 #define SAP_PORT 9875
@@ -74,16 +82,83 @@ PA_MODULE_USAGE(
 #define DEFAULT_LATENCY_MSEC 500
 #define MEMBLOCKQ_MAXLENGTH (1024*1024*40)
 #define MAX_SESSIONS 16
+#define MAX_SHARED_SESSIONS 512
 #define DEATH_TIMEOUT 20
 #define RATE_UPDATE_INTERVAL (5*PA_USEC_PER_SEC)
+#define DEFAULT_ADAPTIVE_LATENCY true
+
+/* With adaptive latency the sink may run at this latency, the lowest
+ * target latency is twice as much */
+#define ADAPTIVE_SINK_LATENCY (20*PA_USEC_PER_MSEC)
+
+/* The target latency keeps this many times the jitter in the queue */
+#define JITTER_FACTOR 4
+
+/* Gaps up to this long are filled with the last packet, fading out */
+#define CONCEAL_MAX_USEC (80*PA_USEC_PER_MSEC)
+
+/* Packets a session can have queued in shared receiver mode */
+#define JITTER_QUEUE_SIZE 1024
 
 static const char* const valid_modargs[] = {
     "sink",
     "sap_address",
     "latency_msec",
+    "adaptive_latency",
+    "shared_receiver",
     NULL
 };
 
+/* In shared receiver mode there is one socket per port, which joins the
+ * groups of all sessions on it, and a thread of the module reads all
+ * these sockets. It tells the packets apart by their destination address
+ * and queues them for their session, and the sink inputs take them from
+ * there when the sink asks them for data. So the sessions don't add
+ * anything to the rtpoll of the sink. */
+
+struct packet {
+    pa_memchunk chunk;
+    struct timeval tstamp;
+    uint32_t timestamp;
+    uint32_t ssrc;
+    uint8_t payload;
+};
+
+PA_STATIC_FLIST_DECLARE(packets, 0, pa_xfree);
+
+/* Sessions are found by destination address and port. The address is left
+ * zero for the sockets. */
+struct demux_key {
+    sa_family_t family;
+    uint16_t port;
+    uint8_t address[16];
+};
+
+struct shared_socket {
+    struct userdata *userdata;
+    struct demux_key key;
+    unsigned n_sessions;
+
+    /* Only the receive thread reads from it */
+    pa_rtp_context rtp_context;
+    pa_rtpoll_item *rtpoll_item;
+};
+
+struct receiver_msg {
+    pa_msgobject parent;
+    struct userdata *userdata;
+};
+
+typedef struct receiver_msg receiver_msg;
+PA_DEFINE_PRIVATE_CLASS(receiver_msg, pa_msgobject);
+
+enum {
+    RECEIVER_MESSAGE_ADD_SOCKET,
+    RECEIVER_MESSAGE_REMOVE_SOCKET,
+    RECEIVER_MESSAGE_ADD_SESSION,
+    RECEIVER_MESSAGE_REMOVE_SESSION
+};
+
 struct session {
     struct userdata *userdata;
     PA_LLIST_FIELDS(struct session);
@@ -101,6 +176,11 @@ struct session {
 
     pa_rtpoll_item *rtpoll_item;
 
+    /* Shared receiver mode */
+    struct demux_key key;
+    struct shared_socket *socket;
+    pa_asyncq *jitter_queue;
+
     pa_atomic_t timestamp;
 
     pa_usec_t intended_latency;
@@ -110,6 +190,20 @@ struct session {
     pa_usec_t last_latency;
     double estimated_rate;
     double avg_estimated_rate;
+
+    /* Interarrival jitter as in RFC 3550 A.8, in timestamp units */
+    bool have_transit;
+    int32_t last_transit;
+    double jitter;
+    pa_usec_t packet_usec;
+
+    /* The payload of the last packet, to conceal losses with */
+    pa_memchunk last_chunk;
+
+    /* For the proplist */
+    pa_atomic_t jitter_usec;
+    pa_atomic_t target_latency_usec;
+    pa_atomic_t concealed_frames;
 };
 
 struct userdata {
@@ -128,6 +222,17 @@ struct userdata {
     int n_sessions;
 
     pa_usec_t latency;
+    bool adaptive;
+
+    /* Shared receiver mode. The sockets are looked up by the main thread,
+     * the sessions by the receive thread. */
+    bool shared;
+    pa_hashmap *sockets;
+    pa_hashmap *demux;
+    pa_thread *thread;
+    pa_rtpoll *rtpoll;
+    pa_thread_mq thread_mq;
+    receiver_msg *msg;
 };
 
 static void session_free(struct session *s);
@@ -148,12 +253,17 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *data, int64_t
     return pa_sink_input_process_msg(o, code, data, offset, chunk);
 }
 
+static void drain_jitter_queue(struct session *s);
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk) {
     struct session *s;
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
+    if (s->jitter_queue)
+        drain_jitter_queue(s);
+
     if (pa_memblockq_peek(s->memblockq, chunk) < 0)
         return -1;
 
@@ -191,9 +301,18 @@ static void sink_input_kill(pa_sink_input* i) {
     pa_hashmap_remove_and_free(s->userdata->by_origin, s->sdp_info.origin);
 }
 
+static void packet_free(struct packet *p) {
+    pa_memblock_unref(p->chunk.memblock);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(packets), p) < 0)
+        pa_xfree(p);
+}
+
 /* Called from IO context */
 static void sink_input_suspend_within_thread(pa_sink_input* i, bool b) {
     struct session *s;
+    struct packet *p;
+
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
@@ -201,88 +320,279 @@ static void sink_input_suspend_within_thread(pa_sink_input* i, bool b) {
         pa_memblockq_flush_read(s->memblockq);
     else
         s->first_packet = false;
+
+    /* What was queued meanwhile is stale */
+    if (s->jitter_queue)
+        while ((p = pa_asyncq_pop(s->jitter_queue, false)))
+            packet_free(p);
 }
 
-/* Called from I/O thread context */
-static int rtpoll_work_cb(pa_rtpoll_item *i) {
-    pa_memchunk chunk;
-    int64_t k, j, delta;
-    struct timeval now = { 0, 0 };
-    struct session *s;
-    struct pollfd *p;
+/* Fills a gap of length bytes, where packets are missing, with copies of
+ * the last packet at half the volume of the one before. Beyond
+ * CONCEAL_MAX_USEC the gap stays silent. Packets that arrive late still
+ * replace this.
+ *
+ * Called from I/O thread context */
+static void conceal_gap(struct session *s, size_t length) {
+    size_t max, done = 0;
+    double gain = 1.0;
+
+    max = pa_usec_to_bytes(CONCEAL_MAX_USEC, &s->sdp_info.sample_spec);
+
+    while (s->last_chunk.memblock && done < length && done < max) {
+        pa_memchunk c;
+        pa_cvolume v;
+        void *src, *dst;
+
+        c.index = 0;
+        c.length = PA_MIN(s->last_chunk.length, length - done);
+        c.memblock = pa_memblock_new(s->userdata->module->core->mempool, c.length);
+
+        src = pa_memblock_acquire(s->last_chunk.memblock);
+        dst = pa_memblock_acquire(c.memblock);
+        memcpy(dst, (uint8_t*) src + s->last_chunk.index, c.length);
+        pa_memblock_release(c.memblock);
+        pa_memblock_release(s->last_chunk.memblock);
+
+        gain /= 2;
+        pa_cvolume_set(&v, s->sdp_info.sample_spec.channels, pa_sw_volume_from_linear(gain));
+        pa_volume_memchunk(&c, &s->sdp_info.sample_spec, &v);
+
+        if (pa_memblockq_push(s->memblockq, &c) < 0)
+            pa_memblockq_seek(s->memblockq, (int64_t) c.length, PA_SEEK_RELATIVE, true);
+
+        pa_memblock_unref(c.memblock);
+        done += c.length;
+    }
 
-    pa_assert_se(s = pa_rtpoll_item_get_userdata(i));
+    if (done > 0)
+        pa_atomic_add(&s->concealed_frames, (int) (done / s->rtp_context.frame_size));
 
-    p = pa_rtpoll_item_get_pollfd(i, NULL);
+    if (done < length)
+        pa_memblockq_seek(s->memblockq, (int64_t) (length - done), PA_SEEK_RELATIVE, true);
+}
 
-    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
-        pa_log("poll() signalled bad revents.");
-        return -1;
+/* now is the arrival time of the packet with the given timestamp.
+ *
+ * Called from I/O thread context */
+static void update_jitter(struct session *s, uint32_t timestamp, const struct timeval *now) {
+    uint32_t rate = s->sdp_info.sample_spec.rate;
+    uint32_t arrival;
+    int32_t transit, d;
+
+    arrival = (uint32_t) (pa_timeval_load(now) * rate / PA_USEC_PER_SEC);
+    transit = (int32_t) (arrival - timestamp);
+
+    if (s->have_transit) {
+        d = transit - s->last_transit;
+        s->jitter += (fabs((double) d) - s->jitter) / 16;
     }
 
-    if ((p->revents & POLLIN) == 0)
-        return 0;
+    s->last_transit = transit;
+    s->have_transit = true;
 
-    p->revents = 0;
+    pa_atomic_store(&s->jitter_usec, (int) (s->jitter * PA_USEC_PER_SEC / rate));
+}
 
-    if (pa_rtp_recv(&s->rtp_context, &chunk, s->userdata->module->core->mempool, &now) < 0)
-        return 0;
+/* Takes one packet, returns whether it was queued.
+ *
+ * Called from I/O thread context */
+static bool queue_packet(struct session *s, struct packet *p) {
+    pa_memchunk *chunk = &p->chunk;
+    struct timeval *now = &p->tstamp;
+    int64_t k, j, delta;
 
-    if (s->sdp_info.payload != s->rtp_context.payload ||
+    if (s->sdp_info.payload != p->payload ||
         !PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state)) {
-        pa_memblock_unref(chunk.memblock);
-        return 0;
+        pa_memblock_unref(chunk->memblock);
+        return false;
+    }
+
+    /* A shared socket carries sessions of all frame sizes */
+    if (chunk->length % s->rtp_context.frame_size != 0) {
+        pa_log_warn("Bad RTP packet size.");
+        pa_memblock_unref(chunk->memblock);
+        return false;
     }
 
     if (!s->first_packet) {
         s->first_packet = true;
 
-        s->ssrc = s->rtp_context.ssrc;
-        s->offset = s->rtp_context.timestamp;
+        s->ssrc = p->ssrc;
+        s->offset = p->timestamp;
 
         if (s->ssrc == s->userdata->module->core->cookie)
             pa_log_warn("Detected RTP packet loop!");
     } else {
-        if (s->ssrc != s->rtp_context.ssrc) {
-            pa_memblock_unref(chunk.memblock);
-            return 0;
+        if (s->ssrc != p->ssrc) {
+            pa_memblock_unref(chunk->memblock);
+            return false;
         }
     }
 
     /* Check whether there was a timestamp overflow */
-    k = (int64_t) s->rtp_context.timestamp - (int64_t) s->offset;
-    j = (int64_t) 0x100000000LL - (int64_t) s->offset + (int64_t) s->rtp_context.timestamp;
+    k = (int64_t) p->timestamp - (int64_t) s->offset;
+    j = (int64_t) 0x100000000LL - (int64_t) s->offset + (int64_t) p->timestamp;
 
     if ((k < 0 ? -k : k) < (j < 0 ? -j : j))
         delta = k;
     else
         delta = j;
 
-    pa_memblockq_seek(s->memblockq, delta * (int64_t) s->rtp_context.frame_size, PA_SEEK_RELATIVE, true);
+    if (delta > 0)
+        conceal_gap(s, (size_t) delta * s->rtp_context.frame_size);
+    else
+        pa_memblockq_seek(s->memblockq, delta * (int64_t) s->rtp_context.frame_size, PA_SEEK_RELATIVE, true);
 
-    if (now.tv_sec == 0) {
+    if (now->tv_sec == 0) {
         PA_ONCE_BEGIN {
             pa_log_warn("Using artificial time instead of timestamp");
         } PA_ONCE_END;
-        pa_rtclock_get(&now);
+        pa_rtclock_get(now);
     } else
-        pa_rtclock_from_wallclock(&now);
+        pa_rtclock_from_wallclock(now);
+
+    update_jitter(s, p->timestamp, now);
 
-    if (pa_memblockq_push(s->memblockq, &chunk) < 0) {
+    if (pa_memblockq_push(s->memblockq, chunk) < 0) {
         pa_log_warn("Queue overrun");
-        pa_memblockq_seek(s->memblockq, (int64_t) chunk.length, PA_SEEK_RELATIVE, true);
+        pa_memblockq_seek(s->memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, true);
     }
 
 /*     pa_log("blocks in q: %u", pa_memblockq_get_nblocks(s->memblockq)); */
 
-    pa_memblock_unref(chunk.memblock);
+    /* A late packet went into what was concealed or left silent. Keep
+     * writing behind the newest one. Further back it is a new start of
+     * the sender, which we follow. */
+    if (delta * (int64_t) s->rtp_context.frame_size + (int64_t) chunk->length < 0 &&
+        pa_bytes_to_usec((uint64_t) -delta * s->rtp_context.frame_size, &s->sdp_info.sample_spec) <= s->intended_latency) {
+        pa_memblockq_seek(s->memblockq, -(delta * (int64_t) s->rtp_context.frame_size + (int64_t) chunk->length), PA_SEEK_RELATIVE, true);
+        pa_memblock_unref(chunk->memblock);
+        pa_atomic_store(&s->timestamp, (int) now->tv_sec);
+        return true;
+    }
+
+    if (s->last_chunk.memblock)
+        pa_memblock_unref(s->last_chunk.memblock);
+    s->last_chunk = *chunk;
+
+    s->packet_usec = pa_bytes_to_usec(chunk->length, &s->sdp_info.sample_spec);
 
     /* The next timestamp we expect */
-    s->offset = s->rtp_context.timestamp + (uint32_t) (chunk.length / s->rtp_context.frame_size);
+    s->offset = p->timestamp + (uint32_t) (chunk->length / s->rtp_context.frame_size);
 
-    pa_atomic_store(&s->timestamp, (int) now.tv_sec);
+    pa_atomic_store(&s->timestamp, (int) now->tv_sec);
+
+    return true;
+}
+
+static void adjust_rate(struct session *s, const struct timeval *now);
+
+/* Called from I/O thread context */
+static void drain_jitter_queue(struct session *s) {
+    struct timeval now = { 0, 0 };
+    struct packet *p;
+    bool queued = false;
+
+    while ((p = pa_asyncq_pop(s->jitter_queue, false))) {
+        if (queue_packet(s, p)) {
+            queued = true;
+            now = p->tstamp;
+        }
+
+        /* queue_packet() gave up the memblock already */
+        if (pa_flist_push(PA_STATIC_FLIST_GET(packets), p) < 0)
+            pa_xfree(p);
+    }
+
+    if (queued)
+        adjust_rate(s, &now);
+}
+
+/* Called from I/O thread context */
+static int rtpoll_work_cb(pa_rtpoll_item *i) {
+    struct timeval now = { 0, 0 };
+    struct packet packet;
+    struct session *s;
+    struct pollfd *p;
+    bool queued = false;
+
+    pa_assert_se(s = pa_rtpoll_item_get_userdata(i));
+
+    p = pa_rtpoll_item_get_pollfd(i, NULL);
+
+    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
+        pa_log("poll() signalled bad revents.");
+        return -1;
+    }
+
+    if ((p->revents & POLLIN) == 0)
+        return 0;
+
+    p->revents = 0;
+
+    /* The first call reads all packets that are waiting */
+    do {
+        if (pa_rtp_recv(&s->rtp_context, &packet.chunk, s->userdata->module->core->mempool, &packet.tstamp) < 0)
+            continue;
+
+        packet.timestamp = s->rtp_context.timestamp;
+        packet.ssrc = s->rtp_context.ssrc;
+        packet.payload = s->rtp_context.payload;
+
+        if (queue_packet(s, &packet)) {
+            queued = true;
+            now = packet.tstamp;
+        }
+    } while (pa_rtp_recv_pending(&s->rtp_context));
+
+    if (!queued)
+        return 0;
+
+    adjust_rate(s, &now);
+
+    if (pa_memblockq_is_readable(s->memblockq) &&
+        s->sink_input->thread_info.underrun_for > 0) {
+        pa_log_debug("Requesting rewind due to end of underrun");
+        pa_sink_input_request_rewind(s->sink_input,
+                                     (size_t) (s->sink_input->thread_info.underrun_for == (uint64_t) -1 ? 0 : s->sink_input->thread_info.underrun_for),
+                                     false, true, false);
+    }
 
-    if (s->last_rate_update + RATE_UPDATE_INTERVAL < pa_timeval_load(&now)) {
+    return 1;
+}
+
+/* Sets the latency we aim for from the jitter seen. It grows at once but
+ * shrinks only a quarter of the way at each rate update, the rate
+ * adjustment then moves the queue there without seeking.
+ *
+ * Called from I/O thread context */
+static void update_target_latency(struct session *s) {
+    pa_usec_t target, jitter;
+
+    jitter = (pa_usec_t) (s->jitter * PA_USEC_PER_SEC / s->sdp_info.sample_spec.rate);
+    target = s->sink_latency + JITTER_FACTOR * jitter + 2 * s->packet_usec;
+    target = PA_CLAMP(target, s->sink_latency * 2, PA_MAX(s->userdata->latency, s->sink_latency * 2));
+
+    if (target > s->intended_latency)
+        s->intended_latency = target;
+    else
+        s->intended_latency -= (s->intended_latency - target) / 4;
+
+    /* After an underrun the queue fills up to the new target */
+    pa_memblockq_set_prebuf(s->memblockq, pa_usec_to_bytes(s->intended_latency - s->sink_latency, &s->sdp_info.sample_spec));
+
+    pa_atomic_store(&s->target_latency_usec, (int) s->intended_latency);
+
+    pa_log_debug("Jitter %0.2f ms, target latency %0.2f ms",
+                 (double) jitter / PA_USEC_PER_MSEC, (double) s->intended_latency / PA_USEC_PER_MSEC);
+}
+
+/* Follows the rate of the sender, now is the time of the last packet.
+ *
+ * Called from I/O thread context */
+static void adjust_rate(struct session *s, const struct timeval *now) {
+    if (s->last_rate_update + RATE_UPDATE_INTERVAL < pa_timeval_load(now)) {
         pa_usec_t wi, ri, render_delay, sink_delay = 0, latency;
         uint32_t base_rate = s->sink_input->sink->sample_spec.rate;
         uint32_t current_rate = s->sink_input->sample_spec.rate;
@@ -291,6 +601,9 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
         pa_log_debug("Updating sample rate");
 
+        if (s->userdata->adaptive)
+            update_target_latency(s);
+
         wi = pa_bytes_to_usec((uint64_t) pa_memblockq_get_write_index(s->memblockq), &s->sink_input->sample_spec);
         ri = pa_bytes_to_usec((uint64_t) pa_memblockq_get_read_index(s->memblockq), &s->sink_input->sample_spec);
 
@@ -371,18 +684,8 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
         pa_log_debug("Updated sampling rate to %lu Hz.", (unsigned long) s->sink_input->sample_spec.rate);
 
-        s->last_rate_update = pa_timeval_load(&now);
+        s->last_rate_update = pa_timeval_load(now);
     }
-
-    if (pa_memblockq_is_readable(s->memblockq) &&
-        s->sink_input->thread_info.underrun_for > 0) {
-        pa_log_debug("Requesting rewind due to end of underrun");
-        pa_sink_input_request_rewind(s->sink_input,
-                                     (size_t) (s->sink_input->thread_info.underrun_for == (uint64_t) -1 ? 0 : s->sink_input->thread_info.underrun_for),
-                                     false, true, false);
-    }
-
-    return 1;
 }
 
 /* Called from I/O thread context */
@@ -393,6 +696,10 @@ static void sink_input_attach(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
+    /* The receive thread reads the packets */
+    if (s->jitter_queue)
+        return;
+
     pa_assert(!s->rtpoll_item);
     s->rtpoll_item = pa_rtpoll_item_new(i->sink->thread_info.rtpoll, PA_RTPOLL_LATE, 1);
 
@@ -411,13 +718,46 @@ static void sink_input_detach(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
+    if (s->jitter_queue)
+        return;
+
     pa_assert(s->rtpoll_item);
     pa_rtpoll_item_free(s->rtpoll_item);
     s->rtpoll_item = NULL;
 }
 
+/* Joins or leaves the group of sa, if it is a multicast address */
+static int mcast_membership(int fd, const struct sockaddr *sa, bool join) {
+    int r = 0;
+
+    if (sa->sa_family == AF_INET) {
+        /* IPv4 multicast addresses are in the 224.0.0.0-239.255.255.255 range */
+        static const uint32_t ipv4_mcast_mask = 0xe0000000;
+
+        if ((ntohl(((const struct sockaddr_in*) sa)->sin_addr.s_addr) & ipv4_mcast_mask) == ipv4_mcast_mask) {
+            struct ip_mreq mr4;
+            memset(&mr4, 0, sizeof(mr4));
+            mr4.imr_multiaddr = ((const struct sockaddr_in*) sa)->sin_addr;
+            r = setsockopt(fd, IPPROTO_IP, join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP, &mr4, sizeof(mr4));
+        }
+#ifdef HAVE_IPV6
+    } else if (sa->sa_family == AF_INET6) {
+        /* IPv6 multicast addresses have 255 as the most significant byte */
+        if (((const struct sockaddr_in6*) sa)->sin6_addr.s6_addr[0] == 0xff) {
+            struct ipv6_mreq mr6;
+            memset(&mr6, 0, sizeof(mr6));
+            mr6.ipv6mr_multiaddr = ((const struct sockaddr_in6*) sa)->sin6_addr;
+            r = setsockopt(fd, IPPROTO_IPV6, join ? IPV6_JOIN_GROUP : IPV6_LEAVE_GROUP, &mr6, sizeof(mr6));
+        }
+#endif
+    } else
+        pa_assert_not_reached();
+
+    return r;
+}
+
 static int mcast_socket(const struct sockaddr* sa, socklen_t salen) {
-    int af, fd = -1, r, one;
+    int af, fd = -1, one;
 
     pa_assert(sa);
     pa_assert(salen > 0);
@@ -447,31 +787,7 @@ static int mcast_socket(const struct sockaddr* sa, socklen_t salen) {
         goto fail;
     }
 
-    r = 0;
-    if (af == AF_INET) {
-        /* IPv4 multicast addresses are in the 224.0.0.0-239.255.255.255 range */
-        static const uint32_t ipv4_mcast_mask = 0xe0000000;
-
-        if ((ntohl(((const struct sockaddr_in*) sa)->sin_addr.s_addr) & ipv4_mcast_mask) == ipv4_mcast_mask) {
-            struct ip_mreq mr4;
-            memset(&mr4, 0, sizeof(mr4));
-            mr4.imr_multiaddr = ((const struct sockaddr_in*) sa)->sin_addr;
-            r = setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mr4, sizeof(mr4));
-        }
-#ifdef HAVE_IPV6
-    } else if (af == AF_INET6) {
-        /* IPv6 multicast addresses have 255 as the most significant byte */
-        if (((const struct sockaddr_in6*) sa)->sin6_addr.s6_addr[0] == 0xff) {
-            struct ipv6_mreq mr6;
-            memset(&mr6, 0, sizeof(mr6));
-            mr6.ipv6mr_multiaddr = ((const struct sockaddr_in6*) sa)->sin6_addr;
-            r = setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mr6, sizeof(mr6));
-        }
-#endif
-    } else
-        pa_assert_not_reached();
-
-    if (r < 0) {
+    if (mcast_membership(fd, sa, true) < 0) {
         pa_log_info("Joining mcast group failed: %s", pa_cstrerror(errno));
         goto fail;
     }
@@ -490,6 +806,314 @@ fail:
     return -1;
 }
 
+static unsigned demux_key_hash_func(const void *p) {
+    const struct demux_key *k = p;
+    unsigned hash;
+    size_t i;
+
+    hash = ((unsigned) k->family << 16) | k->port;
+    for (i = 0; i < sizeof(k->address); i++)
+        hash = 31 * hash + k->address[i];
+
+    return hash;
+}
+
+static int demux_key_compare_func(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(struct demux_key));
+}
+
+/* The key of the session that receives packets sent to sa, or with
+ * with_address = false the one of the socket that gets them */
+static void demux_key_from_sockaddr(struct demux_key *k, const struct sockaddr *sa, bool with_address) {
+    pa_zero(*k);
+    k->family = sa->sa_family;
+
+    if (sa->sa_family == AF_INET) {
+        const struct sockaddr_in *sa4 = (const struct sockaddr_in*) sa;
+
+        k->port = sa4->sin_port;
+        if (with_address)
+            memcpy(k->address, &sa4->sin_addr, sizeof(sa4->sin_addr));
+#ifdef HAVE_IPV6
+    } else if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *sa6 = (const struct sockaddr_in6*) sa;
+
+        k->port = sa6->sin6_port;
+        if (with_address)
+            memcpy(k->address, &sa6->sin6_addr, sizeof(sa6->sin6_addr));
+#endif
+    } else
+        pa_assert_not_reached();
+}
+
+/* Called from the receive thread */
+static int socket_work_cb(pa_rtpoll_item *i) {
+    struct shared_socket *ss;
+    struct userdata *u;
+    struct pollfd *p;
+    struct demux_key key;
+    struct session *s;
+    struct packet *packet;
+    pa_memchunk chunk;
+    struct timeval tstamp;
+
+    pa_assert_se(ss = pa_rtpoll_item_get_userdata(i));
+    u = ss->userdata;
+
+    p = pa_rtpoll_item_get_pollfd(i, NULL);
+
+    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
+        pa_log("poll() signalled bad revents.");
+        return -1;
+    }
+
+    if ((p->revents & POLLIN) == 0)
+        return 0;
+
+    p->revents = 0;
+
+    do {
+        if (pa_rtp_recv(&ss->rtp_context, &chunk, u->core->mempool, &tstamp) < 0)
+            continue;
+
+        key = ss->key;
+        memcpy(key.address, ss->rtp_context.destination, ss->rtp_context.destination_size);
+
+        if (!(s = pa_hashmap_get(u->demux, &key))) {
+            pa_memblock_unref(chunk.memblock);
+            continue;
+        }
+
+        pa_rtp_count_received(&s->rtp_context, ss->rtp_context.sequence);
+
+        if (!(packet = pa_flist_pop(PA_STATIC_FLIST_GET(packets))))
+            packet = pa_xnew(struct packet, 1);
+
+        packet->chunk = chunk;
+        packet->tstamp = tstamp;
+        packet->timestamp = ss->rtp_context.timestamp;
+        packet->ssrc = ss->rtp_context.ssrc;
+        packet->payload = ss->rtp_context.payload;
+
+        /* The sink doesn't keep up with the session */
+        if (pa_asyncq_push(s->jitter_queue, packet, false) < 0) {
+            pa_atomic_inc(&s->rtp_context.n_lost);
+            packet_free(packet);
+        }
+    } while (pa_rtp_recv_pending(&ss->rtp_context));
+
+    return 0;
+}
+
+/* Called from the receive thread */
+static int receiver_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = ((receiver_msg*) o)->userdata;
+    struct shared_socket *ss;
+    struct session *s;
+    struct pollfd *p;
+
+    switch (code) {
+        case RECEIVER_MESSAGE_ADD_SOCKET:
+            ss = data;
+
+            pa_assert(!ss->rtpoll_item);
+            ss->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_NORMAL, 1);
+
+            p = pa_rtpoll_item_get_pollfd(ss->rtpoll_item, NULL);
+            p->fd = ss->rtp_context.fd;
+            p->events = POLLIN;
+            p->revents = 0;
+
+            pa_rtpoll_item_set_work_callback(ss->rtpoll_item, socket_work_cb);
+            pa_rtpoll_item_set_userdata(ss->rtpoll_item, ss);
+            return 0;
+
+        case RECEIVER_MESSAGE_REMOVE_SOCKET:
+            ss = data;
+
+            pa_assert(ss->rtpoll_item);
+            pa_rtpoll_item_free(ss->rtpoll_item);
+            ss->rtpoll_item = NULL;
+            return 0;
+
+        case RECEIVER_MESSAGE_ADD_SESSION:
+            s = data;
+            pa_assert_se(pa_hashmap_put(u->demux, &s->key, s) == 0);
+            return 0;
+
+        case RECEIVER_MESSAGE_REMOVE_SESSION:
+            s = data;
+            pa_assert_se(pa_hashmap_remove(u->demux, &s->key) == s);
+            return 0;
+    }
+
+    return 0;
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Receive thread starting up");
+
+    if (u->core->realtime_scheduling)
+        pa_make_realtime(u->core->realtime_priority);
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    for (;;) {
+        int ret;
+
+        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+    }
+
+fail:
+    /* If this was no regular exit from the loop we have to continue
+     * processing messages until we received PA_MESSAGE_SHUTDOWN */
+    pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+    pa_asyncmsgq_wait_for(u->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("Receive thread shutting down");
+}
+
+/* Returns the socket that gets the packets sent to sa, opening it if
+ * needed, and joins the group of sa on it */
+static struct shared_socket *shared_socket_get(struct userdata *u, const struct sockaddr *sa) {
+    struct shared_socket *ss;
+    struct demux_key key;
+    int fd = -1, one;
+
+    demux_key_from_sockaddr(&key, sa, false);
+
+    if ((ss = pa_hashmap_get(u->sockets, &key))) {
+        if (mcast_membership(ss->rtp_context.fd, sa, true) < 0) {
+            pa_log_info("Joining mcast group failed: %s", pa_cstrerror(errno));
+            return NULL;
+        }
+
+        ss->n_sessions++;
+        return ss;
+    }
+
+    if ((fd = pa_socket_cloexec(sa->sa_family, SOCK_DGRAM, 0)) < 0) {
+        pa_log("Failed to create socket: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    pa_make_udp_socket_low_delay(fd);
+
+    one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) < 0) {
+        pa_log("SO_TIMESTAMP failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0) {
+        pa_log("SO_REUSEADDR failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if (sa->sa_family == AF_INET) {
+        struct sockaddr_in sa4;
+
+#ifdef IP_PKTINFO
+        one = 1;
+        if (setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one)) < 0) {
+            pa_log("IP_PKTINFO failed: %s", pa_cstrerror(errno));
+            goto fail;
+        }
+#endif
+
+        pa_zero(sa4);
+        sa4.sin_family = AF_INET;
+        sa4.sin_port = key.port;
+        sa4.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        if (bind(fd, (struct sockaddr*) &sa4, sizeof(sa4)) < 0) {
+            pa_log("bind() failed: %s", pa_cstrerror(errno));
+            goto fail;
+        }
+#ifdef HAVE_IPV6
+    } else {
+        struct sockaddr_in6 sa6;
+
+        /* The IPv4 packets go to a socket of their own */
+        one = 1;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one)) < 0) {
+            pa_log("IPV6_V6ONLY failed: %s", pa_cstrerror(errno));
+            goto fail;
+        }
+
+#ifdef IPV6_RECVPKTINFO
+        one = 1;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &one, sizeof(one)) < 0) {
+            pa_log("IPV6_RECVPKTINFO failed: %s", pa_cstrerror(errno));
+            goto fail;
+        }
+#endif
+
+        pa_zero(sa6);
+        sa6.sin6_family = AF_INET6;
+        sa6.sin6_port = key.port;
+        sa6.sin6_addr = in6addr_any;
+
+        if (bind(fd, (struct sockaddr*) &sa6, sizeof(sa6)) < 0) {
+            pa_log("bind() failed: %s", pa_cstrerror(errno));
+            goto fail;
+        }
+#endif
+    }
+
+    if (mcast_membership(fd, sa, true) < 0) {
+        pa_log_info("Joining mcast group failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    ss = pa_xnew0(struct shared_socket, 1);
+    ss->userdata = u;
+    ss->key = key;
+    ss->n_sessions = 1;
+
+    /* Sessions check the frame size themselves */
+    pa_rtp_context_init_recv(&ss->rtp_context, fd, 1);
+
+    pa_hashmap_put(u->sockets, &ss->key, ss);
+    pa_asyncmsgq_send(u->thread_mq.inq, PA_MSGOBJECT(u->msg), RECEIVER_MESSAGE_ADD_SOCKET, ss, 0, NULL);
+
+    return ss;
+
+fail:
+    if (fd >= 0)
+        pa_close(fd);
+
+    return NULL;
+}
+
+/* Leaves the group of sa, and closes the socket with its last session */
+static void shared_socket_release(struct shared_socket *ss, const struct sockaddr *sa) {
+    struct userdata *u = ss->userdata;
+
+    pa_assert(ss->n_sessions >= 1);
+
+    mcast_membership(ss->rtp_context.fd, sa, false);
+
+    if (--ss->n_sessions > 0)
+        return;
+
+    pa_asyncmsgq_send(u->thread_mq.inq, PA_MSGOBJECT(u->msg), RECEIVER_MESSAGE_REMOVE_SOCKET, ss, 0, NULL);
+    pa_hashmap_remove(u->sockets, &ss->key);
+
+    pa_rtp_context_destroy(&ss->rtp_context);
+    pa_xfree(ss);
+}
+
 static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_info) {
     struct session *s = NULL;
     pa_sink *sink;
@@ -501,7 +1125,7 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     pa_assert(u);
     pa_assert(sdp_info);
 
-    if (u->n_sessions >= MAX_SESSIONS) {
+    if (u->n_sessions >= (u->shared ? MAX_SHARED_SESSIONS : MAX_SESSIONS)) {
         pa_log("Session limit reached.");
         goto fail;
     }
@@ -525,7 +1149,22 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     s->avg_estimated_rate = (double) sink->sample_spec.rate;
     pa_atomic_store(&s->timestamp, (int) now.tv_sec);
 
-    if ((fd = mcast_socket((const struct sockaddr*) &sdp_info->sa, sdp_info->salen)) < 0)
+    if (u->shared) {
+        struct session *other;
+
+        demux_key_from_sockaddr(&s->key, (const struct sockaddr*) &sdp_info->sa, true);
+
+        PA_LLIST_FOREACH(other, u->sessions)
+            if (demux_key_compare_func(&other->key, &s->key) == 0) {
+                pa_log("Session '%s' uses the address of session '%s'.", sdp_info->session_name, other->sdp_info.session_name);
+                goto fail;
+            }
+
+        if (!(s->socket = shared_socket_get(u, (const struct sockaddr*) &sdp_info->sa)))
+            goto fail;
+
+        s->jitter_queue = pa_asyncq_new(JITTER_QUEUE_SIZE);
+    } else if ((fd = mcast_socket((const struct sockaddr*) &sdp_info->sa, sdp_info->salen)) < 0)
         goto fail;
 
     pa_sink_input_new_data_init(&data);
@@ -567,7 +1206,10 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
 
     pa_sink_input_get_silence(s->sink_input, &silence);
 
-    s->sink_latency = pa_sink_input_set_requested_latency(s->sink_input, s->intended_latency/2);
+    /* With adaptive latency the queue may get a lot shorter than
+     * latency_msec, so the sink has to be able to follow */
+    s->sink_latency = pa_sink_input_set_requested_latency(s->sink_input,
+                                                          u->adaptive ? PA_MIN(s->intended_latency/2, ADAPTIVE_SINK_LATENCY) : s->intended_latency/2);
 
     if (s->intended_latency < s->sink_latency*2)
         s->intended_latency = s->sink_latency*2;
@@ -585,6 +1227,8 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
 
     pa_memblock_unref(silence.memblock);
 
+    pa_atomic_store(&s->target_latency_usec, (int) s->intended_latency);
+
     pa_rtp_context_init_recv(&s->rtp_context, fd, pa_frame_size(&s->sdp_info.sample_spec));
 
     pa_hashmap_put(s->userdata->by_origin, s->sdp_info.origin, s);
@@ -593,11 +1237,20 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
 
     pa_sink_input_put(s->sink_input);
 
+    if (s->socket)
+        pa_asyncmsgq_send(u->thread_mq.inq, PA_MSGOBJECT(u->msg), RECEIVER_MESSAGE_ADD_SESSION, s, 0, NULL);
+
     pa_log_info("New session '%s'", s->sdp_info.session_name);
 
     return s;
 
 fail:
+    if (s && s->jitter_queue)
+        pa_asyncq_free(s->jitter_queue, NULL);
+
+    if (s && s->socket)
+        shared_socket_release(s->socket, (const struct sockaddr*) &sdp_info->sa);
+
     pa_xfree(s);
 
     if (fd >= 0)
@@ -611,6 +1264,9 @@ static void session_free(struct session *s) {
 
     pa_log_info("Freeing session '%s'", s->sdp_info.session_name);
 
+    if (s->socket)
+        pa_asyncmsgq_send(s->userdata->thread_mq.inq, PA_MSGOBJECT(s->userdata->msg), RECEIVER_MESSAGE_REMOVE_SESSION, s, 0, NULL);
+
     pa_sink_input_unlink(s->sink_input);
     pa_sink_input_unref(s->sink_input);
 
@@ -619,8 +1275,18 @@ static void session_free(struct session *s) {
     s->userdata->n_sessions--;
 
     pa_memblockq_free(s->memblockq);
+
+    if (s->last_chunk.memblock)
+        pa_memblock_unref(s->last_chunk.memblock);
+
+    if (s->socket) {
+        /* The context only has the counters, the socket has the fd */
+        pa_asyncq_free(s->jitter_queue, (pa_free_cb_t) packet_free);
+        shared_socket_release(s->socket, (const struct sockaddr*) &s->sdp_info.sa);
+    } else
+        pa_rtp_context_destroy(&s->rtp_context);
+
     pa_sdp_info_destroy(&s->sdp_info);
-    pa_rtp_context_destroy(&s->rtp_context);
 
     pa_xfree(s);
 }
@@ -666,6 +1332,7 @@ static void check_death_event_cb(pa_mainloop_api *m, pa_time_event *t, const str
     struct session *s, *n;
     struct userdata *u = userdata;
     struct timeval now;
+    pa_proplist *pl;
 
     pa_assert(m);
     pa_assert(t);
@@ -681,8 +1348,20 @@ static void check_death_event_cb(pa_mainloop_api *m, pa_time_event *t, const str
 
         k = pa_atomic_load(&s->timestamp);
 
-        if (k + DEATH_TIMEOUT < now.tv_sec)
+        if (k + DEATH_TIMEOUT < now.tv_sec) {
             pa_hashmap_remove_and_free(u->by_origin, s->sdp_info.origin);
+            continue;
+        }
+
+        pl = pa_proplist_new();
+        pa_rtp_context_fill_proplist(&s->rtp_context, pl);
+        pa_proplist_setf(pl, "rtp.jitter_usec", "%u", (unsigned) pa_atomic_load(&s->jitter_usec));
+        pa_proplist_setf(pl, "rtp.target_latency_usec", "%u", (unsigned) pa_atomic_load(&s->target_latency_usec));
+        pa_proplist_setf(pl, "rtp.concealed_usec", "%llu",
+                         (unsigned long long) pa_bytes_to_usec((uint64_t) (unsigned) pa_atomic_load(&s->concealed_frames) * s->rtp_context.frame_size,
+                                                               &s->sdp_info.sample_spec));
+        pa_sink_input_update_proplist(s->sink_input, PA_UPDATE_REPLACE, pl);
+        pa_proplist_free(pl);
     }
 
     /* Restart timer */
@@ -700,6 +1379,7 @@ int pa__init(pa_module*m) {
     socklen_t salen;
     const char *sap_address;
     uint32_t latency_msec;
+    bool shared = false, adaptive = DEFAULT_ADAPTIVE_LATENCY;
     int fd = -1;
 
     pa_assert(m);
@@ -734,14 +1414,33 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "adaptive_latency", &adaptive) < 0) {
+        pa_log("Failed to parse adaptive_latency value");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "shared_receiver", &shared) < 0) {
+        pa_log("Failed to parse shared_receiver value");
+        goto fail;
+    }
+
+#if !defined(IP_PKTINFO) || (defined(HAVE_IPV6) && !defined(IPV6_RECVPKTINFO))
+    if (shared) {
+        pa_log("shared_receiver needs the destination address of packets, which isn't available on this platform");
+        goto fail;
+    }
+#endif
+
     if ((fd = mcast_socket(sa, salen)) < 0)
         goto fail;
 
-    m->userdata = u = pa_xnew(struct userdata, 1);
+    m->userdata = u = pa_xnew0(struct userdata, 1);
     u->module = m;
     u->core = m->core;
     u->sink_name = pa_xstrdup(pa_modargs_get_value(ma, "sink", NULL));
     u->latency = (pa_usec_t) latency_msec * PA_USEC_PER_MSEC;
+    u->adaptive = adaptive;
+    u->shared = shared;
 
     u->sap_event = m->core->mainloop->io_new(m->core->mainloop, fd, PA_IO_EVENT_INPUT, sap_event_cb, u);
     pa_sap_context_init_recv(&u->sap_context, fd);
@@ -752,6 +1451,25 @@ int pa__init(pa_module*m) {
 
     u->check_death_event = pa_core_rttime_new(m->core, pa_rtclock_now() + DEATH_TIMEOUT * PA_USEC_PER_SEC, check_death_event_cb, u);
 
+    if (u->shared) {
+        u->sockets = pa_hashmap_new(demux_key_hash_func, demux_key_compare_func);
+        u->demux = pa_hashmap_new(demux_key_hash_func, demux_key_compare_func);
+
+        u->msg = pa_msgobject_new(receiver_msg);
+        u->msg->parent.process_msg = receiver_process_msg;
+        u->msg->userdata = u;
+
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+
+        if (!(u->thread = pa_thread_new("rtp-recv", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            pa_modargs_free(ma);
+            pa__done(m);
+            return -1;
+        }
+    }
+
     pa_modargs_free(ma);
 
     return 0;
@@ -782,9 +1500,31 @@ void pa__done(pa_module*m) {
 
     pa_sap_context_destroy(&u->sap_context);
 
+    /* The sessions leave the receive thread first */
     if (u->by_origin)
         pa_hashmap_free(u->by_origin);
 
+    if (u->thread) {
+        pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(u->thread);
+    }
+
+    if (u->rtpoll) {
+        pa_thread_mq_done(&u->thread_mq);
+        pa_rtpoll_free(u->rtpoll);
+    }
+
+    if (u->msg)
+        pa_xfree(u->msg);
+
+    if (u->sockets) {
+        pa_assert(pa_hashmap_isempty(u->sockets));
+        pa_hashmap_free(u->sockets);
+    }
+
+    if (u->demux)
+        pa_hashmap_free(u->demux);
+
     pa_xfree(u->sink_name);
     pa_xfree(u);
 }
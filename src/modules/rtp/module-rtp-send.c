@@ -36,7 +36,6 @@
 #include <pulsecore/module.h>
 #include <pulsecore/source.h>
 #include <pulsecore/source-output.h>
-#include <pulsecore/memblockq.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/modargs.h>
@@ -75,7 +74,6 @@ PA_MODULE_USAGE(
 #define SAP_PORT 9875
 #define DEFAULT_SOURCE_IP "0.0.0.0"
 #define DEFAULT_DESTINATION_IP "224.0.0.56"
-#define MEMBLOCKQ_MAXLENGTH (1024*170)
 #define DEFAULT_MTU 1280
 #define SAP_INTERVAL (5*PA_USEC_PER_SEC)
 
@@ -105,7 +103,6 @@ struct userdata {
     pa_module *module;
 
     pa_source_output *source_output;
-    pa_memblockq *memblockq;
 
     pa_rtp_context rtp_context;
     pa_sap_context sap_context;
@@ -123,7 +120,7 @@ static int source_output_process_msg(pa_msgobject *o, int code, void *data, int6
 
     switch (code) {
         case PA_SOURCE_OUTPUT_MESSAGE_GET_LATENCY:
-            *((pa_usec_t*) data) = pa_bytes_to_usec(pa_memblockq_get_length(u->memblockq), &u->source_output->sample_spec);
+            *((pa_usec_t*) data) = pa_bytes_to_usec(u->rtp_context.pending_length, &u->source_output->sample_spec);
 
             /* Fall through, the default handler will add in the extra
              * latency added by the resampler */
@@ -139,12 +136,8 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     pa_source_output_assert_ref(o);
     pa_assert_se(u = o->userdata);
 
-    if (pa_memblockq_push(u->memblockq, chunk) < 0) {
-        pa_log_warn("Failed to push chunk into memblockq.");
-        return;
-    }
-
-    pa_rtp_send(&u->rtp_context, u->mtu, u->memblockq);
+    /* The packets are sent right from the memblocks of the chunks */
+    pa_rtp_send(&u->rtp_context, u->mtu, chunk);
 }
 
 static pa_source_output_flags_t get_dont_inhibit_auto_suspend_flag(pa_source *source,
@@ -202,6 +195,14 @@ static void sap_event_cb(pa_mainloop_api *m, pa_time_event *t, const struct time
 
     pa_sap_send(&u->sap_context, 0);
 
+    if (u->source_output) {
+        pa_proplist *pl = pa_proplist_new();
+
+        pa_rtp_context_fill_proplist(&u->rtp_context, pl);
+        pa_source_output_update_proplist(u->source_output, PA_UPDATE_REPLACE, pl);
+        pa_proplist_free(pl);
+    }
+
     pa_core_rttime_restart(u->module->core, t, pa_rtclock_now() + SAP_INTERVAL);
 }
 
@@ -455,17 +456,6 @@ int pa__init(pa_module*m) {
     u->module = m;
     u->source_output = o;
 
-    u->memblockq = pa_memblockq_new(
-            "module-rtp-send memblockq",
-            0,
-            MEMBLOCKQ_MAXLENGTH,
-            MEMBLOCKQ_MAXLENGTH,
-            &ss,
-            1,
-            0,
-            0,
-            NULL);
-
     u->mtu = mtu;
 
     k = sizeof(sa_dst);
@@ -544,8 +534,5 @@ void pa__done(pa_module*m) {
     pa_sap_send(&u->sap_context, 1);
     pa_sap_context_destroy(&u->sap_context);
 
-    if (u->memblockq)
-        pa_memblockq_free(u->memblockq);
-
     pa_xfree(u);
 }
@@ -41,12 +41,23 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/arpa-inet.h>
 
+#ifdef __linux__
+#include <netinet/udp.h>
+#endif
+
 #include "rtp.h"
 
 pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssrc, uint8_t payload, size_t frame_size) {
+#ifdef UDP_SEGMENT
+    int v;
+    socklen_t l = sizeof(v);
+#endif
+
     pa_assert(c);
     pa_assert(fd >= 0);
 
+    pa_zero(*c);
+
     c->fd = fd;
     c->sequence = (uint16_t) (rand()*rand());
     c->timestamp = 0;
@@ -56,102 +67,285 @@ pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssr
 
     pa_memchunk_reset(&c->memchunk);
 
+#ifdef UDP_SEGMENT
+    /* Kernels that know the socket option also take it as control message */
+    c->gso = getsockopt(fd, SOL_UDP, UDP_SEGMENT, &v, &l) >= 0;
+#endif
+
     return c;
 }
 
-#define MAX_IOVECS 16
+/* A header, the pending pieces and the new chunk */
+#define MAX_IOVECS (PA_RTP_PENDING_MAX + 2)
+
+/* UDP GSO limits, the datagram has to fit into one IP packet */
+#define GSO_SEGMENTS_MAX 64
+#define GSO_SIZE_MAX 65000
+
+/* The packets collected by pa_rtp_send(). The iovecs of each packet follow
+ * the ones of the packet before, starting with its header, so that a run of
+ * packets can be handed to the kernel as a single GSO datagram. */
+struct send_batch {
+    struct iovec iov[PA_RTP_BATCH_MAX * MAX_IOVECS];
+    pa_memblock *mb[PA_RTP_BATCH_MAX * MAX_IOVECS];
+    uint32_t header[PA_RTP_BATCH_MAX][3];
+    unsigned first_iov[PA_RTP_BATCH_MAX + 1];
+    size_t length[PA_RTP_BATCH_MAX];
+    unsigned n_packets, n_iovs;
+};
+
+struct send_message {
+    struct msghdr hdr;
+    unsigned n_packets;
+#ifdef UDP_SEGMENT
+    uint8_t control[CMSG_SPACE(sizeof(uint16_t))];
+#endif
+};
 
-int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
-    struct iovec iov[MAX_IOVECS];
-    pa_memblock* mb[MAX_IOVECS];
-    int iov_idx = 1;
-    size_t n = 0;
+/* Fills one message per packet, or per run of packets of the same size if
+ * GSO is used. Returns the number of messages. */
+static unsigned fill_messages(pa_rtp_context *c, struct send_batch *b, struct send_message *msgs) {
+    unsigned i, n = 0;
 
-    pa_assert(c);
-    pa_assert(size > 0);
-    pa_assert(q);
+    for (i = 0; i < b->n_packets; n++) {
+        struct send_message *m = &msgs[n];
+        unsigned j = i + 1;
 
-    if (pa_memblockq_get_length(q) < size)
-        return 0;
+        if (c->gso) {
+            size_t total = b->length[i];
+
+            /* Every packet but the last one has to be as large as the first */
+            while (j < b->n_packets && j - i < GSO_SEGMENTS_MAX && b->length[j - 1] == b->length[i] &&
+                   total + b->length[j] <= GSO_SIZE_MAX)
+                total += b->length[j++];
+        }
+
+        pa_zero(m->hdr);
+        m->hdr.msg_iov = &b->iov[b->first_iov[i]];
+        m->hdr.msg_iovlen = (size_t) (b->first_iov[j] - b->first_iov[i]);
+        m->n_packets = j - i;
+
+#ifdef UDP_SEGMENT
+        if (m->n_packets > 1) {
+            struct cmsghdr *cm;
+            uint16_t gso_size = (uint16_t) b->length[i];
+
+            m->hdr.msg_control = m->control;
+            m->hdr.msg_controllen = sizeof(m->control);
+
+            cm = CMSG_FIRSTHDR(&m->hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(gso_size));
+            memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+        }
+#endif
 
-    for (;;) {
-        int r;
-        pa_memchunk chunk;
+        i = j;
+    }
+
+    return n;
+}
+
+/* Returns how many of the messages were sent, or -1 */
+static int send_messages(pa_rtp_context *c, struct send_message *msgs, unsigned n) {
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr mmsgs[PA_RTP_BATCH_MAX];
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        mmsgs[i].msg_hdr = msgs[i].hdr;
+        mmsgs[i].msg_len = 0;
+    }
+
+    pa_atomic_inc(&c->n_calls);
+    return sendmmsg(c->fd, mmsgs, n, MSG_DONTWAIT);
+#else
+    unsigned i;
 
-        pa_memchunk_reset(&chunk);
+    for (i = 0; i < n; i++) {
+        pa_atomic_inc(&c->n_calls);
 
-        if ((r = pa_memblockq_peek(q, &chunk)) >= 0) {
+        if (sendmsg(c->fd, &msgs[i].hdr, MSG_DONTWAIT) < 0)
+            return i > 0 ? (int) i : -1;
+    }
 
-            size_t k = n + chunk.length > size ? size - n : chunk.length;
+    return (int) n;
+#endif
+}
 
-            pa_assert(chunk.memblock);
+/* Sends and releases the packets of the batch */
+static int flush_batch(pa_rtp_context *c, struct send_batch *b) {
+    struct send_message msgs[PA_RTP_BATCH_MAX];
+    unsigned i, n, sent = 0, n_sent = 0;
+    int ret = 0;
 
-            iov[iov_idx].iov_base = pa_memblock_acquire_chunk(&chunk);
-            iov[iov_idx].iov_len = k;
-            mb[iov_idx] = chunk.memblock;
-            iov_idx ++;
+    n = fill_messages(c, b, msgs);
 
-            n += k;
-            pa_memblockq_drop(q, k);
+    while (sent < n) {
+        int k;
+
+        if ((k = send_messages(c, msgs + sent, n - sent)) >= 0) {
+            for (i = sent; i < sent + (unsigned) k; i++)
+                n_sent += msgs[i].n_packets;
+            sent += (unsigned) k;
+            continue;
         }
 
-        pa_assert(n % c->frame_size == 0);
+        if (c->gso && msgs[sent].n_packets > 1 && (errno == EINVAL || errno == EIO)) {
+            /* The route or the device may not support segmentation. Only
+             * the messages not sent yet are split up again, which is fine
+             * because they start at a packet boundary. */
+            pa_log_info("Sending UDP GSO datagrams failed, sending every packet on its own: %s", pa_cstrerror(errno));
+            c->gso = false;
+
+            for (i = 0; i < sent; i++)
+                b->n_packets -= msgs[i].n_packets;
+            memmove(b->length, b->length + n_sent, b->n_packets * sizeof(b->length[0]));
+            memmove(b->first_iov, b->first_iov + n_sent, (b->n_packets + 1) * sizeof(b->first_iov[0]));
+
+            n = fill_messages(c, b, msgs);
+            sent = 0;
+            continue;
+        }
 
-        if (r < 0 || n >= size || iov_idx >= MAX_IOVECS) {
-            uint32_t header[3];
-            struct msghdr m;
-            ssize_t k;
-            int i;
+        if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
+            pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
 
-            if (n > 0) {
-                header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
-                header[1] = htonl(c->timestamp);
-                header[2] = htonl(c->ssrc);
+        ret = -1;
+        break;
+    }
 
-                iov[0].iov_base = (void*)header;
-                iov[0].iov_len = sizeof(header);
+    pa_atomic_add(&c->n_packets, (int) n_sent);
 
-                m.msg_name = NULL;
-                m.msg_namelen = 0;
-                m.msg_iov = iov;
-                m.msg_iovlen = (size_t) iov_idx;
-                m.msg_control = NULL;
-                m.msg_controllen = 0;
-                m.msg_flags = 0;
+    for (i = sent; i < n; i++)
+        pa_atomic_add(&c->n_lost, (int) msgs[i].n_packets);
 
-                k = sendmsg(c->fd, &m, MSG_DONTWAIT);
+    for (i = 0; i < b->n_iovs; i++) {
+        if (!b->mb[i])
+            continue;
 
-                for (i = 1; i < iov_idx; i++) {
-                    pa_memblock_release(mb[i]);
-                    pa_memblock_unref(mb[i]);
-                }
+        pa_memblock_release(b->mb[i]);
+        pa_memblock_unref(b->mb[i]);
+    }
 
-                c->sequence++;
-            } else
-                k = 0;
+    b->n_packets = 0;
+    b->n_iovs = 0;
 
-            c->timestamp += (unsigned) (n/c->frame_size);
+    return ret;
+}
 
-            if (k < 0) {
-                if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
-                    pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
-                return -1;
-            }
+/* Starts a packet, its first iovec is for the header */
+static void begin_packet(struct send_batch *b) {
+    b->first_iov[b->n_packets] = b->n_iovs;
+    b->mb[b->n_iovs] = NULL;
+    b->n_iovs++;
+}
+
+/* Adds length bytes of mb at index to the packet, taking over the
+ * reference to mb */
+static void add_payload(struct send_batch *b, pa_memblock *mb, size_t index, size_t length) {
+    b->iov[b->n_iovs].iov_base = (uint8_t*) pa_memblock_acquire(mb) + index;
+    b->iov[b->n_iovs].iov_len = length;
+    b->mb[b->n_iovs] = mb;
+    b->n_iovs++;
+}
 
-            if (r < 0 || pa_memblockq_get_length(q) < size)
-                break;
+/* Finishes a packet of n bytes of audio */
+static void end_packet(pa_rtp_context *c, struct send_batch *b, size_t n) {
+    uint32_t *header = b->header[b->n_packets];
 
-            n = 0;
-            iov_idx = 1;
+    header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
+    header[1] = htonl(c->timestamp);
+    header[2] = htonl(c->ssrc);
+
+    b->iov[b->first_iov[b->n_packets]].iov_base = (void*) header;
+    b->iov[b->first_iov[b->n_packets]].iov_len = sizeof(b->header[0]);
+
+    b->length[b->n_packets] = sizeof(b->header[0]) + n;
+    b->n_packets++;
+    b->first_iov[b->n_packets] = b->n_iovs;
+
+    c->sequence++;
+    c->timestamp += (unsigned) (n/c->frame_size);
+}
+
+/* Hands the pending audio to the packet */
+static size_t add_pending(pa_rtp_context *c, struct send_batch *b) {
+    size_t n = c->pending_length;
+    unsigned i;
+
+    for (i = 0; i < c->n_pending; i++)
+        add_payload(b, c->pending[i].memblock, c->pending[i].index, c->pending[i].length);
+
+    c->n_pending = 0;
+    c->pending_length = 0;
+
+    return n;
+}
+
+int pa_rtp_send(pa_rtp_context *c, size_t size, const pa_memchunk *chunk) {
+    struct send_batch b;
+    size_t offset = 0;
+    int ret = 0;
+
+    pa_assert(c);
+    pa_assert(size > 0);
+    pa_assert(size % c->frame_size == 0);
+    pa_assert(chunk);
+    pa_assert(chunk->memblock);
+    pa_assert(chunk->length % c->frame_size == 0);
+
+    b.n_packets = 0;
+    b.n_iovs = 0;
+
+    while (c->pending_length + chunk->length - offset >= size) {
+        size_t k;
+
+        begin_packet(&b);
+        k = size - add_pending(c, &b);
+
+        add_payload(&b, pa_memblock_ref(chunk->memblock), chunk->index + offset, k);
+        offset += k;
+
+        end_packet(c, &b, size);
+
+        /* Packets that couldn't go out are counted as lost, the ones after
+         * them are still tried */
+        if (b.n_packets >= PA_RTP_BATCH_MAX && flush_batch(c, &b) < 0)
+            ret = -1;
+    }
+
+    if (offset < chunk->length) {
+
+        /* The pieces don't fit into the iovecs of a packet anymore, so
+         * what we have goes out as a shorter one */
+        if (c->n_pending >= PA_RTP_PENDING_MAX) {
+            size_t n;
+
+            begin_packet(&b);
+            n = add_pending(c, &b);
+            end_packet(c, &b, n);
         }
+
+        c->pending[c->n_pending].memblock = pa_memblock_ref(chunk->memblock);
+        c->pending[c->n_pending].index = chunk->index + offset;
+        c->pending[c->n_pending].length = chunk->length - offset;
+        c->pending_length += chunk->length - offset;
+        c->n_pending++;
     }
 
-    return 0;
+    if (b.n_packets > 0 && flush_batch(c, &b) < 0)
+        ret = -1;
+
+    return ret;
 }
 
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size) {
     pa_assert(c);
 
+    pa_zero(*c);
+
     c->fd = fd;
     c->frame_size = frame_size;
 
@@ -159,98 +353,213 @@ pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame
     return c;
 }
 
-int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
-    int size;
-    struct msghdr m;
-    struct cmsghdr *cm;
-    struct iovec iov;
-    uint32_t header;
-    unsigned cc;
-    ssize_t r;
-    uint8_t aux[1024];
-    bool found_tstamp = false;
+/* Room for the SCM_TIMESTAMP data of one packet */
+#define RECV_CONTROL_SIZE 128
+
+/* Reads as many packets as are waiting, up to PA_RTP_BATCH_MAX, into
+ * slots of recv_size bytes of the current memblock. */
+static int receive_batch(pa_rtp_context *c, pa_mempool *pool) {
+    struct iovec iov[PA_RTP_BATCH_MAX];
+    uint8_t aux[PA_RTP_BATCH_MAX][RECV_CONTROL_SIZE];
+    unsigned i, n_slots;
+    uint8_t *d;
+    int r;
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr m[PA_RTP_BATCH_MAX];
+#else
+    struct {
+        struct msghdr msg_hdr;
+        unsigned msg_len;
+    } m[PA_RTP_BATCH_MAX];
+#endif
 
-    pa_assert(c);
-    pa_assert(chunk);
+    if (c->received_block) {
+        pa_memblock_unref(c->received_block);
+        c->received_block = NULL;
+    }
 
-    pa_memchunk_reset(chunk);
+    c->n_received = c->next_received = 0;
 
-    if (ioctl(c->fd, FIONREAD, &size) < 0) {
-        pa_log_warn("FIONREAD failed: %s", pa_cstrerror(errno));
-        goto fail;
-    }
+    if (c->recv_size <= 0) {
+        int size;
+
+        /* Learn the size of the packets from the first one */
+        if (ioctl(c->fd, FIONREAD, &size) < 0) {
+            pa_log_warn("FIONREAD failed: %s", pa_cstrerror(errno));
+            return -1;
+        }
 
-    if (size <= 0) {
-        /* size can be 0 due to any of the following reasons:
-         *
-         * 1. Somebody sent us a perfectly valid zero-length UDP packet.
-         * 2. Somebody sent us a UDP packet with a bad CRC.
-         *
-         * It is unknown whether size can actually be less than zero.
-         *
-         * In the first case, the packet has to be read out, otherwise the
-         * kernel will tell us again and again about it, thus preventing
-         * reception of any further packets. So let's just read it out
-         * now and discard it later, when comparing the number of bytes
-         * received (0) with the number of bytes wanted (1, see below).
-         *
-         * In the second case, recvmsg() will fail, thus allowing us to
-         * return the error.
-         *
-         * Just to avoid passing zero-sized memchunks and NULL pointers to
-         * recvmsg(), let's force allocation of at least one byte by setting
-         * size to 1.
-         */
-        size = 1;
+        /* size can be 0 for a valid zero-length UDP packet, or one with a
+         * bad CRC. The former has to be read out, otherwise the kernel will
+         * tell us again and again about it; it is discarded later as too
+         * short. In the latter case recvmsg() will fail. */
+        c->recv_size = PA_ALIGN((size_t) PA_MAX(size, 1));
     }
 
-    if (c->memchunk.length < (unsigned) size) {
+    if (c->memchunk.length < c->recv_size) {
         size_t l;
 
         if (c->memchunk.memblock)
             pa_memblock_unref(c->memchunk.memblock);
 
-        l = PA_MAX((size_t) size, pa_mempool_block_size_max(pool));
+        l = PA_MAX(c->recv_size, pa_mempool_block_size_max(pool));
 
         c->memchunk.memblock = pa_memblock_new(pool, l);
         c->memchunk.index = 0;
         c->memchunk.length = pa_memblock_get_length(c->memchunk.memblock);
     }
 
-    pa_assert(c->memchunk.length >= (size_t) size);
+    n_slots = (unsigned) PA_MIN(c->memchunk.length / c->recv_size, (size_t) PA_RTP_BATCH_MAX);
+    pa_assert(n_slots > 0);
 
-    chunk->memblock = pa_memblock_ref(c->memchunk.memblock);
-    chunk->index = c->memchunk.index;
+    d = pa_memblock_acquire_chunk(&c->memchunk);
 
-    iov.iov_base = pa_memblock_acquire_chunk(chunk);
-    iov.iov_len = (size_t) size;
+    for (i = 0; i < n_slots; i++) {
+        iov[i].iov_base = d + i * c->recv_size;
+        iov[i].iov_len = c->recv_size;
 
-    m.msg_name = NULL;
-    m.msg_namelen = 0;
-    m.msg_iov = &iov;
-    m.msg_iovlen = 1;
-    m.msg_control = aux;
-    m.msg_controllen = sizeof(aux);
-    m.msg_flags = 0;
+        pa_zero(m[i]);
+        m[i].msg_hdr.msg_iov = &iov[i];
+        m[i].msg_hdr.msg_iovlen = 1;
+        m[i].msg_hdr.msg_control = aux[i];
+        m[i].msg_hdr.msg_controllen = sizeof(aux[i]);
+    }
 
-    r = recvmsg(c->fd, &m, 0);
-    pa_memblock_release(chunk->memblock);
+    /* MSG_TRUNC makes us learn the real size of packets that did not fit */
+#ifdef HAVE_RECVMMSG
+    pa_atomic_inc(&c->n_calls);
+    r = recvmmsg(c->fd, m, n_slots, MSG_DONTWAIT|MSG_TRUNC, NULL);
+#else
+    for (r = 0; r < (int) n_slots; r++) {
+        ssize_t k;
 
-    if (r != size) {
+        pa_atomic_inc(&c->n_calls);
+
+        if ((k = recvmsg(c->fd, &m[r].msg_hdr, MSG_DONTWAIT|MSG_TRUNC)) < 0) {
+            if (r == 0)
+                r = -1;
+            break;
+        }
+
+        m[r].msg_len = (unsigned) k;
+    }
+#endif
+
+    pa_memblock_release(c->memchunk.memblock);
+
+    if (r <= 0) {
         if (r < 0 && errno != EAGAIN && errno != EINTR)
-            pa_log_warn("recvmsg() failed: %s", r < 0 ? pa_cstrerror(errno) : "size mismatch");
+            pa_log_warn("recvmsg() failed: %s", pa_cstrerror(errno));
+
+        return -1;
+    }
+
+    for (i = 0; i < (unsigned) r; i++) {
+        pa_rtp_received *p = &c->received[i];
+        struct msghdr *h = &m[i].msg_hdr;
+        struct cmsghdr *cm;
+
+        p->index = c->memchunk.index + i * c->recv_size;
+        p->length = m[i].msg_len;
+        pa_zero(p->tstamp);
+        p->destination_size = 0;
+
+        for (cm = CMSG_FIRSTHDR(h); cm; cm = CMSG_NXTHDR(h, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP)
+                memcpy(&p->tstamp, CMSG_DATA(cm), sizeof(struct timeval));
+#ifdef IP_PKTINFO
+            else if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_PKTINFO) {
+                struct in_pktinfo info;
+
+                memcpy(&info, CMSG_DATA(cm), sizeof(info));
+                memcpy(p->destination, &info.ipi_addr, sizeof(info.ipi_addr));
+                p->destination_size = sizeof(info.ipi_addr);
+            }
+#endif
+#if defined(HAVE_IPV6) && defined(IPV6_PKTINFO)
+            else if (cm->cmsg_level == IPPROTO_IPV6 && cm->cmsg_type == IPV6_PKTINFO) {
+                struct in6_pktinfo info;
+
+                memcpy(&info, CMSG_DATA(cm), sizeof(info));
+                memcpy(p->destination, &info.ipi6_addr, sizeof(info.ipi6_addr));
+                p->destination_size = sizeof(info.ipi6_addr);
+            }
+#endif
+        }
+    }
+
+    c->received_block = pa_memblock_ref(c->memchunk.memblock);
+    c->n_received = (unsigned) r;
 
+    c->memchunk.index += (size_t) r * c->recv_size;
+    c->memchunk.length -= (size_t) r * c->recv_size;
+
+    if (c->memchunk.length <= 0) {
+        pa_memblock_unref(c->memchunk.memblock);
+        pa_memchunk_reset(&c->memchunk);
+    }
+
+    return 0;
+}
+
+void pa_rtp_count_received(pa_rtp_context *c, uint16_t sequence) {
+    pa_assert(c);
+
+    /* Count the packets that went missing since the last one, late ones
+     * don't count */
+    if (c->have_sequence && (uint16_t) (sequence - c->sequence - 1) < 0x8000U)
+        pa_atomic_add(&c->n_lost, (uint16_t) (sequence - c->sequence - 1));
+
+    c->sequence = sequence;
+    c->have_sequence = true;
+
+    pa_atomic_inc(&c->n_packets);
+}
+
+bool pa_rtp_recv_pending(pa_rtp_context *c) {
+    pa_assert(c);
+
+    return c->next_received < c->n_received;
+}
+
+int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
+    pa_rtp_received *p;
+    uint8_t *d;
+    uint32_t header;
+    unsigned cc;
+    size_t size;
+
+    pa_assert(c);
+    pa_assert(chunk);
+
+    pa_memchunk_reset(chunk);
+
+    if (!pa_rtp_recv_pending(c) && receive_batch(c, pool) < 0)
+        goto fail;
+
+    p = &c->received[c->next_received++];
+    size = p->length;
+
+    if (size > c->recv_size) {
+        pa_log_warn("RTP packet larger than the ones before, dropped.");
+        pa_atomic_inc(&c->n_lost);
+        c->recv_size = PA_ALIGN(size);
         goto fail;
     }
 
+    chunk->memblock = pa_memblock_ref(c->received_block);
+    chunk->index = p->index;
+
     if (size < 12) {
         pa_log_warn("RTP packet too short.");
         goto fail;
     }
 
-    memcpy(&header, iov.iov_base, sizeof(uint32_t));
-    memcpy(&c->timestamp, (uint8_t*) iov.iov_base + 4, sizeof(uint32_t));
-    memcpy(&c->ssrc, (uint8_t*) iov.iov_base + 8, sizeof(uint32_t));
+    d = (uint8_t*) pa_memblock_acquire(chunk->memblock) + chunk->index;
+    memcpy(&header, d, sizeof(uint32_t));
+    memcpy(&c->timestamp, d + 4, sizeof(uint32_t));
+    memcpy(&c->ssrc, d + 8, sizeof(uint32_t));
+    pa_memblock_release(chunk->memblock);
 
     header = ntohl(header);
     c->timestamp = ntohl(c->timestamp);
@@ -273,40 +582,29 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
 
     cc = (header >> 24) & 0xF;
     c->payload = (uint8_t) ((header >> 16) & 127U);
-    c->sequence = (uint16_t) (header & 0xFFFFU);
 
-    if (12 + cc*4 > (unsigned) size) {
+    pa_rtp_count_received(c, (uint16_t) (header & 0xFFFFU));
+
+    if (12 + cc*4 > size) {
         pa_log_warn("RTP packet too short. (CSRC)");
         goto fail;
     }
 
     chunk->index += 12 + cc*4;
-    chunk->length = (size_t) size - 12 + cc*4;
+    chunk->length = size - 12 + cc*4;
 
     if (chunk->length % c->frame_size != 0) {
         pa_log_warn("Bad RTP packet size.");
         goto fail;
     }
 
-    c->memchunk.index = chunk->index + chunk->length;
-    c->memchunk.length = pa_memblock_get_length(c->memchunk.memblock) - c->memchunk.index;
-
-    if (c->memchunk.length <= 0) {
-        pa_memblock_unref(c->memchunk.memblock);
-        pa_memchunk_reset(&c->memchunk);
-    }
+    if (p->tstamp.tv_sec == 0 && p->tstamp.tv_usec == 0)
+        pa_log_warn("Couldn't find SCM_TIMESTAMP data in auxiliary recvmsg() data!");
 
-    for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm))
-        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP) {
-            memcpy(tstamp, CMSG_DATA(cm), sizeof(struct timeval));
-            found_tstamp = true;
-            break;
-        }
+    *tstamp = p->tstamp;
 
-    if (!found_tstamp) {
-        pa_log_warn("Couldn't find SCM_TIMESTAMP data in auxiliary recvmsg() data!");
-        pa_zero(*tstamp);
-    }
+    memcpy(c->destination, p->destination, p->destination_size);
+    c->destination_size = p->destination_size;
 
     return 0;
 
@@ -390,13 +688,30 @@ int pa_rtp_sample_spec_valid(const pa_sample_spec *ss) {
         ss->format == PA_SAMPLE_S16BE;
 }
 
+void pa_rtp_context_fill_proplist(pa_rtp_context *c, pa_proplist *p) {
+    pa_assert(c);
+    pa_assert(p);
+
+    pa_proplist_setf(p, "rtp.packets", "%u", (unsigned) pa_atomic_load(&c->n_packets));
+    pa_proplist_setf(p, "rtp.system_calls", "%u", (unsigned) pa_atomic_load(&c->n_calls));
+    pa_proplist_setf(p, "rtp.lost_packets", "%u", (unsigned) pa_atomic_load(&c->n_lost));
+}
+
 void pa_rtp_context_destroy(pa_rtp_context *c) {
+    unsigned i;
+
     pa_assert(c);
 
     pa_assert_se(pa_close(c->fd) == 0);
 
     if (c->memchunk.memblock)
         pa_memblock_unref(c->memchunk.memblock);
+
+    for (i = 0; i < c->n_pending; i++)
+        pa_memblock_unref(c->pending[i].memblock);
+
+    if (c->received_block)
+        pa_memblock_unref(c->received_block);
 }
 
 const char* pa_rtp_format_to_string(pa_sample_format_t f) {
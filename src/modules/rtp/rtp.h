@@ -23,9 +23,29 @@
 #include <inttypes.h>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <pulsecore/memblockq.h>
+#include <sys/time.h>
+
+#include <pulse/proplist.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/memblock.h>
 #include <pulsecore/memchunk.h>
 
+/* How many packets are sent or received with one system call */
+#define PA_RTP_BATCH_MAX 32
+
+/* How many pieces of audio that don't fill a packet are kept */
+#define PA_RTP_PENDING_MAX 14
+
+typedef struct pa_rtp_received {
+    size_t index, length;
+    struct timeval tstamp;
+    /* The destination address of the packet, if IP_PKTINFO or
+     * IPV6_RECVPKTINFO is enabled on the socket */
+    uint8_t destination[16];
+    size_t destination_size;
+} pa_rtp_received;
+
 typedef struct pa_rtp_context {
     int fd;
     uint16_t sequence;
@@ -33,21 +53,61 @@ typedef struct pa_rtp_context {
     uint32_t ssrc;
     uint8_t payload;
     size_t frame_size;
+    /* Of the last packet received, see pa_rtp_received */
+    uint8_t destination[16];
+    size_t destination_size;
 
     pa_memchunk memchunk;
+
+    /* Send equally sized packets as one UDP GSO datagram */
+    bool gso;
+
+    /* Audio that doesn't fill a packet yet. It is sent straight from the
+     * memblocks it came in, together with the next chunk. */
+    pa_memchunk pending[PA_RTP_PENDING_MAX];
+    unsigned n_pending;
+    size_t pending_length;
+
+    /* The packets received with the last system call.
+     * recv_size is the room for one packet, it grows with the largest
+     * packet seen so far. */
+    size_t recv_size;
+    pa_memblock *received_block;
+    pa_rtp_received received[PA_RTP_BATCH_MAX];
+    unsigned n_received, next_received;
+    bool have_sequence;
+
+    /* Counters, updated from the IO thread; they wrap around */
+    pa_atomic_t n_packets;   /* packets sent or received */
+    pa_atomic_t n_calls;     /* system calls they took */
+    pa_atomic_t n_lost;      /* not sent, or missing on the receiving end */
 } pa_rtp_context;
 
 pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssrc, uint8_t payload, size_t frame_size);
 
-/* If the memblockq doesn't have a silence memchunk set, then the caller must
- * guarantee that the current read index doesn't point to a hole. */
-int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q);
+/* Sends all complete packets of size bytes that the pending audio and
+ * chunk make up, in batches of up to PA_RTP_BATCH_MAX packets. The
+ * packets point into the memblocks of the chunks, so these must not be
+ * changed afterwards. What is left is kept for the next call. */
+int pa_rtp_send(pa_rtp_context *c, size_t size, const pa_memchunk *chunk);
 
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size);
+
+/* Returns the next packet. All packets that are waiting on the socket are
+ * read at once, the ones left are returned without a system call as long
+ * as pa_rtp_recv_pending() is true. */
 int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp);
+bool pa_rtp_recv_pending(pa_rtp_context *c);
 
 void pa_rtp_context_destroy(pa_rtp_context *c);
 
+/* Counts a received packet in c, pa_rtp_recv() does that itself. For
+ * contexts that get their packets from another one. */
+void pa_rtp_count_received(pa_rtp_context *c, uint16_t sequence);
+
+/* Puts the counters of the context into p */
+void pa_rtp_context_fill_proplist(pa_rtp_context *c, pa_proplist *p);
+
 pa_sample_spec* pa_rtp_sample_spec_fixup(pa_sample_spec *ss);
 int pa_rtp_sample_spec_valid(const pa_sample_spec *ss);
 
@@ -0,0 +1,215 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "sim-device.h"
+
+struct pa_sim_device {
+    pa_sample_spec sample_spec;
+    size_t frame_size;
+    bool playback;
+
+    uint8_t *buffer;
+    size_t buffer_size;
+
+    uint64_t granularity; /* frames */
+    double frames_per_usec;
+
+    bool running;
+    pa_usec_t start_time;
+    uint64_t hw_start; /* where the hardware pointer was when starting */
+    uint64_t appl; /* what we wrote or read */
+
+    pa_usec_t jitter_usec;
+    uint64_t jitter_state;
+};
+
+pa_sim_device *pa_sim_device_new(const pa_sample_spec *ss, bool playback, size_t buffer_size, size_t granularity,
+                                 int32_t drift_ppm, pa_usec_t jitter_usec, uint32_t seed) {
+    pa_sim_device *d;
+
+    pa_assert(ss);
+    pa_assert(pa_sample_spec_valid(ss));
+    pa_assert(buffer_size > 0);
+    pa_assert(pa_frame_aligned(buffer_size, ss));
+    pa_assert(granularity > 0);
+    pa_assert(drift_ppm > -1000000);
+
+    d = pa_xnew0(pa_sim_device, 1);
+    d->sample_spec = *ss;
+    d->frame_size = pa_frame_size(ss);
+    d->playback = playback;
+
+    /* What capture records is silence */
+    d->buffer_size = buffer_size;
+    d->buffer = pa_xmalloc(buffer_size);
+    pa_silence_memory(d->buffer, buffer_size, ss);
+
+    d->granularity = granularity;
+    d->frames_per_usec = (double) ss->rate * (1.0 + (double) drift_ppm / 1000000.0) / PA_USEC_PER_SEC;
+
+    d->jitter_usec = jitter_usec;
+    d->jitter_state = ((uint64_t) seed + 1) * UINT64_C(0x9e3779b97f4a7c15) | 1;
+
+    return d;
+}
+
+void pa_sim_device_free(pa_sim_device *d) {
+    pa_assert(d);
+
+    pa_xfree(d->buffer);
+    pa_xfree(d);
+}
+
+void pa_sim_device_start(pa_sim_device *d, pa_usec_t now) {
+    pa_assert(d);
+    pa_assert(!d->running);
+
+    d->running = true;
+    d->start_time = now;
+}
+
+void pa_sim_device_drop(pa_sim_device *d) {
+    pa_assert(d);
+
+    d->running = false;
+    d->hw_start = d->appl;
+}
+
+bool pa_sim_device_is_running(pa_sim_device *d) {
+    pa_assert(d);
+
+    return d->running;
+}
+
+static uint64_t hw_position(pa_sim_device *d, pa_usec_t now) {
+    uint64_t frames;
+
+    if (!d->running || now <= d->start_time)
+        return d->hw_start;
+
+    frames = (uint64_t) ((double) (now - d->start_time) * d->frames_per_usec);
+    frames -= frames % d->granularity;
+
+    return d->hw_start + frames * d->frame_size;
+}
+
+int64_t pa_sim_device_delay(pa_sim_device *d, pa_usec_t now) {
+    uint64_t hw;
+
+    pa_assert(d);
+
+    hw = hw_position(d, now);
+
+    return d->playback ? (int64_t) (d->appl - hw) : (int64_t) (hw - d->appl);
+}
+
+size_t pa_sim_device_avail(pa_sim_device *d, pa_usec_t now) {
+    int64_t delay;
+
+    pa_assert(d);
+
+    delay = pa_sim_device_delay(d, now);
+
+    /* Never negative: we can't read more than was recorded nor write
+     * more than a buffer ahead */
+    return d->playback ? (size_t) ((int64_t) d->buffer_size - delay) : (size_t) delay;
+}
+
+void *pa_sim_device_begin(pa_sim_device *d, size_t *length) {
+    size_t offset;
+
+    pa_assert(d);
+    pa_assert(length);
+
+    offset = (size_t) (d->appl % d->buffer_size);
+    *length = PA_MIN(*length, d->buffer_size - offset);
+
+    return d->buffer + offset;
+}
+
+void pa_sim_device_commit(pa_sim_device *d, size_t length) {
+    pa_assert(d);
+    pa_assert(pa_frame_aligned(length, &d->sample_spec));
+
+    d->appl += length;
+}
+
+void pa_sim_device_rewind(pa_sim_device *d, size_t length) {
+    pa_assert(d);
+    pa_assert(d->playback);
+    pa_assert(length <= d->appl - d->hw_start);
+
+    d->appl -= length;
+}
+
+pa_usec_t pa_sim_device_when_avail(pa_sim_device *d, size_t avail, size_t period) {
+    int64_t target;
+    uint64_t frames, period_frames;
+
+    pa_assert(d);
+
+    if (!d->running)
+        return PA_USEC_INVALID;
+
+    if (d->playback)
+        target = (int64_t) (d->appl - d->hw_start) + (int64_t) avail - (int64_t) d->buffer_size;
+    else
+        target = (int64_t) (d->appl - d->hw_start) + (int64_t) avail;
+
+    if (target <= 0)
+        return d->start_time;
+
+    /* The first position at or after the target that the device shows */
+    frames = ((uint64_t) target + d->frame_size - 1) / d->frame_size;
+
+    if ((period_frames = period / d->frame_size) > 0)
+        frames = (frames + period_frames - 1) / period_frames * period_frames;
+
+    frames = (frames + d->granularity - 1) / d->granularity * d->granularity;
+
+    return d->start_time + (pa_usec_t) ceil((double) frames / d->frames_per_usec);
+}
+
+pa_usec_t pa_sim_device_next_jitter(pa_sim_device *d) {
+    double u;
+
+    pa_assert(d);
+
+    if (d->jitter_usec <= 0)
+        return 0;
+
+    /* xorshift64*, the same numbers everywhere */
+    d->jitter_state ^= d->jitter_state >> 12;
+    d->jitter_state ^= d->jitter_state << 25;
+    d->jitter_state ^= d->jitter_state >> 27;
+    u = (double) ((d->jitter_state * UINT64_C(2685821657736338717)) >> 11) / (double) (UINT64_C(1) << 53);
+
+    /* Mostly short delays, now and then a long one */
+    return (pa_usec_t) (-(double) d->jitter_usec * log(1 - u));
+}
@@ -0,0 +1,74 @@
+#ifndef foosimdevicehfoo
+#define foosimdevicehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+
+/* The sound card of module-sim-sink and module-sim-source: a DMA engine
+ * going round a ring buffer on a clock of its own, which may be off the
+ * system clock by some ppm, and whose position is only seen in steps,
+ * like the period interrupts of many cards. As with ALSA, positions are
+ * byte counts since the device was last stopped. Like PulseAudio sets
+ * up ALSA devices, with the stop threshold at the boundary, the device
+ * doesn't stop on an xrun but plays the stale ring or overwrites what
+ * wasn't read yet.
+ * The wakeup jitter is a deterministic random delay to add to the
+ * wakeups of the IO thread. */
+
+typedef struct pa_sim_device pa_sim_device;
+
+/* granularity is in frames, drift_ppm > 0 makes the device faster than
+ * the system clock */
+pa_sim_device *pa_sim_device_new(const pa_sample_spec *ss, bool playback, size_t buffer_size, size_t granularity,
+                                 int32_t drift_ppm, pa_usec_t jitter_usec, uint32_t seed);
+void pa_sim_device_free(pa_sim_device *d);
+
+/* Like snd_pcm_start() and snd_pcm_drop(). Dropping empties the buffer. */
+void pa_sim_device_start(pa_sim_device *d, pa_usec_t now);
+void pa_sim_device_drop(pa_sim_device *d);
+bool pa_sim_device_is_running(pa_sim_device *d);
+
+/* Bytes that can be written or read at now, more than the buffer
+ * size after an xrun */
+size_t pa_sim_device_avail(pa_sim_device *d, pa_usec_t now);
+
+/* Bytes between what we wrote and what the device played, or what the
+ * device recorded and we read. Negative after an xrun. */
+int64_t pa_sim_device_delay(pa_sim_device *d, pa_usec_t now);
+
+/* Like snd_pcm_mmap_begin() and snd_pcm_mmap_commit(): *length is
+ * limited to the contiguous part of the ring there is to write or read */
+void *pa_sim_device_begin(pa_sim_device *d, size_t *length);
+void pa_sim_device_commit(pa_sim_device *d, size_t length);
+
+/* Takes back written data, the caller keeps clear of what is played */
+void pa_sim_device_rewind(pa_sim_device *d, size_t length);
+
+/* When the device will have avail of at least the given bytes,
+ * PA_USEC_INVALID if it isn't running. With period > 0 only a wakeup at
+ * the end of a period of that many bytes counts, like when polling with
+ * period events. */
+pa_usec_t pa_sim_device_when_avail(pa_sim_device *d, size_t avail, size_t period);
+
+/* The delay to add to the next wakeup */
+pa_usec_t pa_sim_device_next_jitter(pa_sim_device *d);
+
+#endif
@@ -23,6 +23,7 @@
 #endif
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include <stdio.h>
 #include <errno.h>
@@ -65,13 +66,19 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "rate=<sample rate>"
         "channels=<number of channels> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "ring_pages=<number of pages to share with the backend>");
 
 #define DEFAULT_SINK_NAME "xenpv_output"
 #define DEFAULT_FILE_NAME "xenpv_output"
 
 #define STATE_UNDEFINED 9999
 
+/* Xen pages are always this big */
+#define RING_PAGE_SIZE 4096
+#define DEFAULT_RING_PAGES 1
+#define MAX_RING_PAGES 64
+
 int device_id = -1;
 enum xenbus_state {
     XenbusStateUnknown      = 0,
@@ -106,25 +113,27 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
-    pa_memchunk memchunk;
-
     pa_rtpoll_item *rtpoll_item;
 
+    /* Where prod_indx was when we last notified the backend */
+    uint32_t notified_indx;
+
     int write_type;
 };
 
 pa_sample_spec ss;
 pa_channel_map map;
 
-/* just to test non- frame-aligned size */
-#define BUFSIZE 2047
-
+/* The ring takes up all the granted pages, the buffer is what is left after
+ * the indices */
 struct ring {
     uint32_t cons_indx, prod_indx;
     uint32_t usable_buffer_space; /* kept here for convenience */
-    uint8_t buffer[BUFSIZE];
+    uint8_t buffer[];
 } *ioring;
 
+static size_t ring_size;
+
 static const char* const valid_modargs[] = {
     "sink_name",
     "sink_properties",
@@ -133,6 +142,7 @@ static const char* const valid_modargs[] = {
     "rate",
     "channels",
     "channel_map",
+    "ring_pages",
     NULL
 };
 
@@ -141,12 +151,13 @@ xc_interface* xch;
 xc_evtchn* xce;
 evtchn_port_or_error_t xen_evtchn_port;
 static struct xs_handle *xsh;
-struct ioctl_gntalloc_alloc_gref gref;
+struct ioctl_gntalloc_alloc_gref *gref;
 
 static int register_backend_state_watch(void);
 static int wait_for_backend_state_change(void);
 static int alloc_gref(struct ioctl_gntalloc_alloc_gref *gref, void **addr);
-static int ring_write(struct ring *r, void *src, int length);
+static size_t ring_writable(struct ring *r, size_t frame_size);
+static bool ring_wait_writable(struct ring *r, size_t frame_size);
 static int publish_spec(pa_sample_spec *ss);
 static int read_backend_default_spec(pa_sample_spec *ss);
 static int publish_param(const char *paramname, const char *value);
@@ -238,8 +249,14 @@ int (*state_callbacks[9])(void) = {
 
 static void xen_cleanup() {
     char keybuf[64];
-    /*XXX hardcoded*/
-    munmap((void*)gref.index, 4096);
+
+    if (ioring) {
+        munmap(ioring, ring_size);
+        ioring = NULL;
+    }
+
+    pa_xfree(gref);
+    gref = NULL;
 
     set_state(XenbusStateClosing);
     /* send one last event to unblock the backend */
@@ -261,9 +278,10 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
     switch (code) {
 
         case PA_SINK_MESSAGE_GET_LATENCY: {
-            size_t n = 0;
+            size_t n;
 
-            n += u->memchunk.length;
+            /* What the backend hasn't taken out of the ring yet */
+            n = (ioring->prod_indx + ioring->usable_buffer_space - ioring->cons_indx) % ioring->usable_buffer_space;
 
             *((pa_usec_t*) data) = pa_bytes_to_usec(n, &u->sink->sample_spec);
             return 0;
@@ -274,49 +292,47 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 }
 
 static int process_render(struct userdata *u) {
-    pa_assert(u);
-
-    if (u->memchunk.length <= 0)
-        pa_sink_render(u->sink, ioring->usable_buffer_space, &u->memchunk);
-
-    pa_assert(u->memchunk.length > 0);
+    size_t frame_size, n;
+    bool written = false;
 
-    xc_evtchn_notify(xce, xen_evtchn_port);
-    for (;;) {
-        ssize_t l;
-        void *p;
-
-        p = pa_memblock_acquire(u->memchunk.memblock);
-        /* xen: write data to ring buffer & notify backend */
-        l = ring_write(ioring, (uint8_t*)p + u->memchunk.index, u->memchunk.length);
+    pa_assert(u);
 
-        pa_memblock_release(u->memchunk.memblock);
+    frame_size = pa_frame_size(&u->sink->sample_spec);
 
-        pa_assert(l != 0);
+    if (!ring_wait_writable(ioring, frame_size))
+        return 0;
 
-        if (l < 0) {
-            if (errno == EINTR)
-                continue;
-            else if (errno == EAGAIN)
-                return 0;
-            else {
-                pa_log("Failed to write data to FIFO: %s", pa_cstrerror(errno));
-                return -1;
-            }
+    /* Render right into the granted pages, the free space may be split over
+     * the end of the buffer */
+    while ((n = ring_writable(ioring, frame_size)) > 0) {
+        pa_memchunk chunk;
 
-        } else {
+        chunk.memblock = pa_memblock_new_fixed(u->core->mempool, ioring->buffer + ioring->prod_indx, n, false);
+        chunk.index = 0;
+        chunk.length = n;
 
-            u->memchunk.index += (size_t) l;
-            u->memchunk.length -= (size_t) l;
+        pa_sink_render_into_full(u->sink, &chunk);
+        pa_memblock_unref_fixed(chunk.memblock);
 
-            if (u->memchunk.length <= 0) {
-                pa_memblock_unref(u->memchunk.memblock);
-                pa_memchunk_reset(&u->memchunk);
-            }
-        }
+        /* The backend must not see the index before the data */
+        xen_wmb();
+        ioring->prod_indx = (uint32_t) ((ioring->prod_indx + n) % ioring->usable_buffer_space);
+        written = true;
+    }
 
+    if (!written)
         return 0;
+
+    /* A backend that is still busy with what we notified it of before will
+     * find the new data by itself, only one that caught up may be waiting
+     * for the event */
+    xen_mb();
+    if (ioring->cons_indx == u->notified_indx) {
+        xc_evtchn_notify(xce, xen_evtchn_port);
+        u->notified_indx = ioring->prod_indx;
     }
+
+    return 0;
 }
 
 static void thread_func(void *userdata) {
@@ -384,6 +400,8 @@ int pa__init(pa_module*m) {
     int backend_state;
     int ret;
     char strbuf[100];
+    uint32_t ring_pages = DEFAULT_RING_PAGES;
+    unsigned i;
 
     pa_assert(m);
 
@@ -401,6 +419,11 @@ int pa__init(pa_module*m) {
         return 1;
     }
 
+    if (pa_modargs_get_value_u32(ma, "ring_pages", &ring_pages) < 0 || ring_pages < 1 || ring_pages > MAX_RING_PAGES) {
+        pa_log("Invalid ring_pages value, must be between 1 and %u.", MAX_RING_PAGES);
+        goto fail;
+    }
+
     /* Xen Basic init */
     xsh = xs_domain_open();
     if (xsh==NULL) {
@@ -427,8 +450,12 @@ int pa__init(pa_module*m) {
         pa_log("xc_evtchn_bind_unbound_port failed");
     }
 
-    /* get grant reference & map locally */
-    if (alloc_gref(&gref, (void**)&ioring)) {
+    /* get grant references & map locally */
+    gref = pa_xmalloc0(sizeof(*gref) + (ring_pages - 1) * sizeof(gref->gref_ids[0]));
+    gref->count = ring_pages;
+    ring_size = ring_pages * RING_PAGE_SIZE;
+
+    if (alloc_gref(gref, (void**)&ioring)) {
        pa_log("alloc_gref failed");
     };
     device_id = 0; /* hardcoded for now */
@@ -438,7 +465,19 @@ int pa__init(pa_module*m) {
     };
 
     publish_param_int("event-channel", xen_evtchn_port);
-    publish_param_int("ring-ref", gref.gref_ids[0]);
+    publish_param_int("ring-ref", gref->gref_ids[0]);
+
+    /* Backends that know about multi-page rings look for the others here */
+    if (ring_pages > 1) {
+        publish_param_int("ring-pages", ring_pages);
+
+        for (i = 0; i < ring_pages; i++) {
+            char key[32];
+
+            snprintf(key, sizeof(key), "ring-ref%u", i);
+            publish_param_int(key, gref->gref_ids[i]);
+        }
+    }
 
     /* let's ask for something absurd and deal with rejection */
     ss.rate = 192000;
@@ -472,14 +511,15 @@ int pa__init(pa_module*m) {
     u->core = m->core;
     u->module = m;
     m->userdata = u;
-    pa_memchunk_reset(&u->memchunk);
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
     u->write_type = 0;
 
     /* init ring buffer */
     ioring->prod_indx = ioring->cons_indx = 0;
-    ioring->usable_buffer_space = BUFSIZE - BUFSIZE % pa_frame_size(&ss);
+    ioring->usable_buffer_space = ring_size - offsetof(struct ring, buffer);
+    ioring->usable_buffer_space -= ioring->usable_buffer_space % pa_frame_size(&ss);
+    u->notified_indx = 0;
 
     pa_sink_new_data_init(&data);
     data.driver = __FILE__;
@@ -564,9 +604,6 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
-    if (u->memchunk.memblock)
-       pa_memblock_unref(u->memchunk.memblock);
-
     if (u->rtpoll_item)
         pa_rtpoll_item_free(u->rtpoll_item);
 
@@ -598,7 +635,6 @@ static int alloc_gref(struct ioctl_gntalloc_alloc_gref *gref_, void **addr) {
     /* use dom0 */
     gref_->domid = 0;
     gref_->flags = GNTALLOC_FLAG_WRITABLE;
-    gref_->count = 1;
 
     rv = ioctl(alloc_fd, IOCTL_GNTALLOC_ALLOC_GREF, gref_);
     if (rv) {
@@ -607,15 +643,15 @@ static int alloc_gref(struct ioctl_gntalloc_alloc_gref *gref_, void **addr) {
     }
 
     /*addr=NULL(default),length, prot,             flags,    fd,         offset*/
-    *addr = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, alloc_fd, gref_->index);
+    *addr = mmap(0, gref_->count * RING_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, alloc_fd, gref_->index);
     if (*addr == MAP_FAILED) {
         *addr = 0;
         pa_log_debug("Xen audio sink: mmap'ing shared page failed\n");
         goto finish;
     }
 
-    pa_log_debug("Xen audio sink: Got grant #%d. Mapped locally at %Ld=%p\n",
-            gref_->gref_ids[0], (long long)gref_->index, *addr);
+    pa_log_debug("Xen audio sink: Got %u grants starting with #%d. Mapped locally at %Ld=%p\n",
+            gref_->count, gref_->gref_ids[0], (long long)gref_->index, *addr);
 
     /* skip this for now
        struct ioctl_gntalloc_unmap_notify uarg = {
@@ -634,41 +670,39 @@ finish:
     return rv;
 }
 
-#define RING_FREE_BYTES ((r->usable_buffer_space - (r->prod_indx-r->cons_indx) -1) % r->usable_buffer_space)
-static int ring_write(struct ring *r, void *src, int length) {
-    int full = 0;
-    for (;;) {
-        /* free space may be split over the end of the buffer */
-        int first_chunk_size = (r->usable_buffer_space-r->prod_indx);
-        int second_chunk_size = (r->cons_indx>=r->prod_indx)? (r->cons_indx) : 0;
-        int l, fl, sl;
-
-        /* full? */
-        if (RING_FREE_BYTES==0) {
-            /*XXX hardcoded*/
-            if (full>=100) {
-                errno = EINTR;
-                return -1;
-            }
-            /*XXX hardcoded */
-            usleep(1000);
-            /* should return in 100ms max; definitely not midstream */
-            full++;
-            continue;
-        }
+/* How much can be written at prod_indx in one go. One byte always stays free,
+ * as prod_indx == cons_indx means that the ring is empty. */
+static size_t ring_writable(struct ring *r, size_t frame_size) {
+    uint32_t cons = r->cons_indx, prod = r->prod_indx;
+    size_t used, contiguous, n;
+
+    xen_rmb();
+
+    used = (prod + r->usable_buffer_space - cons) % r->usable_buffer_space;
 
-        /* calculate lengths in case of a split buffer */
-        l = PA_MIN((int)RING_FREE_BYTES, length);
-        fl = PA_MIN(l, first_chunk_size);
-        sl = PA_MIN(l-fl, second_chunk_size);
+    if (cons > prod)
+        contiguous = cons - prod - 1;
+    else
+        contiguous = r->usable_buffer_space - prod - (cons == 0 ? 1 : 0);
 
-        memcpy(r->buffer+r->prod_indx, src, fl);
-        if (sl)
-            memcpy(r->buffer, ((char*)src)+fl, sl);
-        r->prod_indx = (r->prod_indx+fl+sl) % r->usable_buffer_space;
+    n = PA_MIN(contiguous, r->usable_buffer_space - 1 - used);
 
-        return sl+fl;
+    return n - n % frame_size;
+}
+
+static bool ring_wait_writable(struct ring *r, size_t frame_size) {
+    int full;
+
+    for (full = 0; ring_writable(r, frame_size) == 0; full++) {
+        /* should return in 100ms max */
+        if (full >= 100)
+            return false;
+
+        /*XXX hardcoded */
+        usleep(1000);
     }
+
+    return true;
 }
 
 static int publish_param(const char *paramname, const char *value) {
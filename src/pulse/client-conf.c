@@ -35,6 +35,7 @@
 #include <pulsecore/conf-parser.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/authkey.h>
+#include <pulsecore/mutex.h>
 
 #include "client-conf.h"
 
@@ -65,7 +66,10 @@ static const pa_client_conf default_conf = {
     .cookie_file_from_client_conf = NULL,
     .autospawn = true,
     .disable_shm = false,
+    .disable_memfd = false,
     .shm_size = 0,
+    .srbchannel_spin_usec = 0,
+    .record_srbchannel = false,
     .auto_connect_localhost = false,
     .auto_connect_display = false
 };
@@ -141,7 +145,11 @@ void pa_client_conf_load(pa_client_conf *c, bool load_from_x11, bool load_from_e
         { "cookie-file",            pa_config_parse_string,   &c->cookie_file_from_client_conf, NULL },
         { "disable-shm",            pa_config_parse_bool,     &c->disable_shm, NULL },
         { "enable-shm",             pa_config_parse_not_bool, &c->disable_shm, NULL },
+        { "disable-memfd",          pa_config_parse_bool,     &c->disable_memfd, NULL },
+        { "enable-memfd",           pa_config_parse_not_bool, &c->disable_memfd, NULL },
         { "shm-size-bytes",         pa_config_parse_size,     &c->shm_size, NULL },
+        { "srbchannel-spin-usec",   pa_config_parse_unsigned, &c->srbchannel_spin_usec, NULL },
+        { "enable-record-srbchannel", pa_config_parse_bool,   &c->record_srbchannel, NULL },
         { "auto-connect-localhost", pa_config_parse_bool,     &c->auto_connect_localhost, NULL },
         { "auto-connect-display",   pa_config_parse_bool,     &c->auto_connect_display, NULL },
         { NULL,                     NULL,                     NULL, NULL },
@@ -164,10 +172,36 @@ void pa_client_conf_load(pa_client_conf *c, bool load_from_x11, bool load_from_e
         load_env(c);
 }
 
-int pa_client_conf_load_cookie(pa_client_conf *c, uint8_t *cookie, size_t cookie_length) {
+/* The cookie from the default source is the same for all contexts of a
+ * process, so it is read from disk only once and then kept here until the
+ * server rejects it. */
+static pa_static_mutex default_cookie_mutex = PA_STATIC_MUTEX_INIT;
+static uint8_t default_cookie[PA_NATIVE_COOKIE_LENGTH];
+static bool default_cookie_valid = false;
+
+static int load_default_cookie(uint8_t *cookie, size_t cookie_length) {
     int r;
     char *fallback_path;
 
+    r = pa_authkey_load(PA_NATIVE_COOKIE_FILE, false, cookie, cookie_length);
+    if (r >= 0)
+        return 0;
+
+    if (pa_append_to_home_dir(PA_NATIVE_COOKIE_FILE_FALLBACK, &fallback_path) > 0) {
+        r = pa_authkey_load(fallback_path, false, cookie, cookie_length);
+        pa_xfree(fallback_path);
+        if (r >= 0)
+            return 0;
+    }
+
+    return pa_authkey_load(PA_NATIVE_COOKIE_FILE, true, cookie, cookie_length);
+}
+
+int pa_client_conf_load_cookie(pa_client_conf *c, uint8_t *cookie, size_t cookie_length) {
+    int r;
+    bool cacheable;
+    pa_mutex *mutex;
+
     pa_assert(c);
     pa_assert(cookie);
     pa_assert(cookie_length > 0);
@@ -208,18 +242,25 @@ int pa_client_conf_load_cookie(pa_client_conf *c, uint8_t *cookie, size_t cookie
                     pa_cstrerror(errno));
     }
 
-    r = pa_authkey_load(PA_NATIVE_COOKIE_FILE, false, cookie, cookie_length);
-    if (r >= 0)
+    cacheable = cookie_length == sizeof(default_cookie);
+    mutex = pa_static_mutex_get(&default_cookie_mutex, false, false);
+    pa_mutex_lock(mutex);
+
+    if (cacheable && default_cookie_valid) {
+        memcpy(cookie, default_cookie, cookie_length);
+        pa_mutex_unlock(mutex);
         return 0;
+    }
 
-    if (pa_append_to_home_dir(PA_NATIVE_COOKIE_FILE_FALLBACK, &fallback_path) > 0) {
-        r = pa_authkey_load(fallback_path, false, cookie, cookie_length);
-        pa_xfree(fallback_path);
-        if (r >= 0)
-            return 0;
+    r = load_default_cookie(cookie, cookie_length);
+
+    if (r >= 0 && cacheable) {
+        memcpy(default_cookie, cookie, cookie_length);
+        default_cookie_valid = true;
     }
 
-    r = pa_authkey_load(PA_NATIVE_COOKIE_FILE, true, cookie, cookie_length);
+    pa_mutex_unlock(mutex);
+
     if (r >= 0)
         return 0;
 
@@ -229,6 +270,15 @@ int pa_client_conf_load_cookie(pa_client_conf *c, uint8_t *cookie, size_t cookie
     return -1;
 }
 
+void pa_client_conf_forget_cookie(void) {
+    pa_mutex *mutex;
+
+    mutex = pa_static_mutex_get(&default_cookie_mutex, false, false);
+    pa_mutex_lock(mutex);
+    default_cookie_valid = false;
+    pa_mutex_unlock(mutex);
+}
+
 void pa_client_conf_set_cookie_file_from_application(pa_client_conf *c, const char *cookie_file) {
     pa_assert(c);
     pa_assert(!cookie_file || *cookie_file);
@@ -37,8 +37,10 @@ typedef struct pa_client_conf {
     bool cookie_from_x11_valid;
     char *cookie_file_from_application;
     char *cookie_file_from_client_conf;
-    bool autospawn, disable_shm, auto_connect_localhost, auto_connect_display;
+    bool autospawn, disable_shm, disable_memfd, auto_connect_localhost, auto_connect_display;
     size_t shm_size;
+    unsigned srbchannel_spin_usec;
+    bool record_srbchannel;
 } pa_client_conf;
 
 /* Create a new configuration data object and reset it to defaults */
@@ -56,6 +58,10 @@ void pa_client_conf_load(pa_client_conf *c, bool load_from_x11, bool load_from_e
  * returns a negative value and initializes the cookie to all-zeroes. */
 int pa_client_conf_load_cookie(pa_client_conf *c, uint8_t *cookie, size_t cookie_length);
 
+/* The cookie from the default source is only read once per process. Call this
+ * when the server rejected it, so that it is read again next time. */
+void pa_client_conf_forget_cookie(void);
+
 void pa_client_conf_set_cookie_file_from_application(pa_client_conf *c, const char *cookie_file);
 
 #endif
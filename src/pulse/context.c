@@ -68,6 +68,7 @@
 
 void pa_command_extension(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void pa_command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void pa_command_register_memfd_shmid(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void pa_command_disable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 
 static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
@@ -89,6 +90,7 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_PLAYBACK_BUFFER_ATTR_CHANGED] = pa_command_stream_buffer_attr,
     [PA_COMMAND_RECORD_BUFFER_ATTR_CHANGED] = pa_command_stream_buffer_attr,
     [PA_COMMAND_ENABLE_SRBCHANNEL] = pa_command_enable_srbchannel,
+    [PA_COMMAND_REGISTER_MEMFD_SHMID] = pa_command_register_memfd_shmid,
     [PA_COMMAND_DISABLE_SRBCHANNEL] = pa_command_disable_srbchannel,
 };
 static void context_free(pa_context *c);
@@ -109,6 +111,8 @@ static void reset_callbacks(pa_context *c) {
 
     c->subscribe_callback = NULL;
     c->subscribe_userdata = NULL;
+    c->subscribe_delta_callback = NULL;
+    c->subscribe_delta_userdata = NULL;
 
     c->event_callback = NULL;
     c->event_userdata = NULL;
@@ -250,6 +254,8 @@ static void context_free(pa_context *c) {
 
     if (c->mempool)
         pa_mempool_free(c->mempool);
+    if (c->import_mempool)
+        pa_mempool_free(c->import_mempool);
 
     if (c->conf)
         pa_client_conf_free(c->conf);
@@ -368,6 +374,8 @@ static void handle_srbchannel_memblock(pa_context *c, pa_memblock *memblock) {
         return;
     }
 
+    pa_srbchannel_set_spin(sr, c->conf->srbchannel_spin_usec);
+
     /* Ack the enable command */
     t = pa_tagstruct_new();
     pa_tagstruct_putu32(t, PA_COMMAND_ENABLE_SRBCHANNEL);
@@ -396,8 +404,25 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
         return;
     }
 
+    /* The server sends no data to playback streams, except for their
+     * timing page. It comes right after the reply announcing it, so a
+     * record stream with the same channel number can't get in between. */
+    if ((s = pa_hashmap_get(c->playback_streams, PA_UINT32_TO_PTR(channel))) &&
+        s->timing_page_length > 0) {
+        pa_stream_handle_timing_page_memblock(s, chunk->memblock);
+        pa_context_unref(c);
+        return;
+    }
+
     if ((s = pa_hashmap_get(c->record_streams, PA_UINT32_TO_PTR(channel)))) {
 
+        /* Record data is always sent with relative seeks */
+        if (seek == PA_SEEK_ABSOLUTE && s->srbchannel_requested && !s->srb_template.memblock) {
+            pa_stream_handle_srbchannel_memblock(s, chunk->memblock);
+            pa_context_unref(c);
+            return;
+        }
+
         if (chunk->memblock) {
             pa_memblockq_seek(s->record_memblockq, offset, seek, true);
             pa_memblockq_push_align(s->record_memblockq, chunk);
@@ -464,14 +489,20 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
     pa_context_ref(c);
 
     if (command != PA_COMMAND_REPLY) {
+        bool authorizing = c->state == PA_CONTEXT_AUTHORIZING;
+
         pa_context_handle_error(c, command, t, true);
+
+        /* The cached cookie might be stale, read it again next time */
+        if (authorizing && c->error == PA_ERR_ACCESS)
+            pa_client_conf_forget_cookie();
+
         goto finish;
     }
 
     switch(c->state) {
         case PA_CONTEXT_AUTHORIZING: {
-            pa_tagstruct *reply;
-            bool shm_on_remote = false;
+            bool shm_on_remote, memfd_on_remote;
 
             if (pa_tagstruct_getu32(t, &c->version) < 0 ||
                 !pa_tagstruct_eof(t)) {
@@ -479,26 +510,29 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
                 goto finish;
             }
 
-            /* Minimum supported version */
-            if (c->version < 8) {
-                pa_context_fail(c, PA_ERR_VERSION);
-                goto finish;
-            }
-
             /* Starting with protocol version 13 the MSB of the version
                tag reflects if shm is available for this connection or
                not. */
-            if (c->version >= 13) {
-                shm_on_remote = !!(c->version & 0x80000000U);
-                c->version &= 0x7FFFFFFFU;
+            shm_on_remote = !!(c->version & 0x80000000U);
+
+            /* Starting with protocol version 42 the second MSB tells
+               whether the server passes memfd pools */
+            memfd_on_remote = !!(c->version & 0x40000000U);
+            c->version &= 0x3FFFFFFFU;
+
+            /* Minimum supported version. The client name was sent together
+             * with the authentication in the proplist format, which needs
+             * version 13. */
+            if (c->version < 13) {
+                pa_context_fail(c, PA_ERR_VERSION);
+                goto finish;
             }
 
             pa_log_debug("Protocol version: remote %u, local %u", c->version, PA_PROTOCOL_VERSION);
 
             /* Enable shared memory support if possible */
-            if (c->do_shm)
-                if (c->version < 10 || (c->version >= 13 && !shm_on_remote))
-                    c->do_shm = false;
+            if (c->do_shm && !shm_on_remote)
+                c->do_shm = false;
 
             if (c->do_shm) {
 
@@ -516,25 +550,36 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             pa_log_debug("Negotiated SHM: %s", pa_yes_no(c->do_shm));
             pa_pstream_enable_shm(c->pstream, c->do_shm);
 
-            reply = pa_tagstruct_command(c, PA_COMMAND_SET_CLIENT_NAME, &tag);
+            if (!c->do_shm || !memfd_on_remote || c->version < 42)
+                c->do_memfd = false;
 
-            if (c->version >= 13) {
-                pa_init_proplist(c->proplist);
-                pa_tagstruct_put_proplist(reply, c->proplist);
-            } else
-                pa_tagstruct_puts(reply, pa_proplist_gets(c->proplist, PA_PROP_APPLICATION_NAME));
+            pa_log_debug("Negotiated memfd: %s", pa_yes_no(c->do_memfd));
+
+            if (c->do_memfd) {
+                pa_mempool *pool;
+
+                pa_pstream_enable_memfd(c->pstream);
 
-            pa_pstream_send_tagstruct(c->pstream, reply);
-            pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
+                /* Our playback data goes into a pool of our own from now
+                 * on, if we can't get one the shared one still works */
+                if ((pool = pa_mempool_new_memfd(c->conf->shm_size))) {
+                    if (pa_pstream_register_memfd_mempool(c->pstream, pool) >= 0) {
+                        c->import_mempool = c->mempool;
+                        c->mempool = pool;
+                    } else
+                        pa_mempool_free(pool);
+                }
+            }
 
+            /* The reply to SET_CLIENT_NAME is up next */
             pa_context_set_state(c, PA_CONTEXT_SETTING_NAME);
             break;
         }
 
         case PA_CONTEXT_SETTING_NAME :
 
-            if ((c->version >= 13 && (pa_tagstruct_getu32(t, &c->client_index) < 0 ||
-                                      c->client_index == PA_INVALID_INDEX)) ||
+            if (pa_tagstruct_getu32(t, &c->client_index) < 0 ||
+                c->client_index == PA_INVALID_INDEX ||
                 !pa_tagstruct_eof(t)) {
                 pa_context_fail(c, PA_ERR_PROTOCOL);
                 goto finish;
@@ -582,9 +627,18 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
 
     pa_log_debug("SHM possible: %s", pa_yes_no(c->do_shm));
 
+#ifdef HAVE_MEMFD
+    c->do_memfd =
+        c->do_shm &&
+        !c->conf->disable_memfd;
+#else
+    c->do_memfd = false;
+#endif
+
     /* Starting with protocol version 13 we use the MSB of the version
-     * tag for informing the other side if we could do SHM or not */
-    pa_tagstruct_putu32(t, PA_PROTOCOL_VERSION | (c->do_shm ? 0x80000000U : 0));
+     * tag for informing the other side if we could do SHM or not,
+     * starting with version 42 the second MSB tells about memfd */
+    pa_tagstruct_putu32(t, PA_PROTOCOL_VERSION | (c->do_shm ? 0x80000000U : 0) | (c->do_memfd ? 0x40000000U : 0));
     pa_tagstruct_put_arbitrary(t, cookie, sizeof(cookie));
 
 #ifdef HAVE_CREDS
@@ -605,6 +659,15 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
 
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
 
+    /* Don't wait for the server to accept the cookie before sending the
+     * client name, this saves a round trip. The server handles the commands
+     * in order, so the name is only set once the authentication passed. */
+    t = pa_tagstruct_command(c, PA_COMMAND_SET_CLIENT_NAME, &tag);
+    pa_init_proplist(c->proplist);
+    pa_tagstruct_put_proplist(t, c->proplist);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
+
     pa_context_set_state(c, PA_CONTEXT_AUTHORIZING);
 
     pa_context_unref(c);
@@ -1459,6 +1522,45 @@ static void pa_command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uin
 #endif
 }
 
+static void pa_command_register_memfd_shmid(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_context *c = userdata;
+
+#ifdef HAVE_CREDS
+    uint32_t shm_id;
+    bool writable;
+    const int *fds;
+    int nfd;
+
+    pa_assert(pd);
+    pa_assert(command == PA_COMMAND_REGISTER_MEMFD_SHMID);
+    pa_assert(t);
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    if (pa_tagstruct_getu32(t, &shm_id) < 0 ||
+        pa_tagstruct_get_boolean(t, &writable) < 0 ||
+        !pa_tagstruct_eof(t) ||
+        !pa_pstream_get_memfd(c->pstream)) {
+        pa_context_fail(c, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    fds = pa_pdispatch_fds(pd, &nfd);
+    if (nfd != 1 || !fds || fds[0] < 0) {
+        pa_context_fail(c, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    if (pa_pstream_attach_memfd_shmid(c->pstream, shm_id, fds[0], writable) < 0)
+        pa_log_warn("Failed to attach the memfd pool of the server.");
+
+    pa_close(fds[0]);
+#else
+    pa_assert(c);
+    pa_context_fail(c, PA_ERR_PROTOCOL);
+#endif
+}
+
 static void pa_command_disable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_context *c = userdata;
     pa_tagstruct *t2;
@@ -347,11 +347,17 @@ typedef enum pa_stream_flags {
      * consider absolute when the sink is in flat volume mode,
      * relative otherwise. \since 0.9.20 */
 
-    PA_STREAM_PASSTHROUGH = 0x80000U
+    PA_STREAM_PASSTHROUGH = 0x80000U,
     /**< Used to tag content that will be rendered by passthrough sinks.
      * The data will be left as is and not reformatted, resampled.
      * \since 1.0 */
 
+    PA_STREAM_COMPRESS = 0x100000U
+    /**< Compress the audio data of this stream losslessly while it
+     * travels to or from the server. This only has an effect for 16 bit
+     * sample formats on connections that are not local, and is meant
+     * for streams over slow networks. \since 7.0 */
+
 } pa_stream_flags_t;
 
 /** \cond fulldocs */
@@ -380,6 +386,7 @@ typedef enum pa_stream_flags {
 #define PA_STREAM_FAIL_ON_SUSPEND PA_STREAM_FAIL_ON_SUSPEND
 #define PA_STREAM_RELATIVE_VOLUME PA_STREAM_RELATIVE_VOLUME
 #define PA_STREAM_PASSTHROUGH PA_STREAM_PASSTHROUGH
+#define PA_STREAM_COMPRESS PA_STREAM_COMPRESS
 
 /** \endcond */
 
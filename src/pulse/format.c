@@ -619,10 +619,37 @@ static int pa_json_value_equal(json_object *o1, json_object *o2) {
         pa_streq(json_object_to_json_string(o1), json_object_to_json_string(o2));
 }
 
+/* Returns true for values that are a canonical integer which fits into an
+ * int, or a string without escapes. Two such values are equal if and only if
+ * they are the same text, so they can be compared without parsing them. */
+static bool is_simple_fixed_value(const char *v) {
+    size_t n;
+
+    if (v[0] == '"') {
+        n = strcspn(v + 1, "\\\"");
+        return v[n + 1] == '"' && v[n + 2] == 0;
+    }
+
+    if (v[0] == '0')
+        return v[1] == 0;
+
+    if (v[0] == '-' && v[1] != '0')
+        v++;
+
+    n = strspn(v, "0123456789");
+
+    return n > 0 && n <= 9 && v[n] == 0;
+}
+
 static int pa_format_info_prop_compatible(const char *one, const char *two) {
     json_object *o1 = NULL, *o2 = NULL;
     int i, ret = 0;
 
+    /* The common case of comparing two fixed values, like a rate against a
+     * rate, doesn't need the JSON parser */
+    if (is_simple_fixed_value(one) && is_simple_fixed_value(two))
+        return pa_streq(one, two);
+
     o1 = json_tokener_parse(one);
     if (!o1)
         goto out;
@@ -41,6 +41,10 @@
 #include <pulsecore/hashmap.h>
 #include <pulsecore/refcnt.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/asyncq.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/thread.h>
 #ifdef HAVE_DBUS
 #include <pulsecore/dbus-util.h>
 #endif
@@ -81,13 +85,20 @@ struct pa_context {
     void *state_userdata;
     pa_context_subscribe_cb_t subscribe_callback;
     void *subscribe_userdata;
+    pa_context_subscribe_delta_cb_t subscribe_delta_callback;
+    void *subscribe_delta_userdata;
     pa_context_event_cb_t event_callback;
     void *event_userdata;
 
     pa_mempool *mempool;
+    /* Once a memfd pool has been negotiated, mempool is that pool and
+     * this is the one the context started out with. The pstream keeps
+     * importing the server's blocks into it. */
+    pa_mempool *import_mempool;
 
     bool is_local:1;
     bool do_shm:1;
+    bool do_memfd:1;
     bool server_specified:1;
     bool no_fail:1;
     bool do_autospawn:1;
@@ -177,6 +188,40 @@ struct pa_stream {
     void *peek_data;
     pa_memblockq *record_memblockq;
 
+    /* Shared ringbuffer the server writes record data into, see
+     * request_srbchannel() in stream.c */
+    pa_srbchannel *srbchannel;
+    pa_srbchannel_template srb_template;
+    bool srbchannel_requested:1;
+
+    /* Shared page the server publishes the timing of a playback stream
+     * in, see request_timing_page() in stream.c. The length is set from
+     * the reply, while the page itself is still on its way. */
+    pa_memblock *timing_page;
+    int timing_page_seq;
+    uint32_t timing_page_length;
+
+    /* Writing from another thread without the mainloop lock, see
+     * pa_stream_enable_lock_free_write(). The counters wrap around,
+     * only their difference matters. granted is the requested bytes
+     * plus everything drained from the queue so far, written what the
+     * other thread queued so far. */
+    pa_asyncq *lock_free_queue;
+    pa_io_event *lock_free_event;
+    pa_context *lock_free_context;
+    pa_atomic_t lock_free_granted;
+    pa_atomic_t lock_free_written;
+    uint32_t lock_free_drained;
+
+    /* Thread that renders into the lock-free queue, see
+     * pa_stream_start_render_thread() */
+    pa_thread *render_thread;
+    pa_semaphore *render_semaphore;
+    pa_atomic_t render_quit;
+    pa_stream_render_cb_t render_callback;
+    void *render_userdata;
+    int render_rtprio;
+
     /* Store latest latency info */
     pa_timing_info timing_info;
 
@@ -267,6 +312,8 @@ int pa_context_handle_error(pa_context *c, uint32_t command, pa_tagstruct *t, bo
 pa_operation* pa_context_send_simple_command(pa_context *c, uint32_t command, void (*internal_callback)(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata), void (*cb)(void), void *userdata);
 
 void pa_stream_set_state(pa_stream *s, pa_stream_state_t st);
+void pa_stream_handle_srbchannel_memblock(pa_stream *s, pa_memblock *memblock);
+void pa_stream_handle_timing_page_memblock(pa_stream *s, pa_memblock *memblock);
 
 pa_tagstruct *pa_tagstruct_command(pa_context *c, uint32_t command, uint32_t *tag);
 
@@ -78,6 +78,171 @@ pa_operation* pa_context_stat(pa_context *c, pa_stat_info_cb_t cb, void *userdat
     return pa_context_send_simple_command(c, PA_COMMAND_STAT, context_stat_callback, (pa_operation_cb_t) cb, userdata);
 }
 
+/*** IO Traces ***/
+
+static void context_get_io_trace_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    pa_io_trace_info i, *p = &i;
+    pa_io_trace_entry *entries = NULL;
+    bool frozen = false;
+    uint32_t j;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    pa_zero(i);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        p = NULL;
+    } else {
+        if (pa_tagstruct_getu32(t, &i.xruns) < 0 ||
+            pa_tagstruct_get_boolean(t, &frozen) < 0 ||
+            pa_tagstruct_getu32(t, &i.n_entries) < 0 ||
+            i.n_entries > 0x10000U) {
+
+            pa_context_fail(o->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        i.frozen = frozen;
+        entries = pa_xnew0(pa_io_trace_entry, PA_MAX(i.n_entries, 1U));
+
+        for (j = 0; j < i.n_entries; j++) {
+            uint32_t flags;
+
+            if (pa_tagstruct_get_usec(t, &entries[j].time) < 0 ||
+                pa_tagstruct_gets64(t, &entries[j].lateness) < 0 ||
+                pa_tagstruct_gets64(t, &entries[j].avail) < 0 ||
+                pa_tagstruct_get_usec(t, &entries[j].process_usec) < 0 ||
+                pa_tagstruct_get_usec(t, &entries[j].sleep_usec) < 0 ||
+                pa_tagstruct_getu32(t, &flags) < 0) {
+
+                pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                goto finish;
+            }
+
+            entries[j].flags = (pa_io_trace_flags_t) flags;
+        }
+
+        if (!pa_tagstruct_eof(t)) {
+            pa_context_fail(o->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        i.entries = entries;
+    }
+
+    if (o->callback) {
+        pa_io_trace_info_cb_t cb = (pa_io_trace_info_cb_t) o->callback;
+        cb(o->context, p, o->userdata);
+    }
+
+finish:
+    pa_xfree(entries);
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+static pa_operation* get_io_trace(pa_context *c, uint32_t command, const char *name, pa_io_trace_info_cb_t cb, void *userdata) {
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cb);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, name && *name, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 37, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
+
+    t = pa_tagstruct_command(c, command, &tag);
+    pa_tagstruct_puts(t, name);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_io_trace_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
+pa_operation* pa_context_get_sink_io_trace(pa_context *c, const char *name, pa_io_trace_info_cb_t cb, void *userdata) {
+    return get_io_trace(c, PA_COMMAND_GET_SINK_IO_TRACE, name, cb, userdata);
+}
+
+pa_operation* pa_context_get_source_io_trace(pa_context *c, const char *name, pa_io_trace_info_cb_t cb, void *userdata) {
+    return get_io_trace(c, PA_COMMAND_GET_SOURCE_IO_TRACE, name, cb, userdata);
+}
+
+/*** Metrics ***/
+
+static void context_get_metric_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        eol = -1;
+    } else {
+
+        while (!pa_tagstruct_eof(t)) {
+            pa_metric_info i;
+
+            pa_zero(i);
+
+            if (pa_tagstruct_gets(t, &i.name) < 0 ||
+                pa_tagstruct_gets(t, &i.label_name) < 0 ||
+                pa_tagstruct_gets(t, &i.label_value) < 0 ||
+                pa_tagstruct_getu64(t, &i.value) < 0) {
+                pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                goto finish;
+            }
+
+            if (o->callback) {
+                pa_metric_info_cb_t cb = (pa_metric_info_cb_t) o->callback;
+                cb(o->context, &i, 0, o->userdata);
+            }
+        }
+    }
+
+    if (o->callback) {
+        pa_metric_info_cb_t cb = (pa_metric_info_cb_t) o->callback;
+        cb(o->context, NULL, eol, o->userdata);
+    }
+
+finish:
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+pa_operation* pa_context_get_metric_info_list(pa_context *c, pa_metric_info_cb_t cb, void *userdata) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 41, PA_ERR_NOTSUPPORTED);
+
+    return pa_context_send_simple_command(c, PA_COMMAND_GET_METRICS, context_get_metric_info_callback, (pa_operation_cb_t) cb, userdata);
+}
+
 /*** Server Info ***/
 
 static void context_get_server_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -108,6 +273,8 @@ static void context_get_server_info_callback(pa_pdispatch *pd, uint32_t command,
                pa_tagstruct_getu32(t, &i.cookie) < 0 ||
                (o->context->version >= 15 &&
                 pa_tagstruct_get_channel_map(t, &i.channel_map) < 0) ||
+               (o->context->version >= 31 &&
+                pa_tagstruct_gets(t, &i.cpu_kernels) < 0) ||
                !pa_tagstruct_eof(t)) {
 
         pa_context_fail(o->context, PA_ERR_PROTOCOL);
@@ -157,7 +324,7 @@ static void context_get_sink_info_callback(pa_pdispatch *pd, uint32_t command, u
     } else {
 
         while (!pa_tagstruct_eof(t)) {
-            bool mute;
+            bool mute, overloaded;
             uint32_t flags;
             uint32_t state;
             const char *ap = NULL;
@@ -166,7 +333,7 @@ static void context_get_sink_info_callback(pa_pdispatch *pd, uint32_t command, u
             i.proplist = pa_proplist_new();
             i.base_volume = PA_VOLUME_NORM;
             i.n_volume_steps = PA_VOLUME_NORM+1;
-            mute = false;
+            mute = overloaded = false;
             state = PA_SINK_INVALID_STATE;
             i.card = PA_INVALID_INDEX;
 
@@ -252,9 +419,16 @@ static void context_get_sink_info_callback(pa_pdispatch *pd, uint32_t command, u
                 }
             }
 
+            if (o->context->version >= 40) {
+                if (pa_tagstruct_getu32(t, &i.render_load) < 0 ||
+                    pa_tagstruct_get_boolean(t, &overloaded) < 0)
+                    goto fail;
+            }
+
             i.mute = (int) mute;
             i.flags = (pa_sink_flags_t) flags;
             i.state = (pa_sink_state_t) state;
+            i.overloaded = (int) overloaded;
 
             if (o->callback) {
                 pa_sink_info_cb_t cb = (pa_sink_info_cb_t) o->callback;
@@ -1182,6 +1356,65 @@ pa_operation* pa_context_get_module_info_list(pa_context *c, pa_module_info_cb_t
 
 /*** Sink input info ***/
 
+static void free_resampler_phases(pa_sink_input_info *i) {
+    uint32_t j;
+
+    if (!i->resampler_phases)
+        return;
+
+    for (j = 0; j < i->n_resampler_phases; j++)
+        pa_xfree(i->resampler_phases[j].histogram);
+
+    pa_xfree(i->resampler_phases);
+}
+
+static int fill_resampler_phases(pa_tagstruct *t, pa_sink_input_info *i) {
+    uint32_t j, k;
+
+    if (pa_tagstruct_getu64(t, &i->resampler_runs) < 0 ||
+        pa_tagstruct_getu32(t, &i->n_resampler_phases) < 0)
+        return -1;
+
+    if (i->n_resampler_phases == 0)
+        return 0;
+
+    if (i->n_resampler_phases > 32)
+        return -1;
+
+    i->resampler_phases = pa_xnew0(pa_sink_input_resampler_phase, i->n_resampler_phases);
+
+    for (j = 0; j < i->n_resampler_phases; j++) {
+        pa_sink_input_resampler_phase *p = &i->resampler_phases[j];
+
+        if (pa_tagstruct_gets(t, &p->name) < 0 ||
+            pa_tagstruct_get_usec(t, &p->usec) < 0 ||
+            pa_tagstruct_getu32(t, &p->n_buckets) < 0 ||
+            p->n_buckets > 64)
+            return -1;
+
+        if (p->n_buckets == 0)
+            continue;
+
+        p->histogram = pa_xnew(uint32_t, p->n_buckets);
+
+        for (k = 0; k < p->n_buckets; k++)
+            if (pa_tagstruct_getu32(t, &p->histogram[k]) < 0)
+                return -1;
+    }
+
+    return 0;
+}
+
+static int fill_sink_input_stats(pa_tagstruct *t, pa_sink_input_info *i) {
+    if (pa_tagstruct_getu32(t, &i->underruns) < 0 ||
+        pa_tagstruct_getu32(t, &i->silence_frames) < 0 ||
+        pa_tagstruct_getu32(t, &i->rewinds) < 0 ||
+        pa_tagstruct_getu32(t, &i->render_usec) < 0)
+        return -1;
+
+    return 0;
+}
+
 static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     int eol = 1;
@@ -1225,11 +1458,14 @@ static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t comm
                 (o->context->version >= 19 && pa_tagstruct_get_boolean(t, &corked) < 0) ||
                 (o->context->version >= 20 && (pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
                                                pa_tagstruct_get_boolean(t, &volume_writable) < 0)) ||
-                (o->context->version >= 21 && pa_tagstruct_get_format_info(t, i.format) < 0)) {
+                (o->context->version >= 21 && pa_tagstruct_get_format_info(t, i.format) < 0) ||
+                (o->context->version >= 32 && fill_resampler_phases(t, &i) < 0) ||
+                (o->context->version >= 39 && fill_sink_input_stats(t, &i) < 0)) {
 
                 pa_context_fail(o->context, PA_ERR_PROTOCOL);
                 pa_proplist_free(i.proplist);
                 pa_format_info_free(i.format);
+                free_resampler_phases(&i);
                 goto finish;
             }
 
@@ -1245,6 +1481,7 @@ static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t comm
 
             pa_proplist_free(i.proplist);
             pa_format_info_free(i.format);
+            free_resampler_phases(&i);
         }
     }
 
@@ -1285,6 +1522,116 @@ pa_operation* pa_context_get_sink_input_info_list(pa_context *c, void (*cb)(pa_c
     return pa_context_send_simple_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_LIST, context_get_sink_input_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
+static void context_get_sink_input_info_masked_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    uint32_t mask;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    mask = PA_PTR_TO_UINT32(o->private);
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        eol = -1;
+    } else {
+
+        while (!pa_tagstruct_eof(t)) {
+            pa_sink_input_info i;
+            bool mute = false, corked = false, has_volume = false, volume_writable = false;
+
+            pa_zero(i);
+            i.owner_module = i.client = i.sink = PA_INVALID_INDEX;
+            i.proplist = pa_proplist_new();
+            i.format = pa_format_info_new();
+
+            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+                ((mask & PA_SINK_INPUT_INFO_NAME) && pa_tagstruct_gets(t, &i.name) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_OWNER) && (pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+                                                       pa_tagstruct_getu32(t, &i.client) < 0)) ||
+                ((mask & PA_SINK_INPUT_INFO_SINK) && pa_tagstruct_getu32(t, &i.sink) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_SAMPLE_SPEC) && (pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
+                                                             pa_tagstruct_get_channel_map(t, &i.channel_map) < 0)) ||
+                ((mask & PA_SINK_INPUT_INFO_VOLUME) && (pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
+                                                        pa_tagstruct_get_boolean(t, &mute) < 0 ||
+                                                        pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
+                                                        pa_tagstruct_get_boolean(t, &volume_writable) < 0)) ||
+                ((mask & PA_SINK_INPUT_INFO_LATENCY) && (pa_tagstruct_get_usec(t, &i.buffer_usec) < 0 ||
+                                                         pa_tagstruct_get_usec(t, &i.sink_usec) < 0)) ||
+                ((mask & PA_SINK_INPUT_INFO_RESAMPLE_METHOD) && pa_tagstruct_gets(t, &i.resample_method) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_DRIVER) && pa_tagstruct_gets(t, &i.driver) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_PROPLIST) && pa_tagstruct_get_proplist(t, i.proplist) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_CORKED) && pa_tagstruct_get_boolean(t, &corked) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_FORMAT) && pa_tagstruct_get_format_info(t, i.format) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_RESAMPLER_TIMING) && fill_resampler_phases(t, &i) < 0) ||
+                ((mask & PA_SINK_INPUT_INFO_STATS) && fill_sink_input_stats(t, &i) < 0)) {
+
+                pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                pa_proplist_free(i.proplist);
+                pa_format_info_free(i.format);
+                free_resampler_phases(&i);
+                goto finish;
+            }
+
+            i.mute = (int) mute;
+            i.corked = (int) corked;
+            i.has_volume = (int) has_volume;
+            i.volume_writable = (int) volume_writable;
+
+            if (o->callback) {
+                pa_sink_input_info_cb_t cb = (pa_sink_input_info_cb_t) o->callback;
+                cb(o->context, &i, 0, o->userdata);
+            }
+
+            pa_proplist_free(i.proplist);
+            pa_format_info_free(i.format);
+            free_resampler_phases(&i);
+        }
+    }
+
+    if (o->callback) {
+        pa_sink_input_info_cb_t cb = (pa_sink_input_info_cb_t) o->callback;
+        cb(o->context, NULL, eol, o->userdata);
+    }
+
+finish:
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+pa_operation* pa_context_get_sink_input_info_list_masked(pa_context *c, pa_sink_input_info_mask_t mask, pa_sink_input_info_cb_t cb, void *userdata) {
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cb);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !(mask & ~PA_SINK_INPUT_INFO_ALL), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 34, PA_ERR_NOTSUPPORTED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 39 || !(mask & PA_SINK_INPUT_INFO_STATS), PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
+    o->private = PA_UINT32_TO_PTR(mask);
+
+    t = pa_tagstruct_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_LIST_MASKED, &tag);
+    pa_tagstruct_putu32(t, mask);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_sink_input_info_masked_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
 /*** Source output info ***/
 
 static void context_get_source_output_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -259,6 +259,8 @@ typedef struct pa_sink_info {
     pa_sink_port_info* active_port;    /**< Pointer to active port in the array, or NULL. \since 0.9.16 */
     uint8_t n_formats;                 /**< Number of formats supported by the sink. \since 1.0 */
     pa_format_info **formats;          /**< Array of formats supported by the sink. \since 1.0 */
+    uint32_t render_load;              /**< Time spent rendering, in permille of the time the rendered data plays for. \since 7.0 */
+    int overloaded;                    /**< Non-zero while the server considers the sink to have too little headroom left. \since 7.0 */
 } pa_sink_info;
 
 /** Callback prototype for pa_context_get_sink_info_by_name() and friends */
@@ -394,6 +396,7 @@ typedef struct pa_server_info {
     const char *default_source_name;    /**< Name of default source. */
     uint32_t cookie;                    /**< A random cookie for identifying this instance of PulseAudio. */
     pa_channel_map channel_map;         /**< Default channel map. \since 0.9.15 */
+    const char *cpu_kernels;            /**< Implementations of the mixing, remapping, sample conversion and volume functions the daemon uses, as space separated function=implementation pairs. \since 7.0 */
 } pa_server_info;
 
 /** Callback prototype for pa_context_get_server_info() */
@@ -554,6 +557,14 @@ pa_operation* pa_context_set_port_latency_offset(pa_context *c, const char *card
 
 /** @{ \name Sink Inputs */
 
+/** Time the resampler of a sink input spent in one of its phases. \since 7.0 */
+typedef struct pa_sink_input_resampler_phase {
+    const char *name;                    /**< Name of the phase, "convert", "remap" or "resample" */
+    pa_usec_t usec;                      /**< Total time spent in this phase */
+    uint32_t n_buckets;                  /**< Number of entries in histogram */
+    uint32_t *histogram;                 /**< Entry n counts the resampler runs in which the phase took less than 2^n usec, the last entry all longer runs */
+} pa_sink_input_resampler_phase;
+
 /** Stores information about sink inputs. Please note that this structure
  * can be extended as part of evolutionary API updates at any time in
  * any new release. */
@@ -576,6 +587,13 @@ typedef struct pa_sink_input_info {
     int has_volume;                      /**< Stream has volume. If not set, then the meaning of this struct's volume member is unspecified. \since 1.0 */
     int volume_writable;                 /**< The volume can be set. If not set, the volume can still change even though clients can't control the volume. \since 1.0 */
     pa_format_info *format;              /**< Stream format information. \since 1.0 */
+    uint64_t resampler_runs;             /**< Number of times the resampler ran, if the server measures resampler timing. \since 7.0 */
+    uint32_t n_resampler_phases;         /**< Number of entries in resampler_phases, 0 unless the server measures resampler timing. \since 7.0 */
+    pa_sink_input_resampler_phase *resampler_phases; /**< Time spent in each phase of the resampler. \since 7.0 */
+    uint32_t underruns;                  /**< Number of times the stream ran out of data while playing, wrapping around. \since 7.0 */
+    uint32_t silence_frames;             /**< Frames of silence the sink played because the stream had no data, wrapping around. \since 7.0 */
+    uint32_t rewinds;                    /**< Number of rewinds of the sink the stream asked for, wrapping around. \since 7.0 */
+    uint32_t render_usec;                /**< Time the server spent getting data of the stream and resampling it, wrapping around. \since 7.0 */
 } pa_sink_input_info;
 
 /** Callback prototype for pa_context_get_sink_input_info() and friends */
@@ -587,6 +605,32 @@ pa_operation* pa_context_get_sink_input_info(pa_context *c, uint32_t idx, pa_sin
 /** Get the complete sink input list */
 pa_operation* pa_context_get_sink_input_info_list(pa_context *c, pa_sink_input_info_cb_t cb, void *userdata);
 
+/** Fields of pa_sink_input_info, for
+ * pa_context_get_sink_input_info_list_masked(). \since 7.0 */
+typedef enum pa_sink_input_info_mask {
+    PA_SINK_INPUT_INFO_NAME = 0x0001U,              /**< name */
+    PA_SINK_INPUT_INFO_OWNER = 0x0002U,             /**< owner_module and client */
+    PA_SINK_INPUT_INFO_SINK = 0x0004U,              /**< sink */
+    PA_SINK_INPUT_INFO_SAMPLE_SPEC = 0x0008U,       /**< sample_spec and channel_map */
+    PA_SINK_INPUT_INFO_VOLUME = 0x0010U,            /**< volume, mute, has_volume and volume_writable */
+    PA_SINK_INPUT_INFO_LATENCY = 0x0020U,           /**< buffer_usec and sink_usec. Getting these needs a round trip to the server's IO thread for each sink input. */
+    PA_SINK_INPUT_INFO_RESAMPLE_METHOD = 0x0040U,   /**< resample_method */
+    PA_SINK_INPUT_INFO_DRIVER = 0x0080U,            /**< driver */
+    PA_SINK_INPUT_INFO_PROPLIST = 0x0100U,          /**< proplist */
+    PA_SINK_INPUT_INFO_CORKED = 0x0200U,            /**< corked */
+    PA_SINK_INPUT_INFO_FORMAT = 0x0400U,            /**< format */
+    PA_SINK_INPUT_INFO_RESAMPLER_TIMING = 0x0800U,  /**< resampler_runs, n_resampler_phases and resampler_phases */
+    PA_SINK_INPUT_INFO_STATS = 0x1000U,             /**< underruns, silence_frames, rewinds and render_usec. Needs a server with protocol version 39. */
+    PA_SINK_INPUT_INFO_ALL = 0x1FFFU                /**< All of the above */
+} pa_sink_input_info_mask_t;
+
+/** Get the complete sink input list, with only the fields in mask
+ * filled in. The index is always set. The other fields are zero,
+ * proplist and format are empty, owner_module, client and sink are
+ * PA_INVALID_INDEX. Needs a server with protocol version 34, otherwise
+ * the call fails with PA_ERR_NOTSUPPORTED. \since 7.0 */
+pa_operation* pa_context_get_sink_input_info_list_masked(pa_context *c, pa_sink_input_info_mask_t mask, pa_sink_input_info_cb_t cb, void *userdata);
+
 /** Move the specified sink input to a different sink. \since 0.9.5 */
 pa_operation* pa_context_move_sink_input_by_name(pa_context *c, uint32_t idx, const char *sink_name, pa_context_success_cb_t cb, void* userdata);
 
@@ -677,6 +721,67 @@ pa_operation* pa_context_stat(pa_context *c, pa_stat_info_cb_t cb, void *userdat
 
 /** @} */
 
+/** @{ \name IO Traces */
+
+/** Flags of an IO cycle. \since 7.0 */
+typedef enum pa_io_trace_flags {
+    PA_IO_TRACE_XRUN = 0x0001U,     /**< The device ran out of data or space during the cycle */
+    PA_IO_TRACE_TIMEOUT = 0x0002U,  /**< The cycle was started by the timer */
+    PA_IO_TRACE_POLLED = 0x0004U    /**< The cycle was started by the device */
+} pa_io_trace_flags_t;
+
+/** One cycle of the IO thread of a sink or source. \since 7.0 */
+typedef struct pa_io_trace_entry {
+    pa_usec_t time;                 /**< When the cycle started, on the server's monotonic clock */
+    int64_t lateness;               /**< How much later than asked the timer started the cycle, in usec */
+    int64_t avail;                  /**< Bytes the device could take, or had ready, at the start of the cycle. A negative errno value if asking the device failed. */
+    pa_usec_t process_usec;         /**< Time spent rendering the data of a sink, or posting the data of a source */
+    pa_usec_t sleep_usec;           /**< How long the thread then asked to sleep, 0 if only the device could wake it */
+    pa_io_trace_flags_t flags;      /**< Flags of the cycle */
+} pa_io_trace_entry;
+
+/** The last IO cycles of a sink or source. Once a cycle had an xrun,
+ * the server records a few more cycles and then stops until the trace
+ * is fetched again. \since 7.0 */
+typedef struct pa_io_trace_info {
+    uint32_t xruns;                 /**< Number of xruns since the device was created */
+    int frozen;                     /**< Non-zero if recording had stopped after an xrun. It restarted when the trace was fetched. */
+    uint32_t n_entries;             /**< Number of entries */
+    const pa_io_trace_entry *entries; /**< The cycles, oldest first */
+} pa_io_trace_info;
+
+/** Callback prototype for pa_context_get_sink_io_trace() and pa_context_get_source_io_trace(). i is NULL on failure. \since 7.0 */
+typedef void (*pa_io_trace_info_cb_t)(pa_context *c, const pa_io_trace_info *i, void *userdata);
+
+/** Get the IO trace of a sink, by its name or index. Fails with
+ * PA_ERR_NOENTITY if the sink keeps no trace. \since 7.0 */
+pa_operation* pa_context_get_sink_io_trace(pa_context *c, const char *name, pa_io_trace_info_cb_t cb, void *userdata);
+
+/** Get the IO trace of a source, by its name or index. Fails with
+ * PA_ERR_NOENTITY if the source keeps no trace. \since 7.0 */
+pa_operation* pa_context_get_source_io_trace(pa_context *c, const char *name, pa_io_trace_info_cb_t cb, void *userdata);
+
+/** @} */
+
+/** @{ \name Metrics */
+
+/** A counter the server keeps about one of its objects, e.g. the
+ * rewinds of a sink. Counters only ever grow. \since 7.0 */
+typedef struct pa_metric_info {
+    const char *name;               /**< Name of the counter family, e.g. "pulseaudio_sink_rewinds_total" */
+    const char *label_name;         /**< What kind of object the counter is about, e.g. "sink" */
+    const char *label_value;        /**< Which object the counter is about, e.g. the name of the sink */
+    uint64_t value;                 /**< The count */
+} pa_metric_info;
+
+/** Callback prototype for pa_context_get_metric_info_list(). \since 7.0 */
+typedef void (*pa_metric_info_cb_t)(pa_context *c, const pa_metric_info *i, int eol, void *userdata);
+
+/** Get all counters of the server. \since 7.0 */
+pa_operation* pa_context_get_metric_info_list(pa_context *c, pa_metric_info_cb_t cb, void *userdata);
+
+/** @} */
+
 /** @{ \name Cached Samples */
 
 /** Stores information about sample cache entries. Please note that this structure
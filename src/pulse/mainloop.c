@@ -55,7 +55,9 @@ struct pa_io_event {
 
     int fd;
     pa_io_event_flags_t events;
-    struct pollfd *pollfd;
+
+    /* Index into the pollfd array, 0 while we have none yet */
+    unsigned pollfd_idx;
 
     pa_io_event_cb_t callback;
     void *userdata;
@@ -72,6 +74,9 @@ struct pa_time_event {
     bool use_rtclock:1;
     pa_usec_t time;
 
+    /* Position in the timer heap, valid while enabled */
+    unsigned heap_idx;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -100,12 +105,24 @@ struct pa_mainloop {
     unsigned n_enabled_defer_events, n_enabled_time_events, n_io_events;
     unsigned io_events_please_scan, time_events_please_scan, defer_events_please_scan;
 
-    bool rebuild_pollfds:1;
+    /* The first pollfd is the wakeup pipe, the others belong to the
+     * io events in pollfd_events. New io events get theirs appended in
+     * pa_mainloop_prepare(), since the array may be in use by a poll()
+     * running without our lock. */
     struct pollfd *pollfds;
+    pa_io_event **pollfd_events;
     unsigned max_pollfds, n_pollfds;
 
+    /* All enabled time events as a binary heap ordered by time, the next
+     * one to expire first */
+    pa_time_event **time_heap;
+    unsigned max_time_heap;
+
+    /* Scratch space for dispatch_timeout() */
+    pa_time_event **due_time_events;
+    unsigned max_due_time_events;
+
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
 
     pa_mainloop_api api;
 
@@ -172,8 +189,9 @@ static pa_io_event* mainloop_io_new(
     e->callback = callback;
     e->userdata = userdata;
 
+    /* New events have to stay at the head of the list until they got
+     * their pollfd, see add_pollfds() */
     PA_LLIST_PREPEND(pa_io_event, m->io_events, e);
-    m->rebuild_pollfds = true;
     m->n_io_events ++;
 
     pa_mainloop_wakeup(m);
@@ -190,10 +208,8 @@ static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
 
     e->events = events;
 
-    if (e->pollfd)
-        e->pollfd->events = map_flags_to_libc(events);
-    else
-        e->mainloop->rebuild_pollfds = true;
+    if (e->pollfd_idx > 0)
+        e->mainloop->pollfds[e->pollfd_idx].events = map_flags_to_libc(events);
 
     pa_mainloop_wakeup(e->mainloop);
 }
@@ -206,7 +222,6 @@ static void mainloop_io_free(pa_io_event *e) {
     e->mainloop->io_events_please_scan ++;
 
     e->mainloop->n_io_events --;
-    e->mainloop->rebuild_pollfds = true;
 
     pa_mainloop_wakeup(e->mainloop);
 }
@@ -286,6 +301,79 @@ static void mainloop_defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy
 }
 
 /* Time events */
+static void time_heap_set(pa_mainloop *m, unsigned i, pa_time_event *e) {
+    m->time_heap[i] = e;
+    e->heap_idx = i;
+}
+
+static void time_heap_sift_up(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+
+        if (m->time_heap[parent]->time <= e->time)
+            break;
+
+        time_heap_set(m, i, m->time_heap[parent]);
+        i = parent;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_sift_down(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+    unsigned n = m->n_enabled_time_events;
+
+    for (;;) {
+        unsigned child = 2 * i + 1;
+
+        if (child >= n)
+            break;
+
+        if (child + 1 < n && m->time_heap[child + 1]->time < m->time_heap[child]->time)
+            child++;
+
+        if (e->time <= m->time_heap[child]->time)
+            break;
+
+        time_heap_set(m, i, m->time_heap[child]);
+        i = child;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_insert(pa_mainloop *m, pa_time_event *e) {
+    if (m->n_enabled_time_events >= m->max_time_heap) {
+        m->max_time_heap = PA_MAX(2 * m->max_time_heap, 16U);
+        m->time_heap = pa_xrenew(pa_time_event*, m->time_heap, m->max_time_heap);
+    }
+
+    time_heap_set(m, m->n_enabled_time_events++, e);
+    time_heap_sift_up(m, e->heap_idx);
+}
+
+static void time_heap_remove(pa_mainloop *m, pa_time_event *e) {
+    unsigned i = e->heap_idx;
+    pa_time_event *last;
+
+    pa_assert(m->n_enabled_time_events > 0);
+    pa_assert(m->time_heap[i] == e);
+
+    if (i == --m->n_enabled_time_events)
+        return;
+
+    /* Move the last one into the hole and restore the order */
+    last = m->time_heap[m->n_enabled_time_events];
+    time_heap_set(m, i, last);
+    time_heap_sift_up(m, i);
+
+    if (last->heap_idx == i)
+        time_heap_sift_down(m, i);
+}
+
 static pa_usec_t make_rt(const struct timeval *tv, bool *use_rtclock) {
     struct timeval ttv;
 
@@ -332,14 +420,7 @@ static pa_time_event* mainloop_time_new(
         e->time = t;
         e->use_rtclock = use_rtclock;
 
-        m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
+        time_heap_insert(m, e);
     }
 
     e->callback = callback;
@@ -364,27 +445,27 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
     t = make_rt(tv, &use_rtclock);
 
     valid = (t != PA_USEC_INVALID);
-    if (e->enabled && !valid) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
-    } else if (!e->enabled && valid)
-        e->mainloop->n_enabled_time_events++;
 
-    if ((e->enabled = valid)) {
-        e->time = t;
-        e->use_rtclock = use_rtclock;
-        pa_mainloop_wakeup(e->mainloop);
-    }
+    if (!valid) {
+        if (e->enabled)
+            time_heap_remove(e->mainloop, e);
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
+        e->enabled = false;
+        return;
+    }
 
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
+    e->time = t;
+    e->use_rtclock = use_rtclock;
 
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
+    if (e->enabled) {
+        time_heap_sift_up(e->mainloop, e->heap_idx);
+        time_heap_sift_down(e->mainloop, e->heap_idx);
+    } else {
+        e->enabled = true;
+        time_heap_insert(e->mainloop, e);
     }
+
+    pa_mainloop_wakeup(e->mainloop);
 }
 
 static void mainloop_time_free(pa_time_event *e) {
@@ -395,14 +476,10 @@ static void mainloop_time_free(pa_time_event *e) {
     e->mainloop->time_events_please_scan ++;
 
     if (e->enabled) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
+        time_heap_remove(e->mainloop, e);
         e->enabled = false;
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
     /* no wakeup needed here. Think about it! */
 }
 
@@ -463,7 +540,14 @@ pa_mainloop *pa_mainloop_new(void) {
     pa_make_fd_nonblock(m->wakeup_pipe[0]);
     pa_make_fd_nonblock(m->wakeup_pipe[1]);
 
-    m->rebuild_pollfds = true;
+    m->max_pollfds = 16;
+    m->pollfds = pa_xnew(struct pollfd, m->max_pollfds);
+    m->pollfd_events = pa_xnew0(pa_io_event*, m->max_pollfds);
+
+    m->pollfds[0].fd = m->wakeup_pipe[0];
+    m->pollfds[0].events = POLLIN;
+    m->pollfds[0].revents = 0;
+    m->n_pollfds = 1;
 
     m->api = vtable;
     m->api.userdata = m;
@@ -475,6 +559,53 @@ pa_mainloop *pa_mainloop_new(void) {
     return m;
 }
 
+/* Fills the slot of e with the last pollfd */
+static void remove_pollfd(pa_mainloop *m, pa_io_event *e) {
+    unsigned i = e->pollfd_idx, last = m->n_pollfds - 1;
+
+    pa_assert(i > 0);
+    pa_assert(m->pollfd_events[i] == e);
+
+    if (i != last) {
+        m->pollfds[i] = m->pollfds[last];
+        m->pollfd_events[i] = m->pollfd_events[last];
+        m->pollfd_events[i]->pollfd_idx = i;
+    }
+
+    m->pollfd_events[last] = NULL;
+    m->n_pollfds--;
+    e->pollfd_idx = 0;
+}
+
+static void add_pollfds(pa_mainloop *m) {
+    pa_io_event *e;
+
+    /* The events without pollfd are the ones at the head of the list */
+    PA_LLIST_FOREACH(e, m->io_events) {
+        struct pollfd *p;
+
+        if (e->pollfd_idx > 0)
+            break;
+
+        if (e->dead)
+            continue;
+
+        if (m->n_pollfds >= m->max_pollfds) {
+            m->max_pollfds *= 2;
+            m->pollfds = pa_xrenew(struct pollfd, m->pollfds, m->max_pollfds);
+            m->pollfd_events = pa_xrenew(pa_io_event*, m->pollfd_events, m->max_pollfds);
+        }
+
+        e->pollfd_idx = m->n_pollfds++;
+        m->pollfd_events[e->pollfd_idx] = e;
+
+        p = &m->pollfds[e->pollfd_idx];
+        p->fd = e->fd;
+        p->events = map_flags_to_libc(e->events);
+        p->revents = 0;
+    }
+}
+
 static void cleanup_io_events(pa_mainloop *m, bool force) {
     pa_io_event *e, *n;
 
@@ -491,12 +622,13 @@ static void cleanup_io_events(pa_mainloop *m, bool force) {
                 m->io_events_please_scan--;
             }
 
+            if (e->pollfd_idx > 0)
+                remove_pollfd(m, e);
+
             if (e->destroy_callback)
                 e->destroy_callback(&m->api, e, e->userdata);
 
             pa_xfree(e);
-
-            m->rebuild_pollfds = true;
         }
     }
 
@@ -520,8 +652,7 @@ static void cleanup_time_events(pa_mainloop *m, bool force) {
             }
 
             if (!e->dead && e->enabled) {
-                pa_assert(m->n_enabled_time_events > 0);
-                m->n_enabled_time_events--;
+                time_heap_remove(m, e);
                 e->enabled = false;
             }
 
@@ -575,6 +706,9 @@ void pa_mainloop_free(pa_mainloop *m) {
     cleanup_time_events(m, true);
 
     pa_xfree(m->pollfds);
+    pa_xfree(m->pollfd_events);
+    pa_xfree(m->time_heap);
+    pa_xfree(m->due_time_events);
 
     pa_close_pipe(m->wakeup_pipe);
 
@@ -594,68 +728,39 @@ static void scan_dead(pa_mainloop *m) {
         cleanup_defer_events(m, false);
 }
 
-static void rebuild_pollfds(pa_mainloop *m) {
-    pa_io_event*e;
-    struct pollfd *p;
-    unsigned l;
-
-    l = m->n_io_events + 1;
-    if (m->max_pollfds < l) {
-        l *= 2;
-        m->pollfds = pa_xrealloc(m->pollfds, sizeof(struct pollfd)*l);
-        m->max_pollfds = l;
-    }
-
-    m->n_pollfds = 0;
-    p = m->pollfds;
-
-    m->pollfds[0].fd = m->wakeup_pipe[0];
-    m->pollfds[0].events = POLLIN;
-    m->pollfds[0].revents = 0;
-    p++;
-    m->n_pollfds++;
-
-    PA_LLIST_FOREACH(e, m->io_events) {
-        if (e->dead) {
-            e->pollfd = NULL;
-            continue;
-        }
-
-        e->pollfd = p;
-        p->fd = e->fd;
-        p->events = map_flags_to_libc(e->events);
-        p->revents = 0;
-
-        p++;
-        m->n_pollfds++;
-    }
-
-    m->rebuild_pollfds = false;
-}
-
 static unsigned dispatch_pollfds(pa_mainloop *m) {
-    pa_io_event *e;
-    unsigned r = 0, k;
+    unsigned r = 0, k, i;
 
     pa_assert(m->poll_func_ret > 0);
 
     k = m->poll_func_ret;
 
-    PA_LLIST_FOREACH(e, m->io_events) {
+    /* Skip the wakeup pipe. Callbacks may add events, which get their
+     * pollfds only on the next iteration, and free events, which keep
+     * their slot until then. */
+    for (i = 1; i < m->n_pollfds; i++) {
+        pa_io_event *e;
+        short revents;
 
         if (k <= 0 || m->quit)
             break;
 
-        if (e->dead || !e->pollfd || !e->pollfd->revents)
+        if (!(revents = m->pollfds[i].revents))
             continue;
 
-        pa_assert(e->pollfd->fd == e->fd);
+        m->pollfds[i].revents = 0;
+        k--;
+
+        e = m->pollfd_events[i];
+
+        if (e->dead)
+            continue;
+
+        pa_assert(m->pollfds[i].fd == e->fd);
         pa_assert(e->callback);
 
-        e->callback(&m->api, e, e->fd, map_flags_from_libc(e->pollfd->revents), e->userdata);
-        e->pollfd->revents = 0;
+        e->callback(&m->api, e, e->fd, map_flags_from_libc(revents), e->userdata);
         r++;
-        k--;
     }
 
     return r;
@@ -684,31 +789,6 @@ static unsigned dispatch_defer(pa_mainloop *m) {
     return r;
 }
 
-static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
-    pa_assert(m);
-
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
-
-    PA_LLIST_FOREACH(t, m->time_events) {
-
-        if (t->dead || !t->enabled)
-            continue;
-
-        if (!n || t->time < n->time) {
-            n = t;
-
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
-        }
-    }
-
-    m->cached_next_time_event = n;
-    return n;
-}
-
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     pa_time_event *t;
     pa_usec_t clock_now;
@@ -716,7 +796,7 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     if (m->n_enabled_time_events <= 0)
         return PA_USEC_INVALID;
 
-    pa_assert_se(t = find_next_time_event(m));
+    t = m->time_heap[0];
 
     if (t->time <= 0)
         return 0;
@@ -729,10 +809,15 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     return t->time - clock_now;
 }
 
+static int time_event_compare(const void *a, const void *b) {
+    const pa_time_event *x = *(pa_time_event * const *) a, *y = *(pa_time_event * const *) b;
+
+    return x->time < y->time ? -1 : (x->time > y->time ? 1 : 0);
+}
+
 static unsigned dispatch_timeout(pa_mainloop *m) {
-    pa_time_event *e;
     pa_usec_t now;
-    unsigned r = 0;
+    unsigned r = 0, n = 0, i;
     pa_assert(m);
 
     if (m->n_enabled_time_events <= 0)
@@ -740,11 +825,38 @@ static unsigned dispatch_timeout(pa_mainloop *m) {
 
     now = pa_rtclock_now();
 
-    PA_LLIST_FOREACH(e, m->time_events) {
+    if (m->time_heap[0]->time > now)
+        return 0;
+
+    if (m->max_due_time_events < m->n_enabled_time_events) {
+        m->max_due_time_events = m->max_time_heap;
+        m->due_time_events = pa_xrenew(pa_time_event*, m->due_time_events, m->max_due_time_events);
+    }
+
+    /* Collect the expired events first, the callbacks will change the
+     * heap. Only the subtrees of expired events can contain more. */
+    m->due_time_events[n++] = m->time_heap[0];
+
+    for (i = 0; i < n; i++) {
+        unsigned child = 2 * m->due_time_events[i]->heap_idx + 1;
+
+        if (child < m->n_enabled_time_events && m->time_heap[child]->time <= now)
+            m->due_time_events[n++] = m->time_heap[child];
+
+        if (child + 1 < m->n_enabled_time_events && m->time_heap[child + 1]->time <= now)
+            m->due_time_events[n++] = m->time_heap[child + 1];
+    }
+
+    qsort(m->due_time_events, n, sizeof(pa_time_event*), time_event_compare);
+
+    for (i = 0; i < n; i++) {
+        pa_time_event *e = m->due_time_events[i];
 
         if (m->quit)
             break;
 
+        /* Events are only freed in scan_dead(), but earlier callbacks
+         * may have disabled or moved this one */
         if (e->dead || !e->enabled)
             continue;
 
@@ -794,8 +906,7 @@ int pa_mainloop_prepare(pa_mainloop *m, int timeout) {
 
     if (m->n_enabled_defer_events <= 0) {
 
-        if (m->rebuild_pollfds)
-            rebuild_pollfds(m);
+        add_pollfds(m);
 
         m->prepared_timeout = calc_next_timeout(m);
         if (timeout >= 0) {
@@ -838,8 +949,6 @@ int pa_mainloop_poll(pa_mainloop *m) {
     if (m->n_enabled_defer_events)
         m->poll_func_ret = 0;
     else {
-        pa_assert(!m->rebuild_pollfds);
-
         if (m->poll_func)
             m->poll_func_ret = m->poll_func(
                     m->pollfds, m->n_pollfds,
@@ -21,6 +21,7 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -30,17 +31,133 @@
 #include <pulsecore/hashmap.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/refcnt.h>
 
 #include "proplist.h"
 
+/* The properties are kept in a flat array, in the order they were added.
+ * Each property lives in a single allocation that holds the value followed
+ * by the key, unless the key is one of the well-known PA_PROP_* keys, which
+ * are interned and never copied. Lists that grow long get a hash index on
+ * top of the array.
+ *
+ * pa_proplist_copy() doesn't copy any properties: the copy shares the data
+ * of the original until either of them is modified.
+ *
+ * pa_proplist_unset() only clears the key of a property, so that the
+ * positions pa_proplist_iterate() keeps as its state stay valid when the
+ * current entry is removed. Cleared slots are squeezed out when a
+ * property is added. */
+
+#define INDEX_THRESHOLD 16U
+
 struct property {
-    char *key;
+    const char *key;
     void *value;
     size_t nbytes;
+    unsigned hash;
+    bool is_string;
+};
+
+typedef struct proplist_data {
+    PA_REFCNT_DECLARE;
+
+    /* n_properties counts the slots in use, n_removed the ones of them
+     * that were unset and have a NULL key */
+    struct property *properties;
+    unsigned n_properties, n_removed, n_allocated;
+
+    /* Maps keys to their position in properties plus one, only used for
+     * lists with more than INDEX_THRESHOLD properties */
+    pa_hashmap *index;
+} proplist_data;
+
+struct pa_proplist {
+    /* NULL for lists that never had any properties */
+    proplist_data *data;
 };
 
-#define MAKE_HASHMAP(p) ((pa_hashmap*) (p))
-#define MAKE_PROPLIST(p) ((pa_proplist*) (p))
+/* Sorted as by strcmp() */
+static const char * const well_known_keys[] = {
+    PA_PROP_APPLICATION_ICON,
+    PA_PROP_APPLICATION_ICON_NAME,
+    PA_PROP_APPLICATION_ID,
+    PA_PROP_APPLICATION_LANGUAGE,
+    PA_PROP_APPLICATION_NAME,
+    PA_PROP_APPLICATION_PROCESS_BINARY,
+    PA_PROP_APPLICATION_PROCESS_HOST,
+    PA_PROP_APPLICATION_PROCESS_ID,
+    PA_PROP_APPLICATION_PROCESS_MACHINE_ID,
+    PA_PROP_APPLICATION_PROCESS_SESSION_ID,
+    PA_PROP_APPLICATION_PROCESS_USER,
+    PA_PROP_APPLICATION_VERSION,
+    PA_PROP_DEVICE_ACCESS_MODE,
+    PA_PROP_DEVICE_API,
+    PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE,
+    PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE,
+    PA_PROP_DEVICE_BUFFERING_WATERMARK,
+    PA_PROP_DEVICE_BUS,
+    PA_PROP_DEVICE_BUS_PATH,
+    PA_PROP_DEVICE_CLASS,
+    PA_PROP_DEVICE_DESCRIPTION,
+    PA_PROP_DEVICE_FORM_FACTOR,
+    PA_PROP_DEVICE_ICON,
+    PA_PROP_DEVICE_ICON_NAME,
+    PA_PROP_DEVICE_INTENDED_ROLES,
+    PA_PROP_DEVICE_MASTER_DEVICE,
+    PA_PROP_DEVICE_PRODUCT_ID,
+    PA_PROP_DEVICE_PRODUCT_NAME,
+    PA_PROP_DEVICE_PROFILE_DESCRIPTION,
+    PA_PROP_DEVICE_PROFILE_NAME,
+    PA_PROP_DEVICE_SERIAL,
+    PA_PROP_DEVICE_STRING,
+    PA_PROP_DEVICE_THREAD_CPUS,
+    PA_PROP_DEVICE_VENDOR_ID,
+    PA_PROP_DEVICE_VENDOR_NAME,
+    PA_PROP_EVENT_DESCRIPTION,
+    PA_PROP_EVENT_ID,
+    PA_PROP_EVENT_MOUSE_BUTTON,
+    PA_PROP_EVENT_MOUSE_HPOS,
+    PA_PROP_EVENT_MOUSE_VPOS,
+    PA_PROP_EVENT_MOUSE_X,
+    PA_PROP_EVENT_MOUSE_Y,
+    PA_PROP_FILTER_APPLY,
+    PA_PROP_FILTER_SUPPRESS,
+    PA_PROP_FILTER_WANT,
+    PA_PROP_FORMAT_CHANNEL_MAP,
+    PA_PROP_FORMAT_CHANNELS,
+    PA_PROP_FORMAT_RATE,
+    PA_PROP_FORMAT_SAMPLE_FORMAT,
+    PA_PROP_MEDIA_ARTIST,
+    PA_PROP_MEDIA_COPYRIGHT,
+    PA_PROP_MEDIA_FILENAME,
+    PA_PROP_MEDIA_ICON,
+    PA_PROP_MEDIA_ICON_NAME,
+    PA_PROP_MEDIA_LANGUAGE,
+    PA_PROP_MEDIA_NAME,
+    PA_PROP_MEDIA_ROLE,
+    PA_PROP_MEDIA_SOFTWARE,
+    PA_PROP_MEDIA_TITLE,
+    PA_PROP_MODULE_AUTHOR,
+    PA_PROP_MODULE_DESCRIPTION,
+    PA_PROP_MODULE_USAGE,
+    PA_PROP_MODULE_VERSION,
+    PA_PROP_WINDOW_DESKTOP,
+    PA_PROP_WINDOW_HEIGHT,
+    PA_PROP_WINDOW_HPOS,
+    PA_PROP_WINDOW_ICON,
+    PA_PROP_WINDOW_ICON_NAME,
+    PA_PROP_WINDOW_ID,
+    PA_PROP_WINDOW_NAME,
+    PA_PROP_WINDOW_VPOS,
+    PA_PROP_WINDOW_WIDTH,
+    PA_PROP_WINDOW_X,
+    PA_PROP_WINDOW_X11_DISPLAY,
+    PA_PROP_WINDOW_X11_MONITOR,
+    PA_PROP_WINDOW_X11_SCREEN,
+    PA_PROP_WINDOW_X11_XID,
+    PA_PROP_WINDOW_Y,
+};
 
 int pa_proplist_key_valid(const char *key) {
 
@@ -53,29 +170,290 @@ int pa_proplist_key_valid(const char *key) {
     return 1;
 }
 
-static void property_free(struct property *prop) {
+static int key_compare(const void *a, const void *b) {
+    return strcmp(a, *(const char * const *) b);
+}
+
+static const char *intern_key(const char *key) {
+    const char * const *k;
+
+    k = bsearch(key, well_known_keys, PA_ELEMENTSOF(well_known_keys), sizeof(well_known_keys[0]), key_compare);
+
+    return k ? *k : NULL;
+}
+
+static bool property_key_is_interned(const struct property *prop) {
+    return prop->key != (const char*) prop->value + prop->nbytes + 1;
+}
+
+/* Fills in prop with a copy of the key and the value. If interned is not
+ * NULL it is used as the key instead of copying it. */
+static void property_init(struct property *prop, const char *key, const char *interned, unsigned hash, const void *value, size_t nbytes) {
+    size_t key_size;
+    char *block;
+
+    pa_assert(prop);
+    pa_assert(key);
+    pa_assert(value || nbytes == 0);
+
+    key_size = interned ? 0 : strlen(key) + 1;
+
+    block = pa_xmalloc(nbytes + 1 + key_size);
+    if (nbytes > 0)
+        memcpy(block, value, nbytes);
+    block[nbytes] = 0;
+
+    if (!interned) {
+        memcpy(block + nbytes + 1, key, key_size);
+        interned = block + nbytes + 1;
+    }
+
+    prop->key = interned;
+    prop->value = block;
+    prop->nbytes = nbytes;
+    prop->hash = hash;
+
+    /* Checking this once here is cheaper than on every pa_proplist_gets() */
+    prop->is_string =
+        nbytes > 0 &&
+        block[nbytes-1] == 0 &&
+        strlen(block) == nbytes-1 &&
+        pa_utf8_valid(block);
+}
+
+static void property_done(struct property *prop) {
     pa_assert(prop);
 
-    pa_xfree(prop->key);
     pa_xfree(prop->value);
-    pa_xfree(prop);
+}
+
+static void data_rebuild_index(proplist_data *d) {
+    unsigned i;
+
+    pa_assert(d);
+
+    if (d->index) {
+        pa_hashmap_free(d->index);
+        d->index = NULL;
+    }
+
+    if (d->n_properties - d->n_removed <= INDEX_THRESHOLD)
+        return;
+
+    d->index = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    for (i = 0; i < d->n_properties; i++)
+        if (d->properties[i].key)
+            pa_hashmap_put(d->index, (void*) d->properties[i].key, PA_UINT_TO_PTR(i + 1));
+}
+
+static proplist_data *data_new(unsigned n_allocated) {
+    proplist_data *d;
+
+    d = pa_xnew0(proplist_data, 1);
+    PA_REFCNT_INIT(d);
+
+    if (n_allocated > 0) {
+        d->properties = pa_xnew(struct property, n_allocated);
+        d->n_allocated = n_allocated;
+    }
+
+    return d;
+}
+
+static proplist_data *data_copy(const proplist_data *d) {
+    proplist_data *copy;
+    unsigned i;
+
+    pa_assert(d);
+
+    copy = data_new(d->n_properties);
+
+    /* Removed slots are kept, an iteration running on the original goes
+     * on the same way on the copy */
+    for (i = 0; i < d->n_properties; i++) {
+        const struct property *prop = &d->properties[i];
+
+        if (!prop->key) {
+            copy->properties[i] = *prop;
+            continue;
+        }
+
+        property_init(&copy->properties[i], prop->key, property_key_is_interned(prop) ? prop->key : NULL,
+                      prop->hash, prop->value, prop->nbytes);
+    }
+
+    copy->n_properties = d->n_properties;
+    copy->n_removed = d->n_removed;
+    data_rebuild_index(copy);
+
+    return copy;
+}
+
+static proplist_data *data_ref(proplist_data *d) {
+    pa_assert(d);
+    pa_assert(PA_REFCNT_VALUE(d) >= 1);
+
+    PA_REFCNT_INC(d);
+    return d;
+}
+
+static void data_unref(proplist_data *d) {
+    unsigned i;
+
+    pa_assert(d);
+    pa_assert(PA_REFCNT_VALUE(d) >= 1);
+
+    if (PA_REFCNT_DEC(d) > 0)
+        return;
+
+    for (i = 0; i < d->n_properties; i++)
+        if (d->properties[i].key)
+            property_done(&d->properties[i]);
+
+    if (d->index)
+        pa_hashmap_free(d->index);
+
+    pa_xfree(d->properties);
+    pa_xfree(d);
+}
+
+/* Returns the data of p for modification, copying it first if it is shared
+ * with another list */
+static proplist_data *make_writable(pa_proplist *p) {
+    proplist_data *copy;
+
+    pa_assert(p);
+
+    if (!p->data)
+        p->data = data_new(0);
+    else if (PA_REFCNT_VALUE(p->data) > 1) {
+        copy = data_copy(p->data);
+        data_unref(p->data);
+        p->data = copy;
+    }
+
+    return p->data;
+}
+
+static int find_property(const proplist_data *d, const char *key, unsigned hash) {
+    unsigned i;
+
+    pa_assert(key);
+
+    if (!d)
+        return -1;
+
+    if (d->index) {
+        void *n;
+
+        if (!(n = pa_hashmap_get(d->index, key)))
+            return -1;
+
+        return (int) PA_PTR_TO_UINT(n) - 1;
+    }
+
+    for (i = 0; i < d->n_properties; i++)
+        if (d->properties[i].hash == hash &&
+            d->properties[i].key &&
+            (d->properties[i].key == key || strcmp(d->properties[i].key, key) == 0))
+            return (int) i;
+
+    return -1;
+}
+
+static const struct property *get_property(const pa_proplist *p, const char *key) {
+    int i;
+
+    pa_assert(p);
+    pa_assert(key);
+
+    if ((i = find_property(p->data, key, pa_idxset_string_hash_func(key))) < 0)
+        return NULL;
+
+    return &p->data->properties[i];
+}
+
+/* Drops the slots of unset properties */
+static void data_compact(proplist_data *d) {
+    unsigned i, n = 0;
+
+    pa_assert(d);
+
+    if (d->n_removed <= 0)
+        return;
+
+    for (i = 0; i < d->n_properties; i++)
+        if (d->properties[i].key)
+            d->properties[n++] = d->properties[i];
+
+    d->n_properties = n;
+    d->n_removed = 0;
+
+    data_rebuild_index(d);
+}
+
+/* The key must be valid, the value is copied */
+static void set_property(pa_proplist *p, const char *key, const void *value, size_t nbytes) {
+    proplist_data *d;
+    struct property *prop, old;
+    unsigned hash;
+    int i;
+
+    pa_assert(p);
+    pa_assert(key);
+
+    hash = pa_idxset_string_hash_func(key);
+    d = make_writable(p);
+
+    if ((i = find_property(d, key, hash)) >= 0) {
+        prop = &d->properties[i];
+        old = *prop;
+
+        /* The key may point into the old value block, so the new one has to
+         * be set up first */
+        property_init(prop, key, property_key_is_interned(&old) ? old.key : NULL, hash, value, nbytes);
+
+        if (d->index) {
+            pa_hashmap_remove(d->index, old.key);
+            pa_hashmap_put(d->index, (void*) prop->key, PA_UINT_TO_PTR(i + 1));
+        }
+
+        property_done(&old);
+        return;
+    }
+
+    data_compact(d);
+
+    if (d->n_properties >= d->n_allocated) {
+        d->n_allocated = PA_MAX(8U, d->n_allocated * 2);
+        d->properties = pa_xrenew(struct property, d->properties, d->n_allocated);
+    }
+
+    prop = &d->properties[d->n_properties++];
+    property_init(prop, key, intern_key(key), hash, value, nbytes);
+
+    if (d->index)
+        pa_hashmap_put(d->index, (void*) prop->key, PA_UINT_TO_PTR(d->n_properties));
+    else if (d->n_properties > INDEX_THRESHOLD)
+        data_rebuild_index(d);
 }
 
 pa_proplist* pa_proplist_new(void) {
-    return MAKE_PROPLIST(pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) property_free));
+    return pa_xnew0(pa_proplist, 1);
 }
 
 void pa_proplist_free(pa_proplist* p) {
     pa_assert(p);
 
-    pa_hashmap_free(MAKE_HASHMAP(p));
+    if (p->data)
+        data_unref(p->data);
+
+    pa_xfree(p);
 }
 
 /** Will accept only valid UTF-8 */
 int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
-    struct property *prop;
-    bool add = false;
-
     pa_assert(p);
     pa_assert(key);
     pa_assert(value);
@@ -83,27 +461,15 @@ int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
     if (!pa_proplist_key_valid(key) || !pa_utf8_valid(value))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = pa_xstrdup(value);
-    prop->nbytes = strlen(value)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    set_property(p, key, value, strlen(value)+1);
 
     return 0;
 }
 
 /** Will accept only valid UTF-8 */
 static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
-    struct property *prop;
-    bool add = false;
     char *k, *v;
+    int r = -1;
 
     pa_assert(p);
     pa_assert(key);
@@ -112,28 +478,15 @@ static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, con
     k = pa_xstrndup(key, key_length);
     v = pa_xstrndup(value, value_length);
 
-    if (!pa_proplist_key_valid(k) || !pa_utf8_valid(v)) {
-        pa_xfree(k);
-        pa_xfree(v);
-        return -1;
-    }
-
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = true;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
+    if (pa_proplist_key_valid(k) && pa_utf8_valid(v)) {
+        set_property(p, k, v, strlen(v)+1);
+        r = 0;
     }
 
-    prop->value = v;
-    prop->nbytes = strlen(v)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    pa_xfree(k);
+    pa_xfree(v);
 
-    return 0;
+    return r;
 }
 
 /** Will accept only valid UTF-8 */
@@ -152,8 +505,6 @@ int pa_proplist_setp(pa_proplist *p, const char *pair) {
 }
 
 static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
-    struct property *prop;
-    bool add = false;
     char *k, *v;
     uint8_t *d;
     size_t dn;
@@ -179,31 +530,17 @@ static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, c
         return -1;
     }
 
-    pa_xfree(v);
-
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = true;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
-    }
-
-    d[dn] = 0;
-    prop->value = d;
-    prop->nbytes = dn;
+    set_property(p, k, d, dn);
 
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    pa_xfree(k);
+    pa_xfree(v);
+    pa_xfree(d);
 
     return 0;
 }
 
 /** Will accept only valid UTF-8 */
 int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
-    struct property *prop;
-    bool add = false;
     va_list ap;
     char *v;
 
@@ -221,18 +558,8 @@ int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
     if (!pa_utf8_valid(v))
         goto fail;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = v;
-    prop->nbytes = strlen(v)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    set_property(p, key, v, strlen(v)+1);
+    pa_xfree(v);
 
     return 0;
 
@@ -242,9 +569,6 @@ fail:
 }
 
 int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nbytes) {
-    struct property *prop;
-    bool add = false;
-
     pa_assert(p);
     pa_assert(key);
     pa_assert(data || nbytes == 0);
@@ -252,27 +576,13 @@ int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nb
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = pa_xmalloc(nbytes+1);
-    if (nbytes > 0)
-        memcpy(prop->value, data, nbytes);
-    ((char*) prop->value)[nbytes] = 0;
-    prop->nbytes = nbytes;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    set_property(p, key, data, nbytes);
 
     return 0;
 }
 
 const char *pa_proplist_gets(pa_proplist *p, const char *key) {
-    struct property *prop;
+    const struct property *prop;
 
     pa_assert(p);
     pa_assert(key);
@@ -280,26 +590,17 @@ const char *pa_proplist_gets(pa_proplist *p, const char *key) {
     if (!pa_proplist_key_valid(key))
         return NULL;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key)))
-        return NULL;
-
-    if (prop->nbytes <= 0)
+    if (!(prop = get_property(p, key)))
         return NULL;
 
-    if (((char*) prop->value)[prop->nbytes-1] != 0)
-        return NULL;
-
-    if (strlen((char*) prop->value) != prop->nbytes-1)
-        return NULL;
-
-    if (!pa_utf8_valid((char*) prop->value))
+    if (!prop->is_string)
         return NULL;
 
     return (char*) prop->value;
 }
 
 int pa_proplist_get(pa_proplist *p, const char *key, const void **data, size_t *nbytes) {
-    struct property *prop;
+    const struct property *prop;
 
     pa_assert(p);
     pa_assert(key);
@@ -309,7 +610,7 @@ int pa_proplist_get(pa_proplist *p, const char *key, const void **data, size_t *
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (!(prop = get_property(p, key)))
         return -1;
 
     *data = prop->value;
@@ -319,37 +620,68 @@ int pa_proplist_get(pa_proplist *p, const char *key, const void **data, size_t *
 }
 
 void pa_proplist_update(pa_proplist *p, pa_update_mode_t mode, const pa_proplist *other) {
-    struct property *prop;
-    void *state = NULL;
+    proplist_data *d;
+    unsigned i;
 
     pa_assert(p);
     pa_assert(mode == PA_UPDATE_SET || mode == PA_UPDATE_MERGE || mode == PA_UPDATE_REPLACE);
     pa_assert(other);
 
+    if (p == other || (p->data && p->data == other->data))
+        return;
+
     if (mode == PA_UPDATE_SET)
         pa_proplist_clear(p);
 
-    /* MAKE_HASHMAP turns the const pointer into a non-const pointer, but
-     * that's ok, because we don't modify the hashmap contents. */
-    while ((prop = pa_hashmap_iterate(MAKE_HASHMAP(other), &state, NULL))) {
+    if (!(d = other->data))
+        return;
+
+    /* Updating an empty list in any mode yields a copy of the other list,
+     * which can share its data */
+    if (pa_proplist_isempty(p)) {
+        if (p->data)
+            data_unref(p->data);
+
+        p->data = data_ref(d);
+        return;
+    }
+
+    for (i = 0; i < d->n_properties; i++) {
+        const struct property *prop = &d->properties[i];
+
+        if (!prop->key)
+            continue;
 
-        if (mode == PA_UPDATE_MERGE && pa_proplist_contains(p, prop->key))
+        if (mode == PA_UPDATE_MERGE && find_property(p->data, prop->key, prop->hash) >= 0)
             continue;
 
-        pa_assert_se(pa_proplist_set(p, prop->key, prop->value, prop->nbytes) == 0);
+        set_property(p, prop->key, prop->value, prop->nbytes);
     }
 }
 
 int pa_proplist_unset(pa_proplist *p, const char *key) {
+    proplist_data *d;
+    int i;
+
     pa_assert(p);
     pa_assert(key);
 
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (pa_hashmap_remove_and_free(MAKE_HASHMAP(p), key) < 0)
+    if (!get_property(p, key))
         return -2;
 
+    d = make_writable(p);
+    pa_assert_se((i = find_property(d, key, pa_idxset_string_hash_func(key))) >= 0);
+
+    if (d->index)
+        pa_hashmap_remove(d->index, d->properties[i].key);
+
+    property_done(&d->properties[i]);
+    pa_zero(d->properties[i]);
+    d->n_removed++;
+
     return 0;
 }
 
@@ -372,12 +704,25 @@ int pa_proplist_unset_many(pa_proplist *p, const char * const keys[]) {
 }
 
 const char *pa_proplist_iterate(pa_proplist *p, void **state) {
-    struct property *prop;
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(state);
+
+    i = PA_PTR_TO_UINT(*state);
 
-    if (!(prop = pa_hashmap_iterate(MAKE_HASHMAP(p), state, NULL)))
+    if (!p->data)
         return NULL;
 
-    return prop->key;
+    while (i < p->data->n_properties && !p->data->properties[i].key)
+        i++;
+
+    if (i >= p->data->n_properties)
+        return NULL;
+
+    *state = PA_UINT_TO_PTR(i + 1);
+
+    return p->data->properties[i].key;
 }
 
 char *pa_proplist_to_string_sep(pa_proplist *p, const char *sep) {
@@ -626,7 +971,7 @@ pa_proplist *pa_proplist_from_string(const char *s) {
     }
 
 success:
-    return MAKE_PROPLIST(pl);
+    return pl;
 
 fail:
     pa_proplist_free(pl);
@@ -640,7 +985,7 @@ int pa_proplist_contains(pa_proplist *p, const char *key) {
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (!(pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (!get_property(p, key))
         return 0;
 
     return 1;
@@ -649,7 +994,10 @@ int pa_proplist_contains(pa_proplist *p, const char *key) {
 void pa_proplist_clear(pa_proplist *p) {
     pa_assert(p);
 
-    pa_hashmap_remove_all(MAKE_HASHMAP(p));
+    if (p->data) {
+        data_unref(p->data);
+        p->data = NULL;
+    }
 }
 
 pa_proplist* pa_proplist_copy(const pa_proplist *p) {
@@ -657,8 +1005,8 @@ pa_proplist* pa_proplist_copy(const pa_proplist *p) {
 
     pa_assert_se(copy = pa_proplist_new());
 
-    if (p)
-        pa_proplist_update(copy, PA_UPDATE_REPLACE, p);
+    if (p && p->data)
+        copy->data = data_ref(p->data);
 
     return copy;
 }
@@ -666,38 +1014,44 @@ pa_proplist* pa_proplist_copy(const pa_proplist *p) {
 unsigned pa_proplist_size(pa_proplist *p) {
     pa_assert(p);
 
-    return pa_hashmap_size(MAKE_HASHMAP(p));
+    return p->data ? p->data->n_properties - p->data->n_removed : 0;
 }
 
 int pa_proplist_isempty(pa_proplist *p) {
     pa_assert(p);
 
-    return pa_hashmap_isempty(MAKE_HASHMAP(p));
+    return pa_proplist_size(p) == 0;
 }
 
 int pa_proplist_equal(pa_proplist *a, pa_proplist *b) {
-    const void *key = NULL;
-    struct property *a_prop = NULL;
-    struct property *b_prop = NULL;
-    void *state = NULL;
+    unsigned i;
 
     pa_assert(a);
     pa_assert(b);
 
-    if (a == b)
+    if (a == b || a->data == b->data)
         return 1;
 
     if (pa_proplist_size(a) != pa_proplist_size(b))
         return 0;
 
-    while ((a_prop = pa_hashmap_iterate(MAKE_HASHMAP(a), &state, &key))) {
-        if (!(b_prop = pa_hashmap_get(MAKE_HASHMAP(b), key)))
+    if (!a->data)
+        return 1;
+
+    for (i = 0; i < a->data->n_properties; i++) {
+        const struct property *a_prop = &a->data->properties[i];
+        int j;
+
+        if (!a_prop->key)
+            continue;
+
+        if ((j = find_property(b->data, a_prop->key, a_prop->hash)) < 0)
             return 0;
 
-        if (a_prop->nbytes != b_prop->nbytes)
+        if (a_prop->nbytes != b->data->properties[j].nbytes)
             return 0;
 
-        if (memcmp(a_prop->value, b_prop->value, a_prop->nbytes) != 0)
+        if (memcmp(a_prop->value, b->data->properties[j].value, a_prop->nbytes) != 0)
             return 0;
     }
 
@@ -243,6 +243,12 @@ PA_C_DECL_BEGIN
 /** For devices: human readable one-line description of the profile this device is in. E.g. "Analog Stereo", ... */
 #define PA_PROP_DEVICE_PROFILE_DESCRIPTION     "device.profile.description"
 
+/** For devices: the wakeup watermark timer based scheduling learned for the device, in usec, integer formatted as string. Updated when the device is suspended or goes away, and taken as the starting point when a device of that name is created. \since 7.0 */
+#define PA_PROP_DEVICE_BUFFERING_WATERMARK     "device.buffering.watermark"
+
+/** For devices: the CPUs the IO thread of the device is bound to, as a comma separated list of CPU numbers and ranges. E.g. "0-3,8" \since 7.0 */
+#define PA_PROP_DEVICE_THREAD_CPUS             "device.thread.cpus"
+
 /** For modules: the author's name, formatted as UTF-8 string. E.g. "Lennart Poettering" */
 #define PA_PROP_MODULE_AUTHOR                  "module.author"
 
@@ -28,6 +28,7 @@
 #include <pulse/def.h>
 #include <pulse/context.h>
 #include <pulse/stream.h>
+#include <pulse/stream-group.h>
 #include <pulse/introspect.h>
 #include <pulse/subscribe.h>
 #include <pulse/scache.h>
@@ -49,7 +50,7 @@
 /** \file
  * Include all libpulse header files at once. The following files are
  * included: \ref direction.h, \ref mainloop-api.h, \ref sample.h, \ref def.h,
- * \ref context.h, \ref stream.h, \ref introspect.h, \ref subscribe.h, \ref
+ * \ref context.h, \ref stream.h, \ref stream-group.h, \ref introspect.h, \ref subscribe.h, \ref
  * scache.h, \ref version.h, \ref error.h, \ref channelmap.h, \ref
  * operation.h,\ref volume.h, \ref xmalloc.h, \ref utf8.h, \ref
  * thread-mainloop.h, \ref mainloop.h, \ref util.h, \ref proplist.h,
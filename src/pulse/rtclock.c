@@ -22,6 +22,7 @@
 #endif
 
 #include <sys/time.h>
+#include <time.h>
 
 #include <pulse/timeval.h>
 
@@ -32,5 +33,13 @@
 pa_usec_t pa_rtclock_now(void) {
     struct timeval tv;
 
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC) && !defined(OS_IS_DARWIN)
+    struct timespec ts;
+
+    /* Straight from the vDSO, without going through a timeval */
+    if (PA_LIKELY(clock_gettime(CLOCK_MONOTONIC, &ts) == 0))
+        return (pa_usec_t) ts.tv_sec * PA_USEC_PER_SEC + (pa_usec_t) ts.tv_nsec / PA_NSEC_PER_USEC;
+#endif
+
     return pa_timeval_load(pa_rtclock_get(&tv));
 }
@@ -0,0 +1,499 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+#include <pulse/fork-detect.h>
+
+#include <pulsecore/llist.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/mix.h>
+#include <pulsecore/refcnt.h>
+
+#include "internal.h"
+#include "stream-group.h"
+
+/* Same as the limit of a server side stream queue */
+#define MEMBER_MAX_LENGTH (4*1024*1024)
+
+/* How much a member may queue while the server stream is not ready */
+#define MEMBER_DEFAULT_BUFFER_USEC (100*PA_USEC_PER_MSEC)
+
+struct pa_stream_group_member {
+    pa_stream_group *group;
+    pa_memblockq *memblockq;
+
+    pa_cvolume volume;
+    bool muted;
+
+    pa_stream_group_member_request_cb_t write_callback;
+    void *write_userdata;
+
+    /* Freed while the group was calling back, see reap_members() */
+    bool dead:1;
+
+    PA_LLIST_FIELDS(pa_stream_group_member);
+};
+
+struct pa_stream_group {
+    PA_REFCNT_DECLARE;
+
+    pa_context *context;
+    pa_stream *stream;
+    pa_sample_spec sample_spec;
+
+    PA_LLIST_HEAD(pa_stream_group_member, members);
+    unsigned n_members;
+
+    /* One entry per member, for pa_mix() */
+    pa_mix_info *mix_info;
+    unsigned n_mix_info;
+
+    /* Member writes don't mix right away, many writes in a row are
+     * mixed once from here */
+    pa_defer_event *defer_event;
+
+    /* Set while the members are asked for data and while mixing, so that
+     * writes from the callbacks do not start mixing of their own and
+     * members freed from them are only marked dead */
+    bool mixing:1;
+    bool has_dead:1;
+};
+
+pa_stream_group* pa_stream_group_new(pa_context *c, const char *name, const pa_sample_spec *ss, const pa_channel_map *map) {
+    pa_stream_group *g;
+    pa_stream *s;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, ss && pa_sample_spec_valid(ss), PA_ERR_INVALID);
+
+    if (!(s = pa_stream_new(c, name, ss, map)))
+        return NULL;
+
+    g = pa_xnew0(pa_stream_group, 1);
+    PA_REFCNT_INIT(g);
+    g->context = pa_context_ref(c);
+    g->stream = s;
+    g->sample_spec = *ss;
+    PA_LLIST_HEAD_INIT(pa_stream_group_member, g->members);
+
+    return g;
+}
+
+static void member_free(pa_stream_group_member *m) {
+    pa_stream_group *g = m->group;
+
+    PA_LLIST_REMOVE(pa_stream_group_member, g->members, m);
+    g->n_members--;
+
+    pa_memblockq_free(m->memblockq);
+    pa_xfree(m);
+}
+
+/* Frees the members that were freed from a callback */
+static void reap_members(pa_stream_group *g) {
+    pa_stream_group_member *m, *next;
+
+    if (!g->has_dead)
+        return;
+
+    PA_LLIST_FOREACH_SAFE(m, next, g->members)
+        if (m->dead)
+            member_free(m);
+
+    g->has_dead = false;
+}
+
+static void group_free(pa_stream_group *g) {
+    pa_assert(g);
+
+    if (g->defer_event)
+        g->context->mainloop->defer_free(g->defer_event);
+
+    while (g->members)
+        member_free(g->members);
+
+    pa_stream_set_write_callback(g->stream, NULL, NULL);
+
+    if (pa_stream_get_state(g->stream) == PA_STREAM_READY ||
+        pa_stream_get_state(g->stream) == PA_STREAM_CREATING)
+        pa_stream_disconnect(g->stream);
+
+    pa_stream_unref(g->stream);
+    pa_context_unref(g->context);
+
+    pa_xfree(g->mix_info);
+    pa_xfree(g);
+}
+
+pa_stream_group* pa_stream_group_ref(pa_stream_group *g) {
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) >= 1);
+
+    PA_REFCNT_INC(g);
+    return g;
+}
+
+void pa_stream_group_unref(pa_stream_group *g) {
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) >= 1);
+
+    if (PA_REFCNT_DEC(g) <= 0)
+        group_free(g);
+}
+
+/* Mixes what the members have into one block of the server stream.
+ * Returns the number of bytes written. */
+static size_t mix_block(pa_stream_group *g, size_t length) {
+    pa_stream_group_member *m;
+    pa_mix_info *info;
+    unsigned n = 0, k;
+    size_t fs;
+    void *data;
+
+    pa_assert(g->n_mix_info >= g->n_members);
+
+    fs = pa_frame_size(&g->sample_spec);
+
+    PA_LLIST_FOREACH(m, g->members) {
+        info = g->mix_info + n;
+
+        if (m->dead)
+            continue;
+
+        if (pa_memblockq_peek(m->memblockq, &info->chunk) < 0)
+            continue;
+
+        /* Members only ever append, so there are no holes */
+        pa_assert(info->chunk.memblock);
+
+        if (m->muted)
+            pa_cvolume_mute(&info->volume, g->sample_spec.channels);
+        else
+            info->volume = m->volume;
+
+        info->userdata = m;
+        length = PA_MIN(length, info->chunk.length);
+        n++;
+    }
+
+    length = (length / fs) * fs;
+
+    if (n <= 0 || length <= 0 ||
+        pa_stream_begin_write(g->stream, &data, &length) < 0) {
+        length = 0;
+        goto finish;
+    }
+
+    if (n == 1) {
+        info = g->mix_info;
+
+        memcpy(data, (uint8_t*) pa_memblock_acquire(info->chunk.memblock) + info->chunk.index, length);
+        pa_memblock_release(info->chunk.memblock);
+
+        if (!pa_cvolume_is_norm(&info->volume)) {
+            pa_memchunk chunk;
+
+            chunk.memblock = pa_memblock_new_fixed(g->context->mempool, data, length, false);
+            chunk.index = 0;
+            chunk.length = length;
+
+            pa_volume_memchunk(&chunk, &g->sample_spec, &info->volume);
+            pa_memblock_unref_fixed(chunk.memblock);
+        }
+    } else
+        pa_mix(g->mix_info, n, data, length, &g->sample_spec, NULL, false);
+
+    for (k = 0; k < n; k++)
+        pa_memblockq_drop(((pa_stream_group_member*) g->mix_info[k].userdata)->memblockq, length);
+
+    if (pa_stream_write(g->stream, data, length, NULL, 0, PA_SEEK_RELATIVE) < 0)
+        length = 0;
+
+finish:
+    for (k = 0; k < n; k++)
+        pa_memblock_unref(g->mix_info[k].chunk.memblock);
+
+    return length;
+}
+
+/* Writes as much of a mix as the server asks for */
+static void mix(pa_stream_group *g) {
+    size_t l;
+
+    if (g->mixing || pa_stream_get_state(g->stream) != PA_STREAM_READY)
+        return;
+
+    g->mixing = true;
+
+    while ((l = pa_stream_writable_size(g->stream)) > 0 && l != (size_t) -1)
+        if (mix_block(g, l) <= 0)
+            break;
+
+    g->mixing = false;
+}
+
+static void defer_cb(pa_mainloop_api *m, pa_defer_event *e, void *userdata) {
+    pa_stream_group *g = userdata;
+
+    pa_assert(g);
+    pa_assert(g->defer_event == e);
+
+    m->defer_enable(e, 0);
+
+    mix(g);
+}
+
+static void stream_write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    pa_stream_group *g = userdata;
+    pa_stream_group_member *m, *next;
+
+    pa_assert(g);
+    pa_assert(g->stream == s);
+
+    pa_stream_group_ref(g);
+
+    /* Give the members a chance to queue more before the mix is made */
+    g->mixing = true;
+
+    PA_LLIST_FOREACH_SAFE(m, next, g->members) {
+        size_t l;
+
+        if (!m->dead && m->write_callback && (l = pa_stream_group_member_writable_size(m)) > 0)
+            m->write_callback(m, l, m->write_userdata);
+    }
+
+    g->mixing = false;
+
+    reap_members(g);
+
+    mix(g);
+
+    pa_stream_group_unref(g);
+}
+
+int pa_stream_group_connect(pa_stream_group *g, const char *dev, const pa_buffer_attr *attr, pa_stream_flags_t flags) {
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) >= 1);
+
+    PA_CHECK_VALIDITY(g->context, !pa_detect_fork(), PA_ERR_FORKED);
+
+    pa_stream_set_write_callback(g->stream, stream_write_cb, g);
+
+    return pa_stream_connect_playback(g->stream, dev, attr, flags, NULL, NULL);
+}
+
+int pa_stream_group_disconnect(pa_stream_group *g) {
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) >= 1);
+
+    PA_CHECK_VALIDITY(g->context, !pa_detect_fork(), PA_ERR_FORKED);
+
+    pa_stream_set_write_callback(g->stream, NULL, NULL);
+
+    return pa_stream_disconnect(g->stream);
+}
+
+pa_stream* pa_stream_group_get_stream(pa_stream_group *g) {
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) >= 1);
+
+    return g->stream;
+}
+
+pa_stream_group_member* pa_stream_group_member_new(pa_stream_group *g) {
+    pa_stream_group_member *m;
+
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(g->context, !pa_detect_fork(), PA_ERR_FORKED);
+
+    m = pa_xnew0(pa_stream_group_member, 1);
+    m->group = g;
+    m->memblockq = pa_memblockq_new("stream group member memblockq", 0, MEMBER_MAX_LENGTH, 0, &g->sample_spec, 0, 0, 0, NULL);
+    pa_cvolume_reset(&m->volume, g->sample_spec.channels);
+
+    PA_LLIST_PREPEND(pa_stream_group_member, g->members, m);
+    g->n_members++;
+
+    if (g->n_mix_info < g->n_members) {
+        g->n_mix_info = g->n_members * 2;
+        g->mix_info = pa_xrenew(pa_mix_info, g->mix_info, g->n_mix_info);
+    }
+
+    return m;
+}
+
+void pa_stream_group_member_free(pa_stream_group_member *m) {
+    pa_stream_group *g;
+
+    pa_assert(m);
+    pa_assert(!m->dead);
+
+    g = m->group;
+
+    /* Other members' callbacks may still be walking the list */
+    if (g->mixing) {
+        m->dead = true;
+        g->has_dead = true;
+        return;
+    }
+
+    member_free(m);
+}
+
+void pa_stream_group_member_set_write_callback(pa_stream_group_member *m, pa_stream_group_member_request_cb_t cb, void *userdata) {
+    pa_assert(m);
+
+    m->write_callback = cb;
+    m->write_userdata = userdata;
+}
+
+int pa_stream_group_member_write(pa_stream_group_member *m, const void *data, size_t nbytes, pa_free_cb_t free_cb) {
+    pa_stream_group *g;
+    pa_memchunk chunk;
+
+    pa_assert(m);
+    pa_assert(data);
+
+    g = m->group;
+
+    PA_CHECK_VALIDITY(g->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(g->context, nbytes > 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(g->context, nbytes % pa_frame_size(&g->sample_spec) == 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(g->context, pa_memblockq_get_length(m->memblockq) + nbytes <= MEMBER_MAX_LENGTH, PA_ERR_TOOLARGE);
+
+    if (free_cb) {
+        chunk.memblock = pa_memblock_new_user(g->context->mempool, (void*) data, nbytes, free_cb, (void*) data, true);
+        chunk.index = 0;
+        chunk.length = nbytes;
+
+        pa_assert_se(pa_memblockq_push_align(m->memblockq, &chunk) >= 0);
+        pa_memblock_unref(chunk.memblock);
+
+    } else {
+        while (nbytes > 0) {
+            void *d;
+
+            chunk.index = 0;
+            chunk.length = PA_MIN(nbytes, pa_mempool_block_size_max(g->context->mempool));
+            chunk.memblock = pa_memblock_new(g->context->mempool, chunk.length);
+
+            d = pa_memblock_acquire(chunk.memblock);
+            memcpy(d, data, chunk.length);
+            pa_memblock_release(chunk.memblock);
+
+            pa_assert_se(pa_memblockq_push_align(m->memblockq, &chunk) >= 0);
+            pa_memblock_unref(chunk.memblock);
+
+            data = (const uint8_t*) data + chunk.length;
+            nbytes -= chunk.length;
+        }
+    }
+
+    /* If the server asked for more than the members had, this goes out
+     * soon, together with whatever else is written until then. From the
+     * write callbacks stream_write_cb() mixes anyway. */
+    if (!g->mixing && pa_stream_get_state(g->stream) == PA_STREAM_READY) {
+        if (!g->defer_event)
+            g->defer_event = g->context->mainloop->defer_new(g->context->mainloop, defer_cb, g);
+
+        g->context->mainloop->defer_enable(g->defer_event, 1);
+    }
+
+    return 0;
+}
+
+size_t pa_stream_group_member_writable_size(pa_stream_group_member *m) {
+    pa_stream_group *g;
+    size_t tlength, length;
+
+    pa_assert(m);
+
+    g = m->group;
+
+    if (pa_stream_get_state(g->stream) == PA_STREAM_READY)
+        tlength = pa_stream_get_buffer_attr(g->stream)->tlength;
+    else
+        tlength = pa_usec_to_bytes(MEMBER_DEFAULT_BUFFER_USEC, &g->sample_spec);
+
+    length = pa_memblockq_get_length(m->memblockq);
+
+    return length < tlength ? tlength - length : 0;
+}
+
+int pa_stream_group_member_set_volume(pa_stream_group_member *m, const pa_cvolume *volume) {
+    pa_stream_group *g;
+
+    pa_assert(m);
+
+    g = m->group;
+
+    PA_CHECK_VALIDITY(g->context, volume && pa_cvolume_valid(volume), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(g->context, volume->channels == 1 || pa_cvolume_compatible(volume, &g->sample_spec), PA_ERR_INVALID);
+
+    if (volume->channels == 1)
+        pa_cvolume_set(&m->volume, g->sample_spec.channels, volume->values[0]);
+    else
+        m->volume = *volume;
+
+    return 0;
+}
+
+int pa_stream_group_member_set_mute(pa_stream_group_member *m, int mute) {
+    pa_assert(m);
+
+    m->muted = !!mute;
+
+    return 0;
+}
+
+int pa_stream_group_member_get_latency(pa_stream_group_member *m, pa_usec_t *r_usec) {
+    pa_stream_group *g;
+    pa_usec_t usec, queued;
+    int r, negative;
+
+    pa_assert(m);
+    pa_assert(r_usec);
+
+    g = m->group;
+
+    if ((r = pa_stream_get_latency(g->stream, &usec, &negative)) < 0)
+        return r;
+
+    queued = pa_bytes_to_usec(pa_memblockq_get_length(m->memblockq), &g->sample_spec);
+
+    /* A negative server latency means the server is behind what it
+     * already played, which the member's queue partly makes up for */
+    if (negative)
+        *r_usec = queued > usec ? queued - usec : 0;
+    else
+        *r_usec = usec + queued;
+
+    return 0;
+}
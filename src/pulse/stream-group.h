@@ -0,0 +1,131 @@
+#ifndef foostreamgrouphfoo
+#define foostreamgrouphfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/types.h>
+
+#include <pulse/def.h>
+#include <pulse/cdecl.h>
+#include <pulse/sample.h>
+#include <pulse/channelmap.h>
+#include <pulse/volume.h>
+#include <pulse/context.h>
+#include <pulse/stream.h>
+
+/** \file
+ * Mixing many playback streams in the client.
+ *
+ * Applications that play lots of sounds at the same time on the same
+ * device, like games and browsers, may put them into a stream group
+ * instead of opening a \ref pa_stream for each. The members of a group
+ * are mixed in the client and sent to the server as a single playback
+ * stream, which saves the server a sink input, a resampler and a queue
+ * per sound. All members share the sample spec and channel map of the
+ * group and play on the device the group is connected to.
+ *
+ * Members are written to much like a \ref pa_stream, and each has its own
+ * volume and latency. The mix is written to the server whenever it asks
+ * for data. Members that have no data at that time simply do not take
+ * part in the mix, hence a member's audio plays as soon as possible after
+ * it was written, like it would on a stream of its own.
+ *
+ * The server stream can be accessed with pa_stream_group_get_stream(),
+ * for instance to watch its state or change its volume. Its write
+ * callback is used by the group and must not be changed. \since 7.0 */
+
+PA_C_DECL_BEGIN
+
+/** An opaque stream group object. \since 7.0 */
+typedef struct pa_stream_group pa_stream_group;
+
+/** An opaque member of a stream group. \since 7.0 */
+typedef struct pa_stream_group_member pa_stream_group_member;
+
+/** A generic request callback for stream group members. \since 7.0 */
+typedef void (*pa_stream_group_member_request_cb_t)(pa_stream_group_member *m, size_t nbytes, void *userdata);
+
+/** Create a new, unconnected stream group with the specified name,
+ * sample type and channel map. \since 7.0 */
+pa_stream_group* pa_stream_group_new(
+        pa_context *c                     /**< The context to create the group in */,
+        const char *name                  /**< A name for the server stream */,
+        const pa_sample_spec *ss          /**< The sample type all members use */,
+        const pa_channel_map *map         /**< The channel map all members use, or NULL for default */);
+
+/** Increase the reference counter by one. \since 7.0 */
+pa_stream_group* pa_stream_group_ref(pa_stream_group *g);
+
+/** Decrease the reference counter by one. When it drops to zero the
+ * group is disconnected and freed with all its members. \since 7.0 */
+void pa_stream_group_unref(pa_stream_group *g);
+
+/** Connect the group to a sink, like pa_stream_connect_playback(). \since 7.0 */
+int pa_stream_group_connect(
+        pa_stream_group *g                /**< The group to connect */,
+        const char *dev                   /**< Name of the sink to connect to, or NULL for default */,
+        const pa_buffer_attr *attr        /**< Buffering attributes of the server stream, or NULL for default */,
+        pa_stream_flags_t flags           /**< Additional flags for the server stream */);
+
+/** Disconnect the group from its sink. \since 7.0 */
+int pa_stream_group_disconnect(pa_stream_group *g);
+
+/** Return the stream the group plays on. \since 7.0 */
+pa_stream* pa_stream_group_get_stream(pa_stream_group *g);
+
+/** Add a new, empty member to the group. Members start at full volume
+ * and unmuted. \since 7.0 */
+pa_stream_group_member* pa_stream_group_member_new(pa_stream_group *g);
+
+/** Remove a member from its group, dropping the data it still has
+ * queued. May be called from any member's write callback. \since 7.0 */
+void pa_stream_group_member_free(pa_stream_group_member *m);
+
+/** Set the callback function that is called when the group is about to
+ * mix and the member could take more data. \since 7.0 */
+void pa_stream_group_member_set_write_callback(pa_stream_group_member *m, pa_stream_group_member_request_cb_t cb, void *userdata);
+
+/** Queue data on a member. Works like pa_stream_write() with an offset
+ * of 0 and PA_SEEK_RELATIVE. The data is mixed when the server asks for
+ * more, or from the main loop shortly after, so that writes to several
+ * members in a row end up in one mix. \since 7.0 */
+int pa_stream_group_member_write(
+        pa_stream_group_member *m         /**< The member to use */,
+        const void *data                  /**< The data to write */,
+        size_t nbytes                     /**< The length of the data to write in bytes */,
+        pa_free_cb_t free_cb              /**< A cleanup routine for the data or NULL to request an internal copy */);
+
+/** Return the number of bytes that may be written to a member without
+ * growing its latency beyond the one of the server stream. \since 7.0 */
+size_t pa_stream_group_member_writable_size(pa_stream_group_member *m);
+
+/** Set the volume of a member, which is applied in the mix. The volume
+ * has to have either one channel or as many as the group. \since 7.0 */
+int pa_stream_group_member_set_volume(pa_stream_group_member *m, const pa_cvolume *volume);
+
+/** Mute or unmute a member. \since 7.0 */
+int pa_stream_group_member_set_mute(pa_stream_group_member *m, int mute);
+
+/** Return the time until data written to the member now is played,
+ * which is the latency of the server stream plus the data the member
+ * still has queued. Fails like pa_stream_get_latency(). \since 7.0 */
+int pa_stream_group_member_get_latency(pa_stream_group_member *m, pa_usec_t *r_usec);
+
+PA_C_DECL_END
+
+#endif
@@ -38,6 +38,10 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/pcm-codec.h>
+#include <pulsecore/timing-page.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/semaphore.h>
 
 #include "internal.h"
 #include "stream.h"
@@ -51,6 +55,20 @@
 #define SMOOTHER_HISTORY_TIME (5000*PA_USEC_PER_MSEC)
 #define SMOOTHER_MIN_HISTORY (4)
 
+static bool read_timing_page(pa_stream *s);
+
+/* Called whenever requested_bytes changes */
+static void update_lock_free_granted(pa_stream *s) {
+    if (!s->lock_free_queue)
+        return;
+
+    pa_atomic_store(&s->lock_free_granted, (int) (uint32_t) (PA_MAX(s->requested_bytes, 0) + s->lock_free_drained));
+
+    /* There might be more to render now */
+    if (s->render_semaphore)
+        pa_semaphore_post(s->render_semaphore);
+}
+
 pa_stream *pa_stream_new(pa_context *c, const char *name, const pa_sample_spec *ss, const pa_channel_map *map) {
     return pa_stream_new_with_proplist(c, name, ss, map, NULL);
 }
@@ -176,6 +194,30 @@ static pa_stream *pa_stream_new_with_proplist_internal(
     s->peek_data = NULL;
     s->record_memblockq = NULL;
 
+    s->srbchannel = NULL;
+    s->srb_template.readfd = -1;
+    s->srb_template.writefd = -1;
+    s->srb_template.memblock = NULL;
+    s->srbchannel_requested = false;
+
+    s->timing_page = NULL;
+    s->timing_page_seq = 0;
+    s->timing_page_length = 0;
+
+    s->lock_free_queue = NULL;
+    s->lock_free_event = NULL;
+    s->lock_free_context = NULL;
+    pa_atomic_store(&s->lock_free_granted, 0);
+    pa_atomic_store(&s->lock_free_written, 0);
+    s->lock_free_drained = 0;
+
+    s->render_thread = NULL;
+    s->render_semaphore = NULL;
+    pa_atomic_store(&s->render_quit, 0);
+    s->render_callback = NULL;
+    s->render_userdata = NULL;
+    s->render_rtprio = 0;
+
     memset(&s->timing_info, 0, sizeof(s->timing_info));
     s->timing_info_valid = false;
 
@@ -236,6 +278,41 @@ pa_stream *pa_stream_new_extended(
     return pa_stream_new_with_proplist_internal(c, name, NULL, NULL, formats, n_formats, p);
 }
 
+static void stream_free_srbchannel(pa_stream *s) {
+    pa_assert(s);
+
+    /* The srbchannel owns the file descriptors once created */
+    if (s->srbchannel) {
+        pa_srbchannel_free(s->srbchannel);
+        s->srbchannel = NULL;
+    } else {
+        if (s->srb_template.readfd >= 0)
+            pa_close(s->srb_template.readfd);
+        if (s->srb_template.writefd >= 0)
+            pa_close(s->srb_template.writefd);
+    }
+
+    s->srb_template.readfd = s->srb_template.writefd = -1;
+
+    if (s->srb_template.memblock) {
+        pa_memblock_unref(s->srb_template.memblock);
+        s->srb_template.memblock = NULL;
+    }
+
+    s->srbchannel_requested = false;
+}
+
+static void stream_free_timing_page(pa_stream *s) {
+    pa_assert(s);
+
+    if (s->timing_page) {
+        pa_memblock_unref(s->timing_page);
+        s->timing_page = NULL;
+    }
+
+    s->timing_page_length = 0;
+}
+
 static void stream_unlink(pa_stream *s) {
     pa_operation *o, *n;
     pa_assert(s);
@@ -243,6 +320,9 @@ static void stream_unlink(pa_stream *s) {
     if (!s->context)
         return;
 
+    stream_free_srbchannel(s);
+    stream_free_timing_page(s);
+
     /* Detach from context */
 
     /* Unref all operation objects that point to us */
@@ -258,6 +338,9 @@ static void stream_unlink(pa_stream *s) {
         pa_pdispatch_unregister_reply(s->context->pdispatch, s);
 
     if (s->channel_valid) {
+        if (s->direction == PA_STREAM_PLAYBACK && s->context->pstream)
+            pa_pstream_set_codec(s->context->pstream, s->channel, NULL);
+
         pa_hashmap_remove((s->direction == PA_STREAM_RECORD) ? s->context->record_streams : s->context->playback_streams, PA_UINT32_TO_PTR(s->channel));
         s->channel = 0;
         s->channel_valid = false;
@@ -273,6 +356,26 @@ static void stream_unlink(pa_stream *s) {
         s->mainloop->time_free(s->auto_timing_update_event);
     }
 
+    if (s->render_thread) {
+        pa_atomic_store(&s->render_quit, 1);
+        pa_semaphore_post(s->render_semaphore);
+        pa_thread_free(s->render_thread);
+        s->render_thread = NULL;
+    }
+
+    if (s->render_semaphore) {
+        pa_semaphore_free(s->render_semaphore);
+        s->render_semaphore = NULL;
+    }
+
+    /* The queue itself stays until the stream is freed, since the
+     * writing thread may not have noticed yet */
+    if (s->lock_free_event) {
+        pa_assert(s->mainloop);
+        s->mainloop->io_free(s->lock_free_event);
+        s->lock_free_event = NULL;
+    }
+
     reset_callbacks(s);
 }
 
@@ -310,6 +413,12 @@ static void stream_free(pa_stream *s) {
     if (s->format)
         pa_format_info_free(s->format);
 
+    if (s->lock_free_queue)
+        pa_asyncq_free(s->lock_free_queue, (pa_free_cb_t) pa_memblock_unref);
+
+    if (s->lock_free_context)
+        pa_context_unref(s->lock_free_context);
+
     pa_xfree(s->device_name);
     pa_xfree(s);
 }
@@ -385,13 +494,20 @@ static void request_auto_timing_update(pa_stream *s, bool force) {
         (force || !s->auto_timing_update_requested)) {
         pa_operation *o;
 
+        /* If the server publishes the timing in a shared page there is
+         * no need to ask, unless the write index got lost */
+        if (read_timing_page(s)) {
+            if (s->latency_update_callback)
+                s->latency_update_callback(s, s->latency_update_userdata);
+        } else {
 #ifdef STREAM_DEBUG
-        pa_log_debug("Automatically requesting new timing data");
+            pa_log_debug("Automatically requesting new timing data");
 #endif
 
-        if ((o = pa_stream_update_timing_info(s, NULL, NULL))) {
-            pa_operation_unref(o);
-            s->auto_timing_update_requested = true;
+            if ((o = pa_stream_update_timing_info(s, NULL, NULL))) {
+                pa_operation_unref(o);
+                s->auto_timing_update_requested = true;
+            }
         }
     }
 
@@ -837,6 +953,7 @@ void pa_command_request(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tag
         goto finish;
 
     s->requested_bytes += bytes;
+    update_lock_free_granted(s);
 
 #ifdef STREAM_DEBUG
     pa_log_debug("got request for %lli, now at %lli", (long long) bytes, (long long) s->requested_bytes);
@@ -979,6 +1096,271 @@ static void create_stream_complete(pa_stream *s) {
     check_smoother_status(s, true, false, false);
 }
 
+static bool srbchannel_cb(pa_srbchannel *srb, void *userdata) {
+    pa_stream *s = userdata;
+    size_t frame_size, block_size, l;
+    bool received = false, ret;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(s->srbchannel == srb);
+
+    pa_stream_ref(s);
+
+    frame_size = pa_frame_size(&s->sample_spec);
+    block_size = pa_mempool_block_size_max(s->context->mempool);
+
+    /* The server only writes whole frames, but they may still be on
+     * their way in two halves around the end of the ringbuffer */
+    while ((l = pa_srbchannel_get_readable(srb)) >= frame_size) {
+        pa_memchunk chunk;
+
+        l = PA_MIN(l, block_size);
+        l -= l % frame_size;
+
+        chunk.memblock = pa_memblock_new(s->context->mempool, l);
+        chunk.index = 0;
+        chunk.length = pa_srbchannel_read(srb, pa_memblock_acquire(chunk.memblock), l);
+        pa_memblock_release(chunk.memblock);
+
+        pa_memblockq_push_align(s->record_memblockq, &chunk);
+        pa_memblock_unref(chunk.memblock);
+
+        received = true;
+    }
+
+    if (received && s->read_callback) {
+        if ((l = pa_memblockq_get_length(s->record_memblockq)) > 0)
+            s->read_callback(s, l, s->read_userdata);
+    }
+
+    /* The callback may have disconnected the stream */
+    ret = s->srbchannel == srb;
+    pa_stream_unref(s);
+
+    return ret;
+}
+
+/* Data in the ringbuffer is what the server would otherwise still
+ * have in its queue, so a flush drops it too */
+static void stream_flush_srbchannel(pa_stream *s) {
+    uint8_t buf[4096];
+    size_t frame_size, l;
+
+    pa_assert(s);
+    pa_assert(s->srbchannel);
+
+    frame_size = pa_frame_size(&s->sample_spec);
+
+    /* Whole frames only, see srbchannel_cb() */
+    while ((l = pa_srbchannel_get_readable(s->srbchannel)) >= frame_size) {
+        l = PA_MIN(l, sizeof(buf));
+        l -= l % frame_size;
+
+        pa_srbchannel_read(s->srbchannel, buf, l);
+    }
+}
+
+static void stream_start_srbchannel_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_stream *s = userdata;
+
+    pa_assert(pd);
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    if (!s->context || !s->srbchannel)
+        return;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(s->context, command, t, false) < 0)
+            return;
+
+        /* The data keeps coming the usual way */
+        stream_free_srbchannel(s);
+        return;
+    }
+
+    if (!pa_tagstruct_eof(t)) {
+        pa_context_fail(s->context, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    /* Everything sent over the pstream before has arrived */
+    pa_log_debug("Reading record stream %u from srbchannel.", s->channel);
+    pa_srbchannel_set_callback(s->srbchannel, srbchannel_cb, s);
+}
+
+/* Called once both the file descriptors and the memblock arrived, in
+ * whatever order the socket and the connection's srbchannel delivered
+ * them */
+static void srbchannel_setup_complete(pa_stream *s) {
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    pa_assert(s);
+
+    if (s->srb_template.readfd < 0 || !s->srb_template.memblock)
+        return;
+
+    s->srbchannel = pa_srbchannel_new_from_template(s->mainloop, &s->srb_template);
+    s->srb_template.readfd = s->srb_template.writefd = -1;
+
+    if (!s->srbchannel) {
+        pa_context_fail(s->context, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    pa_srbchannel_set_spin(s->srbchannel, s->context->conf->srbchannel_spin_usec);
+
+    t = pa_tagstruct_command(s->context, PA_COMMAND_START_STREAM_SRBCHANNEL, &tag);
+    pa_tagstruct_putu32(t, s->channel);
+    pa_pstream_send_tagstruct(s->context->pstream, t);
+    pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, stream_start_srbchannel_callback, s, NULL);
+}
+
+void pa_stream_handle_srbchannel_memblock(pa_stream *s, pa_memblock *memblock) {
+    pa_assert(s);
+    pa_assert(s->srbchannel_requested);
+    pa_assert(!s->srb_template.memblock);
+
+    if (!memblock || pa_memblock_is_read_only(memblock) || pa_memblock_is_ours(memblock)) {
+        pa_context_fail(s->context, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    s->srb_template.memblock = memblock;
+    pa_memblock_ref(memblock);
+
+    srbchannel_setup_complete(s);
+}
+
+#ifdef HAVE_CREDS
+static void stream_enable_srbchannel_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_stream *s = userdata;
+    const int *fds;
+    int nfd;
+
+    pa_assert(pd);
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    if (!s->context)
+        return;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(s->context, command, t, false) < 0)
+            return;
+
+        /* The server won't send a memblock either */
+        s->srbchannel_requested = false;
+        return;
+    }
+
+    fds = pa_pdispatch_fds(pd, &nfd);
+    if (nfd != 2 || !fds || fds[0] == -1 || fds[1] == -1 || !pa_tagstruct_eof(t)) {
+        pa_context_fail(s->context, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    s->srb_template.readfd = fds[0];
+    s->srb_template.writefd = fds[1];
+
+    srbchannel_setup_complete(s);
+}
+#endif
+
+/* Asks the server to write the data of a record stream into a ringbuffer
+ * of its own, instead of sending it over the pstream. Only done where
+ * the connection has an srbchannel already, and only if enabled in
+ * client.conf for now. */
+static void request_srbchannel(pa_stream *s) {
+#ifdef HAVE_CREDS
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    pa_assert(s);
+    pa_assert(s->direction == PA_STREAM_RECORD);
+
+    if (!s->context->conf->record_srbchannel || s->context->version < 33 || !s->context->srb_template.memblock)
+        return;
+
+    t = pa_tagstruct_command(s->context, PA_COMMAND_ENABLE_STREAM_SRBCHANNEL, &tag);
+    pa_tagstruct_putu32(t, s->channel);
+    pa_pstream_send_tagstruct(s->context->pstream, t);
+    pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, stream_enable_srbchannel_callback, s, NULL);
+
+    s->srbchannel_requested = true;
+#endif
+}
+
+void pa_stream_handle_timing_page_memblock(pa_stream *s, pa_memblock *memblock) {
+    pa_assert(s);
+    pa_assert(s->timing_page_length > 0);
+    pa_assert(!s->timing_page);
+
+    if (!memblock || pa_memblock_is_ours(memblock) || pa_memblock_get_length(memblock) < s->timing_page_length) {
+        pa_context_fail(s->context, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    s->timing_page_length = 0;
+    s->timing_page = memblock;
+    pa_memblock_ref(memblock);
+    s->timing_page_seq = 0;
+}
+
+static void stream_enable_timing_page_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_stream *s = userdata;
+    uint32_t length;
+
+    pa_assert(pd);
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    if (!s->context)
+        return;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(s->context, command, t, false) < 0)
+            return;
+
+        /* We keep asking for timing updates */
+        return;
+    }
+
+    if (pa_tagstruct_getu32(t, &length) < 0 ||
+        length < sizeof(pa_timing_page) ||
+        !pa_tagstruct_eof(t)) {
+        pa_context_fail(s->context, PA_ERR_PROTOCOL);
+        return;
+    }
+
+    /* The page is the next memblock on our channel */
+    s->timing_page_length = length;
+}
+
+/* Asks the server to publish the timing of a playback stream in shared
+ * memory, so that the automatic timing updates need no round trip. Like
+ * request_srbchannel() only done where the connection has an srbchannel. */
+static void request_timing_page(pa_stream *s) {
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    pa_assert(s);
+    pa_assert(s->direction == PA_STREAM_PLAYBACK);
+
+    if (!(s->flags & PA_STREAM_AUTO_TIMING_UPDATE))
+        return;
+
+    if (s->context->version < 38 || !s->context->srb_template.memblock)
+        return;
+
+    t = pa_tagstruct_command(s->context, PA_COMMAND_ENABLE_STREAM_TIMING_PAGE, &tag);
+    pa_tagstruct_putu32(t, s->channel);
+    pa_pstream_send_tagstruct(s->context->pstream, t);
+    pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, stream_enable_timing_page_callback, s, NULL);
+}
+
 static void patch_buffer_attr(pa_stream *s, pa_buffer_attr *attr, pa_stream_flags_t *flags) {
     const char *e;
 
@@ -1040,6 +1422,7 @@ static void patch_buffer_attr(pa_stream *s, pa_buffer_attr *attr, pa_stream_flag
 void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_stream *s = userdata;
     uint32_t requested_bytes = 0;
+    bool compressed = false;
 
     pa_assert(pd);
     pa_assert(s);
@@ -1065,6 +1448,7 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     }
 
     s->requested_bytes = (int64_t) requested_bytes;
+    update_lock_free_granted(s);
 
     if (s->context->version >= 9) {
         if (s->direction == PA_STREAM_PLAYBACK) {
@@ -1151,11 +1535,23 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
         }
     }
 
+    if (s->context->version >= 36 && s->direction != PA_STREAM_UPLOAD) {
+        if (pa_tagstruct_get_boolean(t, &compressed) < 0 ||
+            (compressed && !pa_pcm_codec_supported(&s->sample_spec))) {
+            pa_context_fail(s->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+    }
+
     if (!pa_tagstruct_eof(t)) {
         pa_context_fail(s->context, PA_ERR_PROTOCOL);
         goto finish;
     }
 
+    /* Record data is decoded by the pstream on its own */
+    if (compressed && s->direction == PA_STREAM_PLAYBACK)
+        pa_pstream_set_codec(s->context->pstream, s->channel, &s->sample_spec);
+
     if (s->direction == PA_STREAM_RECORD) {
         pa_assert(!s->record_memblockq);
 
@@ -1174,6 +1570,11 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     s->channel_valid = true;
     pa_hashmap_put((s->direction == PA_STREAM_RECORD) ? s->context->record_streams : s->context->playback_streams, PA_UINT32_TO_PTR(s->channel), s);
 
+    if (s->direction == PA_STREAM_RECORD)
+        request_srbchannel(s);
+    else if (s->direction == PA_STREAM_PLAYBACK)
+        request_timing_page(s);
+
     create_stream_complete(s);
 
 finish:
@@ -1221,7 +1622,8 @@ static int create_stream(
                                               PA_STREAM_START_UNMUTED|
                                               PA_STREAM_FAIL_ON_SUSPEND|
                                               PA_STREAM_RELATIVE_VOLUME|
-                                              PA_STREAM_PASSTHROUGH)), PA_ERR_INVALID);
+                                              PA_STREAM_PASSTHROUGH|
+                                              PA_STREAM_COMPRESS)), PA_ERR_INVALID);
 
     PA_CHECK_VALIDITY(s->context, s->context->version >= 12 || !(flags & PA_STREAM_VARIABLE_RATE), PA_ERR_NOTSUPPORTED);
     PA_CHECK_VALIDITY(s->context, s->context->version >= 13 || !(flags & PA_STREAM_PEAK_DETECT), PA_ERR_NOTSUPPORTED);
@@ -1380,6 +1782,9 @@ static int create_stream(
         pa_tagstruct_put_boolean(t, flags & (PA_STREAM_PASSTHROUGH));
     }
 
+    if (s->context->version >= 36)
+        pa_tagstruct_put_boolean(t, flags & PA_STREAM_COMPRESS);
+
     pa_pstream_send_tagstruct(s->context->pstream, t);
     pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, pa_create_stream_callback, s, NULL);
 
@@ -1472,6 +1877,49 @@ int pa_stream_cancel_write(
     return 0;
 }
 
+/* Updates the requested bytes and the write index after data has been
+ * sent, or at least queued in the pstream */
+static void stream_account_write(pa_stream *s, int64_t offset, size_t length, pa_seek_mode_t seek) {
+    /* This is obviously wrong since we ignore the seeking index . But
+     * that's OK, the server side applies the same error */
+    s->requested_bytes -= (seek == PA_SEEK_RELATIVE ? offset : 0) + (int64_t) length;
+    update_lock_free_granted(s);
+
+#ifdef STREAM_DEBUG
+    pa_log_debug("wrote %lli, now at %lli", (long long) length, (long long) s->requested_bytes);
+#endif
+
+    if (s->direction == PA_STREAM_PLAYBACK) {
+
+        /* Update latency request correction */
+        if (s->write_index_corrections[s->current_write_index_correction].valid) {
+
+            if (seek == PA_SEEK_ABSOLUTE) {
+                s->write_index_corrections[s->current_write_index_correction].corrupt = false;
+                s->write_index_corrections[s->current_write_index_correction].absolute = true;
+                s->write_index_corrections[s->current_write_index_correction].value = offset + (int64_t) length;
+            } else if (seek == PA_SEEK_RELATIVE) {
+                if (!s->write_index_corrections[s->current_write_index_correction].corrupt)
+                    s->write_index_corrections[s->current_write_index_correction].value += offset + (int64_t) length;
+            } else
+                s->write_index_corrections[s->current_write_index_correction].corrupt = true;
+        }
+
+        /* Update the write index in the already available latency data */
+        if (s->timing_info_valid) {
+
+            if (seek == PA_SEEK_ABSOLUTE) {
+                s->timing_info.write_index_corrupt = false;
+                s->timing_info.write_index = offset + (int64_t) length;
+            } else if (seek == PA_SEEK_RELATIVE) {
+                if (!s->timing_info.write_index_corrupt)
+                    s->timing_info.write_index += offset + (int64_t) length;
+            } else
+                s->timing_info.write_index_corrupt = true;
+        }
+    }
+}
+
 int pa_stream_write_ext_free(
         pa_stream *s,
         const void *data,
@@ -1558,45 +2006,338 @@ int pa_stream_write_ext_free(
             free_cb(free_cb_data);
     }
 
-    /* This is obviously wrong since we ignore the seeking index . But
-     * that's OK, the server side applies the same error */
-    s->requested_bytes -= (seek == PA_SEEK_RELATIVE ? offset : 0) + (int64_t) length;
+    stream_account_write(s, offset, length, seek);
 
-#ifdef STREAM_DEBUG
-    pa_log_debug("wrote %lli, now at %lli", (long long) length, (long long) s->requested_bytes);
-#endif
+    if (s->direction == PA_STREAM_PLAYBACK &&
+        (!s->timing_info_valid || s->timing_info.write_index_corrupt))
+        request_auto_timing_update(s, true);
 
-    if (s->direction == PA_STREAM_PLAYBACK) {
+    return 0;
+}
 
-        /* Update latency request correction */
-        if (s->write_index_corrections[s->current_write_index_correction].valid) {
+static void send_write_block(pa_stream *s, pa_memchunk *block, int64_t offset, pa_seek_mode_t seek) {
+    if (!block->memblock)
+        return;
 
-            if (seek == PA_SEEK_ABSOLUTE) {
-                s->write_index_corrections[s->current_write_index_correction].corrupt = false;
-                s->write_index_corrections[s->current_write_index_correction].absolute = true;
-                s->write_index_corrections[s->current_write_index_correction].value = offset + (int64_t) length;
-            } else if (seek == PA_SEEK_RELATIVE) {
-                if (!s->write_index_corrections[s->current_write_index_correction].corrupt)
-                    s->write_index_corrections[s->current_write_index_correction].value += offset + (int64_t) length;
-            } else
-                s->write_index_corrections[s->current_write_index_correction].corrupt = true;
+    pa_pstream_send_memblock(s->context->pstream, s->channel, offset, seek, block);
+    pa_memblock_unref(block->memblock);
+    pa_memchunk_reset(block);
+}
+
+int pa_stream_writev(pa_stream *s, const pa_stream_write_chunk *chunks, unsigned n_chunks) {
+    pa_memchunk block;
+    int64_t block_offset = 0;
+    pa_seek_mode_t block_seek = PA_SEEK_RELATIVE;
+    size_t block_size;
+    bool shm;
+    unsigned k;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(chunks || n_chunks == 0);
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, !s->write_memblock, PA_ERR_BADSTATE);
+
+    /* Check everything first, so that either all or none of the chunks
+     * are written */
+    for (k = 0; k < n_chunks; k++) {
+        const pa_stream_write_chunk *c = chunks + k;
+
+        PA_CHECK_VALIDITY(s->context, c->data && c->nbytes > 0, PA_ERR_INVALID);
+        PA_CHECK_VALIDITY(s->context, c->seek <= PA_SEEK_RELATIVE_END, PA_ERR_INVALID);
+        PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || (c->seek == PA_SEEK_RELATIVE && c->offset == 0), PA_ERR_INVALID);
+        PA_CHECK_VALIDITY(s->context, c->offset % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
+        PA_CHECK_VALIDITY(s->context, c->nbytes % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
+    }
+
+    shm = pa_pstream_get_shm(s->context->pstream);
+    block_size = pa_mempool_block_size_max(s->context->mempool);
+    pa_memchunk_reset(&block);
+
+    for (k = 0; k < n_chunks; k++) {
+        const pa_stream_write_chunk *c = chunks + k;
+
+        if (c->free_cb && !shm) {
+            pa_memchunk chunk;
+
+            /* Keep the reference instead of copying, as
+             * pa_stream_write_ext_free() does. This needs a frame of
+             * its own. */
+            send_write_block(s, &block, block_offset, block_seek);
+
+            chunk.memblock = pa_memblock_new_user(s->context->mempool, (void*) c->data, c->nbytes, c->free_cb, c->free_cb_data, 1);
+            chunk.index = 0;
+            chunk.length = c->nbytes;
+
+            pa_pstream_send_memblock(s->context->pstream, s->channel, c->offset, c->seek, &chunk);
+            pa_memblock_unref(chunk.memblock);
+
+        } else {
+            const uint8_t *d = c->data;
+            size_t l = c->nbytes;
+            int64_t offset = c->offset;
+            pa_seek_mode_t seek = c->seek;
+
+            /* Chunks that continue right where the previous one ended
+             * are collected into the same memblock, which goes out as
+             * one frame and is pushed into the server's queue in one
+             * go */
+            if (seek != PA_SEEK_RELATIVE || offset != 0)
+                send_write_block(s, &block, block_offset, block_seek);
+
+            while (l > 0) {
+                size_t n;
+                void *p;
+
+                if (!block.memblock) {
+                    block.memblock = pa_memblock_new(s->context->mempool, block_size);
+                    block.index = block.length = 0;
+                    block_offset = offset;
+                    block_seek = seek;
+
+                    offset = 0;
+                    seek = PA_SEEK_RELATIVE;
+                }
+
+                n = PA_MIN(l, block_size - block.length);
+
+                p = pa_memblock_acquire(block.memblock);
+                memcpy((uint8_t*) p + block.length, d, n);
+                pa_memblock_release(block.memblock);
+
+                block.length += n;
+                d += n;
+                l -= n;
+
+                if (block.length >= block_size)
+                    send_write_block(s, &block, block_offset, block_seek);
+            }
+
+            if (c->free_cb)
+                c->free_cb(c->free_cb_data);
         }
 
-        /* Update the write index in the already available latency data */
-        if (s->timing_info_valid) {
+        stream_account_write(s, c->offset, c->nbytes, c->seek);
+    }
 
-            if (seek == PA_SEEK_ABSOLUTE) {
-                s->timing_info.write_index_corrupt = false;
-                s->timing_info.write_index = offset + (int64_t) length;
-            } else if (seek == PA_SEEK_RELATIVE) {
-                if (!s->timing_info.write_index_corrupt)
-                    s->timing_info.write_index += offset + (int64_t) length;
+    send_write_block(s, &block, block_offset, block_seek);
+
+    if (s->direction == PA_STREAM_PLAYBACK &&
+        (!s->timing_info_valid || s->timing_info.write_index_corrupt))
+        request_auto_timing_update(s, true);
+
+    return 0;
+}
+
+static void lock_free_write_cb(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_stream *s = userdata;
+    pa_memblock *b;
+    bool written = false;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(s->lock_free_event == e);
+
+    pa_stream_ref(s);
+
+    pa_asyncq_read_after_poll(s->lock_free_queue);
+
+    for (;;) {
+        while ((b = pa_asyncq_pop(s->lock_free_queue, false))) {
+            pa_memchunk chunk;
+
+            chunk.memblock = b;
+            chunk.index = 0;
+            chunk.length = pa_memblock_get_length(b);
+
+            /* Data that cannot be sent anymore still counts as drained,
+             * to keep the writer's view of the writable size right */
+            s->lock_free_drained += (uint32_t) chunk.length;
+
+            if (s->state == PA_STREAM_READY) {
+                pa_pstream_send_memblock(s->context->pstream, s->channel, 0, PA_SEEK_RELATIVE, &chunk);
+                stream_account_write(s, 0, chunk.length, PA_SEEK_RELATIVE);
+                written = true;
             } else
-                s->timing_info.write_index_corrupt = true;
+                update_lock_free_granted(s);
+
+            pa_memblock_unref(b);
         }
 
-        if (!s->timing_info_valid || s->timing_info.write_index_corrupt)
-            request_auto_timing_update(s, true);
+        if (pa_asyncq_read_before_poll(s->lock_free_queue) == 0)
+            break;
+    }
+
+    if (written && (!s->timing_info_valid || s->timing_info.write_index_corrupt))
+        request_auto_timing_update(s, true);
+
+    pa_stream_unref(s);
+}
+
+int pa_stream_enable_lock_free_write(pa_stream *s) {
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_UNCONNECTED || s->state == PA_STREAM_CREATING || s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, !s->lock_free_queue, PA_ERR_EXIST);
+
+    s->lock_free_queue = pa_asyncq_new(0);
+    s->lock_free_context = pa_context_ref(s->context);
+
+    pa_assert_se(pa_asyncq_read_before_poll(s->lock_free_queue) == 0);
+    pa_assert_se(s->lock_free_event = s->mainloop->io_new(s->mainloop, pa_asyncq_read_fd(s->lock_free_queue), PA_IO_EVENT_INPUT, lock_free_write_cb, s));
+
+    update_lock_free_granted(s);
+
+    return 0;
+}
+
+/* Called from the writing thread, takes over the reference */
+static int lock_free_push(pa_stream *s, pa_memblock *b) {
+    size_t length = pa_memblock_get_length(b);
+
+    if (pa_asyncq_push(s->lock_free_queue, b, false) < 0) {
+        pa_memblock_unref(b);
+        return -PA_ERR_TOOLARGE;
+    }
+
+    pa_atomic_add(&s->lock_free_written, (int) length);
+
+    return 0;
+}
+
+/* Called from any thread, but only one at a time */
+int pa_stream_write_lock_free(pa_stream *s, const void *data, size_t nbytes) {
+    pa_memblock *b;
+    void *d;
+
+    pa_assert(s);
+    pa_assert(data);
+
+    /* The context's error must not be touched from here */
+    if (!s->lock_free_queue)
+        return -PA_ERR_BADSTATE;
+
+    if (nbytes <= 0 ||
+        nbytes % pa_frame_size(&s->sample_spec) != 0 ||
+        nbytes > pa_mempool_block_size_max(s->lock_free_context->mempool))
+        return -PA_ERR_INVALID;
+
+    b = pa_memblock_new(s->lock_free_context->mempool, nbytes);
+
+    d = pa_memblock_acquire(b);
+    memcpy(d, data, nbytes);
+    pa_memblock_release(b);
+
+    return lock_free_push(s, b);
+}
+
+/* Called from any thread, but only one at a time */
+size_t pa_stream_writable_size_lock_free(pa_stream *s) {
+    int32_t l;
+
+    pa_assert(s);
+
+    if (!s->lock_free_queue)
+        return (size_t) -1;
+
+    l = (int32_t) ((uint32_t) pa_atomic_load(&s->lock_free_granted) - (uint32_t) pa_atomic_load(&s->lock_free_written));
+
+    return l > 0 ? (size_t) l : 0;
+}
+
+static void render_thread_func(void *userdata) {
+    pa_stream *s = userdata;
+    size_t fs, block_size;
+
+    pa_assert(s);
+
+    if (s->render_rtprio > 0)
+        pa_make_realtime(s->render_rtprio);
+
+    fs = pa_frame_size(&s->sample_spec);
+    block_size = (pa_mempool_block_size_max(s->lock_free_context->mempool) / fs) * fs;
+
+    for (;;) {
+        size_t l;
+
+        pa_semaphore_wait(s->render_semaphore);
+
+        if (pa_atomic_load(&s->render_quit))
+            break;
+
+        /* The application renders right into the memblocks that are
+         * sent, as with pa_stream_begin_write() */
+        while ((l = (pa_stream_writable_size_lock_free(s) / fs) * fs) > 0) {
+            pa_memblock *b;
+            size_t n;
+            void *d;
+
+            l = PA_MIN(l, block_size);
+            b = pa_memblock_new(s->lock_free_context->mempool, l);
+
+            d = pa_memblock_acquire(b);
+            n = s->render_callback(s, d, l, s->render_userdata);
+            pa_memblock_release(b);
+
+            n = (PA_MIN(n, l) / fs) * fs;
+
+            if (n <= 0) {
+                pa_memblock_unref(b);
+                break;
+            }
+
+            if (n < l) {
+                pa_memblock *t = b;
+
+                /* Don't send what the application left empty */
+                b = pa_memblock_new(s->lock_free_context->mempool, n);
+                memcpy(pa_memblock_acquire(b), pa_memblock_acquire(t), n);
+                pa_memblock_release(t);
+                pa_memblock_release(b);
+                pa_memblock_unref(t);
+            }
+
+            if (lock_free_push(s, b) < 0)
+                break;
+
+            if (n < l)
+                break;
+        }
+    }
+}
+
+int pa_stream_start_render_thread(pa_stream *s, pa_stream_render_cb_t cb, void *userdata, int rtprio) {
+    int r;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, cb, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, !s->render_thread, PA_ERR_EXIST);
+
+    if (!s->lock_free_queue && (r = pa_stream_enable_lock_free_write(s)) < 0)
+        return r;
+
+    s->render_callback = cb;
+    s->render_userdata = userdata;
+    s->render_rtprio = rtprio;
+    pa_atomic_store(&s->render_quit, 0);
+
+    /* Start with one pass, there might be something requested already */
+    s->render_semaphore = pa_semaphore_new(1);
+
+    if (!(s->render_thread = pa_thread_new("pulse-render", render_thread_func, s))) {
+        pa_semaphore_free(s->render_semaphore);
+        s->render_semaphore = NULL;
+        return -pa_context_set_error(s->context, PA_ERR_INTERNAL);
     }
 
     return 0;
@@ -1789,6 +2530,103 @@ static pa_usec_t calc_time(pa_stream *s, bool ignore_transport) {
     return usec;
 }
 
+/* Feeds the timing info into the smoother, u being the local time it was
+ * taken at */
+static void update_smoother(pa_stream *s, pa_usec_t u) {
+    pa_timing_info *i = &s->timing_info;
+    pa_usec_t x = u;
+
+    if (s->direction == PA_STREAM_PLAYBACK && s->context->version >= 13) {
+        pa_usec_t su;
+
+        /* If we weren't playing then it will take some time
+         * until the audio will actually come out through the
+         * speakers. Since we follow that timing here, we need
+         * to try to fix this up */
+
+        su = pa_bytes_to_usec((uint64_t) i->since_underrun, &s->sample_spec);
+
+        if (su < i->sink_usec)
+            x += i->sink_usec - su;
+    }
+
+    if (!i->playing)
+        pa_smoother_pause(s->smoother, x);
+
+    /* Update the smoother */
+    if ((s->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
+        (s->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
+        pa_smoother_put(s->smoother, u, calc_time(s, true));
+
+    if (i->playing)
+        pa_smoother_resume(s->smoother, x, true);
+}
+
+/* Takes the timing info from the shared page, if the server publishes one.
+ * The write index is not in there, we keep it up to date ourselves since
+ * the last timing update. Returns false if a timing update is needed. */
+static bool read_timing_page(pa_stream *s) {
+    pa_timing_info *i = &s->timing_info;
+    pa_timing_page_data d;
+    pa_usec_t now;
+    int seq, r;
+
+    pa_assert(s);
+
+    if (!s->timing_page || !s->timing_info_valid || i->write_index_corrupt)
+        return false;
+
+    r = pa_timing_page_read(pa_memblock_acquire(s->timing_page), &d, &seq);
+    pa_memblock_release(s->timing_page);
+
+    if (r < 0) {
+        pa_log_debug("Timing page busy, asking the server instead.");
+        return false;
+    }
+
+    if (seq == s->timing_page_seq)
+        return true;
+
+    s->timing_page_seq = seq;
+
+    i->sink_usec = (pa_usec_t) d.sink_usec;
+    i->source_usec = 0;
+    i->read_index = d.read_index;
+    i->read_index_corrupt = false;
+    i->playing = !!(d.flags & PA_TIMING_PAGE_PLAYING);
+    i->since_underrun = (int64_t) (i->playing ? d.playing_for : d.underrun_for);
+
+    /* The server's timestamp is from the monotonic clock, which we share
+     * with it: the page is only handed out on local connections */
+    now = pa_rtclock_now();
+    pa_gettimeofday(&i->timestamp);
+    pa_timeval_sub(&i->timestamp, now > d.timestamp ? now - d.timestamp : 0);
+    i->transport_usec = 0;
+    i->synchronized_clocks = true;
+
+    if (s->smoother && !s->corked)
+        update_smoother(s, PA_MIN((pa_usec_t) d.timestamp, now));
+
+    return true;
+}
+
+/* Like read_timing_page(), for where the timing info is about to be
+ * used. If the page can't be read, the info is left as it is and a
+ * timing update is sent for, unless one is on its way already. */
+static void update_from_timing_page(pa_stream *s) {
+    pa_operation *o;
+
+    pa_assert(s);
+
+    if (!s->timing_page || read_timing_page(s) || s->auto_timing_update_requested)
+        return;
+
+    if ((o = pa_stream_update_timing_info(s, NULL, NULL))) {
+        pa_operation_unref(o);
+        s->auto_timing_update_requested = true;
+    }
+}
+
 static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     struct timeval local, remote, now;
@@ -1927,36 +2765,8 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
         }
 
         /* Update smoother if we're not corked */
-        if (o->stream->smoother && !o->stream->corked) {
-            pa_usec_t u, x;
-
-            u = x = pa_rtclock_now() - i->transport_usec;
-
-            if (o->stream->direction == PA_STREAM_PLAYBACK && o->context->version >= 13) {
-                pa_usec_t su;
-
-                /* If we weren't playing then it will take some time
-                 * until the audio will actually come out through the
-                 * speakers. Since we follow that timing here, we need
-                 * to try to fix this up */
-
-                su = pa_bytes_to_usec((uint64_t) i->since_underrun, &o->stream->sample_spec);
-
-                if (su < i->sink_usec)
-                    x += i->sink_usec - su;
-            }
-
-            if (!i->playing)
-                pa_smoother_pause(o->stream->smoother, x);
-
-            /* Update the smoother */
-            if ((o->stream->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
-                (o->stream->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
-                pa_smoother_put(o->stream->smoother, u, calc_time(o->stream, true));
-
-            if (i->playing)
-                pa_smoother_resume(o->stream->smoother, x, true);
-        }
+        if (o->stream->smoother && !o->stream->corked)
+            update_smoother(o->stream, pa_rtclock_now() - i->transport_usec);
     }
 
     o->stream->auto_timing_update_requested = false;
@@ -2299,6 +3109,40 @@ pa_operation* pa_stream_cork(pa_stream *s, int b, pa_stream_success_cb_t cb, voi
     return o;
 }
 
+pa_operation* pa_stream_uncork_at(pa_stream *s, pa_usec_t when, pa_stream_success_cb_t cb, void *userdata) {
+    pa_operation *o;
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->corked, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, when > 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->context->version >= 43, PA_ERR_NOTSUPPORTED);
+
+    request_auto_timing_update(s, true);
+
+    s->corked = false;
+
+    o = pa_operation_new(s->context, s, (pa_operation_cb_t) cb, userdata);
+
+    t = pa_tagstruct_command(s->context, PA_COMMAND_UNCORK_PLAYBACK_STREAM_AT, &tag);
+    pa_tagstruct_putu32(t, s->channel);
+    pa_tagstruct_put_usec(t, when);
+    pa_pstream_send_tagstruct(s->context->pstream, t);
+    pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, pa_stream_simple_ack_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    check_smoother_status(s, false, false, false);
+
+    request_auto_timing_update(s, true);
+
+    return o;
+}
+
 static pa_operation* stream_send_simple_command(pa_stream *s, uint32_t command, pa_stream_success_cb_t cb, void *userdata) {
     pa_tagstruct *t;
     pa_operation *o;
@@ -2350,10 +3194,14 @@ pa_operation* pa_stream_flush(pa_stream *s, pa_stream_success_cb_t cb, void *use
          * read index untouched. */
         invalidate_indexes(s, false, true);
 
-    } else
+    } else {
+        if (s->srbchannel)
+            stream_flush_srbchannel(s);
+
         /* For record streams this has no influence on the write
          * index, but the read index might jump. */
         invalidate_indexes(s, true, false);
+    }
 
     /* Note that we do not update requested_bytes here. This is
      * because we cannot really know how data actually was dropped
@@ -2459,6 +3307,9 @@ int pa_stream_get_time(pa_stream *s, pa_usec_t *r_usec) {
     PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+    update_from_timing_page(s);
+
     PA_CHECK_VALIDITY(s->context, s->timing_info_valid, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_PLAYBACK || !s->timing_info.read_index_corrupt, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_RECORD || !s->timing_info.write_index_corrupt, PA_ERR_NODATA);
@@ -2544,6 +3395,9 @@ const pa_timing_info* pa_stream_get_timing_info(pa_stream *s) {
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+    update_from_timing_page(s);
+
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->timing_info_valid, PA_ERR_NODATA);
 
     return &s->timing_info;
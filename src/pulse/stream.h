@@ -309,6 +309,11 @@
  * been created -- uncork them all with a single call to
  * pa_stream_cork() for the master stream.
  *
+ * Streams on different output devices can't be synchronized like that.
+ * To start them at the same time instead, connect them with
+ * PA_STREAM_START_CORKED, write the first data, and resume them all
+ * with pa_stream_uncork_at() and the same time a little ahead.
+ *
  * To make sure that a particular stream doesn't stop to play when a
  * server side buffer underrun happens on it while the other
  * synchronized streams continue playing and hence deviate, you need to
@@ -340,6 +345,10 @@ typedef void (*pa_stream_success_cb_t) (pa_stream*s, int success, void *userdata
 /** A generic request callback */
 typedef void (*pa_stream_request_cb_t)(pa_stream *p, size_t nbytes, void *userdata);
 
+/** A callback that fills a buffer of \a nbytes with data and returns how
+ * much it filled, see pa_stream_start_render_thread(). \since 7.0 */
+typedef size_t (*pa_stream_render_cb_t)(pa_stream *p, void *data, size_t nbytes, void *userdata);
+
 /** A generic notification callback */
 typedef void (*pa_stream_notify_cb_t)(pa_stream *p, void *userdata);
 
@@ -563,6 +572,67 @@ int pa_stream_write_ext_free(
         int64_t offset           /**< Offset for seeking, must be 0 for upload streams */,
         pa_seek_mode_t seek      /**< Seek mode, must be PA_SEEK_RELATIVE for upload streams */);
 
+/** One chunk of data for pa_stream_writev(). The fields have the same
+ * meaning as the arguments of pa_stream_write_ext_free(). \since 7.0 */
+typedef struct pa_stream_write_chunk {
+    const void *data;        /**< The data to write */
+    size_t nbytes;           /**< The length of the data to write in bytes, must be larger than 0 */
+    pa_free_cb_t free_cb;    /**< A cleanup routine for the data or NULL to request an internal copy */
+    void *free_cb_data;      /**< Argument passed to free_cb function */
+    int64_t offset;          /**< Offset for seeking, must be 0 for upload streams */
+    pa_seek_mode_t seek;     /**< Seek mode, must be PA_SEEK_RELATIVE for upload streams */
+} pa_stream_write_chunk;
+
+/** Write several chunks of data to the server at once, as if
+ * pa_stream_write_ext_free() was called for each of them in order.
+ * Consecutive chunks that are copied and do not seek are sent to the
+ * server together, which makes many small writes much cheaper. Either
+ * all or none of the chunks are written. Cannot be combined with
+ * pa_stream_begin_write(). \since 7.0 */
+int pa_stream_writev(
+        pa_stream *p                         /**< The stream to use */,
+        const pa_stream_write_chunk *chunks  /**< The chunks to write */,
+        unsigned n_chunks                    /**< The number of chunks */);
+
+/** Allow writing to a playback stream from a thread that does not hold
+ * the lock of the threaded mainloop, with
+ * pa_stream_write_lock_free() and pa_stream_writable_size_lock_free().
+ * The data goes through a lock-free queue, which the mainloop thread
+ * empties into the connection, so a real-time audio thread never waits
+ * for the mainloop. Only one thread may use these functions at a time,
+ * and it has to stop before the stream is released with
+ * pa_stream_unref(). Call with the mainloop lock held, before or after
+ * connecting the stream. \since 7.0 */
+int pa_stream_enable_lock_free_write(pa_stream *p);
+
+/** Queue data for writing without taking the mainloop lock. The data is
+ * always copied. At most one memory block may be written per call, 64
+ * KiB by default. Does not set the context's error, but returns the
+ * negated error code on failure, e.g. -PA_ERR_TOOLARGE if the queue is
+ * full. \since 7.0 */
+int pa_stream_write_lock_free(pa_stream *p, const void *data, size_t nbytes);
+
+/** Return the number of bytes that may be written with
+ * pa_stream_write_lock_free(), without taking the mainloop lock. Returns
+ * (size_t) -1 if pa_stream_enable_lock_free_write() was not
+ * called. \since 7.0 */
+size_t pa_stream_writable_size_lock_free(pa_stream *p);
+
+/** Start a thread that renders the data of a playback stream, in the
+ * way of a pull model. Whenever the server asks for data, the thread
+ * calls \a cb with a buffer to fill, which is then sent as it is, like
+ * with pa_stream_begin_write(). The callback returns how much it
+ * filled, which may be less than it was offered if it has nothing more
+ * right now. If \a rtprio is larger than 0 the thread asks for real-time
+ * scheduling with that priority, through RealtimeKit where available.
+ *
+ * The thread uses the lock-free write path of
+ * pa_stream_enable_lock_free_write(), and lives until the stream is
+ * disconnected or fails. The callback must not take the lock of a
+ * threaded mainloop, since the thread is stopped with the lock held.
+ * Call with the mainloop lock held. \since 7.0 */
+int pa_stream_start_render_thread(pa_stream *p, pa_stream_render_cb_t cb, void *userdata, int rtprio);
+
 /** Read the next fragment from the buffer (for recording streams).
  * If there is data at the current read index, \a data will point to
  * the actual data and \a nbytes will contain the size of the data in
@@ -680,6 +750,15 @@ void pa_stream_set_buffer_attr_callback(pa_stream *p, pa_stream_notify_cb_t cb,
  * the stream, it will be created in corked state. */
 pa_operation* pa_stream_cork(pa_stream *s, int b, pa_stream_success_cb_t cb, void *userdata);
 
+/** Resume a corked playback stream such that its next sample plays at \a
+ * when, which is a time of the server's monotonic clock. For a local
+ * server that is the clock pa_rtclock_now() reads. Until then the stream
+ * plays silence. Streams on different sinks that are resumed with the same
+ * time start sample-accurately together, as far as the latency the sinks
+ * report is exact. The data to start with should be written before. See
+ * \ref sync_streams. \since 7.0 */
+pa_operation* pa_stream_uncork_at(pa_stream *s, pa_usec_t when, pa_stream_success_cb_t cb, void *userdata);
+
 /** Flush the playback or record buffer of this stream. This discards any audio data
  * in the buffer.  Most of the time you're better off using the parameter
  * \a seek of pa_stream_write() instead of this function. */
@@ -32,6 +32,7 @@
 void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_context *c = userdata;
     pa_subscription_event_type_t e;
+    pa_subscription_delta delta, *d = NULL;
     uint32_t idx;
 
     pa_assert(pd);
@@ -43,20 +44,41 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
     pa_context_ref(c);
 
     if (pa_tagstruct_getu32(t, &e) < 0 ||
-        pa_tagstruct_getu32(t, &idx) < 0 ||
-        !pa_tagstruct_eof(t)) {
+        pa_tagstruct_getu32(t, &idx) < 0) {
         pa_context_fail(c, PA_ERR_PROTOCOL);
         goto finish;
     }
 
-    if (c->subscribe_callback)
+    if (!pa_tagstruct_eof(t)) {
+        bool mute = false;
+
+        pa_zero(delta);
+        d = &delta;
+
+        if (c->version < 35 ||
+            pa_tagstruct_getu32(t, &delta.changed) < 0 ||
+            ((delta.changed & PA_SUBSCRIPTION_DELTA_VOLUME) && pa_tagstruct_get_cvolume(t, &delta.volume) < 0) ||
+            ((delta.changed & PA_SUBSCRIPTION_DELTA_MUTE) && pa_tagstruct_get_boolean(t, &mute) < 0) ||
+            ((delta.changed & PA_SUBSCRIPTION_DELTA_STATE) && pa_tagstruct_getu32(t, &delta.state) < 0) ||
+            ((delta.changed & PA_SUBSCRIPTION_DELTA_LATENCY) && pa_tagstruct_get_usec(t, &delta.latency) < 0) ||
+            !pa_tagstruct_eof(t)) {
+            pa_context_fail(c, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        delta.mute = (int) mute;
+    }
+
+    if (c->subscribe_delta_callback)
+        c->subscribe_delta_callback(c, e, idx, d, c->subscribe_delta_userdata);
+    else if (c->subscribe_callback)
         c->subscribe_callback(c, e, idx, c->subscribe_userdata);
 
 finish:
     pa_context_unref(c);
 }
 
-pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+static pa_operation* subscribe(pa_context *c, pa_subscription_mask_t m, bool deltas, pa_context_success_cb_t cb, void *userdata) {
     pa_operation *o;
     pa_tagstruct *t;
     uint32_t tag;
@@ -65,17 +87,28 @@ pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_c
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
 
     PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !deltas || c->version >= 35, PA_ERR_NOTSUPPORTED);
 
     o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
 
     t = pa_tagstruct_command(c, PA_COMMAND_SUBSCRIBE, &tag);
     pa_tagstruct_putu32(t, m);
+    if (c->version >= 35)
+        pa_tagstruct_put_boolean(t, deltas);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, pa_context_simple_ack_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
     return o;
 }
 
+pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    return subscribe(c, m, false, cb, userdata);
+}
+
+pa_operation* pa_context_subscribe_with_deltas(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    return subscribe(c, m, true, cb, userdata);
+}
+
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata) {
     pa_assert(c);
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
@@ -86,3 +119,14 @@ void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t
     c->subscribe_callback = cb;
     c->subscribe_userdata = userdata;
 }
+
+void pa_context_set_subscribe_delta_callback(pa_context *c, pa_context_subscribe_delta_cb_t cb, void *userdata) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    if (c->state == PA_CONTEXT_TERMINATED || c->state == PA_CONTEXT_FAILED)
+        return;
+
+    c->subscribe_delta_callback = cb;
+    c->subscribe_delta_userdata = userdata;
+}
@@ -25,6 +25,7 @@
 
 #include <pulse/def.h>
 #include <pulse/context.h>
+#include <pulse/volume.h>
 #include <pulse/cdecl.h>
 #include <pulse/version.h>
 
@@ -78,6 +79,43 @@ pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_c
 /** Set the context specific call back function that is called whenever the state of the daemon changes */
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata);
 
+/** Fields in a pa_subscription_delta. \since 7.0 */
+typedef enum pa_subscription_delta_mask {
+    PA_SUBSCRIPTION_DELTA_VOLUME = 0x0001U,  /**< volume */
+    PA_SUBSCRIPTION_DELTA_MUTE = 0x0002U,    /**< mute */
+    PA_SUBSCRIPTION_DELTA_STATE = 0x0004U,   /**< state */
+    PA_SUBSCRIPTION_DELTA_LATENCY = 0x0008U  /**< latency */
+} pa_subscription_delta_mask_t;
+
+/** What changed about a sink, source, sink input or source output,
+ * delivered with its change events when subscribed with
+ * pa_context_subscribe_with_deltas(). \since 7.0 */
+typedef struct pa_subscription_delta {
+    pa_subscription_delta_mask_t changed; /**< The fields that changed since the previous event for the object. Only these are set. */
+    pa_cvolume volume;                    /**< Volume */
+    int mute;                             /**< Mute switch */
+    uint32_t state;                       /**< For sinks and sources a pa_sink_state_t or pa_source_state_t, for streams 1 if corked, 0 otherwise */
+    pa_usec_t latency;                    /**< Latency of the device, for streams including their buffered data */
+} pa_subscription_delta;
+
+/** Subscription event callback prototype with deltas. delta is NULL for
+ * events that carry none, i.e. anything but change events of sinks,
+ * sources, sink inputs and source outputs. \since 7.0 */
+typedef void (*pa_context_subscribe_delta_cb_t)(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, const pa_subscription_delta *delta, void *userdata);
+
+/** Enable event notification like pa_context_subscribe(), with change
+ * events that carry the changed volume, mute, state and latency of the
+ * object, so that no introspection request is needed to find out. The
+ * server coalesces the changes of one main loop iteration into one
+ * event. Needs a server with protocol version 35, otherwise the call
+ * fails with PA_ERR_NOTSUPPORTED. \since 7.0 */
+pa_operation* pa_context_subscribe_with_deltas(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata);
+
+/** Set the call back function that gets the subscription events with
+ * their deltas. If set, it is called instead of the one set with
+ * pa_context_set_subscribe_callback(). \since 7.0 */
+void pa_context_set_subscribe_delta_callback(pa_context *c, pa_context_subscribe_delta_cb_t cb, void *userdata);
+
 PA_C_DECL_END
 
 #endif
@@ -198,20 +198,17 @@ pa_volume_t pa_cvolume_min_mask(const pa_cvolume *a, const pa_channel_map *cm, p
     return m;
 }
 
-pa_volume_t pa_sw_volume_multiply(pa_volume_t a, pa_volume_t b) {
-
-    pa_return_val_if_fail(PA_VOLUME_IS_VALID(a), PA_VOLUME_INVALID);
-    pa_return_val_if_fail(PA_VOLUME_IS_VALID(b), PA_VOLUME_INVALID);
+/* The unchecked versions of pa_sw_volume_multiply() and
+ * pa_sw_volume_divide(), for the cvolume functions, which validate their
+ * arguments once for all channels */
+static inline pa_volume_t volume_multiply(pa_volume_t a, pa_volume_t b) {
 
     /* cbrt((a/PA_VOLUME_NORM)^3*(b/PA_VOLUME_NORM)^3)*PA_VOLUME_NORM = a*b/PA_VOLUME_NORM */
 
     return (pa_volume_t) PA_CLAMP_VOLUME((((uint64_t) a * (uint64_t) b + (uint64_t) PA_VOLUME_NORM / 2ULL) / (uint64_t) PA_VOLUME_NORM));
 }
 
-pa_volume_t pa_sw_volume_divide(pa_volume_t a, pa_volume_t b) {
-
-    pa_return_val_if_fail(PA_VOLUME_IS_VALID(a), PA_VOLUME_INVALID);
-    pa_return_val_if_fail(PA_VOLUME_IS_VALID(b), PA_VOLUME_INVALID);
+static inline pa_volume_t volume_divide(pa_volume_t a, pa_volume_t b) {
 
     if (b <= PA_VOLUME_MUTED)
         return 0;
@@ -219,20 +216,31 @@ pa_volume_t pa_sw_volume_divide(pa_volume_t a, pa_volume_t b) {
     return (pa_volume_t) (((uint64_t) a * (uint64_t) PA_VOLUME_NORM + (uint64_t) b / 2ULL) / (uint64_t) b);
 }
 
-/* Amplitude, not power */
-static double linear_to_dB(double v) {
-    return 20.0 * log10(v);
+pa_volume_t pa_sw_volume_multiply(pa_volume_t a, pa_volume_t b) {
+
+    pa_return_val_if_fail(PA_VOLUME_IS_VALID(a), PA_VOLUME_INVALID);
+    pa_return_val_if_fail(PA_VOLUME_IS_VALID(b), PA_VOLUME_INVALID);
+
+    return volume_multiply(a, b);
 }
 
-static double dB_to_linear(double v) {
-    return pow(10.0, v / 20.0);
+pa_volume_t pa_sw_volume_divide(pa_volume_t a, pa_volume_t b) {
+
+    pa_return_val_if_fail(PA_VOLUME_IS_VALID(a), PA_VOLUME_INVALID);
+    pa_return_val_if_fail(PA_VOLUME_IS_VALID(b), PA_VOLUME_INVALID);
+
+    return volume_divide(a, b);
 }
 
+/* Because of the cubic mapping (see pa_sw_volume_from_linear()) the volume
+ * is (10^(dB/20))^(1/3) * PA_VOLUME_NORM = 10^(dB/60) * PA_VOLUME_NORM, and
+ * vice versa, which saves a cbrt() in one direction and the cubing in the
+ * other. Amplitude, not power. */
 pa_volume_t pa_sw_volume_from_dB(double dB) {
     if (isinf(dB) < 0 || dB <= PA_DECIBEL_MININFTY)
         return PA_VOLUME_MUTED;
 
-    return pa_sw_volume_from_linear(dB_to_linear(dB));
+    return (pa_volume_t) PA_CLAMP_VOLUME((uint64_t) lround(pow(10.0, dB / 60.0) * PA_VOLUME_NORM));
 }
 
 double pa_sw_volume_to_dB(pa_volume_t v) {
@@ -242,7 +250,7 @@ double pa_sw_volume_to_dB(pa_volume_t v) {
     if (v <= PA_VOLUME_MUTED)
         return PA_DECIBEL_MININFTY;
 
-    return linear_to_dB(pa_sw_volume_to_linear(v));
+    return 60.0 * log10((double) v / PA_VOLUME_NORM);
 }
 
 pa_volume_t pa_sw_volume_from_linear(double v) {
@@ -466,7 +474,7 @@ pa_cvolume *pa_sw_cvolume_multiply(pa_cvolume *dest, const pa_cvolume *a, const
     pa_return_val_if_fail(pa_cvolume_valid(b), NULL);
 
     for (i = 0; i < a->channels && i < b->channels; i++)
-        dest->values[i] = pa_sw_volume_multiply(a->values[i], b->values[i]);
+        dest->values[i] = volume_multiply(a->values[i], b->values[i]);
 
     dest->channels = (uint8_t) i;
 
@@ -483,7 +491,7 @@ pa_cvolume *pa_sw_cvolume_multiply_scalar(pa_cvolume *dest, const pa_cvolume *a,
     pa_return_val_if_fail(PA_VOLUME_IS_VALID(b), NULL);
 
     for (i = 0; i < a->channels; i++)
-        dest->values[i] = pa_sw_volume_multiply(a->values[i], b);
+        dest->values[i] = volume_multiply(a->values[i], b);
 
     dest->channels = (uint8_t) i;
 
@@ -501,7 +509,7 @@ pa_cvolume *pa_sw_cvolume_divide(pa_cvolume *dest, const pa_cvolume *a, const pa
     pa_return_val_if_fail(pa_cvolume_valid(b), NULL);
 
     for (i = 0; i < a->channels && i < b->channels; i++)
-        dest->values[i] = pa_sw_volume_divide(a->values[i], b->values[i]);
+        dest->values[i] = volume_divide(a->values[i], b->values[i]);
 
     dest->channels = (uint8_t) i;
 
@@ -518,7 +526,7 @@ pa_cvolume *pa_sw_cvolume_divide_scalar(pa_cvolume *dest, const pa_cvolume *a, p
     pa_return_val_if_fail(PA_VOLUME_IS_VALID(b), NULL);
 
     for (i = 0; i < a->channels; i++)
-        dest->values[i] = pa_sw_volume_divide(a->values[i], b);
+        dest->values[i] = volume_divide(a->values[i], b);
 
     dest->channels = (uint8_t) i;
 
@@ -30,12 +30,19 @@
 #include <pulse/gccmacro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/xmalloc-stats.h>
 
 #include "xmalloc.h"
 
 /* Make sure not to allocate more than this much memory. */
 #define MAX_ALLOC_SIZE (1024*1024*96) /* 96MB */
 
+#ifdef XMALLOC_STATS
+#define COUNT(counter) pa_atomic_inc(&pa_xmalloc_stats.counter)
+#else
+#define COUNT(counter) do { } while (false)
+#endif
+
 /* #undef malloc */
 /* #undef free */
 /* #undef realloc */
@@ -63,6 +70,7 @@ void* pa_xmalloc(size_t size) {
     if (!(p = malloc(size)))
         oom();
 
+    COUNT(n_allocs);
     return p;
 }
 
@@ -74,6 +82,7 @@ void* pa_xmalloc0(size_t size) {
     if (!(p = calloc(1, size)))
         oom();
 
+    COUNT(n_allocs);
     return p;
 }
 
@@ -84,6 +93,8 @@ void *pa_xrealloc(void *ptr, size_t size) {
 
     if (!(p = realloc(ptr, size)))
         oom();
+
+    COUNT(n_reallocs);
     return p;
 }
 
@@ -128,4 +139,6 @@ void pa_xfree(void *p) {
     saved_errno = errno;
     free(p);
     errno = saved_errno;
+
+    COUNT(n_frees);
 }
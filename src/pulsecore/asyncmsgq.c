@@ -29,12 +29,15 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/log.h>
 #include <pulsecore/semaphore.h>
-#include <pulsecore/macro.h>
-#include <pulsecore/mutex.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/flist.h>
 
 #include "asyncmsgq.h"
 
+/* Bursts beyond the initial size grow the queue up to this size rather
+ * than piling up in the local queue of the writer */
+#define ASYNCMSGQ_MAX_SIZE 4096
+
 PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
 PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
 
@@ -46,13 +49,34 @@ struct asyncmsgq_item {
     int64_t offset;
     pa_memchunk memchunk;
     pa_semaphore *semaphore;
+    pa_asyncmsgq_done_cb_t done_cb;
+    void *done_userdata;
     int ret;
+
+    struct asyncmsgq_item *next;
 };
 
+/* Carries the messages of pa_asyncmsgq_send_many() for one queue */
+typedef struct asyncmsgq_batch {
+    pa_msgobject parent;
+    pa_asyncmsgq *q;
+    pa_asyncmsgq_batch_item **items;
+    unsigned n_items;
+    pa_semaphore *semaphore;
+} asyncmsgq_batch;
+
+PA_DEFINE_PRIVATE_CLASS(asyncmsgq_batch, pa_msgobject);
+#define ASYNCMSGQ_BATCH(o) (asyncmsgq_batch_cast(o))
+
 struct pa_asyncmsgq {
     PA_REFCNT_DECLARE;
     pa_asyncq *asyncq;
-    pa_mutex *mutex; /* only for the writer side */
+
+    /* Writers push their items on this stack. Whoever finds the
+     * flushing flag unset moves the stack into the asyncq, which thus
+     * keeps having only one writer at a time. */
+    pa_atomic_ptr_t pending;
+    pa_atomic_t flushing;
 
     struct asyncmsgq_item *current;
 };
@@ -63,8 +87,9 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     a = pa_xnew(pa_asyncmsgq, 1);
 
     PA_REFCNT_INIT(a);
-    pa_assert_se(a->asyncq = pa_asyncq_new(size));
-    pa_assert_se(a->mutex = pa_mutex_new(false, true));
+    pa_assert_se(a->asyncq = pa_asyncq_new_full(size, ASYNCMSGQ_MAX_SIZE));
+    pa_atomic_ptr_store(&a->pending, NULL);
+    pa_atomic_store(&a->flushing, 0);
     a->current = NULL;
 
     return a;
@@ -73,11 +98,15 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
 static void asyncmsgq_free(pa_asyncmsgq *a) {
     struct asyncmsgq_item *i;
     pa_assert(a);
+    pa_assert(!pa_atomic_ptr_load(&a->pending));
 
     while ((i = pa_asyncq_pop(a->asyncq, false))) {
 
         pa_assert(!i->semaphore);
 
+        if (i->done_cb)
+            i->done_cb(-1, i->done_userdata);
+
         if (i->object)
             pa_msgobject_unref(i->object);
 
@@ -92,7 +121,6 @@ static void asyncmsgq_free(pa_asyncmsgq *a) {
     }
 
     pa_asyncq_free(a->asyncq, NULL);
-    pa_mutex_free(a->mutex);
     pa_xfree(a);
 }
 
@@ -110,7 +138,59 @@ void pa_asyncmsgq_unref(pa_asyncmsgq* q) {
         asyncmsgq_free(q);
 }
 
+/* Lock-free for the writers: nobody waits for another writer, the one
+ * that is flushing just picks up what the others pushed meanwhile.
+ * Posted items are queued locally while the queue is full. For items
+ * of _send() the flushing writer waits for room instead, as somebody
+ * is blocked on them. */
+static void enqueue(pa_asyncmsgq *a, struct asyncmsgq_item *i) {
+    struct asyncmsgq_item *head;
+
+    do {
+        head = pa_atomic_ptr_load(&a->pending);
+        i->next = head;
+    } while (!pa_atomic_ptr_cmpxchg(&a->pending, head, i));
+
+    while (pa_atomic_cmpxchg(&a->flushing, 0, 1)) {
+        struct asyncmsgq_item *list = NULL, *n;
+
+        do {
+            head = pa_atomic_ptr_load(&a->pending);
+        } while (!pa_atomic_ptr_cmpxchg(&a->pending, head, NULL));
+
+        /* The stack is newest first */
+        for (; head; head = n) {
+            n = head->next;
+            head->next = list;
+            list = head;
+        }
+
+        for (; list; list = n) {
+            /* The reader may reuse the item as soon as it has it */
+            n = list->next;
+
+            if (list->semaphore)
+                pa_assert_se(pa_asyncq_push(a->asyncq, list, true) == 0);
+            else
+                pa_asyncq_post(a->asyncq, list);
+        }
+
+        pa_atomic_store(&a->flushing, 0);
+
+        /* Somebody might have pushed and left while we were flushing */
+        if (!pa_atomic_ptr_load(&a->pending))
+            break;
+    }
+}
+
 void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+
+    pa_asyncmsgq_send_async(a, object, code, userdata, offset, chunk, free_cb, NULL, NULL);
+}
+
+void pa_asyncmsgq_send_async(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb,
+                             pa_asyncmsgq_done_cb_t done_cb, void *done_userdata) {
     struct asyncmsgq_item *i;
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
@@ -129,11 +209,10 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     } else
         pa_memchunk_reset(&i->memchunk);
     i->semaphore = NULL;
+    i->done_cb = done_cb;
+    i->done_userdata = done_userdata;
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_asyncq_post(a->asyncq, i);
-    pa_mutex_unlock(a->mutex);
+    enqueue(a, i);
 }
 
 int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk) {
@@ -144,6 +223,7 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     i.object = object;
     i.userdata = (void*) userdata;
     i.free_cb = NULL;
+    i.done_cb = NULL;
     i.ret = -1;
     i.offset = offset;
     if (chunk) {
@@ -155,10 +235,7 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     if (!(i.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
         i.semaphore = pa_semaphore_new(0);
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_assert_se(pa_asyncq_push(a->asyncq, &i, true) == 0);
-    pa_mutex_unlock(a->mutex);
+    enqueue(a, &i);
 
     pa_semaphore_wait(i.semaphore);
 
@@ -168,6 +245,92 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     return i.ret;
 }
 
+/* Called from the reading thread */
+static int batch_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    asyncmsgq_batch *b = ASYNCMSGQ_BATCH(o);
+    unsigned k;
+
+    for (k = 0; k < b->n_items; k++) {
+        pa_asyncmsgq_batch_item *i = b->items[k];
+
+        i->ret = i->object ? i->object->process_msg(i->object, i->code, i->userdata, i->offset, NULL) : 0;
+    }
+
+    return 0;
+}
+
+/* Called from the reading thread */
+static void batch_done(int ret, void *userdata) {
+    asyncmsgq_batch *b = userdata;
+
+    pa_semaphore_post(b->semaphore);
+}
+
+static void batch_free(pa_object *o) {
+    asyncmsgq_batch *b = ASYNCMSGQ_BATCH(o);
+
+    pa_xfree(b->items);
+    pa_xfree(b);
+}
+
+void pa_asyncmsgq_send_many(pa_asyncmsgq_batch_item *items, unsigned n) {
+    asyncmsgq_batch **batches;
+    pa_semaphore *semaphore;
+    unsigned k, j, n_batches = 0;
+
+    pa_assert(items || n == 0);
+
+    if (n == 0)
+        return;
+
+    batches = pa_xnew(asyncmsgq_batch*, n);
+
+    for (k = 0; k < n; k++) {
+        pa_assert(PA_REFCNT_VALUE(items[k].q) > 0);
+
+        /* Stays like that if the queue drops the message */
+        items[k].ret = -1;
+
+        for (j = 0; j < n_batches; j++)
+            if (batches[j]->q == items[k].q)
+                break;
+
+        if (j >= n_batches) {
+            asyncmsgq_batch *b;
+
+            b = pa_msgobject_new(asyncmsgq_batch);
+            b->parent.parent.free = batch_free;
+            b->parent.process_msg = batch_process_msg;
+            b->q = items[k].q;
+            b->items = pa_xnew(pa_asyncmsgq_batch_item*, n - k);
+            b->n_items = 0;
+            batches[n_batches++] = b;
+        }
+
+        batches[j]->items[batches[j]->n_items++] = &items[k];
+    }
+
+    if (!(semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
+        semaphore = pa_semaphore_new(0);
+
+    /* Wake everybody up before waiting for anybody */
+    for (j = 0; j < n_batches; j++) {
+        batches[j]->semaphore = semaphore;
+        pa_asyncmsgq_send_async(batches[j]->q, PA_MSGOBJECT(batches[j]), 0, NULL, 0, NULL, NULL, batch_done, batches[j]);
+    }
+
+    for (j = 0; j < n_batches; j++)
+        pa_semaphore_wait(semaphore);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(semaphores), semaphore) < 0)
+        pa_semaphore_free(semaphore);
+
+    for (j = 0; j < n_batches; j++)
+        pa_msgobject_unref(PA_MSGOBJECT(batches[j]));
+
+    pa_xfree(batches);
+}
+
 int pa_asyncmsgq_get(pa_asyncmsgq *a, pa_msgobject **object, int *code, void **userdata, int64_t *offset, pa_memchunk *chunk, bool wait_op) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
     pa_assert(!a->current);
@@ -213,6 +376,9 @@ void pa_asyncmsgq_done(pa_asyncmsgq *a, int ret) {
         pa_semaphore_post(a->current->semaphore);
     } else {
 
+        if (a->current->done_cb)
+            a->current->done_cb(ret, a->current->done_userdata);
+
         if (a->current->free_cb)
             a->current->free_cb(a->current->userdata);
 
@@ -30,9 +30,9 @@
  * contrast to pa_asyncq this one is multiple-writer safe, though
  * still not multiple-reader safe. This queue is intended to be used
  * for controlling real-time threads from normal-priority
- * threads. Multiple-writer-safety is accomplished by using a mutex on
- * the writer side. This queue is thus not useful for communication
- * between several real-time threads.
+ * threads. Multiple-writer-safety is accomplished by collecting the
+ * messages on a lock-free stack which one writer at a time moves into
+ * the pa_asyncq, so no writer ever waits for another one.
  *
  * The queue takes messages consisting of:
  *    "Object" for which this messages is intended (may be NULL)
@@ -40,9 +40,17 @@
  *    Arbitrary userdata pointer (may be NULL)
  *    A memchunk (may be NULL)
  *
- * There are two functions for submitting messages: _post and
- * _send. The former just enqueues the message asynchronously, the
- * latter waits for completion, synchronously. */
+ * There are three functions for submitting messages: _post, _send
+ * and _send_async. The first just enqueues the message
+ * asynchronously, the second waits for completion, synchronously. The
+ * last one enqueues the message like _post, and calls a callback
+ * with the result once the message has been processed.
+ *
+ * _send_many() is like _send for a set of messages, possibly for
+ * different queues: the messages for the same queue are delivered to
+ * it as one message and processed in order, and all queues are woken
+ * up before waiting for any of them, so the cost is one round trip
+ * for the slowest reader instead of one for every message. */
 
 enum {
     PA_MESSAGE_SHUTDOWN = -1/* A generic message to inform the handler of this queue to quit */
@@ -50,6 +58,23 @@ enum {
 
 typedef struct pa_asyncmsgq pa_asyncmsgq;
 
+/* Called from the reading thread, with the return value of the
+ * message handler, or -1 if the message was dropped unprocessed */
+typedef void (*pa_asyncmsgq_done_cb_t)(int ret, void *userdata);
+
+/* One message for pa_asyncmsgq_send_many(). The object may be reset
+ * to NULL as long as the batch is not sent, to drop the message. */
+typedef struct pa_asyncmsgq_batch_item {
+    pa_asyncmsgq *q;
+    pa_msgobject *object;
+    int code;
+    void *userdata;
+    int64_t offset;
+
+    /* Return value of the handler, filled in by _send_many() */
+    int ret;
+} pa_asyncmsgq_batch_item;
+
 pa_asyncmsgq* pa_asyncmsgq_new(unsigned size);
 pa_asyncmsgq* pa_asyncmsgq_ref(pa_asyncmsgq *q);
 
@@ -57,6 +82,9 @@ void pa_asyncmsgq_unref(pa_asyncmsgq* q);
 
 void pa_asyncmsgq_post(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk, pa_free_cb_t userdata_free_cb);
 int pa_asyncmsgq_send(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk);
+void pa_asyncmsgq_send_async(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk, pa_free_cb_t userdata_free_cb,
+                             pa_asyncmsgq_done_cb_t done_cb, void *done_userdata);
+void pa_asyncmsgq_send_many(pa_asyncmsgq_batch_item *items, unsigned n);
 
 int pa_asyncmsgq_get(pa_asyncmsgq *q, pa_msgobject **object, int *code, void **userdata, int64_t *offset, pa_memchunk *memchunk, bool wait);
 int pa_asyncmsgq_dispatch(pa_msgobject *object, int code, void *userdata, int64_t offset, pa_memchunk *memchunk);
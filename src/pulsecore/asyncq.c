@@ -55,12 +55,24 @@ struct localq {
     PA_LLIST_FIELDS(struct localq);
 };
 
-struct pa_asyncq {
+/* When the writer finds its segment full it may link a new, larger one
+ * and continue there. The reader moves on to the next segment once it
+ * has emptied its current one, and frees it. */
+struct segment {
     unsigned size;
+    pa_atomic_ptr_t next;
+};
+
+struct pa_asyncq {
+    unsigned max_size;
     unsigned read_idx;
     unsigned write_idx;
     pa_fdsem *read_fdsem, *write_fdsem;
 
+    struct segment *read_segment, *write_segment;
+    pa_atomic_t total_size;
+    pa_atomic_t overflows;
+
     PA_LLIST_HEAD(struct localq, localq);
     struct localq *last_localq;
     bool waiting_for_post;
@@ -68,13 +80,27 @@ struct pa_asyncq {
 
 PA_STATIC_FLIST_DECLARE(localq, 0, pa_xfree);
 
-#define PA_ASYNCQ_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct pa_asyncq))))
+#define PA_SEGMENT_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct segment))))
+
+static unsigned reduce(struct segment *s, unsigned value) {
+    return value & (unsigned) (s->size - 1);
+}
+
+static struct segment *segment_new(unsigned size) {
+    struct segment *s;
+
+    s = pa_xmalloc0(PA_ALIGN(sizeof(struct segment)) + (sizeof(pa_atomic_ptr_t) * size));
+    s->size = size;
+    pa_atomic_ptr_store(&s->next, NULL);
 
-static unsigned reduce(pa_asyncq *l, unsigned value) {
-    return value & (unsigned) (l->size - 1);
+    return s;
 }
 
 pa_asyncq *pa_asyncq_new(unsigned size) {
+    return pa_asyncq_new_full(size, 0);
+}
+
+pa_asyncq *pa_asyncq_new_full(unsigned size, unsigned max_size) {
     pa_asyncq *l;
 
     if (!size)
@@ -82,21 +108,26 @@ pa_asyncq *pa_asyncq_new(unsigned size) {
 
     pa_assert(pa_is_power_of_two(size));
 
-    l = pa_xmalloc0(PA_ALIGN(sizeof(pa_asyncq)) + (sizeof(pa_atomic_ptr_t) * size));
+    l = pa_xnew0(pa_asyncq, 1);
 
-    l->size = size;
+    l->max_size = PA_MAX(size, max_size);
+    l->read_segment = l->write_segment = segment_new(size);
+    pa_atomic_store(&l->total_size, (int) size);
+    pa_atomic_store(&l->overflows, 0);
 
     PA_LLIST_HEAD_INIT(struct localq, l->localq);
     l->last_localq = NULL;
     l->waiting_for_post = false;
 
     if (!(l->read_fdsem = pa_fdsem_new())) {
+        pa_xfree(l->read_segment);
         pa_xfree(l);
         return NULL;
     }
 
     if (!(l->write_fdsem = pa_fdsem_new())) {
         pa_fdsem_free(l->read_fdsem);
+        pa_xfree(l->read_segment);
         pa_xfree(l);
         return NULL;
     }
@@ -125,33 +156,96 @@ void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
             pa_xfree(q);
     }
 
+    while (l->read_segment) {
+        struct segment *next = pa_atomic_ptr_load(&l->read_segment->next);
+
+        pa_xfree(l->read_segment);
+        l->read_segment = next;
+    }
+
     pa_fdsem_free(l->read_fdsem);
     pa_fdsem_free(l->write_fdsem);
     pa_xfree(l);
 }
 
+/* Called from the writer when its segment is full */
+static bool grow(pa_asyncq *l) {
+    struct segment *s;
+    unsigned size;
+
+    size = l->write_segment->size * 2;
+
+    if ((unsigned) pa_atomic_load(&l->total_size) + size > l->max_size)
+        return false;
+
+    s = segment_new(size);
+    pa_atomic_add(&l->total_size, (int) size);
+
+    /* From here on the reader may switch over, so the old segment must
+     * not be touched anymore */
+    pa_atomic_ptr_store(&l->write_segment->next, s);
+    l->write_segment = s;
+    l->write_idx = 0;
+
+    pa_log_debug("asyncq %p is full, adding a segment of %u entries", (void *) l, size);
+    return true;
+}
+
+/* Returns the cell the reader has to look at next. Moves on to the
+ * next segment if the current one has been emptied. */
+static pa_atomic_ptr_t *read_cell(pa_asyncq *l) {
+
+    for (;;) {
+        struct segment *s = l->read_segment, *next;
+        pa_atomic_ptr_t *cell = &PA_SEGMENT_CELLS(s)[reduce(s, l->read_idx)];
+
+        if (pa_atomic_ptr_load(cell))
+            return cell;
+
+        if (!(next = pa_atomic_ptr_load(&s->next)))
+            return cell;
+
+        /* The writer only leaves a segment that is full, and links the
+         * next one after its last write here, so an empty cell means
+         * we have seen everything */
+        if (pa_atomic_ptr_load(cell))
+            return cell;
+
+        l->read_segment = next;
+        l->read_idx = 0;
+
+        pa_atomic_sub(&l->total_size, (int) s->size);
+        pa_xfree(s);
+    }
+}
+
 static int push(pa_asyncq*l, void *p, bool wait_op) {
-    unsigned idx;
-    pa_atomic_ptr_t *cells;
+    pa_atomic_ptr_t *cell;
 
     pa_assert(l);
     pa_assert(p);
 
-    cells = PA_ASYNCQ_CELLS(l);
-
     _Y;
-    idx = reduce(l, l->write_idx);
+    cell = &PA_SEGMENT_CELLS(l->write_segment)[reduce(l->write_segment, l->write_idx)];
 
-    if (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p)) {
+    if (!pa_atomic_ptr_cmpxchg(cell, NULL, p)) {
 
-        if (!wait_op)
-            return -1;
+        if (grow(l)) {
+            cell = PA_SEGMENT_CELLS(l->write_segment);
+            pa_assert_se(pa_atomic_ptr_cmpxchg(cell, NULL, p));
 
-/*         pa_log("sleeping on push"); */
+        } else {
+            pa_atomic_inc(&l->overflows);
 
-        do {
-            pa_fdsem_wait(l->read_fdsem);
-        } while (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p));
+            if (!wait_op)
+                return -1;
+
+/*             pa_log("sleeping on push"); */
+
+            do {
+                pa_fdsem_wait(l->read_fdsem);
+            } while (!pa_atomic_ptr_cmpxchg(cell, NULL, p));
+        }
     }
 
     _Y;
@@ -221,18 +315,15 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
 }
 
 void* pa_asyncq_pop(pa_asyncq*l, bool wait_op) {
-    unsigned idx;
     void *ret;
-    pa_atomic_ptr_t *cells;
+    pa_atomic_ptr_t *cell;
 
     pa_assert(l);
 
-    cells = PA_ASYNCQ_CELLS(l);
-
     _Y;
-    idx = reduce(l, l->read_idx);
+    cell = read_cell(l);
 
-    if (!(ret = pa_atomic_ptr_load(&cells[idx]))) {
+    if (!(ret = pa_atomic_ptr_load(cell))) {
 
         if (!wait_op)
             return NULL;
@@ -241,13 +332,14 @@ void* pa_asyncq_pop(pa_asyncq*l, bool wait_op) {
 
         do {
             pa_fdsem_wait(l->write_fdsem);
-        } while (!(ret = pa_atomic_ptr_load(&cells[idx])));
+            cell = read_cell(l);
+        } while (!(ret = pa_atomic_ptr_load(cell)));
     }
 
     pa_assert(ret);
 
     /* Guaranteed to succeed if we only have a single reader */
-    pa_assert_se(pa_atomic_ptr_cmpxchg(&cells[idx], ret, NULL));
+    pa_assert_se(pa_atomic_ptr_cmpxchg(cell, ret, NULL));
 
     _Y;
     l->read_idx++;
@@ -264,18 +356,12 @@ int pa_asyncq_read_fd(pa_asyncq *q) {
 }
 
 int pa_asyncq_read_before_poll(pa_asyncq *l) {
-    unsigned idx;
-    pa_atomic_ptr_t *cells;
-
     pa_assert(l);
 
-    cells = PA_ASYNCQ_CELLS(l);
-
     _Y;
-    idx = reduce(l, l->read_idx);
 
     for (;;) {
-        if (pa_atomic_ptr_load(&cells[idx]))
+        if (pa_atomic_ptr_load(read_cell(l)))
             return -1;
 
         if (pa_fdsem_before_poll(l->write_fdsem) >= 0)
@@ -318,3 +404,9 @@ void pa_asyncq_write_after_poll(pa_asyncq *l) {
         l->waiting_for_post = false;
     }
 }
+
+unsigned pa_asyncq_get_overflows(pa_asyncq *l) {
+    pa_assert(l);
+
+    return (unsigned) pa_atomic_load(&l->overflows);
+}
@@ -41,6 +41,10 @@
 typedef struct pa_asyncq pa_asyncq;
 
 pa_asyncq* pa_asyncq_new(unsigned size);
+/* Like pa_asyncq_new(), but when the queue is full the writer adds
+ * larger segments, without locking, until max_size entries are
+ * queued. Only then does pushing fail or wait. */
+pa_asyncq* pa_asyncq_new_full(unsigned size, unsigned max_size);
 void pa_asyncq_free(pa_asyncq* q, pa_free_cb_t free_cb);
 
 void* pa_asyncq_pop(pa_asyncq *q, bool wait);
@@ -51,6 +55,10 @@ int pa_asyncq_push(pa_asyncq *q, void *p, bool wait);
  * pa_asyncq_before_poll_post() is called. */
 void pa_asyncq_post(pa_asyncq*l, void *p);
 
+/* The number of times a push found the queue full even after growing
+ * it. If this keeps going up the queue is too small. */
+unsigned pa_asyncq_get_overflows(pa_asyncq *q);
+
 /* For the reading side */
 int pa_asyncq_read_fd(pa_asyncq *q);
 int pa_asyncq_read_before_poll(pa_asyncq *a);
@@ -34,8 +34,13 @@
 #include <fcntl.h>
 #include <ctype.h>
 
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#endif
+
 #include <pulse/xmalloc.h>
 #include <pulse/error.h>
+#include <pulse/util.h>
 
 #include <pulsecore/module.h>
 #include <pulsecore/sink.h>
@@ -52,10 +57,15 @@
 #include <pulsecore/play-memchunk.h>
 #include <pulsecore/sound-file-stream.h>
 #include <pulsecore/shared.h>
+#include <pulsecore/startup-trace.h>
+#include <pulsecore/tracepoint.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/modinfo.h>
 #include <pulsecore/dynarray.h>
+#include <pulsecore/pdispatch.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/thread.h>
 
 #include "cli-command.h"
 
@@ -82,16 +92,10 @@ enum {
 /* Prototypes for all available commands */
 static int pa_cli_command_exit(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_help(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_modules(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_clients(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_cards(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_sinks(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_sources(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_sink_inputs(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_source_outputs(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_list(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_info(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_load_deferred(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_unload(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_describe(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_sink_volume(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
@@ -109,7 +113,6 @@ static int pa_cli_command_kill_sink_input(pa_core *c, pa_tokenizer *t, pa_strbuf
 static int pa_cli_command_kill_source_output(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_scache_play(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_scache_remove(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
-static int pa_cli_command_scache_list(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_scache_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_scache_load_dir(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_play_file(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
@@ -135,23 +138,31 @@ static int pa_cli_command_sink_port(pa_core *c, pa_tokenizer *t, pa_strbuf *buf,
 static int pa_cli_command_source_port(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_port_offset(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_dump_volumes(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_io_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_metrics(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_hooks(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_hook_profiling(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_startup_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_trace_points(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_trace_points(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 
 /* A method table for all available commands */
 
 static const struct command commands[] = {
     { "help",                    pa_cli_command_help,               "Show this help",               1 },
-    { "list-modules",            pa_cli_command_modules,            "List loaded modules",          1 },
-    { "list-cards",              pa_cli_command_cards,              "List cards",                   1 },
-    { "list-sinks",              pa_cli_command_sinks,              "List loaded sinks",            1 },
-    { "list-sources",            pa_cli_command_sources,            "List loaded sources",          1 },
-    { "list-clients",            pa_cli_command_clients,            "List loaded clients",          1 },
-    { "list-sink-inputs",        pa_cli_command_sink_inputs,        "List sink inputs",             1 },
-    { "list-source-outputs",     pa_cli_command_source_outputs,     "List source outputs",          1 },
+    { "list-modules",            pa_cli_command_list,               "List loaded modules (args: [filter])", 2 },
+    { "list-cards",              pa_cli_command_list,               "List cards (args: [filter])",  2 },
+    { "list-sinks",              pa_cli_command_list,               "List loaded sinks (args: [filter])", 2 },
+    { "list-sources",            pa_cli_command_list,               "List loaded sources (args: [filter])", 2 },
+    { "list-clients",            pa_cli_command_list,               "List loaded clients (args: [filter])", 2 },
+    { "list-sink-inputs",        pa_cli_command_list,               "List sink inputs (args: [filter])", 2 },
+    { "list-source-outputs",     pa_cli_command_list,               "List source outputs (args: [filter])", 2 },
     { "stat",                    pa_cli_command_stat,               "Show memory block statistics", 1 },
-    { "info",                    pa_cli_command_info,               "Show comprehensive status",    1 },
-    { "ls",                      pa_cli_command_info,               NULL,                           1 },
-    { "list",                    pa_cli_command_info,               NULL,                           1 },
+    { "info",                    pa_cli_command_list,               "Show comprehensive status (args: [filter])", 2 },
+    { "ls",                      pa_cli_command_list,               NULL,                           2 },
+    { "list",                    pa_cli_command_list,               NULL,                           2 },
     { "load-module",             pa_cli_command_load,               "Load a module (args: name, arguments)", 3},
+    { "load-module-deferred",    pa_cli_command_load_deferred,      "Load a module once the startup script is done (args: name, arguments)", 3},
     { "unload-module",           pa_cli_command_unload,             "Unload a module (args: index|name)", 2},
     { "describe-module",         pa_cli_command_describe,           "Describe a module (arg: name)", 2},
     { "set-sink-volume",         pa_cli_command_sink_volume,        "Set the volume of a sink (args: index|name, volume)", 3},
@@ -177,7 +188,7 @@ static const struct command commands[] = {
     { "update-source-proplist",  pa_cli_command_update_source_proplist, "Update the properties of a source (args: index|name, properties)", 3},
     { "update-sink-input-proplist", pa_cli_command_update_sink_input_proplist, "Update the properties of a sink input (args: index, properties)", 3},
     { "update-source-output-proplist", pa_cli_command_update_source_output_proplist, "Update the properties of a source output (args: index, properties)", 3},
-    { "list-samples",            pa_cli_command_scache_list,        "List all entries in the sample cache", 1},
+    { "list-samples",            pa_cli_command_list,               "List all entries in the sample cache (args: [filter])", 2},
     { "play-sample",             pa_cli_command_scache_play,        "Play a sample from the sample cache (args: name, sink|index)", 3},
     { "remove-sample",           pa_cli_command_scache_remove,      "Remove a sample from the sample cache (args: name)", 2},
     { "load-sample",             pa_cli_command_scache_load,        "Load a sound file into the sample cache (args: name, filename)", 3},
@@ -194,6 +205,14 @@ static const struct command commands[] = {
     { "play-file",               pa_cli_command_play_file,          "Play a sound file (args: filename, sink|index)", 3},
     { "dump",                    pa_cli_command_dump,               "Dump daemon configuration", 1},
     { "dump-volumes",            pa_cli_command_dump_volumes,       "Debug: Show the state of all volumes", 1 },
+    { "dump-sink-io-trace",      pa_cli_command_dump_io_trace,      "Debug: Show the last IO cycles of a sink (args: index|name)", 2 },
+    { "dump-source-io-trace",    pa_cli_command_dump_io_trace,      "Debug: Show the last IO cycles of a source (args: index|name)", 2 },
+    { "dump-metrics",            pa_cli_command_dump_metrics,       "Debug: Show the counters of the core objects, in the Prometheus text format", 1 },
+    { "dump-hooks",              pa_cli_command_dump_hooks,         "Debug: Show how often and how long the core hooks ran", 1 },
+    { "set-hook-profiling",      pa_cli_command_hook_profiling,     "Debug: Measure the time spent in core hooks (args: bool)", 2 },
+    { "dump-startup-trace",      pa_cli_command_dump_startup_trace, "Debug: Show how long the phases of the daemon startup took, as Chrome trace JSON", 1 },
+    { "set-trace-points",        pa_cli_command_trace_points,       "Debug: Record the trace points of the IO threads (args: bool)", 2 },
+    { "dump-trace-points",       pa_cli_command_dump_trace_points,  "Debug: Write what the trace points recorded to a file (args: filename)", 2 },
     { "shared",                  pa_cli_command_list_shared_props,  "Debug: Show shared properties", 1},
     { "exit",                    pa_cli_command_exit,               "Terminate the daemon",         1 },
     { "vacuum",                  pa_cli_command_vacuum,             NULL, 1},
@@ -240,102 +259,97 @@ static int pa_cli_command_help(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
     return 0;
 }
 
-static int pa_cli_command_modules(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+static const struct {
+    const char *name;
+    pa_cli_listing_type_t type;
+} listings[] = {
+    { "list-modules",        PA_CLI_LISTING_MODULES },
+    { "list-cards",          PA_CLI_LISTING_CARDS },
+    { "list-sinks",          PA_CLI_LISTING_SINKS },
+    { "list-sources",        PA_CLI_LISTING_SOURCES },
+    { "list-clients",        PA_CLI_LISTING_CLIENTS },
+    { "list-sink-inputs",    PA_CLI_LISTING_SINK_INPUTS },
+    { "list-source-outputs", PA_CLI_LISTING_SOURCE_OUTPUTS },
+    { "list-samples",        PA_CLI_LISTING_SAMPLES },
+    { "info",                PA_CLI_LISTING_ALL },
+    { "ls",                  PA_CLI_LISTING_ALL },
+    { "list",                PA_CLI_LISTING_ALL },
+};
 
-    pa_core_assert_ref(c);
-    pa_assert(t);
-    pa_assert(buf);
-    pa_assert(fail);
+/* Returns NULL if t isn't a listing command. Anything shown before the
+ * objects themselves goes to buf right away. */
+static pa_cli_listing *listing_new(pa_core *c, pa_tokenizer *t, pa_strbuf *buf) {
+    const char *cmd;
+    unsigned i;
 
-    pa_assert_se(s = pa_module_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
-}
+    if (!(cmd = pa_tokenizer_get(t, 0)))
+        return NULL;
 
-static int pa_cli_command_clients(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+    for (i = 0; i < PA_ELEMENTSOF(listings); i++)
+        if (pa_streq(cmd, listings[i].name))
+            break;
 
-    pa_core_assert_ref(c);
-    pa_assert(t);
-    pa_assert(buf);
-    pa_assert(fail);
+    if (i >= PA_ELEMENTSOF(listings))
+        return NULL;
 
-    pa_assert_se(s = pa_client_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
-}
-
-static int pa_cli_command_cards(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+    if (listings[i].type == PA_CLI_LISTING_ALL) {
+        bool fail = false;
 
-    pa_core_assert_ref(c);
-    pa_assert(t);
-    pa_assert(buf);
-    pa_assert(fail);
+        pa_cli_command_stat(c, t, buf, &fail);
+    }
 
-    pa_assert_se(s = pa_card_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
+    return pa_cli_listing_new(c, listings[i].type, pa_tokenizer_get(t, 1));
 }
 
-static int pa_cli_command_sinks(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+static int pa_cli_command_list(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    pa_cli_listing *l;
 
     pa_core_assert_ref(c);
     pa_assert(t);
     pa_assert(buf);
     pa_assert(fail);
 
-    pa_assert_se(s = pa_sink_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
-}
-
-static int pa_cli_command_sources(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+    pa_assert_se(l = listing_new(c, t, buf));
 
-    pa_core_assert_ref(c);
-    pa_assert(t);
-    pa_assert(buf);
-    pa_assert(fail);
+    while (pa_cli_listing_next(l, buf))
+        ;
 
-    pa_assert_se(s = pa_source_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
+    pa_cli_listing_free(l);
     return 0;
 }
 
-static int pa_cli_command_sink_inputs(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+/* A sink and its monitor source, or the sink and source of a card
+ * often share a thread, and so its numbers */
+static void append_perf_counters(pa_strbuf *buf, const char *type, const char *name, pa_rtpoll *rtpoll) {
+    pa_thread_perf_counters pc;
+    pa_thread *thread;
 
-    pa_core_assert_ref(c);
-    pa_assert(t);
-    pa_assert(buf);
-    pa_assert(fail);
+    if (!rtpoll || !(thread = pa_rtpoll_get_thread(rtpoll)) || pa_thread_get_perf_counters(thread, &pc) < 0) {
+        pa_strbuf_printf(buf, "    %s %s: not counted\n", type, name);
+        return;
+    }
 
-    pa_assert_se(s = pa_sink_input_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
-}
+    pa_strbuf_printf(buf, "    %s %s (thread %s):", type, name, pa_strnull(pa_thread_get_name(thread)));
 
-static int pa_cli_command_source_outputs(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+    if (pc.cycles != UINT64_MAX)
+        pa_strbuf_printf(buf, " %llu cycles,", (unsigned long long) pc.cycles);
+    else
+        pa_strbuf_puts(buf, " - cycles,");
 
-    pa_core_assert_ref(c);
-    pa_assert(t);
-    pa_assert(buf);
-    pa_assert(fail);
+    if (pc.cycles != UINT64_MAX && pc.instructions != UINT64_MAX && pc.cycles > 0)
+        pa_strbuf_printf(buf, " %0.2f IPC,", (double) pc.instructions / (double) pc.cycles);
+    else
+        pa_strbuf_puts(buf, " - IPC,");
 
-    pa_assert_se(s = pa_source_output_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
+    if (pc.cache_references != UINT64_MAX && pc.cache_misses != UINT64_MAX && pc.cache_references > 0)
+        pa_strbuf_printf(buf, " %0.2f%% cache misses,", 100.0 * (double) pc.cache_misses / (double) pc.cache_references);
+    else
+        pa_strbuf_puts(buf, " - cache misses,");
+
+    if (pc.context_switches != UINT64_MAX)
+        pa_strbuf_printf(buf, " %llu context switches\n", (unsigned long long) pc.context_switches);
+    else
+        pa_strbuf_puts(buf, " - context switches\n");
 }
 
 static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
@@ -343,6 +357,7 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
     char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
     char bytes[PA_BYTES_SNPRINT_MAX];
     const pa_mempool_stat *mstat;
+    const pa_pdispatch_stats *dstat;
     unsigned k;
     pa_sink *def_sink;
     pa_source *def_source;
@@ -379,6 +394,17 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
                      (unsigned) pa_atomic_load(&mstat->n_exported),
                      pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&mstat->exported_size)));
 
+    pa_strbuf_printf(buf, "Memory pool segments: %u, added: %u, released: %u. Allocations that fell back to the heap: %u.\n",
+                     pa_mempool_get_n_segments(c->mempool),
+                     (unsigned) pa_atomic_load(&mstat->n_segments_grown),
+                     (unsigned) pa_atomic_load(&mstat->n_segments_shrunk),
+                     (unsigned) (pa_atomic_load(&mstat->n_pool_full) + pa_atomic_load(&mstat->n_too_large_for_pool)));
+
+    pa_strbuf_printf(buf, "Memory block allocations served by thread caches: %u, misses: %u, batch transfers: %u.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_thread_cache_hits),
+                     (unsigned) pa_atomic_load(&mstat->n_thread_cache_misses),
+                     (unsigned) pa_atomic_load(&mstat->n_thread_cache_transfers));
+
     pa_strbuf_printf(buf, "Total sample cache size: %s.\n",
                      pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_scache_total_size(c)));
 
@@ -402,28 +428,71 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
                          (unsigned) pa_atomic_load(&mstat->n_allocated_by_type[k]),
                          (unsigned) pa_atomic_load(&mstat->n_accumulated_by_type[k]));
 
+    /* Filled in by the native protocol, if loaded */
+    if ((dstat = pa_shared_get(c, "pdispatch-stats"))) {
+        pa_strbuf_puts(buf, "Native protocol command handling times (calls, total usec, calls below 1, 2, 4, ... usec):\n");
+
+        for (k = 0; k < PA_COMMAND_MAX; k++) {
+            const char *name;
+            unsigned b;
+
+            if (!dstat->n_calls[k])
+                continue;
+
+            if (!(name = pa_pdispatch_command_name(k)))
+                name = "UNKNOWN";
+
+            pa_strbuf_printf(buf, "    %s: %llu, %llu,",
+                             name,
+                             (unsigned long long) dstat->n_calls[k],
+                             (unsigned long long) dstat->usec[k]);
+
+            for (b = 0; b < PA_PDISPATCH_TIMING_BUCKETS; b++)
+                pa_strbuf_printf(buf, " %u", dstat->histogram[k][b]);
+
+            pa_strbuf_puts(buf, "\n");
+        }
+    }
+
+    if (pa_thread_perf_counters_enabled()) {
+        pa_sink *sink;
+        pa_source *source;
+        uint32_t idx;
+
+        pa_strbuf_puts(buf, "IO thread perf counters:\n");
+
+        PA_IDXSET_FOREACH(sink, c->sinks, idx)
+            append_perf_counters(buf, "Sink", sink->name, sink->thread_info.rtpoll);
+
+        PA_IDXSET_FOREACH(source, c->sources, idx)
+            append_perf_counters(buf, "Source", source->name, source->thread_info.rtpoll);
+    }
+
     return 0;
 }
 
-static int pa_cli_command_info(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+static int pa_cli_command_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *name;
+
     pa_core_assert_ref(c);
     pa_assert(t);
     pa_assert(buf);
     pa_assert(fail);
 
-    pa_cli_command_stat(c, t, buf, fail);
-    pa_cli_command_modules(c, t, buf, fail);
-    pa_cli_command_sinks(c, t, buf, fail);
-    pa_cli_command_sources(c, t, buf, fail);
-    pa_cli_command_clients(c, t, buf, fail);
-    pa_cli_command_cards(c, t, buf, fail);
-    pa_cli_command_sink_inputs(c, t, buf, fail);
-    pa_cli_command_source_outputs(c, t, buf, fail);
-    pa_cli_command_scache_list(c, t, buf, fail);
+    if (!(name = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify the module name and optionally arguments.\n");
+        return -1;
+    }
+
+    if (!pa_module_load(c, name,  pa_tokenizer_get(t, 2))) {
+        pa_strbuf_puts(buf, "Module load failed.\n");
+        return -1;
+    }
+
     return 0;
 }
 
-static int pa_cli_command_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+static int pa_cli_command_load_deferred(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     const char *name;
 
     pa_core_assert_ref(c);
@@ -436,8 +505,8 @@ static int pa_cli_command_load(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
         return -1;
     }
 
-    if (!pa_module_load(c, name,  pa_tokenizer_get(t, 2))) {
-        pa_strbuf_puts(buf, "Module load failed.\n");
+    if (pa_module_load_deferred(c, name, pa_tokenizer_get(t, 2)) < 0) {
+        pa_strbuf_puts(buf, "Module loading is disabled.\n");
         return -1;
     }
 
@@ -1149,21 +1218,6 @@ static int pa_cli_command_kill_source_output(pa_core *c, pa_tokenizer *t, pa_str
     return 0;
 }
 
-static int pa_cli_command_scache_list(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
-
-    pa_core_assert_ref(c);
-    pa_assert(t);
-    pa_assert(buf);
-    pa_assert(fail);
-
-    pa_assert_se(s = pa_scache_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-
-    return 0;
-}
-
 static int pa_cli_command_scache_play(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     const char *n, *sink_name;
     pa_sink *sink;
@@ -1871,6 +1925,279 @@ static int pa_cli_command_dump(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
     return 0;
 }
 
+static int pa_cli_command_dump_io_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *cmd, *n;
+    pa_io_trace *trace = NULL;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    pa_assert_se(cmd = pa_tokenizer_get(t, 0));
+
+    if (pa_streq(cmd, "dump-sink-io-trace")) {
+        pa_sink *sink;
+
+        if (!(n = pa_tokenizer_get(t, 1))) {
+            pa_strbuf_puts(buf, "You need to specify a sink either by its name or its index.\n");
+            return -1;
+        }
+
+        if (!(sink = pa_namereg_get(c, n, PA_NAMEREG_SINK))) {
+            pa_strbuf_puts(buf, "No sink found by this name or index.\n");
+            return -1;
+        }
+
+        trace = sink->io_trace;
+    } else {
+        pa_source *source;
+
+        if (!(n = pa_tokenizer_get(t, 1))) {
+            pa_strbuf_puts(buf, "You need to specify a source either by its name or its index.\n");
+            return -1;
+        }
+
+        if (!(source = pa_namereg_get(c, n, PA_NAMEREG_SOURCE))) {
+            pa_strbuf_puts(buf, "No source found by this name or index.\n");
+            return -1;
+        }
+
+        trace = source->io_trace;
+    }
+
+    if (!trace) {
+        pa_strbuf_puts(buf, "This device keeps no IO trace.\n");
+        return -1;
+    }
+
+    pa_io_trace_dump(trace, buf);
+
+    return 0;
+}
+
+static int pa_cli_command_dump_metrics(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    pa_metrics_dump(c->metrics, buf);
+
+    return 0;
+}
+
+static const char *hook_slot_owner(pa_hook_slot *slot, char *buf, size_t l) {
+#ifdef HAVE_DLADDR
+    Dl_info info;
+
+    /* Static callbacks have no symbol, but the object and the offset are
+     * enough for addr2line */
+    if (dladdr((void*) slot->callback, &info) && info.dli_fname) {
+        pa_snprintf(buf, l, "%s+%#lx", pa_path_get_filename(info.dli_fname),
+                    (unsigned long) ((uint8_t*) slot->callback - (uint8_t*) info.dli_fbase));
+        return buf;
+    }
+#endif
+
+    pa_snprintf(buf, l, "%p", (void*) slot->callback);
+    return buf;
+}
+
+static int pa_cli_command_dump_hooks(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    unsigned i;
+
+    static const char* const hook_names[PA_CORE_HOOK_MAX] = {
+        [PA_CORE_HOOK_SINK_NEW] = "sink-new",
+        [PA_CORE_HOOK_SINK_FIXATE] = "sink-fixate",
+        [PA_CORE_HOOK_SINK_PUT] = "sink-put",
+        [PA_CORE_HOOK_SINK_UNLINK] = "sink-unlink",
+        [PA_CORE_HOOK_SINK_UNLINK_POST] = "sink-unlink-post",
+        [PA_CORE_HOOK_SINK_STATE_CHANGED] = "sink-state-changed",
+        [PA_CORE_HOOK_SINK_PROPLIST_CHANGED] = "sink-proplist-changed",
+        [PA_CORE_HOOK_SINK_PORT_CHANGED] = "sink-port-changed",
+        [PA_CORE_HOOK_SINK_FLAGS_CHANGED] = "sink-flags-changed",
+        [PA_CORE_HOOK_SINK_VOLUME_CHANGED] = "sink-volume-changed",
+        [PA_CORE_HOOK_SINK_MUTE_CHANGED] = "sink-mute-changed",
+        [PA_CORE_HOOK_SOURCE_NEW] = "source-new",
+        [PA_CORE_HOOK_SOURCE_FIXATE] = "source-fixate",
+        [PA_CORE_HOOK_SOURCE_PUT] = "source-put",
+        [PA_CORE_HOOK_SOURCE_UNLINK] = "source-unlink",
+        [PA_CORE_HOOK_SOURCE_UNLINK_POST] = "source-unlink-post",
+        [PA_CORE_HOOK_SOURCE_STATE_CHANGED] = "source-state-changed",
+        [PA_CORE_HOOK_SOURCE_PROPLIST_CHANGED] = "source-proplist-changed",
+        [PA_CORE_HOOK_SOURCE_PORT_CHANGED] = "source-port-changed",
+        [PA_CORE_HOOK_SOURCE_FLAGS_CHANGED] = "source-flags-changed",
+        [PA_CORE_HOOK_SOURCE_VOLUME_CHANGED] = "source-volume-changed",
+        [PA_CORE_HOOK_SOURCE_MUTE_CHANGED] = "source-mute-changed",
+        [PA_CORE_HOOK_SINK_INPUT_NEW] = "sink-input-new",
+        [PA_CORE_HOOK_SINK_INPUT_FIXATE] = "sink-input-fixate",
+        [PA_CORE_HOOK_SINK_INPUT_PUT] = "sink-input-put",
+        [PA_CORE_HOOK_SINK_INPUT_UNLINK] = "sink-input-unlink",
+        [PA_CORE_HOOK_SINK_INPUT_UNLINK_POST] = "sink-input-unlink-post",
+        [PA_CORE_HOOK_SINK_INPUT_MOVE_START] = "sink-input-move-start",
+        [PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH] = "sink-input-move-finish",
+        [PA_CORE_HOOK_SINK_INPUT_MOVE_FAIL] = "sink-input-move-fail",
+        [PA_CORE_HOOK_SINK_INPUT_STATE_CHANGED] = "sink-input-state-changed",
+        [PA_CORE_HOOK_SINK_INPUT_PROPLIST_CHANGED] = "sink-input-proplist-changed",
+        [PA_CORE_HOOK_SINK_INPUT_VOLUME_CHANGED] = "sink-input-volume-changed",
+        [PA_CORE_HOOK_SINK_INPUT_MUTE_CHANGED] = "sink-input-mute-changed",
+        [PA_CORE_HOOK_SINK_INPUT_SEND_EVENT] = "sink-input-send-event",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_NEW] = "source-output-new",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_FIXATE] = "source-output-fixate",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_PUT] = "source-output-put",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_UNLINK] = "source-output-unlink",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_UNLINK_POST] = "source-output-unlink-post",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_MOVE_START] = "source-output-move-start",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_MOVE_FINISH] = "source-output-move-finish",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_MOVE_FAIL] = "source-output-move-fail",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_STATE_CHANGED] = "source-output-state-changed",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_PROPLIST_CHANGED] = "source-output-proplist-changed",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_VOLUME_CHANGED] = "source-output-volume-changed",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_MUTE_CHANGED] = "source-output-mute-changed",
+        [PA_CORE_HOOK_SOURCE_OUTPUT_SEND_EVENT] = "source-output-send-event",
+        [PA_CORE_HOOK_CLIENT_NEW] = "client-new",
+        [PA_CORE_HOOK_CLIENT_PUT] = "client-put",
+        [PA_CORE_HOOK_CLIENT_UNLINK] = "client-unlink",
+        [PA_CORE_HOOK_CLIENT_PROPLIST_CHANGED] = "client-proplist-changed",
+        [PA_CORE_HOOK_CLIENT_SEND_EVENT] = "client-send-event",
+        [PA_CORE_HOOK_CARD_NEW] = "card-new",
+        [PA_CORE_HOOK_CARD_PUT] = "card-put",
+        [PA_CORE_HOOK_CARD_UNLINK] = "card-unlink",
+        [PA_CORE_HOOK_CARD_PROFILE_CHANGED] = "card-profile-changed",
+        [PA_CORE_HOOK_CARD_PROFILE_ADDED] = "card-profile-added",
+        [PA_CORE_HOOK_CARD_PROFILE_AVAILABLE_CHANGED] = "card-profile-available-changed",
+        [PA_CORE_HOOK_PORT_AVAILABLE_CHANGED] = "port-available-changed",
+        [PA_CORE_HOOK_PORT_LATENCY_OFFSET_CHANGED] = "port-latency-offset-changed",
+        [PA_CORE_HOOK_DEFAULT_SINK_CHANGED] = "default-sink-changed",
+        [PA_CORE_HOOK_DEFAULT_SOURCE_CHANGED] = "default-source-changed",
+        [PA_CORE_HOOK_MODULE_NEW] = "module-new",
+        [PA_CORE_HOOK_MODULE_PROPLIST_CHANGED] = "module-proplist-changed",
+        [PA_CORE_HOOK_MODULE_UNLINK] = "module-unlink",
+        [PA_CORE_HOOK_SAMPLE_CACHE_NEW] = "sample-cache-new",
+        [PA_CORE_HOOK_SAMPLE_CACHE_CHANGED] = "sample-cache-changed",
+        [PA_CORE_HOOK_SAMPLE_CACHE_UNLINK] = "sample-cache-unlink",
+    };
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    pa_strbuf_printf(buf, "Hook profiling is %s.\n", pa_hook_get_profiling() ? "enabled" : "disabled");
+
+    for (i = 0; i < PA_CORE_HOOK_MAX; i++) {
+        pa_hook *hook = &c->hooks[i];
+        pa_hook_slot *slot;
+
+        if (!hook->slots)
+            continue;
+
+        pa_strbuf_printf(buf, "%s: fired %u times, %llu usec\n",
+                         pa_strnull(hook_names[i]), hook->n_fired, (unsigned long long) hook->usec);
+
+        PA_LLIST_FOREACH(slot, hook->slots) {
+            char owner[256];
+
+            if (slot->dead)
+                continue;
+
+            pa_strbuf_printf(buf, "\t%s, priority %i%s%s: %u calls, %u skipped, %llu usec\n",
+                             hook_slot_owner(slot, owner, sizeof(owner)), slot->priority,
+                             slot->property ? ", needs " : "", slot->property ? slot->property : "",
+                             slot->n_calls, slot->n_skipped, (unsigned long long) slot->usec);
+        }
+    }
+
+    return 0;
+}
+
+static int pa_cli_command_hook_profiling(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *m;
+    unsigned i;
+    int b;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(m = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify a boolean.\n");
+        return -1;
+    }
+
+    if ((b = pa_parse_boolean(m)) < 0) {
+        pa_strbuf_puts(buf, "Failed to parse hook profiling switch.\n");
+        return -1;
+    }
+
+    /* Start over, so that the numbers cover the same period */
+    if (b)
+        for (i = 0; i < PA_CORE_HOOK_MAX; i++)
+            pa_hook_reset_stats(&c->hooks[i]);
+
+    pa_hook_set_profiling(b);
+
+    return 0;
+}
+
+static int pa_cli_command_dump_startup_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    pa_startup_trace_dump(buf);
+
+    return 0;
+}
+
+static int pa_cli_command_trace_points(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *m;
+    int b;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(m = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify a boolean.\n");
+        return -1;
+    }
+
+    if ((b = pa_parse_boolean(m)) < 0) {
+        pa_strbuf_puts(buf, "Failed to parse trace points switch.\n");
+        return -1;
+    }
+
+    pa_tracepoints_set_enabled(b);
+
+    return 0;
+}
+
+static int pa_cli_command_dump_trace_points(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *fn;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(fn = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify a file name.\n");
+        return -1;
+    }
+
+    if (pa_tracepoints_dump(fn) < 0) {
+        pa_strbuf_printf(buf, "Failed to write trace file '%s'.\n", fn);
+        return -1;
+    }
+
+    return 0;
+}
+
 static int pa_cli_command_dump_volumes(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     pa_sink *s;
     pa_source *so;
@@ -2155,6 +2482,22 @@ int pa_cli_command_execute_line(pa_core *c, const char *s, pa_strbuf *buf, bool
     return pa_cli_command_execute_line_stateful(c, s, buf, fail, NULL);
 }
 
+pa_cli_listing *pa_cli_command_listing_new(pa_core *c, const char *s, pa_strbuf *buf) {
+    pa_tokenizer *t;
+    pa_cli_listing *l;
+
+    pa_assert(c);
+    pa_assert(s);
+    pa_assert(buf);
+
+    t = pa_tokenizer_new(s + strspn(s, whitespace), 2);
+    pa_assert(t);
+    l = listing_new(c, t, buf);
+    pa_tokenizer_free(t);
+
+    return l;
+}
+
 int pa_cli_command_execute_file_stream(pa_core *c, FILE *f, pa_strbuf *buf, bool *fail) {
     char line[2048];
     int ifstate = IFSTATE_NONE;
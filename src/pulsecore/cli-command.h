@@ -22,6 +22,7 @@
 
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core.h>
+#include <pulsecore/cli-text.h>
 
 /* Execute a single CLI command. Write the results to the string
  * buffer *buf. If *fail is non-zero the function will return -1 when
@@ -41,4 +42,10 @@ int pa_cli_command_execute(pa_core *c, const char *s, pa_strbuf *buf, bool *fail
 /* Same as pa_cli_command_execute_line() but also take ifstate var. */
 int pa_cli_command_execute_line_stateful(pa_core *c, const char *s, pa_strbuf *buf, bool *fail, int *ifstate);
 
+/* If s is one of the list commands, write what it shows ahead of the
+ * objects to *buf and return the listing of the objects, for the caller
+ * to generate at its own pace with pa_cli_listing_next(). Returns NULL
+ * for any other line. */
+pa_cli_listing *pa_cli_command_listing_new(pa_core *c, const char *s, pa_strbuf *buf);
+
 #endif
@@ -39,66 +39,73 @@
 
 #include "cli-text.h"
 
-char *pa_module_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_module *m;
-    uint32_t idx = PA_IDXSET_INVALID;
-    pa_assert(c);
-
-    s = pa_strbuf_new();
-
-    pa_strbuf_printf(s, "%u module(s) loaded.\n", pa_idxset_size(c->modules));
-
-    PA_IDXSET_FOREACH(m, c->modules, idx) {
-        char *t;
-
-        pa_strbuf_printf(s, "    index: %u\n"
-                         "\tname: <%s>\n"
-                         "\targument: <%s>\n"
-                         "\tused: %i\n"
-                         "\tload once: %s\n",
-                         m->index,
-                         m->name,
-                         pa_strempty(m->argument),
-                         pa_module_get_n_used(m),
-                         pa_yes_no(m->load_once));
-
-        t = pa_proplist_to_string_sep(m->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
-    }
-
-    return pa_strbuf_tostring_free(s);
+struct pa_cli_listing {
+    pa_core *core;
+
+    /* The type being listed, up to and including last */
+    unsigned type, last;
+    bool started;
+    uint32_t idx;
+
+    /* Only objects with this index, or with this name or property
+     * value, see pa_cli_listing_new() */
+    uint32_t filter_index;
+    char *filter_key, *filter_value;
+    bool filter_prefix;
+};
+
+static void append_module(pa_strbuf *s, pa_core *c, void *object) {
+    pa_module *m = object;
+    char *t;
+
+    pa_strbuf_printf(s, "    index: %u\n"
+                     "\tname: <%s>\n"
+                     "\targument: <%s>\n"
+                     "\tused: %i\n"
+                     "\tload once: %s\n",
+                     m->index,
+                     m->name,
+                     pa_strempty(m->argument),
+                     pa_module_get_n_used(m),
+                     pa_yes_no(m->load_once));
+
+    t = pa_proplist_to_string_sep(m->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
 }
 
-char *pa_client_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_client *client;
-    uint32_t idx = PA_IDXSET_INVALID;
-    pa_assert(c);
+static void describe_module(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_module *m = object;
 
-    s = pa_strbuf_new();
+    *idx = m->index;
+    *name = m->name;
+    *proplist = m->proplist;
+}
 
-    pa_strbuf_printf(s, "%u client(s) logged in.\n", pa_idxset_size(c->clients));
+static void append_client(pa_strbuf *s, pa_core *c, void *object) {
+    pa_client *client = object;
+    char *t;
+    pa_strbuf_printf(
+            s,
+            "    index: %u\n"
+            "\tdriver: <%s>\n",
+            client->index,
+            client->driver);
 
-    PA_IDXSET_FOREACH(client, c->clients, idx) {
-        char *t;
-        pa_strbuf_printf(
-                s,
-                "    index: %u\n"
-                "\tdriver: <%s>\n",
-                client->index,
-                client->driver);
+    if (client->module)
+        pa_strbuf_printf(s, "\towner module: %u\n", client->module->index);
 
-        if (client->module)
-            pa_strbuf_printf(s, "\towner module: %u\n", client->module->index);
+    t = pa_proplist_to_string_sep(client->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
+}
 
-        t = pa_proplist_to_string_sep(client->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
-    }
+static void describe_client(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_client *client = object;
 
-    return pa_strbuf_tostring_free(s);
+    *idx = client->index;
+    *name = pa_proplist_gets(client->proplist, PA_PROP_APPLICATION_NAME);
+    *proplist = client->proplist;
 }
 
 static const char *available_to_string(pa_available_t a) {
@@ -134,66 +141,62 @@ static void append_port_list(pa_strbuf *s, pa_hashmap *ports) {
     }
 }
 
-char *pa_card_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_card *card;
-    uint32_t idx = PA_IDXSET_INVALID;
-    pa_assert(c);
+static void append_card(pa_strbuf *s, pa_core *c, void *object) {
+    pa_card *card = object;
+    char *t;
+    pa_sink *sink;
+    pa_source *source;
+    uint32_t sidx;
+    pa_card_profile *profile;
+    void *state;
 
-    s = pa_strbuf_new();
+    pa_strbuf_printf(
+            s,
+            "    index: %u\n"
+            "\tname: <%s>\n"
+            "\tdriver: <%s>\n",
+            card->index,
+            card->name,
+            card->driver);
 
-    pa_strbuf_printf(s, "%u card(s) available.\n", pa_idxset_size(c->cards));
+    if (card->module)
+        pa_strbuf_printf(s, "\towner module: %u\n", card->module->index);
 
-    PA_IDXSET_FOREACH(card, c->cards, idx) {
-        char *t;
-        pa_sink *sink;
-        pa_source *source;
-        uint32_t sidx;
-        pa_card_profile *profile;
-        void *state;
+    t = pa_proplist_to_string_sep(card->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
 
-        pa_strbuf_printf(
-                s,
-                "    index: %u\n"
-                "\tname: <%s>\n"
-                "\tdriver: <%s>\n",
-                card->index,
-                card->name,
-                card->driver);
-
-        if (card->module)
-            pa_strbuf_printf(s, "\towner module: %u\n", card->module->index);
-
-        t = pa_proplist_to_string_sep(card->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
+    pa_strbuf_puts(s, "\tprofiles:\n");
+    PA_HASHMAP_FOREACH(profile, card->profiles, state)
+        pa_strbuf_printf(s, "\t\t%s: %s (priority %u, available: %s)\n", profile->name, profile->description,
+                         profile->priority, available_to_string(profile->available));
 
-        pa_strbuf_puts(s, "\tprofiles:\n");
-        PA_HASHMAP_FOREACH(profile, card->profiles, state)
-            pa_strbuf_printf(s, "\t\t%s: %s (priority %u, available: %s)\n", profile->name, profile->description,
-                             profile->priority, available_to_string(profile->available));
+    pa_strbuf_printf(
+            s,
+            "\tactive profile: <%s>\n",
+            card->active_profile->name);
 
-        pa_strbuf_printf(
-                s,
-                "\tactive profile: <%s>\n",
-                card->active_profile->name);
+    if (!pa_idxset_isempty(card->sinks)) {
+        pa_strbuf_puts(s, "\tsinks:\n");
+        PA_IDXSET_FOREACH(sink, card->sinks, sidx)
+            pa_strbuf_printf(s, "\t\t%s/#%u: %s\n", sink->name, sink->index, pa_strna(pa_proplist_gets(sink->proplist, PA_PROP_DEVICE_DESCRIPTION)));
+    }
 
-        if (!pa_idxset_isempty(card->sinks)) {
-            pa_strbuf_puts(s, "\tsinks:\n");
-            PA_IDXSET_FOREACH(sink, card->sinks, sidx)
-                pa_strbuf_printf(s, "\t\t%s/#%u: %s\n", sink->name, sink->index, pa_strna(pa_proplist_gets(sink->proplist, PA_PROP_DEVICE_DESCRIPTION)));
-        }
+    if (!pa_idxset_isempty(card->sources)) {
+        pa_strbuf_puts(s, "\tsources:\n");
+        PA_IDXSET_FOREACH(source, card->sources, sidx)
+            pa_strbuf_printf(s, "\t\t%s/#%u: %s\n", source->name, source->index, pa_strna(pa_proplist_gets(source->proplist, PA_PROP_DEVICE_DESCRIPTION)));
+    }
 
-        if (!pa_idxset_isempty(card->sources)) {
-            pa_strbuf_puts(s, "\tsources:\n");
-            PA_IDXSET_FOREACH(source, card->sources, sidx)
-                pa_strbuf_printf(s, "\t\t%s/#%u: %s\n", source->name, source->index, pa_strna(pa_proplist_gets(source->proplist, PA_PROP_DEVICE_DESCRIPTION)));
-        }
+    append_port_list(s, card->ports);
+}
 
-        append_port_list(s, card->ports);
-    }
+static void describe_card(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_card *card = object;
 
-    return pa_strbuf_tostring_free(s);
+    *idx = card->index;
+    *name = card->name;
+    *proplist = card->proplist;
 }
 
 static const char *sink_state_to_string(pa_sink_state_t state) {
@@ -230,340 +233,349 @@ static const char *source_state_to_string(pa_source_state_t state) {
     }
 }
 
-char *pa_sink_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_sink *sink, *default_sink;
-    uint32_t idx = PA_IDXSET_INVALID;
-    pa_assert(c);
-
-    s = pa_strbuf_new();
-
-    pa_strbuf_printf(s, "%u sink(s) available.\n", pa_idxset_size(c->sinks));
+static void append_sink(pa_strbuf *s, pa_core *c, void *object) {
+    pa_sink *sink = object, *default_sink;
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX],
+        cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX],
+        v[PA_VOLUME_SNPRINT_VERBOSE_MAX],
+        cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t;
+    const char *cmn;
 
     default_sink = pa_namereg_get_default_sink(c);
 
-    PA_IDXSET_FOREACH(sink, c->sinks, idx) {
-        char ss[PA_SAMPLE_SPEC_SNPRINT_MAX],
-            cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX],
-            v[PA_VOLUME_SNPRINT_VERBOSE_MAX],
-            cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t;
-        const char *cmn;
-
-        cmn = pa_channel_map_to_pretty_name(&sink->channel_map);
+    cmn = pa_channel_map_to_pretty_name(&sink->channel_map);
+
+    pa_strbuf_printf(
+        s,
+        "  %c index: %u\n"
+        "\tname: <%s>\n"
+        "\tdriver: <%s>\n"
+        "\tflags: %s%s%s%s%s%s%s%s\n"
+        "\tstate: %s\n"
+        "\tsuspend cause: %s%s%s%s\n"
+        "\tpriority: %u\n"
+        "\tvolume: %s\n"
+        "\t        balance %0.2f\n"
+        "\tbase volume: %s\n"
+        "\tvolume steps: %u\n"
+        "\tmuted: %s\n"
+        "\tcurrent latency: %0.2f ms\n"
+        "\tmax request: %lu KiB\n"
+        "\tmax rewind: %lu KiB\n"
+        "\tmonitor source: %u\n"
+        "\tsample spec: %s\n"
+        "\tchannel map: %s%s%s\n"
+        "\tused by: %u\n"
+        "\tlinked by: %u\n",
+        sink == default_sink ? '*' : ' ',
+        sink->index,
+        sink->name,
+        sink->driver,
+        sink->flags & PA_SINK_HARDWARE ? "HARDWARE " : "",
+        sink->flags & PA_SINK_NETWORK ? "NETWORK " : "",
+        sink->flags & PA_SINK_HW_MUTE_CTRL ? "HW_MUTE_CTRL " : "",
+        sink->flags & PA_SINK_HW_VOLUME_CTRL ? "HW_VOLUME_CTRL " : "",
+        sink->flags & PA_SINK_DECIBEL_VOLUME ? "DECIBEL_VOLUME " : "",
+        sink->flags & PA_SINK_LATENCY ? "LATENCY " : "",
+        sink->flags & PA_SINK_FLAT_VOLUME ? "FLAT_VOLUME " : "",
+        sink->flags & PA_SINK_DYNAMIC_LATENCY ? "DYNAMIC_LATENCY" : "",
+        sink_state_to_string(pa_sink_get_state(sink)),
+        sink->suspend_cause & PA_SUSPEND_USER ? "USER " : "",
+        sink->suspend_cause & PA_SUSPEND_APPLICATION ? "APPLICATION " : "",
+        sink->suspend_cause & PA_SUSPEND_IDLE ? "IDLE " : "",
+        sink->suspend_cause & PA_SUSPEND_SESSION ? "SESSION" : "",
+        sink->priority,
+        pa_cvolume_snprint_verbose(cv,
+                                   sizeof(cv),
+                                   pa_sink_get_volume(sink, false),
+                                   &sink->channel_map,
+                                   sink->flags & PA_SINK_DECIBEL_VOLUME),
+        pa_cvolume_get_balance(pa_sink_get_volume(sink, false), &sink->channel_map),
+        pa_volume_snprint_verbose(v, sizeof(v), sink->base_volume, sink->flags & PA_SINK_DECIBEL_VOLUME),
+        sink->n_volume_steps,
+        pa_yes_no(pa_sink_get_mute(sink, false)),
+        (double) pa_sink_get_latency(sink) / (double) PA_USEC_PER_MSEC,
+        (unsigned long) pa_sink_get_max_request(sink) / 1024,
+        (unsigned long) pa_sink_get_max_rewind(sink) / 1024,
+        sink->monitor_source ? sink->monitor_source->index : PA_INVALID_INDEX,
+        pa_sample_spec_snprint(ss, sizeof(ss), &sink->sample_spec),
+        pa_channel_map_snprint(cm, sizeof(cm), &sink->channel_map),
+        cmn ? "\n\t             " : "",
+        cmn ? cmn : "",
+        pa_sink_used_by(sink),
+        pa_sink_linked_by(sink));
+
+    if (sink->flags & PA_SINK_DYNAMIC_LATENCY) {
+        pa_usec_t min_latency, max_latency;
+        pa_sink_get_latency_range(sink, &min_latency, &max_latency);
 
         pa_strbuf_printf(
-            s,
-            "  %c index: %u\n"
-            "\tname: <%s>\n"
-            "\tdriver: <%s>\n"
-            "\tflags: %s%s%s%s%s%s%s%s\n"
-            "\tstate: %s\n"
-            "\tsuspend cause: %s%s%s%s\n"
-            "\tpriority: %u\n"
-            "\tvolume: %s\n"
-            "\t        balance %0.2f\n"
-            "\tbase volume: %s\n"
-            "\tvolume steps: %u\n"
-            "\tmuted: %s\n"
-            "\tcurrent latency: %0.2f ms\n"
-            "\tmax request: %lu KiB\n"
-            "\tmax rewind: %lu KiB\n"
-            "\tmonitor source: %u\n"
-            "\tsample spec: %s\n"
-            "\tchannel map: %s%s%s\n"
-            "\tused by: %u\n"
-            "\tlinked by: %u\n",
-            sink == default_sink ? '*' : ' ',
-            sink->index,
-            sink->name,
-            sink->driver,
-            sink->flags & PA_SINK_HARDWARE ? "HARDWARE " : "",
-            sink->flags & PA_SINK_NETWORK ? "NETWORK " : "",
-            sink->flags & PA_SINK_HW_MUTE_CTRL ? "HW_MUTE_CTRL " : "",
-            sink->flags & PA_SINK_HW_VOLUME_CTRL ? "HW_VOLUME_CTRL " : "",
-            sink->flags & PA_SINK_DECIBEL_VOLUME ? "DECIBEL_VOLUME " : "",
-            sink->flags & PA_SINK_LATENCY ? "LATENCY " : "",
-            sink->flags & PA_SINK_FLAT_VOLUME ? "FLAT_VOLUME " : "",
-            sink->flags & PA_SINK_DYNAMIC_LATENCY ? "DYNAMIC_LATENCY" : "",
-            sink_state_to_string(pa_sink_get_state(sink)),
-            sink->suspend_cause & PA_SUSPEND_USER ? "USER " : "",
-            sink->suspend_cause & PA_SUSPEND_APPLICATION ? "APPLICATION " : "",
-            sink->suspend_cause & PA_SUSPEND_IDLE ? "IDLE " : "",
-            sink->suspend_cause & PA_SUSPEND_SESSION ? "SESSION" : "",
-            sink->priority,
-            pa_cvolume_snprint_verbose(cv,
-                                       sizeof(cv),
-                                       pa_sink_get_volume(sink, false),
-                                       &sink->channel_map,
-                                       sink->flags & PA_SINK_DECIBEL_VOLUME),
-            pa_cvolume_get_balance(pa_sink_get_volume(sink, false), &sink->channel_map),
-            pa_volume_snprint_verbose(v, sizeof(v), sink->base_volume, sink->flags & PA_SINK_DECIBEL_VOLUME),
-            sink->n_volume_steps,
-            pa_yes_no(pa_sink_get_mute(sink, false)),
-            (double) pa_sink_get_latency(sink) / (double) PA_USEC_PER_MSEC,
-            (unsigned long) pa_sink_get_max_request(sink) / 1024,
-            (unsigned long) pa_sink_get_max_rewind(sink) / 1024,
-            sink->monitor_source ? sink->monitor_source->index : PA_INVALID_INDEX,
-            pa_sample_spec_snprint(ss, sizeof(ss), &sink->sample_spec),
-            pa_channel_map_snprint(cm, sizeof(cm), &sink->channel_map),
-            cmn ? "\n\t             " : "",
-            cmn ? cmn : "",
-            pa_sink_used_by(sink),
-            pa_sink_linked_by(sink));
-
-        if (sink->flags & PA_SINK_DYNAMIC_LATENCY) {
-            pa_usec_t min_latency, max_latency;
-            pa_sink_get_latency_range(sink, &min_latency, &max_latency);
-
-            pa_strbuf_printf(
-                    s,
-                    "\tconfigured latency: %0.2f ms; range is %0.2f .. %0.2f ms\n",
-                    (double) pa_sink_get_requested_latency(sink) / (double) PA_USEC_PER_MSEC,
-                    (double) min_latency / PA_USEC_PER_MSEC,
-                    (double) max_latency / PA_USEC_PER_MSEC);
-        } else
-            pa_strbuf_printf(
-                    s,
-                    "\tfixed latency: %0.2f ms\n",
-                    (double) pa_sink_get_fixed_latency(sink) / PA_USEC_PER_MSEC);
-
-        if (sink->card)
-            pa_strbuf_printf(s, "\tcard: %u <%s>\n", sink->card->index, sink->card->name);
-        if (sink->module)
-            pa_strbuf_printf(s, "\tmodule: %u\n", sink->module->index);
-
-        t = pa_proplist_to_string_sep(sink->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
+                s,
+                "\tconfigured latency: %0.2f ms; range is %0.2f .. %0.2f ms\n",
+                (double) pa_sink_get_requested_latency(sink) / (double) PA_USEC_PER_MSEC,
+                (double) min_latency / PA_USEC_PER_MSEC,
+                (double) max_latency / PA_USEC_PER_MSEC);
+    } else
+        pa_strbuf_printf(
+                s,
+                "\tfixed latency: %0.2f ms\n",
+                (double) pa_sink_get_fixed_latency(sink) / PA_USEC_PER_MSEC);
 
-        append_port_list(s, sink->ports);
+    pa_strbuf_printf(s, "\tsilent periods skipped: %u\n", pa_sink_get_silent_skipped(sink));
+    pa_strbuf_printf(s, "\trender load: %0.1f%%%s\n",
+                     (double) pa_sink_get_render_load(sink) / 10.0,
+                     sink->refuse_inputs ? ", overloaded, refusing new streams" :
+                     sink->overloaded ? ", overloaded" : "");
 
-        if (sink->active_port)
-            pa_strbuf_printf(
-                    s,
-                    "\tactive port: <%s>\n",
-                    sink->active_port->name);
-    }
+    if (sink->card)
+        pa_strbuf_printf(s, "\tcard: %u <%s>\n", sink->card->index, sink->card->name);
+    if (sink->module)
+        pa_strbuf_printf(s, "\tmodule: %u\n", sink->module->index);
 
-    return pa_strbuf_tostring_free(s);
+    t = pa_proplist_to_string_sep(sink->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
+
+    append_port_list(s, sink->ports);
+
+    if (sink->active_port)
+        pa_strbuf_printf(
+                s,
+                "\tactive port: <%s>\n",
+                sink->active_port->name);
 }
 
-char *pa_source_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_source *source, *default_source;
-    uint32_t idx = PA_IDXSET_INVALID;
-    pa_assert(c);
+static void describe_sink(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_sink *sink = object;
 
-    s = pa_strbuf_new();
+    *idx = sink->index;
+    *name = sink->name;
+    *proplist = sink->proplist;
+}
 
-    pa_strbuf_printf(s, "%u source(s) available.\n", pa_idxset_size(c->sources));
+static void append_source(pa_strbuf *s, pa_core *c, void *object) {
+    pa_source *source = object, *default_source;
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX],
+        cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX],
+        v[PA_VOLUME_SNPRINT_VERBOSE_MAX],
+        cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t;
+    const char *cmn;
 
     default_source = pa_namereg_get_default_source(c);
 
-    PA_IDXSET_FOREACH(source, c->sources, idx) {
-        char ss[PA_SAMPLE_SPEC_SNPRINT_MAX],
-            cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX],
-            v[PA_VOLUME_SNPRINT_VERBOSE_MAX],
-            cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t;
-        const char *cmn;
-
-        cmn = pa_channel_map_to_pretty_name(&source->channel_map);
+    cmn = pa_channel_map_to_pretty_name(&source->channel_map);
+
+    pa_strbuf_printf(
+        s,
+        "  %c index: %u\n"
+        "\tname: <%s>\n"
+        "\tdriver: <%s>\n"
+        "\tflags: %s%s%s%s%s%s%s\n"
+        "\tstate: %s\n"
+        "\tsuspend cause: %s%s%s%s\n"
+        "\tpriority: %u\n"
+        "\tvolume: %s\n"
+        "\t        balance %0.2f\n"
+        "\tbase volume: %s\n"
+        "\tvolume steps: %u\n"
+        "\tmuted: %s\n"
+        "\tcurrent latency: %0.2f ms\n"
+        "\tmax rewind: %lu KiB\n"
+        "\tsample spec: %s\n"
+        "\tchannel map: %s%s%s\n"
+        "\tused by: %u\n"
+        "\tlinked by: %u\n",
+        source == default_source ? '*' : ' ',
+        source->index,
+        source->name,
+        source->driver,
+        source->flags & PA_SOURCE_HARDWARE ? "HARDWARE " : "",
+        source->flags & PA_SOURCE_NETWORK ? "NETWORK " : "",
+        source->flags & PA_SOURCE_HW_MUTE_CTRL ? "HW_MUTE_CTRL " : "",
+        source->flags & PA_SOURCE_HW_VOLUME_CTRL ? "HW_VOLUME_CTRL " : "",
+        source->flags & PA_SOURCE_DECIBEL_VOLUME ? "DECIBEL_VOLUME " : "",
+        source->flags & PA_SOURCE_LATENCY ? "LATENCY " : "",
+        source->flags & PA_SOURCE_DYNAMIC_LATENCY ? "DYNAMIC_LATENCY" : "",
+        source_state_to_string(pa_source_get_state(source)),
+        source->suspend_cause & PA_SUSPEND_USER ? "USER " : "",
+        source->suspend_cause & PA_SUSPEND_APPLICATION ? "APPLICATION " : "",
+        source->suspend_cause & PA_SUSPEND_IDLE ? "IDLE " : "",
+        source->suspend_cause & PA_SUSPEND_SESSION ? "SESSION" : "",
+        source->priority,
+        pa_cvolume_snprint_verbose(cv,
+                                   sizeof(cv),
+                                   pa_source_get_volume(source, false),
+                                   &source->channel_map,
+                                   source->flags & PA_SOURCE_DECIBEL_VOLUME),
+        pa_cvolume_get_balance(pa_source_get_volume(source, false), &source->channel_map),
+        pa_volume_snprint_verbose(v, sizeof(v), source->base_volume, source->flags & PA_SOURCE_DECIBEL_VOLUME),
+        source->n_volume_steps,
+        pa_yes_no(pa_source_get_mute(source, false)),
+        (double) pa_source_get_latency(source) / PA_USEC_PER_MSEC,
+        (unsigned long) pa_source_get_max_rewind(source) / 1024,
+        pa_sample_spec_snprint(ss, sizeof(ss), &source->sample_spec),
+        pa_channel_map_snprint(cm, sizeof(cm), &source->channel_map),
+        cmn ? "\n\t             " : "",
+        cmn ? cmn : "",
+        pa_source_used_by(source),
+        pa_source_linked_by(source));
+
+    if (source->flags & PA_SOURCE_DYNAMIC_LATENCY) {
+        pa_usec_t min_latency, max_latency;
+        pa_source_get_latency_range(source, &min_latency, &max_latency);
 
         pa_strbuf_printf(
-            s,
-            "  %c index: %u\n"
-            "\tname: <%s>\n"
-            "\tdriver: <%s>\n"
-            "\tflags: %s%s%s%s%s%s%s\n"
-            "\tstate: %s\n"
-            "\tsuspend cause: %s%s%s%s\n"
-            "\tpriority: %u\n"
-            "\tvolume: %s\n"
-            "\t        balance %0.2f\n"
-            "\tbase volume: %s\n"
-            "\tvolume steps: %u\n"
-            "\tmuted: %s\n"
-            "\tcurrent latency: %0.2f ms\n"
-            "\tmax rewind: %lu KiB\n"
-            "\tsample spec: %s\n"
-            "\tchannel map: %s%s%s\n"
-            "\tused by: %u\n"
-            "\tlinked by: %u\n",
-            source == default_source ? '*' : ' ',
-            source->index,
-            source->name,
-            source->driver,
-            source->flags & PA_SOURCE_HARDWARE ? "HARDWARE " : "",
-            source->flags & PA_SOURCE_NETWORK ? "NETWORK " : "",
-            source->flags & PA_SOURCE_HW_MUTE_CTRL ? "HW_MUTE_CTRL " : "",
-            source->flags & PA_SOURCE_HW_VOLUME_CTRL ? "HW_VOLUME_CTRL " : "",
-            source->flags & PA_SOURCE_DECIBEL_VOLUME ? "DECIBEL_VOLUME " : "",
-            source->flags & PA_SOURCE_LATENCY ? "LATENCY " : "",
-            source->flags & PA_SOURCE_DYNAMIC_LATENCY ? "DYNAMIC_LATENCY" : "",
-            source_state_to_string(pa_source_get_state(source)),
-            source->suspend_cause & PA_SUSPEND_USER ? "USER " : "",
-            source->suspend_cause & PA_SUSPEND_APPLICATION ? "APPLICATION " : "",
-            source->suspend_cause & PA_SUSPEND_IDLE ? "IDLE " : "",
-            source->suspend_cause & PA_SUSPEND_SESSION ? "SESSION" : "",
-            source->priority,
-            pa_cvolume_snprint_verbose(cv,
-                                       sizeof(cv),
-                                       pa_source_get_volume(source, false),
-                                       &source->channel_map,
-                                       source->flags & PA_SOURCE_DECIBEL_VOLUME),
-            pa_cvolume_get_balance(pa_source_get_volume(source, false), &source->channel_map),
-            pa_volume_snprint_verbose(v, sizeof(v), source->base_volume, source->flags & PA_SOURCE_DECIBEL_VOLUME),
-            source->n_volume_steps,
-            pa_yes_no(pa_source_get_mute(source, false)),
-            (double) pa_source_get_latency(source) / PA_USEC_PER_MSEC,
-            (unsigned long) pa_source_get_max_rewind(source) / 1024,
-            pa_sample_spec_snprint(ss, sizeof(ss), &source->sample_spec),
-            pa_channel_map_snprint(cm, sizeof(cm), &source->channel_map),
-            cmn ? "\n\t             " : "",
-            cmn ? cmn : "",
-            pa_source_used_by(source),
-            pa_source_linked_by(source));
-
-        if (source->flags & PA_SOURCE_DYNAMIC_LATENCY) {
-            pa_usec_t min_latency, max_latency;
-            pa_source_get_latency_range(source, &min_latency, &max_latency);
-
-            pa_strbuf_printf(
-                    s,
-                    "\tconfigured latency: %0.2f ms; range is %0.2f .. %0.2f ms\n",
-                    (double) pa_source_get_requested_latency(source) / PA_USEC_PER_MSEC,
-                    (double) min_latency / PA_USEC_PER_MSEC,
-                    (double) max_latency / PA_USEC_PER_MSEC);
-        } else
-            pa_strbuf_printf(
-                    s,
-                    "\tfixed latency: %0.2f ms\n",
-                    (double) pa_source_get_fixed_latency(source) / PA_USEC_PER_MSEC);
-
-        if (source->monitor_of)
-            pa_strbuf_printf(s, "\tmonitor_of: %u\n", source->monitor_of->index);
-        if (source->card)
-            pa_strbuf_printf(s, "\tcard: %u <%s>\n", source->card->index, source->card->name);
-        if (source->module)
-            pa_strbuf_printf(s, "\tmodule: %u\n", source->module->index);
-
-        t = pa_proplist_to_string_sep(source->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
+                s,
+                "\tconfigured latency: %0.2f ms; range is %0.2f .. %0.2f ms\n",
+                (double) pa_source_get_requested_latency(source) / PA_USEC_PER_MSEC,
+                (double) min_latency / PA_USEC_PER_MSEC,
+                (double) max_latency / PA_USEC_PER_MSEC);
+    } else
+        pa_strbuf_printf(
+                s,
+                "\tfixed latency: %0.2f ms\n",
+                (double) pa_source_get_fixed_latency(source) / PA_USEC_PER_MSEC);
 
-        append_port_list(s, source->ports);
+    if (source->monitor_of)
+        pa_strbuf_printf(s, "\tmonitor_of: %u\n", source->monitor_of->index);
+    if (source->card)
+        pa_strbuf_printf(s, "\tcard: %u <%s>\n", source->card->index, source->card->name);
+    if (source->module)
+        pa_strbuf_printf(s, "\tmodule: %u\n", source->module->index);
 
-        if (source->active_port)
-            pa_strbuf_printf(
-                    s,
-                    "\tactive port: <%s>\n",
-                    source->active_port->name);
-    }
+    t = pa_proplist_to_string_sep(source->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
 
-    return pa_strbuf_tostring_free(s);
+    append_port_list(s, source->ports);
+
+    if (source->active_port)
+        pa_strbuf_printf(
+                s,
+                "\tactive port: <%s>\n",
+                source->active_port->name);
 }
 
-char *pa_source_output_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_source_output *o;
-    uint32_t idx = PA_IDXSET_INVALID;
+static void describe_source(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_source *source = object;
+
+    *idx = source->index;
+    *name = source->name;
+    *proplist = source->proplist;
+}
+
+static void append_source_output(pa_strbuf *s, pa_core *c, void *object) {
+    pa_source_output *o = object;
     static const char* const state_table[] = {
         [PA_SOURCE_OUTPUT_INIT] = "INIT",
         [PA_SOURCE_OUTPUT_RUNNING] = "RUNNING",
         [PA_SOURCE_OUTPUT_CORKED] = "CORKED",
         [PA_SOURCE_OUTPUT_UNLINKED] = "UNLINKED"
     };
-    pa_assert(c);
-
-    s = pa_strbuf_new();
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
+    pa_usec_t cl;
+    const char *cmn;
+    pa_cvolume v;
+    char *volume_str = NULL;
+
+    cmn = pa_channel_map_to_pretty_name(&o->channel_map);
+
+    if ((cl = pa_source_output_get_requested_latency(o)) == (pa_usec_t) -1)
+        pa_snprintf(clt, sizeof(clt), "n/a");
+    else
+        pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+
+    pa_assert(o->source);
+
+    if (pa_source_output_is_volume_readable(o)) {
+        pa_source_output_get_volume(o, &v, true);
+        volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
+                                       pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &o->channel_map, true),
+                                       pa_cvolume_get_balance(&v, &o->channel_map));
+    } else
+        volume_str = pa_xstrdup("n/a");
+
+    pa_strbuf_printf(
+        s,
+        "    index: %u\n"
+        "\tdriver: <%s>\n"
+        "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
+        "\tstate: %s\n"
+        "\tsource: %u <%s>\n"
+        "\tvolume: %s\n"
+        "\tmuted: %s\n"
+        "\tcurrent latency: %0.2f ms\n"
+        "\trequested latency: %s\n"
+        "\tsample spec: %s\n"
+        "\tchannel map: %s%s%s\n"
+        "\tresample method: %s\n",
+        o->index,
+        o->driver,
+        o->flags & PA_SOURCE_OUTPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
+        o->flags & PA_SOURCE_OUTPUT_DONT_MOVE ? "DONT_MOVE " : "",
+        o->flags & PA_SOURCE_OUTPUT_START_CORKED ? "START_CORKED " : "",
+        o->flags & PA_SOURCE_OUTPUT_NO_REMAP ? "NO_REMAP " : "",
+        o->flags & PA_SOURCE_OUTPUT_NO_REMIX ? "NO_REMIX " : "",
+        o->flags & PA_SOURCE_OUTPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
+        o->flags & PA_SOURCE_OUTPUT_FIX_RATE ? "FIX_RATE " : "",
+        o->flags & PA_SOURCE_OUTPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
+        o->flags & PA_SOURCE_OUTPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
+        o->flags & PA_SOURCE_OUTPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_ON_SUSPEND " : "",
+        o->flags & PA_SOURCE_OUTPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
+        o->flags & PA_SOURCE_OUTPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
+        state_table[pa_source_output_get_state(o)],
+        o->source->index, o->source->name,
+        volume_str,
+        pa_yes_no(o->muted),
+        (double) pa_source_output_get_latency(o, NULL) / PA_USEC_PER_MSEC,
+        clt,
+        pa_sample_spec_snprint(ss, sizeof(ss), &o->sample_spec),
+        pa_channel_map_snprint(cm, sizeof(cm), &o->channel_map),
+        cmn ? "\n\t             " : "",
+        cmn ? cmn : "",
+        pa_resample_method_to_string(pa_source_output_get_resample_method(o)));
+
+    pa_xfree(volume_str);
+
+    if (o->module)
+        pa_strbuf_printf(s, "\towner module: %u\n", o->module->index);
+    if (o->client)
+        pa_strbuf_printf(s, "\tclient: %u <%s>\n", o->client->index, pa_strnull(pa_proplist_gets(o->client->proplist, PA_PROP_APPLICATION_NAME)));
+    if (o->direct_on_input)
+        pa_strbuf_printf(s, "\tdirect on input: %u\n", o->direct_on_input->index);
+
+    t = pa_proplist_to_string_sep(o->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
+}
 
-    pa_strbuf_printf(s, "%u source output(s) available.\n", pa_idxset_size(c->source_outputs));
+static void describe_source_output(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_source_output *o = object;
 
-    PA_IDXSET_FOREACH(o, c->source_outputs, idx) {
-        char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
-        pa_usec_t cl;
-        const char *cmn;
-        pa_cvolume v;
-        char *volume_str = NULL;
+    *idx = o->index;
+    *name = pa_proplist_gets(o->proplist, PA_PROP_MEDIA_NAME);
+    *proplist = o->proplist;
+}
 
-        cmn = pa_channel_map_to_pretty_name(&o->channel_map);
+static void append_resampler_timing(pa_strbuf *s, const pa_resampler_timing *t) {
+    unsigned p, b;
 
-        if ((cl = pa_source_output_get_requested_latency(o)) == (pa_usec_t) -1)
-            pa_snprintf(clt, sizeof(clt), "n/a");
-        else
-            pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+    pa_strbuf_printf(s, "\tresampler timing: %llu runs\n", (unsigned long long) t->calls);
 
-        pa_assert(o->source);
+    for (p = 0; p < PA_RESAMPLER_PHASE_MAX; p++) {
+        pa_strbuf_printf(s, "\t\t%s: %0.3f ms,", pa_resampler_phase_to_string(p), (double) t->nsec[p] / PA_NSEC_PER_MSEC);
 
-        if (pa_source_output_is_volume_readable(o)) {
-            pa_source_output_get_volume(o, &v, true);
-            volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
-                                           pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &o->channel_map, true),
-                                           pa_cvolume_get_balance(&v, &o->channel_map));
-        } else
-            volume_str = pa_xstrdup("n/a");
+        for (b = 0; b < PA_RESAMPLER_TIMING_BUCKETS - 1; b++)
+            pa_strbuf_printf(s, " <%uus: %u", 1U << b, t->histogram[p][b]);
 
-        pa_strbuf_printf(
-            s,
-            "    index: %u\n"
-            "\tdriver: <%s>\n"
-            "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
-            "\tstate: %s\n"
-            "\tsource: %u <%s>\n"
-            "\tvolume: %s\n"
-            "\tmuted: %s\n"
-            "\tcurrent latency: %0.2f ms\n"
-            "\trequested latency: %s\n"
-            "\tsample spec: %s\n"
-            "\tchannel map: %s%s%s\n"
-            "\tresample method: %s\n",
-            o->index,
-            o->driver,
-            o->flags & PA_SOURCE_OUTPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
-            o->flags & PA_SOURCE_OUTPUT_DONT_MOVE ? "DONT_MOVE " : "",
-            o->flags & PA_SOURCE_OUTPUT_START_CORKED ? "START_CORKED " : "",
-            o->flags & PA_SOURCE_OUTPUT_NO_REMAP ? "NO_REMAP " : "",
-            o->flags & PA_SOURCE_OUTPUT_NO_REMIX ? "NO_REMIX " : "",
-            o->flags & PA_SOURCE_OUTPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
-            o->flags & PA_SOURCE_OUTPUT_FIX_RATE ? "FIX_RATE " : "",
-            o->flags & PA_SOURCE_OUTPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
-            o->flags & PA_SOURCE_OUTPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
-            o->flags & PA_SOURCE_OUTPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_ON_SUSPEND " : "",
-            o->flags & PA_SOURCE_OUTPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
-            o->flags & PA_SOURCE_OUTPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
-            state_table[pa_source_output_get_state(o)],
-            o->source->index, o->source->name,
-            volume_str,
-            pa_yes_no(o->muted),
-            (double) pa_source_output_get_latency(o, NULL) / PA_USEC_PER_MSEC,
-            clt,
-            pa_sample_spec_snprint(ss, sizeof(ss), &o->sample_spec),
-            pa_channel_map_snprint(cm, sizeof(cm), &o->channel_map),
-            cmn ? "\n\t             " : "",
-            cmn ? cmn : "",
-            pa_resample_method_to_string(pa_source_output_get_resample_method(o)));
-
-        pa_xfree(volume_str);
-
-        if (o->module)
-            pa_strbuf_printf(s, "\towner module: %u\n", o->module->index);
-        if (o->client)
-            pa_strbuf_printf(s, "\tclient: %u <%s>\n", o->client->index, pa_strnull(pa_proplist_gets(o->client->proplist, PA_PROP_APPLICATION_NAME)));
-        if (o->direct_on_input)
-            pa_strbuf_printf(s, "\tdirect on input: %u\n", o->direct_on_input->index);
-
-        t = pa_proplist_to_string_sep(o->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
+        pa_strbuf_printf(s, " >=%uus: %u\n", 1U << (b - 1), t->histogram[p][b]);
     }
-
-    return pa_strbuf_tostring_free(s);
 }
 
-char *pa_sink_input_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_sink_input *i;
-    uint32_t idx = PA_IDXSET_INVALID;
+static void append_sink_input(pa_strbuf *s, pa_core *c, void *object) {
+    pa_sink_input *i = object;
+    pa_resampler_timing timing;
+    pa_sink_input_stats stats;
     static const char* const state_table[] = {
         [PA_SINK_INPUT_INIT] = "INIT",
         [PA_SINK_INPUT_RUNNING] = "RUNNING",
@@ -571,186 +583,372 @@ char *pa_sink_input_list_to_string(pa_core *c) {
         [PA_SINK_INPUT_CORKED] = "CORKED",
         [PA_SINK_INPUT_UNLINKED] = "UNLINKED"
     };
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
+    pa_usec_t cl;
+    const char *cmn;
+    pa_cvolume v;
+    char *volume_str = NULL;
+
+    cmn = pa_channel_map_to_pretty_name(&i->channel_map);
+
+    if ((cl = pa_sink_input_get_requested_latency(i)) == (pa_usec_t) -1)
+        pa_snprintf(clt, sizeof(clt), "n/a");
+    else
+        pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+
+    pa_assert(i->sink);
+
+    if (pa_sink_input_is_volume_readable(i)) {
+        pa_sink_input_get_volume(i, &v, true);
+        volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
+                                       pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &i->channel_map, true),
+                                       pa_cvolume_get_balance(&v, &i->channel_map));
+    } else
+        volume_str = pa_xstrdup("n/a");
+
+    pa_strbuf_printf(
+        s,
+        "    index: %u\n"
+        "\tdriver: <%s>\n"
+        "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
+        "\tstate: %s\n"
+        "\tsink: %u <%s>\n"
+        "\tvolume: %s\n"
+        "\tmuted: %s\n"
+        "\tcurrent latency: %0.2f ms\n"
+        "\trequested latency: %s\n"
+        "\tsample spec: %s\n"
+        "\tchannel map: %s%s%s\n"
+        "\tresample method: %s\n",
+        i->index,
+        i->driver,
+        i->flags & PA_SINK_INPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
+        i->flags & PA_SINK_INPUT_DONT_MOVE ? "DONT_MOVE " : "",
+        i->flags & PA_SINK_INPUT_START_CORKED ? "START_CORKED " : "",
+        i->flags & PA_SINK_INPUT_NO_REMAP ? "NO_REMAP " : "",
+        i->flags & PA_SINK_INPUT_NO_REMIX ? "NO_REMIX " : "",
+        i->flags & PA_SINK_INPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
+        i->flags & PA_SINK_INPUT_FIX_RATE ? "FIX_RATE " : "",
+        i->flags & PA_SINK_INPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
+        i->flags & PA_SINK_INPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
+        i->flags & PA_SINK_INPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_SUSPEND " : "",
+        i->flags & PA_SINK_INPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
+        i->flags & PA_SINK_INPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
+        state_table[pa_sink_input_get_state(i)],
+        i->sink->index, i->sink->name,
+        volume_str,
+        pa_yes_no(i->muted),
+        (double) pa_sink_input_get_latency(i, NULL) / PA_USEC_PER_MSEC,
+        clt,
+        pa_sample_spec_snprint(ss, sizeof(ss), &i->sample_spec),
+        pa_channel_map_snprint(cm, sizeof(cm), &i->channel_map),
+        cmn ? "\n\t             " : "",
+        cmn ? cmn : "",
+        pa_resample_method_to_string(pa_sink_input_get_resample_method(i)));
+
+    pa_xfree(volume_str);
+
+    if (i->module)
+        pa_strbuf_printf(s, "\tmodule: %u\n", i->module->index);
+    if (i->client)
+        pa_strbuf_printf(s, "\tclient: %u <%s>\n", i->client->index, pa_strnull(pa_proplist_gets(i->client->proplist, PA_PROP_APPLICATION_NAME)));
+    if (pa_sink_input_get_resampler_timing(i, &timing))
+        append_resampler_timing(s, &timing);
+
+    pa_sink_input_get_stats(i, &stats);
+    pa_strbuf_printf(
+        s,
+        "\tunderruns: %u\n"
+        "\tsilence played: %u frames\n"
+        "\trewinds: %u\n"
+        "\trender time: %u usec\n",
+        stats.underruns,
+        stats.silence_frames,
+        stats.rewinds,
+        stats.render_usec);
+
+    t = pa_proplist_to_string_sep(i->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
+}
+
+static void describe_sink_input(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_sink_input *i = object;
+
+    *idx = i->index;
+    *name = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME);
+    *proplist = i->proplist;
+}
+
+static void append_scache_entry(pa_strbuf *s, pa_core *c, void *object) {
+    pa_scache_entry *e = object;
+    double l = 0;
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX] = "n/a", cv[PA_CVOLUME_SNPRINT_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX] = "n/a", *t;
+    const char *cmn;
+
+    cmn = pa_channel_map_to_pretty_name(&e->channel_map);
+
+    if (e->memchunk.memblock) {
+        pa_sample_spec_snprint(ss, sizeof(ss), &e->sample_spec);
+        pa_channel_map_snprint(cm, sizeof(cm), &e->channel_map);
+        l = (double) e->memchunk.length / (double) pa_bytes_per_second(&e->sample_spec);
+    }
+
+    pa_strbuf_printf(
+        s,
+        "    name: <%s>\n"
+        "\tindex: %u\n"
+        "\tsample spec: %s\n"
+        "\tchannel map: %s%s%s\n"
+        "\tlength: %lu\n"
+        "\tduration: %0.1f s\n"
+        "\tvolume: %s\n"
+        "\t        balance %0.2f\n"
+        "\tlazy: %s\n"
+        "\tfilename: <%s>\n",
+        e->name,
+        e->index,
+        ss,
+        cm,
+        cmn ? "\n\t             " : "",
+        cmn ? cmn : "",
+        (long unsigned)(e->memchunk.memblock ? e->memchunk.length : 0),
+        l,
+        e->volume_is_set ? pa_cvolume_snprint_verbose(cv, sizeof(cv), &e->volume, &e->channel_map, true) : "n/a",
+        (e->memchunk.memblock && e->volume_is_set) ? pa_cvolume_get_balance(&e->volume, &e->channel_map) : 0.0f,
+        pa_yes_no(e->lazy),
+        e->filename ? e->filename : "n/a");
+
+    t = pa_proplist_to_string_sep(e->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
+
+}
+
+static void describe_scache_entry(void *object, uint32_t *idx, const char **name, pa_proplist **proplist) {
+    pa_scache_entry *e = object;
+
+    *idx = e->index;
+    *name = e->name;
+    *proplist = e->proplist;
+}
+
+static const struct listing_type {
+    const char *header;
+    size_t objects; /* offset of the idxset in pa_core, which may be NULL */
+    void (*append)(pa_strbuf *s, pa_core *c, void *object);
+    /* For filtering: the object's index, its name or the property that
+     * stands in for it, and its properties */
+    void (*describe)(void *object, uint32_t *idx, const char **name, pa_proplist **proplist);
+} listing_types[PA_CLI_LISTING_ALL] = {
+    [PA_CLI_LISTING_MODULES] = {
+        "%u module(s) loaded.\n", offsetof(pa_core, modules), append_module, describe_module },
+    [PA_CLI_LISTING_SINKS] = {
+        "%u sink(s) available.\n", offsetof(pa_core, sinks), append_sink, describe_sink },
+    [PA_CLI_LISTING_SOURCES] = {
+        "%u source(s) available.\n", offsetof(pa_core, sources), append_source, describe_source },
+    [PA_CLI_LISTING_CLIENTS] = {
+        "%u client(s) logged in.\n", offsetof(pa_core, clients), append_client, describe_client },
+    [PA_CLI_LISTING_CARDS] = {
+        "%u card(s) available.\n", offsetof(pa_core, cards), append_card, describe_card },
+    [PA_CLI_LISTING_SINK_INPUTS] = {
+        "%u sink input(s) available.\n", offsetof(pa_core, sink_inputs), append_sink_input, describe_sink_input },
+    [PA_CLI_LISTING_SOURCE_OUTPUTS] = {
+        "%u source output(s) available.\n", offsetof(pa_core, source_outputs), append_source_output, describe_source_output },
+    [PA_CLI_LISTING_SAMPLES] = {
+        "%u cache entrie(s) available.\n", offsetof(pa_core, scache), append_scache_entry, describe_scache_entry },
+};
+
+pa_cli_listing *pa_cli_listing_new(pa_core *c, pa_cli_listing_type_t type, const char *filter) {
+    pa_cli_listing *l;
+    const char *e;
+    size_t n;
 
     pa_assert(c);
-    s = pa_strbuf_new();
+    pa_assert(type <= PA_CLI_LISTING_ALL);
 
-    pa_strbuf_printf(s, "%u sink input(s) available.\n", pa_idxset_size(c->sink_inputs));
+    l = pa_xnew0(pa_cli_listing, 1);
+    l->core = c;
+    l->type = type == PA_CLI_LISTING_ALL ? 0 : type;
+    l->last = type == PA_CLI_LISTING_ALL ? PA_CLI_LISTING_ALL - 1 : type;
+    l->idx = PA_IDXSET_INVALID;
+    l->filter_index = PA_INVALID_INDEX;
 
-    PA_IDXSET_FOREACH(i, c->sink_inputs, idx) {
-        char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
-        pa_usec_t cl;
-        const char *cmn;
-        pa_cvolume v;
-        char *volume_str = NULL;
+    if (!filter || !*filter)
+        return l;
 
-        cmn = pa_channel_map_to_pretty_name(&i->channel_map);
+    if (pa_atou(filter[0] == '#' ? filter + 1 : filter, &l->filter_index) >= 0)
+        return l;
 
-        if ((cl = pa_sink_input_get_requested_latency(i)) == (pa_usec_t) -1)
-            pa_snprintf(clt, sizeof(clt), "n/a");
-        else
-            pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+    l->filter_index = PA_INVALID_INDEX;
 
-        pa_assert(i->sink);
+    if ((e = strchr(filter, '='))) {
+        l->filter_key = pa_xstrndup(filter, (size_t) (e - filter));
+        filter = e + 1;
+    }
 
-        if (pa_sink_input_is_volume_readable(i)) {
-            pa_sink_input_get_volume(i, &v, true);
-            volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
-                                           pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &i->channel_map, true),
-                                           pa_cvolume_get_balance(&v, &i->channel_map));
-        } else
-            volume_str = pa_xstrdup("n/a");
+    n = strlen(filter);
+    if (n > 0 && filter[n - 1] == '*') {
+        l->filter_prefix = true;
+        n--;
+    }
 
-        pa_strbuf_printf(
-            s,
-            "    index: %u\n"
-            "\tdriver: <%s>\n"
-            "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
-            "\tstate: %s\n"
-            "\tsink: %u <%s>\n"
-            "\tvolume: %s\n"
-            "\tmuted: %s\n"
-            "\tcurrent latency: %0.2f ms\n"
-            "\trequested latency: %s\n"
-            "\tsample spec: %s\n"
-            "\tchannel map: %s%s%s\n"
-            "\tresample method: %s\n",
-            i->index,
-            i->driver,
-            i->flags & PA_SINK_INPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
-            i->flags & PA_SINK_INPUT_DONT_MOVE ? "DONT_MOVE " : "",
-            i->flags & PA_SINK_INPUT_START_CORKED ? "START_CORKED " : "",
-            i->flags & PA_SINK_INPUT_NO_REMAP ? "NO_REMAP " : "",
-            i->flags & PA_SINK_INPUT_NO_REMIX ? "NO_REMIX " : "",
-            i->flags & PA_SINK_INPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
-            i->flags & PA_SINK_INPUT_FIX_RATE ? "FIX_RATE " : "",
-            i->flags & PA_SINK_INPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
-            i->flags & PA_SINK_INPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
-            i->flags & PA_SINK_INPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_SUSPEND " : "",
-            i->flags & PA_SINK_INPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
-            i->flags & PA_SINK_INPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
-            state_table[pa_sink_input_get_state(i)],
-            i->sink->index, i->sink->name,
-            volume_str,
-            pa_yes_no(i->muted),
-            (double) pa_sink_input_get_latency(i, NULL) / PA_USEC_PER_MSEC,
-            clt,
-            pa_sample_spec_snprint(ss, sizeof(ss), &i->sample_spec),
-            pa_channel_map_snprint(cm, sizeof(cm), &i->channel_map),
-            cmn ? "\n\t             " : "",
-            cmn ? cmn : "",
-            pa_resample_method_to_string(pa_sink_input_get_resample_method(i)));
-
-        pa_xfree(volume_str);
-
-        if (i->module)
-            pa_strbuf_printf(s, "\tmodule: %u\n", i->module->index);
-        if (i->client)
-            pa_strbuf_printf(s, "\tclient: %u <%s>\n", i->client->index, pa_strnull(pa_proplist_gets(i->client->proplist, PA_PROP_APPLICATION_NAME)));
-
-        t = pa_proplist_to_string_sep(i->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
+    l->filter_value = pa_xstrndup(filter, n);
+
+    return l;
+}
+
+void pa_cli_listing_free(pa_cli_listing *l) {
+    pa_assert(l);
+
+    pa_xfree(l->filter_key);
+    pa_xfree(l->filter_value);
+    pa_xfree(l);
+}
+
+static bool listing_matches(pa_cli_listing *l, const struct listing_type *t, void *object) {
+    uint32_t idx;
+    const char *name;
+    pa_proplist *proplist;
+
+    if (l->filter_index == PA_INVALID_INDEX && !l->filter_value)
+        return true;
+
+    t->describe(object, &idx, &name, &proplist);
+
+    if (l->filter_index != PA_INVALID_INDEX)
+        return idx == l->filter_index;
+
+    if (l->filter_key)
+        name = proplist ? pa_proplist_gets(proplist, l->filter_key) : NULL;
+
+    if (!name)
+        return false;
+
+    return l->filter_prefix ? pa_startswith(name, l->filter_value) : pa_streq(name, l->filter_value);
+}
+
+/* The number in the header, which only counts what the filter lets through */
+static unsigned listing_count(pa_cli_listing *l, const struct listing_type *t, pa_idxset *objects) {
+    void *object;
+    uint32_t idx;
+    unsigned n = 0;
+
+    if (!objects)
+        return 0;
+
+    if (l->filter_index == PA_INVALID_INDEX && !l->filter_value)
+        return pa_idxset_size(objects);
+
+    PA_IDXSET_FOREACH(object, objects, idx)
+        if (listing_matches(l, t, object))
+            n++;
+
+    return n;
+}
+
+bool pa_cli_listing_next(pa_cli_listing *l, pa_strbuf *buf) {
+    pa_assert(l);
+    pa_assert(buf);
+
+    /* Objects may have come and gone since the last call, hence the
+     * lookup by index, which continues after removed objects */
+    for (; l->type <= l->last; l->type++, l->started = false) {
+        const struct listing_type *t = &listing_types[l->type];
+        pa_idxset *objects = *(pa_idxset**) ((uint8_t*) l->core + t->objects);
+        void *object;
+
+        if (!l->started) {
+            l->started = true;
+            l->idx = PA_IDXSET_INVALID;
+            pa_strbuf_printf(buf, t->header, listing_count(l, t, objects));
+            return true;
+        }
+
+        if (!objects)
+            continue;
+
+        for (object = l->idx == PA_IDXSET_INVALID ? pa_idxset_first(objects, &l->idx) : pa_idxset_next(objects, &l->idx);
+             object;
+             object = pa_idxset_next(objects, &l->idx))
+            if (listing_matches(l, t, object)) {
+                t->append(buf, l->core, object);
+                return true;
+            }
     }
 
-    return pa_strbuf_tostring_free(s);
+    return false;
 }
 
-char *pa_scache_list_to_string(pa_core *c) {
+static char *listing_to_string(pa_core *c, pa_cli_listing_type_t type) {
+    pa_cli_listing *l;
     pa_strbuf *s;
+
     pa_assert(c);
 
     s = pa_strbuf_new();
+    l = pa_cli_listing_new(c, type, NULL);
 
-    pa_strbuf_printf(s, "%u cache entrie(s) available.\n", c->scache ? pa_idxset_size(c->scache) : 0);
+    while (pa_cli_listing_next(l, s))
+        ;
 
-    if (c->scache) {
-        pa_scache_entry *e;
-        uint32_t idx = PA_IDXSET_INVALID;
+    pa_cli_listing_free(l);
 
-        PA_IDXSET_FOREACH(e, c->scache, idx) {
-            double l = 0;
-            char ss[PA_SAMPLE_SPEC_SNPRINT_MAX] = "n/a", cv[PA_CVOLUME_SNPRINT_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX] = "n/a", *t;
-            const char *cmn;
+    return pa_strbuf_tostring_free(s);
+}
 
-            cmn = pa_channel_map_to_pretty_name(&e->channel_map);
+char *pa_module_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_MODULES);
+}
 
-            if (e->memchunk.memblock) {
-                pa_sample_spec_snprint(ss, sizeof(ss), &e->sample_spec);
-                pa_channel_map_snprint(cm, sizeof(cm), &e->channel_map);
-                l = (double) e->memchunk.length / (double) pa_bytes_per_second(&e->sample_spec);
-            }
+char *pa_client_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_CLIENTS);
+}
 
-            pa_strbuf_printf(
-                s,
-                "    name: <%s>\n"
-                "\tindex: %u\n"
-                "\tsample spec: %s\n"
-                "\tchannel map: %s%s%s\n"
-                "\tlength: %lu\n"
-                "\tduration: %0.1f s\n"
-                "\tvolume: %s\n"
-                "\t        balance %0.2f\n"
-                "\tlazy: %s\n"
-                "\tfilename: <%s>\n",
-                e->name,
-                e->index,
-                ss,
-                cm,
-                cmn ? "\n\t             " : "",
-                cmn ? cmn : "",
-                (long unsigned)(e->memchunk.memblock ? e->memchunk.length : 0),
-                l,
-                e->volume_is_set ? pa_cvolume_snprint_verbose(cv, sizeof(cv), &e->volume, &e->channel_map, true) : "n/a",
-                (e->memchunk.memblock && e->volume_is_set) ? pa_cvolume_get_balance(&e->volume, &e->channel_map) : 0.0f,
-                pa_yes_no(e->lazy),
-                e->filename ? e->filename : "n/a");
-
-            t = pa_proplist_to_string_sep(e->proplist, "\n\t\t");
-            pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-            pa_xfree(t);
-        }
-    }
+char *pa_card_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_CARDS);
+}
 
-    return pa_strbuf_tostring_free(s);
+char *pa_sink_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_SINKS);
+}
+
+char *pa_source_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_SOURCES);
+}
+
+char *pa_source_output_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_SOURCE_OUTPUTS);
+}
+
+char *pa_sink_input_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_SINK_INPUTS);
+}
+
+char *pa_scache_list_to_string(pa_core *c) {
+    return listing_to_string(c, PA_CLI_LISTING_SAMPLES);
 }
 
 char *pa_full_status_string(pa_core *c) {
+    static const pa_cli_listing_type_t types[] = {
+        PA_CLI_LISTING_SINKS,
+        PA_CLI_LISTING_SOURCES,
+        PA_CLI_LISTING_SINK_INPUTS,
+        PA_CLI_LISTING_SOURCE_OUTPUTS,
+        PA_CLI_LISTING_CLIENTS,
+        PA_CLI_LISTING_CARDS,
+        PA_CLI_LISTING_MODULES,
+        PA_CLI_LISTING_SAMPLES
+    };
     pa_strbuf *s;
-    int i;
+    unsigned i;
 
     s = pa_strbuf_new();
 
-    for (i = 0; i < 8; i++) {
-        char *t = NULL;
-
-        switch (i) {
-            case 0:
-                t = pa_sink_list_to_string(c);
-                break;
-            case 1:
-                t = pa_source_list_to_string(c);
-                break;
-            case 2:
-                t = pa_sink_input_list_to_string(c);
-                break;
-            case 3:
-                t = pa_source_output_list_to_string(c);
-                break;
-            case 4:
-                t = pa_client_list_to_string(c);
-                break;
-            case 5:
-                t = pa_card_list_to_string(c);
-                break;
-            case 6:
-                t = pa_module_list_to_string(c);
-                break;
-            case 7:
-                t = pa_scache_list_to_string(c);
-                break;
-        }
+    for (i = 0; i < PA_ELEMENTSOF(types); i++) {
+        char *t;
 
+        t = listing_to_string(c, types[i]);
         pa_strbuf_puts(s, t);
         pa_xfree(t);
     }
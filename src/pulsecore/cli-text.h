@@ -21,6 +21,7 @@
 ***/
 
 #include <pulsecore/core.h>
+#include <pulsecore/strbuf.h>
 
 /* Some functions to generate pretty formatted listings of
  * entities. The returned strings have to be freed manually. */
@@ -36,4 +37,36 @@ char *pa_scache_list_to_string(pa_core *c);
 
 char *pa_full_status_string(pa_core *c);
 
+/* The same listings, generated one object at a time, so that listing
+ * thousands of objects can be spread over several main loop
+ * iterations. */
+
+typedef enum pa_cli_listing_type {
+    PA_CLI_LISTING_MODULES,
+    PA_CLI_LISTING_SINKS,
+    PA_CLI_LISTING_SOURCES,
+    PA_CLI_LISTING_CLIENTS,
+    PA_CLI_LISTING_CARDS,
+    PA_CLI_LISTING_SINK_INPUTS,
+    PA_CLI_LISTING_SOURCE_OUTPUTS,
+    PA_CLI_LISTING_SAMPLES,
+    PA_CLI_LISTING_ALL /* All of the above, in this order */
+} pa_cli_listing_type_t;
+
+typedef struct pa_cli_listing pa_cli_listing;
+
+/* filter may be NULL to list everything, an index, optionally prefixed
+ * with '#', a name or "key=value" to list only the objects with that
+ * property value. Names are those of sinks, sources, cards, modules and
+ * samples, the media.name of streams and the application.name of
+ * clients. A trailing '*' matches any name or value with that
+ * prefix. */
+pa_cli_listing *pa_cli_listing_new(pa_core *c, pa_cli_listing_type_t type, const char *filter);
+void pa_cli_listing_free(pa_cli_listing *l);
+
+/* Appends the next header or object to buf. Objects that were added or
+ * removed in between calls may or may not be listed. Returns false,
+ * without appending anything, once the listing is complete. */
+bool pa_cli_listing_next(pa_cli_listing *l, pa_strbuf *buf);
+
 #endif
@@ -41,6 +41,9 @@
 
 #define PROMPT ">>> "
 
+/* Objects written per main loop iteration while listing */
+#define LISTING_BATCH 16
+
 struct pa_cli {
     pa_core *core;
     pa_ioline *line;
@@ -55,6 +58,9 @@ struct pa_cli {
 
     bool interactive;
     char *last_line;
+
+    /* The listing being written, input is paused meanwhile */
+    pa_cli_listing *listing;
 };
 
 static void line_callback(pa_ioline *line, const char *s, void *userdata);
@@ -96,6 +102,10 @@ pa_cli* pa_cli_new(pa_core *core, pa_iochannel *io, pa_module *m) {
 void pa_cli_free(pa_cli *c) {
     pa_assert(c);
 
+    if (c->listing)
+        pa_cli_listing_free(c->listing);
+
+    pa_ioline_set_drain_callback(c->line, NULL, NULL);
     pa_ioline_close(c->line);
     pa_ioline_unref(c->line);
     pa_client_free(c->client);
@@ -117,6 +127,49 @@ static void client_kill(pa_client *client) {
         c->eof_callback(c, c->userdata);
 }
 
+static void listing_write(pa_cli *c) {
+    pa_strbuf *buf;
+    unsigned n;
+    bool more = true;
+    char *p;
+
+    pa_assert(c);
+    pa_assert(c->listing);
+
+    buf = pa_strbuf_new();
+
+    for (n = 0; n < LISTING_BATCH && more; n++)
+        more = pa_cli_listing_next(c->listing, buf);
+
+    pa_ioline_puts(c->line, p = pa_strbuf_tostring_free(buf));
+    pa_xfree(p);
+
+    if (more)
+        return;
+
+    pa_cli_listing_free(c->listing);
+    c->listing = NULL;
+
+    pa_ioline_set_drain_callback(c->line, NULL, NULL);
+    pa_ioline_set_read_paused(c->line, false);
+
+    if (c->interactive)
+        pa_ioline_puts(c->line, PROMPT);
+}
+
+/* The next batch only once the previous one went out, so that a big
+ * listing neither piles up in the output buffer nor holds up the main
+ * loop */
+static void drain_callback(pa_ioline *line, void *userdata) {
+    pa_cli *c = userdata;
+
+    pa_assert(line);
+    pa_assert(c);
+
+    if (c->listing)
+        listing_write(c);
+}
+
 static void line_callback(pa_ioline *line, const char *s, void *userdata) {
     pa_strbuf *buf;
     pa_cli *c = userdata;
@@ -143,6 +196,19 @@ static void line_callback(pa_ioline *line, const char *s, void *userdata) {
     }
 
     pa_assert_se(buf = pa_strbuf_new());
+
+    /* Commands queued up behind a listing wait for it to finish */
+    if ((c->listing = pa_cli_command_listing_new(c->core, s, buf))) {
+        pa_ioline_set_read_paused(line, true);
+        pa_ioline_set_drain_callback(line, drain_callback, c);
+
+        pa_ioline_puts(line, p = pa_strbuf_tostring_free(buf));
+        pa_xfree(p);
+
+        listing_write(c);
+        return;
+    }
+
     c->defer_kill++;
     if (pa_streq(s, "hello")) {
         pa_strbuf_printf(buf, "Welcome to PulseAudio %s! "
@@ -31,6 +31,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/startup-trace.h>
 
 #include "conf-parser.h"
 
@@ -157,11 +158,13 @@ int pa_config_parse(const char *filename, FILE *f, const pa_config_item *t, pa_p
     int r = -1;
     bool do_close = !f;
     pa_config_parser_state state;
+    pa_usec_t begin;
 
     pa_assert(filename);
     pa_assert(t);
 
     pa_zero(state);
+    begin = pa_startup_trace_begin();
 
     if (!f && !(f = pa_fopen_cloexec(filename, "r"))) {
         if (errno == ENOENT) {
@@ -211,6 +214,8 @@ finish:
     if (do_close && f)
         fclose(f);
 
+    pa_startup_trace_end(begin, "conf", filename);
+
     return r;
 }
 
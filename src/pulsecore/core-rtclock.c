@@ -46,6 +46,7 @@
 #include <windows.h>
 #endif
 
+#include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-error.h>
@@ -63,6 +64,17 @@ pa_usec_t pa_rtclock_age(const struct timeval *tv) {
     return pa_timeval_diff(pa_rtclock_get(&now), tv);
 }
 
+uint64_t pa_rtclock_nsec(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (uint64_t) ts.tv_sec * PA_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+#endif
+
+    return pa_rtclock_now() * PA_NSEC_PER_USEC;
+}
+
 struct timeval *pa_rtclock_get(struct timeval *tv) {
 
 #if defined(OS_IS_DARWIN)
@@ -149,13 +161,15 @@ bool pa_rtclock_hrtimer(void) {
     return false;
 }
 
-#define TIMER_SLACK_NS (int) ((500 * PA_NSEC_PER_USEC))
-
-void pa_rtclock_hrtimer_enable(void) {
+void pa_rtclock_hrtimer_enable(pa_usec_t slack_usec) {
 
 #ifdef PR_SET_TIMERSLACK
     int slack_ns;
 
+    /* 0 would mean the default slack of the process */
+    if (slack_usec < 1)
+        slack_usec = 1;
+
     if ((slack_ns = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0)) < 0) {
         pa_log_info("PR_GET_TIMERSLACK/PR_SET_TIMERSLACK not supported.");
         return;
@@ -163,8 +177,8 @@ void pa_rtclock_hrtimer_enable(void) {
 
     pa_log_debug("Timer slack is set to %i us.", (int) (slack_ns/PA_NSEC_PER_USEC));
 
-    if (slack_ns > TIMER_SLACK_NS) {
-        slack_ns = TIMER_SLACK_NS;
+    if ((pa_usec_t) slack_ns > slack_usec * PA_NSEC_PER_USEC) {
+        slack_ns = (int) (slack_usec * PA_NSEC_PER_USEC);
 
         pa_log_debug("Setting timer slack to %i us.", (int) (slack_ns/PA_NSEC_PER_USEC));
 
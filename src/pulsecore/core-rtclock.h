@@ -30,8 +30,13 @@ struct timeval;
 struct timeval *pa_rtclock_get(struct timeval *ts);
 
 pa_usec_t pa_rtclock_age(const struct timeval *tv);
+
+/* Monotonic time in nanoseconds, for timing short code sections */
+uint64_t pa_rtclock_nsec(void);
 bool pa_rtclock_hrtimer(void);
-void pa_rtclock_hrtimer_enable(void);
+/* Lowers the timer slack of the calling thread, and of all threads it
+ * creates afterwards, to at most slack_usec */
+void pa_rtclock_hrtimer_enable(pa_usec_t slack_usec);
 
 /* timer with a resolution better than this are considered high-resolution */
 #define PA_HRTIMER_THRESHOLD_USEC 10
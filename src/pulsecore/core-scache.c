@@ -48,6 +48,7 @@
 #include <pulse/rtclock.h>
 
 #include <pulsecore/sink-input.h>
+#include <pulsecore/resampler.h>
 #include <pulsecore/play-memchunk.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/namereg.h>
@@ -62,6 +63,15 @@
 
 #define UNLOAD_POLL_TIME (60 * PA_USEC_PER_SEC)
 
+struct pa_scache_converted {
+    pa_sample_spec sample_spec;
+    pa_channel_map channel_map;
+    pa_memchunk memchunk;
+    pa_usec_t last_used;
+
+    PA_LLIST_FIELDS(pa_scache_converted);
+};
+
 static void timeout_callback(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
     pa_core *c = userdata;
 
@@ -74,9 +84,34 @@ static void timeout_callback(pa_mainloop_api *m, pa_time_event *e, const struct
     pa_core_rttime_restart(c, e, pa_rtclock_now() + UNLOAD_POLL_TIME);
 }
 
+static void ensure_unload_event(pa_core *c) {
+    pa_assert(c);
+
+    if (!c->scache_auto_unload_event)
+        c->scache_auto_unload_event = pa_core_rttime_new(c, pa_rtclock_now() + UNLOAD_POLL_TIME, timeout_callback, c);
+}
+
+static void free_converted(pa_scache_entry *e, pa_scache_converted *v) {
+    pa_assert(e);
+    pa_assert(v);
+
+    PA_LLIST_REMOVE(pa_scache_converted, e->converted, v);
+    pa_memblock_unref(v->memchunk.memblock);
+    pa_xfree(v);
+}
+
+static void free_all_converted(pa_scache_entry *e) {
+    pa_assert(e);
+
+    while (e->converted)
+        free_converted(e, e->converted);
+}
+
 static void free_entry(pa_scache_entry *e) {
     pa_assert(e);
 
+    free_all_converted(e);
+
     pa_namereg_unregister(e->core, e->name);
     pa_subscription_post(e->core, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_REMOVE, e->index);
     pa_hook_fire(&e->core->hooks[PA_CORE_HOOK_SAMPLE_CACHE_UNLINK], e);
@@ -100,6 +135,7 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
         if (e->memchunk.memblock)
             pa_memblock_unref(e->memchunk.memblock);
 
+        free_all_converted(e);
         pa_xfree(e->filename);
         pa_proplist_clear(e->proplist);
 
@@ -118,6 +154,7 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
         e->name = pa_xstrdup(name);
         e->core = c;
         e->proplist = pa_proplist_new();
+        PA_LLIST_HEAD_INIT(pa_scache_converted, e->converted);
 
         pa_idxset_put(c->scache, e, &e->index);
 
@@ -125,11 +162,10 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
         *new_sample = true;
     }
 
-    e->last_used_time = 0;
     pa_memchunk_reset(&e->memchunk);
     e->filename = NULL;
     e->lazy = false;
-    e->last_used_time = 0;
+    e->last_used = 0;
 
     pa_sample_spec_init(&e->sample_spec);
     pa_channel_map_init(&e->channel_map);
@@ -141,6 +177,60 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
     return e;
 }
 
+/* Drops the data that can be restored, least recently used first, until the
+ * cache fits into scache_max_size again. Uploaded samples are the only copy
+ * of their data and are always kept. */
+static void enforce_max_size(pa_core *c) {
+    size_t size;
+
+    pa_assert(c);
+
+    if (c->scache_max_size <= 0)
+        return;
+
+    size = pa_scache_total_size(c);
+
+    while (size > c->scache_max_size) {
+        pa_scache_entry *e, *oldest_entry = NULL;
+        pa_scache_converted *v, *oldest_converted = NULL;
+        pa_usec_t oldest = 0;
+        uint32_t idx;
+
+        PA_IDXSET_FOREACH(e, c->scache, idx) {
+
+            PA_LLIST_FOREACH(v, e->converted)
+                if (!oldest_entry || v->last_used < oldest) {
+                    oldest_entry = e;
+                    oldest_converted = v;
+                    oldest = v->last_used;
+                }
+
+            if (e->lazy && e->memchunk.memblock)
+                if (!oldest_entry || e->last_used < oldest) {
+                    oldest_entry = e;
+                    oldest_converted = NULL;
+                    oldest = e->last_used;
+                }
+        }
+
+        if (!oldest_entry)
+            break;
+
+        if (oldest_converted) {
+            size -= oldest_converted->memchunk.length;
+            free_converted(oldest_entry, oldest_converted);
+        } else {
+            size -= oldest_entry->memchunk.length;
+            pa_memblock_unref(oldest_entry->memchunk.memblock);
+            pa_memchunk_reset(&oldest_entry->memchunk);
+
+            pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_CHANGE, oldest_entry->index);
+        }
+
+        pa_log_debug("Dropped data of sample \"%s\" to stay within the sample cache size limit", oldest_entry->name);
+    }
+}
+
 int pa_scache_add_item(
         pa_core *c,
         const char *name,
@@ -201,6 +291,8 @@ int pa_scache_add_item(
 
     pa_hook_fire(&e->core->hooks[new_sample ? PA_CORE_HOOK_SAMPLE_CACHE_NEW : PA_CORE_HOOK_SAMPLE_CACHE_CHANGED], e);
 
+    enforce_max_size(c);
+
     return 0;
 }
 
@@ -260,8 +352,7 @@ int pa_scache_add_file_lazy(pa_core *c, const char *name, const char *filename,
 
     pa_proplist_sets(e->proplist, PA_PROP_MEDIA_FILENAME, filename);
 
-    if (!c->scache_auto_unload_event)
-        c->scache_auto_unload_event = pa_core_rttime_new(c, pa_rtclock_now() + UNLOAD_POLL_TIME, timeout_callback, c);
+    ensure_unload_event(c);
 
     if (idx)
         *idx = e->index;
@@ -300,11 +391,126 @@ void pa_scache_free_all(pa_core *c) {
     }
 }
 
+/* Converts the whole entry at once, so that playing it again on a sink with
+ * the same format needs no resampler */
+static pa_scache_converted *convert_entry(pa_scache_entry *e, pa_sink *sink) {
+    pa_core *c = e->core;
+    pa_resampler *r;
+    pa_scache_converted *v;
+    size_t index, block_size, length;
+    uint8_t *dst;
+
+    if (!(r = pa_resampler_new(c->mempool,
+                               &e->sample_spec, &e->channel_map,
+                               &sink->sample_spec, &sink->channel_map,
+                               c->lfe_crossover_freq,
+                               c->resample_method,
+                               (c->disable_remixing ? PA_RESAMPLER_NO_REMIX : 0) |
+                               (c->disable_lfe_remixing ? PA_RESAMPLER_NO_LFE : 0))))
+        return NULL;
+
+    if ((length = pa_resampler_result(r, e->memchunk.length)) > PA_SCACHE_ENTRY_SIZE_MAX || length <= 0) {
+        pa_resampler_free(r);
+        return NULL;
+    }
+
+    v = pa_xnew(pa_scache_converted, 1);
+    v->sample_spec = sink->sample_spec;
+    v->channel_map = sink->channel_map;
+    v->last_used = pa_rtclock_now();
+    v->memchunk.memblock = pa_memblock_new(c->mempool, length);
+    v->memchunk.index = v->memchunk.length = 0;
+
+    block_size = pa_resampler_max_block_size(r);
+    dst = pa_memblock_acquire(v->memchunk.memblock);
+
+    for (index = 0; index < e->memchunk.length; index += block_size) {
+        pa_memchunk in, out;
+
+        in = e->memchunk;
+        in.index += index;
+        in.length = PA_MIN(block_size, e->memchunk.length - index);
+
+        pa_resampler_run(r, &in, &out);
+
+        if (!out.memblock)
+            continue;
+
+        /* pa_resampler_result() rounds up, so this is only a safety net */
+        out.length = PA_MIN(out.length, length - v->memchunk.length);
+
+        memcpy(dst + v->memchunk.length, (uint8_t*) pa_memblock_acquire(out.memblock) + out.index, out.length);
+        pa_memblock_release(out.memblock);
+        pa_memblock_unref(out.memblock);
+
+        v->memchunk.length += out.length;
+    }
+
+    pa_memblock_release(v->memchunk.memblock);
+    pa_resampler_free(r);
+
+    if (v->memchunk.length <= 0) {
+        pa_memblock_unref(v->memchunk.memblock);
+        pa_xfree(v);
+        return NULL;
+    }
+
+    PA_LLIST_PREPEND(pa_scache_converted, e->converted, v);
+
+    pa_log_debug("Converted sample \"%s\" for sink \"%s\", %lu bytes", e->name, sink->name, (unsigned long) v->memchunk.length);
+
+    ensure_unload_event(c);
+
+    return v;
+}
+
+/* Returns the copy of the entry in the format of the sink, or NULL if the
+ * original data should be played */
+static pa_scache_converted *get_converted(pa_scache_entry *e, pa_sink *sink) {
+    pa_scache_converted *v;
+
+    pa_assert(e);
+    pa_assert(sink);
+
+    if (!pa_sample_spec_valid(&e->sample_spec))
+        return NULL;
+
+    if (pa_sample_spec_equal(&e->sample_spec, &sink->sample_spec) &&
+        pa_channel_map_equal(&e->channel_map, &sink->channel_map))
+        return NULL;
+
+    /* Let the sink pick up the rate of the stream instead */
+    if (e->core->avoid_resampling || pa_sink_is_passthrough(sink))
+        return NULL;
+
+    PA_LLIST_FOREACH(v, e->converted)
+        if (pa_sample_spec_equal(&v->sample_spec, &sink->sample_spec) &&
+            pa_channel_map_equal(&v->channel_map, &sink->channel_map)) {
+
+            if (v != e->converted) {
+                PA_LLIST_REMOVE(pa_scache_converted, e->converted, v);
+                PA_LLIST_PREPEND(pa_scache_converted, e->converted, v);
+            }
+
+            return v;
+        }
+
+    if (!e->memchunk.memblock)
+        return NULL;
+
+    return convert_entry(e, sink);
+}
+
 int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t volume, pa_proplist *p, uint32_t *sink_input_idx) {
     pa_scache_entry *e;
+    pa_scache_converted *v;
+    const pa_sample_spec *ss;
+    const pa_channel_map *map;
+    const pa_memchunk *chunk;
     pa_cvolume r;
     pa_proplist *merged;
     bool pass_volume;
+    pa_usec_t now;
 
     pa_assert(c);
     pa_assert(name);
@@ -317,7 +523,9 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
     pa_proplist_sets(merged, PA_PROP_MEDIA_NAME, name);
     pa_proplist_sets(merged, PA_PROP_EVENT_ID, name);
 
-    if (e->lazy && !e->memchunk.memblock) {
+    /* A converted copy may still be around after the file data has been
+     * unloaded, in that case there is no need to load it again */
+    if (!(v = get_converted(e, sink)) && e->lazy && !e->memchunk.memblock) {
         pa_channel_map old_channel_map = e->channel_map;
 
         if (pa_sound_file_load(c->mempool, e->filename, &e->sample_spec, &e->channel_map, &e->memchunk, merged) < 0)
@@ -331,9 +539,19 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
             else
                 pa_cvolume_reset(&e->volume, e->sample_spec.channels);
         }
+
+        v = get_converted(e, sink);
     }
 
-    if (!e->memchunk.memblock)
+    if (v) {
+        ss = &v->sample_spec;
+        map = &v->channel_map;
+        chunk = &v->memchunk;
+    } else if (e->memchunk.memblock) {
+        ss = &e->sample_spec;
+        map = &e->channel_map;
+        chunk = &e->memchunk;
+    } else
         goto fail;
 
     pa_log_debug("Playing sample \"%s\" on \"%s\"", name, sink->name);
@@ -350,14 +568,17 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
     else
         pass_volume = false;
 
+    if (pass_volume && v)
+        pa_cvolume_remap(&r, &e->channel_map, map);
+
     pa_proplist_update(merged, PA_UPDATE_REPLACE, e->proplist);
 
     if (p)
         pa_proplist_update(merged, PA_UPDATE_REPLACE, p);
 
     if (pa_play_memchunk(sink,
-                         &e->sample_spec, &e->channel_map,
-                         &e->memchunk,
+                         ss, map,
+                         chunk,
                          pass_volume ? &r : NULL,
                          merged,
                          PA_SINK_INPUT_NO_CREATE_ON_SUSPEND|PA_SINK_INPUT_KILL_ON_SUSPEND, sink_input_idx) < 0)
@@ -365,8 +586,12 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
 
     pa_proplist_free(merged);
 
-    if (e->lazy)
-        time(&e->last_used_time);
+    now = pa_rtclock_now();
+    e->last_used = now;
+    if (v)
+        v->last_used = now;
+
+    enforce_max_size(c);
 
     return 0;
 
@@ -421,16 +646,22 @@ size_t pa_scache_total_size(pa_core *c) {
     if (!c->scache || !pa_idxset_size(c->scache))
         return 0;
 
-    PA_IDXSET_FOREACH(e, c->scache, idx)
+    PA_IDXSET_FOREACH(e, c->scache, idx) {
+        pa_scache_converted *v;
+
         if (e->memchunk.memblock)
             sum += e->memchunk.length;
 
+        PA_LLIST_FOREACH(v, e->converted)
+            sum += v->memchunk.length;
+    }
+
     return sum;
 }
 
 void pa_scache_unload_unused(pa_core *c) {
     pa_scache_entry *e;
-    time_t now;
+    pa_usec_t now, idle;
     uint32_t idx;
 
     pa_assert(c);
@@ -438,14 +669,20 @@ void pa_scache_unload_unused(pa_core *c) {
     if (!c->scache || !pa_idxset_size(c->scache))
         return;
 
-    time(&now);
+    now = pa_rtclock_now();
+    idle = (pa_usec_t) PA_MAX(c->scache_idle_time, 0) * PA_USEC_PER_SEC;
 
     PA_IDXSET_FOREACH(e, c->scache, idx) {
+        pa_scache_converted *v, *n;
+
+        PA_LLIST_FOREACH_SAFE(v, n, e->converted)
+            if (v->last_used + idle <= now)
+                free_converted(e, v);
 
         if (!e->lazy || !e->memchunk.memblock)
             continue;
 
-        if (e->last_used_time + c->scache_idle_time > now)
+        if (e->last_used + idle > now)
             continue;
 
         pa_memblock_unref(e->memchunk.memblock);
@@ -24,9 +24,12 @@
 #include <pulsecore/core.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/sink.h>
+#include <pulsecore/llist.h>
 
 #define PA_SCACHE_ENTRY_SIZE_MAX (1024*1024*16)
 
+typedef struct pa_scache_converted pa_scache_converted;
+
 typedef struct pa_scache_entry {
     uint32_t index;
     pa_core *core;
@@ -42,7 +45,12 @@ typedef struct pa_scache_entry {
     char *filename;
 
     bool lazy;
-    time_t last_used_time;
+    /* pa_rtclock_now() of the last time the entry was played */
+    pa_usec_t last_used;
+
+    /* Copies of the data in the sample spec and channel map of the sinks
+     * the entry was played on, most recently used first */
+    PA_LLIST_HEAD(pa_scache_converted, converted);
 
     pa_proplist *proplist;
 } pa_scache_entry;
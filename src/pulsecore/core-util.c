@@ -68,6 +68,10 @@
 #include <sys/resource.h>
 #endif
 
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
 #endif
@@ -120,6 +124,7 @@
 #include <sys/personality.h>
 #endif
 
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
 #include <pulse/utf8.h>
@@ -841,6 +846,53 @@ int pa_make_realtime(int rtprio) {
     return -1;
 }
 
+#if defined(__linux__) && defined(SYS_sched_setattr)
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/* The kernel's struct sched_attr, which not every libc has */
+struct deadline_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+#endif
+
+/* Make the current thread a SCHED_DEADLINE task that may run for
+ * runtime in every period. RealtimeKit only hands out SCHED_RR, so this
+ * needs CAP_SYS_NICE. */
+int pa_make_deadline(pa_usec_t runtime, pa_usec_t period) {
+#if defined(__linux__) && defined(SYS_sched_setattr)
+    struct deadline_attr attr;
+
+    pa_assert(runtime <= period);
+
+    pa_zero(attr);
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_flags = 0x01; /* SCHED_FLAG_RESET_ON_FORK */
+    attr.sched_runtime = runtime * PA_NSEC_PER_USEC;
+    attr.sched_deadline = attr.sched_period = period * PA_NSEC_PER_USEC;
+
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0) {
+        pa_log_info("Successfully enabled SCHED_DEADLINE scheduling for thread, with %llu us runtime every %llu us.",
+                    (unsigned long long) runtime, (unsigned long long) period);
+        return 0;
+    }
+#else
+    errno = ENOTSUP;
+#endif
+
+    pa_log_info("Failed to acquire SCHED_DEADLINE scheduling: %s", pa_cstrerror(errno));
+    return -1;
+}
+
 #ifdef HAVE_SYS_RESOURCE_H
 static int set_nice(int nice_level) {
 #ifdef HAVE_DBUS
@@ -1109,6 +1161,13 @@ char *pa_split_spaces(const char *c, const char **state) {
         return NULL;
 
     current += strspn(current, WHITESPACE);
+
+    /* Trailing whitespace is no empty word */
+    if (!*current) {
+        *state = current;
+        return NULL;
+    }
+
     l = strcspn(current, WHITESPACE);
 
     *state = current+l;
@@ -82,6 +82,7 @@ char *pa_strlcpy(char *b, const char *s, size_t l);
 char *pa_parent_dir(const char *fn);
 
 int pa_make_realtime(int rtprio);
+int pa_make_deadline(pa_usec_t runtime, pa_usec_t period);
 int pa_raise_priority(int nice_level);
 void pa_reset_priority(void);
 
@@ -38,11 +38,69 @@
 #include <pulsecore/random.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/source-output.h>
 
 #include "core.h"
 
 PA_DEFINE_PUBLIC_CLASS(pa_core, pa_msgobject);
 
+static pa_proplist *sink_input_new_data_get_proplist(void *call_data) {
+    return ((pa_sink_input_new_data*) call_data)->proplist;
+}
+
+static pa_proplist *sink_input_get_proplist(void *call_data) {
+    return PA_SINK_INPUT(call_data)->proplist;
+}
+
+static pa_proplist *source_output_new_data_get_proplist(void *call_data) {
+    return ((pa_source_output_new_data*) call_data)->proplist;
+}
+
+static pa_proplist *source_output_get_proplist(void *call_data) {
+    return PA_SOURCE_OUTPUT(call_data)->proplist;
+}
+
+/* Lets the slots of the stream hooks filter on stream properties */
+static void set_hook_proplist_callbacks(pa_core *c) {
+    static const pa_core_hook_t sink_input_hooks[] = {
+        PA_CORE_HOOK_SINK_INPUT_PUT,
+        PA_CORE_HOOK_SINK_INPUT_UNLINK,
+        PA_CORE_HOOK_SINK_INPUT_UNLINK_POST,
+        PA_CORE_HOOK_SINK_INPUT_MOVE_START,
+        PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH,
+        PA_CORE_HOOK_SINK_INPUT_MOVE_FAIL,
+        PA_CORE_HOOK_SINK_INPUT_STATE_CHANGED,
+        PA_CORE_HOOK_SINK_INPUT_PROPLIST_CHANGED,
+        PA_CORE_HOOK_SINK_INPUT_VOLUME_CHANGED,
+        PA_CORE_HOOK_SINK_INPUT_MUTE_CHANGED
+    };
+    static const pa_core_hook_t source_output_hooks[] = {
+        PA_CORE_HOOK_SOURCE_OUTPUT_PUT,
+        PA_CORE_HOOK_SOURCE_OUTPUT_UNLINK,
+        PA_CORE_HOOK_SOURCE_OUTPUT_UNLINK_POST,
+        PA_CORE_HOOK_SOURCE_OUTPUT_MOVE_START,
+        PA_CORE_HOOK_SOURCE_OUTPUT_MOVE_FINISH,
+        PA_CORE_HOOK_SOURCE_OUTPUT_MOVE_FAIL,
+        PA_CORE_HOOK_SOURCE_OUTPUT_STATE_CHANGED,
+        PA_CORE_HOOK_SOURCE_OUTPUT_PROPLIST_CHANGED,
+        PA_CORE_HOOK_SOURCE_OUTPUT_VOLUME_CHANGED,
+        PA_CORE_HOOK_SOURCE_OUTPUT_MUTE_CHANGED
+    };
+    unsigned i;
+
+    pa_hook_set_proplist_callback(&c->hooks[PA_CORE_HOOK_SINK_INPUT_NEW], sink_input_new_data_get_proplist);
+    pa_hook_set_proplist_callback(&c->hooks[PA_CORE_HOOK_SINK_INPUT_FIXATE], sink_input_new_data_get_proplist);
+    pa_hook_set_proplist_callback(&c->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_NEW], source_output_new_data_get_proplist);
+    pa_hook_set_proplist_callback(&c->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_FIXATE], source_output_new_data_get_proplist);
+
+    for (i = 0; i < PA_ELEMENTSOF(sink_input_hooks); i++)
+        pa_hook_set_proplist_callback(&c->hooks[sink_input_hooks[i]], sink_input_get_proplist);
+
+    for (i = 0; i < PA_ELEMENTSOF(source_output_hooks); i++)
+        pa_hook_set_proplist_callback(&c->hooks[source_output_hooks[i]], source_output_get_proplist);
+}
+
 static int core_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_core *c = PA_CORE(o);
 
@@ -61,7 +119,7 @@ static int core_process_msg(pa_msgobject *o, int code, void *userdata, int64_t o
 
 static void core_free(pa_object *o);
 
-pa_core* pa_core_new(pa_mainloop_api *m, bool shared, size_t shm_size) {
+pa_core* pa_core_new(pa_mainloop_api *m, bool shared, size_t shm_size, bool shm_huge_pages, int shm_numa_node) {
     pa_core* c;
     pa_mempool *pool;
     int j;
@@ -69,14 +127,14 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, size_t shm_size) {
     pa_assert(m);
 
     if (shared) {
-        if (!(pool = pa_mempool_new(shared, shm_size))) {
+        if (!(pool = pa_mempool_new_full(shared, shm_size, shm_huge_pages, shm_numa_node))) {
             pa_log_warn("Failed to allocate shared memory pool. Falling back to a normal memory pool.");
             shared = false;
         }
     }
 
     if (!shared) {
-        if (!(pool = pa_mempool_new(shared, shm_size))) {
+        if (!(pool = pa_mempool_new_full(shared, shm_size, shm_huge_pages, shm_numa_node))) {
             pa_log("pa_mempool_new() failed.");
             return NULL;
         }
@@ -116,6 +174,8 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, size_t shm_size) {
 
     c->module_defer_unload_event = NULL;
     c->modules_pending_unload = pa_hashmap_new(NULL, NULL);
+    c->module_defer_load_event = NULL;
+    c->modules_pending_load = pa_queue_new();
 
     c->subscription_defer_event = NULL;
     PA_LLIST_HEAD_INIT(pa_subscription, c->subscriptions);
@@ -125,32 +185,48 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, size_t shm_size) {
     c->mempool = pool;
     pa_silence_cache_init(&c->silence_cache);
 
-    if (shared && !(c->rw_mempool = pa_mempool_new(shared, shm_size)))
+    if (shared && !(c->rw_mempool = pa_mempool_new_full(shared, shm_size, shm_huge_pages, shm_numa_node)))
         pa_log_warn("Failed to allocate shared writable memory pool.");
     if (c->rw_mempool)
         pa_mempool_set_is_remote_writable(c->rw_mempool, true);
 
+    c->metrics = pa_metrics_new(m);
+    pa_atomic_store(&c->n_resampler_usec_observers, 0);
+
     c->exit_event = NULL;
     c->scache_auto_unload_event = NULL;
 
     c->exit_idle_time = -1;
     c->scache_idle_time = 20;
+    c->scache_max_size = 0;
 
     c->flat_volumes = true;
     c->disallow_module_loading = false;
     c->disallow_exit = false;
     c->running_as_daemon = false;
     c->realtime_scheduling = false;
+    c->deadline_scheduling = false;
     c->realtime_priority = 5;
     c->disable_remixing = false;
+    c->avoid_resampling = false;
     c->disable_lfe_remixing = false;
+    c->resampler_timing = false;
     c->lfe_crossover_freq = 120;
     c->deferred_volume = true;
+    c->memblock_thread_cache = false;
+    c->mempool_numa_node_auto = false;
+    c->lock_mempools = false;
+    c->dsp_worker_threads = -1;
+    c->shared_io_threads = 0;
+    c->client_command_rate = 0;
+    c->client_command_burst = 0;
     c->resample_method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 1;
 
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
         pa_hook_init(&c->hooks[j], c);
 
+    set_hook_proplist_callbacks(c);
+
     pa_random(&c->cookie, sizeof(c->cookie));
 
 #ifdef SIGPIPE
@@ -206,6 +282,8 @@ static void core_free(pa_object *o) {
 
     pa_assert(pa_hashmap_isempty(c->modules_pending_unload));
     pa_hashmap_free(c->modules_pending_unload);
+    pa_assert(pa_queue_isempty(c->modules_pending_load));
+    pa_queue_free(c->modules_pending_load, NULL);
 
     pa_subscription_free_all(c);
 
@@ -215,6 +293,8 @@ static void core_free(pa_object *o) {
     pa_assert(!c->default_source);
     pa_assert(!c->default_sink);
 
+    pa_metrics_free(c->metrics);
+
     pa_silence_cache_done(&c->silence_cache);
     if (c->rw_mempool)
         pa_mempool_free(c->rw_mempool);
@@ -223,6 +303,10 @@ static void core_free(pa_object *o) {
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
         pa_hook_done(&c->hooks[j]);
 
+    if (c->workpool)
+        pa_workpool_free(c->workpool);
+
+    pa_xfree(c->io_thread_cpus);
     pa_xfree(c);
 }
 
@@ -259,6 +343,53 @@ int pa_core_exit(pa_core *c, bool force, int retval) {
     return 0;
 }
 
+void pa_core_set_mempool_numa_node(pa_core *c, int numa_node) {
+    pa_assert(c);
+
+    if (numa_node < 0)
+        return;
+
+    pa_log_info("Binding memory pools to NUMA node %i.", numa_node);
+
+    pa_mempool_set_numa_node(c->mempool, numa_node);
+
+    if (c->rw_mempool)
+        pa_mempool_set_numa_node(c->rw_mempool, numa_node);
+
+    c->mempool_numa_node_auto = false;
+}
+
+void pa_core_lock_mempools(pa_core *c) {
+    pa_assert(c);
+
+    if (pa_mempool_lock_memory(c->mempool) < 0)
+        return;
+
+    if (c->rw_mempool && pa_mempool_lock_memory(c->rw_mempool) < 0)
+        return;
+
+    pa_log_info("Locked memory pools into memory.");
+    c->lock_mempools = true;
+}
+
+pa_workpool *pa_core_get_workpool(pa_core *c) {
+    unsigned n;
+
+    pa_assert(c);
+
+    if (c->workpool)
+        return c->workpool;
+
+    if (c->dsp_worker_threads >= 0)
+        n = (unsigned) c->dsp_worker_threads;
+    else
+        n = pa_ncpus() - 1;
+
+    c->workpool = pa_workpool_new(n, c->realtime_scheduling ? c->realtime_priority : 0);
+
+    return c->workpool;
+}
+
 void pa_core_maybe_vacuum(pa_core *c) {
     pa_assert(c);
 
@@ -40,6 +40,7 @@ typedef enum pa_suspend_cause {
 
 #include <pulsecore/idxset.h>
 #include <pulsecore/hashmap.h>
+#include <pulsecore/queue.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/resampler.h>
 #include <pulsecore/llist.h>
@@ -50,6 +51,8 @@ typedef enum pa_suspend_cause {
 #include <pulsecore/source.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/msgobject.h>
+#include <pulsecore/workpool.h>
+#include <pulsecore/metrics.h>
 
 typedef enum pa_server_type {
     PA_SERVER_TYPE_UNSET,
@@ -172,6 +175,8 @@ struct pa_core {
 
     pa_defer_event *module_defer_unload_event;
     pa_hashmap *modules_pending_unload; /* pa_module -> pa_module (hashmap-as-a-set) */
+    pa_defer_event *module_defer_load_event;
+    pa_queue *modules_pending_load;
 
     pa_defer_event *subscription_defer_event;
     PA_LLIST_HEAD(pa_subscription, subscriptions);
@@ -184,23 +189,61 @@ struct pa_core {
     pa_mempool *mempool, *rw_mempool;
     pa_silence_cache silence_cache;
 
+    /* Counters the core objects keep about themselves, see metrics.h */
+    pa_metrics *metrics;
+
+    /* Modules reading pa_sink_input_get_resampler_usec(). The IO threads
+     * only time the resamplers while there are any, it costs two clock
+     * readings per run. */
+    pa_atomic_t n_resampler_usec_observers;
+
     pa_time_event *exit_event;
     pa_time_event *scache_auto_unload_event;
 
     int exit_idle_time, scache_idle_time;
+    size_t scache_max_size;
 
     bool flat_volumes:1;
     bool disallow_module_loading:1;
     bool disallow_exit:1;
     bool running_as_daemon:1;
     bool realtime_scheduling:1;
+    /* Let timer scheduled device threads try SCHED_DEADLINE first */
+    bool deadline_scheduling:1;
     bool disable_remixing:1;
     bool disable_lfe_remixing:1;
+    bool avoid_resampling:1;
+    bool resampler_timing:1;
     bool deferred_volume:1;
+    bool memblock_thread_cache:1;
+    /* Bind the memory pools to the NUMA node of the first sound card
+     * we find */
+    bool mempool_numa_node_auto:1;
+    /* Locked with pa_core_lock_mempools(), pools created from then on
+     * have to be locked as well */
+    bool lock_mempools:1;
 
     pa_resample_method_t resample_method;
     int realtime_priority;
 
+    /* CPUs to bind device IO threads to, "irq" for the ones handling
+     * the sound card's interrupt, or NULL to leave them alone */
+    char *io_thread_cpus;
+
+    /* Number of DSP worker threads, -1 for one less than the number of
+     * CPUs. The pool is only created once a module asks for it. */
+    int dsp_worker_threads;
+    pa_workpool *workpool;
+
+    /* Number of IO threads simple devices share instead of running a
+     * thread each, 0 to disable. See io-scheduler.h. */
+    unsigned shared_io_threads;
+
+    /* How many commands per second a native protocol client may send
+     * on average, 0 for no limit, and how many in a row beyond that */
+    unsigned client_command_rate;
+    unsigned client_command_burst;
+
     pa_server_type_t server_type;
     pa_cpu_info cpu_info;
 
@@ -216,7 +259,7 @@ enum {
     PA_CORE_MESSAGE_MAX
 };
 
-pa_core* pa_core_new(pa_mainloop_api *m, bool shared, size_t shm_size);
+pa_core* pa_core_new(pa_mainloop_api *m, bool shared, size_t shm_size, bool shm_huge_pages, int shm_numa_node);
 
 /* Check whether no one is connected to this core */
 void pa_core_check_idle(pa_core *c);
@@ -225,6 +268,17 @@ int pa_core_exit(pa_core *c, bool force, int retval);
 
 void pa_core_maybe_vacuum(pa_core *c);
 
+/* Move the memory pools to the specified NUMA node */
+void pa_core_set_mempool_numa_node(pa_core *c, int numa_node);
+
+/* Lock the memory pools, and whatever clients share with us through
+ * them, into RAM */
+void pa_core_lock_mempools(pa_core *c);
+
+/* Returns the DSP worker pool, creating it on first use. Called from
+ * the main thread. */
+pa_workpool *pa_core_get_workpool(pa_core *c);
+
 /* wrapper for c->mainloop->time_*() RT time events */
 pa_time_event* pa_core_rttime_new(pa_core *c, pa_usec_t usec, pa_time_event_cb_t cb, void *userdata);
 void pa_core_rttime_restart(pa_core *c, pa_time_event *e, pa_usec_t usec);
@@ -31,6 +31,7 @@
 #include <pulsecore/log.h>
 
 #include "cpu-arm.h"
+#include "cpu-autotune.h"
 
 #if defined (__arm__) && defined (__linux__)
 
@@ -147,14 +148,18 @@ bool pa_cpu_init_arm(pa_cpu_arm_flag_t *flags) {
 #if defined (__linux__)
     pa_cpu_get_arm_flags(flags);
 
-    if (*flags & PA_CPU_ARM_V6)
+    if (*flags & PA_CPU_ARM_V6) {
         pa_volume_func_init_arm(*flags);
+        pa_cpu_autotune_stage("armv6");
+    }
 
 #ifdef HAVE_NEON
     if (*flags & PA_CPU_ARM_NEON) {
         pa_convert_func_init_neon(*flags);
         pa_mix_func_init_neon(*flags);
         pa_remap_func_init_neon(*flags);
+        pa_polyphase_func_init_neon(*flags);
+        pa_cpu_autotune_stage("neon");
     }
 #endif
 
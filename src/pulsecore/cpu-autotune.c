@@ -0,0 +1,569 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mix.h>
+#include <pulsecore/remap.h>
+#include <pulsecore/sample-util.h>
+#include <pulsecore/sconv.h>
+#include <pulsecore/strbuf.h>
+
+#include "cpu-autotune.h"
+
+/* Each implementation is timed BENCH_ROUNDS times over BENCH_ITERATIONS
+ * calls on BENCH_FRAMES frames, and the fastest round counts. That takes
+ * a few milliseconds per function. */
+#define BENCH_FRAMES 1024
+#define BENCH_ROUNDS 5
+#define BENCH_ITERATIONS 32
+
+/* Generic, MMX, SSE, SSE4.1, AVX2, AVX-512 and Orc on x86 */
+#define MAX_CANDIDATES 8
+
+typedef void (*any_func_t)(void);
+
+typedef enum {
+    SLOT_MIX,
+    SLOT_VOLUME,
+    SLOT_TO_FLOAT32,
+    SLOT_FROM_FLOAT32,
+    SLOT_REMAP,
+    SLOT_MAX
+} slot_kind_t;
+
+static const char * const slot_names[SLOT_MAX] = {
+    [SLOT_MIX] = "mix",
+    [SLOT_VOLUME] = "volume",
+    [SLOT_TO_FLOAT32] = "to-float32",
+    [SLOT_FROM_FLOAT32] = "from-float32",
+    [SLOT_REMAP] = "remap"
+};
+
+struct candidate {
+    const char *name;
+    any_func_t func;
+};
+
+struct slot {
+    struct candidate candidates[MAX_CANDIDATES];
+    unsigned n_candidates;
+};
+
+/* The remapping init function is not per format, it uses the first entry */
+static struct slot slots[SLOT_MAX][PA_SAMPLE_MAX];
+
+struct bench {
+    pa_sample_format_t format;
+    unsigned channels;
+    unsigned n_samples;
+
+    void *samples, *samples2, *out;
+    float *floats;
+
+    union {
+        int32_t i;
+        float f;
+    } volumes[PA_CHANNELS_MAX * 2];
+
+    pa_mix_info streams[2];
+
+    /* Upmix and downmix between stereo and the configured channels */
+    pa_remap_t remaps[2];
+};
+
+static any_func_t get_func(slot_kind_t kind, pa_sample_format_t f) {
+    switch (kind) {
+        case SLOT_MIX:
+            return (any_func_t) pa_get_mix_func(f);
+        case SLOT_VOLUME:
+            return (any_func_t) pa_get_volume_func(f);
+        case SLOT_TO_FLOAT32:
+            return (any_func_t) pa_get_convert_to_float32ne_function(f);
+        case SLOT_FROM_FLOAT32:
+            return (any_func_t) pa_get_convert_from_float32ne_function(f);
+        case SLOT_REMAP:
+            return (any_func_t) pa_get_init_remap_func();
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+static void set_func(slot_kind_t kind, pa_sample_format_t f, any_func_t func) {
+    switch (kind) {
+        case SLOT_MIX:
+            pa_set_mix_func(f, (pa_do_mix_func_t) func);
+            break;
+        case SLOT_VOLUME:
+            pa_set_volume_func(f, (pa_do_volume_func_t) func);
+            break;
+        case SLOT_TO_FLOAT32:
+            pa_set_convert_to_float32ne_function(f, (pa_convert_func_t) func);
+            break;
+        case SLOT_FROM_FLOAT32:
+            pa_set_convert_from_float32ne_function(f, (pa_convert_func_t) func);
+            break;
+        case SLOT_REMAP:
+            pa_set_init_remap_func((pa_init_remap_func_t) func);
+            break;
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+static const struct candidate *find_by_func(const struct slot *s, any_func_t func) {
+    unsigned i;
+
+    for (i = 0; i < s->n_candidates; i++)
+        if (s->candidates[i].func == func)
+            return s->candidates + i;
+
+    return NULL;
+}
+
+static const struct candidate *find_by_name(const struct slot *s, const char *name) {
+    unsigned i;
+
+    for (i = 0; i < s->n_candidates; i++)
+        if (pa_streq(s->candidates[i].name, name))
+            return s->candidates + i;
+
+    return NULL;
+}
+
+void pa_cpu_autotune_stage(const char *name) {
+    unsigned k, f;
+
+    pa_assert(name);
+
+    for (k = 0; k < SLOT_MAX; k++) {
+        for (f = 0; f < (k == SLOT_REMAP ? 1 : PA_SAMPLE_MAX); f++) {
+            struct slot *s = &slots[k][f];
+            any_func_t func = get_func(k, f);
+
+            if (!func || find_by_func(s, func) || s->n_candidates >= MAX_CANDIDATES)
+                continue;
+
+            s->candidates[s->n_candidates].name = name;
+            s->candidates[s->n_candidates].func = func;
+            s->n_candidates++;
+        }
+    }
+}
+
+/* The functions that matter for a daemon running with ss */
+static bool slot_used(slot_kind_t kind, const pa_sample_spec *ss) {
+    if (kind == SLOT_TO_FLOAT32 || kind == SLOT_FROM_FLOAT32)
+        return ss->format != PA_SAMPLE_FLOAT32NE;
+
+    return true;
+}
+
+static pa_sample_format_t slot_format(slot_kind_t kind, const pa_sample_spec *ss) {
+    return kind == SLOT_REMAP ? 0 : ss->format;
+}
+
+static char *slot_key(slot_kind_t kind, const pa_sample_spec *ss) {
+    if (kind == SLOT_REMAP)
+        return pa_xstrdup(slot_names[kind]);
+
+    return pa_sprintf_malloc("%s-%s", slot_names[kind], pa_sample_format_to_string(ss->format));
+}
+
+/* Remapping works on s16ne or float32ne, the resampler converts the
+ * other formats to float32ne */
+static pa_sample_format_t remap_format(pa_sample_format_t f) {
+    return f == PA_SAMPLE_S16NE ? PA_SAMPLE_S16NE : PA_SAMPLE_FLOAT32NE;
+}
+
+static void remap_setup(pa_remap_t *m, pa_sample_format_t format, unsigned i_channels, unsigned o_channels) {
+    unsigned oc, ic;
+
+    pa_zero(*m);
+    m->format = format;
+    m->i_ss.format = m->o_ss.format = format;
+    m->i_ss.rate = m->o_ss.rate = 48000;
+    m->i_ss.channels = (uint8_t) i_channels;
+    m->o_ss.channels = (uint8_t) o_channels;
+
+    /* Spread the inputs over more outputs, or average them into fewer */
+    for (oc = 0; oc < o_channels; oc++) {
+        for (ic = 0; ic < i_channels; ic++) {
+            if (i_channels <= o_channels)
+                m->map_table_f[oc][ic] = oc % i_channels == ic ? 1.0f : 0.0f;
+            else
+                m->map_table_f[oc][ic] = ic % o_channels == oc ? (float) o_channels / i_channels : 0.0f;
+
+            m->map_table_i[oc][ic] = (int32_t) (m->map_table_f[oc][ic] * 0x10000);
+        }
+    }
+}
+
+static void bench_init(struct bench *b, const pa_sample_spec *ss) {
+    unsigned channels = PA_MAX(ss->channels, 2);
+    size_t size = BENCH_FRAMES * channels * sizeof(float);
+    unsigned i;
+    uint32_t r = 1;
+
+    pa_zero(*b);
+    b->format = ss->format;
+    b->channels = ss->channels;
+    b->n_samples = BENCH_FRAMES * ss->channels;
+
+    b->samples = pa_xmalloc(size);
+    b->samples2 = pa_xmalloc(size);
+    b->out = pa_xmalloc(size);
+    b->floats = pa_xmalloc(size);
+
+    /* Noise between -0.5 and 0.5 */
+    for (i = 0; i < BENCH_FRAMES * channels; i++) {
+        r = r * 1103515245 + 12345;
+        b->floats[i] = (float) (r >> 8) / (1 << 24) - 0.5f;
+    }
+
+    pa_get_convert_from_float32ne_function(b->format)(b->n_samples, b->floats, b->samples);
+    memcpy(b->samples2, b->samples, size);
+
+    /* Unity gain, so that the samples don't change when applying the
+     * volume over and over */
+    for (i = 0; i < PA_ELEMENTSOF(b->volumes); i++) {
+        if (b->format == PA_SAMPLE_FLOAT32NE || b->format == PA_SAMPLE_FLOAT32RE)
+            b->volumes[i].f = 1.0f;
+        else
+            b->volumes[i].i = 0x10000;
+    }
+
+    for (i = 0; i < PA_CHANNELS_MAX; i++) {
+        if (b->format == PA_SAMPLE_FLOAT32NE || b->format == PA_SAMPLE_FLOAT32RE) {
+            b->streams[0].linear[i].f = 0.5f;
+            b->streams[1].linear[i].f = 0.5f;
+        } else {
+            b->streams[0].linear[i].i = 0x8000;
+            b->streams[1].linear[i].i = 0x8000;
+        }
+    }
+
+    if (ss->channels == 2) {
+        remap_setup(&b->remaps[0], remap_format(b->format), 1, 2);
+        remap_setup(&b->remaps[1], remap_format(b->format), 2, 1);
+    } else {
+        remap_setup(&b->remaps[0], remap_format(b->format), 2, ss->channels);
+        remap_setup(&b->remaps[1], remap_format(b->format), ss->channels, 2);
+    }
+}
+
+static void bench_done(struct bench *b) {
+    pa_xfree(b->samples);
+    pa_xfree(b->samples2);
+    pa_xfree(b->out);
+    pa_xfree(b->floats);
+}
+
+static void bench_run(slot_kind_t kind, struct bench *b, any_func_t func) {
+    size_t length = b->n_samples * pa_sample_size_of_format(b->format);
+    unsigned i;
+
+    switch (kind) {
+        case SLOT_MIX:
+            b->streams[0].ptr = b->samples;
+            b->streams[1].ptr = b->samples2;
+            ((pa_do_mix_func_t) func)(b->streams, 2, b->channels, b->out, length);
+            break;
+        case SLOT_VOLUME:
+            ((pa_do_volume_func_t) func)(b->samples, b->volumes, b->channels, length);
+            break;
+        case SLOT_TO_FLOAT32:
+            ((pa_convert_func_t) func)(b->n_samples, b->samples, b->out);
+            break;
+        case SLOT_FROM_FLOAT32:
+            ((pa_convert_func_t) func)(b->n_samples, b->floats, b->out);
+            break;
+        case SLOT_REMAP:
+            for (i = 0; i < PA_ELEMENTSOF(b->remaps); i++)
+                b->remaps[i].do_remap(&b->remaps[i], b->out, b->floats, BENCH_FRAMES);
+            break;
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+static pa_usec_t bench_time(slot_kind_t kind, struct bench *b, any_func_t func) {
+    pa_usec_t best = (pa_usec_t) -1;
+    unsigned round, i;
+
+    /* The remapping functions are picked by the init function */
+    if (kind == SLOT_REMAP) {
+        pa_init_remap_func_t saved = pa_get_init_remap_func();
+
+        pa_set_init_remap_func((pa_init_remap_func_t) func);
+        for (i = 0; i < PA_ELEMENTSOF(b->remaps); i++)
+            pa_init_remap_func(&b->remaps[i]);
+        pa_set_init_remap_func(saved);
+    }
+
+    /* Once to warm up the caches */
+    bench_run(kind, b, func);
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        pa_usec_t start = pa_rtclock_now(), t;
+
+        for (i = 0; i < BENCH_ITERATIONS; i++)
+            bench_run(kind, b, func);
+
+        t = pa_rtclock_now() - start;
+        best = PA_MIN(best, t);
+    }
+
+    if (kind == SLOT_REMAP) {
+        for (i = 0; i < PA_ELEMENTSOF(b->remaps); i++) {
+            pa_xfree(b->remaps[i].state);
+            b->remaps[i].state = NULL;
+        }
+    }
+
+    return best;
+}
+
+static char *get_cpu_model(void) {
+    static const char * const tags[] = { "model name", "Processor", "Hardware", "cpu model" };
+    char line[256], *model = NULL;
+    FILE *f;
+
+    if (!(f = pa_fopen_cloexec("/proc/cpuinfo", "r")))
+        return pa_xstrdup("unknown");
+
+    while (!model && fgets(line, sizeof(line), f)) {
+        char *colon;
+        unsigned i;
+
+        if (!(colon = strchr(line, ':')))
+            continue;
+
+        for (i = 0; i < PA_ELEMENTSOF(tags); i++) {
+            if (strncmp(line, tags[i], strlen(tags[i])) == 0) {
+                model = pa_xstrdup(pa_strip(colon + 1));
+                break;
+            }
+        }
+    }
+
+    fclose(f);
+
+    return model ? model : pa_xstrdup("unknown");
+}
+
+/* The first lines identify the CPU and sample spec the choice was made
+ * for, the others hold one function=implementation pair each */
+static char *cache_header(const pa_cpu_info *cpu_info, const pa_sample_spec *ss) {
+    char *model = get_cpu_model(), *h;
+
+    h = pa_sprintf_malloc("cpu = %s\nflags = 0x%x %u\nspec = %s %u\n",
+                          model, (unsigned) cpu_info->flags.x86, (unsigned) cpu_info->cpu_type,
+                          pa_sample_format_to_string(ss->format), ss->channels);
+    pa_xfree(model);
+
+    return h;
+}
+
+static bool cache_load(const char *path, const char *header, const pa_sample_spec *ss) {
+    const struct candidate *chosen[SLOT_MAX] = { NULL };
+    char line[256];
+    pa_strbuf *buf;
+    char *h;
+    unsigned k, n_header = 0;
+    bool ok = true;
+    FILE *f;
+
+    if (!(f = pa_fopen_cloexec(path, "r"))) {
+        if (errno != ENOENT)
+            pa_log_warn("Failed to open %s: %s", path, pa_cstrerror(errno));
+        return false;
+    }
+
+    buf = pa_strbuf_new();
+
+    while (fgets(line, sizeof(line), f)) {
+        char *eq, *key, *value;
+
+        if (n_header < 3) {
+            pa_strbuf_puts(buf, line);
+            n_header++;
+            continue;
+        }
+
+        if (!(eq = strchr(line, '=')))
+            continue;
+
+        *eq = 0;
+        key = pa_strip(line);
+        value = pa_strip(eq + 1);
+
+        for (k = 0; k < SLOT_MAX; k++) {
+            char *sk;
+
+            if (!slot_used(k, ss))
+                continue;
+
+            sk = slot_key(k, ss);
+            if (pa_streq(sk, key))
+                chosen[k] = find_by_name(&slots[k][slot_format(k, ss)], value);
+            pa_xfree(sk);
+        }
+    }
+
+    fclose(f);
+
+    h = pa_strbuf_tostring_free(buf);
+    if (!pa_streq(h, header))
+        ok = false;
+    pa_xfree(h);
+
+    /* Every function with a choice must have a known implementation */
+    for (k = 0; ok && k < SLOT_MAX; k++)
+        if (slot_used(k, ss) && slots[k][slot_format(k, ss)].n_candidates > 1 && !chosen[k])
+            ok = false;
+
+    if (!ok) {
+        pa_log_info("CPU autotune cache %s is out of date.", path);
+        return false;
+    }
+
+    for (k = 0; k < SLOT_MAX; k++) {
+        if (!chosen[k])
+            continue;
+
+        pa_log_debug("Using cached %s implementation for %s.", chosen[k]->name, slot_names[k]);
+        set_func(k, slot_format(k, ss), chosen[k]->func);
+    }
+
+    return true;
+}
+
+static void cache_save(const char *path, const char *header, const pa_sample_spec *ss) {
+    char *s, *selection;
+    FILE *f;
+
+    selection = pa_cpu_autotune_selection(ss);
+    s = pa_sprintf_malloc("%s%s\n", header, selection);
+    pa_xfree(selection);
+
+    /* One pair per line */
+    for (selection = s + strlen(header); *selection; selection++)
+        if (*selection == ' ')
+            *selection = '\n';
+
+    if (!(f = pa_fopen_cloexec(path, "w"))) {
+        pa_log_warn("Failed to write %s: %s", path, pa_cstrerror(errno));
+        pa_xfree(s);
+        return;
+    }
+
+    fputs(s, f);
+    fclose(f);
+    pa_xfree(s);
+}
+
+void pa_cpu_autotune(const pa_cpu_info *cpu_info, const pa_sample_spec *ss, const char *cache_path) {
+    struct bench b;
+    char *header = NULL;
+    unsigned k;
+
+    pa_assert(cpu_info);
+    pa_assert(ss);
+    pa_assert(pa_sample_spec_valid(ss));
+
+    if (cache_path) {
+        header = cache_header(cpu_info, ss);
+
+        if (cache_load(cache_path, header, ss)) {
+            pa_xfree(header);
+            return;
+        }
+    }
+
+    pa_log_info("Timing the optimized functions for %s %uch.", pa_sample_format_to_string(ss->format), ss->channels);
+
+    bench_init(&b, ss);
+
+    for (k = 0; k < SLOT_MAX; k++) {
+        const struct slot *s = &slots[k][slot_format(k, ss)];
+        const struct candidate *best = NULL;
+        pa_usec_t best_t = 0;
+        unsigned i;
+
+        if (!slot_used(k, ss) || s->n_candidates < 2)
+            continue;
+
+        for (i = 0; i < s->n_candidates; i++) {
+            pa_usec_t t = bench_time(k, &b, s->candidates[i].func);
+
+            pa_log_debug("%s %s: %llu usec", slot_names[k], s->candidates[i].name, (unsigned long long) t);
+
+            if (!best || t < best_t) {
+                best = s->candidates + i;
+                best_t = t;
+            }
+        }
+
+        pa_log_info("Using %s implementation for %s.", best->name, slot_names[k]);
+        set_func(k, slot_format(k, ss), best->func);
+    }
+
+    bench_done(&b);
+
+    if (cache_path)
+        cache_save(cache_path, header, ss);
+
+    pa_xfree(header);
+}
+
+char *pa_cpu_autotune_selection(const pa_sample_spec *ss) {
+    pa_strbuf *buf;
+    unsigned k;
+
+    pa_assert(ss);
+
+    buf = pa_strbuf_new();
+
+    for (k = 0; k < SLOT_MAX; k++) {
+        pa_sample_format_t f = slot_format(k, ss);
+        const struct candidate *c;
+        char *key;
+
+        if (!slot_used(k, ss) || !(c = find_by_func(&slots[k][f], get_func(k, f))))
+            continue;
+
+        key = slot_key(k, ss);
+        pa_strbuf_printf(buf, "%s%s=%s", pa_strbuf_isempty(buf) ? "" : " ", key, c->name);
+        pa_xfree(key);
+    }
+
+    return pa_strbuf_tostring_free(buf);
+}
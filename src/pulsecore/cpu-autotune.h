@@ -0,0 +1,42 @@
+#ifndef foocpuautotunehfoo
+#define foocpuautotunehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/cpu.h>
+
+/* Records the mixing, remapping, conversion and volume functions the
+ * CPU init code installed since the previous call as implementations
+ * named name. pa_cpu_init() calls this after the generic functions and
+ * after each group of optimized ones. */
+void pa_cpu_autotune_stage(const char *name);
+
+/* Times all recorded implementations for the format and channel count
+ * of ss and installs the fastest ones. If cache_path is not NULL the
+ * choice is read from there when it was made on the same CPU, and
+ * written there otherwise. */
+void pa_cpu_autotune(const pa_cpu_info *cpu_info, const pa_sample_spec *ss, const char *cache_path);
+
+/* Returns the implementations currently installed for the format of
+ * ss, as space separated function=implementation pairs. Free with
+ * pa_xfree(). */
+char *pa_cpu_autotune_selection(const pa_sample_spec *ss);
+
+#endif
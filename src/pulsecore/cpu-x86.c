@@ -27,6 +27,7 @@
 #include <pulsecore/log.h>
 
 #include "cpu-x86.h"
+#include "cpu-autotune.h"
 
 #if defined (__i386__) || defined (__amd64__)
 static void get_cpuid(uint32_t op, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
@@ -40,6 +41,31 @@ static void get_cpuid(uint32_t op, uint32_t *a, uint32_t *b, uint32_t *c, uint32
         : "0" (op)
     );
 }
+
+static void get_cpuid_count(uint32_t op, uint32_t count, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ __volatile__ (
+        "  push %%"PA_REG_b"   \n\t"
+        "  cpuid               \n\t"
+        "  mov %%ebx, %%esi    \n\t"
+        "  pop %%"PA_REG_b"    \n\t"
+
+        : "=a" (*a), "=S" (*b), "=c" (*c), "=d" (*d)
+        : "0" (op), "2" (count)
+    );
+}
+
+/* Returns which register state the OS saves on context switches */
+static uint32_t get_xcr0(void) {
+    uint32_t eax, edx;
+
+    __asm__ __volatile__ (
+        "  .byte 0x0f, 0x01, 0xd0 \n\t" /* xgetbv */
+        : "=a" (eax), "=d" (edx)
+        : "c" (0)
+    );
+
+    return eax;
+}
 #endif
 
 void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
@@ -77,6 +103,26 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
 
         if (ecx & (1<<20))
           *flags |= PA_CPU_X86_SSE4_2;
+
+        /* AVX needs the OS to save the YMM registers, AVX-512 the ZMM
+         * and opmask registers, too */
+        if ((ecx & (1<<27)) && (ecx & (1<<28))) {
+            uint32_t xcr0 = get_xcr0();
+
+            if ((xcr0 & 0x06) == 0x06) {
+                *flags |= PA_CPU_X86_AVX;
+
+                if (level >= 7) {
+                    get_cpuid_count(0x00000007, 0, &eax, &ebx, &ecx, &edx);
+
+                    if (ebx & (1<<5))
+                      *flags |= PA_CPU_X86_AVX2;
+
+                    if ((ebx & (1<<16)) && (xcr0 & 0xE0) == 0xE0)
+                      *flags |= PA_CPU_X86_AVX512F;
+                }
+            }
+        }
     }
 
     /* get extended level */
@@ -97,7 +143,7 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
           *flags |= PA_CPU_X86_3DNOW;
     }
 
-    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s",
+    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s%s%s%s",
     (*flags & PA_CPU_X86_CMOV) ? "CMOV " : "",
     (*flags & PA_CPU_X86_MMX) ? "MMX " : "",
     (*flags & PA_CPU_X86_SSE) ? "SSE " : "",
@@ -106,6 +152,9 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
     (*flags & PA_CPU_X86_SSSE3) ? "SSSE3 " : "",
     (*flags & PA_CPU_X86_SSE4_1) ? "SSE4_1 " : "",
     (*flags & PA_CPU_X86_SSE4_2) ? "SSE4_2 " : "",
+    (*flags & PA_CPU_X86_AVX) ? "AVX " : "",
+    (*flags & PA_CPU_X86_AVX2) ? "AVX2 " : "",
+    (*flags & PA_CPU_X86_AVX512F) ? "AVX512F " : "",
     (*flags & PA_CPU_X86_MMXEXT) ? "MMXEXT " : "",
     (*flags & PA_CPU_X86_3DNOW) ? "3DNOW " : "",
     (*flags & PA_CPU_X86_3DNOWEXT) ? "3DNOWEXT " : "");
@@ -120,14 +169,37 @@ bool pa_cpu_init_x86(pa_cpu_x86_flag_t *flags) {
     if (*flags & PA_CPU_X86_MMX) {
         pa_volume_func_init_mmx(*flags);
         pa_remap_func_init_mmx(*flags);
+        pa_cpu_autotune_stage("mmx");
     }
 
     if (*flags & (PA_CPU_X86_SSE | PA_CPU_X86_SSE2)) {
         pa_volume_func_init_sse(*flags);
         pa_remap_func_init_sse(*flags);
         pa_convert_func_init_sse(*flags);
+        pa_cpu_autotune_stage("sse");
     }
 
+#ifdef HAVE_SSE4_1
+    pa_mix_func_init_sse4(*flags);
+    pa_remap_func_init_sse4(*flags);
+    pa_polyphase_func_init_sse4(*flags);
+    pa_convert_func_init_sse4(*flags);
+    pa_cpu_autotune_stage("sse4.1");
+#endif
+#ifdef HAVE_AVX2
+    pa_mix_func_init_avx2(*flags);
+    pa_remap_func_init_avx2(*flags);
+    pa_polyphase_func_init_avx2(*flags);
+    pa_convert_func_init_avx2(*flags);
+    pa_volume_func_init_avx2(*flags);
+    pa_cpu_autotune_stage("avx2");
+#endif
+#ifdef HAVE_AVX512F
+    pa_mix_func_init_avx512(*flags);
+    pa_volume_func_init_avx512(*flags);
+    pa_cpu_autotune_stage("avx512");
+#endif
+
     return true;
 #else /* defined (__i386__) || defined (__amd64__) */
     return false;
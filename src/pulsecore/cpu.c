@@ -19,20 +19,28 @@
 #endif
 
 #include "cpu.h"
+#include "cpu-autotune.h"
 #include "cpu-orc.h"
 
 void pa_cpu_init(pa_cpu_info *cpu_info) {
     cpu_info->cpu_type = PA_CPU_UNDEFINED;
     /* don't force generic code, used for testing only */
     cpu_info->force_generic_code = false;
+
+    /* Set up the generic mixing functions first, so that the optimized
+     * ones replacing them can use them as fallback */
+    pa_mix_func_init(cpu_info);
+    pa_volume_func_init(cpu_info);
+    pa_cpu_autotune_stage("generic");
+
     if (!getenv("PULSE_NO_SIMD")) {
         if (pa_cpu_init_x86(&cpu_info->flags.x86))
             cpu_info->cpu_type = PA_CPU_X86;
         else if (pa_cpu_init_arm(&cpu_info->flags.arm))
             cpu_info->cpu_type = PA_CPU_ARM;
-        pa_cpu_init_orc(*cpu_info);
+        if (pa_cpu_init_orc(*cpu_info))
+            pa_cpu_autotune_stage("orc");
     }
 
     pa_remap_func_init(cpu_info);
-    pa_mix_func_init(cpu_info);
 }
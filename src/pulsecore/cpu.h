@@ -45,5 +45,6 @@ void pa_cpu_init(pa_cpu_info *cpu_info);
 
 void pa_remap_func_init(const pa_cpu_info *cpu_info);
 void pa_mix_func_init(const pa_cpu_info *cpu_info);
+void pa_volume_func_init(const pa_cpu_info *cpu_info);
 
 #endif /* foocpuhfoo */
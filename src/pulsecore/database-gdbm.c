@@ -27,6 +27,7 @@
 #include <pulse/xmalloc.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
+#include <pulsecore/startup-trace.h>
 
 #include "database.h"
 
@@ -63,9 +64,12 @@ pa_database* pa_database_open(const char *fn, bool for_write) {
     GDBM_FILE f;
     int gdbm_cache_size;
     char *path;
+    pa_usec_t begin;
 
     pa_assert(fn);
 
+    begin = pa_startup_trace_begin();
+
     /* We include the host identifier in the file name because gdbm
      * files are CPU dependent, and we don't want things to go wrong
      * if we are on a multiarch system. */
@@ -80,6 +84,7 @@ pa_database* pa_database_open(const char *fn, bool for_write) {
     if (f)
         pa_log_debug("Opened GDBM database '%s'", path);
 
+    pa_startup_trace_end(begin, "database", path);
     pa_xfree(path);
 
     if (!f) {
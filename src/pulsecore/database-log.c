@@ -0,0 +1,830 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/startup-trace.h>
+#include <pulsecore/thread.h>
+
+#include "database.h"
+
+/* An append-only log of records. Every set and unset appends a record,
+ * so saving costs as much as what changed rather than as much as the whole
+ * database. pa_database_sync() hands the records to a writer thread, which
+ * writes and fsyncs them, so the main loop never waits for the disk. Syncs
+ * that happen while the writer is busy are written as one batch. When most
+ * of the file is made of records that were overwritten later, the writer
+ * writes the live entries to a new file, which then replaces the log.
+ *
+ * The file starts with LOG_MAGIC, followed by records made of the key size
+ * and the data size as native 32 bit integers, the key and the data. A data
+ * size of RECORD_UNSET marks a removed key and has no data. A record that
+ * was only partially written is dropped when loading. */
+
+#define LOG_MAGIC "PADBLOG1"
+#define LOG_MAGIC_SIZE 8
+#define RECORD_HEADER_SIZE 8
+#define RECORD_UNSET ((uint32_t) -1)
+
+/* Compact when the log grew to more than twice the size of its live
+ * entries, but leave small files alone */
+#define COMPACT_MIN_SIZE (256*1024)
+
+#define WRITE_CHUNK_SIZE (64*1024)
+
+typedef struct entry {
+    PA_REFCNT_DECLARE;
+    pa_datum key;
+    pa_datum data;
+} entry;
+
+typedef struct buffer {
+    uint8_t *data;
+    size_t length;
+    size_t allocated;
+} buffer;
+
+typedef struct log_data {
+    char *filename;
+    char *tmp_filename;
+    bool read_only;
+    pa_hashmap *map;
+
+    /* The position of the entry last returned by pa_database_first() or
+     * pa_database_next(), so that walking the database is not quadratic */
+    void *iterate_state;
+    entry *iterate_entry;
+
+    /* Records not yet handed to the writer */
+    buffer records;
+
+    /* The size of the records of the live entries */
+    uint64_t live_size;
+
+    /* The writer. The file is only accessed by the writer thread once it
+     * runs, everything else below is protected by the mutex. */
+    pa_thread *thread;
+    pa_mutex *mutex;
+    pa_cond *cond;
+    int fd;
+    uint64_t log_size;
+
+    /* Records handed over by pa_database_sync() */
+    buffer queued;
+
+    /* The live entries for a compaction that the writer did not start yet.
+     * The first snapshot_offset bytes of queued were already part of the
+     * state that was taken. The entries are immutable, so the writer can
+     * read them while the main thread goes on. */
+    entry **snapshot;
+    unsigned n_snapshot;
+    size_t snapshot_offset;
+
+    bool compacting;
+    /* A write failed, so the whole file should be written again */
+    bool rewrite;
+    bool quit;
+} log_data;
+
+void pa_datum_free(pa_datum *d) {
+    pa_assert(d);
+
+    pa_xfree(d->data);
+    d->data = NULL;
+    d->size = 0;
+}
+
+static int compare_func(const void *a, const void *b) {
+    const pa_datum *aa, *bb;
+
+    aa = (const pa_datum*)a;
+    bb = (const pa_datum*)b;
+
+    if (aa->size != bb->size)
+        return aa->size > bb->size ? 1 : -1;
+
+    return memcmp(aa->data, bb->data, aa->size);
+}
+
+/* pa_idxset_string_hash_func modified for our use */
+static unsigned hash_func(const void *p) {
+    const pa_datum *d;
+    unsigned hash = 0;
+    const char *c;
+    unsigned i;
+
+    d = (const pa_datum*)p;
+    c = d->data;
+
+    for (i = 0; i < d->size; i++) {
+        hash = 31 * hash + (unsigned) *c;
+        c++;
+    }
+
+    return hash;
+}
+
+static entry* entry_new(const void *key, size_t key_size, const void *data, size_t data_size) {
+    entry *e;
+    uint8_t *p;
+
+    e = pa_xmalloc(PA_ALIGN(sizeof(entry)) + key_size + data_size);
+    PA_REFCNT_INIT(e);
+
+    p = (uint8_t*) e + PA_ALIGN(sizeof(entry));
+    e->key.data = key_size > 0 ? memcpy(p, key, key_size) : NULL;
+    e->key.size = key_size;
+    e->data.data = data_size > 0 ? memcpy(p + key_size, data, data_size) : NULL;
+    e->data.size = data_size;
+
+    return e;
+}
+
+static void entry_unref(entry *e) {
+    pa_assert(e);
+    pa_assert(PA_REFCNT_VALUE(e) >= 1);
+
+    if (PA_REFCNT_DEC(e) <= 0)
+        pa_xfree(e);
+}
+
+static uint64_t entry_record_size(const entry *e) {
+    return RECORD_HEADER_SIZE + e->key.size + e->data.size;
+}
+
+static void datum_copy(pa_datum *dst, const pa_datum *src) {
+    dst->data = src->size > 0 ? pa_xmemdup(src->data, src->size) : NULL;
+    dst->size = src->size;
+}
+
+static void buffer_append(buffer *b, const void *p, size_t n) {
+    if (n <= 0)
+        return;
+
+    if (b->length + n > b->allocated) {
+        b->allocated = PA_MAX(b->length + n, PA_MAX(b->allocated * 2, (size_t) 4096));
+        b->data = pa_xrealloc(b->data, b->allocated);
+    }
+
+    memcpy(b->data + b->length, p, n);
+    b->length += n;
+}
+
+static void buffer_append_record(buffer *b, const pa_datum *key, const pa_datum *data) {
+    uint32_t header[2];
+
+    header[0] = (uint32_t) key->size;
+    header[1] = data ? (uint32_t) data->size : RECORD_UNSET;
+
+    buffer_append(b, header, sizeof(header));
+    buffer_append(b, key->data, key->size);
+
+    if (data)
+        buffer_append(b, data->data, data->size);
+}
+
+static void put_entry(log_data *db, entry *e) {
+    entry *old;
+
+    if ((old = pa_hashmap_remove(db->map, &e->key))) {
+        db->live_size -= entry_record_size(old);
+        entry_unref(old);
+    }
+
+    pa_hashmap_put(db->map, &e->key, e);
+    db->live_size += entry_record_size(e);
+
+    /* Adding entries may move the others around */
+    db->iterate_entry = NULL;
+}
+
+static void remove_entry(log_data *db, const pa_datum *key) {
+    entry *e;
+
+    if (!(e = pa_hashmap_remove(db->map, key)))
+        return;
+
+    if (db->iterate_entry == e)
+        db->iterate_entry = NULL;
+
+    db->live_size -= entry_record_size(e);
+    entry_unref(e);
+}
+
+static void free_snapshot(entry **snapshot, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        entry_unref(snapshot[i]);
+
+    pa_xfree(snapshot);
+}
+
+static int write_buffer(int fd, const uint8_t *p, size_t n) {
+    if (n <= 0)
+        return 0;
+
+    return pa_loop_write(fd, p, n, NULL) == (ssize_t) n ? 0 : -1;
+}
+
+/* Called from the writer thread. Appends queued records to the log. */
+static int write_batch(log_data *db, uint64_t *log_size, const uint8_t *p, size_t n) {
+    if (write_buffer(db->fd, p, n) < 0 || fsync(db->fd) < 0) {
+        pa_log_warn("Failed to write %s: %s", db->filename, pa_cstrerror(errno));
+
+        /* Don't leave a partial record before the ones written next */
+        if (ftruncate(db->fd, (off_t) *log_size) < 0)
+            pa_log_warn("Failed to truncate %s: %s", db->filename, pa_cstrerror(errno));
+
+        return -1;
+    }
+
+    *log_size += n;
+
+    return 0;
+}
+
+/* Called from the writer thread. Writes the snapshot and the records that
+ * followed it to a new file, which replaces the log. */
+static int compact(log_data *db, uint64_t *log_size, entry **snapshot, unsigned n_snapshot, const uint8_t *p, size_t n) {
+    buffer b = { NULL, 0, 0 };
+    uint64_t size = 0;
+    unsigned i;
+    int fd;
+
+    if ((fd = pa_open_cloexec(db->tmp_filename, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 0666)) < 0) {
+        pa_log_warn("Failed to create %s: %s", db->tmp_filename, pa_cstrerror(errno));
+        return -1;
+    }
+
+    buffer_append(&b, LOG_MAGIC, LOG_MAGIC_SIZE);
+
+    for (i = 0; i < n_snapshot; i++) {
+        buffer_append_record(&b, &snapshot[i]->key, &snapshot[i]->data);
+
+        if (b.length >= WRITE_CHUNK_SIZE) {
+            if (write_buffer(fd, b.data, b.length) < 0)
+                goto fail;
+
+            size += b.length;
+            b.length = 0;
+        }
+    }
+
+    buffer_append(&b, p, n);
+
+    if (write_buffer(fd, b.data, b.length) < 0)
+        goto fail;
+
+    size += b.length;
+
+    /* Make sure the new file is on disk before it replaces the log */
+    if (fsync(fd) < 0)
+        goto fail;
+
+    if (rename(db->tmp_filename, db->filename) < 0)
+        goto fail;
+
+    pa_log_debug("Compacted %s from %llu to %llu bytes.", db->filename,
+                 (unsigned long long) *log_size, (unsigned long long) size);
+
+    pa_xfree(b.data);
+    pa_close(db->fd);
+    db->fd = fd;
+    *log_size = size;
+
+    return 0;
+
+fail:
+    pa_log_warn("Failed to write %s: %s", db->tmp_filename, pa_cstrerror(errno));
+    pa_xfree(b.data);
+    pa_close(fd);
+    unlink(db->tmp_filename);
+
+    return -1;
+}
+
+static void writer_thread(void *userdata) {
+    log_data *db = userdata;
+    buffer batch = { NULL, 0, 0 };
+
+    pa_mutex_lock(db->mutex);
+
+    for (;;) {
+        buffer tmp;
+        entry **snapshot;
+        unsigned n_snapshot;
+        size_t snapshot_offset;
+        uint64_t log_size;
+        int r;
+
+        if (db->queued.length <= 0 && !db->snapshot) {
+            if (db->quit)
+                break;
+
+            pa_cond_wait(db->cond, db->mutex);
+            continue;
+        }
+
+        /* Take everything that was queued while the last batch was
+         * written */
+        tmp = batch;
+        batch = db->queued;
+        db->queued = tmp;
+        db->queued.length = 0;
+
+        snapshot = db->snapshot;
+        n_snapshot = db->n_snapshot;
+        snapshot_offset = db->snapshot_offset;
+        db->snapshot = NULL;
+        db->compacting = !!snapshot;
+
+        log_size = db->log_size;
+
+        pa_mutex_unlock(db->mutex);
+
+        if (snapshot) {
+            /* The records before the snapshot are part of it already */
+            r = compact(db, &log_size, snapshot, n_snapshot, batch.data + snapshot_offset, batch.length - snapshot_offset);
+
+            if (r < 0)
+                r = write_batch(db, &log_size, batch.data, batch.length);
+
+            free_snapshot(snapshot, n_snapshot);
+        } else
+            r = write_batch(db, &log_size, batch.data, batch.length);
+
+        pa_mutex_lock(db->mutex);
+
+        db->log_size = log_size;
+        db->compacting = false;
+
+        if (r < 0)
+            db->rewrite = true;
+    }
+
+    pa_mutex_unlock(db->mutex);
+
+    pa_xfree(batch.data);
+}
+
+/* Called with the mutex held. Takes the live entries for the writer to
+ * replace the log with. */
+static void request_compaction(log_data *db) {
+    void *state;
+    entry *e;
+
+    if (db->snapshot)
+        free_snapshot(db->snapshot, db->n_snapshot);
+
+    db->snapshot = pa_xnew(entry*, PA_MAX(pa_hashmap_size(db->map), 1U));
+    db->n_snapshot = 0;
+    db->snapshot_offset = db->queued.length;
+    db->rewrite = false;
+
+    PA_HASHMAP_FOREACH(e, db->map, state) {
+        PA_REFCNT_INC(e);
+        db->snapshot[db->n_snapshot++] = e;
+    }
+}
+
+/* Called with the mutex held */
+static void queue_records(log_data *db) {
+    if (db->records.length <= 0)
+        return;
+
+    if (db->queued.length <= 0) {
+        buffer tmp;
+
+        tmp = db->queued;
+        db->queued = db->records;
+        db->records = tmp;
+    } else
+        buffer_append(&db->queued, db->records.data, db->records.length);
+
+    db->records.length = 0;
+}
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void *map_file(int fd, size_t *size) {
+    struct stat st;
+    void *p;
+
+    if (fstat(fd, &st) < 0 || st.st_size <= 0 || (uint64_t) st.st_size > SIZE_MAX)
+        return NULL;
+
+    if ((p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        return NULL;
+
+    *size = (size_t) st.st_size;
+    return p;
+}
+
+/* Returns the size of the valid part of the log */
+static size_t load_log(log_data *db, int fd) {
+    const uint8_t *p;
+    size_t size, offset;
+
+    if (!(p = map_file(fd, &size)))
+        return 0;
+
+    if (size < LOG_MAGIC_SIZE || memcmp(p, LOG_MAGIC, LOG_MAGIC_SIZE) != 0) {
+        pa_log_warn("%s is not a database log, ignoring it.", db->filename);
+        munmap((void*) p, size);
+        return 0;
+    }
+
+    offset = LOG_MAGIC_SIZE;
+
+    while (size - offset >= RECORD_HEADER_SIZE) {
+        uint32_t header[2];
+        pa_datum key;
+
+        memcpy(header, p + offset, sizeof(header));
+
+        if (header[0] > size - offset - RECORD_HEADER_SIZE)
+            break;
+
+        if (header[1] != RECORD_UNSET && header[1] > size - offset - RECORD_HEADER_SIZE - header[0])
+            break;
+
+        key.data = (void*) (p + offset + RECORD_HEADER_SIZE);
+        key.size = header[0];
+
+        if (header[1] == RECORD_UNSET) {
+            remove_entry(db, &key);
+            offset += RECORD_HEADER_SIZE + header[0];
+        } else {
+            put_entry(db, entry_new(key.data, key.size, (const uint8_t*) key.data + key.size, header[1]));
+            offset += RECORD_HEADER_SIZE + header[0] + header[1];
+        }
+    }
+
+    if (offset < size)
+        pa_log_warn("Dropping %lu bytes at the end of %s.", (unsigned long) (size - offset), db->filename);
+
+    munmap((void*) p, size);
+
+    return offset;
+}
+
+/* Read the file of the simple backend, which was the default before, so
+ * that nothing is lost when switching. The records are appended to the
+ * log on the next sync. */
+static void import_simple(log_data *db, const char *fn) {
+    char *path;
+    int fd;
+    const uint8_t *p;
+    size_t size, offset = 0;
+
+    path = pa_sprintf_malloc("%s."CANONICAL_HOST".simple", fn);
+    fd = pa_open_cloexec(path, O_RDONLY, 0);
+
+    if (fd < 0 || !(p = map_file(fd, &size))) {
+        if (fd >= 0)
+            pa_close(fd);
+        pa_xfree(path);
+        return;
+    }
+
+    for (;;) {
+        pa_datum key, data;
+
+        if (size - offset < 4 || (key.size = read_le32(p + offset)) <= 0 || key.size > size - offset - 4)
+            break;
+
+        key.data = (void*) (p + offset + 4);
+        offset += 4 + key.size;
+
+        if (size - offset < 4 || (data.size = read_le32(p + offset)) <= 0 || data.size > size - offset - 4)
+            break;
+
+        data.data = (void*) (p + offset + 4);
+        offset += 4 + data.size;
+
+        put_entry(db, entry_new(key.data, key.size, data.data, data.size));
+        buffer_append_record(&db->records, &key, &data);
+    }
+
+    pa_log_info("Imported %u entries from %s.", pa_hashmap_size(db->map), path);
+
+    munmap((void*) p, size);
+    pa_close(fd);
+    pa_xfree(path);
+}
+
+pa_database* pa_database_open(const char *fn, bool for_write) {
+    char *path;
+    log_data *db;
+    int fd;
+    size_t valid;
+    bool exists = true;
+    pa_usec_t begin;
+
+    pa_assert(fn);
+
+    begin = pa_startup_trace_begin();
+
+    path = pa_sprintf_malloc("%s."CANONICAL_HOST".log", fn);
+
+    if ((fd = pa_open_cloexec(path, for_write ? O_RDWR|O_APPEND : O_RDONLY, 0)) < 0) {
+        if (errno != ENOENT) {
+            pa_xfree(path);
+            return NULL;
+        }
+
+        exists = false;
+
+        if (for_write && (fd = pa_open_cloexec(path, O_RDWR|O_APPEND|O_CREAT, 0666)) < 0) {
+            pa_xfree(path);
+            return NULL;
+        }
+    }
+
+    db = pa_xnew0(log_data, 1);
+    db->map = pa_hashmap_new_full(hash_func, compare_func, NULL, (pa_free_cb_t) entry_unref);
+    db->filename = path;
+    db->tmp_filename = pa_sprintf_malloc("%s.tmp", path);
+    db->read_only = !for_write;
+    db->fd = -1;
+
+    if (exists)
+        valid = load_log(db, fd);
+    else {
+        valid = 0;
+        import_simple(db, fn);
+    }
+
+    pa_startup_trace_end(begin, "database", path);
+
+    if (!for_write) {
+        if (fd >= 0)
+            pa_close(fd);
+
+        db->records.length = 0;
+        return (pa_database*) db;
+    }
+
+    db->fd = fd;
+
+    if (valid <= 0) {
+        /* A new or unusable file, start over */
+        if (ftruncate(fd, 0) < 0 || pa_loop_write(fd, LOG_MAGIC, LOG_MAGIC_SIZE, NULL) != LOG_MAGIC_SIZE) {
+            pa_log_warn("Failed to initialize %s: %s", path, pa_cstrerror(errno));
+            pa_database_close((pa_database*) db);
+            errno = EIO;
+            return NULL;
+        }
+
+        valid = LOG_MAGIC_SIZE;
+
+    } else if (ftruncate(fd, (off_t) valid) < 0)
+        pa_log_warn("Failed to truncate %s: %s", path, pa_cstrerror(errno));
+
+    db->log_size = valid;
+
+    db->mutex = pa_mutex_new(false, false);
+    db->cond = pa_cond_new();
+
+    if (!(db->thread = pa_thread_new("database", writer_thread, db))) {
+        pa_log_warn("Failed to create the writer thread for %s.", path);
+        pa_database_close((pa_database*) db);
+        errno = EIO;
+        return NULL;
+    }
+
+    return (pa_database*) db;
+}
+
+void pa_database_close(pa_database *database) {
+    log_data *db = (log_data*)database;
+    pa_assert(db);
+
+    if (db->thread) {
+        pa_mutex_lock(db->mutex);
+        queue_records(db);
+        db->quit = true;
+        pa_cond_signal(db->cond, 0);
+        pa_mutex_unlock(db->mutex);
+
+        /* Waits for everything to be written */
+        pa_thread_free(db->thread);
+    }
+
+    if (db->snapshot)
+        free_snapshot(db->snapshot, db->n_snapshot);
+
+    if (db->fd >= 0)
+        pa_close(db->fd);
+
+    if (db->cond)
+        pa_cond_free(db->cond);
+    if (db->mutex)
+        pa_mutex_free(db->mutex);
+
+    pa_xfree(db->filename);
+    pa_xfree(db->tmp_filename);
+    pa_xfree(db->records.data);
+    pa_xfree(db->queued.data);
+    pa_hashmap_free(db->map);
+    pa_xfree(db);
+}
+
+pa_datum* pa_database_get(pa_database *database, const pa_datum *key, pa_datum* data) {
+    log_data *db = (log_data*)database;
+    entry *e;
+
+    pa_assert(db);
+    pa_assert(key);
+    pa_assert(data);
+
+    if (!(e = pa_hashmap_get(db->map, key)))
+        return NULL;
+
+    datum_copy(data, &e->data);
+
+    return data;
+}
+
+int pa_database_set(pa_database *database, const pa_datum *key, const pa_datum* data, bool overwrite) {
+    log_data *db = (log_data*)database;
+
+    pa_assert(db);
+    pa_assert(key);
+    pa_assert(data);
+
+    if (db->read_only)
+        return -1;
+
+    if (key->size >= RECORD_UNSET || data->size >= RECORD_UNSET)
+        return -1;
+
+    if (!overwrite && pa_hashmap_get(db->map, key))
+        return -1;
+
+    put_entry(db, entry_new(key->data, key->size, data->data, data->size));
+    buffer_append_record(&db->records, key, data);
+
+    return 0;
+}
+
+int pa_database_unset(pa_database *database, const pa_datum *key) {
+    log_data *db = (log_data*)database;
+
+    pa_assert(db);
+    pa_assert(key);
+
+    if (!pa_hashmap_get(db->map, key))
+        return -1;
+
+    remove_entry(db, key);
+
+    if (!db->read_only)
+        buffer_append_record(&db->records, key, NULL);
+
+    return 0;
+}
+
+int pa_database_clear(pa_database *database) {
+    log_data *db = (log_data*)database;
+
+    pa_assert(db);
+
+    pa_hashmap_remove_all(db->map);
+    db->iterate_entry = NULL;
+    db->live_size = 0;
+    db->records.length = 0;
+
+    if (db->read_only)
+        return 0;
+
+    /* Let the writer replace the log by an empty one */
+    pa_mutex_lock(db->mutex);
+    request_compaction(db);
+    pa_cond_signal(db->cond, 0);
+    pa_mutex_unlock(db->mutex);
+
+    return 0;
+}
+
+signed pa_database_size(pa_database *database) {
+    log_data *db = (log_data*)database;
+    pa_assert(db);
+
+    return (signed) pa_hashmap_size(db->map);
+}
+
+static pa_datum* return_entry(log_data *db, entry *e, pa_datum *key, pa_datum *data) {
+    db->iterate_entry = e;
+
+    if (!e)
+        return NULL;
+
+    datum_copy(key, &e->key);
+
+    if (data)
+        datum_copy(data, &e->data);
+
+    return key;
+}
+
+pa_datum* pa_database_first(pa_database *database, pa_datum *key, pa_datum *data) {
+    log_data *db = (log_data*)database;
+
+    pa_assert(db);
+    pa_assert(key);
+
+    db->iterate_state = NULL;
+
+    return return_entry(db, pa_hashmap_iterate(db->map, &db->iterate_state, NULL), key, data);
+}
+
+pa_datum* pa_database_next(pa_database *database, const pa_datum *key, pa_datum *next, pa_datum *data) {
+    log_data *db = (log_data*)database;
+    entry *e, *search;
+
+    pa_assert(db);
+    pa_assert(next);
+
+    if (!key)
+        return pa_database_first(database, next, data);
+
+    if (!db->iterate_entry || compare_func(&db->iterate_entry->key, key) != 0) {
+        if (!(search = pa_hashmap_get(db->map, key)))
+            return NULL;
+
+        db->iterate_state = NULL;
+        while ((e = pa_hashmap_iterate(db->map, &db->iterate_state, NULL)))
+            if (e == search)
+                break;
+    }
+
+    return return_entry(db, pa_hashmap_iterate(db->map, &db->iterate_state, NULL), next, data);
+}
+
+int pa_database_sync(pa_database *database) {
+    log_data *db = (log_data*)database;
+    int r = 0;
+
+    pa_assert(db);
+
+    if (db->read_only)
+        return 0;
+
+    pa_mutex_lock(db->mutex);
+
+    queue_records(db);
+
+    /* Report that a previous write failed, the rewrite below makes up for
+     * it */
+    if (db->rewrite)
+        r = -1;
+
+    if (!db->snapshot && !db->compacting) {
+        uint64_t size = db->log_size + db->queued.length;
+
+        if (db->rewrite || (size > COMPACT_MIN_SIZE && size > 2 * (LOG_MAGIC_SIZE + db->live_size)))
+            request_compaction(db);
+    }
+
+    if (db->queued.length > 0 || db->snapshot)
+        pa_cond_signal(db->cond, 0);
+
+    pa_mutex_unlock(db->mutex);
+
+    return r;
+}
@@ -32,6 +32,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/hashmap.h>
+#include <pulsecore/startup-trace.h>
 
 #include "database.h"
 
@@ -226,9 +227,11 @@ pa_database* pa_database_open(const char *fn, bool for_write) {
     FILE *f;
     char *path;
     simple_data *db;
+    pa_usec_t begin;
 
     pa_assert(fn);
 
+    begin = pa_startup_trace_begin();
     path = pa_sprintf_malloc("%s."CANONICAL_HOST".simple", fn);
     errno = 0;
 
@@ -238,7 +241,7 @@ pa_database* pa_database_open(const char *fn, bool for_write) {
         db = pa_xnew0(simple_data, 1);
         db->map = pa_hashmap_new_full(hash_func, compare_func, NULL, (pa_free_cb_t) free_entry);
         db->filename = pa_xstrdup(path);
-        db->tmp_filename = pa_sprintf_malloc(".%s.tmp", db->filename);
+        db->tmp_filename = pa_sprintf_malloc("%s.tmp", db->filename);
         db->read_only = !for_write;
 
         if (f) {
@@ -251,6 +254,7 @@ pa_database* pa_database_open(const char *fn, bool for_write) {
         db = NULL;
     }
 
+    pa_startup_trace_end(begin, "database", path);
     pa_xfree(path);
 
     return (pa_database*) db;
@@ -32,6 +32,7 @@
 #include <pulse/xmalloc.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
+#include <pulsecore/startup-trace.h>
 
 #include "database.h"
 
@@ -100,13 +101,16 @@ finish:
 pa_database* pa_database_open(const char *fn, bool for_write) {
     struct tdb_context *c;
     char *path;
+    pa_usec_t begin;
 
     pa_assert(fn);
 
+    begin = pa_startup_trace_begin();
     path = pa_sprintf_malloc("%s.tdb", fn);
     if ((c = tdb_open_cloexec(path, 0, TDB_NOSYNC|TDB_NOLOCK, (for_write ? O_RDWR|O_CREAT : O_RDONLY), 0644)))
         pa_log_debug("Opened TDB database '%s'", path);
 
+    pa_startup_trace_end(begin, "database", path);
     pa_xfree(path);
 
     if (!c) {
@@ -33,6 +33,8 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-error.h>
+#include <pulsecore/core-rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #ifndef HAVE_PIPE
@@ -52,8 +54,21 @@ struct pa_fdsem {
 #endif
     int write_type;
     pa_fdsem_data *data;
+
+    /* The configured and the current spin budget, and when we last went
+     * to sleep */
+    uint64_t spin_max_nsec, spin_nsec;
+    uint64_t sleep_nsec;
 };
 
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax() __asm__ __volatile__ ("pause" ::: "memory")
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__ ("yield" ::: "memory")
+#else
+#define cpu_relax() do { } while (false)
+#endif
+
 pa_fdsem *pa_fdsem_new(void) {
     pa_fdsem *f;
 
@@ -136,6 +151,44 @@ void pa_fdsem_free(pa_fdsem *f) {
     pa_xfree(f);
 }
 
+/* Waits for a signal without announcing it in waiting, so that posters
+ * don't write to the fd. Every spin that times out halves the budget,
+ * so that idle peers soon go straight to sleep. on_sleep() restores it
+ * once a sleep ends earlier than a full spin would have. */
+static bool spin(pa_fdsem *f) {
+    uint64_t deadline;
+    unsigned n = 0;
+
+    if (f->spin_nsec == 0)
+        return false;
+
+    deadline = pa_rtclock_nsec() + f->spin_nsec;
+
+    for (;;) {
+        if (pa_atomic_load(&f->data->signalled))
+            return true;
+
+        /* Reading the clock costs more than a spin */
+        if ((++n & 63) == 0 && pa_rtclock_nsec() >= deadline)
+            break;
+
+        cpu_relax();
+    }
+
+    f->spin_nsec /= 2;
+    return false;
+}
+
+static void on_sleep(pa_fdsem *f) {
+    if (f->spin_max_nsec > 0)
+        f->sleep_nsec = pa_rtclock_nsec();
+}
+
+static void on_wakeup(pa_fdsem *f) {
+    if (f->spin_max_nsec > 0 && pa_rtclock_nsec() - f->sleep_nsec < f->spin_max_nsec)
+        f->spin_nsec = f->spin_max_nsec;
+}
+
 static void flush(pa_fdsem *f) {
     ssize_t r;
     pa_assert(f);
@@ -227,7 +280,11 @@ void pa_fdsem_wait(pa_fdsem *f) {
     if (pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
         return;
 
+    if (spin(f) && pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
+        return;
+
     pa_atomic_inc(&f->data->waiting);
+    on_sleep(f);
 
     while (!pa_atomic_cmpxchg(&f->data->signalled, 1, 0)) {
         char x[10];
@@ -265,6 +322,7 @@ void pa_fdsem_wait(pa_fdsem *f) {
     }
 
     pa_assert_se(pa_atomic_dec(&f->data->waiting) >= 1);
+    on_wakeup(f);
 }
 
 int pa_fdsem_try(pa_fdsem *f) {
@@ -297,12 +355,17 @@ int pa_fdsem_before_poll(pa_fdsem *f) {
     if (pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
         return -1;
 
+    if (spin(f) && pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
+        return -1;
+
     pa_atomic_inc(&f->data->waiting);
 
     if (pa_atomic_cmpxchg(&f->data->signalled, 1, 0)) {
         pa_assert_se(pa_atomic_dec(&f->data->waiting) >= 1);
         return -1;
     }
+
+    on_sleep(f);
     return 0;
 }
 
@@ -310,6 +373,7 @@ int pa_fdsem_after_poll(pa_fdsem *f) {
     pa_assert(f);
 
     pa_assert_se(pa_atomic_dec(&f->data->waiting) >= 1);
+    on_wakeup(f);
 
     flush(f);
 
@@ -318,3 +382,9 @@ int pa_fdsem_after_poll(pa_fdsem *f) {
 
     return 0;
 }
+
+void pa_fdsem_set_spin(pa_fdsem *f, pa_usec_t usec) {
+    pa_assert(f);
+
+    f->spin_max_nsec = f->spin_nsec = usec * PA_NSEC_PER_USEC;
+}
@@ -26,6 +26,8 @@
  * the best case all functions are lock-free unless sleeping is
  * required.  */
 
+#include <pulse/sample.h>
+
 #include <pulsecore/atomic.h>
 
 typedef struct pa_fdsem pa_fdsem;
@@ -50,4 +52,9 @@ int pa_fdsem_get(pa_fdsem *f);
 int pa_fdsem_before_poll(pa_fdsem *f);
 int pa_fdsem_after_poll(pa_fdsem *f);
 
+/* Makes pa_fdsem_wait() and pa_fdsem_before_poll() busy wait for up to
+ * usec for a signal before going to sleep. While we spin pa_fdsem_post()
+ * needs no system call. 0, the default, disables spinning. */
+void pa_fdsem_set_spin(pa_fdsem *f, pa_usec_t usec);
+
 #endif
@@ -13,9 +13,11 @@
 #include <config.h>
 #endif
 
+#include <pulse/xmalloc.h>
 #include <pulsecore/macro.h>
 
 #include <math.h>
+#include <string.h>
 #include "biquad.h"
 
 #ifndef M_PI
@@ -115,3 +117,167 @@ void biquad_set(struct biquad *bq, enum biquad_type type, double freq)
 		break;
 	}
 }
+
+struct biquad_cascade *biquad_cascade_new(int channels, int sections)
+{
+	struct biquad_cascade *bc;
+	struct biquad pass = { 1, 0, 0, 0, 0 };
+	int s, c;
+
+	pa_assert(channels > 0);
+	pa_assert(sections > 0);
+
+	bc = pa_xnew0(struct biquad_cascade, 1);
+	bc->channels = channels;
+	bc->lanes = PA_ROUND_UP(channels, BIQUAD_LANES);
+	bc->sections = sections;
+	bc->coef = pa_xnew0(float, 5 * bc->lanes * sections);
+	bc->state = pa_xnew0(float, biquad_cascade_state_size(bc));
+	bc->frame = pa_xnew0(float, bc->lanes);
+
+	/* The padding lanes pass their (zero) input through too */
+	for (s = 0; s < sections; s++)
+		for (c = 0; c < bc->lanes; c++)
+			biquad_cascade_set(bc, s, c, &pass);
+
+	return bc;
+}
+
+void biquad_cascade_free(struct biquad_cascade *bc)
+{
+	pa_assert(bc);
+
+	pa_xfree(bc->coef);
+	pa_xfree(bc->state);
+	pa_xfree(bc->frame);
+	pa_xfree(bc);
+}
+
+void biquad_cascade_set(struct biquad_cascade *bc, int section, int channel,
+			const struct biquad *bq)
+{
+	float *k;
+
+	pa_assert(bc);
+	pa_assert(bq);
+	pa_assert(section >= 0 && section < bc->sections);
+	pa_assert(channel >= 0 && channel < bc->lanes);
+
+	k = bc->coef + 5 * bc->lanes * section + channel;
+	k[0] = bq->b0;
+	k[bc->lanes] = bq->b1;
+	k[2 * bc->lanes] = bq->b2;
+	k[3 * bc->lanes] = bq->a1;
+	k[4 * bc->lanes] = bq->a2;
+}
+
+void biquad_cascade_reset(struct biquad_cascade *bc)
+{
+	pa_assert(bc);
+
+	memset(bc->state, 0, sizeof(float) * biquad_cascade_state_size(bc));
+}
+
+int biquad_cascade_state_size(const struct biquad_cascade *bc)
+{
+	pa_assert(bc);
+
+	return 2 * bc->lanes * (bc->sections + 1);
+}
+
+void biquad_cascade_get_state(const struct biquad_cascade *bc, float *state)
+{
+	pa_assert(bc);
+	pa_assert(state);
+
+	memcpy(state, bc->state, sizeof(float) * biquad_cascade_state_size(bc));
+}
+
+void biquad_cascade_set_state(struct biquad_cascade *bc, const float *state)
+{
+	pa_assert(bc);
+	pa_assert(state);
+
+	memcpy(bc->state, state, sizeof(float) * biquad_cascade_state_size(bc));
+}
+
+/* Runs bc->frame through all sections. The inner loop has a constant trip
+ * count and no dependencies between its iterations, so it becomes one
+ * vector operation per term. */
+static void cascade_frame(struct biquad_cascade *bc)
+{
+	const int lanes = bc->lanes;
+	const float *k = bc->coef;
+	float *h = bc->state;
+	float *v = bc->frame;
+	int s, l, i;
+
+	for (s = 0; s < bc->sections; s++) {
+		const float *b0 = k, *b1 = k + lanes, *b2 = k + 2 * lanes;
+		const float *a1 = k + 3 * lanes, *a2 = k + 4 * lanes;
+		float *x1 = h, *x2 = h + lanes;
+		const float *y1 = h + 2 * lanes, *y2 = h + 3 * lanes;
+
+		for (l = 0; l < lanes; l += BIQUAD_LANES)
+			for (i = l; i < l + BIQUAD_LANES; i++) {
+				float x = v[i];
+				float y = b0[i]*x + b1[i]*x1[i] + b2[i]*x2[i]
+					- a1[i]*y1[i] - a2[i]*y2[i];
+				x2[i] = x1[i];
+				x1[i] = x;
+				v[i] = y;
+			}
+
+		k += 5 * lanes;
+		h += 2 * lanes;
+	}
+
+	/* The history of the last output, the others were shifted as the
+	 * input of the following section */
+	for (i = 0; i < lanes; i++) {
+		h[lanes + i] = h[i];
+		h[i] = v[i];
+	}
+}
+
+void biquad_cascade_process_float32(struct biquad_cascade *bc, int samples,
+				    const float *src, float *dest)
+{
+	int n, c;
+
+	pa_assert(bc);
+
+	for (n = 0; n < samples; n++) {
+		for (c = 0; c < bc->channels; c++)
+			bc->frame[c] = src[c];
+
+		cascade_frame(bc);
+
+		for (c = 0; c < bc->channels; c++)
+			dest[c] = bc->frame[c];
+
+		src += bc->channels;
+		dest += bc->channels;
+	}
+}
+
+void biquad_cascade_process_s16(struct biquad_cascade *bc, int samples,
+				const short *src, short *dest)
+{
+	int n, c;
+
+	pa_assert(bc);
+
+	for (n = 0; n < samples; n++) {
+		for (c = 0; c < bc->channels; c++)
+			bc->frame[c] = src[c];
+
+		cascade_frame(bc);
+
+		for (c = 0; c < bc->channels; c++)
+			dest[c] = PA_CLAMP_UNLIKELY((int) bc->frame[c], -0x8000, 0x7fff);
+
+		src += bc->channels;
+		dest += bc->channels;
+	}
+}
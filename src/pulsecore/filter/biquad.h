@@ -38,6 +38,55 @@ enum biquad_type {
  */
 void biquad_set(struct biquad *bq, enum biquad_type type, double freq);
 
+/* A cascade of biquad filters run over all channels of an interleaved stream
+ * at once. Each channel has its own coefficients for every section. The
+ * coefficients and the history values are stored interleaved by channel, in
+ * lanes padded to a multiple of BIQUAD_LANES, so that a frame is computed with
+ * the same operations on all lanes side by side, which the compiler turns into
+ * SIMD instructions. Like a chain of struct lr4, the output history of one
+ * section is the input history of the next, and sections that were never set
+ * pass the signal through unchanged.
+ */
+#define BIQUAD_LANES 4
+
+struct biquad_cascade {
+	int channels;
+	int lanes;
+	int sections;
+	/* sections blocks of b0, b1, b2, a1 and a2 for each lane */
+	float *coef;
+	/* sections + 1 blocks of the last two values for each lane */
+	float *state;
+	/* one frame being worked on */
+	float *frame;
+};
+
+/* Allocate a cascade of the given number of sections for the given number of
+ * channels. All sections start out passing the signal through. */
+struct biquad_cascade *biquad_cascade_new(int channels, int sections);
+void biquad_cascade_free(struct biquad_cascade *bc);
+
+/* Set the parameters of one section for one channel. The history values are
+ * left alone, call biquad_cascade_reset() to clear them. */
+void biquad_cascade_set(struct biquad_cascade *bc, int section, int channel,
+			const struct biquad *bq);
+
+/* Clear the history values of all sections. */
+void biquad_cascade_reset(struct biquad_cascade *bc);
+
+/* The number of floats in the history values, for saving and restoring them
+ * with biquad_cascade_get_state() and biquad_cascade_set_state(). */
+int biquad_cascade_state_size(const struct biquad_cascade *bc);
+void biquad_cascade_get_state(const struct biquad_cascade *bc, float *state);
+void biquad_cascade_set_state(struct biquad_cascade *bc, const float *state);
+
+/* Filter samples frames of interleaved audio with bc->channels channels.
+ * src and dest may be the same buffer. */
+void biquad_cascade_process_float32(struct biquad_cascade *bc, int samples,
+				    const float *src, float *dest);
+void biquad_cascade_process_s16(struct biquad_cascade *bc, int samples,
+				const short *src, short *dest);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
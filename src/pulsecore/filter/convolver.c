@@ -0,0 +1,530 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "convolver.h"
+
+/* A real FFT of 2 * n samples, done as a complex one of n points and
+ * giving n + 1 bins */
+struct fft {
+    unsigned n;
+    float *cos, *sin;
+    unsigned *bitrev;
+    float *split_cos, *split_sin;
+};
+
+struct stage {
+    unsigned block, start, n_partitions;
+
+    /* Whether the stage starts 2 * block taps in, and does the work for
+     * a window during the following block. Otherwise it starts block
+     * taps in and does it at the end of the window. */
+    bool spread;
+
+    struct fft fft;
+    size_t spectrum_floats;
+
+    /* Per pair and partition */
+    float *spectra;
+
+    /* Per input: the previous block followed by the current one, and
+     * the last complete window of that, for spreading */
+    float *input, *window;
+    unsigned pos;
+
+    /* Per input, the spectra of the last n_partitions windows. The
+     * newest is at fdl_pos. */
+    float *fdl;
+    unsigned fdl_pos;
+
+    /* Per output: what the stage contributes to the current block, and
+     * to the one after it while that is being worked out */
+    float *out_cur, *out_next;
+
+    /* Of the n_inputs forward and n_outputs inverse transforms for the
+     * last window */
+    unsigned units_done;
+
+    float *accum, *work;
+};
+
+struct pa_convolver {
+    unsigned n_inputs, n_outputs, length, block;
+
+    /* Per pair: the first block taps, time reversed. Pairs whose
+     * response is all zero are skipped. */
+    float *head;
+    bool *active;
+
+    /* Per input: the previous block followed by the current one */
+    float *input;
+    unsigned pos;
+
+    struct stage *stages;
+    unsigned n_stages;
+};
+
+static void fft_init(struct fft *f, unsigned n) {
+    unsigned i, bits;
+
+    f->n = n;
+
+    f->cos = pa_xnew(float, n / 2);
+    f->sin = pa_xnew(float, n / 2);
+    for (i = 0; i < n / 2; i++) {
+        f->cos[i] = (float) cos(2 * M_PI * i / n);
+        f->sin[i] = (float) sin(2 * M_PI * i / n);
+    }
+
+    for (bits = 0; (1U << bits) < n; bits++)
+        ;
+
+    f->bitrev = pa_xnew(unsigned, n);
+    for (i = 0; i < n; i++) {
+        unsigned j, r = 0;
+
+        for (j = 0; j < bits; j++)
+            if (i & (1U << j))
+                r |= 1U << (bits - 1 - j);
+
+        f->bitrev[i] = r;
+    }
+
+    f->split_cos = pa_xnew(float, n + 1);
+    f->split_sin = pa_xnew(float, n + 1);
+    for (i = 0; i <= n; i++) {
+        f->split_cos[i] = (float) cos(M_PI * i / n);
+        f->split_sin[i] = (float) sin(M_PI * i / n);
+    }
+}
+
+static void fft_done(struct fft *f) {
+    pa_xfree(f->cos);
+    pa_xfree(f->sin);
+    pa_xfree(f->bitrev);
+    pa_xfree(f->split_cos);
+    pa_xfree(f->split_sin);
+}
+
+/* In place complex FFT of f->n interleaved points, unscaled */
+static void fft(const struct fft *f, float *d, bool inverse) {
+    unsigned n = f->n, len, i, k;
+
+    for (i = 0; i < n; i++) {
+        unsigned j = f->bitrev[i];
+
+        if (j > i) {
+            float t;
+
+            t = d[2 * i]; d[2 * i] = d[2 * j]; d[2 * j] = t;
+            t = d[2 * i + 1]; d[2 * i + 1] = d[2 * j + 1]; d[2 * j + 1] = t;
+        }
+    }
+
+    for (len = 2; len <= n; len <<= 1) {
+        unsigned half = len / 2, step = n / len;
+
+        for (i = 0; i < n; i += len) {
+            for (k = 0; k < half; k++) {
+                float wr = f->cos[k * step];
+                float wi = inverse ? f->sin[k * step] : -f->sin[k * step];
+                float *a = d + 2 * (i + k), *b = d + 2 * (i + k + half);
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+/* Spectrum of 2 * f->n real samples x into f->n + 1 bins. The samples
+ * are transformed as f->n complex ones, even samples in the real part,
+ * and the two halves are separated afterwards. */
+static void rfft(const struct fft *f, const float *x, float *X) {
+    unsigned n = f->n, k;
+    float r, i;
+
+    memcpy(X, x, 2 * n * sizeof(float));
+    fft(f, X, false);
+
+    r = X[0];
+    i = X[1];
+    X[0] = r + i;
+    X[1] = 0;
+    X[2 * n] = r - i;
+    X[2 * n + 1] = 0;
+
+    for (k = 1; k <= n / 2; k++) {
+        unsigned m = n - k, side;
+        float zk[2], zm[2];
+
+        zk[0] = X[2 * k]; zk[1] = X[2 * k + 1];
+        zm[0] = X[2 * m]; zm[1] = X[2 * m + 1];
+
+        for (side = 0; side < 2; side++) {
+            const float *a = side ? zm : zk, *b = side ? zk : zm;
+            unsigned idx = side ? m : k;
+            float fe_r = 0.5f * (a[0] + b[0]), fe_i = 0.5f * (a[1] - b[1]);
+            float d_r = 0.5f * (a[0] - b[0]), d_i = 0.5f * (a[1] + b[1]);
+            /* fo = -i * d, multiplied with exp(-i pi idx / n) */
+            float fo_r = d_i, fo_i = -d_r;
+            float wr = f->split_cos[idx], wi = -f->split_sin[idx];
+
+            X[2 * idx] = fe_r + fo_r * wr - fo_i * wi;
+            X[2 * idx + 1] = fe_i + fo_r * wi + fo_i * wr;
+        }
+    }
+}
+
+/* The inverse of rfft(), scaled up by f->n */
+static void irfft(const struct fft *f, const float *X, float *x) {
+    unsigned n = f->n, k;
+
+    for (k = 0; k < n; k++) {
+        const float *a = X + 2 * k, *b = X + 2 * (n - k);
+        float fe_r = 0.5f * (a[0] + b[0]), fe_i = 0.5f * (a[1] - b[1]);
+        float d_r = 0.5f * (a[0] - b[0]), d_i = 0.5f * (a[1] + b[1]);
+        float wr = f->split_cos[k], wi = f->split_sin[k];
+        float fo_r = d_r * wr - d_i * wi, fo_i = d_r * wi + d_i * wr;
+
+        x[2 * k] = fe_r - fo_i;
+        x[2 * k + 1] = fe_i + fo_r;
+    }
+
+    fft(f, x, true);
+}
+
+static void stage_init(pa_convolver *c, struct stage *s, unsigned block, unsigned start, unsigned end) {
+    unsigned n_pairs = c->n_inputs * c->n_outputs;
+
+    s->block = block;
+    s->start = start;
+    s->n_partitions = (end - start + block - 1) / block;
+    s->spread = start == 2 * block;
+    s->spectrum_floats = 2 * (block + 1);
+
+    fft_init(&s->fft, block);
+
+    s->spectra = pa_xnew0(float, n_pairs * s->n_partitions * s->spectrum_floats);
+    s->input = pa_xnew0(float, c->n_inputs * 2 * block);
+    s->window = pa_xnew0(float, c->n_inputs * 2 * block);
+    s->fdl = pa_xnew0(float, c->n_inputs * s->n_partitions * s->spectrum_floats);
+    s->out_cur = pa_xnew0(float, c->n_outputs * block);
+    s->out_next = pa_xnew0(float, c->n_outputs * block);
+    s->accum = pa_xnew0(float, s->spectrum_floats);
+    s->work = pa_xnew0(float, 2 * block);
+
+    /* Nothing pending */
+    s->units_done = c->n_inputs + c->n_outputs;
+}
+
+static void stage_done(struct stage *s) {
+    fft_done(&s->fft);
+    pa_xfree(s->spectra);
+    pa_xfree(s->input);
+    pa_xfree(s->window);
+    pa_xfree(s->fdl);
+    pa_xfree(s->out_cur);
+    pa_xfree(s->out_next);
+    pa_xfree(s->accum);
+    pa_xfree(s->work);
+}
+
+pa_convolver *pa_convolver_new(unsigned n_inputs, unsigned n_outputs, unsigned length, unsigned block_size) {
+    pa_convolver *c;
+    unsigned n_pairs, b;
+
+    pa_assert(n_inputs > 0);
+    pa_assert(n_outputs > 0);
+    pa_assert(length > 0);
+    pa_assert(block_size >= 4);
+    pa_assert(pa_is_power_of_two(block_size));
+
+    c = pa_xnew0(pa_convolver, 1);
+    c->n_inputs = n_inputs;
+    c->n_outputs = n_outputs;
+    c->length = length;
+    c->block = block_size;
+
+    n_pairs = n_inputs * n_outputs;
+
+    c->head = pa_xnew0(float, n_pairs * block_size);
+    c->active = pa_xnew0(bool, n_pairs);
+    c->input = pa_xnew0(float, n_inputs * 2 * block_size);
+
+    /* One stage for the second block of taps, then one per doubling */
+    for (b = block_size; 2 * b < length; b *= 2)
+        c->n_stages++;
+    if (length > block_size)
+        c->n_stages++;
+
+    c->stages = pa_xnew0(struct stage, PA_MAX(c->n_stages, 1U));
+
+    if (length > block_size) {
+        unsigned n = 0;
+
+        stage_init(c, &c->stages[n++], block_size, block_size, PA_MIN(length, 2 * block_size));
+
+        /* The last stage takes all the rest, at most two partitions */
+        for (b = block_size; 2 * b < length; b *= 2)
+            stage_init(c, &c->stages[n++], b, 2 * b, 4 * b >= length ? length : 4 * b);
+
+        pa_assert(n == c->n_stages);
+    }
+
+    return c;
+}
+
+void pa_convolver_free(pa_convolver *c) {
+    unsigned n;
+
+    pa_assert(c);
+
+    for (n = 0; n < c->n_stages; n++)
+        stage_done(&c->stages[n]);
+
+    pa_xfree(c->stages);
+    pa_xfree(c->head);
+    pa_xfree(c->active);
+    pa_xfree(c->input);
+    pa_xfree(c);
+}
+
+void pa_convolver_set_response(pa_convolver *c, unsigned input, unsigned output, const float *h, unsigned stride) {
+    unsigned pair, j, p, n;
+    float *head;
+    bool active = false;
+
+    pa_assert(c);
+    pa_assert(input < c->n_inputs);
+    pa_assert(output < c->n_outputs);
+
+    pair = input * c->n_outputs + output;
+    head = c->head + pair * c->block;
+
+    memset(head, 0, c->block * sizeof(float));
+    for (j = 0; h && j < PA_MIN(c->length, c->block); j++) {
+        head[c->block - 1 - j] = h[j * stride];
+        active = active || h[j * stride] != 0;
+    }
+
+    for (n = 0; n < c->n_stages; n++) {
+        struct stage *s = &c->stages[n];
+
+        for (p = 0; p < s->n_partitions; p++) {
+            float *H = s->spectra + (pair * s->n_partitions + p) * s->spectrum_floats;
+            unsigned first = s->start + p * s->block;
+
+            /* The response goes first, so that the last half of the
+             * circular convolution with a window of two blocks is the
+             * linear one */
+            memset(s->work, 0, 2 * s->block * sizeof(float));
+            for (j = 0; h && j < s->block && first + j < c->length; j++) {
+                /* irfft() scales up by block, undo that here once */
+                s->work[j] = h[(first + j) * stride] / (float) s->block;
+                active = active || s->work[j] != 0;
+            }
+
+            rfft(&s->fft, s->work, H);
+        }
+    }
+
+    c->active[pair] = active;
+}
+
+static void stage_reset(pa_convolver *c, struct stage *s) {
+    memset(s->input, 0, c->n_inputs * 2 * s->block * sizeof(float));
+    memset(s->window, 0, c->n_inputs * 2 * s->block * sizeof(float));
+    memset(s->fdl, 0, c->n_inputs * s->n_partitions * s->spectrum_floats * sizeof(float));
+    memset(s->out_cur, 0, c->n_outputs * s->block * sizeof(float));
+    memset(s->out_next, 0, c->n_outputs * s->block * sizeof(float));
+
+    s->pos = 0;
+    s->fdl_pos = 0;
+    s->units_done = c->n_inputs + c->n_outputs;
+}
+
+void pa_convolver_reset(pa_convolver *c) {
+    unsigned n;
+
+    pa_assert(c);
+
+    memset(c->input, 0, c->n_inputs * 2 * c->block * sizeof(float));
+    c->pos = 0;
+
+    for (n = 0; n < c->n_stages; n++)
+        stage_reset(c, &c->stages[n]);
+}
+
+/* Does the transforms for the last window up to the given number: first
+ * the forward one of each input, then the products and the inverse
+ * transform of each output */
+static void stage_run(pa_convolver *c, struct stage *s, unsigned until) {
+    size_t S = s->spectrum_floats;
+
+    for (; s->units_done < until; s->units_done++) {
+        unsigned i, o, p, k;
+
+        if (s->units_done < c->n_inputs) {
+            i = s->units_done;
+            rfft(&s->fft, s->window + i * 2 * s->block, s->fdl + (i * s->n_partitions + s->fdl_pos) * S);
+            continue;
+        }
+
+        o = s->units_done - c->n_inputs;
+        memset(s->accum, 0, S * sizeof(float));
+
+        for (i = 0; i < c->n_inputs; i++) {
+            unsigned pair = i * c->n_outputs + o;
+
+            if (!c->active[pair])
+                continue;
+
+            /* The newest window goes with the first partition */
+            for (p = 0; p < s->n_partitions; p++) {
+                const float *X = s->fdl + (i * s->n_partitions + (s->fdl_pos + p) % s->n_partitions) * S;
+                const float *H = s->spectra + (pair * s->n_partitions + p) * S;
+
+                for (k = 0; k < S; k += 2) {
+                    s->accum[k] += X[k] * H[k] - X[k + 1] * H[k + 1];
+                    s->accum[k + 1] += X[k] * H[k + 1] + X[k + 1] * H[k];
+                }
+            }
+        }
+
+        irfft(&s->fft, s->accum, s->work);
+        memcpy(s->out_next + o * s->block, s->work + s->block, s->block * sizeof(float));
+    }
+}
+
+static void stage_swap(struct stage *s) {
+    float *t = s->out_cur;
+
+    s->out_cur = s->out_next;
+    s->out_next = t;
+}
+
+/* Takes the block that just completed as the next window */
+static void stage_capture(pa_convolver *c, struct stage *s) {
+    unsigned i;
+
+    s->fdl_pos = (s->fdl_pos + s->n_partitions - 1) % s->n_partitions;
+
+    for (i = 0; i < c->n_inputs; i++) {
+        float *x = s->input + i * 2 * s->block;
+
+        memcpy(s->window + i * 2 * s->block, x, 2 * s->block * sizeof(float));
+        memcpy(x, x + s->block, s->block * sizeof(float));
+    }
+
+    s->units_done = 0;
+    s->pos = 0;
+}
+
+static void stage_finish_block(pa_convolver *c, struct stage *s) {
+    unsigned total = c->n_inputs + c->n_outputs;
+
+    if (s->spread) {
+        /* What was worked out during this block is for the next one */
+        stage_run(c, s, total);
+        stage_swap(s);
+        stage_capture(c, s);
+    } else {
+        stage_capture(c, s);
+        stage_run(c, s, total);
+        stage_swap(s);
+    }
+}
+
+void pa_convolver_process(pa_convolver *c, const float *in, float *out, unsigned n_frames) {
+    unsigned f, i, o, j, n;
+
+    pa_assert(c);
+    pa_assert(in || n_frames == 0);
+    pa_assert(out || n_frames == 0);
+
+    for (f = 0; f < n_frames; f++) {
+        const float *frame = in + f * c->n_inputs;
+
+        for (i = 0; i < c->n_inputs; i++) {
+            c->input[i * 2 * c->block + c->block + c->pos] = frame[i];
+
+            for (n = 0; n < c->n_stages; n++) {
+                struct stage *s = &c->stages[n];
+
+                s->input[i * 2 * s->block + s->block + s->pos] = frame[i];
+            }
+        }
+
+        for (o = 0; o < c->n_outputs; o++) {
+            float sum = 0;
+
+            for (n = 0; n < c->n_stages; n++)
+                sum += c->stages[n].out_cur[o * c->stages[n].block + c->stages[n].pos];
+
+            for (i = 0; i < c->n_inputs; i++) {
+                unsigned pair = i * c->n_outputs + o;
+                /* The last block input frames, oldest first, so that the
+                 * reversed head lines up */
+                const float *x = c->input + i * 2 * c->block + c->pos + 1;
+                const float *h = c->head + pair * c->block;
+
+                if (!c->active[pair])
+                    continue;
+
+                for (j = 0; j < c->block; j++)
+                    sum += h[j] * x[j];
+            }
+
+            out[f * c->n_outputs + o] = sum;
+        }
+
+        if (++c->pos == c->block) {
+            for (i = 0; i < c->n_inputs; i++) {
+                float *x = c->input + i * 2 * c->block;
+
+                memcpy(x, x + c->block, c->block * sizeof(float));
+            }
+
+            c->pos = 0;
+        }
+
+        for (n = 0; n < c->n_stages; n++) {
+            struct stage *s = &c->stages[n];
+
+            if (++s->pos == s->block)
+                stage_finish_block(c, s);
+            else if (s->spread)
+                stage_run(c, s, (c->n_inputs + c->n_outputs) * s->pos / s->block);
+        }
+    }
+}
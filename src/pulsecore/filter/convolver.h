@@ -0,0 +1,50 @@
+#ifndef fooconvolverhfoo
+#define fooconvolverhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Convolves a number of input channels with one impulse response per
+ * input/output pair and sums the results per output. The first
+ * block_size taps are applied in the time domain so that no latency is
+ * added, the rest with non-uniformly partitioned overlap-save
+ * convolution: taps block_size to 2 * block_size in blocks of
+ * block_size, done at the end of each block, then stages of blocks of b
+ * covering taps 2 * b to 4 * b, for b = block_size, 2 * block_size and
+ * so on. Starting 2 * b in leaves such a stage a whole block for the
+ * transforms of one, so that their work is spread over the frames of
+ * the next block instead of done in one go. */
+
+typedef struct pa_convolver pa_convolver;
+
+/* block_size must be a power of two of at least 4. All responses are
+ * zero until set. */
+pa_convolver *pa_convolver_new(unsigned n_inputs, unsigned n_outputs, unsigned length, unsigned block_size);
+void pa_convolver_free(pa_convolver *c);
+
+/* Takes length taps from h, stride floats apart. h may be NULL for
+ * silence. This may also be called between pa_convolver_process()
+ * calls, the new response takes over at once. */
+void pa_convolver_set_response(pa_convolver *c, unsigned input, unsigned output, const float *h, unsigned stride);
+
+/* Forgets all past input */
+void pa_convolver_reset(pa_convolver *c);
+
+/* in has n_inputs, out n_outputs interleaved float channels */
+void pa_convolver_process(pa_convolver *c, const float *in, float *out, unsigned n_frames);
+
+#endif
@@ -26,18 +26,21 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/filter/biquad.h>
-#include <pulsecore/filter/crossover.h>
+
+/* The history of the two sections for the most channels we can have */
+#define LFE_STATE_SIZE (2 * 3 * ((PA_CHANNELS_MAX + BIQUAD_LANES - 1) / BIQUAD_LANES * BIQUAD_LANES))
 
 struct saved_state {
     PA_LLIST_FIELDS(struct saved_state);
     pa_memchunk chunk;
     int64_t index;
-    struct lr4 lr4[PA_CHANNELS_MAX];
+    float state[LFE_STATE_SIZE];
 };
 
 PA_STATIC_FLIST_DECLARE(lfe_state, 0, pa_xfree);
 
-/* An LR4 filter, implemented as a chain of two Butterworth filters.
+/* An LR4 filter, implemented as a chain of two Butterworth filters, run over
+   all channels at once.
 
    Currently the channel map is fixed so that a highpass filter is applied to all
    channels except for the LFE channel, where a lowpass filter is applied.
@@ -53,7 +56,7 @@ struct pa_lfe_filter {
     pa_sample_spec ss;
     size_t maxrewind;
     bool active;
-    struct lr4 lr4[PA_CHANNELS_MAX];
+    struct biquad_cascade *bc;
 };
 
 static void remove_state(pa_lfe_filter_t *f, struct saved_state *s) {
@@ -69,6 +72,8 @@ pa_lfe_filter_t * pa_lfe_filter_new(const pa_sample_spec* ss, const pa_channel_m
     f->cm = *cm;
     f->ss = *ss;
     f->maxrewind = maxrewind;
+    f->bc = biquad_cascade_new(cm->channels, 2);
+    pa_assert(biquad_cascade_state_size(f->bc) <= LFE_STATE_SIZE);
     pa_lfe_filter_update_rate(f, ss->rate);
     return f;
 }
@@ -77,6 +82,7 @@ void pa_lfe_filter_free(pa_lfe_filter_t *f) {
     while (f->saved)
         remove_state(f, f->saved);
 
+    biquad_cascade_free(f->bc);
     pa_xfree(f);
 }
 
@@ -90,17 +96,13 @@ static void process_block(pa_lfe_filter_t *f, pa_memchunk *buf, bool store_resul
     void *garbage = store_result ? NULL : pa_xmalloc(buf->length);
 
     if (f->ss.format == PA_SAMPLE_FLOAT32NE) {
-        int i;
         float *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_float32(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
+        biquad_cascade_process_float32(f->bc, samples, data, garbage ? garbage : data);
         pa_memblock_release(buf->memblock);
     }
     else if (f->ss.format == PA_SAMPLE_S16NE) {
-        int i;
         short *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_s16(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
+        biquad_cascade_process_s16(f->bc, samples, data, garbage ? garbage : data);
         pa_memblock_release(buf->memblock);
     }
     else pa_assert_not_reached();
@@ -135,7 +137,7 @@ pa_memchunk * pa_lfe_filter_process(pa_lfe_filter_t *f, pa_memchunk *buf) {
     pa_memblock_release(buf->memblock);
 
     s->index = f->index;
-    memcpy(s->lr4, f->lr4, sizeof(struct lr4) * f->cm.channels);
+    biquad_cascade_get_state(f->bc, s->state);
     PA_LLIST_PREPEND(struct saved_state, f->saved, s);
 
     process_block(f, buf, true);
@@ -157,8 +159,14 @@ void pa_lfe_filter_update_rate(pa_lfe_filter_t *f, uint32_t new_rate) {
         return;
     }
 
-    for (i = 0; i < f->cm.channels; i++)
-        lr4_set(&f->lr4[i], f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, biquad_freq);
+    for (i = 0; i < f->cm.channels; i++) {
+        struct biquad bq;
+
+        biquad_set(&bq, f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, biquad_freq);
+        biquad_cascade_set(f->bc, 0, i, &bq);
+        biquad_cascade_set(f->bc, 1, i, &bq);
+    }
+    biquad_cascade_reset(f->bc);
 
     f->active = true;
 }
@@ -182,7 +190,7 @@ void pa_lfe_filter_rewind(pa_lfe_filter_t *f, size_t amount) {
     }
     pa_log_debug("Rewinding LFE filter %zu samples to position %lli. Found saved state at position %lli",
         samples, (long long) f->index, (long long) s->index);
-    memcpy(f->lr4, s->lr4, sizeof(struct lr4) * f->cm.channels);
+    biquad_cascade_set_state(f->bc, s->state);
 
     /* now fast forward to the actual position */
     if (f->index > s->index) {
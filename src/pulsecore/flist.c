@@ -25,6 +25,10 @@
 #include <config.h>
 #endif
 
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/atomic.h>
@@ -35,7 +39,7 @@
 
 #include "flist.h"
 
-#define FLIST_SIZE 256
+#define CACHE_LINE_SIZE 64
 
 /* Atomic table indices contain
    sign bit = if set, indicates empty/NULL value
@@ -55,15 +59,32 @@ struct pa_flist {
     char *name;
     unsigned size;
 
-    pa_atomic_t current_tag;
+    /* Once this list is full, pushes go on to the next segment, which
+     * is created on demand as long as max_size allows it */
+    unsigned max_size;
+    pa_atomic_ptr_t next;
+
     int index_mask;
     int tag_shift;
     int tag_mask;
 
+    /* A sharded list has no table of its own, just one list per CPU */
+    unsigned n_shards;
+    pa_flist **shards;
+
+    /* The fields below are written by every push and pop, keep them off
+     * the cache lines of the read-only ones above and of the table */
+    char padding1[CACHE_LINE_SIZE];
+
+    pa_atomic_t current_tag;
     /* Stack that contains pointers stored into free list */
     pa_atomic_t stored;
     /* Stack that contains empty list elements */
     pa_atomic_t empty;
+    pa_atomic_t overflows;
+
+    char padding2[CACHE_LINE_SIZE];
+
     pa_flist_elem table[];
 };
 
@@ -99,18 +120,19 @@ static void stack_push(pa_flist *flist, pa_atomic_t *list, pa_flist_elem *new_el
     } while (!pa_atomic_cmpxchg(list, next, newindex));
 }
 
-pa_flist *pa_flist_new_with_name(unsigned size, const char *name) {
+static pa_flist *flist_new(unsigned size, unsigned max_size, const char *name) {
     pa_flist *l;
     unsigned i;
-    pa_assert(name);
-
-    if (!size)
-        size = FLIST_SIZE;
 
-    l = pa_xmalloc0(sizeof(pa_flist) + sizeof(pa_flist_elem) * size);
+    /* The padding at the end keeps whatever follows in memory off the
+     * cache line of the last element */
+    l = pa_xmalloc0(sizeof(pa_flist) + sizeof(pa_flist_elem) * size + CACHE_LINE_SIZE);
 
     l->name = pa_xstrdup(name);
     l->size = size;
+    l->max_size = PA_MAX(size, max_size);
+    pa_atomic_ptr_store(&l->next, NULL);
+    pa_atomic_store(&l->overflows, 0);
 
     while (1 << l->tag_shift < (int) size)
         l->tag_shift++;
@@ -125,14 +147,64 @@ pa_flist *pa_flist_new_with_name(unsigned size, const char *name) {
     return l;
 }
 
+pa_flist *pa_flist_new_full(unsigned size, unsigned max_size, const char *name) {
+    pa_assert(name);
+
+    if (!size)
+        size = PA_FLIST_DEFAULT_SIZE;
+
+    return flist_new(size, max_size, name);
+}
+
+pa_flist *pa_flist_new_sharded(unsigned size, const char *name) {
+    pa_flist *l;
+    unsigned i, n;
+
+    pa_assert(name);
+
+    if (!size)
+        size = PA_FLIST_DEFAULT_SIZE;
+
+    if ((n = PA_MIN(pa_ncpus(), size)) <= 1)
+        return flist_new(size, 0, name);
+
+    l = flist_new(0, 0, name);
+    l->n_shards = n;
+    l->shards = pa_xnew(pa_flist*, n);
+
+    /* Together the shards hold at least size entries */
+    for (i = 0; i < n; i++)
+        l->shards[i] = flist_new((size + n - 1) / n, 0, name);
+
+    return l;
+}
+
+pa_flist *pa_flist_new_with_name(unsigned size, const char *name) {
+    return pa_flist_new_full(size, 0, name);
+}
+
 pa_flist *pa_flist_new(unsigned size) {
     return pa_flist_new_with_name(size, "unknown");
 }
 
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
+    pa_flist *next;
+
     pa_assert(l);
     pa_assert(l->name);
 
+    if (l->shards) {
+        unsigned i;
+
+        for (i = 0; i < l->n_shards; i++)
+            pa_flist_free(l->shards[i], free_cb);
+
+        pa_xfree(l->shards);
+    }
+
+    if ((next = pa_atomic_ptr_load(&l->next)))
+        pa_flist_free(next, free_cb);
+
     if (free_cb) {
         pa_flist_elem *elem;
         while((elem = stack_pop(l, &l->stored)))
@@ -143,35 +215,126 @@ void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
     pa_xfree(l);
 }
 
-int pa_flist_push(pa_flist *l, void *p) {
+/* Returns the segment after l, creating it if max_size allows */
+static pa_flist *get_next(pa_flist *l) {
+    pa_flist *next;
+    unsigned size;
+
+    if ((next = pa_atomic_ptr_load(&l->next)) || l->max_size <= l->size)
+        return next;
+
+    /* Double the capacity with every segment */
+    size = PA_MIN(l->size * 2, l->max_size - l->size);
+    next = pa_flist_new_full(size, l->max_size - l->size, l->name);
+
+    if (!pa_atomic_ptr_cmpxchg(&l->next, NULL, next)) {
+        /* Somebody else was faster */
+        pa_flist_free(next, NULL);
+        return pa_atomic_ptr_load(&l->next);
+    }
+
+    pa_log_debug("%s flist is full, growing by %u entries", l->name, size);
+    return next;
+}
+
+static int table_push(pa_flist *l, void *p) {
     pa_flist_elem *elem;
-    pa_assert(l);
-    pa_assert(p);
 
-    elem = stack_pop(l, &l->empty);
-    if (elem == NULL) {
-        if (pa_log_ratelimit(PA_LOG_DEBUG))
-            pa_log_debug("%s flist is full (don't worry)", l->name);
+    if (!(elem = stack_pop(l, &l->empty)))
         return -1;
-    }
+
     pa_atomic_ptr_store(&elem->ptr, p);
     stack_push(l, &l->stored, elem);
 
     return 0;
 }
 
-void* pa_flist_pop(pa_flist *l) {
+static void *table_pop(pa_flist *l) {
     pa_flist_elem *elem;
     void *ptr;
-    pa_assert(l);
 
-    elem = stack_pop(l, &l->stored);
-    if (elem == NULL)
+    if (!(elem = stack_pop(l, &l->stored)))
         return NULL;
 
     ptr = pa_atomic_ptr_load(&elem->ptr);
-
     stack_push(l, &l->empty, elem);
 
     return ptr;
 }
+
+static unsigned current_shard(pa_flist *l) {
+#ifdef HAVE_SCHED_GETCPU
+    int cpu;
+
+    if ((cpu = sched_getcpu()) >= 0)
+        return (unsigned) cpu % l->n_shards;
+#endif
+
+    return 0;
+}
+
+int pa_flist_push(pa_flist *l, void *p) {
+    pa_assert(l);
+    pa_assert(p);
+
+    if (l->shards) {
+        unsigned i, start = current_shard(l);
+
+        /* Our own shard first, then whichever has room */
+        for (i = 0; i < l->n_shards; i++)
+            if (table_push(l->shards[(start + i) % l->n_shards], p) >= 0)
+                return 0;
+
+    } else if (table_push(l, p) >= 0)
+        return 0;
+
+    else {
+        pa_flist *next;
+
+        if ((next = get_next(l)))
+            return pa_flist_push(next, p);
+    }
+
+    pa_atomic_inc(&l->overflows);
+
+    if (pa_log_ratelimit(PA_LOG_DEBUG))
+        pa_log_debug("%s flist is full (don't worry)", l->name);
+    return -1;
+}
+
+void* pa_flist_pop(pa_flist *l) {
+    pa_flist *next;
+    void *ptr;
+
+    pa_assert(l);
+
+    if (l->shards) {
+        unsigned i, start = current_shard(l);
+
+        /* Steal from the others if our own shard is empty */
+        for (i = 0; i < l->n_shards; i++)
+            if ((ptr = table_pop(l->shards[(start + i) % l->n_shards])))
+                return ptr;
+
+        return NULL;
+    }
+
+    if ((ptr = table_pop(l)))
+        return ptr;
+
+    if ((next = pa_atomic_ptr_load(&l->next)))
+        return pa_flist_pop(next);
+
+    return NULL;
+}
+
+unsigned pa_flist_get_overflows(pa_flist *l) {
+    unsigned n = 0;
+
+    pa_assert(l);
+
+    for (; l; l = pa_atomic_ptr_load(&l->next))
+        n += (unsigned) pa_atomic_load(&l->overflows);
+
+    return n;
+}
@@ -34,12 +34,30 @@ pa_flist * pa_flist_new(unsigned size);
 /* Name string is copied and added to flist structure. The original is
  * responsibility of the caller. The name is only used for debug printing. */
 pa_flist * pa_flist_new_with_name(unsigned size, const char *name);
+/* Like pa_flist_new_with_name(), but once size entries are stored the
+ * list grows, without locking, until it holds max_size entries. */
+pa_flist * pa_flist_new_full(unsigned size, unsigned max_size, const char *name);
+/* A list of at least size entries, split into one shard per CPU. Push
+ * and pop go to the shard of the CPU the caller runs on and only touch
+ * the others if that one is full or empty, so threads on different
+ * CPUs don't fight over the same cache lines. */
+pa_flist * pa_flist_new_sharded(unsigned size, const char *name);
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb);
 
 /* Please note that this routine might fail! */
 int pa_flist_push(pa_flist*l, void *p);
 void* pa_flist_pop(pa_flist*l);
 
+/* The number of pushes that failed because the list was full. If this
+ * keeps going up the list is too small. */
+unsigned pa_flist_get_overflows(pa_flist *l);
+
+#define PA_FLIST_DEFAULT_SIZE 256
+
+/* The static free lists may grow up to this many times their initial
+ * size */
+#define PA_STATIC_FLIST_GROWTH 16
+
 /* Please note that the destructor stuff is not really necessary, we do
  * this just to make valgrind output more useful. */
 
@@ -50,7 +68,9 @@ void* pa_flist_pop(pa_flist*l);
     } name##_flist = { NULL, PA_ONCE_INIT };                            \
     static void name##_flist_init(void) {                               \
         name##_flist.flist =                                            \
-            pa_flist_new_with_name(size, __FILE__ ": " #name);          \
+            pa_flist_new_full(size,                                     \
+                              ((size) ? (size) : PA_FLIST_DEFAULT_SIZE) * PA_STATIC_FLIST_GROWTH, \
+                              __FILE__ ": " #name);                     \
     }                                                                   \
     static inline pa_flist* name##_flist_get(void) {                    \
         pa_run_once(&name##_flist.once, name##_flist_init);             \
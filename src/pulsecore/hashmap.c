@@ -22,22 +22,31 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <pulse/xmalloc.h>
 #include <pulsecore/idxset.h>
-#include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
 
 #include "hashmap.h"
 
-#define NBUCKETS 127
+/* The entries are stored in a dense array in insertion order, which is also
+ * the iteration order. Removed entries leave a hole behind that is only
+ * closed when the array has to grow, so that removing entries while
+ * iterating is safe. Lookups go through an open addressing table with linear
+ * probing that holds positions in the entry array. The table is twice as
+ * large as the entry array and is rebuilt before it gets more than half
+ * full, counting the slots of removed entries. */
+
+#define MIN_ENTRIES 4U
+#define SLOT_EMPTY 0U
+#define SLOT_REMOVED ((uint32_t) -1)
 
 struct hashmap_entry {
     void *key;
     void *value;
-
-    struct hashmap_entry *bucket_next, *bucket_previous;
-    struct hashmap_entry *iterate_next, *iterate_previous;
+    unsigned hash;
+    bool removed;
 };
 
 struct pa_hashmap {
@@ -47,18 +56,28 @@ struct pa_hashmap {
     pa_free_cb_t key_free_func;
     pa_free_cb_t value_free_func;
 
-    struct hashmap_entry *iterate_list_head, *iterate_list_tail;
-    unsigned n_entries;
-};
+    struct hashmap_entry *entries;
+    unsigned n_entries;   /* Live entries */
+    unsigned n_used;      /* Used positions in entries, including holes */
+    unsigned n_allocated;
+    unsigned first;       /* No live entries before this position */
 
-#define BY_HASH(h) ((struct hashmap_entry**) ((uint8_t*) (h) + PA_ALIGN(sizeof(pa_hashmap))))
+    /* Positions plus one, or SLOT_EMPTY or SLOT_REMOVED */
+    uint32_t *table;
+    unsigned table_mask, table_shift;
+    unsigned n_table_used; /* Slots that are not SLOT_EMPTY */
+};
 
-PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
+/* Fibonacci hashing, to spread the bits of the hash, since the trivial hash
+ * of a pointer has its low bits all zero */
+static inline unsigned table_start(pa_hashmap *h, unsigned hash) {
+    return (unsigned) (((uint32_t) hash * 2654435769U) >> h->table_shift);
+}
 
 pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t compare_func, pa_free_cb_t key_free_func, pa_free_cb_t value_free_func) {
     pa_hashmap *h;
 
-    h = pa_xmalloc0(PA_ALIGN(sizeof(pa_hashmap)) + NBUCKETS*sizeof(struct hashmap_entry*));
+    h = pa_xnew0(pa_hashmap, 1);
 
     h->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     h->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
@@ -66,9 +85,6 @@ pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t comp
     h->key_free_func = key_free_func;
     h->value_free_func = value_free_func;
 
-    h->n_entries = 0;
-    h->iterate_list_head = h->iterate_list_tail = NULL;
-
     return h;
 }
 
@@ -76,59 +92,124 @@ pa_hashmap *pa_hashmap_new(pa_hash_func_t hash_func, pa_compare_func_t compare_f
     return pa_hashmap_new_full(hash_func, compare_func, NULL, NULL);
 }
 
-static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
-    pa_assert(h);
-    pa_assert(e);
-
-    /* Remove from iteration list */
-    if (e->iterate_next)
-        e->iterate_next->iterate_previous = e->iterate_previous;
-    else
-        h->iterate_list_tail = e->iterate_previous;
-
-    if (e->iterate_previous)
-        e->iterate_previous->iterate_next = e->iterate_next;
-    else
-        h->iterate_list_head = e->iterate_next;
-
-    /* Remove from hash table bucket list */
-    if (e->bucket_next)
-        e->bucket_next->bucket_previous = e->bucket_previous;
-
-    if (e->bucket_previous)
-        e->bucket_previous->bucket_next = e->bucket_next;
-    else {
-        unsigned hash = h->hash_func(e->key) % NBUCKETS;
-        BY_HASH(h)[hash] = e->bucket_next;
+static void table_insert(pa_hashmap *h, unsigned hash, unsigned pos) {
+    unsigned i;
+
+    for (i = table_start(h, hash); h->table[i] != SLOT_EMPTY; i = (i + 1) & h->table_mask)
+        ;
+
+    h->table[i] = pos + 1;
+}
+
+/* Closes the holes in the entry array and grows it if it is still full
+ * then, and rebuilds the table */
+static void make_room(pa_hashmap *h) {
+    unsigned i, j;
+
+    for (i = j = 0; i < h->n_used; i++)
+        if (!h->entries[i].removed)
+            h->entries[j++] = h->entries[i];
+
+    h->n_used = j;
+    h->first = 0;
+
+    if (h->n_used >= h->n_allocated / 2) {
+        h->n_allocated = PA_MAX(MIN_ENTRIES, h->n_allocated * 2);
+        h->entries = pa_xrenew(struct hashmap_entry, h->entries, h->n_allocated);
+
+        pa_xfree(h->table);
+        h->table = pa_xnew(uint32_t, h->n_allocated * 2);
+        h->table_mask = h->n_allocated * 2 - 1;
+
+        for (h->table_shift = 32; (1U << (32 - h->table_shift)) < h->n_allocated * 2; h->table_shift--)
+            ;
     }
 
-    if (h->key_free_func)
-        h->key_free_func(e->key);
+    memset(h->table, 0, (h->table_mask + 1) * sizeof(uint32_t));
+
+    for (i = 0; i < h->n_used; i++)
+        table_insert(h, h->entries[i].hash, i);
+
+    h->n_table_used = h->n_used;
+}
+
+/* Returns the table slot of the key, or -1 */
+static int table_find(pa_hashmap *h, unsigned hash, const void *key) {
+    unsigned i;
+
+    if (!h->table)
+        return -1;
+
+    for (i = table_start(h, hash); h->table[i] != SLOT_EMPTY; i = (i + 1) & h->table_mask) {
+        struct hashmap_entry *e;
+
+        if (h->table[i] == SLOT_REMOVED)
+            continue;
 
-    if (pa_flist_push(PA_STATIC_FLIST_GET(entries), e) < 0)
-        pa_xfree(e);
+        e = &h->entries[h->table[i] - 1];
+
+        if (e->hash == hash && h->compare_func(e->key, key) == 0)
+            return (int) i;
+    }
+
+    return -1;
+}
+
+static void remove_entry(pa_hashmap *h, unsigned slot) {
+    struct hashmap_entry *e;
+
+    pa_assert(h);
+    pa_assert(h->table[slot] != SLOT_EMPTY && h->table[slot] != SLOT_REMOVED);
+
+    e = &h->entries[h->table[slot] - 1];
+    pa_assert(!e->removed);
+
+    e->removed = true;
+    h->table[slot] = SLOT_REMOVED;
 
     pa_assert(h->n_entries >= 1);
     h->n_entries--;
+
+    /* Cheaply reclaim space at the end of the array, and everything once
+     * the map is empty */
+    while (h->n_used > 0 && h->entries[h->n_used - 1].removed)
+        h->n_used--;
+
+    if (h->first > h->n_used)
+        h->first = h->n_used;
+
+    if (h->n_entries == 0) {
+        h->n_used = 0;
+        h->first = 0;
+        h->n_table_used = 0;
+        memset(h->table, 0, (h->table_mask + 1) * sizeof(uint32_t));
+    }
+
+    if (h->key_free_func)
+        h->key_free_func(e->key);
 }
 
-void pa_hashmap_free(pa_hashmap *h) {
-    pa_assert(h);
+/* Returns the position of the first live entry, or -1 */
+static int first_entry(pa_hashmap *h) {
+    while (h->first < h->n_used && h->entries[h->first].removed)
+        h->first++;
 
-    pa_hashmap_remove_all(h);
-    pa_xfree(h);
+    return h->first < h->n_used ? (int) h->first : -1;
 }
 
-static struct hashmap_entry *hash_scan(pa_hashmap *h, unsigned hash, const void *key) {
-    struct hashmap_entry *e;
+static int last_entry(pa_hashmap *h) {
+    /* remove_entry() makes sure there are no holes at the end */
+    return h->n_used > 0 ? (int) h->n_used - 1 : -1;
+}
+
+void pa_hashmap_free(pa_hashmap *h) {
     pa_assert(h);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_HASH(h)[hash]; e; e = e->bucket_next)
-        if (h->compare_func(e->key, key) == 0)
-            return e;
+    pa_hashmap_remove_all(h);
 
-    return NULL;
+    pa_xfree(h->entries);
+    pa_xfree(h->table);
+    pa_xfree(h);
 }
 
 int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
@@ -137,35 +218,23 @@ int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = h->hash_func(key);
 
-    if (hash_scan(h, hash, key))
+    if (table_find(h, hash, key) >= 0)
         return -1;
 
-    if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(entries))))
-        e = pa_xnew(struct hashmap_entry, 1);
+    if (h->n_used >= h->n_allocated || h->n_table_used >= h->n_allocated)
+        make_room(h);
 
+    e = &h->entries[h->n_used];
     e->key = key;
     e->value = value;
+    e->hash = hash;
+    e->removed = false;
 
-    /* Insert into hash table */
-    e->bucket_next = BY_HASH(h)[hash];
-    e->bucket_previous = NULL;
-    if (BY_HASH(h)[hash])
-        BY_HASH(h)[hash]->bucket_previous = e;
-    BY_HASH(h)[hash] = e;
-
-    /* Insert into iteration list */
-    e->iterate_previous = h->iterate_list_tail;
-    e->iterate_next = NULL;
-    if (h->iterate_list_tail) {
-        pa_assert(h->iterate_list_head);
-        h->iterate_list_tail->iterate_next = e;
-    } else {
-        pa_assert(!h->iterate_list_head);
-        h->iterate_list_head = e;
-    }
-    h->iterate_list_tail = e;
+    table_insert(h, hash, h->n_used);
+    h->n_table_used++;
+    h->n_used++;
 
     h->n_entries++;
     pa_assert(h->n_entries >= 1);
@@ -174,33 +243,27 @@ int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
 }
 
 void* pa_hashmap_get(pa_hashmap *h, const void *key) {
-    unsigned hash;
-    struct hashmap_entry *e;
+    int slot;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
-
-    if (!(e = hash_scan(h, hash, key)))
+    if ((slot = table_find(h, h->hash_func(key), key)) < 0)
         return NULL;
 
-    return e->value;
+    return h->entries[h->table[slot] - 1].value;
 }
 
 void* pa_hashmap_remove(pa_hashmap *h, const void *key) {
-    struct hashmap_entry *e;
-    unsigned hash;
     void *data;
+    int slot;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
-
-    if (!(e = hash_scan(h, hash, key)))
+    if ((slot = table_find(h, h->hash_func(key), key)) < 0)
         return NULL;
 
-    data = e->value;
-    remove_entry(h, e);
+    data = h->entries[h->table[slot] - 1].value;
+    remove_entry(h, (unsigned) slot);
 
     return data;
 }
@@ -218,21 +281,39 @@ int pa_hashmap_remove_and_free(pa_hashmap *h, const void *key) {
     return data ? 0 : -1;
 }
 
+/* Removes the entry at pos, which must be live, and returns its value */
+static void *remove_position(pa_hashmap *h, unsigned pos) {
+    struct hashmap_entry *e = &h->entries[pos];
+    void *data = e->value;
+    int slot;
+
+    pa_assert_se((slot = table_find(h, e->hash, e->key)) >= 0);
+    pa_assert(h->table[slot] == pos + 1);
+
+    remove_entry(h, (unsigned) slot);
+
+    return data;
+}
+
 void pa_hashmap_remove_all(pa_hashmap *h) {
+    int pos;
+
     pa_assert(h);
 
-    while (h->iterate_list_head) {
+    while ((pos = first_entry(h)) >= 0) {
         void *data;
-        data = h->iterate_list_head->value;
-        remove_entry(h, h->iterate_list_head);
+
+        data = remove_position(h, (unsigned) pos);
 
         if (h->value_free_func)
             h->value_free_func(data);
     }
 }
 
+/* The state is the position of the next entry to look at plus one, or -1
+ * at the end */
 void *pa_hashmap_iterate(pa_hashmap *h, void **state, const void **key) {
-    struct hashmap_entry *e;
+    unsigned pos;
 
     pa_assert(h);
     pa_assert(state);
@@ -240,20 +321,19 @@ void *pa_hashmap_iterate(pa_hashmap *h, void **state, const void **key) {
     if (*state == (void*) -1)
         goto at_end;
 
-    if (!*state && !h->iterate_list_head)
-        goto at_end;
+    for (pos = *state ? PA_PTR_TO_UINT(*state) - 1 : h->first; pos < h->n_used; pos++) {
+        struct hashmap_entry *e = &h->entries[pos];
 
-    e = *state ? *state : h->iterate_list_head;
+        if (e->removed)
+            continue;
 
-    if (e->iterate_next)
-        *state = e->iterate_next;
-    else
-        *state = (void*) -1;
+        *state = PA_UINT_TO_PTR(pos + 2);
 
-    if (key)
-        *key = e->key;
+        if (key)
+            *key = e->key;
 
-    return e->value;
+        return e->value;
+    }
 
 at_end:
     *state = (void *) -1;
@@ -264,8 +344,9 @@ at_end:
     return NULL;
 }
 
+/* Here the state is the number of positions left to look at plus one */
 void *pa_hashmap_iterate_backwards(pa_hashmap *h, void **state, const void **key) {
-    struct hashmap_entry *e;
+    unsigned n;
 
     pa_assert(h);
     pa_assert(state);
@@ -273,20 +354,21 @@ void *pa_hashmap_iterate_backwards(pa_hashmap *h, void **state, const void **key
     if (*state == (void*) -1)
         goto at_beginning;
 
-    if (!*state && !h->iterate_list_tail)
-        goto at_beginning;
+    n = *state ? PA_PTR_TO_UINT(*state) - 1 : h->n_used;
 
-    e = *state ? *state : h->iterate_list_tail;
+    for (n = PA_MIN(n, h->n_used); n > 0; n--) {
+        struct hashmap_entry *e = &h->entries[n - 1];
 
-    if (e->iterate_previous)
-        *state = e->iterate_previous;
-    else
-        *state = (void*) -1;
+        if (e->removed)
+            continue;
 
-    if (key)
-        *key = e->key;
+        *state = PA_UINT_TO_PTR(n);
 
-    return e->value;
+        if (key)
+            *key = e->key;
+
+        return e->value;
+    }
 
 at_beginning:
     *state = (void *) -1;
@@ -298,35 +380,36 @@ at_beginning:
 }
 
 void* pa_hashmap_first(pa_hashmap *h) {
+    int pos;
+
     pa_assert(h);
 
-    if (!h->iterate_list_head)
+    if ((pos = first_entry(h)) < 0)
         return NULL;
 
-    return h->iterate_list_head->value;
+    return h->entries[pos].value;
 }
 
 void* pa_hashmap_last(pa_hashmap *h) {
+    int pos;
+
     pa_assert(h);
 
-    if (!h->iterate_list_tail)
+    if ((pos = last_entry(h)) < 0)
         return NULL;
 
-    return h->iterate_list_tail->value;
+    return h->entries[pos].value;
 }
 
 void* pa_hashmap_steal_first(pa_hashmap *h) {
-    void *data;
+    int pos;
 
     pa_assert(h);
 
-    if (!h->iterate_list_head)
+    if ((pos = first_entry(h)) < 0)
         return NULL;
 
-    data = h->iterate_list_head->value;
-    remove_entry(h, h->iterate_list_head);
-
-    return data;
+    return remove_position(h, (unsigned) pos);
 }
 
 unsigned pa_hashmap_size(pa_hashmap *h) {
@@ -21,18 +21,25 @@
 #include <config.h>
 #endif
 
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/macro.h>
 
 #include "hook-list.h"
 
+/* Hooks are only fired from the main thread */
+static bool profiling = false;
+
 void pa_hook_init(pa_hook *hook, void *data) {
     pa_assert(hook);
 
     PA_LLIST_HEAD_INIT(pa_hook_slot, hook->slots);
     hook->n_dead = hook->n_firing = 0;
     hook->data = data;
+    hook->get_proplist = NULL;
+    hook->n_fired = 0;
+    hook->usec = 0;
 }
 
 static void slot_free(pa_hook *hook, pa_hook_slot *slot) {
@@ -41,6 +48,7 @@ static void slot_free(pa_hook *hook, pa_hook_slot *slot) {
 
     PA_LLIST_REMOVE(pa_hook_slot, hook->slots, slot);
 
+    pa_xfree(slot->property);
     pa_xfree(slot);
 }
 
@@ -59,7 +67,7 @@ pa_hook_slot* pa_hook_connect(pa_hook *hook, pa_hook_priority_t prio, pa_hook_cb
 
     pa_assert(cb);
 
-    slot = pa_xnew(pa_hook_slot, 1);
+    slot = pa_xnew0(pa_hook_slot, 1);
     slot->hook = hook;
     slot->dead = false;
     slot->callback = cb;
@@ -92,19 +100,55 @@ void pa_hook_slot_free(pa_hook_slot *slot) {
 pa_hook_result_t pa_hook_fire(pa_hook *hook, void *data) {
     pa_hook_slot *slot, *next;
     pa_hook_result_t result = PA_HOOK_OK;
+    pa_proplist *proplist = NULL;
+    bool have_proplist = false;
+    pa_usec_t start = 0;
 
     pa_assert(hook);
 
     hook->n_firing ++;
+    hook->n_fired ++;
+
+    if (profiling)
+        start = pa_rtclock_now();
 
     PA_LLIST_FOREACH(slot, hook->slots) {
+        pa_usec_t t = 0;
+
         if (slot->dead)
             continue;
 
-        if ((result = slot->callback(hook->data, data, slot->data)) != PA_HOOK_OK)
+        if (slot->property) {
+            /* The proplist object stays the same, but an earlier callback
+             * may have changed what is in it */
+            if (!have_proplist) {
+                proplist = hook->get_proplist(data);
+                have_proplist = true;
+            }
+
+            if (!proplist || !pa_proplist_contains(proplist, slot->property)) {
+                slot->n_skipped++;
+                continue;
+            }
+        }
+
+        slot->n_calls++;
+
+        if (profiling)
+            t = pa_rtclock_now();
+
+        result = slot->callback(hook->data, data, slot->data);
+
+        if (profiling)
+            slot->usec += pa_rtclock_now() - t;
+
+        if (result != PA_HOOK_OK)
             break;
     }
 
+    if (profiling)
+        hook->usec += pa_rtclock_now() - start;
+
     hook->n_firing --;
     pa_assert(hook->n_firing >= 0);
 
@@ -127,3 +171,40 @@ bool pa_hook_is_firing(pa_hook *hook) {
 
     return hook->n_firing > 0;
 }
+
+void pa_hook_set_proplist_callback(pa_hook *hook, pa_hook_proplist_cb_t cb) {
+    pa_assert(hook);
+
+    hook->get_proplist = cb;
+}
+
+void pa_hook_slot_set_property_filter(pa_hook_slot *slot, const char *key) {
+    pa_assert(slot);
+    pa_assert(key);
+    pa_assert(slot->hook->get_proplist);
+
+    pa_xfree(slot->property);
+    slot->property = pa_xstrdup(key);
+}
+
+void pa_hook_set_profiling(bool enabled) {
+    profiling = enabled;
+}
+
+bool pa_hook_get_profiling(void) {
+    return profiling;
+}
+
+void pa_hook_reset_stats(pa_hook *hook) {
+    pa_hook_slot *slot;
+
+    pa_assert(hook);
+
+    hook->n_fired = 0;
+    hook->usec = 0;
+
+    PA_LLIST_FOREACH(slot, hook->slots) {
+        slot->n_calls = slot->n_skipped = 0;
+        slot->usec = 0;
+    }
+}
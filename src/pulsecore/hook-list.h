@@ -20,6 +20,9 @@
   License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <pulse/proplist.h>
+#include <pulse/sample.h>
+
 #include <pulsecore/llist.h>
 
 typedef struct pa_hook_slot pa_hook_slot;
@@ -42,12 +45,25 @@ typedef pa_hook_result_t (*pa_hook_cb_t)(
         void *call_data,
         void *slot_data);
 
+/* Returns the proplist of the object a hook is fired for */
+typedef pa_proplist* (*pa_hook_proplist_cb_t)(void *call_data);
+
 struct pa_hook_slot {
     bool dead;
     pa_hook *hook;
     pa_hook_priority_t priority;
     pa_hook_cb_t callback;
     void *data;
+
+    /* If set, the callback is skipped unless the proplist of the call
+     * data contains this property */
+    char *property;
+
+    unsigned n_calls, n_skipped;
+    /* Only counted while profiling is enabled, including the time spent
+     * in hooks that are fired from the callback */
+    pa_usec_t usec;
+
     PA_LLIST_FIELDS(pa_hook_slot);
 };
 
@@ -56,6 +72,11 @@ struct pa_hook {
     int n_firing, n_dead;
 
     void *data;
+
+    pa_hook_proplist_cb_t get_proplist;
+
+    unsigned n_fired;
+    pa_usec_t usec;
 };
 
 void pa_hook_init(pa_hook *hook, void *data);
@@ -68,4 +89,20 @@ pa_hook_result_t pa_hook_fire(pa_hook *hook, void *data);
 
 bool pa_hook_is_firing(pa_hook *hook);
 
+/* Lets slots of this hook use property filters */
+void pa_hook_set_proplist_callback(pa_hook *hook, pa_hook_proplist_cb_t cb);
+
+/* Skip the callback of the slot unless the proplist of the call data
+ * contains the property key. This is cheaper than calling a callback which
+ * would return right away. */
+void pa_hook_slot_set_property_filter(pa_hook_slot *slot, const char *key);
+
+/* Measure the time spent in every hook and slot. This is off by default,
+ * since it takes two clock reads per callback. */
+void pa_hook_set_profiling(bool enabled);
+bool pa_hook_get_profiling(void);
+
+/* Reset the counters of the hook and its slots */
+void pa_hook_reset_stats(pa_hook *hook);
+
 #endif
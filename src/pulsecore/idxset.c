@@ -17,7 +17,6 @@
   You should have received a copy of the GNU Lesser General Public
   License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
 ***/
-
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -27,20 +26,25 @@
 #include <string.h>
 
 #include <pulse/xmalloc.h>
-#include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
 
 #include "idxset.h"
 
-#define NBUCKETS 127
+/* Laid out like pa_hashmap, see there: a dense entry array in insertion
+ * order and an open addressing table for the lookups by data. Since the
+ * indexes are handed out in insertion order, the entry array is sorted by
+ * index too, so lookups by index are a binary search, which usually hits
+ * on the first try while there are no holes before the entry. */
+
+#define MIN_ENTRIES 4U
+#define SLOT_EMPTY 0U
+#define SLOT_REMOVED ((uint32_t) -1)
 
 struct idxset_entry {
     uint32_t idx;
+    bool removed;
+    unsigned hash;
     void *data;
-
-    struct idxset_entry *data_next, *data_previous;
-    struct idxset_entry *index_next, *index_previous;
-    struct idxset_entry *iterate_next, *iterate_previous;
 };
 
 struct pa_idxset {
@@ -49,14 +53,17 @@ struct pa_idxset {
 
     uint32_t current_index;
 
-    struct idxset_entry *iterate_list_head, *iterate_list_tail;
-    unsigned n_entries;
-};
-
-#define BY_DATA(i) ((struct idxset_entry**) ((uint8_t*) (i) + PA_ALIGN(sizeof(pa_idxset))))
-#define BY_INDEX(i) (BY_DATA(i) + NBUCKETS)
+    struct idxset_entry *entries;
+    unsigned n_entries;   /* Live entries */
+    unsigned n_used;      /* Used positions in entries, including holes */
+    unsigned n_allocated;
+    unsigned first;       /* No live entries before this position */
 
-PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
+    /* Positions plus one, or SLOT_EMPTY or SLOT_REMOVED */
+    uint32_t *table;
+    unsigned table_mask, table_shift;
+    unsigned n_table_used; /* Slots that are not SLOT_EMPTY */
+};
 
 unsigned pa_idxset_string_hash_func(const void *p) {
     unsigned hash = 0;
@@ -80,143 +87,222 @@ int pa_idxset_trivial_compare_func(const void *a, const void *b) {
     return a < b ? -1 : (a > b ? 1 : 0);
 }
 
+/* Fibonacci hashing, to spread the bits of the hash, since the trivial hash
+ * of a pointer has its low bits all zero */
+static inline unsigned table_start(pa_idxset *s, unsigned hash) {
+    return (unsigned) (((uint32_t) hash * 2654435769U) >> s->table_shift);
+}
+
 pa_idxset* pa_idxset_new(pa_hash_func_t hash_func, pa_compare_func_t compare_func) {
     pa_idxset *s;
 
-    s = pa_xmalloc0(PA_ALIGN(sizeof(pa_idxset)) + NBUCKETS*2*sizeof(struct idxset_entry*));
+    s = pa_xnew0(pa_idxset, 1);
 
     s->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     s->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
 
-    s->current_index = 0;
-    s->n_entries = 0;
-    s->iterate_list_head = s->iterate_list_tail = NULL;
-
     return s;
 }
 
-static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
-    pa_assert(s);
-    pa_assert(e);
-
-    /* Remove from iteration linked list */
-    if (e->iterate_next)
-        e->iterate_next->iterate_previous = e->iterate_previous;
-    else
-        s->iterate_list_tail = e->iterate_previous;
-
-    if (e->iterate_previous)
-        e->iterate_previous->iterate_next = e->iterate_next;
-    else
-        s->iterate_list_head = e->iterate_next;
-
-    /* Remove from data hash table */
-    if (e->data_next)
-        e->data_next->data_previous = e->data_previous;
-
-    if (e->data_previous)
-        e->data_previous->data_next = e->data_next;
-    else {
-        unsigned hash = s->hash_func(e->data) % NBUCKETS;
-        BY_DATA(s)[hash] = e->data_next;
+static void table_insert(pa_idxset *s, unsigned hash, unsigned pos) {
+    unsigned i;
+
+    for (i = table_start(s, hash); s->table[i] != SLOT_EMPTY; i = (i + 1) & s->table_mask)
+        ;
+
+    s->table[i] = pos + 1;
+}
+
+/* Closes the holes in the entry array and grows it if it is still full
+ * then, and rebuilds the table */
+static void make_room(pa_idxset *s) {
+    unsigned i, j;
+
+    for (i = j = 0; i < s->n_used; i++)
+        if (!s->entries[i].removed)
+            s->entries[j++] = s->entries[i];
+
+    s->n_used = j;
+    s->first = 0;
+
+    if (s->n_used >= s->n_allocated / 2) {
+        s->n_allocated = PA_MAX(MIN_ENTRIES, s->n_allocated * 2);
+        s->entries = pa_xrenew(struct idxset_entry, s->entries, s->n_allocated);
+
+        pa_xfree(s->table);
+        s->table = pa_xnew(uint32_t, s->n_allocated * 2);
+        s->table_mask = s->n_allocated * 2 - 1;
+
+        for (s->table_shift = 32; (1U << (32 - s->table_shift)) < s->n_allocated * 2; s->table_shift--)
+            ;
     }
 
-    /* Remove from index hash table */
-    if (e->index_next)
-        e->index_next->index_previous = e->index_previous;
+    memset(s->table, 0, (s->table_mask + 1) * sizeof(uint32_t));
 
-    if (e->index_previous)
-        e->index_previous->index_next = e->index_next;
-    else
-        BY_INDEX(s)[e->idx % NBUCKETS] = e->index_next;
+    for (i = 0; i < s->n_used; i++)
+        table_insert(s, s->entries[i].hash, i);
 
-    if (pa_flist_push(PA_STATIC_FLIST_GET(entries), e) < 0)
-        pa_xfree(e);
+    s->n_table_used = s->n_used;
+}
 
-    pa_assert(s->n_entries >= 1);
-    s->n_entries--;
+/* Returns the table slot of the data, or -1 */
+static int table_find(pa_idxset *s, unsigned hash, const void *p) {
+    unsigned i;
+
+    if (!s->table)
+        return -1;
+
+    for (i = table_start(s, hash); s->table[i] != SLOT_EMPTY; i = (i + 1) & s->table_mask) {
+        struct idxset_entry *e;
+
+        if (s->table[i] == SLOT_REMOVED)
+            continue;
+
+        e = &s->entries[s->table[i] - 1];
+
+        if (e->hash == hash && s->compare_func(e->data, p) == 0)
+            return (int) i;
+    }
+
+    return -1;
 }
 
-void pa_idxset_free(pa_idxset *s, pa_free_cb_t free_cb) {
-    pa_assert(s);
+/* Returns the first position whose index is not smaller than idx */
+static unsigned index_lower_bound(pa_idxset *s, uint32_t idx) {
+    unsigned lo = 0, hi = s->n_used;
 
-    pa_idxset_remove_all(s, free_cb);
-    pa_xfree(s);
+    if (s->n_used > 0 && idx >= s->entries[0].idx) {
+        uint32_t guess = idx - s->entries[0].idx;
+
+        if (guess < s->n_used && s->entries[guess].idx == idx)
+            return guess;
+    }
+
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+
+        if (s->entries[mid].idx < idx)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Returns the position of the live entry with the index, or -1 */
+static int index_find(pa_idxset *s, uint32_t idx) {
+    unsigned pos;
+
+    pos = index_lower_bound(s, idx);
+
+    if (pos >= s->n_used || s->entries[pos].idx != idx || s->entries[pos].removed)
+        return -1;
+
+    return (int) pos;
+}
+
+/* Returns the position of the first live entry at or after pos, or -1 */
+static int next_entry(pa_idxset *s, unsigned pos) {
+    for (; pos < s->n_used; pos++)
+        if (!s->entries[pos].removed)
+            return (int) pos;
+
+    return -1;
+}
+
+static int first_entry(pa_idxset *s) {
+    int pos;
+
+    if ((pos = next_entry(s, s->first)) >= 0)
+        s->first = (unsigned) pos;
+
+    return pos;
 }
 
-static struct idxset_entry* data_scan(pa_idxset *s, unsigned hash, const void *p) {
+static void remove_entry(pa_idxset *s, unsigned slot) {
     struct idxset_entry *e;
+
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
-    pa_assert(p);
+    pa_assert(s->table[slot] != SLOT_EMPTY && s->table[slot] != SLOT_REMOVED);
 
-    for (e = BY_DATA(s)[hash]; e; e = e->data_next)
-        if (s->compare_func(e->data, p) == 0)
-            return e;
+    e = &s->entries[s->table[slot] - 1];
+    pa_assert(!e->removed);
 
-    return NULL;
+    e->removed = true;
+    s->table[slot] = SLOT_REMOVED;
+
+    pa_assert(s->n_entries >= 1);
+    s->n_entries--;
+
+    /* Cheaply reclaim space at the end of the array, and everything once
+     * the set is empty */
+    while (s->n_used > 0 && s->entries[s->n_used - 1].removed)
+        s->n_used--;
+
+    if (s->first > s->n_used)
+        s->first = s->n_used;
+
+    if (s->n_entries == 0) {
+        s->n_used = 0;
+        s->first = 0;
+        s->n_table_used = 0;
+        memset(s->table, 0, (s->table_mask + 1) * sizeof(uint32_t));
+    }
 }
 
-static struct idxset_entry* index_scan(pa_idxset *s, unsigned hash, uint32_t idx) {
-    struct idxset_entry *e;
+/* Removes the entry at pos, which must be live, and returns its data */
+static void *remove_position(pa_idxset *s, unsigned pos) {
+    struct idxset_entry *e = &s->entries[pos];
+    void *data = e->data;
+    int slot;
+
+    pa_assert_se((slot = table_find(s, e->hash, e->data)) >= 0);
+    pa_assert(s->table[slot] == pos + 1);
+
+    remove_entry(s, (unsigned) slot);
+
+    return data;
+}
+
+void pa_idxset_free(pa_idxset *s, pa_free_cb_t free_cb) {
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_INDEX(s)[hash]; e; e = e->index_next)
-        if (e->idx == idx)
-            return e;
+    pa_idxset_remove_all(s, free_cb);
 
-    return NULL;
+    pa_xfree(s->entries);
+    pa_xfree(s->table);
+    pa_xfree(s);
 }
 
 int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
-    unsigned hash;
     struct idxset_entry *e;
+    unsigned hash;
+    int slot;
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
+    hash = s->hash_func(p);
 
-    if ((e = data_scan(s, hash, p))) {
+    if ((slot = table_find(s, hash, p)) >= 0) {
         if (idx)
-            *idx = e->idx;
+            *idx = s->entries[s->table[slot] - 1].idx;
 
         return -1;
     }
 
-    if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(entries))))
-        e = pa_xnew(struct idxset_entry, 1);
+    if (s->n_used >= s->n_allocated || s->n_table_used >= s->n_allocated)
+        make_room(s);
 
+    e = &s->entries[s->n_used];
     e->data = p;
+    e->hash = hash;
     e->idx = s->current_index++;
+    e->removed = false;
 
-    /* Insert into data hash table */
-    e->data_next = BY_DATA(s)[hash];
-    e->data_previous = NULL;
-    if (BY_DATA(s)[hash])
-        BY_DATA(s)[hash]->data_previous = e;
-    BY_DATA(s)[hash] = e;
-
-    hash = e->idx % NBUCKETS;
-
-    /* Insert into index hash table */
-    e->index_next = BY_INDEX(s)[hash];
-    e->index_previous = NULL;
-    if (BY_INDEX(s)[hash])
-        BY_INDEX(s)[hash]->index_previous = e;
-    BY_INDEX(s)[hash] = e;
-
-    /* Insert into iteration list */
-    e->iterate_previous = s->iterate_list_tail;
-    e->iterate_next = NULL;
-    if (s->iterate_list_tail) {
-        pa_assert(s->iterate_list_head);
-        s->iterate_list_tail->iterate_next = e;
-    } else {
-        pa_assert(!s->iterate_list_head);
-        s->iterate_list_head = e;
-    }
-    s->iterate_list_tail = e;
+    table_insert(s, hash, s->n_used);
+    s->n_table_used++;
+    s->n_used++;
 
     s->n_entries++;
     pa_assert(s->n_entries >= 1);
@@ -228,30 +314,28 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
 }
 
 void* pa_idxset_get_by_index(pa_idxset*s, uint32_t idx) {
-    unsigned hash;
-    struct idxset_entry *e;
+    int pos;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if ((pos = index_find(s, idx)) < 0)
         return NULL;
 
-    return e->data;
+    return s->entries[pos].data;
 }
 
 void* pa_idxset_get_by_data(pa_idxset*s, const void *p, uint32_t *idx) {
-    unsigned hash;
     struct idxset_entry *e;
+    int slot;
 
     pa_assert(s);
+    pa_assert(p);
 
-    hash = s->hash_func(p) % NBUCKETS;
-
-    if (!(e = data_scan(s, hash, p)))
+    if ((slot = table_find(s, s->hash_func(p), p)) < 0)
         return NULL;
 
+    e = &s->entries[s->table[slot] - 1];
+
     if (idx)
         *idx = e->idx;
 
@@ -259,52 +343,45 @@ void* pa_idxset_get_by_data(pa_idxset*s, const void *p, uint32_t *idx) {
 }
 
 void* pa_idxset_remove_by_index(pa_idxset*s, uint32_t idx) {
-    struct idxset_entry *e;
-    unsigned hash;
-    void *data;
+    int pos;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if ((pos = index_find(s, idx)) < 0)
         return NULL;
 
-    data = e->data;
-    remove_entry(s, e);
-
-    return data;
+    return remove_position(s, (unsigned) pos);
 }
 
 void* pa_idxset_remove_by_data(pa_idxset*s, const void *data, uint32_t *idx) {
     struct idxset_entry *e;
-    unsigned hash;
     void *r;
+    int slot;
 
     pa_assert(s);
+    pa_assert(data);
 
-    hash = s->hash_func(data) % NBUCKETS;
-
-    if (!(e = data_scan(s, hash, data)))
+    if ((slot = table_find(s, s->hash_func(data), data)) < 0)
         return NULL;
 
+    e = &s->entries[s->table[slot] - 1];
     r = e->data;
 
     if (idx)
         *idx = e->idx;
 
-    remove_entry(s, e);
+    remove_entry(s, (unsigned) slot);
 
     return r;
 }
 
 void pa_idxset_remove_all(pa_idxset *s, pa_free_cb_t free_cb) {
-    pa_assert(s);
+    int pos;
 
-    while (s->iterate_list_head) {
-        void *data = s->iterate_list_head->data;
+    pa_assert(s);
 
-        remove_entry(s, s->iterate_list_head);
+    while ((pos = first_entry(s)) >= 0) {
+        void *data = remove_position(s, (unsigned) pos);
 
         if (free_cb)
             free_cb(data);
@@ -312,30 +389,26 @@ void pa_idxset_remove_all(pa_idxset *s, pa_free_cb_t free_cb) {
 }
 
 void* pa_idxset_rrobin(pa_idxset *s, uint32_t *idx) {
-    unsigned hash;
-    struct idxset_entry *e;
+    int pos;
 
     pa_assert(s);
     pa_assert(idx);
 
-    hash = *idx % NBUCKETS;
-
-    e = index_scan(s, hash, *idx);
+    if ((pos = index_find(s, *idx)) < 0 ||
+        (pos = next_entry(s, (unsigned) pos + 1)) < 0)
+        pos = first_entry(s);
 
-    if (e && e->iterate_next)
-        e = e->iterate_next;
-    else
-        e = s->iterate_list_head;
-
-    if (!e)
+    if (pos < 0)
         return NULL;
 
-    *idx = e->idx;
-    return e->data;
+    *idx = s->entries[pos].idx;
+    return s->entries[pos].data;
 }
 
+/* The state is the position of the next entry to look at plus one, or -1
+ * at the end */
 void *pa_idxset_iterate(pa_idxset *s, void **state, uint32_t *idx) {
-    struct idxset_entry *e;
+    int pos;
 
     pa_assert(s);
     pa_assert(state);
@@ -343,20 +416,15 @@ void *pa_idxset_iterate(pa_idxset *s, void **state, uint32_t *idx) {
     if (*state == (void*) -1)
         goto at_end;
 
-    if ((!*state && !s->iterate_list_head))
+    if ((pos = next_entry(s, *state ? PA_PTR_TO_UINT(*state) - 1 : s->first)) < 0)
         goto at_end;
 
-    e = *state ? *state : s->iterate_list_head;
-
-    if (e->iterate_next)
-        *state = e->iterate_next;
-    else
-        *state = (void*) -1;
+    *state = PA_UINT_TO_PTR(pos + 2);
 
     if (idx)
-        *idx = e->idx;
+        *idx = s->entries[pos].idx;
 
-    return e->data;
+    return s->entries[pos].data;
 
 at_end:
     *state = (void *) -1;
@@ -368,41 +436,39 @@ at_end:
 }
 
 void* pa_idxset_steal_first(pa_idxset *s, uint32_t *idx) {
-    void *data;
+    int pos;
 
     pa_assert(s);
 
-    if (!s->iterate_list_head)
+    if ((pos = first_entry(s)) < 0)
         return NULL;
 
-    data = s->iterate_list_head->data;
-
     if (idx)
-        *idx = s->iterate_list_head->idx;
-
-    remove_entry(s, s->iterate_list_head);
+        *idx = s->entries[pos].idx;
 
-    return data;
+    return remove_position(s, (unsigned) pos);
 }
 
 void* pa_idxset_first(pa_idxset *s, uint32_t *idx) {
+    int pos;
+
     pa_assert(s);
 
-    if (!s->iterate_list_head) {
+    if ((pos = first_entry(s)) < 0) {
         if (idx)
             *idx = PA_IDXSET_INVALID;
         return NULL;
     }
 
     if (idx)
-        *idx = s->iterate_list_head->idx;
+        *idx = s->entries[pos].idx;
 
-    return s->iterate_list_head->data;
+    return s->entries[pos].data;
 }
 
 void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
-    struct idxset_entry *e;
-    unsigned hash;
+    unsigned pos;
+    int next;
 
     pa_assert(s);
     pa_assert(idx);
@@ -410,38 +476,20 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
     if (*idx == PA_IDXSET_INVALID)
         return NULL;
 
-    hash = *idx % NBUCKETS;
+    /* The entry passed may not exist anymore, in that case we return the
+     * one following where it was */
+    pos = index_lower_bound(s, *idx);
 
-    if ((e = index_scan(s, hash, *idx))) {
-
-        e = e->iterate_next;
-
-        if (e) {
-            *idx = e->idx;
-            return e->data;
-        } else {
-            *idx = PA_IDXSET_INVALID;
-            return NULL;
-        }
-
-    } else {
-
-        /* If the entry passed doesn't exist anymore we try to find
-         * the next following */
-
-        for ((*idx)++; *idx < s->current_index; (*idx)++) {
-
-            hash = *idx % NBUCKETS;
-
-            if ((e = index_scan(s, hash, *idx))) {
-                *idx = e->idx;
-                return e->data;
-            }
-        }
+    if (pos < s->n_used && s->entries[pos].idx == *idx)
+        pos++;
 
+    if ((next = next_entry(s, pos)) < 0) {
         *idx = PA_IDXSET_INVALID;
         return NULL;
     }
+
+    *idx = s->entries[next].idx;
+    return s->entries[next].data;
 }
 
 unsigned pa_idxset_size(pa_idxset*s) {
@@ -458,14 +506,14 @@ bool pa_idxset_isempty(pa_idxset *s) {
 
 pa_idxset *pa_idxset_copy(pa_idxset *s, pa_copy_func_t copy_func) {
     pa_idxset *copy;
-    struct idxset_entry *i;
+    int pos;
 
     pa_assert(s);
 
     copy = pa_idxset_new(s->hash_func, s->compare_func);
 
-    for (i = s->iterate_list_head; i; i = i->iterate_next)
-        pa_idxset_put(copy, copy_func ? copy_func(i->data) : i->data, NULL);
+    for (pos = next_entry(s, 0); pos >= 0; pos = next_entry(s, (unsigned) pos + 1))
+        pa_idxset_put(copy, copy_func ? copy_func(s->entries[pos].data) : s->entries[pos].data, NULL);
 
     return copy;
 }
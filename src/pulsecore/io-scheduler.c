@@ -0,0 +1,430 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/util.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+#include "io-scheduler.h"
+
+typedef struct io_thread io_thread;
+
+struct pa_io_scheduler_client {
+    io_thread *thread;
+    pa_module *module;
+
+    pa_io_scheduler_process_cb_t cb;
+    void *userdata;
+
+    /* Only the inq is used: the outq of the thread is installed for
+     * everything running in it */
+    pa_thread_mq mq;
+
+    /* Only accessed from the IO thread */
+    pa_rtpoll_item *read_item;
+    pa_usec_t deadline;
+};
+
+struct io_thread {
+    pa_msgobject parent;
+
+    pa_thread *thread;
+    pa_thread_mq mq;
+    pa_rtpoll *rtpoll;
+    int rtprio;
+
+    /* Set if the memblock thread cache shall be used */
+    pa_mempool *cache_mempool;
+
+    pa_io_scheduler_round_cb_t round_cb;
+    void *round_userdata;
+
+    /* Main thread */
+    unsigned n_clients;
+
+    /* IO thread, ordered by deadline */
+    pa_io_scheduler_client **clients;
+    unsigned n_active, n_allocated;
+};
+
+struct pa_io_scheduler {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+    bool shared;
+    unsigned n_threads;
+    io_thread **threads;
+};
+
+enum {
+    IO_THREAD_MESSAGE_ADD_CLIENT,
+    IO_THREAD_MESSAGE_REMOVE_CLIENT,
+    IO_THREAD_MESSAGE_MAX
+};
+
+PA_DEFINE_PRIVATE_CLASS(io_thread, pa_msgobject);
+#define IO_THREAD(o) (io_thread_cast(o))
+
+static void io_thread_free(pa_object *o) {
+    io_thread *t = IO_THREAD(o);
+
+    pa_assert(t->n_active == 0);
+
+    pa_xfree(t->clients);
+    pa_xfree(t);
+}
+
+/* Called from IO thread context */
+static int io_thread_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    io_thread *t = IO_THREAD(o);
+    pa_io_scheduler_client *c = data;
+    unsigned i;
+
+    switch (code) {
+        case IO_THREAD_MESSAGE_ADD_CLIENT:
+            if (t->n_active >= t->n_allocated) {
+                t->n_allocated = PA_MAX(2 * t->n_allocated, 8U);
+                t->clients = pa_xrenew(pa_io_scheduler_client*, t->clients, t->n_allocated);
+            }
+
+            c->read_item = pa_rtpoll_item_new_asyncmsgq_read(t->rtpoll, PA_RTPOLL_EARLY, c->mq.inq);
+
+            /* Run it on the next iteration */
+            c->deadline = 0;
+            memmove(t->clients + 1, t->clients, t->n_active * sizeof(pa_io_scheduler_client*));
+            t->clients[0] = c;
+            t->n_active++;
+
+            return 0;
+
+        case IO_THREAD_MESSAGE_REMOVE_CLIENT:
+            for (i = 0; i < t->n_active; i++)
+                if (t->clients[i] == c)
+                    break;
+
+            pa_assert(i < t->n_active);
+
+            memmove(t->clients + i, t->clients + i + 1, (t->n_active - i - 1) * sizeof(pa_io_scheduler_client*));
+            t->n_active--;
+
+            pa_rtpoll_item_free(c->read_item);
+            c->read_item = NULL;
+
+            return 0;
+    }
+
+    return 0;
+}
+
+/* Calls every client, the one whose deadline is closest first, and
+ * returns the earliest of the new deadlines. The clients can't tell us
+ * whether a message they got needs them to act, so the ones not due yet
+ * are called as well, just like the loop of a dedicated thread would run
+ * on every wakeup. */
+static pa_usec_t run_clients(io_thread *t) {
+    pa_usec_t deadline = PA_USEC_INVALID;
+    unsigned i, j;
+
+    for (i = 0; i < t->n_active; i++) {
+        pa_io_scheduler_client *c = t->clients[i];
+
+        c->deadline = c->cb(c->userdata);
+        deadline = PA_MIN(deadline, c->deadline);
+    }
+
+    /* The order hardly changes between two runs, so insertion sort it */
+    for (i = 1; i < t->n_active; i++) {
+        pa_io_scheduler_client *c = t->clients[i];
+
+        for (j = i; j > 0 && t->clients[j - 1]->deadline > c->deadline; j--)
+            t->clients[j] = t->clients[j - 1];
+
+        t->clients[j] = c;
+    }
+
+    return deadline;
+}
+
+/* If the rtpoll broke, unload the modules of our clients and serve the
+ * queues by polling them until the main thread shuts us down */
+static void drain_queues(io_thread *t) {
+    unsigned i;
+
+    for (i = 0; i < t->n_active; i++)
+        pa_asyncmsgq_post(t->mq.outq, PA_MSGOBJECT(t->clients[i]->module->core), PA_CORE_MESSAGE_UNLOAD_MODULE,
+                          t->clients[i]->module, 0, NULL, NULL);
+
+    for (;;) {
+        pa_msgobject *object;
+        int code;
+        void *data;
+        int64_t offset;
+        pa_memchunk chunk;
+
+        for (i = 0; i < t->n_active; i++)
+            while (pa_asyncmsgq_process_one(t->clients[i]->mq.inq) > 0)
+                ;
+
+        while (pa_asyncmsgq_get(t->mq.inq, &object, &code, &data, &offset, &chunk, false) >= 0) {
+            int ret;
+
+            if (!object && code == PA_MESSAGE_SHUTDOWN) {
+                pa_asyncmsgq_done(t->mq.inq, 0);
+                return;
+            }
+
+            ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
+            pa_asyncmsgq_done(t->mq.inq, ret);
+        }
+
+        pa_msleep(10);
+    }
+}
+
+static void thread_func(void *userdata) {
+    io_thread *t = userdata;
+
+    pa_assert(t);
+
+    pa_log_debug("Thread starting up");
+
+    if (t->rtprio > 0)
+        pa_make_realtime(t->rtprio);
+
+    pa_thread_mq_install(&t->mq);
+
+    if (t->cache_mempool)
+        pa_mempool_thread_cache_enable(t->cache_mempool);
+
+    for (;;) {
+        pa_usec_t deadline;
+        int ret;
+
+        deadline = run_clients(t);
+
+        if (t->round_cb)
+            t->round_cb(t->round_userdata);
+
+        if (deadline != PA_USEC_INVALID)
+            pa_rtpoll_set_timer_absolute(t->rtpoll, deadline);
+        else
+            pa_rtpoll_set_timer_disabled(t->rtpoll);
+
+        if ((ret = pa_rtpoll_run(t->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+    }
+
+fail:
+    pa_log("Shared IO thread failed, unloading its devices.");
+    drain_queues(t);
+
+finish:
+    if (t->cache_mempool)
+        pa_mempool_thread_cache_disable(t->cache_mempool);
+
+    pa_log_debug("Thread shutting down");
+}
+
+static void io_scheduler_free(pa_io_scheduler *s) {
+    unsigned i;
+
+    pa_assert(s);
+
+    for (i = 0; i < s->n_threads; i++) {
+        io_thread *t = s->threads[i];
+
+        pa_assert(t->n_clients == 0);
+
+        pa_asyncmsgq_send(t->mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(t->thread);
+
+        pa_thread_mq_done(&t->mq);
+        pa_rtpoll_free(t->rtpoll);
+        io_thread_unref(t);
+    }
+
+    pa_xfree(s->threads);
+    pa_xfree(s);
+}
+
+/* If name is NULL the threads are the shared ones of the core */
+static pa_io_scheduler *io_scheduler_new(pa_core *c, const char *name, unsigned n_threads,
+                                         pa_io_scheduler_round_cb_t round_cb, void *round_userdata) {
+    pa_io_scheduler *s;
+    unsigned i;
+
+    pa_assert(c);
+    pa_assert(n_threads > 0);
+
+    s = pa_xnew0(pa_io_scheduler, 1);
+    PA_REFCNT_INIT(s);
+    s->core = c;
+    s->shared = !name;
+    s->threads = pa_xnew0(io_thread*, n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        io_thread *t;
+        char *thread_name;
+
+        t = pa_msgobject_new(io_thread);
+        t->parent.parent.free = io_thread_free;
+        t->parent.process_msg = io_thread_process_msg;
+        t->rtprio = c->realtime_scheduling ? c->realtime_priority : 0;
+        t->cache_mempool = c->memblock_thread_cache ? c->mempool : NULL;
+        t->round_cb = round_cb;
+        t->round_userdata = round_userdata;
+        t->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&t->mq, c->mainloop, t->rtpoll);
+
+        thread_name = name ? pa_xstrdup(name) : pa_sprintf_malloc("shared-io-%u", i);
+        t->thread = pa_thread_new(thread_name, thread_func, t);
+        pa_xfree(thread_name);
+
+        if (!t->thread) {
+            pa_log("Failed to create thread.");
+            pa_thread_mq_done(&t->mq);
+            pa_rtpoll_free(t->rtpoll);
+            io_thread_unref(t);
+            break;
+        }
+
+        s->threads[s->n_threads++] = t;
+    }
+
+    if (s->n_threads == 0) {
+        io_scheduler_free(s);
+        return NULL;
+    }
+
+    if (s->shared) {
+        pa_log_debug("Started %u shared IO threads.", s->n_threads);
+        pa_assert_se(pa_shared_set(c, "io-scheduler", s) >= 0);
+    }
+
+    return s;
+}
+
+pa_io_scheduler *pa_io_scheduler_get(pa_core *c) {
+    pa_io_scheduler *s;
+
+    pa_assert(c);
+
+    if ((s = pa_shared_get(c, "io-scheduler")))
+        return pa_io_scheduler_ref(s);
+
+    if (c->shared_io_threads == 0)
+        return NULL;
+
+    return io_scheduler_new(c, NULL, c->shared_io_threads, NULL, NULL);
+}
+
+pa_io_scheduler *pa_io_scheduler_new(pa_core *c, const char *name, pa_io_scheduler_round_cb_t round_cb, void *userdata) {
+    pa_assert(c);
+    pa_assert(name);
+
+    return io_scheduler_new(c, name, 1, round_cb, userdata);
+}
+
+pa_io_scheduler *pa_io_scheduler_ref(pa_io_scheduler *s) {
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_REFCNT_INC(s);
+
+    return s;
+}
+
+void pa_io_scheduler_unref(pa_io_scheduler *s) {
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    if (PA_REFCNT_DEC(s) > 0)
+        return;
+
+    if (s->shared) {
+        pa_assert_se(pa_shared_remove(s->core, "io-scheduler") >= 0);
+        pa_log_debug("Stopping %u shared IO threads.", s->n_threads);
+    }
+
+    io_scheduler_free(s);
+}
+
+pa_io_scheduler_client *pa_io_scheduler_client_new(pa_io_scheduler *s, pa_module *m, pa_io_scheduler_process_cb_t cb, void *userdata) {
+    pa_io_scheduler_client *c;
+    io_thread *t;
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(m);
+    pa_assert(cb);
+
+    t = s->threads[0];
+    for (i = 1; i < s->n_threads; i++)
+        if (s->threads[i]->n_clients < t->n_clients)
+            t = s->threads[i];
+
+    c = pa_xnew0(pa_io_scheduler_client, 1);
+    c->thread = t;
+    c->module = m;
+    c->cb = cb;
+    c->userdata = userdata;
+    pa_thread_mq_init(&c->mq, m->core->mainloop, NULL);
+
+    pa_asyncmsgq_send(t->mq.inq, PA_MSGOBJECT(t), IO_THREAD_MESSAGE_ADD_CLIENT, c, 0, NULL);
+    t->n_clients++;
+
+    return c;
+}
+
+void pa_io_scheduler_client_free(pa_io_scheduler_client *c) {
+    pa_assert(c);
+
+    pa_asyncmsgq_send(c->thread->mq.inq, PA_MSGOBJECT(c->thread), IO_THREAD_MESSAGE_REMOVE_CLIENT, c, 0, NULL);
+    c->thread->n_clients--;
+
+    pa_thread_mq_done(&c->mq);
+    pa_xfree(c);
+}
+
+pa_asyncmsgq *pa_io_scheduler_client_get_asyncmsgq(pa_io_scheduler_client *c) {
+    pa_assert(c);
+
+    return c->mq.inq;
+}
+
+pa_rtpoll *pa_io_scheduler_client_get_rtpoll(pa_io_scheduler_client *c) {
+    pa_assert(c);
+
+    return c->thread->rtpoll;
+}
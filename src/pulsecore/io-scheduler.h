@@ -0,0 +1,71 @@
+#ifndef foopulseioschedulerhfoo
+#define foopulseioschedulerhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/asyncmsgq.h>
+#include <pulsecore/core.h>
+#include <pulsecore/module.h>
+#include <pulsecore/rtpoll.h>
+
+/* A few IO threads shared by many simple devices, instead of a thread
+ * per device. Every client gets a message queue that is served by one
+ * of the threads, and a callback that does what the loop of a dedicated
+ * thread would do and returns when it wants to be called again. On
+ * every wakeup a thread calls its clients in earliest deadline first
+ * order. Clients share the thread's rtpoll and must not set its timer
+ * themselves. */
+
+typedef struct pa_io_scheduler pa_io_scheduler;
+typedef struct pa_io_scheduler_client pa_io_scheduler_client;
+
+/* Called from the IO thread. Returns the absolute time at which the
+ * client must be called next, or PA_USEC_INVALID if only messages
+ * should wake it. */
+typedef pa_usec_t (*pa_io_scheduler_process_cb_t)(void *userdata);
+
+/* Called from the IO thread after every round of client calls, before
+ * it goes to sleep */
+typedef void (*pa_io_scheduler_round_cb_t)(void *userdata);
+
+/* Returns the scheduler of the core, starting its threads if needed, or
+ * NULL if shared IO threads are disabled. The threads stop when the last
+ * reference is dropped. */
+pa_io_scheduler *pa_io_scheduler_get(pa_core *c);
+
+/* Returns a scheduler with a thread of its own, for devices that want to
+ * be served together, e.g. the PCMs of one sound card. round_cb may be
+ * NULL. The thread stops when the last reference is dropped. */
+pa_io_scheduler *pa_io_scheduler_new(pa_core *c, const char *name, pa_io_scheduler_round_cb_t round_cb, void *userdata);
+pa_io_scheduler *pa_io_scheduler_ref(pa_io_scheduler *s);
+void pa_io_scheduler_unref(pa_io_scheduler *s);
+
+/* Called from the main thread. The client is put on the thread with the
+ * fewest clients; cb may be called as soon as this returns. If the
+ * thread fails the module is unloaded. */
+pa_io_scheduler_client *pa_io_scheduler_client_new(pa_io_scheduler *s, pa_module *m, pa_io_scheduler_process_cb_t cb, void *userdata);
+void pa_io_scheduler_client_free(pa_io_scheduler_client *c);
+
+/* The queue to pass to pa_sink_set_asyncmsgq() and friends, and the
+ * rtpoll of the thread serving the client */
+pa_asyncmsgq *pa_io_scheduler_client_get_asyncmsgq(pa_io_scheduler_client *c);
+pa_rtpoll *pa_io_scheduler_client_get_rtpoll(pa_io_scheduler_client *c);
+
+#endif
@@ -0,0 +1,208 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "io-trace.h"
+
+struct pa_io_trace {
+    unsigned size, mask;
+    pa_io_trace_entry *entries;
+
+    /* Set by the IO thread. started and written count the entries
+     * whose copy into the ring began and ended, and wrap around. frozen
+     * is cleared again by the reader. */
+    pa_atomic_t started, written, full, xruns, frozen, queries;
+
+    /* Only accessed from the IO thread */
+    unsigned idx, stop_at;
+    bool triggered;
+
+    /* Only accessed from the main thread, for the rate of queries
+     * since the last dump */
+    pa_usec_t last_dump;
+    unsigned last_queries;
+};
+
+pa_io_trace *pa_io_trace_new(unsigned n_entries) {
+    pa_io_trace *t;
+
+    t = pa_xnew0(pa_io_trace, 1);
+    t->size = PA_MAX(pa_make_power_of_two(n_entries), 4U);
+    t->mask = t->size - 1;
+    t->entries = pa_xnew0(pa_io_trace_entry, t->size);
+
+    pa_atomic_store(&t->started, 0);
+    pa_atomic_store(&t->written, 0);
+    pa_atomic_store(&t->full, 0);
+    pa_atomic_store(&t->xruns, 0);
+    pa_atomic_store(&t->frozen, 0);
+    pa_atomic_store(&t->queries, 0);
+
+    t->last_dump = pa_rtclock_now();
+
+    return t;
+}
+
+void pa_io_trace_free(pa_io_trace *t) {
+    pa_assert(t);
+
+    pa_xfree(t->entries);
+    pa_xfree(t);
+}
+
+void pa_io_trace_push(pa_io_trace *t, const pa_io_trace_entry *e) {
+    pa_assert(t);
+    pa_assert(e);
+
+    if (e->flags & PA_IO_TRACE_XRUN)
+        pa_atomic_inc(&t->xruns);
+
+    if (pa_atomic_load(&t->frozen))
+        return;
+
+    pa_atomic_store(&t->started, (int) (t->idx + 1));
+    t->entries[t->idx & t->mask] = *e;
+    t->idx++;
+    pa_atomic_store(&t->written, (int) t->idx);
+
+    if (t->idx == t->size)
+        pa_atomic_store(&t->full, 1);
+
+    if ((e->flags & PA_IO_TRACE_XRUN) && !t->triggered) {
+        t->triggered = true;
+        t->stop_at = t->idx + t->size / 4;
+    }
+
+    if (t->triggered && t->idx == t->stop_at) {
+        t->triggered = false;
+        pa_atomic_store(&t->frozen, 1);
+    }
+}
+
+unsigned pa_io_trace_get(pa_io_trace *t, pa_io_trace_entry *e, unsigned n, uint32_t *xruns, bool *frozen) {
+    unsigned w, first, lost = 0, i;
+    bool f;
+
+    pa_assert(t);
+    pa_assert(e || n == 0);
+
+    /* While frozen the writer does not touch the ring until we thaw it */
+    f = !!pa_atomic_load(&t->frozen);
+    w = (unsigned) pa_atomic_load(&t->written);
+
+    n = PA_MIN(n, pa_atomic_load(&t->full) ? t->size : PA_MIN(w, t->size));
+    first = w - n;
+
+    for (i = 0; i < n; i++)
+        e[i] = t->entries[(first + i) & t->mask];
+
+    if (!f) {
+        /* Whatever the writer started since we looked went over the
+         * oldest entries, maybe while we copied them */
+        unsigned d = (unsigned) pa_atomic_load(&t->started) - w;
+
+        if (d > t->size - n)
+            lost = PA_MIN(d - (t->size - n), n);
+
+        memmove(e, e + lost, (n - lost) * sizeof(pa_io_trace_entry));
+        n -= lost;
+    }
+
+    if (xruns)
+        *xruns = (uint32_t) pa_atomic_load(&t->xruns);
+
+    if (frozen)
+        *frozen = f;
+
+    if (f)
+        pa_atomic_store(&t->frozen, 0);
+
+    return n;
+}
+
+unsigned pa_io_trace_get_size(pa_io_trace *t) {
+    pa_assert(t);
+
+    return t->size;
+}
+
+void pa_io_trace_count_queries(pa_io_trace *t, unsigned n) {
+    pa_assert(t);
+
+    pa_atomic_add(&t->queries, (int) n);
+}
+
+unsigned pa_io_trace_get_queries(pa_io_trace *t) {
+    pa_assert(t);
+
+    return (unsigned) pa_atomic_load(&t->queries);
+}
+
+void pa_io_trace_dump(pa_io_trace *t, pa_strbuf *buf) {
+    pa_io_trace_entry *e;
+    uint32_t xruns;
+    bool frozen;
+    unsigned n, i, queries;
+    pa_usec_t now;
+
+    pa_assert(t);
+    pa_assert(buf);
+
+    now = pa_rtclock_now();
+    queries = pa_io_trace_get_queries(t);
+
+    if (now > t->last_dump)
+        pa_strbuf_printf(buf, "%u device queries, %.1f per second since the last dump.\n", queries,
+                         (double) (queries - t->last_queries) * PA_USEC_PER_SEC / (double) (now - t->last_dump));
+
+    t->last_dump = now;
+    t->last_queries = queries;
+
+    e = pa_xnew(pa_io_trace_entry, t->size);
+    n = pa_io_trace_get(t, e, t->size, &xruns, &frozen);
+
+    pa_strbuf_printf(buf, "%u xruns, %u cycles recorded%s.\n", xruns, n, frozen ? ", stopped after an xrun" : "");
+
+    if (n > 0)
+        pa_strbuf_puts(buf, "      time (ms)  late (ms)       avail  process (ms)  sleep (ms)\n");
+
+    for (i = 0; i < n; i++)
+        pa_strbuf_printf(buf, "%15.3f %10.3f %11lli %13.3f %11.3f%s%s%s\n",
+                         (double) (int64_t) (e[i].time - e[n - 1].time) / PA_USEC_PER_MSEC,
+                         (double) e[i].lateness / PA_USEC_PER_MSEC,
+                         (long long) e[i].avail,
+                         (double) e[i].process_usec / PA_USEC_PER_MSEC,
+                         (double) e[i].sleep_usec / PA_USEC_PER_MSEC,
+                         e[i].flags & PA_IO_TRACE_TIMEOUT ? " timeout" : "",
+                         e[i].flags & PA_IO_TRACE_POLLED ? " polled" : "",
+                         e[i].flags & PA_IO_TRACE_XRUN ? " XRUN" : "");
+
+    pa_xfree(e);
+}
@@ -0,0 +1,56 @@
+#ifndef foopulseiotracehfoo
+#define foopulseiotracehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/introspect.h>
+
+#include <pulsecore/strbuf.h>
+
+/* A ring of the last IO cycles of a device, written by its IO thread
+ * and read from the main thread without locking. When a cycle with an
+ * xrun is pushed, a quarter of the ring more is recorded and then the
+ * ring stops taking entries, so that it keeps what led to the first
+ * xrun. Reading with pa_io_trace_get() starts recording again. */
+
+typedef struct pa_io_trace pa_io_trace;
+
+/* n_entries is rounded up to a power of two */
+pa_io_trace *pa_io_trace_new(unsigned n_entries);
+void pa_io_trace_free(pa_io_trace *t);
+
+/* Called from the IO thread */
+void pa_io_trace_push(pa_io_trace *t, const pa_io_trace_entry *e);
+
+/* Called from the main thread. Copies up to n entries, oldest first,
+ * to e and returns how many were copied. Then restarts recording if it
+ * stopped after an xrun. */
+unsigned pa_io_trace_get(pa_io_trace *t, pa_io_trace_entry *e, unsigned n, uint32_t *xruns, bool *frozen);
+unsigned pa_io_trace_get_size(pa_io_trace *t);
+
+/* Counts the calls that asked the device for its state, e.g. ioctls
+ * for its position. Called from the IO thread. */
+void pa_io_trace_count_queries(pa_io_trace *t, unsigned n);
+
+/* Called from the main thread. The count wraps around. */
+unsigned pa_io_trace_get_queries(pa_io_trace *t);
+
+/* Formats what pa_io_trace_get() returns for the CLI */
+void pa_io_trace_dump(pa_io_trace *t, pa_strbuf *buf);
+
+#endif
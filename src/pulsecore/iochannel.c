@@ -30,6 +30,10 @@
 #include <sys/un.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core-error.h>
@@ -259,6 +263,93 @@ ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l) {
     return r;
 }
 
+#ifdef HAVE_SYS_UIO_H
+
+static size_t iovec_length(const struct iovec *iov, int n) {
+    size_t l = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        l += iov[i].iov_len;
+
+    return l;
+}
+
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, int n) {
+    ssize_t r;
+    size_t l;
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(n > 0);
+    pa_assert(io->ofd >= 0);
+
+    l = iovec_length(iov, n);
+    pa_assert(l);
+
+    for (;;) {
+        if (io->ofd_type == 0) {
+            struct msghdr mh;
+
+            /* Like pa_write(), use sendmsg() on sockets to avoid SIGPIPE */
+            pa_zero(mh);
+            mh.msg_iov = (struct iovec *) iov;
+            mh.msg_iovlen = n;
+
+            r = sendmsg(io->ofd, &mh, MSG_NOSIGNAL);
+
+            if (r < 0 && errno == ENOTSOCK) {
+                io->ofd_type = 1;
+                continue;
+            }
+        } else
+            r = writev(io->ofd, iov, n);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        break;
+    }
+
+    if ((size_t) r == l)
+        return r; /* Fast path - we almost always successfully write everything */
+
+    if (r < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            r = 0;
+        else
+            return r;
+    }
+
+    /* Partial write - let's get a notification when we can write more */
+    io->writable = io->hungup = false;
+    enable_events(io);
+
+    return r;
+}
+
+ssize_t pa_iochannel_readv(pa_iochannel*io, const struct iovec *iov, int n) {
+    ssize_t r;
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(n > 0);
+    pa_assert(io->ifd >= 0);
+
+    while ((r = readv(io->ifd, iov, n)) < 0 && errno == EINTR)
+        ;
+
+    if (r >= 0) {
+        /* See pa_iochannel_read() */
+        io->readable = io->hungup = false;
+        enable_events(io);
+    }
+
+    return r;
+}
+
+#endif /* HAVE_SYS_UIO_H */
+
 #ifdef HAVE_CREDS
 
 bool pa_iochannel_creds_supported(pa_iochannel *io) {
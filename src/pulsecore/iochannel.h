@@ -27,6 +27,10 @@
 
 #include <sys/types.h>
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include <pulse/mainloop-api.h>
 #include <pulsecore/creds.h>
 #include <pulsecore/macro.h>
@@ -51,6 +55,12 @@ void pa_iochannel_free(pa_iochannel*io);
 ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l);
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l);
 
+#ifdef HAVE_SYS_UIO_H
+/* Like the above, but scatter/gather the data with a single system call */
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, int n);
+ssize_t pa_iochannel_readv(pa_iochannel*io, const struct iovec *iov, int n);
+#endif
+
 #ifdef HAVE_CREDS
 bool pa_iochannel_creds_supported(pa_iochannel *io);
 int pa_iochannel_creds_enable(pa_iochannel *io);
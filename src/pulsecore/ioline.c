@@ -61,6 +61,9 @@ struct pa_ioline {
 
     bool dead:1;
     bool defer_close:1;
+    bool read_paused:1;
+    /* Lines may be left in rbuf from before the pause */
+    bool rescan:1;
 };
 
 static void io_callback(pa_iochannel*io, void *userdata);
@@ -93,6 +96,8 @@ pa_ioline* pa_ioline_new(pa_iochannel *io) {
 
     l->dead = false;
     l->defer_close = false;
+    l->read_paused = false;
+    l->rescan = false;
 
     pa_iochannel_set_callback(io, io_callback, l);
 
@@ -246,7 +251,7 @@ static void scan_for_lines(pa_ioline *l, size_t skip) {
     pa_assert(PA_REFCNT_VALUE(l) >= 1);
     pa_assert(skip < l->rbuf_valid_length);
 
-    while (!l->dead && l->rbuf_valid_length > skip) {
+    while (!l->dead && !l->read_paused && l->rbuf_valid_length > skip) {
         char *e, *p;
         size_t m;
 
@@ -272,7 +277,7 @@ static void scan_for_lines(pa_ioline *l, size_t skip) {
     }
 
     /* If the buffer became too large and still no newline was found, drop it. */
-    if (l->rbuf_valid_length >= BUFFER_LIMIT)
+    if (!l->read_paused && l->rbuf_valid_length >= BUFFER_LIMIT)
         l->rbuf_index = l->rbuf_valid_length = 0;
 }
 
@@ -282,7 +287,7 @@ static int do_read(pa_ioline *l) {
     pa_assert(l);
     pa_assert(PA_REFCNT_VALUE(l) >= 1);
 
-    while (l->io && !l->dead && pa_iochannel_is_readable(l->io)) {
+    while (l->io && !l->dead && !l->read_paused && pa_iochannel_is_readable(l->io)) {
         ssize_t r;
         size_t len;
 
@@ -382,6 +387,13 @@ static void do_work(pa_ioline *l) {
 
     l->mainloop->defer_enable(l->defer_event, 0);
 
+    if (!l->dead && !l->read_paused && l->rescan) {
+        l->rescan = false;
+
+        if (l->rbuf_valid_length > 0)
+            scan_for_lines(l, 0);
+    }
+
     if (!l->dead)
         do_read(l);
 
@@ -415,6 +427,22 @@ static void defer_callback(pa_mainloop_api*m, pa_defer_event*e, void *userdata)
     do_work(l);
 }
 
+void pa_ioline_set_read_paused(pa_ioline *l, bool b) {
+    pa_assert(l);
+    pa_assert(PA_REFCNT_VALUE(l) >= 1);
+
+    if (l->dead || l->read_paused == b)
+        return;
+
+    l->read_paused = b;
+
+    /* Get going again from the main loop, not from within the caller */
+    if (!b) {
+        l->rescan = true;
+        l->mainloop->defer_enable(l->defer_event, 1);
+    }
+}
+
 void pa_ioline_defer_close(pa_ioline *l) {
     pa_assert(l);
     pa_assert(PA_REFCNT_VALUE(l) >= 1);
@@ -50,6 +50,10 @@ void pa_ioline_set_callback(pa_ioline*io, pa_ioline_cb_t callback, void *userdat
 /* Set the callback function that is called when everything has been written */
 void pa_ioline_set_drain_callback(pa_ioline*io, pa_ioline_drain_cb_t callback, void *userdata);
 
+/* Stop passing received lines to the callback, and reading from the
+ * channel, until unpaused. Lines already read are kept. */
+void pa_ioline_set_read_paused(pa_ioline *io, bool b);
+
 /* Make sure to close the ioline object as soon as the send buffer is emptied */
 void pa_ioline_defer_close(pa_ioline *io);
 
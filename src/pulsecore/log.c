@@ -50,10 +50,12 @@
 #include <pulse/timeval.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/once.h>
 #include <pulsecore/ratelimit.h>
+#include <pulsecore/semaphore.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/i18n.h>
 
@@ -336,7 +338,7 @@ static void init_defaults(void) {
 }
 
 #ifdef HAVE_SYSLOG_H
-static void log_syslog(pa_log_level_t level, char *t, char *timestamp, char *location, char *bt) {
+static void log_syslog(pa_log_level_t level, char *t, const char *timestamp, const char *location, const char *bt) {
     char *local_t;
 
     openlog(ident, LOG_PID, LOG_USER);
@@ -349,52 +351,18 @@ static void log_syslog(pa_log_level_t level, char *t, char *timestamp, char *loc
 }
 #endif
 
-void pa_log_levelv_meta(
-        pa_log_level_t level,
-        const char*file,
-        int line,
-        const char *func,
-        const char *format,
-        va_list ap) {
-
-    char *t, *n;
-    int saved_errno = errno;
-    char *bt = NULL;
-    pa_log_target_type_t _target;
-    pa_log_level_t _maximum_level;
-    unsigned _show_backtrace;
-    pa_log_flags_t _flags;
-
-    /* We don't use dynamic memory allocation here to minimize the hit
-     * in RT threads */
-    char text[16*1024], location[128], timestamp[32];
-
-    pa_assert(level < PA_LOG_LEVEL_MAX);
-    pa_assert(format);
-
-    init_defaults();
-
-    _target = target_override_set ? target_override : target.type;
-    _maximum_level = PA_MAX(maximum_level, maximum_level_override);
-    _show_backtrace = PA_MAX(show_backtrace, show_backtrace_override);
-    _flags = flags | flags_override;
-
-    if (PA_LIKELY(level > _maximum_level)) {
-        errno = saved_errno;
-        return;
-    }
-
-    pa_vsnprintf(text, sizeof(text), format, ap);
-
+static void format_location(char *location, size_t l, pa_log_flags_t _flags, const char *file, int line, const char *func) {
     if ((_flags & PA_LOG_PRINT_META) && file && line > 0 && func)
-        pa_snprintf(location, sizeof(location), "[%s][%s:%i %s()] ",
+        pa_snprintf(location, l, "[%s][%s:%i %s()] ",
                     pa_strnull(pa_thread_get_name(pa_thread_self())), file, line, func);
     else if ((_flags & (PA_LOG_PRINT_META|PA_LOG_PRINT_FILE)) && file)
-        pa_snprintf(location, sizeof(location), "[%s] %s: ",
+        pa_snprintf(location, l, "[%s] %s: ",
                     pa_strnull(pa_thread_get_name(pa_thread_self())), pa_path_get_filename(file));
     else
         location[0] = 0;
+}
 
+static void format_timestamp(char *timestamp, size_t l, pa_log_flags_t _flags) {
     if (_flags & PA_LOG_PRINT_TIME) {
         static pa_usec_t start, last;
         pa_usec_t u, a, r;
@@ -413,7 +381,7 @@ void pa_log_levelv_meta(
          * anyway. */
         last = u;
 
-        pa_snprintf(timestamp, sizeof(timestamp), "(%4llu.%03llu|%4llu.%03llu) ",
+        pa_snprintf(timestamp, l, "(%4llu.%03llu|%4llu.%03llu) ",
                     (unsigned long long) (a / PA_USEC_PER_SEC),
                     (unsigned long long) (((a / PA_USEC_PER_MSEC)) % 1000),
                     (unsigned long long) (r / PA_USEC_PER_SEC),
@@ -421,11 +389,26 @@ void pa_log_levelv_meta(
 
     } else
         timestamp[0] = 0;
+}
 
-#ifdef HAVE_EXECINFO_H
-    if (_show_backtrace > 0)
-        bt = get_backtrace(_show_backtrace);
-#endif
+/* Writes out a formatted message line by line. text is modified. */
+static void log_output(
+        pa_log_level_t level,
+        const char *file,
+        int line,
+        const char *func,
+        char *text,
+        const char *location,
+        const char *timestamp,
+        const char *bt,
+        int *saved_errno) {
+
+    char *t, *n;
+    pa_log_target_type_t _target;
+    pa_log_flags_t _flags;
+
+    _target = target_override_set ? target_override : target.type;
+    _flags = flags | flags_override;
 
     if (!pa_utf8_valid(text))
         pa_logl(level, "Invalid UTF-8 string following below:");
@@ -503,7 +486,7 @@ void pa_log_levelv_meta(
 #else
                     pa_log_target new_target = { .type = PA_LOG_STDERR, .file = NULL };
 
-                    saved_errno = errno;
+                    *saved_errno = errno;
                     fprintf(stderr, "%s\n", "Error writing logs to the journal. Redirect log messages to console.");
                     fprintf(stderr, "%s %s\n", metadata, t);
 #endif
@@ -532,7 +515,7 @@ void pa_log_levelv_meta(
                             || (bt && pa_write(log_fd, bt, strlen(bt), &write_type) < 0)
                             || (pa_write(log_fd, "\n", 1, &write_type) < 0)) {
                         pa_log_target new_target = { .type = PA_LOG_STDERR, .file = NULL };
-                        saved_errno = errno;
+                        *saved_errno = errno;
                         fprintf(stderr, "%s\n", "Error writing logs to a file descriptor. Redirect log messages to console.");
                         fprintf(stderr, "%s %s\n", metadata, t);
                         pa_log_set_target(&new_target);
@@ -549,6 +532,283 @@ void pa_log_levelv_meta(
         }
     }
 
+}
+
+/* Asynchronous logging: while enabled, messages from all threads except the
+ * one that enabled it are formatted into a ring owned by the calling thread
+ * instead of being written out. Each ring has a single writer (its thread)
+ * and a single reader (the logger thread), so neither side takes a lock, and
+ * a message that finds its ring full is dropped and counted. The logger
+ * thread runs at normal priority and writes the records to the configured
+ * target. */
+
+#define ASYNC_RING_SLOTS 128
+#define ASYNC_TEXT_MAX 1024
+
+typedef struct log_record {
+    pa_log_level_t level;
+    const char *file;
+    int line;
+    const char *func;
+    char timestamp[32];
+    char location[128];
+    char text[ASYNC_TEXT_MAX];
+} log_record;
+
+typedef struct log_ring log_ring;
+
+struct log_ring {
+    log_record records[ASYNC_RING_SLOTS];
+    pa_atomic_t write_index; /* only changed by the owning thread */
+    pa_atomic_t read_index;  /* only changed by the logger thread */
+    pa_atomic_t dropped;
+    pa_atomic_t dead;        /* set when the owning thread exited */
+    char *thread_name;
+    log_ring *next;
+};
+
+static pa_atomic_t async_enabled = PA_ATOMIC_INIT(0);
+static pa_atomic_t async_quit = PA_ATOMIC_INIT(0);
+static pa_atomic_t async_dropped = PA_ATOMIC_INIT(0);
+static pa_atomic_ptr_t new_rings = PA_ATOMIC_PTR_INIT(NULL);
+static log_ring *rings = NULL; /* only accessed by the logger thread */
+static pa_thread *logger_thread = NULL;
+static pa_semaphore *logger_semaphore = NULL;
+
+static void thread_ring_exit(void *p) {
+    log_ring *r = p;
+
+    pa_atomic_store(&r->dead, 1);
+}
+
+PA_STATIC_TLS_DECLARE(thread_ring, thread_ring_exit);
+
+/* Set for the threads that always log synchronously */
+PA_STATIC_TLS_DECLARE_NO_FREE(thread_sync);
+
+static log_ring *get_thread_ring(void) {
+    log_ring *r;
+
+    if ((r = PA_STATIC_TLS_GET(thread_ring)))
+        return r;
+
+    /* The first message of a thread pays for the allocation of its ring */
+    r = pa_xnew0(log_ring, 1);
+    r->thread_name = pa_xstrdup(pa_thread_get_name(pa_thread_self()));
+    PA_STATIC_TLS_SET(thread_ring, r);
+
+    do
+        r->next = pa_atomic_ptr_load(&new_rings);
+    while (!pa_atomic_ptr_cmpxchg(&new_rings, r->next, r));
+
+    return r;
+}
+
+static void log_async(
+        pa_log_level_t level,
+        const char *file,
+        int line,
+        const char *func,
+        pa_log_flags_t _flags,
+        const char *format,
+        va_list ap) {
+
+    log_ring *r;
+    log_record *rec;
+    unsigned w;
+
+    r = get_thread_ring();
+
+    w = (unsigned) pa_atomic_load(&r->write_index);
+    if (w - (unsigned) pa_atomic_load(&r->read_index) >= ASYNC_RING_SLOTS) {
+        pa_atomic_inc(&r->dropped);
+        pa_atomic_inc(&async_dropped);
+        return;
+    }
+
+    rec = &r->records[w % ASYNC_RING_SLOTS];
+    rec->level = level;
+    rec->file = file;
+    rec->line = line;
+    rec->func = func;
+    pa_vsnprintf(rec->text, sizeof(rec->text), format, ap);
+    format_location(rec->location, sizeof(rec->location), _flags, file, line, func);
+    format_timestamp(rec->timestamp, sizeof(rec->timestamp), _flags);
+
+    pa_atomic_inc(&r->write_index);
+
+    /* Only enters the kernel if the logger thread is sleeping */
+    pa_semaphore_post(logger_semaphore);
+}
+
+static void drain_ring(log_ring *r) {
+    int dropped, saved_errno = 0;
+    unsigned i;
+
+    i = (unsigned) pa_atomic_load(&r->read_index);
+
+    while (i != (unsigned) pa_atomic_load(&r->write_index)) {
+        log_record *rec = &r->records[i % ASYNC_RING_SLOTS];
+
+        log_output(rec->level, rec->file, rec->line, rec->func, rec->text, rec->location, rec->timestamp, NULL, &saved_errno);
+
+        pa_atomic_inc(&r->read_index);
+        i++;
+    }
+
+    if ((dropped = pa_atomic_load(&r->dropped)) > 0) {
+        pa_atomic_sub(&r->dropped, dropped);
+        pa_log_warn("Dropped %i log messages of thread %s, its log ring was full.", dropped, pa_strnull(r->thread_name));
+    }
+}
+
+static void drain_rings(void) {
+    log_ring *r, **p, *n;
+
+    /* Pick up the rings of threads that logged for the first time */
+    do
+        n = pa_atomic_ptr_load(&new_rings);
+    while (!pa_atomic_ptr_cmpxchg(&new_rings, n, NULL));
+
+    while (n) {
+        r = n;
+        n = r->next;
+        r->next = rings;
+        rings = r;
+    }
+
+    for (p = &rings; (r = *p);) {
+        bool dead = pa_atomic_load(&r->dead);
+
+        drain_ring(r);
+
+        if (dead) {
+            *p = r->next;
+            pa_xfree(r->thread_name);
+            pa_xfree(r);
+        } else
+            p = &r->next;
+    }
+}
+
+static void logger_thread_func(void *userdata) {
+    PA_STATIC_TLS_SET(thread_sync, (void*) 1);
+
+    /* Don't inherit the priority of the thread that started us */
+    pa_reset_priority();
+
+    for (;;) {
+        bool quit;
+
+        pa_semaphore_wait(logger_semaphore);
+
+        quit = pa_atomic_load(&async_quit);
+        drain_rings();
+
+        if (quit)
+            break;
+    }
+}
+
+int pa_log_start_async(void) {
+    if (logger_thread)
+        return 0;
+
+    init_defaults();
+
+    /* Threads that saw logging as asynchronous just before it was stopped
+     * might still post this, hence it is never freed */
+    if (!logger_semaphore)
+        logger_semaphore = pa_semaphore_new(0);
+
+    pa_atomic_store(&async_quit, 0);
+
+    if (!(logger_thread = pa_thread_new("log", logger_thread_func, NULL)))
+        return -1;
+
+    PA_STATIC_TLS_SET(thread_sync, (void*) 1);
+    pa_atomic_store(&async_enabled, 1);
+
+    return 0;
+}
+
+void pa_log_stop_async(void) {
+    if (!logger_thread)
+        return;
+
+    pa_atomic_store(&async_enabled, 0);
+
+    /* Messages that are being pushed right now may still miss the final
+     * drain, they stay in their ring until logging is made asynchronous
+     * again. */
+    pa_atomic_store(&async_quit, 1);
+    pa_semaphore_post(logger_semaphore);
+
+    pa_thread_free(logger_thread);
+    logger_thread = NULL;
+
+    PA_STATIC_TLS_SET(thread_sync, NULL);
+
+    if (pa_atomic_load(&async_dropped) > 0)
+        pa_log_warn("Dropped %i log messages in total while logging asynchronously.", pa_atomic_load(&async_dropped));
+}
+
+unsigned pa_log_get_async_dropped(void) {
+    return (unsigned) pa_atomic_load(&async_dropped);
+}
+
+void pa_log_levelv_meta(
+        pa_log_level_t level,
+        const char*file,
+        int line,
+        const char *func,
+        const char *format,
+        va_list ap) {
+
+    int saved_errno = errno;
+    char *bt = NULL;
+    pa_log_level_t _maximum_level;
+    unsigned _show_backtrace;
+    pa_log_flags_t _flags;
+
+    /* We don't use dynamic memory allocation here to minimize the hit
+     * in RT threads */
+    char text[16*1024], location[128], timestamp[32];
+
+    pa_assert(level < PA_LOG_LEVEL_MAX);
+    pa_assert(format);
+
+    init_defaults();
+
+    _maximum_level = PA_MAX(maximum_level, maximum_level_override);
+    _show_backtrace = PA_MAX(show_backtrace, show_backtrace_override);
+    _flags = flags | flags_override;
+
+    if (PA_LIKELY(level > _maximum_level)) {
+        errno = saved_errno;
+        return;
+    }
+
+    /* Backtraces are not recorded for asynchronous messages, taking them
+     * allocates memory */
+    if (pa_atomic_load(&async_enabled) && !PA_STATIC_TLS_GET(thread_sync)) {
+        log_async(level, file, line, func, _flags, format, ap);
+        errno = saved_errno;
+        return;
+    }
+
+    pa_vsnprintf(text, sizeof(text), format, ap);
+
+    format_location(location, sizeof(location), _flags, file, line, func);
+    format_timestamp(timestamp, sizeof(timestamp), _flags);
+
+#ifdef HAVE_EXECINFO_H
+    if (_show_backtrace > 0)
+        bt = get_backtrace(_show_backtrace);
+#endif
+
+    log_output(level, file, line, func, text, location, timestamp, bt, &saved_errno);
+
     pa_xfree(bt);
     errno = saved_errno;
 }
@@ -590,6 +850,14 @@ bool pa_log_ratelimit(pa_log_level_t level) {
     return pa_ratelimit_test(&ratelimit, level);
 }
 
+bool pa_log_level_enabled(pa_log_level_t level) {
+    pa_assert(level < PA_LOG_LEVEL_MAX);
+
+    init_defaults();
+
+    return level <= PA_MAX(maximum_level, maximum_level_override);
+}
+
 pa_log_target *pa_log_target_new(pa_log_target_type_t type, const char *file) {
     pa_log_target *t = NULL;
 
@@ -87,6 +87,18 @@ void pa_log_set_show_backtrace(unsigned nlevels);
 /* Skip the first backtrace frames */
 void pa_log_set_skip_backtrace(unsigned nlevels);
 
+/* Make logging asynchronous for all threads but the calling one: they queue
+ * their messages in a lock-free ring of their own, which a logger thread
+ * writes out. Messages that don't fit into the ring are dropped. */
+int pa_log_start_async(void);
+
+/* Write out what is queued and make logging synchronous again. Must be
+ * called from the thread that called pa_log_start_async(). */
+void pa_log_stop_async(void);
+
+/* Number of messages dropped because a ring was full */
+unsigned pa_log_get_async_dropped(void);
+
 void pa_log_level_meta(
         pa_log_level_t level,
         const char*file,
@@ -152,4 +164,9 @@ LOG_FUNC(error, PA_LOG_ERROR)
 
 bool pa_log_ratelimit(pa_log_level_t level);
 
+/* Returns true if messages of the given level are currently logged. Useful
+ * to skip formatting expensive arguments of messages that would be dropped
+ * anyway. */
+bool pa_log_level_enabled(pa_log_level_t level);
+
 #endif
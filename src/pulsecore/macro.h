@@ -44,6 +44,18 @@
 #endif
 #endif
 
+/* Asks the CPU to start loading the cache line at p. Never faults, not
+ * even on addresses that aren't mapped. */
+#ifndef PA_PREFETCH
+#ifdef __GNUC__
+#define PA_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#else
+#define PA_PREFETCH(p) ((void) (p))
+#endif
+#endif
+
+#define PA_CACHE_LINE_SIZE 64
+
 #if defined(PAGE_SIZE)
 #define PA_PAGE_SIZE ((size_t) PAGE_SIZE)
 #elif defined(PAGESIZE)
@@ -47,6 +47,7 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/memtrap.h>
+#include <pulsecore/thread.h>
 
 #include "memblock.h"
 
@@ -57,6 +58,25 @@
 #define PA_MEMPOOL_SLOTS_MAX 1024
 #define PA_MEMPOOL_SLOT_SIZE (64*1024)
 
+/* Once all slots are taken a pool may add further segments of the
+ * size of the first one, see pa_mempool_set_max_segments() */
+#define PA_MEMPOOL_SEGMENTS_MAX 8
+
+/* Small blocks are not served from full slots. Instead a slot is
+ * split into equally sized sub-slots of one of these size classes, each
+ * size class being 4 times as large as the previous one. The largest
+ * class is the full slot, i.e. with 64 KiB slots we get 1, 4, 16 and
+ * 64 KiB classes. Each of the smaller classes may use at most
+ * 1/PA_MEMPOOL_SLAB_SHARE of the slots of the pool. */
+#define PA_MEMPOOL_SLAB_CLASSES 4
+#define PA_MEMPOOL_SLAB_SHIFT 2
+#define PA_MEMPOOL_SLAB_SHARE 8
+
+/* The number of slots of each size class and of memblock structures a
+ * per-thread cache holds at maximum. Whenever it runs empty or full
+ * half of that is moved from or to the shared free lists at once. */
+#define PA_MEMPOOL_THREAD_CACHE_SIZE 32
+
 #define PA_MEMEXPORT_SLOTS_MAX 128
 
 #define PA_MEMIMPORT_SLOTS_MAX 160
@@ -98,6 +118,10 @@ struct pa_memimport_segment {
     pa_memtrap *trap;
     unsigned n_blocks;
     bool writable;
+
+    /* memfd segments can't be looked up again by their id, hence they
+     * aren't detached when their last block goes */
+    bool permanent;
 };
 
 /* A collection of multiple segments */
@@ -141,30 +165,244 @@ struct pa_memexport {
     PA_LLIST_FIELDS(pa_memexport);
 };
 
+struct mempool_slab_class {
+    size_t slot_size;
+
+    /* A list of free (sub-)slots of this size that may be reused */
+    pa_flist *free_slots;
+
+    /* How many full slots have been split up for this class so far,
+     * and how many we may split at maximum */
+    pa_atomic_t n_split;
+    unsigned n_split_max;
+};
+
+/* One contiguous piece of a pool, made of n_blocks full slots */
+struct mempool_segment {
+    pa_shm memory;
+
+    /* How many slots have been handed out at least once */
+    pa_atomic_t n_init;
+
+    /* For each full slot the index of the size class it has been
+     * assigned to */
+    uint8_t *slot_class;
+
+    /* What pa_mempool_vacuum() added to n_init to stop it from handing
+     * out slots before the segment was released */
+    int n_init_closed;
+};
+
 struct pa_mempool {
     pa_semaphore *semaphore;
     pa_mutex *mutex;
 
-    pa_shm memory;
+    /* The first segment lives as long as the pool. Further ones are
+     * only added and removed at the end, with the mutex held, and are
+     * made visible by n_segments. */
+    struct mempool_segment segments[PA_MEMPOOL_SEGMENTS_MAX];
+    pa_atomic_t n_segments;
+    unsigned max_segments;
+
     size_t block_size;
     unsigned n_blocks;
     bool is_remote_writable;
 
-    pa_atomic_t n_init;
+    /* What every segment is created with */
+    bool huge_pages;
+    int numa_node;
+
+    /* Lock the pool and every segment imported into it into RAM */
+    bool lock_memory;
 
     PA_LLIST_HEAD(pa_memimport, imports);
     PA_LLIST_HEAD(pa_memexport, exports);
 
-    /* A list of free slots that may be reused */
-    pa_flist *free_slots;
+    /* The size classes, the last one is for full slots */
+    struct mempool_slab_class classes[PA_MEMPOOL_SLAB_CLASSES];
+
+    pa_atomic_t n_thread_caches;
 
     pa_mempool_stat stat;
 };
 
+/* A magazine of slots and memblock structures private to one thread,
+ * see pa_mempool_thread_cache_enable() */
+struct mempool_thread_cache {
+    pa_mempool *pool;
+
+    void *slots[PA_MEMPOOL_SLAB_CLASSES][PA_MEMPOOL_THREAD_CACHE_SIZE];
+    unsigned n_slots[PA_MEMPOOL_SLAB_CLASSES];
+
+    pa_memblock *memblocks[PA_MEMPOOL_THREAD_CACHE_SIZE];
+    unsigned n_memblocks;
+
+    /* Counted locally and added to the pool statistics whenever we
+     * have to touch the shared free lists anyway */
+    unsigned n_hits, n_misses;
+};
+
 static void segment_detach(pa_memimport_segment *seg);
 
 PA_STATIC_FLIST_DECLARE(unused_memblocks, 0, pa_xfree);
 
+PA_STATIC_TLS_DECLARE_NO_FREE(thread_cache);
+
+/* No lock necessary */
+static inline struct mempool_thread_cache *thread_cache_get(pa_mempool *p) {
+    struct mempool_thread_cache *cache;
+
+    if (!pa_atomic_load(&p->n_thread_caches))
+        return NULL;
+
+    if (!(cache = PA_STATIC_TLS_GET(thread_cache)) || cache->pool != p)
+        return NULL;
+
+    return cache;
+}
+
+/* No lock necessary */
+static void thread_cache_flush_stat(struct mempool_thread_cache *cache) {
+    pa_assert(cache);
+
+    if (cache->n_hits > 0) {
+        pa_atomic_add(&cache->pool->stat.n_thread_cache_hits, (int) cache->n_hits);
+        cache->n_hits = 0;
+    }
+
+    if (cache->n_misses > 0) {
+        pa_atomic_add(&cache->pool->stat.n_thread_cache_misses, (int) cache->n_misses);
+        cache->n_misses = 0;
+    }
+}
+
+/* No lock necessary */
+static void* thread_cache_pop_slot(struct mempool_thread_cache *cache, unsigned c) {
+    pa_flist *free_slots;
+    void *slot;
+
+    pa_assert(cache);
+    pa_assert(c < PA_MEMPOOL_SLAB_CLASSES);
+
+    if (cache->n_slots[c] > 0) {
+        cache->n_hits++;
+        return cache->slots[c][--cache->n_slots[c]];
+    }
+
+    /* Refill half of the magazine from the shared free list */
+    free_slots = cache->pool->classes[c].free_slots;
+
+    while (cache->n_slots[c] < PA_MEMPOOL_THREAD_CACHE_SIZE / 2 &&
+           (slot = pa_flist_pop(free_slots)))
+        cache->slots[c][cache->n_slots[c]++] = slot;
+
+    cache->n_misses++;
+    pa_atomic_inc(&cache->pool->stat.n_thread_cache_transfers);
+    thread_cache_flush_stat(cache);
+
+    if (cache->n_slots[c] <= 0)
+        return NULL;
+
+    return cache->slots[c][--cache->n_slots[c]];
+}
+
+/* No lock necessary */
+static void thread_cache_spill_slots(struct mempool_thread_cache *cache, unsigned c, unsigned n) {
+    pa_flist *free_slots;
+
+    pa_assert(cache);
+    pa_assert(c < PA_MEMPOOL_SLAB_CLASSES);
+    pa_assert(n <= cache->n_slots[c]);
+
+    free_slots = cache->pool->classes[c].free_slots;
+
+    /* The free list dimensions easily allow all slots to fit in,
+     * hence try harder if pushing fails */
+    for (; n > 0; n--)
+        while (pa_flist_push(free_slots, cache->slots[c][--cache->n_slots[c]]) < 0)
+            ;
+}
+
+/* No lock necessary */
+static void thread_cache_push_slot(struct mempool_thread_cache *cache, unsigned c, void *slot) {
+    pa_assert(cache);
+    pa_assert(c < PA_MEMPOOL_SLAB_CLASSES);
+    pa_assert(slot);
+
+    if (cache->n_slots[c] >= PA_MEMPOOL_THREAD_CACHE_SIZE) {
+        thread_cache_spill_slots(cache, c, PA_MEMPOOL_THREAD_CACHE_SIZE / 2);
+        pa_atomic_inc(&cache->pool->stat.n_thread_cache_transfers);
+        thread_cache_flush_stat(cache);
+    }
+
+    cache->slots[c][cache->n_slots[c]++] = slot;
+}
+
+/* No lock necessary */
+static void thread_cache_spill_memblocks(struct mempool_thread_cache *cache, unsigned n) {
+    pa_assert(cache);
+    pa_assert(n <= cache->n_memblocks);
+
+    for (; n > 0; n--) {
+        pa_memblock *b = cache->memblocks[--cache->n_memblocks];
+
+        if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
+            pa_xfree(b);
+    }
+}
+
+/* No lock necessary */
+static pa_memblock *memblock_struct_new(pa_mempool *p) {
+    struct mempool_thread_cache *cache;
+    pa_memblock *b;
+
+    if ((cache = thread_cache_get(p))) {
+
+        if (cache->n_memblocks > 0) {
+            cache->n_hits++;
+            return cache->memblocks[--cache->n_memblocks];
+        }
+
+        while (cache->n_memblocks < PA_MEMPOOL_THREAD_CACHE_SIZE / 2 &&
+               (b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
+            cache->memblocks[cache->n_memblocks++] = b;
+
+        cache->n_misses++;
+        pa_atomic_inc(&p->stat.n_thread_cache_transfers);
+        thread_cache_flush_stat(cache);
+
+        if (cache->n_memblocks > 0)
+            return cache->memblocks[--cache->n_memblocks];
+
+        return pa_xnew(pa_memblock, 1);
+    }
+
+    if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
+        b = pa_xnew(pa_memblock, 1);
+
+    return b;
+}
+
+/* No lock necessary */
+static void memblock_struct_free(pa_mempool *p, pa_memblock *b) {
+    struct mempool_thread_cache *cache;
+
+    if ((cache = thread_cache_get(p))) {
+
+        if (cache->n_memblocks >= PA_MEMPOOL_THREAD_CACHE_SIZE) {
+            thread_cache_spill_memblocks(cache, PA_MEMPOOL_THREAD_CACHE_SIZE / 2);
+            pa_atomic_inc(&p->stat.n_thread_cache_transfers);
+            thread_cache_flush_stat(cache);
+        }
+
+        cache->memblocks[cache->n_memblocks++] = b;
+        return;
+    }
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
+        pa_xfree(b);
+}
+
 /* No lock necessary */
 static void stat_add(pa_memblock*b) {
     pa_assert(b);
@@ -249,26 +487,208 @@ static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length) {
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
+static struct mempool_slot* segment_allocate_full_slot(pa_mempool *p, struct mempool_segment *seg) {
+    int idx;
+
+    if ((unsigned) (idx = pa_atomic_inc(&seg->n_init)) >= p->n_blocks) {
+        pa_atomic_dec(&seg->n_init);
+        return NULL;
+    }
+
+    return (struct mempool_slot*) ((uint8_t*) seg->memory.ptr + (p->block_size * (size_t) idx));
+}
+
+/* Self-locked. Returns the last segment, which is a new one unless
+ * somebody else has been faster. */
+static struct mempool_segment* mempool_grow(pa_mempool *p, unsigned n_seen) {
+    struct mempool_segment *seg = NULL;
+    unsigned n;
+
+    pa_mutex_lock(p->mutex);
+
+    if ((n = (unsigned) pa_atomic_load(&p->n_segments)) != n_seen) {
+        seg = &p->segments[n - 1];
+        goto finish;
+    }
+
+    if (n >= p->max_segments)
+        goto finish;
+
+    seg = &p->segments[n];
+
+    if (pa_shm_create_rw(&seg->memory, p->n_blocks * p->block_size, p->segments[0].memory.shared, 0700,
+                         p->huge_pages, p->numa_node) < 0) {
+        seg = NULL;
+        goto finish;
+    }
+
+    if (p->lock_memory)
+        pa_shm_lock(&seg->memory);
+
+    seg->slot_class = pa_xnew0(uint8_t, p->n_blocks);
+
+    /* Somebody who still saw this segment before it was released in
+     * pa_mempool_vacuum() may be in the middle of incrementing n_init,
+     * hence no pa_atomic_store() here */
+    pa_atomic_sub(&seg->n_init, seg->n_init_closed);
+    seg->n_init_closed = 0;
+
+    pa_atomic_store(&p->n_segments, (int) n + 1);
+    pa_atomic_inc(&p->stat.n_segments_grown);
+
+    pa_log_debug("Memory pool full, added segment %u of %u", n + 1, p->max_segments);
+
+finish:
+    pa_mutex_unlock(p->mutex);
+
+    return seg;
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_allocate_full_slot(pa_mempool *p) {
+    struct mempool_slot *slot = NULL;
+    unsigned i, n;
+
+    pa_assert(p);
+
+    /* The free list was empty, we have to allocate a new entry */
+
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+
+    for (i = 0; i < n; i++)
+        if ((slot = segment_allocate_full_slot(p, &p->segments[i])))
+            return slot;
+
+    while (n < p->max_segments) {
+        struct mempool_segment *seg;
+
+        if (!(seg = mempool_grow(p, n)))
+            break;
+
+        if ((slot = segment_allocate_full_slot(p, seg)))
+            break;
+
+        n = (unsigned) pa_atomic_load(&p->n_segments);
+    }
+
+    return slot;
+}
+
+/* No lock necessary */
+static struct mempool_segment* mempool_segment_by_ptr(pa_mempool *p, const void *ptr) {
+    unsigned i, n;
+
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+
+    for (i = 0; i < n; i++) {
+        struct mempool_segment *seg = &p->segments[i];
+
+        if ((const uint8_t*) ptr >= (const uint8_t*) seg->memory.ptr &&
+            (const uint8_t*) ptr < (const uint8_t*) seg->memory.ptr + seg->memory.size)
+            return seg;
+    }
+
+    pa_assert_not_reached();
+}
+
+/* No lock necessary */
+static void mempool_set_slot_class(pa_mempool *p, struct mempool_slot *slot, unsigned c) {
+    struct mempool_segment *seg;
+
+    seg = mempool_segment_by_ptr(p, slot);
+    seg->slot_class[((uint8_t*) slot - (uint8_t*) seg->memory.ptr) / p->block_size] = (uint8_t) c;
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_split_slot(pa_mempool *p, unsigned c) {
+    struct mempool_slab_class *sc;
     struct mempool_slot *slot;
+    unsigned i, n;
+
+    pa_assert(p);
+    pa_assert(c < PA_MEMPOOL_SLAB_CLASSES - 1);
+
+    sc = &p->classes[c];
+
+    if ((unsigned) pa_atomic_inc(&sc->n_split) >= sc->n_split_max) {
+        pa_atomic_dec(&sc->n_split);
+        return NULL;
+    }
+
+    if (!(slot = pa_flist_pop(p->classes[PA_MEMPOOL_SLAB_CLASSES-1].free_slots)))
+        slot = mempool_allocate_full_slot(p);
+
+    if (!slot) {
+        pa_atomic_dec(&sc->n_split);
+        return NULL;
+    }
+
+    /* Slots which have been split up are never merged again, hence
+     * the slot class stays fixed from here on. */
+    mempool_set_slot_class(p, slot, c);
+
+    /* We keep the first sub-slot for ourselves and hand out the rest
+     * via the free list. The free list is dimensioned to take all
+     * sub-slots we may split off, hence try harder if pushing fails */
+    n = (unsigned) (p->block_size / sc->slot_size);
+    for (i = 1; i < n; i++)
+        while (pa_flist_push(sc->free_slots, (uint8_t*) slot + sc->slot_size * i) < 0)
+            ;
+
+    return slot;
+}
+
+/* No lock necessary */
+static unsigned mempool_slab_class_for_size(pa_mempool *p, size_t size) {
+    unsigned c;
+
+    pa_assert(p);
+
+    for (c = 0; c < PA_MEMPOOL_SLAB_CLASSES; c++)
+        if (p->classes[c].slot_size >= size)
+            break;
+
+    return c;
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_allocate_slot(pa_mempool *p, size_t size) {
+    struct mempool_slot *slot = NULL;
+    struct mempool_thread_cache *cache;
+    unsigned c;
+
     pa_assert(p);
+    pa_assert(size <= p->block_size);
 
-    if (!(slot = pa_flist_pop(p->free_slots))) {
-        int idx;
+    cache = thread_cache_get(p);
 
-        /* The free list was empty, we have to allocate a new entry */
+    /* Try the smallest class that fits first. If that one is exhausted
+     * fall back to the next larger one. */
+    for (c = mempool_slab_class_for_size(p, size); c < PA_MEMPOOL_SLAB_CLASSES; c++) {
 
-        if ((unsigned) (idx = pa_atomic_inc(&p->n_init)) >= p->n_blocks)
-            pa_atomic_dec(&p->n_init);
+        if (cache)
+            slot = thread_cache_pop_slot(cache, c);
         else
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
+            slot = pa_flist_pop(p->classes[c].free_slots);
 
-        if (!slot) {
-            if (pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Pool full");
-            pa_atomic_inc(&p->stat.n_pool_full);
-            return NULL;
-        }
+        if (slot)
+            break;
+
+        if (c == PA_MEMPOOL_SLAB_CLASSES - 1) {
+            if ((slot = mempool_allocate_full_slot(p)))
+                mempool_set_slot_class(p, slot, c);
+        } else
+            slot = mempool_split_slot(p, c);
+
+        if (slot)
+            break;
+    }
+
+    if (!slot) {
+        if (pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Pool full");
+        pa_atomic_inc(&p->stat.n_pool_full);
+        return NULL;
     }
 
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
@@ -286,23 +706,26 @@ static inline void* mempool_slot_data(struct mempool_slot *slot) {
 }
 
 /* No lock necessary */
-static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
+static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr, unsigned *class) {
+    struct mempool_segment *seg;
+    unsigned c;
+    size_t offset;
+
     pa_assert(p);
 
-    pa_assert((uint8_t*) ptr >= (uint8_t*) p->memory.ptr);
-    pa_assert((uint8_t*) ptr < (uint8_t*) p->memory.ptr + p->memory.size);
+    seg = mempool_segment_by_ptr(p, ptr);
+    offset = (size_t) ((uint8_t*) ptr - (uint8_t*) seg->memory.ptr);
 
-    return (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / p->block_size);
-}
+    c = seg->slot_class[offset / p->block_size];
+    pa_assert(c < PA_MEMPOOL_SLAB_CLASSES);
 
-/* No lock necessary */
-static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr) {
-    unsigned idx;
+    if (class)
+        *class = c;
 
-    if ((idx = mempool_slot_idx(p, ptr)) == (unsigned) -1)
-        return NULL;
+    /* Round down to the beginning of the sub-slot */
+    offset -= offset % p->classes[c].slot_size;
 
-    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (idx * p->block_size));
+    return (struct mempool_slot*) ((uint8_t*) seg->memory.ptr + offset);
 }
 
 /* No lock necessary */
@@ -341,7 +764,7 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
 
     if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(slot = mempool_allocate_slot(p, PA_ALIGN(sizeof(pa_memblock)) + length)))
             return NULL;
 
         b = mempool_slot_data(slot);
@@ -350,11 +773,10 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
 
     } else if (p->block_size >= length) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(slot = mempool_allocate_slot(p, length)))
             return NULL;
 
-        if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
-            b = pa_xnew(pa_memblock, 1);
+        b = memblock_struct_new(p);
 
         b->type = PA_MEMBLOCK_POOL_EXTERNAL;
         pa_atomic_ptr_store(&b->data, mempool_slot_data(slot));
@@ -385,8 +807,7 @@ pa_memblock *pa_memblock_new_fixed(pa_mempool *p, void *d, size_t length, bool r
     pa_assert(length != (size_t) -1);
     pa_assert(length);
 
-    if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
-        b = pa_xnew(pa_memblock, 1);
+    b = memblock_struct_new(p);
 
     PA_REFCNT_INIT(b);
     b->pool = p;
@@ -418,8 +839,7 @@ pa_memblock *pa_memblock_new_user(
     pa_assert(length != (size_t) -1);
     pa_assert(free_cb);
 
-    if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
-        b = pa_xnew(pa_memblock, 1);
+    b = memblock_struct_new(p);
 
     PA_REFCNT_INIT(b);
     b->pool = p;
@@ -549,9 +969,7 @@ static void memblock_free(pa_memblock *b) {
             /* Fall through */
 
         case PA_MEMBLOCK_FIXED:
-            if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
-                pa_xfree(b);
-
+            memblock_struct_free(b->pool, b);
             break;
 
         case PA_MEMBLOCK_APPENDED:
@@ -575,15 +993,14 @@ static void memblock_free(pa_memblock *b) {
             pa_assert_se(pa_hashmap_remove(import->blocks, PA_UINT32_TO_PTR(b->per_type.imported.id)));
 
             pa_assert(segment->n_blocks >= 1);
-            if (-- segment->n_blocks <= 0)
+            if (-- segment->n_blocks <= 0 && !segment->permanent)
                 segment_detach(segment);
 
             pa_mutex_unlock(import->mutex);
 
             import->release_cb(import, b->per_type.imported.id, import->userdata);
 
-            if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
-                pa_xfree(b);
+            memblock_struct_free(b->pool, b);
 
             break;
         }
@@ -591,9 +1008,11 @@ static void memblock_free(pa_memblock *b) {
         case PA_MEMBLOCK_POOL_EXTERNAL:
         case PA_MEMBLOCK_POOL: {
             struct mempool_slot *slot;
+            struct mempool_thread_cache *cache;
+            unsigned c;
             bool call_free;
 
-            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data)));
+            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data), &c));
 
             call_free = b->type == PA_MEMBLOCK_POOL_EXTERNAL;
 
@@ -606,12 +1025,14 @@ static void memblock_free(pa_memblock *b) {
             /* The free list dimensions should easily allow all slots
              * to fit in, hence try harder if pushing this slot into
              * the free list fails */
-            while (pa_flist_push(b->pool->free_slots, slot) < 0)
-                ;
+            if ((cache = thread_cache_get(b->pool)))
+                thread_cache_push_slot(cache, c, slot);
+            else
+                while (pa_flist_push(b->pool->classes[c].free_slots, slot) < 0)
+                    ;
 
             if (call_free)
-                if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
-                    pa_xfree(b);
+                memblock_struct_free(b->pool, b);
 
             break;
         }
@@ -660,7 +1081,7 @@ static void memblock_make_local(pa_memblock *b) {
     if (b->length <= b->pool->block_size) {
         struct mempool_slot *slot;
 
-        if ((slot = mempool_allocate_slot(b->pool))) {
+        if ((slot = mempool_allocate_slot(b->pool, b->length))) {
             void *new_data;
             /* We can move it into a local pool, perfect! */
 
@@ -738,15 +1159,21 @@ static void memblock_replace_import(pa_memblock *b) {
     memblock_make_local(b);
 
     pa_assert(segment->n_blocks >= 1);
-    if (-- segment->n_blocks <= 0)
+    if (-- segment->n_blocks <= 0 && !segment->permanent)
         segment_detach(segment);
 
     pa_mutex_unlock(import->mutex);
 }
 
 pa_mempool* pa_mempool_new(bool shared, size_t size) {
+    return pa_mempool_new_full(shared, size, false, -1);
+}
+
+static pa_mempool* mempool_new(bool shared, bool memfd, size_t size, bool huge_pages, int numa_node) {
     pa_mempool *p;
     char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
+    unsigned c;
+    int r;
 
     p = pa_xnew0(pa_mempool, 1);
 
@@ -763,19 +1190,29 @@ pa_mempool* pa_mempool_new(bool shared, size_t size) {
             p->n_blocks = 2;
     }
 
-    if (pa_shm_create_rw(&p->memory, p->n_blocks * p->block_size, shared, 0700) < 0) {
+    if (memfd)
+        r = pa_shm_create_memfd(&p->segments[0].memory, p->n_blocks * p->block_size);
+    else
+        r = pa_shm_create_rw(&p->segments[0].memory, p->n_blocks * p->block_size, shared, 0700, huge_pages, numa_node);
+
+    if (r < 0) {
         pa_xfree(p);
         return NULL;
     }
 
     pa_log_debug("Using %s memory pool with %u slots of size %s each, total size is %s, maximum usable slot size is %lu",
-                 p->memory.shared ? "shared" : "private",
+                 p->segments[0].memory.memfd ? "memfd" : p->segments[0].memory.shared ? "shared" : "private",
                  p->n_blocks,
                  pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->block_size),
                  pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->n_blocks * p->block_size)),
                  (unsigned long) pa_mempool_block_size_max(p));
 
-    pa_atomic_store(&p->n_init, 0);
+    pa_atomic_store(&p->segments[0].n_init, 0);
+    p->segments[0].slot_class = pa_xnew0(uint8_t, p->n_blocks);
+    pa_atomic_store(&p->n_segments, 1);
+    p->max_segments = 1;
+    p->huge_pages = huge_pages;
+    p->numa_node = numa_node;
 
     PA_LLIST_HEAD_INIT(pa_memimport, p->imports);
     PA_LLIST_HEAD_INIT(pa_memexport, p->exports);
@@ -783,12 +1220,39 @@ pa_mempool* pa_mempool_new(bool shared, size_t size) {
     p->mutex = pa_mutex_new(true, true);
     p->semaphore = pa_semaphore_new(0);
 
-    p->free_slots = pa_flist_new(p->n_blocks);
+    pa_atomic_store(&p->n_thread_caches, 0);
+
+    for (c = 0; c < PA_MEMPOOL_SLAB_CLASSES; c++) {
+        struct mempool_slab_class *sc = &p->classes[c];
+
+        sc->slot_size = p->block_size >> (PA_MEMPOOL_SLAB_SHIFT * (PA_MEMPOOL_SLAB_CLASSES - 1 - c));
+        pa_atomic_store(&sc->n_split, 0);
+
+        if (c == PA_MEMPOOL_SLAB_CLASSES - 1) {
+            /* Large enough for the slots of all segments the pool
+             * might ever grow to */
+            sc->n_split_max = p->n_blocks;
+            sc->free_slots = pa_flist_new_sharded(p->n_blocks * PA_MEMPOOL_SEGMENTS_MAX, "memblock slots");
+        } else {
+            sc->n_split_max = PA_MAX(p->n_blocks / PA_MEMPOOL_SLAB_SHARE, 1U);
+            sc->free_slots = pa_flist_new_sharded(sc->n_split_max * (unsigned) (p->block_size / sc->slot_size), "memblock slots");
+        }
+    }
 
     return p;
 }
 
+pa_mempool* pa_mempool_new_full(bool shared, size_t size, bool huge_pages, int numa_node) {
+    return mempool_new(shared, false, size, huge_pages, numa_node);
+}
+
+pa_mempool* pa_mempool_new_memfd(size_t size) {
+    return mempool_new(true, true, size, false, -1);
+}
+
 void pa_mempool_free(pa_mempool *p) {
+    unsigned c;
+
     pa_assert(p);
 
     pa_mutex_lock(p->mutex);
@@ -801,28 +1265,38 @@ void pa_mempool_free(pa_mempool *p) {
 
     pa_mutex_unlock(p->mutex);
 
-    pa_flist_free(p->free_slots, NULL);
+    if (pa_atomic_load(&p->n_thread_caches) > 0)
+        pa_log_error("Memory pool destroyed but %u thread caches still enabled!", pa_atomic_load(&p->n_thread_caches));
 
     if (pa_atomic_load(&p->stat.n_allocated) > 0) {
 
         /* Ouch, somebody is retaining a memory block reference! */
 
 #ifdef DEBUG_REF
+        struct mempool_segment *seg = &p->segments[0];
         unsigned i;
         pa_flist *list;
 
-        /* Let's try to find at least one of those leaked memory blocks */
+        /* Let's try to find at least one of those leaked memory blocks,
+         * in the first segment only */
 
-        list = pa_flist_new(p->n_blocks);
+        list = pa_flist_new(p->n_blocks * PA_MEMPOOL_SEGMENTS_MAX);
 
-        for (i = 0; i < (unsigned) pa_atomic_load(&p->n_init); i++) {
+        for (i = 0; i < (unsigned) PA_MIN(pa_atomic_load(&seg->n_init), (int) p->n_blocks); i++) {
             struct mempool_slot *slot;
             pa_memblock *b, *k;
+            pa_flist *free_slots;
 
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) i));
+            /* We only check the full slots here */
+            if (seg->slot_class[i] != PA_MEMPOOL_SLAB_CLASSES - 1)
+                continue;
+
+            free_slots = p->classes[PA_MEMPOOL_SLAB_CLASSES - 1].free_slots;
+
+            slot = (struct mempool_slot*) ((uint8_t*) seg->memory.ptr + (p->block_size * (size_t) i));
             b = mempool_slot_data(slot);
 
-            while ((k = pa_flist_pop(p->free_slots))) {
+            while ((k = pa_flist_pop(free_slots))) {
                 while (pa_flist_push(list, k) < 0)
                     ;
 
@@ -834,7 +1308,7 @@ void pa_mempool_free(pa_mempool *p) {
                 pa_log("REF: Leaked memory block %p", b);
 
             while ((k = pa_flist_pop(list)))
-                while (pa_flist_push(p->free_slots, k) < 0)
+                while (pa_flist_push(free_slots, k) < 0)
                     ;
         }
 
@@ -847,7 +1321,13 @@ void pa_mempool_free(pa_mempool *p) {
 /*         PA_DEBUG_TRAP; */
     }
 
-    pa_shm_free(&p->memory);
+    for (c = 0; c < PA_MEMPOOL_SLAB_CLASSES; c++)
+        pa_flist_free(p->classes[c].free_slots, NULL);
+
+    for (c = 0; c < (unsigned) pa_atomic_load(&p->n_segments); c++) {
+        pa_xfree(p->segments[c].slot_class);
+        pa_shm_free(&p->segments[c].memory);
+    }
 
     pa_mutex_free(p->mutex);
     pa_semaphore_free(p->semaphore);
@@ -862,6 +1342,49 @@ const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p) {
     return &p->stat;
 }
 
+/* No lock necessary. Needs to be called from the thread the cache
+ * shall be used in. */
+void pa_mempool_thread_cache_enable(pa_mempool *p) {
+    struct mempool_thread_cache *cache;
+
+    pa_assert(p);
+
+    if ((cache = PA_STATIC_TLS_GET(thread_cache))) {
+        if (cache->pool != p)
+            pa_log_warn("Thread already has a memblock cache for a different memory pool.");
+        return;
+    }
+
+    cache = pa_xnew0(struct mempool_thread_cache, 1);
+    cache->pool = p;
+
+    PA_STATIC_TLS_SET(thread_cache, cache);
+    pa_atomic_inc(&p->n_thread_caches);
+}
+
+/* No lock necessary. Needs to be called from the same thread as
+ * pa_mempool_thread_cache_enable() */
+void pa_mempool_thread_cache_disable(pa_mempool *p) {
+    struct mempool_thread_cache *cache;
+    unsigned c;
+
+    pa_assert(p);
+
+    if (!(cache = PA_STATIC_TLS_GET(thread_cache)) || cache->pool != p)
+        return;
+
+    for (c = 0; c < PA_MEMPOOL_SLAB_CLASSES; c++)
+        thread_cache_spill_slots(cache, c, cache->n_slots[c]);
+
+    thread_cache_spill_memblocks(cache, cache->n_memblocks);
+    thread_cache_flush_stat(cache);
+
+    PA_STATIC_TLS_SET(thread_cache, NULL);
+    pa_atomic_dec(&p->n_thread_caches);
+
+    pa_xfree(cache);
+}
+
 /* No lock necessary */
 size_t pa_mempool_block_size_max(pa_mempool *p) {
     pa_assert(p);
@@ -869,46 +1392,196 @@ size_t pa_mempool_block_size_max(pa_mempool *p) {
     return p->block_size - PA_ALIGN(sizeof(pa_memblock));
 }
 
+/* Called with the mutex held. Releases the last segment if all slots
+ * it ever handed out are among the n free ones, which are then removed
+ * from the array. Returns false if the segment is still in use. */
+static bool mempool_shrink(pa_mempool *p, struct mempool_slot **free, unsigned *n) {
+    struct mempool_segment *seg;
+    unsigned i, j, k, n_used;
+
+    k = (unsigned) pa_atomic_load(&p->n_segments) - 1;
+    if (k == 0)
+        return false;
+
+    seg = &p->segments[k];
+
+    /* Stop handing out fresh slots first, so that what we count stays
+     * valid. Concurrent allocations only add and remove again, hence
+     * this is undone by subtracting the same. */
+    n_used = (unsigned) PA_MIN(pa_atomic_add(&seg->n_init, (int) p->n_blocks), (int) p->n_blocks);
+
+    for (i = 0, j = 0; i < *n; i++)
+        if (mempool_segment_by_ptr(p, free[i]) == seg)
+            j++;
+
+    /* Slots that are in use, sit in a thread cache or have been split
+     * up are missing here */
+    if (j != n_used) {
+        pa_atomic_sub(&seg->n_init, (int) p->n_blocks);
+        return false;
+    }
+
+    for (i = 0, j = 0; i < *n; i++)
+        if (mempool_segment_by_ptr(p, free[i]) != seg)
+            free[j++] = free[i];
+    *n = j;
+
+    pa_atomic_store(&p->n_segments, (int) k);
+
+    seg->n_init_closed = (int) (n_used + p->n_blocks);
+    pa_xfree(seg->slot_class);
+    seg->slot_class = NULL;
+    pa_shm_free(&seg->memory);
+    pa_zero(seg->memory);
+
+    pa_atomic_inc(&p->stat.n_segments_shrunk);
+    pa_log_debug("Released memory pool segment %u", k + 1);
+
+    return true;
+}
+
 /* No lock necessary */
 void pa_mempool_vacuum(pa_mempool *p) {
-    struct mempool_slot *slot;
-    pa_flist *list;
+    struct mempool_slot **free, *slot;
+    pa_flist *free_slots;
+    unsigned i, n = 0;
 
     pa_assert(p);
 
-    list = pa_flist_new(p->n_blocks);
+    /* Only full slots are given back to the OS, split up slots are
+     * never completely free as a whole */
+    free_slots = p->classes[PA_MEMPOOL_SLAB_CLASSES - 1].free_slots;
 
-    while ((slot = pa_flist_pop(p->free_slots)))
-        while (pa_flist_push(list, slot) < 0)
-            ;
+    free = pa_xnew(struct mempool_slot*, p->n_blocks * PA_MEMPOOL_SEGMENTS_MAX);
+
+    while ((slot = pa_flist_pop(free_slots)))
+        free[n++] = slot;
+
+    /* The segments the pool has grown by go away entirely once they are
+     * unused, the newest first */
+    pa_mutex_lock(p->mutex);
+    while (mempool_shrink(p, free, &n))
+        ;
+    pa_mutex_unlock(p->mutex);
+
+    for (i = 0; i < n; i++) {
+        struct mempool_segment *seg = mempool_segment_by_ptr(p, free[i]);
 
-    while ((slot = pa_flist_pop(list))) {
-        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), p->block_size);
+        pa_shm_punch(&seg->memory, (size_t) ((uint8_t*) free[i] - (uint8_t*) seg->memory.ptr), p->block_size);
 
-        while (pa_flist_push(p->free_slots, slot))
+        while (pa_flist_push(free_slots, free[i]))
             ;
     }
 
-    pa_flist_free(list, NULL);
+    pa_xfree(free);
 }
 
 /* No lock necessary */
 int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id) {
     pa_assert(p);
 
-    if (!p->memory.shared)
+    if (!p->segments[0].memory.shared)
         return -1;
 
-    *id = p->memory.id;
+    *id = p->segments[0].memory.id;
 
     return 0;
 }
 
+/* No lock necessary */
+int pa_mempool_set_numa_node(pa_mempool *p, int numa_node) {
+    unsigned i, n;
+    int r = 0;
+
+    pa_assert(p);
+
+    pa_mutex_lock(p->mutex);
+
+    p->numa_node = numa_node;
+
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+    for (i = 0; i < n; i++)
+        if (pa_shm_set_numa_node(&p->segments[i].memory, numa_node) < 0)
+            r = -1;
+
+    pa_mutex_unlock(p->mutex);
+
+    return r;
+}
+
+/* Should be called before the pool is used by more than one thread */
+int pa_mempool_lock_memory(pa_mempool *p) {
+    unsigned i, n;
+    int r = 0;
+
+    pa_assert(p);
+
+    pa_mutex_lock(p->mutex);
+
+    p->lock_memory = true;
+
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+    for (i = 0; i < n; i++)
+        if (pa_shm_lock(&p->segments[i].memory) < 0)
+            r = -1;
+
+    pa_mutex_unlock(p->mutex);
+
+    return r;
+}
+
+/* Self-locked */
+void pa_mempool_set_max_segments(pa_mempool *p, unsigned n) {
+    pa_assert(p);
+    pa_assert(n >= 1);
+
+    /* The other side only learns about the one memfd it has been sent
+     * when the connection was set up */
+    if (p->segments[0].memory.memfd)
+        return;
+
+    pa_mutex_lock(p->mutex);
+    p->max_segments = PA_CLAMP(n, (unsigned) pa_atomic_load(&p->n_segments), PA_MEMPOOL_SEGMENTS_MAX);
+    pa_mutex_unlock(p->mutex);
+}
+
+/* Should be called locked */
+static void segment_maybe_lock(pa_memimport_segment *seg) {
+    pa_assert(seg);
+
+    /* Clients hand us data in these segments, and the first one to
+     * read it is usually an IO thread, which shouldn't page fault */
+    if (seg->import->pool->lock_memory)
+        pa_shm_lock(&seg->memory);
+}
+
+/* No lock necessary */
+unsigned pa_mempool_get_n_segments(pa_mempool *p) {
+    pa_assert(p);
+
+    return (unsigned) pa_atomic_load(&p->n_segments);
+}
+
 /* No lock necessary */
 bool pa_mempool_is_shared(pa_mempool *p) {
     pa_assert(p);
 
-    return p->memory.shared;
+    return p->segments[0].memory.shared;
+}
+
+/* No lock necessary */
+bool pa_mempool_is_memfd_backed(pa_mempool *p) {
+    pa_assert(p);
+
+    return p->segments[0].memory.memfd;
+}
+
+/* No lock necessary */
+int pa_mempool_get_memfd_fd(pa_mempool *p) {
+    pa_assert(p);
+    pa_assert(p->segments[0].memory.memfd);
+
+    return p->segments[0].memory.fd;
 }
 
 /* For receiving blocks from other nodes */
@@ -952,6 +1625,7 @@ static pa_memimport_segment* segment_attach(pa_memimport *i, uint32_t shm_id, bo
     seg->writable = writable;
     seg->import = i;
     seg->trap = pa_memtrap_add(seg->memory.ptr, seg->memory.size);
+    segment_maybe_lock(seg);
 
     pa_hashmap_put(i->segments, PA_UINT32_TO_PTR(seg->memory.id), seg);
     return seg;
@@ -970,10 +1644,51 @@ static void segment_detach(pa_memimport_segment *seg) {
     pa_xfree(seg);
 }
 
+/* Self-locked */
+int pa_memimport_attach_memfd(pa_memimport *i, uint32_t shm_id, int memfd_fd, bool writable) {
+    pa_memimport_segment *seg;
+    int ret = -1;
+
+    pa_assert(i);
+    pa_assert(memfd_fd >= 0);
+
+    pa_mutex_lock(i->mutex);
+
+    if (pa_hashmap_get(i->segments, PA_UINT32_TO_PTR(shm_id))) {
+        pa_log("Memory segment %u is already known.", shm_id);
+        goto finish;
+    }
+
+    if (pa_hashmap_size(i->segments) >= PA_MEMIMPORT_SEGMENTS_MAX)
+        goto finish;
+
+    seg = pa_xnew0(pa_memimport_segment, 1);
+
+    if (pa_shm_attach_memfd(&seg->memory, shm_id, memfd_fd, writable) < 0) {
+        pa_xfree(seg);
+        goto finish;
+    }
+
+    seg->writable = writable;
+    seg->permanent = true;
+    seg->import = i;
+    seg->trap = pa_memtrap_add(seg->memory.ptr, seg->memory.size);
+    segment_maybe_lock(seg);
+
+    pa_hashmap_put(i->segments, PA_UINT32_TO_PTR(seg->memory.id), seg);
+    ret = 0;
+
+finish:
+    pa_mutex_unlock(i->mutex);
+
+    return ret;
+}
+
 /* Self-locked. Not multiple-caller safe */
 void pa_memimport_free(pa_memimport *i) {
     pa_memexport *e;
     pa_memblock *b;
+    pa_memimport_segment *seg;
 
     pa_assert(i);
 
@@ -982,7 +1697,11 @@ void pa_memimport_free(pa_memimport *i) {
     while ((b = pa_hashmap_first(i->blocks)))
         memblock_replace_import(b);
 
-    pa_assert(pa_hashmap_size(i->segments) == 0);
+    while ((seg = pa_hashmap_first(i->segments))) {
+        pa_assert(seg->permanent);
+        pa_assert(seg->n_blocks == 0);
+        segment_detach(seg);
+    }
 
     pa_mutex_unlock(i->mutex);
 
@@ -1034,8 +1753,7 @@ pa_memblock* pa_memimport_get(pa_memimport *i, uint32_t block_id, uint32_t shm_i
     if (offset+size > seg->memory.size)
         goto finish;
 
-    if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
-        b = pa_xnew(pa_memblock, 1);
+    b = memblock_struct_new(i->pool);
 
     PA_REFCNT_INIT(b);
     b->pool = i->pool;
@@ -1090,7 +1808,7 @@ pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void
     pa_assert(p);
     pa_assert(cb);
 
-    if (!p->memory.shared)
+    if (!p->segments[0].memory.shared)
         return NULL;
 
     e = pa_xnew(pa_memexport, 1);
@@ -1202,7 +1920,9 @@ static pa_memblock *memblock_shared_copy(pa_mempool *p, pa_memblock *b) {
     pa_assert(p);
     pa_assert(b);
 
-    if (b->type == PA_MEMBLOCK_IMPORTED ||
+    /* Blocks imported from a memfd are only ever passed on as copies,
+     * only the peer we got them from may map that memory */
+    if ((b->type == PA_MEMBLOCK_IMPORTED && !b->per_type.imported.segment->memory.memfd) ||
         b->type == PA_MEMBLOCK_POOL ||
         b->type == PA_MEMBLOCK_POOL_EXTERNAL) {
         pa_assert(b->pool == p);
@@ -1261,7 +1981,7 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, uint32_t *block_id, uint32
     } else {
         pa_assert(b->type == PA_MEMBLOCK_POOL || b->type == PA_MEMBLOCK_POOL_EXTERNAL);
         pa_assert(b->pool);
-        memory = &b->pool->memory;
+        memory = &mempool_segment_by_ptr(b->pool, data)->memory;
     }
 
     pa_assert(data >= memory->ptr);
@@ -70,11 +70,24 @@ struct pa_mempool_stat {
     pa_atomic_t imported_size;
     pa_atomic_t exported_size;
 
+    /* Allocations that could not be served by the pool and got heap
+     * memory instead, which can't be shared */
     pa_atomic_t n_too_large_for_pool;
     pa_atomic_t n_pool_full;
 
+    /* How often the pool added or released a segment */
+    pa_atomic_t n_segments_grown;
+    pa_atomic_t n_segments_shrunk;
+
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
+
+    /* Allocations served by per-thread caches without touching the
+     * shared free lists, allocations that had to go to them, and the
+     * number of batch transfers between both */
+    pa_atomic_t n_thread_cache_hits;
+    pa_atomic_t n_thread_cache_misses;
+    pa_atomic_t n_thread_cache_transfers;
 };
 
 /* Allocate a new memory block of type PA_MEMBLOCK_MEMPOOL or PA_MEMBLOCK_APPENDED, depending on the size */
@@ -122,21 +135,54 @@ pa_memblock *pa_memblock_will_need(pa_memblock *b);
 
 /* The memory block manager */
 pa_mempool* pa_mempool_new(bool shared, size_t size);
+/* Like pa_mempool_new(), but optionally ask for huge pages and bind
+ * the pool to a NUMA node. Pass -1 as numa_node to not bind it. */
+pa_mempool* pa_mempool_new_full(bool shared, size_t size, bool huge_pages, int numa_node);
+/* A shared pool backed by a sealed memfd. Peers can only import its
+ * blocks once they have been handed the file descriptor, see
+ * pa_memimport_attach_memfd(). Returns NULL if memfds are not
+ * supported. */
+pa_mempool* pa_mempool_new_memfd(size_t size);
 void pa_mempool_free(pa_mempool *p);
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p);
 void pa_mempool_vacuum(pa_mempool *p);
 int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id);
 bool pa_mempool_is_shared(pa_mempool *p);
+bool pa_mempool_is_memfd_backed(pa_mempool *p);
+/* The pool keeps ownership of the file descriptor */
+int pa_mempool_get_memfd_fd(pa_mempool *p);
+int pa_mempool_set_numa_node(pa_mempool *p, int numa_node);
+/* Locks the pool into RAM, and every segment imported into it from now
+ * on as well */
+int pa_mempool_lock_memory(pa_mempool *p);
+/* Lets the pool add up to n - 1 further segments of its initial size
+ * when it runs full, instead of falling back to the heap. Segments are
+ * released again by pa_mempool_vacuum() once unused. Pools backed by a
+ * memfd never grow. */
+void pa_mempool_set_max_segments(pa_mempool *p, unsigned n);
+unsigned pa_mempool_get_n_segments(pa_mempool *p);
 bool pa_mempool_is_remote_writable(pa_mempool *p);
 void pa_mempool_set_is_remote_writable(pa_mempool *p, bool writable);
 size_t pa_mempool_block_size_max(pa_mempool *p);
 
+/* Serve slot and memblock allocations and frees of the calling thread
+ * from a small thread-local cache, which exchanges memory with the
+ * shared free lists in batches only. Meant for the IO threads. The
+ * cache has to be disabled again from the same thread before it
+ * exits and before the pool is freed. */
+void pa_mempool_thread_cache_enable(pa_mempool *p);
+void pa_mempool_thread_cache_disable(pa_mempool *p);
+
 /* For receiving blocks from other nodes */
 pa_memimport* pa_memimport_new(pa_mempool *p, pa_memimport_release_cb_t cb, void *userdata);
 void pa_memimport_free(pa_memimport *i);
 pa_memblock* pa_memimport_get(pa_memimport *i, uint32_t block_id, uint32_t shm_id,
                               size_t offset, size_t size, bool writable);
 int pa_memimport_process_revoke(pa_memimport *i, uint32_t block_id);
+/* Makes the memfd segment of a peer's pool known under shm_id. Unlike
+ * named segments it stays attached until the import is freed, since it
+ * could not be attached again. The caller keeps ownership of fd. */
+int pa_memimport_attach_memfd(pa_memimport *i, uint32_t shm_id, int memfd_fd, bool writable);
 
 /* For sending blocks to other nodes */
 pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void *userdata);
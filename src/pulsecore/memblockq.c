@@ -36,6 +36,18 @@
 
 /* #define MEMBLOCKQ_DEBUG */
 
+/* Chunks up to this size are copied into a block owned by the queue
+ * instead of being referenced directly, so that a client writing
+ * tiny fragments doesn't end up with one list item per fragment */
+#define PA_MEMBLOCKQ_COALESCE_MAX 256
+
+/* The size of the blocks small chunks are coalesced into */
+#define PA_MEMBLOCKQ_COALESCE_BLOCK_SIZE 4096
+
+/* Below this number of list items we just walk the list when looking
+ * for the read or write position instead of consulting the index */
+#define PA_MEMBLOCKQ_LOOKUP_MIN 16
+
 struct list_item {
     struct list_item *next, *prev;
     int64_t index;
@@ -56,6 +68,20 @@ struct pa_memblockq {
     int64_t missing, requested;
     char *name;
     pa_sample_spec sample_spec;
+
+    /* The block small chunks are currently copied into. index points
+     * to the first byte not handed out to any list item yet */
+    pa_memchunk coalesce;
+
+    pa_memblockq_stat stat;
+
+    /* An array of all list items in queue order, for binary searching
+     * the item at a given index. Appending at the tail and dropping at
+     * either end keep it up-to-date, everything else marks it dirty and
+     * causes it to be rebuilt on the next lookup. */
+    struct list_item **lookup;
+    unsigned lookup_start, lookup_n, lookup_size;
+    bool lookup_dirty;
 };
 
 pa_memblockq* pa_memblockq_new(
@@ -113,13 +139,143 @@ void pa_memblockq_free(pa_memblockq* bq) {
     if (bq->silence.memblock)
         pa_memblock_unref(bq->silence.memblock);
 
+    if (bq->coalesce.memblock)
+        pa_memblock_unref(bq->coalesce.memblock);
+
     if (bq->mcalign)
         pa_mcalign_free(bq->mcalign);
 
+    pa_xfree(bq->lookup);
     pa_xfree(bq->name);
     pa_xfree(bq);
 }
 
+static void lookup_append(pa_memblockq *bq, struct list_item *q) {
+    pa_assert(bq);
+    pa_assert(q);
+    pa_assert(!q->next);
+
+    if (bq->lookup_dirty)
+        return;
+
+    if (bq->lookup_start + bq->lookup_n >= bq->lookup_size) {
+
+        if (bq->lookup_start > 0) {
+            /* Reclaim the space of items dropped from the front */
+            memmove(bq->lookup, bq->lookup + bq->lookup_start, bq->lookup_n * sizeof(struct list_item*));
+            bq->lookup_start = 0;
+        }
+
+        if (bq->lookup_n >= bq->lookup_size) {
+            bq->lookup_size = PA_MAX(bq->lookup_size * 2, PA_MEMBLOCKQ_LOOKUP_MIN);
+            bq->lookup = pa_xrenew(struct list_item*, bq->lookup, bq->lookup_size);
+        }
+    }
+
+    bq->lookup[bq->lookup_start + bq->lookup_n++] = q;
+}
+
+static void lookup_remove(pa_memblockq *bq, struct list_item *q) {
+    pa_assert(bq);
+    pa_assert(q);
+
+    if (bq->lookup_dirty)
+        return;
+
+    pa_assert(bq->lookup_n > 0);
+
+    if (bq->lookup[bq->lookup_start] == q) {
+        bq->lookup_start++;
+        bq->lookup_n--;
+
+        if (bq->lookup_n == 0)
+            bq->lookup_start = 0;
+
+    } else if (bq->lookup[bq->lookup_start + bq->lookup_n - 1] == q)
+        bq->lookup_n--;
+    else
+        bq->lookup_dirty = true;
+}
+
+static void lookup_rebuild(pa_memblockq *bq) {
+    struct list_item *q;
+
+    pa_assert(bq);
+
+    if (!bq->lookup_dirty)
+        return;
+
+    if (bq->lookup_size < bq->n_blocks) {
+        bq->lookup_size = PA_MAX(bq->n_blocks, PA_MEMBLOCKQ_LOOKUP_MIN);
+        bq->lookup = pa_xrenew(struct list_item*, bq->lookup, bq->lookup_size);
+    }
+
+    bq->lookup_start = bq->lookup_n = 0;
+    for (q = bq->blocks; q; q = q->next)
+        bq->lookup[bq->lookup_n++] = q;
+
+    pa_assert(bq->lookup_n == bq->n_blocks);
+    bq->lookup_dirty = false;
+}
+
+/* Returns the first item that ends right of idx, or NULL */
+static struct list_item *lookup_read(pa_memblockq *bq, int64_t idx) {
+    unsigned l, r;
+
+    pa_assert(bq);
+
+    lookup_rebuild(bq);
+
+    l = bq->lookup_start;
+    r = bq->lookup_start + bq->lookup_n;
+
+    while (l < r) {
+        unsigned m = l + (r - l) / 2;
+
+        if (bq->lookup[m]->index + (int64_t) bq->lookup[m]->chunk.length <= idx)
+            l = m + 1;
+        else
+            r = m;
+    }
+
+    return l < bq->lookup_start + bq->lookup_n ? bq->lookup[l] : NULL;
+}
+
+/* Returns the last item that starts at or left of idx, or NULL */
+static struct list_item *lookup_write(pa_memblockq *bq, int64_t idx) {
+    unsigned l, r;
+
+    pa_assert(bq);
+
+    lookup_rebuild(bq);
+
+    l = bq->lookup_start;
+    r = bq->lookup_start + bq->lookup_n;
+
+    while (l < r) {
+        unsigned m = l + (r - l) / 2;
+
+        if (bq->lookup[m]->index <= idx)
+            l = m + 1;
+        else
+            r = m;
+    }
+
+    return l > bq->lookup_start ? bq->lookup[l - 1] : NULL;
+}
+
+static bool is_read_item(struct list_item *q, int64_t idx) {
+    return q &&
+        q->index + (int64_t) q->chunk.length > idx &&
+        (!q->prev || q->prev->index + (int64_t) q->prev->chunk.length <= idx);
+}
+
+static bool is_write_item(struct list_item *q, int64_t idx) {
+    return q &&
+        q->index <= idx &&
+        (!q->next || q->next->index > idx);
+}
+
 static void fix_current_read(pa_memblockq *bq) {
     pa_assert(bq);
 
@@ -131,6 +287,22 @@ static void fix_current_read(pa_memblockq *bq) {
     if (PA_UNLIKELY(!bq->current_read))
         bq->current_read = bq->blocks;
 
+    /* On long queues avoid walking the list, unless we're already at
+     * or next to the right item */
+    if (bq->n_blocks > PA_MEMBLOCKQ_LOOKUP_MIN) {
+
+        if (is_read_item(bq->current_read, bq->read_index))
+            return;
+
+        if (is_read_item(bq->current_read->next, bq->read_index)) {
+            bq->current_read = bq->current_read->next;
+            return;
+        }
+
+        bq->current_read = lookup_read(bq, bq->read_index);
+        return;
+    }
+
     /* Scan left */
     while (PA_UNLIKELY(bq->current_read->index > bq->read_index))
 
@@ -159,6 +331,20 @@ static void fix_current_write(pa_memblockq *bq) {
     if (PA_UNLIKELY(!bq->current_write))
         bq->current_write = bq->blocks_tail;
 
+    if (bq->n_blocks > PA_MEMBLOCKQ_LOOKUP_MIN) {
+
+        if (is_write_item(bq->current_write, bq->write_index))
+            return;
+
+        if (is_write_item(bq->current_write->next, bq->write_index)) {
+            bq->current_write = bq->current_write->next;
+            return;
+        }
+
+        bq->current_write = lookup_write(bq, bq->write_index);
+        return;
+    }
+
     /* Scan right */
     while (PA_UNLIKELY(bq->current_write->index + (int64_t) bq->current_write->chunk.length <= bq->write_index))
 
@@ -182,6 +368,8 @@ static void drop_block(pa_memblockq *bq, struct list_item *q) {
 
     pa_assert(bq->n_blocks >= 1);
 
+    lookup_remove(bq, q);
+
     if (q->prev)
         q->prev->next = q->next;
     else {
@@ -208,6 +396,11 @@ static void drop_block(pa_memblockq *bq, struct list_item *q) {
         pa_xfree(q);
 
     bq->n_blocks--;
+
+    if (bq->n_blocks == 0) {
+        bq->lookup_start = bq->lookup_n = 0;
+        bq->lookup_dirty = false;
+    }
 }
 
 static void drop_backlog(pa_memblockq *bq) {
@@ -274,6 +467,71 @@ static void read_index_changed(pa_memblockq *bq, int64_t old_read_index) {
 #endif
 }
 
+static unsigned histogram_bucket(size_t length) {
+    unsigned i;
+
+    for (i = 0; i < PA_MEMBLOCKQ_HISTOGRAM_BUCKETS - 1; i++)
+        if (length <= ((size_t) PA_MEMBLOCKQ_HISTOGRAM_MIN << i))
+            break;
+
+    return i;
+}
+
+static bool can_merge(pa_memblockq *bq, struct list_item *q, const pa_memchunk *chunk) {
+    pa_assert(bq);
+    pa_assert(chunk);
+
+    return q &&
+        q->chunk.memblock == chunk->memblock &&
+        q->chunk.index + q->chunk.length == chunk->index &&
+        bq->write_index == q->index + (int64_t) q->chunk.length;
+}
+
+/* Copy a small chunk into the queue's own coalescing block and make
+ * *chunk point to the copy. Only the bytes right of coalesce.index
+ * are ever written to, hence it doesn't matter that earlier parts of
+ * the block might still be referenced by readers. */
+static bool coalesce_chunk(pa_memblockq *bq, pa_memchunk *chunk) {
+    pa_memchunk dst;
+
+    pa_assert(bq);
+    pa_assert(chunk);
+
+    if (chunk->length > PA_MEMBLOCKQ_COALESCE_MAX)
+        return false;
+
+    /* Keep the silence flag intact */
+    if (pa_memblock_is_silence(chunk->memblock))
+        return false;
+
+    if (chunk->memblock == bq->coalesce.memblock)
+        return false;
+
+    if (!bq->coalesce.memblock ||
+        bq->coalesce.index + chunk->length > pa_memblock_get_length(bq->coalesce.memblock)) {
+
+        if (bq->coalesce.memblock)
+            pa_memblock_unref(bq->coalesce.memblock);
+
+        bq->coalesce.memblock = pa_memblock_new(pa_memblock_get_pool(chunk->memblock),
+                                                (PA_MEMBLOCKQ_COALESCE_BLOCK_SIZE / bq->base) * bq->base);
+        bq->coalesce.index = 0;
+    }
+
+    dst.memblock = bq->coalesce.memblock;
+    dst.index = bq->coalesce.index;
+    dst.length = chunk->length;
+    pa_memchunk_memcpy(&dst, chunk);
+
+    bq->coalesce.index += dst.length;
+
+    bq->stat.n_coalesced++;
+    bq->stat.coalesced_bytes += dst.length;
+
+    *chunk = dst;
+    return true;
+}
+
 int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     struct list_item *q, *n;
     pa_memchunk chunk;
@@ -294,6 +552,9 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     old = bq->write_index;
     chunk = *uchunk;
 
+    bq->stat.n_pushed[histogram_bucket(chunk.length)]++;
+    bq->stat.pushed_bytes[histogram_bucket(chunk.length)] += chunk.length;
+
     fix_current_write(bq);
     q = bq->current_write;
 
@@ -354,6 +615,7 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
 
                 /* Drop it from the new entry */
                 p->index = q->index + (int64_t) d;
+                p->chunk.index += d;
                 p->chunk.length -= d;
 
                 /* Add it to the list */
@@ -365,6 +627,11 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
                 q->next = p;
 
                 bq->n_blocks++;
+
+                if (p->next)
+                    bq->lookup_dirty = true;
+                else
+                    lookup_append(bq, p);
             }
 
             /* Truncate the chunk */
@@ -398,20 +665,21 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     if (q) {
         pa_assert(bq->write_index >=  q->index + (int64_t)q->chunk.length);
         pa_assert(!q->next || (bq->write_index + (int64_t)chunk.length <= q->next->index));
-
-        /* Try to merge memory blocks */
-
-        if (q->chunk.memblock == chunk.memblock &&
-            q->chunk.index + q->chunk.length == chunk.index &&
-            bq->write_index == q->index + (int64_t) q->chunk.length) {
-
-            q->chunk.length += chunk.length;
-            bq->write_index += (int64_t) chunk.length;
-            goto finish;
-        }
     } else
         pa_assert(!bq->blocks || (bq->write_index + (int64_t)chunk.length <= bq->blocks->index));
 
+    /* Small chunks that cannot be merged as they are get copied into
+     * our coalescing block, which likely makes them mergeable */
+    if (!can_merge(bq, q, &chunk))
+        coalesce_chunk(bq, &chunk);
+
+    /* Try to merge memory blocks */
+    if (can_merge(bq, q, &chunk)) {
+        q->chunk.length += chunk.length;
+        bq->write_index += (int64_t) chunk.length;
+        goto finish;
+    }
+
     if (!(n = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
         n = pa_xnew(struct list_item, 1);
 
@@ -435,6 +703,11 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
 
     bq->n_blocks++;
 
+    if (n->next)
+        bq->lookup_dirty = true;
+    else
+        lookup_append(bq, n);
+
 finish:
 
     write_index_changed(bq, old, true);
@@ -1009,6 +1282,11 @@ void pa_memblockq_silence(pa_memblockq *bq) {
         drop_block(bq, bq->blocks);
 
     pa_assert(bq->n_blocks == 0);
+
+    if (bq->coalesce.memblock) {
+        pa_memblock_unref(bq->coalesce.memblock);
+        pa_memchunk_reset(&bq->coalesce);
+    }
 }
 
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq) {
@@ -1022,3 +1300,10 @@ size_t pa_memblockq_get_base(pa_memblockq *bq) {
 
     return bq->base;
 }
+
+void pa_memblockq_get_stat(pa_memblockq *bq, pa_memblockq_stat *stat) {
+    pa_assert(bq);
+    pa_assert(stat);
+
+    *stat = bq->stat;
+}
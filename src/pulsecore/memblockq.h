@@ -35,6 +35,21 @@
 
 typedef struct pa_memblockq pa_memblockq;
 
+#define PA_MEMBLOCKQ_HISTOGRAM_BUCKETS 8
+#define PA_MEMBLOCKQ_HISTOGRAM_MIN 64
+
+/* Push statistics of a queue. Bucket 0 counts chunks of up to
+ * PA_MEMBLOCKQ_HISTOGRAM_MIN bytes, every following bucket twice as
+ * much, the last one everything larger. Chunks that were copied into
+ * the queue's own blocks to keep the number of list items low are
+ * accounted in n_coalesced/coalesced_bytes. */
+typedef struct pa_memblockq_stat {
+    uint64_t n_pushed[PA_MEMBLOCKQ_HISTOGRAM_BUCKETS];
+    uint64_t pushed_bytes[PA_MEMBLOCKQ_HISTOGRAM_BUCKETS];
+    uint64_t n_coalesced;
+    uint64_t coalesced_bytes;
+} pa_memblockq_stat;
+
 /* Parameters:
 
    - name:      name for debugging purposes
@@ -187,4 +202,7 @@ bool pa_memblockq_prebuf_active(pa_memblockq *bq);
 /* Return how many items are currently stored in the queue */
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq);
 
+/* Return the push statistics of the queue */
+void pa_memblockq_get_stat(pa_memblockq *bq, pa_memblockq_stat *stat);
+
 #endif
@@ -39,8 +39,11 @@ pa_memchunk* pa_memchunk_make_writable(pa_memchunk *c, size_t min) {
     pa_assert(c);
     pa_assert(c->memblock);
 
+    /* Blocks tagged as silence are never written to in place,
+     * since the tag would outlive their contents */
     if (pa_memblock_ref_is_one(c->memblock) &&
         !pa_memblock_is_read_only(c->memblock) &&
+        !pa_memblock_is_silence(c->memblock) &&
         pa_memblock_get_length(c->memblock) >= c->index+min)
         return c;
 
@@ -88,6 +91,24 @@ pa_memchunk *pa_memchunk_will_need(const pa_memchunk *c) {
     return (pa_memchunk*) c;
 }
 
+void pa_memchunk_prefetch(const pa_memchunk *c, size_t length) {
+    const uint8_t *p;
+    size_t o;
+
+    pa_assert(c);
+    pa_assert(c->memblock);
+
+    if (length > c->length)
+        length = c->length;
+
+    p = pa_memblock_acquire_chunk(c);
+
+    for (o = 0; o < length; o += PA_CACHE_LINE_SIZE)
+        PA_PREFETCH(p + o);
+
+    pa_memblock_release(c->memblock);
+}
+
 pa_memchunk* pa_memchunk_memcpy(pa_memchunk *dst, pa_memchunk *src) {
     void *p, *q;
 
@@ -47,6 +47,10 @@ pa_memchunk* pa_memchunk_reset(pa_memchunk *c);
 /* Map a memory chunk back into memory if it was swapped out */
 pa_memchunk *pa_memchunk_will_need(const pa_memchunk *c);
 
+/* Start loading the first length bytes of the chunk into the CPU
+ * caches, for data that is about to be read but not right away */
+void pa_memchunk_prefetch(const pa_memchunk *c, size_t length);
+
 /* Copy the data in the src memchunk to the dst memchunk */
 pa_memchunk* pa_memchunk_memcpy(pa_memchunk *dst, pa_memchunk *src);
 
@@ -0,0 +1,220 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/macro.h>
+
+#include "metrics.h"
+
+/* The fastest counters, render time in usec, wrap after about 71
+ * minutes */
+#define FOLD_INTERVAL (60*PA_USEC_PER_SEC)
+
+struct pa_metrics {
+    pa_mainloop_api *mainloop;
+    pa_time_event *fold_event;
+
+    PA_LLIST_HEAD(pa_metric, families[PA_METRIC_FAMILY_MAX]);
+};
+
+static const struct {
+    const char *name;
+    const char *label;
+    const char *help;
+} families[PA_METRIC_FAMILY_MAX] = {
+    [PA_METRIC_SINK_RENDER_USEC] = {
+        "pulseaudio_sink_render_usec_total", "sink",
+        "Time spent rendering the data of the sink, in microseconds." },
+    [PA_METRIC_SINK_RESAMPLER_USEC] = {
+        "pulseaudio_sink_resampler_usec_total", "sink",
+        "Time spent resampling the streams of the sink, in microseconds, while module-resampler-downgrade is loaded." },
+    [PA_METRIC_SINK_REWINDS] = {
+        "pulseaudio_sink_rewinds_total", "sink",
+        "Rewinds of the sink." },
+    [PA_METRIC_SINK_XRUNS] = {
+        "pulseaudio_sink_xruns_total", "sink",
+        "Underruns of the sink's device." },
+    [PA_METRIC_SINK_WATERMARK_INCREASES] = {
+        "pulseaudio_sink_watermark_increases_total", "sink",
+        "Times the sink woke up too late and raised its wakeup watermark or minimal latency." },
+    [PA_METRIC_SOURCE_XRUNS] = {
+        "pulseaudio_source_xruns_total", "source",
+        "Overruns of the source's device." },
+    [PA_METRIC_CLIENT_BYTES_RECEIVED] = {
+        "pulseaudio_client_received_bytes_total", "client",
+        "Audio data received from the native protocol client." },
+    [PA_METRIC_CLIENT_BYTES_SENT] = {
+        "pulseaudio_client_sent_bytes_total", "client",
+        "Audio data sent to the native protocol client." },
+    [PA_METRIC_NATIVE_COMMANDS] = {
+        "pulseaudio_native_commands_total", "command",
+        "Native protocol commands received from all clients." },
+};
+
+static void fold(pa_metric *metric) {
+    uint32_t value;
+
+    value = (uint32_t) pa_atomic_load(&metric->value);
+    metric->total += (uint32_t) (value - metric->folded);
+    metric->folded = value;
+}
+
+static void fold_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_metrics *m = userdata;
+    struct timeval tv;
+    pa_metric *metric;
+    unsigned f;
+
+    pa_assert(m);
+
+    for (f = 0; f < PA_METRIC_FAMILY_MAX; f++)
+        PA_LLIST_FOREACH(metric, m->families[f])
+            fold(metric);
+
+    a->time_restart(e, pa_timeval_rtstore(&tv, pa_rtclock_now() + FOLD_INTERVAL, true));
+}
+
+pa_metrics *pa_metrics_new(pa_mainloop_api *mainloop) {
+    pa_metrics *m;
+    struct timeval tv;
+
+    pa_assert(mainloop);
+
+    m = pa_xnew0(pa_metrics, 1);
+    m->mainloop = mainloop;
+    m->fold_event = mainloop->time_new(mainloop, pa_timeval_rtstore(&tv, pa_rtclock_now() + FOLD_INTERVAL, true), fold_cb, m);
+
+    return m;
+}
+
+void pa_metrics_free(pa_metrics *m) {
+    unsigned f;
+
+    pa_assert(m);
+
+    for (f = 0; f < PA_METRIC_FAMILY_MAX; f++)
+        pa_assert(!m->families[f]);
+
+    m->mainloop->time_free(m->fold_event);
+    pa_xfree(m);
+}
+
+pa_metric *pa_metric_new(pa_metrics *m, pa_metric_family_t family, const char *label_value) {
+    pa_metric *metric;
+
+    pa_assert(m);
+    pa_assert(family < PA_METRIC_FAMILY_MAX);
+    pa_assert(label_value);
+
+    metric = pa_xnew0(pa_metric, 1);
+    metric->metrics = m;
+    metric->family = family;
+    metric->label_value = pa_xstrdup(label_value);
+
+    PA_LLIST_PREPEND(pa_metric, m->families[family], metric);
+
+    return metric;
+}
+
+void pa_metric_free(pa_metric *metric) {
+    pa_assert(metric);
+
+    PA_LLIST_REMOVE(pa_metric, metric->metrics->families[metric->family], metric);
+
+    pa_xfree(metric->label_value);
+    pa_xfree(metric);
+}
+
+uint64_t pa_metric_get(pa_metric *metric) {
+    pa_assert(metric);
+
+    fold(metric);
+
+    return metric->total;
+}
+
+const char *pa_metric_family_name(pa_metric_family_t family) {
+    pa_assert(family < PA_METRIC_FAMILY_MAX);
+
+    return families[family].name;
+}
+
+const char *pa_metric_family_label(pa_metric_family_t family) {
+    pa_assert(family < PA_METRIC_FAMILY_MAX);
+
+    return families[family].label;
+}
+
+void pa_metrics_foreach(pa_metrics *m, pa_metrics_cb_t cb, void *userdata) {
+    pa_metric *metric;
+    unsigned f;
+
+    pa_assert(m);
+    pa_assert(cb);
+
+    for (f = 0; f < PA_METRIC_FAMILY_MAX; f++)
+        PA_LLIST_FOREACH(metric, m->families[f])
+            cb(metric, pa_metric_get(metric), userdata);
+}
+
+/* Label values may contain anything, the format wants backslashes,
+ * quotes and line feeds escaped */
+static void put_label_value(pa_strbuf *buf, const char *value) {
+    for (; *value; value++) {
+        switch (*value) {
+            case '\\':
+                pa_strbuf_puts(buf, "\\\\");
+                break;
+            case '"':
+                pa_strbuf_puts(buf, "\\\"");
+                break;
+            case '\n':
+                pa_strbuf_puts(buf, "\\n");
+                break;
+            default:
+                pa_strbuf_putc(buf, *value);
+                break;
+        }
+    }
+}
+
+void pa_metrics_dump(pa_metrics *m, pa_strbuf *buf) {
+    pa_metric *metric;
+    unsigned f;
+
+    pa_assert(m);
+    pa_assert(buf);
+
+    for (f = 0; f < PA_METRIC_FAMILY_MAX; f++) {
+        pa_strbuf_printf(buf, "# HELP %s %s\n", families[f].name, families[f].help);
+        pa_strbuf_printf(buf, "# TYPE %s counter\n", families[f].name);
+
+        PA_LLIST_FOREACH(metric, m->families[f]) {
+            pa_strbuf_printf(buf, "%s{%s=\"", families[f].name, families[f].label);
+            put_label_value(buf, metric->label_value);
+            pa_strbuf_printf(buf, "\"} %" PRIu64 "\n", pa_metric_get(metric));
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef foopulsemetricshfoo
+#define foopulsemetricshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/mainloop-api.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/strbuf.h>
+
+/* A registry of counters that the core and its objects keep about
+ * themselves. Objects register their counters when they are created and
+ * bump them from any thread with a single atomic add. Exporting the
+ * registry only walks the registered counters, not the core's object
+ * lists. The counters themselves are 32 bits wide, the registry folds
+ * them into 64 bit totals whenever they are read and at least once a
+ * minute, so that they never appear to wrap around. Everything but
+ * pa_metric_add() and pa_metric_inc() is called from the main thread. */
+
+typedef enum pa_metric_family {
+    PA_METRIC_SINK_RENDER_USEC,
+    PA_METRIC_SINK_RESAMPLER_USEC,
+    PA_METRIC_SINK_REWINDS,
+    PA_METRIC_SINK_XRUNS,
+    PA_METRIC_SINK_WATERMARK_INCREASES,
+    PA_METRIC_SOURCE_XRUNS,
+    PA_METRIC_CLIENT_BYTES_RECEIVED,
+    PA_METRIC_CLIENT_BYTES_SENT,
+    PA_METRIC_NATIVE_COMMANDS,
+    PA_METRIC_FAMILY_MAX
+} pa_metric_family_t;
+
+typedef struct pa_metrics pa_metrics;
+typedef struct pa_metric pa_metric;
+
+struct pa_metric {
+    /* Bumped from any thread */
+    pa_atomic_t value;
+
+    /* The rest belongs to the registry */
+    pa_metrics *metrics;
+    pa_metric_family_t family;
+    char *label_value;
+    uint32_t folded;
+    uint64_t total;
+
+    PA_LLIST_FIELDS(pa_metric);
+};
+
+pa_metrics *pa_metrics_new(pa_mainloop_api *mainloop);
+void pa_metrics_free(pa_metrics *m);
+
+/* Registers a counter of family for the object named label_value, e.g. a
+ * sink name. All counters of a family share the label name the family
+ * defines. */
+pa_metric *pa_metric_new(pa_metrics *m, pa_metric_family_t family, const char *label_value);
+void pa_metric_free(pa_metric *metric);
+
+/* Called from any thread */
+static inline void pa_metric_add(pa_metric *metric, unsigned n) {
+    pa_atomic_add(&metric->value, (int) n);
+}
+
+static inline void pa_metric_inc(pa_metric *metric) {
+    pa_atomic_inc(&metric->value);
+}
+
+/* The total since the counter was registered */
+uint64_t pa_metric_get(pa_metric *metric);
+
+const char *pa_metric_family_name(pa_metric_family_t family);
+const char *pa_metric_family_label(pa_metric_family_t family);
+
+typedef void (*pa_metrics_cb_t)(pa_metric *metric, uint64_t value, void *userdata);
+
+/* Calls cb for every counter, grouped by family */
+void pa_metrics_foreach(pa_metrics *m, pa_metrics_cb_t cb, void *userdata);
+
+/* Formats all counters in the Prometheus text exposition format */
+void pa_metrics_dump(pa_metrics *m, pa_strbuf *buf);
+
+#endif
@@ -188,31 +188,58 @@ static void pa_mix2_s16ne(pa_mix_info streams[], unsigned channels, int16_t *dat
     }
 }
 
-/* special case: mix s16ne streams, 2 channels each */
-static void pa_mix_ch2_s16ne(pa_mix_info streams[], unsigned nstreams, int16_t *data, unsigned length) {
-
-    length /= sizeof(int16_t) * 2;
-
-    for (; length > 0; length--) {
-        int32_t sum0 = 0, sum1 = 0;
-        unsigned i;
-
-        for (i = 0; i < nstreams; i++) {
-            pa_mix_info *m = streams + i;
-            int32_t cv0 = m->linear[0].i;
-            int32_t cv1 = m->linear[1].i;
-
-            sum0 += pa_mult_s16_volume(*((int16_t*) m->ptr), cv0);
-            m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
+/* special cases: mix s16ne or float32ne streams with a fixed number of
+ * channels each. The loops over one frame have a constant trip count,
+ * so the compiler unrolls them and keeps the sums in registers. */
+#define DEFINE_MIX_CHANNELS(ch)                                                                 \
+    static void pa_mix_ch##ch##_s16ne(pa_mix_info streams[], unsigned nstreams, int16_t *data, unsigned length) { \
+        length /= sizeof(int16_t) * ch;                                                         \
+                                                                                                \
+        for (; length > 0; length--, data += ch) {                                              \
+            int32_t sum[ch] = { 0 };                                                            \
+            unsigned i, c;                                                                      \
+                                                                                                \
+            for (i = 0; i < nstreams; i++) {                                                    \
+                pa_mix_info *m = streams + i;                                                   \
+                const int16_t *p = m->ptr;                                                      \
+                                                                                                \
+                for (c = 0; c < ch; c++)                                                        \
+                    sum[c] += pa_mult_s16_volume(p[c], m->linear[c].i);                         \
+                m->ptr = (uint8_t*) m->ptr + ch * sizeof(int16_t);                              \
+            }                                                                                   \
+                                                                                                \
+            for (c = 0; c < ch; c++)                                                            \
+                data[c] = PA_CLAMP_UNLIKELY(sum[c], -0x8000, 0x7FFF);                           \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static void pa_mix_ch##ch##_float32ne(pa_mix_info streams[], unsigned nstreams, float *data, unsigned length) { \
+        length /= sizeof(float) * ch;                                                           \
+                                                                                                \
+        for (; length > 0; length--, data += ch) {                                              \
+            float sum[ch] = { 0 };                                                              \
+            unsigned i, c;                                                                      \
+                                                                                                \
+            for (i = 0; i < nstreams; i++) {                                                    \
+                pa_mix_info *m = streams + i;                                                   \
+                const float *p = m->ptr;                                                        \
+                                                                                                \
+                for (c = 0; c < ch; c++)                                                        \
+                    sum[c] += p[c] * m->linear[c].f;                                            \
+                m->ptr = (uint8_t*) m->ptr + ch * sizeof(float);                                \
+            }                                                                                   \
+                                                                                                \
+            for (c = 0; c < ch; c++)                                                            \
+                data[c] = sum[c];                                                               \
+        }                                                                                       \
+    }
 
-            sum1 += pa_mult_s16_volume(*((int16_t*) m->ptr), cv1);
-            m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
-        }
+DEFINE_MIX_CHANNELS(1)
+DEFINE_MIX_CHANNELS(2)
+DEFINE_MIX_CHANNELS(6)
+DEFINE_MIX_CHANNELS(8)
 
-        *data++ = PA_CLAMP_UNLIKELY(sum0, -0x8000, 0x7FFF);
-        *data++ = PA_CLAMP_UNLIKELY(sum1, -0x8000, 0x7FFF);
-    }
-}
+#undef DEFINE_MIX_CHANNELS
 
 static void pa_mix_generic_s16ne(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
     unsigned channel = 0;
@@ -247,8 +274,14 @@ static void pa_mix_s16ne_c(pa_mix_info streams[], unsigned nstreams, unsigned ch
         pa_mix2_ch2_s16ne(streams, data, length);
     else if (nstreams == 2)
         pa_mix2_s16ne(streams, channels, data, length);
+    else if (channels == 1)
+        pa_mix_ch1_s16ne(streams, nstreams, data, length);
     else if (channels == 2)
         pa_mix_ch2_s16ne(streams, nstreams, data, length);
+    else if (channels == 6)
+        pa_mix_ch6_s16ne(streams, nstreams, data, length);
+    else if (channels == 8)
+        pa_mix_ch8_s16ne(streams, nstreams, data, length);
     else
         pa_mix_generic_s16ne(streams, nstreams, channels, data, length);
 }
@@ -536,7 +569,7 @@ static void pa_mix_alaw_c(pa_mix_info streams[], unsigned nstreams, unsigned cha
     }
 }
 
-static void pa_mix_float32ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+static void pa_mix_generic_float32ne(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
     unsigned channel = 0;
 
     length /= sizeof(float);
@@ -564,6 +597,19 @@ static void pa_mix_float32ne_c(pa_mix_info streams[], unsigned nstreams, unsigne
     }
 }
 
+static void pa_mix_float32ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+    if (channels == 1)
+        pa_mix_ch1_float32ne(streams, nstreams, data, length);
+    else if (channels == 2)
+        pa_mix_ch2_float32ne(streams, nstreams, data, length);
+    else if (channels == 6)
+        pa_mix_ch6_float32ne(streams, nstreams, data, length);
+    else if (channels == 8)
+        pa_mix_ch8_float32ne(streams, nstreams, data, length);
+    else
+        pa_mix_generic_float32ne(streams, nstreams, channels, data, length);
+}
+
 static void pa_mix_float32re_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
     unsigned channel = 0;
 
@@ -606,20 +652,111 @@ static pa_do_mix_func_t do_mix_table[] = {
 };
 
 void pa_mix_func_init(const pa_cpu_info *cpu_info) {
-    if (cpu_info->force_generic_code)
+    if (cpu_info->force_generic_code) {
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_generic_s16ne;
-    else
+        do_mix_table[PA_SAMPLE_FLOAT32NE] = (pa_do_mix_func_t) pa_mix_generic_float32ne;
+    } else {
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_s16ne_c;
+        do_mix_table[PA_SAMPLE_FLOAT32NE] = (pa_do_mix_func_t) pa_mix_float32ne_c;
+    }
 }
 
-size_t pa_mix(
+/* Streams with a ramp are mixed in steps of this many frames, the volume
+ * of such a stream only moves on from one step to the next */
+#define RAMP_STEP_FRAMES 32
+
+static void copy_linear(pa_mix_info *m, bool to, unsigned channels) {
+    unsigned channel;
+
+    for (channel = 0; channel < channels; channel++)
+        if (to)
+            m->linear_to[channel] = m->linear[channel];
+        else
+            m->linear_from[channel] = m->linear[channel];
+}
+
+/* Sets the volumes of a ramping stream for the step that is centered
+ * around index, which is in bytes from the start of the mix */
+static void calc_ramp_step(pa_mix_info *m, size_t index, bool is_float, unsigned channels) {
+    unsigned channel;
+    double t;
+
+    t = index >= m->ramp_length ? 1.0 : (double) index / (double) m->ramp_length;
+
+    for (channel = 0; channel < channels; channel++) {
+        if (is_float)
+            m->linear[channel].f = (float) (m->linear_from[channel].f + (m->linear_to[channel].f - m->linear_from[channel].f) * t);
+        else
+            m->linear[channel].i = (int32_t) lrint(m->linear_from[channel].i + (m->linear_to[channel].i - m->linear_from[channel].i) * t);
+    }
+}
+
+static void mix_ramps(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume) {
+
+    size_t fs, step, ramp = 0, offset, l;
+    bool is_float;
+    unsigned k;
+
+    fs = pa_frame_size(spec);
+    step = RAMP_STEP_FRAMES * fs;
+    is_float = spec->format == PA_SAMPLE_FLOAT32LE || spec->format == PA_SAMPLE_FLOAT32BE;
+
+    for (k = 0; k < nstreams; k++) {
+        pa_mix_info *m = streams + k;
+        pa_cvolume v;
+
+        m->base = m->ptr;
+
+        if (m->ramp_length <= 0)
+            continue;
+
+        pa_assert(pa_frame_aligned(m->ramp_length, spec));
+        pa_assert(pa_cvolume_compatible(&m->ramp_volume, spec));
+
+        /* Take the linear volumes at both ends of the ramp */
+        copy_linear(m, false, spec->channels);
+        v = m->volume;
+        m->volume = m->ramp_volume;
+        calc_stream_volumes_table[spec->format](m, 1, volume, spec);
+        m->volume = v;
+        copy_linear(m, true, spec->channels);
+
+        ramp = PA_MAX(ramp, m->ramp_length);
+    }
+
+    ramp = PA_MIN(ramp, length);
+
+    for (offset = 0; offset < length; offset += l) {
+        l = offset < ramp ? PA_MIN(step, ramp - offset) : length - offset;
+
+        for (k = 0; k < nstreams; k++) {
+            pa_mix_info *m = streams + k;
+
+            m->ptr = (uint8_t*) m->base + offset;
+
+            if (m->ramp_length > 0)
+                calc_ramp_step(m, offset < ramp ? offset + l / 2 : m->ramp_length, is_float, spec->channels);
+        }
+
+        do_mix_table[spec->format](streams, nstreams, spec->channels, (uint8_t*) data + offset, (unsigned) l);
+    }
+}
+
+static size_t mix(
         pa_mix_info streams[],
         unsigned nstreams,
         void *data,
         size_t length,
         const pa_sample_spec *spec,
         const pa_cvolume *volume,
-        bool mute) {
+        bool mute,
+        bool ramps) {
 
     pa_cvolume full_volume;
     unsigned k;
@@ -628,7 +765,6 @@ size_t pa_mix(
     pa_assert(data);
     pa_assert(length);
     pa_assert(spec);
-    pa_assert(nstreams > 1);
 
     if (!volume)
         volume = pa_cvolume_reset(&full_volume, spec->channels);
@@ -644,7 +780,11 @@ size_t pa_mix(
     }
 
     calc_stream_volumes_table[spec->format](streams, nstreams, volume, spec);
-    do_mix_table[spec->format](streams, nstreams, spec->channels, data, length);
+
+    if (ramps)
+        mix_ramps(streams, nstreams, data, length, spec, volume);
+    else
+        do_mix_table[spec->format](streams, nstreams, spec->channels, data, length);
 
     for (k = 0; k < nstreams; k++)
         pa_memblock_release(streams[k].chunk.memblock);
@@ -652,6 +792,161 @@ size_t pa_mix(
     return length;
 }
 
+size_t pa_mix(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume,
+        bool mute) {
+
+    pa_assert(nstreams > 1);
+
+    return mix(streams, nstreams, data, length, spec, volume, mute, false);
+}
+
+size_t pa_mix_ramp(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume,
+        bool mute) {
+
+    bool ramps = false;
+    unsigned k;
+
+    pa_assert(streams);
+    pa_assert(nstreams > 0);
+
+    for (k = 0; k < nstreams; k++)
+        if (streams[k].ramp_length > 0)
+            ramps = true;
+
+    return mix(streams, nstreams, data, length, spec, volume, mute, ramps);
+}
+
+bool pa_mix_is_replaceable(
+        const pa_memchunk *mix,
+        const pa_sample_spec *spec) {
+
+    const int16_t *d;
+    size_t n;
+
+    pa_assert(mix);
+    pa_assert(mix->memblock);
+    pa_assert(spec);
+
+    if (spec->format == PA_SAMPLE_FLOAT32NE)
+        return true;
+
+    if (spec->format != PA_SAMPLE_S16NE)
+        return false;
+
+    if (pa_memblock_is_silence(mix->memblock))
+        return true;
+
+    /* A clipped sample has lost the part that exceeded the range, which
+     * no later subtraction can bring back */
+    d = pa_memblock_acquire_chunk(mix);
+
+    for (n = mix->length / sizeof(int16_t); n > 0; n--, d++)
+        if (PA_UNLIKELY(*d == -0x8000 || *d == 0x7FFF))
+            break;
+
+    pa_memblock_release(mix->memblock);
+
+    return n == 0;
+}
+
+static void pa_mix_replace_s16ne(const int16_t *mix, pa_mix_info *o, pa_mix_info *n, unsigned channels, int16_t *data, unsigned length) {
+    const int16_t *optr = o->ptr, *nptr = n->ptr;
+    unsigned channel = 0;
+
+    length /= sizeof(int16_t);
+
+    for (; length > 0; length--, data++) {
+        int32_t sum = *mix++;
+
+        if (optr)
+            sum -= pa_mult_s16_volume(*optr++, o->linear[channel].i);
+        if (nptr)
+            sum += pa_mult_s16_volume(*nptr++, n->linear[channel].i);
+
+        sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        *data = sum;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static void pa_mix_replace_float32ne(const float *mix, pa_mix_info *o, pa_mix_info *n, unsigned channels, float *data, unsigned length) {
+    const float *optr = o->ptr, *nptr = n->ptr;
+    unsigned channel = 0;
+
+    length /= sizeof(float);
+
+    for (; length > 0; length--, data++) {
+        float sum = *mix++;
+
+        if (optr)
+            sum -= *optr++ * o->linear[channel].f;
+        if (nptr)
+            sum += *nptr++ * n->linear[channel].f;
+
+        *data = sum;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+void pa_mix_replace(
+        const pa_memchunk *mix,
+        pa_mix_info *old_stream,
+        const pa_cvolume *old_volume,
+        pa_mix_info *new_stream,
+        const pa_cvolume *new_volume,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec) {
+
+    const void *m;
+
+    pa_assert(mix);
+    pa_assert(old_stream);
+    pa_assert(old_volume);
+    pa_assert(new_stream);
+    pa_assert(new_volume);
+    pa_assert(data);
+    pa_assert(spec);
+    pa_assert(spec->format == PA_SAMPLE_S16NE || spec->format == PA_SAMPLE_FLOAT32NE);
+    pa_assert(length <= mix->length);
+    pa_assert(length <= old_stream->chunk.length);
+    pa_assert(length <= new_stream->chunk.length);
+
+    calc_stream_volumes_table[spec->format](old_stream, 1, old_volume, spec);
+    calc_stream_volumes_table[spec->format](new_stream, 1, new_volume, spec);
+
+    old_stream->ptr = pa_memblock_is_silence(old_stream->chunk.memblock) ? NULL : pa_memblock_acquire_chunk(&old_stream->chunk);
+    new_stream->ptr = pa_memblock_is_silence(new_stream->chunk.memblock) ? NULL : pa_memblock_acquire_chunk(&new_stream->chunk);
+    m = pa_memblock_acquire_chunk(mix);
+
+    if (spec->format == PA_SAMPLE_S16NE)
+        pa_mix_replace_s16ne(m, old_stream, new_stream, spec->channels, data, length);
+    else
+        pa_mix_replace_float32ne(m, old_stream, new_stream, spec->channels, data, length);
+
+    pa_memblock_release(mix->memblock);
+    if (new_stream->ptr)
+        pa_memblock_release(new_stream->chunk.memblock);
+    if (old_stream->ptr)
+        pa_memblock_release(old_stream->chunk.memblock);
+}
+
 pa_do_mix_func_t pa_get_mix_func(pa_sample_format_t f) {
     pa_assert(pa_sample_format_valid(f));
 
@@ -31,13 +31,20 @@ typedef struct pa_mix_info {
     pa_cvolume volume;
     void *userdata;
 
+    /* Only used by pa_mix_ramp(): if ramp_length is not 0, the volume
+     * of the stream moves from volume to ramp_volume over the first
+     * ramp_length bytes and stays at ramp_volume after that. */
+    pa_cvolume ramp_volume;
+    size_t ramp_length;
+
     /* The following fields are used internally by pa_mix(), should
      * not be initialised by the caller of pa_mix(). */
     void *ptr;
     union {
         int32_t i;
         float f;
-    } linear[PA_CHANNELS_MAX];
+    } linear[PA_CHANNELS_MAX], linear_from[PA_CHANNELS_MAX], linear_to[PA_CHANNELS_MAX];
+    void *base;
 } pa_mix_info;
 
 size_t pa_mix(
@@ -49,6 +56,40 @@ size_t pa_mix(
     const pa_cvolume *volume,
     bool mute);
 
+/* Like pa_mix(), but takes the ramps of the streams into account. The
+ * ramps are applied by the mixing functions while they mix, so there is
+ * no extra pass over the data. A single stream may be passed too. */
+size_t pa_mix_ramp(
+    pa_mix_info channels[],
+    unsigned nchannels,
+    void *data,
+    size_t length,
+    const pa_sample_spec *spec,
+    const pa_cvolume *volume,
+    bool mute);
+
+/* Whether the contribution of a single stream can be taken out of a chunk
+ * that pa_mix() produced again, which is the case for S16NE and FLOAT32NE
+ * as long as no sample of the chunk was clipped. */
+bool pa_mix_is_replaceable(
+    const pa_memchunk *mix,
+    const pa_sample_spec *spec);
+
+/* Replaces the contribution of the stream old_stream by the one of
+ * new_stream in mix, as if pa_mix() had been called with new_stream
+ * instead. The volumes are the sink volumes the streams are (or were)
+ * mixed with, the stream volumes are taken from the pa_mix_info
+ * structs. Silent chunks are taken to contribute nothing. */
+void pa_mix_replace(
+    const pa_memchunk *mix,
+    pa_mix_info *old_stream,
+    const pa_cvolume *old_volume,
+    pa_mix_info *new_stream,
+    const pa_cvolume *new_volume,
+    void *data,
+    size_t length,
+    const pa_sample_spec *spec);
+
 typedef void (*pa_do_mix_func_t) (pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length);
 
 pa_do_mix_func_t pa_get_mix_func(pa_sample_format_t f);
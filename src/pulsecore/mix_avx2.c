@@ -0,0 +1,211 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "mix.h"
+
+#include <immintrin.h>
+
+/* All streams are summed into an accumulator of this many samples
+ * before the result is clamped and stored, so that the accumulator
+ * stays in the L1 cache no matter how many streams are mixed */
+#define BLOCK_SAMPLES 256
+
+/* Number of samples per vector */
+#define LANES 8
+
+static pa_do_mix_func_t fallback_s16ne, fallback_s32ne, fallback_float32ne;
+
+/* Since LANES is a multiple of the number of channels every lane always
+ * sees the same channel, hence the volumes fit in a single vector */
+static void stream_volumes(const pa_mix_info *m, unsigned channels, int32_t v[LANES]) {
+    unsigned j;
+
+    for (j = 0; j < LANES; j++)
+        v[j] = m->linear[j % channels].i;
+}
+
+/* Arithmetic right shift of 64 bit lanes by 16, which AVX2 lacks */
+static inline __m256i sra64_16(__m256i x) {
+    __m256i s = _mm256_shuffle_epi32(_mm256_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1));
+
+    return _mm256_xor_si256(_mm256_srli_epi64(_mm256_xor_si256(x, s), 16), s);
+}
+
+static void pa_mix_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int32_t, acc[BLOCK_SAMPLES]);
+    unsigned n = length / sizeof(int16_t);
+
+    if (LANES % channels != 0) {
+        fallback_s16ne(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    while (n >= LANES) {
+        unsigned block = PA_MIN(n, BLOCK_SAMPLES) & ~(LANES - 1);
+        unsigned i, k;
+
+        for (k = 0; k < block; k += LANES)
+            _mm256_store_si256((__m256i*) (acc + k), _mm256_setzero_si256());
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const int16_t *src = m->ptr;
+            int32_t v[LANES];
+            __m256i lo, hi;
+
+            /* Like pa_mult_s16_volume(), split the volume in two halves
+             * so that all products fit in 32 bits */
+            stream_volumes(m, channels, v);
+            lo = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) v), _mm256_set1_epi32(0xFFFF));
+            hi = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*) v), 16);
+
+            for (k = 0; k < block; k += LANES) {
+                __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) (src + k)));
+                __m256i p = _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(s, lo), 16), _mm256_mullo_epi32(s, hi));
+
+                _mm256_store_si256((__m256i*) (acc + k), _mm256_add_epi32(_mm256_load_si256((const __m256i*) (acc + k)), p));
+            }
+
+            m->ptr = (uint8_t*) m->ptr + block * sizeof(int16_t);
+        }
+
+        for (k = 0; k < block; k += LANES) {
+            __m256i s = _mm256_load_si256((const __m256i*) (acc + k));
+            _mm_storeu_si128((__m128i*) (data + k), _mm_packs_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)));
+        }
+
+        data += block;
+        n -= block;
+    }
+
+    if (n > 0)
+        fallback_s16ne(streams, nstreams, channels, data, n * sizeof(int16_t));
+}
+
+static void pa_mix_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned length) {
+    /* Per group of LANES samples, the even samples come first, then the odd ones */
+    PA_DECLARE_ALIGNED(32, int64_t, acc[BLOCK_SAMPLES]);
+    unsigned n = length / sizeof(int32_t);
+
+    if (LANES % channels != 0) {
+        fallback_s32ne(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    while (n >= LANES) {
+        unsigned block = PA_MIN(n, BLOCK_SAMPLES) & ~(LANES - 1);
+        unsigned i, k;
+
+        for (k = 0; k < block; k += 4)
+            _mm256_store_si256((__m256i*) (acc + k), _mm256_setzero_si256());
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const int32_t *src = m->ptr;
+            int32_t v[LANES];
+            __m256i cv_even, cv_odd;
+
+            stream_volumes(m, channels, v);
+            cv_even = _mm256_loadu_si256((const __m256i*) v);
+            cv_odd = _mm256_srli_epi64(cv_even, 32);
+
+            for (k = 0; k < block; k += LANES) {
+                __m256i s = _mm256_loadu_si256((const __m256i*) (src + k));
+                __m256i pe = sra64_16(_mm256_mul_epi32(s, cv_even));
+                __m256i po = sra64_16(_mm256_mul_epi32(_mm256_srli_epi64(s, 32), cv_odd));
+
+                _mm256_store_si256((__m256i*) (acc + k), _mm256_add_epi64(_mm256_load_si256((const __m256i*) (acc + k)), pe));
+                _mm256_store_si256((__m256i*) (acc + k + 4), _mm256_add_epi64(_mm256_load_si256((const __m256i*) (acc + k + 4)), po));
+            }
+
+            m->ptr = (uint8_t*) m->ptr + block * sizeof(int32_t);
+        }
+
+        for (k = 0; k < block; k++) {
+            int64_t sum = acc[(k & ~(LANES - 1)) + (k & 1) * (LANES / 2) + (k % LANES) / 2];
+            data[k] = (int32_t) PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        }
+
+        data += block;
+        n -= block;
+    }
+
+    if (n > 0)
+        fallback_s32ne(streams, nstreams, channels, data, n * sizeof(int32_t));
+}
+
+static void pa_mix_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+    unsigned n = length / sizeof(float);
+
+    if (LANES % channels != 0) {
+        fallback_float32ne(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    /* Floats need no clamping, so accumulate in the output buffer directly */
+    while (n >= LANES) {
+        unsigned block = PA_MIN(n, BLOCK_SAMPLES) & ~(LANES - 1);
+        unsigned i, k;
+
+        for (k = 0; k < block; k += LANES)
+            _mm256_storeu_ps(data + k, _mm256_setzero_ps());
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const float *src = m->ptr;
+            int32_t v[LANES];
+            __m256 cv;
+
+            stream_volumes(m, channels, v);
+            cv = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*) v));
+
+            for (k = 0; k < block; k += LANES)
+                _mm256_storeu_ps(data + k, _mm256_add_ps(_mm256_loadu_ps(data + k), _mm256_mul_ps(_mm256_loadu_ps(src + k), cv)));
+
+            m->ptr = (uint8_t*) m->ptr + block * sizeof(float);
+        }
+
+        data += block;
+        n -= block;
+    }
+
+    if (n > 0)
+        fallback_float32ne(streams, nstreams, channels, data, n * sizeof(float));
+}
+
+void pa_mix_func_init_avx2(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_AVX2))
+        return;
+
+    pa_log_info("Initialising AVX2 optimized mixing functions.");
+
+    fallback_s16ne = pa_get_mix_func(PA_SAMPLE_S16NE);
+    fallback_s32ne = pa_get_mix_func(PA_SAMPLE_S32NE);
+    fallback_float32ne = pa_get_mix_func(PA_SAMPLE_FLOAT32NE);
+
+    pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_avx2);
+    pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_avx2);
+    pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_avx2);
+}
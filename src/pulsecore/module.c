@@ -30,6 +30,8 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/proplist.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/log.h>
@@ -37,6 +39,8 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/ltdl-helper.h>
 #include <pulsecore/modinfo.h>
+#include <pulsecore/queue.h>
+#include <pulsecore/startup-trace.h>
 
 #include "module.h"
 
@@ -107,17 +111,30 @@ void pa_module_hook_connect(pa_module *m, pa_hook *hook, pa_hook_priority_t prio
     pa_dynarray_append(m->hooks, pa_hook_connect(hook, prio, cb, data));
 }
 
-pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
+typedef struct pending_load {
+    char *name, *argument;
+} pending_load;
+
+static void pending_load_free(pending_load *l) {
+    pa_assert(l);
+
+    pa_xfree(l->name);
+    pa_xfree(l->argument);
+    pa_xfree(l);
+}
+
+static pa_module* module_load(pa_core *c, const char *name, const char *argument) {
     pa_module *m = NULL;
     bool (*load_once)(void);
     const char* (*get_deprecated)(void);
     pa_modinfo *mi;
+    pa_usec_t start, trace_begin, trace_dlopen;
 
     pa_assert(c);
     pa_assert(name);
 
-    if (c->disallow_module_loading)
-        goto fail;
+    start = pa_rtclock_now();
+    trace_begin = pa_startup_trace_begin();
 
     m = pa_xnew(pa_module, 1);
     m->name = pa_xstrdup(name);
@@ -127,7 +144,11 @@ pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
     m->hooks = pa_dynarray_new((pa_free_cb_t) pa_hook_slot_free);
     m->index = PA_IDXSET_INVALID;
 
-    if (!(m->dl = lt_dlopenext(name))) {
+    trace_dlopen = pa_startup_trace_begin();
+    m->dl = lt_dlopenext(name);
+    pa_startup_trace_end(trace_dlopen, "dlopen", name);
+
+    if (!m->dl) {
         /* We used to print the error that is returned by lt_dlerror(), but
          * lt_dlerror() is useless. It returns pretty much always "file not
          * found". That's because if there are any problems with loading the
@@ -182,7 +203,8 @@ pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
         goto fail;
     }
 
-    pa_log_info("Loaded \"%s\" (index: #%u; argument: \"%s\").", m->name, m->index, m->argument ? m->argument : "");
+    pa_log_info("Loaded \"%s\" (index: #%u; argument: \"%s\") in %0.1f ms.", m->name, m->index, m->argument ? m->argument : "",
+                (double) (pa_rtclock_now() - start) / PA_USEC_PER_MSEC);
 
     pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_MODULE|PA_SUBSCRIPTION_EVENT_NEW, m->index);
 
@@ -202,9 +224,12 @@ pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
 
     pa_hook_fire(&m->core->hooks[PA_CORE_HOOK_MODULE_NEW], m);
 
+    pa_startup_trace_end(trace_begin, "module", name);
+
     return m;
 
 fail:
+    pa_startup_trace_end(trace_begin, "module", name);
 
     if (m) {
         if (m->index != PA_IDXSET_INVALID)
@@ -228,6 +253,61 @@ fail:
     return NULL;
 }
 
+pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
+    pa_assert(c);
+    pa_assert(name);
+
+    if (c->disallow_module_loading)
+        return NULL;
+
+    return module_load(c, name, argument);
+}
+
+static void defer_load_cb(pa_mainloop_api*api, pa_defer_event *e, void *userdata) {
+    pa_core *c = PA_CORE(userdata);
+    pending_load *l;
+
+    pa_core_assert_ref(c);
+
+    /* Only one module per main loop iteration, so that clients are served
+     * in between */
+    if ((l = pa_queue_pop(c->modules_pending_load))) {
+        /* The load was allowed when it was queued, even if module loading
+         * has been disabled after the startup script since */
+        if (!module_load(c, l->name, l->argument))
+            pa_log("Deferred load of module \"%s\" failed.", l->name);
+
+        pending_load_free(l);
+    }
+
+    if (pa_queue_isempty(c->modules_pending_load)) {
+        api->defer_enable(e, 0);
+        pa_log_info("All deferred modules have been loaded.");
+    }
+}
+
+int pa_module_load_deferred(pa_core *c, const char *name, const char *argument) {
+    pending_load *l;
+
+    pa_assert(c);
+    pa_assert(name);
+
+    if (c->disallow_module_loading)
+        return -1;
+
+    l = pa_xnew(pending_load, 1);
+    l->name = pa_xstrdup(name);
+    l->argument = pa_xstrdup(argument);
+    pa_queue_push(c->modules_pending_load, l);
+
+    if (!c->module_defer_load_event)
+        c->module_defer_load_event = c->mainloop->defer_new(c->mainloop, defer_load_cb, c);
+
+    c->mainloop->defer_enable(c->module_defer_load_event, 1);
+
+    return 0;
+}
+
 static void pa_module_free(pa_module *m) {
     pa_assert(m);
     pa_assert(m->core);
@@ -288,6 +368,7 @@ void pa_module_unload_by_index(pa_core *c, uint32_t idx, bool force) {
 
 void pa_module_unload_all(pa_core *c) {
     pa_module *m;
+    pending_load *l;
     uint32_t *indices;
     uint32_t state;
     int i;
@@ -295,6 +376,15 @@ void pa_module_unload_all(pa_core *c) {
     pa_assert(c);
     pa_assert(c->modules);
 
+    /* Modules that were not loaded yet won't be anymore */
+    while ((l = pa_queue_pop(c->modules_pending_load)))
+        pending_load_free(l);
+
+    if (c->module_defer_load_event) {
+        c->mainloop->defer_free(c->module_defer_load_event);
+        c->module_defer_load_event = NULL;
+    }
+
     if (pa_idxset_isempty(c->modules))
         return;
 
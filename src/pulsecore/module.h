@@ -54,6 +54,12 @@ bool pa_module_exists(const char *name);
 
 pa_module* pa_module_load(pa_core *c, const char *name, const char *argument);
 
+/* Queue a module to be loaded from the main loop once the current dispatch,
+ * e.g. the startup script, is done. Deferred modules are loaded in the order
+ * they were queued, one per main loop iteration. Returns 0 if the module was
+ * queued, a failure to load it later is only logged. */
+int pa_module_load_deferred(pa_core *c, const char *name, const char *argument);
+
 void pa_module_unload(pa_core *c, pa_module *m, bool force);
 void pa_module_unload_by_index(pa_core *c, uint32_t idx, bool force);
 
@@ -179,6 +179,29 @@ enum {
     PA_COMMAND_ENABLE_SRBCHANNEL,
     PA_COMMAND_DISABLE_SRBCHANNEL,
 
+    /* Supported since protocol v33 (7.0) */
+    PA_COMMAND_ENABLE_STREAM_SRBCHANNEL,
+    PA_COMMAND_START_STREAM_SRBCHANNEL,
+
+    /* Supported since protocol v34 (7.0) */
+    PA_COMMAND_GET_SINK_INPUT_INFO_LIST_MASKED,
+
+    /* Supported since protocol v37 (7.0) */
+    PA_COMMAND_GET_SINK_IO_TRACE,
+    PA_COMMAND_GET_SOURCE_IO_TRACE,
+
+    /* Supported since protocol v38 (7.0) */
+    PA_COMMAND_ENABLE_STREAM_TIMING_PAGE,
+
+    /* Supported since protocol v41 (7.0) */
+    PA_COMMAND_GET_METRICS,
+
+    /* Supported since protocol v42 (7.0) */
+    PA_COMMAND_REGISTER_MEMFD_SHMID,
+
+    /* Supported since protocol v43 (7.0) */
+    PA_COMMAND_UNCORK_PLAYBACK_STREAM_AT,
+
     PA_COMMAND_MAX
 };
 
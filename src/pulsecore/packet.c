@@ -34,15 +34,41 @@
 
 typedef struct pa_packet {
     PA_REFCNT_DECLARE;
-    enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC } type;
+    enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC, PA_PACKET_BUFFER } type;
     size_t length;
     uint8_t *data;
     union {
         uint8_t appended[MAX_APPENDED_SIZE];
+        size_t allocated;
     } per_type;
 } pa_packet;
 
 PA_STATIC_FLIST_DECLARE(packets, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers, 0, pa_xfree);
+
+uint8_t *pa_packet_buffer_new(size_t length, size_t *allocated) {
+    uint8_t *b;
+
+    pa_assert(allocated);
+
+    if (length > PA_PACKET_BUFFER_SIZE) {
+        *allocated = length;
+        return pa_xmalloc(length);
+    }
+
+    if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(buffers))))
+        b = pa_xmalloc(PA_PACKET_BUFFER_SIZE);
+
+    *allocated = PA_PACKET_BUFFER_SIZE;
+    return b;
+}
+
+void pa_packet_buffer_free(uint8_t *b, size_t allocated) {
+    pa_assert(b);
+
+    if (allocated != PA_PACKET_BUFFER_SIZE || pa_flist_push(PA_STATIC_FLIST_GET(buffers), b) < 0)
+        pa_xfree(b);
+}
 
 pa_packet* pa_packet_new(size_t length) {
     pa_packet *p;
@@ -91,6 +117,24 @@ pa_packet* pa_packet_new_dynamic(void* data, size_t length) {
     return p;
 }
 
+pa_packet* pa_packet_new_buffer(uint8_t *b, size_t allocated, size_t length) {
+    pa_packet *p;
+
+    pa_assert(b);
+    pa_assert(length > 0);
+    pa_assert(length <= allocated);
+
+    if (!(p = pa_flist_pop(PA_STATIC_FLIST_GET(packets))))
+        p = pa_xnew(pa_packet, 1);
+    PA_REFCNT_INIT(p);
+    p->length = length;
+    p->data = b;
+    p->per_type.allocated = allocated;
+    p->type = PA_PACKET_BUFFER;
+
+    return p;
+}
+
 const void* pa_packet_data(pa_packet *p, size_t *l) {
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
     pa_assert(p->data);
@@ -116,6 +160,8 @@ void pa_packet_unref(pa_packet *p) {
     if (PA_REFCNT_DEC(p) <= 0) {
         if (p->type == PA_PACKET_DYNAMIC)
             pa_xfree(p->data);
+        else if (p->type == PA_PACKET_BUFFER)
+            pa_packet_buffer_free(p->data, p->per_type.allocated);
         if (pa_flist_push(PA_STATIC_FLIST_GET(packets), p) < 0)
             pa_xfree(p);
     }
@@ -37,6 +37,18 @@ pa_packet* pa_packet_new_data(const void* data, size_t length);
  * i.e. memory is free()d with the packet */
 pa_packet* pa_packet_new_dynamic(void* data, size_t length);
 
+/* Buffers for building packet data in place. Buffers of up to
+ * PA_PACKET_BUFFER_SIZE bytes all have that size and are kept on a free
+ * list when released, larger ones are allocated as requested. *allocated
+ * is set to the real size of the buffer. */
+#define PA_PACKET_BUFFER_SIZE 4096
+uint8_t *pa_packet_buffer_new(size_t length, size_t *allocated);
+void pa_packet_buffer_free(uint8_t *b, size_t allocated);
+
+/* b must come from pa_packet_buffer_new(); the packet takes ownership of
+ * it and hands it back to the free list when it is freed */
+pa_packet* pa_packet_new_buffer(uint8_t *b, size_t allocated, size_t length);
+
 const void* pa_packet_data(pa_packet *p, size_t *l);
 
 pa_packet* pa_packet_ref(pa_packet *p);
@@ -0,0 +1,328 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/endianmacros.h>
+
+#include "pcm-codec.h"
+
+/* Encoded data: a header, then for each channel the Rice parameter in
+ * one byte followed by the residuals of all its samples, padded to a
+ * full byte.
+ *
+ *     uint8_t format, channels
+ *     uint32_t n_frames, big endian
+ *
+ * A residual u is coded as u >> k zero bits, a one bit and the k lower
+ * bits of u. Quotients of MAX_QUOTIENT or more are escaped by
+ * MAX_QUOTIENT zero bits followed by u in RESIDUAL_BITS bits. */
+
+#define HEADER_SIZE 6
+#define MAX_QUOTIENT 32
+
+/* The residual of the order two predictor, folded to unsigned, fits in
+ * 18 bits for 16 bit samples */
+#define RESIDUAL_BITS 18
+#define MAX_RICE_PARAMETER (RESIDUAL_BITS - 1)
+
+struct bit_writer {
+    uint8_t *data, *end;
+    uint64_t acc;
+    unsigned n_bits;
+    bool overflow;
+};
+
+struct bit_reader {
+    const uint8_t *data, *end;
+    uint64_t acc;
+    unsigned n_bits;
+};
+
+static void put_bits(struct bit_writer *w, uint32_t value, unsigned n) {
+    pa_assert(n <= 32);
+
+    w->acc = (w->acc << n) | (value & ((1ULL << n) - 1));
+    w->n_bits += n;
+
+    while (w->n_bits >= 8) {
+        if (w->data >= w->end) {
+            w->overflow = true;
+            w->n_bits = 0;
+            return;
+        }
+
+        w->n_bits -= 8;
+        *(w->data++) = (uint8_t) (w->acc >> w->n_bits);
+    }
+}
+
+static void flush_bits(struct bit_writer *w) {
+    if (w->n_bits > 0)
+        put_bits(w, 0, 8 - w->n_bits);
+}
+
+static int get_bits(struct bit_reader *r, unsigned n, uint32_t *value) {
+    pa_assert(n <= 32);
+
+    while (r->n_bits < n) {
+        if (r->data >= r->end)
+            return -1;
+
+        r->acc = (r->acc << 8) | *(r->data++);
+        r->n_bits += 8;
+    }
+
+    r->n_bits -= n;
+    *value = (uint32_t) (r->acc >> r->n_bits) & (uint32_t) ((1ULL << n) - 1);
+    return 0;
+}
+
+static void align_bits(struct bit_reader *r) {
+    r->n_bits -= r->n_bits % 8;
+}
+
+static inline int16_t read_sample(const uint8_t *p, pa_sample_format_t format) {
+    int16_t s;
+
+    memcpy(&s, p, sizeof(s));
+    return format == PA_SAMPLE_S16LE ? PA_INT16_FROM_LE(s) : PA_INT16_FROM_BE(s);
+}
+
+static inline void write_sample(uint8_t *p, pa_sample_format_t format, int32_t v) {
+    int16_t s = (int16_t) v;
+
+    s = format == PA_SAMPLE_S16LE ? PA_INT16_TO_LE(s) : PA_INT16_TO_BE(s);
+    memcpy(p, &s, sizeof(s));
+}
+
+static inline uint32_t fold(int32_t r) {
+    return ((uint32_t) r << 1) ^ (uint32_t) (r >> 31);
+}
+
+static inline int32_t unfold(uint32_t u) {
+    return (int32_t) (u >> 1) ^ -(int32_t) (u & 1);
+}
+
+/* Order two fixed predictor; samples before the start count as zero */
+#define PREDICT(x1, x2) (2 * (x1) - (x2))
+
+static unsigned rice_parameter(const uint8_t *src, size_t stride, unsigned n, pa_sample_format_t format) {
+    int32_t x1 = 0, x2 = 0;
+    uint64_t sum = 0;
+    unsigned i, k = 0;
+
+    for (i = 0; i < n; i++, src += stride) {
+        int32_t x = read_sample(src, format);
+
+        sum += fold(x - PREDICT(x1, x2));
+        x2 = x1;
+        x1 = x;
+    }
+
+    /* About log2 of the mean residual */
+    while (k < MAX_RICE_PARAMETER && ((uint64_t) n << (k + 1)) < sum)
+        k++;
+
+    return k;
+}
+
+bool pa_pcm_codec_supported(const pa_sample_spec *ss) {
+    pa_assert(ss);
+
+    return ss->format == PA_SAMPLE_S16LE || ss->format == PA_SAMPLE_S16BE;
+}
+
+int pa_pcm_codec_encode(pa_mempool *pool, const pa_sample_spec *ss, const pa_memchunk *chunk, pa_memchunk *encoded) {
+    struct bit_writer w;
+    size_t frame_size;
+    unsigned n_frames, c;
+    const uint8_t *src;
+    uint8_t *dst;
+
+    pa_assert(pool);
+    pa_assert(ss);
+    pa_assert(chunk);
+    pa_assert(encoded);
+    pa_assert(pa_pcm_codec_supported(ss));
+
+    frame_size = pa_frame_size(ss);
+    n_frames = (unsigned) (chunk->length / frame_size);
+
+    if (n_frames == 0 || chunk->length % frame_size != 0 || chunk->length <= HEADER_SIZE + ss->channels)
+        return -1;
+
+    encoded->memblock = pa_memblock_new(pool, chunk->length);
+    encoded->index = 0;
+
+    src = (const uint8_t *) pa_memblock_acquire(chunk->memblock) + chunk->index;
+    dst = pa_memblock_acquire(encoded->memblock);
+
+    dst[0] = (uint8_t) ss->format;
+    dst[1] = ss->channels;
+    dst[2] = (uint8_t) (n_frames >> 24);
+    dst[3] = (uint8_t) (n_frames >> 16);
+    dst[4] = (uint8_t) (n_frames >> 8);
+    dst[5] = (uint8_t) n_frames;
+
+    w.data = dst + HEADER_SIZE;
+    w.end = dst + chunk->length;
+    w.acc = 0;
+    w.n_bits = 0;
+    w.overflow = false;
+
+    for (c = 0; c < ss->channels && !w.overflow; c++) {
+        const uint8_t *p = src + c * sizeof(int16_t);
+        int32_t x1 = 0, x2 = 0;
+        unsigned i, k;
+
+        k = rice_parameter(p, frame_size, n_frames, ss->format);
+        put_bits(&w, k, 8);
+
+        for (i = 0; i < n_frames && !w.overflow; i++, p += frame_size) {
+            int32_t x = read_sample(p, ss->format);
+            uint32_t u = fold(x - PREDICT(x1, x2)), q = u >> k;
+
+            if (q < MAX_QUOTIENT) {
+                put_bits(&w, 1, q + 1);
+                put_bits(&w, u, k);
+            } else {
+                put_bits(&w, 0, MAX_QUOTIENT);
+                put_bits(&w, u, RESIDUAL_BITS);
+            }
+
+            x2 = x1;
+            x1 = x;
+        }
+
+        flush_bits(&w);
+    }
+
+    encoded->length = (size_t) (w.data - dst);
+
+    pa_memblock_release(encoded->memblock);
+    pa_memblock_release(chunk->memblock);
+
+    if (w.overflow || encoded->length >= chunk->length) {
+        pa_memblock_unref(encoded->memblock);
+        pa_memchunk_reset(encoded);
+        return -1;
+    }
+
+    return 0;
+}
+
+pa_memblock *pa_pcm_codec_decode(pa_mempool *pool, const void *data, size_t length) {
+    pa_sample_spec ss;
+    const uint8_t *src = data;
+    struct bit_reader r;
+    pa_memblock *b;
+    size_t frame_size;
+    unsigned n_frames, c;
+    uint8_t *dst;
+
+    pa_assert(pool);
+    pa_assert(data);
+
+    if (length < HEADER_SIZE)
+        return NULL;
+
+    ss.format = (pa_sample_format_t) src[0];
+    ss.channels = src[1];
+    ss.rate = 44100;
+    n_frames = ((unsigned) src[2] << 24) | ((unsigned) src[3] << 16) | ((unsigned) src[4] << 8) | src[5];
+
+    if (!pa_sample_spec_valid(&ss) || !pa_pcm_codec_supported(&ss) || n_frames == 0)
+        return NULL;
+
+    frame_size = pa_frame_size(&ss);
+
+    /* Every residual takes at least one bit */
+    if (n_frames > (length - HEADER_SIZE) * 8 / ss.channels)
+        return NULL;
+
+    b = pa_memblock_new(pool, n_frames * frame_size);
+    dst = pa_memblock_acquire(b);
+
+    r.data = src + HEADER_SIZE;
+    r.end = src + length;
+    r.acc = 0;
+    r.n_bits = 0;
+
+    for (c = 0; c < ss.channels; c++) {
+        uint8_t *p = dst + c * sizeof(int16_t);
+        int32_t x1 = 0, x2 = 0;
+        uint32_t k;
+        unsigned i;
+
+        if (get_bits(&r, 8, &k) < 0 || k > MAX_RICE_PARAMETER)
+            goto fail;
+
+        for (i = 0; i < n_frames; i++, p += frame_size) {
+            uint32_t q = 0, bit, u;
+            int32_t x;
+
+            for (;;) {
+                if (get_bits(&r, 1, &bit) < 0)
+                    goto fail;
+
+                if (bit)
+                    break;
+
+                if (++q >= MAX_QUOTIENT)
+                    break;
+            }
+
+            if (q >= MAX_QUOTIENT) {
+                if (get_bits(&r, RESIDUAL_BITS, &u) < 0)
+                    goto fail;
+            } else {
+                uint32_t low;
+
+                if (get_bits(&r, k, &low) < 0)
+                    goto fail;
+
+                u = (q << k) | low;
+            }
+
+            x = unfold(u) + PREDICT(x1, x2);
+
+            if (x < INT16_MIN || x > INT16_MAX)
+                goto fail;
+
+            write_sample(p, ss.format, x);
+
+            x2 = x1;
+            x1 = x;
+        }
+
+        align_bits(&r);
+    }
+
+    pa_memblock_release(b);
+    return b;
+
+fail:
+    pa_memblock_release(b);
+    pa_memblock_unref(b);
+    return NULL;
+}
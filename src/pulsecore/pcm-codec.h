@@ -0,0 +1,42 @@
+#ifndef foopcmcodechfoo
+#define foopcmcodechfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/memblock.h>
+#include <pulsecore/memchunk.h>
+
+/* A lossless codec for 16 bit PCM, in the manner of FLAC's fixed
+ * predictors: each channel is predicted from its previous two samples,
+ * and the residuals are Rice coded. Every memblock is coded on its own,
+ * so the codec adds no latency beyond the time it takes to run. The
+ * encoded data carries its sample format and channel count. */
+
+bool pa_pcm_codec_supported(const pa_sample_spec *ss);
+
+/* Encodes chunk into a new memblock from pool. Returns a negative value
+ * if the data would not get smaller. */
+int pa_pcm_codec_encode(pa_mempool *pool, const pa_sample_spec *ss, const pa_memchunk *chunk, pa_memchunk *encoded);
+
+/* Returns a new memblock from pool with the decoded data, or NULL if
+ * the data is invalid. */
+pa_memblock *pa_pcm_codec_decode(pa_mempool *pool, const void *data, size_t length);
+
+#endif
@@ -37,13 +37,12 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/hashmap.h>
 
 #include "pdispatch.h"
 
 /* #define DEBUG_OPCODES */
 
-#ifdef DEBUG_OPCODES
-
 static const char *command_names[PA_COMMAND_MAX] = {
     /* Generic commands */
     [PA_COMMAND_ERROR] = "ERROR",
@@ -195,9 +194,30 @@ static const char *command_names[PA_COMMAND_MAX] = {
     /* BOTH DIRECTIONS */
     [PA_COMMAND_ENABLE_SRBCHANNEL] = "ENABLE_SRBCHANNEL",
     [PA_COMMAND_DISABLE_SRBCHANNEL] = "DISABLE_SRBCHANNEL",
-};
 
-#endif
+    /* Supported since protocol v33 (7.0) */
+    [PA_COMMAND_ENABLE_STREAM_SRBCHANNEL] = "ENABLE_STREAM_SRBCHANNEL",
+    [PA_COMMAND_START_STREAM_SRBCHANNEL] = "START_STREAM_SRBCHANNEL",
+
+    /* Supported since protocol v34 (7.0) */
+    [PA_COMMAND_GET_SINK_INPUT_INFO_LIST_MASKED] = "GET_SINK_INPUT_INFO_LIST_MASKED",
+
+    /* Supported since protocol v37 (7.0) */
+    [PA_COMMAND_GET_SINK_IO_TRACE] = "GET_SINK_IO_TRACE",
+    [PA_COMMAND_GET_SOURCE_IO_TRACE] = "GET_SOURCE_IO_TRACE",
+
+    /* Supported since protocol v38 (7.0) */
+    [PA_COMMAND_ENABLE_STREAM_TIMING_PAGE] = "ENABLE_STREAM_TIMING_PAGE",
+
+    /* Supported since protocol v41 (7.0) */
+    [PA_COMMAND_GET_METRICS] = "GET_METRICS",
+
+    /* Supported since protocol v42 (7.0) */
+    [PA_COMMAND_REGISTER_MEMFD_SHMID] = "REGISTER_MEMFD_SHMID",
+
+    /* Supported since protocol v43 (7.0) */
+    [PA_COMMAND_UNCORK_PLAYBACK_STREAM_AT] = "UNCORK_PLAYBACK_STREAM_AT",
+};
 
 PA_STATIC_FLIST_DECLARE(reply_infos, 0, pa_xfree);
 
@@ -217,10 +237,12 @@ struct pa_pdispatch {
     const pa_pdispatch_cb_t *callback_table;
     unsigned n_commands;
     PA_LLIST_HEAD(struct reply_info, replies);
+    pa_hashmap *replies_by_tag;
     pa_pdispatch_drain_cb_t drain_callback;
     void *drain_userdata;
     const pa_cmsg_ancil_data *ancil_data;
     bool use_rtclock;
+    pa_pdispatch_stats *stats;
 };
 
 static void reply_info_free(struct reply_info *r) {
@@ -233,6 +255,9 @@ static void reply_info_free(struct reply_info *r) {
 
     PA_LLIST_REMOVE(struct reply_info, r->pdispatch->replies, r);
 
+    if (pa_hashmap_get(r->pdispatch->replies_by_tag, PA_UINT32_TO_PTR(r->tag)) == r)
+        pa_hashmap_remove(r->pdispatch->replies_by_tag, PA_UINT32_TO_PTR(r->tag));
+
     if (pa_flist_push(PA_STATIC_FLIST_GET(reply_infos), r) < 0)
         pa_xfree(r);
 }
@@ -249,6 +274,7 @@ pa_pdispatch* pa_pdispatch_new(pa_mainloop_api *mainloop, bool use_rtclock, cons
     pd->callback_table = table;
     pd->n_commands = entries;
     PA_LLIST_HEAD_INIT(struct reply_info, pd->replies);
+    pd->replies_by_tag = pa_hashmap_new(NULL, NULL);
     pd->use_rtclock = use_rtclock;
 
     return pd;
@@ -264,6 +290,7 @@ static void pdispatch_free(pa_pdispatch *pd) {
         reply_info_free(pd->replies);
     }
 
+    pa_hashmap_free(pd->replies_by_tag);
     pa_xfree(pd);
 }
 
@@ -289,6 +316,20 @@ static void run_action(pa_pdispatch *pd, struct reply_info *r, uint32_t command,
     pa_pdispatch_unref(pd);
 }
 
+static void stats_add(pa_pdispatch_stats *stats, uint32_t command, pa_usec_t usec) {
+    unsigned bucket = 0;
+
+    stats->n_calls[command]++;
+    stats->usec[command] += usec;
+
+    while (usec && bucket < PA_PDISPATCH_TIMING_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+
+    stats->histogram[command][bucket]++;
+}
+
 int pa_pdispatch_run(pa_pdispatch *pd, pa_packet *packet, const pa_cmsg_ancil_data *ancil_data, void *userdata) {
     uint32_t tag, command;
     pa_tagstruct *ts = NULL;
@@ -329,17 +370,21 @@ int pa_pdispatch_run(pa_pdispatch *pd, pa_packet *packet, const pa_cmsg_ancil_da
     if (command == PA_COMMAND_ERROR || command == PA_COMMAND_REPLY) {
         struct reply_info *r;
 
-        PA_LLIST_FOREACH(r, pd->replies)
-            if (r->tag == tag)
-                break;
-
-        if (r)
+        if ((r = pa_hashmap_get(pd->replies_by_tag, PA_UINT32_TO_PTR(tag))))
             run_action(pd, r, command, ts);
 
     } else if (pd->callback_table && (command < pd->n_commands) && pd->callback_table[command]) {
         const pa_pdispatch_cb_t *cb = pd->callback_table+command;
+        pa_usec_t start = 0;
+
+        if (pd->stats)
+            start = pa_rtclock_now();
 
         (*cb)(pd, command, tag, ts, userdata);
+
+        /* The callback may have taken the stats away */
+        if (pd->stats && command < PA_COMMAND_MAX)
+            stats_add(pd->stats, command, pa_rtclock_now() - start);
     } else {
         pa_log("Received unsupported command %u", command);
         goto finish;
@@ -392,6 +437,10 @@ void pa_pdispatch_register_reply(pa_pdispatch *pd, uint32_t tag, int timeout, pa
                                                         timeout_callback, r));
 
     PA_LLIST_PREPEND(struct reply_info, pd->replies, r);
+
+    /* Tags are unique per sender. Should one come twice, the first
+     * reply goes to the older slot, the newer one only times out. */
+    pa_hashmap_put(pd->replies_by_tag, PA_UINT32_TO_PTR(tag), r);
 }
 
 int pa_pdispatch_is_pending(pa_pdispatch *pd) {
@@ -421,6 +470,20 @@ void pa_pdispatch_unregister_reply(pa_pdispatch *pd, void *userdata) {
             reply_info_free(r);
 }
 
+void pa_pdispatch_set_stats(pa_pdispatch *pd, pa_pdispatch_stats *stats) {
+    pa_assert(pd);
+    pa_assert(PA_REFCNT_VALUE(pd) >= 1);
+
+    pd->stats = stats;
+}
+
+const char *pa_pdispatch_command_name(uint32_t command) {
+    if (command >= PA_COMMAND_MAX)
+        return NULL;
+
+    return command_names[command];
+}
+
 void pa_pdispatch_unref(pa_pdispatch *pd) {
     pa_assert(pd);
     pa_assert(PA_REFCNT_VALUE(pd) >= 1);
@@ -29,9 +29,21 @@
 #include <pulsecore/tagstruct.h>
 #include <pulsecore/packet.h>
 #include <pulsecore/creds.h>
+#include <pulsecore/native-common.h>
 
 typedef struct pa_pdispatch pa_pdispatch;
 
+#define PA_PDISPATCH_TIMING_BUCKETS 16
+
+/* How long the command callbacks took. Bucket n of a histogram counts
+ * the calls that took less than 2^n usec, the last one all longer
+ * calls. */
+typedef struct pa_pdispatch_stats {
+    uint64_t n_calls[PA_COMMAND_MAX];
+    pa_usec_t usec[PA_COMMAND_MAX];
+    uint32_t histogram[PA_COMMAND_MAX][PA_PDISPATCH_TIMING_BUCKETS];
+} pa_pdispatch_stats;
+
 typedef void (*pa_pdispatch_cb_t)(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 typedef void (*pa_pdispatch_drain_cb_t)(pa_pdispatch *pd, void *userdata);
 
@@ -50,6 +62,14 @@ void pa_pdispatch_set_drain_callback(pa_pdispatch *pd, pa_pdispatch_drain_cb_t c
 /* Remove all reply slots with the give userdata parameter */
 void pa_pdispatch_unregister_reply(pa_pdispatch *pd, void *userdata);
 
+/* Record the time spent in the command callbacks in stats, or stop
+ * recording if stats is NULL. stats may be shared between several
+ * pa_pdispatch objects of the same thread. */
+void pa_pdispatch_set_stats(pa_pdispatch *pd, pa_pdispatch_stats *stats);
+
+/* Returns the command's name, NULL if it is unknown */
+const char *pa_pdispatch_command_name(uint32_t command);
+
 const pa_creds * pa_pdispatch_creds(pa_pdispatch *pd);
 
 const int * pa_pdispatch_fds(pa_pdispatch *pd, int *nfd);
@@ -51,6 +51,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/shared.h>
+#include <pulsecore/source-fanout.h>
 #include <pulsecore/endianmacros.h>
 
 #include "protocol-esound.h"
@@ -93,8 +94,8 @@ typedef struct connection {
     esd_proto_t request;
     esd_client_state_t state;
     pa_sink_input *sink_input;
-    pa_source_output *source_output;
-    pa_memblockq *input_memblockq, *output_memblockq;
+    pa_source_fanout_reader *record;
+    pa_memblockq *input_memblockq;
     pa_defer_event *defer_event;
 
     char *original_name;
@@ -133,7 +134,6 @@ enum {
 
 enum {
     CONNECTION_MESSAGE_REQUEST_DATA,
-    CONNECTION_MESSAGE_POST_DATA,
     CONNECTION_MESSAGE_UNLINK_CONNECTION
 };
 
@@ -148,10 +148,9 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_kill_cb(pa_sink_input *i);
 static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk);
-static pa_usec_t source_output_get_latency_cb(pa_source_output *o);
 
-static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk);
-static void source_output_kill_cb(pa_source_output *o);
+static void record_data_cb(pa_source_fanout_reader *r, void *userdata);
+static void record_kill_cb(pa_source_fanout_reader *r, void *userdata);
 
 static int esd_proto_connect(connection *c, esd_proto_t request, const void *data, size_t length);
 static int esd_proto_stream_play(connection *c, esd_proto_t request, const void *data, size_t length);
@@ -219,10 +218,9 @@ static void connection_unlink(connection *c) {
         c->sink_input = NULL;
     }
 
-    if (c->source_output) {
-        pa_source_output_unlink(c->source_output);
-        pa_source_output_unref(c->source_output);
-        c->source_output = NULL;
+    if (c->record) {
+        pa_source_fanout_reader_free(c->record);
+        c->record = NULL;
     }
 
     if (c->client) {
@@ -259,8 +257,6 @@ static void connection_free(pa_object *obj) {
 
     if (c->input_memblockq)
         pa_memblockq_free(c->input_memblockq);
-    if (c->output_memblockq)
-        pa_memblockq_free(c->output_memblockq);
 
     if (c->playback.current_memblock)
         pa_memblock_unref(c->playback.current_memblock);
@@ -472,7 +468,6 @@ static int esd_proto_stream_record(connection *c, esd_proto_t request, const voi
     pa_source *source = NULL;
     pa_sample_spec ss;
     size_t l;
-    pa_source_output_new_data sdata;
 
     connection_assert_ref(c);
     pa_assert(data);
@@ -516,47 +511,36 @@ static int esd_proto_stream_record(connection *c, esd_proto_t request, const voi
 
     c->original_name = pa_xstrdup(name);
 
-    pa_assert(!c->output_memblockq && !c->source_output);
+    pa_assert(!c->record);
 
-    pa_source_output_new_data_init(&sdata);
-    sdata.driver = __FILE__;
-    sdata.module = c->options->module;
-    sdata.client = c->client;
-    if (source)
-        pa_source_output_new_data_set_source(&sdata, source, false);
-    pa_source_output_new_data_set_sample_spec(&sdata, &ss);
+    if (!source)
+        source = pa_namereg_get(c->protocol->core, NULL, PA_NAMEREG_SOURCE);
+    CHECK_VALIDITY(source, "No such source.");
 
-    pa_source_output_new(&c->source_output, c->protocol->core, &sdata);
-    pa_source_output_new_data_done(&sdata);
+    /* All connections of this module recording the same source in the
+     * same format share the source output */
+    c->record = pa_source_fanout_reader_new(
+            c->protocol->core,
+            c->options->module,
+            source,
+            &ss,
+            NULL,
+            "EsounD record stream",
+            DEFAULT_SOURCE_LATENCY,
+            RECORD_BUFFER_SECONDS * PA_USEC_PER_SEC,
+            record_data_cb,
+            record_kill_cb,
+            c);
 
-    CHECK_VALIDITY(c->source_output, "Failed to create source output.");
+    CHECK_VALIDITY(c->record, "Failed to create source output.");
 
     l = (size_t) (pa_bytes_per_second(&ss)*RECORD_BUFFER_SECONDS);
-    c->output_memblockq = pa_memblockq_new(
-            "esound protocol connection output_memblockq",
-            0,
-            l,
-            l,
-            &ss,
-            1,
-            0,
-            0,
-            NULL);
     pa_iochannel_socket_set_sndbuf(c->io, l);
 
-    c->source_output->push = source_output_push_cb;
-    c->source_output->kill = source_output_kill_cb;
-    c->source_output->get_latency = source_output_get_latency_cb;
-    c->source_output->userdata = c;
-
-    pa_source_output_set_requested_latency(c->source_output, DEFAULT_SOURCE_LATENCY);
-
     c->state = ESD_STREAMING_DATA;
 
     c->protocol->n_player++;
 
-    pa_source_output_put(c->source_output);
-
     return 0;
 }
 
@@ -1204,12 +1188,12 @@ static int do_write(connection *c) {
 
         return 1;
 
-    } else if (c->state == ESD_STREAMING_DATA && c->source_output) {
+    } else if (c->state == ESD_STREAMING_DATA && c->record) {
         pa_memchunk chunk;
         ssize_t r;
         void *p;
 
-        if (pa_memblockq_peek(c->output_memblockq, &chunk) < 0)
+        if (pa_memblockq_peek(pa_source_fanout_reader_get_memblockq(c->record), &chunk) < 0)
             return 0;
 
         pa_assert(chunk.memblock);
@@ -1226,7 +1210,7 @@ static int do_write(connection *c) {
             return -1;
         }
 
-        pa_memblockq_drop(c->output_memblockq, (size_t) r);
+        pa_memblockq_drop(pa_source_fanout_reader_get_memblockq(c->record), (size_t) r);
         return 1;
     }
 
@@ -1304,12 +1288,6 @@ static int connection_process_msg(pa_msgobject *o, int code, void*userdata, int6
             do_work(c);
             break;
 
-        case CONNECTION_MESSAGE_POST_DATA:
-/*             pa_log("got data %u", chunk->length); */
-            pa_memblockq_push_align(c->output_memblockq, chunk);
-            do_work(c);
-            break;
-
         case CONNECTION_MESSAGE_UNLINK_CONNECTION:
             connection_unlink(c);
             break;
@@ -1431,34 +1409,14 @@ static void sink_input_kill_cb(pa_sink_input *i) {
     connection_unlink(CONNECTION(i->userdata));
 }
 
-/*** source_output callbacks ***/
-
-/* Called from thread context */
-static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
-    connection *c;
-
-    pa_source_output_assert_ref(o);
-    c = CONNECTION(o->userdata);
-    pa_assert(c);
-    pa_assert(chunk);
-
-    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
-}
-
-static void source_output_kill_cb(pa_source_output *o) {
-    pa_source_output_assert_ref(o);
+/*** record callbacks ***/
 
-    connection_unlink(CONNECTION(o->userdata));
+static void record_data_cb(pa_source_fanout_reader *r, void *userdata) {
+    do_work(CONNECTION(userdata));
 }
 
-static pa_usec_t source_output_get_latency_cb(pa_source_output *o) {
-    connection*c;
-
-    pa_source_output_assert_ref(o);
-    c = CONNECTION(o->userdata);
-    pa_assert(c);
-
-    return pa_bytes_to_usec(pa_memblockq_get_length(c->output_memblockq), &c->source_output->sample_spec);
+static void record_kill_cb(pa_source_fanout_reader *r, void *userdata) {
+    connection_unlink(CONNECTION(userdata));
 }
 
 /*** entry points ***/
@@ -1530,8 +1488,7 @@ void pa_esound_protocol_connect(pa_esound_protocol *p, pa_iochannel *io, pa_esou
     c->sink_input = NULL;
     c->input_memblockq = NULL;
 
-    c->source_output = NULL;
-    c->output_memblockq = NULL;
+    c->record = NULL;
 
     c->playback.current_memblock = NULL;
     c->playback.memblock_index = 0;
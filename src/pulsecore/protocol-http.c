@@ -38,8 +38,10 @@
 #include <pulsecore/namereg.h>
 #include <pulsecore/cli-text.h>
 #include <pulsecore/shared.h>
+#include <pulsecore/source-fanout.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/mime-type.h>
+#include <pulsecore/strbuf.h>
 
 #include "protocol-http.h"
 
@@ -51,10 +53,12 @@
 #define URL_STATUS "/status"
 #define URL_LISTEN "/listen"
 #define URL_LISTEN_SOURCE "/listen/source/"
+#define URL_METRICS "/metrics"
 
 #define MIME_HTML "text/html; charset=utf-8"
 #define MIME_TEXT "text/plain; charset=utf-8"
 #define MIME_CSS "text/css"
+#define MIME_METRICS "text/plain; version=0.0.4"
 
 #define HTML_HEADER(t)                                                  \
     "<?xml version=\"1.0\"?>\n"                                         \
@@ -70,7 +74,8 @@
     "        </body>\n"                                                 \
     "</html>\n"
 
-#define RECORD_BUFFER_SECONDS (5)
+/* How far a listener may fall behind before it loses its oldest data */
+#define LISTENER_QUEUE_SECONDS (2)
 #define DEFAULT_SOURCE_LATENCY (300*PA_USEC_PER_MSEC)
 
 enum state {
@@ -88,11 +93,11 @@ struct connection {
     pa_http_protocol *protocol;
     pa_iochannel *io;
     pa_ioline *line;
-    pa_memblockq *output_memblockq;
-    pa_source_output *source_output;
+    pa_source_fanout_reader *listen;
     pa_client *client;
     enum state state;
     char *url;
+    char *query;
     enum method method;
     pa_module *module;
 };
@@ -106,24 +111,18 @@ struct pa_http_protocol {
     pa_strlist *servers;
 };
 
-enum {
-    SOURCE_OUTPUT_MESSAGE_POST_DATA = PA_SOURCE_OUTPUT_MESSAGE_MAX
-};
-
 /* Called from main context */
 static void connection_unlink(struct connection *c) {
     pa_assert(c);
 
-    if (c->source_output) {
-        pa_source_output_unlink(c->source_output);
-        c->source_output->userdata = NULL;
-        pa_source_output_unref(c->source_output);
-    }
+    if (c->listen)
+        pa_source_fanout_reader_free(c->listen);
 
     if (c->client)
         pa_client_free(c->client);
 
     pa_xfree(c->url);
+    pa_xfree(c->query);
 
     if (c->line)
         pa_ioline_unref(c->line);
@@ -131,9 +130,6 @@ static void connection_unlink(struct connection *c) {
     if (c->io)
         pa_iochannel_free(c->io);
 
-    if (c->output_memblockq)
-        pa_memblockq_free(c->output_memblockq);
-
     pa_idxset_remove_by_data(c->protocol->connections, c, NULL);
 
     pa_xfree(c);
@@ -147,7 +143,7 @@ static int do_write(struct connection *c) {
 
     pa_assert(c);
 
-    if (pa_memblockq_peek(c->output_memblockq, &chunk) < 0)
+    if (pa_memblockq_peek(pa_source_fanout_reader_get_memblockq(c->listen), &chunk) < 0)
         return 0;
 
     pa_assert(chunk.memblock);
@@ -164,87 +160,45 @@ static int do_write(struct connection *c) {
         return -1;
     }
 
-    pa_memblockq_drop(c->output_memblockq, (size_t) r);
+    pa_memblockq_drop(pa_source_fanout_reader_get_memblockq(c->listen), (size_t) r);
 
     return 1;
 }
 
-/* Called from main context */
-static void do_work(struct connection *c) {
+/* Called from main context. Writes as much as the socket takes without
+ * blocking, the rest waits for the next IO event. */
+static int do_work(struct connection *c) {
     pa_assert(c);
 
+    /* Still sending the HTTP header */
+    if (!c->io)
+        return 0;
+
     if (pa_iochannel_is_hungup(c->io))
-        goto fail;
+        return -1;
 
     while (pa_iochannel_is_writable(c->io)) {
         int r = do_write(c);
         if (r < 0)
-            goto fail;
+            return -1;
         if (r == 0)
             break;
     }
 
-    return;
-
-fail:
-    connection_unlink(c);
-}
-
-/* Called from thread context, except when it is not */
-static int source_output_process_msg(pa_msgobject *m, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
-    pa_source_output *o = PA_SOURCE_OUTPUT(m);
-    struct connection *c;
-
-    pa_source_output_assert_ref(o);
-
-    if (!(c = o->userdata))
-        return -1;
-
-    switch (code) {
-
-        case SOURCE_OUTPUT_MESSAGE_POST_DATA:
-            /* While this function is usually called from IO thread
-             * context, this specific command is not! */
-            pa_memblockq_push_align(c->output_memblockq, chunk);
-            do_work(c);
-            break;
-
-        default:
-            return pa_source_output_process_msg(m, code, userdata, offset, chunk);
-    }
-
     return 0;
 }
 
-/* Called from thread context */
-static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
-    struct connection *c;
-
-    pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
-    pa_assert(chunk);
-
-    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(o), SOURCE_OUTPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
-}
-
 /* Called from main context */
-static void source_output_kill_cb(pa_source_output *o) {
-    struct connection*c;
-
-    pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
+static void listen_data_cb(pa_source_fanout_reader *r, void *userdata) {
+    struct connection *c = userdata;
 
-    connection_unlink(c);
+    if (do_work(c) < 0)
+        connection_unlink(c);
 }
 
 /* Called from main context */
-static pa_usec_t source_output_get_latency_cb(pa_source_output *o) {
-    struct connection*c;
-
-    pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
-
-    return pa_bytes_to_usec(pa_memblockq_get_length(c->output_memblockq), &c->source_output->sample_spec);
+static void listen_kill_cb(pa_source_fanout_reader *r, void *userdata) {
+    connection_unlink(userdata);
 }
 
 /*** client callbacks ***/
@@ -264,7 +218,8 @@ static void io_callback(pa_iochannel*io, void *userdata) {
     pa_assert(c);
     pa_assert(io);
 
-    do_work(c);
+    if (do_work(c) < 0)
+        connection_unlink(c);
 }
 
 static char *escape_html(const char *t) {
@@ -407,6 +362,7 @@ static void handle_root(struct connection *c) {
                    "</table>\n"
                    "<p><a href=\"" URL_STATUS "\">Show an extensive server status report</a></p>\n"
                    "<p><a href=\"" URL_LISTEN "\">Monitor sinks and sources</a></p>\n"
+                   "<p><a href=\"" URL_METRICS "\">Show the server's counters</a></p>\n"
                    HTML_FOOTER);
 
     pa_ioline_defer_close(c->line);
@@ -453,6 +409,29 @@ static void handle_status(struct connection *c) {
     pa_ioline_defer_close(c->line);
 }
 
+/* The core's counters, for Prometheus to scrape */
+static void handle_metrics(struct connection *c) {
+    pa_strbuf *buf;
+    char *r;
+
+    pa_assert(c);
+
+    http_response(c, 200, "OK", MIME_METRICS);
+
+    if (c->method == METHOD_HEAD) {
+        pa_ioline_defer_close(c->line);
+        return;
+    }
+
+    buf = pa_strbuf_new();
+    pa_metrics_dump(c->protocol->core->metrics, buf);
+    r = pa_strbuf_tostring_free(buf);
+    pa_ioline_puts(c->line, r);
+    pa_xfree(r);
+
+    pa_ioline_defer_close(c->line);
+}
+
 static void handle_listen(struct connection *c) {
     pa_source *source;
     pa_sink *sink;
@@ -477,8 +456,9 @@ static void handle_listen(struct connection *c) {
         m = pa_sample_spec_to_mime_type_mimefy(&sink->sample_spec, &sink->channel_map);
 
         pa_ioline_printf(c->line,
-                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a><br/>\n",
-                         sink->monitor_source->name, m, t);
+                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a> "
+                         "<a href=\"" URL_LISTEN_SOURCE "%s?" PA_HTTP_QUERY_ULAW "\" class=\"grey\">(mu-law)</a><br/>\n",
+                         sink->monitor_source->name, m, t, sink->monitor_source->name);
 
         pa_xfree(t);
         pa_xfree(m);
@@ -499,8 +479,9 @@ static void handle_listen(struct connection *c) {
         m = pa_sample_spec_to_mime_type_mimefy(&source->sample_spec, &source->channel_map);
 
         pa_ioline_printf(c->line,
-                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a><br/>\n",
-                         source->name, m, t);
+                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a> "
+                         "<a href=\"" URL_LISTEN_SOURCE "%s?" PA_HTTP_QUERY_ULAW "\" class=\"grey\">(mu-law)</a><br/>\n",
+                         source->name, m, t, source->name);
 
         pa_xfree(m);
         pa_xfree(t);
@@ -525,7 +506,7 @@ static void line_drain_callback(pa_ioline *l, void *userdata) {
     pa_assert_se(c->io = pa_ioline_detach_iochannel(c->line));
     pa_iochannel_set_callback(c->io, io_callback, c);
 
-    pa_iochannel_socket_set_sndbuf(c->io, pa_memblockq_get_length(c->output_memblockq));
+    pa_iochannel_socket_set_sndbuf(c->io, pa_memblockq_get_maxlength(pa_source_fanout_reader_get_memblockq(c->listen)));
 
     pa_ioline_unref(c->line);
     c->line = NULL;
@@ -533,11 +514,9 @@ static void line_drain_callback(pa_ioline *l, void *userdata) {
 
 static void handle_listen_prefix(struct connection *c, const char *source_name) {
     pa_source *source;
-    pa_source_output_new_data data;
     pa_sample_spec ss;
     pa_channel_map cm;
     char *t;
-    size_t l;
 
     pa_assert(c);
     pa_assert(source_name);
@@ -555,44 +534,38 @@ static void handle_listen_prefix(struct connection *c, const char *source_name)
 
     pa_sample_spec_mimefy(&ss, &cm);
 
-    pa_source_output_new_data_init(&data);
-    data.driver = __FILE__;
-    data.module = c->module;
-    data.client = c->client;
-    pa_source_output_new_data_set_source(&data, source, false);
-    pa_proplist_update(data.proplist, PA_UPDATE_MERGE, c->client->proplist);
-    pa_source_output_new_data_set_sample_spec(&data, &ss);
-    pa_source_output_new_data_set_channel_map(&data, &cm);
-
-    pa_source_output_new(&c->source_output, c->protocol->core, &data);
-    pa_source_output_new_data_done(&data);
+    /* Telephone quality for slow links, 64 kbit/s of mu-law */
+    if (c->query && pa_streq(c->query, PA_HTTP_QUERY_ULAW)) {
+        ss.format = PA_SAMPLE_ULAW;
+        ss.rate = 8000;
+        ss.channels = 1;
+        pa_channel_map_init_mono(&cm);
+    }
 
-    if (!c->source_output) {
+    /* All listeners of a source that want the same format share a
+     * single source output */
+    c->listen = pa_source_fanout_reader_new(
+            c->protocol->core,
+            c->module,
+            source,
+            &ss,
+            &cm,
+            "HTTP listeners",
+            DEFAULT_SOURCE_LATENCY,
+            LISTENER_QUEUE_SECONDS * PA_USEC_PER_SEC,
+            listen_data_cb,
+            listen_kill_cb,
+            c);
+
+    if (!c->listen) {
         html_response(c, 403, "Cannot create source output", NULL);
         return;
     }
 
-    c->source_output->parent.process_msg = source_output_process_msg;
-    c->source_output->push = source_output_push_cb;
-    c->source_output->kill = source_output_kill_cb;
-    c->source_output->get_latency = source_output_get_latency_cb;
-    c->source_output->userdata = c;
-
-    pa_source_output_set_requested_latency(c->source_output, DEFAULT_SOURCE_LATENCY);
-
-    l = (size_t) (pa_bytes_per_second(&ss)*RECORD_BUFFER_SECONDS);
-    c->output_memblockq = pa_memblockq_new(
-            "http protocol connection output_memblockq",
-            0,
-            l,
-            0,
-            &ss,
-            1,
-            0,
-            0,
-            NULL);
-
-    pa_source_output_put(c->source_output);
+    /* A listener that joins a running source output gets what it was
+     * actually created with */
+    ss = *pa_source_fanout_reader_get_sample_spec(c->listen);
+    cm = *pa_source_fanout_reader_get_channel_map(c->listen);
 
     t = pa_sample_spec_to_mime_type(&ss, &cm);
     http_response(c, 200, "OK", t);
@@ -623,6 +596,8 @@ static void handle_url(struct connection *c) {
         handle_status(c);
     else if (pa_streq(c->url, URL_LISTEN))
         handle_listen(c);
+    else if (pa_streq(c->url, URL_METRICS))
+        handle_metrics(c);
     else if (pa_startswith(c->url, URL_LISTEN_SOURCE))
         handle_listen_prefix(c, c->url + sizeof(URL_LISTEN_SOURCE)-1);
     else
@@ -653,6 +628,9 @@ static void line_callback(pa_ioline *line, const char *s, void *userdata) {
             }
 
             c->url = pa_xstrndup(s, strcspn(s, " \r\n\t?"));
+            s += strlen(c->url);
+            if (*s == '?')
+                c->query = pa_xstrndup(s + 1, strcspn(s + 1, " \r\n\t"));
             c->state = STATE_MIME_HEADER;
             break;
         }
@@ -28,6 +28,9 @@
 
 typedef struct pa_http_protocol pa_http_protocol;
 
+/* Appended to a listen URL, asks for the source as 8 kHz mono mu-law */
+#define PA_HTTP_QUERY_ULAW "encoding=ulaw"
+
 pa_http_protocol* pa_http_protocol_get(pa_core *core);
 pa_http_protocol* pa_http_protocol_ref(pa_http_protocol *p);
 void pa_http_protocol_unref(pa_http_protocol *p);
@@ -34,6 +34,7 @@
 #include <pulse/util.h>
 #include <pulse/xmalloc.h>
 #include <pulse/internal.h>
+#include <pulse/introspect.h>
 
 #include <pulsecore/native-common.h>
 #include <pulsecore/packet.h>
@@ -41,6 +42,7 @@
 #include <pulsecore/source-output.h>
 #include <pulsecore/sink-input.h>
 #include <pulsecore/pstream.h>
+#include <pulsecore/pcm-codec.h>
 #include <pulsecore/tagstruct.h>
 #include <pulsecore/pdispatch.h>
 #include <pulsecore/pstream-util.h>
@@ -51,10 +53,14 @@
 #include <pulsecore/strlist.h>
 #include <pulsecore/shared.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/cpu-autotune.h>
 #include <pulsecore/creds.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/ipacl.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/asyncq.h>
+#include <pulsecore/flist.h>
+#include <pulsecore/timing-page.h>
 
 #include "protocol-native.h"
 
@@ -67,10 +73,17 @@
 #define MAX_CONNECTIONS 64
 
 #define MAX_MEMBLOCKQ_LENGTH (4*1024*1024) /* 4MB */
+#define CONNECTION_MEMPOOL_SIZE (1024*1024) /* 1MB, the srbchannels of a connection */
 #define DEFAULT_TLENGTH_MSEC 2000 /* 2s */
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
 #define DEFAULT_FRAGSIZE_MSEC DEFAULT_TLENGTH_MSEC
 
+/* Recorded chunks the IO thread may queue before the main loop picks
+ * them up */
+#define RECORD_CHUNK_QUEUE_SIZE 256
+
+PA_STATIC_FLIST_DECLARE(record_chunks, 0, pa_xfree);
+
 struct pa_native_protocol;
 
 typedef struct record_stream {
@@ -98,6 +111,30 @@ typedef struct record_stream {
     size_t on_the_fly_snapshot;
     pa_usec_t current_monitor_latency;
     pa_usec_t current_source_latency;
+
+    /* Shared ringbuffer the client asked for with
+     * PA_COMMAND_ENABLE_STREAM_SRBCHANNEL. Once started, the source
+     * output writes into it directly from the IO thread. The reply to
+     * PA_COMMAND_START_STREAM_SRBCHANNEL is held back until the data
+     * queued before is sent, so that the client gets it in order.
+     * What doesn't fit into the ringbuffer waits in srbchannel_memblockq,
+     * which is owned by the IO thread and limited to maxlength like
+     * memblockq. */
+    pa_srbchannel *srbchannel;
+    pa_srbchannel *srbchannel_thread;
+    pa_memblockq *srbchannel_memblockq;
+    size_t srbchannel_size;
+    bool srbchannel_start_pending:1;
+    bool srbchannel_started:1;
+    uint32_t srbchannel_start_tag;
+
+    /* The IO thread queues recorded chunks here and only posts
+     * RECORD_STREAM_MESSAGE_POST_DATA if the main loop has not been
+     * told about the queue yet, so that it is woken up once per batch
+     * instead of once per chunk. NULL if the queue couldn't be
+     * created, in which case every chunk is posted. */
+    pa_asyncq *chunk_queue;
+    pa_atomic_t chunk_queue_posted;
 } record_stream;
 
 #define RECORD_STREAM(o) (record_stream_cast(o))
@@ -143,9 +180,18 @@ typedef struct playback_stream {
     size_t render_memblockq_length;
     pa_usec_t current_sink_latency;
     uint64_t playing_for, underrun_for;
+
+    /* The shared timing page, if the client asked for one. The memblock
+     * stays acquired for as long as the stream lives. */
+    pa_memblock *timing_page;
+    pa_timing_page *thread_timing_page;
+    pa_usec_t thread_timing_page_next;
 } playback_stream;
 
 #define PLAYBACK_STREAM(o) (playback_stream_cast(o))
+
+/* How often the IO thread updates the timing page while playing */
+#define TIMING_PAGE_INTERVAL_USEC (10*PA_USEC_PER_MSEC)
 PA_DEFINE_PRIVATE_CLASS(playback_stream, output_stream);
 
 typedef struct upload_stream {
@@ -178,8 +224,22 @@ struct pa_native_connection {
     pa_idxset *record_streams, *output_streams;
     uint32_t rrobin_index;
     pa_subscription *subscription;
+    /* What the client last saw of the sinks, sources, sink inputs and
+     * source outputs, indexed by facility. Only with subscription
+     * deltas, see PA_COMMAND_SUBSCRIBE in v35. */
+    pa_hashmap *subscription_deltas[PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT + 1];
+    bool subscription_deltas_enabled;
     pa_time_event *auth_timeout_event;
+    /* Command budget, see command_budget_charge() */
+    pa_usec_t command_tat;
+    pa_time_event *throttle_event;
+    /* Audio data exchanged with the client */
+    pa_metric *bytes_received, *bytes_sent;
     pa_srbchannel *srbpending;
+    bool srbchannel;
+    /* With memfd, the client's own pool for the srbchannels, sized
+     * and freed with the connection */
+    pa_mempool *rw_mempool;
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
@@ -195,10 +255,18 @@ struct pa_native_protocol {
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
     pa_hashmap *extensions;
+
+    pa_pdispatch_stats dispatch_stats;
+
+    /* Created when a command is first received */
+    pa_metric *command_metrics[PA_COMMAND_MAX];
 };
 
 enum {
-    SOURCE_OUTPUT_MESSAGE_UPDATE_LATENCY = PA_SOURCE_OUTPUT_MESSAGE_MAX
+    SOURCE_OUTPUT_MESSAGE_UPDATE_LATENCY = PA_SOURCE_OUTPUT_MESSAGE_MAX,
+    SOURCE_OUTPUT_MESSAGE_SET_SRBCHANNEL,
+    SOURCE_OUTPUT_MESSAGE_FLUSH_SRBCHANNEL,
+    SOURCE_OUTPUT_MESSAGE_UPDATE_BUFFER_ATTR
 };
 
 enum {
@@ -209,7 +277,9 @@ enum {
     SINK_INPUT_MESSAGE_SEEK,
     SINK_INPUT_MESSAGE_PREBUF_FORCE,
     SINK_INPUT_MESSAGE_UPDATE_LATENCY,
-    SINK_INPUT_MESSAGE_UPDATE_BUFFER_ATTR
+    SINK_INPUT_MESSAGE_UPDATE_BUFFER_ATTR,
+    SINK_INPUT_MESSAGE_SET_TIMING_PAGE,
+    SINK_INPUT_MESSAGE_UPDATE_TIMING_PAGE
 };
 
 enum {
@@ -222,7 +292,8 @@ enum {
 };
 
 enum {
-    RECORD_STREAM_MESSAGE_POST_DATA         /* data from source output to main loop */
+    RECORD_STREAM_MESSAGE_POST_DATA,        /* data from source output to main loop */
+    RECORD_STREAM_MESSAGE_SRBCHANNEL_STARTED /* source output writes into the srbchannel from now on */
 };
 
 enum {
@@ -230,6 +301,8 @@ enum {
     CONNECTION_MESSAGE_REVOKE
 };
 
+static void update_timing_page(playback_stream *s, bool force);
+
 static bool sink_input_process_underrun_cb(pa_sink_input *i);
 static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk);
 static void sink_input_kill_cb(pa_sink_input *i);
@@ -262,6 +335,8 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
 static void command_set_client_name(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_lookup(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_stat(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_get_metrics(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_get_io_trace(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_get_playback_latency(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_get_record_latency(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_create_upload_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
@@ -270,11 +345,13 @@ static void command_play_sample(pa_pdispatch *pd, uint32_t command, uint32_t tag
 static void command_remove_sample(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_get_sink_input_info_list_masked(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_set_volume(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_set_mute(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_cork_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_uncork_playback_stream_at(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_trigger_or_flush_or_prebuf_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_set_default_sink_or_source(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_set_stream_name(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
@@ -294,6 +371,10 @@ static void command_set_card_profile(pa_pdispatch *pd, uint32_t command, uint32_
 static void command_set_sink_or_source_port(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_set_port_latency_offset(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_register_memfd_shmid(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_enable_stream_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_start_stream_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_enable_stream_timing_page(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 
 static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_ERROR] = NULL,
@@ -311,6 +392,9 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_LOOKUP_SINK] = command_lookup,
     [PA_COMMAND_LOOKUP_SOURCE] = command_lookup,
     [PA_COMMAND_STAT] = command_stat,
+    [PA_COMMAND_GET_METRICS] = command_get_metrics,
+    [PA_COMMAND_GET_SINK_IO_TRACE] = command_get_io_trace,
+    [PA_COMMAND_GET_SOURCE_IO_TRACE] = command_get_io_trace,
     [PA_COMMAND_GET_PLAYBACK_LATENCY] = command_get_playback_latency,
     [PA_COMMAND_GET_RECORD_LATENCY] = command_get_record_latency,
     [PA_COMMAND_CREATE_UPLOAD_STREAM] = command_create_upload_stream,
@@ -334,6 +418,7 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_GET_SINK_INPUT_INFO_LIST] = command_get_info_list,
     [PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST] = command_get_info_list,
     [PA_COMMAND_GET_SAMPLE_INFO_LIST] = command_get_info_list,
+    [PA_COMMAND_GET_SINK_INPUT_INFO_LIST_MASKED] = command_get_sink_input_info_list_masked,
     [PA_COMMAND_GET_SERVER_INFO] = command_get_server_info,
     [PA_COMMAND_SUBSCRIBE] = command_subscribe,
 
@@ -398,6 +483,12 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_SET_PORT_LATENCY_OFFSET] = command_set_port_latency_offset,
 
     [PA_COMMAND_ENABLE_SRBCHANNEL] = command_enable_srbchannel,
+    [PA_COMMAND_ENABLE_STREAM_SRBCHANNEL] = command_enable_stream_srbchannel,
+    [PA_COMMAND_START_STREAM_SRBCHANNEL] = command_start_stream_srbchannel,
+    [PA_COMMAND_REGISTER_MEMFD_SHMID] = command_register_memfd_shmid,
+
+    [PA_COMMAND_UNCORK_PLAYBACK_STREAM_AT] = command_uncork_playback_stream_at,
+    [PA_COMMAND_ENABLE_STREAM_TIMING_PAGE] = command_enable_stream_timing_page,
 
     [PA_COMMAND_EXTENSION] = command_extension
 };
@@ -474,17 +565,57 @@ static void record_stream_unlink(record_stream *s) {
     if (!s->connection)
         return;
 
+    pa_pstream_set_codec(s->connection->pstream, s->index, NULL);
+
     if (s->source_output) {
         pa_source_output_unlink(s->source_output);
         pa_source_output_unref(s->source_output);
         s->source_output = NULL;
     }
 
+    /* The IO thread is done with it now */
+    if (s->srbchannel) {
+        pa_srbchannel_free(s->srbchannel);
+        s->srbchannel = s->srbchannel_thread = NULL;
+    }
+
+    if (s->srbchannel_memblockq) {
+        pa_memblockq_free(s->srbchannel_memblockq);
+        s->srbchannel_memblockq = NULL;
+    }
+
     pa_assert_se(pa_idxset_remove_by_data(s->connection->record_streams, s, NULL) == s);
     s->connection = NULL;
     record_stream_unref(s);
 }
 
+/* Called from main and thread context */
+static void record_chunk_free(void *p) {
+    pa_memchunk *c = p;
+
+    pa_memblock_unref(c->memblock);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(record_chunks), c) < 0)
+        pa_xfree(c);
+}
+
+/* Called from main context */
+static void record_stream_drain_queue(record_stream *s) {
+    pa_memchunk *c;
+
+    if (!s->chunk_queue)
+        return;
+
+    /* Reset first, so that chunks queued while we pop get posted again */
+    pa_atomic_store(&s->chunk_queue_posted, 0);
+
+    while ((c = pa_asyncq_pop(s->chunk_queue, false))) {
+        pa_atomic_sub(&s->on_the_fly, c->length);
+        pa_memblockq_push_align(s->memblockq, c);
+        record_chunk_free(c);
+    }
+}
+
 /* Called from main context */
 static void record_stream_free(pa_object *o) {
     record_stream *s = RECORD_STREAM(o);
@@ -492,10 +623,29 @@ static void record_stream_free(pa_object *o) {
 
     record_stream_unlink(s);
 
+    if (s->chunk_queue)
+        pa_asyncq_free(s->chunk_queue, record_chunk_free);
+
     pa_memblockq_free(s->memblockq);
     pa_xfree(s);
 }
 
+/* Called from main context */
+static void record_stream_check_srbchannel_started(record_stream *s) {
+    record_stream_assert_ref(s);
+
+    if (!s->srbchannel_start_pending || !s->srbchannel_started)
+        return;
+
+    if (pa_memblockq_get_length(s->memblockq) > 0)
+        return;
+
+    /* Everything from before the switch is on its way, so the client
+     * may start reading the ringbuffer */
+    pa_pstream_send_simple_ack(s->connection->pstream, s->srbchannel_start_tag);
+    s->srbchannel_start_pending = false;
+}
+
 /* Called from main context */
 static int record_stream_process_msg(pa_msgobject *o, int code, void*userdata, int64_t offset, pa_memchunk *chunk) {
     record_stream *s = RECORD_STREAM(o);
@@ -508,19 +658,31 @@ static int record_stream_process_msg(pa_msgobject *o, int code, void*userdata, i
 
         case RECORD_STREAM_MESSAGE_POST_DATA:
 
-            /* We try to keep up to date with how many bytes are
-             * currently on the fly */
-            pa_atomic_sub(&s->on_the_fly, chunk->length);
+            if (!chunk)
+                record_stream_drain_queue(s);
+            else {
+                /* We try to keep up to date with how many bytes are
+                 * currently on the fly */
+                pa_atomic_sub(&s->on_the_fly, chunk->length);
 
-            if (pa_memblockq_push_align(s->memblockq, chunk) < 0) {
-/*                 pa_log_warn("Failed to push data into output queue."); */
-                return -1;
+                if (pa_memblockq_push_align(s->memblockq, chunk) < 0) {
+/*                     pa_log_warn("Failed to push data into output queue."); */
+                    return -1;
+                }
             }
 
             if (!pa_pstream_is_pending(s->connection->pstream))
                 native_connection_send_memblock(s->connection);
 
             break;
+
+        case RECORD_STREAM_MESSAGE_SRBCHANNEL_STARTED:
+            /* Whatever was queued before the switch goes out first */
+            record_stream_drain_queue(s);
+
+            s->srbchannel_started = true;
+            record_stream_check_srbchannel_started(s);
+            break;
     }
 
     return 0;
@@ -635,6 +797,12 @@ static void fix_record_buffer_attr_post(record_stream *s) {
 
     if (s->buffer_attr.fragsize > s->buffer_attr.maxlength)
         s->buffer_attr.fragsize = s->buffer_attr.maxlength;
+
+    /* The same limit command_enable_stream_srbchannel() checks for */
+    if (s->srbchannel && s->buffer_attr.fragsize > s->srbchannel_size / 2) {
+        pa_log_debug("Fragment size of record stream %u limited by its ringbuffer.", s->index);
+        s->buffer_attr.fragsize = (uint32_t) ((s->srbchannel_size / 2 / base) * base);
+    }
 }
 
 /* Called from main context */
@@ -711,6 +879,8 @@ static record_stream* record_stream_new(
     s->adjust_latency = adjust_latency;
     s->early_requests = early_requests;
     pa_atomic_store(&s->on_the_fly, 0);
+    s->chunk_queue = pa_asyncq_new(RECORD_CHUNK_QUEUE_SIZE);
+    pa_atomic_store(&s->chunk_queue_posted, 0);
 
     s->source_output->parent.process_msg = source_output_process_msg;
     s->source_output->push = source_output_push_cb;
@@ -793,6 +963,11 @@ static void playback_stream_free(pa_object* o) {
 
     playback_stream_unlink(s);
 
+    if (s->timing_page) {
+        pa_memblock_release(s->timing_page);
+        pa_memblock_unref(s->timing_page);
+    }
+
     pa_memblockq_free(s->memblockq);
     pa_xfree(s);
 }
@@ -1316,6 +1491,24 @@ static int native_connection_process_msg(pa_msgobject *o, int code, void*userdat
 }
 
 /* Called from main context */
+/* The fields of an object carried by subscription deltas */
+struct subscription_delta {
+    pa_cvolume volume;
+    bool mute;
+    uint32_t state;
+    pa_usec_t latency;
+};
+
+static void subscription_deltas_free(pa_native_connection *c) {
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(c->subscription_deltas); i++)
+        if (c->subscription_deltas[i]) {
+            pa_hashmap_free(c->subscription_deltas[i]);
+            c->subscription_deltas[i] = NULL;
+        }
+}
+
 static void native_connection_unlink(pa_native_connection *c) {
     record_stream *r;
     output_stream *o;
@@ -1345,14 +1538,27 @@ static void native_connection_unlink(pa_native_connection *c) {
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
+    subscription_deltas_free(c);
+
     if (c->pstream)
         pa_pstream_unlink(c->pstream);
 
+    /* The pdispatch object may outlive the protocol */
+    pa_pdispatch_set_stats(c->pdispatch, NULL);
+
     if (c->auth_timeout_event) {
         c->protocol->core->mainloop->time_free(c->auth_timeout_event);
         c->auth_timeout_event = NULL;
     }
 
+    if (c->throttle_event) {
+        c->protocol->core->mainloop->time_free(c->throttle_event);
+        c->throttle_event = NULL;
+    }
+
+    pa_metric_free(c->bytes_received);
+    pa_metric_free(c->bytes_sent);
+
     pa_assert_se(pa_idxset_remove_by_data(c->protocol->connections, c, NULL) == c);
     c->protocol = NULL;
     pa_native_connection_unref(c);
@@ -1373,6 +1579,9 @@ static void native_connection_free(pa_object *o) {
     pa_pstream_unref(c->pstream);
     pa_client_free(c->client);
 
+    if (c->rw_mempool)
+        pa_mempool_free(c->rw_mempool);
+
     pa_xfree(c);
 }
 
@@ -1400,10 +1609,13 @@ static void native_connection_send_memblock(pa_native_connection *c) {
                 schunk.length = r->buffer_attr.fragsize;
 
             pa_pstream_send_memblock(c->pstream, r->index, 0, PA_SEEK_RELATIVE, &schunk);
+            pa_metric_add(c->bytes_sent, (unsigned) schunk.length);
 
             pa_memblockq_drop(r->memblockq, schunk.length);
             pa_memblock_unref(schunk.memblock);
 
+            record_stream_check_srbchannel_started(r);
+
             return;
         }
     }
@@ -1566,8 +1778,18 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
 
             return 0;
 
+        case SINK_INPUT_MESSAGE_SET_TIMING_PAGE:
+            s->thread_timing_page = userdata;
+            update_timing_page(s, true);
+            return 0;
+
+        case SINK_INPUT_MESSAGE_UPDATE_TIMING_PAGE:
+            update_timing_page(s, true);
+            return 0;
+
         case PA_SINK_INPUT_MESSAGE_SET_STATE: {
             int64_t windex;
+            int r;
 
             windex = pa_memblockq_get_write_index(s->memblockq);
 
@@ -1581,8 +1803,11 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
 
             handle_seek(s, windex);
 
-            /* Fall through to the default handler */
-            break;
+            /* Let the default handler change the state before it goes into
+             * the timing page */
+            r = pa_sink_input_process_msg(o, code, userdata, offset, chunk);
+            update_timing_page(s, true);
+            return r;
         }
 
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
@@ -1605,6 +1830,40 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
     return pa_sink_input_process_msg(o, code, userdata, offset, chunk);
 }
 
+/* Called from thread context */
+static void update_timing_page(playback_stream *s, bool force) {
+    pa_sink_input *i = s->sink_input;
+    pa_timing_page_data d;
+    pa_usec_t now;
+
+    if (!s->thread_timing_page)
+        return;
+
+    now = pa_rtclock_now();
+
+    if (!force && now < s->thread_timing_page_next)
+        return;
+
+    s->thread_timing_page_next = now + TIMING_PAGE_INTERVAL_USEC;
+
+    pa_zero(d);
+    d.read_index = pa_memblockq_get_read_index(s->memblockq);
+    d.sink_usec = pa_sink_get_latency_within_thread(i->sink) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+    d.underrun_for = i->thread_info.underrun_for;
+    d.playing_for = i->thread_info.playing_for;
+    d.timestamp = now;
+
+    /* Same as what the client concludes from the reply to
+     * GET_PLAYBACK_LATENCY */
+    if (d.playing_for > 0 &&
+        i->sink->thread_info.state == PA_SINK_RUNNING &&
+        i->thread_info.state == PA_SINK_INPUT_RUNNING)
+        d.flags |= PA_TIMING_PAGE_PLAYING;
+
+    pa_timing_page_write(s->thread_timing_page, &d);
+}
+
 static bool handle_input_underrun(playback_stream *s, bool force) {
     bool send_drain;
 
@@ -1656,6 +1915,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     if (!handle_input_underrun(s, false))
         s->is_underrun = false;
 
+    update_timing_page(s, false);
+
     /* This call will not fail with prebuf=0, hence we check for
        underrun explicitly in handle_input_underrun */
     if (pa_memblockq_peek(s->memblockq, chunk) < 0)
@@ -1766,6 +2027,10 @@ static void sink_input_suspend_cb(pa_sink_input *i, bool suspend) {
     s = PLAYBACK_STREAM(i->userdata);
     playback_stream_assert_ref(s);
 
+    /* The sink is not rendering anymore, resp. again */
+    if (s->timing_page)
+        pa_asyncmsgq_post(i->sink->asyncmsgq, PA_MSGOBJECT(i), SINK_INPUT_MESSAGE_UPDATE_TIMING_PAGE, NULL, 0, NULL, NULL);
+
     if (s->connection->version < 12)
       return;
 
@@ -1817,6 +2082,32 @@ static void sink_input_moving_cb(pa_sink_input *i, pa_sink *dest) {
 
 /*** source_output callbacks ***/
 
+/* Called from thread context */
+static void record_stream_write_srbchannel(record_stream *s) {
+    size_t frame_size, writable;
+    pa_memchunk chunk;
+
+    pa_assert(s->srbchannel_thread);
+
+    frame_size = pa_frame_size(&s->source_output->sample_spec);
+    writable = pa_srbchannel_get_writable(s->srbchannel_thread);
+
+    while (writable >= frame_size && pa_memblockq_peek(s->srbchannel_memblockq, &chunk) >= 0) {
+        size_t l;
+
+        /* Only whole frames, so that the client stays aligned */
+        l = PA_MIN(chunk.length, writable);
+        l -= l % frame_size;
+
+        pa_srbchannel_write(s->srbchannel_thread, (uint8_t*) pa_memblock_acquire(chunk.memblock) + chunk.index, l);
+        pa_memblock_release(chunk.memblock);
+        pa_memblock_unref(chunk.memblock);
+
+        pa_memblockq_drop(s->srbchannel_memblockq, l);
+        writable -= l;
+    }
+}
+
 /* Called from thread context */
 static int source_output_process_msg(pa_msgobject *_o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_source_output *o = PA_SOURCE_OUTPUT(_o);
@@ -1832,6 +2123,32 @@ static int source_output_process_msg(pa_msgobject *_o, int code, void *userdata,
             s->current_monitor_latency = o->source->monitor_of ? pa_sink_get_latency_within_thread(o->source->monitor_of) : 0;
             s->current_source_latency = pa_source_get_latency_within_thread(o->source);
             s->on_the_fly_snapshot = pa_atomic_load(&s->on_the_fly);
+
+            /* Data in the ringbuffer or waiting for it hasn't reached
+             * the client yet either */
+            if (s->srbchannel_thread) {
+                record_stream_write_srbchannel(s);
+                s->on_the_fly_snapshot += pa_srbchannel_get_written(s->srbchannel_thread) +
+                    pa_memblockq_get_length(s->srbchannel_memblockq);
+            }
+            return 0;
+
+        case SOURCE_OUTPUT_MESSAGE_SET_SRBCHANNEL:
+            s->srbchannel_thread = userdata;
+
+            /* Queued after all data posted so far */
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), RECORD_STREAM_MESSAGE_SRBCHANNEL_STARTED, NULL, 0, NULL, NULL);
+            return 0;
+
+        case SOURCE_OUTPUT_MESSAGE_FLUSH_SRBCHANNEL:
+            /* The client drops what is in the ringbuffer itself */
+            if (s->srbchannel_thread)
+                pa_memblockq_flush_read(s->srbchannel_memblockq);
+            return 0;
+
+        case SOURCE_OUTPUT_MESSAGE_UPDATE_BUFFER_ATTR:
+            if (s->srbchannel_memblockq)
+                pa_memblockq_set_maxlength(s->srbchannel_memblockq, s->buffer_attr.maxlength);
             return 0;
     }
 
@@ -1847,7 +2164,44 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     record_stream_assert_ref(s);
     pa_assert(chunk);
 
+    if (s->srbchannel_thread) {
+        /* Overruns are handled like the ones of memblockq: once the
+         * client is maxlength behind, new data is dropped */
+        if (pa_memblockq_push_align(s->srbchannel_memblockq, chunk) < 0 && pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Record ringbuffer queue full, dropping %lu bytes.", (unsigned long) chunk->length);
+
+        record_stream_write_srbchannel(s);
+        return;
+    }
+
     pa_atomic_add(&s->on_the_fly, chunk->length);
+
+    if (s->chunk_queue) {
+        pa_memchunk *c;
+
+        if (!(c = pa_flist_pop(PA_STATIC_FLIST_GET(record_chunks))))
+            c = pa_xnew(pa_memchunk, 1);
+
+        *c = *chunk;
+        pa_memblock_ref(c->memblock);
+
+        if (pa_asyncq_push(s->chunk_queue, c, false) < 0) {
+            pa_atomic_sub(&s->on_the_fly, chunk->length);
+            record_chunk_free(c);
+
+            if (pa_log_ratelimit(PA_LOG_DEBUG))
+                pa_log_debug("Record queue full, dropping %lu bytes.", (unsigned long) chunk->length);
+
+            return;
+        }
+
+        /* The main loop drains the whole queue when it gets this */
+        if (pa_atomic_cmpxchg(&s->chunk_queue_posted, 0, 1))
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), RECORD_STREAM_MESSAGE_POST_DATA, NULL, 0, NULL, NULL);
+
+        return;
+    }
+
     pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), RECORD_STREAM_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
 }
 
@@ -2010,7 +2364,8 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         muted_set = false,
         fail_on_suspend = false,
         relative_volume = false,
-        passthrough = false;
+        passthrough = false,
+        compress = false;
 
     pa_sink_input_flags_t flags = 0;
     pa_proplist *p = NULL;
@@ -2140,6 +2495,14 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         }
     }
 
+    if (c->version >= 36) {
+
+        if (pa_tagstruct_get_boolean(t, &compress) < 0) {
+            protocol_error(c);
+            goto finish;
+        }
+    }
+
     if (n_formats == 0) {
         CHECK_VALIDITY_GOTO(c->pstream, pa_sample_spec_valid(&ss), tag, PA_ERR_INVALID, finish);
         CHECK_VALIDITY_GOTO(c->pstream, map.channels == ss.channels && volume.channels == ss.channels, tag, PA_ERR_INVALID, finish);
@@ -2240,6 +2603,12 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         }
     }
 
+    if (c->version >= 36) {
+        /* The client compresses with the sample spec we send back, our
+         * pstream decodes it without further setup */
+        pa_tagstruct_put_boolean(reply, compress && !c->is_local && pa_pcm_codec_supported(&ss));
+    }
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 
 finish:
@@ -2336,7 +2705,8 @@ static void command_create_record_stream(pa_pdispatch *pd, uint32_t command, uin
         muted_set = false,
         fail_on_suspend = false,
         relative_volume = false,
-        passthrough = false;
+        passthrough = false,
+        compress = false;
 
     pa_source_output_flags_t flags = 0;
     pa_proplist *p = NULL;
@@ -2458,6 +2828,14 @@ static void command_create_record_stream(pa_pdispatch *pd, uint32_t command, uin
         CHECK_VALIDITY_GOTO(c->pstream, pa_cvolume_valid(&volume), tag, PA_ERR_INVALID, finish);
     }
 
+    if (c->version >= 36) {
+
+        if (pa_tagstruct_get_boolean(t, &compress) < 0) {
+            protocol_error(c);
+            goto finish;
+        }
+    }
+
     if (n_formats == 0) {
         CHECK_VALIDITY_GOTO(c->pstream, pa_sample_spec_valid(&ss), tag, PA_ERR_INVALID, finish);
         CHECK_VALIDITY_GOTO(c->pstream, map.channels == ss.channels, tag, PA_ERR_INVALID, finish);
@@ -2554,6 +2932,17 @@ static void command_create_record_stream(pa_pdispatch *pd, uint32_t command, uin
         }
     }
 
+    if (c->version >= 36) {
+        /* Only worth it where the data is not in SHM or a local socket
+         * anyway; the pstream of the client decodes it on its own */
+        compress = compress && !c->is_local && pa_pcm_codec_supported(&s->source_output->sample_spec);
+
+        if (compress)
+            pa_pstream_set_codec(c->pstream, s->index, &s->source_output->sample_spec);
+
+        pa_tagstruct_put_boolean(reply, compress);
+    }
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 
 finish:
@@ -2584,6 +2973,10 @@ static void command_exit(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_pstream_send_simple_ack(c->pstream, tag); /* nonsense */
 }
 
+static pa_mempool *connection_rw_mempool(pa_native_connection *c) {
+    return c->rw_mempool ? c->rw_mempool : c->protocol->core->rw_mempool;
+}
+
 static void setup_srbchannel(pa_native_connection *c) {
     pa_srbchannel_template srbt;
     pa_srbchannel *srb;
@@ -2606,12 +2999,12 @@ static void setup_srbchannel(pa_native_connection *c) {
         return;
     }
 
-    if (!c->protocol->core->rw_mempool) {
+    if (!connection_rw_mempool(c)) {
         pa_log_debug("Disabling srbchannel, reason: No rw memory pool");
         return;
     }
 
-    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->protocol->core->rw_mempool);
+    srb = pa_srbchannel_new(c->protocol->core->mainloop, connection_rw_mempool(c));
     if (!srb) {
         pa_log_debug("Failed to create srbchannel");
         return;
@@ -2645,13 +3038,164 @@ static void command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32
     pa_log_debug("Client enabled srbchannel.");
     pa_pstream_set_srbchannel(c->pstream, c->srbpending);
     c->srbpending = NULL;
+    c->srbchannel = true;
+}
+
+static void command_enable_stream_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t channel;
+    record_stream *s;
+    pa_srbchannel *srb;
+    pa_srbchannel_template srbt;
+    pa_tagstruct *reply;
+    pa_memchunk mc;
+    int fdlist[2];
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &channel) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    s = pa_idxset_get_by_index(c->record_streams, channel);
+    CHECK_VALIDITY(c->pstream, s, tag, PA_ERR_NOENTITY);
+    CHECK_VALIDITY(c->pstream, !s->srbchannel, tag, PA_ERR_EXIST);
+
+    /* Without the connection's srbchannel there is no SHM to put it in,
+     * nor a way to pass the file descriptors along */
+    CHECK_VALIDITY(c->pstream, c->srbchannel && connection_rw_mempool(c), tag, PA_ERR_NOTSUPPORTED);
+
+    if (!(srb = pa_srbchannel_new(c->protocol->core->mainloop, connection_rw_mempool(c)))) {
+        pa_pstream_send_error(c->pstream, tag, PA_ERR_NOTSUPPORTED);
+        return;
+    }
+
+    /* The client needs to keep up with a full fragment while the next
+     * one is written */
+    if (pa_srbchannel_get_writable(srb) < 2 * s->buffer_attr.fragsize) {
+        pa_log_debug("Fragment size of record stream %u too large for a ringbuffer.", s->index);
+        pa_srbchannel_free(srb);
+        pa_pstream_send_error(c->pstream, tag, PA_ERR_NOTSUPPORTED);
+        return;
+    }
+
+    pa_log_debug("Enabling srbchannel for record stream %u...", s->index);
+    pa_srbchannel_export(srb, &srbt);
+    s->srbchannel = srb;
+    s->srbchannel_size = pa_srbchannel_get_writable(srb);
+
+    reply = reply_new(tag);
+    fdlist[0] = srbt.readfd;
+    fdlist[1] = srbt.writefd;
+    pa_pstream_send_tagstruct_with_fds(c->pstream, reply, 2, fdlist);
+
+    /* The reply travels over the socket, which may overtake the
+     * connection's srbchannel. The memblock is hence recognizable on its
+     * own: it is the only one of a record stream with an absolute seek. */
+    mc.memblock = srbt.memblock;
+    mc.index = 0;
+    mc.length = pa_memblock_get_length(srbt.memblock);
+    pa_pstream_send_memblock(c->pstream, s->index, 0, PA_SEEK_ABSOLUTE, &mc);
+}
+
+static void command_start_stream_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t channel;
+    record_stream *s;
+    char *memblockq_name;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &channel) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    s = pa_idxset_get_by_index(c->record_streams, channel);
+    CHECK_VALIDITY(c->pstream, s, tag, PA_ERR_NOENTITY);
+    CHECK_VALIDITY(c->pstream, s->srbchannel && !s->srbchannel_start_pending && !s->srbchannel_started, tag, PA_ERR_BADSTATE);
+
+    pa_log_debug("Client started srbchannel for record stream %u.", s->index);
+
+    s->srbchannel_start_pending = true;
+    s->srbchannel_start_tag = tag;
+
+    memblockq_name = pa_sprintf_malloc("native protocol record stream srbchannel memblockq [%u]", s->source_output->index);
+    s->srbchannel_memblockq = pa_memblockq_new(
+            memblockq_name,
+            0,
+            s->buffer_attr.maxlength,
+            0,
+            &s->source_output->sample_spec,
+            1,
+            0,
+            0,
+            NULL);
+    pa_xfree(memblockq_name);
+
+    /* The reply is sent by record_stream_check_srbchannel_started() */
+    pa_assert_se(pa_asyncmsgq_send(s->source_output->source->asyncmsgq, PA_MSGOBJECT(s->source_output), SOURCE_OUTPUT_MESSAGE_SET_SRBCHANNEL, s->srbchannel, 0, NULL) == 0);
+}
+
+static void command_enable_stream_timing_page(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t channel;
+    playback_stream *s;
+    pa_timing_page *page;
+    pa_tagstruct *reply;
+    pa_memchunk mc;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &channel) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    s = pa_idxset_get_by_index(c->output_streams, channel);
+    CHECK_VALIDITY(c->pstream, s && playback_stream_isinstance(s), tag, PA_ERR_NOENTITY);
+    CHECK_VALIDITY(c->pstream, !s->timing_page, tag, PA_ERR_EXIST);
+
+    /* The page has to be in memory the client can map, same as for the
+     * stream srbchannels */
+    CHECK_VALIDITY(c->pstream, c->srbchannel && c->protocol->core->rw_mempool, tag, PA_ERR_NOTSUPPORTED);
+
+    s->timing_page = pa_memblock_new(c->protocol->core->rw_mempool, sizeof(pa_timing_page));
+    page = pa_memblock_acquire(s->timing_page);
+    memset(page, 0, sizeof(*page));
+
+    pa_log_debug("Enabling timing page for playback stream %u...", s->index);
+    pa_assert_se(pa_asyncmsgq_send(s->sink_input->sink->asyncmsgq, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_SET_TIMING_PAGE, page, 0, NULL) == 0);
+
+    /* Playback streams never get memblocks sent from the server otherwise,
+     * but record streams may share the channel number. The reply hence
+     * announces the page, and the page follows right after it. Both go
+     * the same way, since the reply carries no file descriptors. */
+    reply = reply_new(tag);
+    pa_tagstruct_putu32(reply, (uint32_t) sizeof(pa_timing_page));
+    pa_pstream_send_tagstruct(c->pstream, reply);
+
+    mc.memblock = s->timing_page;
+    mc.index = 0;
+    mc.length = sizeof(pa_timing_page);
+    pa_pstream_send_memblock(c->pstream, s->index, 0, PA_SEEK_RELATIVE, &mc);
 }
 
 static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     const void*cookie;
     pa_tagstruct *reply;
-    bool shm_on_remote = false, do_shm;
+    bool shm_on_remote = false, memfd_on_remote = false, do_shm, do_memfd;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -2674,7 +3218,11 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
        not. */
     if (c->version >= 13) {
         shm_on_remote = !!(c->version & 0x80000000U);
-        c->version &= 0x7FFFFFFFU;
+
+        /* Starting with protocol version 42 the second MSB tells
+           whether the client can pass memfd pools */
+        memfd_on_remote = !!(c->version & 0x40000000U);
+        c->version &= 0x3FFFFFFFU;
     }
 
     pa_log_debug("Protocol version: remote %u, local %u", c->version, PA_PROTOCOL_VERSION);
@@ -2761,8 +3309,27 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_log_debug("Negotiated SHM: %s", pa_yes_no(do_shm));
     pa_pstream_enable_shm(c->pstream, do_shm);
 
+    do_memfd =
+        do_shm &&
+        c->options->memfd &&
+        memfd_on_remote &&
+        c->version >= 42;
+
+    /* Instead of sharing the core's rw pool with every other client */
+    if (do_memfd && !c->rw_mempool) {
+        if ((c->rw_mempool = pa_mempool_new_memfd(CONNECTION_MEMPOOL_SIZE))) {
+            pa_mempool_set_is_remote_writable(c->rw_mempool, true);
+
+            if (c->protocol->core->lock_mempools)
+                pa_mempool_lock_memory(c->rw_mempool);
+        } else
+            do_memfd = false;
+    }
+
+    pa_log_debug("Negotiated memfd: %s", pa_yes_no(do_memfd));
+
     reply = reply_new(tag);
-    pa_tagstruct_putu32(reply, PA_PROTOCOL_VERSION | (do_shm ? 0x80000000 : 0));
+    pa_tagstruct_putu32(reply, PA_PROTOCOL_VERSION | (do_shm ? 0x80000000 : 0) | (do_memfd ? 0x40000000 : 0));
 
 #ifdef HAVE_CREDS
 {
@@ -2779,9 +3346,50 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_pstream_send_tagstruct(c->pstream, reply);
 #endif
 
+    if (do_memfd) {
+        pa_pstream_enable_memfd(c->pstream);
+        pa_assert_se(pa_pstream_register_memfd_mempool(c->pstream, c->rw_mempool) >= 0);
+    }
+
     setup_srbchannel(c);
 }
 
+static void command_register_memfd_shmid(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+#ifdef HAVE_CREDS
+    uint32_t shm_id;
+    bool writable;
+    const int *fds;
+    int nfd;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &shm_id) < 0 ||
+        pa_tagstruct_get_boolean(t, &writable) < 0 ||
+        !pa_tagstruct_eof(t) ||
+        !c->authorized ||
+        !pa_pstream_get_memfd(c->pstream)) {
+        protocol_error(c);
+        return;
+    }
+
+    fds = pa_pdispatch_fds(pd, &nfd);
+    if (nfd != 1 || !fds || fds[0] < 0) {
+        protocol_error(c);
+        return;
+    }
+
+    if (pa_pstream_attach_memfd_shmid(c->pstream, shm_id, fds[0], writable) < 0)
+        pa_log_warn("Failed to attach the memfd pool of the client.");
+
+    pa_close(fds[0]);
+#else
+    pa_native_connection_assert_ref(c);
+    protocol_error(c);
+#endif
+}
+
 static void command_set_client_name(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     const char *name = NULL;
@@ -2906,6 +3514,91 @@ static void command_stat(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static void put_metric(pa_metric *metric, uint64_t value, void *userdata) {
+    pa_tagstruct *reply = userdata;
+
+    pa_tagstruct_puts(reply, pa_metric_family_name(metric->family));
+    pa_tagstruct_puts(reply, pa_metric_family_label(metric->family));
+    pa_tagstruct_puts(reply, metric->label_value);
+    pa_tagstruct_putu64(reply, value);
+}
+
+static void command_get_metrics(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pa_tagstruct *reply;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (!pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+
+    reply = reply_new(tag);
+    pa_metrics_foreach(c->protocol->core->metrics, put_metric, reply);
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
+static void command_get_io_trace(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pa_tagstruct *reply;
+    pa_io_trace *trace = NULL;
+    pa_io_trace_entry *e;
+    const char *name;
+    uint32_t xruns;
+    bool frozen;
+    unsigned n, i;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_gets(t, &name) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    CHECK_VALIDITY(c->pstream, name && pa_namereg_is_valid_name_or_wildcard(name, command == PA_COMMAND_GET_SINK_IO_TRACE ? PA_NAMEREG_SINK : PA_NAMEREG_SOURCE), tag, PA_ERR_INVALID);
+
+    if (command == PA_COMMAND_GET_SINK_IO_TRACE) {
+        pa_sink *sink;
+
+        if ((sink = pa_namereg_get(c->protocol->core, name, PA_NAMEREG_SINK)))
+            trace = sink->io_trace;
+    } else {
+        pa_source *source;
+
+        if ((source = pa_namereg_get(c->protocol->core, name, PA_NAMEREG_SOURCE)))
+            trace = source->io_trace;
+    }
+
+    CHECK_VALIDITY(c->pstream, trace, tag, PA_ERR_NOENTITY);
+
+    e = pa_xnew(pa_io_trace_entry, pa_io_trace_get_size(trace));
+    n = pa_io_trace_get(trace, e, pa_io_trace_get_size(trace), &xruns, &frozen);
+
+    reply = reply_new(tag);
+    pa_tagstruct_putu32(reply, xruns);
+    pa_tagstruct_put_boolean(reply, frozen);
+    pa_tagstruct_putu32(reply, n);
+
+    for (i = 0; i < n; i++) {
+        pa_tagstruct_put_usec(reply, e[i].time);
+        pa_tagstruct_puts64(reply, e[i].lateness);
+        pa_tagstruct_puts64(reply, e[i].avail);
+        pa_tagstruct_put_usec(reply, e[i].process_usec);
+        pa_tagstruct_put_usec(reply, e[i].sleep_usec);
+        pa_tagstruct_putu32(reply, e[i].flags);
+    }
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+    pa_xfree(e);
+}
+
 static void command_get_playback_latency(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_tagstruct *reply;
@@ -3262,6 +3955,11 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
 
         pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
     }
+
+    if (c->version >= 40) {
+        pa_tagstruct_putu32(t, pa_sink_get_render_load(sink));
+        pa_tagstruct_put_boolean(t, sink->overloaded);
+    }
 }
 
 static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source *source) {
@@ -3417,6 +4115,40 @@ static void module_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_m
         pa_tagstruct_put_proplist(t, module->proplist);
 }
 
+static void sink_input_put_resampler_timing(pa_tagstruct *t, pa_sink_input *s) {
+    pa_resampler_timing timing;
+    unsigned p, b;
+
+    if (!pa_sink_input_get_resampler_timing(s, &timing)) {
+        pa_tagstruct_putu64(t, 0);
+        pa_tagstruct_putu32(t, 0);
+        return;
+    }
+
+    pa_tagstruct_putu64(t, timing.calls);
+    pa_tagstruct_putu32(t, PA_RESAMPLER_PHASE_MAX);
+
+    for (p = 0; p < PA_RESAMPLER_PHASE_MAX; p++) {
+        pa_tagstruct_puts(t, pa_resampler_phase_to_string(p));
+        pa_tagstruct_put_usec(t, timing.nsec[p] / PA_NSEC_PER_USEC);
+        pa_tagstruct_putu32(t, PA_RESAMPLER_TIMING_BUCKETS);
+
+        for (b = 0; b < PA_RESAMPLER_TIMING_BUCKETS; b++)
+            pa_tagstruct_putu32(t, timing.histogram[p][b]);
+    }
+}
+
+static void sink_input_put_stats(pa_tagstruct *t, pa_sink_input *s) {
+    pa_sink_input_stats stats;
+
+    pa_sink_input_get_stats(s, &stats);
+
+    pa_tagstruct_putu32(t, stats.underruns);
+    pa_tagstruct_putu32(t, stats.silence_frames);
+    pa_tagstruct_putu32(t, stats.rewinds);
+    pa_tagstruct_putu32(t, stats.render_usec);
+}
+
 static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s) {
     pa_sample_spec fixed_ss;
     pa_usec_t sink_latency;
@@ -3458,6 +4190,71 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     }
     if (c->version >= 21)
         pa_tagstruct_put_format_info(t, s->format);
+    if (c->version >= 32)
+        sink_input_put_resampler_timing(t, s);
+    if (c->version >= 39)
+        sink_input_put_stats(t, s);
+}
+
+/* Only the fields selected by mask, see PA_COMMAND_GET_SINK_INPUT_INFO_LIST_MASKED */
+static void sink_input_fill_tagstruct_masked(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s, uint32_t mask) {
+    pa_sample_spec fixed_ss;
+
+    pa_assert(t);
+    pa_sink_input_assert_ref(s);
+
+    if (mask & (PA_SINK_INPUT_INFO_SAMPLE_SPEC|PA_SINK_INPUT_INFO_VOLUME))
+        fixup_sample_spec(c, &fixed_ss, &s->sample_spec);
+
+    pa_tagstruct_putu32(t, s->index);
+
+    if (mask & PA_SINK_INPUT_INFO_NAME)
+        pa_tagstruct_puts(t, pa_strnull(pa_proplist_gets(s->proplist, PA_PROP_MEDIA_NAME)));
+    if (mask & PA_SINK_INPUT_INFO_OWNER) {
+        pa_tagstruct_putu32(t, s->module ? s->module->index : PA_INVALID_INDEX);
+        pa_tagstruct_putu32(t, s->client ? s->client->index : PA_INVALID_INDEX);
+    }
+    if (mask & PA_SINK_INPUT_INFO_SINK)
+        pa_tagstruct_putu32(t, s->sink->index);
+    if (mask & PA_SINK_INPUT_INFO_SAMPLE_SPEC) {
+        pa_tagstruct_put_sample_spec(t, &fixed_ss);
+        pa_tagstruct_put_channel_map(t, &s->channel_map);
+    }
+    if (mask & PA_SINK_INPUT_INFO_VOLUME) {
+        pa_cvolume v;
+        bool has_volume;
+
+        has_volume = pa_sink_input_is_volume_readable(s);
+        if (has_volume)
+            pa_sink_input_get_volume(s, &v, true);
+        else
+            pa_cvolume_reset(&v, fixed_ss.channels);
+
+        pa_tagstruct_put_cvolume(t, &v);
+        pa_tagstruct_put_boolean(t, s->muted);
+        pa_tagstruct_put_boolean(t, has_volume);
+        pa_tagstruct_put_boolean(t, s->volume_writable);
+    }
+    if (mask & PA_SINK_INPUT_INFO_LATENCY) {
+        pa_usec_t sink_latency;
+
+        pa_tagstruct_put_usec(t, pa_sink_input_get_latency(s, &sink_latency));
+        pa_tagstruct_put_usec(t, sink_latency);
+    }
+    if (mask & PA_SINK_INPUT_INFO_RESAMPLE_METHOD)
+        pa_tagstruct_puts(t, pa_resample_method_to_string(pa_sink_input_get_resample_method(s)));
+    if (mask & PA_SINK_INPUT_INFO_DRIVER)
+        pa_tagstruct_puts(t, s->driver);
+    if (mask & PA_SINK_INPUT_INFO_PROPLIST)
+        pa_tagstruct_put_proplist(t, s->proplist);
+    if (mask & PA_SINK_INPUT_INFO_CORKED)
+        pa_tagstruct_put_boolean(t, (pa_sink_input_get_state(s) == PA_SINK_INPUT_CORKED));
+    if (mask & PA_SINK_INPUT_INFO_FORMAT)
+        pa_tagstruct_put_format_info(t, s->format);
+    if (mask & PA_SINK_INPUT_INFO_RESAMPLER_TIMING)
+        sink_input_put_resampler_timing(t, s);
+    if (mask & PA_SINK_INPUT_INFO_STATS)
+        sink_input_put_stats(t, s);
 }
 
 static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source_output *s) {
@@ -3693,6 +4490,32 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static void command_get_sink_input_info_list_masked(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pa_sink_input *si;
+    uint32_t mask, idx;
+    pa_tagstruct *reply;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &mask) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    CHECK_VALIDITY(c->pstream, !(mask & ~PA_SINK_INPUT_INFO_ALL), tag, PA_ERR_INVALID);
+
+    reply = reply_new(tag);
+
+    PA_IDXSET_FOREACH(si, c->protocol->core->sink_inputs, idx)
+        sink_input_fill_tagstruct_masked(c, reply, si, mask);
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
 static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_tagstruct *reply;
@@ -3736,9 +4559,143 @@ static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t
     if (c->version >= 15)
         pa_tagstruct_put_channel_map(reply, &c->protocol->core->default_channel_map);
 
+    if (c->version >= 31) {
+        char *kernels = pa_cpu_autotune_selection(&c->protocol->core->default_sample_spec);
+
+        pa_tagstruct_puts(reply, kernels);
+        pa_xfree(kernels);
+    }
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static bool subscription_delta_get(pa_core *core, pa_subscription_event_type_t facility, uint32_t idx, struct subscription_delta *d) {
+    pa_usec_t latency;
+
+    pa_zero(*d);
+
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK: {
+            pa_sink *s;
+
+            if (!(s = pa_idxset_get_by_index(core->sinks, idx)) || !PA_SINK_IS_LINKED(pa_sink_get_state(s)))
+                return false;
+
+            d->volume = *pa_sink_get_volume(s, false);
+            d->mute = pa_sink_get_mute(s, false);
+            d->state = pa_sink_get_state(s);
+            d->latency = pa_sink_get_latency(s);
+            return true;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE: {
+            pa_source *s;
+
+            if (!(s = pa_idxset_get_by_index(core->sources, idx)) || !PA_SOURCE_IS_LINKED(pa_source_get_state(s)))
+                return false;
+
+            d->volume = *pa_source_get_volume(s, false);
+            d->mute = pa_source_get_mute(s, false);
+            d->state = pa_source_get_state(s);
+            d->latency = pa_source_get_latency(s);
+            return true;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT: {
+            pa_sink_input *i;
+
+            if (!(i = pa_idxset_get_by_index(core->sink_inputs, idx)) || !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(i)))
+                return false;
+
+            if (pa_sink_input_is_volume_readable(i))
+                pa_sink_input_get_volume(i, &d->volume, true);
+            else
+                pa_cvolume_reset(&d->volume, i->sample_spec.channels);
+
+            d->mute = i->muted;
+            d->state = pa_sink_input_get_state(i) == PA_SINK_INPUT_CORKED;
+            d->latency = pa_sink_input_get_latency(i, &latency);
+            d->latency += latency;
+            return true;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT: {
+            pa_source_output *o;
+
+            if (!(o = pa_idxset_get_by_index(core->source_outputs, idx)) || !PA_SOURCE_OUTPUT_IS_LINKED(pa_source_output_get_state(o)))
+                return false;
+
+            if (pa_source_output_is_volume_readable(o))
+                pa_source_output_get_volume(o, &d->volume, true);
+            else
+                pa_cvolume_reset(&d->volume, o->sample_spec.channels);
+
+            d->mute = o->muted;
+            d->state = pa_source_output_get_state(o) == PA_SOURCE_OUTPUT_CORKED;
+            d->latency = pa_source_output_get_latency(o, &latency);
+            d->latency += latency;
+            return true;
+        }
+
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+/* Appends the fields of the object that changed since the client saw
+ * them last to a change event, and remembers what it sees now. */
+static void subscription_delta_put(pa_native_connection *c, pa_tagstruct *t, pa_subscription_event_type_t e, uint32_t idx) {
+    pa_subscription_event_type_t facility = e & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    struct subscription_delta now, *last;
+    uint32_t changed = 0;
+    pa_hashmap *h;
+
+    if (facility > PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT)
+        return;
+
+    if (!(h = c->subscription_deltas[facility]))
+        h = c->subscription_deltas[facility] = pa_hashmap_new_full(NULL, NULL, NULL, pa_xfree);
+
+    if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE ||
+        !subscription_delta_get(c->protocol->core, facility, idx, &now)) {
+        pa_hashmap_remove_and_free(h, PA_UINT32_TO_PTR(idx));
+
+        if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE)
+            pa_tagstruct_putu32(t, 0);
+        return;
+    }
+
+    if (!(last = pa_hashmap_get(h, PA_UINT32_TO_PTR(idx)))) {
+        last = pa_xnew(struct subscription_delta, 1);
+        pa_hashmap_put(h, PA_UINT32_TO_PTR(idx), last);
+        changed = PA_SUBSCRIPTION_DELTA_VOLUME|PA_SUBSCRIPTION_DELTA_MUTE|PA_SUBSCRIPTION_DELTA_STATE|PA_SUBSCRIPTION_DELTA_LATENCY;
+    } else {
+        if (!pa_cvolume_equal(&now.volume, &last->volume))
+            changed |= PA_SUBSCRIPTION_DELTA_VOLUME;
+        if (now.mute != last->mute)
+            changed |= PA_SUBSCRIPTION_DELTA_MUTE;
+        if (now.state != last->state)
+            changed |= PA_SUBSCRIPTION_DELTA_STATE;
+        if (now.latency != last->latency)
+            changed |= PA_SUBSCRIPTION_DELTA_LATENCY;
+    }
+
+    *last = now;
+
+    if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_CHANGE)
+        return;
+
+    pa_tagstruct_putu32(t, changed);
+    if (changed & PA_SUBSCRIPTION_DELTA_VOLUME)
+        pa_tagstruct_put_cvolume(t, &now.volume);
+    if (changed & PA_SUBSCRIPTION_DELTA_MUTE)
+        pa_tagstruct_put_boolean(t, now.mute);
+    if (changed & PA_SUBSCRIPTION_DELTA_STATE)
+        pa_tagstruct_putu32(t, now.state);
+    if (changed & PA_SUBSCRIPTION_DELTA_LATENCY)
+        pa_tagstruct_put_usec(t, now.latency);
+}
+
 static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint32_t idx, void *userdata) {
     pa_tagstruct *t;
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
@@ -3750,17 +4707,23 @@ static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint3
     pa_tagstruct_putu32(t, (uint32_t) -1);
     pa_tagstruct_putu32(t, e);
     pa_tagstruct_putu32(t, idx);
+
+    if (c->subscription_deltas_enabled)
+        subscription_delta_put(c, t, e, idx);
+
     pa_pstream_send_tagstruct(c->pstream, t);
 }
 
 static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_subscription_mask_t m;
+    bool deltas = false;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
 
     if (pa_tagstruct_getu32(t, &m) < 0 ||
+        (c->version >= 35 && pa_tagstruct_get_boolean(t, &deltas) < 0) ||
         !pa_tagstruct_eof(t)) {
         protocol_error(c);
         return;
@@ -3772,6 +4735,9 @@ static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
+    subscription_deltas_free(c);
+    c->subscription_deltas_enabled = deltas;
+
     if (m != 0) {
         c->subscription = pa_subscription_new(c->protocol->core, m, subscription_cb, c);
         pa_assert(c->subscription);
@@ -3995,6 +4961,35 @@ static void command_cork_playback_stream(pa_pdispatch *pd, uint32_t command, uin
     pa_pstream_send_simple_ack(c->pstream, tag);
 }
 
+static void command_uncork_playback_stream_at(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t idx;
+    pa_usec_t when;
+    playback_stream *s;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &idx) < 0 ||
+        pa_tagstruct_get_usec(t, &when) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    CHECK_VALIDITY(c->pstream, idx != PA_INVALID_INDEX, tag, PA_ERR_INVALID);
+    CHECK_VALIDITY(c->pstream, when > 0, tag, PA_ERR_INVALID);
+    s = pa_idxset_get_by_index(c->output_streams, idx);
+    CHECK_VALIDITY(c->pstream, s, tag, PA_ERR_NOENTITY);
+    CHECK_VALIDITY(c->pstream, playback_stream_isinstance(s), tag, PA_ERR_NOENTITY);
+    CHECK_VALIDITY(c->pstream, pa_sink_input_set_start_time(s->sink_input, when) >= 0, tag, PA_ERR_BADSTATE);
+
+    pa_sink_input_cork(s->sink_input, false);
+
+    pa_pstream_send_simple_ack(c->pstream, tag);
+}
+
 static void command_trigger_or_flush_or_prebuf_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     uint32_t idx;
@@ -4079,6 +5074,10 @@ static void command_flush_record_stream(pa_pdispatch *pd, uint32_t command, uint
     CHECK_VALIDITY(c->pstream, s, tag, PA_ERR_NOENTITY);
 
     pa_memblockq_flush_read(s->memblockq);
+
+    if (s->srbchannel)
+        pa_assert_se(pa_asyncmsgq_send(s->source_output->source->asyncmsgq, PA_MSGOBJECT(s->source_output), SOURCE_OUTPUT_MESSAGE_FLUSH_SRBCHANNEL, NULL, 0, NULL) == 0);
+
     pa_pstream_send_simple_ack(c->pstream, tag);
 }
 
@@ -4167,6 +5166,9 @@ static void command_set_stream_buffer_attr(pa_pdispatch *pd, uint32_t command, u
         pa_memblockq_get_attr(s->memblockq, &s->buffer_attr);
         fix_record_buffer_attr_post(s);
 
+        if (s->srbchannel_memblockq)
+            pa_assert_se(pa_asyncmsgq_send(s->source_output->source->asyncmsgq, PA_MSGOBJECT(s->source_output), SOURCE_OUTPUT_MESSAGE_UPDATE_BUFFER_ATTR, NULL, 0, NULL) == 0);
+
         reply = reply_new(tag);
         pa_tagstruct_putu32(reply, s->buffer_attr.maxlength);
         pa_tagstruct_putu32(reply, s->buffer_attr.fragsize);
@@ -4887,13 +5889,152 @@ static void command_set_port_latency_offset(pa_pdispatch *pd, uint32_t command,
 
 /*** pstream callbacks ***/
 
+/* Commands that streams need to run smoothly, they don't count against
+ * the client's command budget */
+static bool command_is_exempt(uint32_t command) {
+    switch (command) {
+        case PA_COMMAND_ERROR:
+        case PA_COMMAND_REPLY:
+        case PA_COMMAND_AUTH:
+        case PA_COMMAND_SET_CLIENT_NAME:
+        case PA_COMMAND_CREATE_PLAYBACK_STREAM:
+        case PA_COMMAND_DELETE_PLAYBACK_STREAM:
+        case PA_COMMAND_CREATE_RECORD_STREAM:
+        case PA_COMMAND_DELETE_RECORD_STREAM:
+        case PA_COMMAND_DRAIN_PLAYBACK_STREAM:
+        case PA_COMMAND_GET_PLAYBACK_LATENCY:
+        case PA_COMMAND_GET_RECORD_LATENCY:
+        case PA_COMMAND_CORK_PLAYBACK_STREAM:
+        case PA_COMMAND_FLUSH_PLAYBACK_STREAM:
+        case PA_COMMAND_TRIGGER_PLAYBACK_STREAM:
+        case PA_COMMAND_PREBUF_PLAYBACK_STREAM:
+        case PA_COMMAND_CORK_RECORD_STREAM:
+        case PA_COMMAND_FLUSH_RECORD_STREAM:
+        case PA_COMMAND_SET_PLAYBACK_STREAM_BUFFER_ATTR:
+        case PA_COMMAND_SET_RECORD_STREAM_BUFFER_ATTR:
+        case PA_COMMAND_UPDATE_PLAYBACK_STREAM_SAMPLE_RATE:
+        case PA_COMMAND_UPDATE_RECORD_STREAM_SAMPLE_RATE:
+        case PA_COMMAND_ENABLE_SRBCHANNEL:
+        case PA_COMMAND_DISABLE_SRBCHANNEL:
+        case PA_COMMAND_ENABLE_STREAM_SRBCHANNEL:
+        case PA_COMMAND_START_STREAM_SRBCHANNEL:
+        case PA_COMMAND_ENABLE_STREAM_TIMING_PAGE:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* A token bucket, kept as the time at which the bucket would be full
+ * again: every command advances it by 1/client_command_rate seconds,
+ * and the client is held back while it is more than
+ * client_command_burst commands ahead of now. Returns for how long. */
+static pa_usec_t command_budget_charge(pa_native_connection *c) {
+    pa_core *core = c->protocol->core;
+    pa_usec_t now, cost, allowance;
+
+    if (core->client_command_rate == 0)
+        return 0;
+
+    now = pa_rtclock_now();
+    cost = PA_MAX(PA_USEC_PER_SEC / core->client_command_rate, 1U);
+    allowance = cost * PA_MAX(core->client_command_burst, 1U);
+
+    if (c->command_tat < now)
+        c->command_tat = now;
+
+    c->command_tat += cost;
+
+    if (c->command_tat <= now + allowance)
+        return 0;
+
+    return c->command_tat - now - allowance;
+}
+
+static void throttle_cb(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(m);
+    pa_native_connection_assert_ref(c);
+    pa_assert(c->throttle_event == e);
+
+    m->time_restart(e, NULL);
+    pa_pstream_set_read_paused(c->pstream, false);
+}
+
+/* Returns the command of packet, or PA_COMMAND_MAX if it has none */
+static uint32_t packet_peek_command(pa_packet *packet) {
+    pa_tagstruct *ts;
+    uint32_t command;
+    const void *pdata;
+    size_t plen;
+
+    pdata = pa_packet_data(packet, &plen);
+    ts = pa_tagstruct_new_fixed(pdata, plen);
+
+    if (pa_tagstruct_getu32(ts, &command) < 0 || command >= PA_COMMAND_MAX)
+        command = PA_COMMAND_MAX;
+
+    pa_tagstruct_free(ts);
+
+    return command;
+}
+
+static void command_count(pa_native_protocol *p, uint32_t command) {
+    const char *name;
+
+    if (command >= PA_COMMAND_MAX)
+        return;
+
+    if (!p->command_metrics[command]) {
+        char buf[16];
+
+        if (!(name = pa_pdispatch_command_name(command))) {
+            pa_snprintf(buf, sizeof(buf), "%u", command);
+            name = buf;
+        }
+
+        p->command_metrics[command] = pa_metric_new(p->core->metrics, PA_METRIC_NATIVE_COMMANDS, name);
+    }
+
+    pa_metric_inc(p->command_metrics[command]);
+}
+
+static void command_throttle(pa_native_connection *c, uint32_t command) {
+    pa_usec_t delay;
+
+    if (command >= PA_COMMAND_MAX || command_is_exempt(command))
+        return;
+
+    if ((delay = command_budget_charge(c)) == 0)
+        return;
+
+    if (pa_log_ratelimit(PA_LOG_DEBUG))
+        pa_log_debug("Client %u exceeds its command budget, not reading from it for %0.1f ms.",
+                     c->client->index, (double) delay / PA_USEC_PER_MSEC);
+
+    /* This command still goes through, the following ones wait */
+    pa_pstream_set_read_paused(c->pstream, true);
+
+    if (c->throttle_event)
+        pa_core_rttime_restart(c->protocol->core, c->throttle_event, pa_rtclock_now() + delay);
+    else
+        c->throttle_event = pa_core_rttime_new(c->protocol->core, pa_rtclock_now() + delay, throttle_cb, c);
+}
+
 static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_cmsg_ancil_data *ancil_data, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t command;
 
     pa_assert(p);
     pa_assert(packet);
     pa_native_connection_assert_ref(c);
 
+    command = packet_peek_command(packet);
+    command_count(c->protocol, command);
+    command_throttle(c, command);
+
     if (pa_pdispatch_run(c->pdispatch, packet, ancil_data, c) < 0) {
         pa_log("invalid packet.");
         native_connection_unlink(c);
@@ -4914,6 +6055,8 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
         return;
     }
 
+    pa_metric_add(c->bytes_received, (unsigned) chunk->length);
+
 #ifdef PROTOCOL_NATIVE_DEBUG
     pa_log("got %lu bytes from client", (unsigned long) chunk->length);
 #endif
@@ -5071,8 +6214,8 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     pa_assert(io);
     pa_assert(o);
 
-    if (pa_idxset_size(p->connections)+1 > MAX_CONNECTIONS) {
-        pa_log_warn("Warning! Too many connections (%u), dropping incoming connection.", MAX_CONNECTIONS);
+    if (pa_idxset_size(p->connections)+1 > o->max_connections) {
+        pa_log_warn("Warning! Too many connections (%u), dropping incoming connection.", o->max_connections);
         pa_iochannel_free(io);
         return;
     }
@@ -5115,6 +6258,9 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     else
         c->auth_timeout_event = NULL;
 
+    c->command_tat = 0;
+    c->throttle_event = NULL;
+
     c->is_local = pa_iochannel_socket_is_local(io);
     c->version = 8;
 
@@ -5123,6 +6269,10 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     c->client->send_event = client_send_event_cb;
     c->client->userdata = c;
 
+    pa_snprintf(pname, sizeof(pname), "%u", client->index);
+    c->bytes_received = pa_metric_new(p->core->metrics, PA_METRIC_CLIENT_BYTES_RECEIVED, pname);
+    c->bytes_sent = pa_metric_new(p->core->metrics, PA_METRIC_CLIENT_BYTES_SENT, pname);
+
     c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
     pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
     pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
@@ -5132,6 +6282,7 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
 
     c->pdispatch = pa_pdispatch_new(p->core->mainloop, true, command_table, PA_COMMAND_MAX);
+    pa_pdispatch_set_stats(c->pdispatch, &p->dispatch_stats);
 
     c->record_streams = pa_idxset_new(NULL, NULL);
     c->output_streams = pa_idxset_new(NULL, NULL);
@@ -5167,7 +6318,7 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
 
     pa_assert(c);
 
-    p = pa_xnew(pa_native_protocol, 1);
+    p = pa_xnew0(pa_native_protocol, 1);
     PA_REFCNT_INIT(p);
     p->core = c;
     p->connections = pa_idxset_new(NULL, NULL);
@@ -5180,6 +6331,7 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
         pa_hook_init(&p->hooks[h], p);
 
     pa_assert_se(pa_shared_set(c, "native-protocol", p) >= 0);
+    pa_assert_se(pa_shared_set(c, "pdispatch-stats", &p->dispatch_stats) >= 0);
 
     return p;
 }
@@ -5205,6 +6357,7 @@ pa_native_protocol* pa_native_protocol_ref(pa_native_protocol *p) {
 void pa_native_protocol_unref(pa_native_protocol *p) {
     pa_native_connection *c;
     pa_native_hook_t h;
+    uint32_t command;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
@@ -5224,6 +6377,11 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_hashmap_free(p->extensions);
 
+    for (command = 0; command < PA_COMMAND_MAX; command++)
+        if (p->command_metrics[command])
+            pa_metric_free(p->command_metrics[command]);
+
+    pa_assert_se(pa_shared_remove(p->core, "pdispatch-stats") >= 0);
     pa_assert_se(pa_shared_remove(p->core, "native-protocol") >= 0);
 
     pa_xfree(p);
@@ -5287,6 +6445,7 @@ pa_native_options* pa_native_options_new(void) {
 
     o = pa_xnew0(pa_native_options, 1);
     PA_REFCNT_INIT(o);
+    o->max_connections = MAX_CONNECTIONS;
 
     return o;
 }
@@ -5332,6 +6491,18 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    o->memfd = true;
+    if (pa_modargs_get_value_boolean(ma, "memfd", &o->memfd) < 0) {
+        pa_log("memfd= expects a boolean argument.");
+        return -1;
+    }
+
+    o->max_connections = MAX_CONNECTIONS;
+    if (pa_modargs_get_value_u32(ma, "max-connections", &o->max_connections) < 0 || o->max_connections <= 0) {
+        pa_log("max-connections= expects a positive integer argument.");
+        return -1;
+    }
+
     if (pa_modargs_get_value_boolean(ma, "auth-anonymous", &o->auth_anonymous) < 0) {
         pa_log("auth-anonymous= expects a boolean argument.");
         return -1;
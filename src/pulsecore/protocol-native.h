@@ -43,6 +43,8 @@ typedef struct pa_native_options {
 
     bool auth_anonymous;
     bool srbchannel;
+    bool memfd;
+    uint32_t max_connections;
     char *auth_group;
     pa_ip_acl *auth_ip_acl;
     pa_auth_cookie *auth_cookie;
@@ -39,6 +39,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/shared.h>
+#include <pulsecore/source-fanout.h>
 
 #include "protocol-simple.h"
 
@@ -51,9 +52,9 @@ typedef struct connection {
     pa_simple_options *options;
     pa_iochannel *io;
     pa_sink_input *sink_input;
-    pa_source_output *source_output;
+    pa_source_fanout_reader *record;
     pa_client *client;
-    pa_memblockq *input_memblockq, *output_memblockq;
+    pa_memblockq *input_memblockq;
 
     bool dead;
 
@@ -82,7 +83,6 @@ enum {
 
 enum {
     CONNECTION_MESSAGE_REQUEST_DATA,      /* data requested from sink input from the main loop */
-    CONNECTION_MESSAGE_POST_DATA,         /* data from source output to main loop */
     CONNECTION_MESSAGE_UNLINK_CONNECTION  /* Please drop the connection now */
 };
 
@@ -109,10 +109,9 @@ static void connection_unlink(connection *c) {
         c->sink_input = NULL;
     }
 
-    if (c->source_output) {
-        pa_source_output_unlink(c->source_output);
-        pa_source_output_unref(c->source_output);
-        c->source_output = NULL;
+    if (c->record) {
+        pa_source_fanout_reader_free(c->record);
+        c->record = NULL;
     }
 
     if (c->client) {
@@ -139,8 +138,6 @@ static void connection_free(pa_object *o) {
 
     if (c->input_memblockq)
         pa_memblockq_free(c->input_memblockq);
-    if (c->output_memblockq)
-        pa_memblockq_free(c->output_memblockq);
 
     pa_xfree(c);
 }
@@ -209,10 +206,10 @@ static int do_write(connection *c) {
 
     connection_assert_ref(c);
 
-    if (!c->source_output)
+    if (!c->record)
         return 0;
 
-    if (pa_memblockq_peek(c->output_memblockq, &chunk) < 0) {
+    if (pa_memblockq_peek(pa_source_fanout_reader_get_memblockq(c->record), &chunk) < 0) {
 /*         pa_log("peek failed"); */
         return 0;
     }
@@ -231,7 +228,7 @@ static int do_write(connection *c) {
         return -1;
     }
 
-    pa_memblockq_drop(c->output_memblockq, (size_t) r);
+    pa_memblockq_drop(pa_source_fanout_reader_get_memblockq(c->record), (size_t) r);
 
     return 1;
 }
@@ -286,12 +283,6 @@ static int connection_process_msg(pa_msgobject *o, int code, void*userdata, int6
             do_work(c);
             break;
 
-        case CONNECTION_MESSAGE_POST_DATA:
-/*             pa_log("got data %u", chunk->length); */
-            pa_memblockq_push_align(c->output_memblockq, chunk);
-            do_work(c);
-            break;
-
         case CONNECTION_MESSAGE_UNLINK_CONNECTION:
             connection_unlink(c);
             break;
@@ -415,36 +406,16 @@ static void sink_input_kill_cb(pa_sink_input *i) {
     connection_unlink(CONNECTION(i->userdata));
 }
 
-/*** source_output callbacks ***/
-
-/* Called from thread context */
-static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
-    connection *c;
-
-    pa_source_output_assert_ref(o);
-    c = CONNECTION(o->userdata);
-    pa_assert(c);
-    pa_assert(chunk);
-
-    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
-}
+/*** record callbacks ***/
 
 /* Called from main context */
-static void source_output_kill_cb(pa_source_output *o) {
-    pa_source_output_assert_ref(o);
-
-    connection_unlink(CONNECTION(o->userdata));
+static void record_data_cb(pa_source_fanout_reader *r, void *userdata) {
+    do_work(CONNECTION(userdata));
 }
 
 /* Called from main context */
-static pa_usec_t source_output_get_latency_cb(pa_source_output *o) {
-    connection*c;
-
-    pa_source_output_assert_ref(o);
-    c = CONNECTION(o->userdata);
-    pa_assert(c);
-
-    return pa_bytes_to_usec(pa_memblockq_get_length(c->output_memblockq), &c->source_output->sample_spec);
+static void record_kill_cb(pa_source_fanout_reader *r, void *userdata) {
+    connection_unlink(CONNECTION(userdata));
 }
 
 /*** client callbacks ***/
@@ -494,8 +465,8 @@ void pa_simple_protocol_connect(pa_simple_protocol *p, pa_iochannel *io, pa_simp
     pa_iochannel_set_callback(c->io, io_callback, c);
 
     c->sink_input = NULL;
-    c->source_output = NULL;
-    c->input_memblockq = c->output_memblockq = NULL;
+    c->record = NULL;
+    c->input_memblockq = NULL;
     c->protocol = p;
     c->options = pa_simple_options_ref(o);
     c->playback.current_memblock = NULL;
@@ -577,7 +548,6 @@ void pa_simple_protocol_connect(pa_simple_protocol *p, pa_iochannel *io, pa_simp
     }
 
     if (o->record) {
-        pa_source_output_new_data data;
         size_t l;
         pa_source *source;
 
@@ -586,42 +556,28 @@ void pa_simple_protocol_connect(pa_simple_protocol *p, pa_iochannel *io, pa_simp
             goto fail;
         }
 
-        pa_source_output_new_data_init(&data);
-        data.driver = __FILE__;
-        data.module = o->module;
-        data.client = c->client;
-        pa_source_output_new_data_set_source(&data, source, false);
-        pa_proplist_update(data.proplist, PA_UPDATE_MERGE, c->client->proplist);
-        pa_source_output_new_data_set_sample_spec(&data, &o->sample_spec);
-
-        pa_source_output_new(&c->source_output, p->core, &data);
-        pa_source_output_new_data_done(&data);
-
-        if (!c->source_output) {
+        /* All connections of this module recording the same source
+         * share the source output */
+        c->record = pa_source_fanout_reader_new(
+                p->core,
+                o->module,
+                source,
+                &o->sample_spec,
+                NULL,
+                "Simple protocol record stream",
+                DEFAULT_SOURCE_LATENCY,
+                RECORD_BUFFER_SECONDS * PA_USEC_PER_SEC,
+                record_data_cb,
+                record_kill_cb,
+                c);
+
+        if (!c->record) {
             pa_log("Failed to create source output.");
             goto fail;
         }
-        c->source_output->push = source_output_push_cb;
-        c->source_output->kill = source_output_kill_cb;
-        c->source_output->get_latency = source_output_get_latency_cb;
-        c->source_output->userdata = c;
-
-        pa_source_output_set_requested_latency(c->source_output, DEFAULT_SOURCE_LATENCY);
 
         l = (size_t) (pa_bytes_per_second(&o->sample_spec)*RECORD_BUFFER_SECONDS);
-        c->output_memblockq = pa_memblockq_new(
-                "simple protocol connection output_memblockq",
-                0,
-                l,
-                0,
-                &o->sample_spec,
-                1,
-                0,
-                0,
-                NULL);
         pa_iochannel_socket_set_sndbuf(io, l);
-
-        pa_source_output_put(c->source_output);
     }
 
     pa_idxset_put(p->connections, c, NULL);
@@ -28,16 +28,12 @@
 #include "pstream-util.h"
 
 static void pa_pstream_send_tagstruct_with_ancil_data(pa_pstream *p, pa_tagstruct *t, const pa_cmsg_ancil_data *ancil_data) {
-    size_t length;
-    const uint8_t *data;
     pa_packet *packet;
 
     pa_assert(p);
     pa_assert(t);
 
-    pa_assert_se(data = pa_tagstruct_data(t, &length));
-    pa_assert_se(packet = pa_packet_new_data(data, length));
-    pa_tagstruct_free(t);
+    pa_assert_se(packet = pa_tagstruct_free_to_packet(t));
 
     pa_pstream_send_packet(p, packet, ancil_data);
     pa_packet_unref(packet);
@@ -84,6 +80,39 @@ void pa_pstream_send_tagstruct_with_fds(pa_pstream *p, pa_tagstruct *t, int nfd,
 
 #endif
 
+/* The fd stays with the pool, which has to outlive the pstream since the
+ * fd is only passed on when the packet is actually written */
+int pa_pstream_register_memfd_mempool(pa_pstream *p, pa_mempool *pool) {
+#ifdef HAVE_CREDS
+    pa_tagstruct *t;
+    uint32_t shm_id;
+    int memfd_fd;
+
+    pa_assert(p);
+    pa_assert(pool);
+    pa_assert(pa_pstream_get_memfd(p));
+    pa_assert(pa_mempool_is_memfd_backed(pool));
+
+    if (pa_mempool_get_shm_id(pool, &shm_id) < 0)
+        return -1;
+
+    pa_assert_se((memfd_fd = pa_mempool_get_memfd_fd(pool)) >= 0);
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu32(t, PA_COMMAND_REGISTER_MEMFD_SHMID);
+    pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
+    pa_tagstruct_putu32(t, shm_id);
+    pa_tagstruct_put_boolean(t, pa_mempool_is_remote_writable(pool));
+    pa_pstream_send_tagstruct_with_fds(p, t, 1, &memfd_fd);
+
+    pa_pstream_set_memfd_mempool(p, pool);
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 void pa_pstream_send_error(pa_pstream *p, uint32_t tag, uint32_t error) {
     pa_tagstruct *t;
 
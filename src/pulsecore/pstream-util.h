@@ -31,6 +31,11 @@ void pa_pstream_send_tagstruct_with_fds(pa_pstream *p, pa_tagstruct *t, int nfd,
 
 #define pa_pstream_send_tagstruct(p, t) pa_pstream_send_tagstruct_with_creds((p), (t), NULL)
 
+/* Passes the fd of a memfd backed pool to the other side, so that its
+   blocks can be sent by reference on this pstream. memfd has to be
+   enabled on the pstream. */
+int pa_pstream_register_memfd_mempool(pa_pstream *p, pa_mempool *pool);
+
 void pa_pstream_send_error(pa_pstream *p, uint32_t tag, uint32_t error);
 void pa_pstream_send_simple_ack(pa_pstream *p, uint32_t tag);
 
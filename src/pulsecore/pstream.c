@@ -30,6 +30,8 @@
 #include <netinet/in.h>
 #endif
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/socket.h>
@@ -39,6 +41,9 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/pcm-codec.h>
+#include <pulsecore/core-rtclock.h>
 
 #include "pstream.h"
 
@@ -50,6 +55,9 @@
 #define PA_FLAG_SEEKMASK    0x000000FFLU
 #define PA_FLAG_SHMWRITABLE 0x00800000LU
 
+/* The payload of a memblock frame is coded with pa_pcm_codec */
+#define PA_FLAG_COMPRESSED  0x00400000LU
+
 /* The sequence descriptor header consists of 5 32bit integers: */
 enum {
     PA_PSTREAM_DESCRIPTOR_LENGTH,
@@ -75,6 +83,23 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
 
 #define MINIBUF_SIZE (256)
 
+/* Frames that fit in the minibuf are collected here and sent with a
+ * single write. The receiver parses the stream frame by frame anyway, so
+ * this needs no support on the other side. */
+#define BATCH_SIZE (4096)
+
+/* Reads from the iochannel fill the current frame and then this buffer,
+ * so that the next descriptor usually arrives with the previous frame */
+#define READAHEAD_SIZE (4096)
+
+/* Packets dispatched per main loop wakeup at most. Whatever a client
+ * sent beyond that waits for the next iteration, so that one client
+ * flooding us with commands doesn't hold up everybody else. The rest
+ * is picked up by a time event rather than the defer event, as the
+ * main loop doesn't dispatch IO events while defer events are
+ * pending. */
+#define PACKETS_PER_WAKEUP (8)
+
 /* To allow uploading a single sample in one frame, this value should be the
  * same size (16 MB) as PA_SCACHE_ENTRY_SIZE_MAX from pulsecore/core-scache.h.
  */
@@ -102,6 +127,7 @@ struct item_info {
     uint32_t channel;
     int64_t offset;
     pa_seek_mode_t seek_mode;
+    bool compressed;
 
     /* release/revoke info */
     uint32_t block_id;
@@ -139,14 +165,36 @@ struct pa_pstream {
         size_t index;
         int minibuf_validsize;
         pa_memchunk memchunk;
+
+        uint8_t batch[BATCH_SIZE];
+        size_t batch_length, batch_index;
     } write;
 
     struct pstream_read readio, readsrb;
 
+    struct {
+        uint8_t data[READAHEAD_SIZE];
+        size_t index, length;
+        bool enabled;
+    } readahead;
+
+    unsigned read_budget;
+    pa_time_event *read_event;
+    bool read_paused;
+
     bool use_shm;
     pa_memimport *import;
     pa_memexport *export;
 
+    /* The memfd pool registered with the other side, its blocks are
+     * exported through their own, persistent export */
+    bool use_memfd;
+    pa_mempool *memfd_pool;
+    pa_memexport *memfd_export;
+
+    /* Sample specs of the channels whose memblocks are sent compressed */
+    pa_hashmap *codecs;
+
     pa_pstream_packet_cb_t receive_packet_callback;
     void *receive_packet_callback_userdata;
 
@@ -183,15 +231,29 @@ static void do_pstream_read_write(pa_pstream *p) {
     pa_pstream_ref(p);
 
     p->mainloop->defer_enable(p->defer_event, 0);
+    p->read_budget = PACKETS_PER_WAKEUP;
 
     if (!p->dead && p->srb) {
          do_write(p);
-         while (!p->dead && do_read(p, &p->readsrb) == 0);
+         while (!p->dead && !p->read_paused && do_read(p, &p->readsrb) == 0);
     }
 
-    if (!p->dead && pa_iochannel_is_readable(p->io)) {
+    if (!p->dead && !p->read_paused && (pa_iochannel_is_readable(p->io) || p->readahead.index < p->readahead.length)) {
         if (do_read(p, &p->readio) < 0)
             goto fail;
+
+        /* No IO event will come for data we already have */
+        while (!p->dead && !p->read_paused && p->readahead.index < p->readahead.length && p->read_budget > 0)
+            if (do_read(p, &p->readio) < 0)
+                goto fail;
+
+        /* Whatever is left over, buffered or still in the socket (whose
+         * IO event stays off until we read from it), is for next time */
+        if (!p->dead && !p->read_paused && (p->readahead.index < p->readahead.length || pa_iochannel_is_readable(p->io))) {
+            struct timeval now;
+
+            p->mainloop->time_restart(p->read_event, pa_timeval_rtstore(&now, pa_rtclock_now(), true));
+        }
     } else if (!p->dead && pa_iochannel_is_hungup(p->io))
         goto fail;
 
@@ -247,8 +309,33 @@ static void defer_callback(pa_mainloop_api *m, pa_defer_event *e, void*userdata)
     do_pstream_read_write(p);
 }
 
+static void read_event_callback(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_pstream *p = userdata;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->read_event == e);
+
+    m->time_restart(e, NULL);
+    do_pstream_read_write(p);
+}
+
 static void memimport_release_cb(pa_memimport *i, uint32_t block_id, void *userdata);
 
+/* Ancillary data must be received together with the frame it was sent
+ * with, so reading ahead is only safe where there can't be any */
+static bool may_read_ahead(pa_iochannel *io) {
+#ifndef HAVE_SYS_UIO_H
+    return false;
+#elif defined(HAVE_CREDS)
+    int fd = pa_iochannel_get_recv_fd(io);
+
+    return fd >= 0 && (fd != pa_iochannel_get_send_fd(io) || !pa_iochannel_creds_supported(io));
+#else
+    return true;
+#endif
+}
+
 pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *pool) {
     pa_pstream *p;
 
@@ -260,10 +347,12 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     PA_REFCNT_INIT(p);
     p->io = io;
     pa_iochannel_set_callback(io, io_callback, p);
+    p->readahead.enabled = may_read_ahead(io);
 
     p->mainloop = m;
     p->defer_event = m->defer_new(m, defer_callback, p);
     m->defer_enable(p->defer_event, 0);
+    p->read_event = m->time_new(m, NULL, read_event_callback, p);
 
     p->send_queue = pa_queue_new();
 
@@ -319,6 +408,9 @@ static void pstream_free(pa_pstream *p) {
     if (p->readio.packet)
         pa_packet_unref(p->readio.packet);
 
+    if (p->codecs)
+        pa_hashmap_free(p->codecs);
+
     pa_xfree(p);
 }
 
@@ -356,6 +448,7 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, const pa_cmsg_ancil
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek_mode, const pa_memchunk *chunk) {
     size_t length, idx;
     size_t bsm;
+    const pa_sample_spec *codec = NULL;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
@@ -370,6 +463,9 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
 
     bsm = pa_mempool_block_size_max(p->mempool);
 
+    if (p->codecs)
+        codec = pa_hashmap_get(p->codecs, PA_UINT32_TO_PTR(channel));
+
     while (length > 0) {
         struct item_info *i;
         size_t n;
@@ -379,9 +475,26 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
         i->type = PA_PSTREAM_ITEM_MEMBLOCK;
 
         n = PA_MIN(length, bsm);
+
+        /* Each piece is coded on its own, so keep whole frames in it */
+        if (codec && n < length && n >= pa_frame_size(codec))
+            n -= n % pa_frame_size(codec);
+
         i->chunk.index = chunk->index + idx;
         i->chunk.length = n;
         i->chunk.memblock = pa_memblock_ref(chunk->memblock);
+        i->compressed = false;
+
+        if (codec) {
+            pa_memchunk encoded;
+
+            /* Data that does not get smaller is sent as it is */
+            if (pa_pcm_codec_encode(p->mempool, codec, &i->chunk, &encoded) >= 0) {
+                pa_memblock_unref(i->chunk.memblock);
+                i->chunk = encoded;
+                i->compressed = true;
+            }
+        }
 
         i->channel = channel;
         i->offset = offset;
@@ -526,7 +639,9 @@ static void prepare_next_write_item(pa_pstream *p) {
 
         flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
 
-        if (p->use_shm) {
+        if (p->write.current->compressed)
+            flags |= PA_FLAG_COMPRESSED;
+        else if (p->use_shm) {
             uint32_t block_id, shm_id;
             size_t offset, length;
             uint32_t *shm_info = (uint32_t *) &p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
@@ -536,10 +651,16 @@ static void prepare_next_write_item(pa_pstream *p) {
 
             if (p->mempool == current_pool)
                 pa_assert_se(current_export = p->export);
+            else if (p->memfd_pool == current_pool)
+                pa_assert_se(current_export = p->memfd_export);
+            else if (pa_mempool_is_memfd_backed(current_pool))
+                /* The other side never got the fd of this pool */
+                current_export = NULL;
             else
                 pa_assert_se(current_export = pa_memexport_new(current_pool, memexport_revoke_cb, p));
 
-            if (pa_memexport_put(current_export,
+            if (current_export &&
+                pa_memexport_put(current_export,
                                  p->write.current->chunk.memblock,
                                  &block_id,
                                  &shm_id,
@@ -562,7 +683,7 @@ static void prepare_next_write_item(pa_pstream *p) {
 /*             else */
 /*                 pa_log_warn("Failed to export memory block."); */
 
-            if (current_export != p->export)
+            if (current_export && current_export != p->export && current_export != p->memfd_export)
                 pa_memexport_free(current_export);
         }
 
@@ -581,6 +702,58 @@ static void prepare_next_write_item(pa_pstream *p) {
 #endif
 }
 
+/* Moves small frames from the queue into the batch buffer until one does
+ * not fit or needs ancillary data. That one is left prepared as the
+ * current item, to be written once the batch is out. */
+static void prepare_next_write_batch(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(!p->write.current);
+    pa_assert(p->write.batch_length == 0);
+
+    p->write.batch_index = 0;
+
+    for (;;) {
+        prepare_next_write_item(p);
+
+        if (!p->write.current)
+            return;
+
+        if (p->write.minibuf_validsize <= 0 ||
+            p->write.batch_length + (size_t) p->write.minibuf_validsize > BATCH_SIZE)
+            return;
+
+#ifdef HAVE_CREDS
+        if (p->send_ancil_data_now)
+            return;
+#endif
+
+        memcpy(p->write.batch + p->write.batch_length, p->write.minibuf, (size_t) p->write.minibuf_validsize);
+        p->write.batch_length += (size_t) p->write.minibuf_validsize;
+
+        item_free(p->write.current);
+        p->write.current = NULL;
+    }
+}
+
+static int write_data(pa_pstream *p, const void *d, size_t l, ssize_t *r) {
+    if (p->srb)
+        *r = pa_srbchannel_write(p->srb, d, l);
+    else if ((*r = pa_iochannel_write(p->io, d, l)) < 0)
+        return -1;
+
+    return 0;
+}
+
+static void *acquire_write_payload(pa_pstream *p, pa_memblock **release_memblock) {
+    pa_assert(p->write.data || p->write.memchunk.memblock);
+
+    if (p->write.data)
+        return p->write.data;
+
+    *release_memblock = p->write.memchunk.memblock;
+    return pa_memblock_acquire_chunk(&p->write.memchunk);
+}
+
 static void check_srbpending(pa_pstream *p) {
     if (!p->is_srbpending)
         return;
@@ -604,8 +777,26 @@ static int do_write(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (!p->write.current)
-        prepare_next_write_item(p);
+    if (!p->write.current && p->write.batch_length == 0)
+        prepare_next_write_batch(p);
+
+    if (p->write.batch_length > 0) {
+        l = p->write.batch_length - p->write.batch_index;
+
+        if (write_data(p, p->write.batch + p->write.batch_index, l, &r) < 0)
+            return -1;
+
+        p->write.batch_index += (size_t) r;
+
+        if (p->write.batch_index >= p->write.batch_length) {
+            p->write.batch_length = p->write.batch_index = 0;
+
+            if (p->drain_callback && !pa_pstream_is_pending(p))
+                p->drain_callback(p, p->drain_callback_userdata);
+        }
+
+        return (size_t) r == l ? 1 : 0;
+    }
 
     if (!p->write.current) {
         /* The out queue is empty, so switching channels is safe */
@@ -620,16 +811,7 @@ static int do_write(pa_pstream *p) {
         d = (uint8_t*) p->write.descriptor + p->write.index;
         l = PA_PSTREAM_DESCRIPTOR_SIZE - p->write.index;
     } else {
-        pa_assert(p->write.data || p->write.memchunk.memblock);
-
-        if (p->write.data)
-            d = p->write.data;
-        else {
-            d = pa_memblock_acquire_chunk(&p->write.memchunk);
-            release_memblock = p->write.memchunk.memblock;
-        }
-
-        d = (uint8_t*) d + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
+        d = (uint8_t*) acquire_write_payload(p, &release_memblock) + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
         l = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
     }
 
@@ -648,9 +830,25 @@ static int do_write(pa_pstream *p) {
         p->send_ancil_data_now = false;
     } else
 #endif
-    if (p->srb)
-        r = pa_srbchannel_write(p->srb, d, l);
-    else if ((r = pa_iochannel_write(p->io, d, l)) < 0)
+#ifdef HAVE_SYS_UIO_H
+    if (!p->srb &&
+        p->write.minibuf_validsize <= 0 &&
+        p->write.index < PA_PSTREAM_DESCRIPTOR_SIZE &&
+        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] != 0) {
+        struct iovec iov[2];
+
+        /* Send the rest of the descriptor and the payload at once */
+        iov[0].iov_base = d;
+        iov[0].iov_len = l;
+        iov[1].iov_base = acquire_write_payload(p, &release_memblock);
+        iov[1].iov_len = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+        l += iov[1].iov_len;
+
+        if ((r = pa_iochannel_writev(p->io, iov, 2)) < 0)
+            goto fail;
+    } else
+#endif
+    if (write_data(p, d, l, &r) < 0)
         goto fail;
 
     if (release_memblock)
@@ -682,17 +880,32 @@ fail:
     return -1;
 }
 
-static void memblock_complete(pa_pstream *p, struct pstream_read *re) {
+static int memblock_complete(pa_pstream *p, struct pstream_read *re) {
     pa_memchunk chunk;
     int64_t offset;
 
     if (!p->receive_memblock_callback)
-        return;
+        return 0;
 
     chunk.memblock = re->memblock;
     chunk.index = 0;
     chunk.length = re->index - PA_PSTREAM_DESCRIPTOR_SIZE;
 
+    if (ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_COMPRESSED) {
+        void *d;
+
+        d = pa_memblock_acquire(re->memblock);
+        chunk.memblock = pa_pcm_codec_decode(p->mempool, d, chunk.length);
+        pa_memblock_release(re->memblock);
+
+        if (!chunk.memblock) {
+            pa_log_warn("Received memblock frame with invalid compressed data.");
+            return -1;
+        }
+
+        chunk.length = pa_memblock_get_length(chunk.memblock);
+    }
+
     offset = (int64_t) (
              (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
              (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
@@ -704,8 +917,35 @@ static void memblock_complete(pa_pstream *p, struct pstream_read *re) {
         ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
         &chunk,
         p->receive_memblock_callback_userdata);
+
+    if (chunk.memblock != re->memblock)
+        pa_memblock_unref(chunk.memblock);
+
+    return 0;
 }
 
+#ifdef HAVE_SYS_UIO_H
+static ssize_t read_ahead(pa_pstream *p, void *d, size_t l) {
+    struct iovec iov[2];
+    ssize_t r;
+
+    pa_assert(p->readahead.index >= p->readahead.length);
+
+    iov[0].iov_base = d;
+    iov[0].iov_len = l;
+    iov[1].iov_base = p->readahead.data;
+    iov[1].iov_len = READAHEAD_SIZE;
+
+    if ((r = pa_iochannel_readv(p->io, iov, 2)) <= (ssize_t) l)
+        return r;
+
+    p->readahead.index = 0;
+    p->readahead.length = (size_t) r - l;
+
+    return (ssize_t) l;
+}
+#endif
+
 static int do_read(pa_pstream *p, struct pstream_read *re) {
     void *d;
     size_t l;
@@ -738,7 +978,17 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
                 pa_memblock_release(release_memblock);
             return 1;
         }
+    } else if (p->readahead.index < p->readahead.length) {
+        r = (ssize_t) PA_MIN(l, p->readahead.length - p->readahead.index);
+        memcpy(d, p->readahead.data + p->readahead.index, (size_t) r);
+        p->readahead.index += (size_t) r;
     }
+#ifdef HAVE_SYS_UIO_H
+    else if (p->readahead.enabled) {
+        if ((r = read_ahead(p, d, l)) <= 0)
+            goto fail;
+    }
+#endif
     else
 #ifdef HAVE_CREDS
     {
@@ -785,7 +1035,8 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
 /*             pa_log("Got release frame for %u", ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])); */
 
             pa_assert(p->export);
-            pa_memexport_process_release(p->export, ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI]));
+            if (pa_memexport_process_release(p->export, ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) < 0 && p->memfd_export)
+                pa_memexport_process_release(p->memfd_export, ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI]));
 
             goto frame_done;
 
@@ -833,7 +1084,7 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
 
             if ((flags & PA_FLAG_SHMMASK) == PA_FLAG_SHMDATA) {
 
-                if (length != sizeof(re->shm_info)) {
+                if (length != sizeof(re->shm_info) || (flags & PA_FLAG_COMPRESSED)) {
                     pa_log_warn("Received SHM memblock frame with invalid frame length.");
                     return -1;
                 }
@@ -843,7 +1094,7 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
 
             } else if ((flags & PA_FLAG_SHMMASK) == 0) {
 
-                /* Frame is a memblock frame */
+                /* Frame is a memblock frame, possibly compressed */
 
                 re->memblock = pa_memblock_new(p->mempool, length);
                 re->data = NULL;
@@ -858,11 +1109,16 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
         /* Frame complete */
 
         if (re->memblock) {
-            memblock_complete(p, re);
+            int ret = memblock_complete(p, re);
 
             /* This was a memblock frame. We can unref the memblock now */
             pa_memblock_unref(re->memblock);
 
+            if (ret < 0) {
+                re->memblock = NULL;
+                return -1;
+            }
+
         } else if (re->packet) {
 
             if (p->receive_packet_callback)
@@ -873,6 +1129,9 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
 #endif
 
             pa_packet_unref(re->packet);
+
+            if (p->read_budget > 0)
+                p->read_budget--;
         } else {
             pa_memblock *b;
             uint32_t flags = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]);
@@ -998,7 +1257,7 @@ bool pa_pstream_is_pending(pa_pstream *p) {
     if (p->dead)
         b = false;
     else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        b = p->write.current || p->write.batch_length > 0 || !pa_queue_isempty(p->send_queue);
 
     return b;
 }
@@ -1040,6 +1299,11 @@ void pa_pstream_unlink(pa_pstream *p) {
         p->export = NULL;
     }
 
+    if (p->memfd_export) {
+        pa_memexport_free(p->memfd_export);
+        p->memfd_export = NULL;
+    }
+
     if (p->io) {
         pa_iochannel_free(p->io);
         p->io = NULL;
@@ -1050,6 +1314,11 @@ void pa_pstream_unlink(pa_pstream *p) {
         p->defer_event = NULL;
     }
 
+    if (p->read_event) {
+        p->mainloop->time_free(p->read_event);
+        p->read_event = NULL;
+    }
+
     p->die_callback = NULL;
     p->drain_callback = NULL;
     p->receive_packet_callback = NULL;
@@ -1073,6 +1342,14 @@ void pa_pstream_enable_shm(pa_pstream *p, bool enable) {
             pa_memexport_free(p->export);
             p->export = NULL;
         }
+
+        if (p->memfd_export) {
+            pa_memexport_free(p->memfd_export);
+            p->memfd_export = NULL;
+        }
+
+        p->use_memfd = false;
+        p->memfd_pool = NULL;
     }
 }
 
@@ -1083,6 +1360,81 @@ bool pa_pstream_get_shm(pa_pstream *p) {
     return p->use_shm;
 }
 
+void pa_pstream_enable_memfd(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->use_shm);
+
+    p->use_memfd = true;
+}
+
+bool pa_pstream_get_memfd(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    return p->use_memfd;
+}
+
+void pa_pstream_set_memfd_mempool(pa_pstream *p, pa_mempool *pool) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->use_memfd);
+    pa_assert(pool);
+    pa_assert(pa_mempool_is_memfd_backed(pool));
+    pa_assert(!p->memfd_pool);
+
+    p->memfd_pool = pool;
+    p->memfd_export = pa_memexport_new(pool, memexport_revoke_cb, p);
+}
+
+int pa_pstream_attach_memfd_shmid(pa_pstream *p, unsigned shm_id, int memfd_fd, bool writable) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(memfd_fd >= 0);
+
+    if (!p->use_memfd) {
+        pa_log_warn("Received memfd registration on a socket where memfd is disabled.");
+        return -1;
+    }
+
+    return pa_memimport_attach_memfd(p->import, shm_id, memfd_fd, writable);
+}
+
+void pa_pstream_set_read_paused(pa_pstream *p, bool paused) {
+    struct timeval now;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    if (p->read_paused == paused)
+        return;
+
+    p->read_paused = paused;
+
+    /* Catch up with what arrived in the meantime */
+    if (!paused && p->read_event)
+        p->mainloop->time_restart(p->read_event, pa_timeval_rtstore(&now, pa_rtclock_now(), true));
+}
+
+void pa_pstream_set_codec(pa_pstream *p, uint32_t channel, const pa_sample_spec *ss) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(channel != (uint32_t) -1);
+    pa_assert(!ss || pa_pcm_codec_supported(ss));
+
+    if (!ss) {
+        if (p->codecs)
+            pa_hashmap_remove_and_free(p->codecs, PA_UINT32_TO_PTR(channel));
+        return;
+    }
+
+    if (!p->codecs)
+        p->codecs = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, pa_xfree);
+
+    pa_hashmap_remove_and_free(p->codecs, PA_UINT32_TO_PTR(channel));
+    pa_hashmap_put(p->codecs, PA_UINT32_TO_PTR(channel), pa_xnewdup(pa_sample_spec, ss, 1));
+}
+
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0 || srb == NULL);
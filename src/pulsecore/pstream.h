@@ -65,6 +65,25 @@ bool pa_pstream_is_pending(pa_pstream *p);
 void pa_pstream_enable_shm(pa_pstream *p, bool enable);
 bool pa_pstream_get_shm(pa_pstream *p);
 
+/* memfd pools need SHM to be enabled first. Blocks of the registered
+   memfd pool are sent by reference, blocks of any other memfd pool are
+   copied into the stream since the other side cannot map them. */
+void pa_pstream_enable_memfd(pa_pstream *p);
+bool pa_pstream_get_memfd(pa_pstream *p);
+void pa_pstream_set_memfd_mempool(pa_pstream *p, pa_mempool *pool);
+
+/* Maps the memfd pool the other side registered. The fd is not kept. */
+int pa_pstream_attach_memfd_shmid(pa_pstream *p, unsigned shm_id, int memfd_fd, bool writable);
+
+/* Stops dispatching received packets and memblocks until reading is
+   resumed. Data keeps queueing up in the socket in the meantime. */
+void pa_pstream_set_read_paused(pa_pstream *p, bool paused);
+
+/* Sends the memblocks of a channel coded with pa_pcm_codec from now on,
+   the other side decodes them without further setup. Setting ss to NULL
+   goes back to sending the data as it is. */
+void pa_pstream_set_codec(pa_pstream *p, uint32_t channel, const pa_sample_spec *ss);
+
 /* Enables shared ringbuffer channel. Note that the srbchannel is now owned by the pstream.
    Setting srb to NULL will free any existing srbchannel. */
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb);
@@ -0,0 +1,337 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "remap.h"
+
+#include <immintrin.h>
+
+/* Number of samples per vector */
+#define LANES 8
+
+/* Output frames of up to this many vectors are computed in registers */
+#define MAX_VECTORS 4
+
+static pa_init_remap_func_t fallback_init;
+
+/* The matrix kernels compute one output frame at a time. For every input
+ * channel they multiply the input sample with the coefficients of all
+ * output channels for it, n_ov vectors, and accumulate. The state holds
+ * these coefficients: one row of n_ov * LANES values per input channel,
+ * zero in the lanes past the last output channel. */
+static unsigned matrix_vectors(const pa_remap_t *m) {
+    return (m->o_ss.channels + LANES - 1) / LANES;
+}
+
+/* Computes full frames as long as the stores stay inside the buffer and
+ * returns how many. Each frame stores n_ov full vectors; what is stored
+ * past the frame is overwritten by the next one. Called with a constant
+ * n_ov so that the accumulators are kept in registers. */
+static inline unsigned matrix_float32ne(pa_remap_t *m, float *dst, const float *src, unsigned n, const unsigned n_ov) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const float *coeffs = m->state;
+    unsigned i, ic, v;
+
+    for (i = 0; (n - i) * n_oc >= n_ov * LANES; i++) {
+        __m256 acc[MAX_VECTORS];
+
+        for (v = 0; v < n_ov; v++)
+            acc[v] = _mm256_setzero_ps();
+
+        for (ic = 0; ic < n_ic; ic++) {
+            const float *c = coeffs + ic * n_ov * LANES;
+            __m256 s = _mm256_set1_ps(src[ic]);
+
+            for (v = 0; v < n_ov; v++)
+                acc[v] = _mm256_add_ps(acc[v], _mm256_mul_ps(s, _mm256_loadu_ps(c + v * LANES)));
+        }
+
+        for (v = 0; v < n_ov; v++)
+            _mm256_storeu_ps(dst + v * LANES, acc[v]);
+
+        src += n_ic;
+        dst += n_oc;
+    }
+
+    return i;
+}
+
+static void remap_matrix_float32ne_avx2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const unsigned n_ov = matrix_vectors(m);
+    const float *coeffs = m->state;
+    unsigned i, ic, oc;
+
+    switch (n_ov) {
+        case 1: i = matrix_float32ne(m, dst, src, n, 1); break;
+        case 2: i = matrix_float32ne(m, dst, src, n, 2); break;
+        case 3: i = matrix_float32ne(m, dst, src, n, 3); break;
+        case 4: i = matrix_float32ne(m, dst, src, n, 4); break;
+        default: i = 0; break;
+    }
+
+    src += i * n_ic;
+    dst += i * n_oc;
+
+    /* The last frames, and all frames of very many output channels */
+    for (n -= i; n > 0; n--) {
+        for (oc = 0; oc < n_oc; oc++) {
+            float sum = 0.0f;
+
+            for (ic = 0; ic < n_ic; ic++)
+                sum += src[ic] * coeffs[ic * n_ov * LANES + oc];
+
+            dst[oc] = sum;
+        }
+
+        src += n_ic;
+        dst += n_oc;
+    }
+}
+
+/* Saturates the lanes to 16 bits, in order */
+static inline __m128i pack_s16(__m256i x) {
+    return _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+}
+
+/* Like the generic code every product is scaled down before summing. Each
+ * vector is stored as LANES 16 bit samples, see above. */
+static inline unsigned matrix_s16ne(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n, const unsigned n_ov) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const int32_t *coeffs = m->state;
+    unsigned i, ic, v;
+
+    for (i = 0; (n - i) * n_oc >= n_ov * LANES; i++) {
+        __m256i acc[MAX_VECTORS];
+
+        for (v = 0; v < n_ov; v++)
+            acc[v] = _mm256_setzero_si256();
+
+        for (ic = 0; ic < n_ic; ic++) {
+            const int32_t *c = coeffs + ic * n_ov * LANES;
+            __m256i s = _mm256_set1_epi32(src[ic]);
+
+            for (v = 0; v < n_ov; v++) {
+                __m256i p = _mm256_mullo_epi32(s, _mm256_loadu_si256((const __m256i*) (c + v * LANES)));
+                acc[v] = _mm256_add_epi32(acc[v], _mm256_srai_epi32(p, 16));
+            }
+        }
+
+        for (v = 0; v < n_ov; v++)
+            _mm_storeu_si128((__m128i*) (dst + v * LANES), pack_s16(acc[v]));
+
+        src += n_ic;
+        dst += n_oc;
+    }
+
+    return i;
+}
+
+static void remap_matrix_s16ne_avx2(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const unsigned n_ov = matrix_vectors(m);
+    const int32_t *coeffs = m->state;
+    unsigned i, ic, oc;
+
+    switch (n_ov) {
+        case 1: i = matrix_s16ne(m, dst, src, n, 1); break;
+        case 2: i = matrix_s16ne(m, dst, src, n, 2); break;
+        case 3: i = matrix_s16ne(m, dst, src, n, 3); break;
+        case 4: i = matrix_s16ne(m, dst, src, n, 4); break;
+        default: i = 0; break;
+    }
+
+    src += i * n_ic;
+    dst += i * n_oc;
+
+    for (n -= i; n > 0; n--) {
+        for (oc = 0; oc < n_oc; oc++) {
+            int32_t sum = 0;
+
+            for (ic = 0; ic < n_ic; ic++)
+                sum += (src[ic] * coeffs[ic * n_ov * LANES + oc]) >> 16;
+
+            dst[oc] = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        }
+
+        src += n_ic;
+        dst += n_oc;
+    }
+}
+
+/* Negative and zero coefficients are skipped by the generic code, and
+ * coefficients above one are taken as one */
+static void setup_matrix_avx2(pa_remap_t *m) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const unsigned n_ov = matrix_vectors(m);
+    unsigned ic, oc;
+
+    if (m->format == PA_SAMPLE_FLOAT32NE) {
+        float *coeffs = pa_xnew0(float, n_ic * n_ov * LANES);
+
+        for (ic = 0; ic < n_ic; ic++)
+            for (oc = 0; oc < n_oc; oc++)
+                coeffs[ic * n_ov * LANES + oc] = PA_CLAMP(m->map_table_f[oc][ic], 0.0f, 1.0f);
+
+        m->state = coeffs;
+    } else {
+        int32_t *coeffs = pa_xnew0(int32_t, n_ic * n_ov * LANES);
+
+        for (ic = 0; ic < n_ic; ic++)
+            for (oc = 0; oc < n_oc; oc++)
+                coeffs[ic * n_ov * LANES + oc] = PA_CLAMP(m->map_table_i[oc][ic], 0, 0x10000);
+
+        m->state = coeffs;
+    }
+}
+
+/* Float samples are moved with a lane permutation, as many frames as
+ * fit in a vector at a time. The 16 bit samples are left to the SSE4.1
+ * byte shuffle. */
+struct remap_arrange {
+    int32_t permute[LANES];
+    int32_t mask[LANES];
+    unsigned frames;
+    int8_t arrange[PA_CHANNELS_MAX];
+};
+
+static void remap_arrange_float32ne_avx2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const struct remap_arrange *a = m->state;
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const __m256i permute = _mm256_loadu_si256((const __m256i*) a->permute);
+    const __m256 mask = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*) a->mask));
+    unsigned oc;
+
+    /* Full vectors are loaded and stored, make sure they stay inside the
+     * buffers */
+    for (; n >= a->frames && n * n_ic >= LANES && n * n_oc >= LANES; n -= a->frames) {
+        __m256 s = _mm256_permutevar8x32_ps(_mm256_loadu_ps(src), permute);
+
+        _mm256_storeu_ps(dst, _mm256_and_ps(s, mask));
+
+        src += a->frames * n_ic;
+        dst += a->frames * n_oc;
+    }
+
+    for (; n > 0; n--) {
+        for (oc = 0; oc < n_oc; oc++)
+            dst[oc] = a->arrange[oc] >= 0 ? src[a->arrange[oc]] : 0.0f;
+
+        src += n_ic;
+        dst += n_oc;
+    }
+}
+
+/* Returns how many frames fit in a vector, zero if not even one does */
+static unsigned arrange_frames_avx2(const pa_remap_t *m) {
+    return LANES / PA_MAX(m->i_ss.channels, m->o_ss.channels);
+}
+
+static void setup_arrange_avx2(pa_remap_t *m, const int8_t arrange[PA_CHANNELS_MAX]) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    struct remap_arrange *a;
+    unsigned f, oc;
+
+    a = pa_xnew0(struct remap_arrange, 1);
+    a->frames = arrange_frames_avx2(m);
+    pa_assert(a->frames > 0);
+    memcpy(a->arrange, arrange, sizeof(a->arrange));
+
+    for (f = 0; f < a->frames; f++)
+        for (oc = 0; oc < n_oc; oc++)
+            if (arrange[oc] >= 0) {
+                a->permute[f * n_oc + oc] = f * n_ic + arrange[oc];
+                a->mask[f * n_oc + oc] = -1;
+            }
+
+    m->state = a;
+}
+
+/* set the function that will execute the remapping based on the matrices */
+static void init_remap_avx2(pa_remap_t *m) {
+    unsigned n_oc, n_ic;
+    int8_t arrange[PA_CHANNELS_MAX];
+
+    n_oc = m->o_ss.channels;
+    n_ic = m->i_ss.channels;
+
+    /* Downmixing to mono leaves most lanes unused, the previously
+     * installed functions are faster there. They are at least as fast
+     * for duplicating a mono channel too. */
+    if (n_oc == 1) {
+        fallback_init(m);
+        return;
+    }
+
+    if (n_ic == 1 && (n_oc == 2 || n_oc == 4)) {
+        unsigned oc;
+
+        for (oc = 0; oc < n_oc; oc++)
+            if (m->map_table_i[oc][0] != 0x10000)
+                break;
+
+        if (oc == n_oc) {
+            fallback_init(m);
+            return;
+        }
+    }
+
+    if (pa_setup_remap_arrange(m, arrange)) {
+        unsigned frames = arrange_frames_avx2(m);
+
+        /* 16 bit samples are left to the byte shuffle of SSE4.1. The
+         * generic code only copies the used channels, which beats the
+         * matrix for frames too large for the permutation. With a single
+         * frame per vector its code for two or four output channels is
+         * faster too. */
+        if (m->format == PA_SAMPLE_S16NE || frames == 0 || (frames < 2 && (n_oc == 2 || n_oc == 4))) {
+            fallback_init(m);
+            return;
+        }
+
+        pa_log_info("Using AVX2 arrange remapping");
+        setup_arrange_avx2(m, arrange);
+        m->do_remap = (pa_do_remap_func_t) remap_arrange_float32ne_avx2;
+        return;
+    }
+
+    pa_log_info("Using AVX2 matrix remapping");
+    setup_matrix_avx2(m);
+    pa_set_remap_func(m, (pa_do_remap_func_t) remap_matrix_s16ne_avx2,
+        (pa_do_remap_func_t) remap_matrix_float32ne_avx2);
+}
+
+void pa_remap_func_init_avx2(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_AVX2))
+        return;
+
+    pa_log_info("Initialising AVX2 optimized remappers.");
+
+    fallback_init = pa_get_init_remap_func();
+    pa_set_init_remap_func(init_remap_avx2);
+}
@@ -0,0 +1,340 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "remap.h"
+
+#include <smmintrin.h>
+
+/* Number of samples per vector */
+#define LANES 4
+
+/* Bytes per vector */
+#define VECTOR_SIZE 16
+
+/* Output frames of up to this many vectors are computed in registers */
+#define MAX_VECTORS 4
+
+static pa_init_remap_func_t fallback_init;
+
+/* The matrix kernels compute one output frame at a time. For every input
+ * channel they multiply the input sample with the coefficients of all
+ * output channels for it, n_ov vectors, and accumulate. The state holds
+ * these coefficients: one row of n_ov * LANES values per input channel,
+ * zero in the lanes past the last output channel. */
+static unsigned matrix_vectors(const pa_remap_t *m) {
+    return (m->o_ss.channels + LANES - 1) / LANES;
+}
+
+/* Computes full frames as long as the stores stay inside the buffer and
+ * returns how many. Each frame stores n_ov full vectors; what is stored
+ * past the frame is overwritten by the next one. Called with a constant
+ * n_ov so that the accumulators are kept in registers. */
+static inline unsigned matrix_float32ne(pa_remap_t *m, float *dst, const float *src, unsigned n, const unsigned n_ov) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const float *coeffs = m->state;
+    unsigned i, ic, v;
+
+    for (i = 0; (n - i) * n_oc >= n_ov * LANES; i++) {
+        __m128 acc[MAX_VECTORS];
+
+        for (v = 0; v < n_ov; v++)
+            acc[v] = _mm_setzero_ps();
+
+        for (ic = 0; ic < n_ic; ic++) {
+            const float *c = coeffs + ic * n_ov * LANES;
+            __m128 s = _mm_set1_ps(src[ic]);
+
+            for (v = 0; v < n_ov; v++)
+                acc[v] = _mm_add_ps(acc[v], _mm_mul_ps(s, _mm_loadu_ps(c + v * LANES)));
+        }
+
+        for (v = 0; v < n_ov; v++)
+            _mm_storeu_ps(dst + v * LANES, acc[v]);
+
+        src += n_ic;
+        dst += n_oc;
+    }
+
+    return i;
+}
+
+static void remap_matrix_float32ne_sse4(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const unsigned n_ov = matrix_vectors(m);
+    const float *coeffs = m->state;
+    unsigned i, ic, oc;
+
+    switch (n_ov) {
+        case 1: i = matrix_float32ne(m, dst, src, n, 1); break;
+        case 2: i = matrix_float32ne(m, dst, src, n, 2); break;
+        case 3: i = matrix_float32ne(m, dst, src, n, 3); break;
+        case 4: i = matrix_float32ne(m, dst, src, n, 4); break;
+        default: i = 0; break;
+    }
+
+    src += i * n_ic;
+    dst += i * n_oc;
+
+    /* The last frames, and all frames of very many output channels */
+    for (n -= i; n > 0; n--) {
+        for (oc = 0; oc < n_oc; oc++) {
+            float sum = 0.0f;
+
+            for (ic = 0; ic < n_ic; ic++)
+                sum += src[ic] * coeffs[ic * n_ov * LANES + oc];
+
+            dst[oc] = sum;
+        }
+
+        src += n_ic;
+        dst += n_oc;
+    }
+}
+
+/* Like the generic code every product is scaled down before summing. Each
+ * vector is stored as LANES 16 bit samples, see above. */
+static inline unsigned matrix_s16ne(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n, const unsigned n_ov) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const int32_t *coeffs = m->state;
+    unsigned i, ic, v;
+
+    for (i = 0; (n - i) * n_oc >= n_ov * LANES; i++) {
+        __m128i acc[MAX_VECTORS];
+
+        for (v = 0; v < n_ov; v++)
+            acc[v] = _mm_setzero_si128();
+
+        for (ic = 0; ic < n_ic; ic++) {
+            const int32_t *c = coeffs + ic * n_ov * LANES;
+            __m128i s = _mm_set1_epi32(src[ic]);
+
+            for (v = 0; v < n_ov; v++) {
+                __m128i p = _mm_mullo_epi32(s, _mm_loadu_si128((const __m128i*) (c + v * LANES)));
+                acc[v] = _mm_add_epi32(acc[v], _mm_srai_epi32(p, 16));
+            }
+        }
+
+        for (v = 0; v < n_ov; v++)
+            _mm_storel_epi64((__m128i*) (dst + v * LANES), _mm_packs_epi32(acc[v], acc[v]));
+
+        src += n_ic;
+        dst += n_oc;
+    }
+
+    return i;
+}
+
+static void remap_matrix_s16ne_sse4(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const unsigned n_ov = matrix_vectors(m);
+    const int32_t *coeffs = m->state;
+    unsigned i, ic, oc;
+
+    switch (n_ov) {
+        case 1: i = matrix_s16ne(m, dst, src, n, 1); break;
+        case 2: i = matrix_s16ne(m, dst, src, n, 2); break;
+        case 3: i = matrix_s16ne(m, dst, src, n, 3); break;
+        case 4: i = matrix_s16ne(m, dst, src, n, 4); break;
+        default: i = 0; break;
+    }
+
+    src += i * n_ic;
+    dst += i * n_oc;
+
+    for (n -= i; n > 0; n--) {
+        for (oc = 0; oc < n_oc; oc++) {
+            int32_t sum = 0;
+
+            for (ic = 0; ic < n_ic; ic++)
+                sum += (src[ic] * coeffs[ic * n_ov * LANES + oc]) >> 16;
+
+            dst[oc] = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        }
+
+        src += n_ic;
+        dst += n_oc;
+    }
+}
+
+/* Negative and zero coefficients are skipped by the generic code, and
+ * coefficients above one are taken as one */
+static void setup_matrix_sse4(pa_remap_t *m) {
+    const unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    const unsigned n_ov = matrix_vectors(m);
+    unsigned ic, oc;
+
+    if (m->format == PA_SAMPLE_FLOAT32NE) {
+        float *coeffs = pa_xnew0(float, n_ic * n_ov * LANES);
+
+        for (ic = 0; ic < n_ic; ic++)
+            for (oc = 0; oc < n_oc; oc++)
+                coeffs[ic * n_ov * LANES + oc] = PA_CLAMP(m->map_table_f[oc][ic], 0.0f, 1.0f);
+
+        m->state = coeffs;
+    } else {
+        int32_t *coeffs = pa_xnew0(int32_t, n_ic * n_ov * LANES);
+
+        for (ic = 0; ic < n_ic; ic++)
+            for (oc = 0; oc < n_oc; oc++)
+                coeffs[ic * n_ov * LANES + oc] = PA_CLAMP(m->map_table_i[oc][ic], 0, 0x10000);
+
+        m->state = coeffs;
+    }
+}
+
+/* The arrange kernels move the samples of as many frames as fit in a
+ * vector with a single byte shuffle */
+struct remap_arrange {
+    uint8_t shuffle[VECTOR_SIZE];
+    unsigned frames;
+    int8_t arrange[PA_CHANNELS_MAX];
+};
+
+static void remap_arrange_sse4(pa_remap_t *m, uint8_t *dst, const uint8_t *src, unsigned n) {
+    const struct remap_arrange *a = m->state;
+    const size_t sample_size = m->format == PA_SAMPLE_FLOAT32NE ? sizeof(float) : sizeof(int16_t);
+    const size_t i_fs = m->i_ss.channels * sample_size, o_fs = m->o_ss.channels * sample_size;
+    const __m128i shuffle = _mm_loadu_si128((const __m128i*) a->shuffle);
+    unsigned oc;
+
+    /* Full vectors are loaded and stored, make sure they stay inside the
+     * buffers */
+    for (; n >= a->frames && n * i_fs >= VECTOR_SIZE && n * o_fs >= VECTOR_SIZE; n -= a->frames) {
+        _mm_storeu_si128((__m128i*) dst, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) src), shuffle));
+
+        src += a->frames * i_fs;
+        dst += a->frames * o_fs;
+    }
+
+    for (; n > 0; n--) {
+        for (oc = 0; oc < m->o_ss.channels; oc++) {
+            if (a->arrange[oc] >= 0)
+                memcpy(dst + oc * sample_size, src + a->arrange[oc] * sample_size, sample_size);
+            else
+                memset(dst + oc * sample_size, 0, sample_size);
+        }
+
+        src += i_fs;
+        dst += o_fs;
+    }
+}
+
+/* Returns how many frames fit in a vector, zero if not even one does */
+static unsigned arrange_frames_sse4(const pa_remap_t *m) {
+    const size_t sample_size = m->format == PA_SAMPLE_FLOAT32NE ? sizeof(float) : sizeof(int16_t);
+
+    return VECTOR_SIZE / (PA_MAX(m->i_ss.channels, m->o_ss.channels) * sample_size);
+}
+
+static void setup_arrange_sse4(pa_remap_t *m, const int8_t arrange[PA_CHANNELS_MAX]) {
+    const size_t sample_size = m->format == PA_SAMPLE_FLOAT32NE ? sizeof(float) : sizeof(int16_t);
+    const size_t i_fs = m->i_ss.channels * sample_size, o_fs = m->o_ss.channels * sample_size;
+    struct remap_arrange *a;
+    unsigned f, oc, b;
+
+    a = pa_xnew0(struct remap_arrange, 1);
+    a->frames = arrange_frames_sse4(m);
+    pa_assert(a->frames > 0);
+    memcpy(a->arrange, arrange, sizeof(a->arrange));
+
+    /* Bytes with the high bit set are cleared by the shuffle */
+    memset(a->shuffle, 0x80, sizeof(a->shuffle));
+
+    for (f = 0; f < a->frames; f++)
+        for (oc = 0; oc < m->o_ss.channels; oc++)
+            if (arrange[oc] >= 0)
+                for (b = 0; b < sample_size; b++)
+                    a->shuffle[f * o_fs + oc * sample_size + b] = (uint8_t) (f * i_fs + arrange[oc] * sample_size + b);
+
+    m->state = a;
+}
+
+/* set the function that will execute the remapping based on the matrices */
+static void init_remap_sse4(pa_remap_t *m) {
+    unsigned n_oc, n_ic;
+    int8_t arrange[PA_CHANNELS_MAX];
+
+    n_oc = m->o_ss.channels;
+    n_ic = m->i_ss.channels;
+
+    /* Downmixing to mono leaves most lanes unused, the previously
+     * installed functions are faster there. They are at least as fast
+     * for duplicating a mono channel too. */
+    if (n_oc == 1) {
+        fallback_init(m);
+        return;
+    }
+
+    if (n_ic == 1 && (n_oc == 2 || n_oc == 4)) {
+        unsigned oc;
+
+        for (oc = 0; oc < n_oc; oc++)
+            if (m->map_table_i[oc][0] != 0x10000)
+                break;
+
+        if (oc == n_oc) {
+            fallback_init(m);
+            return;
+        }
+    }
+
+    if (pa_setup_remap_arrange(m, arrange)) {
+        unsigned frames = arrange_frames_sse4(m);
+
+        /* The generic code only copies the used channels, which beats
+         * the matrix for frames too large for the shuffle. With a single
+         * frame per vector its code for two or four output channels is
+         * faster too. */
+        if (frames == 0 || (frames < 2 && (n_oc == 2 || n_oc == 4))) {
+            fallback_init(m);
+            return;
+        }
+
+        pa_log_info("Using SSE4.1 arrange remapping");
+        setup_arrange_sse4(m, arrange);
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_arrange_sse4,
+            (pa_do_remap_func_t) remap_arrange_sse4);
+        return;
+    }
+
+    pa_log_info("Using SSE4.1 matrix remapping");
+    setup_matrix_sse4(m);
+    pa_set_remap_func(m, (pa_do_remap_func_t) remap_matrix_s16ne_sse4,
+        (pa_do_remap_func_t) remap_matrix_float32ne_sse4);
+}
+
+void pa_remap_func_init_sse4(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_SSE4_1))
+        return;
+
+    pa_log_info("Initialising SSE4.1 optimized remappers.");
+
+    fallback_init = pa_get_init_remap_func();
+    pa_set_init_remap_func(init_remap_sse4);
+}
@@ -23,25 +23,37 @@
 
 #include <string.h>
 
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
+#include <pulsecore/llist.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/strbuf.h>
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/sample-util.h>
 
 #include "resampler.h"
 
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* Size of the largest per-tile buffer when running the stages fused, so
+ * that all of them stay in the L1 or L2 cache */
+#define TILE_SIZE (8*1024)
+
 struct ffmpeg_data { /* data specific to ffmpeg */
     struct AVResampleContext *state;
 };
 
 static int copy_init(pa_resampler *r);
+static void setup_tiles(pa_resampler *r);
+static void setup_arena(pa_resampler *r);
 
 static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed);
-static void free_remap(pa_remap_t *m);
+static void get_remap(pa_resampler *r, bool *lfe_remixed);
+static void free_remap(pa_resampler *r);
 
 static int (* const init_table[])(pa_resampler *r) = {
 #ifdef HAVE_LIBSAMPLERATE
@@ -118,6 +130,7 @@ static int (* const init_table[])(pa_resampler *r) = {
     [PA_RESAMPLER_SOXR_HQ]                 = NULL,
     [PA_RESAMPLER_SOXR_VHQ]                = NULL,
 #endif
+    [PA_RESAMPLER_POLYPHASE]               = pa_resampler_polyphase_init,
 };
 
 static pa_resample_method_t choose_auto_resampler(pa_resample_flags_t flags) {
@@ -125,10 +138,8 @@ static pa_resample_method_t choose_auto_resampler(pa_resample_flags_t flags) {
 
     if (pa_resample_method_supported(PA_RESAMPLER_SPEEX_FLOAT_BASE + 1))
         method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 1;
-    else if (flags & PA_RESAMPLER_VARIABLE_RATE)
-        method = PA_RESAMPLER_TRIVIAL;
     else
-        method = PA_RESAMPLER_FFMPEG;
+        method = PA_RESAMPLER_POLYPHASE;
 
     return method;
 }
@@ -414,7 +425,7 @@ pa_resampler* pa_resampler_new(
 
     /* set up the remap structure */
     if (r->map_required)
-        setup_remap(r, &r->remap, &lfe_remixed);
+        get_remap(r, &lfe_remixed);
 
     if (lfe_remixed && crossover_freq > 0) {
         pa_sample_spec wss = r->o_ss;
@@ -428,6 +439,9 @@ pa_resampler* pa_resampler_new(
     if (init_table[method](r) < 0)
         goto fail;
 
+    setup_tiles(r);
+    setup_arena(r);
+
     return r;
 
 fail:
@@ -455,8 +469,10 @@ void pa_resampler_free(pa_resampler *r) {
         pa_memblock_unref(r->resample_buf.memblock);
     if (r->from_work_format_buf.memblock)
         pa_memblock_unref(r->from_work_format_buf.memblock);
+    if (r->arena)
+        pa_memblock_unref(r->arena);
 
-    free_remap(&r->remap);
+    free_remap(r);
 
     pa_xfree(r);
 }
@@ -622,6 +638,37 @@ const pa_sample_spec* pa_resampler_output_sample_spec(pa_resampler *r) {
     return &r->o_ss;
 }
 
+bool pa_resampler_same_conversion(pa_resampler *a, pa_resampler *b) {
+    pa_assert(a);
+    pa_assert(b);
+
+    return a->method == b->method &&
+        a->flags == b->flags &&
+        pa_sample_spec_equal(&a->i_ss, &b->i_ss) &&
+        pa_sample_spec_equal(&a->o_ss, &b->o_ss) &&
+        pa_channel_map_equal(&a->i_cm, &b->i_cm) &&
+        pa_channel_map_equal(&a->o_cm, &b->o_cm);
+}
+
+void pa_resampler_get_timing(pa_resampler *r, pa_resampler_timing *timing) {
+    pa_assert(r);
+    pa_assert(timing);
+
+    *timing = r->timing;
+}
+
+const char *pa_resampler_phase_to_string(pa_resampler_phase_t phase) {
+    static const char * const table[PA_RESAMPLER_PHASE_MAX] = {
+        [PA_RESAMPLER_PHASE_CONVERT] = "convert",
+        [PA_RESAMPLER_PHASE_REMAP] = "remap",
+        [PA_RESAMPLER_PHASE_RESAMPLE] = "resample",
+    };
+
+    pa_assert(phase < PA_RESAMPLER_PHASE_MAX);
+
+    return table[phase];
+}
+
 static const char * const resample_methods[] = {
     "src-sinc-best-quality",
     "src-sinc-medium-quality",
@@ -657,7 +704,8 @@ static const char * const resample_methods[] = {
     "peaks",
     "soxr-mq",
     "soxr-hq",
-    "soxr-vhq"
+    "soxr-vhq",
+    "polyphase"
 };
 
 const char *pa_resample_method_to_string(pa_resample_method_t m) {
@@ -685,6 +733,11 @@ int pa_resample_method_supported(pa_resample_method_t m) {
         return 0;
 #endif
 
+#ifndef HAVE_SOXR
+    if (m >= PA_RESAMPLER_SOXR_MQ && m <= PA_RESAMPLER_SOXR_VHQ)
+        return 0;
+#endif
+
     return 1;
 }
 
@@ -1156,14 +1209,102 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
     pa_init_remap_func(m);
 }
 
-static void free_remap(pa_remap_t *m) {
-    pa_assert(m);
+/* Streams come and go with a handful of channel map pairs, so the
+ * matrices and the kernels picked for them are kept for the lifetime of
+ * the process and shared by all resamplers. The kernel state is only
+ * read after pa_init_remap_func(). */
+#define REMAP_CACHE_MAX 32
+#define REMAP_CACHE_FLAGS (PA_RESAMPLER_NO_REMAP | PA_RESAMPLER_NO_REMIX | PA_RESAMPLER_NO_LFE)
+
+struct remap_cache_entry {
+    pa_channel_map i_cm, o_cm;
+    pa_resample_flags_t flags;
+    pa_sample_format_t work_format;
+    pa_init_remap_func_t init_func;
+
+    pa_remap_t remap;
+    bool lfe_remixed;
+};
+
+static pa_static_mutex remap_cache_mutex = PA_STATIC_MUTEX_INIT;
+static struct remap_cache_entry remap_cache[REMAP_CACHE_MAX];
+static unsigned n_remap_cache = 0;
+
+static void remap_cache_destructor(void) PA_GCC_DESTRUCTOR;
+static void remap_cache_destructor(void) {
+    unsigned i;
+
+    for (i = 0; i < n_remap_cache; i++)
+        pa_xfree(remap_cache[i].remap.state);
+}
+
+static void get_remap(pa_resampler *r, bool *lfe_remixed) {
+    pa_init_remap_func_t init_func;
+    pa_resample_flags_t flags;
+    struct remap_cache_entry *e;
+    pa_mutex *mutex;
+    unsigned i;
+
+    pa_assert(r);
+    pa_assert(lfe_remixed);
+
+    init_func = pa_get_init_remap_func();
+    flags = r->flags & REMAP_CACHE_FLAGS;
+
+    mutex = pa_static_mutex_get(&remap_cache_mutex, false, false);
+    pa_mutex_lock(mutex);
+
+    for (i = 0; i < n_remap_cache; i++) {
+        e = &remap_cache[i];
+
+        if (e->flags == flags &&
+            e->work_format == r->work_format &&
+            e->init_func == init_func &&
+            pa_channel_map_equal(&e->i_cm, &r->i_cm) &&
+            pa_channel_map_equal(&e->o_cm, &r->o_cm)) {
+
+            r->remap = e->remap;
+            r->remap.i_ss = r->i_ss;
+            r->remap.o_ss = r->o_ss;
+            r->remap_shared = true;
+            *lfe_remixed = e->lfe_remixed;
+
+            pa_log_debug("Channel matrix: cached");
+            goto finish;
+        }
+    }
+
+    setup_remap(r, &r->remap, lfe_remixed);
+
+    if (n_remap_cache < REMAP_CACHE_MAX) {
+        e = &remap_cache[n_remap_cache++];
+
+        e->i_cm = r->i_cm;
+        e->o_cm = r->o_cm;
+        e->flags = flags;
+        e->work_format = r->work_format;
+        e->init_func = init_func;
+        e->remap = r->remap;
+        e->lfe_remixed = *lfe_remixed;
+
+        r->remap_shared = true;
+    }
+
+finish:
+    pa_mutex_unlock(mutex);
+}
+
+static void free_remap(pa_resampler *r) {
+    pa_assert(r);
 
-    pa_xfree(m->state);
+    if (!r->remap_shared)
+        pa_xfree(r->remap.state);
 }
 
 /* check if buf's memblock is large enough to hold 'len' bytes; create a
- * new memblock if necessary and optionally preserve 'copy' data bytes */
+ * new memblock if necessary and optionally preserve 'copy' data bytes.
+ * Buffers normally live in their slice of the arena, this only allocates
+ * for chunks larger than pa_resampler_max_block_size(). */
 static void fit_buf(pa_resampler *r, pa_memchunk *buf, size_t len, size_t *size, size_t copy) {
     pa_assert(size);
 
@@ -1172,7 +1313,7 @@ static void fit_buf(pa_resampler *r, pa_memchunk *buf, size_t len, size_t *size,
 
         if (buf->memblock) {
             if (copy > 0) {
-                void *src = pa_memblock_acquire(buf->memblock);
+                void *src = pa_memblock_acquire_chunk(buf);
                 void *dst = pa_memblock_acquire(new_block);
                 pa_assert(copy <= len);
                 memcpy(dst, src, copy);
@@ -1184,12 +1325,68 @@ static void fit_buf(pa_resampler *r, pa_memchunk *buf, size_t len, size_t *size,
         }
 
         buf->memblock = new_block;
+        buf->index = 0;
         *size = len;
     }
 
     buf->length = len;
 }
 
+/* Allocates one memblock for all stage buffers at creation, so that
+ * pa_resampler_run() does not need to allocate them while running. Each
+ * stage in use gets a slice large enough for the largest chunk it will
+ * see: a pair of tiles when the stages are fused, otherwise a block of
+ * pa_resampler_max_block_size(), plus some room for the leftover. */
+static void setup_arena(pa_resampler *r) {
+    pa_memchunk *bufs[4];
+    size_t *sizes[4];
+    size_t frames, fz, slice;
+    unsigned i, n = 0;
+
+    pa_assert(r);
+
+    if (r->to_work_format_func || r->leftover_buf == &r->to_work_format_buf) {
+        bufs[n] = &r->to_work_format_buf;
+        sizes[n++] = &r->to_work_format_buf_size;
+    }
+    if (r->map_required || r->leftover_buf == &r->remap_buf) {
+        bufs[n] = &r->remap_buf;
+        sizes[n++] = &r->remap_buf_size;
+    }
+    if (r->impl.resample) {
+        bufs[n] = &r->resample_buf;
+        sizes[n++] = &r->resample_buf_size;
+    }
+    if (r->from_work_format_func) {
+        bufs[n] = &r->from_work_format_buf;
+        sizes[n++] = &r->from_work_format_buf_size;
+    }
+
+    if (n == 0)
+        return;
+
+    if (r->tile_frames)
+        frames = 2 * r->tile_frames;
+    else
+        frames = pa_resampler_max_block_size(r) / r->i_fz;
+
+    /* In frames at the higher of the two rates */
+    frames = frames * PA_MAX(r->i_ss.rate, r->o_ss.rate) / r->i_ss.rate + 2 * EXTRA_FRAMES;
+
+    fz = PA_MAX(r->i_fz, r->o_fz);
+    fz = PA_MAX(fz, r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels));
+    slice = PA_ALIGN(frames * fz);
+
+    r->arena = pa_memblock_new(r->mempool, n * slice);
+
+    for (i = 0; i < n; i++) {
+        bufs[i]->memblock = pa_memblock_ref(r->arena);
+        bufs[i]->index = i * slice;
+        bufs[i]->length = 0;
+        *sizes[i] = slice;
+    }
+}
+
 static pa_memchunk* convert_to_work_format(pa_resampler *r, pa_memchunk *input) {
     unsigned in_n_samples, out_n_samples;
     void *src, *dst;
@@ -1222,7 +1419,7 @@ static pa_memchunk* convert_to_work_format(pa_resampler *r, pa_memchunk *input)
     fit_buf(r, &r->to_work_format_buf, r->w_sz * out_n_samples, &r->to_work_format_buf_size, leftover_length);
 
     src = pa_memblock_acquire_chunk(input);
-    dst = (uint8_t *) pa_memblock_acquire(r->to_work_format_buf.memblock) + leftover_length;
+    dst = (uint8_t *) pa_memblock_acquire_chunk(&r->to_work_format_buf) + leftover_length;
 
     if (r->to_work_format_func)
         r->to_work_format_func(in_n_samples, src, dst);
@@ -1269,7 +1466,7 @@ static pa_memchunk *remap_channels(pa_resampler *r, pa_memchunk *input) {
     fit_buf(r, &r->remap_buf, out_n_samples * r->w_sz, &r->remap_buf_size, leftover_length);
 
     src = pa_memblock_acquire_chunk(input);
-    dst = (uint8_t *) pa_memblock_acquire(r->remap_buf.memblock) + leftover_length;
+    dst = (uint8_t *) pa_memblock_acquire_chunk(&r->remap_buf) + leftover_length;
 
     if (r->map_required) {
         pa_remap_t *remap = &r->remap;
@@ -1297,7 +1494,7 @@ static void save_leftover(pa_resampler *r, void *buf, size_t len) {
     fit_buf(r, r->leftover_buf, len, r->leftover_buf_size, 0);
     *r->have_leftover = true;
 
-    dst = pa_memblock_acquire(r->leftover_buf->memblock);
+    dst = pa_memblock_acquire_chunk(r->leftover_buf);
     memmove(dst, buf, len);
     pa_memblock_release(r->leftover_buf->memblock);
 }
@@ -1349,7 +1546,7 @@ static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input
     fit_buf(r, &r->from_work_format_buf, r->o_fz * n_frames, &r->from_work_format_buf_size, 0);
 
     src = pa_memblock_acquire_chunk(input);
-    dst = pa_memblock_acquire(r->from_work_format_buf.memblock);
+    dst = pa_memblock_acquire_chunk(&r->from_work_format_buf);
     r->from_work_format_func(n_samples, src, dst);
     pa_memblock_release(input->memblock);
     pa_memblock_release(r->from_work_format_buf.memblock);
@@ -1357,42 +1554,310 @@ static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input
     return &r->from_work_format_buf;
 }
 
-void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+/* Charges the time since *t to the phase and restarts *t. Each stage
+ * boundary costs one clock read. */
+static inline void phase_done(pa_resampler *r, pa_resampler_phase_t phase, uint64_t *t) {
+    uint64_t now;
+
+    if (!(r->flags & PA_RESAMPLER_TIMING))
+        return;
+
+    now = pa_rtclock_nsec();
+    r->run_nsec[phase] += now - *t;
+    *t = now;
+}
+
+/* Passes a chunk through all stages, returns the buffer holding the result */
+static pa_memchunk *run_stages(pa_resampler *r, const pa_memchunk *in) {
     pa_memchunk *buf;
+    uint64_t t = 0;
 
-    pa_assert(r);
-    pa_assert(in);
-    pa_assert(out);
-    pa_assert(in->length);
-    pa_assert(in->memblock);
-    pa_assert(in->length % r->i_fz == 0);
+    if (r->flags & PA_RESAMPLER_TIMING)
+        t = pa_rtclock_nsec();
 
     buf = (pa_memchunk*) in;
     buf = convert_to_work_format(r, buf);
+    phase_done(r, PA_RESAMPLER_PHASE_CONVERT, &t);
 
     /* Try to save resampling effort: if we have more output channels than
      * input channels, do resampling first, then remapping. */
     if (r->o_ss.channels <= r->i_ss.channels) {
         buf = remap_channels(r, buf);
+        phase_done(r, PA_RESAMPLER_PHASE_REMAP, &t);
         buf = resample(r, buf);
+        phase_done(r, PA_RESAMPLER_PHASE_RESAMPLE, &t);
     } else {
         buf = resample(r, buf);
+        phase_done(r, PA_RESAMPLER_PHASE_RESAMPLE, &t);
         buf = remap_channels(r, buf);
+        phase_done(r, PA_RESAMPLER_PHASE_REMAP, &t);
     }
 
-    if (r->lfe_filter)
+    if (r->lfe_filter) {
         buf = pa_lfe_filter_process(r->lfe_filter, buf);
+        phase_done(r, PA_RESAMPLER_PHASE_REMAP, &t);
+    }
 
     if (buf->length) {
         buf = convert_from_work_format(r, buf);
-        *out = *buf;
+        phase_done(r, PA_RESAMPLER_PHASE_CONVERT, &t);
+    }
+
+    return buf;
+}
+
+/* Adds the phase times of the last pa_resampler_run() call to the totals
+ * and the histograms */
+static void timing_commit(pa_resampler *r) {
+    unsigned p;
+
+    r->timing.calls++;
+
+    for (p = 0; p < PA_RESAMPLER_PHASE_MAX; p++) {
+        uint64_t usec = r->run_nsec[p] / PA_NSEC_PER_USEC;
+        unsigned bucket = 0;
+
+        while (usec && bucket < PA_RESAMPLER_TIMING_BUCKETS - 1) {
+            usec >>= 1;
+            bucket++;
+        }
+
+        r->timing.nsec[p] += r->run_nsec[p];
+        r->timing.histogram[p][bucket]++;
+        r->run_nsec[p] = 0;
+    }
+}
+
+/* Fusing the stages only pays off if more than one of them touches the
+ * data. */
+static void setup_tiles(pa_resampler *r) {
+    unsigned n = 0;
+    size_t fz;
+
+    pa_assert(r);
+
+    r->tile_frames = 0;
+
+    if (r->flags & PA_RESAMPLER_NO_FUSE)
+        return;
+
+    n += !!r->to_work_format_func;
+    n += !!r->map_required;
+    n += !!r->impl.resample;
+    n += !!r->lfe_filter;
+    n += !!r->from_work_format_func;
+
+    if (n < 2)
+        return;
+
+    /* The largest buffer is the work format one, in the larger channel
+     * count, at the higher rate */
+    fz = PA_MAX(r->i_fz, r->o_fz);
+    fz = PA_MAX(fz, r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels));
+    fz = fz * (PA_MAX(r->i_ss.rate, r->o_ss.rate) + r->i_ss.rate - 1) / r->i_ss.rate;
+
+    r->tile_frames = PA_MAX(TILE_SIZE / fz, 64U);
+}
+
+/* Runs all stages on one cache sized tile of the input before moving on to
+ * the next one, instead of each stage traversing the whole chunk. The stage
+ * buffers are reused for every tile, and the results are collected in out. */
+static void run_fused(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    size_t tile, offset, size;
+    uint8_t *dst;
+
+    tile = r->tile_frames * r->i_fz;
+
+    size = pa_resampler_result(r, in->length) + EXTRA_FRAMES * r->o_fz;
+    out->memblock = pa_memblock_new(r->mempool, size);
+    out->index = 0;
+    out->length = 0;
+
+    dst = pa_memblock_acquire(out->memblock);
+
+    for (offset = 0; offset < in->length; offset += tile) {
+        pa_memchunk t, *buf;
+
+        t = *in;
+        t.index += offset;
+        t.length = PA_MIN(tile, in->length - offset);
+
+        buf = run_stages(r, &t);
+        pa_assert(buf != &t);
+
+        if (!buf->length)
+            continue;
+
+        /* Resamplers may return a few frames more than estimated */
+        if (out->length + buf->length > size) {
+            pa_memblock *n;
+            uint8_t *d;
+
+            size = PA_MAX(2 * size, out->length + buf->length);
+            n = pa_memblock_new(r->mempool, size);
+            d = pa_memblock_acquire(n);
+            memcpy(d, dst, out->length);
 
-        if (buf == in)
+            pa_memblock_release(out->memblock);
+            pa_memblock_unref(out->memblock);
+            out->memblock = n;
+            dst = d;
+        }
+
+        memcpy(dst + out->length, pa_memblock_acquire_chunk(buf), buf->length);
+        pa_memblock_release(buf->memblock);
+
+        out->length += buf->length;
+    }
+
+    pa_memblock_release(out->memblock);
+
+    if (!out->length) {
+        pa_memblock_unref(out->memblock);
+        pa_memchunk_reset(out);
+    }
+}
+
+static void run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    pa_memchunk *buf;
+
+    if (r->tile_frames && in->length > 2 * r->tile_frames * r->i_fz)
+        run_fused(r, in, out);
+    else {
+        buf = run_stages(r, in);
+
+        if (!buf->length) {
+            pa_memchunk_reset(out);
+            return;
+        }
+
+        if (buf == in) {
+            *out = *buf;
             pa_memblock_ref(buf->memblock);
-        else
+            return;
+        }
+
+        if (buf->memblock == r->arena) {
+            /* The arena is reused on the next run, hand out a copy */
+            out->memblock = pa_memblock_new(r->mempool, buf->length);
+            out->index = 0;
+            out->length = buf->length;
+
+            memcpy(pa_memblock_acquire(out->memblock), pa_memblock_acquire_chunk(buf), buf->length);
+            pa_memblock_release(buf->memblock);
+            pa_memblock_release(out->memblock);
+        } else {
+            *out = *buf;
             pa_memchunk_reset(buf);
-    } else
-        pa_memchunk_reset(out);
+        }
+    }
+
+    /* Keep the silence flag, so that the sink can skip this chunk when
+     * mixing. The filter history of the previous chunk may still ring out
+     * into this one, hence check that the output really is silent. */
+    if (out->memblock && pa_memblock_is_silence(in->memblock)) {
+        bool silent;
+
+        silent = pa_memory_is_silence(pa_memblock_acquire_chunk(out), out->length, &r->o_ss);
+        pa_memblock_release(out->memblock);
+
+        if (silent)
+            pa_memblock_set_is_silence(out->memblock, true);
+    }
+}
+
+void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    pa_assert(r);
+    pa_assert(in);
+    pa_assert(out);
+    pa_assert(in->length);
+    pa_assert(in->memblock);
+    pa_assert(in->length % r->i_fz == 0);
+
+    run(r, in, out);
+
+    if (r->flags & PA_RESAMPLER_TIMING)
+        timing_commit(r);
+}
+
+/*** shared filter tables ***/
+
+struct table_entry {
+    PA_LLIST_FIELDS(struct table_entry);
+    unsigned ref;
+
+    pa_resample_method_t method;
+    uint32_t i_rate, o_rate;
+    unsigned key;
+    size_t size;
+
+    /* The table itself follows */
+};
+
+#define TABLE_ENTRY_SIZE PA_ALIGN(sizeof(struct table_entry))
+#define TABLE_DATA(e) ((void*) ((uint8_t*) (e) + TABLE_ENTRY_SIZE))
+
+static pa_static_mutex table_mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(struct table_entry, tables) = NULL;
+
+const void *pa_resampler_table_ref(pa_resample_method_t method, uint32_t i_rate, uint32_t o_rate, unsigned key,
+                                   size_t size, pa_resampler_table_init_t init, void *userdata) {
+    struct table_entry *e;
+    pa_mutex *mutex;
+
+    pa_assert(size > 0);
+    pa_assert(init);
+
+    mutex = pa_static_mutex_get(&table_mutex, false, false);
+    pa_mutex_lock(mutex);
+
+    PA_LLIST_FOREACH(e, tables)
+        if (e->method == method && e->i_rate == i_rate && e->o_rate == o_rate && e->key == key) {
+            pa_assert(e->size == size);
+            e->ref++;
+            goto finish;
+        }
+
+    e = pa_xmalloc(TABLE_ENTRY_SIZE + size);
+    e->ref = 1;
+    e->method = method;
+    e->i_rate = i_rate;
+    e->o_rate = o_rate;
+    e->key = key;
+    e->size = size;
+
+    init(TABLE_DATA(e), size, userdata);
+
+    PA_LLIST_PREPEND(struct table_entry, tables, e);
+
+    pa_log_debug("Created %lu byte filter table for resampler '%s', %u -> %u Hz.",
+                 (unsigned long) size, pa_resample_method_to_string(method), i_rate, o_rate);
+
+finish:
+    pa_mutex_unlock(mutex);
+
+    return TABLE_DATA(e);
+}
+
+void pa_resampler_table_unref(const void *table) {
+    struct table_entry *e;
+    pa_mutex *mutex;
+
+    pa_assert(table);
+
+    e = (struct table_entry*) ((uint8_t*) table - TABLE_ENTRY_SIZE);
+
+    mutex = pa_static_mutex_get(&table_mutex, false, false);
+    pa_mutex_lock(mutex);
+
+    pa_assert(e->ref >= 1);
+
+    if (--e->ref == 0) {
+        PA_LLIST_REMOVE(struct table_entry, tables, e);
+        pa_xfree(e);
+    }
+
+    pa_mutex_unlock(mutex);
 }
 
 /*** copy (noop) implementation ***/
@@ -61,6 +61,7 @@ typedef enum pa_resample_method {
     PA_RESAMPLER_SOXR_MQ,
     PA_RESAMPLER_SOXR_HQ,
     PA_RESAMPLER_SOXR_VHQ,
+    PA_RESAMPLER_POLYPHASE,
     PA_RESAMPLER_MAX
 } pa_resample_method_t;
 
@@ -68,9 +69,29 @@ typedef enum pa_resample_flags {
     PA_RESAMPLER_VARIABLE_RATE = 0x0001U,
     PA_RESAMPLER_NO_REMAP      = 0x0002U,  /* implies NO_REMIX */
     PA_RESAMPLER_NO_REMIX      = 0x0004U,
-    PA_RESAMPLER_NO_LFE        = 0x0008U
+    PA_RESAMPLER_NO_LFE        = 0x0008U,
+    PA_RESAMPLER_NO_FUSE       = 0x0010U,  /* run each stage over the whole chunk */
+    PA_RESAMPLER_TIMING        = 0x0020U   /* measure the time spent in each phase */
 } pa_resample_flags_t;
 
+typedef enum pa_resampler_phase {
+    PA_RESAMPLER_PHASE_CONVERT,     /* to and from the work format */
+    PA_RESAMPLER_PHASE_REMAP,       /* channel remapping and the LFE filter */
+    PA_RESAMPLER_PHASE_RESAMPLE,
+    PA_RESAMPLER_PHASE_MAX
+} pa_resampler_phase_t;
+
+/* Bucket 0 counts the pa_resampler_run() calls in which a phase took less
+ * than 1 usec, bucket n those that took less than 2^n usec, the last one
+ * all longer calls */
+#define PA_RESAMPLER_TIMING_BUCKETS 8
+
+typedef struct pa_resampler_timing {
+    uint64_t calls;
+    uint64_t nsec[PA_RESAMPLER_PHASE_MAX];
+    uint32_t histogram[PA_RESAMPLER_PHASE_MAX][PA_RESAMPLER_TIMING_BUCKETS];
+} pa_resampler_timing;
+
 struct pa_resampler {
     pa_resample_method_t method;
     pa_resample_flags_t flags;
@@ -89,6 +110,9 @@ struct pa_resampler {
     size_t resample_buf_size;
     size_t from_work_format_buf_size;
 
+    /* The stage buffers above are slices of this block */
+    pa_memblock *arena;
+
     /* points to buffer before resampling stage, remap or to_work */
     pa_memchunk *leftover_buf;
     size_t *leftover_buf_size;
@@ -105,10 +129,20 @@ struct pa_resampler {
     pa_convert_func_t from_work_format_func;
 
     pa_remap_t remap;
+    bool remap_shared; /* remap.state belongs to the remap cache */
     bool map_required;
 
     pa_lfe_filter_t *lfe_filter;
 
+    /* Chunks longer than this are passed through all stages in tiles
+     * of this many input frames, 0 if not worth it */
+    unsigned tile_frames;
+
+    /* With PA_RESAMPLER_TIMING, the totals and the time spent in each
+     * phase during the current pa_resampler_run() call */
+    pa_resampler_timing timing;
+    uint64_t run_nsec[PA_RESAMPLER_PHASE_MAX];
+
     pa_resampler_impl impl;
 };
 
@@ -151,6 +185,12 @@ void pa_resampler_rewind(pa_resampler *r, size_t out_frames);
 /* Return the resampling method of the resampler object */
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r);
 
+/* Copies the accumulated phase timing, only meaningful with PA_RESAMPLER_TIMING */
+void pa_resampler_get_timing(pa_resampler *r, pa_resampler_timing *timing);
+
+/* Returns a short name for the phase */
+const char *pa_resampler_phase_to_string(pa_resampler_phase_t phase);
+
 /* Try to parse the resampler method */
 pa_resample_method_t pa_parse_resample_method(const char *string);
 
@@ -165,6 +205,22 @@ const pa_sample_spec* pa_resampler_input_sample_spec(pa_resampler *r);
 const pa_channel_map* pa_resampler_output_channel_map(pa_resampler *r);
 const pa_sample_spec* pa_resampler_output_sample_spec(pa_resampler *r);
 
+/* Returns true if a and b turn the same input into the same output,
+ * given the same history */
+bool pa_resampler_same_conversion(pa_resampler *a, pa_resampler *b);
+
+/* Filter tables which only depend on the resampling parameters are
+ * shared by all resamplers, so that streams with the same rates don't
+ * each compute and keep their own copy. A table is identified by the
+ * method, the rates and a method specific key, e.g. a quality setting.
+ * init is called to fill in a table of size bytes when there is none
+ * yet. Thread-safe. */
+typedef void (*pa_resampler_table_init_t)(void *table, size_t size, void *userdata);
+
+const void *pa_resampler_table_ref(pa_resample_method_t method, uint32_t i_rate, uint32_t o_rate, unsigned key,
+                                   size_t size, pa_resampler_table_init_t init, void *userdata);
+void pa_resampler_table_unref(const void *table);
+
 /* Implementation specific init functions */
 int pa_resampler_ffmpeg_init(pa_resampler *r);
 int pa_resampler_libsamplerate_init(pa_resampler *r);
@@ -172,6 +228,13 @@ int pa_resampler_peaks_init(pa_resampler *r);
 int pa_resampler_speex_init(pa_resampler *r);
 int pa_resampler_trivial_init(pa_resampler*r);
 int pa_resampler_soxr_init(pa_resampler *r);
+int pa_resampler_polyphase_init(pa_resampler *r);
+
+/* Inner loop of the polyphase resampler, n is a multiple of 8 */
+typedef float (*pa_polyphase_dot_func_t) (const float *a, const float *b, unsigned n);
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void);
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func);
 
 /* Resampler-specific quirks */
 bool pa_speex_is_fixed_point(void);
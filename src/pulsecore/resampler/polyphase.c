@@ -0,0 +1,384 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/resampler.h>
+
+/* Number of taps when upsampling. When downsampling the filter is made
+ * longer by the same factor as the cutoff frequency is lowered, so that
+ * the transition band keeps its width relative to the output rate. */
+#define TAPS_BASE 32
+#define TAPS_MAX 256
+
+/* The optimized dot products work on this many samples at a time */
+#define TAPS_ALIGN 8
+
+/* Cutoff frequency relative to the Nyquist frequency of the slower side */
+#define CUTOFF 0.92
+
+/* Kaiser window parameter, about 80 dB stopband attenuation */
+#define KAISER_BETA 8.0
+
+/* Ratios whose reduced output rate is at most this large get a filter
+ * bank with one phase per output position, e.g. 147/160 for 44.1 to
+ * 48 kHz. Other ratios, and all variable rate resamplers, interpolate
+ * between the phases of a bank of PHASES_INTERP phases instead. */
+#define PHASES_EXACT_MAX 640
+#define PHASES_INTERP 128
+
+struct polyphase_bank {
+    unsigned taps;
+    unsigned n_phases;
+    double cutoff;
+};
+
+struct polyphase_data {
+    /* The filter bank only depends on the ratio, so it is shared with
+     * all other resamplers using the same one. That's the common case:
+     * many streams at 44.1 kHz played on a sink at 48 kHz. It has
+     * n_phases + 1 rows of taps coefficients each. The extra row is the
+     * phase one full input frame ahead, for interpolating past the last
+     * phase. */
+    struct polyphase_bank bank;
+    const float *coeffs;
+    bool interpolate;
+
+    pa_polyphase_dot_func_t dot;
+
+    /* The position of the next output frame in the input is pos + frac/den
+     * frames into the history, and each output frame advances it by
+     * num/den. frac is in units of 1/n_phases of the bank unless
+     * interpolating. */
+    unsigned pos;
+    uint32_t frac, num, den;
+
+    /* Planar history, one row of history_size frames per channel, of
+     * which history_n are valid */
+    float *history;
+    unsigned history_size, history_n;
+};
+
+static float dot_c(const float *a, const float *b, unsigned n) {
+    float s = 0.0f;
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        s += a[i] * b[i];
+
+    return s;
+}
+
+static pa_polyphase_dot_func_t dot_func = dot_c;
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void) {
+    return dot_func;
+}
+
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func) {
+    pa_assert(func);
+
+    dot_func = func;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* Zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    unsigned k;
+
+    for (k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+
+        if (term < sum * 1e-12)
+            break;
+    }
+
+    return sum;
+}
+
+static void bank_init(void *table, size_t size, void *userdata) {
+    const struct polyphase_bank *b = userdata;
+    float *coeffs = table;
+    double i0_beta = bessel_i0(KAISER_BETA);
+    unsigned p, j;
+
+    pa_assert(size == (b->n_phases + 1) * b->taps * sizeof(float));
+
+    for (p = 0; p <= b->n_phases; p++) {
+        float *row = coeffs + p * b->taps;
+        double f = (double) p / b->n_phases, sum = 0.0;
+
+        for (j = 0; j < b->taps; j++) {
+            /* Distance from the output position, in input frames. The
+             * output position lies between taps taps/2-1 and taps/2. */
+            double t = (double) j - (double) (b->taps / 2 - 1) - f;
+            double x = t / (b->taps / 2);
+            double s, w;
+
+            s = t == 0.0 ? 1.0 : sin(M_PI * b->cutoff * t) / (M_PI * b->cutoff * t);
+            w = bessel_i0(KAISER_BETA * sqrt(PA_MAX(0.0, 1.0 - x * x))) / i0_beta;
+
+            row[j] = (float) (s * w);
+            sum += s * w;
+        }
+
+        /* Unity gain at DC for every phase */
+        for (j = 0; j < b->taps; j++)
+            row[j] = (float) (row[j] / sum);
+    }
+}
+
+/* Picks the filter bank for the current rates. */
+static void polyphase_setup(pa_resampler *r, struct polyphase_data *d) {
+    uint32_t g, num, den;
+    double ratio, cutoff;
+    unsigned taps, n_phases;
+    bool interpolate;
+
+    g = gcd(r->i_ss.rate, r->o_ss.rate);
+    num = r->i_ss.rate / g;
+    den = r->o_ss.rate / g;
+
+    ratio = PA_MIN(1.0, (double) r->o_ss.rate / r->i_ss.rate);
+    cutoff = CUTOFF * ratio;
+
+    taps = (unsigned) ceil(TAPS_BASE / ratio);
+    taps = PA_ROUND_UP(PA_MIN(taps, TAPS_MAX), TAPS_ALIGN);
+
+    interpolate = (r->flags & PA_RESAMPLER_VARIABLE_RATE) || den > PHASES_EXACT_MAX;
+    n_phases = interpolate ? PHASES_INTERP : den;
+
+    /* Keep the position of the next output frame across rate changes */
+    if (d->den)
+        d->frac = (uint32_t) (((uint64_t) d->frac * den) / d->den);
+
+    d->num = num;
+    d->den = den;
+
+    /* Variable rate resamplers are adjusted by small amounts all the
+     * time, keep their filter, it has been designed for the initial
+     * ratio */
+    if (d->coeffs && (r->flags & PA_RESAMPLER_VARIABLE_RATE))
+        return;
+
+    if (d->coeffs && d->bank.taps == taps && d->bank.n_phases == n_phases && d->bank.cutoff == cutoff)
+        return;
+
+    if (d->coeffs)
+        pa_resampler_table_unref(d->coeffs);
+
+    d->bank.taps = taps;
+    d->bank.n_phases = n_phases;
+    d->bank.cutoff = cutoff;
+    d->interpolate = interpolate;
+
+    d->coeffs = pa_resampler_table_ref(PA_RESAMPLER_POLYPHASE, num, den, interpolate,
+                                       (n_phases + 1) * taps * sizeof(float), bank_init, &d->bank);
+}
+
+static void history_reserve(pa_resampler *r, struct polyphase_data *d, unsigned frames) {
+    unsigned c, size;
+    float *h;
+
+    if (frames <= d->history_size)
+        return;
+
+    size = PA_MAX(frames, d->history_size * 2);
+    h = pa_xnew(float, size * r->work_channels);
+
+    for (c = 0; c < r->work_channels; c++)
+        memcpy(h + c * size, d->history + c * d->history_size, d->history_n * sizeof(float));
+
+    pa_xfree(d->history);
+    d->history = h;
+    d->history_size = size;
+}
+
+static void polyphase_reset(pa_resampler *r) {
+    struct polyphase_data *d;
+    unsigned c;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+
+    /* Start with half a filter of silence in front of the first input
+     * frame, so that the first output frame is centered on it */
+    d->history_n = 0;
+    history_reserve(r, d, d->bank.taps / 2 - 1);
+    d->history_n = d->bank.taps / 2 - 1;
+
+    for (c = 0; c < r->work_channels; c++)
+        memset(d->history + c * d->history_size, 0, d->history_n * sizeof(float));
+
+    d->pos = 0;
+    d->frac = 0;
+}
+
+static unsigned polyphase_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
+    struct polyphase_data *d;
+    unsigned channels, taps, c, i, o, shift;
+    const float *src;
+    float *dst;
+
+    pa_assert(r);
+    pa_assert(input);
+    pa_assert(output);
+    pa_assert(out_n_frames);
+
+    d = r->impl.data;
+    channels = r->work_channels;
+    taps = d->bank.taps;
+
+    history_reserve(r, d, d->history_n + in_n_frames);
+
+    src = pa_memblock_acquire_chunk(input);
+
+    for (c = 0; c < channels; c++) {
+        float *h = d->history + c * d->history_size + d->history_n;
+
+        for (i = 0; i < in_n_frames; i++)
+            h[i] = src[i * channels + c];
+    }
+
+    pa_memblock_release(input->memblock);
+
+    d->history_n += in_n_frames;
+
+    dst = pa_memblock_acquire_chunk(output);
+
+    for (o = 0; o < *out_n_frames && d->pos + taps <= d->history_n; o++) {
+        if (!d->interpolate) {
+            const float *coeffs = d->coeffs + d->frac * taps;
+
+            for (c = 0; c < channels; c++)
+                dst[o * channels + c] = d->dot(d->history + c * d->history_size + d->pos, coeffs, taps);
+        } else {
+            uint64_t p = (uint64_t) d->frac * d->bank.n_phases;
+            const float *coeffs = d->coeffs + (p / d->den) * taps;
+            float a = (float) (p % d->den) / (float) d->den;
+
+            for (c = 0; c < channels; c++) {
+                const float *h = d->history + c * d->history_size + d->pos;
+                float y0, y1;
+
+                y0 = d->dot(h, coeffs, taps);
+                y1 = d->dot(h, coeffs + taps, taps);
+
+                dst[o * channels + c] = y0 + a * (y1 - y0);
+            }
+        }
+
+        d->frac += d->num;
+        d->pos += d->frac / d->den;
+        d->frac %= d->den;
+    }
+
+    pa_memblock_release(output->memblock);
+
+    *out_n_frames = o;
+
+    /* Drop the history that won't be needed anymore. When downsampling
+     * pos may point past the end of it. */
+    shift = PA_MIN(d->pos, d->history_n);
+
+    if (shift > 0) {
+        for (c = 0; c < channels; c++) {
+            float *h = d->history + c * d->history_size;
+            memmove(h, h + shift, (d->history_n - shift) * sizeof(float));
+        }
+
+        d->pos -= shift;
+        d->history_n -= shift;
+    }
+
+    return 0;
+}
+
+static void polyphase_update_rates(pa_resampler *r) {
+    struct polyphase_data *d;
+    unsigned taps;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+    taps = d->bank.taps;
+
+    polyphase_setup(r, d);
+
+    /* A longer filter needs more history in front of the current
+     * position. Simply start over in that case. */
+    if (d->bank.taps != taps)
+        polyphase_reset(r);
+}
+
+static void polyphase_free(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+
+    if (!d)
+        return;
+
+    if (d->coeffs)
+        pa_resampler_table_unref(d->coeffs);
+
+    pa_xfree(d->history);
+    pa_xfree(d);
+}
+
+int pa_resampler_polyphase_init(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+
+    d = pa_xnew0(struct polyphase_data, 1);
+    d->dot = pa_get_polyphase_dot_func();
+
+    polyphase_setup(r, d);
+
+    r->impl.free = polyphase_free;
+    r->impl.update_rates = polyphase_update_rates;
+    r->impl.resample = polyphase_resample;
+    r->impl.reset = polyphase_reset;
+    r->impl.data = d;
+
+    polyphase_reset(r);
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/resampler.h>
+
+#include <smmintrin.h>
+
+static float dot_sse4(const float *a, const float *b, unsigned n) {
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    unsigned i;
+
+    pa_assert_fp(n % 8 == 0);
+
+    /* Two accumulators to hide the latency of the additions */
+    for (i = 0; i < n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    return _mm_cvtss_f32(_mm_dp_ps(_mm_add_ps(s0, s1), _mm_set1_ps(1.0f), 0xF1));
+}
+
+void pa_polyphase_func_init_sse4(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_SSE4_1))
+        return;
+
+    pa_log_info("Initialising SSE4.1 optimized polyphase resampler.");
+
+    pa_set_polyphase_dot_func(dot_sse4);
+}
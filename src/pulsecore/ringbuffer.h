@@ -0,0 +1,49 @@
+#ifndef foopulseringbufferhfoo
+#define foopulseringbufferhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright 2014 David Henningsson, Canonical Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/atomic.h>
+
+/* A lock-free ringbuffer for one reader and one writer, which may run in
+ * different threads. The count may live in shared memory, so the caller
+ * sets up all fields. */
+
+typedef struct pa_ringbuffer pa_ringbuffer;
+
+struct pa_ringbuffer {
+    pa_atomic_t *count; /* amount of data in the buffer */
+    int capacity;
+    uint8_t *memory;
+    int readindex, writeindex;
+};
+
+/* Both return the contiguous part only, so after the end of the memory
+ * a second call may find more */
+void *pa_ringbuffer_peek(pa_ringbuffer *r, int *count);
+/* Returns true only if the buffer was completely full before the drop. */
+bool pa_ringbuffer_drop(pa_ringbuffer *r, int count);
+
+void *pa_ringbuffer_begin_write(pa_ringbuffer *r, int *count);
+void pa_ringbuffer_end_write(pa_ringbuffer *r, int count);
+
+#endif
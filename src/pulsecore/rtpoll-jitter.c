@@ -0,0 +1,281 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "rtpoll-jitter.h"
+
+typedef enum distribution {
+    DISTRIBUTION_NONE,
+    DISTRIBUTION_FIXED,
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_EXPONENTIAL,
+    DISTRIBUTION_NORMAL
+} distribution_t;
+
+struct delay {
+    distribution_t distribution;
+    double a, b;
+    double probability;
+
+    unsigned n, n_delayed;
+    pa_usec_t total, max;
+};
+
+struct pa_rtpoll_jitter {
+    uint64_t state;
+    struct delay delays[PA_RTPOLL_JITTER_MAX];
+};
+
+static const char * const point_names[PA_RTPOLL_JITTER_MAX] = {
+    [PA_RTPOLL_JITTER_WAKEUP] = "wakeup",
+    [PA_RTPOLL_JITTER_RENDER] = "render",
+};
+
+/* xorshift64*, plenty for this and the same everywhere, unlike
+ * random() */
+static double next_double(pa_rtpoll_jitter *j) {
+    j->state ^= j->state >> 12;
+    j->state ^= j->state << 25;
+    j->state ^= j->state >> 27;
+
+    return (double) ((j->state * UINT64_C(2685821657736338717)) >> 11) / (double) (UINT64_C(1) << 53);
+}
+
+static int parse_delay(struct delay *d, const char *s) {
+    const char *state = NULL;
+    char *spec, *name, *arg, *at;
+    double args[2];
+    unsigned n_args = 0, needed;
+    int r = -1;
+
+    spec = pa_xstrdup(s);
+
+    d->probability = 1;
+    if ((at = strchr(spec, '@'))) {
+        *at = 0;
+        if (pa_atod(at + 1, &d->probability) < 0 || d->probability < 0 || d->probability > 1)
+            goto finish;
+    }
+
+    if (!(name = pa_split(spec, ":", &state)))
+        goto finish;
+
+    while ((arg = pa_split(spec, ":", &state))) {
+        uint32_t u;
+
+        if (n_args >= PA_ELEMENTSOF(args) || pa_atou(arg, &u) < 0) {
+            pa_xfree(arg);
+            goto finish_name;
+        }
+
+        args[n_args++] = u;
+        pa_xfree(arg);
+    }
+
+    if (pa_streq(name, "fixed")) {
+        d->distribution = DISTRIBUTION_FIXED;
+        needed = 1;
+    } else if (pa_streq(name, "uniform")) {
+        d->distribution = DISTRIBUTION_UNIFORM;
+        needed = 2;
+    } else if (pa_streq(name, "exponential")) {
+        d->distribution = DISTRIBUTION_EXPONENTIAL;
+        needed = 1;
+    } else if (pa_streq(name, "normal")) {
+        d->distribution = DISTRIBUTION_NORMAL;
+        needed = 2;
+    } else
+        goto finish_name;
+
+    if (n_args != needed)
+        goto finish_name;
+
+    if (d->distribution == DISTRIBUTION_UNIFORM && args[1] < args[0])
+        goto finish_name;
+
+    d->a = args[0];
+    d->b = n_args > 1 ? args[1] : 0;
+    r = 0;
+
+finish_name:
+    pa_xfree(name);
+
+finish:
+    pa_xfree(spec);
+    return r;
+}
+
+pa_rtpoll_jitter *pa_rtpoll_jitter_new(const char *spec, unsigned stream) {
+    pa_rtpoll_jitter *j;
+    const char *state = NULL;
+    uint32_t seed = 1;
+    char *item;
+
+    pa_assert(spec);
+
+    j = pa_xnew0(pa_rtpoll_jitter, 1);
+
+    while ((item = pa_split(spec, ",", &state))) {
+        char *value;
+        unsigned p;
+        int r = -1;
+
+        if (!(value = strchr(item, '=')))
+            goto fail;
+
+        *value++ = 0;
+
+        if (pa_streq(item, "seed"))
+            r = pa_atou(value, &seed);
+        else
+            for (p = 0; p < PA_RTPOLL_JITTER_MAX; p++)
+                if (pa_streq(item, point_names[p])) {
+                    r = parse_delay(&j->delays[p], value);
+                    break;
+                }
+
+        if (r < 0)
+            goto fail;
+
+        pa_xfree(item);
+        continue;
+
+    fail:
+        pa_log("Invalid rtpoll jitter: %s", spec);
+        pa_xfree(item);
+        pa_xfree(j);
+        return NULL;
+    }
+
+    /* Never 0, which xorshift can't leave */
+    j->state = ((uint64_t) seed << 32 | stream) * UINT64_C(0x9e3779b97f4a7c15) | 1;
+
+    return j;
+}
+
+void pa_rtpoll_jitter_free(pa_rtpoll_jitter *j) {
+    unsigned p;
+
+    pa_assert(j);
+
+    for (p = 0; p < PA_RTPOLL_JITTER_MAX; p++) {
+        struct delay *d = &j->delays[p];
+
+        if (d->distribution == DISTRIBUTION_NONE)
+            continue;
+
+        pa_log_info("Injected %s jitter %u of %u times, %llu usec in total, %llu usec at most.",
+                    point_names[p], d->n_delayed, d->n,
+                    (unsigned long long) d->total, (unsigned long long) d->max);
+    }
+
+    pa_xfree(j);
+}
+
+pa_usec_t pa_rtpoll_jitter_next(pa_rtpoll_jitter *j, pa_rtpoll_jitter_point_t point) {
+    struct delay *d;
+    double v;
+    pa_usec_t usec;
+
+    pa_assert(j);
+    pa_assert(point < PA_RTPOLL_JITTER_MAX);
+
+    d = &j->delays[point];
+
+    if (d->distribution == DISTRIBUTION_NONE)
+        return 0;
+
+    d->n++;
+
+    if (d->probability < 1 && next_double(j) >= d->probability)
+        return 0;
+
+    switch (d->distribution) {
+        case DISTRIBUTION_FIXED:
+            v = d->a;
+            break;
+
+        case DISTRIBUTION_UNIFORM:
+            v = d->a + (d->b - d->a) * next_double(j);
+            break;
+
+        case DISTRIBUTION_EXPONENTIAL:
+            v = -d->a * log(1 - next_double(j));
+            break;
+
+        case DISTRIBUTION_NORMAL: {
+            /* Box-Muller, the other half of the pair is thrown away so
+             * that every delay takes the same numbers */
+            double u1 = next_double(j), u2 = next_double(j);
+
+            v = d->a + d->b * sqrt(-2 * log(1 - u1)) * cos(2 * M_PI * u2);
+            break;
+        }
+
+        default:
+            pa_assert_not_reached();
+    }
+
+    usec = v > 0 ? (pa_usec_t) lrint(v) : 0;
+
+    if (usec > 0) {
+        d->n_delayed++;
+        d->total += usec;
+        d->max = PA_MAX(d->max, usec);
+    }
+
+    return usec;
+}
+
+void pa_rtpoll_jitter_inject(pa_rtpoll_jitter *j, pa_rtpoll_jitter_point_t point) {
+    pa_usec_t usec;
+
+    if ((usec = pa_rtpoll_jitter_next(j, point)) <= 0)
+        return;
+
+    if (point == PA_RTPOLL_JITTER_WAKEUP) {
+        struct timespec ts;
+
+        /* Like a thread that was woken up but didn't get the CPU */
+        ts.tv_sec = (time_t) (usec / PA_USEC_PER_SEC);
+        ts.tv_nsec = (long) ((usec % PA_USEC_PER_SEC) * PA_NSEC_PER_USEC);
+
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+            ;
+    } else {
+        pa_usec_t until = pa_rtclock_now() + usec;
+
+        /* Like rendering that takes longer, so this keeps the CPU */
+        while (pa_rtclock_now() < until)
+            ;
+    }
+}
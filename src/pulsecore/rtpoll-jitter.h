@@ -0,0 +1,67 @@
+#ifndef foortpolljitterhfoo
+#define foortpolljitterhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+/* Artificial scheduling jitter for the IO threads, so that the timer
+ * based scheduling can be tried out against late wakeups and slow
+ * rendering without depending on what else the machine happens to be
+ * doing. When configured with --enable-rtpoll-jitter, every rtpoll reads
+ * its jitter from $PULSE_RTPOLL_JITTER, a comma separated list of
+ *
+ *   wakeup=DISTRIBUTION   sleep this long after each wakeup
+ *   render=DISTRIBUTION   spin this long in each pa_sink_render_full()
+ *                         and pa_sink_render_into_full()
+ *   seed=N                seed of the random numbers, 1 by default
+ *
+ * where DISTRIBUTION is in usec, one of
+ *
+ *   fixed:USEC
+ *   uniform:MIN:MAX
+ *   exponential:MEAN
+ *   normal:MEAN:STDDEV
+ *
+ * optionally followed by @P to delay only a fraction P of the times,
+ * e.g. "wakeup=exponential:200,render=fixed:20000@0.01". The random
+ * numbers don't depend on the time, so the same settings delay the same
+ * loop iterations in every run. */
+
+typedef enum pa_rtpoll_jitter_point {
+    PA_RTPOLL_JITTER_WAKEUP,
+    PA_RTPOLL_JITTER_RENDER,
+    PA_RTPOLL_JITTER_MAX
+} pa_rtpoll_jitter_point_t;
+
+typedef struct pa_rtpoll_jitter pa_rtpoll_jitter;
+
+/* Returns NULL if spec is invalid. Loops with the same spec and stream
+ * get the same delays, different streams different ones. */
+pa_rtpoll_jitter *pa_rtpoll_jitter_new(const char *spec, unsigned stream);
+
+/* Logs how much was injected */
+void pa_rtpoll_jitter_free(pa_rtpoll_jitter *j);
+
+/* The next delay at point, 0 if there is none this time */
+pa_usec_t pa_rtpoll_jitter_next(pa_rtpoll_jitter *j, pa_rtpoll_jitter_point_t point);
+
+/* Takes the next delay and sleeps (wakeups) or spins (rendering) for it */
+void pa_rtpoll_jitter_inject(pa_rtpoll_jitter *j, pa_rtpoll_jitter_point_t point);
+
+#endif
@@ -24,13 +24,22 @@
 
 #include <sys/types.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
 
 #include <pulsecore/poll.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/macro.h>
@@ -38,8 +47,13 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/ratelimit.h>
+#include <pulsecore/thread.h>
 #include <pulse/rtclock.h>
 
+#ifdef RTPOLL_JITTER
+#include <pulsecore/rtpoll-jitter.h>
+#endif
+
 #include "rtpoll.h"
 
 /* #define DEBUG_TIMING */
@@ -57,11 +71,39 @@ struct pa_rtpoll {
     bool quit:1;
     bool timer_elapsed:1;
 
+    /* The time of the current iteration, read on first use after
+     * pa_rtpoll_run() was entered or woke up. Anything the work callbacks
+     * timestamped is never later than it. */
+    pa_usec_t now;
+
 #ifdef DEBUG_TIMING
     pa_usec_t timestamp;
     pa_usec_t slept, awake;
 #endif
 
+#ifdef USE_EPOLL
+    /* With epoll the fds stay registered between iterations, and only
+     * the pollfd entries that changed since are updated, so that the
+     * sleep costs as much as there are ready fds rather than watched
+     * ones. registered mirrors pollfd as epoll knows it, with fd -1 for
+     * entries that aren't registered. The timer is a timerfd in the
+     * same set. epoll_fd is -1 when we use ppoll() instead. */
+    int epoll_fd, timer_fd;
+    struct pollfd *registered;
+    struct epoll_event *events;
+    int n_events;
+    bool epoll_reset_needed:1;
+    bool timer_armed:1;
+    struct timeval armed_elapse;
+#endif
+
+#ifdef RTPOLL_JITTER
+    pa_rtpoll_jitter *jitter;
+#endif
+
+    /* The thread that runs the loop, once it did. Read from others. */
+    pa_atomic_ptr_t thread;
+
     PA_LLIST_HEAD(pa_rtpoll_item, items);
 };
 
@@ -84,6 +126,54 @@ struct pa_rtpoll_item {
 
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
+#ifdef RTPOLL_JITTER
+/* Numbers the loops, so that each one gets its own delays */
+static pa_atomic_t n_jitter_streams = PA_ATOMIC_INIT(0);
+#endif
+
+#ifdef USE_EPOLL
+/* Marks the timerfd in the epoll events, all other events carry the
+ * index of their pollfd entry */
+#define TIMER_INDEX UINT32_MAX
+
+static void epoll_done(pa_rtpoll *p) {
+    pa_assert(p);
+
+    if (p->epoll_fd >= 0)
+        pa_close(p->epoll_fd);
+    if (p->timer_fd >= 0)
+        pa_close(p->timer_fd);
+
+    p->epoll_fd = p->timer_fd = -1;
+}
+
+static int epoll_init(pa_rtpoll *p) {
+    struct epoll_event ev;
+
+    pa_assert(p);
+
+    p->timer_armed = false;
+
+    if ((p->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+        (p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+        goto fail;
+
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.u32 = TIMER_INDEX;
+
+    if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) < 0)
+        goto fail;
+
+    return 0;
+
+fail:
+    pa_log_debug("Failed to set up epoll, using ppoll(): %s", pa_cstrerror(errno));
+    epoll_done(p);
+    return -1;
+}
+#endif
+
 pa_rtpoll *pa_rtpoll_new(void) {
     pa_rtpoll *p;
 
@@ -93,6 +183,27 @@ pa_rtpoll *pa_rtpoll_new(void) {
     p->pollfd = pa_xnew(struct pollfd, p->n_pollfd_alloc);
     p->pollfd2 = pa_xnew(struct pollfd, p->n_pollfd_alloc);
 
+#ifdef USE_EPOLL
+    p->epoll_fd = p->timer_fd = -1;
+
+    if (!getenv("PULSE_RTPOLL_NO_EPOLL") && epoll_init(p) >= 0) {
+        p->registered = pa_xnew(struct pollfd, p->n_pollfd_alloc);
+        p->events = pa_xnew(struct epoll_event, p->n_pollfd_alloc + 1);
+        p->epoll_reset_needed = true;
+    }
+#endif
+
+#ifdef RTPOLL_JITTER
+    {
+        const char *spec;
+
+        if ((spec = getenv("PULSE_RTPOLL_JITTER")))
+            p->jitter = pa_rtpoll_jitter_new(spec, (unsigned) pa_atomic_inc(&n_jitter_streams));
+    }
+#endif
+
+    p->now = PA_USEC_INVALID;
+
 #ifdef DEBUG_TIMING
     p->timestamp = pa_rtclock_now();
 #endif
@@ -143,6 +254,18 @@ static void rtpoll_rebuild(pa_rtpoll *p) {
 
     if (ra)
         p->pollfd2 = pa_xrealloc(p->pollfd2, p->n_pollfd_alloc * sizeof(struct pollfd));
+
+#ifdef USE_EPOLL
+    /* The entries moved, so the indexes epoll knows them by are stale */
+    if (p->epoll_fd >= 0) {
+        if (ra) {
+            p->registered = pa_xrealloc(p->registered, p->n_pollfd_alloc * sizeof(struct pollfd));
+            p->events = pa_xrealloc(p->events, (p->n_pollfd_alloc + 1) * sizeof(struct epoll_event));
+        }
+
+        p->epoll_reset_needed = true;
+    }
+#endif
 }
 
 static void rtpoll_item_destroy(pa_rtpoll_item *i) {
@@ -171,6 +294,17 @@ void pa_rtpoll_free(pa_rtpoll *p) {
     pa_xfree(p->pollfd);
     pa_xfree(p->pollfd2);
 
+#ifdef USE_EPOLL
+    epoll_done(p);
+    pa_xfree(p->registered);
+    pa_xfree(p->events);
+#endif
+
+#ifdef RTPOLL_JITTER
+    if (p->jitter)
+        pa_rtpoll_jitter_free(p->jitter);
+#endif
+
     pa_xfree(p);
 }
 
@@ -201,6 +335,142 @@ static void reset_all_revents(pa_rtpoll *p) {
     }
 }
 
+#ifdef USE_EPOLL
+static int epoll_register(pa_rtpoll *p, unsigned k) {
+    struct pollfd *f = &p->pollfd[k], *r = &p->registered[k];
+    struct epoll_event ev;
+
+    pa_zero(ev);
+    ev.events = (uint32_t) f->events;
+    ev.data.u32 = k;
+
+    if (r->fd >= 0 && r->fd == f->fd) {
+        if (epoll_ctl(p->epoll_fd, EPOLL_CTL_MOD, f->fd, &ev) >= 0)
+            goto done;
+
+        /* Closed and reopened under the same number, epoll forgot it */
+        if (errno != ENOENT)
+            return -1;
+    } else if (r->fd >= 0)
+        /* Fails if the fd is closed already, it is gone from the set then */
+        epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, r->fd, NULL);
+
+    if (f->fd >= 0 && epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, f->fd, &ev) < 0)
+        return -1;
+
+done:
+    r->fd = f->fd;
+    r->events = f->events;
+    return 0;
+}
+
+/* Brings the epoll set in line with the pollfd array. Fails if epoll
+ * can't watch one of the fds, e.g. a regular file or an fd that is in
+ * the array twice. */
+static int epoll_update(pa_rtpoll *p) {
+    unsigned k;
+    int j;
+
+    if (p->epoll_reset_needed) {
+        /* Starting over is simpler than finding out what moved where */
+        epoll_done(p);
+
+        if (epoll_init(p) < 0)
+            return -1;
+
+        for (k = 0; k < p->n_pollfd_used; k++) {
+            p->registered[k].fd = -1;
+            p->pollfd[k].revents = 0;
+        }
+
+        p->n_events = 0;
+        p->epoll_reset_needed = false;
+    }
+
+    /* Clear what the previous sleep reported, as poll() would */
+    for (j = 0; j < p->n_events; j++) {
+        uint32_t idx = p->events[j].data.u32;
+
+        if (idx != TIMER_INDEX && idx < p->n_pollfd_used)
+            p->pollfd[idx].revents = 0;
+    }
+
+    p->n_events = 0;
+
+    for (k = 0; k < p->n_pollfd_used; k++)
+        if (p->pollfd[k].fd != p->registered[k].fd || p->pollfd[k].events != p->registered[k].events)
+            if (epoll_register(p, k) < 0) {
+                pa_log_debug("Can't watch fd %d with epoll, using ppoll(): %s", p->pollfd[k].fd, pa_cstrerror(errno));
+                return -1;
+            }
+
+    return 0;
+}
+
+static int epoll_arm_timer(pa_rtpoll *p, bool enable) {
+    struct itimerspec its;
+
+    if (enable && p->timer_armed && pa_timeval_cmp(&p->armed_elapse, &p->next_elapse) == 0)
+        return 0;
+
+    if (!enable && !p->timer_armed)
+        return 0;
+
+    pa_zero(its);
+
+    if (enable) {
+        /* pa_rtclock_get() is CLOCK_MONOTONIC, so this is the absolute
+         * time the poll path would compute its timeout from */
+        its.it_value.tv_sec = p->next_elapse.tv_sec;
+        its.it_value.tv_nsec = p->next_elapse.tv_usec * PA_NSEC_PER_USEC;
+    }
+
+    if (timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        return -1;
+
+    p->timer_armed = enable;
+    p->armed_elapse = p->next_elapse;
+    return 0;
+}
+
+/* Like ppoll(), returns the number of pollfd entries with events, 0 if
+ * the timer elapsed, negative on error */
+static int epoll_sleep(pa_rtpoll *p, const struct timeval *timeout) {
+    int r, j, n = 0, wait_msec = -1;
+
+    if (p->quit || (p->timer_enabled && timeout->tv_sec == 0 && timeout->tv_usec == 0))
+        wait_msec = 0;
+    else if (epoll_arm_timer(p, p->timer_enabled) < 0)
+        return -1;
+
+    if ((r = epoll_wait(p->epoll_fd, p->events, (int) p->n_pollfd_used + 1, wait_msec)) < 0)
+        return r;
+
+    for (j = 0; j < r; j++) {
+        uint32_t idx = p->events[j].data.u32;
+        struct pollfd *f;
+
+        if (idx == TIMER_INDEX) {
+            uint64_t expirations;
+
+            /* One shot, so it is disarmed now */
+            if (pa_read(p->timer_fd, &expirations, sizeof(expirations), NULL) < 0 && errno != EAGAIN)
+                pa_log_warn("Failed to read timerfd: %s", pa_cstrerror(errno));
+
+            p->timer_armed = false;
+            continue;
+        }
+
+        f = &p->pollfd[idx];
+        f->revents = (short) (p->events[j].events & (uint32_t) (f->events|POLLERR|POLLHUP|POLLNVAL));
+        n++;
+    }
+
+    p->n_events = r;
+    return n;
+}
+#endif
+
 int pa_rtpoll_run(pa_rtpoll *p) {
     pa_rtpoll_item *i;
     int r = 0;
@@ -215,6 +485,10 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 
     p->running = true;
     p->timer_elapsed = false;
+    p->now = PA_USEC_INVALID;
+
+    if (PA_UNLIKELY(!pa_atomic_ptr_load(&p->thread)))
+        pa_atomic_ptr_store(&p->thread, pa_thread_self());
 
     /* First, let's do some work */
     for (i = p->items; i && i->priority < PA_RTPOLL_NEVER; i = i->next) {
@@ -306,6 +580,14 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     /* OK, now let's sleep */
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0 && epoll_update(p) < 0)
+        epoll_done(p);
+
+    if (p->epoll_fd >= 0)
+        r = epoll_sleep(p, &timeout);
+    else
+#endif
 #ifdef HAVE_PPOLL
     {
         struct timespec ts;
@@ -318,6 +600,7 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     p->timer_elapsed = r == 0;
+    p->now = PA_USEC_INVALID;
 
 #ifdef DEBUG_TIMING
     {
@@ -340,6 +623,11 @@ int pa_rtpoll_run(pa_rtpoll *p) {
         reset_all_revents(p);
     }
 
+#ifdef RTPOLL_JITTER
+    if (p->jitter)
+        pa_rtpoll_jitter_inject(p->jitter, PA_RTPOLL_JITTER_WAKEUP);
+#endif
+
     /* Let's tell everyone that we left the sleep */
     for (i = p->items; i && i->priority < PA_RTPOLL_NEVER; i = i->next) {
 
@@ -543,18 +831,31 @@ static void asyncmsgq_read_after(pa_rtpoll_item *i) {
     pa_asyncmsgq_read_after_poll(i->userdata);
 }
 
+/* Dispatch what has piled up in one go instead of paying for a full
+ * rtpoll iteration per message, but leave the thread some room for its
+ * own work in between */
+#define ASYNCMSGQ_READ_BATCH 32
+
 static int asyncmsgq_read_work(pa_rtpoll_item *i) {
     pa_msgobject *object;
     int code;
     void *data;
     pa_memchunk chunk;
     int64_t offset;
+    unsigned n;
 
     pa_assert(i);
 
-    if (pa_asyncmsgq_get(i->userdata, &object, &code, &data, &offset, &chunk, 0) == 0) {
+    for (n = 0; n < ASYNCMSGQ_READ_BATCH; n++) {
         int ret;
 
+        /* A handler might have freed us */
+        if (i->dead)
+            break;
+
+        if (pa_asyncmsgq_get(i->userdata, &object, &code, &data, &offset, &chunk, 0) < 0)
+            break;
+
         if (!object && code == PA_MESSAGE_SHUTDOWN) {
             pa_asyncmsgq_done(i->userdata, 0);
             /* Requests the loop to exit. Will cause the next iteration of
@@ -565,10 +866,9 @@ static int asyncmsgq_read_work(pa_rtpoll_item *i) {
 
         ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
         pa_asyncmsgq_done(i->userdata, ret);
-        return 1;
     }
 
-    return 0;
+    return n > 0;
 }
 
 pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_read(pa_rtpoll *p, pa_rtpoll_priority_t prio, pa_asyncmsgq *q) {
@@ -627,8 +927,30 @@ pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_write(pa_rtpoll *p, pa_rtpoll_prior
     return i;
 }
 
+#ifdef RTPOLL_JITTER
+void pa_rtpoll_render_jitter(pa_rtpoll *p) {
+    if (p && p->jitter)
+        pa_rtpoll_jitter_inject(p->jitter, PA_RTPOLL_JITTER_RENDER);
+}
+#endif
+
+pa_thread *pa_rtpoll_get_thread(pa_rtpoll *p) {
+    pa_assert(p);
+
+    return pa_atomic_ptr_load(&p->thread);
+}
+
 bool pa_rtpoll_timer_elapsed(pa_rtpoll *p) {
     pa_assert(p);
 
     return p->timer_elapsed;
 }
+
+pa_usec_t pa_rtpoll_now(pa_rtpoll *p) {
+    pa_assert(p);
+
+    if (p->now == PA_USEC_INVALID)
+        p->now = pa_rtclock_now();
+
+    return p->now;
+}
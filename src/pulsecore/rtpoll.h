@@ -27,6 +27,7 @@
 #include <pulsecore/asyncmsgq.h>
 #include <pulsecore/fdsem.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
 
 /* An implementation of a "real-time" poll loop. Basically, this is
  * yet another wrapper around poll(). However it has certain
@@ -68,6 +69,22 @@ void pa_rtpoll_set_timer_disabled(pa_rtpoll *p);
  * the last pa_rtpoll_run() invocation to finish */
 bool pa_rtpoll_timer_elapsed(pa_rtpoll *p);
 
+/* Returns the time of the current iteration. The clock is read on the
+ * first call after pa_rtpoll_run() returned, later calls return the same
+ * value until it runs again, so all devices on one IO thread share a
+ * single read. Use pa_rtclock_now() where the time must be exact. */
+pa_usec_t pa_rtpoll_now(pa_rtpoll *p);
+
+/* The thread that runs p, NULL until it ran for the first time. May be
+ * called from any thread. */
+pa_thread *pa_rtpoll_get_thread(pa_rtpoll *p);
+
+#ifdef RTPOLL_JITTER
+/* Slows down the rendering of a sink as $PULSE_RTPOLL_JITTER asks, see
+ * rtpoll-jitter.h. p may be NULL. */
+void pa_rtpoll_render_jitter(pa_rtpoll *p);
+#endif
+
 /* A new fd wakeup item for pa_rtpoll */
 pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsigned n_fds);
 void pa_rtpoll_item_free(pa_rtpoll_item *i);
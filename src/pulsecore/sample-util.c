@@ -101,6 +101,21 @@ void* pa_silence_memory(void *p, size_t length, const pa_sample_spec *spec) {
     return p;
 }
 
+bool pa_memory_is_silence(const void *p, size_t length, const pa_sample_spec *spec) {
+    const uint8_t *d = p;
+    uint8_t c;
+
+    pa_assert(p);
+    pa_assert(length > 0);
+    pa_assert(spec);
+
+    c = silence_byte(spec->format);
+
+    /* Compare the buffer with itself shifted by one byte, which checks
+     * all of it against the first byte without a reference buffer */
+    return d[0] == c && memcmp(d, d + 1, length - 1) == 0;
+}
+
 size_t pa_frame_align(size_t l, const pa_sample_spec *ss) {
     size_t fs;
 
@@ -121,6 +136,48 @@ bool pa_frame_aligned(size_t l, const pa_sample_spec *ss) {
     return l % fs == 0;
 }
 
+/* Frame by frame, so the interleaved side is walked in order, with the
+ * common sample sizes copied as integers rather than by memcpy() */
+#define DEFINE_INTERLEAVE(type)                                                                 \
+    static void interleave_##type(const void *src[], unsigned channels, void *dst, unsigned n) { \
+        type *d = dst;                                                                          \
+        unsigned j, c;                                                                          \
+                                                                                                \
+        if (channels == 2) {                                                                    \
+            const type *l = src[0], *r = src[1];                                                \
+                                                                                                \
+            for (j = 0; j < n; j++, d += 2) {                                                   \
+                d[0] = l[j];                                                                    \
+                d[1] = r[j];                                                                    \
+            }                                                                                   \
+        } else                                                                                  \
+            for (j = 0; j < n; j++)                                                             \
+                for (c = 0; c < channels; c++)                                                  \
+                    *(d++) = ((const type*) src[c])[j];                                         \
+    }                                                                                           \
+                                                                                                \
+    static void deinterleave_##type(const void *src, void *dst[], unsigned channels, unsigned n) { \
+        const type *s = src;                                                                    \
+        unsigned j, c;                                                                          \
+                                                                                                \
+        if (channels == 2) {                                                                    \
+            type *l = dst[0], *r = dst[1];                                                      \
+                                                                                                \
+            for (j = 0; j < n; j++, s += 2) {                                                   \
+                l[j] = s[0];                                                                    \
+                r[j] = s[1];                                                                    \
+            }                                                                                   \
+        } else                                                                                  \
+            for (j = 0; j < n; j++)                                                             \
+                for (c = 0; c < channels; c++)                                                  \
+                    ((type*) dst[c])[j] = *(s++);                                               \
+    }
+
+DEFINE_INTERLEAVE(uint16_t)
+DEFINE_INTERLEAVE(uint32_t)
+
+#undef DEFINE_INTERLEAVE
+
 void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
     unsigned c;
     size_t fs;
@@ -131,6 +188,16 @@ void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, u
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if (ss == 4) {
+        interleave_uint32_t(src, channels, dst, n);
+        return;
+    }
+
+    if (ss == 2) {
+        interleave_uint16_t(src, channels, dst, n);
+        return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -159,6 +226,16 @@ void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss,
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if (ss == 4) {
+        deinterleave_uint32_t(src, dst, channels, n);
+        return;
+    }
+
+    if (ss == 2) {
+        deinterleave_uint16_t(src, dst, channels, n);
+        return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
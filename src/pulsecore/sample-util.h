@@ -40,6 +40,7 @@ void pa_silence_cache_init(pa_silence_cache *cache);
 void pa_silence_cache_done(pa_silence_cache *cache);
 
 void *pa_silence_memory(void *p, size_t length, const pa_sample_spec *spec);
+bool pa_memory_is_silence(const void *p, size_t length, const pa_sample_spec *spec);
 pa_memchunk* pa_silence_memchunk(pa_memchunk *c, const pa_sample_spec *spec);
 pa_memblock* pa_silence_memblock(pa_memblock *b, const pa_sample_spec *spec);
 
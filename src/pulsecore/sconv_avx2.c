@@ -0,0 +1,475 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sconv.h"
+
+#include <immintrin.h>
+
+/* The previous functions, for the samples left over at the end */
+static pa_convert_func_t fallback_to[PA_SAMPLE_MAX], fallback_from[PA_SAMPLE_MAX];
+static pa_convert_func_t fallback_to_s16[PA_SAMPLE_MAX], fallback_from_s16[PA_SAMPLE_MAX];
+
+/* Byte shuffles work on each 128 bit half separately, so the masks are
+ * the same as for SSE4.1 and get broadcast to both halves. Bytes with
+ * the high bit set are cleared. */
+static const PA_DECLARE_ALIGNED(16, uint8_t, swap16[16]) = {
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, swap32[16]) = {
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, unpack24le[16]) = {
+    0x80, 0, 1, 2, 0x80, 3, 4, 5, 0x80, 6, 7, 8, 0x80, 9, 10, 11
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, unpack24be[16]) = {
+    0x80, 2, 1, 0, 0x80, 5, 4, 3, 0x80, 8, 7, 6, 0x80, 11, 10, 9
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, pack24le[16]) = {
+    1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, 0x80, 0x80, 0x80, 0x80
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, pack24be[16]) = {
+    3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, 0x80, 0x80, 0x80, 0x80
+};
+
+static inline __m256i shuffle(__m256i x, const uint8_t *mask) {
+    return _mm256_shuffle_epi8(x, _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*) mask)));
+}
+
+static inline __m256 s32_to_float(__m256i x) {
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(x), _mm256_set1_ps(1.0f / (1U << 31)));
+}
+
+/* Like llrintf() clamped to 32 bits. Out of range values convert to
+ * INT32_MIN, flip the positive ones to INT32_MAX. */
+static inline __m256i s32_from_float(__m256 v) {
+    const __m256 scale = _mm256_set1_ps((float) (1U << 31));
+
+    v = _mm256_mul_ps(v, scale);
+
+    return _mm256_xor_si256(_mm256_cvtps_epi32(v), _mm256_castps_si256(_mm256_cmp_ps(v, scale, _CMP_GE_OQ)));
+}
+
+static inline __m256i s16_from_float(__m256 v) {
+    v = _mm256_mul_ps(v, _mm256_set1_ps(1 << 15));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-0x8000)), _mm256_set1_ps(0x7FFF));
+
+    return _mm256_cvtps_epi32(v);
+}
+
+static inline void s16_to_float32ne(unsigned n, const int16_t *a, float *b, const uint8_t *swap, pa_convert_func_t fallback) {
+    const __m256 scale = _mm256_set1_ps(1.0f / (1 << 15));
+
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*) a);
+
+        if (swap)
+            s = _mm_shuffle_epi8(s, _mm_load_si128((const __m128i*) swap));
+
+        _mm256_storeu_ps(b, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s)), scale));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void s16_from_float32ne(unsigned n, const float *a, int16_t *b, const uint8_t *swap, pa_convert_func_t fallback) {
+    for (; n >= 16; n -= 16, a += 16, b += 16) {
+        __m256i lo = s16_from_float(_mm256_loadu_ps(a));
+        __m256i hi = s16_from_float(_mm256_loadu_ps(a + 8));
+
+        /* Packing works on each half, put the samples back in order */
+        __m256i s = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+
+        if (swap)
+            s = shuffle(s, swap);
+
+        _mm256_storeu_si256((__m256i*) b, s);
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+/* With shift set the samples are 24 bit in the lower bits */
+static inline void s32_to_float32ne(unsigned n, const int32_t *a, float *b, const uint8_t *swap, bool shift, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*) a);
+
+        if (swap)
+            s = shuffle(s, swap);
+        if (shift)
+            s = _mm256_slli_epi32(s, 8);
+
+        _mm256_storeu_ps(b, s32_to_float(s));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void s32_from_float32ne(unsigned n, const float *a, int32_t *b, const uint8_t *swap, bool shift, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m256i s = s32_from_float(_mm256_loadu_ps(a));
+
+        if (shift)
+            s = _mm256_srli_epi32(s, 8);
+        if (swap)
+            s = shuffle(s, swap);
+
+        _mm256_storeu_si256((__m256i*) b, s);
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+/* Eight samples take 24 bytes, of which each half of the vector holds
+ * twelve. The halves are loaded and stored separately, which touches 28
+ * bytes, so stop while 30 bytes are left. When storing, the overlapping
+ * bytes are overwritten by the following samples. */
+static inline void s24_to_float32ne(unsigned n, const uint8_t *a, float *b, const uint8_t *unpack, pa_convert_func_t fallback) {
+    for (; n >= 10; n -= 8, a += 24, b += 8) {
+        __m256i s = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) a)),
+                                            _mm_loadu_si128((const __m128i*) (a + 12)), 1);
+
+        _mm256_storeu_ps(b, s32_to_float(shuffle(s, unpack)));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void s24_from_float32ne(unsigned n, const float *a, uint8_t *b, const uint8_t *pack, pa_convert_func_t fallback) {
+    for (; n >= 10; n -= 8, a += 8, b += 24) {
+        __m256i s = shuffle(s32_from_float(_mm256_loadu_ps(a)), pack);
+
+        _mm_storeu_si128((__m128i*) b, _mm256_castsi256_si128(s));
+        _mm_storeu_si128((__m128i*) (b + 12), _mm256_extracti128_si256(s, 1));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static void s16le_to_float32ne_avx2(unsigned n, const int16_t *a, float *b) {
+    s16_to_float32ne(n, a, b, NULL, fallback_to[PA_SAMPLE_S16LE]);
+}
+
+static void s16be_to_float32ne_avx2(unsigned n, const int16_t *a, float *b) {
+    s16_to_float32ne(n, a, b, swap16, fallback_to[PA_SAMPLE_S16BE]);
+}
+
+static void s16le_from_float32ne_avx2(unsigned n, const float *a, int16_t *b) {
+    s16_from_float32ne(n, a, b, NULL, fallback_from[PA_SAMPLE_S16LE]);
+}
+
+static void s16be_from_float32ne_avx2(unsigned n, const float *a, int16_t *b) {
+    s16_from_float32ne(n, a, b, swap16, fallback_from[PA_SAMPLE_S16BE]);
+}
+
+static void s32le_to_float32ne_avx2(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, NULL, false, fallback_to[PA_SAMPLE_S32LE]);
+}
+
+static void s32be_to_float32ne_avx2(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, swap32, false, fallback_to[PA_SAMPLE_S32BE]);
+}
+
+static void s32le_from_float32ne_avx2(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, NULL, false, fallback_from[PA_SAMPLE_S32LE]);
+}
+
+static void s32be_from_float32ne_avx2(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, swap32, false, fallback_from[PA_SAMPLE_S32BE]);
+}
+
+static void s24_32le_to_float32ne_avx2(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, NULL, true, fallback_to[PA_SAMPLE_S24_32LE]);
+}
+
+static void s24_32be_to_float32ne_avx2(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, swap32, true, fallback_to[PA_SAMPLE_S24_32BE]);
+}
+
+static void s24_32le_from_float32ne_avx2(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, NULL, true, fallback_from[PA_SAMPLE_S24_32LE]);
+}
+
+static void s24_32be_from_float32ne_avx2(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, swap32, true, fallback_from[PA_SAMPLE_S24_32BE]);
+}
+
+static void s24le_to_float32ne_avx2(unsigned n, const uint8_t *a, float *b) {
+    s24_to_float32ne(n, a, b, unpack24le, fallback_to[PA_SAMPLE_S24LE]);
+}
+
+static void s24be_to_float32ne_avx2(unsigned n, const uint8_t *a, float *b) {
+    s24_to_float32ne(n, a, b, unpack24be, fallback_to[PA_SAMPLE_S24BE]);
+}
+
+static void s24le_from_float32ne_avx2(unsigned n, const float *a, uint8_t *b) {
+    s24_from_float32ne(n, a, b, pack24le, fallback_from[PA_SAMPLE_S24LE]);
+}
+
+static void s24be_from_float32ne_avx2(unsigned n, const float *a, uint8_t *b) {
+    s24_from_float32ne(n, a, b, pack24be, fallback_from[PA_SAMPLE_S24BE]);
+}
+
+/* Converting either way is the same byte swap */
+static void float32re_to_float32ne_avx2(unsigned n, const float *a, float *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+        _mm256_storeu_si256((__m256i*) b, shuffle(_mm256_loadu_si256((const __m256i*) a), swap32));
+
+    if (n > 0)
+        fallback_to[PA_SAMPLE_FLOAT32RE](n, a, b);
+}
+
+/* G.711 works as with SSE4.1, on sixteen samples at a time */
+static const PA_DECLARE_ALIGNED(16, uint8_t, ulaw_seg_pow2[16]) = {
+    1, 2, 4, 8, 16, 32, 64, 128, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, alaw_seg_pow2[16]) = {
+    1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static inline __m256i seg_pow2(__m256i seg, const uint8_t *pow2) {
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*) pow2)),
+                               _mm256_or_si256(seg, _mm256_set1_epi16((int16_t) 0x8000)));
+}
+
+static inline __m256i ulaw_to_s16(__m256i u) {
+    __m256i seg, t, neg;
+
+    u = _mm256_xor_si256(u, _mm256_set1_epi16(0xFF));
+    neg = _mm256_srai_epi16(_mm256_slli_epi16(u, 8), 15);
+    seg = _mm256_srli_epi16(_mm256_and_si256(u, _mm256_set1_epi16(0x70)), 4);
+
+    t = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(u, _mm256_set1_epi16(0x0F)), 3), _mm256_set1_epi16(0x84));
+    t = _mm256_sub_epi16(_mm256_mullo_epi16(t, seg_pow2(seg, ulaw_seg_pow2)), _mm256_set1_epi16(0x84));
+
+    return _mm256_sub_epi16(_mm256_xor_si256(t, neg), neg);
+}
+
+static inline __m256i alaw_to_s16(__m256i a) {
+    __m256i seg, t, neg;
+
+    a = _mm256_xor_si256(a, _mm256_set1_epi16(0x55));
+    neg = _mm256_cmpgt_epi16(_mm256_slli_epi16(a, 8), _mm256_set1_epi16(-1));
+    seg = _mm256_srli_epi16(_mm256_and_si256(a, _mm256_set1_epi16(0x70)), 4);
+
+    t = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(a, _mm256_set1_epi16(0x0F)), 4), _mm256_set1_epi16(8));
+    t = _mm256_add_epi16(t, _mm256_andnot_si256(_mm256_cmpeq_epi16(seg, _mm256_setzero_si256()), _mm256_set1_epi16(0x100)));
+    t = _mm256_mullo_epi16(t, seg_pow2(seg, alaw_seg_pow2));
+
+    return _mm256_sub_epi16(_mm256_xor_si256(t, neg), neg);
+}
+
+static inline __m256i seg_quant(__m256i mag, int lowest_seg_bit) {
+    return _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(mag)), 19),
+                            _mm256_set1_epi32((127 + lowest_seg_bit) << 4));
+}
+
+static inline __m256i ulaw_from_s14(__m256i x) {
+    __m256i mask = _mm256_xor_si256(_mm256_and_si256(_mm256_srai_epi32(x, 31), _mm256_set1_epi32(0x80)), _mm256_set1_epi32(0xFF));
+    __m256i mag = _mm256_add_epi32(_mm256_min_epi32(_mm256_abs_epi32(x), _mm256_set1_epi32(8158)), _mm256_set1_epi32(0x84 >> 2));
+
+    return _mm256_xor_si256(seg_quant(mag, 5), mask);
+}
+
+static inline __m256i alaw_from_s13(__m256i x) {
+    __m256i neg = _mm256_srai_epi32(x, 31);
+    __m256i mask = _mm256_xor_si256(_mm256_and_si256(neg, _mm256_set1_epi32(0x80)), _mm256_set1_epi32(0xD5));
+    __m256i mag = _mm256_xor_si256(x, neg);
+    __m256i seg0 = _mm256_cmpgt_epi32(_mm256_set1_epi32(0x20), mag);
+    __m256i code;
+
+    code = seg_quant(_mm256_add_epi32(mag, _mm256_and_si256(seg0, _mm256_set1_epi32(0x20))), 4);
+    code = _mm256_sub_epi32(code, _mm256_and_si256(seg0, _mm256_set1_epi32(0x10)));
+
+    return _mm256_xor_si256(code, mask);
+}
+
+static inline __m256i g711_to_s16(__m256i c, bool ulaw) {
+    return ulaw ? ulaw_to_s16(c) : alaw_to_s16(c);
+}
+
+static inline __m256i g711_from_s32(__m256i x, bool ulaw) {
+    return ulaw ? ulaw_from_s14(x) : alaw_from_s13(x);
+}
+
+static inline __m256i g711_from_float(__m256 v, bool ulaw) {
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+
+    return g711_from_s32(_mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(ulaw ? 0x1FFF : 0xFFF))), ulaw);
+}
+
+/* Packing works on each half, put the codes back in order */
+static inline void store_g711(uint8_t *b, __m256i lo, __m256i hi) {
+    __m256i c = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+
+    _mm_storeu_si128((__m128i*) b, _mm_packus_epi16(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1)));
+}
+
+static inline void g711_to_s16ne(unsigned n, const uint8_t *a, int16_t *b, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 16; n -= 16, a += 16, b += 16)
+        _mm256_storeu_si256((__m256i*) b, g711_to_s16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) a)), ulaw));
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void g711_to_float32ne(unsigned n, const uint8_t *a, float *b, bool ulaw, pa_convert_func_t fallback) {
+    const __m256 scale = _mm256_set1_ps(1.0f / (1 << 15));
+
+    for (; n >= 16; n -= 16, a += 16, b += 16) {
+        __m256i s = g711_to_s16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) a)), ulaw);
+
+        _mm256_storeu_ps(b, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(s))), scale));
+        _mm256_storeu_ps(b + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1))), scale));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void g711_from_s16ne(unsigned n, const int16_t *a, uint8_t *b, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 16; n -= 16, a += 16, b += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i*) a);
+
+        s = ulaw ? _mm256_srai_epi16(s, 2) : _mm256_srai_epi16(s, 3);
+
+        store_g711(b, g711_from_s32(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)), ulaw),
+                   g711_from_s32(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)), ulaw));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void g711_from_float32ne(unsigned n, const float *a, uint8_t *b, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 16; n -= 16, a += 16, b += 16)
+        store_g711(b, g711_from_float(_mm256_loadu_ps(a), ulaw), g711_from_float(_mm256_loadu_ps(a + 8), ulaw));
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static void ulaw_to_s16ne_avx2(unsigned n, const uint8_t *a, int16_t *b) {
+    g711_to_s16ne(n, a, b, true, fallback_to_s16[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_to_s16ne_avx2(unsigned n, const uint8_t *a, int16_t *b) {
+    g711_to_s16ne(n, a, b, false, fallback_to_s16[PA_SAMPLE_ALAW]);
+}
+
+static void ulaw_from_s16ne_avx2(unsigned n, const int16_t *a, uint8_t *b) {
+    g711_from_s16ne(n, a, b, true, fallback_from_s16[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_from_s16ne_avx2(unsigned n, const int16_t *a, uint8_t *b) {
+    g711_from_s16ne(n, a, b, false, fallback_from_s16[PA_SAMPLE_ALAW]);
+}
+
+static void ulaw_to_float32ne_avx2(unsigned n, const uint8_t *a, float *b) {
+    g711_to_float32ne(n, a, b, true, fallback_to[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_to_float32ne_avx2(unsigned n, const uint8_t *a, float *b) {
+    g711_to_float32ne(n, a, b, false, fallback_to[PA_SAMPLE_ALAW]);
+}
+
+static void ulaw_from_float32ne_avx2(unsigned n, const float *a, uint8_t *b) {
+    g711_from_float32ne(n, a, b, true, fallback_from[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_from_float32ne_avx2(unsigned n, const float *a, uint8_t *b) {
+    g711_from_float32ne(n, a, b, false, fallback_from[PA_SAMPLE_ALAW]);
+}
+
+static void set_to_float32ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_to[f] = pa_get_convert_to_float32ne_function(f);
+    pa_set_convert_to_float32ne_function(f, func);
+}
+
+static void set_from_float32ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_from[f] = pa_get_convert_from_float32ne_function(f);
+    pa_set_convert_from_float32ne_function(f, func);
+}
+
+static void set_to_s16ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_to_s16[f] = pa_get_convert_to_s16ne_function(f);
+    pa_set_convert_to_s16ne_function(f, func);
+}
+
+static void set_from_s16ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_from_s16[f] = pa_get_convert_from_s16ne_function(f);
+    pa_set_convert_from_s16ne_function(f, func);
+}
+
+void pa_convert_func_init_avx2(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_AVX2))
+        return;
+
+    pa_log_info("Initialising AVX2 optimized conversions.");
+
+    set_to_float32ne(PA_SAMPLE_S16LE, (pa_convert_func_t) s16le_to_float32ne_avx2);
+    set_to_float32ne(PA_SAMPLE_S16BE, (pa_convert_func_t) s16be_to_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S16LE, (pa_convert_func_t) s16le_from_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S16BE, (pa_convert_func_t) s16be_from_float32ne_avx2);
+
+    set_to_float32ne(PA_SAMPLE_S32LE, (pa_convert_func_t) s32le_to_float32ne_avx2);
+    set_to_float32ne(PA_SAMPLE_S32BE, (pa_convert_func_t) s32be_to_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S32LE, (pa_convert_func_t) s32le_from_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S32BE, (pa_convert_func_t) s32be_from_float32ne_avx2);
+
+    set_to_float32ne(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_to_float32ne_avx2);
+    set_to_float32ne(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_to_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_from_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_from_float32ne_avx2);
+
+    set_to_float32ne(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_to_float32ne_avx2);
+    set_to_float32ne(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_to_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_from_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_from_float32ne_avx2);
+
+    set_to_float32ne(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) float32re_to_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) float32re_to_float32ne_avx2);
+
+    set_to_s16ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_to_s16ne_avx2);
+    set_to_s16ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_to_s16ne_avx2);
+    set_from_s16ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_from_s16ne_avx2);
+    set_from_s16ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_from_s16ne_avx2);
+
+    set_to_float32ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_to_float32ne_avx2);
+    set_to_float32ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_to_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_from_float32ne_avx2);
+    set_from_float32ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_from_float32ne_avx2);
+}
@@ -85,6 +85,252 @@ static void pa_sconv_s16le_to_f32ne_neon(unsigned n, const int16_t *src, float *
     }
 }
 
+/* The previous functions, for the samples left over at the end */
+static pa_convert_func_t fallback_to[PA_SAMPLE_MAX], fallback_from[PA_SAMPLE_MAX];
+static pa_convert_func_t fallback_to_s16[PA_SAMPLE_MAX], fallback_from_s16[PA_SAMPLE_MAX];
+
+/* With swap set the samples are byte swapped, with shift they are 24 bit
+ * in the lower bits */
+static inline void s32_to_f32ne(unsigned n, const int32_t *src, float *dst, bool swap, bool shift, pa_convert_func_t fallback) {
+    for (; n >= 4; n -= 4, src += 4, dst += 4) {
+        int32x4_t s = vld1q_s32(src);
+
+        if (swap)
+            s = vreinterpretq_s32_u8(vrev32q_u8(vreinterpretq_u8_s32(s)));
+        if (shift)
+            s = vshlq_n_s32(s, 8);
+
+        vst1q_f32(dst, vcvtq_n_f32_s32(s, 31)); /* f32<-s32 and divide by (1<<31) */
+    }
+
+    if (n > 0)
+        fallback(n, src, dst);
+}
+
+static inline void s32_from_f32ne(unsigned n, const float *src, int32_t *dst, bool swap, bool shift, pa_convert_func_t fallback) {
+    for (; n >= 4; n -= 4, src += 4, dst += 4) {
+        int32x4_t s = vcvtq_n_s32_f32(vld1q_f32(src), 31); /* saturating s32<-f32 times (1<<31) */
+
+        if (shift)
+            s = vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(s), 8));
+        if (swap)
+            s = vreinterpretq_s32_u8(vrev32q_u8(vreinterpretq_u8_s32(s)));
+
+        vst1q_s32(dst, s);
+    }
+
+    if (n > 0)
+        fallback(n, src, dst);
+}
+
+static void pa_sconv_s32le_to_f32ne_neon(unsigned n, const int32_t *src, float *dst) {
+    s32_to_f32ne(n, src, dst, false, false, fallback_to[PA_SAMPLE_S32LE]);
+}
+
+static void pa_sconv_s32be_to_f32ne_neon(unsigned n, const int32_t *src, float *dst) {
+    s32_to_f32ne(n, src, dst, true, false, fallback_to[PA_SAMPLE_S32BE]);
+}
+
+static void pa_sconv_s32le_from_f32ne_neon(unsigned n, const float *src, int32_t *dst) {
+    s32_from_f32ne(n, src, dst, false, false, fallback_from[PA_SAMPLE_S32LE]);
+}
+
+static void pa_sconv_s32be_from_f32ne_neon(unsigned n, const float *src, int32_t *dst) {
+    s32_from_f32ne(n, src, dst, true, false, fallback_from[PA_SAMPLE_S32BE]);
+}
+
+static void pa_sconv_s24_32le_to_f32ne_neon(unsigned n, const int32_t *src, float *dst) {
+    s32_to_f32ne(n, src, dst, false, true, fallback_to[PA_SAMPLE_S24_32LE]);
+}
+
+static void pa_sconv_s24_32be_to_f32ne_neon(unsigned n, const int32_t *src, float *dst) {
+    s32_to_f32ne(n, src, dst, true, true, fallback_to[PA_SAMPLE_S24_32BE]);
+}
+
+static void pa_sconv_s24_32le_from_f32ne_neon(unsigned n, const float *src, int32_t *dst) {
+    s32_from_f32ne(n, src, dst, false, true, fallback_from[PA_SAMPLE_S24_32LE]);
+}
+
+static void pa_sconv_s24_32be_from_f32ne_neon(unsigned n, const float *src, int32_t *dst) {
+    s32_from_f32ne(n, src, dst, true, true, fallback_from[PA_SAMPLE_S24_32BE]);
+}
+
+/* G.711, with the variable shifts and the leading zero counts of NEON
+ * in place of the branches and table searches */
+static inline int16x8_t ulaw_to_s16(uint16x8_t u) {
+    uint16x8_t seg, t;
+    int16x8_t s;
+
+    u = veorq_u16(u, vdupq_n_u16(0xFF));
+    seg = vshrq_n_u16(vandq_u16(u, vdupq_n_u16(0x70)), 4);
+
+    t = vaddq_u16(vshlq_n_u16(vandq_u16(u, vdupq_n_u16(0x0F)), 3), vdupq_n_u16(0x84));
+    t = vsubq_u16(vshlq_u16(t, vreinterpretq_s16_u16(seg)), vdupq_n_u16(0x84));
+    s = vreinterpretq_s16_u16(t);
+
+    return vbslq_s16(vtstq_u16(u, vdupq_n_u16(0x80)), vnegq_s16(s), s);
+}
+
+/* Segment 0 has no leading one, the others are shifted by one less than
+ * their number */
+static inline int16x8_t alaw_to_s16(uint16x8_t a) {
+    uint16x8_t seg, t;
+    int16x8_t s;
+
+    a = veorq_u16(a, vdupq_n_u16(0x55));
+    seg = vshrq_n_u16(vandq_u16(a, vdupq_n_u16(0x70)), 4);
+
+    t = vaddq_u16(vshlq_n_u16(vandq_u16(a, vdupq_n_u16(0x0F)), 4), vdupq_n_u16(8));
+    t = vaddq_u16(t, vshlq_n_u16(vminq_u16(seg, vdupq_n_u16(1)), 8));
+    t = vshlq_u16(t, vreinterpretq_s16_u16(vqsubq_u16(seg, vdupq_n_u16(1))));
+    s = vreinterpretq_s16_u16(t);
+
+    return vbslq_s16(vtstq_u16(a, vdupq_n_u16(0x80)), s, vnegq_s16(s));
+}
+
+/* Like st_14linear2ulaw(). The leading one of the biased magnitude is at
+ * bit 5 in segment 0. Clipping at 8158 rather than at 8159 gives the same
+ * code without going past the last segment. */
+static inline uint16x8_t ulaw_from_s14(int16x8_t x) {
+    uint16x8_t mask = veorq_u16(vandq_u16(vcltq_s16(x, vdupq_n_s16(0)), vdupq_n_u16(0x80)), vdupq_n_u16(0xFF));
+    uint16x8_t mag = vaddq_u16(vminq_u16(vreinterpretq_u16_s16(vabsq_s16(x)), vdupq_n_u16(8158)), vdupq_n_u16(0x84 >> 2));
+    int16x8_t clz = vreinterpretq_s16_u16(vclzq_u16(mag));
+    int16x8_t seg = vsubq_s16(vdupq_n_s16(10), clz);
+    uint16x8_t quant = vandq_u16(vshlq_u16(mag, vsubq_s16(clz, vdupq_n_s16(11))), vdupq_n_u16(0x0F));
+
+    return veorq_u16(vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(seg), 4), quant), mask);
+}
+
+/* Like st_13linear2alaw(). The leading one is at bit 5 in segment 1,
+ * segment 0 is quantized like segment 1. */
+static inline uint16x8_t alaw_from_s13(int16x8_t x) {
+    uint16x8_t neg = vcltq_s16(x, vdupq_n_s16(0));
+    uint16x8_t mask = veorq_u16(vandq_u16(neg, vdupq_n_u16(0x80)), vdupq_n_u16(0xD5));
+    uint16x8_t mag = veorq_u16(vreinterpretq_u16_s16(x), neg);
+    int16x8_t seg = vmaxq_s16(vsubq_s16(vdupq_n_s16(11), vreinterpretq_s16_u16(vclzq_u16(mag))), vdupq_n_s16(0));
+    uint16x8_t quant = vandq_u16(vshlq_u16(mag, vnegq_s16(vmaxq_s16(seg, vdupq_n_s16(1)))), vdupq_n_u16(0x0F));
+
+    return veorq_u16(vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(seg), 4), quant), mask);
+}
+
+/* Rounds to nearest even like lrintf(), which the conversions of ARMv7
+ * don't. Adding 1.5 * 2^23 leaves the integer in the mantissa. */
+static inline int32x4_t round_f32(float32x4_t v) {
+    const float32x4_t magic = vdupq_n_f32(12582912.0f);
+
+    return vsubq_s32(vreinterpretq_s32_f32(vaddq_f32(v, magic)), vreinterpretq_s32_f32(magic));
+}
+
+static inline int16x8_t g711_to_s16(uint16x8_t c, bool ulaw) {
+    return ulaw ? ulaw_to_s16(c) : alaw_to_s16(c);
+}
+
+/* The samples are scaled to 14 bit for u-law and to 13 bit for A-law */
+static inline uint8x8_t g711_from_s16(int16x8_t x, bool ulaw) {
+    return vmovn_u16(ulaw ? ulaw_from_s14(x) : alaw_from_s13(x));
+}
+
+static inline int32x4_t g711_from_f32(float32x4_t v, bool ulaw) {
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-1.0f)), vdupq_n_f32(1.0f));
+
+    return round_f32(vmulq_f32(v, vdupq_n_f32(ulaw ? 0x1FFF : 0xFFF)));
+}
+
+static inline void g711_to_s16ne(unsigned n, const uint8_t *src, int16_t *dst, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, src += 8, dst += 8)
+        vst1q_s16(dst, g711_to_s16(vmovl_u8(vld1_u8(src)), ulaw));
+
+    if (n > 0)
+        fallback(n, src, dst);
+}
+
+static inline void g711_to_f32ne(unsigned n, const uint8_t *src, float *dst, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, src += 8, dst += 8) {
+        int16x8_t s = g711_to_s16(vmovl_u8(vld1_u8(src)), ulaw);
+
+        vst1q_f32(dst, vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(s)), 15)); /* f32<-s32 and divide by (1<<15) */
+        vst1q_f32(dst + 4, vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(s)), 15));
+    }
+
+    if (n > 0)
+        fallback(n, src, dst);
+}
+
+static inline void g711_from_s16ne(unsigned n, const int16_t *src, uint8_t *dst, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, src += 8, dst += 8) {
+        int16x8_t s = vld1q_s16(src);
+
+        vst1_u8(dst, g711_from_s16(ulaw ? vshrq_n_s16(s, 2) : vshrq_n_s16(s, 3), ulaw));
+    }
+
+    if (n > 0)
+        fallback(n, src, dst);
+}
+
+static inline void g711_from_f32ne(unsigned n, const float *src, uint8_t *dst, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, src += 8, dst += 8) {
+        int16x8_t s = vcombine_s16(vmovn_s32(g711_from_f32(vld1q_f32(src), ulaw)),
+                                   vmovn_s32(g711_from_f32(vld1q_f32(src + 4), ulaw)));
+
+        vst1_u8(dst, g711_from_s16(s, ulaw));
+    }
+
+    if (n > 0)
+        fallback(n, src, dst);
+}
+
+static void pa_sconv_ulaw_to_s16ne_neon(unsigned n, const uint8_t *src, int16_t *dst) {
+    g711_to_s16ne(n, src, dst, true, fallback_to_s16[PA_SAMPLE_ULAW]);
+}
+
+static void pa_sconv_alaw_to_s16ne_neon(unsigned n, const uint8_t *src, int16_t *dst) {
+    g711_to_s16ne(n, src, dst, false, fallback_to_s16[PA_SAMPLE_ALAW]);
+}
+
+static void pa_sconv_ulaw_from_s16ne_neon(unsigned n, const int16_t *src, uint8_t *dst) {
+    g711_from_s16ne(n, src, dst, true, fallback_from_s16[PA_SAMPLE_ULAW]);
+}
+
+static void pa_sconv_alaw_from_s16ne_neon(unsigned n, const int16_t *src, uint8_t *dst) {
+    g711_from_s16ne(n, src, dst, false, fallback_from_s16[PA_SAMPLE_ALAW]);
+}
+
+static void pa_sconv_ulaw_to_f32ne_neon(unsigned n, const uint8_t *src, float *dst) {
+    g711_to_f32ne(n, src, dst, true, fallback_to[PA_SAMPLE_ULAW]);
+}
+
+static void pa_sconv_alaw_to_f32ne_neon(unsigned n, const uint8_t *src, float *dst) {
+    g711_to_f32ne(n, src, dst, false, fallback_to[PA_SAMPLE_ALAW]);
+}
+
+static void pa_sconv_ulaw_from_f32ne_neon(unsigned n, const float *src, uint8_t *dst) {
+    g711_from_f32ne(n, src, dst, true, fallback_from[PA_SAMPLE_ULAW]);
+}
+
+static void pa_sconv_alaw_from_f32ne_neon(unsigned n, const float *src, uint8_t *dst) {
+    g711_from_f32ne(n, src, dst, false, fallback_from[PA_SAMPLE_ALAW]);
+}
+
+static void set_to_f32ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_to[f] = pa_get_convert_to_float32ne_function(f);
+    pa_set_convert_to_float32ne_function(f, func);
+}
+
+static void set_from_f32ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_from[f] = pa_get_convert_from_float32ne_function(f);
+    pa_set_convert_from_float32ne_function(f, func);
+}
+
+static void set_to_s16ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_to_s16[f] = pa_get_convert_to_s16ne_function(f);
+    pa_set_convert_to_s16ne_function(f, func);
+}
+
+static void set_from_s16ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_from_s16[f] = pa_get_convert_from_s16ne_function(f);
+    pa_set_convert_from_s16ne_function(f, func);
+}
+
 void pa_convert_func_init_neon(pa_cpu_arm_flag_t flags) {
     pa_log_info("Initialising ARM NEON optimized conversions.");
     pa_set_convert_from_float32ne_function(PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_neon);
@@ -92,5 +338,25 @@ void pa_convert_func_init_neon(pa_cpu_arm_flag_t flags) {
 #ifndef WORDS_BIGENDIAN
     pa_set_convert_from_s16ne_function(PA_SAMPLE_FLOAT32LE, (pa_convert_func_t) pa_sconv_s16le_to_f32ne_neon);
     pa_set_convert_to_s16ne_function(PA_SAMPLE_FLOAT32LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_neon);
+
+    set_to_f32ne(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_f32ne_neon);
+    set_to_f32ne(PA_SAMPLE_S32BE, (pa_convert_func_t) pa_sconv_s32be_to_f32ne_neon);
+    set_from_f32ne(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_from_f32ne_neon);
+    set_from_f32ne(PA_SAMPLE_S32BE, (pa_convert_func_t) pa_sconv_s32be_from_f32ne_neon);
+
+    set_to_f32ne(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_f32ne_neon);
+    set_to_f32ne(PA_SAMPLE_S24_32BE, (pa_convert_func_t) pa_sconv_s24_32be_to_f32ne_neon);
+    set_from_f32ne(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_from_f32ne_neon);
+    set_from_f32ne(PA_SAMPLE_S24_32BE, (pa_convert_func_t) pa_sconv_s24_32be_from_f32ne_neon);
 #endif
+
+    set_to_s16ne(PA_SAMPLE_ULAW, (pa_convert_func_t) pa_sconv_ulaw_to_s16ne_neon);
+    set_to_s16ne(PA_SAMPLE_ALAW, (pa_convert_func_t) pa_sconv_alaw_to_s16ne_neon);
+    set_from_s16ne(PA_SAMPLE_ULAW, (pa_convert_func_t) pa_sconv_ulaw_from_s16ne_neon);
+    set_from_s16ne(PA_SAMPLE_ALAW, (pa_convert_func_t) pa_sconv_alaw_from_s16ne_neon);
+
+    set_to_f32ne(PA_SAMPLE_ULAW, (pa_convert_func_t) pa_sconv_ulaw_to_f32ne_neon);
+    set_to_f32ne(PA_SAMPLE_ALAW, (pa_convert_func_t) pa_sconv_alaw_to_f32ne_neon);
+    set_from_f32ne(PA_SAMPLE_ULAW, (pa_convert_func_t) pa_sconv_ulaw_from_f32ne_neon);
+    set_from_f32ne(PA_SAMPLE_ALAW, (pa_convert_func_t) pa_sconv_alaw_from_f32ne_neon);
 }
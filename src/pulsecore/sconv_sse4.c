@@ -0,0 +1,470 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sconv.h"
+
+#include <smmintrin.h>
+
+/* The scalar functions, for the samples left over at the end */
+static pa_convert_func_t fallback_to[PA_SAMPLE_MAX], fallback_from[PA_SAMPLE_MAX];
+static pa_convert_func_t fallback_to_s16[PA_SAMPLE_MAX], fallback_from_s16[PA_SAMPLE_MAX];
+
+/* Byte shuffles, bytes with the high bit set are cleared */
+static const PA_DECLARE_ALIGNED(16, uint8_t, swap16[16]) = {
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, swap32[16]) = {
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+/* Four packed 24 bit samples to the upper 24 bits of 32 bit lanes */
+static const PA_DECLARE_ALIGNED(16, uint8_t, unpack24le[16]) = {
+    0x80, 0, 1, 2, 0x80, 3, 4, 5, 0x80, 6, 7, 8, 0x80, 9, 10, 11
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, unpack24be[16]) = {
+    0x80, 2, 1, 0, 0x80, 5, 4, 3, 0x80, 8, 7, 6, 0x80, 11, 10, 9
+};
+
+/* And back, the last four bytes are don't care */
+static const PA_DECLARE_ALIGNED(16, uint8_t, pack24le[16]) = {
+    1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, 0x80, 0x80, 0x80, 0x80
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, pack24be[16]) = {
+    3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, 0x80, 0x80, 0x80, 0x80
+};
+
+static inline __m128i shuffle(__m128i x, const uint8_t *mask) {
+    return _mm_shuffle_epi8(x, _mm_load_si128((const __m128i*) mask));
+}
+
+static inline __m128 s32_to_float(__m128i x) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(1.0f / (1U << 31)));
+}
+
+/* Like llrintf() clamped to 32 bits. Out of range values convert to
+ * INT32_MIN, flip the positive ones to INT32_MAX. */
+static inline __m128i s32_from_float(__m128 v) {
+    const __m128 scale = _mm_set1_ps((float) (1U << 31));
+
+    v = _mm_mul_ps(v, scale);
+
+    return _mm_xor_si128(_mm_cvtps_epi32(v), _mm_castps_si128(_mm_cmpge_ps(v, scale)));
+}
+
+static inline void s16_to_float32ne(unsigned n, const int16_t *a, float *b, const uint8_t *swap, pa_convert_func_t fallback) {
+    const __m128 scale = _mm_set1_ps(1.0f / (1 << 15));
+
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*) a);
+
+        if (swap)
+            s = shuffle(s, swap);
+
+        _mm_storeu_ps(b, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(s)), scale));
+        _mm_storeu_ps(b + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(s, 8))), scale));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+/* Clamped first, so that large values can't wrap when converting */
+static inline __m128i s16_from_float(__m128 v) {
+    v = _mm_mul_ps(v, _mm_set1_ps(1 << 15));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-0x8000)), _mm_set1_ps(0x7FFF));
+
+    return _mm_cvtps_epi32(v);
+}
+
+static inline void s16_from_float32ne(unsigned n, const float *a, int16_t *b, const uint8_t *swap, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i lo = s16_from_float(_mm_loadu_ps(a));
+        __m128i hi = s16_from_float(_mm_loadu_ps(a + 4));
+        __m128i s = _mm_packs_epi32(lo, hi);
+
+        if (swap)
+            s = shuffle(s, swap);
+
+        _mm_storeu_si128((__m128i*) b, s);
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+/* With shift set the samples are 24 bit in the lower bits */
+static inline void s32_to_float32ne(unsigned n, const int32_t *a, float *b, const uint8_t *swap, bool shift, pa_convert_func_t fallback) {
+    for (; n >= 4; n -= 4, a += 4, b += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*) a);
+
+        if (swap)
+            s = shuffle(s, swap);
+        if (shift)
+            s = _mm_slli_epi32(s, 8);
+
+        _mm_storeu_ps(b, s32_to_float(s));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void s32_from_float32ne(unsigned n, const float *a, int32_t *b, const uint8_t *swap, bool shift, pa_convert_func_t fallback) {
+    for (; n >= 4; n -= 4, a += 4, b += 4) {
+        __m128i s = s32_from_float(_mm_loadu_ps(a));
+
+        if (shift)
+            s = _mm_srli_epi32(s, 8);
+        if (swap)
+            s = shuffle(s, swap);
+
+        _mm_storeu_si128((__m128i*) b, s);
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+/* Four samples take 12 bytes but a full vector is loaded or stored, so
+ * stop while 16 bytes are left. When storing, the last four bytes are
+ * overwritten by the next samples. */
+static inline void s24_to_float32ne(unsigned n, const uint8_t *a, float *b, const uint8_t *unpack, pa_convert_func_t fallback) {
+    for (; n >= 6; n -= 4, a += 12, b += 4)
+        _mm_storeu_ps(b, s32_to_float(shuffle(_mm_loadu_si128((const __m128i*) a), unpack)));
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void s24_from_float32ne(unsigned n, const float *a, uint8_t *b, const uint8_t *pack, pa_convert_func_t fallback) {
+    for (; n >= 6; n -= 4, a += 4, b += 12)
+        _mm_storeu_si128((__m128i*) b, shuffle(s32_from_float(_mm_loadu_ps(a)), pack));
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static void s16le_to_float32ne_sse4(unsigned n, const int16_t *a, float *b) {
+    s16_to_float32ne(n, a, b, NULL, fallback_to[PA_SAMPLE_S16LE]);
+}
+
+static void s16be_to_float32ne_sse4(unsigned n, const int16_t *a, float *b) {
+    s16_to_float32ne(n, a, b, swap16, fallback_to[PA_SAMPLE_S16BE]);
+}
+
+static void s16be_from_float32ne_sse4(unsigned n, const float *a, int16_t *b) {
+    s16_from_float32ne(n, a, b, swap16, fallback_from[PA_SAMPLE_S16BE]);
+}
+
+static void s32le_to_float32ne_sse4(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, NULL, false, fallback_to[PA_SAMPLE_S32LE]);
+}
+
+static void s32be_to_float32ne_sse4(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, swap32, false, fallback_to[PA_SAMPLE_S32BE]);
+}
+
+static void s32le_from_float32ne_sse4(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, NULL, false, fallback_from[PA_SAMPLE_S32LE]);
+}
+
+static void s32be_from_float32ne_sse4(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, swap32, false, fallback_from[PA_SAMPLE_S32BE]);
+}
+
+static void s24_32le_to_float32ne_sse4(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, NULL, true, fallback_to[PA_SAMPLE_S24_32LE]);
+}
+
+static void s24_32be_to_float32ne_sse4(unsigned n, const int32_t *a, float *b) {
+    s32_to_float32ne(n, a, b, swap32, true, fallback_to[PA_SAMPLE_S24_32BE]);
+}
+
+static void s24_32le_from_float32ne_sse4(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, NULL, true, fallback_from[PA_SAMPLE_S24_32LE]);
+}
+
+static void s24_32be_from_float32ne_sse4(unsigned n, const float *a, int32_t *b) {
+    s32_from_float32ne(n, a, b, swap32, true, fallback_from[PA_SAMPLE_S24_32BE]);
+}
+
+static void s24le_to_float32ne_sse4(unsigned n, const uint8_t *a, float *b) {
+    s24_to_float32ne(n, a, b, unpack24le, fallback_to[PA_SAMPLE_S24LE]);
+}
+
+static void s24be_to_float32ne_sse4(unsigned n, const uint8_t *a, float *b) {
+    s24_to_float32ne(n, a, b, unpack24be, fallback_to[PA_SAMPLE_S24BE]);
+}
+
+static void s24le_from_float32ne_sse4(unsigned n, const float *a, uint8_t *b) {
+    s24_from_float32ne(n, a, b, pack24le, fallback_from[PA_SAMPLE_S24LE]);
+}
+
+static void s24be_from_float32ne_sse4(unsigned n, const float *a, uint8_t *b) {
+    s24_from_float32ne(n, a, b, pack24be, fallback_from[PA_SAMPLE_S24BE]);
+}
+
+/* Converting either way is the same byte swap */
+static void float32re_to_float32ne_sse4(unsigned n, const float *a, float *b) {
+    for (; n >= 4; n -= 4, a += 4, b += 4)
+        _mm_storeu_si128((__m128i*) b, shuffle(_mm_loadu_si128((const __m128i*) a), swap32));
+
+    if (n > 0)
+        fallback_to[PA_SAMPLE_FLOAT32RE](n, a, b);
+}
+
+/* G.711 is decoded with a few shifts, where the shift by the segment is
+ * a multiplication by its power of two from a byte shuffle. With the
+ * high bit set in the upper byte of the index that byte is cleared. */
+static const PA_DECLARE_ALIGNED(16, uint8_t, ulaw_seg_pow2[16]) = {
+    1, 2, 4, 8, 16, 32, 64, 128, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const PA_DECLARE_ALIGNED(16, uint8_t, alaw_seg_pow2[16]) = {
+    1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static inline __m128i seg_pow2(__m128i seg, const uint8_t *pow2) {
+    return _mm_shuffle_epi8(_mm_load_si128((const __m128i*) pow2), _mm_or_si128(seg, _mm_set1_epi16((int16_t) 0x8000)));
+}
+
+/* Like st_ulaw2linear16() on the codes in the lower bytes of the words */
+static inline __m128i ulaw_to_s16(__m128i u) {
+    __m128i seg, t, neg;
+
+    u = _mm_xor_si128(u, _mm_set1_epi16(0xFF));
+    neg = _mm_srai_epi16(_mm_slli_epi16(u, 8), 15);
+    seg = _mm_srli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x70)), 4);
+
+    t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x0F)), 3), _mm_set1_epi16(0x84));
+    t = _mm_sub_epi16(_mm_mullo_epi16(t, seg_pow2(seg, ulaw_seg_pow2)), _mm_set1_epi16(0x84));
+
+    return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+/* Like st_alaw2linear16(), segment 0 has no leading one and the others
+ * are shifted by one less than their number */
+static inline __m128i alaw_to_s16(__m128i a) {
+    __m128i seg, t, neg;
+
+    a = _mm_xor_si128(a, _mm_set1_epi16(0x55));
+    neg = _mm_cmpgt_epi16(_mm_slli_epi16(a, 8), _mm_set1_epi16(-1));
+    seg = _mm_srli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x70)), 4);
+
+    t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x0F)), 4), _mm_set1_epi16(8));
+    t = _mm_add_epi16(t, _mm_andnot_si128(_mm_cmpeq_epi16(seg, _mm_setzero_si128()), _mm_set1_epi16(0x100)));
+    t = _mm_mullo_epi16(t, seg_pow2(seg, alaw_seg_pow2));
+
+    return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+/* Converting a magnitude to float puts the position of its leading one
+ * in the exponent and the four bits below it at the top of the mantissa,
+ * which is just the segment and the quantization bits of G.711 */
+static inline __m128i seg_quant(__m128i mag, int lowest_seg_bit) {
+    return _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(mag)), 19), _mm_set1_epi32((127 + lowest_seg_bit) << 4));
+}
+
+/* Like st_14linear2ulaw(). Clipping at 8158 rather than at 8159 gives the
+ * same code without the biased magnitude going past the last segment. */
+static inline __m128i ulaw_from_s14(__m128i x) {
+    __m128i mask = _mm_xor_si128(_mm_and_si128(_mm_srai_epi32(x, 31), _mm_set1_epi32(0x80)), _mm_set1_epi32(0xFF));
+    __m128i mag = _mm_add_epi32(_mm_min_epi32(_mm_abs_epi32(x), _mm_set1_epi32(8158)), _mm_set1_epi32(0x84 >> 2));
+
+    return _mm_xor_si128(seg_quant(mag, 5), mask);
+}
+
+/* Like st_13linear2alaw(). Segment 0 lacks the leading one, so one is
+ * added and taken away again afterwards. */
+static inline __m128i alaw_from_s13(__m128i x) {
+    __m128i neg = _mm_srai_epi32(x, 31);
+    __m128i mask = _mm_xor_si128(_mm_and_si128(neg, _mm_set1_epi32(0x80)), _mm_set1_epi32(0xD5));
+    __m128i mag = _mm_xor_si128(x, neg);
+    __m128i seg0 = _mm_cmpgt_epi32(_mm_set1_epi32(0x20), mag);
+    __m128i code;
+
+    code = seg_quant(_mm_add_epi32(mag, _mm_and_si128(seg0, _mm_set1_epi32(0x20))), 4);
+    code = _mm_sub_epi32(code, _mm_and_si128(seg0, _mm_set1_epi32(0x10)));
+
+    return _mm_xor_si128(code, mask);
+}
+
+static inline __m128i g711_to_s16(__m128i c, bool ulaw) {
+    return ulaw ? ulaw_to_s16(c) : alaw_to_s16(c);
+}
+
+/* The samples are scaled to 14 bit for u-law and to 13 bit for A-law */
+static inline __m128i g711_from_s32(__m128i x, bool ulaw) {
+    return ulaw ? ulaw_from_s14(x) : alaw_from_s13(x);
+}
+
+static inline __m128i g711_from_float(__m128 v, bool ulaw) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+
+    return g711_from_s32(_mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(ulaw ? 0x1FFF : 0xFFF))), ulaw);
+}
+
+static inline void store_g711(uint8_t *b, __m128i lo, __m128i hi) {
+    _mm_storel_epi64((__m128i*) b, _mm_packus_epi16(_mm_packus_epi32(lo, hi), _mm_setzero_si128()));
+}
+
+static inline void g711_to_s16ne(unsigned n, const uint8_t *a, int16_t *b, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+        _mm_storeu_si128((__m128i*) b, g711_to_s16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) a)), ulaw));
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void g711_to_float32ne(unsigned n, const uint8_t *a, float *b, bool ulaw, pa_convert_func_t fallback) {
+    const __m128 scale = _mm_set1_ps(1.0f / (1 << 15));
+
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i s = g711_to_s16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) a)), ulaw);
+
+        _mm_storeu_ps(b, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(s)), scale));
+        _mm_storeu_ps(b + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(s, 8))), scale));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void g711_from_s16ne(unsigned n, const int16_t *a, uint8_t *b, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*) a);
+
+        s = ulaw ? _mm_srai_epi16(s, 2) : _mm_srai_epi16(s, 3);
+
+        store_g711(b, g711_from_s32(_mm_cvtepi16_epi32(s), ulaw),
+                   g711_from_s32(_mm_cvtepi16_epi32(_mm_srli_si128(s, 8)), ulaw));
+    }
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static inline void g711_from_float32ne(unsigned n, const float *a, uint8_t *b, bool ulaw, pa_convert_func_t fallback) {
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+        store_g711(b, g711_from_float(_mm_loadu_ps(a), ulaw), g711_from_float(_mm_loadu_ps(a + 4), ulaw));
+
+    if (n > 0)
+        fallback(n, a, b);
+}
+
+static void ulaw_to_s16ne_sse4(unsigned n, const uint8_t *a, int16_t *b) {
+    g711_to_s16ne(n, a, b, true, fallback_to_s16[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_to_s16ne_sse4(unsigned n, const uint8_t *a, int16_t *b) {
+    g711_to_s16ne(n, a, b, false, fallback_to_s16[PA_SAMPLE_ALAW]);
+}
+
+static void ulaw_from_s16ne_sse4(unsigned n, const int16_t *a, uint8_t *b) {
+    g711_from_s16ne(n, a, b, true, fallback_from_s16[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_from_s16ne_sse4(unsigned n, const int16_t *a, uint8_t *b) {
+    g711_from_s16ne(n, a, b, false, fallback_from_s16[PA_SAMPLE_ALAW]);
+}
+
+static void ulaw_to_float32ne_sse4(unsigned n, const uint8_t *a, float *b) {
+    g711_to_float32ne(n, a, b, true, fallback_to[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_to_float32ne_sse4(unsigned n, const uint8_t *a, float *b) {
+    g711_to_float32ne(n, a, b, false, fallback_to[PA_SAMPLE_ALAW]);
+}
+
+static void ulaw_from_float32ne_sse4(unsigned n, const float *a, uint8_t *b) {
+    g711_from_float32ne(n, a, b, true, fallback_from[PA_SAMPLE_ULAW]);
+}
+
+static void alaw_from_float32ne_sse4(unsigned n, const float *a, uint8_t *b) {
+    g711_from_float32ne(n, a, b, false, fallback_from[PA_SAMPLE_ALAW]);
+}
+
+static void set_to_float32ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_to[f] = pa_get_convert_to_float32ne_function(f);
+    pa_set_convert_to_float32ne_function(f, func);
+}
+
+static void set_from_float32ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_from[f] = pa_get_convert_from_float32ne_function(f);
+    pa_set_convert_from_float32ne_function(f, func);
+}
+
+static void set_to_s16ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_to_s16[f] = pa_get_convert_to_s16ne_function(f);
+    pa_set_convert_to_s16ne_function(f, func);
+}
+
+static void set_from_s16ne(pa_sample_format_t f, pa_convert_func_t func) {
+    fallback_from_s16[f] = pa_get_convert_from_s16ne_function(f);
+    pa_set_convert_from_s16ne_function(f, func);
+}
+
+void pa_convert_func_init_sse4(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_SSE4_1))
+        return;
+
+    pa_log_info("Initialising SSE4.1 optimized conversions.");
+
+    /* S16LE from float32ne is left to the SSE2 code */
+    set_to_float32ne(PA_SAMPLE_S16LE, (pa_convert_func_t) s16le_to_float32ne_sse4);
+    set_to_float32ne(PA_SAMPLE_S16BE, (pa_convert_func_t) s16be_to_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_S16BE, (pa_convert_func_t) s16be_from_float32ne_sse4);
+
+    set_to_float32ne(PA_SAMPLE_S32LE, (pa_convert_func_t) s32le_to_float32ne_sse4);
+    set_to_float32ne(PA_SAMPLE_S32BE, (pa_convert_func_t) s32be_to_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_S32LE, (pa_convert_func_t) s32le_from_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_S32BE, (pa_convert_func_t) s32be_from_float32ne_sse4);
+
+    set_to_float32ne(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_to_float32ne_sse4);
+    set_to_float32ne(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_to_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_S24_32LE, (pa_convert_func_t) s24_32le_from_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_S24_32BE, (pa_convert_func_t) s24_32be_from_float32ne_sse4);
+
+    set_to_float32ne(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_to_float32ne_sse4);
+    set_to_float32ne(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_to_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_S24LE, (pa_convert_func_t) s24le_from_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_S24BE, (pa_convert_func_t) s24be_from_float32ne_sse4);
+
+    set_to_float32ne(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) float32re_to_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) float32re_to_float32ne_sse4);
+
+    set_to_s16ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_to_s16ne_sse4);
+    set_to_s16ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_to_s16ne_sse4);
+    set_from_s16ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_from_s16ne_sse4);
+    set_from_s16ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_from_s16ne_sse4);
+
+    set_to_float32ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_to_float32ne_sse4);
+    set_to_float32ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_to_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_ULAW, (pa_convert_func_t) ulaw_from_float32ne_sse4);
+    set_from_float32ne(PA_SAMPLE_ALAW, (pa_convert_func_t) alaw_from_float32ne_sse4);
+}
@@ -37,6 +37,10 @@
 #include <sys/mman.h>
 #endif
 
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
 /* This is deprecated on glibc but is still used by FreeBSD */
 #if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
 # define MAP_ANONYMOUS MAP_ANON
@@ -58,6 +62,40 @@
 #define MADV_REMOVE 9
 #endif
 
+#if defined(__linux__) && !defined(MADV_HUGEPAGE)
+#define MADV_HUGEPAGE 14
+#endif
+
+#ifdef HAVE_MEMFD
+/* Not all libcs know about these yet */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (1024 + 9)
+#define F_GET_SEALS (1024 + 10)
+#endif
+#ifndef F_SEAL_SEAL
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+#endif
+
+/* We don't want to depend on libnuma just for mbind() */
+#if defined(__linux__) && defined(SYS_mbind)
+#define SHM_HAVE_MBIND 1
+#define SHM_MPOL_BIND 2
+#define SHM_MPOL_MF_MOVE (1<<1)
+#endif
+
+/* The usual size of huge pages. We only ask for explicit huge pages
+ * if the segment size is a multiple of this */
+#define SHM_HUGE_PAGE_SIZE (2*1024*1024)
+
 /* 1 GiB at max */
 #define MAX_SHM_SIZE (PA_ALIGN(1024*1024*1024))
 
@@ -100,7 +138,77 @@ static char *segment_name(char *fn, size_t l, unsigned id) {
 }
 #endif
 
-int pa_shm_create_rw(pa_shm *m, size_t size, bool shared, mode_t mode) {
+static void advise_huge_pages(pa_shm *m) {
+    pa_assert(m);
+
+#ifdef MADV_HUGEPAGE
+    /* Transparent huge pages. For SHM segments this only has an effect
+     * if the kernel has been configured to allow huge pages on tmpfs. */
+    if (madvise(m->ptr, PA_PAGE_ALIGN(m->size), MADV_HUGEPAGE) < 0)
+        pa_log_debug("madvise(MADV_HUGEPAGE) failed: %s", pa_cstrerror(errno));
+    else
+        pa_log_debug("Requested transparent huge pages for memory segment.");
+#endif
+}
+
+int pa_shm_set_numa_node(pa_shm *m, int numa_node) {
+#ifdef SHM_HAVE_MBIND
+    unsigned long mask = 0;
+#endif
+
+    pa_assert(m);
+    pa_assert(m->ptr);
+    pa_assert(m->size > 0);
+
+    if (numa_node < 0)
+        return 0;
+
+#ifdef SHM_HAVE_MBIND
+    if (numa_node >= (int) (sizeof(mask) * 8)) {
+        pa_log_warn("NUMA node %i out of range.", numa_node);
+        return -1;
+    }
+
+    mask = 1UL << numa_node;
+
+    /* The kernel takes the number of bits plus one here */
+    if (syscall(SYS_mbind, m->ptr, (unsigned long) PA_PAGE_ALIGN(m->size), SHM_MPOL_BIND,
+                &mask, (unsigned long) (sizeof(mask) * 8 + 1), SHM_MPOL_MF_MOVE) < 0) {
+        pa_log_warn("mbind() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    pa_log_debug("Bound memory segment to NUMA node %i.", numa_node);
+    return 0;
+#else
+    pa_log_warn("Binding memory to NUMA nodes is not supported on this platform.");
+    return -1;
+#endif
+}
+
+int pa_shm_lock(pa_shm *m) {
+    pa_assert(m);
+    pa_assert(m->ptr);
+    pa_assert(m->size > 0);
+
+    if (m->locked)
+        return 0;
+
+#ifdef HAVE_MLOCK
+    if (mlock(m->ptr, m->size) < 0) {
+        pa_log_warn("mlock() of %lu byte segment failed: %s", (unsigned long) m->size, pa_cstrerror(errno));
+        return -1;
+    }
+
+    m->locked = true;
+    return 0;
+#else
+    pa_log_warn("Locking memory is not supported on this platform.");
+    return -1;
+#endif
+}
+
+int pa_shm_create_rw(pa_shm *m, size_t size, bool shared, mode_t mode, bool huge_pages, int numa_node) {
 #ifdef HAVE_SHM_OPEN
     char fn[32];
     int fd = -1;
@@ -124,7 +232,23 @@ int pa_shm_create_rw(pa_shm *m, size_t size, bool shared, mode_t mode) {
         m->size = size;
 
 #ifdef MAP_ANONYMOUS
-        if ((m->ptr = mmap(NULL, m->size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, (off_t) 0)) == MAP_FAILED) {
+        m->ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+        /* Try explicit huge pages first, this only works if some have
+         * been reserved by the administrator */
+        if (huge_pages && m->size % SHM_HUGE_PAGE_SIZE == 0) {
+            if ((m->ptr = mmap(NULL, m->size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGETLB, -1, (off_t) 0)) == MAP_FAILED)
+                pa_log_debug("mmap(MAP_HUGETLB) failed, falling back to transparent huge pages: %s", pa_cstrerror(errno));
+            else {
+                pa_log_debug("Using explicit huge pages for memory segment.");
+                huge_pages = false;
+            }
+        }
+#endif
+
+        if (m->ptr == MAP_FAILED &&
+            (m->ptr = mmap(NULL, m->size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, (off_t) 0)) == MAP_FAILED) {
             pa_log("mmap() failed: %s", pa_cstrerror(errno));
             goto fail;
         }
@@ -185,6 +309,17 @@ int pa_shm_create_rw(pa_shm *m, size_t size, bool shared, mode_t mode) {
     }
 
     m->shared = shared;
+    m->memfd = false;
+    m->locked = false;
+    m->fd = -1;
+
+    /* Both are just hints, we don't fail if the kernel doesn't
+     * follow them */
+    if (huge_pages)
+        advise_huge_pages(m);
+
+    if (numa_node >= 0)
+        pa_shm_set_numa_node(m, numa_node);
 
     return 0;
 
@@ -200,6 +335,112 @@ fail:
     return -1;
 }
 
+int pa_shm_create_memfd(pa_shm *m, size_t size) {
+#ifdef HAVE_MEMFD
+    char name[32];
+    int fd;
+
+    pa_assert(m);
+    pa_assert(size > 0);
+    pa_assert(size <= MAX_SHM_SIZE);
+
+    size = PA_PAGE_ALIGN(size);
+
+    pa_random(&m->id, sizeof(m->id));
+
+    /* Only shows up in /proc/<pid>/fd, there is no namespace to clash in */
+    pa_snprintf(name, sizeof(name), "pulseaudio-%u", m->id);
+
+    if ((fd = (int) syscall(SYS_memfd_create, name, MFD_CLOEXEC|MFD_ALLOW_SEALING)) < 0) {
+        pa_log_debug("memfd_create() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t) size) < 0) {
+        pa_log("ftruncate() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL) < 0) {
+        pa_log("Failed to seal memfd: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+    if ((m->ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_NORESERVE, fd, (off_t) 0)) == MAP_FAILED) {
+        pa_log("mmap() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    m->size = size;
+    m->do_unlink = false;
+    m->shared = true;
+    m->memfd = true;
+    m->locked = false;
+    m->fd = fd;
+
+    return 0;
+
+fail:
+    pa_close(fd);
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+int pa_shm_attach_memfd(pa_shm *m, unsigned id, int fd, bool writable) {
+#ifdef HAVE_MEMFD
+    struct stat st;
+    int seals;
+
+    pa_assert(m);
+    pa_assert(fd >= 0);
+
+    /* Without the seal the peer could truncate the file under us at any
+     * time, and every access past the end would fault */
+    if ((seals = fcntl(fd, F_GET_SEALS)) < 0 || !(seals & F_SEAL_SHRINK)) {
+        pa_log("Refusing to map memfd that is not sealed against shrinking.");
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        pa_log("fstat() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    if (st.st_size <= 0 ||
+        st.st_size > (off_t) MAX_SHM_SIZE ||
+        PA_ALIGN((size_t) st.st_size) != (size_t) st.st_size) {
+        pa_log("Invalid shared memory segment size");
+        return -1;
+    }
+
+    m->size = (size_t) st.st_size;
+
+    if ((m->ptr = mmap(NULL, PA_PAGE_ALIGN(m->size), writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, (off_t) 0)) == MAP_FAILED) {
+        pa_log("mmap() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    m->id = id;
+    m->do_unlink = false;
+    m->shared = true;
+    m->memfd = true;
+    m->locked = false;
+
+    /* Only the creator keeps it open */
+    m->fd = -1;
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 void pa_shm_free(pa_shm *m) {
     pa_assert(m);
     pa_assert(m->ptr);
@@ -209,6 +450,12 @@ void pa_shm_free(pa_shm *m) {
     pa_assert(m->ptr != MAP_FAILED);
 #endif
 
+#ifdef HAVE_MLOCK
+    /* munmap() would do this for us, free() wouldn't */
+    if (m->locked)
+        munlock(m->ptr, m->size);
+#endif
+
     if (!m->shared) {
 #ifdef MAP_ANONYMOUS
         if (munmap(m->ptr, m->size) < 0)
@@ -218,6 +465,12 @@ void pa_shm_free(pa_shm *m) {
 #else
         pa_xfree(m->ptr);
 #endif
+    } else if (m->memfd) {
+        if (munmap(m->ptr, PA_PAGE_ALIGN(m->size)) < 0)
+            pa_log("munmap() failed: %s", pa_cstrerror(errno));
+
+        if (m->fd >= 0)
+            pa_close(m->fd);
     } else {
 #ifdef HAVE_SHM_OPEN
         if (munmap(m->ptr, PA_PAGE_ALIGN(m->size)) < 0)
@@ -256,6 +509,9 @@ void pa_shm_punch(pa_shm *m, size_t offset, size_t size) {
     /* You're welcome to implement this as NOOP on systems that don't
      * support it */
 
+    if (m->locked)
+        return;
+
     /* Align the pointer up to multiples of the page size */
     ptr = (uint8_t*) m->ptr + offset;
     o = (size_t) ((uint8_t*) ptr - (uint8_t*) PA_PAGE_ALIGN_PTR(ptr));
@@ -326,6 +582,9 @@ int pa_shm_attach(pa_shm *m, unsigned id, bool writable) {
 
     m->do_unlink = false;
     m->shared = true;
+    m->memfd = false;
+    m->locked = false;
+    m->fd = -1;
 
     pa_assert_se(pa_close(fd) == 0);
 
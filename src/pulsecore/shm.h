@@ -30,13 +30,43 @@ typedef struct pa_shm {
     size_t size;
     bool do_unlink:1;
     bool shared:1;
+
+    /* Backed by an anonymous memfd instead of a named POSIX segment.
+     * Others can only map it if we pass them fd, which stays open for
+     * as long as we created the segment. */
+    bool memfd:1;
+    int fd;
+
+    /* Locked into RAM with pa_shm_lock() */
+    bool locked:1;
 } pa_shm;
 
-int pa_shm_create_rw(pa_shm *m, size_t size, bool shared, mode_t mode);
+/* If huge_pages is true the segment is backed with huge pages if
+ * possible. If numa_node is non-negative the memory is bound to that
+ * NUMA node. */
+int pa_shm_create_rw(pa_shm *m, size_t size, bool shared, mode_t mode, bool huge_pages, int numa_node);
 int pa_shm_attach(pa_shm *m, unsigned id, bool writable);
 
+/* Creates a shared segment that can neither grow nor shrink, so that
+ * whoever maps it never faults on a truncated file. Fails if memfds are
+ * not supported. */
+int pa_shm_create_memfd(pa_shm *m, size_t size);
+
+/* Maps the memfd segment another process sent us. It has to be sealed
+ * against shrinking. The caller keeps ownership of fd. */
+int pa_shm_attach_memfd(pa_shm *m, unsigned id, int fd, bool writable);
+
 void pa_shm_punch(pa_shm *m, size_t offset, size_t size);
 
+/* Bind the memory to the specified NUMA node, migrating pages that
+ * have already been touched */
+int pa_shm_set_numa_node(pa_shm *m, int numa_node);
+
+/* Fault in the whole segment and keep it in RAM, so that whoever reads
+ * it never page faults. Punching holes into it does nothing from then
+ * on. */
+int pa_shm_lock(pa_shm *m);
+
 void pa_shm_free(pa_shm *m);
 
 int pa_shm_cleanup(void);
@@ -28,6 +28,7 @@
 #include <pulse/utf8.h>
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
+#include <pulse/rtclock.h>
 #include <pulse/internal.h>
 
 #include <pulsecore/core-format.h>
@@ -38,6 +39,7 @@
 #include <pulsecore/play-memblockq.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/tracepoint.h>
 
 #include "sink-input.h"
 
@@ -256,6 +258,7 @@ static void reset_callbacks(pa_sink_input *i) {
     pa_assert(i);
 
     i->pop = NULL;
+    i->pop_into = NULL;
     i->process_underrun = NULL;
     i->process_rewind = NULL;
     i->update_max_rewind = NULL;
@@ -441,6 +444,11 @@ int pa_sink_input_new(
         return -PA_ERR_TOOLARGE;
     }
 
+    if (data->sink->refuse_inputs) {
+        pa_log_warn("Failed to create sink input: sink %s is overloaded.", data->sink->name);
+        return -PA_ERR_TOOLARGE;
+    }
+
     if ((data->flags & PA_SINK_INPUT_VARIABLE_RATE) ||
         !pa_sample_spec_equal(&data->sample_spec, &data->sink->sample_spec) ||
         !pa_channel_map_equal(&data->channel_map, &data->sink->channel_map)) {
@@ -456,7 +464,8 @@ int pa_sink_input_new(
                           ((data->flags & PA_SINK_INPUT_VARIABLE_RATE) ? PA_RESAMPLER_VARIABLE_RATE : 0) |
                           ((data->flags & PA_SINK_INPUT_NO_REMAP) ? PA_RESAMPLER_NO_REMAP : 0) |
                           (core->disable_remixing || (data->flags & PA_SINK_INPUT_NO_REMIX) ? PA_RESAMPLER_NO_REMIX : 0) |
-                          (core->disable_lfe_remixing ? PA_RESAMPLER_NO_LFE : 0)))) {
+                          (core->disable_lfe_remixing ? PA_RESAMPLER_NO_LFE : 0) |
+                          (core->resampler_timing ? PA_RESAMPLER_TIMING : 0)))) {
                 pa_log_warn("Unsupported resampling operation.");
                 return -PA_ERR_NOTSUPPORTED;
             }
@@ -529,17 +538,28 @@ int pa_sink_input_new(
     i->thread_info.state = i->state;
     i->thread_info.attached = false;
     pa_atomic_store(&i->thread_info.drained, 1);
+    pa_atomic_store(&i->thread_info.resampler_usec, 0);
+    pa_atomic_store(&i->thread_info.n_underruns, 0);
+    pa_atomic_store(&i->thread_info.silence_frames, 0);
+    pa_atomic_store(&i->thread_info.n_rewinds, 0);
+    pa_atomic_store(&i->thread_info.render_usec, 0);
     i->thread_info.sample_spec = i->sample_spec;
     i->thread_info.resampler = resampler;
     i->thread_info.soft_volume = i->soft_volume;
     i->thread_info.muted = i->muted;
+    i->thread_info.ramp_length = 0;
+    i->thread_info.ramp_index = 0;
     i->thread_info.requested_sink_latency = (pa_usec_t) -1;
     i->thread_info.rewrite_nbytes = 0;
     i->thread_info.rewrite_flush = false;
     i->thread_info.dont_rewind_render = false;
+    i->thread_info.move_rewrite = 0;
     i->thread_info.underrun_for = (uint64_t) -1;
     i->thread_info.underrun_for_sink = 0;
     i->thread_info.playing_for = 0;
+    i->thread_info.mix_since = INT64_MAX;
+    i->thread_info.start_time = 0;
+    i->thread_info.start_padding = (size_t) -1;
     i->thread_info.direct_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
     pa_assert_se(pa_idxset_put(core->sink_inputs, i, &i->index) == 0);
@@ -835,12 +855,90 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency) {
 }
 
 /* Called from thread context */
+/* Called from thread context. The soft volume at the given position of
+ * the ramp. */
+static void get_ramp_volume(pa_sink_input *i, int64_t index, pa_cvolume *volume) {
+    double t;
+    unsigned c;
+
+    if (index >= (int64_t) i->thread_info.ramp_length) {
+        *volume = i->thread_info.soft_volume;
+        return;
+    }
+
+    /* The ramp is linear in the amplitude, like the mixing is */
+    t = (double) index / (double) i->thread_info.ramp_length;
+
+    volume->channels = i->thread_info.soft_volume.channels;
+    for (c = 0; c < volume->channels; c++) {
+        double from = pa_sw_volume_to_linear(i->thread_info.ramp_volume.values[c]);
+        double to = pa_sw_volume_to_linear(i->thread_info.soft_volume.values[c]);
+
+        volume->values[c] = pa_sw_volume_from_linear(from + (to - from) * t);
+    }
+}
+
+/* Called from thread context. Changes the soft volume to volume, gliding
+ * there from from over usec, or at once if usec is 0 or the volume is
+ * applied before resampling. The ramp starts with the next data that is
+ * rendered. */
+static void start_volume_ramp(pa_sink_input *i, const pa_cvolume *from, const pa_cvolume *volume, pa_usec_t usec) {
+    pa_cvolume current;
+
+    if (!from) {
+        get_ramp_volume(i, i->thread_info.ramp_index, &current);
+        from = &current;
+    }
+
+    i->thread_info.ramp_volume = *from;
+    i->thread_info.soft_volume = *volume;
+    i->thread_info.ramp_index = 0;
+    i->thread_info.ramp_length = 0;
+
+    /* With different channel maps the volume is applied in the stream's
+     * sample spec before resampling, too early for a ramp that is
+     * measured in what the sink renders */
+    if (usec > 0 && pa_cvolume_compatible(from, &i->thread_info.sample_spec) &&
+        pa_channel_map_equal(&i->channel_map, &i->sink->channel_map))
+        i->thread_info.ramp_length = pa_usec_to_bytes(usec, &i->sink->sample_spec);
+}
+
+/* Called from thread context, while the input waits for its start time.
+ * Returns how much of the next length bytes are still silence. */
+static size_t start_padding(pa_sink_input *i, size_t length) {
+    size_t n;
+
+    if (i->thread_info.start_padding == (size_t) -1) {
+        /* What is rendered now plays once the sink played what it has */
+        pa_usec_t due = pa_rtclock_now() + pa_sink_get_latency_within_thread(i->sink);
+
+        if (i->thread_info.start_time > due)
+            i->thread_info.start_padding = pa_usec_to_bytes(i->thread_info.start_time - due, &i->sink->sample_spec);
+        else {
+            pa_log_debug("Sink input %u starts %llu usec late.", i->index, (unsigned long long) (due - i->thread_info.start_time));
+            i->thread_info.start_padding = 0;
+        }
+    }
+
+    n = PA_MIN(length, i->thread_info.start_padding);
+    i->thread_info.start_padding -= n;
+
+    if (i->thread_info.start_padding <= 0) {
+        i->thread_info.start_time = 0;
+        i->thread_info.start_padding = (size_t) -1;
+    }
+
+    return n;
+}
+
 void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa_memchunk *chunk, pa_cvolume *volume) {
     bool do_volume_adj_here, need_volume_factor_sink;
     bool volume_is_norm;
     size_t block_size_max_sink, block_size_max_sink_input;
     size_t ilength;
     size_t ilength_full;
+    size_t padding;
+    pa_usec_t render_start = 0;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -853,6 +951,8 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     pa_log_debug("peek");
 #endif
 
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SINK_INPUT_PEEK, i->index, (int64_t) slength);
+
     block_size_max_sink_input = i->thread_info.resampler ?
         pa_resampler_max_block_size(i->thread_info.resampler) :
         pa_frame_align(pa_mempool_block_size_max(i->core->mempool), &i->sample_spec);
@@ -889,12 +989,25 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     volume_is_norm = pa_cvolume_is_norm(&i->thread_info.soft_volume) && !i->thread_info.muted;
     need_volume_factor_sink = !pa_cvolume_is_norm(&i->volume_factor_sink);
 
+    if (!pa_memblockq_is_readable(i->thread_info.render_memblockq))
+        render_start = pa_rtclock_now();
+
     while (!pa_memblockq_is_readable(i->thread_info.render_memblockq)) {
         pa_memchunk tchunk;
 
         /* There's nothing in our render queue. We need to fill it up
          * with data from the implementor. */
 
+        if (PA_UNLIKELY(i->thread_info.start_time > 0) &&
+            i->thread_info.state == PA_SINK_INPUT_RUNNING &&
+            (padding = start_padding(i, slength)) > 0) {
+
+            /* Not due yet. The silence goes through the render queue so
+             * that rewinds keep the start where it is. */
+            pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) padding, PA_SEEK_RELATIVE, true);
+            break;
+        }
+
         if (i->thread_info.state == PA_SINK_INPUT_CORKED ||
             i->pop(i, ilength, &tchunk) < 0) {
 
@@ -902,6 +1015,15 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
              * data, so let's just hand out silence */
             pa_atomic_store(&i->thread_info.drained, 1);
 
+            /* Silence before the first data and while corked is not
+             * the client's fault */
+            if (i->thread_info.state != PA_SINK_INPUT_CORKED && i->thread_info.underrun_for != (uint64_t) -1) {
+                if (i->thread_info.underrun_for == 0)
+                    pa_atomic_inc(&i->thread_info.n_underruns);
+
+                pa_atomic_add(&i->thread_info.silence_frames, (int) (slength / pa_frame_size(&i->sink->sample_spec)));
+            }
+
             pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) slength, PA_SEEK_RELATIVE, true);
             i->thread_info.playing_for = 0;
             if (i->thread_info.underrun_for != (uint64_t) -1) {
@@ -922,7 +1044,6 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
 
         while (tchunk.length > 0) {
             pa_memchunk wchunk;
-            bool nvfs = need_volume_factor_sink;
 
             wchunk = tchunk;
             pa_memblock_ref(wchunk.memblock);
@@ -930,51 +1051,39 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
             if (wchunk.length > block_size_max_sink_input)
                 wchunk.length = block_size_max_sink_input;
 
-            /* It might be necessary to adjust the volume here */
-            if (do_volume_adj_here && !volume_is_norm) {
+            /* It might be necessary to adjust the volume here. Silence
+             * stays silence, so leave such blocks alone and keep their
+             * silence flag for the sink. */
+            if (do_volume_adj_here && !volume_is_norm && !pa_memblock_is_silence(wchunk.memblock)) {
                 pa_memchunk_make_writable(&wchunk, 0);
 
-                if (i->thread_info.muted) {
+                if (i->thread_info.muted)
                     pa_silence_memchunk(&wchunk, &i->thread_info.sample_spec);
-                    nvfs = false;
-
-                } else if (!i->thread_info.resampler && nvfs) {
-                    pa_cvolume v;
-
-                    /* If we don't need a resampler we can merge the
-                     * post and the pre volume adjustment into one */
-
-                    pa_sw_cvolume_multiply(&v, &i->thread_info.soft_volume, &i->volume_factor_sink);
-                    pa_volume_memchunk(&wchunk, &i->thread_info.sample_spec, &v);
-                    nvfs = false;
-
-                } else
+                else
                     pa_volume_memchunk(&wchunk, &i->thread_info.sample_spec, &i->thread_info.soft_volume);
             }
 
-            if (!i->thread_info.resampler) {
-
-                if (nvfs) {
-                    pa_memchunk_make_writable(&wchunk, 0);
-                    pa_volume_memchunk(&wchunk, &i->sink->sample_spec, &i->volume_factor_sink);
-                }
-
+            if (!i->thread_info.resampler)
                 pa_memblockq_push_align(i->thread_info.render_memblockq, &wchunk);
-            } else {
+            else {
                 pa_memchunk rchunk;
-                pa_resampler_run(i->thread_info.resampler, &wchunk, &rchunk);
+
+                if (pa_atomic_load(&i->core->n_resampler_usec_observers) > 0) {
+                    pa_usec_t t;
+
+                    t = pa_rtclock_now();
+                    pa_resampler_run(i->thread_info.resampler, &wchunk, &rchunk);
+                    t = pa_rtclock_now() - t;
+                    pa_atomic_add(&i->thread_info.resampler_usec, (int) t);
+                    pa_metric_add(i->sink->metrics.resampler_usec, (unsigned) t);
+                } else
+                    pa_resampler_run(i->thread_info.resampler, &wchunk, &rchunk);
 
 #ifdef SINK_INPUT_DEBUG
                 pa_log_debug("pushing %lu", (unsigned long) rchunk.length);
 #endif
 
                 if (rchunk.memblock) {
-
-                    if (nvfs) {
-                        pa_memchunk_make_writable(&rchunk, 0);
-                        pa_volume_memchunk(&rchunk, &i->sink->sample_spec, &i->volume_factor_sink);
-                    }
-
                     pa_memblockq_push_align(i->thread_info.render_memblockq, &rchunk);
                     pa_memblock_unref(rchunk.memblock);
                 }
@@ -989,6 +1098,9 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         pa_memblock_unref(tchunk.memblock);
     }
 
+    if (render_start > 0)
+        pa_atomic_add(&i->thread_info.render_usec, (int) (pa_rtclock_now() - render_start));
+
     pa_assert_se(pa_memblockq_peek(i->thread_info.render_memblockq, chunk) >= 0);
 
     pa_assert(chunk->length > 0);
@@ -1001,17 +1113,124 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     if (chunk->length > block_size_max_sink)
         chunk->length = block_size_max_sink;
 
+    /* The sink peeks all other inputs before it mixes this one, which
+     * is time enough for the data to arrive in the cache. This is what
+     * the sink will read, which might be less than the chunk. */
+    pa_memchunk_prefetch(chunk, slength);
+
+    PA_TRACE_END(PA_TRACEPOINT_SINK_INPUT_PEEK, i->index, (int64_t) chunk->length);
+
     /* Let's see if we had to apply the volume adjustment ourselves,
-     * or if this can be done by the sink for us */
+     * or if this can be done by the sink for us. volume_factor_sink is
+     * in the sink's channel map, hence it is always left to the sink,
+     * which applies it while mixing without an extra pass over the
+     * data. */
 
-    if (do_volume_adj_here)
-        /* We had different channel maps, so we already did the adjustment */
-        pa_cvolume_reset(volume, i->sink->sample_spec.channels);
-    else if (i->thread_info.muted)
-        /* We've both the same channel map, so let's have the sink do the adjustment for us*/
+    if (i->thread_info.muted)
         pa_cvolume_mute(volume, i->sink->sample_spec.channels);
-    else
-        *volume = i->thread_info.soft_volume;
+    else if (do_volume_adj_here) {
+        /* We had different channel maps, so we already did the adjustment */
+        if (need_volume_factor_sink)
+            *volume = i->volume_factor_sink;
+        else
+            pa_cvolume_reset(volume, i->sink->sample_spec.channels);
+    } else {
+        get_ramp_volume(i, i->thread_info.ramp_index, volume);
+
+        if (need_volume_factor_sink)
+            pa_sw_cvolume_multiply(volume, volume, &i->volume_factor_sink);
+    }
+}
+
+/* Called from thread context. Returns for how many of the next length
+ * bytes the volume pa_sink_input_peek() returned is still ramping, 0 if
+ * it is not, and the volume at the end of them. The sink applies the
+ * ramp while mixing. */
+size_t pa_sink_input_get_volume_ramp(pa_sink_input *i, size_t length /* in sink bytes */, pa_cvolume *volume) {
+    size_t left;
+
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(volume);
+
+    if (i->thread_info.muted || i->thread_info.ramp_index >= (int64_t) i->thread_info.ramp_length)
+        return 0;
+
+    left = i->thread_info.ramp_length - (size_t) i->thread_info.ramp_index;
+    if (length > left)
+        length = left;
+
+    get_ramp_volume(i, i->thread_info.ramp_index + (int64_t) length, volume);
+
+    if (!pa_cvolume_is_norm(&i->volume_factor_sink))
+        pa_sw_cvolume_multiply(volume, volume, &i->volume_factor_sink);
+
+    return length;
+}
+
+/* Called from thread context. Lets the volume rise from silence over
+ * usec, for instance after the input was attached in the middle of
+ * what the sink plays. */
+void pa_sink_input_fade_in(pa_sink_input *i, pa_usec_t usec) {
+    pa_cvolume muted;
+
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+
+    pa_cvolume_mute(&muted, i->thread_info.soft_volume.channels);
+    start_volume_ramp(i, &muted, &i->thread_info.soft_volume, usec);
+}
+
+/* Called from thread context. Lets the implementor write directly into
+ * target, returns false if that isn't possible and pa_sink_input_peek()
+ * needs to be used. On success the data needs to be confirmed with
+ * pa_sink_input_drop() like data that was peeked. */
+bool pa_sink_input_peek_into(pa_sink_input *i, pa_memchunk *target) {
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
+    pa_assert(target);
+    pa_assert(target->memblock);
+    pa_assert(pa_frame_aligned(target->length, &i->sink->sample_spec));
+
+    if (!i->pop_into)
+        return false;
+
+    if (i->thread_info.state != PA_SINK_INPUT_RUNNING || i->thread_info.resampler ||
+        i->thread_info.start_time > 0)
+        return false;
+
+    if (i->thread_info.muted ||
+        !pa_cvolume_is_norm(&i->thread_info.soft_volume) ||
+        i->thread_info.ramp_index < (int64_t) i->thread_info.ramp_length ||
+        !pa_cvolume_is_norm(&i->volume_factor_sink))
+        return false;
+
+    /* Data written to the target is not kept, hence we can do this
+     * only if nothing is queued and nothing needs to be rewound */
+    if (pa_memblockq_get_length(i->thread_info.render_memblockq) > 0 ||
+        pa_sink_input_get_max_rewind(i) > 0)
+        return false;
+
+    if (pa_hashmap_size(i->thread_info.direct_outputs) > 0)
+        return false;
+
+    if (i->pop_into(i, target) < 0)
+        return false;
+
+    pa_assert(target->length > 0);
+    pa_assert(pa_frame_aligned(target->length, &i->sink->sample_spec));
+
+    pa_atomic_store(&i->thread_info.drained, 0);
+    i->thread_info.underrun_for = 0;
+    i->thread_info.underrun_for_sink = 0;
+    i->thread_info.playing_for += target->length;
+
+    /* Keep the indexes of the render queue in sync, as if the data had
+     * passed through it */
+    pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) target->length, PA_SEEK_RELATIVE, true);
+
+    return true;
 }
 
 /* Called from thread context */
@@ -1028,6 +1247,9 @@ void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in sink sample spec *
 #endif
 
     pa_memblockq_drop(i->thread_info.render_memblockq, nbytes);
+
+    if (i->thread_info.ramp_length > 0)
+        i->thread_info.ramp_index += (int64_t) nbytes;
 }
 
 /* Called from thread context */
@@ -1065,6 +1287,9 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
     if (nbytes > 0 && !i->thread_info.dont_rewind_render) {
         pa_log_debug("Have to rewind %lu bytes on render memblockq.", (unsigned long) nbytes);
         pa_memblockq_rewind(i->thread_info.render_memblockq, nbytes);
+
+        /* A ramp that only started later starts here now */
+        i->thread_info.ramp_index = PA_MAX(i->thread_info.ramp_index - (int64_t) nbytes, 0);
     }
 
     if (i->thread_info.rewrite_nbytes == (size_t) -1) {
@@ -1266,7 +1491,7 @@ void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool s
         /* We are in flat volume mode, so let's update all sink input
          * volumes and update the flat volume of the sink */
 
-        pa_sink_set_volume(i->sink, NULL, true, save);
+        pa_sink_update_flat_volume(i->sink, i, save);
 
     } else {
         /* OK, we are in normal volume mode. The volume only affects
@@ -1279,7 +1504,7 @@ void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool s
     }
 }
 
-void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor) {
+void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor, pa_usec_t ramp) {
     struct volume_factor_entry *v;
 
     pa_sink_input_assert_ref(i);
@@ -1303,12 +1528,12 @@ void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa
     pa_sw_cvolume_multiply(&i->soft_volume, &i->real_ratio, &i->volume_factor);
 
     /* Copy the new soft_volume to the thread_info struct */
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, (int64_t) ramp, NULL) == 0);
 }
 
 /* Returns 0 if an entry was removed and -1 if no entry for the given key was
  * found. */
-int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key) {
+int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key, pa_usec_t ramp) {
     struct volume_factor_entry *v;
 
     pa_sink_input_assert_ref(i);
@@ -1334,7 +1559,7 @@ int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key) {
     pa_sw_cvolume_multiply(&i->soft_volume, &i->real_ratio, &i->volume_factor);
 
     /* Copy the new soft_volume to the thread_info struct */
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, (int64_t) ramp, NULL) == 0);
 
     return 0;
 }
@@ -1449,6 +1674,19 @@ void pa_sink_input_cork(pa_sink_input *i, bool b) {
     sink_input_set_state(i, b ? PA_SINK_INPUT_CORKED : PA_SINK_INPUT_RUNNING);
 }
 
+/* Called from main context */
+int pa_sink_input_set_start_time(pa_sink_input *i, pa_usec_t when) {
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_INPUT_IS_LINKED(i->state));
+    pa_return_val_if_fail(when > 0, -PA_ERR_INVALID);
+    pa_return_val_if_fail(i->state == PA_SINK_INPUT_CORKED && i->sink, -PA_ERR_BADSTATE);
+
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_START_TIME, NULL, (int64_t) when, NULL) == 0);
+
+    return 0;
+}
+
 /* Called from main context */
 int pa_sink_input_set_rate(pa_sink_input *i, uint32_t rate) {
     pa_sink_input_assert_ref(i);
@@ -1500,6 +1738,101 @@ pa_resample_method_t pa_sink_input_get_resample_method(pa_sink_input *i) {
     return i->actual_resample_method;
 }
 
+/* Called from main context */
+/* Replaces the resampler of a linked sink input by one using the given
+ * method, keeping the sample specs. The swap happens in the IO thread,
+ * so the stream keeps playing. */
+int pa_sink_input_set_resample_method(pa_sink_input *i, pa_resample_method_t method) {
+    pa_resampler *new_resampler, *old_resampler;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_INPUT_IS_LINKED(i->state));
+    pa_return_val_if_fail(method < PA_RESAMPLER_MAX, -PA_ERR_INVALID);
+    pa_return_val_if_fail(i->sink, -PA_ERR_BADSTATE);
+
+    if (method == i->requested_resample_method)
+        return 0;
+
+    /* Used once a resampler is needed */
+    if (!(old_resampler = i->thread_info.resampler)) {
+        i->requested_resample_method = method;
+        return 0;
+    }
+
+    if (!(new_resampler = pa_resampler_new(i->core->mempool,
+                                           &i->sample_spec, &i->channel_map,
+                                           &i->sink->sample_spec, &i->sink->channel_map,
+                                           i->core->lfe_crossover_freq,
+                                           method,
+                                           old_resampler->flags))) {
+        pa_log_warn("Unsupported resampling operation.");
+        return -PA_ERR_NOTSUPPORTED;
+    }
+
+    i->requested_resample_method = method;
+
+    if (pa_resampler_get_method(new_resampler) == i->actual_resample_method) {
+        pa_resampler_free(new_resampler);
+        return 0;
+    }
+
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_RESAMPLER, new_resampler, 0, NULL) == 0);
+    pa_resampler_free(old_resampler);
+
+    i->actual_resample_method = pa_resampler_get_method(new_resampler);
+
+    pa_log_debug("Sink input %u now resamples with %s", i->index, pa_resample_method_to_string(i->actual_resample_method));
+
+    pa_subscription_post(i->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, i->index);
+    return 0;
+}
+
+/* Called from main context */
+uint32_t pa_sink_input_get_resampler_usec(pa_sink_input *i) {
+    pa_sink_input_assert_ref(i);
+
+    return (uint32_t) pa_atomic_load(&i->thread_info.resampler_usec);
+}
+
+/* Called from main context */
+void pa_sink_input_observe_resampler_usec(pa_core *c, bool observe) {
+    pa_assert(c);
+    pa_assert_ctl_context();
+
+    if (observe)
+        pa_atomic_inc(&c->n_resampler_usec_observers);
+    else
+        pa_assert_se(pa_atomic_dec(&c->n_resampler_usec_observers) >= 1);
+}
+
+/* Called from any context */
+void pa_sink_input_get_stats(pa_sink_input *i, pa_sink_input_stats *stats) {
+    pa_sink_input_assert_ref(i);
+    pa_assert(stats);
+
+    stats->underruns = (uint32_t) pa_atomic_load(&i->thread_info.n_underruns);
+    stats->silence_frames = (uint32_t) pa_atomic_load(&i->thread_info.silence_frames);
+    stats->rewinds = (uint32_t) pa_atomic_load(&i->thread_info.n_rewinds);
+    stats->render_usec = (uint32_t) pa_atomic_load(&i->thread_info.render_usec);
+}
+
+/* Called from main context */
+bool pa_sink_input_get_resampler_timing(pa_sink_input *i, pa_resampler_timing *timing) {
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+    pa_assert(timing);
+
+    if (!PA_SINK_INPUT_IS_LINKED(i->state) || !i->sink)
+        return false;
+
+    if (!i->thread_info.resampler || !(i->thread_info.resampler->flags & PA_RESAMPLER_TIMING))
+        return false;
+
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_GET_RESAMPLER_TIMING, timing, 0, NULL) == 0);
+    return true;
+}
+
 /* Called from main context */
 bool pa_sink_input_may_move(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
@@ -1563,10 +1896,8 @@ bool pa_sink_input_may_move_to(pa_sink_input *i, pa_sink *dest) {
 }
 
 /* Called from main context */
-int pa_sink_input_start_move(pa_sink_input *i) {
+static int start_move_begin(pa_sink_input *i) {
     pa_source_output *o, PA_UNUSED *p = NULL;
-    struct volume_factor_entry *v;
-    void *state = NULL;
     int r;
 
     pa_sink_input_assert_ref(i);
@@ -1601,7 +1932,13 @@ int pa_sink_input_start_move(pa_sink_input *i) {
          * volume mode. */
         pa_sink_set_volume(i->sink, NULL, false, false);
 
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_START_MOVE, i, 0, NULL) == 0);
+    return 0;
+}
+
+/* Called from main context, after the IO thread detached the input */
+static void start_move_end(pa_sink_input *i) {
+    struct volume_factor_entry *v;
+    void *state = NULL;
 
     pa_sink_update_status(i->sink);
 
@@ -1613,10 +1950,47 @@ int pa_sink_input_start_move(pa_sink_input *i) {
     i->sink = NULL;
 
     pa_sink_input_unref(i);
+}
+
+/* Called from main context */
+int pa_sink_input_start_move(pa_sink_input *i) {
+    int r;
+
+    if ((r = start_move_begin(i)) < 0)
+        return r;
+
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_START_MOVE, i, 0, NULL) == 0);
+
+    start_move_end(i);
 
     return 0;
 }
 
+/* Called from main context */
+void pa_sink_input_start_move_all(pa_sink *s, pa_idxset *inputs) {
+    pa_sink_input *i;
+    uint32_t idx;
+
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(inputs);
+
+    PA_IDXSET_FOREACH(i, inputs, idx) {
+        pa_assert(i->sink == s);
+
+        if (start_move_begin(i) < 0)
+            pa_idxset_remove_by_index(inputs, idx);
+    }
+
+    if (pa_idxset_isempty(inputs))
+        return;
+
+    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_START_MOVE_ALL, inputs, 0, NULL) == 0);
+
+    PA_IDXSET_FOREACH(i, inputs, idx)
+        start_move_end(i);
+}
+
 /* Called from main context. If i has an origin sink that uses volume sharing,
  * then also the origin sink and all streams connected to it need to update
  * their volume - this function does all that by using recursion. */
@@ -1744,9 +2118,10 @@ static void update_volume_due_to_moving(pa_sink_input *i, pa_sink *dest) {
 }
 
 /* Called from main context */
-int pa_sink_input_finish_move(pa_sink_input *i, pa_sink *dest, bool save) {
+static int finish_move_begin(pa_sink_input *i, pa_sink *dest, bool save) {
     struct volume_factor_entry *v;
     void *state = NULL;
+    pa_memblockq *render_memblockq;
 
     pa_sink_input_assert_ref(i);
     pa_assert_ctl_context();
@@ -1794,8 +2169,19 @@ int pa_sink_input_finish_move(pa_sink_input *i, pa_sink *dest, bool save) {
     if (pa_sink_input_get_state(i) == PA_SINK_INPUT_CORKED)
         i->sink->n_corked++;
 
+    render_memblockq = i->thread_info.render_memblockq;
     pa_sink_input_update_rate(i);
 
+    /* If the resampler could be kept, so can the audio that was already
+     * rendered, and the stream goes on without a gap */
+    if (i->thread_info.render_memblockq == render_memblockq) {
+        if (i->thread_info.resampler || pa_sample_spec_equal(&i->sample_spec, &dest->sample_spec)) {
+            pa_memblockq_set_silence(render_memblockq, &dest->silence);
+            i->thread_info.move_rewrite = 0;
+        } else
+            pa_memblockq_flush_write(render_memblockq, true);
+    }
+
     pa_sink_update_status(dest);
 
     update_volume_due_to_moving(i, dest);
@@ -1803,17 +2189,118 @@ int pa_sink_input_finish_move(pa_sink_input *i, pa_sink *dest, bool save) {
     if (pa_sink_input_is_passthrough(i))
         pa_sink_enter_passthrough(i->sink);
 
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_FINISH_MOVE, i, 0, NULL) == 0);
+    return 0;
+}
 
-    pa_log_debug("Successfully moved sink input %i to %s.", i->index, dest->name);
+/* Called from main context, after the IO thread attached the input */
+static void finish_move_end(pa_sink_input *i) {
+    pa_log_debug("Successfully moved sink input %i to %s.", i->index, i->sink->name);
 
     /* Notify everyone */
     pa_hook_fire(&i->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], i);
     pa_subscription_post(i->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, i->index);
+}
+
+/* Called from main context */
+int pa_sink_input_finish_move(pa_sink_input *i, pa_sink *dest, bool save) {
+    int r;
+
+    if ((r = finish_move_begin(i, dest, save)) < 0)
+        return r;
+
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_FINISH_MOVE, i, 0, NULL) == 0);
+
+    finish_move_end(i);
 
     return 0;
 }
 
+/* Called from main context */
+void pa_sink_input_finish_move_all(pa_idxset *inputs, pa_sink *dest, bool save) {
+    pa_sink_input *i;
+    pa_idxset *failed;
+    uint32_t idx;
+
+    pa_sink_assert_ref(dest);
+    pa_assert_ctl_context();
+    pa_assert(inputs);
+
+    failed = pa_idxset_new(NULL, NULL);
+
+    PA_IDXSET_FOREACH(i, inputs, idx) {
+        if (finish_move_begin(i, dest, save) < 0) {
+            pa_idxset_remove_by_index(inputs, idx);
+            pa_idxset_put(failed, i, NULL);
+        }
+    }
+
+    if (!pa_idxset_isempty(inputs)) {
+        pa_assert_se(pa_asyncmsgq_send(dest->asyncmsgq, PA_MSGOBJECT(dest), PA_SINK_MESSAGE_FINISH_MOVE_ALL, inputs, 0, NULL) == 0);
+
+        PA_IDXSET_FOREACH(i, inputs, idx)
+            finish_move_end(i);
+    }
+
+    PA_IDXSET_FOREACH(i, failed, idx)
+        pa_sink_input_fail_move(i);
+
+    pa_idxset_free(failed, NULL);
+}
+
+static void free_group(pa_idxset *group) {
+    pa_idxset_free(group, NULL);
+}
+
+/* Called from main context */
+unsigned pa_sink_input_move_all_to(pa_idxset *inputs, pa_sink *dest, bool save) {
+    pa_sink_input *i;
+    pa_hashmap *groups;
+    pa_idxset *group, *held, *moving;
+    pa_sink *s;
+    uint32_t idx;
+    void *state;
+    unsigned n;
+
+    pa_sink_assert_ref(dest);
+    pa_assert_ctl_context();
+    pa_assert(inputs);
+
+    groups = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, (pa_free_cb_t) free_group);
+    held = pa_idxset_new(NULL, NULL);
+    moving = pa_idxset_new(NULL, NULL);
+
+    /* The inputs are grouped by the sink they are on, so that each of
+     * these gets a single message */
+    PA_IDXSET_FOREACH(i, inputs, idx) {
+        if (!i->sink || i->sink == dest || !pa_sink_input_may_move_to(i, dest))
+            continue;
+
+        if (!(group = pa_hashmap_get(groups, i->sink))) {
+            group = pa_idxset_new(NULL, NULL);
+            pa_hashmap_put(groups, i->sink, group);
+        }
+
+        pa_idxset_put(group, i, NULL);
+        pa_idxset_put(held, pa_sink_input_ref(i), NULL);
+    }
+
+    PA_HASHMAP_FOREACH_KV(s, group, groups, state) {
+        pa_sink_input_start_move_all(s, group);
+
+        PA_IDXSET_FOREACH(i, group, idx)
+            pa_idxset_put(moving, i, NULL);
+    }
+
+    pa_sink_input_finish_move_all(moving, dest, save);
+    n = pa_idxset_size(moving);
+
+    pa_idxset_free(moving, NULL);
+    pa_hashmap_free(groups);
+    pa_idxset_free(held, (pa_free_cb_t) pa_sink_input_unref);
+
+    return n;
+}
+
 /* Called from main context */
 void pa_sink_input_fail_move(pa_sink_input *i) {
 
@@ -1925,7 +2412,9 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
 
         case PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME:
             if (!pa_cvolume_equal(&i->thread_info.soft_volume, &i->soft_volume)) {
-                i->thread_info.soft_volume = i->soft_volume;
+                /* offset is the time to ramp to the new volume, the ramp
+                 * starts with what the rewind renders again */
+                start_volume_ramp(i, NULL, &i->soft_volume, (pa_usec_t) offset);
                 pa_sink_input_request_rewind(i, 0, true, false, false);
             }
             return 0;
@@ -1953,6 +2442,39 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
 
             return 0;
 
+        case PA_SINK_INPUT_MESSAGE_SET_RESAMPLER:
+
+            i->thread_info.resampler = userdata;
+            return 0;
+
+        case PA_SINK_INPUT_MESSAGE_GET_RESAMPLER_TIMING:
+
+            if (i->thread_info.resampler)
+                pa_resampler_get_timing(i->thread_info.resampler, userdata);
+            else
+                pa_zero(*(pa_resampler_timing*) userdata);
+
+            return 0;
+
+        case PA_SINK_INPUT_MESSAGE_SET_START_TIME: {
+            pa_sink_input *ssync;
+
+            i->thread_info.start_time = (pa_usec_t) offset;
+            i->thread_info.start_padding = (size_t) -1;
+
+            for (ssync = i->thread_info.sync_prev; ssync; ssync = ssync->thread_info.sync_prev) {
+                ssync->thread_info.start_time = (pa_usec_t) offset;
+                ssync->thread_info.start_padding = (size_t) -1;
+            }
+
+            for (ssync = i->thread_info.sync_next; ssync; ssync = ssync->thread_info.sync_next) {
+                ssync->thread_info.start_time = (pa_usec_t) offset;
+                ssync->thread_info.start_padding = (size_t) -1;
+            }
+
+            return 0;
+        }
+
         case PA_SINK_INPUT_MESSAGE_SET_STATE: {
             pa_sink_input *ssync;
 
@@ -2090,9 +2612,10 @@ void pa_sink_input_request_rewind(
         if (i->thread_info.resampler)
             nbytes = pa_resampler_result(i->thread_info.resampler, nbytes);
 
-        if (nbytes > lbq)
+        if (nbytes > lbq) {
+            pa_atomic_inc(&i->thread_info.n_rewinds);
             pa_sink_request_rewind(i->sink, nbytes - lbq);
-        else
+        } else
             /* This call will make sure process_rewind() is called later */
             pa_sink_request_rewind(i->sink, 0);
     }
@@ -2174,7 +2697,8 @@ int pa_sink_input_update_rate(pa_sink_input *i) {
                                      ((i->flags & PA_SINK_INPUT_VARIABLE_RATE) ? PA_RESAMPLER_VARIABLE_RATE : 0) |
                                      ((i->flags & PA_SINK_INPUT_NO_REMAP) ? PA_RESAMPLER_NO_REMAP : 0) |
                                      (i->core->disable_remixing || (i->flags & PA_SINK_INPUT_NO_REMIX) ? PA_RESAMPLER_NO_REMIX : 0) |
-                                     (i->core->disable_lfe_remixing ? PA_RESAMPLER_NO_LFE : 0));
+                                     (i->core->disable_lfe_remixing ? PA_RESAMPLER_NO_LFE : 0) |
+                                     (i->core->resampler_timing ? PA_RESAMPLER_TIMING : 0));
 
         if (!new_resampler) {
             pa_log_warn("Unsupported resampling operation.");
@@ -2228,9 +2752,10 @@ void pa_sink_input_set_volume_direct(pa_sink_input *i, const pa_cvolume *volume)
         return;
 
     i->volume = *volume;
-    pa_log_debug("The volume of sink input %u changed from %s to %s.", i->index,
-                 pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &i->channel_map, true),
-                 pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &i->channel_map, true));
+    if (pa_log_level_enabled(PA_LOG_DEBUG))
+        pa_log_debug("The volume of sink input %u changed from %s to %s.", i->index,
+                     pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &i->channel_map, true),
+                     pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &i->channel_map, true));
 
     if (i->volume_changed)
         i->volume_changed(i);
@@ -2258,7 +2783,8 @@ void pa_sink_input_set_reference_ratio(pa_sink_input *i, const pa_cvolume *ratio
     if (!PA_SINK_INPUT_IS_LINKED(i->state))
         return;
 
-    pa_log_debug("Sink input %u reference ratio changed from %s to %s.", i->index,
-                 pa_cvolume_snprint_verbose(old_ratio_str, sizeof(old_ratio_str), &old_ratio, &i->channel_map, true),
-                 pa_cvolume_snprint_verbose(new_ratio_str, sizeof(new_ratio_str), ratio, &i->channel_map, true));
+    if (pa_log_level_enabled(PA_LOG_DEBUG))
+        pa_log_debug("Sink input %u reference ratio changed from %s to %s.", i->index,
+                     pa_cvolume_snprint_verbose(old_ratio_str, sizeof(old_ratio_str), &old_ratio, &i->channel_map, true),
+                     pa_cvolume_snprint_verbose(new_ratio_str, sizeof(new_ratio_str), ratio, &i->channel_map, true));
 }
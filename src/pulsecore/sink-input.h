@@ -133,6 +133,16 @@ struct pa_sink_input {
      * the full block. */
     int (*pop) (pa_sink_input *i, size_t request_nbytes, pa_memchunk *chunk); /* may NOT be NULL */
 
+    /* Like pop(), but writes the data directly into the target memory
+     * instead of returning a block, lowering target->length if less
+     * data is available. This is only used when the data needs
+     * neither conversion nor volume adjustment and the sink keeps no
+     * rewind history, so that the data can go straight from the
+     * implementor to the device buffer. Return -1 if no data could be
+     * written, pop() will be called as usual then. Called from IO
+     * thread context. */
+    int (*pop_into) (pa_sink_input *i, pa_memchunk *target); /* may be NULL */
+
     /* This is called when the playback buffer has actually played back
        all available data. Return true unless there is more data to play back.
        Called from IO context. */
@@ -223,12 +233,35 @@ struct pa_sink_input {
     void (*mute_changed)(pa_sink_input *i); /* may be NULL */
 
     struct {
+        /* What the sink touches for every input in every period comes
+         * first, so that it shares as few cache lines as possible */
         pa_sink_input_state_t state;
         pa_atomic_t drained;
 
+        pa_resampler *resampler;                     /* may be NULL */
+
+        /* We maintain a history of resampled audio data here. */
+        pa_memblockq *render_memblockq;
+
         pa_cvolume soft_volume;
         bool muted:1;
 
+        /* The soft volume moves from ramp_volume to soft_volume over the
+         * first ramp_length bytes (in the sink's sample spec) that are
+         * rendered after the ramp was started. ramp_index is where the
+         * read index of the render queue is in the ramp. */
+        pa_cvolume ramp_volume;
+        size_t ramp_length;
+        int64_t ramp_index;
+
+        /* Microseconds spent in the resampler, wrapping around. Written
+         * by the IO thread, read with pa_sink_input_get_resampler_usec() */
+        pa_atomic_t resampler_usec;
+
+        /* How the stream fared, wrapping around. Written by the IO
+         * thread, read with pa_sink_input_get_stats() */
+        pa_atomic_t n_underruns, silence_frames, n_rewinds, render_usec;
+
         bool attached:1; /* True only between ->attach() and ->detach() calls */
 
         /* rewrite_nbytes: 0: rewrite nothing, (size_t) -1: rewrite everything, otherwise how many bytes to rewrite */
@@ -239,10 +272,10 @@ struct pa_sink_input {
 
         pa_sample_spec sample_spec;
 
-        pa_resampler *resampler;                     /* may be NULL */
-
-        /* We maintain a history of resampled audio data here. */
-        pa_memblockq *render_memblockq;
+        /* While the input moves: how much the implementor has to render
+         * again if the render_memblockq can't be kept on the new sink,
+         * in the input's sample spec */
+        size_t move_rewrite;
 
         pa_sink_input *sync_prev, *sync_next;
 
@@ -250,6 +283,19 @@ struct pa_sink_input {
         pa_usec_t requested_sink_latency;
 
         pa_hashmap *direct_outputs;
+
+        /* The volume and sink volume the stream has been mixed with
+         * without a change since mix_since, an index of the sink's mix
+         * history. INT64_MAX if it has not been mixed yet. */
+        pa_cvolume mix_volume, mix_sink_volume;
+        int64_t mix_since;
+
+        /* If not 0, the rtclock time at which the first data after the
+         * input starts running shall be played. Until then the input
+         * plays start_padding bytes of silence, which is (size_t) -1
+         * until the input started. */
+        pa_usec_t start_time;
+        size_t start_padding;
     } thread_info;
 
     void *userdata;
@@ -266,6 +312,9 @@ enum {
     PA_SINK_INPUT_MESSAGE_SET_STATE,
     PA_SINK_INPUT_MESSAGE_SET_REQUESTED_LATENCY,
     PA_SINK_INPUT_MESSAGE_GET_REQUESTED_LATENCY,
+    PA_SINK_INPUT_MESSAGE_SET_RESAMPLER,
+    PA_SINK_INPUT_MESSAGE_GET_RESAMPLER_TIMING,
+    PA_SINK_INPUT_MESSAGE_SET_START_TIME,
     PA_SINK_INPUT_MESSAGE_MAX
 };
 
@@ -351,6 +400,12 @@ void pa_sink_input_request_rewind(pa_sink_input *i, size_t nbytes, bool rewrite,
 
 void pa_sink_input_cork(pa_sink_input *i, bool b);
 
+/* Makes a corked input, and the inputs synchronized with it, start so
+ * that the first sample after uncorking plays at the rtclock time when.
+ * This holds across sinks as far as their latency reports are exact.
+ * Uncorking is left to the caller. */
+int pa_sink_input_set_start_time(pa_sink_input *i, pa_usec_t when);
+
 int pa_sink_input_set_rate(pa_sink_input *i, uint32_t rate);
 int pa_sink_input_update_rate(pa_sink_input *i);
 
@@ -368,8 +423,10 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency);
 bool pa_sink_input_is_passthrough(pa_sink_input *i);
 bool pa_sink_input_is_volume_readable(pa_sink_input *i);
 void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool save, bool absolute);
-void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor);
-int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key);
+/* With a ramp other than 0 the volume glides to the new factor over that
+ * time instead of changing at once */
+void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor, pa_usec_t ramp);
+int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key, pa_usec_t ramp);
 pa_cvolume *pa_sink_input_get_volume(pa_sink_input *i, pa_cvolume *volume, bool absolute);
 
 void pa_sink_input_set_mute(pa_sink_input *i, bool mute, bool save);
@@ -377,6 +434,29 @@ void pa_sink_input_set_mute(pa_sink_input *i, bool mute, bool save);
 void pa_sink_input_update_proplist(pa_sink_input *i, pa_update_mode_t mode, pa_proplist *p);
 
 pa_resample_method_t pa_sink_input_get_resample_method(pa_sink_input *i);
+int pa_sink_input_set_resample_method(pa_sink_input *i, pa_resample_method_t method);
+
+/* The time spent resampling for this sink input. The counter wraps
+ * around, so only the difference between two calls is meaningful. It
+ * only advances while someone observes it, so call
+ * pa_sink_input_observe_resampler_usec() first. */
+uint32_t pa_sink_input_get_resampler_usec(pa_sink_input *i);
+void pa_sink_input_observe_resampler_usec(pa_core *c, bool observe);
+
+typedef struct pa_sink_input_stats {
+    uint32_t underruns;       /* Times the stream ran out of data while playing */
+    uint32_t silence_frames;  /* Frames of silence the sink played instead */
+    uint32_t rewinds;         /* Rewinds of the sink the stream asked for */
+    uint32_t render_usec;     /* Time spent getting data from the implementor and resampling it */
+} pa_sink_input_stats;
+
+/* Like above, these counters wrap around. Can be called from any
+ * thread. */
+void pa_sink_input_get_stats(pa_sink_input *i, pa_sink_input_stats *stats);
+
+/* Fetches the per phase timing of the resampler from the IO thread.
+ * Returns false if there is no resampler or resampler timing is disabled. */
+bool pa_sink_input_get_resampler_timing(pa_sink_input *i, pa_resampler_timing *timing);
 
 void pa_sink_input_send_event(pa_sink_input *i, const char *name, pa_proplist *data);
 
@@ -391,6 +471,22 @@ int pa_sink_input_start_move(pa_sink_input *i);
 int pa_sink_input_finish_move(pa_sink_input *i, pa_sink *dest, bool save);
 void pa_sink_input_fail_move(pa_sink_input *i);
 
+/* The same as pa_sink_input_start_move() and pa_sink_input_finish_move(),
+ * but for many inputs at once with a single message to the IO thread. All
+ * inputs passed to pa_sink_input_start_move_all() need to be on s, those
+ * that can't start moving are removed from the set. Those that can't be
+ * moved to dest are removed from the set by
+ * pa_sink_input_finish_move_all() and fail their move. The caller needs
+ * to hold a reference to all of them. */
+void pa_sink_input_start_move_all(pa_sink *s, pa_idxset *inputs);
+void pa_sink_input_finish_move_all(pa_idxset *inputs, pa_sink *dest, bool save);
+
+/* Like pa_sink_input_move_to() for all inputs of the set, which may be
+ * on different sinks, with a single message to each IO thread that is
+ * involved. Inputs which may not move to dest are left alone. Returns the
+ * number of inputs that were moved. */
+unsigned pa_sink_input_move_all_to(pa_idxset *inputs, pa_sink *dest, bool save);
+
 pa_sink_input_state_t pa_sink_input_get_state(pa_sink_input *i);
 
 pa_usec_t pa_sink_input_get_requested_latency(pa_sink_input *i);
@@ -399,6 +495,9 @@ pa_usec_t pa_sink_input_get_requested_latency(pa_sink_input *i);
 
 void pa_sink_input_peek(pa_sink_input *i, size_t length, pa_memchunk *chunk, pa_cvolume *volume);
 void pa_sink_input_drop(pa_sink_input *i, size_t length);
+bool pa_sink_input_peek_into(pa_sink_input *i, pa_memchunk *target);
+size_t pa_sink_input_get_volume_ramp(pa_sink_input *i, size_t length, pa_cvolume *volume);
+void pa_sink_input_fade_in(pa_sink_input *i, pa_usec_t usec);
 void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in the sink's sample spec */);
 void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
 void pa_sink_input_update_max_request(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
@@ -45,24 +45,66 @@
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/play-memblockq.h>
-#include <pulsecore/flist.h>
+#include <pulsecore/strbuf.h>
+#include <pulsecore/tracepoint.h>
 
 #include "sink.h"
 
-#define MAX_MIX_CHANNELS 32
+#define MIX_INFO_MIN 32
 #define MIX_BUFFER_LENGTH (PA_PAGE_SIZE)
 #define ABSOLUTE_MIN_LATENCY (500)
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
 #define DEFAULT_FIXED_LATENCY (250*PA_USEC_PER_MSEC)
+#define CHECK_FORMATS_CACHE_MAX 16
+#define MIX_HISTORY_MAXLENGTH (32*1024*1024)
+#define MOVE_FADE_IN_USEC (10*PA_USEC_PER_MSEC)
 
 PA_DEFINE_PUBLIC_CLASS(pa_sink, pa_msgobject);
 
-struct pa_sink_volume_change {
-    pa_usec_t at;
-    pa_cvolume hw_volume;
+static void free_formats(pa_idxset *formats) {
+    pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
+}
 
-    PA_LLIST_FIELDS(pa_sink_volume_change);
-};
+/* Describes a list of formats unambiguously, for looking up the result of a
+ * previous pa_sink_check_formats() call. */
+static char *formats_cache_key(pa_idxset *formats) {
+    pa_strbuf *buf;
+    pa_format_info *f;
+    uint32_t idx;
+
+    buf = pa_strbuf_new();
+
+    PA_IDXSET_FOREACH(f, formats, idx) {
+        const char *key;
+        void *state = NULL;
+
+        pa_strbuf_printf(buf, "%i{", (int) f->encoding);
+
+        while ((key = pa_proplist_iterate(f->plist, &state))) {
+            const char *value;
+            const void *data;
+            size_t nbytes;
+            char *hex;
+
+            pa_strbuf_printf(buf, "%zu:%s", strlen(key), key);
+
+            if ((value = pa_proplist_gets(f->plist, key))) {
+                pa_strbuf_printf(buf, "s%zu:%s", strlen(value), value);
+                continue;
+            }
+
+            pa_assert_se(pa_proplist_get(f->plist, key, &data, &nbytes) == 0);
+            hex = pa_xmalloc(nbytes * 2 + 1);
+            pa_hexstr(data, nbytes, hex, nbytes * 2 + 1);
+            pa_strbuf_printf(buf, "x%s;", hex);
+            pa_xfree(hex);
+        }
+
+        pa_strbuf_puts(buf, "}");
+    }
+
+    return pa_strbuf_tostring_free(buf);
+}
 
 struct sink_message_set_port {
     pa_device_port *port;
@@ -151,6 +193,7 @@ static void reset_callbacks(pa_sink *s) {
     pa_assert(s);
 
     s->set_state = NULL;
+    s->suspend_cause_changed = NULL;
     s->get_volume = NULL;
     s->set_volume = NULL;
     s->write_volume = NULL;
@@ -254,7 +297,14 @@ pa_sink* pa_sink_new(
     s->priority = 0;
     s->suspend_cause = data->suspend_cause;
     pa_sink_set_mixer_dirty(s, false);
+    pa_atomic_store(&s->silent_skipped, 0);
+    pa_atomic_store(&s->render_load, 0);
     s->name = pa_xstrdup(name);
+    s->metrics.render_usec = pa_metric_new(core->metrics, PA_METRIC_SINK_RENDER_USEC, s->name);
+    s->metrics.resampler_usec = pa_metric_new(core->metrics, PA_METRIC_SINK_RESAMPLER_USEC, s->name);
+    s->metrics.rewinds = pa_metric_new(core->metrics, PA_METRIC_SINK_REWINDS, s->name);
+    s->metrics.xruns = pa_metric_new(core->metrics, PA_METRIC_SINK_XRUNS, s->name);
+    s->metrics.watermark_increases = pa_metric_new(core->metrics, PA_METRIC_SINK_WATERMARK_INCREASES, s->name);
     s->proplist = pa_proplist_copy(data->proplist);
     s->driver = pa_xstrdup(pa_path_get_filename(data->driver));
     s->module = data->module;
@@ -278,6 +328,8 @@ pa_sink* pa_sink_new(
 
     s->inputs = pa_idxset_new(NULL, NULL);
     s->n_corked = 0;
+    s->check_formats_cache = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree,
+                                                 (pa_free_cb_t) free_formats);
     s->input_to_master = NULL;
 
     s->reference_volume = s->real_volume = data->volume;
@@ -291,6 +343,7 @@ pa_sink* pa_sink_new(
     s->userdata = NULL;
 
     s->asyncmsgq = NULL;
+    s->io_trace = NULL;
 
     /* As a minor optimization we just steal the list instead of
      * copying it here */
@@ -327,12 +380,19 @@ pa_sink* pa_sink_new(
     s->thread_info.rtpoll = NULL;
     s->thread_info.inputs = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL,
                                                 (pa_free_cb_t) pa_sink_input_unref);
+    s->thread_info.render_inputs = pa_dynarray_new(NULL);
+    s->thread_info.mix_info = pa_xnew(pa_mix_info, MIX_INFO_MIN);
+    s->thread_info.mix_info_size = MIX_INFO_MIN;
     s->thread_info.soft_volume =  s->soft_volume;
     s->thread_info.soft_muted = s->muted;
     s->thread_info.state = s->state;
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = false;
     s->thread_info.max_rewind = 0;
+    s->thread_info.mix_history = pa_memblockq_new("sink mix history", 0, MIX_HISTORY_MAXLENGTH, 0, &s->sample_spec, 0, 1, 0, NULL);
+    s->thread_info.mix_history_valid = 0;
+    s->thread_info.rewind_mix = pa_memblockq_new("sink rewind mix", 0, MIX_HISTORY_MAXLENGTH, 0, &s->sample_spec, 0, 1, 0, NULL);
+    s->thread_info.rewind_input = pa_memblockq_new("sink rewind input", 0, MIX_HISTORY_MAXLENGTH, 0, &s->sample_spec, 0, 1, 0, NULL);
     s->thread_info.max_request = 0;
     s->thread_info.requested_latency_valid = false;
     s->thread_info.requested_latency = 0;
@@ -340,8 +400,8 @@ pa_sink* pa_sink_new(
     s->thread_info.max_latency = ABSOLUTE_MAX_LATENCY;
     s->thread_info.fixed_latency = flags & PA_SINK_DYNAMIC_LATENCY ? 0 : DEFAULT_FIXED_LATENCY;
 
-    PA_LLIST_HEAD_INIT(pa_sink_volume_change, s->thread_info.volume_changes);
-    s->thread_info.volume_changes_tail = NULL;
+    s->thread_info.volume_changes_first = 0;
+    s->thread_info.n_volume_changes = 0;
     pa_sw_cvolume_multiply(&s->thread_info.current_hw_volume, &s->soft_volume, &s->real_volume);
     s->thread_info.volume_change_safety_margin = core->deferred_volume_safety_margin_usec;
     s->thread_info.volume_change_extra_delay = core->deferred_volume_extra_delay_usec;
@@ -397,9 +457,39 @@ pa_sink* pa_sink_new(
 }
 
 /* Called from main context */
+/* Called from main context, after the IO thread has taken over the
+ * new state. Returns whether the sink was suspended or resumed. */
+static bool sink_state_changed(pa_sink *s, pa_sink_state_t original_state) {
+    bool suspend_change;
+
+    suspend_change =
+        (original_state == PA_SINK_SUSPENDED && PA_SINK_IS_OPENED(s->state)) ||
+        (PA_SINK_IS_OPENED(original_state) && s->state == PA_SINK_SUSPENDED);
+
+    if (s->state != PA_SINK_UNLINKED) { /* if we enter UNLINKED state pa_sink_unlink() will fire the appropriate events */
+        pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SINK_STATE_CHANGED], s);
+        pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK | PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
+    }
+
+    if (suspend_change) {
+        pa_sink_input *i;
+        uint32_t idx;
+
+        /* We're suspending or resuming, tell everyone about it */
+
+        PA_IDXSET_FOREACH(i, s->inputs, idx)
+            if (s->state == PA_SINK_SUSPENDED &&
+                (i->flags & PA_SINK_INPUT_KILL_ON_SUSPEND))
+                pa_sink_input_kill(i);
+            else if (i->suspend)
+                i->suspend(i, s->state == PA_SINK_SUSPENDED);
+    }
+
+    return suspend_change;
+}
+
 static int sink_set_state(pa_sink *s, pa_sink_state_t state) {
     int ret;
-    bool suspend_change;
     pa_sink_state_t original_state;
 
     pa_assert(s);
@@ -410,9 +500,25 @@ static int sink_set_state(pa_sink *s, pa_sink_state_t state) {
 
     original_state = s->state;
 
-    suspend_change =
-        (original_state == PA_SINK_SUSPENDED && PA_SINK_IS_OPENED(state)) ||
-        (PA_SINK_IS_OPENED(original_state) && state == PA_SINK_SUSPENDED);
+    if (s->pending_state) {
+        if (state != PA_SINK_UNLINKED) {
+            /* Somebody changes the state again while the batched
+             * change is not sent yet (e.g. a filter sink corking its
+             * stream on us): the batch will carry the final state and
+             * fire the notifications */
+            if (s->set_state)
+                if ((ret = s->set_state(s, state)) < 0)
+                    return ret;
+
+            s->pending_state->userdata = PA_UINT_TO_PTR(state);
+            s->state = state;
+            return 0;
+        }
+
+        /* The IO thread never sees the batched change then */
+        s->pending_state->object = NULL;
+        s->pending_state = NULL;
+    }
 
     if (s->set_state)
         if ((ret = s->set_state(s, state)) < 0)
@@ -429,27 +535,8 @@ static int sink_set_state(pa_sink *s, pa_sink_state_t state) {
 
     s->state = state;
 
-    if (state != PA_SINK_UNLINKED) { /* if we enter UNLINKED state pa_sink_unlink() will fire the appropriate events */
-        pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SINK_STATE_CHANGED], s);
-        pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK | PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
-    }
-
-    if (suspend_change) {
-        pa_sink_input *i;
-        uint32_t idx;
-
-        /* We're suspending or resuming, tell everyone about it */
-
-        PA_IDXSET_FOREACH(i, s->inputs, idx)
-            if (s->state == PA_SINK_SUSPENDED &&
-                (i->flags & PA_SINK_INPUT_KILL_ON_SUSPEND))
-                pa_sink_input_kill(i);
-            else if (i->suspend)
-                i->suspend(i, state == PA_SINK_SUSPENDED);
-
-        if (s->monitor_source)
-            pa_source_sync_suspend(s->monitor_source);
-    }
+    if (sink_state_changed(s, original_state) && s->monitor_source)
+        pa_source_sync_suspend(s->monitor_source);
 
     return 0;
 }
@@ -736,10 +823,22 @@ static void sink_free(pa_object *o) {
 
     pa_idxset_free(s->inputs, NULL);
     pa_hashmap_free(s->thread_info.inputs);
+    pa_dynarray_free(s->thread_info.render_inputs);
+    pa_xfree(s->thread_info.mix_info);
+    pa_memblockq_free(s->thread_info.mix_history);
+    pa_memblockq_free(s->thread_info.rewind_mix);
+    pa_memblockq_free(s->thread_info.rewind_input);
+    pa_hashmap_free(s->check_formats_cache);
 
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    pa_metric_free(s->metrics.render_usec);
+    pa_metric_free(s->metrics.resampler_usec);
+    pa_metric_free(s->metrics.rewinds);
+    pa_metric_free(s->metrics.xruns);
+    pa_metric_free(s->metrics.watermark_increases);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -832,13 +931,53 @@ void pa_sink_set_mixer_dirty(pa_sink *s, bool is_dirty) {
     pa_atomic_store(&s->mixer_dirty, is_dirty ? 1 : 0);
 }
 
+/* Called from any context - must be threadsafe */
+unsigned pa_sink_get_silent_skipped(pa_sink *s) {
+    pa_sink_assert_ref(s);
+
+    return (unsigned) pa_atomic_load(&s->silent_skipped);
+}
+
+/* Called from any context - must be threadsafe */
+unsigned pa_sink_get_render_load(pa_sink *s) {
+    pa_sink_assert_ref(s);
+
+    return (unsigned) pa_atomic_load(&s->render_load);
+}
+
 /* Called from main context */
-int pa_sink_suspend(pa_sink *s, bool suspend, pa_suspend_cause_t cause) {
+void pa_sink_set_overloaded(pa_sink *s, bool overloaded, bool refuse_inputs) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    refuse_inputs = overloaded && refuse_inputs;
+
+    if (s->overloaded == overloaded && s->refuse_inputs == refuse_inputs)
+        return;
+
+    if (overloaded != s->overloaded)
+        pa_log_info("Sink %s is %s.", s->name, overloaded ? "overloaded" : "no longer overloaded");
+
+    s->overloaded = overloaded;
+    s->refuse_inputs = refuse_inputs;
+
+    if (PA_SINK_IS_LINKED(s->state))
+        pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
+}
+
+/* Called from main context */
+/* Called from main context. Returns whether the sink needs to change
+ * its state for the new suspend cause, and to which one. */
+static bool sink_update_suspend_cause(pa_sink *s, bool suspend, pa_suspend_cause_t cause, pa_sink_state_t *state) {
+    pa_suspend_cause_t old_cause;
+
     pa_sink_assert_ref(s);
     pa_assert_ctl_context();
     pa_assert(PA_SINK_IS_LINKED(s->state));
     pa_assert(cause != 0);
 
+    old_cause = s->suspend_cause;
+
     if (suspend) {
         s->suspend_cause |= cause;
         s->monitor_source->suspend_cause |= cause;
@@ -868,20 +1007,162 @@ int pa_sink_suspend(pa_sink *s, bool suspend, pa_suspend_cause_t cause) {
         }
     }
 
-    if ((pa_sink_get_state(s) == PA_SINK_SUSPENDED) == !!s->suspend_cause)
-        return 0;
+    if ((pa_sink_get_state(s) == PA_SINK_SUSPENDED) == !!s->suspend_cause) {
+        if (s->suspend_cause && s->suspend_cause != old_cause && s->suspend_cause_changed)
+            s->suspend_cause_changed(s, old_cause);
+
+        return false;
+    }
 
     pa_log_debug("Suspend cause of sink %s is 0x%04x, %s", s->name, s->suspend_cause, s->suspend_cause ? "suspending" : "resuming");
 
     if (s->suspend_cause)
-        return sink_set_state(s, PA_SINK_SUSPENDED);
+        *state = PA_SINK_SUSPENDED;
     else
-        return sink_set_state(s, pa_sink_used_by(s) ? PA_SINK_RUNNING : PA_SINK_IDLE);
+        *state = pa_sink_used_by(s) ? PA_SINK_RUNNING : PA_SINK_IDLE;
+
+    return true;
+}
+
+int pa_sink_suspend(pa_sink *s, bool suspend, pa_suspend_cause_t cause) {
+    pa_sink_state_t state;
+
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_IS_LINKED(s->state));
+    pa_assert(cause != 0);
+
+    if (!sink_update_suspend_cause(s, suspend, cause, &state))
+        return 0;
+
+    return sink_set_state(s, state);
+}
+
+struct sink_state_change {
+    pa_sink *sink;
+    pa_sink_state_t state;
+    pa_sink_state_t original_state;
+    pa_asyncmsgq_batch_item *item;
+};
+
+/* Called from main context. Like pa_sink_suspend() on each of the
+ * sinks, but the state messages are sent as one per IO thread and the
+ * main loop waits for all of them at once. */
+int pa_sink_suspend_many(pa_idxset *sinks, bool suspend, pa_suspend_cause_t cause) {
+    struct sink_state_change *changes;
+    pa_asyncmsgq_batch_item *items;
+    pa_idxset *monitors;
+    unsigned k, n = 0, n_items = 0;
+    pa_sink *s;
+    uint32_t idx;
+    int ret = 0;
+
+    pa_assert(sinks);
+    pa_assert_ctl_context();
+    pa_assert(cause != 0);
+
+    if (pa_idxset_isempty(sinks))
+        return 0;
+
+    changes = pa_xnew(struct sink_state_change, pa_idxset_size(sinks));
+    items = pa_xnew(pa_asyncmsgq_batch_item, pa_idxset_size(sinks));
+
+    PA_IDXSET_FOREACH(s, sinks, idx) {
+        pa_sink_assert_ref(s);
+        pa_assert(PA_SINK_IS_LINKED(s->state));
+
+        if (!sink_update_suspend_cause(s, suspend, cause, &changes[n].state))
+            continue;
+
+        changes[n].sink = pa_sink_ref(s);
+        n++;
+    }
+
+    for (k = 0; k < n; k++) {
+        int r;
+
+        s = changes[k].sink;
+        changes[k].item = NULL;
+
+        /* The state callback of one sink may already have moved
+         * another one, e.g. a filter sink its master */
+        if (s->state == changes[k].state || !PA_SINK_IS_LINKED(s->state))
+            continue;
+
+        /* Nothing to batch */
+        if (!s->asyncmsgq) {
+            if ((r = sink_set_state(s, changes[k].state)) < 0)
+                ret = r;
+            continue;
+        }
+
+        if (s->set_state)
+            if ((r = s->set_state(s, changes[k].state)) < 0) {
+                ret = r;
+                continue;
+            }
+
+        changes[k].original_state = s->state;
+        s->state = changes[k].state;
+
+        items[n_items].q = s->asyncmsgq;
+        items[n_items].object = PA_MSGOBJECT(s);
+        items[n_items].code = PA_SINK_MESSAGE_SET_STATE;
+        items[n_items].userdata = PA_UINT_TO_PTR(s->state);
+        items[n_items].offset = 0;
+        changes[k].item = s->pending_state = &items[n_items++];
+    }
+
+    pa_asyncmsgq_send_many(items, n_items);
+
+    for (k = 0; k < n; k++)
+        if (changes[k].item)
+            changes[k].sink->pending_state = NULL;
+
+    monitors = pa_idxset_new(NULL, NULL);
+
+    for (k = 0; k < n; k++) {
+        pa_asyncmsgq_batch_item *i = changes[k].item;
+
+        s = changes[k].sink;
+
+        /* Not batched, or dropped by pa_sink_unlink() */
+        if (!i || !i->object)
+            continue;
+
+        if (i->ret < 0) {
+            if (s->set_state)
+                s->set_state(s, changes[k].original_state);
+
+            s->state = changes[k].original_state;
+            ret = i->ret;
+            continue;
+        }
+
+        if (!PA_SINK_IS_LINKED(s->state))
+            continue;
+
+        if (sink_state_changed(s, changes[k].original_state) &&
+            s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->state))
+            pa_idxset_put(monitors, s->monitor_source, NULL);
+    }
+
+    pa_source_sync_suspend_many(monitors);
+    pa_idxset_free(monitors, NULL);
+
+    for (k = 0; k < n; k++)
+        pa_sink_unref(changes[k].sink);
+
+    pa_xfree(changes);
+    pa_xfree(items);
+
+    return ret;
 }
 
 /* Called from main context */
 pa_queue *pa_sink_move_all_start(pa_sink *s, pa_queue *q) {
-    pa_sink_input *i, *n;
+    pa_sink_input *i;
+    pa_idxset *inputs, *held;
     uint32_t idx;
 
     pa_sink_assert_ref(s);
@@ -891,16 +1172,21 @@ pa_queue *pa_sink_move_all_start(pa_sink *s, pa_queue *q) {
     if (!q)
         q = pa_queue_new();
 
-    for (i = PA_SINK_INPUT(pa_idxset_first(s->inputs, &idx)); i; i = n) {
-        n = PA_SINK_INPUT(pa_idxset_next(s->inputs, &idx));
+    inputs = pa_idxset_copy(s->inputs, NULL);
+    held = pa_idxset_copy(s->inputs, NULL);
 
+    PA_IDXSET_FOREACH(i, held, idx)
         pa_sink_input_ref(i);
 
-        if (pa_sink_input_start_move(i) >= 0)
-            pa_queue_push(q, i);
-        else
-            pa_sink_input_unref(i);
-    }
+    /* The inputs are detached with a single message, those that can't
+     * be moved are dropped from the set */
+    pa_sink_input_start_move_all(s, inputs);
+
+    while ((i = pa_idxset_steal_first(inputs, NULL)))
+        pa_queue_push(q, pa_sink_input_ref(i));
+
+    pa_idxset_free(inputs, NULL);
+    pa_idxset_free(held, (pa_free_cb_t) pa_sink_input_unref);
 
     return q;
 }
@@ -908,19 +1194,27 @@ pa_queue *pa_sink_move_all_start(pa_sink *s, pa_queue *q) {
 /* Called from main context */
 void pa_sink_move_all_finish(pa_sink *s, pa_queue *q, bool save) {
     pa_sink_input *i;
+    pa_idxset *inputs, *held;
 
     pa_sink_assert_ref(s);
     pa_assert_ctl_context();
     pa_assert(PA_SINK_IS_LINKED(s->state));
     pa_assert(q);
 
-    while ((i = PA_SINK_INPUT(pa_queue_pop(q)))) {
-        if (pa_sink_input_finish_move(i, s, save) < 0)
-            pa_sink_input_fail_move(i);
+    inputs = pa_idxset_new(NULL, NULL);
+    held = pa_idxset_new(NULL, NULL);
 
-        pa_sink_input_unref(i);
+    while ((i = PA_SINK_INPUT(pa_queue_pop(q)))) {
+        pa_idxset_put(inputs, i, NULL);
+        pa_idxset_put(held, i, NULL);
     }
 
+    /* The inputs are attached with a single message, those that can't
+     * be moved here fail their move */
+    pa_sink_input_finish_move_all(inputs, s, save);
+
+    pa_idxset_free(inputs, NULL);
+    pa_idxset_free(held, (pa_free_cb_t) pa_sink_input_unref);
     pa_queue_free(q, NULL);
 }
 
@@ -966,9 +1260,262 @@ size_t pa_sink_process_input_underruns(pa_sink *s, size_t left_to_play) {
 }
 
 /* Called from IO thread context */
-void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
-    pa_sink_input *i;
+static void invalidate_mix_history(pa_sink *s) {
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    /* What was rendered so far contains inputs that are gone, replacing
+     * the part of another input would keep them playing */
+    s->thread_info.mix_history_valid = pa_memblockq_get_write_index(s->thread_info.mix_history);
+}
+
+/* Called from IO thread context */
+static void get_mix_sink_volume(pa_sink *s, pa_cvolume *volume) {
+    pa_sink_assert_ref(s);
+    pa_assert(volume);
+
+    if (s->thread_info.soft_muted)
+        pa_cvolume_mute(volume, s->sample_spec.channels);
+    else
+        *volume = s->thread_info.soft_volume;
+}
+
+/* Called from IO thread context */
+static void record_mix_volume(pa_sink_input *i, const pa_cvolume *volume, const pa_cvolume *sink_volume, int64_t index) {
+    pa_sink_input_assert_ref(i);
+    pa_assert(volume);
+    pa_assert(sink_volume);
+
+    if (i->thread_info.mix_since != INT64_MAX &&
+        pa_cvolume_equal(&i->thread_info.mix_volume, volume) &&
+        pa_cvolume_equal(&i->thread_info.mix_sink_volume, sink_volume))
+        return;
+
+    i->thread_info.mix_volume = *volume;
+    i->thread_info.mix_sink_volume = *sink_volume;
+    i->thread_info.mix_since = index;
+}
+
+/* Called from IO thread context, for everything that was rendered from
+ * the inputs. The target of pa_sink_render_into() belongs to the caller,
+ * we need to keep a copy of that. */
+static void mix_history_push(pa_sink *s, const pa_memchunk *chunk, bool copy) {
+    pa_memblockq *history;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_assert(chunk);
+
+    history = s->thread_info.mix_history;
+    pa_assert(pa_memblockq_get_length(history) == 0);
+
+    if (s->thread_info.max_rewind <= 0 || s->thread_info.passthrough)
+        /* Nothing can be rewound, just keep the index going */
+        pa_memblockq_seek(history, (int64_t) chunk->length, PA_SEEK_RELATIVE, true);
+    else if (copy) {
+        pa_memchunk c;
+
+        c.memblock = pa_memblock_new(s->core->mempool, chunk->length);
+        c.index = 0;
+        c.length = chunk->length;
+        pa_memchunk_memcpy(&c, (pa_memchunk*) chunk);
+
+        pa_assert_se(pa_memblockq_push(history, &c) >= 0);
+        pa_memblock_unref(c.memblock);
+    } else
+        pa_assert_se(pa_memblockq_push(history, chunk) >= 0);
+
+    pa_memblockq_drop(history, chunk->length);
+}
+
+/* Called from IO thread context. Hands out what a partial rewind mixed
+ * again, which has to be played before the inputs are asked for more. */
+static bool peek_remixed(pa_sink *s, size_t length, pa_memchunk *result) {
+    pa_memblockq *history;
+    size_t remixed;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_assert(result);
+
+    history = s->thread_info.mix_history;
+
+    if ((remixed = pa_memblockq_get_length(history)) <= 0)
+        return false;
+
+    pa_assert_se(pa_memblockq_peek(history, result) >= 0);
+    pa_assert(result->memblock);
+
+    result->length = PA_MIN(result->length, PA_MIN(length, remixed));
+    pa_memblockq_drop(history, result->length);
+
+    if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
+        pa_source_post(s->monitor_source, result);
+
+    return true;
+}
+
+/* Called from IO thread context. Serves a rewind that only the input i
+ * asked for by replacing its part of what was rendered, instead of
+ * rewinding and mixing all inputs again. Returns false, without having
+ * changed anything, if that is not possible. */
+static bool process_partial_rewind(pa_sink *s, pa_sink_input *i, size_t nbytes) {
+    pa_memblockq *history, *render;
+    pa_sink_input *j;
     void *state = NULL;
+    pa_cvolume old_volume, old_sink_volume, sink_volume;
+    int64_t start;
+    size_t left;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_sink_input_assert_ref(i);
+    pa_assert(nbytes > 0);
+
+    history = s->thread_info.mix_history;
+    render = i->thread_info.render_memblockq;
+
+    if (nbytes > s->thread_info.max_rewind)
+        return false;
+
+    if (s->sample_spec.format != PA_SAMPLE_S16NE && s->sample_spec.format != PA_SAMPLE_FLOAT32NE)
+        return false;
+
+    /* An earlier partial rewind has not been played completely yet */
+    if (pa_memblockq_get_length(history) > 0)
+        return false;
+
+    if (i->thread_info.dont_rewind_render)
+        return false;
+
+    /* pa_mix_replace() knows nothing of ramps */
+    if (i->thread_info.ramp_length > 0 &&
+        i->thread_info.ramp_index - (int64_t) nbytes < (int64_t) i->thread_info.ramp_length)
+        return false;
+
+    /* The part of the input that is replaced must have been mixed with
+     * one volume only */
+    start = pa_memblockq_get_write_index(history) - (int64_t) nbytes;
+    if (start < s->thread_info.mix_history_valid || start < i->thread_info.mix_since)
+        return false;
+
+    /* Direct outputs get the data of every input separately, they would
+     * all need it again */
+    PA_HASHMAP_FOREACH(j, s->thread_info.inputs, state)
+        if (pa_hashmap_size(j->thread_info.direct_outputs) > 0)
+            return false;
+
+    /* Take the old mix and the old data of the input before the input
+     * gets rewound. This moves no index in the end. */
+    pa_memblockq_rewind(history, nbytes);
+    pa_memblockq_rewind(render, nbytes);
+
+    for (left = nbytes; left > 0;) {
+        pa_memchunk m, o;
+        size_t l;
+
+        if (pa_memblockq_peek(history, &m) < 0 || !m.memblock)
+            break;
+
+        if (pa_memblockq_peek(render, &o) < 0) {
+            pa_memblock_unref(m.memblock);
+            break;
+        }
+
+        l = PA_MIN(left, PA_MIN(m.length, o.length));
+        m.length = o.length = l;
+
+        if (!pa_mix_is_replaceable(&m, &s->sample_spec)) {
+            pa_memblock_unref(m.memblock);
+            pa_memblock_unref(o.memblock);
+            break;
+        }
+
+        pa_assert_se(pa_memblockq_push(s->thread_info.rewind_mix, &m) >= 0);
+        pa_assert_se(pa_memblockq_push(s->thread_info.rewind_input, &o) >= 0);
+        pa_memblock_unref(m.memblock);
+        pa_memblock_unref(o.memblock);
+
+        pa_memblockq_drop(history, l);
+        pa_memblockq_drop(render, l);
+        left -= l;
+    }
+
+    if (left > 0) {
+        pa_memblockq_drop(history, left);
+        pa_memblockq_drop(render, left);
+
+        pa_memblockq_flush_read(s->thread_info.rewind_mix);
+        pa_memblockq_flush_read(s->thread_info.rewind_input);
+        return false;
+    }
+
+    pa_log_debug("Processing rewind of sink input %u only...", i->index);
+
+    PA_HASHMAP_FOREACH(j, s->thread_info.inputs, state) {
+        pa_sink_input_assert_ref(j);
+        pa_sink_input_process_rewind(j, j == i ? nbytes : 0);
+    }
+
+    /* The next nbytes of the history are replaced by the new mix, and
+     * stay readable until they are played */
+    pa_memblockq_rewind(history, nbytes);
+    pa_memblockq_seek(history, - (int64_t) nbytes, PA_SEEK_RELATIVE, true);
+
+    old_volume = i->thread_info.mix_volume;
+    old_sink_volume = i->thread_info.mix_sink_volume;
+    get_mix_sink_volume(s, &sink_volume);
+
+    for (left = nbytes; left > 0;) {
+        pa_mix_info old_info, new_info;
+        pa_memchunk m, result;
+        size_t l;
+        void *ptr;
+
+        pa_assert_se(pa_memblockq_peek(s->thread_info.rewind_mix, &m) >= 0);
+        pa_assert_se(pa_memblockq_peek(s->thread_info.rewind_input, &old_info.chunk) >= 0);
+        pa_assert(m.memblock);
+        pa_assert(old_info.chunk.memblock);
+
+        l = PA_MIN(left, PA_MIN(m.length, old_info.chunk.length));
+
+        pa_sink_input_peek(i, l, &new_info.chunk, &new_info.volume);
+        l = PA_MIN(l, new_info.chunk.length);
+
+        old_info.volume = old_volume;
+
+        if (!pa_memblock_is_silence(new_info.chunk.memblock))
+            record_mix_volume(i, &new_info.volume, &sink_volume, start + (int64_t) (nbytes - left));
+
+        result.memblock = pa_memblock_new(s->core->mempool, l);
+        result.index = 0;
+        result.length = l;
+
+        ptr = pa_memblock_acquire(result.memblock);
+        pa_mix_replace(&m, &old_info, &old_sink_volume, &new_info, &sink_volume, ptr, l, &s->sample_spec);
+        pa_memblock_release(result.memblock);
+
+        pa_assert_se(pa_memblockq_push(history, &result) >= 0);
+
+        pa_memblock_unref(result.memblock);
+        pa_memblock_unref(m.memblock);
+        pa_memblock_unref(old_info.chunk.memblock);
+        pa_memblock_unref(new_info.chunk.memblock);
+
+        pa_memblockq_drop(s->thread_info.rewind_mix, l);
+        pa_memblockq_drop(s->thread_info.rewind_input, l);
+        pa_sink_input_drop(i, l);
+        left -= l;
+    }
+
+    return true;
+}
+
+/* Called from IO thread context */
+void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
+    pa_sink_input *i, *rewriting = NULL;
+    unsigned n_rewriting = 0;
+    unsigned idx;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -984,35 +1531,97 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = false;
 
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SINK_PROCESS_REWIND, s->index, (int64_t) nbytes);
+
     if (nbytes > 0) {
         pa_log_debug("Processing rewind...");
+        pa_metric_inc(s->metrics.rewinds);
         if (s->flags & PA_SINK_DEFERRED_VOLUME)
             pa_sink_volume_change_rewind(s, nbytes);
     }
 
-    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
-        pa_sink_input_assert_ref(i);
-        pa_sink_input_process_rewind(i, nbytes);
+    PA_DYNARRAY_FOREACH(i, s->thread_info.render_inputs, idx) {
+        if (i->thread_info.rewrite_nbytes > 0) {
+            rewriting = i;
+            n_rewriting++;
+        }
+    }
+
+    if (nbytes <= 0 || n_rewriting != 1 || !process_partial_rewind(s, rewriting, nbytes)) {
+        size_t remixed;
+
+        /* What a partial rewind mixed again has not been played yet,
+         * hence the inputs are ahead of the device by that much */
+        remixed = pa_memblockq_get_length(s->thread_info.mix_history);
+        pa_memblockq_seek(s->thread_info.mix_history, - (int64_t) (nbytes + remixed), PA_SEEK_RELATIVE, true);
+        pa_memblockq_rewind(s->thread_info.mix_history, nbytes);
+
+        PA_DYNARRAY_FOREACH(i, s->thread_info.render_inputs, idx) {
+            pa_sink_input_assert_ref(i);
+            pa_sink_input_process_rewind(i, nbytes + remixed);
+        }
     }
 
     if (nbytes > 0) {
         if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
             pa_source_process_rewind(s->monitor_source, nbytes);
     }
+
+    PA_TRACE_END(PA_TRACEPOINT_SINK_PROCESS_REWIND, s->index, (int64_t) nbytes);
+}
+
+/* Called from IO thread context, whenever the inputs change */
+static void update_passthrough_within_thread(pa_sink *s) {
+    pa_sink_input *i;
+
+    /* A passthrough input is always alone on its sink */
+    s->thread_info.passthrough =
+        pa_dynarray_size(s->thread_info.render_inputs) == 1 &&
+        (i = pa_dynarray_get(s->thread_info.render_inputs, 0)) &&
+        pa_sink_input_is_passthrough(i);
+}
+
+/* Called from IO thread context. Encoded data can only be played as it
+ * came, so in passthrough mode the inputs keep no history. */
+static size_t input_max_rewind(pa_sink *s) {
+    return s->thread_info.passthrough ? 0 : s->thread_info.max_rewind;
+}
+
+/* Called from IO thread context, whenever an input has been added, so
+ * that the render path never needs to allocate */
+static void ensure_mix_info(pa_sink *s) {
+    unsigned n;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    n = pa_hashmap_size(s->thread_info.inputs);
+    if (n <= s->thread_info.mix_info_size)
+        return;
+
+    /* The array only lives for the duration of a render call, hence
+     * there is nothing to preserve */
+    s->thread_info.mix_info_size = PA_MAX(n, s->thread_info.mix_info_size * 2);
+    pa_xfree(s->thread_info.mix_info);
+    s->thread_info.mix_info = pa_xnew(pa_mix_info, s->thread_info.mix_info_size);
 }
 
 /* Called from IO thread context */
 static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, unsigned maxinfo) {
     pa_sink_input *i;
-    unsigned n = 0;
-    void *state = NULL;
+    unsigned n = 0, idx = 0;
     size_t mixlength = *length;
+    pa_cvolume sink_volume;
+    int64_t index;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(info);
 
-    while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL)) && maxinfo > 0) {
+    get_mix_sink_volume(s, &sink_volume);
+    index = pa_memblockq_get_write_index(s->thread_info.mix_history);
+
+    for (; maxinfo > 0 && (i = pa_dynarray_get(s->thread_info.render_inputs, idx)); idx++) {
         pa_sink_input_assert_ref(i);
 
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
@@ -1026,6 +1635,14 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
         }
 
         info->userdata = pa_sink_input_ref(i);
+        info->ramp_length = pa_sink_input_get_volume_ramp(i, info->chunk.length, &info->ramp_volume);
+
+        /* What is mixed during a ramp has no single volume, so the
+         * ramp must be over before the input can be replaced */
+        if (info->ramp_length > 0)
+            record_mix_volume(i, &info->ramp_volume, &sink_volume, index + (int64_t) info->ramp_length);
+        else
+            record_mix_volume(i, &info->volume, &sink_volume, index);
 
         pa_assert(info->chunk.memblock);
         pa_assert(info->chunk.length > 0);
@@ -1041,10 +1658,22 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
     return n;
 }
 
+/* Called from IO thread context */
+static bool direct_outputs_running(pa_sink_input *i) {
+    pa_source_output *o;
+    void *state;
+
+    PA_HASHMAP_FOREACH(o, i->thread_info.direct_outputs, state)
+        if (o->push && o->thread_info.state == PA_SOURCE_OUTPUT_RUNNING)
+            return true;
+
+    return false;
+}
+
 /* Called from IO thread context */
 static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *result) {
     pa_sink_input *i;
-    void *state;
+    unsigned idx;
     unsigned p = 0;
     unsigned n_unreffed = 0;
 
@@ -1054,9 +1683,10 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
     pa_assert(result->memblock);
     pa_assert(result->length > 0);
 
-    /* We optimize for the case where the order of the inputs has not changed */
+    /* fill_mix_info() walked the same array, hence the entries are
+     * usually found right where the search continues */
 
-    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
+    PA_DYNARRAY_FOREACH(i, s->thread_info.render_inputs, idx) {
         unsigned j;
         pa_mix_info* m = NULL;
 
@@ -1080,7 +1710,7 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
 
         if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state)) {
 
-            if (pa_hashmap_size(i->thread_info.direct_outputs) > 0) {
+            if (direct_outputs_running(i)) {
                 void *ostate = NULL;
                 pa_source_output *o;
                 pa_memchunk c;
@@ -1091,8 +1721,11 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
                     pa_assert(result->length <= c.length);
                     c.length = result->length;
 
-                    pa_memchunk_make_writable(&c, 0);
-                    pa_volume_memchunk(&c, &s->sample_spec, &m->volume);
+                    /* Only copy the data if the volume changes it */
+                    if (!pa_cvolume_is_norm(&m->volume)) {
+                        pa_memchunk_make_writable(&c, 0);
+                        pa_volume_memchunk(&c, &s->sample_spec, &m->volume);
+                    }
                 } else {
                     c = s->silence;
                     pa_memblock_ref(c.memblock);
@@ -1135,13 +1768,31 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
         }
     }
 
-    if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
-        pa_source_post(s->monitor_source, result);
+    if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
+        pa_source_post(s->monitor_source, result);
+}
+
+/* Called from IO thread context. In passthrough mode the one input is
+ * passed on as it is: it has no volume, there is nothing to mix with and
+ * the monitor source is suspended. */
+static void passthrough_peek(pa_sink *s, size_t length, pa_memchunk *result) {
+    pa_sink_input *i;
+    pa_cvolume volume;
+
+    i = pa_dynarray_get(s->thread_info.render_inputs, 0);
+    pa_assert(i);
+
+    pa_sink_input_peek(i, length, result, &volume);
+
+    if (result->length > length)
+        result->length = length;
+
+    pa_sink_input_drop(i, result->length);
 }
 
 /* Called from IO thread context */
 void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
     unsigned n;
     size_t block_size_max;
 
@@ -1161,6 +1812,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
         return;
     }
 
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SINK_RENDER, s->index, (int64_t) length);
+
     pa_sink_ref(s);
 
     if (length <= 0)
@@ -1172,17 +1825,38 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    if (peek_remixed(s, length, result)) {
+        PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER, s->index, (int64_t) result->length);
+        pa_sink_unref(s);
+        return;
+    }
+
+    if (s->thread_info.passthrough) {
+        passthrough_peek(s, length, result);
+        mix_history_push(s, result, false);
+
+        PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER, s->index, (int64_t) result->length);
+        pa_sink_unref(s);
+        return;
+    }
+
+    /* There's room for every input, since ensure_mix_info() is
+     * called whenever one is attached */
+    info = s->thread_info.mix_info;
+    n = fill_mix_info(s, &length, info, s->thread_info.mix_info_size);
 
     if (n == 0) {
 
+        if (!pa_hashmap_isempty(s->thread_info.inputs))
+            pa_atomic_inc(&s->silent_skipped);
+
         *result = s->silence;
         pa_memblock_ref(result->memblock);
 
         if (result->length > length)
             result->length = length;
 
-    } else if (n == 1) {
+    } else if (n == 1 && info[0].ramp_length <= 0) {
         pa_cvolume volume;
 
         *result = info[0].chunk;
@@ -1209,24 +1883,28 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
         result->memblock = pa_memblock_new(s->core->mempool, length);
 
         ptr = pa_memblock_acquire(result->memblock);
-        result->length = pa_mix(info, n,
-                                ptr, length,
-                                &s->sample_spec,
-                                &s->thread_info.soft_volume,
-                                s->thread_info.soft_muted);
+        result->length = pa_mix_ramp(info, n,
+                                     ptr, length,
+                                     &s->sample_spec,
+                                     &s->thread_info.soft_volume,
+                                     s->thread_info.soft_muted);
         pa_memblock_release(result->memblock);
 
         result->index = 0;
     }
 
     inputs_drop(s, info, n, result);
+    mix_history_push(s, result, false);
+
+    PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER, s->index, (int64_t) result->length);
 
     pa_sink_unref(s);
 }
 
 /* Called from IO thread context */
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
+    pa_memchunk chunk;
     unsigned n;
     size_t length, block_size_max;
 
@@ -1246,6 +1924,8 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
         return;
     }
 
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SINK_RENDER_INTO, s->index, (int64_t) target->length);
+
     pa_sink_ref(s);
 
     length = target->length;
@@ -1255,14 +1935,68 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    if (peek_remixed(s, length, &chunk)) {
+        target->length = chunk.length;
+        pa_memchunk_memcpy(target, &chunk);
+        pa_memblock_unref(chunk.memblock);
+
+        PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER_INTO, s->index, (int64_t) target->length);
+        pa_sink_unref(s);
+        return;
+    }
+
+    if (s->thread_info.passthrough) {
+        passthrough_peek(s, length, &chunk);
+
+        target->length = chunk.length;
+        pa_memchunk_memcpy(target, &chunk);
+        pa_memblock_unref(chunk.memblock);
+        mix_history_push(s, target, true);
+
+        PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER_INTO, s->index, (int64_t) target->length);
+        pa_sink_unref(s);
+        return;
+    }
+
+    /* With a single input that needs no processing, let it write
+     * straight into the target */
+    if (pa_dynarray_size(s->thread_info.render_inputs) == 1 &&
+        !s->thread_info.soft_muted &&
+        pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
+
+        pa_sink_input *i = pa_dynarray_get(s->thread_info.render_inputs, 0);
+
+        if (target->length > length)
+            target->length = length;
+
+        if (pa_sink_input_peek_into(i, target)) {
+            pa_sink_input_drop(i, target->length);
+            mix_history_push(s, target, true);
+
+            if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
+                pa_source_post(s->monitor_source, target);
+
+            PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER_INTO, s->index, (int64_t) target->length);
+
+            pa_sink_unref(s);
+            return;
+        }
+    }
+
+    /* There's room for every input, since ensure_mix_info() is
+     * called whenever one is attached */
+    info = s->thread_info.mix_info;
+    n = fill_mix_info(s, &length, info, s->thread_info.mix_info_size);
 
     if (n == 0) {
+        if (!pa_hashmap_isempty(s->thread_info.inputs))
+            pa_atomic_inc(&s->silent_skipped);
+
         if (target->length > length)
             target->length = length;
 
         pa_silence_memchunk(target, &s->sample_spec);
-    } else if (n == 1) {
+    } else if (n == 1 && info[0].ramp_length <= 0) {
         pa_cvolume volume;
 
         if (target->length > length)
@@ -1295,25 +2029,71 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
         ptr = pa_memblock_acquire(target->memblock);
 
-        target->length = pa_mix(info, n,
-                                (uint8_t*) ptr + target->index, length,
-                                &s->sample_spec,
-                                &s->thread_info.soft_volume,
-                                s->thread_info.soft_muted);
+        target->length = pa_mix_ramp(info, n,
+                                     (uint8_t*) ptr + target->index, length,
+                                     &s->sample_spec,
+                                     &s->thread_info.soft_volume,
+                                     s->thread_info.soft_muted);
 
         pa_memblock_release(target->memblock);
     }
 
     inputs_drop(s, info, n, target);
+    mix_history_push(s, target, true);
+
+    PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER_INTO, s->index, (int64_t) target->length);
 
     pa_sink_unref(s);
 }
 
+/* Called from IO thread context. Folds the time it took to render length
+ * bytes, which started at start, into the render load. */
+static void update_render_load(pa_sink *s, pa_usec_t start, size_t length) {
+    pa_usec_t budget, spent;
+    int load, cycle;
+
+#ifdef RTPOLL_JITTER
+    /* Counted as render time, like real slow rendering would be */
+    pa_rtpoll_render_jitter(s->thread_info.rtpoll);
+#endif
+
+    spent = pa_rtclock_now() - start;
+    pa_metric_add(s->metrics.render_usec, (unsigned) spent);
+
+    if ((budget = pa_bytes_to_usec(length, &s->sample_spec)) <= 0)
+        return;
+
+    cycle = (int) PA_MIN(spent * 1000 / budget, (pa_usec_t) 100000);
+
+    /* Smoothed over about 8 calls, so that a single slow cycle doesn't
+     * count as load */
+    load = pa_atomic_load(&s->render_load);
+    pa_atomic_store(&s->render_load, load + (cycle - load) / 8);
+}
+
 /* Called from IO thread context */
-void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
+static void render_into_full(pa_sink *s, pa_memchunk *target) {
     pa_memchunk chunk;
     size_t l, d;
 
+    l = target->length;
+    d = 0;
+    while (l > 0) {
+        chunk = *target;
+        chunk.index += d;
+        chunk.length -= d;
+
+        pa_sink_render_into(s, &chunk);
+
+        d += chunk.length;
+        l -= chunk.length;
+    }
+}
+
+/* Called from IO thread context */
+void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
+    pa_usec_t start;
+
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
@@ -1330,26 +2110,23 @@ void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
         return;
     }
 
-    pa_sink_ref(s);
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SINK_RENDER_INTO_FULL, s->index, (int64_t) target->length);
 
-    l = target->length;
-    d = 0;
-    while (l > 0) {
-        chunk = *target;
-        chunk.index += d;
-        chunk.length -= d;
+    pa_sink_ref(s);
 
-        pa_sink_render_into(s, &chunk);
+    start = pa_rtclock_now();
+    render_into_full(s, target);
+    update_render_load(s, start, target->length);
 
-        d += chunk.length;
-        l -= chunk.length;
-    }
+    PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER_INTO_FULL, s->index, (int64_t) target->length);
 
     pa_sink_unref(s);
 }
 
 /* Called from IO thread context */
 void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
+    pa_usec_t start;
+
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
@@ -1360,8 +2137,11 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
     pa_assert(!s->thread_info.rewind_requested);
     pa_assert(s->thread_info.rewind_nbytes == 0);
 
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SINK_RENDER_FULL, s->index, (int64_t) length);
+
     pa_sink_ref(s);
 
+    start = pa_rtclock_now();
     pa_sink_render(s, length, result);
 
     if (result->length < length) {
@@ -1373,11 +2153,18 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
         chunk.index = result->index + result->length;
         chunk.length = length - result->length;
 
-        pa_sink_render_into_full(s, &chunk);
+        if (s->thread_info.state == PA_SINK_SUSPENDED)
+            pa_silence_memchunk(&chunk, &s->sample_spec);
+        else
+            render_into_full(s, &chunk);
 
         result->length = length;
     }
 
+    update_render_load(s, start, length);
+
+    PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER_FULL, s->index, (int64_t) length);
+
     pa_sink_unref(s);
 }
 
@@ -1385,6 +2172,7 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
 int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
     int ret = -1;
     uint32_t desired_rate = rate;
+    uint32_t fallback_rate = rate;
     uint32_t default_rate = s->default_sample_rate;
     uint32_t alternate_rate = s->alternate_sample_rate;
     uint32_t idx;
@@ -1398,7 +2186,7 @@ int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
     if (!s->update_rate)
         return -1;
 
-    if (PA_UNLIKELY(default_rate == alternate_rate && !passthrough)) {
+    if (PA_UNLIKELY(default_rate == alternate_rate && !passthrough && !s->core->avoid_resampling)) {
         pa_log_debug("Default and alternate sample rates are the same, so there is no point in switching.");
         return -1;
     }
@@ -1430,9 +2218,14 @@ int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
             alternate_rate_is_usable = true;
 
         if (alternate_rate_is_usable && !default_rate_is_usable)
-            desired_rate = alternate_rate;
+            fallback_rate = alternate_rate;
         else
-            desired_rate = default_rate;
+            fallback_rate = default_rate;
+
+        /* With avoid-resampling the stream's own rate is tried first, the
+         * device may well support it */
+        if (!s->core->avoid_resampling)
+            desired_rate = fallback_rate;
     }
 
     if (desired_rate == s->sample_spec.rate)
@@ -1444,7 +2237,15 @@ int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
     pa_log_debug("Suspending sink %s due to changing the sample rate.", s->name);
     pa_sink_suspend(s, true, PA_SUSPEND_INTERNAL);
 
-    if (s->update_rate(s, desired_rate) >= 0) {
+    ret = s->update_rate(s, desired_rate);
+
+    if (ret < 0 && fallback_rate != desired_rate && fallback_rate != s->sample_spec.rate) {
+        pa_log_debug("Sink %s cannot use %u Hz, trying %u Hz.", s->name, desired_rate, fallback_rate);
+        desired_rate = fallback_rate;
+        ret = s->update_rate(s, desired_rate);
+    }
+
+    if (ret >= 0) {
         /* update monitor source as well */
         if (s->monitor_source && !passthrough)
             pa_source_update_rate(s->monitor_source, desired_rate, false);
@@ -1675,6 +2476,51 @@ static void compute_reference_ratios(pa_sink *s) {
     }
 }
 
+/* Called from main context. Not called for inputs whose origin sink uses
+ * volume sharing. */
+static void compute_real_ratio(pa_sink *s, pa_sink_input *i) {
+    unsigned c;
+    pa_cvolume remapped;
+
+    /*
+     * This basically calculates:
+     *
+     * i->real_ratio := i->volume / s->real_volume
+     * i->soft_volume := i->real_ratio * i->volume_factor
+     */
+
+    remapped = s->real_volume;
+    pa_cvolume_remap(&remapped, &s->channel_map, &i->channel_map);
+
+    i->real_ratio.channels = i->sample_spec.channels;
+    i->soft_volume.channels = i->sample_spec.channels;
+
+    for (c = 0; c < i->sample_spec.channels; c++) {
+
+        if (remapped.values[c] <= PA_VOLUME_MUTED) {
+            /* We leave i->real_ratio untouched */
+            i->soft_volume.values[c] = PA_VOLUME_MUTED;
+            continue;
+        }
+
+        /* Don't lose accuracy unless necessary */
+        if (pa_sw_volume_multiply(
+                    i->real_ratio.values[c],
+                    remapped.values[c]) != i->volume.values[c])
+
+            i->real_ratio.values[c] = pa_sw_volume_divide(
+                    i->volume.values[c],
+                    remapped.values[c]);
+
+        i->soft_volume.values[c] = pa_sw_volume_multiply(
+                i->real_ratio.values[c],
+                i->volume_factor.values[c]);
+    }
+
+    /* We don't copy the soft_volume to the thread_info data
+     * here. That must be done by the caller */
+}
+
 /* Called from main context. Only called for the root sink in volume sharing
  * cases, except for internal recursive calls. */
 static void compute_real_ratios(pa_sink *s) {
@@ -1687,8 +2533,6 @@ static void compute_real_ratios(pa_sink *s) {
     pa_assert(pa_sink_flat_volume_enabled(s));
 
     PA_IDXSET_FOREACH(i, s->inputs, idx) {
-        unsigned c;
-        pa_cvolume remapped;
 
         if (i->origin_sink && (i->origin_sink->flags & PA_SINK_SHARE_VOLUME_WITH_MASTER)) {
             /* The origin sink uses volume sharing, so this input's real ratio
@@ -1702,43 +2546,7 @@ static void compute_real_ratios(pa_sink *s) {
             continue;
         }
 
-        /*
-         * This basically calculates:
-         *
-         * i->real_ratio := i->volume / s->real_volume
-         * i->soft_volume := i->real_ratio * i->volume_factor
-         */
-
-        remapped = s->real_volume;
-        pa_cvolume_remap(&remapped, &s->channel_map, &i->channel_map);
-
-        i->real_ratio.channels = i->sample_spec.channels;
-        i->soft_volume.channels = i->sample_spec.channels;
-
-        for (c = 0; c < i->sample_spec.channels; c++) {
-
-            if (remapped.values[c] <= PA_VOLUME_MUTED) {
-                /* We leave i->real_ratio untouched */
-                i->soft_volume.values[c] = PA_VOLUME_MUTED;
-                continue;
-            }
-
-            /* Don't lose accuracy unless necessary */
-            if (pa_sw_volume_multiply(
-                        i->real_ratio.values[c],
-                        remapped.values[c]) != i->volume.values[c])
-
-                i->real_ratio.values[c] = pa_sw_volume_divide(
-                        i->volume.values[c],
-                        remapped.values[c]);
-
-            i->soft_volume.values[c] = pa_sw_volume_multiply(
-                    i->real_ratio.values[c],
-                    i->volume_factor.values[c]);
-        }
-
-        /* We don't copy the soft_volume to the thread_info data
-         * here. That must be done by the caller */
+        compute_real_ratio(s, i);
     }
 }
 
@@ -2067,6 +2875,49 @@ void pa_sink_set_volume(
         pa_assert_se(pa_asyncmsgq_send(root_sink->asyncmsgq, PA_MSGOBJECT(root_sink), PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL) == 0);
 }
 
+/* Called from main thread */
+void pa_sink_update_flat_volume(pa_sink *s, pa_sink_input *i, bool save) {
+    pa_cvolume max_volume, reference_volume;
+
+    pa_sink_assert_ref(s);
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_IS_LINKED(s->state));
+    pa_assert(pa_sink_flat_volume_enabled(s));
+    pa_assert(i->sink == s);
+
+    /* The shortcut below doesn't handle volume sharing */
+    if ((s->flags & PA_SINK_SHARE_VOLUME_WITH_MASTER) ||
+        (i->origin_sink && (i->origin_sink->flags & PA_SINK_SHARE_VOLUME_WITH_MASTER)))
+        goto full_update;
+
+    /* The sink's real volume is the maximum of all input volumes. If the new
+     * volume of i doesn't change that maximum, and the reference volume
+     * doesn't need to be pushed up either, none of the other inputs are
+     * affected and the sink doesn't need to be told anything. */
+    pa_cvolume_mute(&max_volume, s->channel_map.channels);
+    get_maximum_input_volume(s, &max_volume, &s->channel_map);
+
+    if (!pa_cvolume_equal(&max_volume, &s->real_volume))
+        goto full_update;
+
+    pa_cvolume_merge(&reference_volume, &s->reference_volume, &max_volume);
+
+    if (!pa_cvolume_equal(&reference_volume, &s->reference_volume))
+        goto full_update;
+
+    s->save_volume = s->save_volume || save;
+
+    compute_real_ratio(s, i);
+    compute_reference_ratio(i);
+
+    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+    return;
+
+full_update:
+    pa_sink_set_volume(s, NULL, true, save);
+}
+
 /* Called from the io thread if sync volume is used, otherwise from the main thread.
  * Only to be called by sink implementor */
 void pa_sink_set_soft_volume(pa_sink *s, const pa_cvolume *volume) {
@@ -2432,6 +3283,163 @@ static void set_shared_volume_within_thread(pa_sink *s) {
     }
 }
 
+/* Called from IO thread, for every input that starts moving away */
+static void start_move_within_thread(pa_sink *s, pa_sink_input *i) {
+    pa_sink_assert_ref(s);
+    pa_sink_input_assert_ref(i);
+
+    /* We don't support moving synchronized streams. */
+    pa_assert(!i->sync_prev);
+    pa_assert(!i->sync_next);
+    pa_assert(!i->thread_info.sync_next);
+    pa_assert(!i->thread_info.sync_prev);
+
+    i->thread_info.move_rewrite = 0;
+
+    if (i->thread_info.state != PA_SINK_INPUT_CORKED) {
+        pa_usec_t usec = 0;
+        size_t sink_nbytes;
+
+        /* The old sink probably has some audio from this stream in its
+         * buffer. We want to "take it back" as much as possible and
+         * play it to the new sink. We don't know at this point how much
+         * the old sink can rewind. We have to pick something, and that
+         * something is the full latency of the old sink here. So we
+         * rewind the stream buffer by the sink latency amount, which
+         * may be more than what we should rewind. This can result in a
+         * chunk of audio being played both to the old sink and the new
+         * sink.
+         *
+         * FIXME: Fix this code so that we don't have to make guesses
+         * about how much the sink will actually be able to rewind. If
+         * someone comes up with a solution for this, something to note
+         * is that the part of the latency that the old sink couldn't
+         * rewind should ideally be compensated after the stream has
+         * moved to the new sink by adding silence. The new sink most
+         * likely can't start playing the moved stream immediately, and
+         * that gap should be removed from the "compensation silence"
+         * (at least at the time of writing this, the move finish code
+         * will actually already take care of dropping the new sink's
+         * unrewindable latency, so taking into account the
+         * unrewindable latency of the old sink is the only problem).
+         *
+         * Only the render_memblockq is rewound here, its contents and
+         * the resampler are kept: if the new sink has the same sample
+         * spec and channel map as the old one, the stream just goes on
+         * with them. Otherwise the audio stored in the render_memblockq
+         * is invalid on the new sink, and pa_sink_input_finish_move()
+         * leaves move_rewrite set to have the implementor render it
+         * again. */
+
+        /* Get the latency of the sink */
+        usec = pa_sink_get_latency_within_thread(s);
+        sink_nbytes = pa_usec_to_bytes(usec, &s->sample_spec);
+        sink_nbytes = PA_MIN(sink_nbytes, pa_memblockq_get_maxrewind(i->thread_info.render_memblockq));
+
+        pa_sink_input_process_rewind(i, sink_nbytes);
+
+        i->thread_info.move_rewrite = pa_memblockq_get_length(i->thread_info.render_memblockq);
+        if (i->thread_info.resampler && i->thread_info.move_rewrite > 0)
+            i->thread_info.move_rewrite = pa_resampler_request(i->thread_info.resampler, i->thread_info.move_rewrite);
+    }
+
+    if (i->detach)
+        i->detach(i);
+
+    pa_assert(i->thread_info.attached);
+    i->thread_info.attached = false;
+
+    /* Let's remove the sink input ...*/
+    pa_dynarray_remove_by_data(s->thread_info.render_inputs, i);
+    pa_hashmap_remove_and_free(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index));
+    update_passthrough_within_thread(s);
+    invalidate_mix_history(s);
+}
+
+/* Called from IO thread, for every input that was moved here. Returns
+ * true if the sink needs to rewind, and raises nbytes to how much. */
+static bool finish_move_within_thread(pa_sink *s, pa_sink_input *i, size_t *nbytes) {
+    pa_usec_t usec = 0;
+    size_t n;
+
+    pa_sink_assert_ref(s);
+    pa_sink_input_assert_ref(i);
+    pa_assert(nbytes);
+
+    /* We don't support moving synchronized streams. */
+    pa_assert(!i->sync_prev);
+    pa_assert(!i->sync_next);
+    pa_assert(!i->thread_info.sync_next);
+    pa_assert(!i->thread_info.sync_prev);
+
+    pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+    pa_dynarray_append(s->thread_info.render_inputs, i);
+    update_passthrough_within_thread(s);
+    ensure_mix_info(s);
+    i->thread_info.mix_since = INT64_MAX;
+
+    pa_assert(!i->thread_info.attached);
+    i->thread_info.attached = true;
+
+    if (i->attach)
+        i->attach(i);
+
+    /* What the render_memblockq held had to be thrown away, let the
+     * implementor give it to us again */
+    if (i->thread_info.move_rewrite > 0) {
+        pa_log_debug("Have to rewind %lu bytes on implementor.", (unsigned long) i->thread_info.move_rewrite);
+
+        if (i->process_rewind)
+            i->process_rewind(i, i->thread_info.move_rewrite);
+
+        i->thread_info.move_rewrite = 0;
+    }
+
+    if (i->thread_info.state == PA_SINK_INPUT_CORKED)
+        return false;
+
+    /* In the ideal case the new sink would start playing the stream
+     * immediately. That requires the sink to be able to rewind all of
+     * its latency, which usually isn't possible, so there will probably
+     * be some gap before the moved stream becomes audible. We then have
+     * two possibilities: 1) start playing the stream from where it is
+     * now, or 2) drop the unrewindable latency of the sink from the
+     * stream. With option 1 we won't lose any audio but the stream will
+     * have a pause. With option 2 we may lose some audio but the stream
+     * time will be somewhat in sync with the wall clock. Lennart seems
+     * to have chosen option 2 (one of the reasons might have been that
+     * option 1 is actually much harder to implement), so we drop the
+     * latency of the new sink from the moved stream and hope that the
+     * sink will undo most of that in the rewind. */
+
+    /* Get the latency of the sink */
+    usec = pa_sink_get_latency_within_thread(s);
+    n = pa_usec_to_bytes(usec, &s->sample_spec);
+
+    if (n > 0)
+        pa_sink_input_drop(i, n);
+
+    /* The stream comes in somewhere in the middle, don't let it start
+     * with a click */
+    pa_sink_input_fade_in(i, MOVE_FADE_IN_USEC);
+
+    *nbytes = PA_MAX(*nbytes, n);
+    return true;
+}
+
+/* Called from IO thread, after the rewind for the moved inputs was
+ * requested */
+static void finish_move_latency_within_thread(pa_sink *s, pa_sink_input *i) {
+    pa_sink_assert_ref(s);
+    pa_sink_input_assert_ref(i);
+
+    if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
+        pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
+
+    pa_sink_input_update_max_rewind(i, input_max_rewind(s));
+    pa_sink_input_update_max_request(i, s->thread_info.max_request);
+}
+
 /* Called from IO thread, except when it is not */
 int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_sink *s = PA_SINK(o);
@@ -2447,6 +3455,10 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
              * PA_SINK_MESSAGE_FINISH_MOVE, too. */
 
             pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+            pa_dynarray_append(s->thread_info.render_inputs, i);
+            update_passthrough_within_thread(s);
+            ensure_mix_info(s);
+            i->thread_info.mix_since = INT64_MAX;
 
             /* Since the caller sleeps in pa_sink_input_put(), we can
              * safely access data outside of thread_info even though
@@ -2486,7 +3498,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
                 pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
 
-            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
+            pa_sink_input_update_max_rewind(i, input_max_rewind(s));
             pa_sink_input_update_max_request(i, s->thread_info.max_request);
 
             /* We don't rewind here automatically. This is left to the
@@ -2535,7 +3547,10 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
                 i->thread_info.sync_next = NULL;
             }
 
+            pa_dynarray_remove_by_data(s->thread_info.render_inputs, i);
             pa_hashmap_remove_and_free(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index));
+            update_passthrough_within_thread(s);
+            invalidate_mix_history(s);
             pa_sink_invalidate_requested_latency(s, true);
             pa_sink_request_rewind(s, (size_t) -1);
 
@@ -2544,79 +3559,16 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             return o->process_msg(o, PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL);
         }
 
-        case PA_SINK_MESSAGE_START_MOVE: {
-            pa_sink_input *i = PA_SINK_INPUT(userdata);
-
-            /* We don't support moving synchronized streams. */
-            pa_assert(!i->sync_prev);
-            pa_assert(!i->sync_next);
-            pa_assert(!i->thread_info.sync_next);
-            pa_assert(!i->thread_info.sync_prev);
-
-            if (i->thread_info.state != PA_SINK_INPUT_CORKED) {
-                pa_usec_t usec = 0;
-                size_t sink_nbytes, total_nbytes;
-
-                /* The old sink probably has some audio from this
-                 * stream in its buffer. We want to "take it back" as
-                 * much as possible and play it to the new sink. We
-                 * don't know at this point how much the old sink can
-                 * rewind. We have to pick something, and that
-                 * something is the full latency of the old sink here.
-                 * So we rewind the stream buffer by the sink latency
-                 * amount, which may be more than what we should
-                 * rewind. This can result in a chunk of audio being
-                 * played both to the old sink and the new sink.
-                 *
-                 * FIXME: Fix this code so that we don't have to make
-                 * guesses about how much the sink will actually be
-                 * able to rewind. If someone comes up with a solution
-                 * for this, something to note is that the part of the
-                 * latency that the old sink couldn't rewind should
-                 * ideally be compensated after the stream has moved
-                 * to the new sink by adding silence. The new sink
-                 * most likely can't start playing the moved stream
-                 * immediately, and that gap should be removed from
-                 * the "compensation silence" (at least at the time of
-                 * writing this, the move finish code will actually
-                 * already take care of dropping the new sink's
-                 * unrewindable latency, so taking into account the
-                 * unrewindable latency of the old sink is the only
-                 * problem).
-                 *
-                 * The render_memblockq contents are discarded,
-                 * because when the sink changes, the format of the
-                 * audio stored in the render_memblockq may change
-                 * too, making the stored audio invalid. FIXME:
-                 * However, the read and write indices are moved back
-                 * the same amount, so if they are not the same now,
-                 * they won't be the same after the rewind either. If
-                 * the write index of the render_memblockq is ahead of
-                 * the read index, then the render_memblockq will feed
-                 * the new sink some silence first, which it shouldn't
-                 * do. The write index should be flushed to be the
-                 * same as the read index. */
-
-                /* Get the latency of the sink */
-                usec = pa_sink_get_latency_within_thread(s);
-                sink_nbytes = pa_usec_to_bytes(usec, &s->sample_spec);
-                total_nbytes = sink_nbytes + pa_memblockq_get_length(i->thread_info.render_memblockq);
-
-                if (total_nbytes > 0) {
-                    i->thread_info.rewrite_nbytes = i->thread_info.resampler ? pa_resampler_request(i->thread_info.resampler, total_nbytes) : total_nbytes;
-                    i->thread_info.rewrite_flush = true;
-                    pa_sink_input_process_rewind(i, sink_nbytes);
-                }
-            }
-
-            if (i->detach)
-                i->detach(i);
-
-            pa_assert(i->thread_info.attached);
-            i->thread_info.attached = false;
+        case PA_SINK_MESSAGE_START_MOVE:
+        case PA_SINK_MESSAGE_START_MOVE_ALL: {
+            pa_sink_input *i;
+            uint32_t idx;
 
-            /* Let's remove the sink input ...*/
-            pa_hashmap_remove_and_free(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index));
+            if (code == PA_SINK_MESSAGE_START_MOVE)
+                start_move_within_thread(s, PA_SINK_INPUT(userdata));
+            else
+                PA_IDXSET_FOREACH(i, (pa_idxset*) userdata, idx)
+                    start_move_within_thread(s, i);
 
             pa_sink_invalidate_requested_latency(s, true);
 
@@ -2628,52 +3580,22 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             return o->process_msg(o, PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL);
         }
 
-        case PA_SINK_MESSAGE_FINISH_MOVE: {
-            pa_sink_input *i = PA_SINK_INPUT(userdata);
-
-            /* We don't support moving synchronized streams. */
-            pa_assert(!i->sync_prev);
-            pa_assert(!i->sync_next);
-            pa_assert(!i->thread_info.sync_next);
-            pa_assert(!i->thread_info.sync_prev);
-
-            pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
-
-            pa_assert(!i->thread_info.attached);
-            i->thread_info.attached = true;
-
-            if (i->attach)
-                i->attach(i);
-
-            if (i->thread_info.state != PA_SINK_INPUT_CORKED) {
-                pa_usec_t usec = 0;
-                size_t nbytes;
-
-                /* In the ideal case the new sink would start playing
-                 * the stream immediately. That requires the sink to
-                 * be able to rewind all of its latency, which usually
-                 * isn't possible, so there will probably be some gap
-                 * before the moved stream becomes audible. We then
-                 * have two possibilities: 1) start playing the stream
-                 * from where it is now, or 2) drop the unrewindable
-                 * latency of the sink from the stream. With option 1
-                 * we won't lose any audio but the stream will have a
-                 * pause. With option 2 we may lose some audio but the
-                 * stream time will be somewhat in sync with the wall
-                 * clock. Lennart seems to have chosen option 2 (one
-                 * of the reasons might have been that option 1 is
-                 * actually much harder to implement), so we drop the
-                 * latency of the new sink from the moved stream and
-                 * hope that the sink will undo most of that in the
-                 * rewind. */
-
-                /* Get the latency of the sink */
-                usec = pa_sink_get_latency_within_thread(s);
-                nbytes = pa_usec_to_bytes(usec, &s->sample_spec);
-
-                if (nbytes > 0)
-                    pa_sink_input_drop(i, nbytes);
+        case PA_SINK_MESSAGE_FINISH_MOVE:
+        case PA_SINK_MESSAGE_FINISH_MOVE_ALL: {
+            pa_sink_input *i;
+            uint32_t idx;
+            size_t nbytes = 0;
+            bool rewind;
+
+            if (code == PA_SINK_MESSAGE_FINISH_MOVE)
+                rewind = finish_move_within_thread(s, PA_SINK_INPUT(userdata), &nbytes);
+            else {
+                rewind = false;
+                PA_IDXSET_FOREACH(i, (pa_idxset*) userdata, idx)
+                    rewind = finish_move_within_thread(s, i, &nbytes) || rewind;
+            }
 
+            if (rewind) {
                 pa_log_debug("Requesting rewind due to finished move");
                 pa_sink_request_rewind(s, nbytes);
             }
@@ -2683,11 +3605,11 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
              * otherwise the sink may limit the rewind amount
              * needlessly. */
 
-            if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
-                pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
-
-            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
-            pa_sink_input_update_max_request(i, s->thread_info.max_request);
+            if (code == PA_SINK_MESSAGE_FINISH_MOVE)
+                finish_move_latency_within_thread(s, PA_SINK_INPUT(userdata));
+            else
+                PA_IDXSET_FOREACH(i, (pa_idxset*) userdata, idx)
+                    finish_move_latency_within_thread(s, i);
 
             return o->process_msg(o, PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL);
         }
@@ -2768,6 +3690,10 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             if (s->thread_info.state == PA_SINK_SUSPENDED) {
                 s->thread_info.rewind_nbytes = 0;
                 s->thread_info.rewind_requested = false;
+
+                /* Whatever was mixed again for the device is gone now */
+                pa_memblockq_drop(s->thread_info.mix_history, pa_memblockq_get_length(s->thread_info.mix_history));
+                invalidate_mix_history(s);
             }
 
             if (suspend_change) {
@@ -2878,22 +3804,11 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
 
 /* Called from main thread */
 int pa_sink_suspend_all(pa_core *c, bool suspend, pa_suspend_cause_t cause) {
-    pa_sink *sink;
-    uint32_t idx;
-    int ret = 0;
-
     pa_core_assert_ref(c);
     pa_assert_ctl_context();
     pa_assert(cause != 0);
 
-    PA_IDXSET_FOREACH(sink, c->sinks, idx) {
-        int r;
-
-        if ((r = pa_sink_suspend(sink, suspend, cause)) < 0)
-            ret = r;
-    }
-
-    return ret;
+    return pa_sink_suspend_many(c->sinks, suspend, cause);
 }
 
 /* Called from IO thread */
@@ -2936,6 +3851,11 @@ void pa_sink_request_rewind(pa_sink*s, size_t nbytes) {
     pa_sink_assert_io_context(s);
     pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
 
+    /* What the device has of a bitstream can't be replaced by
+     * anything that would still decode, let it play out */
+    if (s->thread_info.passthrough)
+        return;
+
     if (nbytes == (size_t) -1)
         nbytes = s->thread_info.max_rewind;
 
@@ -2948,6 +3868,8 @@ void pa_sink_request_rewind(pa_sink*s, size_t nbytes) {
     s->thread_info.rewind_nbytes = nbytes;
     s->thread_info.rewind_requested = true;
 
+    PA_TRACE_INSTANT(PA_TRACEPOINT_SINK_REQUEST_REWIND, s->index, (int64_t) nbytes);
+
     if (s->request_rewind)
         s->request_rewind(s);
 }
@@ -3019,10 +3941,11 @@ void pa_sink_set_max_rewind_within_thread(pa_sink *s, size_t max_rewind) {
         return;
 
     s->thread_info.max_rewind = max_rewind;
+    pa_memblockq_set_maxrewind(s->thread_info.mix_history, max_rewind);
 
     if (PA_SINK_IS_LINKED(s->thread_info.state))
         PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state)
-            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
+            pa_sink_input_update_max_rewind(i, input_max_rewind(s));
 
     if (s->monitor_source)
         pa_source_set_max_rewind_within_thread(s->monitor_source, s->thread_info.max_rewind);
@@ -3518,117 +4441,107 @@ unsigned pa_device_init_priority(pa_proplist *p) {
     return priority;
 }
 
-PA_STATIC_FLIST_DECLARE(pa_sink_volume_change, 0, pa_xfree);
-
 /* Called from the IO thread. */
-static pa_sink_volume_change *pa_sink_volume_change_new(pa_sink *s) {
-    pa_sink_volume_change *c;
-    if (!(c = pa_flist_pop(PA_STATIC_FLIST_GET(pa_sink_volume_change))))
-        c = pa_xnew(pa_sink_volume_change, 1);
+static pa_sink_volume_change *volume_change_nth(pa_sink *s, unsigned n) {
+    pa_assert(n < PA_SINK_VOLUME_CHANGES_MAX);
 
-    PA_LLIST_INIT(pa_sink_volume_change, c);
-    c->at = 0;
-    pa_cvolume_reset(&c->hw_volume, s->sample_spec.channels);
-    return c;
-}
-
-/* Called from the IO thread. */
-static void pa_sink_volume_change_free(pa_sink_volume_change *c) {
-    pa_assert(c);
-    if (pa_flist_push(PA_STATIC_FLIST_GET(pa_sink_volume_change), c) < 0)
-        pa_xfree(c);
+    return &s->thread_info.volume_changes[(s->thread_info.volume_changes_first + n) % PA_SINK_VOLUME_CHANGES_MAX];
 }
 
 /* Called from the IO thread. */
 void pa_sink_volume_change_push(pa_sink *s) {
     pa_sink_volume_change *c = NULL;
-    pa_sink_volume_change *nc = NULL;
+    pa_cvolume hw_volume;
+    pa_usec_t at;
+    unsigned n, k;
     uint32_t safety_margin = s->thread_info.volume_change_safety_margin;
 
     const char *direction = NULL;
 
     pa_assert(s);
-    nc = pa_sink_volume_change_new(s);
 
     /* NOTE: There is already more different volumes in pa_sink that I can remember.
      *       Adding one more volume for HW would get us rid of this, but I am trying
      *       to survive with the ones we already have. */
-    pa_sw_cvolume_divide(&nc->hw_volume, &s->real_volume, &s->soft_volume);
+    pa_sw_cvolume_divide(&hw_volume, &s->real_volume, &s->soft_volume);
 
-    if (!s->thread_info.volume_changes && pa_cvolume_equal(&nc->hw_volume, &s->thread_info.current_hw_volume)) {
+    if (s->thread_info.n_volume_changes == 0 && pa_cvolume_equal(&hw_volume, &s->thread_info.current_hw_volume)) {
         pa_log_debug("Volume not changing");
-        pa_sink_volume_change_free(nc);
         return;
     }
 
-    nc->at = pa_sink_get_latency_within_thread(s);
-    nc->at += pa_rtclock_now() + s->thread_info.volume_change_extra_delay;
+    at = pa_sink_get_latency_within_thread(s);
+    at += pa_rtclock_now() + s->thread_info.volume_change_extra_delay;
 
-    if (s->thread_info.volume_changes_tail) {
-        for (c = s->thread_info.volume_changes_tail; c; c = c->prev) {
-            /* If volume is going up let's do it a bit late. If it is going
-             * down let's do it a bit early. */
-            if (pa_cvolume_avg(&nc->hw_volume) > pa_cvolume_avg(&c->hw_volume)) {
-                if (nc->at + safety_margin > c->at) {
-                    nc->at += safety_margin;
-                    direction = "up";
-                    break;
-                }
-            }
-            else if (nc->at - safety_margin > c->at) {
-                    nc->at -= safety_margin;
-                    direction = "down";
-                    break;
+    for (n = s->thread_info.n_volume_changes; n > 0; n--) {
+        c = volume_change_nth(s, n - 1);
+
+        /* If volume is going up let's do it a bit late. If it is going
+         * down let's do it a bit early. */
+        if (pa_cvolume_avg(&hw_volume) > pa_cvolume_avg(&c->hw_volume)) {
+            if (at + safety_margin > c->at) {
+                at += safety_margin;
+                direction = "up";
+                break;
             }
         }
+        else if (at - safety_margin > c->at) {
+                at -= safety_margin;
+                direction = "down";
+                break;
+        }
     }
 
-    if (c == NULL) {
-        if (pa_cvolume_avg(&nc->hw_volume) > pa_cvolume_avg(&s->thread_info.current_hw_volume)) {
-            nc->at += safety_margin;
+    if (n == 0) {
+        if (pa_cvolume_avg(&hw_volume) > pa_cvolume_avg(&s->thread_info.current_hw_volume)) {
+            at += safety_margin;
             direction = "up";
         } else {
-            nc->at -= safety_margin;
+            at -= safety_margin;
             direction = "down";
         }
-        PA_LLIST_PREPEND(pa_sink_volume_change, s->thread_info.volume_changes, nc);
-    }
-    else {
-        PA_LLIST_INSERT_AFTER(pa_sink_volume_change, s->thread_info.volume_changes, c, nc);
     }
 
-    pa_log_debug("Volume going %s to %d at %llu", direction, pa_cvolume_avg(&nc->hw_volume), (long long unsigned) nc->at);
-
     /* We can ignore volume events that came earlier but should happen later than this. */
-    PA_LLIST_FOREACH(c, nc->next) {
+    for (k = n; k < s->thread_info.n_volume_changes; k++) {
+        c = volume_change_nth(s, k);
+        pa_log_debug("Volume change to %d at %llu was dropped", pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at);
+    }
+    s->thread_info.n_volume_changes = n;
+
+    /* During a long sweep the queue can fill up. The new volume then
+     * supersedes the last one still pending. */
+    if (n >= PA_SINK_VOLUME_CHANGES_MAX) {
+        c = volume_change_nth(s, n - 1);
         pa_log_debug("Volume change to %d at %llu was dropped", pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at);
-        pa_sink_volume_change_free(c);
+        s->thread_info.n_volume_changes = --n;
     }
-    nc->next = NULL;
-    s->thread_info.volume_changes_tail = nc;
+
+    c = volume_change_nth(s, n);
+    c->at = at;
+    c->hw_volume = hw_volume;
+    s->thread_info.n_volume_changes++;
+
+    pa_log_debug("Volume going %s to %d at %llu", direction, pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at);
 }
 
 /* Called from the IO thread. */
 static void pa_sink_volume_change_flush(pa_sink *s) {
-    pa_sink_volume_change *c = s->thread_info.volume_changes;
     pa_assert(s);
-    s->thread_info.volume_changes = NULL;
-    s->thread_info.volume_changes_tail = NULL;
-    while (c) {
-        pa_sink_volume_change *next = c->next;
-        pa_sink_volume_change_free(c);
-        c = next;
-    }
+
+    s->thread_info.volume_changes_first = 0;
+    s->thread_info.n_volume_changes = 0;
 }
 
 /* Called from the IO thread. */
 bool pa_sink_volume_change_apply(pa_sink *s, pa_usec_t *usec_to_next) {
+    pa_sink_volume_change *c;
     pa_usec_t now;
     bool ret = false;
 
     pa_assert(s);
 
-    if (!s->thread_info.volume_changes || !PA_SINK_IS_LINKED(s->state)) {
+    if (s->thread_info.n_volume_changes == 0 || !PA_SINK_IS_LINKED(s->state)) {
         if (usec_to_next)
             *usec_to_next = 0;
         return ret;
@@ -3638,29 +4551,28 @@ bool pa_sink_volume_change_apply(pa_sink *s, pa_usec_t *usec_to_next) {
 
     now = pa_rtclock_now();
 
-    while (s->thread_info.volume_changes && now >= s->thread_info.volume_changes->at) {
-        pa_sink_volume_change *c = s->thread_info.volume_changes;
-        PA_LLIST_REMOVE(pa_sink_volume_change, s->thread_info.volume_changes, c);
+    while (s->thread_info.n_volume_changes > 0 && now >= (c = volume_change_nth(s, 0))->at) {
         pa_log_debug("Volume change to %d at %llu was written %llu usec late",
                      pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at, (long long unsigned) (now - c->at));
         ret = true;
         s->thread_info.current_hw_volume = c->hw_volume;
-        pa_sink_volume_change_free(c);
+        s->thread_info.volume_changes_first = (s->thread_info.volume_changes_first + 1) % PA_SINK_VOLUME_CHANGES_MAX;
+        s->thread_info.n_volume_changes--;
     }
 
     if (ret)
         s->write_volume(s);
 
-    if (s->thread_info.volume_changes) {
+    if (s->thread_info.n_volume_changes > 0) {
+        c = volume_change_nth(s, 0);
         if (usec_to_next)
-            *usec_to_next = s->thread_info.volume_changes->at - now;
+            *usec_to_next = c->at - now;
         if (pa_log_ratelimit(PA_LOG_DEBUG))
-            pa_log_debug("Next volume change in %lld usec", (long long) (s->thread_info.volume_changes->at - now));
+            pa_log_debug("Next volume change in %lld usec", (long long) (c->at - now));
     }
     else {
         if (usec_to_next)
             *usec_to_next = 0;
-        s->thread_info.volume_changes_tail = NULL;
     }
     return ret;
 }
@@ -3669,6 +4581,7 @@ bool pa_sink_volume_change_apply(pa_sink *s, pa_usec_t *usec_to_next) {
 static void pa_sink_volume_change_rewind(pa_sink *s, size_t nbytes) {
     /* All the queued volume events later than current latency are shifted to happen earlier. */
     pa_sink_volume_change *c;
+    unsigned n;
     pa_volume_t prev_vol = pa_cvolume_avg(&s->thread_info.current_hw_volume);
     pa_usec_t rewound = pa_bytes_to_usec(nbytes, &s->sample_spec);
     pa_usec_t limit = pa_sink_get_latency_within_thread(s);
@@ -3676,8 +4589,10 @@ static void pa_sink_volume_change_rewind(pa_sink *s, size_t nbytes) {
     pa_log_debug("latency = %lld", (long long) limit);
     limit += pa_rtclock_now() + s->thread_info.volume_change_extra_delay;
 
-    PA_LLIST_FOREACH(c, s->thread_info.volume_changes) {
+    for (n = 0; n < s->thread_info.n_volume_changes; n++) {
         pa_usec_t modified_limit = limit;
+
+        c = volume_change_nth(s, n);
         if (prev_vol > pa_cvolume_avg(&c->hw_volume))
             modified_limit -= s->thread_info.volume_change_safety_margin;
         else
@@ -3722,10 +4637,11 @@ bool pa_sink_set_formats(pa_sink *s, pa_idxset *formats) {
     pa_assert(s);
     pa_assert(formats);
 
-    if (s->set_formats)
+    if (s->set_formats) {
         /* Sink supports setting formats -- let's give it a shot */
+        pa_hashmap_remove_all(s->check_formats_cache);
         return s->set_formats(s, formats);
-    else
+    } else
         /* Sink doesn't support setting this -- bail out */
         return false;
 }
@@ -3762,15 +4678,26 @@ bool pa_sink_check_format(pa_sink *s, pa_format_info *f) {
 /* Calculates the intersection between formats supported by the sink and
  * in_formats, and returns these, in the order of the sink's formats. */
 pa_idxset* pa_sink_check_formats(pa_sink *s, pa_idxset *in_formats) {
-    pa_idxset *out_formats = pa_idxset_new(NULL, NULL), *sink_formats = NULL;
+    pa_idxset *out_formats = pa_idxset_new(NULL, NULL), *sink_formats = NULL, *cached;
     pa_format_info *f_sink, *f_in;
     uint32_t i, j;
+    char *key = NULL;
 
     pa_assert(s);
 
     if (!in_formats || pa_idxset_isempty(in_formats))
         goto done;
 
+    /* Clients tend to ask for the same formats over and over again, and
+     * comparing them is expensive, since the properties have to be parsed */
+    key = formats_cache_key(in_formats);
+
+    if ((cached = pa_hashmap_get(s->check_formats_cache, key))) {
+        pa_xfree(key);
+        pa_idxset_free(out_formats, NULL);
+        return pa_idxset_copy(cached, (pa_copy_func_t) pa_format_info_copy);
+    }
+
     sink_formats = pa_sink_get_formats(s);
 
     PA_IDXSET_FOREACH(f_sink, sink_formats, i) {
@@ -3780,6 +4707,11 @@ pa_idxset* pa_sink_check_formats(pa_sink *s, pa_idxset *in_formats) {
         }
     }
 
+    if (pa_hashmap_size(s->check_formats_cache) >= CHECK_FORMATS_CACHE_MAX)
+        pa_hashmap_remove_all(s->check_formats_cache);
+
+    pa_hashmap_put(s->check_formats_cache, key, pa_idxset_copy(out_formats, (pa_copy_func_t) pa_format_info_copy));
+
 done:
     if (sink_formats)
         pa_idxset_free(sink_formats, (pa_free_cb_t) pa_format_info_free);
@@ -3802,11 +4734,12 @@ void pa_sink_set_reference_volume_direct(pa_sink *s, const pa_cvolume *volume) {
         return;
 
     s->reference_volume = *volume;
-    pa_log_debug("The reference volume of sink %s changed from %s to %s.", s->name,
-                 pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &s->channel_map,
-                                            s->flags & PA_SINK_DECIBEL_VOLUME),
-                 pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &s->channel_map,
-                                            s->flags & PA_SINK_DECIBEL_VOLUME));
+    if (pa_log_level_enabled(PA_LOG_DEBUG))
+        pa_log_debug("The reference volume of sink %s changed from %s to %s.", s->name,
+                     pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &s->channel_map,
+                                                s->flags & PA_SINK_DECIBEL_VOLUME),
+                     pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &s->channel_map,
+                                                s->flags & PA_SINK_DECIBEL_VOLUME));
 
     pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
     pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SINK_VOLUME_CHANGED], s);
@@ -22,7 +22,6 @@
 ***/
 
 typedef struct pa_sink pa_sink;
-typedef struct pa_sink_volume_change pa_sink_volume_change;
 
 #include <inttypes.h>
 
@@ -33,8 +32,11 @@ typedef struct pa_sink_volume_change pa_sink_volume_change;
 #include <pulse/volume.h>
 
 #include <pulsecore/core.h>
+#include <pulsecore/dynarray.h>
 #include <pulsecore/idxset.h>
+#include <pulsecore/io-trace.h>
 #include <pulsecore/memchunk.h>
+#include <pulsecore/metrics.h>
 #include <pulsecore/source.h>
 #include <pulsecore/module.h>
 #include <pulsecore/asyncmsgq.h>
@@ -48,6 +50,14 @@ typedef struct pa_sink_volume_change pa_sink_volume_change;
 
 #define PA_MAX_INPUTS_PER_SINK 256
 
+/* How many deferred hardware volume changes can be pending at a time */
+#define PA_SINK_VOLUME_CHANGES_MAX 32
+
+typedef struct pa_sink_volume_change {
+    pa_usec_t at;
+    pa_cvolume hw_volume;
+} pa_sink_volume_change;
+
 /* Returns true if sink is linked: registered and accessible from client side. */
 static inline bool PA_SINK_IS_LINKED(pa_sink_state_t x) {
     return x == PA_SINK_RUNNING || x == PA_SINK_IDLE || x == PA_SINK_SUSPENDED;
@@ -68,6 +78,10 @@ struct pa_sink {
     pa_sink_flags_t flags;
     pa_suspend_cause_t suspend_cause;
 
+    /* The state message of a batched state change that is not sent
+     * yet, see pa_sink_suspend_many() */
+    pa_asyncmsgq_batch_item *pending_state;
+
     char *name;
     char *driver;                           /* may be NULL */
     pa_proplist *proplist;
@@ -107,12 +121,45 @@ struct pa_sink {
 
     pa_asyncmsgq *asyncmsgq;
 
+    /* The last cycles of the IO thread, NULL if the implementor keeps
+     * no trace. Owned by the implementor. */
+    pa_io_trace *io_trace;
+
     pa_memchunk silence;
 
     pa_hashmap *ports;
     pa_device_port *active_port;
     pa_atomic_t mixer_dirty;
 
+    /* Results of pa_sink_check_formats(), keyed by the requested formats.
+     * Dropped when the formats are changed with pa_sink_set_formats(). */
+    pa_hashmap *check_formats_cache;
+
+    /* Number of render passes in which all inputs were silent, hence
+     * mixing was skipped. Incremented from the IO thread. */
+    pa_atomic_t silent_skipped;
+
+    /* How long rendering takes, in permille of the time the rendered
+     * data plays for, smoothed over the last calls. Updated by the IO
+     * thread in pa_sink_render_full() and pa_sink_render_into_full(). */
+    pa_atomic_t render_load;
+
+    /* Registered with the core's metrics, bumped by the IO thread and
+     * the sink implementation */
+    struct {
+        pa_metric *render_usec;
+        pa_metric *resampler_usec;
+        pa_metric *rewinds;
+        pa_metric *xruns;
+        pa_metric *watermark_increases;
+    } metrics;
+
+    /* Set by policy modules with pa_sink_set_overloaded() while the IO
+     * thread has too little headroom left. New sink inputs are refused
+     * while refuse_inputs is set. */
+    bool overloaded:1;
+    bool refuse_inputs:1;
+
     /* The latency offset is inherited from the currently active port */
     int64_t latency_offset;
 
@@ -125,6 +172,11 @@ struct pa_sink {
      * inhibited */
     int (*set_state)(pa_sink *s, pa_sink_state_t state); /* may be NULL */
 
+    /* Called when the suspend cause changes while the sink stays
+     * suspended, e.g. when the user suspends a sink that was idle
+     * already. Called from main loop context. */
+    void (*suspend_cause_changed)(pa_sink *s, pa_suspend_cause_t old_cause); /* may be NULL */
+
     /* Sink drivers that support hardware volume may set this
      * callback. This is called when the current volume needs to be
      * re-read from the hardware.
@@ -231,7 +283,8 @@ struct pa_sink {
     int (*set_port)(pa_sink *s, pa_device_port *port); /* may be NULL */
 
     /* Called to get the list of formats supported by the sink, sorted
-     * in descending order of preference. */
+     * in descending order of preference. The list may only change
+     * through set_formats(), because negotiation results are cached. */
     pa_idxset* (*get_formats)(pa_sink *s); /* may be NULL */
 
     /* Called to set the list of formats supported by the sink. Can be
@@ -250,6 +303,19 @@ struct pa_sink {
         pa_sink_state_t state;
         pa_hashmap *inputs;
 
+        /* The same inputs as above, without references, in an array the
+         * render and rewind paths walk once per period instead of
+         * chasing the hashmap's entries */
+        pa_dynarray *render_inputs;
+
+        /* The only input is a passthrough one, which is neither mixed,
+         * scaled nor rewound */
+        bool passthrough;
+
+        /* Scratch space for mixing, always large enough for all inputs */
+        struct pa_mix_info *mix_info;
+        unsigned mix_info_size;
+
         pa_rtpoll *rtpoll;
 
         pa_cvolume soft_volume;
@@ -273,6 +339,18 @@ struct pa_sink {
         size_t rewind_nbytes;
         bool rewind_requested;
 
+        /* The last max_rewind bytes that were rendered, so that a rewind
+         * requested by a single input can be served by replacing only
+         * its part of the mix. Data that is readable has been mixed
+         * again by such a rewind and is handed out before the inputs
+         * are asked for more. The history is only good for partial
+         * rewinds from mix_history_valid on. */
+        pa_memblockq *mix_history;
+        int64_t mix_history_valid;
+        /* Scratch queues for the old mix and the old stream data of a
+         * partial rewind */
+        pa_memblockq *rewind_mix, *rewind_input;
+
         /* Both dynamic and fixed latencies will be clamped to this
          * range. */
         pa_usec_t min_latency; /* we won't go below this latency */
@@ -287,10 +365,10 @@ struct pa_sink {
         int64_t latency_offset;
 
         /* Delayed volume change events are queued here. The events
-         * are stored in expiration order. The one expiring next is in
-         * the head of the list. */
-        PA_LLIST_HEAD(pa_sink_volume_change, volume_changes);
-        pa_sink_volume_change *volume_changes_tail;
+         * are stored in expiration order in a ring, the one expiring
+         * next at volume_changes_first. */
+        pa_sink_volume_change volume_changes[PA_SINK_VOLUME_CHANGES_MAX];
+        unsigned volume_changes_first, n_volume_changes;
         /* This value is updated in pa_sink_volume_change_apply() and
          * used only by sinks with PA_SINK_DEFERRED_VOLUME. */
         pa_cvolume current_hw_volume;
@@ -334,6 +412,8 @@ typedef enum pa_sink_message {
     PA_SINK_MESSAGE_SET_PORT,
     PA_SINK_MESSAGE_UPDATE_VOLUME_AND_MUTE,
     PA_SINK_MESSAGE_SET_LATENCY_OFFSET,
+    PA_SINK_MESSAGE_START_MOVE_ALL,
+    PA_SINK_MESSAGE_FINISH_MOVE_ALL,
     PA_SINK_MESSAGE_MAX
 } pa_sink_message_t;
 
@@ -432,6 +512,7 @@ size_t pa_sink_get_max_request(pa_sink *s);
 
 int pa_sink_update_status(pa_sink*s);
 int pa_sink_suspend(pa_sink *s, bool suspend, pa_suspend_cause_t cause);
+int pa_sink_suspend_many(pa_idxset *sinks, bool suspend, pa_suspend_cause_t cause);
 int pa_sink_suspend_all(pa_core *c, bool suspend, pa_suspend_cause_t cause);
 
 /* Use this instead of checking s->flags & PA_SINK_FLAT_VOLUME directly. */
@@ -450,6 +531,11 @@ void pa_sink_enter_passthrough(pa_sink *s);
 void pa_sink_leave_passthrough(pa_sink *s);
 
 void pa_sink_set_volume(pa_sink *sink, const pa_cvolume *volume, bool sendmsg, bool save);
+
+/* Does what pa_sink_set_volume(s, NULL, true, save) does after the volume of
+ * a sink input was changed in flat volume mode. If the change leaves the
+ * volume of the sink as it is, only i is updated. */
+void pa_sink_update_flat_volume(pa_sink *s, pa_sink_input *i, bool save);
 const pa_cvolume *pa_sink_get_volume(pa_sink *sink, bool force_refresh);
 
 void pa_sink_set_mute(pa_sink *sink, bool mute, bool save);
@@ -459,6 +545,9 @@ bool pa_sink_update_proplist(pa_sink *s, pa_update_mode_t mode, pa_proplist *p);
 
 int pa_sink_set_port(pa_sink *s, const char *name, bool save);
 void pa_sink_set_mixer_dirty(pa_sink *s, bool is_dirty);
+unsigned pa_sink_get_silent_skipped(pa_sink *s);
+unsigned pa_sink_get_render_load(pa_sink *s);
+void pa_sink_set_overloaded(pa_sink *s, bool overloaded, bool refuse_inputs);
 
 unsigned pa_sink_linked_by(pa_sink *s); /* Number of connected streams */
 unsigned pa_sink_used_by(pa_sink *s); /* Number of connected streams which are not corked */
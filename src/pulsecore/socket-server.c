@@ -91,29 +91,28 @@ struct pa_socket_server {
     } type;
 };
 
-static void callback(pa_mainloop_api *mainloop, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
-    pa_socket_server *s = userdata;
-    pa_iochannel *io;
-    int nfd;
+/* Queued up connections before the kernel refuses new ones, on Linux
+ * capped by net.core.somaxconn */
+#define DEFAULT_BACKLOG SOMAXCONN
 
-    pa_assert(s);
-    pa_assert(PA_REFCNT_VALUE(s) >= 1);
-    pa_assert(s->mainloop == mainloop);
-    pa_assert(s->io_event == e);
-    pa_assert(e);
-    pa_assert(fd >= 0);
-    pa_assert(fd == s->fd);
+/* Connections accepted per wakeup at most, the IO event fires right
+ * again for the rest */
+#define ACCEPTS_PER_WAKEUP (64)
 
-    pa_socket_server_ref(s);
+/* Returns false when there is nothing more to accept for now */
+static bool accept_one(pa_socket_server *s) {
+    pa_iochannel *io;
+    int nfd;
 
-    if ((nfd = pa_accept_cloexec(fd, NULL, NULL)) < 0) {
-        pa_log("accept(): %s", pa_cstrerror(errno));
-        goto finish;
+    if ((nfd = pa_accept_cloexec(s->fd, NULL, NULL)) < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            pa_log("accept(): %s", pa_cstrerror(errno));
+        return false;
     }
 
     if (!s->on_connection) {
         pa_close(nfd);
-        goto finish;
+        return true;
     }
 
 #ifdef HAVE_LIBWRAP
@@ -126,7 +125,7 @@ static void callback(pa_mainloop_api *mainloop, pa_io_event *e, int fd, pa_io_ev
         if (!hosts_access(&req)) {
             pa_log_warn("TCP connection refused by tcpwrap.");
             pa_close(nfd);
-            goto finish;
+            return true;
         }
 
         pa_log_info("TCP connection accepted by tcpwrap.");
@@ -142,7 +141,30 @@ static void callback(pa_mainloop_api *mainloop, pa_io_event *e, int fd, pa_io_ev
     pa_assert_se(io = pa_iochannel_new(s->mainloop, nfd, nfd));
     s->on_connection(s, io, s->userdata);
 
-finish:
+    return true;
+}
+
+static void callback(pa_mainloop_api *mainloop, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    pa_socket_server *s = userdata;
+    unsigned n;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(s->mainloop == mainloop);
+    pa_assert(s->io_event == e);
+    pa_assert(e);
+    pa_assert(fd >= 0);
+    pa_assert(fd == s->fd);
+
+    pa_socket_server_ref(s);
+
+    /* When many clients connect at once, take them all in one go. Stop
+     * if the server was dropped from a connection callback, in which
+     * case ours is the last reference. */
+    for (n = 0; n < ACCEPTS_PER_WAKEUP && PA_REFCNT_VALUE(s) > 1; n++)
+        if (!accept_one(s))
+            break;
+
     pa_socket_server_unref(s);
 }
 
@@ -157,6 +179,9 @@ static pa_socket_server* socket_server_new(pa_mainloop_api *m, int fd) {
     s->fd = fd;
     s->mainloop = m;
 
+    /* We accept until there is nothing left */
+    pa_make_fd_nonblock(fd);
+
     pa_assert_se(s->io_event = m->io_new(m, fd, PA_IO_EVENT_INPUT, callback, s));
 
     return s;
@@ -220,7 +245,7 @@ pa_socket_server* pa_socket_server_new_unix(pa_mainloop_api *m, const char *file
         * inodes. */
         chmod(filename, 0777);
 
-        if (listen(fd, 5) < 0) {
+        if (listen(fd, DEFAULT_BACKLOG) < 0) {
             pa_log("listen(): %s", pa_cstrerror(errno));
             goto fail;
         }
@@ -308,7 +333,7 @@ pa_socket_server* pa_socket_server_new_ipv4(pa_mainloop_api *m, uint32_t address
             }
         }
 
-        if (listen(fd, 5) < 0) {
+        if (listen(fd, DEFAULT_BACKLOG) < 0) {
             pa_log("listen(): %s", pa_cstrerror(errno));
             goto fail;
         }
@@ -396,7 +421,7 @@ pa_socket_server* pa_socket_server_new_ipv6(pa_mainloop_api *m, const uint8_t ad
             }
         }
 
-        if (listen(fd, 5) < 0) {
+        if (listen(fd, DEFAULT_BACKLOG) < 0) {
             pa_log("listen(): %s", pa_cstrerror(errno));
             goto fail;
         }
@@ -509,6 +534,20 @@ void pa_socket_server_set_callback(pa_socket_server*s, pa_socket_server_on_conne
     s->userdata = userdata;
 }
 
+int pa_socket_server_set_backlog(pa_socket_server *s, int backlog) {
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(backlog > 0);
+
+    /* Listening again on a listening socket just updates the backlog */
+    if (listen(s->fd, backlog) < 0) {
+        pa_log("listen(): %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
 char *pa_socket_server_get_address(pa_socket_server *s, char *c, size_t l) {
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
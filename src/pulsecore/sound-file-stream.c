@@ -29,12 +29,16 @@
 
 #include <sndfile.h>
 
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
 
+#include <pulsecore/atomic.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/sink-input.h>
 #include <pulsecore/log.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/mix.h>
@@ -44,13 +48,34 @@
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* How much the reader thread reads ahead, twice the latency of the sink
+ * within these bounds */
+#define PREFETCH_MIN_USEC (100*PA_USEC_PER_MSEC)
+#define PREFETCH_MAX_USEC (2*PA_USEC_PER_SEC)
+
 typedef struct file_stream {
     pa_msgobject parent;
     pa_core *core;
     pa_sink_input *sink_input;
 
+    /* Only the reader thread touches the file while it runs */
     SNDFILE *sndfile;
     sf_count_t (*readf_function)(SNDFILE *sndfile, void *ptr, sf_count_t frames);
+    size_t frame_size;
+
+    /* The prefetch ring. The reader thread fills the slots at
+     * prefetch_write, the IO thread takes them at prefetch_read, and
+     * prefetch_fill hands them over. The reader sleeps on
+     * reader_semaphore while the ring is full. */
+    pa_thread *reader;
+    pa_semaphore *reader_semaphore;
+    pa_memchunk *prefetch;
+    unsigned n_prefetch;
+    size_t prefetch_block_size;
+    unsigned prefetch_read, prefetch_write;
+    pa_atomic_t prefetch_fill;
+    pa_atomic_t eof;
+    pa_atomic_t quit;
 
     /* We need this memblockq here to easily fulfill rewind requests
      * (even beyond the file start!) */
@@ -82,8 +107,27 @@ static void file_stream_unlink(file_stream *u) {
 /* Called from main context */
 static void file_stream_free(pa_object *o) {
     file_stream *u = FILE_STREAM(o);
+    unsigned j;
+
     pa_assert(u);
 
+    if (u->reader) {
+        pa_atomic_store(&u->quit, 1);
+        pa_semaphore_post(u->reader_semaphore);
+        pa_thread_free(u->reader);
+    }
+
+    if (u->reader_semaphore)
+        pa_semaphore_free(u->reader_semaphore);
+
+    if (u->prefetch) {
+        for (j = 0; j < u->n_prefetch; j++)
+            if (u->prefetch[j].memblock)
+                pa_memblock_unref(u->prefetch[j].memblock);
+
+        pa_xfree(u->prefetch);
+    }
+
     if (u->memblockq)
         pa_memblockq_free(u->memblockq);
 
@@ -107,6 +151,63 @@ static int file_stream_process_msg(pa_msgobject *o, int code, void*userdata, int
     return 0;
 }
 
+/* Called from the reader thread, and from main context before it is
+ * started. Reads the next block into the ring, false at the end of the
+ * file. */
+static bool read_block(file_stream *u) {
+    pa_memchunk *chunk;
+    size_t fs;
+    void *p;
+    sf_count_t n;
+
+    chunk = &u->prefetch[u->prefetch_write];
+    chunk->memblock = pa_memblock_new(u->core->mempool, u->prefetch_block_size);
+    chunk->index = 0;
+
+    p = pa_memblock_acquire(chunk->memblock);
+
+    if (u->readf_function) {
+        fs = u->frame_size;
+        n = u->readf_function(u->sndfile, p, (sf_count_t) (u->prefetch_block_size/fs));
+    } else {
+        fs = 1;
+        n = sf_read_raw(u->sndfile, p, (sf_count_t) u->prefetch_block_size);
+    }
+
+    pa_memblock_release(chunk->memblock);
+
+    if (n <= 0) {
+        pa_memblock_unref(chunk->memblock);
+        pa_memchunk_reset(chunk);
+        return false;
+    }
+
+    chunk->length = (size_t) n * fs;
+
+    u->prefetch_write = (u->prefetch_write + 1) % u->n_prefetch;
+    pa_atomic_inc(&u->prefetch_fill);
+
+    return true;
+}
+
+/* Called from the reader thread */
+static void reader_thread_func(void *userdata) {
+    file_stream *u = userdata;
+
+    pa_assert(u);
+
+    for (;;) {
+        while (!pa_atomic_load(&u->quit) && (unsigned) pa_atomic_load(&u->prefetch_fill) >= u->n_prefetch)
+            pa_semaphore_wait(u->reader_semaphore);
+
+        if (pa_atomic_load(&u->quit) || !read_block(u))
+            break;
+    }
+
+    /* Only after the last block was handed over */
+    pa_atomic_store(&u->eof, 1);
+}
+
 /* Called from main context */
 static void sink_input_kill_cb(pa_sink_input *i) {
     file_stream *u;
@@ -146,10 +247,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
         return -1;
 
     for (;;) {
-        pa_memchunk tchunk;
-        size_t fs;
-        void *p;
-        sf_count_t n;
+        pa_memchunk *tchunk;
+        bool eof;
 
         if (pa_memblockq_peek(u->memblockq, chunk) >= 0) {
             chunk->length = PA_MIN(chunk->length, length);
@@ -157,36 +256,26 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
             return 0;
         }
 
-        if (!u->sndfile)
-            break;
+        /* Check for the end before looking into the ring, so that we
+         * don't miss the last block */
+        eof = pa_atomic_load(&u->eof);
 
-        tchunk.memblock = pa_memblock_new(i->sink->core->mempool, length);
-        tchunk.index = 0;
+        if (pa_atomic_load(&u->prefetch_fill) <= 0) {
+            if (eof)
+                break;
 
-        p = pa_memblock_acquire(tchunk.memblock);
-
-        if (u->readf_function) {
-            fs = pa_frame_size(&i->sample_spec);
-            n = u->readf_function(u->sndfile, p, (sf_count_t) (length/fs));
-        } else {
-            fs = 1;
-            n = sf_read_raw(u->sndfile, p, (sf_count_t) length);
+            /* The disk is slower than we are, underrun */
+            return -1;
         }
 
-        pa_memblock_release(tchunk.memblock);
-
-        if (n <= 0) {
-            pa_memblock_unref(tchunk.memblock);
-
-            sf_close(u->sndfile);
-            u->sndfile = NULL;
-            break;
-        }
+        tchunk = &u->prefetch[u->prefetch_read];
+        pa_memblockq_push(u->memblockq, tchunk);
+        pa_memblock_unref(tchunk->memblock);
+        pa_memchunk_reset(tchunk);
 
-        tchunk.length = (size_t) n * fs;
-
-        pa_memblockq_push(u->memblockq, &tchunk);
-        pa_memblock_unref(tchunk.memblock);
+        u->prefetch_read = (u->prefetch_read + 1) % u->n_prefetch;
+        pa_atomic_dec(&u->prefetch_fill);
+        pa_semaphore_post(u->reader_semaphore);
     }
 
     if (pa_sink_input_safe_to_remove(i)) {
@@ -237,6 +326,7 @@ int pa_play_file(
     int fd;
     SF_INFO sfi;
     pa_memchunk silence;
+    pa_usec_t latency;
 
     pa_assert(sink);
     pa_assert(fname);
@@ -248,6 +338,14 @@ int pa_play_file(
     u->sink_input = NULL;
     u->sndfile = NULL;
     u->readf_function = NULL;
+    u->reader = NULL;
+    u->reader_semaphore = NULL;
+    u->prefetch = NULL;
+    u->n_prefetch = 0;
+    u->prefetch_read = u->prefetch_write = 0;
+    pa_atomic_store(&u->prefetch_fill, 0);
+    pa_atomic_store(&u->eof, 0);
+    pa_atomic_store(&u->quit, 0);
     u->memblockq = NULL;
 
     if ((fd = pa_open_cloexec(fname, O_RDONLY, 0)) < 0) {
@@ -255,10 +353,8 @@ int pa_play_file(
         goto fail;
     }
 
-    /* FIXME: For now we just use posix_fadvise to avoid page faults
-     * when accessing the file data. Eventually we should move the
-     * file reader into the main event loop and pass the data over the
-     * asyncmsgq. */
+    /* The reader thread reads sequentially, let the kernel read ahead
+     * for it */
 
 #ifdef HAVE_POSIX_FADVISE
     if (posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL) < 0) {
@@ -294,6 +390,17 @@ int pa_play_file(
     }
 
     u->readf_function = pa_sndfile_readf_function(&ss);
+    u->frame_size = pa_frame_size(&ss);
+
+    if ((latency = pa_sink_get_requested_latency(sink)) == (pa_usec_t) -1)
+        pa_sink_get_latency_range(sink, NULL, &latency);
+
+    latency = PA_CLAMP(2 * latency, PREFETCH_MIN_USEC, PREFETCH_MAX_USEC);
+
+    u->prefetch_block_size = pa_frame_align(pa_mempool_block_size_max(u->core->mempool), &ss);
+    u->n_prefetch = (unsigned) PA_MAX(pa_usec_to_bytes(latency, &ss) / u->prefetch_block_size, 2U);
+    u->prefetch = pa_xnew0(pa_memchunk, u->n_prefetch);
+    u->reader_semaphore = pa_semaphore_new(0);
 
     pa_sink_input_new_data_init(&data);
     pa_sink_input_new_data_set_sink(&data, sink, false);
@@ -311,6 +418,23 @@ int pa_play_file(
     if (!u->sink_input)
         goto fail;
 
+    /* Like when loading a sample we read the start of the file right
+     * away, the sink would play silence until the reader thread caught
+     * up otherwise. From here on the file belongs to that thread. */
+    while ((unsigned) pa_atomic_load(&u->prefetch_fill) < u->n_prefetch)
+        if (!read_block(u)) {
+            pa_atomic_store(&u->eof, 1);
+            break;
+        }
+
+    if (!pa_atomic_load(&u->eof) && !(u->reader = pa_thread_new("sound-file", reader_thread_func, u))) {
+        pa_log("Failed to create reader thread.");
+        pa_sink_input_unlink(u->sink_input);
+        pa_sink_input_unref(u->sink_input);
+        u->sink_input = NULL;
+        goto fail;
+    }
+
     u->sink_input->pop = sink_input_pop_cb;
     u->sink_input->process_rewind = sink_input_process_rewind_cb;
     u->sink_input->update_max_rewind = sink_input_update_max_rewind_cb;
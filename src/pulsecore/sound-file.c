@@ -24,19 +24,138 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <sndfile.h>
 
 #include <pulse/sample.h>
+#include <pulse/xmalloc.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-scache.h>
+#include <pulsecore/memtrap.h>
 #include <pulsecore/sndfile-util.h>
 
 #include "sound-file.h"
 
+#ifdef HAVE_SYS_MMAN_H
+
+/* A WAV file whose samples we use right from the page cache */
+typedef struct mapped_file {
+    void *start;
+    size_t size;
+    pa_memtrap *memtrap;
+} mapped_file;
+
+static void mapped_file_free(void *userdata) {
+    mapped_file *m = userdata;
+
+    pa_memtrap_remove(m->memtrap);
+    munmap(m->start, m->size);
+    pa_xfree(m);
+}
+
+/* The format of the samples in a WAV file as they are on disk */
+static pa_sample_format_t wav_sample_format(int format) {
+
+    if ((format & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAV &&
+        (format & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAVEX)
+        return PA_SAMPLE_INVALID;
+
+    if ((format & SF_FORMAT_ENDMASK) != SF_ENDIAN_FILE &&
+        (format & SF_FORMAT_ENDMASK) != SF_ENDIAN_LITTLE)
+        return PA_SAMPLE_INVALID;
+
+    switch (format & SF_FORMAT_SUBMASK) {
+        case SF_FORMAT_PCM_16:
+            return PA_SAMPLE_S16LE;
+        case SF_FORMAT_PCM_24:
+            return PA_SAMPLE_S24LE;
+        case SF_FORMAT_PCM_32:
+            return PA_SAMPLE_S32LE;
+        case SF_FORMAT_FLOAT:
+            return PA_SAMPLE_FLOAT32LE;
+        case SF_FORMAT_ULAW:
+            return PA_SAMPLE_ULAW;
+        case SF_FORMAT_ALAW:
+            return PA_SAMPLE_ALAW;
+        default:
+            return PA_SAMPLE_INVALID;
+    }
+}
+
+/* Finds the samples of a RIFF WAVE file, libsndfile doesn't tell */
+static int wav_find_data(int fd, off_t *offset, size_t *length) {
+    uint8_t h[12];
+    off_t o = 12;
+
+    if (pread(fd, h, 12, 0) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4))
+        return -1;
+
+    while (pread(fd, h, 8, o) == 8) {
+        uint32_t l = (uint32_t) h[4] | (uint32_t) h[5] << 8 | (uint32_t) h[6] << 16 | (uint32_t) h[7] << 24;
+
+        if (!memcmp(h, "data", 4)) {
+            *offset = o + 8;
+            *length = l;
+            return 0;
+        }
+
+        /* Chunks are padded to an even size */
+        o += 8 + (off_t) l + (l & 1);
+    }
+
+    return -1;
+}
+
+/* Maps length bytes of samples of a WAV file in, instead of decoding
+ * them into pool memory */
+static int map_wav(pa_mempool *pool, int fd, const char *fname, size_t length, pa_memchunk *chunk) {
+    mapped_file *m;
+    off_t data_offset, map_offset;
+    size_t data_length;
+    struct stat st;
+
+    if (wav_find_data(fd, &data_offset, &data_length) < 0 || data_length < length)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || data_offset + (off_t) length > st.st_size)
+        return -1;
+
+    map_offset = data_offset & ~((off_t) PA_PAGE_SIZE - 1);
+
+    m = pa_xnew(mapped_file, 1);
+    m->size = (size_t) (data_offset - map_offset) + length;
+
+    /* Private and writable, so that whoever alters the samples gets a
+     * copy of the page instead of a crash */
+    if ((m->start = mmap(NULL, m->size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, map_offset)) == MAP_FAILED) {
+        pa_log_debug("mmap() of %s failed: %s", fname, pa_cstrerror(errno));
+        pa_xfree(m);
+        return -1;
+    }
+
+    /* Should the file be truncated beneath us we get zeros instead of
+     * SIGBUS */
+    m->memtrap = pa_memtrap_add(m->start, m->size);
+
+    chunk->memblock = pa_memblock_new_user(pool, (uint8_t*) m->start + (data_offset - map_offset), length, mapped_file_free, m, false);
+    chunk->index = 0;
+    chunk->length = length;
+
+    pa_log_debug("Mapped the samples of %s into memory.", fname);
+    return 0;
+}
+
+#endif
+
 int pa_sound_file_load(
         pa_mempool *pool,
         const char *fname,
@@ -72,14 +191,13 @@ int pa_sound_file_load(
         pa_log_debug("POSIX_FADV_SEQUENTIAL succeeded.");
 #endif
 
+    /* We keep the file descriptor for mapping the file in */
     pa_zero(sfi);
-    if (!(sf = sf_open_fd(fd, SFM_READ, &sfi, 1))) {
+    if (!(sf = sf_open_fd(fd, SFM_READ, &sfi, 0))) {
         pa_log("Failed to open file %s", fname);
         goto finish;
     }
 
-    fd = -1;
-
     if (pa_sndfile_read_sample_spec(sf, ss) < 0) {
         pa_log("Failed to determine file sample format.");
         goto finish;
@@ -99,6 +217,15 @@ int pa_sound_file_load(
         goto finish;
     }
 
+#ifdef HAVE_SYS_MMAN_H
+    /* WAV files with samples we can play as they are are used without
+     * decoding, so that they load right away and share the page cache */
+    if (l > 0 && wav_sample_format(sfi.format) == ss->format && map_wav(pool, fd, fname, l, chunk) == 0) {
+        ret = 0;
+        goto finish;
+    }
+#endif
+
     chunk->memblock = pa_memblock_new(pool, l);
     chunk->index = 0;
     chunk->length = l;
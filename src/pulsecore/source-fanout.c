@@ -0,0 +1,346 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/source-output.h>
+#include <pulsecore/thread-mq.h>
+
+#include "source-fanout.h"
+
+typedef struct fanout {
+    pa_msgobject parent;
+
+    pa_core *core;
+    char *key;
+
+    /* NULL once the last reader is gone */
+    pa_source_output *source_output;
+    pa_idxset *readers;
+} fanout;
+
+PA_DEFINE_PRIVATE_CLASS(fanout, pa_msgobject);
+#define FANOUT(o) (fanout_cast(o))
+
+struct pa_source_fanout_reader {
+    fanout *fanout;
+    pa_memblockq *memblockq;
+
+    pa_source_fanout_reader_cb_t data_cb, kill_cb;
+    void *userdata;
+};
+
+enum {
+    FANOUT_MESSAGE_POST_DATA /* data from the source output to the main loop */
+};
+
+static void fanout_free(pa_object *o) {
+    fanout *f = FANOUT(o);
+
+    pa_assert(f);
+    pa_assert(!f->source_output);
+
+    pa_idxset_free(f->readers, NULL);
+    pa_xfree(f->key);
+    pa_xfree(f);
+}
+
+static void fanout_unlink(fanout *f) {
+    pa_hashmap *h;
+
+    pa_assert(f);
+    pa_assert(pa_idxset_isempty(f->readers));
+
+    pa_assert_se(h = pa_shared_get(f->core, "source-fanouts"));
+    pa_assert_se(pa_hashmap_remove(h, f->key) == f);
+
+    if (pa_hashmap_isempty(h)) {
+        pa_assert_se(pa_shared_remove(f->core, "source-fanouts") >= 0);
+        pa_hashmap_free(h);
+    }
+
+    if (f->source_output) {
+        pa_source_output_unlink(f->source_output);
+        f->source_output->userdata = NULL;
+        pa_source_output_unref(f->source_output);
+        f->source_output = NULL;
+    }
+
+    fanout_unref(f);
+}
+
+/* Whole frames only, so that the stream stays aligned */
+static void reader_push(pa_source_fanout_reader *r, const pa_memchunk *chunk) {
+    size_t length, maxlength;
+
+    length = pa_memblockq_get_length(r->memblockq);
+    maxlength = pa_memblockq_get_maxlength(r->memblockq);
+
+    if (length + chunk->length > maxlength) {
+        size_t fs, n;
+
+        fs = pa_frame_size(&r->fanout->source_output->sample_spec);
+        n = ((length + chunk->length - maxlength + fs - 1) / fs) * fs;
+        if (n > length)
+            n = length - length % fs;
+
+        if (pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Reader of source output %u too slow, dropping %lu bytes.",
+                         r->fanout->source_output->index, (unsigned long) n);
+
+        pa_memblockq_drop(r->memblockq, n);
+    }
+
+    pa_memblockq_push_align(r->memblockq, chunk);
+}
+
+/* Called from main context, as opposed to source output messages */
+static int fanout_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    fanout *f = FANOUT(o);
+    pa_source_fanout_reader *r;
+    uint32_t idx;
+
+    fanout_assert_ref(f);
+
+    if (!f->source_output)
+        return -1;
+
+    switch (code) {
+
+        case FANOUT_MESSAGE_POST_DATA:
+
+            /* Readers may go away from their callback, taking the
+             * source output with them when they are the last */
+            fanout_ref(f);
+
+            for (r = pa_idxset_first(f->readers, &idx); r && f->source_output; r = pa_idxset_next(f->readers, &idx)) {
+                reader_push(r, chunk);
+                r->data_cb(r, r->userdata);
+            }
+
+            fanout_unref(f);
+            break;
+    }
+
+    return 0;
+}
+
+/* Called from thread context */
+static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
+    fanout *f;
+
+    pa_source_output_assert_ref(o);
+    pa_assert_se(f = o->userdata);
+    pa_assert(chunk);
+
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(f), FANOUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
+}
+
+/* Called from main context */
+static void source_output_kill_cb(pa_source_output *o) {
+    fanout *f;
+    pa_source_fanout_reader *r;
+    uint32_t idx;
+
+    pa_source_output_assert_ref(o);
+    pa_assert_se(f = o->userdata);
+
+    fanout_ref(f);
+
+    for (r = pa_idxset_first(f->readers, &idx); r; r = pa_idxset_next(f->readers, &idx))
+        r->kill_cb(r, r->userdata);
+
+    pa_assert(!f->source_output);
+    fanout_unref(f);
+}
+
+/* Called from main context. What the reader furthest behind still has
+ * to get. */
+static pa_usec_t source_output_get_latency_cb(pa_source_output *o) {
+    fanout *f;
+    pa_source_fanout_reader *r;
+    size_t length = 0;
+    uint32_t idx;
+
+    pa_source_output_assert_ref(o);
+    pa_assert_se(f = o->userdata);
+
+    PA_IDXSET_FOREACH(r, f->readers, idx)
+        length = PA_MAX(length, pa_memblockq_get_length(r->memblockq));
+
+    return pa_bytes_to_usec(length, &o->sample_spec);
+}
+
+static fanout *fanout_get(
+        pa_core *c,
+        pa_module *m,
+        pa_source *source,
+        const pa_sample_spec *ss,
+        const pa_channel_map *cm,
+        const char *name,
+        pa_usec_t latency) {
+
+    pa_source_output_new_data data;
+    char cm_str[PA_CHANNEL_MAP_SNPRINT_MAX];
+    pa_hashmap *h;
+    fanout *f;
+    char *key;
+
+    key = pa_sprintf_malloc("%u:%u:%s:%u:%u:%s",
+                            m ? m->index : PA_INVALID_INDEX, source->index,
+                            pa_sample_format_to_string(ss->format), ss->rate, ss->channels,
+                            cm ? pa_channel_map_snprint(cm_str, sizeof(cm_str), cm) : "");
+
+    if (!(h = pa_shared_get(c, "source-fanouts"))) {
+        h = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+        pa_assert_se(pa_shared_set(c, "source-fanouts", h) >= 0);
+    }
+
+    if ((f = pa_hashmap_get(h, key))) {
+        pa_xfree(key);
+        return f;
+    }
+
+    f = pa_msgobject_new(fanout);
+    f->parent.parent.free = fanout_free;
+    f->parent.process_msg = fanout_process_msg;
+    f->core = c;
+    f->key = key;
+    f->readers = pa_idxset_new(NULL, NULL);
+    pa_assert_se(pa_hashmap_put(h, f->key, f) >= 0);
+
+    pa_source_output_new_data_init(&data);
+    data.driver = __FILE__;
+    data.module = m;
+    pa_source_output_new_data_set_source(&data, source, false);
+    pa_proplist_sets(data.proplist, PA_PROP_MEDIA_NAME, name);
+    pa_source_output_new_data_set_sample_spec(&data, ss);
+    if (cm)
+        pa_source_output_new_data_set_channel_map(&data, cm);
+
+    pa_source_output_new(&f->source_output, c, &data);
+    pa_source_output_new_data_done(&data);
+
+    if (!f->source_output) {
+        fanout_unlink(f);
+        return NULL;
+    }
+
+    f->source_output->push = source_output_push_cb;
+    f->source_output->kill = source_output_kill_cb;
+    f->source_output->get_latency = source_output_get_latency_cb;
+    f->source_output->userdata = f;
+
+    pa_source_output_set_requested_latency(f->source_output, latency);
+
+    pa_source_output_put(f->source_output);
+
+    return f;
+}
+
+pa_source_fanout_reader *pa_source_fanout_reader_new(
+        pa_core *c,
+        pa_module *m,
+        pa_source *source,
+        const pa_sample_spec *ss,
+        const pa_channel_map *cm,
+        const char *name,
+        pa_usec_t latency,
+        pa_usec_t max_queue,
+        pa_source_fanout_reader_cb_t data_cb,
+        pa_source_fanout_reader_cb_t kill_cb,
+        void *userdata) {
+
+    pa_source_fanout_reader *r;
+    fanout *f;
+    const pa_sample_spec *oss;
+
+    pa_assert(c);
+    pa_assert(source);
+    pa_assert(ss);
+    pa_assert(name);
+    pa_assert(data_cb);
+    pa_assert(kill_cb);
+
+    if (!(f = fanout_get(c, m, source, ss, cm, name, latency)))
+        return NULL;
+
+    oss = &f->source_output->sample_spec;
+
+    r = pa_xnew0(pa_source_fanout_reader, 1);
+    r->fanout = f;
+    r->data_cb = data_cb;
+    r->kill_cb = kill_cb;
+    r->userdata = userdata;
+    r->memblockq = pa_memblockq_new(
+            "source fanout reader memblockq",
+            0,
+            pa_usec_to_bytes(max_queue, oss),
+            0,
+            oss,
+            1,
+            0,
+            0,
+            NULL);
+
+    pa_idxset_put(f->readers, r, NULL);
+
+    return r;
+}
+
+void pa_source_fanout_reader_free(pa_source_fanout_reader *r) {
+    pa_assert(r);
+
+    pa_assert_se(pa_idxset_remove_by_data(r->fanout->readers, r, NULL) == r);
+
+    if (pa_idxset_isempty(r->fanout->readers))
+        fanout_unlink(r->fanout);
+
+    pa_memblockq_free(r->memblockq);
+    pa_xfree(r);
+}
+
+pa_memblockq *pa_source_fanout_reader_get_memblockq(pa_source_fanout_reader *r) {
+    pa_assert(r);
+
+    return r->memblockq;
+}
+
+const pa_sample_spec *pa_source_fanout_reader_get_sample_spec(pa_source_fanout_reader *r) {
+    pa_assert(r);
+    pa_assert(r->fanout->source_output);
+
+    return &r->fanout->source_output->sample_spec;
+}
+
+const pa_channel_map *pa_source_fanout_reader_get_channel_map(pa_source_fanout_reader *r) {
+    pa_assert(r);
+    pa_assert(r->fanout->source_output);
+
+    return &r->fanout->source_output->channel_map;
+}
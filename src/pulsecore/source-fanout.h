@@ -0,0 +1,70 @@
+#ifndef foopulsesourcefanouthfoo
+#define foopulsesourcefanouthfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+#include <pulse/channelmap.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/module.h>
+#include <pulsecore/source.h>
+
+/* Recording for network protocols that serve many connections from the
+ * same source. All readers of a module that record the same source in
+ * the same format share a single source output. Its data is captured
+ * and converted once and handed to every reader as references to the
+ * same memblocks, in a queue of the reader's own. A reader that doesn't
+ * keep up loses its oldest data, so that it stays close to real time
+ * without holding up the others. Everything here is called from the
+ * main thread. */
+
+typedef struct pa_source_fanout_reader pa_source_fanout_reader;
+
+typedef void (*pa_source_fanout_reader_cb_t)(pa_source_fanout_reader *r, void *userdata);
+
+/* Returns a new reader of source in the format ss and cm, which may be
+ * NULL for the default map. name and latency are only used when the
+ * source output is created, for the first reader. The reader queues up
+ * at most max_queue worth of data. data_cb is called whenever new data
+ * was queued up. kill_cb is called when the source output goes away,
+ * it must free the reader. */
+pa_source_fanout_reader *pa_source_fanout_reader_new(
+        pa_core *c,
+        pa_module *m,
+        pa_source *source,
+        const pa_sample_spec *ss,
+        const pa_channel_map *cm,
+        const char *name,
+        pa_usec_t latency,
+        pa_usec_t max_queue,
+        pa_source_fanout_reader_cb_t data_cb,
+        pa_source_fanout_reader_cb_t kill_cb,
+        void *userdata);
+
+void pa_source_fanout_reader_free(pa_source_fanout_reader *r);
+
+/* The queue to peek and drop the data from */
+pa_memblockq *pa_source_fanout_reader_get_memblockq(pa_source_fanout_reader *r);
+
+/* The format the source output was actually created with */
+const pa_sample_spec *pa_source_fanout_reader_get_sample_spec(pa_source_fanout_reader *r);
+const pa_channel_map *pa_source_fanout_reader_get_channel_map(pa_source_fanout_reader *r);
+
+#endif
@@ -711,8 +711,8 @@ pa_usec_t pa_source_output_get_latency(pa_source_output *o, pa_usec_t *source_la
 
 /* Called from thread context */
 void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
-    bool need_volume_factor_source;
-    bool volume_is_norm;
+    pa_cvolume pre, post;
+    bool pre_is_norm, post_is_norm;
     size_t length;
     size_t limit, mbs = 0;
 
@@ -734,8 +734,25 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
     limit = o->process_rewind ? 0 : o->source->thread_info.max_rewind;
 
-    volume_is_norm = pa_cvolume_is_norm(&o->thread_info.soft_volume) && !o->thread_info.muted;
-    need_volume_factor_source = !pa_cvolume_is_norm(&o->volume_factor_source);
+    /* Work out which volume is applied before and which after the
+     * resampler. Outputs that end up with the same volumes and the same
+     * conversion get the same data. */
+    if (o->thread_info.muted)
+        pa_cvolume_mute(&pre, o->source->sample_spec.channels);
+    else if (!o->thread_info.resampler && !pa_cvolume_is_norm(&o->volume_factor_source))
+        /* If we don't need a resampler we can merge the post and the pre
+         * volume adjustment into one */
+        pa_sw_cvolume_multiply(&pre, &o->thread_info.soft_volume, &o->volume_factor_source);
+    else
+        pre = o->thread_info.soft_volume;
+
+    if (o->thread_info.muted || !o->thread_info.resampler)
+        pa_cvolume_reset(&post, o->thread_info.sample_spec.channels);
+    else
+        post = o->volume_factor_source;
+
+    pre_is_norm = pa_cvolume_is_norm(&pre);
+    post_is_norm = pa_cvolume_is_norm(&post);
 
     if (limit > 0 && o->source->monitor_of) {
         pa_usec_t latency;
@@ -758,8 +775,7 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
     /* Implement the delay queue */
     while ((length = pa_memblockq_get_length(o->thread_info.delay_memblockq)) > limit) {
-        pa_memchunk qchunk;
-        bool nvfs = need_volume_factor_source;
+        pa_memchunk qchunk, rchunk;
 
         length -= limit;
 
@@ -770,59 +786,67 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
         pa_assert(qchunk.length > 0);
 
-        /* It might be necessary to adjust the volume here */
-        if (!volume_is_norm) {
-            pa_memchunk_make_writable(&qchunk, 0);
+        if (o->thread_info.resampler) {
+            if (mbs == 0)
+                mbs = pa_resampler_max_block_size(o->thread_info.resampler);
 
-            if (o->thread_info.muted) {
-                pa_silence_memchunk(&qchunk, &o->source->sample_spec);
-                nvfs = false;
+            if (qchunk.length > mbs)
+                qchunk.length = mbs;
+        }
 
-            } else if (!o->thread_info.resampler && nvfs) {
-                pa_cvolume v;
+        if (!o->thread_info.resampler && pre_is_norm) {
+            /* Nothing to do, pass the data on as it is */
+            rchunk = qchunk;
+            pa_memblock_ref(rchunk.memblock);
 
-                /* If we don't need a resampler we can merge the
-                 * post and the pre volume adjustment into one */
+        } else if (pa_source_get_processed(o->source, o->thread_info.resampler, &pre, &post, &qchunk, &rchunk)) {
+            /* Another output already did the same to this data. Our own
+             * resampler then misses that part of the stream and has to
+             * start over when we use it again. */
+            if (o->thread_info.resampler)
+                o->thread_info.resampler_behind = true;
 
-                pa_sw_cvolume_multiply(&v, &o->thread_info.soft_volume, &o->volume_factor_source);
-                pa_volume_memchunk(&qchunk, &o->source->sample_spec, &v);
-                nvfs = false;
+        } else {
+            pa_memchunk vchunk = qchunk;
 
-            } else
-                pa_volume_memchunk(&qchunk, &o->source->sample_spec, &o->thread_info.soft_volume);
-        }
+            pa_memblock_ref(vchunk.memblock);
 
-        if (!o->thread_info.resampler) {
-            if (nvfs) {
-                pa_memchunk_make_writable(&qchunk, 0);
-                pa_volume_memchunk(&qchunk, &o->thread_info.sample_spec, &o->volume_factor_source);
-            }
+            /* It might be necessary to adjust the volume here */
+            if (!pre_is_norm) {
+                pa_memchunk_make_writable(&vchunk, 0);
 
-            o->push(o, &qchunk);
-        } else {
-            pa_memchunk rchunk;
-
-            if (mbs == 0)
-                mbs = pa_resampler_max_block_size(o->thread_info.resampler);
+                if (o->thread_info.muted)
+                    pa_silence_memchunk(&vchunk, &o->source->sample_spec);
+                else
+                    pa_volume_memchunk(&vchunk, &o->source->sample_spec, &pre);
+            }
 
-            if (qchunk.length > mbs)
-                qchunk.length = mbs;
+            if (!o->thread_info.resampler)
+                rchunk = vchunk;
+            else {
+                if (o->thread_info.resampler_behind) {
+                    pa_resampler_reset(o->thread_info.resampler);
+                    o->thread_info.resampler_behind = false;
+                }
 
-            pa_resampler_run(o->thread_info.resampler, &qchunk, &rchunk);
+                pa_resampler_run(o->thread_info.resampler, &vchunk, &rchunk);
+                pa_memblock_unref(vchunk.memblock);
 
-            if (rchunk.length > 0) {
-                if (nvfs) {
+                if (rchunk.length > 0 && !post_is_norm) {
                     pa_memchunk_make_writable(&rchunk, 0);
-                    pa_volume_memchunk(&rchunk, &o->thread_info.sample_spec, &o->volume_factor_source);
+                    pa_volume_memchunk(&rchunk, &o->thread_info.sample_spec, &post);
                 }
-
-                o->push(o, &rchunk);
             }
 
-            if (rchunk.memblock)
-                pa_memblock_unref(rchunk.memblock);
+            pa_source_put_processed(o->source, o->thread_info.resampler, &pre, &post, &qchunk, &rchunk);
         }
 
+        if (rchunk.length > 0)
+            o->push(o, &rchunk);
+
+        if (rchunk.memblock)
+            pa_memblock_unref(rchunk.memblock);
+
         pa_memblock_unref(qchunk.memblock);
         pa_memblockq_drop(o->thread_info.delay_memblockq, qchunk.length);
     }
@@ -1647,6 +1671,7 @@ int pa_source_output_update_rate(pa_source_output *o) {
         pa_resampler_free(o->thread_info.resampler);
 
     o->thread_info.resampler = new_resampler;
+    o->thread_info.resampler_behind = false;
 
     pa_memblockq_free(o->thread_info.delay_memblockq);
 
@@ -1685,9 +1710,10 @@ void pa_source_output_set_volume_direct(pa_source_output *o, const pa_cvolume *v
         return;
 
     o->volume = *volume;
-    pa_log_debug("The volume of source output %u changed from %s to %s.", o->index,
-                 pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &o->channel_map, true),
-                 pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &o->channel_map, true));
+    if (pa_log_level_enabled(PA_LOG_DEBUG))
+        pa_log_debug("The volume of source output %u changed from %s to %s.", o->index,
+                     pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &o->channel_map, true),
+                     pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &o->channel_map, true));
 
     if (o->volume_changed)
         o->volume_changed(o);
@@ -1715,7 +1741,8 @@ void pa_source_output_set_reference_ratio(pa_source_output *o, const pa_cvolume
     if (!PA_SOURCE_OUTPUT_IS_LINKED(o->state))
         return;
 
-    pa_log_debug("Source output %u reference ratio changed from %s to %s.", o->index,
-                 pa_cvolume_snprint_verbose(old_ratio_str, sizeof(old_ratio_str), &old_ratio, &o->channel_map, true),
-                 pa_cvolume_snprint_verbose(new_ratio_str, sizeof(new_ratio_str), ratio, &o->channel_map, true));
+    if (pa_log_level_enabled(PA_LOG_DEBUG))
+        pa_log_debug("Source output %u reference ratio changed from %s to %s.", o->index,
+                     pa_cvolume_snprint_verbose(old_ratio_str, sizeof(old_ratio_str), &old_ratio, &o->channel_map, true),
+                     pa_cvolume_snprint_verbose(new_ratio_str, sizeof(new_ratio_str), ratio, &o->channel_map, true));
 }
@@ -199,6 +199,9 @@ struct pa_source_output {
         pa_sample_spec sample_spec;
 
         pa_resampler* resampler;              /* may be NULL */
+        /* True if the output took resampled data from another output
+         * since the resampler last ran */
+        bool resampler_behind:1;
 
         /* We maintain a delay memblockq here for source outputs that
          * don't implement rewind() */
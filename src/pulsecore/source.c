@@ -39,7 +39,7 @@
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/log.h>
 #include <pulsecore/mix.h>
-#include <pulsecore/flist.h>
+#include <pulsecore/tracepoint.h>
 
 #include "source.h"
 
@@ -49,13 +49,6 @@
 
 PA_DEFINE_PUBLIC_CLASS(pa_source, pa_msgobject);
 
-struct pa_source_volume_change {
-    pa_usec_t at;
-    pa_cvolume hw_volume;
-
-    PA_LLIST_FIELDS(pa_source_volume_change);
-};
-
 struct source_message_set_port {
     pa_device_port *port;
     int ret;
@@ -242,6 +235,7 @@ pa_source* pa_source_new(
     s->suspend_cause = data->suspend_cause;
     pa_source_set_mixer_dirty(s, false);
     s->name = pa_xstrdup(name);
+    s->metrics.xruns = pa_metric_new(core->metrics, PA_METRIC_SOURCE_XRUNS, s->name);
     s->proplist = pa_proplist_copy(data->proplist);
     s->driver = pa_xstrdup(pa_path_get_filename(data->driver));
     s->module = data->module;
@@ -279,6 +273,7 @@ pa_source* pa_source_new(
     s->userdata = NULL;
 
     s->asyncmsgq = NULL;
+    s->io_trace = NULL;
 
     /* As a minor optimization we just steal the list instead of
      * copying it here */
@@ -325,8 +320,8 @@ pa_source* pa_source_new(
     s->thread_info.max_latency = ABSOLUTE_MAX_LATENCY;
     s->thread_info.fixed_latency = flags & PA_SOURCE_DYNAMIC_LATENCY ? 0 : DEFAULT_FIXED_LATENCY;
 
-    PA_LLIST_HEAD_INIT(pa_source_volume_change, s->thread_info.volume_changes);
-    s->thread_info.volume_changes_tail = NULL;
+    s->thread_info.volume_changes_first = 0;
+    s->thread_info.n_volume_changes = 0;
     pa_sw_cvolume_multiply(&s->thread_info.current_hw_volume, &s->soft_volume, &s->real_volume);
     s->thread_info.volume_change_safety_margin = core->deferred_volume_safety_margin_usec;
     s->thread_info.volume_change_extra_delay = core->deferred_volume_extra_delay_usec;
@@ -351,9 +346,37 @@ pa_source* pa_source_new(
 }
 
 /* Called from main context */
+/* Called from main context, after the IO thread has taken over the
+ * new state */
+static void source_state_changed(pa_source *s, pa_source_state_t original_state) {
+    bool suspend_change;
+
+    suspend_change =
+        (original_state == PA_SOURCE_SUSPENDED && PA_SOURCE_IS_OPENED(s->state)) ||
+        (PA_SOURCE_IS_OPENED(original_state) && s->state == PA_SOURCE_SUSPENDED);
+
+    if (s->state != PA_SOURCE_UNLINKED) { /* if we enter UNLINKED state pa_source_unlink() will fire the appropriate events */
+        pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SOURCE_STATE_CHANGED], s);
+        pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SOURCE | PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
+    }
+
+    if (suspend_change) {
+        pa_source_output *o;
+        uint32_t idx;
+
+        /* We're suspending or resuming, tell everyone about it */
+
+        PA_IDXSET_FOREACH(o, s->outputs, idx)
+            if (s->state == PA_SOURCE_SUSPENDED &&
+                (o->flags & PA_SOURCE_OUTPUT_KILL_ON_SUSPEND))
+                pa_source_output_kill(o);
+            else if (o->suspend)
+                o->suspend(o, s->state == PA_SOURCE_SUSPENDED);
+    }
+}
+
 static int source_set_state(pa_source *s, pa_source_state_t state) {
     int ret;
-    bool suspend_change;
     pa_source_state_t original_state;
 
     pa_assert(s);
@@ -364,9 +387,24 @@ static int source_set_state(pa_source *s, pa_source_state_t state) {
 
     original_state = s->state;
 
-    suspend_change =
-        (original_state == PA_SOURCE_SUSPENDED && PA_SOURCE_IS_OPENED(state)) ||
-        (PA_SOURCE_IS_OPENED(original_state) && state == PA_SOURCE_SUSPENDED);
+    if (s->pending_state) {
+        if (state != PA_SOURCE_UNLINKED) {
+            /* Somebody changes the state again while the batched
+             * change is not sent yet: the batch will carry the final
+             * state and fire the notifications */
+            if (s->set_state)
+                if ((ret = s->set_state(s, state)) < 0)
+                    return ret;
+
+            s->pending_state->userdata = PA_UINT_TO_PTR(state);
+            s->state = state;
+            return 0;
+        }
+
+        /* The IO thread never sees the batched change then */
+        s->pending_state->object = NULL;
+        s->pending_state = NULL;
+    }
 
     if (s->set_state)
         if ((ret = s->set_state(s, state)) < 0)
@@ -383,26 +421,97 @@ static int source_set_state(pa_source *s, pa_source_state_t state) {
 
     s->state = state;
 
-    if (state != PA_SOURCE_UNLINKED) { /* if we enter UNLINKED state pa_source_unlink() will fire the appropriate events */
-        pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SOURCE_STATE_CHANGED], s);
-        pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SOURCE | PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
+    source_state_changed(s, original_state);
+
+    return 0;
+}
+
+struct source_state_change {
+    pa_source *source;
+    pa_source_state_t state;
+    pa_source_state_t original_state;
+    pa_asyncmsgq_batch_item *item;
+};
+
+/* Called from main context. Like source_set_state() on each of the
+ * referenced sources, with one state message per IO thread. */
+static int source_set_state_many(struct source_state_change *changes, unsigned n) {
+    pa_asyncmsgq_batch_item *items;
+    unsigned k, n_items = 0;
+    pa_source *s;
+    int ret = 0;
+
+    if (n == 0)
+        return 0;
+
+    items = pa_xnew(pa_asyncmsgq_batch_item, n);
+
+    for (k = 0; k < n; k++) {
+        int r;
+
+        s = changes[k].source;
+        changes[k].item = NULL;
+
+        /* The state callback of one source may already have moved
+         * another one, e.g. a filter source its master */
+        if (s->state == changes[k].state || !PA_SOURCE_IS_LINKED(s->state))
+            continue;
+
+        /* Nothing to batch */
+        if (!s->asyncmsgq) {
+            if ((r = source_set_state(s, changes[k].state)) < 0)
+                ret = r;
+            continue;
+        }
+
+        if (s->set_state)
+            if ((r = s->set_state(s, changes[k].state)) < 0) {
+                ret = r;
+                continue;
+            }
+
+        changes[k].original_state = s->state;
+        s->state = changes[k].state;
+
+        items[n_items].q = s->asyncmsgq;
+        items[n_items].object = PA_MSGOBJECT(s);
+        items[n_items].code = PA_SOURCE_MESSAGE_SET_STATE;
+        items[n_items].userdata = PA_UINT_TO_PTR(s->state);
+        items[n_items].offset = 0;
+        changes[k].item = s->pending_state = &items[n_items++];
     }
 
-    if (suspend_change) {
-        pa_source_output *o;
-        uint32_t idx;
+    pa_asyncmsgq_send_many(items, n_items);
 
-        /* We're suspending or resuming, tell everyone about it */
+    for (k = 0; k < n; k++)
+        if (changes[k].item)
+            changes[k].source->pending_state = NULL;
 
-        PA_IDXSET_FOREACH(o, s->outputs, idx)
-            if (s->state == PA_SOURCE_SUSPENDED &&
-                (o->flags & PA_SOURCE_OUTPUT_KILL_ON_SUSPEND))
-                pa_source_output_kill(o);
-            else if (o->suspend)
-                o->suspend(o, state == PA_SOURCE_SUSPENDED);
+    for (k = 0; k < n; k++) {
+        pa_asyncmsgq_batch_item *i = changes[k].item;
+
+        s = changes[k].source;
+
+        /* Not batched, or dropped by pa_source_unlink() */
+        if (!i || !i->object)
+            continue;
+
+        if (i->ret < 0) {
+            if (s->set_state)
+                s->set_state(s, changes[k].original_state);
+
+            s->state = changes[k].original_state;
+            ret = i->ret;
+            continue;
+        }
+
+        if (PA_SOURCE_IS_LINKED(s->state))
+            source_state_changed(s, changes[k].original_state);
     }
 
-    return 0;
+    pa_xfree(items);
+
+    return ret;
 }
 
 void pa_source_set_get_volume_callback(pa_source *s, pa_source_cb_t cb) {
@@ -670,6 +779,8 @@ static void source_free(pa_object *o) {
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    pa_metric_free(s->metrics.xruns);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -750,15 +861,9 @@ void pa_source_set_mixer_dirty(pa_source *s, bool is_dirty) {
 }
 
 /* Called from main context */
-int pa_source_suspend(pa_source *s, bool suspend, pa_suspend_cause_t cause) {
-    pa_source_assert_ref(s);
-    pa_assert_ctl_context();
-    pa_assert(PA_SOURCE_IS_LINKED(s->state));
-    pa_assert(cause != 0);
-
-    if (s->monitor_of && cause != PA_SUSPEND_PASSTHROUGH)
-        return -PA_ERR_NOTSUPPORTED;
-
+/* Called from main context. Returns whether the source needs to
+ * change its state for the new suspend cause, and to which one. */
+static bool source_update_suspend_cause(pa_source *s, bool suspend, pa_suspend_cause_t cause, pa_source_state_t *state) {
     if (suspend)
         s->suspend_cause |= cause;
     else
@@ -786,14 +891,79 @@ int pa_source_suspend(pa_source *s, bool suspend, pa_suspend_cause_t cause) {
     }
 
     if ((pa_source_get_state(s) == PA_SOURCE_SUSPENDED) == !!s->suspend_cause)
-        return 0;
+        return false;
 
     pa_log_debug("Suspend cause of source %s is 0x%04x, %s", s->name, s->suspend_cause, s->suspend_cause ? "suspending" : "resuming");
 
     if (s->suspend_cause)
-        return source_set_state(s, PA_SOURCE_SUSPENDED);
+        *state = PA_SOURCE_SUSPENDED;
     else
-        return source_set_state(s, pa_source_used_by(s) ? PA_SOURCE_RUNNING : PA_SOURCE_IDLE);
+        *state = pa_source_used_by(s) ? PA_SOURCE_RUNNING : PA_SOURCE_IDLE;
+
+    return true;
+}
+
+int pa_source_suspend(pa_source *s, bool suspend, pa_suspend_cause_t cause) {
+    pa_source_state_t state;
+
+    pa_source_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(PA_SOURCE_IS_LINKED(s->state));
+    pa_assert(cause != 0);
+
+    if (s->monitor_of && cause != PA_SUSPEND_PASSTHROUGH)
+        return -PA_ERR_NOTSUPPORTED;
+
+    if (!source_update_suspend_cause(s, suspend, cause, &state))
+        return 0;
+
+    return source_set_state(s, state);
+}
+
+/* Called from main context. Like pa_source_suspend() on each of the
+ * sources, but the state messages are sent as one per IO thread and
+ * the main loop waits for all of them at once. */
+int pa_source_suspend_many(pa_idxset *sources, bool suspend, pa_suspend_cause_t cause) {
+    struct source_state_change *changes;
+    unsigned k, n = 0;
+    pa_source *s;
+    uint32_t idx;
+    int r, ret = 0;
+
+    pa_assert(sources);
+    pa_assert_ctl_context();
+    pa_assert(cause != 0);
+
+    if (pa_idxset_isempty(sources))
+        return 0;
+
+    changes = pa_xnew(struct source_state_change, pa_idxset_size(sources));
+
+    PA_IDXSET_FOREACH(s, sources, idx) {
+        pa_source_assert_ref(s);
+        pa_assert(PA_SOURCE_IS_LINKED(s->state));
+
+        if (s->monitor_of && cause != PA_SUSPEND_PASSTHROUGH) {
+            ret = -PA_ERR_NOTSUPPORTED;
+            continue;
+        }
+
+        if (!source_update_suspend_cause(s, suspend, cause, &changes[n].state))
+            continue;
+
+        changes[n].source = pa_source_ref(s);
+        n++;
+    }
+
+    if ((r = source_set_state_many(changes, n)) < 0)
+        ret = r;
+
+    for (k = 0; k < n; k++)
+        pa_source_unref(changes[k].source);
+
+    pa_xfree(changes);
+
+    return ret;
 }
 
 /* Called from main context */
@@ -815,6 +985,53 @@ int pa_source_sync_suspend(pa_source *s) {
     return source_set_state(s, pa_source_used_by(s) ? PA_SOURCE_RUNNING : PA_SOURCE_IDLE);
 }
 
+/* Called from main context. Like pa_source_sync_suspend() on each of
+ * the monitor sources, with one state message per IO thread. */
+int pa_source_sync_suspend_many(pa_idxset *sources) {
+    struct source_state_change *changes;
+    unsigned k, n = 0;
+    pa_source *s;
+    uint32_t idx;
+    int ret;
+
+    pa_assert(sources);
+    pa_assert_ctl_context();
+
+    if (pa_idxset_isempty(sources))
+        return 0;
+
+    changes = pa_xnew(struct source_state_change, pa_idxset_size(sources));
+
+    PA_IDXSET_FOREACH(s, sources, idx) {
+        pa_sink_state_t state;
+
+        pa_source_assert_ref(s);
+        pa_assert(PA_SOURCE_IS_LINKED(s->state));
+        pa_assert(s->monitor_of);
+
+        state = pa_sink_get_state(s->monitor_of);
+
+        if (state == PA_SINK_SUSPENDED)
+            changes[n].state = PA_SOURCE_SUSPENDED;
+        else {
+            pa_assert(PA_SINK_IS_OPENED(state));
+            changes[n].state = pa_source_used_by(s) ? PA_SOURCE_RUNNING : PA_SOURCE_IDLE;
+        }
+
+        changes[n].source = pa_source_ref(s);
+        n++;
+    }
+
+    ret = source_set_state_many(changes, n);
+
+    for (k = 0; k < n; k++)
+        pa_source_unref(changes[k].source);
+
+    pa_xfree(changes);
+
+    return ret;
+}
+
 /* Called from main context */
 pa_queue *pa_source_move_all_start(pa_source *s, pa_queue *q) {
     pa_source_output *o, *n;
@@ -892,16 +1109,35 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
 
     pa_log_debug("Processing rewind...");
 
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SOURCE_PROCESS_REWIND, s->index, (int64_t) nbytes);
+
     PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
         pa_source_output_assert_ref(o);
         pa_source_output_process_rewind(o, nbytes);
     }
+
+    PA_TRACE_END(PA_TRACEPOINT_SOURCE_PROCESS_REWIND, s->index, (int64_t) nbytes);
+}
+
+/* Called from IO thread context. Counts the outputs that
+ * pa_source_output_push() would pass data to. */
+static unsigned count_running_outputs(pa_source *s) {
+    pa_source_output *o;
+    void *state;
+    unsigned n = 0;
+
+    PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state)
+        if (!o->thread_info.direct_on_input && o->push && o->thread_info.state == PA_SOURCE_OUTPUT_RUNNING)
+            n++;
+
+    return n;
 }
 
 /* Called from IO thread context */
 void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     pa_source_output *o;
     void *state = NULL;
+    unsigned i, n;
 
     pa_source_assert_ref(s);
     pa_source_assert_io_context(s);
@@ -911,6 +1147,15 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     if (s->thread_info.state == PA_SOURCE_SUSPENDED)
         return;
 
+    /* Monitor sources get every chunk their sink renders, most of the time
+     * without anyone listening */
+    if ((n = count_running_outputs(s)) <= 0)
+        return;
+
+    PA_TRACE_BEGIN(PA_TRACEPOINT_SOURCE_POST, s->index, (int64_t) chunk->length);
+
+    s->thread_info.share_processed = n > 1;
+
     if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
         pa_memchunk vchunk = *chunk;
 
@@ -939,6 +1184,86 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
                 pa_source_output_push(o, chunk);
         }
     }
+
+    for (i = 0; i < s->thread_info.n_processed; i++) {
+        pa_memblock_unref(s->thread_info.processed[i].in.memblock);
+        if (s->thread_info.processed[i].out.memblock)
+            pa_memblock_unref(s->thread_info.processed[i].out.memblock);
+    }
+
+    s->thread_info.n_processed = s->thread_info.next_processed = 0;
+    s->thread_info.share_processed = false;
+
+    PA_TRACE_END(PA_TRACEPOINT_SOURCE_POST, s->index, (int64_t) chunk->length);
+}
+
+/* Called from IO thread context */
+bool pa_source_get_processed(pa_source *s, pa_resampler *r, const pa_cvolume *pre, const pa_cvolume *post, const pa_memchunk *in, pa_memchunk *out) {
+    unsigned i;
+
+    pa_source_assert_ref(s);
+    pa_source_assert_io_context(s);
+    pa_assert(pre);
+    pa_assert(post);
+    pa_assert(in);
+    pa_assert(out);
+
+    for (i = 0; i < s->thread_info.n_processed; i++) {
+        pa_source_processed *e = &s->thread_info.processed[i];
+
+        if (e->in.memblock != in->memblock ||
+            e->in.index != in->index ||
+            e->in.length != in->length ||
+            !e->resampler != !r ||
+            (r && !pa_resampler_same_conversion(e->resampler, r)) ||
+            !pa_cvolume_equal(&e->pre, pre) ||
+            !pa_cvolume_equal(&e->post, post))
+            continue;
+
+        *out = e->out;
+        if (out->memblock)
+            pa_memblock_ref(out->memblock);
+        return true;
+    }
+
+    return false;
+}
+
+/* Called from IO thread context */
+void pa_source_put_processed(pa_source *s, pa_resampler *r, const pa_cvolume *pre, const pa_cvolume *post, const pa_memchunk *in, const pa_memchunk *out) {
+    pa_source_processed *e;
+
+    pa_source_assert_ref(s);
+    pa_source_assert_io_context(s);
+    pa_assert(pre);
+    pa_assert(post);
+    pa_assert(in);
+    pa_assert(out);
+
+    if (!s->thread_info.share_processed)
+        return;
+
+    if (s->thread_info.n_processed < PA_SOURCE_PROCESSED_MAX)
+        e = &s->thread_info.processed[s->thread_info.n_processed++];
+    else {
+        /* Outputs are served in the same order for all chunks, so the
+         * oldest entry is the least likely to be asked for again */
+        e = &s->thread_info.processed[s->thread_info.next_processed];
+        s->thread_info.next_processed = (s->thread_info.next_processed + 1) % PA_SOURCE_PROCESSED_MAX;
+
+        pa_memblock_unref(e->in.memblock);
+        if (e->out.memblock)
+            pa_memblock_unref(e->out.memblock);
+    }
+
+    e->resampler = r;
+    e->pre = *pre;
+    e->post = *post;
+    e->in = *in;
+    e->out = *out;
+    pa_memblock_ref(e->in.memblock);
+    if (e->out.memblock)
+        pa_memblock_ref(e->out.memblock);
 }
 
 /* Called from IO thread context */
@@ -975,6 +1300,7 @@ void pa_source_post_direct(pa_source*s, pa_source_output *o, const pa_memchunk *
 int pa_source_update_rate(pa_source *s, uint32_t rate, bool passthrough) {
     int ret;
     uint32_t desired_rate = rate;
+    uint32_t fallback_rate = rate;
     uint32_t default_rate = s->default_sample_rate;
     uint32_t alternate_rate = s->alternate_sample_rate;
     bool default_rate_is_usable = false;
@@ -986,7 +1312,7 @@ int pa_source_update_rate(pa_source *s, uint32_t rate, bool passthrough) {
     if (!s->update_rate && !s->monitor_of)
         return -1;
 
-    if (PA_UNLIKELY(default_rate == alternate_rate && !passthrough)) {
+    if (PA_UNLIKELY(default_rate == alternate_rate && !passthrough && !s->core->avoid_resampling)) {
         pa_log_debug("Default and alternate sample rates are the same, so there is no point in switching.");
         return -1;
     }
@@ -1018,9 +1344,14 @@ int pa_source_update_rate(pa_source *s, uint32_t rate, bool passthrough) {
             alternate_rate_is_usable = true;
 
         if (alternate_rate_is_usable && !default_rate_is_usable)
-            desired_rate = alternate_rate;
+            fallback_rate = alternate_rate;
         else
-            desired_rate = default_rate;
+            fallback_rate = default_rate;
+
+        /* With avoid-resampling the stream's own rate is tried first, the
+         * device may well support it */
+        if (!s->core->avoid_resampling)
+            desired_rate = fallback_rate;
     }
 
     if (desired_rate == s->sample_spec.rate)
@@ -1032,9 +1363,15 @@ int pa_source_update_rate(pa_source *s, uint32_t rate, bool passthrough) {
     pa_log_debug("Suspending source %s due to changing the sample rate.", s->name);
     pa_source_suspend(s, true, PA_SUSPEND_INTERNAL);
 
-    if (s->update_rate)
+    if (s->update_rate) {
         ret = s->update_rate(s, desired_rate);
-    else {
+
+        if (ret < 0 && fallback_rate != desired_rate && fallback_rate != s->sample_spec.rate) {
+            pa_log_debug("Source %s cannot use %u Hz, trying %u Hz.", s->name, desired_rate, fallback_rate);
+            desired_rate = fallback_rate;
+            ret = s->update_rate(s, desired_rate);
+        }
+    } else {
         /* This is a monitor source. */
 
         /* XXX: This code is written with non-passthrough streams in mind. I
@@ -1058,7 +1395,10 @@ int pa_source_update_rate(pa_source *s, uint32_t rate, bool passthrough) {
                  * check in the beginning of this function return early, so we
                  * avoid looping. */
                 s->sample_spec.rate = old_rate;
-            }
+            } else
+                /* The sink may have settled on its fallback rate rather
+                 * than the one we asked for; follow what it picked. */
+                s->sample_spec.rate = s->monitor_of->sample_spec.rate;
         } else
             ret = -1;
     }
@@ -2243,22 +2583,23 @@ int pa_source_process_msg(pa_msgobject *object, int code, void *userdata, int64_
 /* Called from main thread */
 int pa_source_suspend_all(pa_core *c, bool suspend, pa_suspend_cause_t cause) {
     pa_source *source;
+    pa_idxset *sources;
     uint32_t idx;
-    int ret = 0;
+    int ret;
 
     pa_core_assert_ref(c);
     pa_assert_ctl_context();
     pa_assert(cause != 0);
 
-    for (source = PA_SOURCE(pa_idxset_first(c->sources, &idx)); source; source = PA_SOURCE(pa_idxset_next(c->sources, &idx))) {
-        int r;
+    sources = pa_idxset_new(NULL, NULL);
 
-        if (source->monitor_of)
-            continue;
+    /* Monitor sources follow their sinks */
+    PA_IDXSET_FOREACH(source, c->sources, idx)
+        if (!source->monitor_of)
+            pa_idxset_put(sources, source, NULL);
 
-        if ((r = pa_source_suspend(source, suspend, cause)) < 0)
-            ret = r;
-    }
+    ret = pa_source_suspend_many(sources, suspend, cause);
+    pa_idxset_free(sources, NULL);
 
     return ret;
 }
@@ -2629,117 +2970,107 @@ int pa_source_set_port(pa_source *s, const char *name, bool save) {
     return 0;
 }
 
-PA_STATIC_FLIST_DECLARE(pa_source_volume_change, 0, pa_xfree);
-
 /* Called from the IO thread. */
-static pa_source_volume_change *pa_source_volume_change_new(pa_source *s) {
-    pa_source_volume_change *c;
-    if (!(c = pa_flist_pop(PA_STATIC_FLIST_GET(pa_source_volume_change))))
-        c = pa_xnew(pa_source_volume_change, 1);
+static pa_source_volume_change *volume_change_nth(pa_source *s, unsigned n) {
+    pa_assert(n < PA_SOURCE_VOLUME_CHANGES_MAX);
 
-    PA_LLIST_INIT(pa_source_volume_change, c);
-    c->at = 0;
-    pa_cvolume_reset(&c->hw_volume, s->sample_spec.channels);
-    return c;
-}
-
-/* Called from the IO thread. */
-static void pa_source_volume_change_free(pa_source_volume_change *c) {
-    pa_assert(c);
-    if (pa_flist_push(PA_STATIC_FLIST_GET(pa_source_volume_change), c) < 0)
-        pa_xfree(c);
+    return &s->thread_info.volume_changes[(s->thread_info.volume_changes_first + n) % PA_SOURCE_VOLUME_CHANGES_MAX];
 }
 
 /* Called from the IO thread. */
 void pa_source_volume_change_push(pa_source *s) {
     pa_source_volume_change *c = NULL;
-    pa_source_volume_change *nc = NULL;
+    pa_cvolume hw_volume;
+    pa_usec_t at;
+    unsigned n, k;
     uint32_t safety_margin = s->thread_info.volume_change_safety_margin;
 
     const char *direction = NULL;
 
     pa_assert(s);
-    nc = pa_source_volume_change_new(s);
 
     /* NOTE: There is already more different volumes in pa_source that I can remember.
      *       Adding one more volume for HW would get us rid of this, but I am trying
      *       to survive with the ones we already have. */
-    pa_sw_cvolume_divide(&nc->hw_volume, &s->real_volume, &s->soft_volume);
+    pa_sw_cvolume_divide(&hw_volume, &s->real_volume, &s->soft_volume);
 
-    if (!s->thread_info.volume_changes && pa_cvolume_equal(&nc->hw_volume, &s->thread_info.current_hw_volume)) {
+    if (s->thread_info.n_volume_changes == 0 && pa_cvolume_equal(&hw_volume, &s->thread_info.current_hw_volume)) {
         pa_log_debug("Volume not changing");
-        pa_source_volume_change_free(nc);
         return;
     }
 
-    nc->at = pa_source_get_latency_within_thread(s);
-    nc->at += pa_rtclock_now() + s->thread_info.volume_change_extra_delay;
+    at = pa_source_get_latency_within_thread(s);
+    at += pa_rtclock_now() + s->thread_info.volume_change_extra_delay;
 
-    if (s->thread_info.volume_changes_tail) {
-        for (c = s->thread_info.volume_changes_tail; c; c = c->prev) {
-            /* If volume is going up let's do it a bit late. If it is going
-             * down let's do it a bit early. */
-            if (pa_cvolume_avg(&nc->hw_volume) > pa_cvolume_avg(&c->hw_volume)) {
-                if (nc->at + safety_margin > c->at) {
-                    nc->at += safety_margin;
-                    direction = "up";
-                    break;
-                }
-            }
-            else if (nc->at - safety_margin > c->at) {
-                    nc->at -= safety_margin;
-                    direction = "down";
-                    break;
+    for (n = s->thread_info.n_volume_changes; n > 0; n--) {
+        c = volume_change_nth(s, n - 1);
+
+        /* If volume is going up let's do it a bit late. If it is going
+         * down let's do it a bit early. */
+        if (pa_cvolume_avg(&hw_volume) > pa_cvolume_avg(&c->hw_volume)) {
+            if (at + safety_margin > c->at) {
+                at += safety_margin;
+                direction = "up";
+                break;
             }
         }
+        else if (at - safety_margin > c->at) {
+                at -= safety_margin;
+                direction = "down";
+                break;
+        }
     }
 
-    if (c == NULL) {
-        if (pa_cvolume_avg(&nc->hw_volume) > pa_cvolume_avg(&s->thread_info.current_hw_volume)) {
-            nc->at += safety_margin;
+    if (n == 0) {
+        if (pa_cvolume_avg(&hw_volume) > pa_cvolume_avg(&s->thread_info.current_hw_volume)) {
+            at += safety_margin;
             direction = "up";
         } else {
-            nc->at -= safety_margin;
+            at -= safety_margin;
             direction = "down";
         }
-        PA_LLIST_PREPEND(pa_source_volume_change, s->thread_info.volume_changes, nc);
     }
-    else {
-        PA_LLIST_INSERT_AFTER(pa_source_volume_change, s->thread_info.volume_changes, c, nc);
-    }
-
-    pa_log_debug("Volume going %s to %d at %llu", direction, pa_cvolume_avg(&nc->hw_volume), (long long unsigned) nc->at);
 
     /* We can ignore volume events that came earlier but should happen later than this. */
-    PA_LLIST_FOREACH(c, nc->next) {
+    for (k = n; k < s->thread_info.n_volume_changes; k++) {
+        c = volume_change_nth(s, k);
+        pa_log_debug("Volume change to %d at %llu was dropped", pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at);
+    }
+    s->thread_info.n_volume_changes = n;
+
+    /* During a long sweep the queue can fill up. The new volume then
+     * supersedes the last one still pending. */
+    if (n >= PA_SOURCE_VOLUME_CHANGES_MAX) {
+        c = volume_change_nth(s, n - 1);
         pa_log_debug("Volume change to %d at %llu was dropped", pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at);
-        pa_source_volume_change_free(c);
+        s->thread_info.n_volume_changes = --n;
     }
-    nc->next = NULL;
-    s->thread_info.volume_changes_tail = nc;
+
+    c = volume_change_nth(s, n);
+    c->at = at;
+    c->hw_volume = hw_volume;
+    s->thread_info.n_volume_changes++;
+
+    pa_log_debug("Volume going %s to %d at %llu", direction, pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at);
 }
 
 /* Called from the IO thread. */
 static void pa_source_volume_change_flush(pa_source *s) {
-    pa_source_volume_change *c = s->thread_info.volume_changes;
     pa_assert(s);
-    s->thread_info.volume_changes = NULL;
-    s->thread_info.volume_changes_tail = NULL;
-    while (c) {
-        pa_source_volume_change *next = c->next;
-        pa_source_volume_change_free(c);
-        c = next;
-    }
+
+    s->thread_info.volume_changes_first = 0;
+    s->thread_info.n_volume_changes = 0;
 }
 
 /* Called from the IO thread. */
 bool pa_source_volume_change_apply(pa_source *s, pa_usec_t *usec_to_next) {
+    pa_source_volume_change *c;
     pa_usec_t now;
     bool ret = false;
 
     pa_assert(s);
 
-    if (!s->thread_info.volume_changes || !PA_SOURCE_IS_LINKED(s->state)) {
+    if (s->thread_info.n_volume_changes == 0 || !PA_SOURCE_IS_LINKED(s->state)) {
         if (usec_to_next)
             *usec_to_next = 0;
         return ret;
@@ -2749,29 +3080,28 @@ bool pa_source_volume_change_apply(pa_source *s, pa_usec_t *usec_to_next) {
 
     now = pa_rtclock_now();
 
-    while (s->thread_info.volume_changes && now >= s->thread_info.volume_changes->at) {
-        pa_source_volume_change *c = s->thread_info.volume_changes;
-        PA_LLIST_REMOVE(pa_source_volume_change, s->thread_info.volume_changes, c);
+    while (s->thread_info.n_volume_changes > 0 && now >= (c = volume_change_nth(s, 0))->at) {
         pa_log_debug("Volume change to %d at %llu was written %llu usec late",
                      pa_cvolume_avg(&c->hw_volume), (long long unsigned) c->at, (long long unsigned) (now - c->at));
         ret = true;
         s->thread_info.current_hw_volume = c->hw_volume;
-        pa_source_volume_change_free(c);
+        s->thread_info.volume_changes_first = (s->thread_info.volume_changes_first + 1) % PA_SOURCE_VOLUME_CHANGES_MAX;
+        s->thread_info.n_volume_changes--;
     }
 
     if (ret)
         s->write_volume(s);
 
-    if (s->thread_info.volume_changes) {
+    if (s->thread_info.n_volume_changes > 0) {
+        c = volume_change_nth(s, 0);
         if (usec_to_next)
-            *usec_to_next = s->thread_info.volume_changes->at - now;
+            *usec_to_next = c->at - now;
         if (pa_log_ratelimit(PA_LOG_DEBUG))
-            pa_log_debug("Next volume change in %lld usec", (long long) (s->thread_info.volume_changes->at - now));
+            pa_log_debug("Next volume change in %lld usec", (long long) (c->at - now));
     }
     else {
         if (usec_to_next)
             *usec_to_next = 0;
-        s->thread_info.volume_changes_tail = NULL;
     }
     return ret;
 }
@@ -2871,11 +3201,12 @@ void pa_source_set_reference_volume_direct(pa_source *s, const pa_cvolume *volum
         return;
 
     s->reference_volume = *volume;
-    pa_log_debug("The reference volume of source %s changed from %s to %s.", s->name,
-                 pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &s->channel_map,
-                                            s->flags & PA_SOURCE_DECIBEL_VOLUME),
-                 pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &s->channel_map,
-                                            s->flags & PA_SOURCE_DECIBEL_VOLUME));
+    if (pa_log_level_enabled(PA_LOG_DEBUG))
+        pa_log_debug("The reference volume of source %s changed from %s to %s.", s->name,
+                     pa_cvolume_snprint_verbose(old_volume_str, sizeof(old_volume_str), &old_volume, &s->channel_map,
+                                                s->flags & PA_SOURCE_DECIBEL_VOLUME),
+                     pa_cvolume_snprint_verbose(new_volume_str, sizeof(new_volume_str), volume, &s->channel_map,
+                                                s->flags & PA_SOURCE_DECIBEL_VOLUME));
 
     pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
     pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SOURCE_VOLUME_CHANGED], s);
@@ -22,7 +22,6 @@
 ***/
 
 typedef struct pa_source pa_source;
-typedef struct pa_source_volume_change pa_source_volume_change;
 
 #include <inttypes.h>
 
@@ -34,7 +33,9 @@ typedef struct pa_source_volume_change pa_source_volume_change;
 
 #include <pulsecore/core.h>
 #include <pulsecore/idxset.h>
+#include <pulsecore/io-trace.h>
 #include <pulsecore/memchunk.h>
+#include <pulsecore/metrics.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/module.h>
 #include <pulsecore/asyncmsgq.h>
@@ -48,6 +49,14 @@ typedef struct pa_source_volume_change pa_source_volume_change;
 
 #define PA_MAX_OUTPUTS_PER_SOURCE 256
 
+/* How many deferred hardware volume changes can be pending at a time */
+#define PA_SOURCE_VOLUME_CHANGES_MAX 32
+
+typedef struct pa_source_volume_change {
+    pa_usec_t at;
+    pa_cvolume hw_volume;
+} pa_source_volume_change;
+
 /* Returns true if source is linked: registered and accessible from client side. */
 static inline bool PA_SOURCE_IS_LINKED(pa_source_state_t x) {
     return x == PA_SOURCE_RUNNING || x == PA_SOURCE_IDLE || x == PA_SOURCE_SUSPENDED;
@@ -58,6 +67,16 @@ typedef void(*pa_source_cb_t)(pa_source *s);
 
 typedef int (*pa_source_get_mute_cb_t)(pa_source *s, bool *mute);
 
+#define PA_SOURCE_PROCESSED_MAX 8
+
+/* What an output made of in: the volume pre applied before resampler, which
+ * may be NULL, and post after it */
+typedef struct pa_source_processed {
+    pa_resampler *resampler;
+    pa_cvolume pre, post;
+    pa_memchunk in, out;
+} pa_source_processed;
+
 struct pa_source {
     pa_msgobject parent;
 
@@ -68,6 +87,10 @@ struct pa_source {
     pa_source_flags_t flags;
     pa_suspend_cause_t suspend_cause;
 
+    /* The state message of a batched state change that is not sent
+     * yet, see pa_source_suspend_many() */
+    pa_asyncmsgq_batch_item *pending_state;
+
     char *name;
     char *driver;                             /* may be NULL */
     pa_proplist *proplist;
@@ -107,6 +130,15 @@ struct pa_source {
 
     pa_asyncmsgq *asyncmsgq;
 
+    /* The last cycles of the IO thread, NULL if the implementor keeps
+     * no trace. Owned by the implementor. */
+    pa_io_trace *io_trace;
+
+    /* Registered with the core's metrics, bumped by the implementor */
+    struct {
+        pa_metric *xruns;
+    } metrics;
+
     pa_memchunk silence;
 
     pa_hashmap *ports;
@@ -228,10 +260,10 @@ struct pa_source {
         int64_t latency_offset;
 
         /* Delayed volume change events are queued here. The events
-         * are stored in expiration order. The one expiring next is in
-         * the head of the list. */
-        PA_LLIST_HEAD(pa_source_volume_change, volume_changes);
-        pa_source_volume_change *volume_changes_tail;
+         * are stored in expiration order in a ring, the one expiring
+         * next at volume_changes_first. */
+        pa_source_volume_change volume_changes[PA_SOURCE_VOLUME_CHANGES_MAX];
+        unsigned volume_changes_first, n_volume_changes;
         /* This value is updated in pa_source_volume_change_apply() and
          * used only by sources with PA_SOURCE_DEFERRED_VOLUME. */
         pa_cvolume current_hw_volume;
@@ -241,6 +273,14 @@ struct pa_source {
         uint32_t volume_change_safety_margin;
         /* Usec delay added to all volume change events, may be negative. */
         int32_t volume_change_extra_delay;
+
+        /* While pa_source_post() hands a chunk to the outputs, what their
+         * volumes and resamplers made of it, so that outputs converting to
+         * the same format with the same volume can take the result instead
+         * of computing it again. */
+        pa_source_processed processed[PA_SOURCE_PROCESSED_MAX];
+        unsigned n_processed, next_processed;
+        bool share_processed:1;
     } thread_info;
 
     void *userdata;
@@ -346,6 +386,7 @@ void pa_source_volume_changed(pa_source *s, const pa_cvolume *new_volume);
 void pa_source_mute_changed(pa_source *s, bool new_muted);
 
 int pa_source_sync_suspend(pa_source *s);
+int pa_source_sync_suspend_many(pa_idxset *sources);
 
 void pa_source_update_flags(pa_source *s, pa_source_flags_t mask, pa_source_flags_t value);
 
@@ -363,6 +404,7 @@ size_t pa_source_get_max_rewind(pa_source *s);
 
 int pa_source_update_status(pa_source*s);
 int pa_source_suspend(pa_source *s, bool suspend, pa_suspend_cause_t cause);
+int pa_source_suspend_many(pa_idxset *sources, bool suspend, pa_suspend_cause_t cause);
 int pa_source_suspend_all(pa_core *c, bool suspend, pa_suspend_cause_t cause);
 
 /* Use this instead of checking s->flags & PA_SOURCE_FLAT_VOLUME directly. */
@@ -417,6 +459,12 @@ pa_idxset* pa_source_check_formats(pa_source *s, pa_idxset *in_formats);
 
 void pa_source_post(pa_source*s, const pa_memchunk *chunk);
 void pa_source_post_direct(pa_source*s, pa_source_output *o, const pa_memchunk *chunk);
+
+/* For source outputs while pa_source_post() runs: looks up what an
+ * output processing the same way made of in, or remembers out as what
+ * pre, r and post made of it. r may be NULL. */
+bool pa_source_get_processed(pa_source *s, pa_resampler *r, const pa_cvolume *pre, const pa_cvolume *post, const pa_memchunk *in, pa_memchunk *out);
+void pa_source_put_processed(pa_source *s, pa_resampler *r, const pa_cvolume *pre, const pa_cvolume *post, const pa_memchunk *in, const pa_memchunk *out);
 void pa_source_process_rewind(pa_source *s, size_t nbytes);
 
 int pa_source_process_msg(pa_msgobject *o, int code, void *userdata, int64_t, pa_memchunk *chunk);
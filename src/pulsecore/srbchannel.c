@@ -24,57 +24,11 @@
 #include "srbchannel.h"
 
 #include <pulsecore/atomic.h>
+#include <pulsecore/ringbuffer.h>
 #include <pulse/xmalloc.h>
 
 /* #define DEBUG_SRBCHANNEL */
 
-/* This ringbuffer might be useful in other contexts too, but
- * right now it's only used inside the srbchannel, so let's keep it here
- * for the time being. */
-typedef struct pa_ringbuffer pa_ringbuffer;
-
-struct pa_ringbuffer {
-    pa_atomic_t *count; /* amount of data in the buffer */
-    int capacity;
-    uint8_t *memory;
-    int readindex, writeindex;
-};
-
-static void *pa_ringbuffer_peek(pa_ringbuffer *r, int *count) {
-    int c = pa_atomic_load(r->count);
-
-    if (r->readindex + c > r->capacity)
-        *count = r->capacity - r->readindex;
-    else
-        *count = c;
-
-    return r->memory + r->readindex;
-}
-
-/* Returns true only if the buffer was completely full before the drop. */
-static bool pa_ringbuffer_drop(pa_ringbuffer *r, int count) {
-    bool b = pa_atomic_sub(r->count, count) >= r->capacity;
-
-    r->readindex += count;
-    r->readindex %= r->capacity;
-
-    return b;
-}
-
-static void *pa_ringbuffer_begin_write(pa_ringbuffer *r, int *count) {
-    int c = pa_atomic_load(r->count);
-
-    *count = PA_MIN(r->capacity - r->writeindex, r->capacity - c);
-
-    return r->memory + r->writeindex;
-}
-
-static void pa_ringbuffer_end_write(pa_ringbuffer *r, int count) {
-    pa_atomic_add(r->count, count);
-    r->writeindex += count;
-    r->writeindex %= r->capacity;
-}
-
 struct pa_srbchannel {
     pa_ringbuffer rb_read, rb_write;
     pa_fdsem *sem_read, *sem_write;
@@ -162,6 +116,24 @@ size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l) {
     return isread;
 }
 
+size_t pa_srbchannel_get_writable(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    return (size_t) (sr->rb_write.capacity - pa_atomic_load(sr->rb_write.count));
+}
+
+size_t pa_srbchannel_get_readable(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    return (size_t) pa_atomic_load(sr->rb_read.count);
+}
+
+size_t pa_srbchannel_get_written(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    return (size_t) pa_atomic_load(sr->rb_write.count);
+}
+
 /* This is the memory layout of the ringbuffer shm block. It is followed by
    read and write ringbuffer memory. */
 struct srbheader {
@@ -353,6 +325,12 @@ void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback,
     }
 }
 
+void pa_srbchannel_set_spin(pa_srbchannel *sr, pa_usec_t usec) {
+    pa_assert(sr);
+
+    pa_fdsem_set_spin(sr->sem_read, usec);
+}
+
 void pa_srbchannel_free(pa_srbchannel *sr)
 {
 #ifdef DEBUG_SRBCHANNEL
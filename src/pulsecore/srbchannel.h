@@ -45,6 +45,14 @@ void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t);
 size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l);
 size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 
+/* The number of bytes that can be written resp. read right now, and the
+ * number of bytes written that the other side has not read yet. Unlike
+ * the rest of the API these may be used from the thread that reads or
+ * writes the channel, which need not be the one running the mainloop. */
+size_t pa_srbchannel_get_writable(pa_srbchannel *sr);
+size_t pa_srbchannel_get_readable(pa_srbchannel *sr);
+size_t pa_srbchannel_get_written(pa_srbchannel *sr);
+
 /* Set the callback function that is called whenever data becomes available for reading.
  * It can also be called if the output buffer was full and can now be written to.
  *
@@ -54,4 +62,10 @@ size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 typedef bool (*pa_srbchannel_cb_t)(pa_srbchannel *sr, void *userdata);
 void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata);
 
+/* Busy wait for up to usec for the other side before going back to the
+ * mainloop to sleep, see pa_fdsem_set_spin(). Meant for peers that
+ * exchange small periods, where the wakeup would cost more than the
+ * spin. */
+void pa_srbchannel_set_spin(pa_srbchannel *sr, pa_usec_t usec);
+
 #endif
@@ -0,0 +1,179 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "startup-trace.h"
+
+#define MAX_EVENTS 1024
+
+typedef struct event {
+    const char *category;
+    char *name;
+    pa_usec_t begin, end;
+} event;
+
+static event *events = NULL;
+static unsigned n_events = 0;
+static bool recording = false;
+static pa_usec_t start_time = 0;
+
+static void clear(void) {
+    unsigned i;
+
+    for (i = 0; i < n_events; i++)
+        pa_xfree(events[i].name);
+
+    n_events = 0;
+}
+
+void pa_startup_trace_start(void) {
+    clear();
+
+    if (!events)
+        events = pa_xnew(event, MAX_EVENTS);
+
+    start_time = pa_rtclock_now();
+    recording = true;
+}
+
+void pa_startup_trace_stop(void) {
+    recording = false;
+}
+
+void pa_startup_trace_free(void) {
+    clear();
+
+    pa_xfree(events);
+    events = NULL;
+    recording = false;
+}
+
+pa_usec_t pa_startup_trace_begin(void) {
+    if (!recording)
+        return 0;
+
+    return pa_rtclock_now();
+}
+
+void pa_startup_trace_end(pa_usec_t begin, const char *category, const char *name) {
+    event *e;
+
+    pa_assert(category);
+    pa_assert(name);
+
+    if (!begin || !recording)
+        return;
+
+    if (n_events >= MAX_EVENTS) {
+        pa_log_debug("Startup trace is full, not recording any further.");
+        recording = false;
+        return;
+    }
+
+    e = &events[n_events++];
+    e->category = category;
+    e->name = pa_xstrdup(name);
+    e->begin = begin;
+    e->end = pa_rtclock_now();
+}
+
+static void put_json_string(pa_strbuf *buf, const char *s) {
+    pa_strbuf_putc(buf, '"');
+
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            pa_strbuf_printf(buf, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            pa_strbuf_printf(buf, "\\u%04x", (unsigned char) *s);
+        else
+            pa_strbuf_putc(buf, *s);
+    }
+
+    pa_strbuf_putc(buf, '"');
+}
+
+void pa_startup_trace_dump(pa_strbuf *buf) {
+    unsigned i;
+
+    pa_assert(buf);
+
+    pa_strbuf_puts(buf, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (i = 0; i < n_events; i++) {
+        event *e = &events[i];
+
+        pa_strbuf_puts(buf, i > 0 ? ",\n" : "\n");
+        pa_strbuf_puts(buf, "{\"name\":");
+        put_json_string(buf, e->name);
+        pa_strbuf_puts(buf, ",\"cat\":");
+        put_json_string(buf, e->category);
+
+        /* Complete events, timestamps are relative to the start in usec */
+        pa_strbuf_printf(buf, ",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%lu,\"tid\":1}",
+                         (unsigned long long) (e->begin > start_time ? e->begin - start_time : 0),
+                         (unsigned long long) (e->end - e->begin),
+                         (unsigned long) getpid());
+    }
+
+    pa_strbuf_puts(buf, "\n]}\n");
+}
+
+int pa_startup_trace_write(const char *fn) {
+    pa_strbuf *buf;
+    char *s;
+    FILE *f;
+    int r = -1;
+
+    pa_assert(fn);
+
+    if (!(f = pa_fopen_cloexec(fn, "w"))) {
+        pa_log("Failed to open startup trace file '%s': %s", fn, pa_cstrerror(errno));
+        return -1;
+    }
+
+    buf = pa_strbuf_new();
+    pa_startup_trace_dump(buf);
+    s = pa_strbuf_tostring_free(buf);
+
+    if (fputs(s, f) < 0 || fflush(f) != 0)
+        pa_log("Failed to write startup trace file '%s': %s", fn, pa_cstrerror(errno));
+    else
+        r = 0;
+
+    pa_xfree(s);
+    fclose(f);
+
+    if (r >= 0)
+        pa_log_info("Wrote startup trace to '%s'.", fn);
+
+    return r;
+}
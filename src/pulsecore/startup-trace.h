@@ -0,0 +1,52 @@
+#ifndef foopulsestartuptracehfoo
+#define foopulsestartuptracehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/strbuf.h>
+
+/* Records how long the phases of the daemon startup take, e.g. parsing
+ * configuration files, opening modules or probing cards, so that they
+ * can be looked at in a viewer for the Chrome trace event format, like
+ * chrome://tracing or Perfetto. Nothing is recorded outside of
+ * pa_startup_trace_start() and pa_startup_trace_stop(), and recording
+ * also stops when the buffer is full. Phases may nest. Only to be used
+ * from the main thread. */
+
+/* Drops what was recorded before and starts recording */
+void pa_startup_trace_start(void);
+void pa_startup_trace_stop(void);
+
+/* Frees what was recorded */
+void pa_startup_trace_free(void);
+
+/* Returns the start time of a phase to pass to pa_startup_trace_end(),
+ * or 0 when not recording */
+pa_usec_t pa_startup_trace_begin(void);
+
+/* Records a phase that began at begin. The name is copied, the category
+ * must be a static string. Does nothing if begin is 0. */
+void pa_startup_trace_end(pa_usec_t begin, const char *category, const char *name);
+
+/* Formats what was recorded as a JSON trace */
+void pa_startup_trace_dump(pa_strbuf *buf);
+int pa_startup_trace_write(const char *fn);
+
+#endif
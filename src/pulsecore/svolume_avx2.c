@@ -0,0 +1,164 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sample-util.h"
+
+#include <immintrin.h>
+
+/* Number of samples per vector */
+#define LANES 8
+
+static unsigned gcd(unsigned a, unsigned b) {
+    while (b) {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* Sample i of a chunk gets volumes[i % channels]. After channels / gcd
+ * vectors the lanes see the same channels again, so the volumes are laid
+ * out for that many vectors, and the loops step through them instead of
+ * cycling through the channels sample by sample. Floats are copied as
+ * their bits. Returns the number of vectors in the period. */
+static unsigned volume_vectors(int32_t v[PA_CHANNELS_MAX * LANES], const int32_t *volumes, unsigned channels) {
+    unsigned period = channels / gcd(channels, LANES);
+    unsigned i;
+
+    pa_assert(channels > 0 && channels <= PA_CHANNELS_MAX);
+
+    for (i = 0; i < period * LANES; i++)
+        v[i] = volumes[i % channels];
+
+    return period;
+}
+
+/* Like pa_mult_s16_volume(), split the volume in two halves so that all
+ * products fit in 32 bits */
+static inline void volume_s16ne(int16_t *samples, const int32_t *v) {
+    __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) samples));
+    __m256i cv = _mm256_load_si256((const __m256i*) v);
+    __m256i lo = _mm256_and_si256(cv, _mm256_set1_epi32(0xFFFF));
+    __m256i hi = _mm256_srai_epi32(cv, 16);
+    __m256i t = _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(s, lo), 16), _mm256_mullo_epi32(s, hi));
+
+    _mm_storeu_si128((__m128i*) samples, _mm_packs_epi32(_mm256_castsi256_si128(t), _mm256_extracti128_si256(t, 1)));
+}
+
+/* Bits 16 to 47 of the 64 bit products, clamped to 32 bits. Only the
+ * lower half of each lane is meaningful. */
+static inline __m256i shift_clamp_s32(__m256i p) {
+    const __m256i max = _mm256_set1_epi64x((1LL << 47) - 1);
+    const __m256i min = _mm256_set1_epi64x(-(1LL << 47));
+    __m256i t = _mm256_srli_epi64(p, 16);
+
+    t = _mm256_blendv_epi8(t, _mm256_set1_epi64x(0x7FFFFFFF), _mm256_cmpgt_epi64(p, max));
+    t = _mm256_blendv_epi8(t, _mm256_set1_epi64x(0x80000000), _mm256_cmpgt_epi64(min, p));
+
+    return t;
+}
+
+static inline __m256i mult_s32(__m256i s, __m256i cv) {
+    __m256i even = shift_clamp_s32(_mm256_mul_epi32(s, cv));
+    __m256i odd = shift_clamp_s32(_mm256_mul_epi32(_mm256_srli_epi64(s, 32), _mm256_srli_epi64(cv, 32)));
+
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+static inline void volume_s32ne(int32_t *samples, const int32_t *v) {
+    __m256i s = _mm256_loadu_si256((const __m256i*) samples);
+
+    _mm256_storeu_si256((__m256i*) samples, mult_s32(s, _mm256_load_si256((const __m256i*) v)));
+}
+
+/* The same on the upper 24 bits */
+static inline void volume_s24_32ne(uint32_t *samples, const int32_t *v) {
+    __m256i s = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i*) samples), 8);
+
+    _mm256_storeu_si256((__m256i*) samples, _mm256_srli_epi32(mult_s32(s, _mm256_load_si256((const __m256i*) v)), 8));
+}
+
+static inline void volume_float32ne(float *samples, const int32_t *v) {
+    __m256 s = _mm256_loadu_ps(samples);
+
+    _mm256_storeu_ps(samples, _mm256_mul_ps(s, _mm256_load_ps((const float*) v)));
+}
+
+/* Runs the vector kernel over all samples of the chunk. The samples left
+ * at the end go through it in a copy padded to a full vector. */
+#define VOLUME_LOOP(type, kernel)                                           \
+    do {                                                                    \
+        PA_DECLARE_ALIGNED(32, int32_t, v[PA_CHANNELS_MAX * LANES]);        \
+        unsigned n = length / sizeof(type), period, k;                      \
+                                                                            \
+        period = volume_vectors(v, volumes, channels);                      \
+                                                                            \
+        for (k = 0; n >= LANES; n -= LANES, samples += LANES) {             \
+            kernel(samples, v + k * LANES);                                 \
+                                                                            \
+            if (++k >= period)                                              \
+                k = 0;                                                      \
+        }                                                                   \
+                                                                            \
+        if (n > 0) {                                                        \
+            type tmp[LANES] = { 0 };                                        \
+                                                                            \
+            memcpy(tmp, samples, n * sizeof(type));                         \
+            kernel(tmp, v + k * LANES);                                     \
+            memcpy(samples, tmp, n * sizeof(type));                         \
+        }                                                                   \
+    } while (0)
+
+static void pa_volume_s16ne_avx2(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(int16_t, volume_s16ne);
+}
+
+static void pa_volume_s32ne_avx2(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(int32_t, volume_s32ne);
+}
+
+static void pa_volume_s24_32ne_avx2(uint32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(uint32_t, volume_s24_32ne);
+}
+
+static void pa_volume_float32ne_avx2(float *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(float, volume_float32ne);
+}
+
+void pa_volume_func_init_avx2(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_AVX2))
+        return;
+
+    pa_log_info("Initialising AVX2 optimized volume functions.");
+
+    pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_avx2);
+    pa_set_volume_func(PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_avx2);
+    pa_set_volume_func(PA_SAMPLE_S24_32NE, (pa_do_volume_func_t) pa_volume_s24_32ne_avx2);
+    pa_set_volume_func(PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_avx2);
+}
@@ -0,0 +1,159 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sample-util.h"
+
+#include <immintrin.h>
+
+/* Number of samples per vector */
+#define LANES 16
+
+static unsigned gcd(unsigned a, unsigned b) {
+    while (b) {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* Sample i of a chunk gets volumes[i % channels]. After channels / gcd
+ * vectors the lanes see the same channels again, so the volumes are laid
+ * out for that many vectors, and the loops step through them instead of
+ * cycling through the channels sample by sample. Floats are copied as
+ * their bits. Returns the number of vectors in the period. */
+static unsigned volume_vectors(int32_t v[PA_CHANNELS_MAX * LANES], const int32_t *volumes, unsigned channels) {
+    unsigned period = channels / gcd(channels, LANES);
+    unsigned i;
+
+    pa_assert(channels > 0 && channels <= PA_CHANNELS_MAX);
+
+    for (i = 0; i < period * LANES; i++)
+        v[i] = volumes[i % channels];
+
+    return period;
+}
+
+/* Like pa_mult_s16_volume(), split the volume in two halves so that all
+ * products fit in 32 bits */
+static inline void volume_s16ne(int16_t *samples, const int32_t *v) {
+    __m512i s = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*) samples));
+    __m512i cv = _mm512_load_si512(v);
+    __m512i lo = _mm512_and_si512(cv, _mm512_set1_epi32(0xFFFF));
+    __m512i hi = _mm512_srai_epi32(cv, 16);
+    __m512i t = _mm512_add_epi32(_mm512_srai_epi32(_mm512_mullo_epi32(s, lo), 16), _mm512_mullo_epi32(s, hi));
+
+    _mm256_storeu_si256((__m256i*) samples, _mm512_cvtsepi32_epi16(t));
+}
+
+/* The 64 bit products shifted and clamped to 32 bits. Only the lower
+ * half of each lane is meaningful. */
+static inline __m512i shift_clamp_s32(__m512i p) {
+    __m512i t = _mm512_srai_epi64(p, 16);
+
+    return _mm512_max_epi64(_mm512_min_epi64(t, _mm512_set1_epi64(0x7FFFFFFF)), _mm512_set1_epi64(-0x80000000LL));
+}
+
+static inline __m512i mult_s32(__m512i s, __m512i cv) {
+    __m512i even = shift_clamp_s32(_mm512_mul_epi32(s, cv));
+    __m512i odd = shift_clamp_s32(_mm512_mul_epi32(_mm512_srli_epi64(s, 32), _mm512_srli_epi64(cv, 32)));
+
+    return _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+}
+
+static inline void volume_s32ne(int32_t *samples, const int32_t *v) {
+    __m512i s = _mm512_loadu_si512(samples);
+
+    _mm512_storeu_si512(samples, mult_s32(s, _mm512_load_si512(v)));
+}
+
+/* The same on the upper 24 bits */
+static inline void volume_s24_32ne(uint32_t *samples, const int32_t *v) {
+    __m512i s = _mm512_slli_epi32(_mm512_loadu_si512(samples), 8);
+
+    _mm512_storeu_si512(samples, _mm512_srli_epi32(mult_s32(s, _mm512_load_si512(v)), 8));
+}
+
+static inline void volume_float32ne(float *samples, const int32_t *v) {
+    __m512 s = _mm512_loadu_ps(samples);
+
+    _mm512_storeu_ps(samples, _mm512_mul_ps(s, _mm512_load_ps(v)));
+}
+
+/* Runs the vector kernel over all samples of the chunk. The samples left
+ * at the end go through it in a copy padded to a full vector. */
+#define VOLUME_LOOP(type, kernel)                                           \
+    do {                                                                    \
+        PA_DECLARE_ALIGNED(64, int32_t, v[PA_CHANNELS_MAX * LANES]);        \
+        unsigned n = length / sizeof(type), period, k;                      \
+                                                                            \
+        period = volume_vectors(v, volumes, channels);                      \
+                                                                            \
+        for (k = 0; n >= LANES; n -= LANES, samples += LANES) {             \
+            kernel(samples, v + k * LANES);                                 \
+                                                                            \
+            if (++k >= period)                                              \
+                k = 0;                                                      \
+        }                                                                   \
+                                                                            \
+        if (n > 0) {                                                        \
+            type tmp[LANES] = { 0 };                                        \
+                                                                            \
+            memcpy(tmp, samples, n * sizeof(type));                         \
+            kernel(tmp, v + k * LANES);                                     \
+            memcpy(samples, tmp, n * sizeof(type));                         \
+        }                                                                   \
+    } while (0)
+
+static void pa_volume_s16ne_avx512(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(int16_t, volume_s16ne);
+}
+
+static void pa_volume_s32ne_avx512(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(int32_t, volume_s32ne);
+}
+
+static void pa_volume_s24_32ne_avx512(uint32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(uint32_t, volume_s24_32ne);
+}
+
+static void pa_volume_float32ne_avx512(float *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    VOLUME_LOOP(float, volume_float32ne);
+}
+
+void pa_volume_func_init_avx512(pa_cpu_x86_flag_t flags) {
+    if (!(flags & PA_CPU_X86_AVX512F))
+        return;
+
+    pa_log_info("Initialising AVX-512 optimized volume functions.");
+
+    pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_avx512);
+    pa_set_volume_func(PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_avx512);
+    pa_set_volume_func(PA_SAMPLE_S24_32NE, (pa_do_volume_func_t) pa_volume_s24_32ne_avx512);
+    pa_set_volume_func(PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_avx512);
+}
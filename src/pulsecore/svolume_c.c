@@ -22,6 +22,7 @@
 #include <config.h>
 #endif
 
+#include <pulsecore/cpu.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/g711.h>
 #include <pulsecore/endianmacros.h>
@@ -70,7 +71,7 @@ static void pa_volume_ulaw_c(uint8_t *samples, const int32_t *volumes, unsigned
     }
 }
 
-static void pa_volume_s16ne_c(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+static void pa_volume_generic_s16ne(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
     unsigned channel;
 
     length /= sizeof(int16_t);
@@ -102,7 +103,7 @@ static void pa_volume_s16re_c(int16_t *samples, const int32_t *volumes, unsigned
     }
 }
 
-static void pa_volume_float32ne_c(float *samples, const float *volumes, unsigned channels, unsigned length) {
+static void pa_volume_generic_float32ne(float *samples, const float *volumes, unsigned channels, unsigned length) {
     unsigned channel;
 
     length /= sizeof(float);
@@ -132,7 +133,7 @@ static void pa_volume_float32re_c(float *samples, const float *volumes, unsigned
     }
 }
 
-static void pa_volume_s32ne_c(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+static void pa_volume_generic_s32ne(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
     unsigned channel;
 
     length /= sizeof(int32_t);
@@ -242,6 +243,64 @@ static void pa_volume_s24_32re_c(uint32_t *samples, const int32_t *volumes, unsi
     }
 }
 
+/* The same for a fixed number of channels: the loop over one frame has a
+ * constant trip count, so the compiler unrolls it and keeps the volumes
+ * in registers. The length is always whole frames. */
+#define DEFINE_VOLUME_CHANNELS(ch)                                                              \
+    static void pa_volume_ch##ch##_s16ne(int16_t *samples, const int32_t *volumes, unsigned length) { \
+        unsigned c;                                                                             \
+                                                                                                \
+        for (length /= sizeof(int16_t) * ch; length; length--, samples += ch)                   \
+            for (c = 0; c < ch; c++) {                                                          \
+                int32_t t = pa_mult_s16_volume(samples[c], volumes[c]);                         \
+                                                                                                \
+                samples[c] = (int16_t) PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF);                   \
+            }                                                                                   \
+    }                                                                                           \
+                                                                                                \
+    static void pa_volume_ch##ch##_float32ne(float *samples, const float *volumes, unsigned length) { \
+        unsigned c;                                                                             \
+                                                                                                \
+        for (length /= sizeof(float) * ch; length; length--, samples += ch)                     \
+            for (c = 0; c < ch; c++)                                                            \
+                samples[c] *= volumes[c];                                                       \
+    }                                                                                           \
+                                                                                                \
+    static void pa_volume_ch##ch##_s32ne(int32_t *samples, const int32_t *volumes, unsigned length) { \
+        unsigned c;                                                                             \
+                                                                                                \
+        for (length /= sizeof(int32_t) * ch; length; length--, samples += ch)                   \
+            for (c = 0; c < ch; c++) {                                                          \
+                int64_t t = ((int64_t) samples[c] * volumes[c]) >> 16;                          \
+                                                                                                \
+                samples[c] = (int32_t) PA_CLAMP_UNLIKELY(t, -0x80000000LL, 0x7FFFFFFFLL);       \
+            }                                                                                   \
+    }
+
+DEFINE_VOLUME_CHANNELS(1)
+DEFINE_VOLUME_CHANNELS(2)
+DEFINE_VOLUME_CHANNELS(6)
+DEFINE_VOLUME_CHANNELS(8)
+
+#undef DEFINE_VOLUME_CHANNELS
+
+#define DEFINE_VOLUME_DISPATCH(format, type, vtype)                                             \
+    static void pa_volume_##format##_c(type *samples, const vtype *volumes, unsigned channels, unsigned length) { \
+        switch (channels) {                                                                     \
+            case 1: pa_volume_ch1_##format(samples, volumes, length); break;                    \
+            case 2: pa_volume_ch2_##format(samples, volumes, length); break;                    \
+            case 6: pa_volume_ch6_##format(samples, volumes, length); break;                    \
+            case 8: pa_volume_ch8_##format(samples, volumes, length); break;                    \
+            default: pa_volume_generic_##format(samples, volumes, channels, length); break;     \
+        }                                                                                       \
+    }
+
+DEFINE_VOLUME_DISPATCH(s16ne, int16_t, int32_t)
+DEFINE_VOLUME_DISPATCH(float32ne, float, float)
+DEFINE_VOLUME_DISPATCH(s32ne, int32_t, int32_t)
+
+#undef DEFINE_VOLUME_DISPATCH
+
 static pa_do_volume_func_t do_volume_table[] = {
     [PA_SAMPLE_U8]        = (pa_do_volume_func_t) pa_volume_u8_c,
     [PA_SAMPLE_ALAW]      = (pa_do_volume_func_t) pa_volume_alaw_c,
@@ -269,3 +328,15 @@ void pa_set_volume_func(pa_sample_format_t f, pa_do_volume_func_t func) {
 
     do_volume_table[f] = func;
 }
+
+void pa_volume_func_init(const pa_cpu_info *cpu_info) {
+    if (cpu_info->force_generic_code) {
+        do_volume_table[PA_SAMPLE_S16NE] = (pa_do_volume_func_t) pa_volume_generic_s16ne;
+        do_volume_table[PA_SAMPLE_FLOAT32NE] = (pa_do_volume_func_t) pa_volume_generic_float32ne;
+        do_volume_table[PA_SAMPLE_S32NE] = (pa_do_volume_func_t) pa_volume_generic_s32ne;
+    } else {
+        do_volume_table[PA_SAMPLE_S16NE] = (pa_do_volume_func_t) pa_volume_s16ne_c;
+        do_volume_table[PA_SAMPLE_FLOAT32NE] = (pa_do_volume_func_t) pa_volume_float32ne_c;
+        do_volume_table[PA_SAMPLE_S32NE] = (pa_do_volume_func_t) pa_volume_s32ne_c;
+    }
+}
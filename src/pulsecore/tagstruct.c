@@ -41,7 +41,6 @@
 
 #define MAX_TAG_SIZE (64*1024)
 #define MAX_APPENDED_SIZE 128
-#define GROW_TAG_SIZE 100
 
 struct pa_tagstruct {
     uint8_t *data;
@@ -50,7 +49,7 @@ struct pa_tagstruct {
 
     enum {
         PA_TAGSTRUCT_FIXED, /* The tagstruct does not own the data, buffer was provided by caller. */
-        PA_TAGSTRUCT_DYNAMIC, /* Buffer owned by tagstruct, data must be freed. */
+        PA_TAGSTRUCT_DYNAMIC, /* Buffer from pa_packet_buffer_new(), owned by tagstruct, data must be freed. */
         PA_TAGSTRUCT_APPENDED, /* Data points to appended buffer, used for small tagstructs. Will change to dynamic if needed. */
     } type;
     union {
@@ -92,11 +91,27 @@ void pa_tagstruct_free(pa_tagstruct*t) {
     pa_assert(t);
 
     if (t->type == PA_TAGSTRUCT_DYNAMIC)
-        pa_xfree(t->data);
+        pa_packet_buffer_free(t->data, t->allocated);
     if (pa_flist_push(PA_STATIC_FLIST_GET(tagstructs), t) < 0)
         pa_xfree(t);
 }
 
+pa_packet *pa_tagstruct_free_to_packet(pa_tagstruct *t) {
+    pa_packet *p;
+
+    pa_assert(t);
+    pa_assert(t->length > 0);
+
+    if (t->type == PA_TAGSTRUCT_DYNAMIC) {
+        p = pa_packet_new_buffer(t->data, t->allocated, t->length);
+        t->type = PA_TAGSTRUCT_APPENDED;
+    } else
+        p = pa_packet_new_data(t->data, t->length);
+
+    pa_tagstruct_free(t);
+    return p;
+}
+
 static inline void extend(pa_tagstruct*t, size_t l) {
     pa_assert(t);
     pa_assert(t->type != PA_TAGSTRUCT_FIXED);
@@ -104,11 +119,19 @@ static inline void extend(pa_tagstruct*t, size_t l) {
     if (t->length+l <= t->allocated)
         return;
 
-    if (t->type == PA_TAGSTRUCT_DYNAMIC)
-        t->data = pa_xrealloc(t->data, t->allocated = t->length + l + GROW_TAG_SIZE);
-    else if (t->type == PA_TAGSTRUCT_APPENDED) {
+    /* Spill into a packet buffer, which can be handed over to the packet
+     * when the tagstruct is sent. Most tagstructs fit into the first one,
+     * larger ones double their size. */
+    if (t->type == PA_TAGSTRUCT_DYNAMIC) {
+        uint8_t *data = t->data;
+        size_t allocated = t->allocated;
+
+        t->data = pa_packet_buffer_new(PA_MAX(t->length + l, allocated * 2), &t->allocated);
+        memcpy(t->data, data, t->length);
+        pa_packet_buffer_free(data, allocated);
+    } else if (t->type == PA_TAGSTRUCT_APPENDED) {
         t->type = PA_TAGSTRUCT_DYNAMIC;
-        t->data = pa_xmalloc(t->allocated = t->length + l + GROW_TAG_SIZE);
+        t->data = pa_packet_buffer_new(t->length + l, &t->allocated);
         memcpy(t->data, t->per_type.appended, t->length);
     }
 }
@@ -25,17 +25,58 @@
 #include <pthread.h>
 #include <sched.h>
 #include <errno.h>
+#include <string.h>
 
 #ifdef __linux__
 #include <sys/prctl.h>
 #endif
 
+#if defined(__linux__) && defined(HAVE_LINUX_PERF_EVENT_H) && defined(HAVE_SYS_SYSCALL_H)
+#define USE_PERF_EVENTS
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
+#ifdef __FreeBSD__
+#include <pthread_np.h>
+#endif
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#endif
+#endif
+
 #include <pulse/xmalloc.h>
 #include <pulsecore/atomic.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
 #include "thread.h"
 
+#ifdef USE_PERF_EVENTS
+/* In the order of pa_thread_perf_counters. Only user space is counted
+ * for the hardware events, so that unprivileged users get them with the
+ * default perf_event_paranoid setting. */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perf_events[] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+#define N_PERF_EVENTS PA_ELEMENTSOF(perf_events)
+#endif
+
+static bool perf_counters_enabled = false;
+
 struct pa_thread {
     pthread_t id;
     pa_thread_func_t thread_func;
@@ -43,6 +84,12 @@ struct pa_thread {
     pa_atomic_t running;
     bool joined;
     char *name;
+
+#ifdef USE_PERF_EVENTS
+    /* Opened by the thread itself, -1 for what isn't counted */
+    int perf_fds[N_PERF_EVENTS];
+    bool perf_counting;
+#endif
 };
 
 struct pa_tls {
@@ -63,6 +110,57 @@ static void thread_free_cb(void *p) {
 
 PA_STATIC_TLS_DECLARE(current_thread, thread_free_cb);
 
+#ifdef USE_PERF_EVENTS
+static void open_perf_counters(pa_thread *t) {
+    unsigned k, n = 0;
+
+    for (k = 0; k < N_PERF_EVENTS; k++) {
+        struct perf_event_attr attr;
+        unsigned long flags = 0;
+
+        pa_zero(attr);
+        attr.size = sizeof(attr);
+        attr.type = perf_events[k].type;
+        attr.config = perf_events[k].config;
+        attr.exclude_kernel = perf_events[k].type == PERF_TYPE_HARDWARE;
+        attr.exclude_hv = 1;
+
+#ifdef PERF_FLAG_FD_CLOEXEC
+        flags = PERF_FLAG_FD_CLOEXEC;
+#endif
+
+        /* This thread, on any CPU */
+        if ((t->perf_fds[k] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, flags)) >= 0)
+            n++;
+    }
+
+    if (n < N_PERF_EVENTS)
+        pa_log_debug("Thread %s counts %u of %u perf events: %s", pa_strnull(t->name), n, (unsigned) N_PERF_EVENTS,
+                     n > 0 ? "some are not available" : pa_cstrerror(errno));
+
+    t->perf_counting = n > 0;
+}
+
+static void close_perf_counters(pa_thread *t) {
+    unsigned k;
+
+    for (k = 0; k < N_PERF_EVENTS; k++)
+        if (t->perf_fds[k] >= 0) {
+            pa_close(t->perf_fds[k]);
+            t->perf_fds[k] = -1;
+        }
+
+    t->perf_counting = false;
+}
+
+static void init_perf_counters(pa_thread *t) {
+    unsigned k;
+
+    for (k = 0; k < N_PERF_EVENTS; k++)
+        t->perf_fds[k] = -1;
+}
+#endif
+
 static void* internal_thread_func(void *userdata) {
     pa_thread *t = userdata;
     pa_assert(t);
@@ -77,6 +175,11 @@ static void* internal_thread_func(void *userdata) {
 
     PA_STATIC_TLS_SET(current_thread, t);
 
+#ifdef USE_PERF_EVENTS
+    if (perf_counters_enabled)
+        open_perf_counters(t);
+#endif
+
     pa_atomic_inc(&t->running);
     t->thread_func(t->userdata);
     pa_atomic_sub(&t->running, 2);
@@ -94,6 +197,10 @@ pa_thread* pa_thread_new(const char *name, pa_thread_func_t thread_func, void *u
     t->thread_func = thread_func;
     t->userdata = userdata;
 
+#ifdef USE_PERF_EVENTS
+    init_perf_counters(t);
+#endif
+
     if (pthread_create(&t->id, NULL, internal_thread_func, t) < 0) {
         pa_xfree(t);
         return NULL;
@@ -121,6 +228,10 @@ void pa_thread_free(pa_thread *t) {
 
     pa_thread_join(t);
 
+#ifdef USE_PERF_EVENTS
+    close_perf_counters(t);
+#endif
+
     pa_xfree(t->name);
     pa_xfree(t);
 }
@@ -128,6 +239,10 @@ void pa_thread_free(pa_thread *t) {
 void pa_thread_free_nojoin(pa_thread *t) {
     pa_assert(t);
 
+#ifdef USE_PERF_EVENTS
+    close_perf_counters(t);
+#endif
+
     pa_xfree(t->name);
     pa_xfree(t);
 }
@@ -157,6 +272,10 @@ pa_thread* pa_thread_self(void) {
     t->joined = true;
     pa_atomic_store(&t->running, 2);
 
+#ifdef USE_PERF_EVENTS
+    init_perf_counters(t);
+#endif
+
     PA_STATIC_TLS_SET(current_thread, t);
 
     return t;
@@ -211,6 +330,114 @@ const char *pa_thread_get_name(pa_thread *t) {
     return t->name;
 }
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
+typedef cpuset_t cpu_set_t;
+#endif
+
+/* Parses lists like "0-3,8" */
+static int parse_cpu_list(const char *cpus, cpu_set_t *mask) {
+    const char *state = NULL;
+    char *n;
+    bool empty = true;
+
+    CPU_ZERO(mask);
+
+    while ((n = pa_split(cpus, ",", &state))) {
+        uint32_t first = 0, last;
+        char *dash;
+        int r;
+
+        if ((dash = strchr(n, '-')))
+            *dash = 0;
+
+        r = pa_atou(n, &first);
+        last = first;
+
+        if (r >= 0 && dash)
+            r = pa_atou(dash + 1, &last);
+
+        pa_xfree(n);
+
+        if (r < 0 || first > last || last >= CPU_SETSIZE)
+            return -1;
+
+        for (; first <= last; first++)
+            CPU_SET(first, mask);
+
+        empty = false;
+    }
+
+    return empty ? -1 : 0;
+}
+#endif
+
+int pa_thread_set_affinity(pa_thread *t, const char *cpus) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t mask;
+    int r;
+
+    pa_assert(t);
+    pa_assert(cpus);
+
+    if (parse_cpu_list(cpus, &mask) < 0) {
+        pa_log("Invalid CPU list '%s'.", cpus);
+        return -1;
+    }
+
+    if ((r = pthread_setaffinity_np(t->id, sizeof(mask), &mask)) != 0) {
+        pa_log_warn("Failed to bind thread %s to CPUs %s: %s", pa_strnull(t->name), cpus, pa_cstrerror(r));
+        return -1;
+    }
+
+    pa_log_info("Bound thread %s to CPUs %s.", pa_strnull(t->name), cpus);
+    return 0;
+#else
+    pa_log_warn("Setting the CPU affinity of threads is not supported on this system.");
+    return -1;
+#endif
+}
+
+void pa_thread_enable_perf_counters(bool enable) {
+#ifdef USE_PERF_EVENTS
+    perf_counters_enabled = enable;
+#else
+    if (enable)
+        pa_log_warn("Counting perf events of threads is not supported on this system.");
+#endif
+}
+
+bool pa_thread_perf_counters_enabled(void) {
+    return perf_counters_enabled;
+}
+
+int pa_thread_get_perf_counters(pa_thread *t, pa_thread_perf_counters *c) {
+#ifdef USE_PERF_EVENTS
+    uint64_t *values[N_PERF_EVENTS];
+    unsigned k;
+
+    pa_assert(t);
+    pa_assert(c);
+
+    if (!t->perf_counting)
+        return -1;
+
+    values[0] = &c->cycles;
+    values[1] = &c->instructions;
+    values[2] = &c->cache_references;
+    values[3] = &c->cache_misses;
+    values[4] = &c->context_switches;
+
+    for (k = 0; k < N_PERF_EVENTS; k++)
+        if (t->perf_fds[k] < 0 || pa_loop_read(t->perf_fds[k], values[k], sizeof(uint64_t), NULL) != sizeof(uint64_t))
+            *values[k] = UINT64_MAX;
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 void pa_thread_yield(void) {
 #ifdef HAVE_PTHREAD_YIELD
     pthread_yield();
@@ -149,6 +149,24 @@ const char *pa_thread_get_name(pa_thread *t) {
     return NULL;
 }
 
+int pa_thread_set_affinity(pa_thread *t, const char *cpus) {
+    /* Not implemented */
+    return -1;
+}
+
+void pa_thread_enable_perf_counters(bool enable) {
+    /* Not implemented */
+}
+
+bool pa_thread_perf_counters_enabled(void) {
+    return false;
+}
+
+int pa_thread_get_perf_counters(pa_thread *t, pa_thread_perf_counters *c) {
+    /* Not implemented */
+    return -1;
+}
+
 void pa_thread_yield(void) {
     Sleep(0);
 }
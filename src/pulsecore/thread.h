@@ -49,6 +49,32 @@ void pa_thread_set_data(pa_thread *t, void *userdata);
 const char *pa_thread_get_name(pa_thread *t);
 void pa_thread_set_name(pa_thread *t, const char *name);
 
+/* Restricts the thread to the CPUs in cpus, a comma separated list of
+ * CPU numbers and ranges like "0-3,8". Returns a negative value if the
+ * list is invalid or the system does not allow it. */
+int pa_thread_set_affinity(pa_thread *t, const char *cpus);
+
+/* What a thread's own execution cost it so far. Anything the system
+ * wouldn't let us count is UINT64_MAX. */
+typedef struct pa_thread_perf_counters {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_references;
+    uint64_t cache_misses;
+    uint64_t context_switches;
+} pa_thread_perf_counters;
+
+/* Makes the threads started from now on count their CPU cycles,
+ * instructions, cache misses and context switches with perf events. Only
+ * supported on Linux. Called from the main thread before any threads are
+ * started. */
+void pa_thread_enable_perf_counters(bool enable);
+bool pa_thread_perf_counters_enabled(void);
+
+/* Returns a negative value if t doesn't count anything. May be called
+ * from any thread, also after t has finished, until it is freed. */
+int pa_thread_get_perf_counters(pa_thread *t, pa_thread_perf_counters *c);
+
 typedef struct pa_tls pa_tls;
 
 pa_tls* pa_tls_new(pa_free_cb_t free_cb);
@@ -71,6 +71,13 @@ struct pa_smoother {
                           /* History of last measurements */
     pa_usec_t history_x[HISTORY_MAX], history_y[HISTORY_MAX];
     unsigned history_idx, n_history;
+    pa_usec_t history_max_x; /* No entry has a larger x */
+
+    /* Sums over the history for the linear regression, kept up to date
+     * as entries come and go. Relative to the oldest entry to keep the
+     * numbers small. */
+    pa_usec_t origin_x, origin_y;
+    int64_t sum_x, sum_y, sum_xx, sum_xy;
 
     /* To even out for monotonicity */
     pa_usec_t last_y, last_x;
@@ -132,7 +139,49 @@ void pa_smoother_free(pa_smoother* s) {
         x = ((x)+1) % HISTORY_MAX;              \
     } while(false)
 
+static void update_sums(pa_smoother *s, pa_usec_t x, pa_usec_t y, int64_t sign) {
+    int64_t dx, dy;
+
+    dx = (int64_t) x - (int64_t) s->origin_x;
+    dy = (int64_t) y - (int64_t) s->origin_y;
+
+    s->sum_x += sign * dx;
+    s->sum_y += sign * dy;
+    s->sum_xx += sign * dx * dx;
+    s->sum_xy += sign * dx * dy;
+}
+
+/* Moves the origin of the sums to the oldest entry */
+static void rebase_sums(pa_smoother *s) {
+    int64_t a, b, n;
+
+    if (s->n_history <= 0) {
+        s->sum_x = s->sum_y = s->sum_xx = s->sum_xy = 0;
+        return;
+    }
+
+    a = (int64_t) s->history_x[s->history_idx] - (int64_t) s->origin_x;
+    b = (int64_t) s->history_y[s->history_idx] - (int64_t) s->origin_y;
+    n = (int64_t) s->n_history;
+
+    s->sum_xx += n * a * a - 2 * a * s->sum_x;
+    s->sum_xy += n * a * b - a * s->sum_y - b * s->sum_x;
+    s->sum_x -= n * a;
+    s->sum_y -= n * b;
+
+    s->origin_x = s->history_x[s->history_idx];
+    s->origin_y = s->history_y[s->history_idx];
+}
+
+static void drop_oldest(pa_smoother *s) {
+    update_sums(s, s->history_x[s->history_idx], s->history_y[s->history_idx], -1);
+
+    REDUCE_INC(s->history_idx);
+    s->n_history --;
+}
+
 static void drop_old(pa_smoother *s, pa_usec_t x) {
+    unsigned n = s->n_history;
 
     /* Drop items from history which are too old, but make sure to
      * always keep min_history in the history */
@@ -145,31 +194,49 @@ static void drop_old(pa_smoother *s, pa_usec_t x) {
             break;
 
         /* Item is too old, let's drop it */
-        REDUCE_INC(s->history_idx);
-
-        s->n_history --;
+        drop_oldest(s);
     }
+
+    if (s->n_history != n)
+        rebase_sums(s);
 }
 
 static void add_to_history(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
     unsigned j, i;
     pa_assert(s);
 
-    /* First try to update an existing history entry */
-    i = s->history_idx;
-    for (j = s->n_history; j > 0; j--) {
+    /* First try to update an existing history entry. Usually x grows
+     * with every call, so there is nothing to find. */
+    if (s->n_history > 0 && x <= s->history_max_x) {
+        i = s->history_idx;
+        for (j = s->n_history; j > 0; j--) {
 
-        if (s->history_x[i] == x) {
-            s->history_y[i] = y;
-            return;
-        }
+            if (s->history_x[i] == x) {
+                update_sums(s, x, s->history_y[i], -1);
+                update_sums(s, x, y, 1);
+                s->history_y[i] = y;
+                return;
+            }
 
-        REDUCE_INC(i);
+            REDUCE_INC(i);
+        }
     }
 
     /* Drop old entries */
     drop_old(s, x);
 
+    /* And make sure we don't store more entries than fit in */
+    if (s->n_history >= HISTORY_MAX) {
+        drop_oldest(s);
+        rebase_sums(s);
+    }
+
+    if (s->n_history <= 0) {
+        s->origin_x = s->history_max_x = x;
+        s->origin_y = y;
+        s->sum_x = s->sum_y = s->sum_xx = s->sum_xy = 0;
+    }
+
     /* Calculate position for new entry */
     j = s->history_idx + s->n_history;
     REDUCE(j);
@@ -177,66 +244,32 @@ static void add_to_history(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
     /* Fill in entry */
     s->history_x[j] = x;
     s->history_y[j] = y;
+    update_sums(s, x, y, 1);
+
+    if (x > s->history_max_x)
+        s->history_max_x = x;
 
     /* Adjust counter */
     s->n_history ++;
-
-    /* And make sure we don't store more entries than fit in */
-    if (s->n_history > HISTORY_MAX) {
-        s->history_idx += s->n_history - HISTORY_MAX;
-        REDUCE(s->history_idx);
-        s->n_history = HISTORY_MAX;
-    }
 }
 
 static double avg_gradient(pa_smoother *s, pa_usec_t x) {
-    unsigned i, j, c = 0;
-    int64_t ax = 0, ay = 0, k, t;
-    double r;
+    double n, k, t, r;
 
-    /* FIXME: Optimization: Jason Newton suggested that instead of
-     * going through the history on each iteration we could calculated
-     * avg_gradient() as we go.
-     *
-     * Second idea: it might make sense to weight history entries:
-     * more recent entries should matter more than old ones. */
+    /* FIXME: it might make sense to weight history entries: more
+     * recent entries should matter more than old ones. */
 
     /* Too few measurements, assume gradient of 1 */
     if (s->n_history < s->min_history)
         return 1;
 
-    /* First, calculate average of all measurements */
-    i = s->history_idx;
-    for (j = s->n_history; j > 0; j--) {
-
-        ax += (int64_t) s->history_x[i];
-        ay += (int64_t) s->history_y[i];
-        c++;
+    /* Linear regression, from the sums we keep instead of going through
+     * the history every time */
+    n = (double) s->n_history;
+    k = (double) s->sum_xy - (double) s->sum_x * (double) s->sum_y / n;
+    t = (double) s->sum_xx - (double) s->sum_x * (double) s->sum_x / n;
 
-        REDUCE_INC(i);
-    }
-
-    pa_assert(c >= s->min_history);
-    ax /= c;
-    ay /= c;
-
-    /* Now, do linear regression */
-    k = t = 0;
-
-    i = s->history_idx;
-    for (j = s->n_history; j > 0; j--) {
-        int64_t dx, dy;
-
-        dx = (int64_t) s->history_x[i] - ax;
-        dy = (int64_t) s->history_y[i] - ay;
-
-        k += dx*dy;
-        t += dx*dx;
-
-        REDUCE_INC(i);
-    }
-
-    r = (double) k / (double) t;
+    r = k / t;
 
     return (s->monotonic && r < 0) ? 0 : r;
 }
@@ -510,6 +543,10 @@ void pa_smoother_reset(pa_smoother *s, pa_usec_t time_offset, bool paused) {
 
     s->history_idx = 0;
     s->n_history = 0;
+    s->history_max_x = 0;
+
+    s->origin_x = s->origin_y = 0;
+    s->sum_x = s->sum_y = s->sum_xx = s->sum_xy = 0;
 
     s->last_y = s->last_x = 0;
 
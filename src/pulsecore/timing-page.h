@@ -0,0 +1,93 @@
+#ifndef foopulsetimingpagehfoo
+#define foopulsetimingpagehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <string.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* A page of shared memory in which the server publishes the timing of a
+ * playback stream, so that the client can read it instead of asking for it
+ * with GET_PLAYBACK_LATENCY. There is a single writer, the sink IO thread,
+ * and the page is guarded by a sequence counter: it is odd while the page is
+ * being written. All fields are naturally aligned, so that the layout is the
+ * same on 32 and 64 bit peers. */
+
+#define PA_TIMING_PAGE_PLAYING 0x1U
+
+typedef struct pa_timing_page_data {
+    uint32_t flags;
+    uint32_t padding;
+    int64_t read_index;
+    /* Latency of the stream in the server: the sink latency plus what is
+     * already rendered but not yet passed to the sink */
+    uint64_t sink_usec;
+    uint64_t underrun_for;
+    uint64_t playing_for;
+    /* pa_rtclock_now() of the server when the fields were taken */
+    uint64_t timestamp;
+} pa_timing_page_data;
+
+typedef struct pa_timing_page {
+    pa_atomic_t seq;
+    uint32_t padding;
+    pa_timing_page_data data;
+} pa_timing_page;
+
+static inline void pa_timing_page_write(pa_timing_page *p, const pa_timing_page_data *d) {
+    pa_assert(p);
+    pa_assert(d);
+
+    pa_atomic_inc(&p->seq);
+    memcpy(&p->data, d, sizeof(*d));
+    pa_atomic_inc(&p->seq);
+}
+
+/* How often to try for a consistent copy. The writer may have been
+ * preempted in the middle of an update, or be gone entirely. */
+#define PA_TIMING_PAGE_READ_TRIES 64
+
+/* Returns 0 and in *seq the sequence number of the copy that was taken,
+ * which can be used to tell whether the page was updated since the last
+ * read. Returns -1 if the page kept changing, in which case the caller
+ * has to get the timing another way. */
+static inline int pa_timing_page_read(pa_timing_page *p, pa_timing_page_data *d, int *seq) {
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(d);
+    pa_assert(seq);
+
+    for (i = 0; i < PA_TIMING_PAGE_READ_TRIES; i++) {
+        *seq = pa_atomic_load(&p->seq);
+
+        if (*seq & 1)
+            continue;
+
+        memcpy(d, &p->data, sizeof(*d));
+
+        if (pa_atomic_load(&p->seq) == *seq)
+            return 0;
+    }
+
+    return -1;
+}
+
+#endif
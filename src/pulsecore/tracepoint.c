@@ -0,0 +1,331 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/thread.h>
+
+#include "tracepoint.h"
+
+/* Must be a power of two */
+#define RING_SIZE 8192
+
+typedef struct ring ring;
+
+struct ring {
+    pa_tracepoint_record records[RING_SIZE];
+    pa_atomic_t write_index; /* only changed by the owning thread */
+    pa_atomic_t owned;       /* cleared when the owning thread exits */
+    pa_atomic_t full;        /* set once the ring wrapped around */
+    uint64_t claimed_ns;
+    char name[PA_TRACEPOINT_THREAD_NAME_MAX];
+    ring *next;
+};
+
+pa_atomic_t pa_tracepoints_active = PA_ATOMIC_INIT(0);
+
+/* Rings are never freed. The ring of a thread that exited is kept for the
+ * next dump and then taken over by the next thread that needs one. */
+static pa_atomic_ptr_t rings = PA_ATOMIC_PTR_INIT(NULL);
+static uint64_t enabled_ns = 0;
+
+static const char * const id_names[PA_TRACEPOINT_MAX] = {
+    [PA_TRACEPOINT_SINK_RENDER] = "sink-render",
+    [PA_TRACEPOINT_SINK_RENDER_INTO] = "sink-render-into",
+    [PA_TRACEPOINT_SINK_RENDER_INTO_FULL] = "sink-render-into-full",
+    [PA_TRACEPOINT_SINK_RENDER_FULL] = "sink-render-full",
+    [PA_TRACEPOINT_SINK_INPUT_PEEK] = "sink-input-peek",
+    [PA_TRACEPOINT_SINK_PROCESS_REWIND] = "sink-process-rewind",
+    [PA_TRACEPOINT_SINK_REQUEST_REWIND] = "sink-request-rewind",
+    [PA_TRACEPOINT_SOURCE_POST] = "source-post",
+    [PA_TRACEPOINT_SOURCE_PROCESS_REWIND] = "source-process-rewind",
+    [PA_TRACEPOINT_ALSA_SINK_WRITE] = "alsa-sink-write",
+    [PA_TRACEPOINT_ALSA_SOURCE_READ] = "alsa-source-read",
+    [PA_TRACEPOINT_ALSA_WAKEUP] = "alsa-wakeup",
+};
+
+static void thread_exit(void *p) {
+    ring *r = p;
+
+    pa_atomic_store(&r->owned, 0);
+}
+
+PA_STATIC_TLS_DECLARE(current_ring, thread_exit);
+
+static ring *get_ring(void) {
+    ring *r;
+
+    if ((r = PA_STATIC_TLS_GET(current_ring)))
+        return r;
+
+    for (r = pa_atomic_ptr_load(&rings); r; r = r->next)
+        if (pa_atomic_cmpxchg(&r->owned, 0, 1))
+            break;
+
+    if (!r) {
+        /* The first trace point a thread passes pays for its ring */
+        r = pa_xnew0(ring, 1);
+        pa_atomic_store(&r->owned, 1);
+
+        do
+            r->next = pa_atomic_ptr_load(&rings);
+        while (!pa_atomic_ptr_cmpxchg(&rings, r->next, r));
+    }
+
+    /* A dump running right now might see half of the name, which is
+     * harmless */
+    pa_strlcpy(r->name, pa_strnull(pa_thread_get_name(pa_thread_self())), sizeof(r->name));
+    r->claimed_ns = pa_rtclock_nsec();
+
+    PA_STATIC_TLS_SET(current_ring, r);
+    return r;
+}
+
+void pa_tracepoint_record_event(pa_tracepoint_id_t id, pa_tracepoint_phase_t phase, uint32_t object, int64_t arg) {
+    pa_tracepoint_record *rec;
+    unsigned w;
+    ring *r;
+
+    pa_assert(id < PA_TRACEPOINT_MAX);
+
+    r = get_ring();
+
+    w = (unsigned) pa_atomic_load(&r->write_index);
+    rec = &r->records[w & (RING_SIZE - 1)];
+    rec->time_ns = pa_rtclock_nsec();
+    rec->id = (uint16_t) id;
+    rec->phase = (uint8_t) phase;
+    rec->object = object;
+    rec->arg = arg;
+
+    pa_atomic_inc(&r->write_index);
+
+    if (PA_UNLIKELY(w == RING_SIZE - 1))
+        pa_atomic_store(&r->full, 1);
+}
+
+void pa_tracepoints_set_enabled(bool enabled) {
+    if (enabled == !!pa_atomic_load(&pa_tracepoints_active))
+        return;
+
+    if (enabled)
+        enabled_ns = pa_rtclock_nsec();
+
+    pa_atomic_store(&pa_tracepoints_active, enabled);
+}
+
+/* Copies the records of r that were written since tracing was enabled to
+ * out, which must have room for RING_SIZE records. */
+static unsigned copy_ring(ring *r, pa_tracepoint_record *out, uint32_t thread) {
+    unsigned w, start, i, copied = 0, n = 0;
+    uint64_t since;
+
+    w = (unsigned) pa_atomic_load(&r->write_index);
+    start = pa_atomic_load(&r->full) ? w - RING_SIZE : 0;
+
+    for (i = start; i != w; i++)
+        out[copied++] = r->records[i & (RING_SIZE - 1)];
+
+    /* The owner kept writing while we copied. A record is intact if the
+     * owner didn't get around the ring to its slot since. */
+    w = (unsigned) pa_atomic_load(&r->write_index);
+    since = PA_MAX(enabled_ns, r->claimed_ns);
+
+    for (i = 0; i < copied; i++) {
+        if (w - (start + i) >= RING_SIZE)
+            continue;
+
+        if (out[i].time_ns < since)
+            continue;
+
+        out[n] = out[i];
+        out[n].thread = thread;
+        n++;
+    }
+
+    return n;
+}
+
+int pa_tracepoints_dump(const char *fn) {
+    pa_tracepoint_file_header h;
+    pa_tracepoint_record *records;
+    unsigned n_threads = 0, n = 0;
+    char *names;
+    ring *head, *r;
+    FILE *f;
+    int ret = -1;
+
+    pa_assert(fn);
+
+    /* Rings are only ever added in front of the head, so what follows the
+     * head we see here doesn't change while we walk it */
+    head = pa_atomic_ptr_load(&rings);
+
+    for (r = head; r; r = r->next)
+        n_threads++;
+
+    records = pa_xnew(pa_tracepoint_record, (size_t) PA_MAX(n_threads, 1U) * RING_SIZE);
+    names = pa_xnew0(char, (size_t) PA_MAX(n_threads, 1U) * PA_TRACEPOINT_THREAD_NAME_MAX);
+
+    n_threads = 0;
+    for (r = head; r; r = r->next) {
+        memcpy(names + n_threads * PA_TRACEPOINT_THREAD_NAME_MAX, r->name, PA_TRACEPOINT_THREAD_NAME_MAX);
+        names[(n_threads + 1) * PA_TRACEPOINT_THREAD_NAME_MAX - 1] = 0;
+
+        n += copy_ring(r, records + n, n_threads);
+        n_threads++;
+    }
+
+    pa_zero(h);
+    memcpy(h.magic, PA_TRACEPOINT_FILE_MAGIC, sizeof(PA_TRACEPOINT_FILE_MAGIC));
+    h.version = PA_TRACEPOINT_FILE_VERSION;
+    h.record_size = sizeof(pa_tracepoint_record);
+    h.n_threads = n_threads;
+    h.n_records = n;
+
+    if (!(f = pa_fopen_cloexec(fn, "w"))) {
+        pa_log("Failed to open trace file '%s': %s", fn, pa_cstrerror(errno));
+        goto finish;
+    }
+
+    if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+        (n_threads > 0 && fwrite(names, PA_TRACEPOINT_THREAD_NAME_MAX, n_threads, f) != n_threads) ||
+        (n > 0 && fwrite(records, sizeof(pa_tracepoint_record), n, f) != n) ||
+        fflush(f) != 0)
+        pa_log("Failed to write trace file '%s': %s", fn, pa_cstrerror(errno));
+    else {
+        pa_log_info("Wrote %u trace records of %u threads to '%s'.", n, n_threads, fn);
+        ret = 0;
+    }
+
+    fclose(f);
+
+finish:
+    pa_xfree(records);
+    pa_xfree(names);
+
+    return ret;
+}
+
+static int compare_records(const void *a, const void *b) {
+    const pa_tracepoint_record *x = a, *y = b;
+
+    if (x->time_ns != y->time_ns)
+        return x->time_ns < y->time_ns ? -1 : 1;
+
+    /* Keep the order of a thread for records with the same time */
+    if (x < y)
+        return -1;
+
+    return x > y ? 1 : 0;
+}
+
+int pa_tracepoints_load(const char *fn, pa_tracepoint_record **records, unsigned *n_records, char ***thread_names, unsigned *n_threads) {
+    pa_tracepoint_file_header h;
+    pa_tracepoint_record *r = NULL;
+    char **names = NULL;
+    char name[PA_TRACEPOINT_THREAD_NAME_MAX];
+    unsigned i;
+    FILE *f;
+
+    pa_assert(fn);
+    pa_assert(records);
+    pa_assert(n_records);
+    pa_assert(thread_names);
+    pa_assert(n_threads);
+
+    if (!(f = pa_fopen_cloexec(fn, "r"))) {
+        pa_log("Failed to open trace file '%s': %s", fn, pa_cstrerror(errno));
+        return -1;
+    }
+
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, PA_TRACEPOINT_FILE_MAGIC, sizeof(PA_TRACEPOINT_FILE_MAGIC)) != 0) {
+        pa_log("'%s' is not a trace file.", fn);
+        goto fail;
+    }
+
+    if (h.version != PA_TRACEPOINT_FILE_VERSION || h.record_size != sizeof(pa_tracepoint_record)) {
+        pa_log("Unsupported version %u of trace file '%s'.", h.version, fn);
+        goto fail;
+    }
+
+    names = pa_xnew0(char*, h.n_threads + 1);
+    for (i = 0; i < h.n_threads; i++) {
+        if (fread(name, sizeof(name), 1, f) != 1)
+            goto truncated;
+
+        name[sizeof(name) - 1] = 0;
+        names[i] = pa_xstrdup(name);
+    }
+
+    r = pa_xnew(pa_tracepoint_record, PA_MAX(h.n_records, 1U));
+    if (h.n_records > 0 && fread(r, sizeof(pa_tracepoint_record), h.n_records, f) != h.n_records)
+        goto truncated;
+
+    for (i = 0; i < h.n_records; i++)
+        if (r[i].thread >= h.n_threads || r[i].id >= PA_TRACEPOINT_MAX) {
+            pa_log("Invalid record in trace file '%s'.", fn);
+            goto fail;
+        }
+
+    fclose(f);
+
+    qsort(r, h.n_records, sizeof(pa_tracepoint_record), compare_records);
+
+    *records = r;
+    *n_records = h.n_records;
+    *thread_names = names;
+    *n_threads = h.n_threads;
+
+    return 0;
+
+truncated:
+    pa_log("Trace file '%s' is truncated.", fn);
+
+fail:
+    fclose(f);
+    pa_xfree(r);
+
+    if (names) {
+        for (i = 0; i < h.n_threads; i++)
+            pa_xfree(names[i]);
+        pa_xfree(names);
+    }
+
+    return -1;
+}
+
+const char *pa_tracepoint_id_to_string(pa_tracepoint_id_t id) {
+    if (id >= PA_TRACEPOINT_MAX)
+        return NULL;
+
+    return id_names[id];
+}
@@ -0,0 +1,123 @@
+#ifndef foopulsetracepointhfoo
+#define foopulsetracepointhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* Trace points for the IO threads. While tracing is enabled every trace
+ * point that is passed appends a fixed size binary record to a ring of the
+ * calling thread. The rings are written without locking and overwrite
+ * their oldest records, so that a dump shows what happened last. When
+ * tracing is disabled a trace point costs a load and a branch. The dump is
+ * converted to a timeline with the patrace utility. */
+
+/* The object of the sink and source trace points is the index of the sink or
+ * source, and the argument a length in bytes: what was asked for at the
+ * beginning and what was done at the end. The ALSA IO cycles begin with
+ * whether the timer woke the thread up and end with the bytes read or
+ * written, the wakeups tell whether it was the timer. */
+typedef enum pa_tracepoint_id {
+    PA_TRACEPOINT_SINK_RENDER,
+    PA_TRACEPOINT_SINK_RENDER_INTO,
+    PA_TRACEPOINT_SINK_RENDER_INTO_FULL,
+    PA_TRACEPOINT_SINK_RENDER_FULL,
+    PA_TRACEPOINT_SINK_INPUT_PEEK,      /* The object is the sink input */
+    PA_TRACEPOINT_SINK_PROCESS_REWIND,
+    PA_TRACEPOINT_SINK_REQUEST_REWIND,
+    PA_TRACEPOINT_SOURCE_POST,
+    PA_TRACEPOINT_SOURCE_PROCESS_REWIND,
+    PA_TRACEPOINT_ALSA_SINK_WRITE,
+    PA_TRACEPOINT_ALSA_SOURCE_READ,
+    PA_TRACEPOINT_ALSA_WAKEUP,
+    PA_TRACEPOINT_MAX
+} pa_tracepoint_id_t;
+
+typedef enum pa_tracepoint_phase {
+    PA_TRACEPOINT_BEGIN,
+    PA_TRACEPOINT_END,
+    PA_TRACEPOINT_INSTANT
+} pa_tracepoint_phase_t;
+
+/* The layout of a record in memory and in a dump */
+typedef struct pa_tracepoint_record {
+    uint64_t time_ns;
+    uint16_t id;
+    uint8_t phase;
+    uint8_t padding;
+    /* Index of the sink, source or stream, or -1 */
+    uint32_t object;
+    /* Usually a length in bytes */
+    int64_t arg;
+    /* Index of the thread in the dump */
+    uint32_t thread;
+    uint32_t padding2;
+} pa_tracepoint_record;
+
+/* A dump is a pa_tracepoint_file_header, then n_threads thread names of
+ * PA_TRACEPOINT_THREAD_NAME_MAX bytes each, then n_records records grouped
+ * by thread, all in the byte order of the machine that wrote it. */
+#define PA_TRACEPOINT_FILE_MAGIC "PATRACE"
+#define PA_TRACEPOINT_FILE_VERSION 1
+#define PA_TRACEPOINT_THREAD_NAME_MAX 32
+
+typedef struct pa_tracepoint_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t n_threads;
+    uint32_t n_records;
+} pa_tracepoint_file_header;
+
+extern pa_atomic_t pa_tracepoints_active;
+
+static inline bool pa_tracepoints_enabled(void) {
+    return PA_UNLIKELY(pa_atomic_load(&pa_tracepoints_active));
+}
+
+void pa_tracepoint_record_event(pa_tracepoint_id_t id, pa_tracepoint_phase_t phase, uint32_t object, int64_t arg);
+
+#define PA_TRACEPOINT(id, phase, object, arg)                           \
+    do {                                                                \
+        if (pa_tracepoints_enabled())                                   \
+            pa_tracepoint_record_event((id), (phase), (object), (arg)); \
+    } while (0)
+
+#define PA_TRACE_BEGIN(id, object, arg) PA_TRACEPOINT(id, PA_TRACEPOINT_BEGIN, object, arg)
+#define PA_TRACE_END(id, object, arg) PA_TRACEPOINT(id, PA_TRACEPOINT_END, object, arg)
+#define PA_TRACE_INSTANT(id, object, arg) PA_TRACEPOINT(id, PA_TRACEPOINT_INSTANT, object, arg)
+
+/* Called from the main thread. Enabling tracing hides what was recorded
+ * before from the next dump. */
+void pa_tracepoints_set_enabled(bool enabled);
+
+/* Writes what the rings hold to a file in the format described above.
+ * Called from the main thread. */
+int pa_tracepoints_dump(const char *fn);
+
+/* Reads a dump written by pa_tracepoints_dump(). Returns a newly allocated
+ * array of records sorted by time, and the thread names, to be freed with
+ * pa_xfree(). */
+int pa_tracepoints_load(const char *fn, pa_tracepoint_record **records, unsigned *n_records, char ***thread_names, unsigned *n_threads);
+
+const char *pa_tracepoint_id_to_string(pa_tracepoint_id_t id);
+
+#endif
@@ -0,0 +1,219 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/flist.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/thread.h>
+
+#include "workpool.h"
+
+PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
+
+/* Lives on the stack of the thread that called pa_workpool_run() */
+struct batch {
+    pa_workpool_job_cb_t cb;
+    void *userdata;
+    unsigned n_jobs;
+
+    /* The next job to hand out, and the number of jobs finished. The
+     * one finishing the last job posts the semaphore. */
+    pa_atomic_t next_job, done;
+    pa_semaphore *semaphore;
+
+    PA_LLIST_FIELDS(struct batch);
+};
+
+struct pa_workpool {
+    unsigned n_threads;
+    pa_thread **threads;
+    int rtprio;
+
+    pa_mutex *mutex;
+    pa_semaphore *semaphore;
+    pa_atomic_t quit;
+
+    PA_LLIST_HEAD(struct batch, batches);
+};
+
+static void finish_job(struct batch *b) {
+    pa_semaphore *s = b->semaphore;
+
+    /* b may be gone as soon as the last job is counted */
+    if ((unsigned) pa_atomic_inc(&b->done) + 1 == b->n_jobs)
+        pa_semaphore_post(s);
+}
+
+/* Runs one job of any queued batch, returns false if there was none */
+static bool run_job(pa_workpool *p) {
+    struct batch *b;
+    unsigned job = 0;
+
+    pa_mutex_lock(p->mutex);
+
+    PA_LLIST_FOREACH(b, p->batches)
+        if ((unsigned) pa_atomic_load(&b->next_job) < b->n_jobs &&
+            (job = (unsigned) pa_atomic_inc(&b->next_job)) < b->n_jobs)
+            break;
+
+    pa_mutex_unlock(p->mutex);
+
+    if (!b)
+        return false;
+
+    b->cb(b->userdata, job);
+    finish_job(b);
+
+    return true;
+}
+
+static void thread_func(void *userdata) {
+    pa_workpool *p = userdata;
+
+    pa_assert(p);
+
+    if (p->rtprio > 0)
+        pa_make_realtime(p->rtprio);
+
+    for (;;) {
+        pa_semaphore_wait(p->semaphore);
+
+        if (pa_atomic_load(&p->quit))
+            break;
+
+        while (run_job(p))
+            ;
+    }
+}
+
+pa_workpool *pa_workpool_new(unsigned n_threads, int rtprio) {
+    pa_workpool *p;
+    unsigned i;
+
+    p = pa_xnew0(pa_workpool, 1);
+    p->rtprio = rtprio;
+    p->mutex = pa_mutex_new(false, true);
+    p->semaphore = pa_semaphore_new(0);
+    pa_atomic_store(&p->quit, 0);
+    PA_LLIST_HEAD_INIT(struct batch, p->batches);
+
+    p->threads = pa_xnew0(pa_thread*, PA_MAX(n_threads, 1U));
+
+    for (i = 0; i < n_threads; i++) {
+        char *name;
+
+        name = pa_sprintf_malloc("dsp-worker-%u", i);
+        p->threads[p->n_threads] = pa_thread_new(name, thread_func, p);
+        pa_xfree(name);
+
+        if (!p->threads[p->n_threads]) {
+            pa_log_warn("Failed to create DSP worker thread.");
+            break;
+        }
+
+        p->n_threads++;
+    }
+
+    pa_log_debug("Created DSP worker pool with %u threads.", p->n_threads);
+
+    return p;
+}
+
+void pa_workpool_free(pa_workpool *p) {
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(!p->batches);
+
+    pa_atomic_store(&p->quit, 1);
+
+    for (i = 0; i < p->n_threads; i++)
+        pa_semaphore_post(p->semaphore);
+
+    for (i = 0; i < p->n_threads; i++)
+        pa_thread_free(p->threads[i]);
+
+    pa_xfree(p->threads);
+    pa_semaphore_free(p->semaphore);
+    pa_mutex_free(p->mutex);
+    pa_xfree(p);
+}
+
+unsigned pa_workpool_get_n_threads(pa_workpool *p) {
+    pa_assert(p);
+
+    return p->n_threads;
+}
+
+void pa_workpool_run(pa_workpool *p, unsigned n_jobs, pa_workpool_job_cb_t cb, void *userdata) {
+    struct batch b;
+    unsigned i, job;
+
+    pa_assert(p);
+    pa_assert(cb);
+
+    if (n_jobs <= 1 || p->n_threads == 0) {
+        for (i = 0; i < n_jobs; i++)
+            cb(userdata, i);
+
+        return;
+    }
+
+    b.cb = cb;
+    b.userdata = userdata;
+    b.n_jobs = n_jobs;
+    pa_atomic_store(&b.next_job, 0);
+    pa_atomic_store(&b.done, 0);
+
+    if (!(b.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
+        b.semaphore = pa_semaphore_new(0);
+
+    pa_mutex_lock(p->mutex);
+    PA_LLIST_PREPEND(struct batch, p->batches, &b);
+    pa_mutex_unlock(p->mutex);
+
+    /* The calling thread takes one job itself */
+    for (i = 0; i < PA_MIN(n_jobs - 1, p->n_threads); i++)
+        pa_semaphore_post(p->semaphore);
+
+    while ((job = (unsigned) pa_atomic_inc(&b.next_job)) < n_jobs) {
+        cb(userdata, job);
+        finish_job(&b);
+    }
+
+    /* Nobody can take a job of ours any more, wait for the ones still
+     * running on the workers */
+    pa_mutex_lock(p->mutex);
+    PA_LLIST_REMOVE(struct batch, p->batches, &b);
+    pa_mutex_unlock(p->mutex);
+
+    pa_semaphore_wait(b.semaphore);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(semaphores), b.semaphore) < 0)
+        pa_semaphore_free(b.semaphore);
+}
@@ -0,0 +1,45 @@
+#ifndef foopulseworkpoolhfoo
+#define foopulseworkpoolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* A pool of worker threads that IO threads can hand DSP work to. The
+ * work of one period is split into a batch of independent jobs, which
+ * the calling thread runs together with whatever workers are idle. Idle
+ * workers take jobs from any batch that has some left, so the load of
+ * several IO threads spreads over all workers. pa_workpool_run() only
+ * returns once every job of its batch is done, hence the work is still
+ * complete by the time the sink needs the data. */
+
+typedef struct pa_workpool pa_workpool;
+
+/* Called with the index of the job, from 0 to n_jobs - 1 */
+typedef void (*pa_workpool_job_cb_t)(void *userdata, unsigned job);
+
+/* A pool without threads runs all jobs in the calling thread. If rtprio
+ * is positive the workers try to get real-time scheduling with it. */
+pa_workpool *pa_workpool_new(unsigned n_threads, int rtprio);
+void pa_workpool_free(pa_workpool *p);
+
+unsigned pa_workpool_get_n_threads(pa_workpool *p);
+
+/* Runs cb for n_jobs jobs and waits for all of them. To be called from
+ * IO threads; jobs must not call it themselves. */
+void pa_workpool_run(pa_workpool *p, unsigned n_jobs, pa_workpool_job_cb_t cb, void *userdata);
+
+#endif
@@ -0,0 +1,34 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xmalloc-stats.h"
+
+#ifdef XMALLOC_STATS
+pa_xmalloc_stat pa_xmalloc_stats;
+#endif
+
+const pa_xmalloc_stat *pa_xmalloc_get_stat(void) {
+#ifdef XMALLOC_STATS
+    return &pa_xmalloc_stats;
+#else
+    return NULL;
+#endif
+}
@@ -0,0 +1,44 @@
+#ifndef fooxmallocstatshfoo
+#define fooxmallocstatshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include <pulsecore/atomic.h>
+
+/* Counts of the calls to pa_xmalloc() and friends, for benchmarks that
+ * want to know how many heap allocations an operation takes. Only kept
+ * when configured with --enable-xmalloc-stats. xmalloc.c is built into
+ * both libpulse and libpulsecommon, the counters live in libpulsecommon
+ * only, so that both copies count into the same place. */
+
+typedef struct pa_xmalloc_stat {
+    pa_atomic_t n_allocs; /* pa_xmalloc(), pa_xmalloc0() and everything built on them */
+    pa_atomic_t n_reallocs;
+    pa_atomic_t n_frees;
+} pa_xmalloc_stat;
+
+#ifdef XMALLOC_STATS
+extern pa_xmalloc_stat pa_xmalloc_stats;
+#endif
+
+/* Returns NULL unless configured with --enable-xmalloc-stats */
+const pa_xmalloc_stat *pa_xmalloc_get_stat(void);
+
+#endif
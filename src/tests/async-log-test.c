@@ -0,0 +1,117 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+
+#define N_MESSAGES 10000
+
+static char *log_file = NULL;
+
+static unsigned count_lines(const char *needle) {
+    FILE *f;
+    char line[256];
+    unsigned n = 0;
+
+    pa_assert_se(f = fopen(log_file, "r"));
+
+    while (fgets(line, sizeof(line), f))
+        if (strstr(line, needle))
+            n++;
+
+    fclose(f);
+    return n;
+}
+
+static void thread_func(void *userdata) {
+    unsigned i;
+
+    for (i = 0; i < N_MESSAGES; i++)
+        pa_log_debug("async message %u", i);
+}
+
+START_TEST (async_log_test) {
+    pa_log_target *t;
+    pa_thread *thread;
+    unsigned n;
+    int fd;
+
+    log_file = pa_xstrdup("/tmp/async-log-test-XXXXXX");
+    fail_unless((fd = mkstemp(log_file)) >= 0);
+    pa_close(fd);
+
+    t = pa_log_target_new(PA_LOG_FILE, log_file);
+    fail_unless(pa_log_set_target(t) == 0);
+    pa_log_target_free(t);
+    pa_log_set_level(PA_LOG_DEBUG);
+
+    fail_unless(pa_log_start_async() == 0);
+
+    /* The thread that made logging asynchronous still logs synchronously */
+    pa_log_debug("sync message");
+    fail_unless(count_lines("sync message") == 1);
+
+    fail_unless(thread = pa_thread_new("async-log-test", thread_func, NULL));
+    pa_thread_free(thread);
+
+    pa_log_stop_async();
+
+    /* Every message was either written or counted as dropped */
+    n = count_lines("async message");
+    pa_log_set_target(&(pa_log_target) { .type = PA_LOG_STDERR, .file = NULL });
+    pa_log_debug("%u messages written, %u dropped", n, pa_log_get_async_dropped());
+
+    fail_unless(n > 0);
+    fail_unless(n + pa_log_get_async_dropped() == N_MESSAGES);
+
+    unlink(log_file);
+    pa_xfree(log_file);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Async Log");
+    tc = tcase_create("async-log");
+    tcase_add_test(tc, async_log_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
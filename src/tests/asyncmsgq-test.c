@@ -26,6 +26,7 @@
 #include <check.h>
 
 #include <pulsecore/asyncmsgq.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -105,6 +106,174 @@ START_TEST (asyncmsgq_test) {
 }
 END_TEST
 
+#define N_WRITERS 4
+#define N_MESSAGES 10000
+
+static pa_atomic_t done_count = PA_ATOMIC_INIT(0);
+
+static void check_done(int ret, void *userdata) {
+    fail_unless(ret == PA_PTR_TO_INT(userdata));
+    pa_atomic_inc(&done_count);
+}
+
+struct writer {
+    pa_asyncmsgq *q;
+    int id;
+    pa_thread *thread;
+};
+
+static void writer_thread(void *userdata) {
+    struct writer *w = userdata;
+    pa_asyncmsgq *q = w->q;
+    int i, id = w->id;
+
+    for (i = 0; i < N_MESSAGES; i++) {
+        /* Every writer's messages must come out in order */
+        if (i % 2)
+            pa_asyncmsgq_send_async(q, NULL, id, PA_INT_TO_PTR(i), 0, NULL, NULL, check_done, PA_INT_TO_PTR(id + i));
+        else
+            pa_asyncmsgq_post(q, NULL, id, PA_INT_TO_PTR(i), 0, NULL, NULL);
+
+        if (i % 1000 == 0)
+            pa_asyncmsgq_send(q, NULL, id, PA_INT_TO_PTR(-1), 0, NULL);
+    }
+
+    /* Nobody polls the write side here, this makes sure nothing is left
+     * queued locally */
+    pa_asyncmsgq_send(q, NULL, id, PA_INT_TO_PTR(-2), 0, NULL);
+}
+
+START_TEST (asyncmsgq_writers_test) {
+    pa_asyncmsgq *q;
+    struct writer w[N_WRITERS];
+    int next[N_WRITERS], i, finished = 0;
+
+    q = pa_asyncmsgq_new(0);
+    fail_unless(q != NULL);
+
+    for (i = 0; i < N_WRITERS; i++) {
+        next[i] = 0;
+        w[i].q = q;
+        w[i].id = i;
+        fail_unless((w[i].thread = pa_thread_new("writer", writer_thread, &w[i])) != NULL);
+    }
+
+    while (finished < N_WRITERS) {
+        int code;
+        void *data;
+
+        fail_unless(pa_asyncmsgq_get(q, NULL, &code, &data, NULL, NULL, true) == 0);
+        fail_unless(code >= 0 && code < N_WRITERS);
+
+        if (PA_PTR_TO_INT(data) >= 0) {
+            fail_unless(PA_PTR_TO_INT(data) == next[code]);
+            next[code]++;
+        } else if (PA_PTR_TO_INT(data) == -2) {
+            fail_unless(next[code] == N_MESSAGES);
+            finished++;
+        }
+
+        pa_asyncmsgq_done(q, code + PA_PTR_TO_INT(data));
+    }
+
+    for (i = 0; i < N_WRITERS; i++)
+        pa_thread_free(w[i].thread);
+
+    fail_unless(pa_atomic_load(&done_count) == N_WRITERS * N_MESSAGES / 2);
+
+    pa_asyncmsgq_unref(q);
+}
+END_TEST
+
+#define N_QUEUES 3
+
+typedef struct batch_object {
+    pa_msgobject parent;
+    int next;
+} batch_object;
+
+PA_DEFINE_PRIVATE_CLASS(batch_object, pa_msgobject);
+#define BATCH_OBJECT(o) (batch_object_cast(o))
+
+static int batch_object_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    batch_object *b = BATCH_OBJECT(o);
+
+    /* Messages for the same queue come out in order */
+    fail_unless(PA_PTR_TO_INT(data) == b->next);
+    b->next++;
+
+    return code + (int) offset;
+}
+
+static void dispatch_thread(void *_q) {
+    pa_asyncmsgq *q = _q;
+
+    for (;;) {
+        pa_msgobject *o;
+        int code;
+        void *data;
+        int64_t offset;
+        pa_memchunk chunk;
+
+        pa_assert_se(pa_asyncmsgq_get(q, &o, &code, &data, &offset, &chunk, true) == 0);
+
+        if (code == QUIT) {
+            pa_asyncmsgq_done(q, 0);
+            break;
+        }
+
+        pa_asyncmsgq_done(q, pa_asyncmsgq_dispatch(o, code, data, offset, &chunk));
+    }
+}
+
+START_TEST (asyncmsgq_send_many_test) {
+    pa_asyncmsgq *q[N_QUEUES];
+    pa_thread *t[N_QUEUES];
+    batch_object *o[N_QUEUES];
+    pa_asyncmsgq_batch_item items[4 * N_QUEUES];
+    int i;
+
+    for (i = 0; i < N_QUEUES; i++) {
+        fail_unless((q[i] = pa_asyncmsgq_new(0)) != NULL);
+        fail_unless((t[i] = pa_thread_new("dispatch", dispatch_thread, q[i])) != NULL);
+
+        o[i] = pa_msgobject_new(batch_object);
+        o[i]->parent.process_msg = batch_object_process_msg;
+        o[i]->next = 0;
+    }
+
+    /* Interleaved, so each queue gets one message carrying several */
+    for (i = 0; i < 4 * N_QUEUES; i++) {
+        items[i].q = q[i % N_QUEUES];
+        items[i].object = PA_MSGOBJECT(o[i % N_QUEUES]);
+        items[i].code = OPERATION_A;
+        items[i].userdata = PA_INT_TO_PTR(i / N_QUEUES);
+        items[i].offset = i;
+    }
+
+    /* Drop the second message of the first queue */
+    items[N_QUEUES].object = NULL;
+    items[2 * N_QUEUES].userdata = PA_INT_TO_PTR(1);
+    items[3 * N_QUEUES].userdata = PA_INT_TO_PTR(2);
+
+    pa_asyncmsgq_send_many(items, 4 * N_QUEUES);
+
+    for (i = 0; i < 4 * N_QUEUES; i++)
+        fail_unless(items[i].ret == (i == N_QUEUES ? 0 : OPERATION_A + i));
+
+    fail_unless(o[0]->next == 3);
+    fail_unless(o[1]->next == 4);
+    fail_unless(o[2]->next == 4);
+
+    for (i = 0; i < N_QUEUES; i++) {
+        pa_asyncmsgq_send(q[i], NULL, QUIT, NULL, 0, NULL);
+        pa_thread_free(t[i]);
+        pa_asyncmsgq_unref(q[i]);
+        pa_msgobject_unref(PA_MSGOBJECT(o[i]));
+    }
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -114,6 +283,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Message Queue");
     tc = tcase_create("asyncmsgq");
     tcase_add_test(tc, asyncmsgq_test);
+    tcase_add_test(tc, asyncmsgq_writers_test);
+    tcase_add_test(tc, asyncmsgq_send_many_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
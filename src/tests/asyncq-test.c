@@ -87,6 +87,36 @@ START_TEST (asyncq_test) {
 }
 END_TEST
 
+START_TEST (asyncq_growth_test) {
+    pa_asyncq *q;
+    unsigned i;
+
+    /* 4 + 8 + 16 entries, a fourth segment would not fit anymore */
+    q = pa_asyncq_new_full(4, 40);
+    fail_unless(q != NULL);
+
+    for (i = 0; i < 28; i++)
+        fail_unless(pa_asyncq_push(q, PA_UINT_TO_PTR(i+1), false) == 0);
+
+    fail_unless(pa_asyncq_push(q, PA_UINT_TO_PTR(29), false) < 0);
+    fail_unless(pa_asyncq_get_overflows(q) == 1);
+
+    /* The writer continues in the last segment once the reader has
+     * emptied the first two and taken something from the last one */
+    for (i = 0; i < 13; i++)
+        fail_unless(pa_asyncq_pop(q, false) == PA_UINT_TO_PTR(i+1));
+
+    fail_unless(pa_asyncq_push(q, PA_UINT_TO_PTR(29), false) == 0);
+
+    for (i = 13; i < 29; i++)
+        fail_unless(pa_asyncq_pop(q, false) == PA_UINT_TO_PTR(i+1));
+
+    fail_unless(pa_asyncq_pop(q, false) == NULL);
+
+    pa_asyncq_free(q, NULL);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -96,6 +126,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Queue");
     tc = tcase_create("asyncq");
     tcase_add_test(tc, asyncq_test);
+    tcase_add_test(tc, asyncq_growth_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
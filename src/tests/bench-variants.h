@@ -0,0 +1,69 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+***/
+
+#ifndef foobenchvariantshfoo
+#define foobenchvariantshfoo
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* The benchmark tools take comma separated lists of option values and
+ * run every combination, or let their inputs take turns in using them.
+ * Define MAX_VARIANTS before including this for longer lists. */
+
+#ifndef MAX_VARIANTS
+#define MAX_VARIANTS 16
+#endif
+
+typedef struct variants {
+    char *values[MAX_VARIANTS];
+    unsigned n;
+} variants;
+
+/* Replaces the values with the ones in s. Fails on an empty list or on
+ * more than MAX_VARIANTS values. */
+static inline int variants_parse(variants *v, const char *s) {
+    const char *state = NULL;
+    char *item;
+
+    while (v->n > 0)
+        pa_xfree(v->values[--v->n]);
+
+    while ((item = pa_split(s, ",", &state))) {
+        if (v->n >= MAX_VARIANTS) {
+            pa_xfree(item);
+            return -1;
+        }
+
+        v->values[v->n++] = item;
+    }
+
+    return v->n > 0 ? 0 : -1;
+}
+
+/* Wraps around, for taking turns */
+static inline const char *variants_get(const variants *v, unsigned i) {
+    pa_assert(v->n > 0);
+
+    return v->values[i % v->n];
+}
+
+static inline void variants_done(variants *v) {
+    while (v->n > 0)
+        pa_xfree(v->values[--v->n]);
+}
+
+#endif
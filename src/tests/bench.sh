@@ -0,0 +1,148 @@
+#!/bin/sh
+#
+# Runs the benchmarking tests with fixed test data, collects their
+# timings as JSON and compares them with the results of an earlier run.
+#
+#   bench.sh [--output=FILE] [--baseline=FILE] [--tolerance=PERCENT]
+#            [--seed=N] TEST...
+#
+# Every TEST is either a test using runtime-test-util.h or render-bench.
+# The results go to FILE (bench.json by default), a JSON array with one
+# object per timed loop. Given a baseline, i.e. the output of a known
+# good build on the same machine, every loop that got more than PERCENT
+# (10 by default) slower is a regression and makes the script fail.
+#
+
+SCRIPTNAME="$0"
+
+OUTPUT=bench.json
+BASELINE=
+TOLERANCE=10
+SEED=1
+
+die()
+{
+    echo $SCRIPTNAME: $* >&2
+    exit 1
+}
+
+while test $# -gt 0; do
+    case "$1" in
+        --output=*)
+            OUTPUT="${1#--output=}" ;;
+        --baseline=*)
+            BASELINE="${1#--baseline=}" ;;
+        --tolerance=*)
+            TOLERANCE="${1#--tolerance=}" ;;
+        --seed=*)
+            SEED="${1#--seed=}" ;;
+        --)
+            shift
+            break ;;
+        -*)
+            die "Unknown option $1" ;;
+        *)
+            break ;;
+    esac
+    shift
+done
+
+test $# -gt 0 || die "No tests given"
+test -z "$BASELINE" || test -r "$BASELINE" || die "Can't read the baseline $BASELINE"
+
+RESULTS=`mktemp` || die "Failed to create a temporary file"
+trap 'rm -f "$RESULTS"' 0
+trap 'die "Received SIGINT"' INT
+
+EXIT_CODE=0
+
+for ONE_TEST in "$@"; do
+    echo "Running $ONE_TEST" >&2
+
+    case "$ONE_TEST" in
+        render-bench)
+            # Prints a single line of key=value pairs per run
+            for FILTERS in 0 2; do
+                LINE=`render-bench --inputs=8 --filters=$FILTERS --periods=2000` || { EXIT_CODE=1; continue; }
+                echo "$LINE" | awk '
+                    { for (i = 1; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] } }
+                    END {
+                        printf "{\"name\": \"render-bench/inputs=%s filters=%s\", \"iterations\": %s, \"usec_per_iteration\": %.4f}\n",
+                               v["inputs"], v["filters"], v["periods"], v["ns_per_period"] / 1000
+                    }' >> "$RESULTS"
+            done ;;
+        *)
+            # Without forking the loops of a test are numbered the same
+            # in every run
+            PA_BENCH_JSON="$RESULTS" PA_BENCH_SEED="$SEED" CK_FORK=no MAKE_CHECK=1 \
+                "$ONE_TEST" > /dev/null || EXIT_CODE=1 ;;
+    esac
+done
+
+awk '
+    BEGIN { print "[" }
+    NR > 1 { print prev "," }
+    { prev = "  " $0 }
+    END { if (NR > 0) print prev; print "]" }' "$RESULTS" > "$OUTPUT" || die "Failed to write $OUTPUT"
+
+echo "Results written to $OUTPUT" >&2
+
+# Both files have one result per line, so no real JSON parser is needed
+FIELD='
+    function field(line, key,    v) {
+        if (!match(line, "\"" key "\": (\"[^\"]*\"|[-+.0-9eE]+)"))
+            return ""
+        v = substr(line, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+        gsub(/"/, "", v)
+        return v
+    }'
+
+if test -z "$BASELINE"; then
+    awk "$FIELD"'
+        (n = field($0, "name")) != "" {
+            printf "%-64s %12.4f usec\n", n, field($0, "usec_per_iteration")
+        }' "$OUTPUT"
+    exit $EXIT_CODE
+fi
+
+awk -v tolerance="$TOLERANCE" "$FIELD"'
+    FNR == NR {
+        if ((n = field($0, "name")) != "")
+            base[n] = field($0, "usec_per_iteration")
+        next
+    }
+
+    (n = field($0, "name")) != "" {
+        v = field($0, "usec_per_iteration")
+
+        if (!(n in base)) {
+            printf "%-64s %12s %12.4f          new\n", n, "-", v
+            next
+        }
+
+        seen[n] = 1
+        change = base[n] > 0 ? (v - base[n]) * 100 / base[n] : 0
+
+        if (change > tolerance) {
+            status = "REGRESSION"
+            regressions++
+        } else if (change < -tolerance)
+            status = "faster"
+        else
+            status = "ok"
+
+        printf "%-64s %12.4f %12.4f %+7.1f%% %s\n", n, base[n], v, change, status
+        compared++
+    }
+
+    END {
+        for (n in base)
+            if (!(n in seen))
+                printf "%-64s %12.4f %12s          missing\n", n, base[n], "-"
+
+        printf "%d of %d results more than %s%% slower than the baseline\n",
+               regressions, compared, tolerance
+        exit regressions > 0
+    }' "$BASELINE" "$OUTPUT" || EXIT_CODE=1
+
+exit $EXIT_CODE
@@ -26,14 +26,30 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <getopt.h>
+#include <sys/resource.h>
 
 #include <check.h>
 
 #include <pulse/pulseaudio.h>
 #include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
 
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/i18n.h>
+#include <pulsecore/macro.h>
 #include <pulsecore/sink.h>
 
+/* Without arguments this is the connect/disconnect stress test run by
+ * test-daemon.sh. With arguments it turns into a load generator instead:
+ * it keeps a configurable number of clients connected to a running daemon
+ * at the same time, each running one of a mix of workloads, and reports
+ * the connect latency, command round trip times and the CPU time the
+ * daemon spent. The daemon accepts 64 clients unless the native protocol
+ * module is loaded with a larger max-connections= argument. */
+
 /* Set the number of streams such that it allows two simultaneous instances of
  * connect-stress to be run and not go above the max limit for streams-per-sink.
  * This leaves enough room for a couple other streams from regular system usage,
@@ -63,7 +79,7 @@ static const pa_sample_spec sample_spec = {
 
 static void context_state_callback(pa_context *c, void *userdata);
 
-static void connect(const char *name, int *try) {
+static void connect_context(const char *name, int *try) {
     int ret;
     pa_mainloop_api *api;
 
@@ -201,7 +217,7 @@ START_TEST (connect_stress_test) {
         streams[i] = NULL;
 
     for (i = 0; i < NTESTS; i++) {
-        connect(bname, &i);
+        connect_context(bname, &i);
         usleep(rand() % 500000);
         disconnect();
         usleep(rand() % 500000);
@@ -211,6 +227,684 @@ START_TEST (connect_stress_test) {
 }
 END_TEST
 
+
+/* Load generator */
+
+enum workload {
+    WORKLOAD_PLAYBACK,
+    WORKLOAD_RECORD,
+    WORKLOAD_INTROSPECT,
+    WORKLOAD_SUBSCRIBE,
+    WORKLOAD_MAX
+};
+
+static const char * const workload_names[WORKLOAD_MAX] = {
+    [WORKLOAD_PLAYBACK] = "playback",
+    [WORKLOAD_RECORD] = "record",
+    [WORKLOAD_INTROSPECT] = "introspect",
+    [WORKLOAD_SUBSCRIBE] = "subscribe",
+};
+
+struct samples {
+    pa_usec_t *values;
+    unsigned n, size;
+};
+
+struct client {
+    unsigned index;
+    enum workload workload;
+
+    pa_context *context;
+    pa_stream *stream;
+    pa_time_event *timer;
+    pa_operation *operation;
+
+    pa_usec_t connect_start;
+    pa_usec_t operation_start;
+};
+
+static struct {
+    pa_mainloop_api *api;
+    const char *server;
+    pa_usec_t interval;
+    bool measuring;
+
+    struct client *clients;
+    unsigned n_clients, n_started;
+    unsigned n_ready, n_connect_failed, n_disconnected, n_stream_failed;
+    uint64_t n_events, bytes_written, bytes_read;
+
+    struct samples connect, ping, introspect;
+} load;
+
+static void samples_add(struct samples *s, pa_usec_t value) {
+    if (s->n >= s->size) {
+        s->size = PA_MAX(s->size * 2, 1024U);
+        s->values = pa_xrenew(pa_usec_t, s->values, s->size);
+    }
+
+    s->values[s->n++] = value;
+}
+
+static int usec_compare(const void *a, const void *b) {
+    pa_usec_t x = *(const pa_usec_t*) a, y = *(const pa_usec_t*) b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static pa_usec_t samples_percentile(struct samples *s, unsigned percent) {
+    unsigned i;
+
+    i = (unsigned) (((uint64_t) s->n * percent) / 100);
+
+    return s->values[PA_MIN(i, s->n - 1)];
+}
+
+static void samples_print(const char *name, struct samples *s) {
+    if (s->n == 0) {
+        printf("%s_usec count=0\n", name);
+        return;
+    }
+
+    qsort(s->values, s->n, sizeof(pa_usec_t), usec_compare);
+
+    printf("%s_usec count=%u p50=%llu p90=%llu p99=%llu max=%llu\n", name, s->n,
+           (unsigned long long) samples_percentile(s, 50),
+           (unsigned long long) samples_percentile(s, 90),
+           (unsigned long long) samples_percentile(s, 99),
+           (unsigned long long) s->values[s->n - 1]);
+}
+
+static void client_schedule(struct client *cl, pa_usec_t delay);
+
+static void operation_done(struct client *cl, struct samples *s) {
+    if (load.measuring)
+        samples_add(s, pa_rtclock_now() - cl->operation_start);
+
+    pa_operation_unref(cl->operation);
+    cl->operation = NULL;
+
+    client_schedule(cl, load.interval);
+}
+
+static void server_info_cb(pa_context *c, const pa_server_info *i, void *userdata) {
+    operation_done(userdata, &load.ping);
+}
+
+static void sink_input_info_cb(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) {
+    if (eol)
+        operation_done(userdata, &load.introspect);
+}
+
+/* Introspection clients list all sink inputs, whose number grows with
+ * the playback clients, everybody else asks for the server info as a
+ * cheap round trip under load */
+static void client_timer_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    struct client *cl = userdata;
+
+    pa_assert(!cl->operation);
+
+    cl->operation_start = pa_rtclock_now();
+
+    if (cl->workload == WORKLOAD_INTROSPECT)
+        cl->operation = pa_context_get_sink_input_info_list(cl->context, sink_input_info_cb, cl);
+    else
+        cl->operation = pa_context_get_server_info(cl->context, server_info_cb, cl);
+
+    pa_assert(cl->operation);
+}
+
+static void client_schedule(struct client *cl, pa_usec_t delay) {
+    struct timeval tv;
+
+    pa_timeval_rtstore(&tv, pa_rtclock_now() + delay, true);
+
+    if (cl->timer)
+        load.api->time_restart(cl->timer, &tv);
+    else
+        cl->timer = load.api->time_new(load.api, &tv, client_timer_cb, cl);
+}
+
+static void load_write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    while (nbytes > 0) {
+        void *data;
+        size_t n = nbytes;
+
+        if (pa_stream_begin_write(s, &data, &n) < 0 || n == 0)
+            break;
+
+        memset(data, 0, n);
+        pa_stream_write(s, data, n, NULL, 0, PA_SEEK_RELATIVE);
+
+        load.bytes_written += n;
+        nbytes -= PA_MIN(n, nbytes);
+    }
+}
+
+static void load_read_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    const void *data;
+    size_t n;
+
+    while (pa_stream_readable_size(s) > 0) {
+        if (pa_stream_peek(s, &data, &n) < 0 || n == 0)
+            break;
+
+        load.bytes_read += n;
+        pa_stream_drop(s);
+    }
+}
+
+static void load_stream_state_cb(pa_stream *s, void *userdata) {
+    if (pa_stream_get_state(s) == PA_STREAM_FAILED)
+        load.n_stream_failed++;
+}
+
+static void subscribe_cb(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    load.n_events++;
+}
+
+static void client_start_workload(struct client *cl) {
+    char name[64];
+    pa_operation *o;
+
+    switch (cl->workload) {
+        case WORKLOAD_PLAYBACK:
+        case WORKLOAD_RECORD:
+            pa_snprintf(name, sizeof(name), "%s #%u", workload_names[cl->workload], cl->index);
+            pa_assert_se(cl->stream = pa_stream_new(cl->context, name, &sample_spec, NULL));
+            pa_stream_set_state_callback(cl->stream, load_stream_state_cb, cl);
+
+            if (cl->workload == WORKLOAD_PLAYBACK) {
+                pa_stream_set_write_callback(cl->stream, load_write_cb, cl);
+                pa_stream_connect_playback(cl->stream, NULL, NULL, 0, NULL, NULL);
+            } else {
+                pa_stream_set_read_callback(cl->stream, load_read_cb, cl);
+                pa_stream_connect_record(cl->stream, NULL, NULL, 0);
+            }
+            break;
+
+        case WORKLOAD_SUBSCRIBE:
+            pa_context_set_subscribe_callback(cl->context, subscribe_cb, cl);
+            if ((o = pa_context_subscribe(cl->context, PA_SUBSCRIPTION_MASK_ALL, NULL, NULL)))
+                pa_operation_unref(o);
+            break;
+
+        case WORKLOAD_INTROSPECT:
+        case WORKLOAD_MAX:
+            break;
+    }
+
+    /* Spread the round trips of the clients over the interval */
+    client_schedule(cl, (pa_usec_t) rand() % load.interval);
+}
+
+static void load_context_state_cb(pa_context *c, void *userdata) {
+    struct client *cl = userdata;
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_READY:
+            load.n_ready++;
+            samples_add(&load.connect, pa_rtclock_now() - cl->connect_start);
+            client_start_workload(cl);
+            break;
+
+        case PA_CONTEXT_FAILED:
+            if (cl->connect_start) {
+                pa_log_debug("Client %u failed: %s", cl->index, pa_strerror(pa_context_errno(c)));
+
+                if (cl->timer || cl->stream)
+                    load.n_disconnected++;
+                else
+                    load.n_connect_failed++;
+            }
+
+            /* Don't ping a dead context */
+            if (cl->timer) {
+                load.api->time_free(cl->timer);
+                cl->timer = NULL;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void client_connect(struct client *cl) {
+    char name[64];
+
+    pa_snprintf(name, sizeof(name), "connect-stress #%u", cl->index);
+    pa_assert_se(cl->context = pa_context_new(load.api, name));
+    pa_context_set_state_callback(cl->context, load_context_state_cb, cl);
+
+    cl->connect_start = pa_rtclock_now();
+
+    if (pa_context_connect(cl->context, load.server, PA_CONTEXT_NOAUTOSPAWN, NULL) < 0) {
+        pa_log_debug("Client %u failed to connect: %s", cl->index, pa_strerror(pa_context_errno(cl->context)));
+        load.n_connect_failed++;
+    }
+}
+
+static void client_free(struct client *cl) {
+    if (cl->timer)
+        load.api->time_free(cl->timer);
+
+    if (cl->operation) {
+        pa_operation_cancel(cl->operation);
+        pa_operation_unref(cl->operation);
+    }
+
+    if (cl->stream) {
+        pa_stream_set_state_callback(cl->stream, NULL, NULL);
+        pa_stream_disconnect(cl->stream);
+        pa_stream_unref(cl->stream);
+    }
+
+    if (cl->context) {
+        pa_context_set_state_callback(cl->context, NULL, NULL);
+        pa_context_disconnect(cl->context);
+        pa_context_unref(cl->context);
+    }
+}
+
+/* Starts up to batch clients, then comes back a little later for the
+ * next batch until all are started */
+static unsigned ramp_batch;
+
+static void ramp_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    struct timeval next;
+    unsigned i;
+
+    for (i = 0; i < ramp_batch && load.n_started < load.n_clients; i++)
+        client_connect(&load.clients[load.n_started++]);
+
+    if (load.n_started < load.n_clients)
+        a->time_restart(e, pa_timeval_rtstore(&next, pa_rtclock_now() + 10 * PA_USEC_PER_MSEC, true));
+    else {
+        a->time_free(e);
+        pa_log_info("All %u clients started.", load.n_clients);
+    }
+}
+
+static void quit_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    load.measuring = false;
+    a->quit(a, 0);
+}
+
+/* User plus system time of a process in clock ticks, from /proc */
+static int cpu_ticks(pid_t pid, uint64_t *ticks) {
+    char fn[64], line[1024], *p;
+    unsigned long long utime, stime;
+    FILE *f;
+
+    pa_snprintf(fn, sizeof(fn), "/proc/%lu/stat", (unsigned long) pid);
+
+    if (!(f = pa_fopen_cloexec(fn, "r")))
+        return -1;
+
+    p = fgets(line, sizeof(line), f);
+    fclose(f);
+
+    /* The command name in parentheses may contain spaces, the fields
+     * we're interested in are the 12th and 13th after it */
+    if (!p || !(p = strrchr(line, ')')))
+        return -1;
+
+    if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+        return -1;
+
+    *ticks = utime + stime;
+    return 0;
+}
+
+static pid_t daemon_pid_from_runtime_dir(void) {
+    char *fn, line[32];
+    uint32_t pid = 0;
+    FILE *f;
+
+    if (!(fn = pa_runtime_path("pid")))
+        return 0;
+
+    if ((f = pa_fopen_cloexec(fn, "r"))) {
+        if (fgets(line, sizeof(line), f))
+            pa_atou(pa_strip_nl(line), &pid);
+        fclose(f);
+    }
+
+    pa_xfree(fn);
+
+    return (pid_t) pid;
+}
+
+static int parse_mix(const char *s, unsigned weights[WORKLOAD_MAX]) {
+    const char *state = NULL;
+    char *item;
+    int ret = 0;
+
+    memset(weights, 0, sizeof(unsigned) * WORKLOAD_MAX);
+
+    while (ret == 0 && (item = pa_split(s, ",", &state))) {
+        char *eq;
+        unsigned w;
+
+        ret = -1;
+
+        if ((eq = strchr(item, '='))) {
+            *eq = 0;
+
+            for (w = 0; w < WORKLOAD_MAX; w++)
+                if (pa_streq(item, workload_names[w]))
+                    break;
+
+            if (w < WORKLOAD_MAX && pa_atou(eq + 1, &weights[w]) >= 0)
+                ret = 0;
+        }
+
+        pa_xfree(item);
+    }
+
+    if (ret == 0) {
+        unsigned w, total = 0;
+
+        for (w = 0; w < WORKLOAD_MAX; w++)
+            total += weights[w];
+
+        if (total == 0)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+/* Goes through the workloads in proportion to their weights, e.g.
+ * playback=3,record=1 gives three playback clients for every record
+ * client */
+static enum workload pick_workload(unsigned i, const unsigned weights[WORKLOAD_MAX]) {
+    unsigned w, total = 0;
+
+    for (w = 0; w < WORKLOAD_MAX; w++)
+        total += weights[w];
+
+    i %= total;
+
+    for (w = 0; w < WORKLOAD_MAX - 1; w++) {
+        if (i < weights[w])
+            break;
+
+        i -= weights[w];
+    }
+
+    return w;
+}
+
+/* libpulse has no switch for the transport but reads its client.conf
+ * from wherever PULSE_CLIENTCONFIG points */
+static char *write_client_conf(const char *transport) {
+    char fn[] = "/tmp/connect-stress-XXXXXX";
+    bool shm, memfd;
+    FILE *f;
+    int fd;
+
+    if (pa_streq(transport, "memfd"))
+        shm = memfd = true;
+    else if (pa_streq(transport, "shm")) {
+        shm = true;
+        memfd = false;
+    } else if (pa_streq(transport, "socket"))
+        shm = memfd = false;
+    else
+        return NULL;
+
+    if ((fd = mkstemp(fn)) < 0 || !(f = fdopen(fd, "w"))) {
+        pa_log("Failed to create client configuration: %s", pa_cstrerror(errno));
+        if (fd >= 0)
+            pa_close(fd);
+        return NULL;
+    }
+
+    fprintf(f, "enable-shm = %s\nenable-memfd = %s\n", pa_yes_no(shm), pa_yes_no(memfd));
+    fclose(f);
+
+    setenv("PULSE_CLIENTCONFIG", fn, 1);
+
+    return pa_xstrdup(fn);
+}
+
+static void help(const char *argv0) {
+    printf(_("%s [options]\n\n"
+             "-h, --help                            Show this help\n"
+             "-v, --verbose                         Print debug messages\n"
+             "-s, --server=SERVER                   The name of the server to connect to\n"
+             "      --clients=N                     Number of concurrent clients (defaults to 100)\n"
+             "      --mix=WORKLOAD=WEIGHT[,...]     Workloads of the clients, out of playback, record,\n"
+             "                                      introspect and subscribe (defaults to an even mix)\n"
+             "      --transport=TRANSPORT           Transport of the audio data: memfd, shm or socket\n"
+             "                                      (defaults to the client configuration)\n"
+             "      --connect-rate=N                Clients started per second (defaults to all at once)\n"
+             "      --interval=MSEC                 Time between the round trips of a client (defaults to 100)\n"
+             "      --duration=SEC                  Length of the run (defaults to 10)\n"
+             "      --daemon-pid=PID                Process to measure the CPU time of (defaults to the\n"
+             "                                      daemon in the runtime directory)\n"
+             "\n"
+             "Without any options the connect/disconnect stress test is run instead.\n"),
+             argv0);
+}
+
+enum {
+    ARG_VERSION = 256,
+    ARG_CLIENTS,
+    ARG_MIX,
+    ARG_TRANSPORT,
+    ARG_CONNECT_RATE,
+    ARG_INTERVAL,
+    ARG_DURATION,
+    ARG_DAEMON_PID
+};
+
+static int load_main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"help",            0, NULL, 'h'},
+        {"verbose",         0, NULL, 'v'},
+        {"version",         0, NULL, ARG_VERSION},
+        {"server",          1, NULL, 's'},
+        {"clients",         1, NULL, ARG_CLIENTS},
+        {"mix",             1, NULL, ARG_MIX},
+        {"transport",       1, NULL, ARG_TRANSPORT},
+        {"connect-rate",    1, NULL, ARG_CONNECT_RATE},
+        {"interval",        1, NULL, ARG_INTERVAL},
+        {"duration",        1, NULL, ARG_DURATION},
+        {"daemon-pid",      1, NULL, ARG_DAEMON_PID},
+        {NULL,              0, NULL, 0}
+    };
+
+    unsigned weights[WORKLOAD_MAX] = { 1, 1, 1, 1 };
+    uint32_t n_clients = 100, connect_rate = 0, interval_msec = 100, duration = 10, pid = 0;
+    unsigned counts[WORKLOAD_MAX] = { 0, 0, 0, 0 };
+    char *conf = NULL;
+    pa_mainloop *m = NULL;
+    pa_time_event *ramp_event;
+    struct timeval tv;
+    struct rlimit rl;
+    struct rusage ru_start, ru_end;
+    uint64_t ticks_start = 0, ticks_end = 0;
+    bool have_ticks;
+    pa_usec_t start, elapsed;
+    double own_start, own_end;
+    long hz;
+    unsigned i;
+    int c, ret = 1;
+
+    pa_zero(load);
+
+    while ((c = getopt_long(argc, argv, "hvs:", long_options, NULL)) != -1) {
+
+        switch (c) {
+            case 'h':
+                help(argv[0]);
+                ret = 0;
+                goto quit;
+
+            case 'v':
+                pa_log_set_level(PA_LOG_DEBUG);
+                break;
+
+            case ARG_VERSION:
+                printf(_("%s %s\n"), argv[0], PACKAGE_VERSION);
+                ret = 0;
+                goto quit;
+
+            case 's':
+                load.server = optarg;
+                break;
+
+            case ARG_CLIENTS:
+                if (pa_atou(optarg, &n_clients) < 0 || n_clients <= 0)
+                    goto invalid;
+                break;
+
+            case ARG_MIX:
+                if (parse_mix(optarg, weights) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_TRANSPORT:
+                pa_xfree(conf);
+                if (!(conf = write_client_conf(optarg)))
+                    goto invalid;
+                break;
+
+            case ARG_CONNECT_RATE:
+                if (pa_atou(optarg, &connect_rate) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_INTERVAL:
+                if (pa_atou(optarg, &interval_msec) < 0 || interval_msec <= 0)
+                    goto invalid;
+                break;
+
+            case ARG_DURATION:
+                if (pa_atou(optarg, &duration) < 0 || duration <= 0)
+                    goto invalid;
+                break;
+
+            case ARG_DAEMON_PID:
+                if (pa_atou(optarg, &pid) < 0 || pid <= 0)
+                    goto invalid;
+                break;
+
+            default:
+                goto quit;
+        }
+    }
+
+    /* Every client needs a socket and, depending on the transport,
+     * descriptors for its memory pool and ring buffer channel */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+
+        if (rl.rlim_cur != RLIM_INFINITY && (rlim_t) n_clients * 4 + 16 > rl.rlim_cur)
+            pa_log_warn("The file descriptor limit of %lu may be too low for %u clients.",
+                        (unsigned long) rl.rlim_cur, n_clients);
+    }
+
+    if (pid == 0 && !load.server)
+        pid = (uint32_t) daemon_pid_from_runtime_dir();
+
+    pa_assert_se(m = pa_mainloop_new());
+    load.api = pa_mainloop_get_api(m);
+    load.interval = interval_msec * PA_USEC_PER_MSEC;
+    load.n_clients = n_clients;
+    load.clients = pa_xnew0(struct client, n_clients);
+
+    for (i = 0; i < n_clients; i++) {
+        load.clients[i].index = i;
+        load.clients[i].workload = pick_workload(i, weights);
+        counts[load.clients[i].workload]++;
+    }
+
+    /* ramp_cb() starts a batch every 10ms */
+    ramp_batch = connect_rate > 0 ? PA_MAX(connect_rate / 100, 1U) : n_clients;
+
+    have_ticks = pid > 0 && cpu_ticks((pid_t) pid, &ticks_start) >= 0;
+    if (pid > 0 && !have_ticks)
+        pa_log_warn("Failed to read the CPU time of process %u.", pid);
+
+    getrusage(RUSAGE_SELF, &ru_start);
+    start = pa_rtclock_now();
+    load.measuring = true;
+
+    ramp_event = load.api->time_new(load.api, pa_timeval_rtstore(&tv, start, true), ramp_cb, NULL);
+    pa_assert(ramp_event);
+    load.api->time_new(load.api, pa_timeval_rtstore(&tv, start + duration * PA_USEC_PER_SEC, true), quit_cb, NULL);
+
+    if (pa_mainloop_run(m, NULL) < 0) {
+        pa_log("pa_mainloop_run() failed.");
+        goto quit;
+    }
+
+    elapsed = pa_rtclock_now() - start;
+    getrusage(RUSAGE_SELF, &ru_end);
+    if (have_ticks)
+        have_ticks = cpu_ticks((pid_t) pid, &ticks_end) >= 0;
+
+    if (load.n_started < load.n_clients)
+        pa_log_warn("Only %u of %u clients were started before the end of the run.", load.n_started, load.n_clients);
+
+    printf("clients=%u started=%u ready=%u connect_failed=%u disconnected=%u stream_failed=%u\n",
+           load.n_clients, load.n_started, load.n_ready, load.n_connect_failed, load.n_disconnected, load.n_stream_failed);
+    printf("mix playback=%u record=%u introspect=%u subscribe=%u\n",
+           counts[WORKLOAD_PLAYBACK], counts[WORKLOAD_RECORD], counts[WORKLOAD_INTROSPECT], counts[WORKLOAD_SUBSCRIBE]);
+
+    samples_print("connect", &load.connect);
+    samples_print("ping", &load.ping);
+    samples_print("introspect", &load.introspect);
+
+    printf("subscribe_events=%llu bytes_written=%llu bytes_read=%llu\n",
+           (unsigned long long) load.n_events, (unsigned long long) load.bytes_written,
+           (unsigned long long) load.bytes_read);
+
+    own_start = ru_start.ru_utime.tv_sec + ru_start.ru_stime.tv_sec +
+        (ru_start.ru_utime.tv_usec + ru_start.ru_stime.tv_usec) / (double) PA_USEC_PER_SEC;
+    own_end = ru_end.ru_utime.tv_sec + ru_end.ru_stime.tv_sec +
+        (ru_end.ru_utime.tv_usec + ru_end.ru_stime.tv_usec) / (double) PA_USEC_PER_SEC;
+    printf("seconds=%0.2f own_cpu_percent=%0.1f", (double) elapsed / PA_USEC_PER_SEC,
+           (own_end - own_start) * 100.0 * PA_USEC_PER_SEC / elapsed);
+
+    if (have_ticks && (hz = sysconf(_SC_CLK_TCK)) > 0)
+        printf(" daemon_cpu_percent=%0.1f", (double) (ticks_end - ticks_start) * 100.0 * PA_USEC_PER_SEC / hz / elapsed);
+
+    printf("\n");
+
+    ret = 0;
+    goto quit;
+
+invalid:
+    pa_log("Invalid argument: %s", optarg);
+
+quit:
+    if (load.clients) {
+        for (i = 0; i < load.n_started; i++)
+            client_free(&load.clients[i]);
+        pa_xfree(load.clients);
+    }
+
+    pa_xfree(load.connect.values);
+    pa_xfree(load.ping.values);
+    pa_xfree(load.introspect.values);
+
+    if (m)
+        pa_mainloop_free(m);
+
+    if (conf) {
+        unlink(conf);
+        pa_xfree(conf);
+    }
+
+    return ret;
+}
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -219,6 +913,9 @@ int main(int argc, char *argv[]) {
 
     bname = argv[0];
 
+    if (argc > 1)
+        return load_main(argc, argv);
+
     s = suite_create("Connect Stress");
     tc = tcase_create("connectstress");
     tcase_add_test(tc, connect_stress_test);
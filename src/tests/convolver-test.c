@@ -0,0 +1,184 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/random.h>
+
+#include <pulsecore/filter/convolver.h>
+
+#define N_FRAMES 2000
+
+static float random_float(void) {
+    unsigned r;
+
+    pa_random(&r, sizeof(r));
+    return (float) (r % 65536) / 32768.0f - 1.0f;
+}
+
+/* Runs the convolver on random input in random sized pieces and checks
+ * it against the direct form, computed in double */
+static void run(unsigned n_in, unsigned n_out, unsigned length, unsigned block) {
+    pa_convolver *c;
+    float *h, *in, *out;
+    unsigned i, o, f, j, done;
+
+    h = pa_xnew(float, n_in * n_out * length);
+    in = pa_xnew(float, n_in * N_FRAMES);
+    out = pa_xnew(float, n_out * N_FRAMES);
+
+    for (j = 0; j < n_in * n_out * length; j++)
+        h[j] = random_float();
+    for (j = 0; j < n_in * N_FRAMES; j++)
+        in[j] = random_float();
+
+    c = pa_convolver_new(n_in, n_out, length, block);
+
+    /* Interleaved by pair, to exercise the stride */
+    for (i = 0; i < n_in; i++)
+        for (o = 0; o < n_out; o++)
+            pa_convolver_set_response(c, i, o, h + i * n_out + o, n_in * n_out);
+
+    for (done = 0; done < N_FRAMES; ) {
+        unsigned n;
+
+        pa_random(&n, sizeof(n));
+        n = PA_MIN(n % (3 * block) + 1, N_FRAMES - done);
+
+        pa_convolver_process(c, in + done * n_in, out + done * n_out, n);
+        done += n;
+    }
+
+    for (f = 0; f < N_FRAMES; f++)
+        for (o = 0; o < n_out; o++) {
+            double sum = 0;
+
+            for (i = 0; i < n_in; i++)
+                for (j = 0; j < length && j <= f; j++)
+                    sum += (double) h[(j * n_in + i) * n_out + o] * in[(f - j) * n_in + i];
+
+            if (fabs(sum - out[f * n_out + o]) > 1e-4 * sqrt(length * n_in) + 1e-5) {
+                pa_log_error("%u inputs, %u outputs, %u taps, block %u: frame %u output %u is %f, expected %f",
+                             n_in, n_out, length, block, f, o, out[f * n_out + o], sum);
+                fail_unless(false);
+            }
+        }
+
+    /* After a reset the past input is gone */
+    pa_convolver_reset(c);
+    pa_convolver_process(c, in, out, 1);
+    for (o = 0; o < n_out; o++) {
+        double sum = 0;
+
+        for (i = 0; i < n_in; i++)
+            sum += (double) h[i * n_out + o] * in[i];
+
+        fail_unless(fabs(sum - out[o]) < 1e-4);
+    }
+
+    pa_convolver_free(c);
+    pa_xfree(h);
+    pa_xfree(in);
+    pa_xfree(out);
+}
+
+START_TEST (convolver_short_test) {
+    run(1, 1, 1, 4);
+    run(2, 2, 5, 8);
+    run(3, 1, 16, 16);
+}
+END_TEST
+
+START_TEST (convolver_partitioned_test) {
+    run(1, 1, 17, 16);
+    run(1, 2, 64, 16);
+    run(3, 2, 200, 16);
+    run(8, 2, 512, 64);
+}
+END_TEST
+
+/* Many stages, most of them spreading their work */
+START_TEST (convolver_stages_test) {
+    run(1, 1, 1000, 4);
+    run(2, 1, 129, 16);
+    run(1, 2, 1500, 32);
+}
+END_TEST
+
+START_TEST (convolver_silent_test) {
+    pa_convolver *c;
+    float h[100], in[2 * 300], out[2 * 300];
+    unsigned j;
+
+    for (j = 0; j < 100; j++)
+        h[j] = random_float();
+    for (j = 0; j < 2 * 300; j++)
+        in[j] = random_float();
+
+    /* The second input has no response and must not leak through */
+    c = pa_convolver_new(2, 1, 100, 32);
+    pa_convolver_set_response(c, 0, 0, h, 1);
+    pa_convolver_set_response(c, 1, 0, NULL, 1);
+    pa_convolver_process(c, in, out, 300);
+
+    for (j = 0; j < 300; j++) {
+        double sum = 0;
+        unsigned k;
+
+        for (k = 0; k < 100 && k <= j; k++)
+            sum += (double) h[k] * in[(j - k) * 2];
+
+        fail_unless(fabs(sum - out[j]) < 1e-3);
+    }
+
+    pa_convolver_free(c);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Convolver");
+    tc = tcase_create("convolver");
+    tcase_add_test(tc, convolver_short_test);
+    tcase_add_test(tc, convolver_partitioned_test);
+    tcase_add_test(tc, convolver_stages_test);
+    tcase_add_test(tc, convolver_silent_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,97 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/cpu.h>
+#include <pulsecore/cpu-autotune.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+START_TEST (cpu_autotune_test) {
+    pa_cpu_info cpu_info;
+    pa_sample_spec ss;
+    char cache[] = "/tmp/cpu-autotune-test-XXXXXX";
+    char *first, *second;
+    int fd;
+
+    fd = mkstemp(cache);
+    fail_unless(fd >= 0);
+    pa_close(fd);
+    pa_assert_se(unlink(cache) == 0);
+
+    pa_zero(cpu_info);
+    pa_cpu_init(&cpu_info);
+
+    ss.format = PA_SAMPLE_S16LE;
+    ss.rate = 44100;
+    ss.channels = 2;
+
+    /* The first run measures and writes the cache */
+    pa_cpu_autotune(&cpu_info, &ss, cache);
+    first = pa_cpu_autotune_selection(&ss);
+    pa_log_debug("Selected: %s", first);
+
+    fail_unless(strstr(first, "mix-s16le=") != NULL);
+    fail_unless(strstr(first, "volume-s16le=") != NULL);
+    fail_unless(strstr(first, "remap=") != NULL);
+    fail_unless(access(cache, R_OK) == 0);
+
+    /* The second one installs the same choice from the cache */
+    pa_cpu_autotune(&cpu_info, &ss, cache);
+    second = pa_cpu_autotune_selection(&ss);
+
+    fail_unless(pa_streq(first, second));
+
+    pa_xfree(first);
+    pa_xfree(second);
+    unlink(cache);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("CPU");
+
+    tc = tcase_create("autotune");
+    tcase_add_test(tc, cpu_autotune_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,9 +20,11 @@
 #endif
 
 #include <check.h>
+#include <math.h>
 
 #include <pulsecore/cpu.h>
 #include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mix.h>
@@ -78,12 +80,12 @@ static void run_mix_test(
 
     fail_unless((pool = pa_mempool_new(false, 0)) != NULL, NULL);
 
-    pa_random(samples0, nsamples * sizeof(int16_t));
+    pa_runtime_test_random(samples0, nsamples * sizeof(int16_t));
     c0.memblock = pa_memblock_new_fixed(pool, samples0, nsamples * sizeof(int16_t), false);
     c0.length = pa_memblock_get_length(c0.memblock);
     c0.index = 0;
 
-    pa_random(samples1, nsamples * sizeof(int16_t));
+    pa_runtime_test_random(samples1, nsamples * sizeof(int16_t));
     c1.memblock = pa_memblock_new_fixed(pool, samples1, nsamples * sizeof(int16_t), false);
     c1.length = pa_memblock_get_length(c1.memblock);
     c1.index = 0;
@@ -196,6 +198,205 @@ START_TEST (mix_neon_test) {
 END_TEST
 #endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
 
+#define MAX_STREAMS 40
+
+/* Mix nstreams streams of the given format with differing volumes,
+ * some of them above 0 dB, and compare against the reference */
+static void run_mix_format_test(
+        pa_do_mix_func_t func,
+        pa_do_mix_func_t orig_func,
+        pa_sample_format_t format,
+        unsigned nstreams,
+        unsigned channels,
+        bool perf) {
+
+    pa_sample_spec ss;
+    pa_mempool *pool;
+    pa_mix_info m[MAX_STREAMS];
+    pa_memchunk out, out_ref;
+    size_t length;
+    void *samples, *samples_ref;
+    unsigned i, j, nsamples;
+
+    pa_assert(nstreams <= MAX_STREAMS);
+
+    ss.format = format;
+    ss.rate = 48000;
+    ss.channels = channels;
+
+    /* Not a multiple of any vector size, to exercise the fallback */
+    nsamples = (SAMPLES - 1) * channels;
+    length = nsamples * pa_sample_size(&ss);
+
+    fail_unless((pool = pa_mempool_new(false, 0)) != NULL, NULL);
+
+    for (i = 0; i < nstreams; i++) {
+        void *d;
+
+        m[i].chunk.memblock = pa_memblock_new(pool, length);
+        m[i].chunk.index = 0;
+        m[i].chunk.length = length;
+
+        d = pa_memblock_acquire(m[i].chunk.memblock);
+        pa_runtime_test_random(d, length);
+
+        if (format == PA_SAMPLE_FLOAT32NE)
+            for (j = 0; j < nsamples; j++)
+                ((float*) d)[j] = (float) ((int16_t*) d)[j * 2] / 0x8000;
+
+        pa_memblock_release(m[i].chunk.memblock);
+
+        m[i].volume.channels = channels;
+        for (j = 0; j < channels; j++) {
+            m[i].volume.values[j] = PA_VOLUME_NORM;
+
+            if (format == PA_SAMPLE_FLOAT32NE)
+                m[i].linear[j].f = 0.1f + 0.2f * (float) ((i + j) % 7);
+            else
+                m[i].linear[j].i = 0x1234 + 0x3456 * (int32_t) ((i + j) % 7);
+        }
+    }
+
+    out.memblock = pa_memblock_new(pool, length);
+    out_ref.memblock = pa_memblock_new(pool, length);
+
+    acquire_mix_streams(m, nstreams);
+    samples_ref = pa_memblock_acquire(out_ref.memblock);
+    orig_func(m, nstreams, channels, samples_ref, length);
+    release_mix_streams(m, nstreams);
+
+    acquire_mix_streams(m, nstreams);
+    samples = pa_memblock_acquire(out.memblock);
+    func(m, nstreams, channels, samples, length);
+    release_mix_streams(m, nstreams);
+
+    for (i = 0; i < nsamples; i++) {
+        bool ok;
+
+        if (format == PA_SAMPLE_S16NE)
+            ok = ((int16_t*) samples)[i] == ((int16_t*) samples_ref)[i];
+        else if (format == PA_SAMPLE_S32NE)
+            ok = ((int32_t*) samples)[i] == ((int32_t*) samples_ref)[i];
+        else
+            ok = fabsf(((float*) samples)[i] - ((float*) samples_ref)[i]) <= 1e-6f * nstreams;
+
+        if (!ok) {
+            pa_log_debug("Correctness test failed: format=%s, streams=%u, channels=%u, sample %u",
+                         pa_sample_format_to_string(format), nstreams, channels, i);
+            fail();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s mixing performance with %u %u-channel streams",
+                     pa_sample_format_to_string(format), nstreams, channels);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES / 10, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            func(m, nstreams, channels, samples, length);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES / 10, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            orig_func(m, nstreams, channels, samples_ref, length);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_memblock_release(out.memblock);
+    pa_memblock_release(out_ref.memblock);
+    pa_memblock_unref(out.memblock);
+    pa_memblock_unref(out_ref.memblock);
+
+    for (i = 0; i < nstreams; i++)
+        pa_memblock_unref(m[i].chunk.memblock);
+
+    pa_mempool_free(pool);
+}
+
+/* The kernels for a fixed number of channels against the generic ones */
+START_TEST (mix_channels_test) {
+    static const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_FLOAT32NE };
+    static const unsigned streams[] = { 2, 3, MAX_STREAMS };
+    static const unsigned channels[] = { 1, 2, 3, 6, 8 };
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, true };
+    pa_do_mix_func_t orig_funcs[PA_ELEMENTSOF(formats)];
+    unsigned f, i, c;
+
+    pa_mix_func_init(&cpu_info);
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++)
+        orig_funcs[f] = pa_get_mix_func(formats[f]);
+
+    cpu_info.force_generic_code = false;
+    pa_mix_func_init(&cpu_info);
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++) {
+        pa_log_debug("Checking channel count specific mix (%s)", pa_sample_format_to_string(formats[f]));
+
+        for (i = 0; i < PA_ELEMENTSOF(streams); i++)
+            for (c = 0; c < PA_ELEMENTSOF(channels); c++)
+                run_mix_format_test(pa_get_mix_func(formats[f]), orig_funcs[f], formats[f], streams[i], channels[c],
+                                    streams[i] == 3 && (channels[c] == 2 || channels[c] == 6));
+    }
+}
+END_TEST
+
+#if (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE4_1) || defined (HAVE_AVX2) || defined (HAVE_AVX512F))
+static void run_mix_x86_tests(const char *name, pa_cpu_x86_flag_t flag, void (*init)(pa_cpu_x86_flag_t flags)) {
+    static const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_S32NE, PA_SAMPLE_FLOAT32NE };
+    static const unsigned streams[] = { 2, 3, MAX_STREAMS };
+    static const unsigned channels[] = { 1, 2, 3, 4, 8 };
+    pa_do_mix_func_t orig_funcs[PA_ELEMENTSOF(formats)];
+    pa_cpu_x86_flag_t flags = 0;
+    unsigned f, i, c;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & flag)) {
+        pa_log_info("%s not supported. Skipping", name);
+        return;
+    }
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++)
+        orig_funcs[f] = pa_get_mix_func(formats[f]);
+
+    init(flags);
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++) {
+        pa_log_debug("Checking %s mix (%s)", name, pa_sample_format_to_string(formats[f]));
+
+        for (i = 0; i < PA_ELEMENTSOF(streams); i++)
+            for (c = 0; c < PA_ELEMENTSOF(channels); c++)
+                run_mix_format_test(pa_get_mix_func(formats[f]), orig_funcs[f], formats[f], streams[i], channels[c],
+                                    streams[i] == MAX_STREAMS && channels[c] == 2);
+
+        pa_set_mix_func(formats[f], orig_funcs[f]);
+    }
+}
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE4_1)
+START_TEST (mix_sse4_test) {
+    run_mix_x86_tests("SSE4.1", PA_CPU_X86_SSE4_1, pa_mix_func_init_sse4);
+}
+END_TEST
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (mix_avx2_test) {
+    run_mix_x86_tests("AVX2", PA_CPU_X86_AVX2, pa_mix_func_init_avx2);
+}
+END_TEST
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512F)
+START_TEST (mix_avx512_test) {
+    run_mix_x86_tests("AVX-512", PA_CPU_X86_AVX512F, pa_mix_func_init_avx512);
+}
+END_TEST
+#endif
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -209,8 +410,18 @@ int main(int argc, char *argv[]) {
 
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_special_test);
+    tcase_add_test(tc, mix_channels_test);
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, mix_neon_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE4_1)
+    tcase_add_test(tc, mix_sse4_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, mix_avx2_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512F)
+    tcase_add_test(tc, mix_avx512_test);
 #endif
     tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
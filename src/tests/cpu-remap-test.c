@@ -113,7 +113,7 @@ static void run_remap_test_s16(
     in = in_buf + (8 - align);
     nsamples = SAMPLES - (8 - align);
 
-    pa_random(in, nsamples * n_ic * sizeof(int16_t));
+    pa_runtime_test_random(in, nsamples * n_ic * sizeof(int16_t));
 
     if (correct) {
         remap_orig->do_remap(remap_orig, out_ref, in, nsamples);
@@ -325,6 +325,80 @@ START_TEST (remap_sse2_test) {
 END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
 
+#if (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE4_1) || defined (HAVE_AVX2))
+/* Channel counts the SIMD matrix and arrange kernels are checked with,
+ * covering the downmix and upmix cases between 5.1, 7.1 and stereo */
+static const unsigned matrix_channels[][2] = {
+    { 6, 2 }, { 8, 2 }, { 2, 6 }, { 2, 8 }, { 1, 6 }, { 6, 4 }, { 6, 6 }, { 3, 5 }
+};
+
+static const unsigned arrange_channels[][2] = {
+    { 2, 2 }, { 4, 4 }, { 6, 6 }, { 8, 8 }, { 6, 2 }, { 2, 6 }, { 8, 2 }
+};
+
+static void remap_init_test_all_channels(
+        pa_init_remap_func_t init_func,
+        pa_init_remap_func_t orig_init_func,
+        const char *name) {
+
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(matrix_channels); i++) {
+        pa_log_debug("Checking %s remap (float, %u-channel->%u-channel)", name, matrix_channels[i][0], matrix_channels[i][1]);
+        remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, matrix_channels[i][0], matrix_channels[i][1], false);
+        pa_log_debug("Checking %s remap (s16, %u-channel->%u-channel)", name, matrix_channels[i][0], matrix_channels[i][1]);
+        remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, matrix_channels[i][0], matrix_channels[i][1], false);
+    }
+
+    for (i = 0; i < PA_ELEMENTSOF(arrange_channels); i++) {
+        pa_log_debug("Checking %s remap (float, %u-channel->%u-channel rearrange)", name, arrange_channels[i][0], arrange_channels[i][1]);
+        remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, arrange_channels[i][0], arrange_channels[i][1], true);
+        pa_log_debug("Checking %s remap (s16, %u-channel->%u-channel rearrange)", name, arrange_channels[i][0], arrange_channels[i][1]);
+        remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, arrange_channels[i][0], arrange_channels[i][1], true);
+    }
+}
+
+#ifdef HAVE_SSE4_1
+START_TEST (remap_sse4_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_init_remap_func_t init_func, orig_init_func;
+
+    pa_cpu_get_x86_flags(&flags);
+    if (!(flags & PA_CPU_X86_SSE4_1)) {
+        pa_log_info("SSE4.1 not supported. Skipping");
+        return;
+    }
+
+    orig_init_func = pa_get_init_remap_func();
+    pa_remap_func_init_sse4(flags);
+    init_func = pa_get_init_remap_func();
+
+    remap_init_test_all_channels(init_func, orig_init_func, "SSE4.1");
+}
+END_TEST
+#endif
+
+#ifdef HAVE_AVX2
+START_TEST (remap_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_init_remap_func_t init_func, orig_init_func;
+
+    pa_cpu_get_x86_flags(&flags);
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    orig_init_func = pa_get_init_remap_func();
+    pa_remap_func_init_avx2(flags);
+    init_func = pa_get_init_remap_func();
+
+    remap_init_test_all_channels(init_func, orig_init_func, "AVX2");
+}
+END_TEST
+#endif
+#endif
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (remap_neon_test) {
     pa_cpu_arm_flag_t flags = 0;
@@ -411,6 +485,12 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, remap_mmx_test);
     tcase_add_test(tc, remap_sse2_test);
 #endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE4_1)
+    tcase_add_test(tc, remap_sse4_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, remap_avx2_test);
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, remap_neon_test);
 #endif
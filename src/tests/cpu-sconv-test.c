@@ -105,7 +105,7 @@ static void run_conv_test_s16_to_float(
     samples = s + (8 - align);
     nsamples = SAMPLES - (8 - align);
 
-    pa_random(samples, nsamples * sizeof(int16_t));
+    pa_runtime_test_random(samples, nsamples * sizeof(int16_t));
 
     if (correct) {
         orig_func(nsamples, samples, floats_ref);
@@ -134,6 +134,240 @@ static void run_conv_test_s16_to_float(
 }
 #endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
 
+#if ((defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE4_1) || defined (HAVE_AVX2))) || \
+    (defined (__arm__) && defined (__linux__) && defined (HAVE_NEON))
+/* Formats the SIMD conversions to and from float32ne and s16ne are
+ * checked with */
+static const pa_sample_format_t conv_formats[] = {
+    PA_SAMPLE_S16LE, PA_SAMPLE_S16BE,
+    PA_SAMPLE_S32LE, PA_SAMPLE_S32BE,
+    PA_SAMPLE_S24_32LE, PA_SAMPLE_S24_32BE,
+    PA_SAMPLE_S24LE, PA_SAMPLE_S24BE,
+    PA_SAMPLE_FLOAT32RE,
+    PA_SAMPLE_ULAW, PA_SAMPLE_ALAW
+};
+
+static void run_conv_test_to_float(
+        pa_convert_func_t func,
+        pa_convert_func_t orig_func,
+        pa_sample_format_t format,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, float, f[SAMPLES]) = { 0.0f };
+    PA_DECLARE_ALIGNED(8, float, f_ref[SAMPLES]) = { 0.0f };
+    PA_DECLARE_ALIGNED(8, uint8_t, s[SAMPLES * 4]);
+    size_t ss = pa_sample_size_of_format(format);
+    float *floats, *floats_ref;
+    uint8_t *samples;
+    int i, nsamples;
+
+    /* Force sample alignment as requested */
+    floats = f + (8 - align);
+    floats_ref = f_ref + (8 - align);
+    samples = s + (8 - align) * ss;
+    nsamples = SAMPLES - (8 - align);
+
+    pa_runtime_test_random(samples, nsamples * ss);
+
+    /* Random bytes may be NaNs, keep the floats finite */
+    if (format == PA_SAMPLE_FLOAT32RE)
+        for (i = 0; i < nsamples; i++)
+            samples[i * ss] &= 0x3F;
+
+    if (correct) {
+        orig_func(nsamples, samples, floats_ref);
+        func(nsamples, samples, floats);
+
+        for (i = 0; i < nsamples; i++) {
+            if (floats[i] != floats_ref[i]) {
+                pa_log_debug("Correctness test failed: format=%s align=%d", pa_sample_format_to_string(format), align);
+                pa_log_debug("%d: %.24f != %.24f\n", i, floats[i], floats_ref[i]);
+                fail();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing sconv performance with %d sample alignment", align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(nsamples, samples, floats);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(nsamples, samples, floats_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+/* Rounding may differ between the implementations, so both results are
+ * converted back to float with ref_to_func and compared within two least
+ * significant bits */
+static void run_conv_test_from_float(
+        pa_convert_func_t func,
+        pa_convert_func_t orig_func,
+        pa_convert_func_t ref_to_func,
+        pa_sample_format_t format,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, s[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, s_ref[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, float, f[SAMPLES]);
+    PA_DECLARE_ALIGNED(8, float, back[SAMPLES]);
+    PA_DECLARE_ALIGNED(8, float, back_ref[SAMPLES]);
+    size_t ss = pa_sample_size_of_format(format);
+    float tolerance = ss == 2 ? 1.0f / (1 << 14) : 1.0f / (1 << 22);
+    uint8_t *samples, *samples_ref;
+    float *floats;
+    int i, nsamples;
+
+    /* Force sample alignment as requested */
+    samples = s + (8 - align) * ss;
+    samples_ref = s_ref + (8 - align) * ss;
+    floats = f + (8 - align);
+    nsamples = SAMPLES - (8 - align);
+
+    /* Slightly out of range, to check the clipping too */
+    for (i = 0; i < nsamples; i++) {
+        floats[i] = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+    }
+
+    if (correct) {
+        orig_func(nsamples, floats, samples_ref);
+        func(nsamples, floats, samples);
+
+        ref_to_func(nsamples, samples_ref, back_ref);
+        ref_to_func(nsamples, samples, back);
+
+        for (i = 0; i < nsamples; i++) {
+            if (fabsf(back[i] - back_ref[i]) > tolerance) {
+                pa_log_debug("Correctness test failed: format=%s align=%d", pa_sample_format_to_string(format), align);
+                pa_log_debug("%d: %.24f != %.24f (%.24f)\n", i, back[i], back_ref[i], floats[i]);
+                fail();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing sconv performance with %d sample alignment", align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(nsamples, floats, samples);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(nsamples, floats, samples_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+/* For the conversions to and from s16ne, which must give the same
+ * samples exactly */
+static void run_conv_test_s16(
+        pa_convert_func_t func,
+        pa_convert_func_t orig_func,
+        size_t in_size,
+        size_t out_size,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, in[SAMPLES * 2]);
+    PA_DECLARE_ALIGNED(8, uint8_t, out[SAMPLES * 2]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, out_ref[SAMPLES * 2]) = { 0 };
+    uint8_t *samples, *results, *results_ref;
+    int i, nsamples;
+
+    /* Force sample alignment as requested */
+    samples = in + (8 - align) * in_size;
+    results = out + (8 - align) * out_size;
+    results_ref = out_ref + (8 - align) * out_size;
+    nsamples = SAMPLES - (8 - align);
+
+    pa_runtime_test_random(samples, nsamples * in_size);
+
+    if (correct) {
+        orig_func(nsamples, samples, results_ref);
+        func(nsamples, samples, results);
+
+        for (i = 0; i < nsamples; i++) {
+            if (memcmp(results + i * out_size, results_ref + i * out_size, out_size)) {
+                pa_log_debug("Correctness test failed: align=%d", align);
+                pa_log_debug("%d: results differ\n", i);
+                fail();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing sconv performance with %d sample alignment", align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(nsamples, samples, results);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(nsamples, samples, results_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+/* Checks all conversions that init replaces against the ones installed
+ * before it */
+static void run_conv_test_all_formats(void (*init)(void), const char *name) {
+    pa_convert_func_t orig_to[PA_ELEMENTSOF(conv_formats)], orig_from[PA_ELEMENTSOF(conv_formats)];
+    pa_convert_func_t orig_to_s16[PA_ELEMENTSOF(conv_formats)], orig_from_s16[PA_ELEMENTSOF(conv_formats)];
+    unsigned i;
+    int align;
+
+    for (i = 0; i < PA_ELEMENTSOF(conv_formats); i++) {
+        orig_to[i] = pa_get_convert_to_float32ne_function(conv_formats[i]);
+        orig_from[i] = pa_get_convert_from_float32ne_function(conv_formats[i]);
+        orig_to_s16[i] = pa_get_convert_to_s16ne_function(conv_formats[i]);
+        orig_from_s16[i] = pa_get_convert_from_s16ne_function(conv_formats[i]);
+    }
+
+    init();
+
+    for (i = 0; i < PA_ELEMENTSOF(conv_formats); i++) {
+        pa_sample_format_t format = conv_formats[i];
+        pa_convert_func_t to_func = pa_get_convert_to_float32ne_function(format);
+        pa_convert_func_t from_func = pa_get_convert_from_float32ne_function(format);
+        size_t size;
+
+        if (to_func != orig_to[i]) {
+            pa_log_debug("Checking %s sconv (%s -> float)", name, pa_sample_format_to_string(format));
+            for (align = 0; align < 8; align++)
+                run_conv_test_to_float(to_func, orig_to[i], format, align, true, align == 7);
+        }
+
+        if (from_func != orig_from[i]) {
+            pa_log_debug("Checking %s sconv (float -> %s)", name, pa_sample_format_to_string(format));
+            for (align = 0; align < 8; align++)
+                run_conv_test_from_float(from_func, orig_from[i], orig_to[i], format, align, true, align == 7);
+        }
+
+        size = pa_sample_size_of_format(format);
+
+        if ((to_func = pa_get_convert_to_s16ne_function(format)) != orig_to_s16[i]) {
+            pa_log_debug("Checking %s sconv (%s -> s16)", name, pa_sample_format_to_string(format));
+            for (align = 0; align < 8; align++)
+                run_conv_test_s16(to_func, orig_to_s16[i], size, sizeof(int16_t), align, true, align == 7);
+        }
+
+        if ((from_func = pa_get_convert_from_s16ne_function(format)) != orig_from_s16[i]) {
+            pa_log_debug("Checking %s sconv (s16 -> %s)", name, pa_sample_format_to_string(format));
+            for (align = 0; align < 8; align++)
+                run_conv_test_s16(from_func, orig_from_s16[i], sizeof(int16_t), size, align, true, align == 7);
+        }
+    }
+}
+#endif
+
 #if defined (__i386__) || defined (__amd64__)
 START_TEST (sconv_sse2_test) {
     pa_cpu_x86_flag_t flags = 0;
@@ -190,6 +424,46 @@ START_TEST (sconv_sse_test) {
 END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
 
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE4_1)
+static void init_sse4(void) {
+    pa_convert_func_init_sse4(PA_CPU_X86_SSE4_1);
+}
+
+START_TEST (sconv_sse4_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE4_1)) {
+        pa_log_info("SSE4.1 not supported. Skipping");
+        return;
+    }
+
+    run_conv_test_all_formats(init_sse4, "SSE4.1");
+}
+END_TEST
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+static void init_avx2(void) {
+    pa_convert_func_init_avx2(PA_CPU_X86_AVX2);
+}
+
+START_TEST (sconv_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    run_conv_test_all_formats(init_avx2, "AVX2");
+}
+END_TEST
+#endif
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (sconv_neon_test) {
     pa_cpu_arm_flag_t flags = 0;
@@ -230,6 +504,24 @@ START_TEST (sconv_neon_test) {
     run_conv_test_s16_to_float(neon_to_func, orig_to_func, 7, true, true);
 }
 END_TEST
+
+static void init_neon(void) {
+    pa_convert_func_init_neon(PA_CPU_ARM_NEON);
+}
+
+START_TEST (sconv_neon_formats_test) {
+    pa_cpu_arm_flag_t flags = 0;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    run_conv_test_all_formats(init_neon, "NEON");
+}
+END_TEST
 #endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
 
 int main(int argc, char *argv[]) {
@@ -248,8 +540,15 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, sconv_sse2_test);
     tcase_add_test(tc, sconv_sse_test);
 #endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE4_1)
+    tcase_add_test(tc, sconv_sse4_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, sconv_avx2_test);
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, sconv_neon_test);
+    tcase_add_test(tc, sconv_neon_formats_test);
 #endif
     tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
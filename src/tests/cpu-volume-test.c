@@ -21,6 +21,7 @@
 
 #include <check.h>
 
+#include <pulsecore/cpu.h>
 #include <pulsecore/cpu-arm.h>
 #include <pulsecore/cpu-x86.h>
 #include <pulsecore/cpu-orc.h>
@@ -60,7 +61,7 @@ static void run_volume_test(
         nsamples -= nsamples % channels;
     size = nsamples * sizeof(int16_t);
 
-    pa_random(samples, size);
+    pa_runtime_test_random(samples, size);
     memcpy(samples_ref, samples, size);
     memcpy(samples_orig, samples, size);
 
@@ -100,6 +101,131 @@ static void run_volume_test(
     }
 }
 
+/* Formats and channel counts the AVX and channel count specific kernels
+ * are checked with. The channel counts include ones that don't divide the
+ * vector length or have no kernel of their own. */
+static const pa_sample_format_t volume_formats[] = {
+    PA_SAMPLE_S16NE, PA_SAMPLE_S32NE, PA_SAMPLE_S24_32NE, PA_SAMPLE_FLOAT32NE
+};
+
+static const int volume_channels[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+static void run_volume_test_format(
+        pa_do_volume_func_t func,
+        pa_do_volume_func_t orig_func,
+        pa_sample_format_t format,
+        int align,
+        int channels,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, s[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, s_ref[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, s_orig[SAMPLES * 4]) = { 0 };
+    union {
+        int32_t i;
+        float f;
+    } volumes[channels + PADDING];
+    size_t ss = pa_sample_size_of_format(format);
+    uint8_t *samples, *samples_ref, *samples_orig;
+    int i, padding, nsamples, size;
+
+    /* Force sample alignment as requested */
+    samples = s + (8 - align) * ss;
+    samples_ref = s_ref + (8 - align) * ss;
+    samples_orig = s_orig + (8 - align) * ss;
+    nsamples = SAMPLES - (8 - align);
+    if (nsamples % channels)
+        nsamples -= nsamples % channels;
+    size = nsamples * ss;
+
+    if (format == PA_SAMPLE_FLOAT32NE) {
+        for (i = 0; i < nsamples; i++)
+            ((float *) samples)[i] = 2.0f * (rand()/(float) RAND_MAX - 0.5f);
+    } else
+        pa_runtime_test_random(samples, size);
+    memcpy(samples_ref, samples, size);
+    memcpy(samples_orig, samples, size);
+
+    /* Up to four times amplification, to check the clipping too */
+    for (i = 0; i < channels; i++) {
+        if (format == PA_SAMPLE_FLOAT32NE)
+            volumes[i].f = 4.0f * rand()/(float) RAND_MAX;
+        else
+            volumes[i].i = rand() >> 13;
+    }
+    for (padding = 0; padding < PADDING; padding++, i++)
+        volumes[i] = volumes[padding];
+
+    if (correct) {
+        orig_func(samples_ref, volumes, channels, size);
+        func(samples, volumes, channels, size);
+
+        if (memcmp(samples, samples_ref, size) != 0) {
+            pa_log_debug("Correctness test failed: format=%s, align=%d, channels=%d",
+                    pa_sample_format_to_string(format), align, channels);
+            fail();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing svolume %s %dch performance with %d sample alignment",
+                pa_sample_format_to_string(format), channels, align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            memcpy(samples, samples_orig, size);
+            func(samples, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            memcpy(samples_ref, samples_orig, size);
+            orig_func(samples_ref, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        fail_unless(memcmp(samples_ref, samples, size) == 0);
+    }
+}
+
+/* Checks the kernels init installs against the ones installed before it,
+ * and times them for stereo and 5.1 */
+static void run_volume_test_all_formats(void (*init)(void), const char *name) {
+    pa_do_volume_func_t orig_funcs[PA_ELEMENTSOF(volume_formats)];
+    unsigned i, j;
+    int align;
+
+    for (i = 0; i < PA_ELEMENTSOF(volume_formats); i++)
+        orig_funcs[i] = pa_get_volume_func(volume_formats[i]);
+
+    init();
+
+    for (i = 0; i < PA_ELEMENTSOF(volume_formats); i++) {
+        pa_sample_format_t format = volume_formats[i];
+        pa_do_volume_func_t func = pa_get_volume_func(format);
+
+        pa_log_debug("Checking %s svolume (%s)", name, pa_sample_format_to_string(format));
+        for (j = 0; j < PA_ELEMENTSOF(volume_channels); j++) {
+            for (align = 0; align < 8; align++)
+                run_volume_test_format(func, orig_funcs[i], format, align, volume_channels[j], true, false);
+        }
+        run_volume_test_format(func, orig_funcs[i], format, 7, 2, true, true);
+        run_volume_test_format(func, orig_funcs[i], format, 7, 6, true, true);
+    }
+}
+
+static void volume_func_init_channels(void) {
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, false };
+
+    pa_volume_func_init(&cpu_info);
+}
+
+START_TEST (svolume_channels_test) {
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, true };
+
+    pa_volume_func_init(&cpu_info);
+    run_volume_test_all_formats(volume_func_init_channels, "channel count specific");
+}
+END_TEST
+
 #if defined (__i386__) || defined (__amd64__)
 START_TEST (svolume_mmx_test) {
     pa_do_volume_func_t orig_func, mmx_func;
@@ -156,6 +282,46 @@ START_TEST (svolume_sse_test) {
 END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
 
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+static void init_avx2(void) {
+    pa_volume_func_init_avx2(PA_CPU_X86_AVX2);
+}
+
+START_TEST (svolume_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    run_volume_test_all_formats(init_avx2, "AVX2");
+}
+END_TEST
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512F)
+static void init_avx512(void) {
+    pa_volume_func_init_avx512(PA_CPU_X86_AVX512F);
+}
+
+START_TEST (svolume_avx512_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX512F)) {
+        pa_log_info("AVX-512 not supported. Skipping");
+        return;
+    }
+
+    run_volume_test_all_formats(init_avx512, "AVX-512");
+}
+END_TEST
+#endif
+
 #if defined (__arm__) && defined (__linux__)
 START_TEST (svolume_arm_test) {
     pa_do_volume_func_t orig_func, arm_func;
@@ -227,10 +393,17 @@ int main(int argc, char *argv[]) {
     s = suite_create("CPU");
 
     tc = tcase_create("svolume");
+    tcase_add_test(tc, svolume_channels_test);
 #if defined (__i386__) || defined (__amd64__)
     tcase_add_test(tc, svolume_mmx_test);
     tcase_add_test(tc, svolume_sse_test);
 #endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, svolume_avx2_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512F)
+    tcase_add_test(tc, svolume_avx512_test);
+#endif
 #if defined (__arm__) && defined (__linux__)
     tcase_add_test(tc, svolume_arm_test);
 #endif
@@ -0,0 +1,253 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/database.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "runtime-test-util.h"
+
+#define N_ENTRIES 5000
+
+static char db_dir[] = "/tmp/database-test-XXXXXX";
+static char *db_path;
+
+static void set_string(pa_database *db, const char *k, const char *v, bool overwrite, int result) {
+    pa_datum key, data;
+
+    key.data = (void*) k;
+    key.size = strlen(k);
+    data.data = (void*) v;
+    data.size = strlen(v);
+
+    fail_unless(pa_database_set(db, &key, &data, overwrite) == result);
+}
+
+static void check_string(pa_database *db, const char *k, const char *v) {
+    pa_datum key, data;
+
+    key.data = (void*) k;
+    key.size = strlen(k);
+
+    if (!v) {
+        fail_unless(pa_database_get(db, &key, &data) == NULL);
+        return;
+    }
+
+    fail_unless(pa_database_get(db, &key, &data) == &data);
+    fail_unless(data.size == strlen(v));
+    fail_unless(memcmp(data.data, v, data.size) == 0);
+    pa_datum_free(&data);
+}
+
+static void unset_string(pa_database *db, const char *k) {
+    pa_datum key;
+
+    key.data = (void*) k;
+    key.size = strlen(k);
+
+    fail_unless(pa_database_unset(db, &key) == 0);
+}
+
+/* The backends add their own suffixes, so just remove whatever they left
+ * in the directory */
+static void remove_files(void) {
+    DIR *d;
+    struct dirent *de;
+
+    pa_assert_se(d = opendir(db_dir));
+
+    while ((de = readdir(d))) {
+        char *fn;
+
+        if (pa_streq(de->d_name, ".") || pa_streq(de->d_name, ".."))
+            continue;
+
+        fn = pa_sprintf_malloc("%s/%s", db_dir, de->d_name);
+        unlink(fn);
+        pa_xfree(fn);
+    }
+
+    closedir(d);
+}
+
+START_TEST (database_test) {
+    pa_database *db;
+
+    fail_unless((db = pa_database_open(db_path, true)) != NULL);
+    fail_unless(pa_database_size(db) == 0);
+
+    set_string(db, "one", "1", false, 0);
+    set_string(db, "two", "2", false, 0);
+    set_string(db, "three", "3", false, 0);
+    set_string(db, "two", "zwei", false, -1);
+    set_string(db, "two", "deux", true, 0);
+    unset_string(db, "one");
+
+    check_string(db, "one", NULL);
+    check_string(db, "two", "deux");
+    fail_unless(pa_database_size(db) == 2);
+    fail_unless(pa_database_sync(db) == 0);
+
+    set_string(db, "four", "4", false, 0);
+    pa_database_close(db);
+
+    /* Reopening sees everything, also what was not synced explicitly */
+    fail_unless((db = pa_database_open(db_path, false)) != NULL);
+    fail_unless(pa_database_size(db) == 3);
+    check_string(db, "one", NULL);
+    check_string(db, "two", "deux");
+    check_string(db, "three", "3");
+    check_string(db, "four", "4");
+    set_string(db, "five", "5", false, -1);
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open(db_path, true)) != NULL);
+    fail_unless(pa_database_clear(db) == 0);
+    fail_unless(pa_database_size(db) == 0);
+    set_string(db, "one", "1", false, 0);
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open(db_path, true)) != NULL);
+    fail_unless(pa_database_size(db) == 1);
+    check_string(db, "one", "1");
+    check_string(db, "two", NULL);
+    pa_database_close(db);
+    remove_files();
+}
+END_TEST
+
+START_TEST (iterate_test) {
+    pa_database *db;
+    pa_datum key, next, data;
+    unsigned i, n = 0;
+    bool done;
+    char k[32];
+
+    fail_unless((db = pa_database_open(db_path, true)) != NULL);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        pa_snprintf(k, sizeof(k), "key-%u", i);
+        set_string(db, k, "value", false, 0);
+    }
+
+    done = !pa_database_first(db, &key, &data);
+
+    while (!done) {
+        fail_unless(data.size == 5);
+        pa_datum_free(&data);
+        n++;
+
+        done = !pa_database_next(db, &key, &next, &data);
+        pa_datum_free(&key);
+        key = next;
+    }
+
+    fail_unless(n == N_ENTRIES);
+    pa_database_close(db);
+    remove_files();
+}
+END_TEST
+
+START_TEST (rewrite_test) {
+    pa_database *db;
+    unsigned i, j;
+    char k[32], v[64];
+
+    fail_unless((db = pa_database_open(db_path, true)) != NULL);
+
+    /* Overwrite the same entries over and over again, which lets the file
+     * grow well beyond the size of the live entries */
+    for (i = 0; i < 50; i++) {
+        PA_RUNTIME_TEST_RUN_START("set and sync", 1, 1) {
+            for (j = 0; j < 500; j++) {
+                pa_snprintf(k, sizeof(k), "key-%u", j);
+                pa_snprintf(v, sizeof(v), "value-%u-%u-padding-padding", j, i);
+                set_string(db, k, v, true, 0);
+            }
+
+            fail_unless(pa_database_sync(db) == 0);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        if (i % 10 == 0) {
+            pa_snprintf(k, sizeof(k), "key-%u", 500 + i);
+            set_string(db, k, "extra", false, 0);
+        }
+
+        if (i % 10 == 5) {
+            pa_snprintf(k, sizeof(k), "key-%u", 500 + i - 5);
+            unset_string(db, k);
+        }
+    }
+
+    fail_unless(pa_database_size(db) == 500);
+    pa_database_close(db);
+
+    fail_unless((db = pa_database_open(db_path, false)) != NULL);
+    fail_unless(pa_database_size(db) == 500);
+
+    for (j = 0; j < 500; j++) {
+        pa_snprintf(k, sizeof(k), "key-%u", j);
+        pa_snprintf(v, sizeof(v), "value-%u-%u-padding-padding", j, 49);
+        check_string(db, k, v);
+    }
+
+    pa_database_close(db);
+    remove_files();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(mkdtemp(db_dir));
+    db_path = pa_sprintf_malloc("%s/test", db_dir);
+
+    s = suite_create("Database");
+    tc = tcase_create("database");
+    tcase_add_test(tc, database_test);
+    tcase_add_test(tc, iterate_test);
+    tcase_add_test(tc, rewrite_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    rmdir(db_dir);
+    pa_xfree(db_path);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
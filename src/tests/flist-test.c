@@ -78,10 +78,52 @@ static void thread_func(void *data) {
         pa_xfree(s);
 }
 
+static void growth_test(void) {
+    pa_flist *l;
+    int i;
+
+    /* Grows from 4 to 4 + 8 entries, then pushing fails */
+    l = pa_flist_new_full(4, 12, "growth");
+
+    for (i = 0; i < 12; i++)
+        pa_assert_se(pa_flist_push(l, PA_INT_TO_PTR(i + 1)) == 0);
+
+    pa_assert_se(pa_flist_push(l, PA_INT_TO_PTR(13)) < 0);
+    pa_assert_se(pa_flist_get_overflows(l) == 1);
+
+    for (i = 0; i < 12; i++)
+        pa_assert_se(pa_flist_pop(l));
+
+    pa_assert_se(!pa_flist_pop(l));
+
+    pa_flist_free(l, NULL);
+}
+
+static void sharded_test(void) {
+    pa_flist *l;
+    int i;
+
+    /* Whichever CPU we are on, all entries fit */
+    l = pa_flist_new_sharded(64, "sharded");
+
+    for (i = 0; i < 64; i++)
+        pa_assert_se(pa_flist_push(l, PA_INT_TO_PTR(i + 1)) == 0);
+
+    for (i = 0; i < 64; i++)
+        pa_assert_se(pa_flist_pop(l));
+
+    pa_assert_se(!pa_flist_pop(l));
+
+    pa_flist_free(l, NULL);
+}
+
 int main(int argc, char* argv[]) {
     pa_thread *threads[THREADS_MAX];
     int i;
 
+    growth_test();
+    sharded_test();
+
     flist = pa_flist_new(0);
 
     for (i = 0; i < THREADS_MAX; i++) {
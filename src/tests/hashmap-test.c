@@ -0,0 +1,253 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "runtime-test-util.h"
+
+#define N_ENTRIES 1000
+#define TIMES 10
+#define TIMES2 20
+
+static char *make_key(unsigned i) {
+    return pa_sprintf_malloc("key-%u", i);
+}
+
+START_TEST (hashmap_test) {
+    pa_hashmap *h;
+    unsigned i, n;
+    void *state, *v;
+    const void *key;
+
+    h = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, NULL);
+
+    for (i = 0; i < N_ENTRIES; i++)
+        fail_unless(pa_hashmap_put(h, make_key(i), PA_UINT_TO_PTR(i + 1)) == 0);
+
+    fail_unless(pa_hashmap_size(h) == N_ENTRIES);
+    fail_unless(pa_hashmap_put(h, (void*) "key-7", NULL) < 0);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        char *k = make_key(i);
+        fail_unless(pa_hashmap_get(h, k) == PA_UINT_TO_PTR(i + 1));
+        pa_xfree(k);
+    }
+
+    fail_unless(pa_hashmap_get(h, "nonexistent") == NULL);
+
+    /* Remove every other entry, the current one while iterating */
+    i = 0;
+    PA_HASHMAP_FOREACH_KV(key, v, h, state) {
+        fail_unless(v == PA_UINT_TO_PTR(i + 1));
+
+        if (i % 2 == 0)
+            fail_unless(pa_hashmap_remove(h, key) == v);
+
+        i++;
+    }
+    fail_unless(i == N_ENTRIES);
+    fail_unless(pa_hashmap_size(h) == N_ENTRIES / 2);
+
+    /* The insertion order is kept, also for entries added after removals */
+    for (i = N_ENTRIES; i < 2 * N_ENTRIES; i++)
+        fail_unless(pa_hashmap_put(h, make_key(i), PA_UINT_TO_PTR(i + 1)) == 0);
+
+    n = 1;
+    PA_HASHMAP_FOREACH(v, h, state) {
+        fail_unless(v == PA_UINT_TO_PTR(n + 1));
+        n += n < N_ENTRIES - 1 ? 2 : 1;
+    }
+    fail_unless(n == 2 * N_ENTRIES);
+
+    n = 2 * N_ENTRIES - 1;
+    PA_HASHMAP_FOREACH_BACKWARDS(v, h, state) {
+        fail_unless(v == PA_UINT_TO_PTR(n + 1));
+        n -= n >= N_ENTRIES ? 1 : 2;
+    }
+
+    fail_unless(pa_hashmap_first(h) == PA_UINT_TO_PTR(2));
+    fail_unless(pa_hashmap_last(h) == PA_UINT_TO_PTR(2 * N_ENTRIES));
+    fail_unless(pa_hashmap_steal_first(h) == PA_UINT_TO_PTR(2));
+    fail_unless(pa_hashmap_first(h) == PA_UINT_TO_PTR(4));
+    fail_unless(pa_hashmap_remove_and_free(h, "key-1999") == 0);
+    fail_unless(pa_hashmap_last(h) == PA_UINT_TO_PTR(2 * N_ENTRIES - 1));
+
+    pa_hashmap_remove_all(h);
+    fail_unless(pa_hashmap_isempty(h));
+    fail_unless(pa_hashmap_first(h) == NULL);
+
+    /* Used like a queue, the map must not grow */
+    for (i = 0; i < 100 * N_ENTRIES; i++) {
+        fail_unless(pa_hashmap_put(h, make_key(i), PA_UINT_TO_PTR(i + 1)) == 0);
+
+        if (i >= 10)
+            fail_unless(pa_hashmap_steal_first(h) == PA_UINT_TO_PTR(i - 9));
+    }
+    fail_unless(pa_hashmap_size(h) == 10);
+
+    pa_hashmap_free(h);
+}
+END_TEST
+
+START_TEST (idxset_test) {
+    pa_idxset *s, *copy;
+    uint32_t idx, i;
+    void *v;
+
+    s = pa_idxset_new(NULL, NULL);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        fail_unless(pa_idxset_put(s, PA_UINT_TO_PTR(i + 1), &idx) == 0);
+        fail_unless(idx == i);
+    }
+
+    fail_unless(pa_idxset_put(s, PA_UINT_TO_PTR(42), &idx) < 0);
+    fail_unless(idx == 41);
+
+    for (i = 0; i < N_ENTRIES; i += 3)
+        fail_unless(pa_idxset_remove_by_index(s, i) == PA_UINT_TO_PTR(i + 1));
+
+    fail_unless(pa_idxset_get_by_index(s, 3) == NULL);
+    fail_unless(pa_idxset_get_by_index(s, 4) == PA_UINT_TO_PTR(5));
+    fail_unless(pa_idxset_get_by_data(s, PA_UINT_TO_PTR(6), &idx) == PA_UINT_TO_PTR(6));
+    fail_unless(idx == 5);
+
+    /* Iterating continues after an entry removed in the loop body */
+    i = 1;
+    PA_IDXSET_FOREACH(v, s, idx) {
+        fail_unless(idx == i);
+        fail_unless(v == PA_UINT_TO_PTR(i + 1));
+
+        pa_idxset_remove_by_data(s, v, NULL);
+        i += i % 3 == 1 ? 1 : 2;
+    }
+    fail_unless(pa_idxset_isempty(s));
+
+    for (i = 0; i < N_ENTRIES; i++)
+        fail_unless(pa_idxset_put(s, PA_UINT_TO_PTR(i + 1), &idx) == 0 && idx == N_ENTRIES + i);
+
+    idx = N_ENTRIES + 5;
+    fail_unless(pa_idxset_rrobin(s, &idx) == PA_UINT_TO_PTR(7));
+    idx = 2 * N_ENTRIES - 1;
+    fail_unless(pa_idxset_rrobin(s, &idx) == PA_UINT_TO_PTR(1));
+
+    pa_idxset_remove_by_index(s, N_ENTRIES + 7);
+    idx = N_ENTRIES + 7;
+    fail_unless(pa_idxset_next(s, &idx) == PA_UINT_TO_PTR(9));
+    fail_unless(idx == N_ENTRIES + 8);
+
+    copy = pa_idxset_copy(s, NULL);
+    fail_unless(pa_idxset_size(copy) == N_ENTRIES - 1);
+    fail_unless(pa_idxset_first(copy, &idx) == PA_UINT_TO_PTR(1) && idx == 0);
+    fail_unless(pa_idxset_steal_first(copy, &idx) == PA_UINT_TO_PTR(1) && idx == 0);
+    fail_unless(pa_idxset_first(copy, &idx) == PA_UINT_TO_PTR(2) && idx == 1);
+
+    pa_idxset_free(copy, NULL);
+    pa_idxset_free(s, NULL);
+}
+END_TEST
+
+static void run_benchmark(unsigned n) {
+    char **keys;
+    pa_hashmap *h;
+    pa_idxset *s;
+    unsigned i;
+    char label[64];
+
+    pa_log_debug("Checking hashmap and idxset with %u entries", n);
+
+    keys = pa_xnew(char*, n);
+    for (i = 0; i < n; i++)
+        keys[i] = make_key(i);
+
+    pa_snprintf(label, sizeof(label), "hashmap put/get/remove %u", n);
+    PA_RUNTIME_TEST_RUN_START(label, TIMES, TIMES2) {
+        h = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+        for (i = 0; i < n; i++)
+            pa_hashmap_put(h, keys[i], keys[i]);
+        for (i = 0; i < n; i++)
+            pa_assert_se(pa_hashmap_get(h, keys[i]) == keys[i]);
+        for (i = 0; i < n; i++)
+            pa_assert_se(pa_hashmap_remove(h, keys[i]) == keys[i]);
+
+        pa_hashmap_free(h);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_snprintf(label, sizeof(label), "idxset put/get/remove %u", n);
+    PA_RUNTIME_TEST_RUN_START(label, TIMES, TIMES2) {
+        s = pa_idxset_new(NULL, NULL);
+
+        for (i = 0; i < n; i++)
+            pa_idxset_put(s, keys[i], NULL);
+        for (i = 0; i < n; i++)
+            pa_assert_se(pa_idxset_get_by_data(s, keys[i], NULL) == keys[i]);
+        for (i = 0; i < n; i++)
+            pa_assert_se(pa_idxset_get_by_index(s, i) == keys[i]);
+        for (i = 0; i < n; i++)
+            pa_assert_se(pa_idxset_remove_by_data(s, keys[i], NULL) == keys[i]);
+
+        pa_idxset_free(s, NULL);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    for (i = 0; i < n; i++)
+        pa_xfree(keys[i]);
+    pa_xfree(keys);
+}
+
+START_TEST (benchmark_test) {
+    run_benchmark(10);
+    run_benchmark(100);
+    run_benchmark(10000);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Hashmap");
+    tc = tcase_create("hashmap");
+    tcase_add_test(tc, hashmap_test);
+    tcase_add_test(tc, idxset_test);
+    tcase_add_test(tc, benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -4,6 +4,8 @@
 
 #include <check.h>
 
+#include <pulse/proplist.h>
+
 #include <pulsecore/hook-list.h>
 #include <pulsecore/log.h>
 
@@ -41,6 +43,59 @@ START_TEST (hooklist_test) {
 }
 END_TEST
 
+static pa_proplist *get_proplist(pa_proplist *call_data) {
+    return call_data;
+}
+
+static pa_hook_result_t count(pa_hook *hook, pa_proplist *call_data, unsigned *slot_data) {
+    (*slot_data)++;
+    return PA_HOOK_OK;
+}
+
+START_TEST (filter_test) {
+    pa_hook hook;
+    pa_hook_slot *filtered, *plain;
+    pa_proplist *with, *without;
+    unsigned n_filtered = 0, n_plain = 0;
+
+    pa_hook_init(&hook, &hook);
+    pa_hook_set_proplist_callback(&hook, (pa_hook_proplist_cb_t) get_proplist);
+
+    filtered = pa_hook_connect(&hook, PA_HOOK_NORMAL, (pa_hook_cb_t) count, &n_filtered);
+    pa_hook_slot_set_property_filter(filtered, PA_PROP_MEDIA_ROLE);
+    plain = pa_hook_connect(&hook, PA_HOOK_NORMAL, (pa_hook_cb_t) count, &n_plain);
+
+    with = pa_proplist_new();
+    pa_proplist_sets(with, PA_PROP_MEDIA_ROLE, "phone");
+    without = pa_proplist_new();
+
+    pa_hook_fire(&hook, with);
+    pa_hook_fire(&hook, without);
+    pa_hook_fire(&hook, without);
+
+    fail_unless(n_filtered == 1);
+    fail_unless(n_plain == 3);
+    fail_unless(hook.n_fired == 3);
+    fail_unless(filtered->n_calls == 1);
+    fail_unless(filtered->n_skipped == 2);
+    fail_unless(plain->n_calls == 3);
+    fail_unless(plain->n_skipped == 0);
+
+    /* Timing is off by default, the counters are not */
+    fail_unless(!pa_hook_get_profiling());
+    fail_unless(hook.usec == 0);
+
+    pa_hook_reset_stats(&hook);
+    fail_unless(hook.n_fired == 0);
+    fail_unless(filtered->n_calls == 0);
+    fail_unless(filtered->n_skipped == 0);
+
+    pa_proplist_free(with);
+    pa_proplist_free(without);
+    pa_hook_done(&hook);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -50,6 +105,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Hook List");
     tc = tcase_create("hooklist");
     tcase_add_test(tc, hooklist_test);
+    tcase_add_test(tc, filter_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,152 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <string.h>
+
+#include <pulsecore/sample-util.h>
+#include <pulsecore/macro.h>
+
+#include "runtime-test-util.h"
+
+#define SAMPLES 1025
+#define MAX_CHANNELS 8
+#define MAX_SAMPLE_SIZE 8
+#define TIMES 1000
+#define TIMES2 100
+
+/* Sample by sample, as the functions did before they had special cases */
+static void interleave_ref(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
+    unsigned c, j;
+
+    for (c = 0; c < channels; c++)
+        for (j = 0; j < n; j++)
+            memcpy((uint8_t*) dst + (j * channels + c) * ss, (const uint8_t*) src[c] + j * ss, ss);
+}
+
+static void deinterleave_ref(const void *src, void *dst[], unsigned channels, size_t ss, unsigned n) {
+    unsigned c, j;
+
+    for (c = 0; c < channels; c++)
+        for (j = 0; j < n; j++)
+            memcpy((uint8_t*) dst[c] + j * ss, (const uint8_t*) src + (j * channels + c) * ss, ss);
+}
+
+static uint8_t interleaved[SAMPLES * MAX_CHANNELS * MAX_SAMPLE_SIZE];
+static uint8_t interleaved_ref[SAMPLES * MAX_CHANNELS * MAX_SAMPLE_SIZE];
+static uint8_t planar[MAX_CHANNELS][SAMPLES * MAX_SAMPLE_SIZE];
+static uint8_t planar_ref[MAX_CHANNELS][SAMPLES * MAX_SAMPLE_SIZE];
+
+START_TEST (interleave_test) {
+    static const size_t sizes[] = { 1, 2, 3, 4, 8 };
+    static const unsigned channel_counts[] = { 1, 2, 3, 6, 8 };
+    unsigned i, k, c;
+
+    for (i = 0; i < PA_ELEMENTSOF(sizes); i++)
+        for (k = 0; k < PA_ELEMENTSOF(channel_counts); k++) {
+            size_t ss = sizes[i];
+            unsigned channels = channel_counts[k];
+            void *dst[MAX_CHANNELS], *dst_ref[MAX_CHANNELS];
+            const void *src[MAX_CHANNELS];
+
+            for (c = 0; c < channels; c++) {
+                pa_runtime_test_random(planar[c], SAMPLES * ss);
+                src[c] = planar[c];
+            }
+
+            interleave_ref(src, channels, interleaved_ref, ss, SAMPLES);
+            pa_interleave(src, channels, interleaved, ss, SAMPLES);
+            fail_unless(memcmp(interleaved, interleaved_ref, SAMPLES * channels * ss) == 0);
+
+            pa_runtime_test_random(interleaved, SAMPLES * channels * ss);
+
+            for (c = 0; c < channels; c++) {
+                dst[c] = planar[c];
+                dst_ref[c] = planar_ref[c];
+            }
+
+            deinterleave_ref(interleaved, dst_ref, channels, ss, SAMPLES);
+            pa_deinterleave(interleaved, dst, channels, ss, SAMPLES);
+
+            for (c = 0; c < channels; c++)
+                fail_unless(memcmp(planar[c], planar_ref[c], SAMPLES * ss) == 0);
+        }
+}
+END_TEST
+
+static void run_perf(unsigned channels) {
+    void *dst[MAX_CHANNELS];
+    const void *src[MAX_CHANNELS];
+    unsigned c;
+
+    for (c = 0; c < channels; c++) {
+        src[c] = dst[c] = planar[c];
+        pa_runtime_test_random(planar[c], SAMPLES * sizeof(float));
+    }
+
+    pa_log_debug("Testing %u channel float performance", channels);
+
+    PA_RUNTIME_TEST_RUN_START("interleave", TIMES, TIMES2) {
+        pa_interleave(src, channels, interleaved, sizeof(float), SAMPLES);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("interleave reference", TIMES, TIMES2) {
+        interleave_ref(src, channels, interleaved, sizeof(float), SAMPLES);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("deinterleave", TIMES, TIMES2) {
+        pa_deinterleave(interleaved, dst, channels, sizeof(float), SAMPLES);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("deinterleave reference", TIMES, TIMES2) {
+        deinterleave_ref(interleaved, dst, channels, sizeof(float), SAMPLES);
+    } PA_RUNTIME_TEST_RUN_STOP
+}
+
+START_TEST (interleave_perf_test) {
+    run_perf(2);
+    run_perf(6);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Interleave");
+    tc = tcase_create("interleave");
+    tcase_add_test(tc, interleave_test);
+    tcase_add_test(tc, interleave_perf_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
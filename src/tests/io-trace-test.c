@@ -0,0 +1,184 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/io-trace.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+
+#define N_ENTRIES 64
+
+static void push(pa_io_trace *t, pa_usec_t time, pa_io_trace_flags_t flags) {
+    pa_io_trace_entry e;
+
+    pa_zero(e);
+    e.time = time;
+    e.flags = flags;
+    pa_io_trace_push(t, &e);
+}
+
+START_TEST (io_trace_order_test) {
+    pa_io_trace_entry e[N_ENTRIES];
+    pa_io_trace *t;
+    uint32_t xruns;
+    bool frozen;
+    unsigned n, i;
+
+    t = pa_io_trace_new(N_ENTRIES - 1);
+    fail_unless(pa_io_trace_get_size(t) == N_ENTRIES);
+
+    fail_unless(pa_io_trace_get(t, e, N_ENTRIES, &xruns, &frozen) == 0);
+    fail_unless(xruns == 0);
+    fail_unless(!frozen);
+
+    for (i = 0; i < 10; i++)
+        push(t, i, 0);
+
+    n = pa_io_trace_get(t, e, N_ENTRIES, NULL, NULL);
+    fail_unless(n == 10);
+    for (i = 0; i < n; i++)
+        fail_unless(e[i].time == i);
+
+    /* After wrapping around only the newest ones are left */
+    for (i = 10; i < 3 * N_ENTRIES; i++)
+        push(t, i, 0);
+
+    n = pa_io_trace_get(t, e, N_ENTRIES, NULL, NULL);
+    fail_unless(n == N_ENTRIES);
+    for (i = 0; i < n; i++)
+        fail_unless(e[i].time == 2 * N_ENTRIES + i);
+
+    /* Asking for fewer gives the newest */
+    n = pa_io_trace_get(t, e, 5, NULL, NULL);
+    fail_unless(n == 5);
+    fail_unless(e[4].time == 3 * N_ENTRIES - 1);
+
+    fail_unless(pa_io_trace_get_queries(t) == 0);
+    pa_io_trace_count_queries(t, 3);
+    pa_io_trace_count_queries(t, 1);
+    fail_unless(pa_io_trace_get_queries(t) == 4);
+
+    pa_io_trace_free(t);
+}
+END_TEST
+
+START_TEST (io_trace_xrun_test) {
+    pa_io_trace_entry e[N_ENTRIES];
+    pa_io_trace *t;
+    uint32_t xruns;
+    bool frozen;
+    unsigned n, i;
+
+    t = pa_io_trace_new(N_ENTRIES);
+
+    for (i = 0; i < 100; i++)
+        push(t, i, 0);
+
+    push(t, 100, PA_IO_TRACE_XRUN);
+
+    /* A quarter of the ring is kept after the xrun, then it stops */
+    for (i = 101; i < 1000; i++)
+        push(t, i, i == 110 ? PA_IO_TRACE_XRUN : 0);
+
+    n = pa_io_trace_get(t, e, N_ENTRIES, &xruns, &frozen);
+    fail_unless(frozen);
+    fail_unless(xruns == 2);
+    fail_unless(n == N_ENTRIES);
+    fail_unless(e[n - 1].time == 100 + N_ENTRIES / 4);
+    fail_unless(e[n - 1 - N_ENTRIES / 4].time == 100);
+    fail_unless(e[n - 1 - N_ENTRIES / 4].flags & PA_IO_TRACE_XRUN);
+
+    /* Reading restarts recording */
+    push(t, 5000, 0);
+    n = pa_io_trace_get(t, e, N_ENTRIES, &xruns, &frozen);
+    fail_unless(!frozen);
+    fail_unless(n == N_ENTRIES);
+    fail_unless(e[n - 1].time == 5000);
+
+    pa_io_trace_free(t);
+}
+END_TEST
+
+static pa_atomic_t stop;
+
+static void writer_func(void *userdata) {
+    pa_io_trace *t = userdata;
+    pa_usec_t i = 0;
+
+    while (!pa_atomic_load(&stop))
+        push(t, i++, 0);
+}
+
+/* Whatever the reader gets while the writer runs must be consecutive */
+START_TEST (io_trace_concurrent_test) {
+    pa_io_trace_entry e[N_ENTRIES];
+    pa_io_trace *t;
+    pa_thread *thread;
+    unsigned n, i, j;
+
+    t = pa_io_trace_new(N_ENTRIES);
+    pa_atomic_store(&stop, 0);
+
+    thread = pa_thread_new("writer", writer_func, t);
+    fail_unless(thread != NULL);
+
+    for (j = 0; j < 20000; j++) {
+        n = pa_io_trace_get(t, e, N_ENTRIES, NULL, NULL);
+
+        for (i = 1; i < n; i++)
+            fail_unless(e[i].time == e[i - 1].time + 1);
+    }
+
+    pa_atomic_store(&stop, 1);
+    pa_thread_free(thread);
+
+    pa_io_trace_free(t);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("IO trace");
+    tc = tcase_create("io-trace");
+    tcase_add_test(tc, io_trace_order_test);
+    tcase_add_test(tc, io_trace_xrun_test);
+    tcase_add_test(tc, io_trace_concurrent_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
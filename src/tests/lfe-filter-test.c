@@ -25,8 +25,11 @@
 #include <pulse/sample.h>
 #include <pulsecore/memblock.h>
 
+#include <pulsecore/filter/biquad.h>
 #include <pulsecore/filter/lfe-filter.h>
 
+#include "runtime-test-util.h"
+
 struct lfe_filter_test {
     pa_lfe_filter_t *lf;
     pa_mempool *pool;
@@ -172,6 +175,106 @@ START_TEST (lfe_filter_test) {
 }
 END_TEST
 
+static const pa_channel_map chmap51 = {6, {
+    PA_CHANNEL_POSITION_FRONT_LEFT, PA_CHANNEL_POSITION_FRONT_RIGHT, PA_CHANNEL_POSITION_FRONT_CENTER,
+    PA_CHANNEL_POSITION_LFE, PA_CHANNEL_POSITION_REAR_LEFT, PA_CHANNEL_POSITION_REAR_RIGHT}};
+
+/* The filter works on all channels at once, check each of them against two
+   biquads run one sample at a time */
+START_TEST (lfe_filter_channels_test) {
+    pa_sample_spec a;
+    pa_mempool *pool;
+    pa_lfe_filter_t *lf;
+    pa_memchunk mc;
+    float *in, *out;
+    unsigned i, c, n = 1000;
+
+    a.channels = chmap51.channels;
+    a.rate = 48000;
+    a.format = PA_SAMPLE_FLOAT32NE;
+
+    pa_assert_se(pool = pa_mempool_new(false, 0));
+    pa_assert_se(lf = pa_lfe_filter_new(&a, &chmap51, 120, 0));
+
+    in = pa_xnew(float, n * a.channels);
+    for (i = 0; i < n * a.channels; i++)
+        in[i] = (float) random() / RAND_MAX - 0.5f;
+
+    mc.memblock = pa_memblock_new_malloced(pool, pa_xmemdup(in, n * pa_frame_size(&a)), n * pa_frame_size(&a));
+    mc.index = 0;
+    mc.length = n * pa_frame_size(&a);
+    pa_lfe_filter_process(lf, &mc);
+    out = pa_memblock_acquire(mc.memblock);
+
+    for (c = 0; c < a.channels; c++) {
+        struct biquad bq;
+        float x1 = 0, x2 = 0, y1 = 0, y2 = 0, z1 = 0, z2 = 0;
+
+        biquad_set(&bq, chmap51.map[c] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, 120.0 / 24000);
+
+        for (i = 0; i < n; i++) {
+            float x = in[i * a.channels + c];
+            float y = bq.b0*x + bq.b1*x1 + bq.b2*x2 - bq.a1*y1 - bq.a2*y2;
+            float z = bq.b0*y + bq.b1*y1 + bq.b2*y2 - bq.a1*z1 - bq.a2*z2;
+
+            x2 = x1; x1 = x;
+            y2 = y1; y1 = y;
+            z2 = z1; z1 = z;
+
+            fail_unless(fabsf(z - out[i * a.channels + c]) < 1e-5f);
+        }
+    }
+
+    pa_memblock_release(mc.memblock);
+    pa_memblock_unref(mc.memblock);
+    pa_xfree(in);
+    pa_lfe_filter_free(lf);
+    pa_mempool_free(pool);
+}
+END_TEST
+
+#define TIMES 100
+#define TIMES2 10
+#define BENCH_FRAMES 4800
+
+START_TEST (lfe_filter_throughput_test) {
+    struct biquad_cascade *bc;
+    struct biquad lp, hp;
+    float *f;
+    short *s;
+    unsigned i, c;
+
+    bc = biquad_cascade_new(chmap51.channels, 2);
+    biquad_set(&lp, BQ_LOWPASS, 120.0 / 24000);
+    biquad_set(&hp, BQ_HIGHPASS, 120.0 / 24000);
+    for (c = 0; c < chmap51.channels; c++) {
+        biquad_cascade_set(bc, 0, c, chmap51.map[c] == PA_CHANNEL_POSITION_LFE ? &lp : &hp);
+        biquad_cascade_set(bc, 1, c, chmap51.map[c] == PA_CHANNEL_POSITION_LFE ? &lp : &hp);
+    }
+
+    f = pa_xnew(float, BENCH_FRAMES * chmap51.channels);
+    s = pa_xnew(short, BENCH_FRAMES * chmap51.channels);
+    for (i = 0; i < BENCH_FRAMES * chmap51.channels; i++) {
+        s[i] = random();
+        f[i] = s[i] / 32768.0f;
+    }
+
+    pa_log_debug("Filtering %u frames of 5.1", BENCH_FRAMES);
+
+    PA_RUNTIME_TEST_RUN_START("float32", TIMES, TIMES2) {
+        biquad_cascade_process_float32(bc, BENCH_FRAMES, f, f);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("s16", TIMES, TIMES2) {
+        biquad_cascade_process_s16(bc, BENCH_FRAMES, s, s);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_xfree(f);
+    pa_xfree(s);
+    biquad_cascade_free(bc);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -184,6 +287,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("lfe-filter");
     tc = tcase_create("lfe-filter");
     tcase_add_test(tc, lfe_filter_test);
+    tcase_add_test(tc, lfe_filter_channels_test);
+    tcase_add_test(tc, lfe_filter_throughput_test);
     tcase_set_timeout(tc, 10);
     suite_add_tcase(s, tc);
 
@@ -0,0 +1,544 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/i18n.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "bench-variants.h"
+#include "lo-test-util.h"
+
+/* Runs the loopback latency test of lo-latency-test once for every
+ * combination of the swept parameters. For every run the devices are
+ * loaded afresh into the running daemon: either a null sink, recorded from
+ * through its monitor, or an ALSA sink and source that are looped back,
+ * e.g. by snd-aloop. A resample method is tested by playing through a
+ * remap sink running at the rate of the stream, on top of a device running
+ * at DEVICE_RATE. Every run prints a single line of key=value pairs. */
+
+#define SAMPLE_HZ 44100
+#define CHANNELS 2
+#define DEVICE_RATE 48000
+#define DEVICE_FRAME_SIZE 4 /* s16le, stereo */
+
+#define SINK_NAME "lo_sweep"
+#define SOURCE_NAME "lo_sweep_in"
+#define REMAP_SINK_NAME "lo_sweep_remap"
+
+static pa_lo_test_context test_ctx;
+static const char *context_name = NULL;
+
+/* State of the current run */
+static float *out;
+static unsigned n_out, ppos;
+static pa_usec_t t_out;
+static float last;
+static struct {
+    pa_usec_t *values;
+    unsigned n, size;
+} samples;
+
+static void nop_free_cb(void *p) {
+}
+
+static void write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
+    unsigned nsamp;
+
+    /* Like in lo-latency-test, write up to the end of the pulse and let the
+     * next request fill up the rest */
+    nbytes = pa_stream_writable_size(s);
+    nsamp = nbytes / ctx->fs;
+
+    if (ppos + nsamp > n_out)
+        nbytes = (n_out - ppos) * ctx->fs;
+
+    if (ppos == 0)
+        t_out = pa_rtclock_now();
+
+    pa_assert_se(pa_stream_write(s, &out[ppos * CHANNELS], nbytes, nop_free_cb, 0, PA_SEEK_RELATIVE) == 0);
+
+    ppos = (ppos + nbytes / ctx->fs) % n_out;
+}
+
+#define WINDOW (2 * CHANNELS)
+
+static void read_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
+    const float *in;
+    unsigned int i = 0;
+    float cur;
+    size_t l;
+
+    pa_assert_se(pa_stream_peek(s, (const void **)&in, &l) == 0);
+
+    if (l == 0)
+        return;
+
+    do {
+        if (i + (ctx->ss * WINDOW) < l)
+            cur = pa_rms(in, WINDOW);
+        else
+            cur = pa_rms(in, (l - i) / ctx->ss);
+
+        /* See lo-latency-test for the thresholds */
+        if (cur - last > 0.4f && t_out > 0) {
+            if (samples.n >= samples.size) {
+                samples.size = PA_MAX(samples.size * 2, 64U);
+                samples.values = pa_xrenew(pa_usec_t, samples.values, samples.size);
+            }
+
+            samples.values[samples.n++] = pa_rtclock_now() - t_out;
+        }
+
+        last = cur;
+        in += WINDOW;
+        i += ctx->ss * WINDOW;
+    } while (i + (ctx->ss * WINDOW) <= l);
+
+    pa_stream_drop(s);
+}
+
+/* Control connection for loading the devices and reading the metrics,
+ * driven synchronously between the runs */
+static pa_mainloop *control_mainloop;
+static pa_context *control;
+
+static int control_wait(pa_operation *o) {
+    int r = 0;
+
+    if (!o) {
+        pa_log("Operation failed: %s", pa_strerror(pa_context_errno(control)));
+        return -1;
+    }
+
+    while (pa_operation_get_state(o) == PA_OPERATION_RUNNING)
+        if ((r = pa_mainloop_iterate(control_mainloop, 1, NULL)) < 0)
+            break;
+
+    pa_operation_unref(o);
+
+    return r < 0 ? -1 : 0;
+}
+
+static void index_cb(pa_context *c, uint32_t idx, void *userdata) {
+    *(uint32_t *) userdata = idx;
+}
+
+static uint32_t load_module(const char *name, const char *args) {
+    uint32_t idx = PA_INVALID_INDEX;
+
+    pa_log_debug("Loading %s %s", name, args);
+
+    if (control_wait(pa_context_load_module(control, name, args, index_cb, &idx)) < 0 || idx == PA_INVALID_INDEX)
+        pa_log("Failed to load %s %s: %s", name, args, pa_strerror(pa_context_errno(control)));
+
+    return idx;
+}
+
+static void unload_module(uint32_t *idx) {
+    if (*idx == PA_INVALID_INDEX)
+        return;
+
+    control_wait(pa_context_unload_module(control, *idx, NULL, NULL));
+    *idx = PA_INVALID_INDEX;
+}
+
+struct xruns {
+    uint64_t sink, source;
+    uint64_t watermark_increases;
+};
+
+static void metric_cb(pa_context *c, const pa_metric_info *i, int eol, void *userdata) {
+    struct xruns *x = userdata;
+
+    if (eol)
+        return;
+
+    if (pa_streq(i->name, "pulseaudio_sink_xruns_total") && pa_streq(i->label_value, SINK_NAME))
+        x->sink = i->value;
+    else if (pa_streq(i->name, "pulseaudio_source_xruns_total") && pa_streq(i->label_value, SOURCE_NAME))
+        x->source = i->value;
+    else if (pa_streq(i->name, "pulseaudio_sink_watermark_increases_total") && pa_streq(i->label_value, SINK_NAME))
+        x->watermark_increases = i->value;
+}
+
+static int control_connect(const char *server) {
+    pa_assert_se(control_mainloop = pa_mainloop_new());
+    pa_assert_se(control = pa_context_new(pa_mainloop_get_api(control_mainloop), context_name));
+
+    if (pa_context_connect(control, server, PA_CONTEXT_NOAUTOSPAWN, NULL) < 0)
+        return -1;
+
+    for (;;) {
+        pa_context_state_t state = pa_context_get_state(control);
+
+        if (state == PA_CONTEXT_READY)
+            return 0;
+
+        if (!PA_CONTEXT_IS_GOOD(state) || pa_mainloop_iterate(control_mainloop, 1, NULL) < 0)
+            return -1;
+    }
+}
+
+static int usec_compare(const void *a, const void *b) {
+    pa_usec_t x = *(const pa_usec_t*) a, y = *(const pa_usec_t*) b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static unsigned long long percentile(unsigned percent) {
+    unsigned i = (unsigned) (((uint64_t) samples.n * percent) / 100);
+
+    return (unsigned long long) samples.values[PA_MIN(i, samples.n - 1)];
+}
+
+struct config {
+    const char *alsa_sink, *alsa_source;
+    unsigned latency, period;
+    int tsched;
+    const char *resample_method;
+    unsigned duration;
+};
+
+static int run(const struct config *cfg) {
+    uint32_t sink_idx = PA_INVALID_INDEX, source_idx = PA_INVALID_INDEX, remap_idx = PA_INVALID_INDEX;
+    struct xruns xruns = { 0, 0, 0 };
+    unsigned long long sum = 0;
+    char *args;
+    unsigned i, pulse_hz = SAMPLE_HZ / 1000;
+    int ret = -1;
+
+    if (cfg->alsa_sink) {
+        args = pa_sprintf_malloc("device=%s sink_name=" SINK_NAME " format=s16le rate=%u channels=2 "
+                                 "tsched=%s fragments=4 fragment_size=%u", cfg->alsa_sink, DEVICE_RATE,
+                                 pa_yes_no(cfg->tsched), cfg->period * DEVICE_RATE / 1000 * DEVICE_FRAME_SIZE);
+        sink_idx = load_module("module-alsa-sink", args);
+        pa_xfree(args);
+
+        args = pa_sprintf_malloc("device=%s source_name=" SOURCE_NAME " format=s16le rate=%u channels=2 "
+                                 "tsched=%s fragments=4 fragment_size=%u", cfg->alsa_source, DEVICE_RATE,
+                                 pa_yes_no(cfg->tsched), cfg->period * DEVICE_RATE / 1000 * DEVICE_FRAME_SIZE);
+        source_idx = load_module("module-alsa-source", args);
+        pa_xfree(args);
+
+        test_ctx.source_name = SOURCE_NAME;
+    } else {
+        args = pa_sprintf_malloc("sink_name=" SINK_NAME " format=s16le rate=%u channels=2", DEVICE_RATE);
+        sink_idx = load_module("module-null-sink", args);
+        pa_xfree(args);
+
+        source_idx = sink_idx;
+        test_ctx.source_name = SINK_NAME ".monitor";
+    }
+
+    test_ctx.sink_name = SINK_NAME;
+
+    if (cfg->resample_method) {
+        args = pa_sprintf_malloc("sink_name=" REMAP_SINK_NAME " master=" SINK_NAME " rate=%u resample_method=%s",
+                                 SAMPLE_HZ, cfg->resample_method);
+        remap_idx = load_module("module-remap-sink", args);
+        pa_xfree(args);
+
+        test_ctx.sink_name = REMAP_SINK_NAME;
+
+        if (remap_idx == PA_INVALID_INDEX)
+            goto finish;
+    }
+
+    if (sink_idx == PA_INVALID_INDEX || source_idx == PA_INVALID_INDEX)
+        goto finish;
+
+    /* A pulse a millisecond long, repeated often enough to get a few dozen
+     * samples, but not so often that it arrives after the next one left */
+    n_out = PA_MAX(SAMPLE_HZ / 2, SAMPLE_HZ / 1000 * cfg->latency * 4);
+    out = pa_xnew0(float, n_out * CHANNELS);
+    for (i = 0; i < pulse_hz * CHANNELS; i++)
+        out[i] = 1.0f;
+
+    ppos = 0;
+    t_out = 0;
+    last = 0.0f;
+    samples.n = 0;
+
+    test_ctx.context_name = context_name;
+    test_ctx.sample_spec.format = PA_SAMPLE_FLOAT32;
+    test_ctx.sample_spec.rate = SAMPLE_HZ;
+    test_ctx.sample_spec.channels = CHANNELS;
+    test_ctx.play_latency = cfg->latency;
+    test_ctx.rec_latency = PA_MIN(cfg->latency, 5U);
+    test_ctx.read_cb = read_cb;
+    test_ctx.write_cb = write_cb;
+    test_ctx.duration = cfg->duration * 1000;
+
+    if (pa_lo_test_init(&test_ctx) < 0)
+        goto finish;
+
+    ret = pa_lo_test_run(&test_ctx);
+    pa_lo_test_deinit(&test_ctx);
+
+    if (ret < 0)
+        goto finish;
+
+    control_wait(pa_context_get_metric_info_list(control, metric_cb, &xruns));
+
+    printf("device=%s latency_msec=%u period_msec=", cfg->alsa_sink ? cfg->alsa_sink : "null", cfg->latency);
+    if (cfg->alsa_sink)
+        printf("%u tsched=%s", cfg->period, pa_yes_no(cfg->tsched));
+    else
+        printf("- tsched=-");
+    printf(" resample_method=%s samples=%u", cfg->resample_method ? cfg->resample_method : "-", samples.n);
+
+    if (samples.n > 0) {
+        qsort(samples.values, samples.n, sizeof(pa_usec_t), usec_compare);
+
+        for (i = 0; i < samples.n; i++)
+            sum += samples.values[i];
+
+        printf(" min_usec=%llu mean_usec=%llu p50_usec=%llu p90_usec=%llu max_usec=%llu",
+               (unsigned long long) samples.values[0], sum / samples.n,
+               percentile(50), percentile(90), (unsigned long long) samples.values[samples.n - 1]);
+    }
+
+    printf(" underflows=%u overflows=%u sink_xruns=%llu source_xruns=%llu watermark_increases=%llu\n",
+           test_ctx.underflows, test_ctx.overflows,
+           (unsigned long long) xruns.sink, (unsigned long long) xruns.source,
+           (unsigned long long) xruns.watermark_increases);
+    fflush(stdout);
+
+finish:
+    pa_xfree(out);
+    out = NULL;
+
+    unload_module(&remap_idx);
+    if (source_idx != sink_idx)
+        unload_module(&source_idx);
+    unload_module(&sink_idx);
+
+    return ret;
+}
+
+static void help(const char *argv0) {
+    printf(_("%s [options]\n\n"
+             "-h, --help                            Show this help\n"
+             "-v, --verbose                         Print debug messages\n"
+             "-s, --server=SERVER                   The name of the server to connect to\n"
+             "      --alsa-sink=DEVICE              ALSA device to play to (defaults to a null sink)\n"
+             "      --alsa-source=DEVICE            ALSA device to record the played signal from\n"
+             "      --latencies=MSEC[,...]          Requested playback latencies (defaults to 10,25,50,100)\n"
+             "      --periods=MSEC[,...]            ALSA fragment sizes (defaults to 5,10,25)\n"
+             "      --tsched=BOOL[,...]             ALSA timer based scheduling (defaults to yes,no)\n"
+             "      --resample-methods=METHOD[,...] Resample methods, played through a remap sink\n"
+             "                                      (defaults to none)\n"
+             "      --duration=SEC                  Length of a run, after calibration (defaults to 10)\n"
+             "\n"
+             "Every combination of the comma separated values is run once, periods and\n"
+             "timer based scheduling only apply to ALSA devices. Results are printed as\n"
+             "one line of key=value pairs per run.\n"),
+             argv0);
+}
+
+enum {
+    ARG_VERSION = 256,
+    ARG_ALSA_SINK,
+    ARG_ALSA_SOURCE,
+    ARG_LATENCIES,
+    ARG_PERIODS,
+    ARG_TSCHED,
+    ARG_RESAMPLE_METHODS,
+    ARG_DURATION
+};
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"help",             0, NULL, 'h'},
+        {"verbose",          0, NULL, 'v'},
+        {"version",          0, NULL, ARG_VERSION},
+        {"server",           1, NULL, 's'},
+        {"alsa-sink",        1, NULL, ARG_ALSA_SINK},
+        {"alsa-source",      1, NULL, ARG_ALSA_SOURCE},
+        {"latencies",        1, NULL, ARG_LATENCIES},
+        {"periods",          1, NULL, ARG_PERIODS},
+        {"tsched",           1, NULL, ARG_TSCHED},
+        {"resample-methods", 1, NULL, ARG_RESAMPLE_METHODS},
+        {"duration",         1, NULL, ARG_DURATION},
+        {NULL,               0, NULL, 0}
+    };
+
+    variants latencies, periods, tscheds, methods;
+    struct config cfg;
+    const char *server = NULL;
+    unsigned l, p, t, m, n_periods, n_tscheds, n_methods, failed = 0;
+    int c, ret = 1;
+
+    context_name = argv[0];
+    pa_zero(cfg);
+    pa_zero(latencies);
+    pa_zero(periods);
+    pa_zero(tscheds);
+    pa_zero(methods);
+    cfg.duration = 10;
+
+    pa_assert_se(variants_parse(&latencies, "10,25,50,100") >= 0);
+    pa_assert_se(variants_parse(&periods, "5,10,25") >= 0);
+    pa_assert_se(variants_parse(&tscheds, "yes,no") >= 0);
+
+    while ((c = getopt_long(argc, argv, "hvs:", long_options, NULL)) != -1) {
+
+        switch (c) {
+            case 'h':
+                help(argv[0]);
+                ret = 0;
+                goto quit;
+
+            case 'v':
+                pa_log_set_level(PA_LOG_DEBUG);
+                break;
+
+            case ARG_VERSION:
+                printf(_("%s %s\n"), argv[0], PACKAGE_VERSION);
+                ret = 0;
+                goto quit;
+
+            case 's':
+                server = optarg;
+                break;
+
+            case ARG_ALSA_SINK:
+                cfg.alsa_sink = optarg;
+                break;
+
+            case ARG_ALSA_SOURCE:
+                cfg.alsa_source = optarg;
+                break;
+
+            case ARG_LATENCIES:
+                if (variants_parse(&latencies, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_PERIODS:
+                if (variants_parse(&periods, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_TSCHED:
+                if (variants_parse(&tscheds, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_RESAMPLE_METHODS:
+                if (variants_parse(&methods, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_DURATION:
+                if (pa_atou(optarg, &cfg.duration) < 0 || cfg.duration <= 0)
+                    goto invalid;
+                break;
+
+            default:
+                goto quit;
+        }
+    }
+
+    if (!cfg.alsa_sink != !cfg.alsa_source) {
+        pa_log("--alsa-sink and --alsa-source go together.");
+        goto quit;
+    }
+
+    /* Only check the values once, rather than failing half way through */
+    for (l = 0; l < latencies.n; l++)
+        if (pa_atou(latencies.values[l], &p) < 0 || p <= 0) {
+            pa_log("Invalid latency: %s", latencies.values[l]);
+            goto quit;
+        }
+
+    for (p = 0; p < periods.n; p++)
+        if (pa_atou(periods.values[p], &t) < 0 || t <= 0) {
+            pa_log("Invalid period: %s", periods.values[p]);
+            goto quit;
+        }
+
+    for (t = 0; t < tscheds.n; t++)
+        if (pa_parse_boolean(tscheds.values[t]) < 0) {
+            pa_log("Invalid tsched value: %s", tscheds.values[t]);
+            goto quit;
+        }
+
+    /* lo-test-util connects to the default server */
+    if (server)
+        setenv("PULSE_SERVER", server, 1);
+
+    if (control_connect(server) < 0) {
+        pa_log("Failed to connect to the server: %s", pa_strerror(pa_context_errno(control)));
+        goto quit;
+    }
+
+    /* The null sink has neither periods nor timer based scheduling */
+    n_periods = cfg.alsa_sink ? periods.n : 1;
+    n_tscheds = cfg.alsa_sink ? tscheds.n : 1;
+    n_methods = PA_MAX(methods.n, 1U);
+
+    for (t = 0; t < n_tscheds; t++)
+        for (p = 0; p < n_periods; p++)
+            for (m = 0; m < n_methods; m++)
+                for (l = 0; l < latencies.n; l++) {
+                    pa_assert_se(pa_atou(latencies.values[l], &cfg.latency) >= 0);
+                    pa_assert_se(pa_atou(periods.values[p], &cfg.period) >= 0);
+                    cfg.tsched = pa_parse_boolean(tscheds.values[t]);
+                    cfg.resample_method = methods.n > 0 ? methods.values[m] : NULL;
+
+                    if (run(&cfg) < 0)
+                        failed++;
+                }
+
+    ret = failed > 0 ? 1 : 0;
+    goto quit;
+
+invalid:
+    pa_log("Invalid argument: %s", optarg);
+
+quit:
+    if (control) {
+        pa_context_disconnect(control);
+        pa_context_unref(control);
+    }
+
+    if (control_mainloop)
+        pa_mainloop_free(control_mainloop);
+
+    pa_xfree(samples.values);
+
+    variants_done(&latencies);
+    variants_done(&periods);
+    variants_done(&tscheds);
+    variants_done(&methods);
+
+    return ret;
+}
@@ -38,11 +38,17 @@ static void nop_free_cb(void *p) {
 }
 
 static void underflow_cb(struct pa_stream *s, void *userdata) {
+    pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
+
     pa_log_warn("Underflow\n");
+    ctx->underflows++;
 }
 
 static void overflow_cb(struct pa_stream *s, void *userdata) {
+    pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
+
     pa_log_warn("Overlow\n");
+    ctx->overflows++;
 }
 
 /*
@@ -66,29 +72,38 @@ enum {
     CALIBRATION_DONE,
 };
 
-static int cal_state = CALIBRATION_ONE;
+/* Reset by pa_lo_test_init(), so that a program can run several tests */
+static struct {
+    int state;
+    int count;
+    double v;
+    int skip, confirm;
+} cal;
 
 static void calibrate_write_cb(pa_stream *s, size_t nbytes, void *userdata) {
     pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
     int i, nsamp = nbytes / ctx->fs;
     float tmp[nsamp][2];
-    static int count = 0;
 
     /* Write out a sine tone */
     for (i = 0; i < nsamp; i++)
-        tmp[i][0] = tmp[i][1] = cal_state == CALIBRATION_ONE ? sinf(count++ * TONE_HZ * 2 * M_PI / ctx->sample_spec.rate) : 0.0f;
+        tmp[i][0] = tmp[i][1] = cal.state == CALIBRATION_ONE ? sinf(cal.count++ * TONE_HZ * 2 * M_PI / ctx->sample_spec.rate) : 0.0f;
 
     pa_assert_se(pa_stream_write(s, &tmp, nbytes, nop_free_cb, 0, PA_SEEK_RELATIVE) == 0);
 
-    if (cal_state == CALIBRATION_DONE)
+    if (cal.state == CALIBRATION_DONE)
         pa_stream_set_write_callback(s, ctx->write_cb, ctx);
 }
 
+static void duration_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    a->time_free(e);
+    a->quit(a, 0);
+}
+
 static void calibrate_read_cb(pa_stream *s, size_t nbytes, void *userdata) {
     pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
-    static double v = 0;
-    static int skip = 0, confirm;
-
+    pa_mainloop_api *api;
+    struct timeval tv;
     pa_cvolume vol;
     pa_operation *o;
     int nsamp;
@@ -101,34 +116,34 @@ static void calibrate_read_cb(pa_stream *s, size_t nbytes, void *userdata) {
 
     /* For each state or volume step change, throw out a few samples so we know
      * we're seeing the changed samples. */
-    if (skip++ < 100)
+    if (cal.skip++ < 100)
         goto out;
     else
-        skip = 0;
+        cal.skip = 0;
 
-    switch (cal_state) {
+    switch (cal.state) {
         case CALIBRATION_ONE:
             /* Try to detect the sine wave. RMS is 0.5, */
             if (pa_rms(in, nsamp) < 0.40f) {
-                confirm = 0;
-                v += 0.02f;
+                cal.confirm = 0;
+                cal.v += 0.02f;
 
-                if (v > 1.0) {
+                if (cal.v > 1.0) {
                     pa_log_error("Capture signal too weak at 100%% volume (%g). Giving up.\n", pa_rms(in, nsamp));
                     pa_assert_not_reached();
                 }
 
-                pa_cvolume_set(&vol, ctx->sample_spec.channels, v * PA_VOLUME_NORM);
+                pa_cvolume_set(&vol, ctx->sample_spec.channels, cal.v * PA_VOLUME_NORM);
                 o = pa_context_set_source_output_volume(ctx->context, pa_stream_get_index(s), &vol, NULL, NULL);
                 pa_assert(o != NULL);
                 pa_operation_unref(o);
             } else {
                 /* Make sure the signal strength is steadily above our threshold */
-                if (++confirm > 5) {
+                if (++cal.confirm > 5) {
 #if 0
-                    pa_log_debug(stderr, "Capture volume = %g (%g)\n", v, pa_rms(in, nsamp));
+                    pa_log_debug(stderr, "Capture volume = %g (%g)\n", cal.v, pa_rms(in, nsamp));
 #endif
-                    cal_state = CALIBRATION_ZERO;
+                    cal.state = CALIBRATION_ZERO;
                 }
             }
 
@@ -142,9 +157,18 @@ static void calibrate_read_cb(pa_stream *s, size_t nbytes, void *userdata) {
                 pa_assert_not_reached();
             }
 
-            cal_state = CALIBRATION_DONE;
+            cal.state = CALIBRATION_DONE;
             pa_stream_set_read_callback(s, ctx->read_cb, ctx);
 
+            /* Only count what happens during the actual test */
+            ctx->underflows = ctx->overflows = 0;
+
+            if (ctx->duration > 0) {
+                api = pa_mainloop_get_api(ctx->mainloop);
+                pa_timeval_add(pa_gettimeofday(&tv), (pa_usec_t) ctx->duration * PA_USEC_PER_MSEC);
+                api->time_new(api, &tv, duration_cb, ctx);
+            }
+
             break;
 
         default:
@@ -223,7 +247,7 @@ static void context_state_callback(pa_context *c, void *userdata) {
             pa_stream_set_write_callback(ctx->play_stream, calibrate_write_cb, ctx);
             pa_stream_set_underflow_callback(ctx->play_stream, underflow_cb, userdata);
 
-            pa_stream_connect_playback(ctx->play_stream, getenv("TEST_SINK"), &buffer_attr,
+            pa_stream_connect_playback(ctx->play_stream, ctx->sink_name ? ctx->sink_name : getenv("TEST_SINK"), &buffer_attr,
                     PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE, NULL, NULL);
 
             /* Create capture stream */
@@ -239,7 +263,7 @@ static void context_state_callback(pa_context *c, void *userdata) {
             pa_stream_set_read_callback(ctx->rec_stream, calibrate_read_cb, ctx);
             pa_stream_set_overflow_callback(ctx->rec_stream, overflow_cb, userdata);
 
-            pa_stream_connect_record(ctx->rec_stream, getenv("TEST_SOURCE"), &buffer_attr,
+            pa_stream_connect_record(ctx->rec_stream, ctx->source_name ? ctx->source_name : getenv("TEST_SOURCE"), &buffer_attr,
                     PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE);
 
             break;
@@ -264,6 +288,10 @@ int pa_lo_test_init(pa_lo_test_context *ctx) {
     ctx->ss = pa_sample_size(&ctx->sample_spec);
     ctx->fs = pa_frame_size(&ctx->sample_spec);
 
+    pa_zero(cal);
+    ctx->play_stream = ctx->rec_stream = NULL;
+    ctx->underflows = ctx->overflows = 0;
+
     ctx->mainloop = pa_mainloop_new();
     ctx->context = pa_context_new(pa_mainloop_get_api(ctx->mainloop), ctx->context_name);
 
@@ -280,6 +308,8 @@ int pa_lo_test_init(pa_lo_test_context *ctx) {
 quit:
     pa_context_unref(ctx->context);
     pa_mainloop_free(ctx->mainloop);
+    ctx->context = NULL;
+    ctx->mainloop = NULL;
 
     return -1;
 }
@@ -306,11 +336,17 @@ void pa_lo_test_deinit(pa_lo_test_context *ctx) {
         pa_stream_unref(ctx->rec_stream);
     }
 
-    if (ctx->context)
+    if (ctx->context) {
+        pa_context_disconnect(ctx->context);
         pa_context_unref(ctx->context);
+    }
 
     if (ctx->mainloop)
         pa_mainloop_free(ctx->mainloop);
+
+    ctx->play_stream = ctx->rec_stream = NULL;
+    ctx->context = NULL;
+    ctx->mainloop = NULL;
 }
 
 float pa_rms(const float *s, int n) {
@@ -34,6 +34,15 @@ typedef struct pa_lo_test_context {
 
     pa_stream_request_cb_t write_cb, read_cb;
 
+    /* Optional, the devices otherwise come from $TEST_SINK and $TEST_SOURCE */
+    const char *sink_name, *source_name;
+    /* Optional, stop this long after calibration, instead of running until
+     * the context goes away */
+    int duration; /* ms */
+
+    /* Stream xruns after calibration, counted by lo_test_run() */
+    unsigned underflows, overflows;
+
     /* These are set by lo_test_init() */
     pa_mainloop *mainloop;
     pa_context *context;
@@ -120,6 +120,140 @@ START_TEST (mainloop_test) {
 }
 END_TEST
 
+#ifndef GLIB_MAIN_LOOP
+
+#define N_TIMERS 500
+#define N_PIPES 64
+
+static pa_usec_t timer_times[N_TIMERS];
+static pa_usec_t last_fired;
+static unsigned n_fired;
+
+static void order_tcb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    pa_usec_t t = timer_times[PA_PTR_TO_UINT(userdata)];
+
+    fail_unless(t >= last_fired);
+    fail_unless(pa_rtclock_now() >= t);
+
+    last_fired = t;
+    n_fired++;
+}
+
+/* Expired timers fire in order of their time, also after restarts and
+ * frees moved them around in the heap */
+START_TEST (mainloop_timer_order_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_time_event *te[N_TIMERS];
+    pa_usec_t now, until;
+    struct timeval tv;
+    unsigned i, n_freed = 0, n_disabled = 0;
+
+    fail_if(!(m = pa_mainloop_new()));
+    a = pa_mainloop_get_api(m);
+
+    srand(0);
+    now = pa_rtclock_now();
+
+    for (i = 0; i < N_TIMERS; i++) {
+        timer_times[i] = now + (rand() % 200) * PA_USEC_PER_MSEC;
+        te[i] = a->time_new(a, pa_timeval_rtstore(&tv, timer_times[i], true), order_tcb, PA_UINT_TO_PTR(i));
+    }
+
+    for (i = 0; i < N_TIMERS; i += 3) {
+        timer_times[i] = now + (rand() % 200) * PA_USEC_PER_MSEC;
+        a->time_restart(te[i], pa_timeval_rtstore(&tv, timer_times[i], true));
+    }
+
+    for (i = 1; i < N_TIMERS; i += 7) {
+        a->time_free(te[i]);
+        te[i] = NULL;
+        n_freed++;
+    }
+
+    for (i = 2; i < N_TIMERS; i += 11) {
+        if (!te[i])
+            continue;
+
+        a->time_restart(te[i], NULL);
+        n_disabled++;
+    }
+
+    /* Each iteration must only fire what has expired, up to the point
+     * where all of them did */
+    until = now + 300 * PA_USEC_PER_MSEC;
+    while (pa_rtclock_now() < until)
+        fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+
+    fail_unless(n_fired == N_TIMERS - n_freed - n_disabled);
+
+    pa_mainloop_free(m);
+}
+END_TEST
+
+static pa_io_event *pipe_events[N_PIPES];
+static int pipes[N_PIPES][2];
+static unsigned n_read;
+
+static void pipe_iocb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    unsigned i = PA_PTR_TO_UINT(userdata);
+    char c;
+
+    fail_unless(fd == pipes[i][0]);
+    fail_unless(read(fd, &c, 1) == 1);
+    n_read++;
+
+    /* Free our neighbour while its pollfd may still be pending */
+    if (i % 2 == 0 && pipe_events[i + 1]) {
+        a->io_free(pipe_events[i + 1]);
+        pipe_events[i + 1] = NULL;
+    }
+}
+
+START_TEST (mainloop_io_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    unsigned i;
+
+    fail_if(!(m = pa_mainloop_new()));
+    a = pa_mainloop_get_api(m);
+
+    for (i = 0; i < N_PIPES; i++) {
+        fail_unless(pipe(pipes[i]) == 0);
+        pipe_events[i] = a->io_new(a, pipes[i][0], PA_IO_EVENT_INPUT, pipe_iocb, PA_UINT_TO_PTR(i));
+        fail_unless(write(pipes[i][1], "x", 1) == 1);
+    }
+
+    while (n_read < N_PIPES / 2)
+        fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    /* Only the even ones are left now, and they must still work */
+    fail_unless(n_read <= N_PIPES);
+    n_read = 0;
+
+    for (i = 0; i < N_PIPES; i += 2)
+        fail_unless(write(pipes[i][1], "y", 1) == 1);
+
+    while (n_read < N_PIPES / 2)
+        fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) == 0);
+    fail_unless(n_read == N_PIPES / 2);
+
+    for (i = 0; i < N_PIPES; i++) {
+        if (pipe_events[i])
+            a->io_free(pipe_events[i]);
+
+        pa_close(pipes[i][0]);
+        pa_close(pipes[i][1]);
+    }
+
+    pa_mainloop_free(m);
+}
+END_TEST
+
+#endif /* GLIB_MAIN_LOOP */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -129,6 +263,10 @@ int main(int argc, char *argv[]) {
     s = suite_create("MainLoop");
     tc = tcase_create("mainloop");
     tcase_add_test(tc, mainloop_test);
+#ifndef GLIB_MAIN_LOOP
+    tcase_add_test(tc, mainloop_timer_order_test);
+    tcase_add_test(tc, mainloop_io_test);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -20,15 +20,20 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/log.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/xmalloc-stats.h>
 
 static void release_cb(pa_memimport *i, uint32_t block_id, void *userdata) {
     pa_log("%s: Imported block %u is released.", (char*) userdata, block_id);
@@ -52,6 +57,9 @@ static void print_stats(pa_mempool *p, const char *text) {
                  "\texported_size = %u\n"
                  "\tn_too_large_for_pool = %u\n"
                  "\tn_pool_full = %u\n"
+                 "\tn_thread_cache_hits = %u\n"
+                 "\tn_thread_cache_misses = %u\n"
+                 "\tn_thread_cache_transfers = %u\n"
                  "}",
            text,
            (unsigned) pa_atomic_load(&s->n_allocated),
@@ -63,7 +71,10 @@ static void print_stats(pa_mempool *p, const char *text) {
            (unsigned) pa_atomic_load(&s->imported_size),
            (unsigned) pa_atomic_load(&s->exported_size),
            (unsigned) pa_atomic_load(&s->n_too_large_for_pool),
-           (unsigned) pa_atomic_load(&s->n_pool_full));
+           (unsigned) pa_atomic_load(&s->n_pool_full),
+           (unsigned) pa_atomic_load(&s->n_thread_cache_hits),
+           (unsigned) pa_atomic_load(&s->n_thread_cache_misses),
+           (unsigned) pa_atomic_load(&s->n_thread_cache_transfers));
 }
 
 START_TEST (memblock_test) {
@@ -175,6 +186,359 @@ START_TEST (memblock_test) {
 }
 END_TEST
 
+START_TEST (memblock_slab_test) {
+    pa_mempool *pool;
+    pa_memblock *blocks[128];
+    unsigned i;
+
+    /* A pool of 16 slots only, which used to give us 16 blocks at
+     * maximum, regardless of the block size */
+    pool = pa_mempool_new(false, 16 * 64 * 1024);
+    fail_unless(pool != NULL);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        uint8_t *d;
+
+        blocks[i] = pa_memblock_new_pool(pool, 256);
+        fail_unless(blocks[i] != NULL);
+        fail_unless(pa_memblock_get_length(blocks[i]) == 256);
+
+        d = pa_memblock_acquire(blocks[i]);
+        memset(d, (int) i, 256);
+        pa_memblock_release(blocks[i]);
+    }
+
+    print_stats(pool, "slab");
+
+    /* Large blocks must still be available next to the small ones */
+    pa_memblock_unref(blocks[0]);
+    blocks[0] = pa_memblock_new_pool(pool, (size_t) -1);
+    fail_unless(blocks[0] != NULL);
+    fail_unless(pa_memblock_get_length(blocks[0]) == pa_mempool_block_size_max(pool));
+
+    for (i = 1; i < PA_ELEMENTSOF(blocks); i++) {
+        uint8_t *d;
+
+        d = pa_memblock_acquire(blocks[i]);
+        fail_unless(d[0] == (uint8_t) i && d[255] == (uint8_t) i);
+        pa_memblock_release(blocks[i]);
+    }
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        pa_memblock_unref(blocks[i]);
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated) == 0);
+
+    /* Freed sub-slots are handed out again */
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        fail_unless((blocks[i] = pa_memblock_new_pool(pool, 256)) != NULL);
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        pa_memblock_unref(blocks[i]);
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+START_TEST (memblock_grow_test) {
+    pa_mempool *pool_a, *pool_b;
+    pa_memexport *export_a;
+    pa_memimport *import_b;
+    pa_memblock *blocks[6], *mb_b;
+    uint32_t id, shm_id, first_shm_id;
+    size_t offset, size;
+    unsigned i;
+    uint8_t *d;
+
+    /* Two slots per segment, three segments */
+    pool_a = pa_mempool_new(true, 2 * 64 * 1024);
+    fail_unless(pool_a != NULL);
+    pool_b = pa_mempool_new(true, 0);
+    fail_unless(pool_b != NULL);
+
+    pa_mempool_set_max_segments(pool_a, 3);
+    pa_mempool_get_shm_id(pool_a, &first_shm_id);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        fail_unless((blocks[i] = pa_memblock_new_pool(pool_a, (size_t) -1)) != NULL);
+
+        d = pa_memblock_acquire(blocks[i]);
+        memset(d, (int) i, pa_memblock_get_length(blocks[i]));
+        pa_memblock_release(blocks[i]);
+    }
+
+    fail_unless(pa_mempool_get_n_segments(pool_a) == 3);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool_a)->n_segments_grown) == 2);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool_a)->n_pool_full) == 0);
+
+    /* Full now */
+    fail_unless(pa_memblock_new_pool(pool_a, (size_t) -1) == NULL);
+
+    /* Blocks of the added segments go out with their own shm id */
+    export_a = pa_memexport_new(pool_a, revoke_cb, (void*) "A");
+    fail_unless(export_a != NULL);
+    import_b = pa_memimport_new(pool_b, release_cb, (void*) "B");
+    fail_unless(import_b != NULL);
+
+    fail_unless(pa_memexport_put(export_a, blocks[5], &id, &shm_id, &offset, &size) >= 0);
+    fail_unless(shm_id != first_shm_id);
+
+    mb_b = pa_memimport_get(import_b, id, shm_id, offset, size, false);
+    fail_unless(mb_b != NULL);
+    d = pa_memblock_acquire(mb_b);
+    fail_unless(d[0] == 5 && d[size - 1] == 5);
+    pa_memblock_release(mb_b);
+    pa_memblock_unref(mb_b);
+
+    pa_memimport_free(import_b);
+    pa_memexport_free(export_a);
+
+    /* The last segment is still in use, hence nothing can be released */
+    for (i = 0; i < 4; i++)
+        pa_memblock_unref(blocks[i]);
+    pa_mempool_vacuum(pool_a);
+    fail_unless(pa_mempool_get_n_segments(pool_a) == 3);
+
+    pa_memblock_unref(blocks[4]);
+    pa_memblock_unref(blocks[5]);
+    pa_mempool_vacuum(pool_a);
+    fail_unless(pa_mempool_get_n_segments(pool_a) == 1);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool_a)->n_segments_shrunk) == 2);
+
+    /* And it grows again */
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        fail_unless((blocks[i] = pa_memblock_new_pool(pool_a, (size_t) -1)) != NULL);
+    fail_unless(pa_mempool_get_n_segments(pool_a) == 3);
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        pa_memblock_unref(blocks[i]);
+
+    print_stats(pool_a, "grow");
+
+    pa_mempool_free(pool_a);
+    pa_mempool_free(pool_b);
+}
+END_TEST
+
+START_TEST (memblock_thread_cache_test) {
+    pa_mempool *pool;
+    pa_memblock *blocks[100];
+    const pa_mempool_stat *stat;
+    unsigned i, j;
+
+    pool = pa_mempool_new(false, 0);
+    fail_unless(pool != NULL);
+    stat = pa_mempool_get_stat(pool);
+
+    pa_mempool_thread_cache_enable(pool);
+
+    for (j = 0; j < 10; j++) {
+        for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+            /* Alternate between in-slot and external memblock structures */
+            blocks[i] = pa_memblock_new_pool(pool, i % 2 ? 1024 : pa_mempool_block_size_max(pool) + 1);
+            fail_unless(blocks[i] != NULL);
+        }
+
+        for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+            pa_memblock_unref(blocks[i]);
+    }
+
+    pa_mempool_thread_cache_disable(pool);
+
+    print_stats(pool, "thread cache");
+
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+    fail_unless(pa_atomic_load(&stat->n_thread_cache_hits) > 0);
+    fail_unless(pa_atomic_load(&stat->n_thread_cache_misses) > 0);
+    fail_unless(pa_atomic_load(&stat->n_thread_cache_hits) > pa_atomic_load(&stat->n_thread_cache_misses));
+
+    /* Everything has been given back to the shared free lists */
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        fail_unless((blocks[i] = pa_memblock_new_pool(pool, 1024)) != NULL);
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        pa_memblock_unref(blocks[i]);
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+START_TEST (memblock_memfd_test) {
+    pa_mempool *pool_a, *pool_b;
+    pa_memexport *export_a, *export_b;
+    pa_memimport *import_b;
+    pa_memblock *mb_a, *mb_b;
+    uint32_t id, shm_id, id_a, id_b;
+    size_t offset, size;
+    char *x;
+
+    pool_a = pa_mempool_new_memfd(0);
+    if (!pool_a) {
+        pa_log_info("No memfd support, skipping.");
+        return;
+    }
+    fail_unless(pa_mempool_is_memfd_backed(pool_a));
+
+    pool_b = pa_mempool_new(true, 0);
+    fail_unless(pool_b != NULL);
+
+    pa_mempool_get_shm_id(pool_a, &id_a);
+    pa_mempool_get_shm_id(pool_b, &id_b);
+
+    mb_a = pa_memblock_new_pool(pool_a, 1024);
+    fail_unless(mb_a != NULL);
+    x = pa_memblock_acquire(mb_a);
+    strcpy(x, "memfd");
+    pa_memblock_release(mb_a);
+
+    export_a = pa_memexport_new(pool_a, revoke_cb, (void*) "A");
+    export_b = pa_memexport_new(pool_b, revoke_cb, (void*) "B");
+    import_b = pa_memimport_new(pool_b, release_cb, (void*) "B");
+
+    /* Unknown until the fd has been passed */
+    fail_unless(pa_memexport_put(export_a, mb_a, &id, &shm_id, &offset, &size) >= 0);
+    fail_unless(shm_id == id_a);
+    fail_unless(pa_memimport_get(import_b, id, shm_id, offset, size, false) == NULL);
+
+    fail_unless(pa_memimport_attach_memfd(import_b, id_a, pa_mempool_get_memfd_fd(pool_a), false) >= 0);
+    fail_unless(pa_memimport_attach_memfd(import_b, id_a, pa_mempool_get_memfd_fd(pool_a), false) < 0);
+
+    fail_unless(pa_memexport_put(export_a, mb_a, &id, &shm_id, &offset, &size) >= 0);
+    mb_b = pa_memimport_get(import_b, id, shm_id, offset, size, false);
+    fail_unless(mb_b != NULL);
+
+    x = pa_memblock_acquire(mb_b);
+    fail_unless(strcmp(x, "memfd") == 0);
+    pa_memblock_release(mb_b);
+
+    /* Passing it on copies it into B's own segment */
+    fail_unless(pa_memexport_put(export_b, mb_b, &id, &shm_id, &offset, &size) >= 0);
+    fail_unless(shm_id == id_b);
+    pa_memblock_unref(mb_b);
+
+    print_stats(pool_a, "memfd A");
+    print_stats(pool_b, "memfd B");
+
+    pa_memexport_free(export_b);
+    pa_memimport_free(import_b);
+    pa_memexport_free(export_a);
+    pa_memblock_unref(mb_a);
+
+    pa_mempool_free(pool_a);
+    pa_mempool_free(pool_b);
+}
+END_TEST
+
+#define BENCH_THREADS_MAX 8
+#define BENCH_ITERATIONS 200000
+#define BENCH_LIVE_BLOCKS 16
+
+struct bench_thread {
+    pa_mempool *pool;
+    bool thread_cache;
+    unsigned seed;
+};
+
+/* Sizes as they come from clients and sinks, now and then too large to
+ * fit a slot */
+static size_t bench_block_size(pa_mempool *pool, unsigned *seed) {
+    unsigned r = (unsigned) rand_r(seed);
+
+    switch (r % 10) {
+        case 0: case 1: case 2: case 3:
+            return 256 + (r >> 4) % 768;
+        case 4: case 5: case 6: case 7: case 8:
+            return 1920 + (r >> 4) % 6272;
+        default:
+            return pa_mempool_block_size_max(pool) / 2 + (r >> 4) % pa_mempool_block_size_max(pool);
+    }
+}
+
+/* Keeps a few blocks alive, like a queue of a stream, replacing the
+ * oldest one on every iteration */
+static void bench_thread_func(void *userdata) {
+    struct bench_thread *t = userdata;
+    pa_memblock *live[BENCH_LIVE_BLOCKS];
+    unsigned i;
+
+    if (t->thread_cache)
+        pa_mempool_thread_cache_enable(t->pool);
+
+    for (i = 0; i < BENCH_LIVE_BLOCKS; i++)
+        live[i] = pa_memblock_new(t->pool, bench_block_size(t->pool, &t->seed));
+
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        pa_memblock_unref(live[i % BENCH_LIVE_BLOCKS]);
+        live[i % BENCH_LIVE_BLOCKS] = pa_memblock_new(t->pool, bench_block_size(t->pool, &t->seed));
+    }
+
+    for (i = 0; i < BENCH_LIVE_BLOCKS; i++)
+        pa_memblock_unref(live[i]);
+
+    if (t->thread_cache)
+        pa_mempool_thread_cache_disable(t->pool);
+}
+
+static void bench_pool(unsigned n_threads, bool thread_cache) {
+    struct bench_thread threads[BENCH_THREADS_MAX];
+    pa_thread *handles[BENCH_THREADS_MAX];
+    const pa_xmalloc_stat *xs = pa_xmalloc_get_stat();
+    const pa_mempool_stat *stat;
+    pa_mempool *pool;
+    unsigned i, allocs = 0;
+    uint64_t ops;
+    pa_usec_t start, usec;
+    char xmallocs[32];
+
+    pool = pa_mempool_new(false, 0);
+    fail_unless(pool != NULL);
+    stat = pa_mempool_get_stat(pool);
+
+    if (xs)
+        allocs = (unsigned) pa_atomic_load(&xs->n_allocs);
+    start = pa_rtclock_now();
+
+    for (i = 0; i < n_threads; i++) {
+        threads[i].pool = pool;
+        threads[i].thread_cache = thread_cache;
+        threads[i].seed = i + 1;
+        handles[i] = pa_thread_new("bench", bench_thread_func, &threads[i]);
+        fail_unless(handles[i] != NULL);
+    }
+
+    for (i = 0; i < n_threads; i++)
+        pa_thread_free(handles[i]);
+
+    usec = PA_MAX(pa_rtclock_now() - start, (pa_usec_t) 1);
+    ops = (uint64_t) n_threads * (BENCH_ITERATIONS + BENCH_LIVE_BLOCKS);
+
+    if (xs)
+        pa_snprintf(xmallocs, sizeof(xmallocs), "%0.3f", (double) ((unsigned) pa_atomic_load(&xs->n_allocs) - allocs) / ops);
+    else
+        pa_snprintf(xmallocs, sizeof(xmallocs), "n/a");
+
+    pa_log_debug("%u threads%s: %llu allocations in %llu usec, %0.0f allocations+frees/s, "
+                 "%0.3f too large/op, %0.3f pool full/op, %s xmallocs/op.",
+                 n_threads, thread_cache ? " with thread cache" : "",
+                 (unsigned long long) ops, (unsigned long long) usec,
+                 (double) ops * PA_USEC_PER_SEC / usec,
+                 (double) pa_atomic_load(&stat->n_too_large_for_pool) / ops,
+                 (double) pa_atomic_load(&stat->n_pool_full) / ops, xmallocs);
+
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+
+    pa_mempool_free(pool);
+}
+
+/* Not run with make check, measures allocating and freeing from a pool
+ * shared by several threads */
+START_TEST (memblock_pool_benchmark) {
+    unsigned n;
+
+    for (n = 1; n <= BENCH_THREADS_MAX; n *= 2) {
+        bench_pool(n, false);
+        bench_pool(n, true);
+    }
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -187,6 +551,12 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock");
     tc = tcase_create("memblock");
     tcase_add_test(tc, memblock_test);
+    tcase_add_test(tc, memblock_slab_test);
+    tcase_add_test(tc, memblock_grow_test);
+    tcase_add_test(tc, memblock_thread_cache_test);
+    tcase_add_test(tc, memblock_memfd_test);
+    if (!getenv("MAKE_CHECK"))
+        tcase_add_test(tc, memblock_pool_benchmark);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
+#include <string.h>
 
 #include <check.h>
 
@@ -30,9 +31,14 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/xmalloc-stats.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
+#include "runtime-test-util.h"
+
 static const char *fixed[] = {
     "1122444411441144__22__11______3333______________________________",
     "__________________3333__________________________________________"
@@ -212,6 +218,376 @@ START_TEST (memblockq_test) {
 }
 END_TEST
 
+START_TEST (memblockq_coalesce_test) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk chunk, out;
+    pa_memblockq_stat stat;
+    char data[64];
+    unsigned i;
+    size_t n;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+
+    p = pa_mempool_new(false, 0);
+
+    bq = pa_memblockq_new("test memblockq", 0, 1024*1024, 0, &ss, 0, 0, 0, NULL);
+    fail_unless(bq != NULL);
+
+    /* Push 1024 small chunks that all live in different blocks; they
+     * should end up in a handful of list items */
+    for (i = 0; i < 1024; i++) {
+        memset(data, 'a' + (i % 26), sizeof(data));
+
+        chunk.memblock = pa_memblock_new_fixed(p, data, sizeof(data), true);
+        chunk.index = 0;
+        chunk.length = sizeof(data);
+
+        fail_unless(pa_memblockq_push(bq, &chunk) == 0);
+        pa_memblock_unref_fixed(chunk.memblock);
+    }
+
+    fail_unless(pa_memblockq_get_length(bq) == 1024 * sizeof(data));
+    fail_unless(pa_memblockq_get_nblocks(bq) <= 1024 * sizeof(data) / 4096 + 1);
+
+    pa_memblockq_get_stat(bq, &stat);
+    fail_unless(stat.n_pushed[0] == 1024);
+    fail_unless(stat.pushed_bytes[0] == 1024 * sizeof(data));
+    fail_unless(stat.n_coalesced == 1024);
+
+    /* Make sure the data survived the copy */
+    n = 0;
+    while (pa_memblockq_peek(bq, &out) >= 0) {
+        const char *d;
+        size_t j;
+
+        fail_unless(out.memblock != NULL);
+
+        d = (const char*) pa_memblock_acquire(out.memblock) + out.index;
+        for (j = 0; j < out.length; j++, n++)
+            fail_unless(d[j] == 'a' + (char) ((n / sizeof(data)) % 26));
+        pa_memblock_release(out.memblock);
+
+        pa_memblockq_drop(bq, out.length);
+        pa_memblock_unref(out.memblock);
+    }
+
+    fail_unless(n == 1024 * sizeof(data));
+
+    pa_memblockq_free(bq);
+    pa_mempool_free(p);
+}
+END_TEST
+
+#define SEEK_CHUNK_SIZE 1024
+#define SEEK_QUEUE_LENGTH (2 * 48000 * 4)
+
+static const pa_sample_spec seek_ss = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 48000,
+    .channels = 2
+};
+
+/* Fill a queue with 2s of audio in many separate blocks, where every
+ * byte identifies the chunk it came from, and read it completely, so
+ * that all of it is available for rewinding */
+static pa_memblockq *seek_queue_new(pa_mempool *p) {
+    pa_memblockq *bq;
+    pa_memchunk chunk;
+    unsigned i;
+
+    bq = pa_memblockq_new("test memblockq", 0, SEEK_QUEUE_LENGTH, 0, &seek_ss, 0, 0, SEEK_QUEUE_LENGTH, NULL);
+    fail_unless(bq != NULL);
+
+    for (i = 0; i < SEEK_QUEUE_LENGTH / SEEK_CHUNK_SIZE; i++) {
+        chunk.memblock = pa_memblock_new(p, SEEK_CHUNK_SIZE);
+        chunk.index = 0;
+        chunk.length = SEEK_CHUNK_SIZE;
+
+        memset(pa_memblock_acquire(chunk.memblock), (int) (i & 0xFF), SEEK_CHUNK_SIZE);
+        pa_memblock_release(chunk.memblock);
+
+        fail_unless(pa_memblockq_push(bq, &chunk) == 0);
+        pa_memblock_unref(chunk.memblock);
+    }
+
+    fail_unless(pa_memblockq_get_nblocks(bq) == SEEK_QUEUE_LENGTH / SEEK_CHUNK_SIZE);
+
+    pa_memblockq_drop(bq, SEEK_QUEUE_LENGTH);
+    fail_unless(pa_memblockq_get_length(bq) == 0);
+
+    return bq;
+}
+
+static void check_read_position(pa_memblockq *bq) {
+    pa_memchunk out;
+    int64_t ri;
+    uint8_t v;
+
+    ri = pa_memblockq_get_read_index(bq);
+
+    fail_unless(pa_memblockq_peek(bq, &out) == 0);
+    fail_unless(out.memblock != NULL);
+    fail_unless(out.length == SEEK_CHUNK_SIZE - (size_t) (ri % SEEK_CHUNK_SIZE));
+
+    v = *((uint8_t*) pa_memblock_acquire(out.memblock) + out.index);
+    pa_memblock_release(out.memblock);
+    pa_memblock_unref(out.memblock);
+
+    fail_unless(v == (uint8_t) ((ri / SEEK_CHUNK_SIZE) & 0xFF));
+}
+
+START_TEST (memblockq_seek_test) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk chunk;
+    size_t rewind;
+    unsigned i;
+
+    p = pa_mempool_new(false, 0);
+    bq = seek_queue_new(p);
+
+    /* Jump back and forth through the history */
+    for (i = 0, rewind = SEEK_QUEUE_LENGTH; i < 100; i++) {
+        pa_memblockq_rewind(bq, rewind);
+        check_read_position(bq);
+        pa_memblockq_drop(bq, rewind);
+
+        rewind = ((rewind * 7 + 4 * 1234) % SEEK_QUEUE_LENGTH) & ~3U;
+        if (rewind <= 0)
+            rewind = 4;
+    }
+
+    /* Overwrite a chunk in the middle of the history, which cannot be
+     * tracked incrementally by the index */
+    pa_memblockq_rewind(bq, SEEK_QUEUE_LENGTH);
+    pa_memblockq_seek(bq, SEEK_QUEUE_LENGTH / SEEK_CHUNK_SIZE / 2 * SEEK_CHUNK_SIZE, PA_SEEK_RELATIVE_ON_READ, true);
+
+    chunk.memblock = pa_memblock_new(p, SEEK_CHUNK_SIZE);
+    chunk.index = 0;
+    chunk.length = SEEK_CHUNK_SIZE;
+    memset(pa_memblock_acquire(chunk.memblock), (SEEK_QUEUE_LENGTH / SEEK_CHUNK_SIZE / 2) & 0xFF, SEEK_CHUNK_SIZE);
+    pa_memblock_release(chunk.memblock);
+    fail_unless(pa_memblockq_push(bq, &chunk) == 0);
+    pa_memblock_unref(chunk.memblock);
+
+    pa_memblockq_seek(bq, 0, PA_SEEK_RELATIVE_END, true);
+    pa_memblockq_drop(bq, SEEK_QUEUE_LENGTH);
+
+    for (i = 0; i < SEEK_QUEUE_LENGTH / SEEK_CHUNK_SIZE; i++) {
+        pa_memblockq_rewind(bq, SEEK_QUEUE_LENGTH - i * SEEK_CHUNK_SIZE);
+        check_read_position(bq);
+        pa_memblockq_drop(bq, SEEK_QUEUE_LENGTH - i * SEEK_CHUNK_SIZE);
+    }
+
+    pa_memblockq_free(bq);
+    pa_mempool_free(p);
+}
+END_TEST
+
+/* Not run with make check, measures rewinding into a long history */
+START_TEST (memblockq_rewind_benchmark) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+
+    pa_log_set_level(PA_LOG_DEBUG);
+
+    p = pa_mempool_new(false, 0);
+    bq = seek_queue_new(p);
+
+    PA_RUNTIME_TEST_RUN_START("rewind full history", 1000, 100) {
+        pa_memchunk out;
+
+        pa_memblockq_rewind(bq, SEEK_QUEUE_LENGTH);
+        pa_memblockq_peek(bq, &out);
+        pa_memblock_unref(out.memblock);
+        pa_memblockq_drop(bq, SEEK_QUEUE_LENGTH);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("rewind 10ms", 1000, 100) {
+        pa_memchunk out;
+
+        pa_memblockq_rewind(bq, 48 * 4 * 10);
+        pa_memblockq_peek(bq, &out);
+        pa_memblock_unref(out.memblock);
+        pa_memblockq_drop(bq, 48 * 4 * 10);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_memblockq_free(bq);
+    pa_mempool_free(p);
+}
+END_TEST
+
+/* A rough picture of what clients write: small chunks from low latency
+ * and web clients, around a period from most, and now and then a large
+ * one from clients that buffer a lot. Frame aligned for s16 stereo. */
+static size_t chunk_size(unsigned *seed) {
+    unsigned r = (unsigned) rand_r(seed);
+
+    switch (r % 10) {
+        case 0: case 1: case 2: case 3:
+            return (256 + (r >> 4) % 768) & ~3U;
+        case 4: case 5: case 6: case 7:
+            return (1920 + (r >> 4) % 2176) & ~3U;
+        default:
+            return (8192 + (r >> 4) % 57344) & ~3U;
+    }
+}
+
+/* Times a stretch of operations and counts the pa_xmalloc() calls they
+ * made, if configured with --enable-xmalloc-stats */
+struct op_bench {
+    const char *label;
+    pa_usec_t usec;
+    uint64_t ops, bytes;
+    unsigned allocs;
+
+    pa_usec_t start;
+    unsigned start_allocs;
+};
+
+static unsigned xmalloc_allocs(void) {
+    const pa_xmalloc_stat *s = pa_xmalloc_get_stat();
+
+    return s ? (unsigned) pa_atomic_load(&s->n_allocs) : 0;
+}
+
+static void op_bench_start(struct op_bench *b) {
+    b->start_allocs = xmalloc_allocs();
+    b->start = pa_rtclock_now();
+}
+
+static void op_bench_stop(struct op_bench *b, uint64_t ops, uint64_t bytes) {
+    b->usec += pa_rtclock_now() - b->start;
+    b->allocs += xmalloc_allocs() - b->start_allocs;
+    b->ops += ops;
+    b->bytes += bytes;
+}
+
+static void op_bench_print(const struct op_bench *b) {
+    char allocs[32];
+
+    if (pa_xmalloc_get_stat())
+        pa_snprintf(allocs, sizeof(allocs), "%0.3f", (double) b->allocs / b->ops);
+    else
+        pa_snprintf(allocs, sizeof(allocs), "n/a");
+
+    pa_log_debug("%s: %llu ops in %llu usec, %0.0f ops/s, %0.1f MiB/s, %s xmallocs/op.", b->label,
+                 (unsigned long long) b->ops, (unsigned long long) b->usec,
+                 (double) b->ops * PA_USEC_PER_SEC / PA_MAX(b->usec, (pa_usec_t) 1),
+                 (double) b->bytes * PA_USEC_PER_SEC / PA_MAX(b->usec, (pa_usec_t) 1) / (1024 * 1024), allocs);
+}
+
+#define BENCH_CHUNKS 4096
+#define BENCH_ROUNDS 50
+#define BENCH_SOURCE_BLOCKS 16
+#define BENCH_RENDER_SIZE (48 * 4 * 10)
+#define BENCH_MAX_REWIND (64 * 1024)
+
+/* Not run with make check, measures the queue operations on the path of
+ * a playback stream */
+START_TEST (memblockq_ops_benchmark) {
+    struct op_bench push = { .label = "push" }, peek_drop = { .label = "peek+drop" }, rewind = { .label = "rewind+peek+drop" };
+    pa_memblock *sources[BENCH_SOURCE_BLOCKS];
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk silence;
+    size_t block_size;
+    unsigned seed = 1, i, j;
+
+    pa_log_set_level(PA_LOG_DEBUG);
+
+    p = pa_mempool_new(false, 0);
+    block_size = pa_mempool_block_size_max(p);
+
+    /* Chunks are slices of a few pool blocks, so that the queue rather
+     * than the pool is measured */
+    for (i = 0; i < BENCH_SOURCE_BLOCKS; i++) {
+        sources[i] = pa_memblock_new(p, block_size);
+        memset(pa_memblock_acquire(sources[i]), 0, block_size);
+        pa_memblock_release(sources[i]);
+    }
+
+    silence.memblock = sources[0];
+    silence.index = 0;
+    silence.length = block_size;
+
+    bq = pa_memblockq_new("test memblockq", 0, 64 * 1024 * 1024, 0, &ss, 0, 1, BENCH_MAX_REWIND, &silence);
+    fail_unless(bq != NULL);
+
+    for (j = 0; j < BENCH_ROUNDS; j++) {
+        uint64_t n, bytes = 0;
+        size_t length;
+
+        op_bench_start(&push);
+        for (i = 0; i < BENCH_CHUNKS; i++) {
+            pa_memchunk chunk;
+
+            chunk.memblock = sources[(unsigned) rand_r(&seed) % BENCH_SOURCE_BLOCKS];
+            chunk.length = PA_MIN(chunk_size(&seed), block_size);
+            chunk.index = ((unsigned) rand_r(&seed) % (block_size - chunk.length + 1)) & ~3U;
+
+            fail_unless(pa_memblockq_push(bq, &chunk) == 0);
+            bytes += chunk.length;
+        }
+        op_bench_stop(&push, BENCH_CHUNKS, bytes);
+
+        /* Drain half of it the way a sink renders, a period at a time */
+        length = pa_memblockq_get_length(bq);
+        op_bench_start(&peek_drop);
+        for (n = 0, bytes = 0; pa_memblockq_get_length(bq) > length / 2; n++) {
+            pa_memchunk out;
+
+            fail_unless(pa_memblockq_peek_fixed_size(bq, BENCH_RENDER_SIZE, &out) == 0);
+            pa_memblock_unref(out.memblock);
+            pa_memblockq_drop(bq, out.length);
+            bytes += out.length;
+        }
+        op_bench_stop(&peek_drop, n, bytes);
+
+        /* Rewind into the history and render again */
+        op_bench_start(&rewind);
+        for (n = 0, bytes = 0; n < BENCH_CHUNKS / 8; n++) {
+            size_t r = (chunk_size(&seed) % BENCH_MAX_REWIND) & ~3U, done;
+
+            pa_memblockq_rewind(bq, r);
+
+            for (done = 0; done < r; done += BENCH_RENDER_SIZE) {
+                pa_memchunk out;
+
+                fail_unless(pa_memblockq_peek_fixed_size(bq, BENCH_RENDER_SIZE, &out) == 0);
+                pa_memblock_unref(out.memblock);
+                pa_memblockq_drop(bq, PA_MIN(out.length, r - done));
+            }
+
+            bytes += r;
+        }
+        op_bench_stop(&rewind, n, bytes);
+
+        pa_memblockq_flush_read(bq);
+    }
+
+    op_bench_print(&push);
+    op_bench_print(&peek_drop);
+    op_bench_print(&rewind);
+
+    pa_memblockq_free(bq);
+
+    for (i = 0; i < BENCH_SOURCE_BLOCKS; i++)
+        pa_memblock_unref(sources[i]);
+
+    pa_mempool_free(p);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -221,6 +597,12 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock Queue");
     tc = tcase_create("memblockq");
     tcase_add_test(tc, memblockq_test);
+    tcase_add_test(tc, memblockq_coalesce_test);
+    tcase_add_test(tc, memblockq_seek_test);
+    if (!getenv("MAKE_CHECK")) {
+        tcase_add_test(tc, memblockq_rewind_benchmark);
+        tcase_add_test(tc, memblockq_ops_benchmark);
+    }
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,175 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/metrics.h>
+#include <pulsecore/thread.h>
+
+static void count_cb(pa_metric *metric, uint64_t value, void *userdata) {
+    unsigned *n = userdata;
+
+    (*n)++;
+}
+
+START_TEST (metrics_wrap_test) {
+    pa_mainloop *ml;
+    pa_metrics *m;
+    pa_metric *a;
+    unsigned i;
+
+    ml = pa_mainloop_new();
+    m = pa_metrics_new(pa_mainloop_get_api(ml));
+    a = pa_metric_new(m, PA_METRIC_SINK_RENDER_USEC, "a");
+
+    fail_unless(pa_metric_get(a) == 0);
+
+    pa_metric_inc(a);
+    pa_metric_add(a, 9);
+    fail_unless(pa_metric_get(a) == 10);
+
+    /* Wraps the 32 bit counter several times, folding in between */
+    for (i = 0; i < 6; i++) {
+        pa_metric_add(a, 0x80000000U);
+        fail_unless(pa_metric_get(a) == 10 + (uint64_t) (i + 1) * 0x80000000U);
+    }
+
+    pa_metric_free(a);
+    pa_metrics_free(m);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+static pa_atomic_t stop = PA_ATOMIC_INIT(0);
+
+static void writer_func(void *userdata) {
+    pa_metric *a = userdata;
+    unsigned i;
+
+    for (i = 0; i < 1000000; i++)
+        pa_metric_inc(a);
+
+    pa_atomic_store(&stop, 1);
+}
+
+START_TEST (metrics_concurrent_test) {
+    pa_mainloop *ml;
+    pa_metrics *m;
+    pa_metric *a;
+    pa_thread *thread;
+    uint64_t last = 0, v;
+
+    ml = pa_mainloop_new();
+    m = pa_metrics_new(pa_mainloop_get_api(ml));
+    a = pa_metric_new(m, PA_METRIC_SINK_REWINDS, "a");
+
+    thread = pa_thread_new("writer", writer_func, a);
+    fail_unless(thread != NULL);
+
+    while (!pa_atomic_load(&stop)) {
+        v = pa_metric_get(a);
+        fail_unless(v >= last);
+        last = v;
+    }
+
+    pa_thread_free(thread);
+
+    fail_unless(pa_metric_get(a) == 1000000);
+
+    pa_metric_free(a);
+    pa_metrics_free(m);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+START_TEST (metrics_dump_test) {
+    pa_mainloop *ml;
+    pa_metrics *m;
+    pa_metric *a, *b, *c;
+    pa_strbuf *buf;
+    unsigned n = 0;
+    char *s;
+
+    ml = pa_mainloop_new();
+    m = pa_metrics_new(pa_mainloop_get_api(ml));
+    a = pa_metric_new(m, PA_METRIC_SINK_XRUNS, "alsa_output.pci");
+    b = pa_metric_new(m, PA_METRIC_SINK_XRUNS, "odd \"name\" \\ with\nbreak");
+    c = pa_metric_new(m, PA_METRIC_NATIVE_COMMANDS, "STAT");
+
+    pa_metric_add(a, 3);
+    pa_metric_inc(c);
+
+    pa_metrics_foreach(m, count_cb, &n);
+    fail_unless(n == 3);
+
+    buf = pa_strbuf_new();
+    pa_metrics_dump(m, buf);
+    s = pa_strbuf_tostring_free(buf);
+
+    pa_log_debug("\n%s", s);
+
+    fail_unless(strstr(s, "# TYPE pulseaudio_sink_xruns_total counter\n") != NULL);
+    fail_unless(strstr(s, "\npulseaudio_sink_xruns_total{sink=\"alsa_output.pci\"} 3\n") != NULL);
+    fail_unless(strstr(s, "\npulseaudio_sink_xruns_total{sink=\"odd \\\"name\\\" \\\\ with\\nbreak\"} 0\n") != NULL);
+    fail_unless(strstr(s, "\npulseaudio_native_commands_total{command=\"STAT\"} 1\n") != NULL);
+
+    /* Every family is described, even without counters */
+    fail_unless(strstr(s, "# HELP pulseaudio_source_xruns_total ") != NULL);
+
+    pa_xfree(s);
+
+    pa_metric_free(a);
+    pa_metric_free(b);
+    pa_metric_free(c);
+    pa_metrics_free(m);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Metrics");
+    tc = tcase_create("metrics");
+    tcase_add_test(tc, metrics_wrap_test);
+    tcase_add_test(tc, metrics_concurrent_test);
+    tcase_add_test(tc, metrics_dump_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -342,6 +342,229 @@ START_TEST (mix_test) {
 }
 END_TEST
 
+static pa_memblock* generate_ramp(pa_mempool *pool, const pa_sample_spec *ss, unsigned seed) {
+    pa_memblock *r;
+    void *d;
+    unsigned k, n = 256 * ss->channels;
+
+    pa_assert_se(r = pa_memblock_new(pool, n * pa_sample_size(ss)));
+    d = pa_memblock_acquire(r);
+
+    for (k = 0; k < n; k++) {
+        /* Loud enough to clip some samples when mixed, with a given seed */
+        int32_t v = (int32_t) (((k * 7919 + seed * 104729) % 40000)) - 20000;
+
+        if (ss->format == PA_SAMPLE_S16NE)
+            ((int16_t*) d)[k] = (int16_t) (v / (seed % 2 ? 2 : 3));
+        else
+            ((float*) d)[k] = (float) v / (seed % 2 ? 65536.0f : 98304.0f);
+    }
+
+    pa_memblock_release(r);
+
+    return r;
+}
+
+static void mix_chunks(pa_mempool *pool, pa_mix_info m[], unsigned n, const pa_sample_spec *ss, const pa_cvolume *volume, pa_memchunk *result) {
+    void *ptr;
+
+    result->memblock = pa_memblock_new(pool, m[0].chunk.length);
+    result->index = 0;
+    result->length = m[0].chunk.length;
+
+    ptr = pa_memblock_acquire_chunk(result);
+    pa_mix(m, n, ptr, result->length, ss, volume, false);
+    pa_memblock_release(result->memblock);
+}
+
+START_TEST (mix_replace_test) {
+    pa_mempool *pool;
+    pa_sample_spec a;
+    pa_cvolume sink_volume;
+    static const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_FLOAT32NE };
+    unsigned f;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    fail_unless((pool = pa_mempool_new(false, 0)) != NULL, NULL);
+
+    a.channels = 2;
+    a.rate = 44100;
+
+    pa_cvolume_set(&sink_volume, a.channels, pa_sw_volume_from_linear(0.8));
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++) {
+        pa_mix_info m[3], old_stream, new_stream;
+        pa_memchunk mixed, expected, replaced;
+        unsigned k, n;
+        void *ptr, *e, *r;
+
+        a.format = formats[f];
+
+        for (k = 0; k < 3; k++) {
+            m[k].chunk.memblock = generate_ramp(pool, &a, k + 1);
+            m[k].chunk.index = 0;
+            m[k].chunk.length = pa_memblock_get_length(m[k].chunk.memblock);
+            pa_cvolume_set(&m[k].volume, a.channels, pa_sw_volume_from_linear(0.5 + 0.1 * k));
+        }
+
+        mix_chunks(pool, m, 3, &a, &sink_volume, &mixed);
+
+        /* Loud mixes with clipped samples can't be taken apart */
+        if (a.format == PA_SAMPLE_FLOAT32NE)
+            fail_unless(pa_mix_is_replaceable(&mixed, &a));
+
+        old_stream = m[2];
+        new_stream.chunk.memblock = generate_ramp(pool, &a, 4);
+        new_stream.chunk.index = 0;
+        new_stream.chunk.length = old_stream.chunk.length;
+        pa_cvolume_set(&new_stream.volume, a.channels, pa_sw_volume_from_linear(0.3));
+
+        m[2] = new_stream;
+        mix_chunks(pool, m, 3, &a, &sink_volume, &expected);
+
+        replaced.memblock = pa_memblock_new(pool, mixed.length);
+        replaced.index = 0;
+        replaced.length = mixed.length;
+
+        ptr = pa_memblock_acquire_chunk(&replaced);
+        pa_mix_replace(&mixed, &old_stream, &sink_volume, &new_stream, &sink_volume, ptr, replaced.length, &a);
+        pa_memblock_release(replaced.memblock);
+
+        e = pa_memblock_acquire_chunk(&expected);
+        r = pa_memblock_acquire_chunk(&replaced);
+        n = (unsigned) (mixed.length / pa_sample_size(&a));
+
+        if (a.format == PA_SAMPLE_S16NE) {
+            const int16_t *x = pa_memblock_acquire_chunk(&mixed);
+
+            /* Exact wherever the original mix was not clipped */
+            for (k = 0; k < n; k++)
+                if (x[k] != -0x8000 && x[k] != 0x7FFF)
+                    fail_unless(((int16_t*) e)[k] == ((int16_t*) r)[k], NULL);
+
+            pa_memblock_release(mixed.memblock);
+        } else
+            for (k = 0; k < n; k++)
+                fail_unless(fabsf(((float*) e)[k] - ((float*) r)[k]) < 1e-5, NULL);
+
+        pa_memblock_release(expected.memblock);
+        pa_memblock_release(replaced.memblock);
+
+        pa_memblock_unref(old_stream.chunk.memblock);
+        for (k = 0; k < 3; k++)
+            pa_memblock_unref(m[k].chunk.memblock);
+        pa_memblock_unref(mixed.memblock);
+        pa_memblock_unref(expected.memblock);
+        pa_memblock_unref(replaced.memblock);
+    }
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+static pa_memblock* generate_constant(pa_mempool *pool, const pa_sample_spec *ss, unsigned frames, double value) {
+    pa_memblock *r;
+    void *d;
+    unsigned k, n = frames * ss->channels;
+
+    pa_assert_se(r = pa_memblock_new(pool, n * pa_sample_size(ss)));
+    d = pa_memblock_acquire(r);
+
+    for (k = 0; k < n; k++) {
+        if (ss->format == PA_SAMPLE_S16NE)
+            ((int16_t*) d)[k] = (int16_t) (value * 0x8000);
+        else
+            ((float*) d)[k] = (float) value;
+    }
+
+    pa_memblock_release(r);
+
+    return r;
+}
+
+static double sample_at(const pa_sample_spec *ss, const void *d, unsigned k) {
+    if (ss->format == PA_SAMPLE_S16NE)
+        return ((const int16_t*) d)[k] / (double) 0x8000;
+
+    return ((const float*) d)[k];
+}
+
+START_TEST (mix_ramp_test) {
+    pa_mempool *pool;
+    pa_sample_spec a;
+    static const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_FLOAT32NE };
+    const unsigned frames = 1536, ramp_frames = 1000;
+    unsigned f;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    fail_unless((pool = pa_mempool_new(false, 0)) != NULL, NULL);
+
+    a.channels = 2;
+    a.rate = 44100;
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++) {
+        pa_mix_info m[2];
+        pa_memchunk result;
+        double last = 0;
+        unsigned k;
+        void *d;
+
+        a.format = formats[f];
+
+        /* One stream at a fixed volume, one fading in from silence */
+        for (k = 0; k < 2; k++) {
+            m[k].chunk.memblock = generate_constant(pool, &a, frames, k ? 0.5 : 0.125);
+            m[k].chunk.index = 0;
+            m[k].chunk.length = pa_memblock_get_length(m[k].chunk.memblock);
+        }
+
+        pa_cvolume_set(&m[0].volume, a.channels, pa_sw_volume_from_linear(0.5));
+        m[0].ramp_length = 0;
+
+        pa_cvolume_mute(&m[1].volume, a.channels);
+        pa_cvolume_reset(&m[1].ramp_volume, a.channels);
+        m[1].ramp_length = ramp_frames * pa_frame_size(&a);
+
+        result.memblock = pa_memblock_new(pool, m[0].chunk.length);
+        result.index = 0;
+        result.length = m[0].chunk.length;
+
+        d = pa_memblock_acquire_chunk(&result);
+        pa_mix_ramp(m, 2, d, result.length, &a, NULL, false);
+
+        for (k = 0; k < frames; k++) {
+            double expected = 0.0625 + 0.5 * PA_MIN((double) k / ramp_frames, 1.0);
+            double v = sample_at(&a, d, k * a.channels);
+
+            /* Both channels get the same volume */
+            fail_unless(v == sample_at(&a, d, k * a.channels + 1), NULL);
+
+            /* The volume moves in small steps, never backwards, and
+             * reaches the end of the ramp exactly */
+            fail_unless(v >= last, NULL);
+            if (k < ramp_frames)
+                fail_unless(fabs(v - expected) < 0.5 * 32 / ramp_frames, NULL);
+            else
+                fail_unless(fabs(v - expected) < 1e-4, NULL);
+
+            last = v;
+        }
+
+        pa_memblock_release(result.memblock);
+
+        for (k = 0; k < 2; k++)
+            pa_memblock_unref(m[k].chunk.memblock);
+        pa_memblock_unref(result.memblock);
+    }
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -351,6 +574,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Mix");
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_test);
+    tcase_add_test(tc, mix_replace_test);
+    tcase_add_test(tc, mix_ramp_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -56,8 +56,8 @@ START_TEST (mult_s16_test) {
     int32_t sum1 = 0, sum2 = 0;
     int i;
 
-    pa_random(samples, sizeof(samples));
-    pa_random(volumes, sizeof(volumes));
+    pa_runtime_test_random(samples, sizeof(samples));
+    pa_runtime_test_random(volumes, sizeof(volumes));
 
     for (i = 0; i < SAMPLES; i++) {
         int32_t a = pa_mult_s16_volume_32(samples[i], volumes[i]);
@@ -0,0 +1,275 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/iochannel.h>
+#include <pulsecore/pstream.h>
+#include <pulsecore/pcm-codec.h>
+#include <pulsecore/endianmacros.h>
+
+#define N_FRAMES 4096
+
+static pa_memblock *make_block(pa_mempool *pool, const pa_sample_spec *ss, bool noise) {
+    pa_memblock *b;
+    int16_t *d;
+    unsigned i, c;
+
+    b = pa_memblock_new(pool, N_FRAMES * pa_frame_size(ss));
+    d = pa_memblock_acquire(b);
+
+    for (i = 0; i < N_FRAMES; i++)
+        for (c = 0; c < ss->channels; c++) {
+            int16_t s;
+
+            if (noise)
+                s = (int16_t) (rand() & 0xFFFF);
+            else
+                s = (int16_t) (20000.0 * sin(2.0 * M_PI * (440.0 + 110.0 * c) * i / ss->rate));
+
+            d[i * ss->channels + c] = ss->format == PA_SAMPLE_S16LE ? PA_INT16_TO_LE(s) : PA_INT16_TO_BE(s);
+        }
+
+    pa_memblock_release(b);
+    return b;
+}
+
+static void check_round_trip(pa_mempool *pool, const pa_sample_spec *ss, const pa_memchunk *chunk) {
+    pa_memchunk encoded;
+    pa_memblock *decoded;
+    void *src, *enc, *dec;
+
+    fail_unless(pa_pcm_codec_encode(pool, ss, chunk, &encoded) == 0);
+    fail_unless(encoded.length < chunk->length);
+
+    enc = pa_memblock_acquire(encoded.memblock);
+    decoded = pa_pcm_codec_decode(pool, (uint8_t *) enc + encoded.index, encoded.length);
+    fail_unless(decoded != NULL);
+
+    /* A truncated stream must be rejected */
+    fail_unless(pa_pcm_codec_decode(pool, (uint8_t *) enc + encoded.index, encoded.length / 2) == NULL);
+    pa_memblock_release(encoded.memblock);
+
+    fail_unless(pa_memblock_get_length(decoded) == chunk->length);
+
+    src = pa_memblock_acquire(chunk->memblock);
+    dec = pa_memblock_acquire(decoded);
+    fail_unless(memcmp((uint8_t *) src + chunk->index, dec, chunk->length) == 0);
+    pa_memblock_release(decoded);
+    pa_memblock_release(chunk->memblock);
+
+    pa_log_debug("%s, %u channels: %lu -> %lu bytes", pa_sample_format_to_string(ss->format), ss->channels,
+                 (unsigned long) chunk->length, (unsigned long) encoded.length);
+
+    pa_memblock_unref(decoded);
+    pa_memblock_unref(encoded.memblock);
+}
+
+START_TEST (pcm_codec_test) {
+    const pa_sample_format_t formats[] = { PA_SAMPLE_S16LE, PA_SAMPLE_S16BE };
+    const uint8_t channels[] = { 1, 2, 6 };
+    pa_mempool *pool;
+    unsigned i, j;
+
+    fail_unless((pool = pa_mempool_new(false, 0)) != NULL);
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++)
+        for (j = 0; j < PA_ELEMENTSOF(channels); j++) {
+            pa_sample_spec ss;
+            pa_memchunk chunk;
+
+            ss.format = formats[i];
+            ss.rate = 44100;
+            ss.channels = channels[j];
+
+            chunk.memblock = make_block(pool, &ss, false);
+            chunk.index = 0;
+            chunk.length = pa_memblock_get_length(chunk.memblock);
+            check_round_trip(pool, &ss, &chunk);
+
+            /* Odd offset and length within the block */
+            chunk.index = pa_frame_size(&ss) * 3;
+            chunk.length -= pa_frame_size(&ss) * 10;
+            check_round_trip(pool, &ss, &chunk);
+
+            pa_memblock_unref(chunk.memblock);
+        }
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+START_TEST (pcm_codec_incompressible_test) {
+    pa_sample_spec ss = { PA_SAMPLE_S16LE, 44100, 2 };
+    pa_memchunk chunk, encoded;
+    pa_mempool *pool;
+
+    fail_unless((pool = pa_mempool_new(false, 0)) != NULL);
+
+    /* White noise does not get smaller, the caller must send it as is */
+    chunk.memblock = make_block(pool, &ss, true);
+    chunk.index = 0;
+    chunk.length = pa_memblock_get_length(chunk.memblock);
+    fail_unless(pa_pcm_codec_encode(pool, &ss, &chunk, &encoded) < 0);
+    fail_unless(encoded.memblock == NULL);
+
+    /* Partial frames are not encoded */
+    chunk.length--;
+    fail_unless(pa_pcm_codec_encode(pool, &ss, &chunk, &encoded) < 0);
+
+    pa_memblock_unref(chunk.memblock);
+    pa_mempool_free(pool);
+}
+END_TEST
+
+START_TEST (pcm_codec_invalid_test) {
+    const uint8_t bad_format[] = { PA_SAMPLE_FLOAT32LE, 2, 0, 0, 0, 1, 0, 0xFF, 0, 0xFF };
+    const uint8_t bad_channels[] = { PA_SAMPLE_S16LE, 0, 0, 0, 0, 1, 0, 0xFF };
+    const uint8_t too_many_frames[] = { PA_SAMPLE_S16LE, 1, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0xFF };
+    const uint8_t bad_parameter[] = { PA_SAMPLE_S16LE, 1, 0, 0, 0, 1, 0xFF, 0xFF };
+    pa_mempool *pool;
+
+    fail_unless((pool = pa_mempool_new(false, 0)) != NULL);
+
+    fail_unless(pa_pcm_codec_decode(pool, bad_format, 3) == NULL);
+    fail_unless(pa_pcm_codec_decode(pool, bad_format, sizeof(bad_format)) == NULL);
+    fail_unless(pa_pcm_codec_decode(pool, bad_channels, sizeof(bad_channels)) == NULL);
+    fail_unless(pa_pcm_codec_decode(pool, too_many_frames, sizeof(too_many_frames)) == NULL);
+    fail_unless(pa_pcm_codec_decode(pool, bad_parameter, sizeof(bad_parameter)) == NULL);
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+static uint8_t *received;
+static size_t received_length;
+
+static void memblock_received(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    void *d;
+
+    fail_unless(channel == 7);
+
+    d = pa_memblock_acquire(chunk->memblock);
+    received = pa_xrealloc(received, received_length + chunk->length);
+    memcpy(received + received_length, (uint8_t *) d + chunk->index, chunk->length);
+    received_length += chunk->length;
+    pa_memblock_release(chunk->memblock);
+}
+
+/* Blocks larger than a pool slot are split and each piece coded on its
+ * own, the other side must get back exactly what was sent */
+START_TEST (pcm_codec_pstream_test) {
+    pa_sample_spec ss = { PA_SAMPLE_S16LE, 48000, 6 };
+    int pipefd[4];
+    pa_mainloop *ml;
+    pa_mempool *pool;
+    pa_iochannel *io1, *io2;
+    pa_pstream *p1, *p2;
+    pa_memchunk chunk;
+    size_t i, n;
+    void *d;
+
+    fail_unless((ml = pa_mainloop_new()) != NULL);
+    fail_unless((pool = pa_mempool_new(false, 0)) != NULL);
+
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+    io1 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[2], pipefd[1]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[0], pipefd[3]);
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), io1, pool);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), io2, pool);
+    pa_pstream_set_receive_memblock_callback(p2, memblock_received, NULL);
+
+    pa_pstream_set_codec(p1, 7, &ss);
+
+    n = 2 * pa_mempool_block_size_max(pool) + 1000;
+    n -= n % pa_frame_size(&ss);
+
+    chunk.memblock = pa_memblock_new(pool, n);
+    d = pa_memblock_acquire(chunk.memblock);
+    for (i = 0; i < n / sizeof(int16_t); i++)
+        ((int16_t *) d)[i] = (int16_t) (10000.0 * sin(i / 50.0));
+    pa_memblock_release(chunk.memblock);
+
+    /* The whole block, then a part of it that is not frame aligned when
+     * split on the slot size */
+    chunk.index = 0;
+    chunk.length = n;
+    pa_pstream_send_memblock(p1, 7, 0, PA_SEEK_RELATIVE, &chunk);
+
+    chunk.index = pa_frame_size(&ss) * 3;
+    chunk.length = n - pa_frame_size(&ss) * 10;
+    pa_pstream_send_memblock(p1, 7, 0, PA_SEEK_RELATIVE, &chunk);
+
+    while (received_length < n + chunk.length)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(received_length == n + chunk.length);
+
+    d = pa_memblock_acquire(chunk.memblock);
+    fail_unless(memcmp(received, d, n) == 0);
+    fail_unless(memcmp(received + n, (uint8_t *) d + chunk.index, chunk.length) == 0);
+    pa_memblock_release(chunk.memblock);
+
+    pa_memblock_unref(chunk.memblock);
+    pa_xfree(received);
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_free(pool);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("PCM codec");
+    tc = tcase_create("pcm-codec");
+    tcase_add_test(tc, pcm_codec_test);
+    tcase_add_test(tc, pcm_codec_incompressible_test);
+    tcase_add_test(tc, pcm_codec_invalid_test);
+    tcase_add_test(tc, pcm_codec_pstream_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
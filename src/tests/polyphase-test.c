@@ -0,0 +1,486 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <string.h>
+
+#include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/random.h>
+#include <pulsecore/resampler.h>
+
+#include "runtime-test-util.h"
+
+#define CHANNELS 2
+#define FREQ 1000.0
+#define CHUNK_FRAMES 1000
+
+/* Leave out the start, where the filter still sees the silence in front
+ * of the first input frame */
+#define SKIP_FRAMES 200
+
+#define TIMES 10000
+#define TIMES2 100
+
+/* Resamples a second of a sine wave, with the input rate switched to
+ * rate_b halfway through if non-zero, and compares the result with the
+ * ideal sine at the output rate. The input is generated at the current
+ * input rate, so the output is the same sine all the way through. */
+static void run_sine_test(uint32_t i_rate, uint32_t o_rate, uint32_t rate_b, pa_resample_flags_t flags) {
+    pa_mempool *pool;
+    pa_resampler *r;
+    pa_sample_spec a, b;
+    pa_memchunk in, out;
+    double in_phase = 0.0, out_phase = 0.0, max_err = 0.0;
+    unsigned n, i, c, o_total = 0, n_chunks;
+    uint64_t expected;
+
+    pa_log_debug("Checking %u Hz -> %u Hz%s", i_rate, o_rate, rate_b ? " (variable)" : "");
+
+    pa_assert_se(pool = pa_mempool_new(false, 0));
+
+    a.format = b.format = PA_SAMPLE_FLOAT32NE;
+    a.channels = b.channels = CHANNELS;
+    a.rate = i_rate;
+    b.rate = o_rate;
+
+    pa_assert_se(r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, PA_RESAMPLER_POLYPHASE, flags | PA_RESAMPLER_NO_LFE));
+    fail_unless(pa_resampler_get_method(r) == PA_RESAMPLER_POLYPHASE);
+
+    in.memblock = pa_memblock_new(pool, CHUNK_FRAMES * pa_frame_size(&a));
+    in.index = 0;
+    in.length = pa_memblock_get_length(in.memblock);
+
+    n_chunks = i_rate / CHUNK_FRAMES;
+    expected = (uint64_t) n_chunks * CHUNK_FRAMES * o_rate / i_rate;
+
+    for (n = 0; n < n_chunks; n++) {
+        float *d;
+
+        if (rate_b && n == n_chunks / 2) {
+            pa_resampler_set_input_rate(r, rate_b);
+            i_rate = rate_b;
+        }
+
+        d = pa_memblock_acquire(in.memblock);
+        for (i = 0; i < CHUNK_FRAMES; i++) {
+            for (c = 0; c < CHANNELS; c++)
+                d[i * CHANNELS + c] = (float) (0.5 * sin(in_phase + c));
+            in_phase += 2.0 * M_PI * FREQ / i_rate;
+        }
+        pa_memblock_release(in.memblock);
+
+        pa_resampler_run(r, &in, &out);
+
+        if (!out.memblock)
+            continue;
+
+        d = pa_memblock_acquire_chunk(&out);
+        for (i = 0; i < out.length / pa_frame_size(&b); i++, o_total++) {
+            if (o_total >= SKIP_FRAMES)
+                for (c = 0; c < CHANNELS; c++)
+                    max_err = PA_MAX(max_err, fabs(d[i * CHANNELS + c] - 0.5 * sin(out_phase + c)));
+
+            out_phase += 2.0 * M_PI * FREQ / o_rate;
+        }
+        pa_memblock_release(out.memblock);
+        pa_memblock_unref(out.memblock);
+    }
+
+    pa_log_debug("%u output frames, max error %g", o_total, max_err);
+
+    /* Only the filter delay may be missing, and the rate switch changes
+     * the output length by less than a percent */
+    fail_unless(o_total <= expected + expected / 100);
+    fail_unless(o_total + 256 + expected / 100 >= expected);
+    fail_unless(max_err < (rate_b ? 5e-3 : 1e-3));
+
+    pa_memblock_unref(in.memblock);
+    pa_resampler_free(r);
+    pa_mempool_free(pool);
+}
+
+START_TEST (polyphase_ratio_test) {
+    run_sine_test(44100, 48000, 0, 0);
+    run_sine_test(48000, 44100, 0, 0);
+    run_sine_test(48000, 16000, 0, 0);
+    run_sine_test(32000, 48000, 0, 0);
+    run_sine_test(8000, 44100, 0, 0);
+}
+END_TEST
+
+START_TEST (polyphase_variable_rate_test) {
+    run_sine_test(44100, 48000, 44150, PA_RESAMPLER_VARIABLE_RATE);
+    run_sine_test(48000, 48000, 47950, PA_RESAMPLER_VARIABLE_RATE);
+}
+END_TEST
+
+/* Running the stages tile by tile must give the same result as running
+ * them one after another over the whole chunk */
+static void run_fused_test(pa_resample_method_t method) {
+    pa_mempool *pool;
+    pa_resampler *fused, *unfused;
+    pa_sample_spec a, b;
+    pa_memchunk in, out_f, out_u;
+    int16_t *d;
+    unsigned i, n;
+
+    pa_log_debug("Checking fused stages with resampler '%s'", pa_resample_method_to_string(method));
+
+    pa_assert_se(pool = pa_mempool_new(false, 0));
+
+    a.format = PA_SAMPLE_S16NE;
+    a.channels = 2;
+    a.rate = 44100;
+    b.format = PA_SAMPLE_FLOAT32NE;
+    b.channels = 1;
+    b.rate = 48000;
+
+    pa_assert_se(fused = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, method, 0));
+    pa_assert_se(unfused = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, method, PA_RESAMPLER_NO_FUSE));
+    fail_unless(fused->tile_frames > 0);
+    fail_unless(unfused->tile_frames == 0);
+
+    in.memblock = pa_memblock_new(pool, 10000 * pa_frame_size(&a));
+    in.index = 0;
+    in.length = pa_memblock_get_length(in.memblock);
+
+    d = pa_memblock_acquire(in.memblock);
+    for (i = 0; i < in.length / sizeof(int16_t); i++)
+        d[i] = (int16_t) (10000 * sin(i * 0.01));
+    pa_memblock_release(in.memblock);
+
+    for (n = 0; n < 3; n++) {
+        pa_resampler_run(fused, &in, &out_f);
+        pa_resampler_run(unfused, &in, &out_u);
+
+        fail_unless(out_f.length == out_u.length);
+        fail_unless(memcmp(pa_memblock_acquire_chunk(&out_f), pa_memblock_acquire_chunk(&out_u), out_f.length) == 0);
+
+        pa_memblock_release(out_f.memblock);
+        pa_memblock_release(out_u.memblock);
+        pa_memblock_unref(out_f.memblock);
+        pa_memblock_unref(out_u.memblock);
+    }
+
+    pa_memblock_unref(in.memblock);
+    pa_resampler_free(fused);
+    pa_resampler_free(unfused);
+    pa_mempool_free(pool);
+}
+
+START_TEST (resampler_fused_test) {
+    run_fused_test(PA_RESAMPLER_POLYPHASE);
+    run_fused_test(PA_RESAMPLER_TRIVIAL);
+    run_fused_test(PA_RESAMPLER_FFMPEG);
+}
+END_TEST
+
+/* With timing enabled every run is counted once per phase, and the
+ * output is the same as without */
+START_TEST (resampler_timing_test) {
+    pa_mempool *pool;
+    pa_resampler *timed, *plain;
+    pa_resampler_timing timing;
+    pa_sample_spec a, b;
+    pa_memchunk in, out_t, out_p;
+    unsigned n, p, k;
+    uint64_t sum;
+
+    pa_assert_se(pool = pa_mempool_new(false, 0));
+
+    a.format = PA_SAMPLE_S16NE;
+    a.channels = 2;
+    a.rate = 44100;
+    b.format = PA_SAMPLE_FLOAT32NE;
+    b.channels = 1;
+    b.rate = 48000;
+
+    pa_assert_se(timed = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, PA_RESAMPLER_POLYPHASE, PA_RESAMPLER_TIMING));
+    pa_assert_se(plain = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, PA_RESAMPLER_POLYPHASE, 0));
+
+    in.memblock = pa_memblock_new(pool, 4096 * pa_frame_size(&a));
+    in.index = 0;
+    in.length = pa_memblock_get_length(in.memblock);
+    pa_silence_memchunk(&in, &a);
+
+    for (n = 0; n < 10; n++) {
+        pa_resampler_run(timed, &in, &out_t);
+        pa_resampler_run(plain, &in, &out_p);
+
+        fail_unless(out_t.length == out_p.length);
+        fail_unless(memcmp(pa_memblock_acquire_chunk(&out_t), pa_memblock_acquire_chunk(&out_p), out_t.length) == 0);
+
+        pa_memblock_release(out_t.memblock);
+        pa_memblock_release(out_p.memblock);
+        pa_memblock_unref(out_t.memblock);
+        pa_memblock_unref(out_p.memblock);
+    }
+
+    pa_resampler_get_timing(timed, &timing);
+    fail_unless(timing.calls == 10);
+
+    for (p = 0; p < PA_RESAMPLER_PHASE_MAX; p++) {
+        for (k = 0, sum = 0; k < PA_RESAMPLER_TIMING_BUCKETS; k++)
+            sum += timing.histogram[p][k];
+
+        fail_unless(sum == 10);
+    }
+
+    fail_unless(timing.nsec[PA_RESAMPLER_PHASE_RESAMPLE] > 0);
+
+    pa_resampler_get_timing(plain, &timing);
+    fail_unless(timing.calls == 0);
+
+    pa_memblock_unref(in.memblock);
+    pa_resampler_free(timed);
+    pa_resampler_free(plain);
+    pa_mempool_free(pool);
+}
+END_TEST
+
+/* Apart from the output block, running the stages must not allocate,
+ * whatever the chunk sizes */
+static void run_arena_test(pa_resample_flags_t flags) {
+    static const unsigned lengths[] = { 1, 4410, 17, 1024, 333, 2048, 5, 700 };
+    pa_mempool *pool;
+    pa_resampler *r;
+    pa_sample_spec a, b;
+    pa_memchunk in, out;
+    unsigned n, k, max_frames;
+    int before;
+
+    pa_assert_se(pool = pa_mempool_new(false, 0));
+
+    a.format = PA_SAMPLE_S16NE;
+    a.channels = 2;
+    a.rate = 44100;
+    b.format = PA_SAMPLE_FLOAT32NE;
+    b.channels = 1;
+    b.rate = 48000;
+
+    pa_assert_se(r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, PA_RESAMPLER_POLYPHASE, flags));
+    max_frames = pa_resampler_max_block_size(r) / pa_frame_size(&a);
+
+    in.memblock = pa_memblock_new(pool, max_frames * pa_frame_size(&a));
+    pa_silence_memblock(in.memblock, &a);
+    in.index = 0;
+
+    for (n = 0; n < 3; n++)
+        for (k = 0; k < PA_ELEMENTSOF(lengths); k++) {
+            in.length = PA_MIN(lengths[k], max_frames) * pa_frame_size(&a);
+
+            before = pa_atomic_load(&pa_mempool_get_stat(pool)->n_accumulated);
+            pa_resampler_run(r, &in, &out);
+
+            if (out.memblock) {
+                fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_accumulated) == before + 1);
+                pa_memblock_unref(out.memblock);
+            } else
+                fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_accumulated) == before);
+        }
+
+    pa_memblock_unref(in.memblock);
+    pa_resampler_free(r);
+    pa_mempool_free(pool);
+}
+
+START_TEST (resampler_arena_test) {
+    run_arena_test(0);
+    run_arena_test(PA_RESAMPLER_NO_FUSE);
+}
+END_TEST
+
+static void table_init(void *table, size_t size, void *userdata) {
+    unsigned *n_init = userdata;
+
+    memset(table, 0x5a, size);
+    (*n_init)++;
+}
+
+START_TEST (resampler_table_test) {
+    const void *t1, *t2, *t3;
+    unsigned n_init = 0;
+
+    t1 = pa_resampler_table_ref(PA_RESAMPLER_POLYPHASE, 44100, 48000, 7, 4096, table_init, &n_init);
+    t2 = pa_resampler_table_ref(PA_RESAMPLER_POLYPHASE, 44100, 48000, 7, 4096, table_init, &n_init);
+    t3 = pa_resampler_table_ref(PA_RESAMPLER_POLYPHASE, 48000, 44100, 7, 4096, table_init, &n_init);
+
+    /* Same parameters share a table, which is only computed once */
+    fail_unless(t1 == t2);
+    fail_unless(t1 != t3);
+    fail_unless(n_init == 2);
+    fail_unless(((const uint8_t*) t1)[4095] == 0x5a);
+
+    pa_resampler_table_unref(t1);
+    pa_resampler_table_unref(t3);
+
+    /* Still referenced once */
+    fail_unless(pa_resampler_table_ref(PA_RESAMPLER_POLYPHASE, 44100, 48000, 7, 4096, table_init, &n_init) == t2);
+    fail_unless(n_init == 2);
+
+    pa_resampler_table_unref(t2);
+    pa_resampler_table_unref(t2);
+}
+END_TEST
+
+#if (defined (__i386__) || defined (__amd64__) || (defined (__arm__) && defined (__linux__))) && \
+    (defined (HAVE_SSE4_1) || defined (HAVE_AVX2) || defined (HAVE_NEON))
+static void run_dot_test(pa_polyphase_dot_func_t func, pa_polyphase_dot_func_t orig_func) {
+    PA_DECLARE_ALIGNED(8, float, a[257]);
+    PA_DECLARE_ALIGNED(8, float, b[256]);
+    int16_t r[257];
+    float sum = 0.0f;
+    unsigned i, n;
+
+    pa_runtime_test_random(r, sizeof(r));
+
+    for (i = 0; i < PA_ELEMENTSOF(a); i++)
+        a[i] = r[i] / 32768.0f;
+    for (i = 0; i < PA_ELEMENTSOF(b); i++)
+        b[i] = r[PA_ELEMENTSOF(r) - 1 - i] / 32768.0f;
+
+    /* Shift by one to check unaligned loads */
+    for (n = 8; n <= 256; n += 8) {
+        float ref = orig_func(a + 1, b, n), v = func(a + 1, b, n);
+
+        if (fabsf(v - ref) > 1e-5f * n) {
+            pa_log_debug("Correctness test failed: n=%u", n);
+            pa_log_debug("%.9f != %.9f", v, ref);
+            fail();
+        }
+    }
+
+    pa_log_debug("Testing polyphase dot product performance with 32 taps");
+
+    PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+        sum += func(a + 1, b, 32);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+        sum += orig_func(a + 1, b, 32);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    /* Keep the compiler from dropping the loops */
+    fail_unless(!isnan(sum));
+}
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE4_1) || defined (HAVE_AVX2))
+static void run_dot_x86_test(const char *name, pa_cpu_x86_flag_t flag, void (*init)(pa_cpu_x86_flag_t flags)) {
+    pa_polyphase_dot_func_t orig_func;
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & flag)) {
+        pa_log_info("%s not supported. Skipping", name);
+        return;
+    }
+
+    orig_func = pa_get_polyphase_dot_func();
+    init(flags);
+
+    pa_log_debug("Checking %s polyphase dot product", name);
+    run_dot_test(pa_get_polyphase_dot_func(), orig_func);
+
+    pa_set_polyphase_dot_func(orig_func);
+}
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE4_1)
+START_TEST (polyphase_sse4_test) {
+    run_dot_x86_test("SSE4.1", PA_CPU_X86_SSE4_1, pa_polyphase_func_init_sse4);
+}
+END_TEST
+#endif
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (polyphase_avx2_test) {
+    run_dot_x86_test("AVX2", PA_CPU_X86_AVX2, pa_polyphase_func_init_avx2);
+}
+END_TEST
+#endif
+
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+START_TEST (polyphase_neon_test) {
+    pa_polyphase_dot_func_t orig_func;
+    pa_cpu_arm_flag_t flags = 0;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_polyphase_dot_func();
+    pa_polyphase_func_init_neon(flags);
+
+    pa_log_debug("Checking NEON polyphase dot product");
+    run_dot_test(pa_get_polyphase_dot_func(), orig_func);
+
+    pa_set_polyphase_dot_func(orig_func);
+}
+END_TEST
+#endif
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Polyphase resampler");
+
+    tc = tcase_create("polyphase");
+    tcase_add_test(tc, polyphase_ratio_test);
+    tcase_add_test(tc, polyphase_variable_rate_test);
+    tcase_add_test(tc, resampler_table_test);
+    tcase_add_test(tc, resampler_fused_test);
+    tcase_add_test(tc, resampler_timing_test);
+    tcase_add_test(tc, resampler_arena_test);
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE4_1)
+    tcase_add_test(tc, polyphase_sse4_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, polyphase_avx2_test);
+#endif
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+    tcase_add_test(tc, polyphase_neon_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -96,6 +96,118 @@ START_TEST (proplist_test) {
 }
 END_TEST
 
+START_TEST (copy_test) {
+    pa_proplist *a, *b;
+    void *state = NULL;
+    const char *key;
+    unsigned i;
+
+    a = pa_proplist_new();
+    fail_unless(pa_proplist_sets(a, PA_PROP_MEDIA_NAME, "Toccata") == 0);
+    fail_unless(pa_proplist_sets(a, "custom.key", "value") == 0);
+
+    /* Modifying a copy must not change the original */
+    b = pa_proplist_copy(a);
+    fail_unless(pa_proplist_equal(a, b));
+    fail_unless(pa_proplist_sets(b, PA_PROP_MEDIA_NAME, "Fugue") == 0);
+    fail_unless(pa_streq(pa_proplist_gets(a, PA_PROP_MEDIA_NAME), "Toccata"));
+    fail_unless(pa_streq(pa_proplist_gets(b, PA_PROP_MEDIA_NAME), "Fugue"));
+    fail_unless(!pa_proplist_equal(a, b));
+
+    fail_unless(pa_proplist_unset(a, "custom.key") == 0);
+    fail_unless(pa_streq(pa_proplist_gets(b, "custom.key"), "value"));
+    fail_unless(pa_proplist_size(a) == 1);
+    fail_unless(pa_proplist_size(b) == 2);
+
+    pa_proplist_update(a, PA_UPDATE_SET, b);
+    fail_unless(pa_proplist_equal(a, b));
+    pa_proplist_free(b);
+    fail_unless(pa_streq(pa_proplist_gets(a, "custom.key"), "value"));
+
+    /* Long lists are indexed, the order of insertion is kept anyway */
+    for (i = 0; i < 100; i++) {
+        char k[16];
+
+        pa_snprintf(k, sizeof(k), "key.%u", i);
+        fail_unless(pa_proplist_setf(a, "key.number", "%u", i) == 0);
+        fail_unless(pa_proplist_setf(a, k, "%u", i) == 0);
+    }
+
+    fail_unless(pa_proplist_size(a) == 103);
+    fail_unless(pa_streq(pa_proplist_gets(a, "key.number"), "99"));
+    fail_unless(pa_streq(pa_proplist_gets(a, "key.42"), "42"));
+
+    fail_unless(pa_streq(pa_proplist_iterate(a, &state), PA_PROP_MEDIA_NAME));
+    fail_unless(pa_streq(pa_proplist_iterate(a, &state), "custom.key"));
+    fail_unless(pa_streq(pa_proplist_iterate(a, &state), "key.number"));
+    fail_unless(pa_streq(pa_proplist_iterate(a, &state), "key.0"));
+
+    b = pa_proplist_copy(a);
+    for (i = 0; i < 100; i += 2) {
+        char k[16];
+
+        pa_snprintf(k, sizeof(k), "key.%u", i);
+        fail_unless(pa_proplist_unset(b, k) == 0);
+    }
+
+    fail_unless(pa_proplist_size(a) == 103);
+    fail_unless(pa_proplist_size(b) == 53);
+    fail_unless(!pa_proplist_contains(b, "key.42"));
+    fail_unless(pa_streq(pa_proplist_gets(b, "key.43"), "43"));
+
+    state = NULL;
+    i = 0;
+    while (pa_proplist_iterate(b, &state))
+        i++;
+    fail_unless(i == 53);
+
+    /* The current entry may be removed while iterating, also from a list
+     * that shares its data with another one and from an indexed one.
+     * Nothing may be skipped. */
+    pa_proplist_free(b);
+    b = pa_proplist_copy(a);
+    state = NULL;
+    i = 0;
+    while ((key = pa_proplist_iterate(b, &state))) {
+        if (i % 3 != 1)
+            fail_unless(pa_proplist_unset(b, key) == 0);
+        i++;
+    }
+
+    fail_unless(i == 103);
+    fail_unless(pa_proplist_size(a) == 103);
+    fail_unless(pa_proplist_size(b) == 34);
+    fail_unless(pa_proplist_contains(b, "custom.key"));
+    fail_unless(!pa_proplist_contains(b, "key.number"));
+    fail_unless(pa_streq(pa_proplist_gets(b, "key.1"), "1"));
+
+    /* Still in order after the removed slots are dropped */
+    fail_unless(pa_proplist_sets(b, "key.new", "new") == 0);
+    state = NULL;
+    fail_unless(pa_streq(pa_proplist_iterate(b, &state), "custom.key"));
+    fail_unless(pa_streq(pa_proplist_iterate(b, &state), "key.1"));
+    fail_unless(pa_proplist_size(b) == 35);
+
+    pa_proplist_free(b);
+    b = pa_proplist_new();
+    fail_unless(pa_proplist_sets(b, "one", "1") == 0);
+    fail_unless(pa_proplist_sets(b, "two", "2") == 0);
+    fail_unless(pa_proplist_sets(b, "three", "3") == 0);
+    state = NULL;
+    i = 0;
+    while ((key = pa_proplist_iterate(b, &state))) {
+        fail_unless(pa_proplist_unset(b, key) == 0);
+        i++;
+    }
+
+    fail_unless(i == 3);
+    fail_unless(pa_proplist_isempty(b));
+
+    pa_proplist_free(a);
+    pa_proplist_free(b);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -108,6 +220,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Property List");
     tc = tcase_create("propertylist");
     tcase_add_test(tc, proplist_test);
+    tcase_add_test(tc, copy_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,661 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Measures what a message costs on the native protocol's transport. Two
+ * pstreams are paired in this process over a socket, one sends and the
+ * other answers, both on the same main loop:
+ *
+ *  - packet: a packet of the given size, echoed back
+ *  - memblock: a memblock of the given size, answered with a small
+ *    packet, like a client's playback and the server's request
+ *  - release: a memblock, timed until its SHM release frame came back
+ *  - revoke: a revoke frame for a block the other side doesn't know,
+ *    followed by a packet to tell when it was processed
+ *  - tagstruct: building and parsing a sink input info reply, without
+ *    any transport
+ *
+ * The transports are plain socket, socket with SHM memblocks, and the
+ * srbchannel with SHM memblocks the native protocol uses locally. Up to
+ * --window messages are in flight, 1 measures the latency, more the
+ * throughput. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <getopt.h>
+#include <locale.h>
+#include <sys/socket.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/i18n.h>
+#include <pulsecore/iochannel.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/packet.h>
+#include <pulsecore/pstream.h>
+#include <pulsecore/srbchannel.h>
+#include <pulsecore/tagstruct.h>
+
+#include "bench-variants.h"
+
+#define ACK_SIZE 20
+
+/* Batches for timing the tagstruct, which is too fast for the clock one
+ * at a time */
+#define TAGSTRUCT_BATCH 100
+
+typedef enum transport {
+    TRANSPORT_SOCKET,
+    TRANSPORT_SHM,
+    TRANSPORT_SRBCHANNEL,
+    TRANSPORT_MAX
+} transport_t;
+
+static const char * const transport_names[TRANSPORT_MAX] = {
+    [TRANSPORT_SOCKET] = "socket",
+    [TRANSPORT_SHM] = "shm",
+    [TRANSPORT_SRBCHANNEL] = "srbchannel",
+};
+
+typedef enum kind {
+    KIND_PACKET,
+    KIND_MEMBLOCK,
+    KIND_RELEASE,
+    KIND_REVOKE,
+    KIND_TAGSTRUCT,
+    KIND_MAX
+} kind_t;
+
+static const char * const kind_names[KIND_MAX] = {
+    [KIND_PACKET] = "packet",
+    [KIND_MEMBLOCK] = "memblock",
+    [KIND_RELEASE] = "release",
+    [KIND_REVOKE] = "revoke",
+    [KIND_TAGSTRUCT] = "tagstruct",
+};
+
+/* Larger memblocks aren't allocated from the pool */
+static size_t max_block_size;
+
+typedef struct bench {
+    pa_mainloop *mainloop;
+    pa_mempool *pool1, *pool2;
+    pa_pstream *p1, *p2;
+    transport_t transport;
+    kind_t kind;
+    size_t size;
+
+    /* Send times of the messages in flight, oldest first, answers come
+     * back in order */
+    pa_usec_t *sent_at;
+    unsigned n_sent, n_done;
+
+    /* Latencies in usec, one per message */
+    double *latencies;
+
+    /* Memblock bytes the receiver got since the last answer, larger ones
+     * arrive in pieces */
+    size_t received;
+
+    /* Blocks pool1 had before sending anything */
+    unsigned n_allocated;
+
+    pa_packet *ack;
+    bool dead;
+} bench;
+
+static void complete(bench *b) {
+    pa_assert(b->n_done < b->n_sent);
+
+    b->latencies[b->n_done] = (double) (pa_rtclock_now() - b->sent_at[b->n_done]);
+    b->n_done++;
+}
+
+static void die_cb(pa_pstream *p, void *userdata) {
+    bench *b = userdata;
+
+    pa_log("Connection died.");
+    b->dead = true;
+}
+
+/* On the answering side */
+static void p2_packet_cb(pa_pstream *p, pa_packet *packet, const pa_cmsg_ancil_data *ancil_data, void *userdata) {
+    pa_pstream_send_packet(p, packet, NULL);
+}
+
+static void p2_memblock_cb(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    bench *b = userdata;
+
+    /* Dropping the chunk is what makes the release go back */
+    if (b->kind != KIND_MEMBLOCK)
+        return;
+
+    b->received += chunk->length;
+
+    while (b->received >= b->size) {
+        pa_pstream_send_packet(p, b->ack, NULL);
+        b->received -= b->size;
+    }
+}
+
+/* On the sending side */
+static void p1_packet_cb(pa_pstream *p, pa_packet *packet, const pa_cmsg_ancil_data *ancil_data, void *userdata) {
+    complete(userdata);
+}
+
+static void send_one(bench *b) {
+    b->sent_at[b->n_sent++] = pa_rtclock_now();
+
+    switch (b->kind) {
+        case KIND_PACKET: {
+            pa_packet *packet = pa_packet_new(b->size);
+            uint8_t *data;
+            size_t length;
+
+            data = (uint8_t *) pa_packet_data(packet, &length);
+            memset(data, 0x5a, length);
+            pa_pstream_send_packet(b->p1, packet, NULL);
+            pa_packet_unref(packet);
+            break;
+        }
+
+        case KIND_MEMBLOCK:
+        case KIND_RELEASE: {
+            pa_memchunk chunk;
+
+            chunk.memblock = pa_memblock_new(b->pool1, b->size);
+            chunk.index = 0;
+            chunk.length = pa_memblock_get_length(chunk.memblock);
+            memset(pa_memblock_acquire(chunk.memblock), 0x5a, chunk.length);
+            pa_memblock_release(chunk.memblock);
+
+            pa_pstream_send_memblock(b->p1, 0, 0, PA_SEEK_RELATIVE, &chunk);
+            pa_memblock_unref(chunk.memblock);
+            break;
+        }
+
+        case KIND_REVOKE:
+            pa_pstream_send_revoke(b->p1, (uint32_t) -1);
+            pa_pstream_send_packet(b->p1, b->ack, NULL);
+            break;
+
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+static int setup(bench *b) {
+    int fds[2];
+    pa_iochannel *io1, *io2;
+    uint8_t *data;
+    size_t length;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        pa_log("socketpair(): %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    pa_make_fd_nonblock(fds[0]);
+    pa_make_fd_nonblock(fds[1]);
+
+    /* Each side exports from and imports into its own pool, like two
+     * processes would */
+    b->pool1 = pa_mempool_new(b->transport != TRANSPORT_SOCKET, 0);
+    b->pool2 = pa_mempool_new(b->transport != TRANSPORT_SOCKET, 0);
+
+    if (!b->pool1 || !b->pool2) {
+        pa_log("Failed to allocate memory pools.");
+        return -1;
+    }
+
+    io1 = pa_iochannel_new(pa_mainloop_get_api(b->mainloop), fds[0], fds[0]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(b->mainloop), fds[1], fds[1]);
+    b->p1 = pa_pstream_new(pa_mainloop_get_api(b->mainloop), io1, b->pool1);
+    b->p2 = pa_pstream_new(pa_mainloop_get_api(b->mainloop), io2, b->pool2);
+
+    pa_pstream_set_die_callback(b->p1, die_cb, b);
+    pa_pstream_set_die_callback(b->p2, die_cb, b);
+    pa_pstream_set_receive_packet_callback(b->p1, p1_packet_cb, b);
+    pa_pstream_set_receive_packet_callback(b->p2, p2_packet_cb, b);
+    pa_pstream_set_receive_memblock_callback(b->p2, p2_memblock_cb, b);
+
+    if (b->transport != TRANSPORT_SOCKET) {
+        pa_pstream_enable_shm(b->p1, true);
+        pa_pstream_enable_shm(b->p2, true);
+    }
+
+    if (b->transport == TRANSPORT_SRBCHANNEL) {
+        pa_srbchannel_template srt;
+        pa_srbchannel *srb1, *srb2;
+
+        if (!(srb1 = pa_srbchannel_new(pa_mainloop_get_api(b->mainloop), b->pool1))) {
+            pa_log("Failed to create srbchannel.");
+            return -1;
+        }
+
+        pa_srbchannel_export(srb1, &srt);
+        pa_pstream_set_srbchannel(b->p1, srb1);
+        pa_assert_se(srb2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(b->mainloop), &srt));
+        pa_pstream_set_srbchannel(b->p2, srb2);
+    }
+
+    b->n_allocated = (unsigned) pa_atomic_load(&pa_mempool_get_stat(b->pool1)->n_allocated);
+
+    b->ack = pa_packet_new(ACK_SIZE);
+    data = (uint8_t *) pa_packet_data(b->ack, &length);
+    memset(data, 0, length);
+
+    return 0;
+}
+
+static void teardown(bench *b) {
+    if (b->ack)
+        pa_packet_unref(b->ack);
+
+    if (b->p1) {
+        pa_pstream_unlink(b->p1);
+        pa_pstream_unref(b->p1);
+    }
+
+    if (b->p2) {
+        pa_pstream_unlink(b->p2);
+        pa_pstream_unref(b->p2);
+    }
+
+    if (b->pool1)
+        pa_mempool_free(b->pool1);
+    if (b->pool2)
+        pa_mempool_free(b->pool2);
+
+    b->ack = NULL;
+    b->p1 = b->p2 = NULL;
+    b->pool1 = b->pool2 = NULL;
+}
+
+static int run_transport(bench *b, unsigned count, unsigned window) {
+    int ret = -1;
+
+    if (setup(b) < 0)
+        goto finish;
+
+    while (b->n_done < count && !b->dead) {
+        while (b->n_sent < count && b->n_sent - b->n_done < window)
+            send_one(b);
+
+        if (pa_mainloop_iterate(b->mainloop, 1, NULL) < 0)
+            goto finish;
+
+        /* Releases don't tell anyone they arrived, but the sender only
+         * keeps its blocks until then */
+        if (b->kind == KIND_RELEASE)
+            while (b->n_done < b->n_sent &&
+                   (unsigned) pa_atomic_load(&pa_mempool_get_stat(b->pool1)->n_allocated) - b->n_allocated < b->n_sent - b->n_done)
+                complete(b);
+    }
+
+    ret = b->dead ? -1 : 0;
+
+finish:
+    teardown(b);
+    return ret;
+}
+
+/* Roughly what introspection replies with for each sink input */
+static void tagstruct_one(pa_proplist *proplist) {
+    pa_tagstruct *t;
+    pa_sample_spec ss = { PA_SAMPLE_FLOAT32LE, 48000, 2 }, ss2;
+    pa_channel_map map, map2;
+    pa_cvolume volume, volume2;
+    pa_proplist *pl;
+    const uint8_t *data;
+    const char *name, *driver;
+    uint32_t idx, module, client, sink;
+    pa_usec_t buffer_usec, sink_usec;
+    bool muted;
+    size_t length;
+
+    pa_channel_map_init_stereo(&map);
+    pa_cvolume_set(&volume, 2, PA_VOLUME_NORM);
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu32(t, 42);
+    pa_tagstruct_puts(t, "Playback Stream");
+    pa_tagstruct_putu32(t, 7);
+    pa_tagstruct_putu32(t, 3);
+    pa_tagstruct_putu32(t, 1);
+    pa_tagstruct_put_sample_spec(t, &ss);
+    pa_tagstruct_put_channel_map(t, &map);
+    pa_tagstruct_put_cvolume(t, &volume);
+    pa_tagstruct_put_usec(t, 20000);
+    pa_tagstruct_put_usec(t, 5000);
+    pa_tagstruct_puts(t, "protocol-native.c");
+    pa_tagstruct_put_boolean(t, false);
+    pa_tagstruct_put_proplist(t, proplist);
+
+    data = pa_tagstruct_data(t, &length);
+
+    pa_assert_se(pl = pa_proplist_new());
+    {
+        pa_tagstruct *r = pa_tagstruct_new_fixed(data, length);
+
+        pa_assert_se(pa_tagstruct_getu32(r, &idx) >= 0);
+        pa_assert_se(pa_tagstruct_gets(r, &name) >= 0);
+        pa_assert_se(pa_tagstruct_getu32(r, &module) >= 0);
+        pa_assert_se(pa_tagstruct_getu32(r, &client) >= 0);
+        pa_assert_se(pa_tagstruct_getu32(r, &sink) >= 0);
+        pa_assert_se(pa_tagstruct_get_sample_spec(r, &ss2) >= 0);
+        pa_assert_se(pa_tagstruct_get_channel_map(r, &map2) >= 0);
+        pa_assert_se(pa_tagstruct_get_cvolume(r, &volume2) >= 0);
+        pa_assert_se(pa_tagstruct_get_usec(r, &buffer_usec) >= 0);
+        pa_assert_se(pa_tagstruct_get_usec(r, &sink_usec) >= 0);
+        pa_assert_se(pa_tagstruct_gets(r, &driver) >= 0);
+        pa_assert_se(pa_tagstruct_get_boolean(r, &muted) >= 0);
+        pa_assert_se(pa_tagstruct_get_proplist(r, pl) >= 0);
+        pa_assert_se(pa_tagstruct_eof(r));
+
+        pa_tagstruct_free(r);
+    }
+
+    pa_proplist_free(pl);
+    pa_tagstruct_free(t);
+}
+
+static void run_tagstruct(bench *b, unsigned count) {
+    pa_proplist *proplist;
+    unsigned i;
+
+    pa_assert_se(proplist = pa_proplist_new());
+    pa_proplist_sets(proplist, PA_PROP_MEDIA_NAME, "Playback Stream");
+    pa_proplist_sets(proplist, PA_PROP_APPLICATION_NAME, "pstream-bench");
+    pa_proplist_sets(proplist, PA_PROP_APPLICATION_PROCESS_ID, "12345");
+    pa_proplist_sets(proplist, PA_PROP_MEDIA_ROLE, "music");
+
+    while (b->n_done < count) {
+        pa_usec_t start = pa_rtclock_now();
+        unsigned n = PA_MIN(TAGSTRUCT_BATCH, count - b->n_done);
+        double each;
+
+        for (i = 0; i < n; i++)
+            tagstruct_one(proplist);
+
+        each = (double) (pa_rtclock_now() - start) / n;
+        for (i = 0; i < n; i++)
+            b->latencies[b->n_done++] = each;
+    }
+
+    pa_proplist_free(proplist);
+}
+
+static int double_compare(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static double percentile(const double *sorted, unsigned n, unsigned p) {
+    return sorted[PA_MIN(n - 1, n * p / 100)];
+}
+
+/* Returns -1 if the transport didn't work, 0 if the combination makes
+ * no sense and was skipped, 1 if a row was printed */
+static int measure(transport_t transport, kind_t kind, size_t size, unsigned count, unsigned window) {
+    bench b;
+    pa_usec_t start, elapsed;
+    int ret = -1;
+
+    /* Only SHM memblocks get released or revoked, and blocks larger than
+     * the pool's go inline */
+    if ((kind == KIND_RELEASE || kind == KIND_REVOKE) && transport == TRANSPORT_SOCKET)
+        return 0;
+    if (kind == KIND_RELEASE && size > max_block_size)
+        return 0;
+
+    pa_zero(b);
+    b.transport = transport;
+    b.kind = kind;
+    b.size = size;
+    b.sent_at = pa_xnew(pa_usec_t, count);
+    b.latencies = pa_xnew(double, count);
+    pa_assert_se(b.mainloop = pa_mainloop_new());
+
+    start = pa_rtclock_now();
+
+    if (kind == KIND_TAGSTRUCT)
+        run_tagstruct(&b, count);
+    else if (run_transport(&b, count, window) < 0)
+        goto finish;
+
+    elapsed = pa_rtclock_now() - start;
+
+    qsort(b.latencies, count, sizeof(double), double_compare);
+
+    printf("%-10s %-9s %8zu %8u %12.0f %9.1f %9.1f %9.1f %9.1f\n",
+           kind == KIND_TAGSTRUCT ? "-" : transport_names[transport], kind_names[kind],
+           kind == KIND_REVOKE || kind == KIND_TAGSTRUCT ? 0 : size, count,
+           (double) count * PA_USEC_PER_SEC / PA_MAX(elapsed, 1U),
+           percentile(b.latencies, count, 50), percentile(b.latencies, count, 90),
+           percentile(b.latencies, count, 99), b.latencies[count - 1]);
+    fflush(stdout);
+
+    ret = 1;
+
+finish:
+    pa_mainloop_free(b.mainloop);
+    pa_xfree(b.sent_at);
+    pa_xfree(b.latencies);
+    return ret;
+}
+
+static int lookup(const char * const *names, unsigned n, const char *name) {
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        if (pa_streq(names[i], name))
+            return (int) i;
+
+    return -1;
+}
+
+static void help(const char *argv0) {
+    printf(_("%s [options]\n\n"
+             "-h, --help                            Show this help\n"
+             "-v, --verbose                         Print debug messages\n"
+             "      --version                       Show version\n"
+             "      --transports=TRANSPORT[,...]    socket, shm and/or srbchannel (defaults to all)\n"
+             "      --kinds=KIND[,...]              packet, memblock, release, revoke and/or tagstruct\n"
+             "                                      (defaults to all)\n"
+             "      --sizes=BYTES[,...]             Packet and memblock sizes (defaults to 64,1024,16384,65536)\n"
+             "      --count=MESSAGES                Messages per measurement (defaults to 10000)\n"
+             "      --window=MESSAGES               Messages in flight at once (defaults to 1)\n"
+             "\n"
+             "Prints the messages per second and the round trip latency percentiles in usec\n"
+             "for every combination.\n"),
+           argv0);
+}
+
+enum {
+    ARG_VERSION = 256,
+    ARG_TRANSPORTS,
+    ARG_KINDS,
+    ARG_SIZES,
+    ARG_COUNT,
+    ARG_WINDOW
+};
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"help",       0, NULL, 'h'},
+        {"verbose",    0, NULL, 'v'},
+        {"version",    0, NULL, ARG_VERSION},
+        {"transports", 1, NULL, ARG_TRANSPORTS},
+        {"kinds",      1, NULL, ARG_KINDS},
+        {"sizes",      1, NULL, ARG_SIZES},
+        {"count",      1, NULL, ARG_COUNT},
+        {"window",     1, NULL, ARG_WINDOW},
+        {NULL,         0, NULL, 0}
+    };
+
+    variants transports, kinds, sizes;
+    uint32_t count = 10000, window = 1;
+    unsigned t, k, s;
+    int c, ret = 1;
+
+    setlocale(LC_ALL, "");
+#ifdef ENABLE_NLS
+    bindtextdomain(GETTEXT_PACKAGE, PULSE_LOCALEDIR);
+#endif
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    pa_zero(transports);
+    pa_zero(kinds);
+    pa_zero(sizes);
+
+    pa_assert_se(variants_parse(&transports, "socket,shm,srbchannel") >= 0);
+    pa_assert_se(variants_parse(&kinds, "packet,memblock,release,revoke,tagstruct") >= 0);
+    pa_assert_se(variants_parse(&sizes, "64,1024,16384,65536") >= 0);
+
+    while ((c = getopt_long(argc, argv, "hv", long_options, NULL)) != -1) {
+
+        switch (c) {
+            case 'h':
+                help(argv[0]);
+                ret = 0;
+                goto quit;
+
+            case 'v':
+                pa_log_set_level(PA_LOG_DEBUG);
+                break;
+
+            case ARG_VERSION:
+                printf(_("%s %s\n"), argv[0], PACKAGE_VERSION);
+                ret = 0;
+                goto quit;
+
+            case ARG_TRANSPORTS:
+                if (variants_parse(&transports, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_KINDS:
+                if (variants_parse(&kinds, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_SIZES:
+                if (variants_parse(&sizes, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_COUNT:
+                if (pa_atou(optarg, &count) < 0 || count <= 0)
+                    goto invalid;
+                break;
+
+            case ARG_WINDOW:
+                if (pa_atou(optarg, &window) < 0 || window <= 0)
+                    goto invalid;
+                break;
+
+            default:
+                goto quit;
+        }
+    }
+
+    for (t = 0; t < transports.n; t++)
+        if (lookup(transport_names, TRANSPORT_MAX, transports.values[t]) < 0) {
+            pa_log("Unknown transport: %s", transports.values[t]);
+            goto quit;
+        }
+
+    for (k = 0; k < kinds.n; k++)
+        if (lookup(kind_names, KIND_MAX, kinds.values[k]) < 0) {
+            pa_log("Unknown message kind: %s", kinds.values[k]);
+            goto quit;
+        }
+
+    for (s = 0; s < sizes.n; s++) {
+        uint32_t size;
+
+        if (pa_atou(sizes.values[s], &size) < 0 || size <= 0) {
+            pa_log("Invalid size: %s", sizes.values[s]);
+            goto quit;
+        }
+    }
+
+    {
+        pa_mempool *pool;
+
+        pa_assert_se(pool = pa_mempool_new(false, 0));
+        max_block_size = pa_mempool_block_size_max(pool);
+        pa_mempool_free(pool);
+    }
+
+    printf("%-10s %-9s %8s %8s %12s %9s %9s %9s %9s\n",
+           "transport", "kind", "bytes", "count", "msgs_per_s", "p50_usec", "p90_usec", "p99_usec", "max_usec");
+
+    ret = 0;
+
+    /* The tagstruct doesn't have a transport or a size, and revokes don't
+     * have a size, so these only get one row */
+    for (k = 0; k < kinds.n; k++) {
+        kind_t kind = (kind_t) lookup(kind_names, KIND_MAX, kinds.values[k]);
+
+        for (t = 0; t < transports.n; t++) {
+            transport_t transport = (transport_t) lookup(transport_names, TRANSPORT_MAX, transports.values[t]);
+
+            for (s = 0; s < sizes.n; s++) {
+                uint32_t size;
+
+                pa_assert_se(pa_atou(sizes.values[s], &size) >= 0);
+
+                if (measure(transport, kind, size, count, window) < 0) {
+                    pa_log("Failed to measure %s over %s.", kind_names[kind], transport_names[transport]);
+                    ret = 1;
+                }
+
+                if (kind == KIND_REVOKE || kind == KIND_TAGSTRUCT)
+                    break;
+            }
+
+            if (kind == KIND_TAGSTRUCT)
+                break;
+        }
+    }
+
+    goto quit;
+
+invalid:
+    pa_log("Invalid argument: %s", optarg);
+
+quit:
+    variants_done(&transports);
+    variants_done(&kinds);
+    variants_done(&sizes);
+
+    return ret;
+}
@@ -0,0 +1,761 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Times the whole render path of a sink: N synthetic sink inputs, each
+ * with its own format, rate and volume, optionally going through a chain
+ * of filter sinks, mixed by a sink that is rendered from in a tight loop
+ * instead of at the pace of a device. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <getopt.h>
+#include <locale.h>
+#include <math.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/i18n.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sample-util.h>
+#include <pulsecore/sconv.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+#include "bench-variants.h"
+
+#define INPUT_LOOP_MSEC 100
+#define FILTER_COEFFICIENT 0.25f
+
+typedef struct input {
+    pa_sink_input *sink_input;
+    pa_memchunk memchunk;
+    size_t peek_index;
+} input;
+
+typedef struct filter {
+    pa_sink *sink;
+    pa_sink_input *sink_input;
+    float state[PA_CHANNELS_MAX];
+} filter;
+
+typedef struct run {
+    unsigned periods;
+    pa_usec_t elapsed, max_period;
+    unsigned memblocks, heap_memblocks;
+} run;
+
+typedef struct bench {
+    pa_core *core;
+    pa_sink *sink;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    size_t period_bytes;
+} bench;
+
+enum {
+    SINK_MESSAGE_RUN = PA_SINK_MESSAGE_MAX
+};
+
+/* Called from IO thread context */
+static void run_periods(bench *b, run *r) {
+    const pa_mempool_stat *stat;
+    unsigned n_accumulated, n_heap;
+    pa_usec_t start, last, now;
+    unsigned i;
+
+    stat = pa_mempool_get_stat(b->core->mempool);
+    n_accumulated = (unsigned) pa_atomic_load(&stat->n_accumulated);
+    n_heap = (unsigned) (pa_atomic_load(&stat->n_too_large_for_pool) + pa_atomic_load(&stat->n_pool_full));
+
+    r->max_period = 0;
+    start = last = pa_rtclock_now();
+
+    for (i = 0; i < r->periods; i++) {
+        pa_memchunk chunk;
+
+        if (b->sink->thread_info.rewind_requested)
+            pa_sink_process_rewind(b->sink, 0);
+
+        pa_sink_render_full(b->sink, b->period_bytes, &chunk);
+        pa_memblock_unref(chunk.memblock);
+
+        now = pa_rtclock_now();
+        r->max_period = PA_MAX(r->max_period, now - last);
+        last = now;
+    }
+
+    r->elapsed = last - start;
+    r->memblocks = (unsigned) pa_atomic_load(&stat->n_accumulated) - n_accumulated;
+    r->heap_memblocks = (unsigned) (pa_atomic_load(&stat->n_too_large_for_pool) + pa_atomic_load(&stat->n_pool_full)) - n_heap;
+}
+
+/* Called from IO thread context */
+static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    pa_sink *s = PA_SINK(o);
+
+    switch (code) {
+        case SINK_MESSAGE_RUN:
+            run_periods(s->userdata, data);
+            return 0;
+
+        case PA_SINK_MESSAGE_GET_LATENCY:
+            *((int64_t*) data) = 0;
+            return 0;
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static void thread_func(void *userdata) {
+    bench *b = userdata;
+
+    pa_assert(b);
+
+    pa_thread_mq_install(&b->thread_mq);
+
+    /* Only processes messages, the rendering happens when the main
+     * thread sends SINK_MESSAGE_RUN */
+    for (;;) {
+        int ret;
+
+        if ((ret = pa_rtpoll_run(b->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            return;
+    }
+
+fail:
+    pa_asyncmsgq_wait_for(b->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+}
+
+/* Nothing ever takes the benchmark's streams away while it runs */
+static void kill_cb(pa_sink_input *i) {
+    pa_assert_not_reached();
+}
+
+/* Called from IO thread context */
+static int input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    input *in = i->userdata;
+
+    *chunk = in->memchunk;
+    pa_memblock_ref(chunk->memblock);
+
+    chunk->index += in->peek_index;
+    chunk->length -= in->peek_index;
+
+    in->peek_index = 0;
+
+    return 0;
+}
+
+/* Called from IO thread context */
+static void input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    input *in = i->userdata;
+
+    nbytes %= in->memchunk.length;
+
+    if (in->peek_index >= nbytes)
+        in->peek_index -= nbytes;
+    else
+        in->peek_index = in->memchunk.length + in->peek_index - nbytes;
+}
+
+/* A sine in the format of the input, looping every INPUT_LOOP_MSEC */
+static void input_memchunk_make(pa_memchunk *c, pa_mempool *pool, const pa_sample_spec *ss) {
+    pa_convert_func_t convert;
+    size_t frames, i;
+    float *f;
+    void *d;
+    unsigned ch;
+
+    frames = ss->rate * INPUT_LOOP_MSEC / 1000;
+
+    f = pa_xnew(float, frames * ss->channels);
+    for (i = 0; i < frames; i++)
+        for (ch = 0; ch < ss->channels; ch++)
+            f[i * ss->channels + ch] = 0.5f * sinf((float) (2.0 * M_PI * 441.0 * (double) i / ss->rate));
+
+    c->memblock = pa_memblock_new(pool, frames * pa_frame_size(ss));
+    c->index = 0;
+    c->length = pa_memblock_get_length(c->memblock);
+
+    d = pa_memblock_acquire(c->memblock);
+    if ((convert = pa_get_convert_from_float32ne_function(ss->format)))
+        convert(frames * ss->channels, f, d);
+    else
+        memcpy(d, f, c->length);
+    pa_memblock_release(c->memblock);
+
+    pa_xfree(f);
+}
+
+static input *input_new(pa_core *core, pa_sink *sink, const pa_sample_spec *ss, pa_volume_t volume, pa_resample_method_t method) {
+    pa_sink_input_new_data data;
+    pa_channel_map map;
+    pa_cvolume cv;
+    input *in;
+
+    in = pa_xnew0(input, 1);
+    input_memchunk_make(&in->memchunk, core->mempool, ss);
+
+    pa_sink_input_new_data_init(&data);
+    data.driver = __FILE__;
+    data.resample_method = method;
+    pa_sink_input_new_data_set_sink(&data, sink, false);
+    pa_proplist_sets(data.proplist, PA_PROP_MEDIA_NAME, "Benchmark Input");
+    pa_sink_input_new_data_set_sample_spec(&data, ss);
+    pa_sink_input_new_data_set_channel_map(&data, pa_channel_map_init_extend(&map, ss->channels, PA_CHANNEL_MAP_DEFAULT));
+    pa_sink_input_new_data_set_volume(&data, pa_cvolume_set(&cv, ss->channels, volume));
+
+    pa_sink_input_new(&in->sink_input, core, &data);
+    pa_sink_input_new_data_done(&data);
+
+    if (!in->sink_input) {
+        pa_memblock_unref(in->memchunk.memblock);
+        pa_xfree(in);
+        return NULL;
+    }
+
+    in->sink_input->pop = input_pop_cb;
+    in->sink_input->process_rewind = input_process_rewind_cb;
+    in->sink_input->kill = kill_cb;
+    in->sink_input->userdata = in;
+
+    pa_sink_input_put(in->sink_input);
+
+    return in;
+}
+
+static void input_free(input *in) {
+    pa_sink_input_unlink(in->sink_input);
+    pa_sink_input_unref(in->sink_input);
+    pa_memblock_unref(in->memchunk.memblock);
+    pa_xfree(in);
+}
+
+/* Called from IO thread context. Renders the filter sink and runs a one
+ * pole low pass over the result. */
+static int filter_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    filter *f = i->userdata;
+    const float *src;
+    float *dst;
+    pa_memchunk tchunk;
+    unsigned channels, ch;
+    size_t n, k;
+
+    pa_sink_process_rewind(f->sink, 0);
+    pa_sink_render_full(f->sink, nbytes, &tchunk);
+
+    channels = f->sink->sample_spec.channels;
+    n = tchunk.length / pa_frame_size(&f->sink->sample_spec);
+
+    chunk->index = 0;
+    chunk->length = tchunk.length;
+    chunk->memblock = pa_memblock_new(f->sink->core->mempool, chunk->length);
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+
+    for (k = 0; k < n; k++)
+        for (ch = 0; ch < channels; ch++) {
+            f->state[ch] += FILTER_COEFFICIENT * (src[k * channels + ch] - f->state[ch]);
+            dst[k * channels + ch] = f->state[ch];
+        }
+
+    pa_memblock_release(chunk->memblock);
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_unref(tchunk.memblock);
+
+    return 0;
+}
+
+/* Called from IO thread context */
+static void filter_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    filter *f = i->userdata;
+
+    pa_sink_process_rewind(f->sink, 0);
+}
+
+/* Called from IO thread context */
+static void filter_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
+    filter *f = i->userdata;
+
+    pa_sink_set_max_request_within_thread(f->sink, nbytes);
+}
+
+/* A float32 stage in front of master, like module-virtual-sink */
+static filter *filter_new(pa_core *core, pa_sink *master, unsigned index, size_t period_bytes) {
+    pa_sink_input_new_data input_data;
+    pa_sink_new_data data;
+    pa_sample_spec ss;
+    filter *f;
+
+    ss = master->sample_spec;
+    ss.format = PA_SAMPLE_FLOAT32NE;
+
+    f = pa_xnew0(filter, 1);
+
+    pa_sink_new_data_init(&data);
+    data.driver = __FILE__;
+    data.name = pa_sprintf_malloc("bench.filter%u", index);
+    pa_sink_new_data_set_sample_spec(&data, &ss);
+    pa_sink_new_data_set_channel_map(&data, &master->channel_map);
+    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_CLASS, "filter");
+
+    f->sink = pa_sink_new(core, &data, 0);
+    pa_sink_new_data_done(&data);
+
+    if (!f->sink) {
+        pa_xfree(f);
+        return NULL;
+    }
+
+    f->sink->parent.process_msg = sink_process_msg;
+    f->sink->userdata = NULL;
+    pa_sink_set_asyncmsgq(f->sink, master->asyncmsgq);
+    pa_sink_set_rtpoll(f->sink, master->thread_info.rtpoll);
+    pa_sink_set_fixed_latency(f->sink, master->thread_info.fixed_latency);
+    pa_sink_set_max_request(f->sink, pa_convert_size(period_bytes, &master->sample_spec, &ss));
+
+    pa_sink_input_new_data_init(&input_data);
+    input_data.driver = __FILE__;
+    input_data.origin_sink = f->sink;
+    pa_sink_input_new_data_set_sink(&input_data, master, false);
+    pa_proplist_sets(input_data.proplist, PA_PROP_MEDIA_NAME, "Benchmark Filter");
+    pa_proplist_sets(input_data.proplist, PA_PROP_MEDIA_ROLE, "filter");
+    pa_sink_input_new_data_set_sample_spec(&input_data, &ss);
+    pa_sink_input_new_data_set_channel_map(&input_data, &master->channel_map);
+
+    pa_sink_input_new(&f->sink_input, core, &input_data);
+    pa_sink_input_new_data_done(&input_data);
+
+    if (!f->sink_input) {
+        pa_sink_unref(f->sink);
+        pa_xfree(f);
+        return NULL;
+    }
+
+    f->sink_input->pop = filter_pop_cb;
+    f->sink_input->process_rewind = filter_process_rewind_cb;
+    f->sink_input->update_max_request = filter_update_max_request_cb;
+    f->sink_input->kill = kill_cb;
+    f->sink_input->userdata = f;
+
+    f->sink->input_to_master = f->sink_input;
+
+    pa_sink_put(f->sink);
+    pa_sink_input_put(f->sink_input);
+
+    return f;
+}
+
+static void filter_free(filter *f) {
+    pa_sink_input_unlink(f->sink_input);
+    pa_sink_unlink(f->sink);
+
+    pa_sink_input_unref(f->sink_input);
+    pa_sink_unref(f->sink);
+    pa_xfree(f);
+}
+
+static int bench_init(bench *b, pa_mainloop_api *api, const pa_sample_spec *ss, pa_usec_t period_usec) {
+    pa_sink_new_data data;
+
+    pa_zero(*b);
+
+    if (!(b->core = pa_core_new(api, false, 0, false, -1)))
+        return -1;
+
+    /* Each input's volume is applied on its own, not folded into the
+     * sink's */
+    b->core->flat_volumes = false;
+
+    pa_sink_new_data_init(&data);
+    data.driver = __FILE__;
+    pa_sink_new_data_set_name(&data, "bench");
+    pa_sink_new_data_set_sample_spec(&data, ss);
+    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_CLASS, "abstract");
+
+    b->sink = pa_sink_new(b->core, &data, 0);
+    pa_sink_new_data_done(&data);
+
+    if (!b->sink)
+        return -1;
+
+    b->period_bytes = pa_usec_to_bytes(period_usec, ss);
+
+    b->sink->parent.process_msg = sink_process_msg;
+    b->sink->userdata = b;
+
+    b->rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&b->thread_mq, api, b->rtpoll);
+
+    pa_sink_set_asyncmsgq(b->sink, b->thread_mq.inq);
+    pa_sink_set_rtpoll(b->sink, b->rtpoll);
+    pa_sink_set_fixed_latency(b->sink, period_usec);
+    pa_sink_set_max_request(b->sink, b->period_bytes);
+
+    if (!(b->thread = pa_thread_new("render-bench", thread_func, b)))
+        return -1;
+
+    pa_sink_put(b->sink);
+
+    return 0;
+}
+
+static void bench_done(bench *b) {
+    if (b->sink)
+        pa_sink_unlink(b->sink);
+
+    if (b->thread) {
+        pa_asyncmsgq_send(b->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(b->thread);
+    }
+
+    if (b->rtpoll)
+        pa_thread_mq_done(&b->thread_mq);
+
+    if (b->sink)
+        pa_sink_unref(b->sink);
+
+    if (b->rtpoll)
+        pa_rtpoll_free(b->rtpoll);
+
+    if (b->core)
+        pa_core_unref(b->core);
+}
+
+static void help(const char *argv0) {
+    printf(_("%s [options]\n\n"
+             "-h, --help                            Show this help\n"
+             "-v, --verbose                         Print debug messages\n"
+             "      --inputs=N                      Number of sink inputs (defaults to 8)\n"
+             "      --format=SAMPLEFORMAT[,...]     Sample type of the inputs (defaults to s16le)\n"
+             "      --rate=SAMPLERATE[,...]         Sample rate of the inputs in Hz (defaults to 44100)\n"
+             "      --channels=CHANNELS[,...]       Number of channels of the inputs (defaults to 2)\n"
+             "      --volume=PERCENT[,...]          Volume of the inputs (defaults to 50)\n"
+             "      --sink-format=SAMPLEFORMAT      Sample type of the sink (defaults to s16le)\n"
+             "      --sink-rate=SAMPLERATE          Sample rate of the sink in Hz (defaults to 48000)\n"
+             "      --sink-channels=CHANNELS        Number of channels of the sink (defaults to 2)\n"
+             "      --filters=N                     Filter sinks between the inputs and the sink (defaults to 0)\n"
+             "      --resample-method=METHOD        Resample method (defaults to the daemon's default)\n"
+             "      --period-msec=MSEC              Length of a period (defaults to 10)\n"
+             "      --periods=N                     Periods to render (defaults to 1000)\n"
+             "\n"
+             "The inputs take turns in using the comma separated values of an option.\n"
+             "Results are printed as a single line of key=value pairs.\n"),
+             argv0);
+}
+
+enum {
+    ARG_VERSION = 256,
+    ARG_INPUTS,
+    ARG_FORMAT,
+    ARG_RATE,
+    ARG_CHANNELS,
+    ARG_VOLUME,
+    ARG_SINK_FORMAT,
+    ARG_SINK_RATE,
+    ARG_SINK_CHANNELS,
+    ARG_FILTERS,
+    ARG_RESAMPLE_METHOD,
+    ARG_PERIOD_MSEC,
+    ARG_PERIODS
+};
+
+static int input_sample_spec(pa_sample_spec *ss, pa_volume_t *volume, unsigned i,
+                             const variants *formats, const variants *rates, const variants *channels, const variants *volumes) {
+    uint32_t v;
+
+    ss->format = pa_parse_sample_format(variants_get(formats, i));
+
+    if (pa_atou(variants_get(rates, i), &ss->rate) < 0 ||
+        pa_atou(variants_get(channels, i), &v) < 0 || v > PA_CHANNELS_MAX)
+        return -1;
+    ss->channels = (uint8_t) v;
+
+    if (pa_atou(variants_get(volumes, i), &v) < 0 || v > 1000)
+        return -1;
+    *volume = (pa_volume_t) ((uint64_t) PA_VOLUME_NORM * v / 100);
+
+    return pa_sample_spec_valid(ss) ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    pa_mainloop *ml = NULL;
+    bench b;
+    input **inputs = NULL;
+    filter **filters = NULL;
+    pa_sink *top;
+    pa_sample_spec sink_ss;
+    pa_resample_method_t method = PA_RESAMPLER_INVALID;
+    variants formats, rates, channels, volumes;
+    unsigned n_inputs = 8, n_filters = 0, period_msec = 10, periods = 1000, i, v;
+    run warmup, r;
+    pa_usec_t period_usec;
+    double seconds;
+    int ret = 1, c;
+
+    static const struct option long_options[] = {
+        {"help",            0, NULL, 'h'},
+        {"verbose",         0, NULL, 'v'},
+        {"version",         0, NULL, ARG_VERSION},
+        {"inputs",          1, NULL, ARG_INPUTS},
+        {"format",          1, NULL, ARG_FORMAT},
+        {"rate",            1, NULL, ARG_RATE},
+        {"channels",        1, NULL, ARG_CHANNELS},
+        {"volume",          1, NULL, ARG_VOLUME},
+        {"sink-format",     1, NULL, ARG_SINK_FORMAT},
+        {"sink-rate",       1, NULL, ARG_SINK_RATE},
+        {"sink-channels",   1, NULL, ARG_SINK_CHANNELS},
+        {"filters",         1, NULL, ARG_FILTERS},
+        {"resample-method", 1, NULL, ARG_RESAMPLE_METHOD},
+        {"period-msec",     1, NULL, ARG_PERIOD_MSEC},
+        {"periods",         1, NULL, ARG_PERIODS},
+        {NULL,              0, NULL, 0}
+    };
+
+    setlocale(LC_ALL, "");
+#ifdef ENABLE_NLS
+    bindtextdomain(GETTEXT_PACKAGE, PULSE_LOCALEDIR);
+#endif
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    pa_zero(formats);
+    pa_zero(rates);
+    pa_zero(channels);
+    pa_zero(volumes);
+    pa_zero(b);
+    pa_assert_se(variants_parse(&formats, "s16le") >= 0);
+    pa_assert_se(variants_parse(&rates, "44100") >= 0);
+    pa_assert_se(variants_parse(&channels, "2") >= 0);
+    pa_assert_se(variants_parse(&volumes, "50") >= 0);
+
+    sink_ss.format = PA_SAMPLE_S16LE;
+    sink_ss.rate = 48000;
+    sink_ss.channels = 2;
+
+    while ((c = getopt_long(argc, argv, "hv", long_options, NULL)) != -1) {
+
+        switch (c) {
+            case 'h':
+                help(argv[0]);
+                ret = 0;
+                goto quit;
+
+            case 'v':
+                pa_log_set_level(PA_LOG_DEBUG);
+                break;
+
+            case ARG_VERSION:
+                printf(_("%s %s\n"), argv[0], PACKAGE_VERSION);
+                ret = 0;
+                goto quit;
+
+            case ARG_INPUTS:
+                if (pa_atou(optarg, &n_inputs) < 0) {
+                    pa_log("Invalid number of inputs: %s", optarg);
+                    goto quit;
+                }
+                break;
+
+            case ARG_FORMAT:
+                if (variants_parse(&formats, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_RATE:
+                if (variants_parse(&rates, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_CHANNELS:
+                if (variants_parse(&channels, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_VOLUME:
+                if (variants_parse(&volumes, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_SINK_FORMAT:
+                sink_ss.format = pa_parse_sample_format(optarg);
+                break;
+
+            case ARG_SINK_RATE:
+                if (pa_atou(optarg, &sink_ss.rate) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_SINK_CHANNELS:
+                if (pa_atou(optarg, &v) < 0 || v > PA_CHANNELS_MAX)
+                    goto invalid;
+                sink_ss.channels = (uint8_t) v;
+                break;
+
+            case ARG_FILTERS:
+                if (pa_atou(optarg, &n_filters) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_RESAMPLE_METHOD:
+                if ((method = pa_parse_resample_method(optarg)) == PA_RESAMPLER_INVALID ||
+                    !pa_resample_method_supported(method))
+                    goto invalid;
+                break;
+
+            case ARG_PERIOD_MSEC:
+                if (pa_atou(optarg, &period_msec) < 0 || period_msec <= 0)
+                    goto invalid;
+                break;
+
+            case ARG_PERIODS:
+                if (pa_atou(optarg, &periods) < 0 || periods <= 0)
+                    goto invalid;
+                break;
+
+            default:
+                goto quit;
+        }
+    }
+
+    if (!pa_sample_spec_valid(&sink_ss)) {
+        pa_log("Invalid sink sample spec.");
+        goto quit;
+    }
+
+    for (i = 0; i < PA_MAX(formats.n, PA_MAX(rates.n, PA_MAX(channels.n, volumes.n))); i++) {
+        pa_sample_spec ss;
+        pa_volume_t volume;
+
+        if (input_sample_spec(&ss, &volume, i, &formats, &rates, &channels, &volumes) < 0) {
+            pa_log("Invalid input specification.");
+            goto quit;
+        }
+    }
+
+    period_usec = period_msec * PA_USEC_PER_MSEC;
+
+    ml = pa_mainloop_new();
+
+    if (bench_init(&b, pa_mainloop_get_api(ml), &sink_ss, period_usec) < 0) {
+        pa_log("Failed to set up the sink.");
+        goto finish;
+    }
+
+    top = b.sink;
+    filters = pa_xnew0(filter*, n_filters + 1);
+    for (i = 0; i < n_filters; i++) {
+        if (!(filters[i] = filter_new(b.core, top, i, b.period_bytes))) {
+            pa_log("Failed to set up filter %u.", i);
+            goto finish;
+        }
+
+        top = filters[i]->sink;
+    }
+
+    inputs = pa_xnew0(input*, n_inputs + 1);
+    for (i = 0; i < n_inputs; i++) {
+        pa_sample_spec ss;
+        pa_volume_t volume;
+
+        pa_assert_se(input_sample_spec(&ss, &volume, i, &formats, &rates, &channels, &volumes) >= 0);
+
+        if (!(inputs[i] = input_new(b.core, top, &ss, volume, method))) {
+            pa_log("Failed to set up input %u.", i);
+            goto finish;
+        }
+    }
+
+    /* Lets the resamplers and the memory pool settle */
+    warmup.periods = PA_MAX(periods / 10, 10U);
+    pa_asyncmsgq_send(b.sink->asyncmsgq, PA_MSGOBJECT(b.sink), SINK_MESSAGE_RUN, &warmup, 0, NULL);
+
+    r.periods = periods;
+    pa_asyncmsgq_send(b.sink->asyncmsgq, PA_MSGOBJECT(b.sink), SINK_MESSAGE_RUN, &r, 0, NULL);
+
+    seconds = (double) r.elapsed / PA_USEC_PER_SEC;
+    printf("inputs=%u filters=%u sink=%s:%u:%u period_usec=%llu periods=%u "
+           "frames_per_sec=%.0f realtime_factor=%.1f ns_per_period=%.0f max_usec_per_period=%llu "
+           "memblocks_per_period=%.2f heap_memblocks_per_period=%.2f\n",
+           n_inputs, n_filters,
+           pa_sample_format_to_string(sink_ss.format), sink_ss.rate, sink_ss.channels,
+           (unsigned long long) period_usec, periods,
+           seconds > 0 ? (double) periods * (b.period_bytes / pa_frame_size(&sink_ss)) / seconds : 0.0,
+           seconds > 0 ? (double) periods * period_usec / r.elapsed : 0.0,
+           (double) r.elapsed * 1000 / periods,
+           (unsigned long long) r.max_period,
+           (double) r.memblocks / periods,
+           (double) r.heap_memblocks / periods);
+
+    ret = 0;
+
+finish:
+    if (inputs) {
+        for (i = 0; i < n_inputs && inputs[i]; i++)
+            input_free(inputs[i]);
+        pa_xfree(inputs);
+    }
+
+    if (filters) {
+        for (i = n_filters; i > 0; i--)
+            if (filters[i - 1])
+                filter_free(filters[i - 1]);
+        pa_xfree(filters);
+    }
+
+    /* Whatever the IO thread posted back */
+    if (ml)
+        while (pa_mainloop_iterate(ml, false, NULL) > 0)
+            ;
+
+    bench_done(&b);
+
+    if (ml)
+        pa_mainloop_free(ml);
+
+quit:
+    variants_done(&formats);
+    variants_done(&rates);
+    variants_done(&channels);
+    variants_done(&volumes);
+
+    return ret;
+
+invalid:
+    pa_log("Invalid argument: %s", optarg);
+    goto quit;
+}
@@ -0,0 +1,567 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <getopt.h>
+#include <locale.h>
+#include <math.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/sample.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/i18n.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/sample-util.h>
+#include <pulsecore/sconv.h>
+
+/* Enough for every resample method */
+#define MAX_VARIANTS 64
+#include "bench-variants.h"
+
+/* Compares the resample methods on cost and quality, for every
+ * combination of method, sample format and rate pair:
+ *
+ *  - usec of CPU time to resample one second of audio, a period at a time
+ *  - latency, from when an impulse goes in until it comes out
+ *  - THD+N of a 1 kHz tone
+ *  - passband ripple, the spread of the gain of tones up to 80% of the
+ *    lower Nyquist frequency
+ *  - aliasing: when downsampling, what is left of a tone the resampler
+ *    should have removed, when upsampling, everything but the tone near
+ *    the input's Nyquist frequency, i.e. its images
+ *
+ * Levels are measured on the first channel by least squares fits of a
+ * sine of the known frequency, so no FFT is needed. The results are
+ * printed as a table, one row per combination. */
+
+#define PERIOD_MSEC 10
+#define SETTLE_MSEC 50
+#define TONE_MSEC 300
+#define TONE_AMPLITUDE 0.5
+#define PASSBAND 0.8
+
+static unsigned n_channels = 2;
+
+struct signal {
+    float *data;
+    unsigned n, size;
+};
+
+static void signal_append(struct signal *s, const float *data, unsigned n) {
+    if (s->n + n > s->size) {
+        s->size = PA_MAX(s->size * 2, s->n + n);
+        s->data = pa_xrenew(float, s->data, s->size);
+    }
+
+    memcpy(s->data + s->n, data, n * sizeof(float));
+    s->n += n;
+}
+
+/* Runs in through a resampler of the given format in periods, like a sink
+ * would, and returns the first channel of what comes out */
+static int resample(pa_mempool *pool, pa_resample_method_t method, pa_sample_format_t format,
+                    uint32_t from, uint32_t to, const float *in, unsigned n_in, struct signal *out) {
+    pa_sample_spec a, b;
+    pa_resampler *r;
+    pa_convert_func_t from_float, to_float;
+    unsigned period, i, c;
+
+    a.format = b.format = format;
+    a.channels = b.channels = (uint8_t) n_channels;
+    a.rate = from;
+    b.rate = to;
+
+    if (!(r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, method, 0)))
+        return -1;
+
+    pa_assert_se(from_float = pa_get_convert_from_float32ne_function(format));
+    pa_assert_se(to_float = pa_get_convert_to_float32ne_function(format));
+
+    period = from * PERIOD_MSEC / 1000;
+    out->n = 0;
+
+    for (i = 0; i < n_in; i += period) {
+        unsigned n = PA_MIN(period, n_in - i), k;
+        float frames[n * n_channels];
+        pa_memchunk ic, oc;
+
+        for (k = 0; k < n; k++)
+            for (c = 0; c < n_channels; c++)
+                frames[k * n_channels + c] = in[i + k];
+
+        ic.memblock = pa_memblock_new(pool, n * pa_frame_size(&a));
+        ic.index = 0;
+        ic.length = n * pa_frame_size(&a);
+        from_float(n * n_channels, frames, pa_memblock_acquire(ic.memblock));
+        pa_memblock_release(ic.memblock);
+
+        pa_resampler_run(r, &ic, &oc);
+        pa_memblock_unref(ic.memblock);
+
+        if (oc.memblock) {
+            unsigned m = oc.length / pa_frame_size(&b);
+            float *f = pa_xnew(float, m * n_channels);
+
+            to_float(m * n_channels, (uint8_t *) pa_memblock_acquire(oc.memblock) + oc.index, f);
+            pa_memblock_release(oc.memblock);
+            pa_memblock_unref(oc.memblock);
+
+            for (k = 0; k < m; k++)
+                f[k] = f[k * n_channels];
+            signal_append(out, f, m);
+
+            pa_xfree(f);
+        }
+    }
+
+    pa_resampler_free(r);
+    return 0;
+}
+
+/* Fits a*sin + b*cos + dc at freq to s[start..end) by least squares and
+ * returns the RMS of the fitted sine and of what's left */
+static void fit_tone(const float *s, unsigned start, unsigned end, double freq, uint32_t rate,
+                     double *tone_rms, double *residual_rms) {
+    double m[3][3] = { { 0 } }, v[3] = { 0 }, x[3], det, res = 0;
+    unsigned i, j, k;
+
+    for (i = start; i < end; i++) {
+        double w = 2 * M_PI * freq * i / rate, basis[3];
+
+        basis[0] = sin(w);
+        basis[1] = cos(w);
+        basis[2] = 1;
+
+        for (j = 0; j < 3; j++) {
+            v[j] += basis[j] * s[i];
+            for (k = 0; k < 3; k++)
+                m[j][k] += basis[j] * basis[k];
+        }
+    }
+
+    /* Cramer's rule */
+    det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+        - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+        + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+
+    for (j = 0; j < 3; j++) {
+        double t[3][3];
+
+        memcpy(t, m, sizeof(t));
+        for (k = 0; k < 3; k++)
+            t[k][j] = v[k];
+
+        x[j] = (t[0][0] * (t[1][1] * t[2][2] - t[1][2] * t[2][1])
+              - t[0][1] * (t[1][0] * t[2][2] - t[1][2] * t[2][0])
+              + t[0][2] * (t[1][0] * t[2][1] - t[1][1] * t[2][0])) / det;
+    }
+
+    for (i = start; i < end; i++) {
+        double w = 2 * M_PI * freq * i / rate;
+        double e = s[i] - (x[0] * sin(w) + x[1] * cos(w) + x[2]);
+
+        res += e * e;
+    }
+
+    *tone_rms = sqrt((x[0] * x[0] + x[1] * x[1]) / 2);
+    *residual_rms = sqrt(res / PA_MAX(end - start, 1U));
+}
+
+static double db(double ratio) {
+    return 20 * log10(PA_MAX(ratio, 1e-12));
+}
+
+/* Plays a tone through the resampler and fits it on the other side,
+ * leaving out the start, where the resampler settles, and the end, which
+ * may still be stuck in its history */
+static int measure_tone(pa_mempool *pool, pa_resample_method_t method, pa_sample_format_t format,
+                        uint32_t from, uint32_t to, double freq, double *tone_rms, double *residual_rms) {
+    unsigned n_in = from * (TONE_MSEC + 2 * SETTLE_MSEC) / 1000, i;
+    struct signal out = { NULL, 0, 0 };
+    float *in;
+    int ret;
+
+    in = pa_xnew(float, n_in);
+    for (i = 0; i < n_in; i++)
+        in[i] = (float) (TONE_AMPLITUDE * sin(2 * M_PI * freq * i / from));
+
+    if ((ret = resample(pool, method, format, from, to, in, n_in, &out)) >= 0) {
+        unsigned start = to * SETTLE_MSEC / 1000, end = start + to * TONE_MSEC / 1000;
+
+        if (out.n < end)
+            ret = -1;
+        else
+            fit_tone(out.data, start, end, freq, to, tone_rms, residual_rms);
+    }
+
+    pa_xfree(in);
+    pa_xfree(out.data);
+    return ret;
+}
+
+struct result {
+    double cpu_usec;
+    double latency_usec;
+    double thd_n;
+    double ripple;
+    double aliasing;
+    bool has_aliasing;
+};
+
+static int measure_cpu(pa_mempool *pool, pa_resample_method_t method, pa_sample_format_t format,
+                       uint32_t from, uint32_t to, unsigned seconds, double *usec_per_second) {
+    pa_sample_spec a, b;
+    pa_resampler *r;
+    pa_memchunk ic;
+    pa_usec_t ts;
+    unsigned i, periods;
+
+    a.format = b.format = format;
+    a.channels = b.channels = (uint8_t) n_channels;
+    a.rate = from;
+    b.rate = to;
+
+    if (!(r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, method, 0)))
+        return -1;
+
+    /* Silence costs the same as music to all methods */
+    ic.memblock = pa_memblock_new(pool, pa_usec_to_bytes(PERIOD_MSEC * PA_USEC_PER_MSEC, &a));
+    ic.index = 0;
+    ic.length = pa_memblock_get_length(ic.memblock);
+    pa_silence_memblock(ic.memblock, &a);
+
+    periods = seconds * 1000 / PERIOD_MSEC;
+
+    ts = pa_rtclock_now();
+    for (i = 0; i < periods; i++) {
+        pa_memchunk oc;
+
+        pa_resampler_run(r, &ic, &oc);
+        if (oc.memblock)
+            pa_memblock_unref(oc.memblock);
+    }
+    ts = pa_rtclock_now() - ts;
+
+    *usec_per_second = (double) ts * 1000 / (periods * PERIOD_MSEC);
+
+    pa_memblock_unref(ic.memblock);
+    pa_resampler_free(r);
+    return 0;
+}
+
+static int measure_latency(pa_mempool *pool, pa_resample_method_t method, pa_sample_format_t format,
+                           uint32_t from, uint32_t to, double *usec) {
+    unsigned n_in = from / 2, at = from / 10, i, peak = 0;
+    struct signal out = { NULL, 0, 0 };
+    double withheld;
+    float *in;
+    int ret;
+
+    in = pa_xnew0(float, n_in);
+    in[at] = TONE_AMPLITUDE;
+
+    if ((ret = resample(pool, method, format, from, to, in, n_in, &out)) >= 0) {
+        for (i = 1; i < out.n; i++)
+            if (fabsf(out.data[i]) > fabsf(out.data[peak]))
+                peak = i;
+
+        /* Some methods line the output up with the input but hold back
+         * the frames their filter still needs to see the future of, so
+         * the peak only leaves once those have been produced too */
+        withheld = (double) n_in * to / from - out.n;
+
+        *usec = (peak + withheld) * PA_USEC_PER_SEC / to - (double) at * PA_USEC_PER_SEC / from;
+    }
+
+    pa_xfree(in);
+    pa_xfree(out.data);
+    return ret;
+}
+
+static int measure(pa_mempool *pool, pa_resample_method_t method, pa_sample_format_t format,
+                   uint32_t from, uint32_t to, unsigned seconds, struct result *r) {
+    double nyquist = PA_MIN(from, to) / 2.0, freq, tone, residual, min_gain = 0, max_gain = 0;
+    bool first = true;
+
+    pa_zero(*r);
+
+    if (measure_cpu(pool, method, format, from, to, seconds, &r->cpu_usec) < 0 ||
+        measure_latency(pool, method, format, from, to, &r->latency_usec) < 0)
+        return -1;
+
+    if (measure_tone(pool, method, format, from, to, 1000, &tone, &residual) < 0)
+        return -1;
+    r->thd_n = db(residual / PA_MAX(tone, 1e-12));
+
+    /* Half octave steps from 100 Hz up to the edge of the passband */
+    for (freq = 100; ; freq *= M_SQRT2) {
+        double gain;
+        bool last = freq >= nyquist * PASSBAND;
+
+        if (last)
+            freq = nyquist * PASSBAND;
+
+        if (measure_tone(pool, method, format, from, to, freq, &tone, &residual) < 0)
+            return -1;
+
+        gain = db(tone / (TONE_AMPLITUDE / M_SQRT2));
+        if (first || gain < min_gain)
+            min_gain = gain;
+        if (first || gain > max_gain)
+            max_gain = gain;
+        first = false;
+
+        if (last)
+            break;
+    }
+    r->ripple = max_gain - min_gain;
+
+    if (to < from) {
+        /* Halfway between both Nyquist frequencies, nothing should be
+         * left of it */
+        freq = (from + to) / 4.0;
+        if (measure_tone(pool, method, format, from, to, freq, &tone, &residual) < 0)
+            return -1;
+
+        r->aliasing = db(sqrt(tone * tone + residual * residual) / (TONE_AMPLITUDE / M_SQRT2));
+        r->has_aliasing = true;
+    } else if (to > from) {
+        freq = from / 2.0 * 0.9;
+        if (measure_tone(pool, method, format, from, to, freq, &tone, &residual) < 0)
+            return -1;
+
+        r->aliasing = db(residual / (TONE_AMPLITUDE / M_SQRT2));
+        r->has_aliasing = true;
+    }
+
+    return 0;
+}
+
+static int parse_rates(const char *s, uint32_t *from, uint32_t *to) {
+    const char *colon;
+    char *f;
+    int r;
+
+    if (!(colon = strchr(s, ':')))
+        return -1;
+
+    f = pa_xstrndup(s, (size_t) (colon - s));
+    r = pa_atou(f, from) >= 0 && pa_atou(colon + 1, to) >= 0 &&
+        pa_sample_rate_valid(*from) && pa_sample_rate_valid(*to) && *from != *to &&
+        *from * PERIOD_MSEC / 1000 > 0 && *to * PERIOD_MSEC / 1000 > 0 ? 0 : -1;
+    pa_xfree(f);
+
+    return r;
+}
+
+static void help(const char *argv0) {
+    printf(_("%s [options]\n\n"
+             "-h, --help                            Show this help\n"
+             "-v, --verbose                         Print debug messages\n"
+             "      --methods=METHOD[,...]          Resample methods (defaults to all supported ones)\n"
+             "      --formats=SAMPLEFORMAT[,...]    Sample types (defaults to s16le,float32le)\n"
+             "      --rates=FROM:TO[,...]           Rate pairs in Hz (defaults to 44100:48000,48000:44100,\n"
+             "                                      48000:96000,96000:48000,16000:48000,48000:16000)\n"
+             "      --channels=CHANNELS             Number of channels (defaults to 2)\n"
+             "      --seconds=SECONDS               Audio to resample for the CPU time (defaults to 10)\n"
+             "\n"
+             "Every combination of the comma separated values is measured. CPU time is\n"
+             "in usec per second of audio, levels are in dB relative to the input tone.\n"),
+             argv0);
+}
+
+enum {
+    ARG_VERSION = 256,
+    ARG_METHODS,
+    ARG_FORMATS,
+    ARG_RATES,
+    ARG_CHANNELS,
+    ARG_SECONDS
+};
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"help",     0, NULL, 'h'},
+        {"verbose",  0, NULL, 'v'},
+        {"version",  0, NULL, ARG_VERSION},
+        {"methods",  1, NULL, ARG_METHODS},
+        {"formats",  1, NULL, ARG_FORMATS},
+        {"rates",    1, NULL, ARG_RATES},
+        {"channels", 1, NULL, ARG_CHANNELS},
+        {"seconds",  1, NULL, ARG_SECONDS},
+        {NULL,       0, NULL, 0}
+    };
+
+    variants methods, formats, rates;
+    pa_mempool *pool = NULL;
+    uint32_t seconds = 10;
+    unsigned m, f, r;
+    int c, ret = 1;
+
+    setlocale(LC_ALL, "");
+#ifdef ENABLE_NLS
+    bindtextdomain(GETTEXT_PACKAGE, PULSE_LOCALEDIR);
+#endif
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    pa_zero(methods);
+    pa_zero(formats);
+    pa_zero(rates);
+
+    pa_assert_se(variants_parse(&formats, "s16le,float32le") >= 0);
+    pa_assert_se(variants_parse(&rates, "44100:48000,48000:44100,48000:96000,96000:48000,16000:48000,48000:16000") >= 0);
+
+    while ((c = getopt_long(argc, argv, "hv", long_options, NULL)) != -1) {
+
+        switch (c) {
+            case 'h':
+                help(argv[0]);
+                ret = 0;
+                goto quit;
+
+            case 'v':
+                pa_log_set_level(PA_LOG_DEBUG);
+                break;
+
+            case ARG_VERSION:
+                printf(_("%s %s\n"), argv[0], PACKAGE_VERSION);
+                ret = 0;
+                goto quit;
+
+            case ARG_METHODS:
+                if (variants_parse(&methods, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_FORMATS:
+                if (variants_parse(&formats, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_RATES:
+                if (variants_parse(&rates, optarg) < 0)
+                    goto invalid;
+                break;
+
+            case ARG_CHANNELS:
+                if (pa_atou(optarg, &n_channels) < 0 || !pa_channels_valid((uint8_t) n_channels))
+                    goto invalid;
+                break;
+
+            case ARG_SECONDS:
+                if (pa_atou(optarg, &seconds) < 0 || seconds <= 0)
+                    goto invalid;
+                break;
+
+            default:
+                goto quit;
+        }
+    }
+
+    /* Copy and peaks don't resample, auto is one of the others */
+    if (methods.n == 0) {
+        pa_resample_method_t i;
+
+        for (i = 0; i < PA_RESAMPLER_MAX; i++)
+            if (i != PA_RESAMPLER_AUTO && i != PA_RESAMPLER_COPY && i != PA_RESAMPLER_PEAKS &&
+                pa_resample_method_supported(i) && methods.n < MAX_VARIANTS)
+                methods.values[methods.n++] = pa_xstrdup(pa_resample_method_to_string(i));
+    }
+
+    for (m = 0; m < methods.n; m++)
+        if (pa_parse_resample_method(methods.values[m]) == PA_RESAMPLER_INVALID ||
+            !pa_resample_method_supported(pa_parse_resample_method(methods.values[m]))) {
+            pa_log("Unsupported resample method: %s", methods.values[m]);
+            goto quit;
+        }
+
+    for (f = 0; f < formats.n; f++)
+        if (!pa_sample_format_valid(pa_parse_sample_format(formats.values[f]))) {
+            pa_log("Invalid sample format: %s", formats.values[f]);
+            goto quit;
+        }
+
+    for (r = 0; r < rates.n; r++) {
+        uint32_t from, to;
+
+        if (parse_rates(rates.values[r], &from, &to) < 0) {
+            pa_log("Invalid rate pair: %s", rates.values[r]);
+            goto quit;
+        }
+    }
+
+    pa_assert_se(pool = pa_mempool_new(false, 0));
+
+    printf("%-20s %-10s %13s %10s %12s %9s %10s %10s\n",
+           "method", "format", "rates", "cpu_usec", "latency_usec", "thd_n_db", "ripple_db", "alias_db");
+
+    ret = 0;
+
+    for (r = 0; r < rates.n; r++)
+        for (f = 0; f < formats.n; f++)
+            for (m = 0; m < methods.n; m++) {
+                pa_resample_method_t method = pa_parse_resample_method(methods.values[m]);
+                pa_sample_format_t format = pa_parse_sample_format(formats.values[f]);
+                struct result res;
+                uint32_t from, to;
+                char alias[16];
+
+                pa_assert_se(parse_rates(rates.values[r], &from, &to) >= 0);
+
+                if (measure(pool, method, format, from, to, seconds, &res) < 0) {
+                    pa_log("Failed to measure %s %s %s.", methods.values[m], formats.values[f], rates.values[r]);
+                    ret = 1;
+                    continue;
+                }
+
+                if (res.has_aliasing)
+                    pa_snprintf(alias, sizeof(alias), "%0.1f", res.aliasing);
+                else
+                    pa_snprintf(alias, sizeof(alias), "-");
+
+                printf("%-20s %-10s %13s %10.0f %12.0f %9.1f %10.2f %10s\n",
+                       methods.values[m], formats.values[f], rates.values[r],
+                       res.cpu_usec, res.latency_usec, res.thd_n, res.ripple, alias);
+                fflush(stdout);
+            }
+
+    goto quit;
+
+invalid:
+    pa_log("Invalid argument: %s", optarg);
+
+quit:
+    variants_done(&methods);
+    variants_done(&formats);
+    variants_done(&rates);
+
+    if (pool)
+        pa_mempool_free(pool);
+
+    return ret;
+}
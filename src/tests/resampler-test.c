@@ -296,6 +296,36 @@ static void dump_resample_methods(void) {
 
 }
 
+/* Resamples seconds times one second of data in a single chunk, and reports
+ * the time it took per input frame */
+static void run_benchmark(const char *label, pa_mempool *pool, const pa_sample_spec *a, const pa_sample_spec *b,
+                          pa_resample_method_t method, pa_resample_flags_t flags, int seconds) {
+    pa_resampler *resampler;
+    pa_memchunk i, j;
+    pa_usec_t ts;
+    int n;
+
+    pa_assert_se(resampler = pa_resampler_new(pool, a, NULL, b, NULL, 0, method, flags));
+
+    i.memblock = pa_memblock_new(pool, pa_usec_to_bytes(1*PA_USEC_PER_SEC, a));
+    i.length = pa_memblock_get_length(i.memblock);
+    i.index = 0;
+
+    ts = pa_rtclock_now();
+    for (n = 0; n < seconds; n++) {
+        pa_resampler_run(resampler, &i, &j);
+        if (j.memblock)
+            pa_memblock_unref(j.memblock);
+    }
+    ts = pa_rtclock_now() - ts;
+
+    pa_log_info("%s: %llu usec, %0.2f ns/frame", label, (long long unsigned) ts,
+                (double) ts * 1000 / ((double) seconds * a->rate));
+
+    pa_memblock_unref(i.memblock);
+    pa_resampler_free(resampler);
+}
+
 int main(int argc, char *argv[]) {
     pa_mempool *pool = NULL;
     pa_sample_spec a, b;
@@ -409,7 +439,7 @@ int main(int argc, char *argv[]) {
     if (!all_formats) {
 
         pa_resampler *resampler;
-        pa_memchunk i, j;
+        pa_sample_spec w1, w2, w3;
         pa_usec_t ts;
 
         pa_log_debug("Compilation CFLAGS: %s", PA_CFLAGS);
@@ -421,18 +451,27 @@ int main(int argc, char *argv[]) {
         pa_assert_se(resampler = pa_resampler_new(pool, &a, NULL, &b, NULL, crossover_freq, method, 0));
         pa_log_info("init: %llu", (long long unsigned)(pa_rtclock_now() - ts));
 
-        i.memblock = pa_memblock_new(pool, pa_usec_to_bytes(1*PA_USEC_PER_SEC, &a));
-
-        ts = pa_rtclock_now();
-        i.length = pa_memblock_get_length(i.memblock);
-        i.index = 0;
-        while (seconds--) {
-            pa_resampler_run(resampler, &i, &j);
-            if (j.memblock)
-                pa_memblock_unref(j.memblock);
+        run_benchmark("resampling", pool, &a, &b, method, 0, seconds);
+        run_benchmark("unfused", pool, &a, &b, method, PA_RESAMPLER_NO_FUSE, seconds);
+
+        /* Time each stage on its own, by running resamplers which only
+         * do that stage, in the order pa_resampler_run() does them */
+        w1 = a;
+        w1.format = resampler->work_format;
+        w3 = b;
+        w3.format = resampler->work_format;
+        w2 = b.channels <= a.channels ? w3 : w1;
+        w2.rate = b.channels <= a.channels ? a.rate : b.rate;
+
+        run_benchmark("stage: to work format", pool, &a, &w1, method, 0, seconds);
+        if (b.channels <= a.channels) {
+            run_benchmark("stage: remap", pool, &w1, &w2, method, 0, seconds);
+            run_benchmark("stage: resample", pool, &w2, &w3, method, 0, seconds);
+        } else {
+            run_benchmark("stage: resample", pool, &w1, &w2, method, 0, seconds);
+            run_benchmark("stage: remap", pool, &w2, &w3, method, 0, seconds);
         }
-        pa_log_info("resampling: %llu", (long long unsigned)(pa_rtclock_now() - ts));
-        pa_memblock_unref(i.memblock);
+        run_benchmark("stage: from work format", pool, &w3, &b, method, 0, seconds);
 
         pa_resampler_free(resampler);
 
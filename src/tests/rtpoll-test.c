@@ -21,10 +21,17 @@
 
 #include <check.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+
+#include <pulsecore/core-util.h>
 #include <pulsecore/poll.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/rtpoll-jitter.h>
 
 static int before(pa_rtpoll_item *i) {
     pa_log("before");
@@ -82,15 +89,166 @@ START_TEST (rtpoll_test) {
 }
 END_TEST
 
+static void run_fd_test(void) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i, *j;
+    struct pollfd *pollfd;
+    int fds[2], dup_fd;
+    char c = 'x';
+
+    fail_unless(pipe(fds) == 0);
+
+    p = pa_rtpoll_new();
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NORMAL, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fds[0];
+    pollfd->events = POLLIN;
+
+    /* Nothing to read, so the timer wakes us */
+    pa_rtpoll_set_timer_relative(p, 1000);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents == 0);
+
+    fail_unless(write(fds[1], &c, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10000000);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(!pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents & POLLIN);
+
+    /* Events changed in place take effect on the next run */
+    pollfd->events = 0;
+    pa_rtpoll_set_timer_relative(p, 1000);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents == 0);
+
+    pollfd->events = POLLIN;
+    pa_rtpoll_set_timer_disabled(p);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pollfd->revents & POLLIN);
+
+    /* A second item on the same fd, which epoll can't take */
+    fail_unless((dup_fd = dup(fds[0])) >= 0);
+    j = pa_rtpoll_item_new(p, PA_RTPOLL_NORMAL, 2);
+    pollfd = pa_rtpoll_item_get_pollfd(j, NULL);
+    pollfd[0].fd = fds[0];
+    pollfd[0].events = POLLIN;
+    pollfd[1].fd = dup_fd;
+    pollfd[1].events = POLLIN;
+
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pollfd[0].revents & POLLIN);
+    fail_unless(pollfd[1].revents & POLLIN);
+
+    pa_rtpoll_item_free(j);
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close(dup_fd);
+    pa_close_pipe(fds);
+}
+
+START_TEST (rtpoll_fd_test) {
+    run_fd_test();
+
+    /* And the same with the plain ppoll() backend */
+    setenv("PULSE_RTPOLL_NO_EPOLL", "1", 1);
+    run_fd_test();
+    unsetenv("PULSE_RTPOLL_NO_EPOLL");
+}
+END_TEST
+
+START_TEST (rtpoll_now_test) {
+    pa_rtpoll *p;
+    pa_usec_t t;
+
+    p = pa_rtpoll_new();
+
+    /* One reading per iteration, a new one after every run */
+    t = pa_rtpoll_now(p);
+    pa_msleep(2);
+    fail_unless(pa_rtpoll_now(p) == t);
+
+    pa_rtpoll_set_timer_relative(p, 1000);
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pa_rtpoll_now(p) >= t + 2 * PA_USEC_PER_MSEC);
+    fail_unless(pa_rtpoll_now(p) <= pa_rtclock_now());
+
+    pa_rtpoll_free(p);
+}
+END_TEST
+
+START_TEST (rtpoll_jitter_test) {
+    pa_rtpoll_jitter *a, *b, *c;
+    pa_usec_t v, sum = 0;
+    unsigned i, n_delayed = 0, n_differ = 0;
+
+    fail_unless(pa_rtpoll_jitter_new("wakeup=gamma:3", 0) == NULL);
+    fail_unless(pa_rtpoll_jitter_new("wakeup=uniform:300", 0) == NULL);
+    fail_unless(pa_rtpoll_jitter_new("wakeup=uniform:300:100", 0) == NULL);
+    fail_unless(pa_rtpoll_jitter_new("render=fixed:100@2", 0) == NULL);
+    fail_unless(pa_rtpoll_jitter_new("sleep=fixed:100", 0) == NULL);
+
+    fail_unless((a = pa_rtpoll_jitter_new("wakeup=uniform:100:300,render=fixed:50@0.25,seed=7", 0)) != NULL);
+    fail_unless((b = pa_rtpoll_jitter_new("wakeup=uniform:100:300,render=fixed:50@0.25,seed=7", 0)) != NULL);
+    fail_unless((c = pa_rtpoll_jitter_new("wakeup=uniform:100:300,render=fixed:50@0.25,seed=7", 1)) != NULL);
+
+    for (i = 0; i < 1000; i++) {
+        v = pa_rtpoll_jitter_next(a, PA_RTPOLL_JITTER_WAKEUP);
+        fail_unless(v >= 100 && v <= 300);
+        fail_unless(pa_rtpoll_jitter_next(b, PA_RTPOLL_JITTER_WAKEUP) == v);
+
+        if (pa_rtpoll_jitter_next(c, PA_RTPOLL_JITTER_WAKEUP) != v)
+            n_differ++;
+
+        v = pa_rtpoll_jitter_next(a, PA_RTPOLL_JITTER_RENDER);
+        fail_unless(v == 0 || v == 50);
+        fail_unless(pa_rtpoll_jitter_next(b, PA_RTPOLL_JITTER_RENDER) == v);
+
+        if (v > 0)
+            n_delayed++;
+    }
+
+    /* Another stream is another sequence, and about a quarter of the
+     * renders are slowed down */
+    fail_unless(n_differ > 900);
+    fail_unless(n_delayed > 150 && n_delayed < 350);
+
+    pa_rtpoll_jitter_free(a);
+    pa_rtpoll_jitter_free(b);
+    pa_rtpoll_jitter_free(c);
+
+    /* Points without a distribution are never delayed */
+    fail_unless((a = pa_rtpoll_jitter_new("wakeup=exponential:200", 0)) != NULL);
+
+    for (i = 0; i < 10000; i++) {
+        sum += pa_rtpoll_jitter_next(a, PA_RTPOLL_JITTER_WAKEUP);
+        fail_unless(pa_rtpoll_jitter_next(a, PA_RTPOLL_JITTER_RENDER) == 0);
+    }
+
+    fail_unless(sum / 10000 > 180 && sum / 10000 < 220);
+
+    pa_rtpoll_jitter_free(a);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
     TCase *tc;
     SRunner *sr;
 
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
     s = suite_create("RT Poll");
     tc = tcase_create("rtpoll");
     tcase_add_test(tc, rtpoll_test);
+    tcase_add_test(tc, rtpoll_fd_test);
+    tcase_add_test(tc, rtpoll_now_test);
+    tcase_add_test(tc, rtpoll_jitter_test);
     /* the default timeout is too small,
      * set it to a reasonable large one.
      */
@@ -19,11 +19,76 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+#include <pulsecore/random.h>
 #include <pulse/rtclock.h>
 
+/* For make bench: with $PA_BENCH_SEED set the test data is the same in
+ * every run, and every timed loop appends a JSON object to the file
+ * named by $PA_BENCH_JSON. Loops are named after the test, their number
+ * within the process and their label, so run the tests with CK_FORK=no
+ * to get names that stay the same between runs. */
+
+static inline void pa_runtime_test_random(void *buf, size_t length) {
+    static uint64_t state = 0;
+    const char *seed;
+    uint8_t *p = buf;
+    size_t i;
+
+    if (!(seed = getenv("PA_BENCH_SEED"))) {
+        pa_random(buf, length);
+        return;
+    }
+
+    if (state == 0)
+        state = (strtoull(seed, NULL, 0) + 1) * UINT64_C(0x9e3779b97f4a7c15) | 1;
+
+    for (i = 0; i < length; i++) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        p[i] = (uint8_t) ((state * UINT64_C(2685821657736338717)) >> 56);
+    }
+}
+
+static inline void pa_runtime_test_record(const char *file, const char *label, int times, int times2,
+                                          pa_usec_t min, pa_usec_t max, double s1, double s2) {
+    static unsigned n = 0;
+    const char *path, *name, *dot;
+    FILE *f;
+
+    n++;
+
+    if (!(path = getenv("PA_BENCH_JSON")))
+        return;
+
+    name = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+    dot = strrchr(name, '.');
+
+    if (!(f = fopen(path, "a"))) {
+        pa_log_warn("Failed to open %s: %s", path, strerror(errno));
+        return;
+    }
+
+    /* The minimum is least disturbed by whatever else the machine does,
+     * so that is what gets compared */
+    fprintf(f, "{\"name\": \"%.*s/%u %s\", \"iterations\": %d, \"usec_per_iteration\": %.4f, "
+            "\"avg_usec\": %.1f, \"min_usec\": %llu, \"max_usec\": %llu, \"stddev_usec\": %.1f}\n",
+            dot ? (int) (dot - name) : (int) strlen(name), name, n, label,
+            times * times2, (double) min / times,
+            s1 / times2, (unsigned long long) min, (unsigned long long) max,
+            sqrt(times2 * s2 - s1 * s1) / times2);
+
+    fclose(f);
+}
+
 #define PA_RUNTIME_TEST_RUN_START(l, t1, t2)                    \
 {                                                               \
     int _j, _k;                                                 \
@@ -51,6 +116,8 @@
             (long long unsigned int)_min,                       \
             (long long unsigned int)_max,                       \
             sqrt(_times2 * _s2 - _s1 * _s1) / _times2);         \
+    pa_runtime_test_record(__FILE__, _label, _times, _times2,   \
+            _min, _max, _s1, _s2);                              \
 }
 
 #endif
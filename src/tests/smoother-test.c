@@ -29,6 +29,8 @@
 #include <pulsecore/log.h>
 #include <pulsecore/time-smoother.h>
 
+#include "runtime-test-util.h"
+
 START_TEST (smoother_test) {
     pa_usec_t x;
     unsigned u = 0;
@@ -47,9 +49,6 @@ START_TEST (smoother_test) {
 
     srand(0);
 
-    if (!getenv("MAKE_CHECK"))
-        pa_log_set_level(PA_LOG_DEBUG);
-
     for (m = 0, u = 0; u < PA_ELEMENTSOF(msec); u+= 2) {
 
         msec[u] = m+1 + (rand() % 100) - 50;
@@ -84,15 +83,71 @@ START_TEST (smoother_test) {
 }
 END_TEST
 
+/* Without smoothing the estimate right of the last measurement follows
+ * the gradient of the history, which must match the line the points are
+ * on. 100 points per history window, so it wraps. */
+START_TEST (smoother_gradient_test) {
+    const double gradients[] = { 1.0, 0.999, 1.25, 0.5 };
+    pa_smoother *s;
+    pa_usec_t x = 0, y = 0, est;
+    unsigned i, j;
+
+    s = pa_smoother_new(PA_USEC_PER_SEC, PA_USEC_PER_SEC, false, false, 2, 0, false);
+
+    for (i = 0; i < PA_ELEMENTSOF(gradients); i++) {
+
+        /* Twice the history time, so the points of the last gradient
+         * are gone */
+        for (j = 0; j < 200; j++) {
+            x += 10 * PA_USEC_PER_MSEC;
+            y += (pa_usec_t) (gradients[i] * 10 * PA_USEC_PER_MSEC);
+            pa_smoother_put(s, x, y);
+        }
+
+        /* Put the same x again, which replaces the entry */
+        pa_smoother_put(s, x, y);
+
+        est = pa_smoother_get(s, x + PA_USEC_PER_SEC);
+        pa_log_debug("gradient %0.3f: %llu -> %llu", gradients[i], (unsigned long long) y, (unsigned long long) est);
+
+        fail_unless(est >= y + (pa_usec_t) (gradients[i] * PA_USEC_PER_SEC) - 10);
+        fail_unless(est <= y + (pa_usec_t) (gradients[i] * PA_USEC_PER_SEC) + 10);
+    }
+
+    pa_smoother_free(s);
+}
+END_TEST
+
+START_TEST (smoother_benchmark_test) {
+    pa_smoother *s;
+    pa_usec_t x = 0;
+
+    s = pa_smoother_new(PA_USEC_PER_SEC, 5 * PA_USEC_PER_SEC, true, true, 4, 0, false);
+
+    PA_RUNTIME_TEST_RUN_START("put and get", 1000, 100) {
+        x += 10 * PA_USEC_PER_MSEC;
+        pa_smoother_put(s, x, x + (rand() % 1000));
+        pa_smoother_get(s, x + 5 * PA_USEC_PER_MSEC);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_smoother_free(s);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
     TCase *tc;
     SRunner *sr;
 
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
     s = suite_create("Smoother");
     tc = tcase_create("smoother");
     tcase_add_test(tc, smoother_test);
+    tcase_add_test(tc, smoother_gradient_test);
+    tcase_add_test(tc, smoother_benchmark_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
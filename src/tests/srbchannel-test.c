@@ -22,13 +22,17 @@
 #endif
 
 #include <unistd.h>
+#include <string.h>
 #include <check.h>
 
 #include <pulse/mainloop.h>
+#include <pulse/util.h>
 #include <pulsecore/packet.h>
 #include <pulsecore/pstream.h>
 #include <pulsecore/iochannel.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/thread.h>
 
 static unsigned packets_received;
 static unsigned packets_checksum;
@@ -80,6 +84,124 @@ static void packet_test(unsigned npackets, size_t plength, pa_mainloop *ml, pa_p
     pa_packet_unref(packet);
 }
 
+static unsigned burst_next;
+
+static void burst_packet_received(pa_pstream *p, pa_packet *packet, const pa_cmsg_ancil_data *ancil_data, void *userdata) {
+    const uint8_t *pdata;
+    size_t plen, i;
+
+    pdata = pa_packet_data(packet, &plen);
+
+    /* Packets must arrive in order and intact */
+    fail_unless(plen == 1 + (burst_next * 37) % 400);
+    for (i = 0; i < plen; i++)
+        fail_unless(pdata[i] == (uint8_t) (burst_next + i));
+
+    burst_next++;
+}
+
+/* Queues packets of mixed sizes at once, so that the small ones are
+ * written in batches, interleaved with the ones that are too large */
+static void packet_burst_test(unsigned npackets, pa_mainloop *ml, pa_pstream *p1, pa_pstream *p2) {
+    unsigned i;
+
+    pa_log_info("Sending a burst of %u packets", npackets);
+    burst_next = 0;
+    pa_pstream_set_receive_packet_callback(p2, burst_packet_received, NULL);
+
+    for (i = 0; i < npackets; i++) {
+        pa_packet *packet = pa_packet_new(1 + (i * 37) % 400);
+        uint8_t *pdata;
+        size_t plen, j;
+
+        pdata = (uint8_t *) pa_packet_data(packet, &plen);
+        for (j = 0; j < plen; j++)
+            pdata[j] = (uint8_t) (i + j);
+
+        pa_pstream_send_packet(p1, packet, NULL);
+        pa_packet_unref(packet);
+    }
+
+    while (burst_next < npackets)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(!pa_pstream_is_pending(p1));
+}
+
+/* Queues many tiny packets at once. Reading ahead gets dozens of them
+ * with a single read, still no more than a few may be dispatched per
+ * main loop iteration. */
+static void packet_fairness_test(unsigned npackets, pa_mainloop *ml, pa_pstream *p1, pa_pstream *p2) {
+    pa_packet *packet = pa_packet_new(5);
+    unsigned i, max_per_iteration = 0;
+    uint8_t *pdata;
+    size_t plen;
+
+    pa_log_info("Flooding with %u packets", npackets);
+    packets_received = 0;
+    packets_checksum = 0;
+    packets_length = 5;
+    pa_pstream_set_receive_packet_callback(p2, packet_received, NULL);
+
+    pdata = (uint8_t *) pa_packet_data(packet, &plen);
+    memset(pdata, 1, plen);
+
+    for (i = 0; i < npackets; i++)
+        pa_pstream_send_packet(p1, packet, NULL);
+
+    while (packets_received < npackets) {
+        unsigned before = packets_received;
+
+        pa_mainloop_iterate(ml, 1, NULL);
+        max_per_iteration = PA_MAX(max_per_iteration, packets_received - before);
+    }
+
+    pa_log_debug("At most %u packets per iteration", max_per_iteration);
+
+    /* Once from the IO event, once from picking up the rest */
+    fail_unless(max_per_iteration <= 16);
+    fail_unless(packets_checksum == npackets * 5);
+    pa_packet_unref(packet);
+}
+
+/* Nothing may be dispatched while reading is paused, everything that
+ * queued up in the meantime once it is resumed */
+static void packet_pause_test(unsigned npackets, pa_mainloop *ml, pa_pstream *p1, pa_pstream *p2) {
+    pa_packet *packet = pa_packet_new(5);
+    unsigned i;
+    uint8_t *pdata;
+    size_t plen;
+
+    pa_log_info("Sending %u packets while paused", npackets);
+    packets_received = 0;
+    packets_checksum = 0;
+    packets_length = 5;
+    pa_pstream_set_receive_packet_callback(p2, packet_received, NULL);
+
+    pdata = (uint8_t *) pa_packet_data(packet, &plen);
+    memset(pdata, 1, plen);
+
+    pa_pstream_set_read_paused(p2, true);
+
+    for (i = 0; i < npackets; i++) {
+        pa_pstream_send_packet(p1, packet, NULL);
+        pa_mainloop_iterate(ml, 0, NULL);
+    }
+
+    for (i = 0; i < 10; i++)
+        pa_mainloop_iterate(ml, 0, NULL);
+
+    fail_unless(packets_received == 0);
+
+    pa_pstream_set_read_paused(p2, false);
+
+    while (packets_received < npackets)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(packets_checksum == npackets * 5);
+    pa_packet_unref(packet);
+}
+
 START_TEST (srbchannel_test) {
 
     int pipefd[4];
@@ -102,6 +224,9 @@ START_TEST (srbchannel_test) {
 
     packet_test(250, 5, ml, p1, p2);
     packet_test(10, 1234567, ml, p1, p2);
+    packet_burst_test(500, ml, p1, p2);
+    packet_fairness_test(500, ml, p1, p2);
+    packet_pause_test(200, ml, p1, p2);
 
     pa_log_debug("And now the same thing with srbchannel...");
 
@@ -113,6 +238,8 @@ START_TEST (srbchannel_test) {
 
     packet_test(250, 5, ml, p1, p2);
     packet_test(10, 1234567, ml, p1, p2);
+    packet_burst_test(500, ml, p1, p2);
+    packet_pause_test(200, ml, p1, p2);
 
     pa_pstream_unref(p1);
     pa_pstream_unref(p2);
@@ -121,6 +248,81 @@ START_TEST (srbchannel_test) {
 }
 END_TEST
 
+START_TEST (srbchannel_length_test) {
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(true, 0);
+    pa_srbchannel *sr1, *sr2;
+    pa_srbchannel_template srt;
+    uint8_t data[100] = { 0 };
+    size_t capacity;
+
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp);
+    pa_srbchannel_export(sr1, &srt);
+    sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
+
+    capacity = pa_srbchannel_get_writable(sr1);
+    fail_unless(capacity > sizeof(data));
+    fail_unless(pa_srbchannel_get_writable(sr2) == capacity);
+
+    fail_unless(pa_srbchannel_write(sr1, data, sizeof(data)) == sizeof(data));
+    fail_unless(pa_srbchannel_get_written(sr1) == sizeof(data));
+    fail_unless(pa_srbchannel_get_writable(sr1) == capacity - sizeof(data));
+    fail_unless(pa_srbchannel_get_readable(sr2) == sizeof(data));
+    fail_unless(pa_srbchannel_get_readable(sr1) == 0);
+
+    fail_unless(pa_srbchannel_read(sr2, data, sizeof(data)) == sizeof(data));
+    fail_unless(pa_srbchannel_get_written(sr1) == 0);
+    fail_unless(pa_srbchannel_get_readable(sr2) == 0);
+
+    pa_srbchannel_free(sr2);
+    pa_srbchannel_free(sr1);
+    pa_mempool_free(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+#define PING_PONG_ROUNDS 2000
+
+static pa_fdsem *ping, *pong;
+
+static void pong_thread(void *userdata) {
+    unsigned i;
+
+    for (i = 0; i < PING_PONG_ROUNDS; i++) {
+        pa_fdsem_wait(ping);
+        pa_fdsem_post(pong);
+    }
+}
+
+/* No wakeup may get lost while the waiters spin, both when the other
+ * side answers within the budget and when it doesn't */
+START_TEST (fdsem_spin_test) {
+    pa_thread *t;
+    unsigned i;
+
+    ping = pa_fdsem_new();
+    pong = pa_fdsem_new();
+    fail_unless(ping && pong);
+
+    pa_fdsem_set_spin(ping, 50);
+    pa_fdsem_set_spin(pong, 50);
+
+    t = pa_thread_new("pong", pong_thread, NULL);
+    fail_unless(t != NULL);
+
+    for (i = 0; i < PING_PONG_ROUNDS; i++) {
+        if (i % 100 == 0)
+            pa_msleep(1);
+
+        pa_fdsem_post(ping);
+        pa_fdsem_wait(pong);
+    }
+
+    pa_thread_free(t);
+    pa_fdsem_free(ping);
+    pa_fdsem_free(pong);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -134,6 +336,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+    tcase_add_test(tc, srbchannel_length_test);
+    tcase_add_test(tc, fdsem_spin_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,124 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/startup-trace.h>
+#include <pulsecore/strbuf.h>
+
+static char *dump(void) {
+    pa_strbuf *buf = pa_strbuf_new();
+
+    pa_startup_trace_dump(buf);
+    return pa_strbuf_tostring_free(buf);
+}
+
+START_TEST (startup_trace_test) {
+    pa_usec_t outer, inner;
+    char *s;
+
+    /* Nothing is recorded before starting */
+    fail_unless(pa_startup_trace_begin() == 0);
+    pa_startup_trace_end(0, "test", "ignored");
+
+    pa_startup_trace_start();
+
+    outer = pa_startup_trace_begin();
+    fail_unless(outer > 0);
+    inner = pa_startup_trace_begin();
+    pa_startup_trace_end(inner, "conf", "/etc/pulse/\"daemon\".conf");
+    pa_startup_trace_end(outer, "module", "module-test\n");
+
+    pa_startup_trace_stop();
+
+    /* Nor after stopping */
+    fail_unless(pa_startup_trace_begin() == 0);
+    pa_startup_trace_end(outer, "test", "ignored");
+
+    s = dump();
+    pa_log_debug("%s", s);
+
+    fail_unless(strstr(s, "\"traceEvents\":[") != NULL);
+    fail_unless(strstr(s, "{\"name\":\"/etc/pulse/\\\"daemon\\\".conf\",\"cat\":\"conf\",\"ph\":\"X\"") != NULL);
+    fail_unless(strstr(s, "{\"name\":\"module-test\\u000a\",\"cat\":\"module\",\"ph\":\"X\"") != NULL);
+    fail_unless(strstr(s, "ignored") == NULL);
+
+    /* Phases are listed in the order they ended */
+    fail_unless(strstr(s, "\"cat\":\"conf\"") < strstr(s, "\"cat\":\"module\""));
+    pa_xfree(s);
+
+    /* Starting again drops what was recorded */
+    pa_startup_trace_start();
+    s = dump();
+    fail_unless(strstr(s, "module-test") == NULL);
+    pa_xfree(s);
+
+    pa_startup_trace_free();
+}
+END_TEST
+
+START_TEST (startup_trace_full_test) {
+    unsigned i;
+    char *s;
+
+    pa_startup_trace_start();
+
+    /* Recording stops once the buffer is full */
+    for (i = 0; i < 10000; i++)
+        pa_startup_trace_end(pa_startup_trace_begin(), "test", "phase");
+
+    fail_unless(pa_startup_trace_begin() == 0);
+
+    s = dump();
+    fail_unless(strstr(s, "phase") != NULL);
+    pa_xfree(s);
+
+    pa_startup_trace_free();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Startup Trace");
+    tc = tcase_create("startup-trace");
+    tcase_add_test(tc, startup_trace_test);
+    tcase_add_test(tc, startup_trace_full_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
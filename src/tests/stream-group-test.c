@@ -0,0 +1,243 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/mainloop.h>
+#include <pulse/stream-group.h>
+
+#define SINE_HZ 440
+#define SAMPLE_HZ 8000
+
+/* Each member plays this much */
+#define PLAY_FRAMES (SAMPLE_HZ/4)
+
+static pa_context *context = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+static pa_stream_group *group = NULL;
+static const char *bname = NULL;
+
+static int16_t data[PLAY_FRAMES];
+
+/* The victim is freed by the killer from its write callback, the keeper
+ * plays to the end. Members are called back newest first, so the killer
+ * runs right before the victim. */
+enum {
+    MEMBER_VICTIM,
+    MEMBER_KILLER,
+    MEMBER_KEEPER,
+    NMEMBERS
+};
+
+static pa_stream_group_member *members[NMEMBERS];
+static size_t written[NMEMBERS];
+static unsigned n_finished = 0;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16NE,
+    .rate = SAMPLE_HZ,
+    .channels = 1
+};
+
+static void drain_cb(pa_stream *s, int success, void *userdata) {
+    fail_unless(success);
+
+    fprintf(stderr, "Drained\n");
+    mainloop_api->quit(mainloop_api, 0);
+}
+
+static void member_write_cb(pa_stream_group_member *m, size_t nbytes, void *userdata) {
+    int i = (int) (long) userdata;
+    pa_usec_t usec;
+    size_t l;
+    int r;
+
+    fail_unless(m == members[i]);
+    fail_unless(i != MEMBER_VICTIM);
+
+    if (i == MEMBER_KILLER && members[MEMBER_VICTIM]) {
+        fprintf(stderr, "Freeing the victim from the killer's callback\n");
+        pa_stream_group_member_free(members[MEMBER_VICTIM]);
+        members[MEMBER_VICTIM] = NULL;
+    }
+
+    if (written[i] >= sizeof(data))
+        return;
+
+    l = sizeof(data) - written[i];
+    if (l > nbytes)
+        l = nbytes;
+
+    fail_unless(pa_stream_group_member_write(m, (uint8_t*) data + written[i], l, NULL) == 0);
+    written[i] += l;
+
+    /* Fails like pa_stream_get_latency() until timing info arrived */
+    r = pa_stream_group_member_get_latency(m, &usec);
+    fail_unless(r == 0 || pa_context_errno(context) == PA_ERR_NODATA);
+
+    if (written[i] >= sizeof(data) && ++n_finished >= NMEMBERS - 1) {
+        fprintf(stderr, "All written, draining\n");
+        pa_operation_unref(pa_stream_drain(pa_stream_group_get_stream(group), drain_cb, NULL));
+    }
+}
+
+static void stream_state_callback(pa_stream *s, void *userdata) {
+    fail_unless(s != NULL);
+
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_UNCONNECTED:
+        case PA_STREAM_CREATING:
+        case PA_STREAM_READY:
+        case PA_STREAM_TERMINATED:
+            break;
+
+        default:
+        case PA_STREAM_FAILED:
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            fail();
+    }
+}
+
+static void context_state_callback(pa_context *c, void *userdata) {
+    fail_unless(c != NULL);
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY: {
+            pa_cvolume v;
+            int i;
+
+            fprintf(stderr, "Connection established.\n");
+
+            group = pa_stream_group_new(c, "stream group", &sample_spec, NULL);
+            fail_unless(group != NULL);
+
+            for (i = 0; i < NMEMBERS; i++) {
+                members[i] = pa_stream_group_member_new(group);
+                fail_unless(members[i] != NULL);
+                pa_stream_group_member_set_write_callback(members[i], member_write_cb, (void*) (long) i);
+            }
+
+            /* Not connected yet, members may queue the default amount */
+            fail_unless(pa_stream_group_member_writable_size(members[MEMBER_KEEPER]) > 0);
+
+            /* Volumes have one channel or as many as the group */
+            pa_cvolume_set(&v, 2, PA_VOLUME_NORM);
+            fail_unless(pa_stream_group_member_set_volume(members[MEMBER_KEEPER], &v) < 0);
+            pa_cvolume_set(&v, 1, PA_VOLUME_NORM/2);
+            fail_unless(pa_stream_group_member_set_volume(members[MEMBER_KEEPER], &v) == 0);
+            fail_unless(pa_stream_group_member_set_mute(members[MEMBER_VICTIM], 1) == 0);
+
+            /* Whole frames only */
+            fail_unless(pa_stream_group_member_write(members[MEMBER_VICTIM], data, 1, NULL) < 0);
+
+            /* Queued ahead of the connection, the victim must never be
+             * mixed once it is freed */
+            fail_unless(pa_stream_group_member_write(members[MEMBER_VICTIM], data, sizeof(data), NULL) == 0);
+
+            pa_stream_set_state_callback(pa_stream_group_get_stream(group), stream_state_callback, NULL);
+            fail_unless(pa_stream_group_connect(group, NULL, NULL, 0) == 0);
+
+            break;
+        }
+
+        case PA_CONTEXT_TERMINATED:
+            mainloop_api->quit(mainloop_api, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+        default:
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            fail();
+    }
+}
+
+START_TEST (stream_group_test) {
+    pa_mainloop* m = NULL;
+    int i, ret = 0;
+
+    for (i = 0; i < PLAY_FRAMES; i++)
+        data[i] = (int16_t) (sin(((double) i/SAMPLE_HZ)*2*M_PI*SINE_HZ) * 0x3fff);
+
+    m = pa_mainloop_new();
+    fail_unless(m != NULL);
+
+    mainloop_api = pa_mainloop_get_api(m);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    if (pa_context_connect(context, NULL, 0, NULL) < 0) {
+        fprintf(stderr, "pa_context_connect() failed.\n");
+        goto quit;
+    }
+
+    if (pa_mainloop_run(m, &ret) < 0)
+        fprintf(stderr, "pa_mainloop_run() failed.\n");
+
+    fail_unless(members[MEMBER_VICTIM] == NULL);
+    fail_unless(written[MEMBER_KILLER] == sizeof(data));
+    fail_unless(written[MEMBER_KEEPER] == sizeof(data));
+
+quit:
+    if (group)
+        pa_stream_group_unref(group);
+
+    pa_context_unref(context);
+    pa_mainloop_free(m);
+
+    fail_unless(ret == 0);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Stream Group");
+    tc = tcase_create("streamgroup");
+    tcase_add_test(tc, stream_group_test);
+    tcase_set_timeout(tc, 5 * 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -19,12 +19,17 @@
 #include <config.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #include <check.h>
 
 #include <pulse/xmalloc.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mutex.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/once.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
@@ -141,6 +146,45 @@ START_TEST (thread_test) {
 }
 END_TEST
 
+static pa_atomic_t affinity_state = PA_ATOMIC_INIT(0);
+
+static void affinity_thread_func(void *data) {
+    /* Wait for the main thread to set our affinity */
+    while (pa_atomic_load(&affinity_state) == 0)
+        pa_thread_yield();
+
+#if defined(__linux__) && defined(HAVE_PTHREAD_SETAFFINITY_NP)
+    {
+        cpu_set_t mask;
+
+        fail_unless(sched_getaffinity(0, sizeof(mask), &mask) == 0);
+        fail_unless(CPU_COUNT(&mask) == 1);
+        fail_unless(CPU_ISSET(0, &mask));
+    }
+#endif
+}
+
+START_TEST (affinity_test) {
+    pa_thread *t;
+
+    t = pa_thread_new("affinity", affinity_thread_func, NULL);
+    fail_unless(t != NULL);
+
+    fail_unless(pa_thread_set_affinity(t, "") < 0);
+    fail_unless(pa_thread_set_affinity(t, "x") < 0);
+    fail_unless(pa_thread_set_affinity(t, "3-1") < 0);
+    fail_unless(pa_thread_set_affinity(t, "0,,1") < 0);
+    fail_unless(pa_thread_set_affinity(t, "0-") < 0);
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    fail_unless(pa_thread_set_affinity(t, "0") == 0);
+#endif
+
+    pa_atomic_store(&affinity_state, 1);
+    pa_thread_free(t);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -150,6 +194,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Thread");
     tc = tcase_create("thread");
     tcase_add_test(tc, thread_test);
+    tcase_add_test(tc, affinity_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,220 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/tracepoint.h>
+
+static char *trace_file = NULL;
+
+static void load(pa_tracepoint_record **records, unsigned *n_records, char ***names, unsigned *n_threads) {
+    fail_unless(pa_tracepoints_dump(trace_file) == 0);
+    fail_unless(pa_tracepoints_load(trace_file, records, n_records, names, n_threads) == 0);
+}
+
+static void free_names(char **names, unsigned n_threads) {
+    unsigned i;
+
+    for (i = 0; i < n_threads; i++)
+        pa_xfree(names[i]);
+    pa_xfree(names);
+}
+
+static unsigned count(const pa_tracepoint_record *r, unsigned n, pa_tracepoint_id_t id, pa_tracepoint_phase_t phase) {
+    unsigned i, c = 0;
+
+    for (i = 0; i < n; i++)
+        if (r[i].id == id && r[i].phase == phase)
+            c++;
+
+    return c;
+}
+
+static void thread_func(void *userdata) {
+    unsigned i, n = PA_PTR_TO_UINT(userdata);
+
+    for (i = 0; i < n; i++) {
+        PA_TRACE_BEGIN(PA_TRACEPOINT_SINK_RENDER, 7, 1024);
+        PA_TRACE_END(PA_TRACEPOINT_SINK_RENDER, 7, (int64_t) i);
+    }
+}
+
+static void make_trace_file(void) {
+    int fd;
+
+    trace_file = pa_xstrdup("/tmp/tracepoint-test-XXXXXX");
+    fail_unless((fd = mkstemp(trace_file)) >= 0);
+    pa_close(fd);
+}
+
+static void remove_trace_file(void) {
+    unlink(trace_file);
+    pa_xfree(trace_file);
+    trace_file = NULL;
+}
+
+START_TEST (tracepoint_test) {
+    pa_tracepoint_record *r;
+    pa_thread *thread;
+    unsigned n, n_threads, i;
+    char **names;
+    bool found = false;
+
+    make_trace_file();
+
+    /* Nothing is recorded while disabled */
+    PA_TRACE_INSTANT(PA_TRACEPOINT_ALSA_WAKEUP, 1, 0);
+
+    pa_tracepoints_set_enabled(true);
+
+    PA_TRACE_INSTANT(PA_TRACEPOINT_SINK_REQUEST_REWIND, 3, 4096);
+
+    fail_unless(thread = pa_thread_new("trace-thread", thread_func, PA_UINT_TO_PTR(10)));
+    pa_thread_free(thread);
+
+    pa_tracepoints_set_enabled(false);
+    PA_TRACE_INSTANT(PA_TRACEPOINT_ALSA_WAKEUP, 1, 0);
+
+    load(&r, &n, &names, &n_threads);
+
+    fail_unless(n == 21);
+    fail_unless(count(r, n, PA_TRACEPOINT_ALSA_WAKEUP, PA_TRACEPOINT_INSTANT) == 0);
+    fail_unless(count(r, n, PA_TRACEPOINT_SINK_REQUEST_REWIND, PA_TRACEPOINT_INSTANT) == 1);
+    fail_unless(count(r, n, PA_TRACEPOINT_SINK_RENDER, PA_TRACEPOINT_BEGIN) == 10);
+    fail_unless(count(r, n, PA_TRACEPOINT_SINK_RENDER, PA_TRACEPOINT_END) == 10);
+
+    /* Sorted by time, the instant event came first */
+    fail_unless(r[0].id == PA_TRACEPOINT_SINK_REQUEST_REWIND);
+    fail_unless(r[0].object == 3);
+    fail_unless(r[0].arg == 4096);
+
+    for (i = 1; i < n; i++) {
+        fail_unless(r[i - 1].time_ns <= r[i].time_ns);
+        fail_unless(r[i].thread < n_threads);
+    }
+
+    for (i = 0; i < n_threads; i++)
+        if (pa_streq(names[i], "trace-thread"))
+            found = true;
+    fail_unless(found);
+
+    pa_xfree(r);
+    free_names(names, n_threads);
+
+    /* Enabling again hides what was recorded before */
+    pa_tracepoints_set_enabled(true);
+    pa_tracepoints_set_enabled(false);
+
+    load(&r, &n, &names, &n_threads);
+    fail_unless(n == 0);
+    pa_xfree(r);
+    free_names(names, n_threads);
+
+    remove_trace_file();
+}
+END_TEST
+
+START_TEST (tracepoint_wrap_test) {
+    pa_tracepoint_record *r;
+    pa_thread *thread;
+    unsigned n, n_threads, i;
+    char **names;
+
+    make_trace_file();
+
+    pa_tracepoints_set_enabled(true);
+
+    /* Much more than a ring holds, the oldest records are overwritten */
+    fail_unless(thread = pa_thread_new("trace-wrap", thread_func, PA_UINT_TO_PTR(20000)));
+    pa_thread_free(thread);
+
+    pa_tracepoints_set_enabled(false);
+
+    load(&r, &n, &names, &n_threads);
+
+    pa_log_debug("%u records of %u threads", n, n_threads);
+    fail_unless(n > 0 && n < 40000);
+
+    /* What is left is the end of the run */
+    fail_unless(r[n - 1].id == PA_TRACEPOINT_SINK_RENDER);
+    fail_unless(r[n - 1].phase == PA_TRACEPOINT_END);
+    fail_unless(r[n - 1].arg == 19999);
+
+    for (i = 1; i < n; i++)
+        fail_unless(r[i - 1].time_ns <= r[i].time_ns);
+
+    pa_xfree(r);
+    free_names(names, n_threads);
+
+    remove_trace_file();
+}
+END_TEST
+
+START_TEST (tracepoint_load_test) {
+    pa_tracepoint_record *r;
+    unsigned n, n_threads;
+    char **names;
+    FILE *f;
+
+    make_trace_file();
+
+    pa_assert_se(f = fopen(trace_file, "w"));
+    fputs("not a trace", f);
+    fclose(f);
+
+    fail_unless(pa_tracepoints_load(trace_file, &r, &n, &names, &n_threads) < 0);
+
+    remove_trace_file();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Trace points");
+    tc = tcase_create("tracepoint");
+    tcase_add_test(tc, tracepoint_test);
+    tcase_add_test(tc, tracepoint_wrap_test);
+    tcase_add_test(tc, tracepoint_load_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,125 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <check.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/workpool.h>
+
+#define N_JOBS 8
+#define N_SUBMITTERS 4
+#define N_ITERATIONS 2000
+
+struct submitter {
+    pa_workpool *pool;
+    unsigned counts[N_JOBS];
+};
+
+static void count_job(void *userdata, unsigned job) {
+    unsigned *counts = userdata;
+
+    fail_unless(job < N_JOBS);
+    counts[job]++;
+}
+
+START_TEST (workpool_inline_test) {
+    unsigned counts[N_JOBS] = { 0 };
+    pa_workpool *pool;
+    unsigned i;
+
+    pool = pa_workpool_new(0, 0);
+    fail_unless(pa_workpool_get_n_threads(pool) == 0);
+
+    pa_workpool_run(pool, N_JOBS, count_job, counts);
+    pa_workpool_run(pool, 0, count_job, counts);
+
+    for (i = 0; i < N_JOBS; i++)
+        fail_unless(counts[i] == 1);
+
+    pa_workpool_free(pool);
+}
+END_TEST
+
+static void submitter_func(void *userdata) {
+    struct submitter *s = userdata;
+    unsigned i, j;
+
+    for (i = 1; i <= N_ITERATIONS; i++) {
+        pa_workpool_run(s->pool, N_JOBS - i % 3, count_job, s->counts);
+
+        /* Every job of the batch is done once run returns */
+        for (j = 0; j < N_JOBS - i % 3; j++)
+            fail_unless(s->counts[j] == i);
+
+        for (; j < N_JOBS; j++)
+            s->counts[j]++;
+    }
+}
+
+START_TEST (workpool_threaded_test) {
+    struct submitter s[N_SUBMITTERS];
+    pa_thread *t[N_SUBMITTERS];
+    pa_workpool *pool;
+    unsigned i;
+
+    pool = pa_workpool_new(3, 0);
+    fail_unless(pa_workpool_get_n_threads(pool) == 3);
+
+    for (i = 0; i < N_SUBMITTERS; i++) {
+        memset(&s[i], 0, sizeof(s[i]));
+        s[i].pool = pool;
+        t[i] = pa_thread_new("submitter", submitter_func, &s[i]);
+        fail_unless(t[i] != NULL);
+    }
+
+    for (i = 0; i < N_SUBMITTERS; i++)
+        pa_thread_free(t[i]);
+
+    pa_workpool_free(pool);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Workpool");
+    tc = tcase_create("workpool");
+    tcase_add_test(tc, workpool_inline_test);
+    tcase_add_test(tc, workpool_threaded_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -32,6 +32,7 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <locale.h>
+#include <sys/stat.h>
 
 #include <sndfile.h>
 
@@ -47,6 +48,10 @@
 
 #define TIME_EVENT_USEC 50000
 
+/* How much recorded data to collect before writing it to a regular
+ * file, pipes and terminals get it right away */
+#define RECORD_BATCH_BYTES (256*1024)
+
 #define CLEAR_LINE "\x1B[K"
 
 static enum { RECORD, PLAYBACK } mode = PLAYBACK;
@@ -59,6 +64,9 @@ static pa_mainloop_api *mainloop_api = NULL;
 static void *buffer = NULL;
 static size_t buffer_length = 0, buffer_index = 0;
 
+/* When recording, the buffer is kept and only grows */
+static size_t buffer_size = 0, record_batch = 0;
+
 static void *silence_buffer = NULL;
 static size_t silence_buffer_length = 0;
 
@@ -241,6 +249,30 @@ static void stream_write_callback(pa_stream *s, size_t length, void *userdata) {
     }
 }
 
+/* Makes room for length more bytes at the end of the recorded data */
+static void *record_buffer_append(size_t length) {
+    void *p;
+
+    if (buffer_index + buffer_length + length > buffer_size) {
+
+        /* What was written out already makes room first */
+        if (buffer_index > 0) {
+            memmove(buffer, (uint8_t *) buffer + buffer_index, buffer_length);
+            buffer_index = 0;
+        }
+
+        if (buffer_length + length > buffer_size) {
+            buffer_size = PA_MAX(buffer_length + length, buffer_size * 2);
+            buffer = pa_xrealloc(buffer, buffer_size);
+        }
+    }
+
+    p = (uint8_t *) buffer + buffer_index + buffer_length;
+    buffer_length += length;
+
+    return p;
+}
+
 /* This is called whenever new data is available */
 static void stream_read_callback(pa_stream *s, size_t length, void *userdata) {
 
@@ -250,9 +282,6 @@ static void stream_read_callback(pa_stream *s, size_t length, void *userdata) {
     if (raw) {
         pa_assert(!sndfile);
 
-        if (stdio_event)
-            mainloop_api->io_enable(stdio_event, PA_IO_EVENT_OUTPUT);
-
         while (pa_stream_readable_size(s) > 0) {
             const void *data;
 
@@ -267,18 +296,20 @@ static void stream_read_callback(pa_stream *s, size_t length, void *userdata) {
             /* If there is a hole in the stream, we generate silence, except
              * if it's a passthrough stream in which case we skip the hole. */
             if (data || !(flags & PA_STREAM_PASSTHROUGH)) {
-                buffer = pa_xrealloc(buffer, buffer_length + length);
+                void *p = record_buffer_append(length);
+
                 if (data)
-                    memcpy((uint8_t *) buffer + buffer_length, data, length);
+                    memcpy(p, data, length);
                 else
-                    pa_silence_memory((uint8_t *) buffer + buffer_length, length, &sample_spec);
-
-                buffer_length += length;
+                    pa_silence_memory(p, length, &sample_spec);
             }
 
             pa_stream_drop(s);
         }
 
+        if (stdio_event && buffer_length >= record_batch)
+            mainloop_api->io_enable(stdio_event, PA_IO_EVENT_OUTPUT);
+
     } else {
         pa_assert(sndfile);
 
@@ -540,8 +571,9 @@ fail:
 
 /* New data on STDIN **/
 static void stdin_callback(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
-    size_t l, w = 0;
+    size_t l = 4096, w = 0;
     ssize_t r;
+    void *data = NULL;
 
     pa_assert(a == mainloop_api);
     pa_assert(e);
@@ -552,12 +584,27 @@ static void stdin_callback(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_even
         return;
     }
 
-    if (!stream || pa_stream_get_state(stream) != PA_STREAM_READY || !(l = w = pa_stream_writable_size(stream)))
-        l = 4096;
+    if (stream && pa_stream_get_state(stream) == PA_STREAM_READY &&
+        (w = pa_stream_writable_size(stream)) > 0 && w != (size_t) -1) {
+
+        /* Read right into the memory that goes to the server instead of
+         * copying it there from a buffer of our own */
+        if (pa_stream_begin_write(stream, &data, &w) < 0) {
+            pa_log(_("pa_stream_begin_write() failed: %s"), pa_strerror(pa_context_errno(context)));
+            quit(1);
+            return;
+        }
+
+        r = pa_read(fd, data, w, userdata);
+    } else {
+        buffer = pa_xmalloc(l);
+        r = pa_read(fd, buffer, l, userdata);
+    }
 
-    buffer = pa_xmalloc(l);
+    if (r <= 0) {
+        if (data)
+            pa_stream_cancel_write(stream);
 
-    if ((r = pa_read(fd, buffer, l, userdata)) <= 0) {
         if (r == 0) {
             if (verbose)
                 pa_log(_("Got EOF."));
@@ -574,11 +621,17 @@ static void stdin_callback(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_even
         return;
     }
 
+    if (data) {
+        if (pa_stream_write(stream, data, (size_t) r, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+            pa_log(_("pa_stream_write() failed: %s"), pa_strerror(pa_context_errno(context)));
+            quit(1);
+        }
+
+        return;
+    }
+
     buffer_length = (uint32_t) r;
     buffer_index = 0;
-
-    if (w)
-        do_stream_write(w);
 }
 
 /* Some data may be written to STDOUT */
@@ -589,13 +642,11 @@ static void stdout_callback(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_eve
     pa_assert(e);
     pa_assert(stdio_event == e);
 
-    if (!buffer) {
+    if (!buffer_length) {
         mainloop_api->io_enable(stdio_event, PA_IO_EVENT_NULL);
         return;
     }
 
-    pa_assert(buffer_length);
-
     if ((r = pa_write(fd, (uint8_t*) buffer+buffer_index, buffer_length, userdata)) <= 0) {
         pa_log(_("write() failed: %s"), strerror(errno));
         quit(1);
@@ -608,11 +659,8 @@ static void stdout_callback(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_eve
     buffer_length -= (uint32_t) r;
     buffer_index += (uint32_t) r;
 
-    if (!buffer_length) {
-        pa_xfree(buffer);
-        buffer = NULL;
-        buffer_length = buffer_index = 0;
-    }
+    if (!buffer_length)
+        buffer_index = 0;
 }
 
 /* UNIX signal to quit received */
@@ -1164,10 +1212,22 @@ int main(int argc, char *argv[]) {
     pa_disable_sigpipe();
 
     if (raw) {
+        struct stat st;
+
 #ifdef OS_IS_WIN32
         /* need to turn on binary mode for stdio io. Windows, meh */
         setmode(mode == PLAYBACK ? STDIN_FILENO : STDOUT_FILENO, O_BINARY);
 #endif
+
+        /* Regular files are read ahead and written in large batches */
+        if (fstat(mode == PLAYBACK ? STDIN_FILENO : STDOUT_FILENO, &st) >= 0 && S_ISREG(st.st_mode)) {
+            if (mode == RECORD)
+                record_batch = RECORD_BATCH_BYTES;
+#ifdef HAVE_POSIX_FADVISE
+            else if (posix_fadvise(STDIN_FILENO, 0, 0, POSIX_FADV_SEQUENTIAL) < 0)
+                pa_log_debug("posix_fadvise() failed: %s", strerror(errno));
+#endif
+        }
         if (!(stdio_event = mainloop_api->io_new(mainloop_api,
                                                  mode == PLAYBACK ? STDIN_FILENO : STDOUT_FILENO,
                                                  mode == PLAYBACK ? PA_IO_EVENT_INPUT : PA_IO_EVENT_OUTPUT,
@@ -1205,6 +1265,11 @@ int main(int argc, char *argv[]) {
     }
 
 quit:
+    /* Recorded data that is still waiting for a batch to fill up */
+    if (mode == RECORD && raw && buffer_length > 0)
+        if (pa_loop_write(STDOUT_FILENO, (uint8_t *) buffer + buffer_index, buffer_length, NULL) < 0)
+            pa_log(_("write() failed: %s"), strerror(errno));
+
     if (stream)
         pa_stream_unref(stream);
 
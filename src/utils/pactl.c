@@ -31,6 +31,7 @@
 #include <getopt.h>
 #include <locale.h>
 #include <ctype.h>
+#include <fcntl.h>
 
 #include <sndfile.h>
 
@@ -40,6 +41,7 @@
 #include <pulsecore/i18n.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/core-error.h>
 #include <pulsecore/log.h>
 #include <pulsecore/sndfile-util.h>
 
@@ -77,6 +79,13 @@ static enum volume_flags {
     VOL_RELATIVE = 1 << 4,
 } volume_flags;
 
+/* What the set-*-volume callbacks get, a copy of the parsed volume since in a
+ * batch the next command may have been parsed by the time they run */
+struct volume_change {
+    pa_cvolume volume;
+    enum volume_flags flags;
+};
+
 static enum mute_flags {
     INVALID_MUTE = -1,
     UNMUTE = 0,
@@ -100,6 +109,17 @@ static int actions = 0;
 
 static bool nl = false;
 
+/* With the batch command, the commands are read from batch_fd one per line
+ * and sent without waiting for the replies of the commands before, unless
+ * batch_wait says that the callbacks of the last one still need what was
+ * parsed for it. */
+static int batch_fd = -1;
+static pa_io_event *batch_event = NULL;
+static char batch_buffer[4096];
+static size_t batch_length = 0;
+static unsigned batch_line = 0;
+static bool batch_eof = false, batch_wait = false, batch_failed = false;
+
 static enum {
     NONE,
     EXIT,
@@ -130,6 +150,9 @@ static enum {
     SET_SOURCE_OUTPUT_MUTE,
     SET_SINK_FORMATS,
     SET_PORT_LATENCY_OFFSET,
+    GET_SINK_IO_TRACE,
+    GET_SOURCE_IO_TRACE,
+    GET_METRICS,
     SUBSCRIBE
 } action = NONE;
 
@@ -151,11 +174,17 @@ static void drain(void) {
         pa_operation_unref(o);
 }
 
+static void batch_run(void);
+
 static void complete_action(void) {
     pa_assert(actions > 0);
 
-    if (!(--actions))
-        drain();
+    if (!(--actions)) {
+        if (batch_fd >= 0)
+            batch_run();
+        else
+            drain();
+    }
 }
 
 static void stat_callback(pa_context *c, const pa_stat_info *i, void *userdata) {
@@ -178,6 +207,54 @@ static void stat_callback(pa_context *c, const pa_stat_info *i, void *userdata)
     complete_action();
 }
 
+static void get_io_trace_callback(pa_context *c, const pa_io_trace_info *i, void *userdata) {
+    uint32_t j;
+
+    if (!i) {
+        pa_log(_("Failed to get IO trace: %s"), pa_strerror(pa_context_errno(c)));
+        quit(1);
+        return;
+    }
+
+    printf(_("%u xruns, %u cycles recorded%s.\n"), i->xruns, i->n_entries, i->frozen ? _(", stopped after an xrun") : "");
+
+    if (i->n_entries > 0)
+        printf(_("      time (ms)  late (ms)       avail  process (ms)  sleep (ms)\n"));
+
+    for (j = 0; j < i->n_entries; j++) {
+        const pa_io_trace_entry *e = &i->entries[j];
+
+        printf("%15.3f %10.3f %11lli %13.3f %11.3f%s%s%s\n",
+               (double) (int64_t) (e->time - i->entries[i->n_entries - 1].time) / PA_USEC_PER_MSEC,
+               (double) e->lateness / PA_USEC_PER_MSEC,
+               (long long) e->avail,
+               (double) e->process_usec / PA_USEC_PER_MSEC,
+               (double) e->sleep_usec / PA_USEC_PER_MSEC,
+               e->flags & PA_IO_TRACE_TIMEOUT ? " timeout" : "",
+               e->flags & PA_IO_TRACE_POLLED ? " polled" : "",
+               e->flags & PA_IO_TRACE_XRUN ? " XRUN" : "");
+    }
+
+    complete_action();
+}
+
+static void get_metric_info_callback(pa_context *c, const pa_metric_info *i, int is_last, void *userdata) {
+    if (is_last < 0) {
+        pa_log(_("Failed to get metrics: %s"), pa_strerror(pa_context_errno(c)));
+        quit(1);
+        return;
+    }
+
+    if (is_last) {
+        complete_action();
+        return;
+    }
+
+    pa_assert(i);
+
+    printf("%s\t%s=%s\t%llu\n", i->name, i->label_name, i->label_value, (unsigned long long) i->value);
+}
+
 static void get_server_info_callback(pa_context *c, const pa_server_info *i, void *useerdata) {
     char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX];
 
@@ -223,6 +300,9 @@ static void get_server_info_callback(pa_context *c, const pa_server_info *i, voi
            i->cookie >> 16,
            i->cookie & 0xFFFFU);
 
+    if (i->cpu_kernels)
+        printf(_("CPU Kernels: %s\n"), i->cpu_kernels);
+
     complete_action();
 }
 
@@ -339,6 +419,11 @@ static void get_sink_info_callback(pa_context *c, const pa_sink_info *i, int is_
         for (j = 0; j < i->n_formats; j++)
             printf("\t\t%s\n", pa_format_info_snprint(f, sizeof(f), i->formats[j]));
     }
+
+    if (pa_context_get_server_protocol_version(c) >= 40)
+        printf(_("\tRender Load: %0.1f%%%s\n"),
+               (double) i->render_load / 10.0,
+               i->overloaded ? _(", overloaded") : "");
 }
 
 static void get_source_info_callback(pa_context *c, const pa_source_info *i, int is_last, void *userdata) {
@@ -681,6 +766,37 @@ static void get_sink_input_info_callback(pa_context *c, const pa_sink_input_info
            i->resample_method ? i->resample_method : _("n/a"),
            pl = pa_proplist_to_string_sep(i->proplist, "\n\t\t"));
 
+    if (i->n_resampler_phases > 0) {
+        uint32_t j, b;
+
+        printf(_("\tResampler Timing: %llu runs\n"), (unsigned long long) i->resampler_runs);
+
+        for (j = 0; j < i->n_resampler_phases; j++) {
+            const pa_sink_input_resampler_phase *p = &i->resampler_phases[j];
+
+            printf(_("\t\t%s: %0.0f usec"), p->name, (double) p->usec);
+
+            for (b = 0; b < p->n_buckets; b++) {
+                if (b + 1 < p->n_buckets)
+                    printf(", <%u usec: %u", 1U << b, p->histogram[b]);
+                else
+                    printf(", >=%u usec: %u", b > 0 ? 1U << (b - 1) : 0, p->histogram[b]);
+            }
+
+            printf("\n");
+        }
+    }
+
+    if (pa_context_get_server_protocol_version(c) >= 39)
+        printf(_("\tUnderruns: %u\n"
+                 "\tSilence Played: %u frames\n"
+                 "\tRewinds: %u\n"
+                 "\tRender Time: %u usec\n"),
+               i->underruns,
+               i->silence_frames,
+               i->rewinds,
+               i->render_usec);
+
     pa_xfree(pl);
 }
 
@@ -834,22 +950,22 @@ static void index_callback(pa_context *c, uint32_t idx, void *userdata) {
     complete_action();
 }
 
-static void volume_relative_adjust(pa_cvolume *cv) {
-    pa_assert(volume_flags & VOL_RELATIVE);
+static void volume_relative_adjust(pa_cvolume *cv, const struct volume_change *v) {
+    pa_assert(v->flags & VOL_RELATIVE);
 
     /* Relative volume change is additive in case of UINT or PERCENT
      * and multiplicative for LINEAR or DECIBEL */
-    if ((volume_flags & 0x0F) == VOL_UINT || (volume_flags & 0x0F) == VOL_PERCENT) {
+    if ((v->flags & 0x0F) == VOL_UINT || (v->flags & 0x0F) == VOL_PERCENT) {
         unsigned i;
         for (i = 0; i < cv->channels; i++) {
-            if (cv->values[i] + volume.values[i] < PA_VOLUME_NORM)
+            if (cv->values[i] + v->volume.values[i] < PA_VOLUME_NORM)
                 cv->values[i] = PA_VOLUME_MUTED;
             else
-                cv->values[i] = cv->values[i] + volume.values[i] - PA_VOLUME_NORM;
+                cv->values[i] = cv->values[i] + v->volume.values[i] - PA_VOLUME_NORM;
         }
     }
-    if ((volume_flags & 0x0F) == VOL_LINEAR || (volume_flags & 0x0F) == VOL_DECIBEL)
-        pa_sw_cvolume_multiply(cv, cv, &volume);
+    if ((v->flags & 0x0F) == VOL_LINEAR || (v->flags & 0x0F) == VOL_DECIBEL)
+        pa_sw_cvolume_multiply(cv, cv, &v->volume);
 }
 
 static void unload_module_by_name_callback(pa_context *c, const pa_module_info *i, int is_last, void *userdata) {
@@ -864,6 +980,7 @@ static void unload_module_by_name_callback(pa_context *c, const pa_module_info *
     if (is_last) {
         if (unloaded == false)
             pa_log(_("Failed to unload module: Module %s not loaded"), module_name);
+        unloaded = false;
         complete_action();
         return;
     }
@@ -877,100 +994,122 @@ static void unload_module_by_name_callback(pa_context *c, const pa_module_info *
     }
 }
 
-static void fill_volume(pa_cvolume *cv, unsigned supported) {
-    if (volume.channels == 1) {
-        pa_cvolume_set(&volume, supported, volume.values[0]);
-    } else if (volume.channels != supported) {
+static struct volume_change *volume_change_new(void) {
+    struct volume_change *v;
+
+    v = pa_xnew(struct volume_change, 1);
+    v->volume = volume;
+    v->flags = volume_flags;
+
+    return v;
+}
+
+static void fill_volume(pa_cvolume *cv, unsigned supported, struct volume_change *v) {
+    if (v->volume.channels == 1) {
+        pa_cvolume_set(&v->volume, supported, v->volume.values[0]);
+    } else if (v->volume.channels != supported) {
         pa_log(_("Failed to set volume: You tried to set volumes for %d channels, whereas channel/s supported = %d\n"),
-            volume.channels, supported);
+            v->volume.channels, supported);
         quit(1);
         return;
     }
 
-    if (volume_flags & VOL_RELATIVE)
-        volume_relative_adjust(cv);
+    if (v->flags & VOL_RELATIVE)
+        volume_relative_adjust(cv, v);
     else
-        *cv = volume;
+        *cv = v->volume;
 }
 
 static void get_sink_volume_callback(pa_context *c, const pa_sink_info *i, int is_last, void *userdata) {
     pa_cvolume cv;
 
     if (is_last < 0) {
+        pa_xfree(userdata);
         pa_log(_("Failed to get sink information: %s"), pa_strerror(pa_context_errno(c)));
         quit(1);
         return;
     }
 
-    if (is_last)
+    if (is_last) {
+        pa_xfree(userdata);
         return;
+    }
 
     pa_assert(i);
 
     cv = i->volume;
-    fill_volume(&cv, i->channel_map.channels);
+    fill_volume(&cv, i->channel_map.channels, userdata);
 
-    pa_operation_unref(pa_context_set_sink_volume_by_name(c, sink_name, &cv, simple_callback, NULL));
+    pa_operation_unref(pa_context_set_sink_volume_by_index(c, i->index, &cv, simple_callback, NULL));
 }
 
 static void get_source_volume_callback(pa_context *c, const pa_source_info *i, int is_last, void *userdata) {
     pa_cvolume cv;
 
     if (is_last < 0) {
+        pa_xfree(userdata);
         pa_log(_("Failed to get source information: %s"), pa_strerror(pa_context_errno(c)));
         quit(1);
         return;
     }
 
-    if (is_last)
+    if (is_last) {
+        pa_xfree(userdata);
         return;
+    }
 
     pa_assert(i);
 
     cv = i->volume;
-    fill_volume(&cv, i->channel_map.channels);
+    fill_volume(&cv, i->channel_map.channels, userdata);
 
-    pa_operation_unref(pa_context_set_source_volume_by_name(c, source_name, &cv, simple_callback, NULL));
+    pa_operation_unref(pa_context_set_source_volume_by_index(c, i->index, &cv, simple_callback, NULL));
 }
 
 static void get_sink_input_volume_callback(pa_context *c, const pa_sink_input_info *i, int is_last, void *userdata) {
     pa_cvolume cv;
 
     if (is_last < 0) {
+        pa_xfree(userdata);
         pa_log(_("Failed to get sink input information: %s"), pa_strerror(pa_context_errno(c)));
         quit(1);
         return;
     }
 
-    if (is_last)
+    if (is_last) {
+        pa_xfree(userdata);
         return;
+    }
 
     pa_assert(i);
 
     cv = i->volume;
-    fill_volume(&cv, i->channel_map.channels);
+    fill_volume(&cv, i->channel_map.channels, userdata);
 
-    pa_operation_unref(pa_context_set_sink_input_volume(c, sink_input_idx, &cv, simple_callback, NULL));
+    pa_operation_unref(pa_context_set_sink_input_volume(c, i->index, &cv, simple_callback, NULL));
 }
 
 static void get_source_output_volume_callback(pa_context *c, const pa_source_output_info *o, int is_last, void *userdata) {
     pa_cvolume cv;
 
     if (is_last < 0) {
+        pa_xfree(userdata);
         pa_log(_("Failed to get source output information: %s"), pa_strerror(pa_context_errno(c)));
         quit(1);
         return;
     }
 
-    if (is_last)
+    if (is_last) {
+        pa_xfree(userdata);
         return;
+    }
 
     pa_assert(o);
 
     cv = o->volume;
-    fill_volume(&cv, o->channel_map.channels);
+    fill_volume(&cv, o->channel_map.channels, userdata);
 
-    pa_operation_unref(pa_context_set_source_output_volume(c, source_output_idx, &cv, simple_callback, NULL));
+    pa_operation_unref(pa_context_set_source_output_volume(c, o->index, &cv, simple_callback, NULL));
 }
 
 static void sink_toggle_mute_callback(pa_context *c, const pa_sink_info *i, int is_last, void *userdata) {
@@ -1085,7 +1224,7 @@ static void stream_state_callback(pa_stream *s, void *userdata) {
             break;
 
         case PA_STREAM_TERMINATED:
-            drain();
+            complete_action();
             break;
 
         case PA_STREAM_FAILED:
@@ -1184,9 +1323,259 @@ static void context_subscribe_callback(pa_context *c, pa_subscription_event_type
     fflush(stdout);
 }
 
-static void context_state_callback(pa_context *c, void *userdata) {
+static void run_command(pa_context *c) {
     pa_operation *o = NULL;
+    struct volume_change *v = NULL;
+
+    switch (action) {
+        case STAT:
+            o = pa_context_stat(c, stat_callback, NULL);
+            break;
+
+        case INFO:
+            o = pa_context_get_server_info(c, get_server_info_callback, NULL);
+            break;
+
+        case PLAY_SAMPLE:
+            o = pa_context_play_sample(c, sample_name, sink_name, PA_VOLUME_NORM, simple_callback, NULL);
+            break;
+
+        case REMOVE_SAMPLE:
+            o = pa_context_remove_sample(c, sample_name, simple_callback, NULL);
+            break;
+
+        case UPLOAD_SAMPLE:
+            sample_stream = pa_stream_new(c, sample_name, &sample_spec, NULL);
+            pa_assert(sample_stream);
+
+            pa_stream_set_state_callback(sample_stream, stream_state_callback, NULL);
+            pa_stream_set_write_callback(sample_stream, stream_write_callback, NULL);
+            pa_stream_connect_upload(sample_stream, sample_length);
+            actions++;
+            break;
+
+        case EXIT:
+            o = pa_context_exit_daemon(c, simple_callback, NULL);
+            break;
+
+        case LIST:
+            if (list_type) {
+                if (pa_streq(list_type, "modules"))
+                    o = pa_context_get_module_info_list(c, get_module_info_callback, NULL);
+                else if (pa_streq(list_type, "sinks"))
+                    o = pa_context_get_sink_info_list(c, get_sink_info_callback, NULL);
+                else if (pa_streq(list_type, "sources"))
+                    o = pa_context_get_source_info_list(c, get_source_info_callback, NULL);
+                else if (pa_streq(list_type, "sink-inputs"))
+                    o = pa_context_get_sink_input_info_list(c, get_sink_input_info_callback, NULL);
+                else if (pa_streq(list_type, "source-outputs"))
+                    o = pa_context_get_source_output_info_list(c, get_source_output_info_callback, NULL);
+                else if (pa_streq(list_type, "clients"))
+                    o = pa_context_get_client_info_list(c, get_client_info_callback, NULL);
+                else if (pa_streq(list_type, "samples"))
+                    o = pa_context_get_sample_info_list(c, get_sample_info_callback, NULL);
+                else if (pa_streq(list_type, "cards"))
+                    o = pa_context_get_card_info_list(c, get_card_info_callback, NULL);
+                else
+                    pa_assert_not_reached();
+            } else {
+                o = pa_context_get_module_info_list(c, get_module_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+
+                o = pa_context_get_sink_info_list(c, get_sink_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+
+                o = pa_context_get_source_info_list(c, get_source_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+                o = pa_context_get_sink_input_info_list(c, get_sink_input_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+
+                o = pa_context_get_source_output_info_list(c, get_source_output_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+
+                o = pa_context_get_client_info_list(c, get_client_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+
+                o = pa_context_get_sample_info_list(c, get_sample_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+
+                o = pa_context_get_card_info_list(c, get_card_info_callback, NULL);
+                if (o) {
+                    pa_operation_unref(o);
+                    actions++;
+                }
+
+                o = NULL;
+            }
+            break;
+
+        case MOVE_SINK_INPUT:
+            o = pa_context_move_sink_input_by_name(c, sink_input_idx, sink_name, simple_callback, NULL);
+            break;
+
+        case MOVE_SOURCE_OUTPUT:
+            o = pa_context_move_source_output_by_name(c, source_output_idx, source_name, simple_callback, NULL);
+            break;
+
+        case LOAD_MODULE:
+            o = pa_context_load_module(c, module_name, module_args, index_callback, NULL);
+            break;
+
+        case UNLOAD_MODULE:
+            if (module_name)
+                o = pa_context_get_module_info_list(c, unload_module_by_name_callback, NULL);
+            else
+                o = pa_context_unload_module(c, module_index, simple_callback, NULL);
+            break;
+
+        case SUSPEND_SINK:
+            if (sink_name)
+                o = pa_context_suspend_sink_by_name(c, sink_name, suspend, simple_callback, NULL);
+            else
+                o = pa_context_suspend_sink_by_index(c, PA_INVALID_INDEX, suspend, simple_callback, NULL);
+            break;
+
+        case SUSPEND_SOURCE:
+            if (source_name)
+                o = pa_context_suspend_source_by_name(c, source_name, suspend, simple_callback, NULL);
+            else
+                o = pa_context_suspend_source_by_index(c, PA_INVALID_INDEX, suspend, simple_callback, NULL);
+            break;
+
+        case SET_CARD_PROFILE:
+            o = pa_context_set_card_profile_by_name(c, card_name, profile_name, simple_callback, NULL);
+            break;
+
+        case SET_SINK_PORT:
+            o = pa_context_set_sink_port_by_name(c, sink_name, port_name, simple_callback, NULL);
+            break;
+
+        case SET_DEFAULT_SINK:
+            o = pa_context_set_default_sink(c, sink_name, simple_callback, NULL);
+            break;
+
+        case SET_SOURCE_PORT:
+            o = pa_context_set_source_port_by_name(c, source_name, port_name, simple_callback, NULL);
+            break;
+
+        case SET_DEFAULT_SOURCE:
+            o = pa_context_set_default_source(c, source_name, simple_callback, NULL);
+            break;
+
+        case SET_SINK_MUTE:
+            if (mute == TOGGLE_MUTE)
+                o = pa_context_get_sink_info_by_name(c, sink_name, sink_toggle_mute_callback, NULL);
+            else
+                o = pa_context_set_sink_mute_by_name(c, sink_name, mute, simple_callback, NULL);
+            break;
+
+        case SET_SOURCE_MUTE:
+            if (mute == TOGGLE_MUTE)
+                o = pa_context_get_source_info_by_name(c, source_name, source_toggle_mute_callback, NULL);
+            else
+                o = pa_context_set_source_mute_by_name(c, source_name, mute, simple_callback, NULL);
+            break;
+
+        case SET_SINK_INPUT_MUTE:
+            if (mute == TOGGLE_MUTE)
+                o = pa_context_get_sink_input_info(c, sink_input_idx, sink_input_toggle_mute_callback, NULL);
+            else
+                o = pa_context_set_sink_input_mute(c, sink_input_idx, mute, simple_callback, NULL);
+            break;
+
+        case SET_SOURCE_OUTPUT_MUTE:
+            if (mute == TOGGLE_MUTE)
+                o = pa_context_get_source_output_info(c, source_output_idx, source_output_toggle_mute_callback, NULL);
+            else
+                o = pa_context_set_source_output_mute(c, source_output_idx, mute, simple_callback, NULL);
+            break;
+
+        case SET_SINK_VOLUME:
+            o = pa_context_get_sink_info_by_name(c, sink_name, get_sink_volume_callback, v = volume_change_new());
+            break;
+
+        case SET_SOURCE_VOLUME:
+            o = pa_context_get_source_info_by_name(c, source_name, get_source_volume_callback, v = volume_change_new());
+            break;
+
+        case SET_SINK_INPUT_VOLUME:
+            o = pa_context_get_sink_input_info(c, sink_input_idx, get_sink_input_volume_callback, v = volume_change_new());
+            break;
+
+        case SET_SOURCE_OUTPUT_VOLUME:
+            o = pa_context_get_source_output_info(c, source_output_idx, get_source_output_volume_callback, v = volume_change_new());
+            break;
+
+        case SET_SINK_FORMATS:
+            set_sink_formats(c, sink_idx, formats);
+            break;
+
+        case SET_PORT_LATENCY_OFFSET:
+            o = pa_context_set_port_latency_offset(c, card_name, port_name, latency_offset, simple_callback, NULL);
+            break;
+
+        case GET_SINK_IO_TRACE:
+            o = pa_context_get_sink_io_trace(c, sink_name, get_io_trace_callback, NULL);
+            break;
+
+        case GET_SOURCE_IO_TRACE:
+            o = pa_context_get_source_io_trace(c, source_name, get_io_trace_callback, NULL);
+            break;
+
+        case GET_METRICS:
+            o = pa_context_get_metric_info_list(c, get_metric_info_callback, NULL);
+            break;
+
+        case SUBSCRIBE:
+            pa_context_set_subscribe_callback(c, context_subscribe_callback, NULL);
+
+            o = pa_context_subscribe(c,
+                                     PA_SUBSCRIPTION_MASK_SINK|
+                                     PA_SUBSCRIPTION_MASK_SOURCE|
+                                     PA_SUBSCRIPTION_MASK_SINK_INPUT|
+                                     PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT|
+                                     PA_SUBSCRIPTION_MASK_MODULE|
+                                     PA_SUBSCRIPTION_MASK_CLIENT|
+                                     PA_SUBSCRIPTION_MASK_SAMPLE_CACHE|
+                                     PA_SUBSCRIPTION_MASK_SERVER|
+                                     PA_SUBSCRIPTION_MASK_CARD,
+                                     NULL,
+                                     NULL);
+            break;
+
+        default:
+            pa_assert_not_reached();
+    }
+
+    if (o) {
+        pa_operation_unref(o);
+        actions++;
+    } else
+        pa_xfree(v);
+}
 
+static void context_state_callback(pa_context *c, void *userdata) {
     pa_assert(c);
 
     switch (pa_context_get_state(c)) {
@@ -1196,239 +1585,12 @@ static void context_state_callback(pa_context *c, void *userdata) {
             break;
 
         case PA_CONTEXT_READY:
-            switch (action) {
-                case STAT:
-                    o = pa_context_stat(c, stat_callback, NULL);
-                    break;
-
-                case INFO:
-                    o = pa_context_get_server_info(c, get_server_info_callback, NULL);
-                    break;
-
-                case PLAY_SAMPLE:
-                    o = pa_context_play_sample(c, sample_name, sink_name, PA_VOLUME_NORM, simple_callback, NULL);
-                    break;
-
-                case REMOVE_SAMPLE:
-                    o = pa_context_remove_sample(c, sample_name, simple_callback, NULL);
-                    break;
-
-                case UPLOAD_SAMPLE:
-                    sample_stream = pa_stream_new(c, sample_name, &sample_spec, NULL);
-                    pa_assert(sample_stream);
-
-                    pa_stream_set_state_callback(sample_stream, stream_state_callback, NULL);
-                    pa_stream_set_write_callback(sample_stream, stream_write_callback, NULL);
-                    pa_stream_connect_upload(sample_stream, sample_length);
-                    actions++;
-                    break;
-
-                case EXIT:
-                    o = pa_context_exit_daemon(c, simple_callback, NULL);
-                    break;
-
-                case LIST:
-                    if (list_type) {
-                        if (pa_streq(list_type, "modules"))
-                            o = pa_context_get_module_info_list(c, get_module_info_callback, NULL);
-                        else if (pa_streq(list_type, "sinks"))
-                            o = pa_context_get_sink_info_list(c, get_sink_info_callback, NULL);
-                        else if (pa_streq(list_type, "sources"))
-                            o = pa_context_get_source_info_list(c, get_source_info_callback, NULL);
-                        else if (pa_streq(list_type, "sink-inputs"))
-                            o = pa_context_get_sink_input_info_list(c, get_sink_input_info_callback, NULL);
-                        else if (pa_streq(list_type, "source-outputs"))
-                            o = pa_context_get_source_output_info_list(c, get_source_output_info_callback, NULL);
-                        else if (pa_streq(list_type, "clients"))
-                            o = pa_context_get_client_info_list(c, get_client_info_callback, NULL);
-                        else if (pa_streq(list_type, "samples"))
-                            o = pa_context_get_sample_info_list(c, get_sample_info_callback, NULL);
-                        else if (pa_streq(list_type, "cards"))
-                            o = pa_context_get_card_info_list(c, get_card_info_callback, NULL);
-                        else
-                            pa_assert_not_reached();
-                    } else {
-                        o = pa_context_get_module_info_list(c, get_module_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-
-                        o = pa_context_get_sink_info_list(c, get_sink_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-
-                        o = pa_context_get_source_info_list(c, get_source_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-                        o = pa_context_get_sink_input_info_list(c, get_sink_input_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-
-                        o = pa_context_get_source_output_info_list(c, get_source_output_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-
-                        o = pa_context_get_client_info_list(c, get_client_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-
-                        o = pa_context_get_sample_info_list(c, get_sample_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-
-                        o = pa_context_get_card_info_list(c, get_card_info_callback, NULL);
-                        if (o) {
-                            pa_operation_unref(o);
-                            actions++;
-                        }
-
-                        o = NULL;
-                    }
-                    break;
-
-                case MOVE_SINK_INPUT:
-                    o = pa_context_move_sink_input_by_name(c, sink_input_idx, sink_name, simple_callback, NULL);
-                    break;
-
-                case MOVE_SOURCE_OUTPUT:
-                    o = pa_context_move_source_output_by_name(c, source_output_idx, source_name, simple_callback, NULL);
-                    break;
-
-                case LOAD_MODULE:
-                    o = pa_context_load_module(c, module_name, module_args, index_callback, NULL);
-                    break;
-
-                case UNLOAD_MODULE:
-                    if (module_name)
-                        o = pa_context_get_module_info_list(c, unload_module_by_name_callback, NULL);
-                    else
-                        o = pa_context_unload_module(c, module_index, simple_callback, NULL);
-                    break;
-
-                case SUSPEND_SINK:
-                    if (sink_name)
-                        o = pa_context_suspend_sink_by_name(c, sink_name, suspend, simple_callback, NULL);
-                    else
-                        o = pa_context_suspend_sink_by_index(c, PA_INVALID_INDEX, suspend, simple_callback, NULL);
-                    break;
-
-                case SUSPEND_SOURCE:
-                    if (source_name)
-                        o = pa_context_suspend_source_by_name(c, source_name, suspend, simple_callback, NULL);
-                    else
-                        o = pa_context_suspend_source_by_index(c, PA_INVALID_INDEX, suspend, simple_callback, NULL);
-                    break;
-
-                case SET_CARD_PROFILE:
-                    o = pa_context_set_card_profile_by_name(c, card_name, profile_name, simple_callback, NULL);
-                    break;
-
-                case SET_SINK_PORT:
-                    o = pa_context_set_sink_port_by_name(c, sink_name, port_name, simple_callback, NULL);
-                    break;
-
-                case SET_DEFAULT_SINK:
-                    o = pa_context_set_default_sink(c, sink_name, simple_callback, NULL);
-                    break;
-
-                case SET_SOURCE_PORT:
-                    o = pa_context_set_source_port_by_name(c, source_name, port_name, simple_callback, NULL);
-                    break;
-
-                case SET_DEFAULT_SOURCE:
-                    o = pa_context_set_default_source(c, source_name, simple_callback, NULL);
-                    break;
-
-                case SET_SINK_MUTE:
-                    if (mute == TOGGLE_MUTE)
-                        o = pa_context_get_sink_info_by_name(c, sink_name, sink_toggle_mute_callback, NULL);
-                    else
-                        o = pa_context_set_sink_mute_by_name(c, sink_name, mute, simple_callback, NULL);
-                    break;
-
-                case SET_SOURCE_MUTE:
-                    if (mute == TOGGLE_MUTE)
-                        o = pa_context_get_source_info_by_name(c, source_name, source_toggle_mute_callback, NULL);
-                    else
-                        o = pa_context_set_source_mute_by_name(c, source_name, mute, simple_callback, NULL);
-                    break;
-
-                case SET_SINK_INPUT_MUTE:
-                    if (mute == TOGGLE_MUTE)
-                        o = pa_context_get_sink_input_info(c, sink_input_idx, sink_input_toggle_mute_callback, NULL);
-                    else
-                        o = pa_context_set_sink_input_mute(c, sink_input_idx, mute, simple_callback, NULL);
-                    break;
-
-                case SET_SOURCE_OUTPUT_MUTE:
-                    if (mute == TOGGLE_MUTE)
-                        o = pa_context_get_source_output_info(c, source_output_idx, source_output_toggle_mute_callback, NULL);
-                    else
-                        o = pa_context_set_source_output_mute(c, source_output_idx, mute, simple_callback, NULL);
-                    break;
-
-                case SET_SINK_VOLUME:
-                    o = pa_context_get_sink_info_by_name(c, sink_name, get_sink_volume_callback, NULL);
-                    break;
-
-                case SET_SOURCE_VOLUME:
-                    o = pa_context_get_source_info_by_name(c, source_name, get_source_volume_callback, NULL);
-                    break;
-
-                case SET_SINK_INPUT_VOLUME:
-                    o = pa_context_get_sink_input_info(c, sink_input_idx, get_sink_input_volume_callback, NULL);
-                    break;
-
-                case SET_SOURCE_OUTPUT_VOLUME:
-                    o = pa_context_get_source_output_info(c, source_output_idx, get_source_output_volume_callback, NULL);
-                    break;
-
-                case SET_SINK_FORMATS:
-                    set_sink_formats(c, sink_idx, formats);
-                    break;
-
-                case SET_PORT_LATENCY_OFFSET:
-                    o = pa_context_set_port_latency_offset(c, card_name, port_name, latency_offset, simple_callback, NULL);
-                    break;
-
-                case SUBSCRIBE:
-                    pa_context_set_subscribe_callback(c, context_subscribe_callback, NULL);
-
-                    o = pa_context_subscribe(c,
-                                             PA_SUBSCRIPTION_MASK_SINK|
-                                             PA_SUBSCRIPTION_MASK_SOURCE|
-                                             PA_SUBSCRIPTION_MASK_SINK_INPUT|
-                                             PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT|
-                                             PA_SUBSCRIPTION_MASK_MODULE|
-                                             PA_SUBSCRIPTION_MASK_CLIENT|
-                                             PA_SUBSCRIPTION_MASK_SAMPLE_CACHE|
-                                             PA_SUBSCRIPTION_MASK_SERVER|
-                                             PA_SUBSCRIPTION_MASK_CARD,
-                                             NULL,
-                                             NULL);
-                    break;
-
-                default:
-                    pa_assert_not_reached();
+            if (batch_fd >= 0) {
+                batch_run();
+                break;
             }
 
-            if (o) {
-                pa_operation_unref(o);
-                actions++;
-            }
+            run_command(c);
 
             if (actions == 0) {
                 pa_log("Operation failed: %s", pa_strerror(pa_context_errno(c)));
@@ -1438,7 +1600,7 @@ static void context_state_callback(pa_context *c, void *userdata) {
             break;
 
         case PA_CONTEXT_TERMINATED:
-            quit(0);
+            quit(batch_failed ? 1 : 0);
             break;
 
         case PA_CONTEXT_FAILED:
@@ -1558,159 +1720,99 @@ static enum mute_flags parse_mute(const char *mute_text) {
     }
 }
 
-static void help(const char *argv0) {
+static void reset_command(void) {
+    action = NONE;
 
-    printf("%s %s %s\n",    argv0, _("[options]"), "stat");
-    printf("%s %s %s\n",    argv0, _("[options]"), "info");
-    printf("%s %s %s %s\n", argv0, _("[options]"), "list [short]", _("[TYPE]"));
-    printf("%s %s %s\n",    argv0, _("[options]"), "exit");
-    printf("%s %s %s %s\n", argv0, _("[options]"), "upload-sample", _("FILENAME [NAME]"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "play-sample ", _("NAME [SINK]"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "remove-sample ", _("NAME"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "load-module ", _("NAME [ARGS ...]"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "unload-module ", _("NAME|#N"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "move-(sink-input|source-output)", _("#N SINK|SOURCE"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "suspend-(sink|source)", _("NAME|#N 1|0"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-card-profile ", _("CARD PROFILE"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-default-(sink|source)", _("NAME"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink|source)-port", _("NAME|#N PORT"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink|source)-volume", _("NAME|#N VOLUME [VOLUME ...]"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink-input|source-output)-volume", _("#N VOLUME [VOLUME ...]"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink|source)-mute", _("NAME|#N 1|0|toggle"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink-input|source-output)-mute", _("#N 1|0|toggle"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-sink-formats", _("#N FORMATS"));
-    printf("%s %s %s %s\n", argv0, _("[options]"), "set-port-latency-offset", _("CARD-NAME|CARD-#N PORT OFFSET"));
-    printf("%s %s %s\n",    argv0, _("[options]"), "subscribe");
-    printf(_("\nThe special names @DEFAULT_SINK@, @DEFAULT_SOURCE@ and @DEFAULT_MONITOR@\n"
-             "can be used to specify the default sink, source and monitor.\n"));
+    pa_xfree(list_type);
+    list_type = NULL;
+    pa_xfree(sample_name);
+    sample_name = NULL;
+    pa_xfree(sink_name);
+    sink_name = NULL;
+    pa_xfree(source_name);
+    source_name = NULL;
+    pa_xfree(module_name);
+    module_name = NULL;
+    pa_xfree(module_args);
+    module_args = NULL;
+    pa_xfree(card_name);
+    card_name = NULL;
+    pa_xfree(profile_name);
+    profile_name = NULL;
+    pa_xfree(port_name);
+    port_name = NULL;
+    pa_xfree(formats);
+    formats = NULL;
 
-    printf(_("\n"
-             "  -h, --help                            Show this help\n"
-             "      --version                         Show version\n\n"
-             "  -s, --server=SERVER                   The name of the server to connect to\n"
-             "  -n, --client-name=NAME                How to call this client on the server\n"));
+    sink_input_idx = source_output_idx = sink_idx = PA_INVALID_INDEX;
+    short_list_format = false;
+    mute = INVALID_MUTE;
+
+    if (sample_stream) {
+        pa_stream_unref(sample_stream);
+        sample_stream = NULL;
+    }
+
+    if (sndfile) {
+        sf_close(sndfile);
+        sndfile = NULL;
+    }
 }
 
-enum {
-    ARG_VERSION = 256
-};
+/* argv[0] is the command */
+static int parse_command(int argc, char *argv[]) {
+    if (argc > 0) {
+        if (pa_streq(argv[0], "stat")) {
+            action = STAT;
 
-int main(int argc, char *argv[]) {
-    pa_mainloop *m = NULL;
-    int ret = 1, c;
-    char *server = NULL, *bn;
+        } else if (pa_streq(argv[0], "info"))
+            action = INFO;
 
-    static const struct option long_options[] = {
-        {"server",      1, NULL, 's'},
-        {"client-name", 1, NULL, 'n'},
-        {"version",     0, NULL, ARG_VERSION},
-        {"help",        0, NULL, 'h'},
-        {NULL,          0, NULL, 0}
-    };
+        else if (pa_streq(argv[0], "exit"))
+            action = EXIT;
 
-    setlocale(LC_ALL, "");
-#ifdef ENABLE_NLS
-    bindtextdomain(GETTEXT_PACKAGE, PULSE_LOCALEDIR);
-#endif
+        else if (pa_streq(argv[0], "list")) {
+            action = LIST;
 
-    bn = pa_path_get_filename(argv[0]);
+            for (int i = 1; i < argc; i++) {
+                if (pa_streq(argv[i], "modules") || pa_streq(argv[i], "clients") ||
+                    pa_streq(argv[i], "sinks")   || pa_streq(argv[i], "sink-inputs") ||
+                    pa_streq(argv[i], "sources") || pa_streq(argv[i], "source-outputs") ||
+                    pa_streq(argv[i], "samples") || pa_streq(argv[i], "cards")) {
+                    list_type = pa_xstrdup(argv[i]);
+                } else if (pa_streq(argv[i], "short")) {
+                    short_list_format = true;
+                } else {
+                    pa_log(_("Specify nothing, or one of: %s"), "modules, sinks, sources, sink-inputs, source-outputs, clients, samples, cards");
+                    return -1;
+                }
+            }
 
-    proplist = pa_proplist_new();
+        } else if (pa_streq(argv[0], "upload-sample")) {
+            struct SF_INFO sfi;
+            action = UPLOAD_SAMPLE;
 
-    while ((c = getopt_long(argc, argv, "+s:n:h", long_options, NULL)) != -1) {
-        switch (c) {
-            case 'h' :
-                help(bn);
-                ret = 0;
-                goto quit;
-
-            case ARG_VERSION:
-                printf(_("pactl %s\n"
-                         "Compiled with libpulse %s\n"
-                         "Linked with libpulse %s\n"),
-                       PACKAGE_VERSION,
-                       pa_get_headers_version(),
-                       pa_get_library_version());
-                ret = 0;
-                goto quit;
-
-            case 's':
-                pa_xfree(server);
-                server = pa_xstrdup(optarg);
-                break;
-
-            case 'n': {
-                char *t;
-
-                if (!(t = pa_locale_to_utf8(optarg)) ||
-                    pa_proplist_sets(proplist, PA_PROP_APPLICATION_NAME, t) < 0) {
-
-                    pa_log(_("Invalid client name '%s'"), t ? t : optarg);
-                    pa_xfree(t);
-                    goto quit;
-                }
-
-                pa_xfree(t);
-                break;
-            }
-
-            default:
-                goto quit;
-        }
-    }
-
-    if (optind < argc) {
-        if (pa_streq(argv[optind], "stat")) {
-            action = STAT;
-
-        } else if (pa_streq(argv[optind], "info"))
-            action = INFO;
-
-        else if (pa_streq(argv[optind], "exit"))
-            action = EXIT;
-
-        else if (pa_streq(argv[optind], "list")) {
-            action = LIST;
-
-            for (int i = optind+1; i < argc; i++) {
-                if (pa_streq(argv[i], "modules") || pa_streq(argv[i], "clients") ||
-                    pa_streq(argv[i], "sinks")   || pa_streq(argv[i], "sink-inputs") ||
-                    pa_streq(argv[i], "sources") || pa_streq(argv[i], "source-outputs") ||
-                    pa_streq(argv[i], "samples") || pa_streq(argv[i], "cards")) {
-                    list_type = pa_xstrdup(argv[i]);
-                } else if (pa_streq(argv[i], "short")) {
-                    short_list_format = true;
-                } else {
-                    pa_log(_("Specify nothing, or one of: %s"), "modules, sinks, sources, sink-inputs, source-outputs, clients, samples, cards");
-                    goto quit;
-                }
-            }
-
-        } else if (pa_streq(argv[optind], "upload-sample")) {
-            struct SF_INFO sfi;
-            action = UPLOAD_SAMPLE;
-
-            if (optind+1 >= argc) {
+            if (argc < 2) {
                 pa_log(_("Please specify a sample file to load"));
-                goto quit;
+                return -1;
             }
 
-            if (optind+2 < argc)
-                sample_name = pa_xstrdup(argv[optind+2]);
+            if (argc > 2)
+                sample_name = pa_xstrdup(argv[2]);
             else {
-                char *f = pa_path_get_filename(argv[optind+1]);
+                char *f = pa_path_get_filename(argv[1]);
                 sample_name = pa_xstrndup(f, strcspn(f, "."));
             }
 
             pa_zero(sfi);
-            if (!(sndfile = sf_open(argv[optind+1], SFM_READ, &sfi))) {
+            if (!(sndfile = sf_open(argv[1], SFM_READ, &sfi))) {
                 pa_log(_("Failed to open sound file."));
-                goto quit;
+                return -1;
             }
 
             if (pa_sndfile_read_sample_spec(sndfile, &sample_spec) < 0) {
                 pa_log(_("Failed to determine sample specification from file."));
-                goto quit;
+                return -1;
             }
             sample_spec.format = PA_SAMPLE_FLOAT32;
 
@@ -1723,341 +1825,630 @@ int main(int argc, char *argv[]) {
             pa_assert(pa_channel_map_compatible(&channel_map, &sample_spec));
             sample_length = (size_t) sfi.frames*pa_frame_size(&sample_spec);
 
-        } else if (pa_streq(argv[optind], "play-sample")) {
+        } else if (pa_streq(argv[0], "play-sample")) {
             action = PLAY_SAMPLE;
-            if (argc != optind+2 && argc != optind+3) {
+            if (argc != 2 && argc != 3) {
                 pa_log(_("You have to specify a sample name to play"));
-                goto quit;
+                return -1;
             }
 
-            sample_name = pa_xstrdup(argv[optind+1]);
+            sample_name = pa_xstrdup(argv[1]);
 
-            if (optind+2 < argc)
-                sink_name = pa_xstrdup(argv[optind+2]);
+            if (argc > 2)
+                sink_name = pa_xstrdup(argv[2]);
 
-        } else if (pa_streq(argv[optind], "remove-sample")) {
+        } else if (pa_streq(argv[0], "remove-sample")) {
             action = REMOVE_SAMPLE;
-            if (argc != optind+2) {
+            if (argc != 2) {
                 pa_log(_("You have to specify a sample name to remove"));
-                goto quit;
+                return -1;
             }
 
-            sample_name = pa_xstrdup(argv[optind+1]);
+            sample_name = pa_xstrdup(argv[1]);
 
-        } else if (pa_streq(argv[optind], "move-sink-input")) {
+        } else if (pa_streq(argv[0], "move-sink-input")) {
             action = MOVE_SINK_INPUT;
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a sink input index and a sink"));
-                goto quit;
+                return -1;
             }
 
-            sink_input_idx = (uint32_t) atoi(argv[optind+1]);
-            sink_name = pa_xstrdup(argv[optind+2]);
+            sink_input_idx = (uint32_t) atoi(argv[1]);
+            sink_name = pa_xstrdup(argv[2]);
 
-        } else if (pa_streq(argv[optind], "move-source-output")) {
+        } else if (pa_streq(argv[0], "move-source-output")) {
             action = MOVE_SOURCE_OUTPUT;
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a source output index and a source"));
-                goto quit;
+                return -1;
             }
 
-            source_output_idx = (uint32_t) atoi(argv[optind+1]);
-            source_name = pa_xstrdup(argv[optind+2]);
+            source_output_idx = (uint32_t) atoi(argv[1]);
+            source_name = pa_xstrdup(argv[2]);
 
-        } else if (pa_streq(argv[optind], "load-module")) {
+        } else if (pa_streq(argv[0], "load-module")) {
             int i;
             size_t n = 0;
             char *p;
 
             action = LOAD_MODULE;
 
-            if (argc <= optind+1) {
+            if (argc <= 1) {
                 pa_log(_("You have to specify a module name and arguments."));
-                goto quit;
+                return -1;
             }
 
-            module_name = argv[optind+1];
+            module_name = pa_xstrdup(argv[1]);
 
-            for (i = optind+2; i < argc; i++)
+            for (i = 2; i < argc; i++)
                 n += strlen(argv[i])+1;
 
             if (n > 0) {
                 p = module_args = pa_xmalloc(n);
 
-                for (i = optind+2; i < argc; i++)
+                for (i = 2; i < argc; i++)
                     p += sprintf(p, "%s%s", p == module_args ? "" : " ", argv[i]);
             }
 
-        } else if (pa_streq(argv[optind], "unload-module")) {
+        } else if (pa_streq(argv[0], "unload-module")) {
             action = UNLOAD_MODULE;
 
-            if (argc != optind+2) {
+            if (argc != 2) {
                 pa_log(_("You have to specify a module index or name"));
-                goto quit;
+                return -1;
             }
 
-            if (pa_atou(argv[optind + 1], &module_index) < 0)
-                module_name = argv[optind + 1];
+            if (pa_atou(argv[1], &module_index) < 0)
+                module_name = pa_xstrdup(argv[1]);
 
-        } else if (pa_streq(argv[optind], "suspend-sink")) {
+        } else if (pa_streq(argv[0], "suspend-sink")) {
             int b;
 
             action = SUSPEND_SINK;
 
-            if (argc > optind+3 || optind+1 >= argc) {
+            if (argc > 3 || argc < 2) {
                 pa_log(_("You may not specify more than one sink. You have to specify a boolean value."));
-                goto quit;
+                return -1;
             }
 
             if ((b = pa_parse_boolean(argv[argc-1])) < 0) {
                 pa_log(_("Invalid suspend specification."));
-                goto quit;
+                return -1;
             }
 
             suspend = !!b;
 
-            if (argc > optind+2)
-                sink_name = pa_xstrdup(argv[optind+1]);
+            if (argc > 2)
+                sink_name = pa_xstrdup(argv[1]);
 
-        } else if (pa_streq(argv[optind], "suspend-source")) {
+        } else if (pa_streq(argv[0], "suspend-source")) {
             int b;
 
             action = SUSPEND_SOURCE;
 
-            if (argc > optind+3 || optind+1 >= argc) {
+            if (argc > 3 || argc < 2) {
                 pa_log(_("You may not specify more than one source. You have to specify a boolean value."));
-                goto quit;
+                return -1;
             }
 
             if ((b = pa_parse_boolean(argv[argc-1])) < 0) {
                 pa_log(_("Invalid suspend specification."));
-                goto quit;
+                return -1;
             }
 
             suspend = !!b;
 
-            if (argc > optind+2)
-                source_name = pa_xstrdup(argv[optind+1]);
-        } else if (pa_streq(argv[optind], "set-card-profile")) {
+            if (argc > 2)
+                source_name = pa_xstrdup(argv[1]);
+        } else if (pa_streq(argv[0], "set-card-profile")) {
             action = SET_CARD_PROFILE;
 
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a card name/index and a profile name"));
-                goto quit;
+                return -1;
             }
 
-            card_name = pa_xstrdup(argv[optind+1]);
-            profile_name = pa_xstrdup(argv[optind+2]);
+            card_name = pa_xstrdup(argv[1]);
+            profile_name = pa_xstrdup(argv[2]);
 
-        } else if (pa_streq(argv[optind], "set-sink-port")) {
+        } else if (pa_streq(argv[0], "set-sink-port")) {
             action = SET_SINK_PORT;
 
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a sink name/index and a port name"));
-                goto quit;
+                return -1;
             }
 
-            sink_name = pa_xstrdup(argv[optind+1]);
-            port_name = pa_xstrdup(argv[optind+2]);
+            sink_name = pa_xstrdup(argv[1]);
+            port_name = pa_xstrdup(argv[2]);
 
-        } else if (pa_streq(argv[optind], "set-default-sink")) {
+        } else if (pa_streq(argv[0], "set-default-sink")) {
             action = SET_DEFAULT_SINK;
 
-            if (argc != optind+2) {
+            if (argc != 2) {
                 pa_log(_("You have to specify a sink name"));
-                goto quit;
+                return -1;
             }
 
-            sink_name = pa_xstrdup(argv[optind+1]);
+            sink_name = pa_xstrdup(argv[1]);
 
-        } else if (pa_streq(argv[optind], "set-source-port")) {
+        } else if (pa_streq(argv[0], "set-source-port")) {
             action = SET_SOURCE_PORT;
 
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a source name/index and a port name"));
-                goto quit;
+                return -1;
             }
 
-            source_name = pa_xstrdup(argv[optind+1]);
-            port_name = pa_xstrdup(argv[optind+2]);
+            source_name = pa_xstrdup(argv[1]);
+            port_name = pa_xstrdup(argv[2]);
 
-        } else if (pa_streq(argv[optind], "set-default-source")) {
+        } else if (pa_streq(argv[0], "set-default-source")) {
             action = SET_DEFAULT_SOURCE;
 
-            if (argc != optind+2) {
+            if (argc != 2) {
                 pa_log(_("You have to specify a source name"));
-                goto quit;
+                return -1;
             }
 
-            source_name = pa_xstrdup(argv[optind+1]);
+            source_name = pa_xstrdup(argv[1]);
 
-        } else if (pa_streq(argv[optind], "set-sink-volume")) {
+        } else if (pa_streq(argv[0], "set-sink-volume")) {
             action = SET_SINK_VOLUME;
 
-            if (argc < optind+3) {
+            if (argc < 3) {
                 pa_log(_("You have to specify a sink name/index and a volume"));
-                goto quit;
+                return -1;
             }
 
-            sink_name = pa_xstrdup(argv[optind+1]);
+            sink_name = pa_xstrdup(argv[1]);
 
-            if (parse_volumes(argv+optind+2, argc-(optind+2)) < 0)
-                goto quit;
+            if (parse_volumes(argv+2, argc-2) < 0)
+                return -1;
 
-        } else if (pa_streq(argv[optind], "set-source-volume")) {
+        } else if (pa_streq(argv[0], "set-source-volume")) {
             action = SET_SOURCE_VOLUME;
 
-            if (argc < optind+3) {
+            if (argc < 3) {
                 pa_log(_("You have to specify a source name/index and a volume"));
-                goto quit;
+                return -1;
             }
 
-            source_name = pa_xstrdup(argv[optind+1]);
+            source_name = pa_xstrdup(argv[1]);
 
-            if (parse_volumes(argv+optind+2, argc-(optind+2)) < 0)
-                goto quit;
+            if (parse_volumes(argv+2, argc-2) < 0)
+                return -1;
 
-        } else if (pa_streq(argv[optind], "set-sink-input-volume")) {
+        } else if (pa_streq(argv[0], "set-sink-input-volume")) {
             action = SET_SINK_INPUT_VOLUME;
 
-            if (argc < optind+3) {
+            if (argc < 3) {
                 pa_log(_("You have to specify a sink input index and a volume"));
-                goto quit;
+                return -1;
             }
 
-            if (pa_atou(argv[optind+1], &sink_input_idx) < 0) {
+            if (pa_atou(argv[1], &sink_input_idx) < 0) {
                 pa_log(_("Invalid sink input index"));
-                goto quit;
+                return -1;
             }
 
-            if (parse_volumes(argv+optind+2, argc-(optind+2)) < 0)
-                goto quit;
+            if (parse_volumes(argv+2, argc-2) < 0)
+                return -1;
 
-        } else if (pa_streq(argv[optind], "set-source-output-volume")) {
+        } else if (pa_streq(argv[0], "set-source-output-volume")) {
             action = SET_SOURCE_OUTPUT_VOLUME;
 
-            if (argc < optind+3) {
+            if (argc < 3) {
                 pa_log(_("You have to specify a source output index and a volume"));
-                goto quit;
+                return -1;
             }
 
-            if (pa_atou(argv[optind+1], &source_output_idx) < 0) {
+            if (pa_atou(argv[1], &source_output_idx) < 0) {
                 pa_log(_("Invalid source output index"));
-                goto quit;
+                return -1;
             }
 
-            if (parse_volumes(argv+optind+2, argc-(optind+2)) < 0)
-                goto quit;
+            if (parse_volumes(argv+2, argc-2) < 0)
+                return -1;
 
-        } else if (pa_streq(argv[optind], "set-sink-mute")) {
+        } else if (pa_streq(argv[0], "set-sink-mute")) {
             action = SET_SINK_MUTE;
 
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a sink name/index and a mute boolean"));
-                goto quit;
+                return -1;
             }
 
-            if ((mute = parse_mute(argv[optind+2])) == INVALID_MUTE) {
+            if ((mute = parse_mute(argv[2])) == INVALID_MUTE) {
                 pa_log(_("Invalid mute specification"));
-                goto quit;
+                return -1;
             }
 
-            sink_name = pa_xstrdup(argv[optind+1]);
+            sink_name = pa_xstrdup(argv[1]);
 
-        } else if (pa_streq(argv[optind], "set-source-mute")) {
+        } else if (pa_streq(argv[0], "set-source-mute")) {
             action = SET_SOURCE_MUTE;
 
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a source name/index and a mute boolean"));
-                goto quit;
+                return -1;
             }
 
-            if ((mute = parse_mute(argv[optind+2])) == INVALID_MUTE) {
+            if ((mute = parse_mute(argv[2])) == INVALID_MUTE) {
                 pa_log(_("Invalid mute specification"));
-                goto quit;
+                return -1;
             }
 
-            source_name = pa_xstrdup(argv[optind+1]);
+            source_name = pa_xstrdup(argv[1]);
 
-        } else if (pa_streq(argv[optind], "set-sink-input-mute")) {
+        } else if (pa_streq(argv[0], "set-sink-input-mute")) {
             action = SET_SINK_INPUT_MUTE;
 
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a sink input index and a mute boolean"));
-                goto quit;
+                return -1;
             }
 
-            if (pa_atou(argv[optind+1], &sink_input_idx) < 0) {
+            if (pa_atou(argv[1], &sink_input_idx) < 0) {
                 pa_log(_("Invalid sink input index specification"));
-                goto quit;
+                return -1;
             }
 
-            if ((mute = parse_mute(argv[optind+2])) == INVALID_MUTE) {
+            if ((mute = parse_mute(argv[2])) == INVALID_MUTE) {
                 pa_log(_("Invalid mute specification"));
-                goto quit;
+                return -1;
             }
 
-        } else if (pa_streq(argv[optind], "set-source-output-mute")) {
+        } else if (pa_streq(argv[0], "set-source-output-mute")) {
             action = SET_SOURCE_OUTPUT_MUTE;
 
-            if (argc != optind+3) {
+            if (argc != 3) {
                 pa_log(_("You have to specify a source output index and a mute boolean"));
-                goto quit;
+                return -1;
             }
 
-            if (pa_atou(argv[optind+1], &source_output_idx) < 0) {
+            if (pa_atou(argv[1], &source_output_idx) < 0) {
                 pa_log(_("Invalid source output index specification"));
-                goto quit;
+                return -1;
             }
 
-            if ((mute = parse_mute(argv[optind+2])) == INVALID_MUTE) {
+            if ((mute = parse_mute(argv[2])) == INVALID_MUTE) {
                 pa_log(_("Invalid mute specification"));
-                goto quit;
+                return -1;
             }
 
-        } else if (pa_streq(argv[optind], "subscribe"))
+        } else if (pa_streq(argv[0], "subscribe"))
 
             action = SUBSCRIBE;
 
-        else if (pa_streq(argv[optind], "set-sink-formats")) {
+        else if (pa_streq(argv[0], "set-sink-formats")) {
             int32_t tmp;
 
-            if (argc != optind+3 || pa_atoi(argv[optind+1], &tmp) < 0) {
+            if (argc != 3 || pa_atoi(argv[1], &tmp) < 0) {
                 pa_log(_("You have to specify a sink index and a semicolon-separated list of supported formats"));
-                goto quit;
+                return -1;
             }
 
             sink_idx = tmp;
             action = SET_SINK_FORMATS;
-            formats = pa_xstrdup(argv[optind+2]);
+            formats = pa_xstrdup(argv[2]);
 
-        } else if (pa_streq(argv[optind], "set-port-latency-offset")) {
+        } else if (pa_streq(argv[0], "set-port-latency-offset")) {
             action = SET_PORT_LATENCY_OFFSET;
 
-            if (argc != optind+4) {
+            if (argc != 4) {
                 pa_log(_("You have to specify a card name/index, a port name and a latency offset"));
-                goto quit;
+                return -1;
             }
 
-            card_name = pa_xstrdup(argv[optind+1]);
-            port_name = pa_xstrdup(argv[optind+2]);
-            if (pa_atoi(argv[optind + 3], &latency_offset) < 0) {
+            card_name = pa_xstrdup(argv[1]);
+            port_name = pa_xstrdup(argv[2]);
+            if (pa_atoi(argv[3], &latency_offset) < 0) {
                 pa_log(_("Could not parse latency offset"));
-                goto quit;
+                return -1;
             }
 
-        } else if (pa_streq(argv[optind], "help")) {
-            help(bn);
-            ret = 0;
-            goto quit;
+        } else if (pa_streq(argv[0], "get-sink-io-trace")) {
+            action = GET_SINK_IO_TRACE;
+
+            if (argc != 2) {
+                pa_log(_("You have to specify a sink name/index"));
+                return -1;
+            }
+
+            sink_name = pa_xstrdup(argv[1]);
+
+        } else if (pa_streq(argv[0], "get-source-io-trace")) {
+            action = GET_SOURCE_IO_TRACE;
+
+            if (argc != 2) {
+                pa_log(_("You have to specify a source name/index"));
+                return -1;
+            }
+
+            source_name = pa_xstrdup(argv[1]);
+
+        } else if (pa_streq(argv[0], "get-metrics")) {
+            action = GET_METRICS;
+
         }
     }
 
     if (action == NONE) {
         pa_log(_("No valid command specified."));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Whether the callbacks of the current command look at what was parsed for
+ * it, so that the next command of a batch has to wait for them */
+static bool command_needs_state(void) {
+    switch (action) {
+        case LIST:
+        case UPLOAD_SAMPLE:
+            return true;
+
+        case UNLOAD_MODULE:
+            return !!module_name;
+
+        default:
+            return false;
+    }
+}
+
+static int batch_command(const char *line) {
+    char **args;
+    int n, r = -1;
+
+    if (!(args = pa_split_spaces_strv(line)))
+        return 0;
+
+    if (args[0][0] == '#') {
+        pa_xstrfreev(args);
+        return 0;
+    }
+
+    for (n = 1; args[n]; n++)
+        ;
+
+    reset_command();
+
+    if (pa_streq(args[0], "subscribe") || pa_streq(args[0], "batch") || pa_streq(args[0], "help"))
+        pa_log(_("%s can't be used in a batch"), args[0]);
+    else if (parse_command(n, args) >= 0) {
+        n = actions;
+        run_command(context);
+
+        if (actions == n)
+            pa_log("Operation failed: %s", pa_strerror(pa_context_errno(context)));
+        else {
+            batch_wait = command_needs_state();
+            r = 0;
+        }
+    }
+
+    pa_xstrfreev(args);
+    return r;
+}
+
+
+static void batch_read_callback(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata);
+
+/* Not just disabled while waiting, poll() would still report a hangup */
+static void batch_set_reading(bool b) {
+    if (b && !batch_event)
+        pa_assert_se(batch_event = mainloop_api->io_new(mainloop_api, batch_fd, PA_IO_EVENT_INPUT, batch_read_callback, NULL));
+    else if (!b && batch_event) {
+        mainloop_api->io_free(batch_event);
+        batch_event = NULL;
+    }
+}
+
+static void batch_read_callback(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    ssize_t r;
+
+    if ((r = pa_read(fd, batch_buffer + batch_length, sizeof(batch_buffer) - 1 - batch_length, NULL)) < 0) {
+        if (errno == EINTR || errno == EAGAIN)
+            return;
+
+        pa_log(_("read() failed: %s"), pa_cstrerror(errno));
+        quit(1);
+        return;
+    }
+
+    if (r == 0) {
+        batch_eof = true;
+        batch_set_reading(false);
+    }
+
+    batch_length += (size_t) r;
+    batch_run();
+}
+
+static void batch_run(void) {
+    char *eol;
+    size_t n;
+
+    for (;;) {
+        if (batch_wait) {
+            if (actions > 0) {
+                batch_set_reading(false);
+                return;
+            }
+
+            batch_wait = false;
+        }
+
+        if (!(eol = memchr(batch_buffer, '\n', batch_length))) {
+            if (!batch_eof) {
+                if (batch_length >= sizeof(batch_buffer) - 1) {
+                    pa_log(_("Line %u of the batch is too long."), batch_line + 1);
+                    quit(1);
+                    return;
+                }
+
+                batch_set_reading(true);
+                return;
+            }
+
+            if (batch_length == 0) {
+                if (actions == 0)
+                    drain();
+                return;
+            }
+
+            /* The last line doesn't have to end in a newline */
+            eol = batch_buffer + batch_length;
+        }
+
+        *eol = 0;
+        n = PA_MIN((size_t) (eol - batch_buffer) + 1, batch_length);
+        batch_line++;
+
+        if (batch_command(batch_buffer) < 0) {
+            /* What was sent already is still carried out */
+            pa_log(_("Failed to execute line %u of the batch."), batch_line);
+            batch_set_reading(false);
+            batch_failed = batch_eof = true;
+            batch_length = 0;
+            continue;
+        }
+
+        memmove(batch_buffer, batch_buffer + n, batch_length - n);
+        batch_length -= n;
+    }
+}
+
+static void help(const char *argv0) {
+
+    printf("%s %s %s\n",    argv0, _("[options]"), "stat");
+    printf("%s %s %s\n",    argv0, _("[options]"), "info");
+    printf("%s %s %s %s\n", argv0, _("[options]"), "list [short]", _("[TYPE]"));
+    printf("%s %s %s\n",    argv0, _("[options]"), "exit");
+    printf("%s %s %s %s\n", argv0, _("[options]"), "upload-sample", _("FILENAME [NAME]"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "play-sample ", _("NAME [SINK]"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "remove-sample ", _("NAME"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "load-module ", _("NAME [ARGS ...]"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "unload-module ", _("NAME|#N"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "move-(sink-input|source-output)", _("#N SINK|SOURCE"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "suspend-(sink|source)", _("NAME|#N 1|0"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-card-profile ", _("CARD PROFILE"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-default-(sink|source)", _("NAME"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink|source)-port", _("NAME|#N PORT"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink|source)-volume", _("NAME|#N VOLUME [VOLUME ...]"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink-input|source-output)-volume", _("#N VOLUME [VOLUME ...]"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink|source)-mute", _("NAME|#N 1|0|toggle"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink-input|source-output)-mute", _("#N 1|0|toggle"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-sink-formats", _("#N FORMATS"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "set-port-latency-offset", _("CARD-NAME|CARD-#N PORT OFFSET"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "get-(sink|source)-io-trace", _("NAME|#N"));
+    printf("%s %s %s\n",    argv0, _("[options]"), "get-metrics");
+    printf("%s %s %s\n",    argv0, _("[options]"), "subscribe");
+    printf("%s %s %s %s\n", argv0, _("[options]"), "batch", _("[FILENAME]"));
+    printf(_("\nThe special names @DEFAULT_SINK@, @DEFAULT_SOURCE@ and @DEFAULT_MONITOR@\n"
+             "can be used to specify the default sink, source and monitor.\n"));
+    printf(_("batch reads one command per line from FILENAME or the standard input.\n"));
+
+    printf(_("\n"
+             "  -h, --help                            Show this help\n"
+             "      --version                         Show version\n\n"
+             "  -s, --server=SERVER                   The name of the server to connect to\n"
+             "  -n, --client-name=NAME                How to call this client on the server\n"));
+}
+
+enum {
+    ARG_VERSION = 256
+};
+
+int main(int argc, char *argv[]) {
+    pa_mainloop *m = NULL;
+    int ret = 1, c;
+    char *server = NULL, *bn;
+
+    static const struct option long_options[] = {
+        {"server",      1, NULL, 's'},
+        {"client-name", 1, NULL, 'n'},
+        {"version",     0, NULL, ARG_VERSION},
+        {"help",        0, NULL, 'h'},
+        {NULL,          0, NULL, 0}
+    };
+
+    setlocale(LC_ALL, "");
+#ifdef ENABLE_NLS
+    bindtextdomain(GETTEXT_PACKAGE, PULSE_LOCALEDIR);
+#endif
+
+    bn = pa_path_get_filename(argv[0]);
+
+    proplist = pa_proplist_new();
+
+    while ((c = getopt_long(argc, argv, "+s:n:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'h' :
+                help(bn);
+                ret = 0;
+                goto quit;
+
+            case ARG_VERSION:
+                printf(_("pactl %s\n"
+                         "Compiled with libpulse %s\n"
+                         "Linked with libpulse %s\n"),
+                       PACKAGE_VERSION,
+                       pa_get_headers_version(),
+                       pa_get_library_version());
+                ret = 0;
+                goto quit;
+
+            case 's':
+                pa_xfree(server);
+                server = pa_xstrdup(optarg);
+                break;
+
+            case 'n': {
+                char *t;
+
+                if (!(t = pa_locale_to_utf8(optarg)) ||
+                    pa_proplist_sets(proplist, PA_PROP_APPLICATION_NAME, t) < 0) {
+
+                    pa_log(_("Invalid client name '%s'"), t ? t : optarg);
+                    pa_xfree(t);
+                    goto quit;
+                }
+
+                pa_xfree(t);
+                break;
+            }
+
+            default:
+                goto quit;
+        }
+    }
+
+    if (optind < argc && pa_streq(argv[optind], "help")) {
+        help(bn);
+        ret = 0;
         goto quit;
     }
 
+    if (optind < argc && pa_streq(argv[optind], "batch")) {
+        if (argc > optind+2) {
+            pa_log(_("You may not specify more than one batch file."));
+            goto quit;
+        }
+
+        if (optind+1 < argc && !pa_streq(argv[optind+1], "-")) {
+            if ((batch_fd = pa_open_cloexec(argv[optind+1], O_RDONLY, 0)) < 0) {
+                pa_log(_("Failed to open batch file '%s': %s"), argv[optind+1], pa_cstrerror(errno));
+                goto quit;
+            }
+        } else
+            batch_fd = STDIN_FILENO;
+
+    } else if (parse_command(argc-optind, argv+optind) < 0)
+        goto quit;
+
     if (!(m = pa_mainloop_new())) {
         pa_log(_("pa_mainloop_new() failed."));
         goto quit;
@@ -2087,30 +2478,23 @@ int main(int argc, char *argv[]) {
     }
 
 quit:
-    if (sample_stream)
-        pa_stream_unref(sample_stream);
+    reset_command();
 
     if (context)
         pa_context_unref(context);
 
+    if (batch_event)
+        batch_set_reading(false);
+
     if (m) {
         pa_signal_done();
         pa_mainloop_free(m);
     }
 
-    pa_xfree(server);
-    pa_xfree(list_type);
-    pa_xfree(sample_name);
-    pa_xfree(sink_name);
-    pa_xfree(source_name);
-    pa_xfree(module_args);
-    pa_xfree(card_name);
-    pa_xfree(profile_name);
-    pa_xfree(port_name);
-    pa_xfree(formats);
+    if (batch_fd > STDIN_FILENO)
+        pa_close(batch_fd);
 
-    if (sndfile)
-        sf_close(sndfile);
+    pa_xfree(server);
 
     if (proplist)
         pa_proplist_free(proplist);
@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -91,9 +92,14 @@ struct fd_info {
     pa_io_event *io_event;
     pa_io_event_flags_t io_flags;
 
-    void *buf;
     size_t rec_offset;
 
+    /* The buffers of OSS mmap mode, with the bytes the streams moved
+     * through them so far */
+    void *play_mmap, *rec_mmap;
+    size_t play_mmap_size, rec_mmap_size;
+    uint64_t play_mmap_count, rec_mmap_count;
+
     int operation_success;
 
     pa_cvolume sink_volume, source_volume;
@@ -101,6 +107,7 @@ struct fd_info {
     int volume_modify_count;
 
     int optr_n_blocks;
+    int iptr_n_blocks;
 
     PA_LLIST_FIELDS(fd_info);
 };
@@ -133,6 +140,11 @@ static int (*___xstat64)(int, const char *, struct stat64 *) = NULL;
 #endif
 static int (*_fclose)(FILE *f) = NULL;
 static int (*_access)(const char *, int) = NULL;
+static void* (*_mmap)(void *, size_t, int, int, int, off_t) = NULL;
+#ifdef HAVE_OPEN64
+static void* (*_mmap64)(void *, size_t, int, int, int, off64_t) = NULL;
+#endif
+static int (*_munmap)(void *, size_t) = NULL;
 
 /* dlsym() violates ISO C, so confide the breakage into this function to
  * avoid warnings. */
@@ -253,6 +265,30 @@ do { \
     pthread_mutex_unlock(&func_mutex); \
 } while(0)
 
+#define LOAD_MMAP_FUNC() \
+do { \
+    pthread_mutex_lock(&func_mutex); \
+    if (!_mmap) \
+        _mmap = (void* (*)(void *, size_t, int, int, int, off_t)) dlsym_fn(RTLD_NEXT, "mmap"); \
+    pthread_mutex_unlock(&func_mutex); \
+} while(0)
+
+#define LOAD_MMAP64_FUNC() \
+do { \
+    pthread_mutex_lock(&func_mutex); \
+    if (!_mmap64) \
+        _mmap64 = (void* (*)(void *, size_t, int, int, int, off64_t)) dlsym_fn(RTLD_NEXT, "mmap64"); \
+    pthread_mutex_unlock(&func_mutex); \
+} while(0)
+
+#define LOAD_MUNMAP_FUNC() \
+do { \
+    pthread_mutex_lock(&func_mutex); \
+    if (!_munmap) \
+        _munmap = (int (*)(void *, size_t)) dlsym_fn(RTLD_NEXT, "munmap"); \
+    pthread_mutex_unlock(&func_mutex); \
+} while(0)
+
 #define CONTEXT_CHECK_DEAD_GOTO(i, label) do { \
 if (!(i)->context || pa_context_get_state((i)->context) != PA_CONTEXT_READY) { \
     debug(DEBUG_LEVEL_NORMAL, __FILE__": Not connected: %s\n", (i)->context ? pa_strerror(pa_context_errno((i)->context)) : "NULL"); \
@@ -415,7 +451,8 @@ static void fd_info_free(fd_info *i) {
         _close(i->thread_fd);
     }
 
-    free(i->buf);
+    /* The buffers of mmap mode stay mapped until the application unmaps
+     * them, as with a real device */
 
     pthread_mutex_destroy(&i->mutex);
     free(i);
@@ -640,8 +677,10 @@ static fd_info* fd_info_new(fd_info_type_t type, int *_errno) {
     i->io_flags = 0;
     pthread_mutex_init(&i->mutex, NULL);
     i->ref = 1;
-    i->buf = NULL;
     i->rec_offset = 0;
+    i->play_mmap = i->rec_mmap = NULL;
+    i->play_mmap_size = i->rec_mmap_size = 0;
+    i->play_mmap_count = i->rec_mmap_count = 0;
     i->unusable = 0;
     pa_cvolume_reset(&i->sink_volume, 2);
     pa_cvolume_reset(&i->source_volume, 2);
@@ -649,6 +688,7 @@ static fd_info* fd_info_new(fd_info_type_t type, int *_errno) {
     i->sink_index = (uint32_t) -1;
     i->source_index = (uint32_t) -1;
     i->optr_n_blocks = 0;
+    i->iptr_n_blocks = 0;
     PA_LLIST_INIT(fd_info, i);
 
     reset_params(i);
@@ -785,10 +825,94 @@ static void fix_metrics(fd_info *i) {
     debug(DEBUG_LEVEL_NORMAL, __FILE__": fixated metrics to %i fragments, %li bytes each.\n", i->n_fragments, (long)i->fragment_size);
 }
 
+/* In mmap mode the streams go round the buffers the application mapped
+ * like the DMA engine of a sound card, without the socket in between.
+ * Playback takes whole fragments, so that the position moves by blocks,
+ * and waits until the application enabled output. */
+static void mmap_play(fd_info *i) {
+    size_t n;
+
+    if (i->play_precork || pa_stream_get_state(i->play_stream) != PA_STREAM_READY)
+        return;
+
+    if ((n = pa_stream_writable_size(i->play_stream)) == (size_t) -1) {
+        debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_writable_size(): %s\n", pa_strerror(pa_context_errno(i->context)));
+        return;
+    }
+
+    while (n >= i->fragment_size) {
+        size_t offset = (size_t) (i->play_mmap_count % i->play_mmap_size);
+        size_t len = PA_MIN(i->fragment_size, i->play_mmap_size - offset);
+        void *data;
+
+        if (pa_stream_begin_write(i->play_stream, &data, &len) < 0) {
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_begin_write(): %s\n", pa_strerror(pa_context_errno(i->context)));
+            return;
+        }
+
+        memcpy(data, (uint8_t*) i->play_mmap + offset, len);
+
+        if (pa_stream_write(i->play_stream, data, len, NULL, 0LL, PA_SEEK_RELATIVE) < 0) {
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_write(): %s\n", pa_strerror(pa_context_errno(i->context)));
+            return;
+        }
+
+        i->play_mmap_count += len;
+        n -= len;
+    }
+}
+
+static void mmap_record(fd_info *i) {
+    for (;;) {
+        const void *data;
+        size_t len;
+
+        if (pa_stream_peek(i->rec_stream, &data, &len) < 0) {
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_peek(): %s\n", pa_strerror(pa_context_errno(i->context)));
+            return;
+        }
+
+        if (len <= 0)
+            return;
+
+        /* Holes are skipped, like when reading */
+        if (data) {
+            const uint8_t *p = data;
+            size_t left = len;
+
+            while (left > 0) {
+                size_t offset = (size_t) (i->rec_mmap_count % i->rec_mmap_size);
+                size_t l = PA_MIN(left, i->rec_mmap_size - offset);
+
+                memcpy((uint8_t*) i->rec_mmap + offset, p, l);
+
+                i->rec_mmap_count += l;
+                p += l;
+                left -= l;
+            }
+        }
+
+        if (pa_stream_drop(i->rec_stream) < 0) {
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_drop(): %s\n", pa_strerror(pa_context_errno(i->context)));
+            return;
+        }
+    }
+}
+
 static void stream_request_cb(pa_stream *s, size_t length, void *userdata) {
     fd_info *i = userdata;
     assert(s);
 
+    if (s == i->play_stream && i->play_mmap) {
+        mmap_play(i);
+        return;
+    }
+
+    if (s == i->rec_stream && i->rec_mmap) {
+        mmap_record(i);
+        return;
+    }
+
     if (i->io_event) {
         pa_mainloop_api *api;
         size_t n;
@@ -855,7 +979,10 @@ static int fd_info_copy_data(fd_info *i, int force) {
     if (!i->play_stream && !i->rec_stream)
         return -1;
 
-    if ((i->play_stream) && (pa_stream_get_state(i->play_stream) == PA_STREAM_READY)) {
+    /* A mapped direction doesn't go through the socket */
+    if (i->play_mmap)
+        i->io_flags &= ~PA_IO_EVENT_INPUT;
+    else if ((i->play_stream) && (pa_stream_get_state(i->play_stream) == PA_STREAM_READY)) {
         n = pa_stream_writable_size(i->play_stream);
 
         if (n == (size_t)-1) {
@@ -866,30 +993,32 @@ static int fd_info_copy_data(fd_info *i, int force) {
 
         while (n >= i->fragment_size || force) {
             ssize_t r;
+            void *data;
+            size_t len = i->fragment_size;
 
-            if (!i->buf) {
-                if (!(i->buf = malloc(i->fragment_size))) {
-                    debug(DEBUG_LEVEL_NORMAL, __FILE__": malloc() failed.\n");
-                    return -1;
-                }
+            /* Read right into the memory that goes to the server */
+            if (pa_stream_begin_write(i->play_stream, &data, &len) < 0) {
+                debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_begin_write(): %s\n", pa_strerror(pa_context_errno(i->context)));
+                return -1;
             }
 
-            if ((r = read(i->thread_fd, i->buf, i->fragment_size)) <= 0) {
+            if ((r = read(i->thread_fd, data, len)) <= 0) {
+                int _errno = errno;
 
-                if (errno == EAGAIN)
+                pa_stream_cancel_write(i->play_stream);
+
+                if (_errno == EAGAIN)
                     break;
 
-                debug(DEBUG_LEVEL_NORMAL, __FILE__": read(): %s\n", r == 0 ? "EOF" : strerror(errno));
+                debug(DEBUG_LEVEL_NORMAL, __FILE__": read(): %s\n", r == 0 ? "EOF" : strerror(_errno));
                 return -1;
             }
 
-            if (pa_stream_write(i->play_stream, i->buf, (size_t) r, free, 0LL, PA_SEEK_RELATIVE) < 0) {
+            if (pa_stream_write(i->play_stream, data, (size_t) r, NULL, 0LL, PA_SEEK_RELATIVE) < 0) {
                 debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_write(): %s\n", pa_strerror(pa_context_errno(i->context)));
                 return -1;
             }
 
-            i->buf = NULL;
-
             assert(n >= (size_t) r);
             n -= (size_t) r;
         }
@@ -900,7 +1029,9 @@ static int fd_info_copy_data(fd_info *i, int force) {
             i->io_flags &= ~PA_IO_EVENT_INPUT;
     }
 
-    if ((i->rec_stream) && (pa_stream_get_state(i->rec_stream) == PA_STREAM_READY)) {
+    if (i->rec_mmap)
+        i->io_flags &= ~PA_IO_EVENT_OUTPUT;
+    else if ((i->rec_stream) && (pa_stream_get_state(i->rec_stream) == PA_STREAM_READY)) {
         n = pa_stream_readable_size(i->rec_stream);
 
         if (n == (size_t)-1) {
@@ -990,6 +1121,7 @@ static void stream_state_cb(pa_stream *s, void * userdata) {
 
         case PA_STREAM_READY:
             debug(DEBUG_LEVEL_NORMAL, __FILE__": stream established.\n");
+            pa_threaded_mainloop_signal(i->mainloop, 0);
             break;
 
         case PA_STREAM_FAILED:
@@ -1007,6 +1139,7 @@ static void stream_state_cb(pa_stream *s, void * userdata) {
                 i->rec_stream = NULL;
             }
             fd_info_shutdown(i);
+            pa_threaded_mainloop_signal(i->mainloop, 0);
             break;
 
         case PA_STREAM_TERMINATED:
@@ -1963,6 +2096,122 @@ fail:
     return r;
 }
 
+static void free_play_stream(fd_info *i) {
+    if (i->play_stream) {
+        pa_stream_disconnect(i->play_stream);
+        pa_stream_unref(i->play_stream);
+        i->play_stream = NULL;
+    }
+}
+
+static void free_rec_stream(fd_info *i) {
+    if (i->rec_stream) {
+        pa_stream_disconnect(i->rec_stream);
+        pa_stream_unref(i->rec_stream);
+        i->rec_stream = NULL;
+    }
+}
+
+/* Unlike with the streams created on the first read or write, triggering
+ * usually follows right away in mmap mode, so wait until the stream can
+ * be corked */
+static int mmap_stream_wait(fd_info *i, pa_stream **s) {
+    while (*s && pa_stream_get_state(*s) == PA_STREAM_CREATING)
+        pa_threaded_mainloop_wait(i->mainloop);
+
+    return *s && pa_stream_get_state(*s) == PA_STREAM_READY ? 0 : -1;
+}
+
+/* As with OSS, the output buffer is mapped for writing and the input
+ * buffer for reading only. Mapping replaces the stream of the direction
+ * with one that goes round the buffer. */
+static void *dsp_mmap(fd_info *i, size_t length, int prot, off64_t offset, int *_errno) {
+    void *p = MAP_FAILED;
+    int play = !!(prot & PROT_WRITE);
+
+    debug(DEBUG_LEVEL_NORMAL, __FILE__": dsp_mmap(%lu, %s)\n", (unsigned long) length, play ? "output" : "input");
+
+    pa_threaded_mainloop_lock(i->mainloop);
+
+    fix_metrics(i);
+
+    if (offset != 0 || length < i->fragment_size || (play ? i->play_mmap : i->rec_mmap)) {
+        *_errno = EINVAL;
+        goto fail;
+    }
+
+    LOAD_MMAP_FUNC();
+    if ((p = _mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        *_errno = errno;
+        goto fail;
+    }
+
+    if (play) {
+        free_play_stream(i);
+
+        i->play_mmap = p;
+        i->play_mmap_size = length;
+        i->play_mmap_count = 0;
+        i->optr_n_blocks = 0;
+
+        if (create_playback_stream(i) < 0 || mmap_stream_wait(i, &i->play_stream) < 0) {
+            free_play_stream(i);
+            i->play_mmap = NULL;
+            goto fail_unmap;
+        }
+    } else {
+        free_rec_stream(i);
+
+        i->rec_mmap = p;
+        i->rec_mmap_size = length;
+        i->rec_mmap_count = 0;
+        i->iptr_n_blocks = 0;
+
+        if (create_record_stream(i) < 0 || mmap_stream_wait(i, &i->rec_stream) < 0) {
+            free_rec_stream(i);
+            i->rec_mmap = NULL;
+            goto fail_unmap;
+        }
+    }
+
+    pa_threaded_mainloop_unlock(i->mainloop);
+
+    return p;
+
+fail_unmap:
+    LOAD_MUNMAP_FUNC();
+    _munmap(p, length);
+    p = MAP_FAILED;
+    *_errno = EIO;
+
+fail:
+    pa_threaded_mainloop_unlock(i->mainloop);
+
+    return p;
+}
+
+static void dsp_munmap(fd_info *i, void *addr) {
+    debug(DEBUG_LEVEL_NORMAL, __FILE__": dsp_munmap()\n");
+
+    pa_threaded_mainloop_lock(i->mainloop);
+
+    if (addr == i->play_mmap) {
+        free_play_stream(i);
+        i->play_mmap = NULL;
+        i->play_mmap_size = 0;
+        i->play_mmap_count = 0;
+    }
+
+    if (addr == i->rec_mmap) {
+        free_rec_stream(i);
+        i->rec_mmap = NULL;
+        i->rec_mmap_size = 0;
+        i->rec_mmap_count = 0;
+    }
+
+    pa_threaded_mainloop_unlock(i->mainloop);
+}
+
 static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno) {
     int ret = -1;
 
@@ -2092,7 +2341,7 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
         case SNDCTL_DSP_GETCAPS:
             debug(DEBUG_LEVEL_NORMAL, __FILE__": SNDCTL_DSP_CAPS\n");
 
-            *(int*) argp = DSP_CAP_DUPLEX | DSP_CAP_TRIGGER
+            *(int*) argp = DSP_CAP_DUPLEX | DSP_CAP_TRIGGER | DSP_CAP_MMAP
 #ifdef DSP_CAP_MULTI
               | DSP_CAP_MULTI
 #endif
@@ -2153,6 +2402,9 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
             dsp_flush_socket(i);
 
             i->optr_n_blocks = 0;
+            i->iptr_n_blocks = 0;
+            i->play_mmap_count = 0;
+            i->rec_mmap_count = 0;
 
             pa_threaded_mainloop_unlock(i->mainloop);
             break;
@@ -2193,6 +2445,21 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
 
             i->play_precork = !((*(int*) argp) & PCM_ENABLE_OUTPUT);
 
+            /* Fill the stream from the buffer before starting it. After a
+             * reset the stream of the buffer is created again. */
+            if (i->play_mmap) {
+                pa_threaded_mainloop_lock(i->mainloop);
+
+                if (i->play_stream)
+                    mmap_play(i);
+                else if (create_playback_stream(i) < 0 || mmap_stream_wait(i, &i->play_stream) < 0) {
+                    free_play_stream(i);
+                    *_errno = EIO;
+                }
+
+                pa_threaded_mainloop_unlock(i->mainloop);
+            }
+
             if (i->play_stream) {
                 if (dsp_cork(i, i->play_stream, !((*(int*) argp) & PCM_ENABLE_OUTPUT)) < 0)
                     *_errno = EIO;
@@ -2202,6 +2469,17 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
 
             i->rec_precork = !((*(int*) argp) & PCM_ENABLE_INPUT);
 
+            if (i->rec_mmap && !i->rec_stream) {
+                pa_threaded_mainloop_lock(i->mainloop);
+
+                if (create_record_stream(i) < 0 || mmap_stream_wait(i, &i->rec_stream) < 0) {
+                    free_rec_stream(i);
+                    *_errno = EIO;
+                }
+
+                pa_threaded_mainloop_unlock(i->mainloop);
+            }
+
             if (i->rec_stream) {
                 if (dsp_cork(i, i->rec_stream, !((*(int*) argp) & PCM_ENABLE_INPUT)) < 0)
                     *_errno = EIO;
@@ -2312,6 +2590,19 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
 
             pa_threaded_mainloop_lock(i->mainloop);
 
+            /* In mmap mode the position is how far the stream took data
+             * out of the buffer */
+            if (i->play_mmap) {
+                int m = (int) (i->play_mmap_count / i->fragment_size);
+
+                info->bytes = (int) i->play_mmap_count;
+                info->blocks = m - i->optr_n_blocks;
+                info->ptr = (int) (i->play_mmap_count % i->play_mmap_size);
+                i->optr_n_blocks = m;
+
+                goto exit_loop2;
+            }
+
             for (;;) {
                 pa_usec_t usec;
 
@@ -2346,9 +2637,33 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
             break;
         }
 
-        case SNDCTL_DSP_GETIPTR:
-            debug(DEBUG_LEVEL_NORMAL, __FILE__": invalid ioctl SNDCTL_DSP_GETIPTR\n");
-            goto inval;
+        case SNDCTL_DSP_GETIPTR: {
+            count_info *info;
+            int m;
+
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": SNDCTL_DSP_GETIPTR\n");
+
+            /* Only known in mmap mode */
+            if (!i->rec_mmap)
+                goto inval;
+
+            info = (count_info*) argp;
+
+            pa_threaded_mainloop_lock(i->mainloop);
+
+            m = (int) (i->rec_mmap_count / i->fragment_size);
+
+            info->bytes = (int) i->rec_mmap_count;
+            info->blocks = m - i->iptr_n_blocks;
+            info->ptr = (int) (i->rec_mmap_count % i->rec_mmap_size);
+            i->iptr_n_blocks = m;
+
+            pa_threaded_mainloop_unlock(i->mainloop);
+
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": GETIPTR bytes=%i, blocks=%i, ptr=%i\n", info->bytes, info->blocks, info->ptr);
+
+            break;
+        }
 
         case SNDCTL_DSP_SETDUPLEX:
             debug(DEBUG_LEVEL_NORMAL, __FILE__": SNDCTL_DSP_SETDUPLEX\n");
@@ -2437,6 +2752,79 @@ int close(int fd) {
     return 0;
 }
 
+static void *real_mmap(void *addr, size_t length, int prot, int flags, int fd, off64_t offset) {
+    fd_info *i;
+    void *r;
+    int _errno = 0;
+
+    if (!(i = fd_info_find(fd)))
+        return NULL;
+
+    if (i->type == FD_INFO_STREAM)
+        r = dsp_mmap(i, length, prot, offset, &_errno);
+    else {
+        r = MAP_FAILED;
+        _errno = ENODEV;
+    }
+
+    fd_info_unref(i);
+
+    if (_errno)
+        errno = _errno;
+
+    return r;
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    void *r;
+
+    debug(DEBUG_LEVEL_VERBOSE, __FILE__": mmap()\n");
+
+    if (fd < 0 || !function_enter()) {
+        LOAD_MMAP_FUNC();
+        return _mmap(addr, length, prot, flags, fd, offset);
+    }
+
+    r = real_mmap(addr, length, prot, flags, fd, offset);
+
+    function_exit();
+
+    if (!r) {
+        LOAD_MMAP_FUNC();
+        return _mmap(addr, length, prot, flags, fd, offset);
+    }
+
+    return r;
+}
+
+int munmap(void *addr, size_t length) {
+    fd_info *i;
+
+    debug(DEBUG_LEVEL_VERBOSE, __FILE__": munmap()\n");
+
+    if (function_enter()) {
+        pthread_mutex_lock(&fd_infos_mutex);
+
+        for (i = fd_infos; i; i = i->next)
+            if (addr && (i->play_mmap == addr || i->rec_mmap == addr)) {
+                fd_info_ref(i);
+                break;
+            }
+
+        pthread_mutex_unlock(&fd_infos_mutex);
+
+        if (i) {
+            dsp_munmap(i, addr);
+            fd_info_unref(i);
+        }
+
+        function_exit();
+    }
+
+    LOAD_MUNMAP_FUNC();
+    return _munmap(addr, length);
+}
+
 int access(const char *pathname, int mode) {
 
     debug(DEBUG_LEVEL_VERBOSE, __FILE__": access(%s)\n", pathname?pathname:"NULL");
@@ -2572,6 +2960,28 @@ int open64(const char *filename, int flags, ...) {
     return real_open(filename, flags, mode);
 }
 
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd, off64_t offset) {
+    void *r;
+
+    debug(DEBUG_LEVEL_VERBOSE, __FILE__": mmap64()\n");
+
+    if (fd < 0 || !function_enter()) {
+        LOAD_MMAP64_FUNC();
+        return _mmap64(addr, length, prot, flags, fd, offset);
+    }
+
+    r = real_mmap(addr, length, prot, flags, fd, offset);
+
+    function_exit();
+
+    if (!r) {
+        LOAD_MMAP64_FUNC();
+        return _mmap64(addr, length, prot, flags, fd, offset);
+    }
+
+    return r;
+}
+
 int __open64_2(const char *filename, int flags) {
     debug(DEBUG_LEVEL_VERBOSE, __FILE__": __open64_2(%s)\n", filename?filename:"NULL");
 
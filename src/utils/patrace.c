@@ -0,0 +1,259 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/i18n.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/tracepoint.h>
+
+/* How deep spans of one thread may nest for the text output */
+#define MAX_DEPTH 16
+
+typedef struct thread_state {
+    uint64_t begin_ns[MAX_DEPTH];
+    unsigned depth;
+} thread_state;
+
+static void print_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            fprintf(f, "\\u%04x", (unsigned char) *s);
+        else
+            fputc(*s, f);
+    }
+
+    fputc('"', f);
+}
+
+/* The Chrome trace event format, which chrome://tracing and Perfetto show
+ * as a timeline */
+static void write_chrome(FILE *f, const pa_tracepoint_record *r, unsigned n_records, char **names, unsigned n_threads) {
+    static const char phases[] = {
+        [PA_TRACEPOINT_BEGIN] = 'B',
+        [PA_TRACEPOINT_END] = 'E',
+        [PA_TRACEPOINT_INSTANT] = 'i',
+    };
+    uint64_t start = n_records > 0 ? r[0].time_ns : 0;
+    unsigned i;
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", f);
+
+    for (i = 0; i < n_threads; i++) {
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", i > 0 ? "," : "", i);
+        print_json_string(f, names[i]);
+        fputs("}}", f);
+    }
+
+    for (i = 0; i < n_records; i++) {
+        uint64_t t = r[i].time_ns - start;
+
+        fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"io\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%u,",
+                n_threads > 0 || i > 0 ? "," : "",
+                pa_tracepoint_id_to_string(r[i].id),
+                r[i].phase <= PA_TRACEPOINT_INSTANT ? phases[r[i].phase] : 'i',
+                (unsigned long long) (t / 1000), (unsigned) (t % 1000),
+                r[i].thread);
+
+        if (r[i].phase == PA_TRACEPOINT_INSTANT)
+            fputs("\"s\":\"t\",", f);
+
+        fprintf(f, "\"args\":{\"object\":%lld,\"arg\":%lld}}",
+                r[i].object == (uint32_t) -1 ? -1LL : (long long) r[i].object,
+                (long long) r[i].arg);
+    }
+
+    fputs("\n]}\n", f);
+}
+
+/* One line per record, with how long a span took on the line that ends
+ * it */
+static void write_text(FILE *f, const pa_tracepoint_record *r, unsigned n_records, char **names, unsigned n_threads) {
+    uint64_t start = n_records > 0 ? r[0].time_ns : 0;
+    thread_state *states;
+    unsigned i;
+
+    states = pa_xnew0(thread_state, PA_MAX(n_threads, 1U));
+
+    for (i = 0; i < n_records; i++) {
+        thread_state *s = &states[r[i].thread];
+        uint64_t t = r[i].time_ns - start;
+        char duration[32] = "";
+        const char *phase;
+
+        switch (r[i].phase) {
+            case PA_TRACEPOINT_BEGIN:
+                phase = "begin";
+                if (s->depth < MAX_DEPTH)
+                    s->begin_ns[s->depth] = r[i].time_ns;
+                s->depth++;
+                break;
+
+            case PA_TRACEPOINT_END:
+                phase = "end";
+                /* The ring may have lost the beginning */
+                if (s->depth > 0) {
+                    s->depth--;
+                    if (s->depth < MAX_DEPTH)
+                        pa_snprintf(duration, sizeof(duration), " took %0.1f us",
+                                    (double) (r[i].time_ns - s->begin_ns[s->depth]) / PA_NSEC_PER_USEC);
+                }
+                break;
+
+            default:
+                phase = "";
+                break;
+        }
+
+        fprintf(f, "%12.6f %-16s %-*s%-22s %-5s %4lld %8lld%s\n",
+                (double) t / PA_NSEC_PER_SEC,
+                names[r[i].thread],
+                (int) PA_MIN(s->depth, MAX_DEPTH) * 2 - (r[i].phase == PA_TRACEPOINT_BEGIN ? 2 : 0), "",
+                pa_tracepoint_id_to_string(r[i].id),
+                phase,
+                r[i].object == (uint32_t) -1 ? -1LL : (long long) r[i].object,
+                (long long) r[i].arg,
+                duration);
+    }
+
+    pa_xfree(states);
+}
+
+static void help(const char *argv0) {
+    printf(_("%s [options] FILE\n\n"
+             "Convert a trace written with the dump-trace-points command to a timeline.\n\n"
+             "  -h, --help                            Show this help\n"
+             "      --version                         Show version\n"
+             "  -f, --format=FORMAT                   The format to write, chrome (default) or text\n"
+             "  -o, --output=FILE                     Write to FILE instead of standard output\n"),
+           argv0);
+}
+
+enum {
+    ARG_VERSION = 256
+};
+
+int main(int argc, char *argv[]) {
+    pa_tracepoint_record *records = NULL;
+    char **names = NULL;
+    unsigned n_records = 0, n_threads = 0, i;
+    const char *output = NULL, *bn;
+    bool text = false;
+    FILE *f = stdout;
+    int c, ret = 1;
+
+    static const struct option long_options[] = {
+        {"format",      1, NULL, 'f'},
+        {"output",      1, NULL, 'o'},
+        {"version",     0, NULL, ARG_VERSION},
+        {"help",        0, NULL, 'h'},
+        {NULL,          0, NULL, 0}
+    };
+
+    setlocale(LC_ALL, "");
+#ifdef ENABLE_NLS
+    bindtextdomain(GETTEXT_PACKAGE, PULSE_LOCALEDIR);
+#endif
+
+    bn = pa_path_get_filename(argv[0]);
+
+    while ((c = getopt_long(argc, argv, "f:o:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'h':
+                help(bn);
+                return 0;
+
+            case ARG_VERSION:
+                printf(_("patrace %s\n"
+                         "Compiled with libpulse %s\n"
+                         "Linked with libpulse %s\n"),
+                       PACKAGE_VERSION,
+                       pa_get_headers_version(),
+                       pa_get_library_version());
+                return 0;
+
+            case 'f':
+                if (pa_streq(optarg, "text"))
+                    text = true;
+                else if (pa_streq(optarg, "chrome"))
+                    text = false;
+                else {
+                    fprintf(stderr, _("Invalid format '%s'.\n"), optarg);
+                    return 1;
+                }
+                break;
+
+            case 'o':
+                output = optarg;
+                break;
+
+            default:
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        help(bn);
+        return 1;
+    }
+
+    if (pa_tracepoints_load(argv[optind], &records, &n_records, &names, &n_threads) < 0)
+        return 1;
+
+    if (output && !(f = pa_fopen_cloexec(output, "w"))) {
+        fprintf(stderr, _("Failed to open '%s': %s\n"), output, pa_cstrerror(errno));
+        goto finish;
+    }
+
+    if (text)
+        write_text(f, records, n_records, names, n_threads);
+    else
+        write_chrome(f, records, n_records, names, n_threads);
+
+    if (fflush(f) != 0)
+        fprintf(stderr, _("Failed to write output: %s\n"), pa_cstrerror(errno));
+    else
+        ret = 0;
+
+    if (f != stdout)
+        fclose(f);
+
+finish:
+    for (i = 0; i < n_threads; i++)
+        pa_xfree(names[i]);
+    pa_xfree(names);
+    pa_xfree(records);
+
+    return ret;
+}